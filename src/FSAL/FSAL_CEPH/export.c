@@ -65,6 +65,8 @@ static void release(struct fsal_export *export_pub)
 	/* The private, expanded export */
 	struct export *export =
 	    container_of(export_pub, struct export, export);
+	/* Client instance */
+	uint32_t n;
 
 	deconstruct_handle(export->root);
 	export->root = 0;
@@ -72,7 +74,9 @@ static void release(struct fsal_export *export_pub)
 	fsal_detach_export(export->export.fsal, &export->export.exports);
 	free_export_ops(&export->export);
 
-	ceph_shutdown(export->cmount);
+	for (n = 0; n < export->mounts; n++)
+		ceph_shutdown(export->cmounts[n]);
+	gsh_free(export->cmounts);
 	export->cmount = NULL;
 	gsh_free(export);
 	export = NULL;
@@ -156,7 +160,7 @@ static fsal_status_t lookup_path(struct fsal_export *export_pub,
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &handle);
+	construct_handle(&stx, i, export->cmount, export, &handle);
 
 	if (attrs_out != NULL)
 		ceph2fsal_attributes(&stx, attrs_out);
@@ -226,6 +230,8 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
 	struct handle *handle = NULL;
 	/* Inode pointer */
 	struct Inode *i;
+	/* Client instance the object belongs on */
+	struct ceph_mount_info *cmount;
 
 	*pub_handle = NULL;
 
@@ -234,19 +240,20 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
 		return status;
 	}
 
-	i = ceph_ll_get_inode(export->cmount, *vi);
-	if (!i)
-		return ceph2fsal_error(-ESTALE);
+	cmount = ceph_export_mount(export, vi->ino.val);
+	rc = ceph_lookup_vino(cmount, *vi, &i);
+	if (rc < 0)
+		return ceph2fsal_error(rc);
 
 	/* The ceph_ll_connectable_m should have populated libceph's
 	   cache with all this anyway */
-	rc = fsal_ceph_ll_getattr(export->cmount, i, &stx,
+	rc = fsal_ceph_ll_getattr(cmount, i, &stx,
 		attrs_out ? CEPH_STATX_ATTR_MASK : CEPH_STATX_HANDLE_MASK,
 		op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &handle);
+	construct_handle(&stx, i, cmount, export, &handle);
 
 	if (attrs_out != NULL)
 		ceph2fsal_attributes(&stx, attrs_out);
@@ -279,7 +286,7 @@ static fsal_status_t get_fs_dynamic_info(struct fsal_export *export_pub,
 	/* Filesystem stat */
 	struct statvfs vfs_st;
 
-	rc = ceph_ll_statfs(export->cmount, export->root->i, &vfs_st);
+	rc = ceph_ll_statfs(export->root->cmount, export->root->i, &vfs_st);
 
 	if (rc < 0)
 		return ceph2fsal_error(rc);
@@ -36,6 +36,8 @@
 #include <sys/sysmacros.h> /* for makedev(3) */
 #endif
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <linux/falloc.h>
 #include <cephfs/libcephfs.h>
 #include "fsal.h"
 #include "fsal_types.h"
@@ -94,12 +96,12 @@ static fsal_status_t lookup(struct fsal_obj_handle *dir_pub,
 
 	LogFullDebug(COMPONENT_FSAL, "Lookup %s", path);
 
-	rc = fsal_ceph_ll_lookup(export->cmount, dir->i, path, &i, &stx,
+	rc = fsal_ceph_ll_lookup(dir->cmount, dir->i, path, &i, &stx,
 					!!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	if (attrs_out != NULL)
 		ceph2fsal_attributes(&stx, attrs_out);
@@ -147,7 +149,7 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 	/* Return status */
 	fsal_status_t fsal_status = { ERR_FSAL_NO_ERROR, 0 };
 
-	rc = fsal_ceph_ll_opendir(export->cmount, dir->i, &dir_desc,
+	rc = fsal_ceph_ll_opendir(dir->cmount, dir->i, &dir_desc,
 				  op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
@@ -155,14 +157,14 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 	if (whence != NULL)
 		start = *whence;
 
-	ceph_seekdir(export->cmount, dir_desc, start);
+	ceph_seekdir(dir->cmount, dir_desc, start);
 
 	while (!(*eof)) {
 		struct ceph_statx stx;
 		struct dirent de;
 		struct Inode *i = NULL;
 
-		rc = fsal_ceph_readdirplus(export->cmount, dir_desc, dir->i,
+		rc = fsal_ceph_readdirplus(dir->cmount, dir_desc, dir->i,
 					   &de, &stx, want, 0, &i,
 					   op_ctx->creds);
 		if (rc < 0) {
@@ -179,7 +181,7 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 				continue;
 			}
 
-			construct_handle(&stx, i, export, &obj);
+			construct_handle(&stx, i, dir->cmount, export, &obj);
 
 			fsal_prepare_attrs(&attrs, attrmask);
 			ceph2fsal_attributes(&stx, &attrs);
@@ -202,7 +204,7 @@ static fsal_status_t ceph_fsal_readdir(struct fsal_obj_handle *dir_pub,
 
  closedir:
 
-	rc = ceph_ll_releasedir(export->cmount, dir_desc);
+	rc = ceph_ll_releasedir(dir->cmount, dir_desc);
 
 	if (rc < 0)
 		fsal_status = ceph2fsal_error(rc);
@@ -257,12 +259,12 @@ static fsal_status_t ceph_fsal_mkdir(struct fsal_obj_handle *dir_hdl,
 	unix_mode = fsal2unix_mode(attrib->mode)
 		& ~op_ctx->fsal_export->exp_ops.fs_umask(op_ctx->fsal_export);
 
-	rc = fsal_ceph_ll_mkdir(export->cmount, dir->i, name, unix_mode, &i,
+	rc = fsal_ceph_ll_mkdir(dir->cmount, dir->i, name, unix_mode, &i,
 			&stx, !!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	*new_obj = &obj->handle;
 
@@ -274,7 +276,7 @@ static fsal_status_t ceph_fsal_mkdir(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*new_obj)->obj_ops.setattr2(*new_obj, false, NULL,
-						      attrib);
+						      attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -370,12 +372,12 @@ static fsal_status_t ceph_fsal_mknode(struct fsal_obj_handle *dir_hdl,
 		return fsalstat(ERR_FSAL_INVAL, EINVAL);
 	}
 
-	rc = fsal_ceph_ll_mknod(export->cmount, dir->i, name, unix_mode,
+	rc = fsal_ceph_ll_mknod(dir->cmount, dir->i, name, unix_mode,
 			unix_dev, &i, &stx, !!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	*new_obj = &obj->handle;
 
@@ -387,7 +389,7 @@ static fsal_status_t ceph_fsal_mknode(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*new_obj)->obj_ops.setattr2(*new_obj, false, NULL,
-						      attrib);
+						      attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -456,12 +458,12 @@ static fsal_status_t ceph_fsal_symlink(struct fsal_obj_handle *dir_hdl,
 	struct handle *obj = NULL;
 	fsal_status_t status;
 
-	rc = fsal_ceph_ll_symlink(export->cmount, dir->i, name, link_path,
+	rc = fsal_ceph_ll_symlink(dir->cmount, dir->i, name, link_path,
 			      &i, &stx, !!attrs_out, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
-	construct_handle(&stx, i, export, &obj);
+	construct_handle(&stx, i, dir->cmount, export, &obj);
 
 	*new_obj = &obj->handle;
 
@@ -473,7 +475,7 @@ static fsal_status_t ceph_fsal_symlink(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*new_obj)->obj_ops.setattr2(*new_obj, false, NULL,
-						      attrib);
+						      attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -519,15 +521,12 @@ static fsal_status_t ceph_fsal_readlink(struct fsal_obj_handle *link_pub,
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' directory handle */
 	struct handle *link = container_of(link_pub, struct handle, handle);
 	/* Pointer to the Ceph link content */
 	char content[PATH_MAX];
 
-	rc = fsal_ceph_ll_readlink(export->cmount, link->i, content,
+	rc = fsal_ceph_ll_readlink(link->cmount, link->i, content,
 				   PATH_MAX, op_ctx->creds);
 	if (rc < 0)
 		return ceph2fsal_error(rc);
@@ -557,16 +556,15 @@ static fsal_status_t getattrs(struct fsal_obj_handle *handle_pub,
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' directory handle */
 	struct handle *handle = container_of(handle_pub, struct handle, handle);
 	/* Stat buffer */
 	struct ceph_statx stx;
+	/* Only what was asked for, sparing caps not otherwise needed */
+	unsigned int want = attrmask2ceph_want(attrs->request_mask);
 
-	rc = fsal_ceph_ll_getattr(export->cmount, handle->i, &stx,
-				CEPH_STATX_ATTR_MASK, op_ctx->creds);
+	rc = fsal_ceph_ll_getattr(handle->cmount, handle->i, &stx, want,
+				  op_ctx->creds);
 	LogDebug(COMPONENT_FSAL, "getattr returned %d", rc);
 	if (rc < 0) {
 		if (attrs->request_mask & ATTR_RDATTR_ERR) {
@@ -596,21 +594,32 @@ static fsal_status_t getattrs(struct fsal_obj_handle *handle_pub,
 
 static fsal_status_t ceph_fsal_link(struct fsal_obj_handle *handle_pub,
 			       struct fsal_obj_handle *destdir_pub,
-			       const char *name)
+			       const char *name,
+			       struct attrlist *destdir_attrs_out)
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' object handle */
 	struct handle *handle = container_of(handle_pub, struct handle, handle);
 	/* The private 'full' destination directory handle */
 	struct handle *destdir =
 	    container_of(destdir_pub, struct handle, handle);
 
-	rc = fsal_ceph_ll_link(export->cmount, handle->i, destdir->i, name,
+	/* Inode of destdir on the client instance of handle */
+	struct Inode *dest_i = destdir->i;
+
+	if (destdir->cmount != handle->cmount) {
+		rc = ceph_lookup_vino(handle->cmount, destdir->vi, &dest_i);
+		if (rc < 0)
+			return ceph2fsal_error(rc);
+	}
+
+	rc = fsal_ceph_ll_link(handle->cmount, handle->i, dest_i, name,
 				op_ctx->creds);
+
+	if (dest_i != destdir->i)
+		ceph_ll_put(handle->cmount, dest_i);
+
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -635,20 +644,32 @@ static fsal_status_t ceph_fsal_rename(struct fsal_obj_handle *obj_hdl,
 				 struct fsal_obj_handle *olddir_pub,
 				 const char *old_name,
 				 struct fsal_obj_handle *newdir_pub,
-				 const char *new_name)
+				 const char *new_name,
+				 struct attrlist *olddir_attrs_out,
+				 struct attrlist *newdir_attrs_out)
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' object handle */
 	struct handle *olddir = container_of(olddir_pub, struct handle, handle);
 	/* The private 'full' destination directory handle */
 	struct handle *newdir = container_of(newdir_pub, struct handle, handle);
 
-	rc = fsal_ceph_ll_rename(export->cmount, olddir->i, old_name,
-					newdir->i, new_name, op_ctx->creds);
+	/* Inode of newdir on the client instance of olddir */
+	struct Inode *new_i = newdir->i;
+
+	if (newdir->cmount != olddir->cmount) {
+		rc = ceph_lookup_vino(olddir->cmount, newdir->vi, &new_i);
+		if (rc < 0)
+			return ceph2fsal_error(rc);
+	}
+
+	rc = fsal_ceph_ll_rename(olddir->cmount, olddir->i, old_name,
+					new_i, new_name, op_ctx->creds);
+
+	if (new_i != newdir->i)
+		ceph_ll_put(olddir->cmount, new_i);
+
 	if (rc < 0)
 		return ceph2fsal_error(rc);
 
@@ -670,13 +691,11 @@ static fsal_status_t ceph_fsal_rename(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t ceph_fsal_unlink(struct fsal_obj_handle *dir_pub,
 				      struct fsal_obj_handle *obj_pub,
-				      const char *name)
+				      const char *name,
+				      struct attrlist *parent_attrs_out)
 {
 	/* Generic status return */
 	int rc = 0;
-	/* The private 'full' export */
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* The private 'full' object handle */
 	struct handle *dir = container_of(dir_pub, struct handle, handle);
 
@@ -685,10 +704,10 @@ static fsal_status_t ceph_fsal_unlink(struct fsal_obj_handle *dir_pub,
 		     name, object_file_type_to_str(obj_pub->type));
 
 	if (obj_pub->type != DIRECTORY) {
-		rc = fsal_ceph_ll_unlink(export->cmount, dir->i, name,
+		rc = fsal_ceph_ll_unlink(dir->cmount, dir->i, name,
 					op_ctx->creds);
 	} else {
-		rc = fsal_ceph_ll_rmdir(export->cmount, dir->i, name,
+		rc = fsal_ceph_ll_rmdir(dir->cmount, dir->i, name,
 					op_ctx->creds);
 	}
 
@@ -719,8 +738,6 @@ fsal_status_t ceph_open_my_fd(struct handle *myself,
 			      struct ceph_fd *my_fd)
 {
 	int rc;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	LogFullDebug(COMPONENT_FSAL,
 		     "my_fd = %p my_fd->fd = %p openflags = %x, posix_flags = %x",
@@ -733,7 +750,7 @@ fsal_status_t ceph_open_my_fd(struct handle *myself,
 		     "openflags = %x, posix_flags = %x",
 		     openflags, posix_flags);
 
-	rc = fsal_ceph_ll_open(export->cmount, myself->i, posix_flags,
+	rc = fsal_ceph_ll_open(myself->cmount, myself->i, posix_flags,
 				&my_fd->fd, op_ctx->creds);
 
 	if (rc < 0) {
@@ -756,13 +773,27 @@ fsal_status_t ceph_open_my_fd(struct handle *myself,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+/* Protects the io_inflight of all the ceph_fds */
+static pthread_mutex_t ceph_io_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ceph_io_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
 fsal_status_t ceph_close_my_fd(struct handle *handle, struct ceph_fd *my_fd)
 {
 	int rc = 0;
 	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
 
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+	/* A nonblocking read or write may still hold the fd */
+	PTHREAD_MUTEX_lock(&ceph_io_mutex);
+	while (my_fd->io_inflight != 0)
+		pthread_cond_wait(&ceph_io_cond, &ceph_io_mutex);
+	PTHREAD_MUTEX_unlock(&ceph_io_mutex);
+#endif
+
 	if (my_fd->fd != NULL && my_fd->openflags != FSAL_O_CLOSED) {
-		rc = ceph_ll_close(handle->export->cmount, my_fd->fd);
+		rc = ceph_ll_close(handle->cmount, my_fd->fd);
 		if (rc < 0)
 			status = ceph2fsal_error(rc);
 		my_fd->fd = NULL;
@@ -1062,7 +1093,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 
 		if (createmode >= FSAL_EXCLUSIVE || truncated) {
 			/* Refresh the attributes */
-			retval = fsal_ceph_ll_getattr(export->cmount,
+			retval = fsal_ceph_ll_getattr(myself->cmount,
 					myself->i, &stx, !!attrs_out,
 					op_ctx->creds);
 
@@ -1199,7 +1230,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 		posix_flags |= O_EXCL;
 	}
 
-	retval = fsal_ceph_ll_create(export->cmount,  myself->i, name,
+	retval = fsal_ceph_ll_create(myself->cmount,  myself->i, name,
 				unix_mode, posix_flags, &i, &fd, &stx,
 				!!attrs_out, op_ctx->creds);
 
@@ -1221,7 +1252,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 		 * the condition of not wanting to set attributes.
 		 */
 		posix_flags &= ~O_EXCL;
-		retval = fsal_ceph_ll_create(export->cmount,  myself->i,
+		retval = fsal_ceph_ll_create(myself->cmount,  myself->i,
 				name, unix_mode, posix_flags, &i, &fd,
 				&stx, !!attrs_out, op_ctx->creds);
 		if (retval < 0) {
@@ -1257,7 +1288,28 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 	 */
 	*caller_perm_check = false;
 
-	construct_handle(&stx, i, export, &hdl);
+	construct_handle(&stx, i, myself->cmount, export, &hdl);
+
+	if (hdl->cmount != myself->cmount) {
+		/* The fd must come from the client instance of the inode.
+		 * The create checked the caller's access, and a new file
+		 * may not grant the open mode, so reopen as root.
+		 */
+		struct user_cred root_creds = {0};
+
+		(void) ceph_ll_close(myself->cmount, fd);
+		retval = fsal_ceph_ll_open(hdl->cmount, hdl->i,
+					   posix_flags &
+					   ~(O_CREAT | O_EXCL | O_TRUNC),
+					   &fd, &root_creds);
+		if (retval < 0) {
+			hdl->handle.obj_ops.release(&hdl->handle);
+			if (created)
+				fsal_ceph_ll_unlink(myself->cmount, myself->i,
+						    name, op_ctx->creds);
+			return ceph2fsal_error(retval);
+		}
+	}
 
 	/* If we didn't have a state above, use the global fd. At this point,
 	 * since we just created the global fd, no one else can have a
@@ -1284,7 +1336,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 		status = (*new_obj)->obj_ops.setattr2(*new_obj,
 						      false,
 						      state,
-						      attrib_set);
+						      attrib_set, NULL);
 
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
@@ -1338,7 +1390,7 @@ fsal_status_t ceph_open2(struct fsal_obj_handle *obj_hdl,
 
 	if (created) {
 		/* Remove the file we just created */
-		fsal_ceph_ll_unlink(export->cmount, myself->i, name,
+		fsal_ceph_ll_unlink(myself->cmount, myself->i, name,
 					op_ctx->creds);
 	}
 
@@ -1446,6 +1498,32 @@ fsal_status_t ceph_reopen2(struct fsal_obj_handle *obj_hdl,
  * We do not need file descriptors for non-regular files, so this never has to
  * handle them.
  */
+static fsal_status_t ceph_find_my_fd(struct ceph_fd **out_fd,
+				     struct fsal_obj_handle *obj_hdl,
+				     bool bypass,
+				     struct state_t *state,
+				     fsal_openflags_t openflags,
+				     bool *has_lock,
+				     bool *closefd,
+				     bool open_for_locks)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	fsal_status_t status;
+
+	status = fsal_find_fd((struct fsal_fd **)out_fd, obj_hdl,
+			      (struct fsal_fd *)&myself->fd, &myself->share,
+			      bypass, state, openflags,
+			      ceph_open_func, ceph_close_func,
+			      has_lock, closefd, open_for_locks);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "fd = %p", (*out_fd)->fd);
+	return status;
+}
+
+/**
+ * @brief As ceph_find_my_fd(), returning only the cephfs file handle
+ */
 fsal_status_t ceph_find_fd(Fh **fd,
 			   struct fsal_obj_handle *obj_hdl,
 			   bool bypass,
@@ -1455,22 +1533,97 @@ fsal_status_t ceph_find_fd(Fh **fd,
 			   bool *closefd,
 			   bool open_for_locks)
 {
-	struct handle *myself = container_of(obj_hdl, struct handle, handle);
 	struct ceph_fd temp_fd = {0, NULL}, *out_fd = &temp_fd;
-	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
-
-	status = fsal_find_fd((struct fsal_fd **)&out_fd, obj_hdl,
-			      (struct fsal_fd *)&myself->fd, &myself->share,
-			      bypass, state, openflags,
-			      ceph_open_func, ceph_close_func,
-			      has_lock, closefd, open_for_locks);
+	fsal_status_t status;
 
-	LogFullDebug(COMPONENT_FSAL,
-		     "fd = %p", out_fd->fd);
+	status = ceph_find_my_fd(&out_fd, obj_hdl, bypass, state, openflags,
+				 has_lock, closefd, open_for_locks);
 	*fd = out_fd->fd;
 	return status;
 }
 
+/**
+ * @brief Read data from a file into a scatter list
+ *
+ * libcephfs has no vectored low-level read, so the segments are filled
+ * one ceph_ll_read() at a time under a single file descriptor.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in]     iov_count      Number of segments in @a iov
+ * @param[in,out] iov            Segments to which data are to be copied
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t ceph_readv2(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  int iov_count,
+			  struct iovec *iov,
+			  size_t *read_amount,
+			  bool *end_of_file,
+			  struct io_info *info)
+{
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
+	Fh *my_fd = NULL;
+	ssize_t nb_read;
+	size_t total = 0;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	int i;
+
+	if (info != NULL) {
+		/* Currently we don't support READ_PLUS */
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	/* Get a usable file descriptor */
+	status = ceph_find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_READ,
+			      &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	for (i = 0; i < iov_count; i++) {
+		nb_read = ceph_ll_read(myself->cmount, my_fd, offset + total,
+				       iov[i].iov_len, iov[i].iov_base);
+
+		if (nb_read < 0) {
+			status = ceph2fsal_error(nb_read);
+			goto out;
+		}
+
+		total += nb_read;
+
+		/* A short read means we hit end of file */
+		if (nb_read < iov[i].iov_len)
+			break;
+	}
+
+	*read_amount = total;
+
+	*end_of_file = total == 0;
+
+ out:
+
+	if (closefd)
+		(void) ceph_ll_close(myself->cmount, my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
 /**
  * @brief Read data from a file
  *
@@ -1501,64 +1654,127 @@ fsal_status_t ceph_read2(struct fsal_obj_handle *obj_hdl,
 			size_t *read_amount,
 			bool *end_of_file,
 			struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return ceph_readv2(obj_hdl, bypass, state, offset, 1, &iov,
+			   read_amount, end_of_file, info);
+}
+
+/**
+ * @brief Write data to a file from a gather list
+ *
+ * As ceph_readv2(), the segments are written one ceph_ll_write() at a
+ * time under a single file descriptor.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position at which to write
+ * @param[in]     iov_count      Number of segments in @a iov
+ * @param[in]     iov            Data to be written
+ * @param[out]    wrote_amount   Amount of data written
+ * @param[in,out] fsal_stable    In, if on, the fsal is requested to write data
+ *                               to stable store. Out, the fsal reports what
+ *                               it did.
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t ceph_writev2(struct fsal_obj_handle *obj_hdl,
+			   bool bypass,
+			   struct state_t *state,
+			   uint64_t offset,
+			   int iov_count,
+			   struct iovec *iov,
+			   size_t *wrote_amount,
+			   bool *fsal_stable,
+			   struct io_info *info)
 {
 	struct handle *myself = container_of(obj_hdl, struct handle, handle);
-	Fh *my_fd = NULL;
-	ssize_t nb_read;
+	ssize_t nb_written;
+	size_t total = 0;
 	fsal_status_t status;
+	int retval = 0;
+	Fh *my_fd = NULL;
 	bool has_lock = false;
 	bool closefd = false;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
+	int i;
+	fsal_openflags_t openflags = FSAL_O_WRITE;
+	bool space = info != NULL &&
+		     info->io_content.what != NFS4_CONTENT_DATA;
 
-	if (info != NULL) {
-		/* Currently we don't support READ_PLUS */
+	/* ALLOCATE and DEALLOCATE, but not WRITE_PLUS holes */
+	if (info != NULL && info->io_content.what != NFS4_CONTENT_DATA &&
+	    info->io_content.what != NFS4_CONTENT_ALLOCATE &&
+	    info->io_content.what != NFS4_CONTENT_DEALLOCATE)
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
-	}
 
 	/* Get a usable file descriptor */
-	status = ceph_find_fd(&my_fd, obj_hdl, bypass, state, FSAL_O_READ,
+	status = ceph_find_fd(&my_fd, obj_hdl, bypass, state, openflags,
 			      &has_lock, &closefd, false);
 
-	if (FSAL_IS_ERROR(status))
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
 		goto out;
+	}
 
-	nb_read =
-	    ceph_ll_read(export->cmount, my_fd, offset, buffer_size, buffer);
+	fsal_set_credentials(op_ctx->creds);
 
-	if (offset == -1 || nb_read < 0) {
-		status = ceph2fsal_error(nb_read);
-		goto out;
+	if (space) {
+		retval = ceph_ll_fallocate(myself->cmount, my_fd,
+				info->io_content.what ==
+					NFS4_CONTENT_DEALLOCATE ?
+				FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE : 0,
+				info->io_content.hole.di_offset,
+				info->io_content.hole.di_length);
+		if (retval < 0) {
+			status = ceph2fsal_error(retval);
+			goto out;
+		}
+		total = info->io_content.hole.di_length;
 	}
 
-	*read_amount = nb_read;
+	for (i = 0; !space && i < iov_count; i++) {
+		nb_written = ceph_ll_write(myself->cmount, my_fd,
+					   offset + total, iov[i].iov_len,
+					   iov[i].iov_base);
 
-	*end_of_file = nb_read == 0;
+		if (nb_written < 0) {
+			status = ceph2fsal_error(nb_written);
+			goto out;
+		}
 
-#if 0
-	/** @todo
-	 *
-	 * Is this all we really need to do to support READ_PLUS? Will anyone
-	 * ever get upset that we don't return holes, even for blocks of all
-	 * zeroes?
-	 *
-	 */
-	if (info != NULL) {
-		info->io_content.what = NFS4_CONTENT_DATA;
-		info->io_content.data.d_offset = offset + nb_read;
-		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
+		total += nb_written;
+
+		if (nb_written < iov[i].iov_len)
+			break;
+	}
+
+	*wrote_amount = total;
+
+	if (*fsal_stable) {
+		retval = ceph_ll_fsync(myself->cmount, my_fd, false);
+
+		if (retval < 0)
+			status = ceph2fsal_error(retval);
 	}
-#endif
 
  out:
 
 	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, my_fd);
+		(void) ceph_ll_close(myself->cmount, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
+	fsal_restore_ganesha_credentials();
 	return status;
 }
 
@@ -1596,62 +1812,240 @@ fsal_status_t ceph_write2(struct fsal_obj_handle *obj_hdl,
 			 size_t *wrote_amount,
 			 bool *fsal_stable,
 			 struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return ceph_writev2(obj_hdl, bypass, state, offset, 1, &iov,
+			    wrote_amount, fsal_stable, info);
+}
+
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+/**
+ * @brief A nonblocking read or write in flight
+ */
+struct ceph_async_io {
+	struct ceph_ll_io_info io_info;	/*< Submitted to libcephfs */
+	struct iovec iov;
+	struct fsal_obj_handle *obj_hdl;
+	struct ceph_fd *my_fd;		/*< Pinned until completion */
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+};
+
+/**
+ * @brief Completion of a nonblocking read or write
+ *
+ * Called by libcephfs from its finisher thread.
+ */
+static void ceph_async_io_done(struct ceph_ll_io_info *io_info)
+{
+	struct ceph_async_io *aio = io_info->priv;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	PTHREAD_MUTEX_lock(&ceph_io_mutex);
+	if (--aio->my_fd->io_inflight == 0)
+		pthread_cond_broadcast(&ceph_io_cond);
+	PTHREAD_MUTEX_unlock(&ceph_io_mutex);
+
+	if (io_info->result < 0) {
+		status = ceph2fsal_error(io_info->result);
+	} else {
+		aio->io_arg->io_amount = io_info->result;
+		if (!io_info->write)
+			aio->io_arg->end_of_file = io_info->result == 0;
+	}
+
+	aio->done_cb(aio->obj_hdl, status, aio->io_arg, aio->caller_arg);
+	gsh_free(aio);
+}
+
+/**
+ * @brief Submit a nonblocking read or write
+ *
+ * The fd is pinned before the submission, the caller may drop the
+ * obj_lock as soon as this returns.
+ *
+ * @return true if submitted, false if completed with an error.
+ */
+static bool ceph_async_io_submit(struct fsal_obj_handle *obj_hdl,
+				 struct ceph_fd *my_fd, bool write,
+				 fsal_async_cb done_cb,
+				 struct fsal_io_arg *io_arg,
+				 void *caller_arg)
 {
 	struct handle *myself = container_of(obj_hdl, struct handle, handle);
-	ssize_t nb_written;
+	struct ceph_async_io *aio = gsh_calloc(1, sizeof(*aio));
+	int64_t rc;
+
+	aio->iov.iov_base = io_arg->buffer;
+	aio->iov.iov_len = io_arg->buffer_size;
+	aio->obj_hdl = obj_hdl;
+	aio->my_fd = my_fd;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+
+	aio->io_info.callback = ceph_async_io_done;
+	aio->io_info.priv = aio;
+	aio->io_info.fh = my_fd->fd;
+	aio->io_info.iov = &aio->iov;
+	aio->io_info.iovcnt = 1;
+	aio->io_info.off = io_arg->offset;
+	aio->io_info.write = write;
+	aio->io_info.fsync = write && io_arg->fsal_stable;
+	aio->io_info.syncdataonly = false;
+
+	PTHREAD_MUTEX_lock(&ceph_io_mutex);
+	my_fd->io_inflight++;
+	PTHREAD_MUTEX_unlock(&ceph_io_mutex);
+
+	rc = ceph_ll_nonblocking_readv_writev(myself->cmount, &aio->io_info);
+
+	if (rc >= 0)
+		return true;
+
+	/* Not submitted, the callback will not run */
+	PTHREAD_MUTEX_lock(&ceph_io_mutex);
+	if (--my_fd->io_inflight == 0)
+		pthread_cond_broadcast(&ceph_io_cond);
+	PTHREAD_MUTEX_unlock(&ceph_io_mutex);
+
+	gsh_free(aio);
+	done_cb(obj_hdl, ceph2fsal_error(rc), io_arg, caller_arg);
+	return false;
+}
+#endif
+
+/**
+ * @brief Start an asynchronous read
+ *
+ * With a libcephfs that has ceph_ll_nonblocking_readv_writev(), the read
+ * is handed to libcephfs and the worker thread is let go; the completion
+ * comes on the libcephfs finisher thread.  Otherwise, for READ_PLUS, or
+ * when no open fd can be pinned, fall back to ceph_read2() and complete
+ * inline.
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share reservation,
+ *                            bypass any deny read
+ * @param[in]     done_cb     Completion callback
+ * @param[in,out] read_arg    Read arguments and results
+ * @param[in]     caller_arg  Argument for done_cb
+ */
+
+static void ceph_read2_async(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     fsal_async_cb done_cb,
+			     struct fsal_io_arg *read_arg,
+			     void *caller_arg)
+{
 	fsal_status_t status;
-	int retval = 0;
-	Fh *my_fd = NULL;
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+	struct ceph_fd temp_fd = {0, NULL}, *my_fd = &temp_fd;
 	bool has_lock = false;
 	bool closefd = false;
-	fsal_openflags_t openflags = FSAL_O_WRITE;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
 
-	if (info != NULL) {
-		/* Currently we don't support WRITE_PLUS */
-		return fsalstat(ERR_FSAL_NOTSUPP, 0);
-	}
+	if (read_arg->info != NULL)
+		goto sync;
 
-	/* Get a usable file descriptor */
-	status = ceph_find_fd(&my_fd, obj_hdl, bypass, state, openflags,
-			      &has_lock, &closefd, false);
+	status = ceph_find_my_fd(&my_fd, obj_hdl, bypass, read_arg->state,
+				 FSAL_O_READ, &has_lock, &closefd, false);
 
 	if (FSAL_IS_ERROR(status)) {
-		LogDebug(COMPONENT_FSAL,
-			 "find_fd failed %s", msg_fsal_err(status.major));
-		goto out;
+		done_cb(obj_hdl, status, read_arg, caller_arg);
+		return;
 	}
 
-	fsal_set_credentials(op_ctx->creds);
+	if (!closefd)
+		(void) ceph_async_io_submit(obj_hdl, my_fd, false,
+					    done_cb, read_arg, caller_arg);
+	else
+		(void) ceph_ll_close(myself->cmount, my_fd->fd);
 
-	nb_written =
-	    ceph_ll_write(export->cmount, my_fd, offset, buffer_size, buffer);
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
-	if (nb_written < 0) {
-		status = ceph2fsal_error(nb_written);
-		goto out;
-	}
+	if (!closefd)
+		return;
 
-	*wrote_amount = nb_written;
+ sync:
+	/* A temporary fd would have to outlive the call, go synchronous */
+#endif
+	status = ceph_read2(obj_hdl, bypass, read_arg->state,
+			    read_arg->offset, read_arg->buffer_size,
+			    read_arg->buffer, &read_arg->io_amount,
+			    &read_arg->end_of_file, read_arg->info);
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
 
-	if (*fsal_stable) {
-		retval = ceph_ll_fsync(export->cmount, my_fd, false);
+/**
+ * @brief Start an asynchronous write
+ *
+ * As ceph_read2_async(), a stable write has libcephfs fsync the file
+ * before completing.
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share reservation,
+ *                            bypass any non-mandatory deny write
+ * @param[in]     done_cb     Completion callback
+ * @param[in,out] write_arg   Write arguments and results
+ * @param[in]     caller_arg  Argument for done_cb
+ */
 
-		if (retval < 0)
-			status = ceph2fsal_error(retval);
-	}
+static void ceph_write2_async(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      fsal_async_cb done_cb,
+			      struct fsal_io_arg *write_arg,
+			      void *caller_arg)
+{
+	fsal_status_t status;
+#ifdef USE_FSAL_CEPH_LL_NONBLOCKING_RW
+	struct ceph_fd temp_fd = {0, NULL}, *my_fd = &temp_fd;
+	bool has_lock = false;
+	bool closefd = false;
+	struct handle *myself = container_of(obj_hdl, struct handle, handle);
 
- out:
+	if (write_arg->info != NULL)
+		goto sync;
 
-	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, my_fd);
+	status = ceph_find_my_fd(&my_fd, obj_hdl, bypass, write_arg->state,
+				 FSAL_O_WRITE, &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		done_cb(obj_hdl, status, write_arg, caller_arg);
+		return;
+	}
+
+	if (!closefd) {
+		/* libcephfs picks up the credentials at submission */
+		fsal_set_credentials(op_ctx->creds);
+		(void) ceph_async_io_submit(obj_hdl, my_fd, true,
+					    done_cb, write_arg, caller_arg);
+		fsal_restore_ganesha_credentials();
+	} else {
+		(void) ceph_ll_close(myself->cmount, my_fd->fd);
+	}
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
-	fsal_restore_ganesha_credentials();
-	return status;
+	if (!closefd)
+		return;
+
+ sync:
+#endif
+	status = ceph_write2(obj_hdl, bypass, write_arg->state,
+			     write_arg->offset, write_arg->buffer_size,
+			     write_arg->buffer, &write_arg->io_amount,
+			     &write_arg->fsal_stable, write_arg->info);
+	done_cb(obj_hdl, status, write_arg, caller_arg);
 }
 
 /**
@@ -1681,8 +2075,6 @@ fsal_status_t ceph_commit2(struct fsal_obj_handle *obj_hdl,
 	struct ceph_fd temp_fd = {0, NULL}, *out_fd = &temp_fd;
 	bool has_lock = false;
 	bool closefd = false;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	/* Make sure file is open in appropriate mode.
 	 * Do not check share reservation.
@@ -1694,14 +2086,14 @@ fsal_status_t ceph_commit2(struct fsal_obj_handle *obj_hdl,
 				 &closefd);
 
 	if (!FSAL_IS_ERROR(status)) {
-		retval = ceph_ll_fsync(export->cmount, out_fd->fd, false);
+		retval = ceph_ll_fsync(myself->cmount, out_fd->fd, false);
 
 		if (retval < 0)
 			status = ceph2fsal_error(retval);
 	}
 
 	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, out_fd->fd);
+		(void) ceph_ll_close(myself->cmount, out_fd->fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1747,8 +2139,6 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
 	bool closefd = false;
 	bool bypass = false;
 	fsal_openflags_t openflags = FSAL_O_RDWR;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 
 	LogFullDebug(COMPONENT_FSAL,
 		     "Locking: op:%d type:%d start:%" PRIu64 " length:%"
@@ -1819,10 +2209,10 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
 	}
 
 	if (lock_op == FSAL_OP_LOCKT) {
-		retval = ceph_ll_getlk(export->cmount, my_fd, &lock_args,
+		retval = ceph_ll_getlk(myself->cmount, my_fd, &lock_args,
 				       (uint64_t) owner);
 	} else {
-		retval = ceph_ll_setlk(export->cmount, my_fd, &lock_args,
+		retval = ceph_ll_setlk(myself->cmount, my_fd, &lock_args,
 				       (uint64_t) owner, false);
 	}
 
@@ -1835,7 +2225,7 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
 
 		if (conflicting_lock != NULL) {
 			/* Get the conflicting lock */
-			retval = ceph_ll_getlk(export->cmount, my_fd,
+			retval = ceph_ll_getlk(myself->cmount, my_fd,
 					       &lock_args, (uint64_t) owner);
 
 			if (retval < 0) {
@@ -1874,7 +2264,7 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
  err:
 
 	if (closefd)
-		(void) ceph_ll_close(myself->export->cmount, my_fd);
+		(void) ceph_ll_close(myself->cmount, my_fd);
 
 	if (has_lock)
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
@@ -1899,19 +2289,20 @@ fsal_status_t ceph_lock_op2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t ceph_setattr2(struct fsal_obj_handle *obj_hdl,
 			    bool bypass,
 			    struct state_t *state,
-			    struct attrlist *attrib_set)
+			    struct attrlist *attrib_set,
+			    struct attrlist *attrs_out)
 {
 	struct handle *myself = container_of(obj_hdl, struct handle, handle);
 	fsal_status_t status = {0, 0};
 	int rc = 0;
 	bool has_lock = false;
 	bool closefd = false;
-	struct export *export =
-	    container_of(op_ctx->fsal_export, struct export, export);
 	/* Stat buffer */
 	struct ceph_statx stx;
 	/* Mask of attributes to set */
 	uint32_t mask = 0;
+	/* Attributes wanted back */
+	unsigned int want;
 
 	if (attrib_set->valid_mask & ~settable_attributes) {
 		LogDebug(COMPONENT_FSAL,
@@ -2030,7 +2421,7 @@ fsal_status_t ceph_setattr2(struct fsal_obj_handle *obj_hdl,
 	}
 #endif
 
-	rc = fsal_ceph_ll_setattr(export->cmount, myself->i, &stx, mask,
+	rc = fsal_ceph_ll_setattr(myself->cmount, myself->i, &stx, mask,
 					op_ctx->creds);
 	if (rc < 0) {
 		LogDebug(COMPONENT_FSAL,
@@ -2040,6 +2431,12 @@ fsal_status_t ceph_setattr2(struct fsal_obj_handle *obj_hdl,
 	} else {
 		/* Success */
 		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+		/* libcephfs hands back the attributes its caps cover */
+		want = attrs_out != NULL ?
+		       attrmask2ceph_want(attrs_out->request_mask) : 0;
+		if (attrs_out != NULL && (stx.stx_mask & want) == want)
+			ceph2fsal_attributes(&stx, attrs_out);
 	}
 
  out:
@@ -2182,6 +2579,10 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = ceph_reopen2;
 	ops->read2 = ceph_read2;
 	ops->write2 = ceph_write2;
+	ops->read2_async = ceph_read2_async;
+	ops->write2_async = ceph_write2_async;
+	ops->readv2 = ceph_readv2;
+	ops->writev2 = ceph_writev2;
 	ops->commit2 = ceph_commit2;
 #ifdef USE_FSAL_CEPH_SETLK
 	ops->lock_op2 = ceph_lock_op2;
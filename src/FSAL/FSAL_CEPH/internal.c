@@ -36,6 +36,7 @@
  * exposed as part of the API.
  */
 
+#include <errno.h>
 #include <sys/stat.h>
 #include <cephfs/libcephfs.h>
 #include "fsal_types.h"
@@ -66,6 +67,33 @@ const attrmask_t settable_attributes = (
 	ATTR_CTIME | ATTR_MTIME | ATTR_SIZE  | ATTR_MTIME_SERVER |
 	ATTR_ATIME_SERVER);
 
+/**
+ * @brief Get a reference on an inode by number
+ *
+ * From the client's cache, else from the MDS when libcephfs can.
+ *
+ * @param[in]  cmount Client instance
+ * @param[in]  vi     Inode and snapshot
+ * @param[out] i      The inode, to be released with ceph_ll_put()
+ *
+ * @return 0 on success, negative error codes on failure.
+ */
+
+int ceph_lookup_vino(struct ceph_mount_info *cmount, vinodeno_t vi,
+		     struct Inode **i)
+{
+	*i = ceph_ll_get_inode(cmount, vi);
+	if (*i != NULL)
+		return 0;
+
+#ifdef USE_FSAL_CEPH_LL_LOOKUP_INODE
+	/* Only the head of a file can be looked up by number */
+	if (vi.snapid.val == CEPH_NOSNAP)
+		return ceph_ll_lookup_inode(cmount, vi.ino, i);
+#endif
+	return -ESTALE;
+}
+
 /**
  * @brief Construct a new filehandle
  *
@@ -73,7 +101,13 @@ const attrmask_t settable_attributes = (
  * it to the export.  After this call the attributes have been filled
  * in and the handdle is up-to-date and usable.
  *
+ * With several mounts on the export, an inode found through the wrong
+ * one is looked up again on its own and the reference on the first
+ * is dropped.
+ *
  * @param[in]  stx    ceph_statx data for the file
+ * @param[in]  i      Inode, a reference owned by the handle
+ * @param[in]  cmount Client instance @a i was obtained from
  * @param[in]  export Export on which the object lives
  * @param[out] obj    Object created
  *
@@ -81,10 +115,13 @@ const attrmask_t settable_attributes = (
  */
 
 void construct_handle(const struct ceph_statx *stx, struct Inode *i,
-		      struct export *export, struct handle **obj)
+		      struct ceph_mount_info *cmount, struct export *export,
+		      struct handle **obj)
 {
 	/* Pointer to the handle under construction */
 	struct handle *constructing = NULL;
+	struct ceph_mount_info *home;
+	struct Inode *home_i;
 
 	assert(i);
 
@@ -94,7 +131,17 @@ void construct_handle(const struct ceph_statx *stx, struct Inode *i,
 #ifdef CEPH_NOSNAP
 	constructing->vi.snapid.val = stx->stx_dev;
 #endif /* CEPH_NOSNAP */
+
+	home = ceph_export_mount(export, stx->stx_ino);
+	if (home != cmount &&
+	    ceph_lookup_vino(home, constructing->vi, &home_i) == 0) {
+		ceph_ll_put(cmount, i);
+		i = home_i;
+		cmount = home;
+	}
+
 	constructing->i = i;
+	constructing->cmount = cmount;
 	constructing->up_ops = export->export.up_ops;
 
 	fsal_obj_handle_init(&constructing->handle, &export->export,
@@ -116,7 +163,7 @@ void construct_handle(const struct ceph_statx *stx, struct Inode *i,
 
 void deconstruct_handle(struct handle *obj)
 {
-	ceph_ll_put(obj->export->cmount, obj->i);
+	ceph_ll_put(obj->cmount, obj->i);
 	fsal_obj_handle_fini(&obj->handle);
 	gsh_free(obj);
 }
@@ -213,6 +260,15 @@ void ceph2fsal_attributes(const struct ceph_statx *stx,
 		fsalattr->change = stx->stx_version;
 	}
 
+#ifdef USE_FSAL_CEPH_LL_CALLBACKS
+	/* The cap recall upcalls invalidate these, see ceph_ino_recall() */
+	if (op_ctx != NULL && op_ctx->fsal_export != NULL &&
+	    op_ctx->fsal_export->fsal == &CephFSM.fsal &&
+	    container_of(op_ctx->fsal_export, struct export,
+			 export)->cap_trust)
+		fsalattr->expire_time_attr = -1;
+#endif
+
 	if ((stx->stx_mask & (CEPH_STATX_CTIME|CEPH_STATX_MTIME)) ==
 	     (CEPH_STATX_CTIME|CEPH_STATX_MTIME)) {
 		fsalattr->valid_mask |= ATTR_CHGTIME;
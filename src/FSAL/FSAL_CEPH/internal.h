@@ -53,6 +53,9 @@
 /* Max length of a secret key for this user */
 #define MAXSECRETLEN	(88)
 
+/* Max libcephfs client instances per export */
+#define CEPH_MAX_MOUNTS	(64)
+
 /**
  * Ceph Main (global) module object
  */
@@ -73,9 +76,16 @@ struct export {
 	struct ceph_mount_info *cmount;	/*< The mount object used to
 					   access all Ceph methods on
 					   this export. */
+	struct ceph_mount_info **cmounts; /*< All the client instances,
+					     cmounts[0] is cmount */
+	uint32_t mounts;		/*< Entries of cmounts */
 	struct handle *root;	/*< The root handle */
 	char *user_id;			/* cephx user_id for this mount */
 	char *secret_key;
+	bool cap_trust;		/*< Cache attributes until a cap recall */
+#ifdef USE_FSAL_CEPH_LL_CALLBACKS
+	struct ceph_client_callback_args cb_args;
+#endif
 };
 
 struct ceph_fd {
@@ -83,6 +93,8 @@ struct ceph_fd {
 	fsal_openflags_t openflags;
 	/** The cephfs file descriptor. */
 	Fh *fd;
+	/** Nonblocking I/Os still using fd, see ceph_close_my_fd() */
+	uint32_t io_inflight;
 };
 
 /**
@@ -93,6 +105,7 @@ struct handle {
 	struct fsal_obj_handle handle;	/*< The public handle */
 	struct ceph_fd fd;
 	struct Inode *i;	/*< The Ceph inode */
+	struct ceph_mount_info *cmount;	/*< The client instance of i */
 	const struct fsal_up_vector *up_ops;	/*< Upcall operations */
 	struct export *export;	/*< The first export this handle belongs to */
 	vinodeno_t vi;		/*< The object identifier */
@@ -149,8 +162,26 @@ static inline fsal_staticfsinfo_t *ceph_staticinfo(struct fsal_module *hdl)
 
 /* Prototypes */
 
+/**
+ * @brief The client instance an inode belongs on
+ *
+ * Objects are spread over the mounts of an export by inode number.
+ */
+static inline struct ceph_mount_info *
+ceph_export_mount(const struct export *export, uint64_t ino)
+{
+	if (export->mounts <= 1)
+		return export->cmount;
+
+	return export->cmounts[((ino * 0x9E3779B97F4A7C15ULL) >> 32) %
+			       export->mounts];
+}
+
+int ceph_lookup_vino(struct ceph_mount_info *cmount, vinodeno_t vi,
+		     struct Inode **i);
 void construct_handle(const struct ceph_statx *stx, struct Inode *i,
-		      struct export *export, struct handle **obj);
+		      struct ceph_mount_info *cmount, struct export *export,
+		      struct handle **obj);
 void deconstruct_handle(struct handle *obj);
 
 /**
@@ -47,6 +47,8 @@
 #include "nfs_exports.h"
 #include "export_mgr.h"
 #include "statx_compat.h"
+#include "fsal_up.h"
+#include "fridgethr.h"
 
 /**
  * Ceph global module object.
@@ -149,9 +151,57 @@ static struct config_item export_params[] = {
 	CONF_ITEM_STR("user_id", 0, MAXUIDLEN, NULL, export, user_id),
 	CONF_ITEM_STR("secret_access_key", 0, MAXSECRETLEN, NULL, export,
 			secret_key),
+	CONF_ITEM_BOOL("cap_trust", false, export, cap_trust),
+	CONF_ITEM_UI32("mounts", 1, CEPH_MAX_MOUNTS, 1, export, mounts),
 	CONFIG_EOL
 };
 
+#ifdef USE_FSAL_CEPH_LL_CALLBACKS
+/**
+ * @brief libcephfs revoked the cached data or attributes of an inode
+ *
+ * Called from the libcephfs client thread, the invalidate is queued so
+ * that it does not take MDCACHE locks under the client lock.
+ */
+static void ceph_ino_recall(void *handle, vinodeno_t vino, int64_t off,
+			    int64_t len)
+{
+	struct export *export = handle;
+	struct gsh_buffdesc key = {
+		.addr = &vino,
+		.len = sizeof(vino),
+	};
+
+	LogFullDebug(COMPONENT_FSAL, "recall inode %" PRIx64,
+		     (uint64_t) vino.ino.val);
+
+	(void) up_async_invalidate(general_fridge, &export->export, &key,
+				   FSAL_UP_INVALIDATE_ATTRS |
+				   FSAL_UP_INVALIDATE_CONTENT, NULL, NULL);
+}
+
+/**
+ * @brief libcephfs revoked a dentry of a directory
+ */
+static void ceph_dentry_recall(void *handle, vinodeno_t dirino,
+			       vinodeno_t ino, const char *name, size_t len)
+{
+	ceph_ino_recall(handle, dirino, 0, 0);
+}
+
+static void ceph_register_recalls(struct export *export)
+{
+	uint32_t n;
+
+	export->cb_args.handle = export;
+	export->cb_args.ino_cb = ceph_ino_recall;
+	export->cb_args.dentry_cb = ceph_dentry_recall;
+	for (n = 0; n < export->mounts; n++)
+		ceph_ll_register_callbacks(export->cmounts[n],
+					   &export->cb_args);
+}
+#endif /* USE_FSAL_CEPH_LL_CALLBACKS */
+
 static struct config_block export_param_block = {
 	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.ceph-export%d",
 	.blk_desc.name = "FSAL",
@@ -161,6 +211,79 @@ static struct config_block export_param_block = {
 	.blk_desc.u.blk.commit = noop_conf_commit
 };
 
+/**
+ * @brief Create and mount one libcephfs client instance of an export
+ *
+ * @param[in]  export The export, with its parameters loaded
+ * @param[out] cmount The instance, for the caller to shut down
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t ceph_mount_instance(struct export *export,
+					 struct ceph_mount_info **cmount)
+{
+	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
+	int ceph_status;
+
+	/* allocates ceph_mount_info */
+	ceph_status = ceph_create(cmount, export->user_id);
+	if (ceph_status != 0) {
+		status.major = ERR_FSAL_SERVERFAULT;
+		LogCrit(COMPONENT_FSAL,
+			"Unable to create Ceph handle for %s.",
+			op_ctx->ctx_export->fullpath);
+		return status;
+	}
+
+	ceph_status = ceph_conf_read_file(*cmount, CephFSM.conf_path);
+	if (ceph_status != 0) {
+		status.major = ERR_FSAL_SERVERFAULT;
+		LogCrit(COMPONENT_FSAL,
+			"Unable to read Ceph configuration for %s.",
+			op_ctx->ctx_export->fullpath);
+		return status;
+	}
+
+	if (export->secret_key) {
+		ceph_status = ceph_conf_set(*cmount, "key",
+					    export->secret_key);
+		if (ceph_status) {
+			status.major = ERR_FSAL_INVAL;
+			LogCrit(COMPONENT_FSAL,
+				"Unable to set Ceph secret key for %s: %d",
+				op_ctx->ctx_export->fullpath, ceph_status);
+			return status;
+		}
+	}
+
+	/*
+	 * Workaround for broken libcephfs that doesn't handle the path
+	 * given in ceph_mount properly. Should be harmless for fixed
+	 * libcephfs as well (see http://tracker.ceph.com/issues/18254).
+	 */
+	ceph_status = ceph_conf_set(*cmount, "client_mountpoint",
+				    op_ctx->ctx_export->fullpath);
+	if (ceph_status) {
+		status.major = ERR_FSAL_INVAL;
+		LogCrit(COMPONENT_FSAL,
+			"Unable to set Ceph client_mountpoint for %s: %d",
+			op_ctx->ctx_export->fullpath, ceph_status);
+		return status;
+	}
+
+	ceph_status = ceph_mount(*cmount, op_ctx->ctx_export->fullpath);
+	if (ceph_status != 0) {
+		status.major = ERR_FSAL_SERVERFAULT;
+		LogCrit(COMPONENT_FSAL,
+			"Unable to mount Ceph cluster for %s.",
+			op_ctx->ctx_export->fullpath);
+		return status;
+	}
+
+	return status;
+}
+
 /**
  * @brief Create a new export under this FSAL
  *
@@ -199,8 +322,8 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	struct ceph_statx stx;
 	/* Return code */
 	int rc;
-	/* Return code from Ceph calls */
-	int ceph_status;
+	/* Client instance */
+	uint32_t n;
 	/* True if we have called fsal_export_init */
 	bool initialized = false;
 
@@ -222,60 +345,28 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 
 	initialized = true;
 
-	/* allocates ceph_mount_info */
-	ceph_status = ceph_create(&export->cmount, export->user_id);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to create Ceph handle for %s.",
-			op_ctx->ctx_export->fullpath);
-		goto error;
-	}
+	if (export->mounts == 0)
+		export->mounts = 1;
 
-	ceph_status = ceph_conf_read_file(export->cmount, CephFSM.conf_path);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to read Ceph configuration for %s.",
+#ifndef USE_FSAL_CEPH_LL_LOOKUP_INODE
+	if (export->mounts > 1) {
+		LogWarn(COMPONENT_FSAL,
+			"Mounts needs ceph_ll_lookup_inode, using 1 for %s",
 			op_ctx->ctx_export->fullpath);
-		goto error;
+		export->mounts = 1;
 	}
+#endif
 
-	if (export->secret_key) {
-		ceph_status = ceph_conf_set(export->cmount, "key",
-					    export->secret_key);
-		if (ceph_status) {
-			status.major = ERR_FSAL_INVAL;
-			LogCrit(COMPONENT_FSAL,
-				"Unable to set Ceph secret key for %s: %d",
-				op_ctx->ctx_export->fullpath, ceph_status);
-			goto error;
-		}
-	}
+	export->cmounts = gsh_calloc(export->mounts,
+				     sizeof(struct ceph_mount_info *));
 
-	/*
-	 * Workaround for broken libcephfs that doesn't handle the path
-	 * given in ceph_mount properly. Should be harmless for fixed
-	 * libcephfs as well (see http://tracker.ceph.com/issues/18254).
-	 */
-	ceph_status = ceph_conf_set(export->cmount, "client_mountpoint",
-				    op_ctx->ctx_export->fullpath);
-	if (ceph_status) {
-		status.major = ERR_FSAL_INVAL;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to set Ceph client_mountpoint for %s: %d",
-			op_ctx->ctx_export->fullpath, ceph_status);
-		goto error;
+	for (n = 0; n < export->mounts; n++) {
+		status = ceph_mount_instance(export, &export->cmounts[n]);
+		if (FSAL_IS_ERROR(status))
+			goto error;
 	}
 
-	ceph_status = ceph_mount(export->cmount, op_ctx->ctx_export->fullpath);
-	if (ceph_status != 0) {
-		status.major = ERR_FSAL_SERVERFAULT;
-		LogCrit(COMPONENT_FSAL,
-			"Unable to mount Ceph cluster for %s.",
-			op_ctx->ctx_export->fullpath);
-		goto error;
-	}
+	export->cmount = export->cmounts[0];
 
 	if (fsal_attach_export(module_in, &export->export.exports) != 0) {
 		status.major = ERR_FSAL_SERVERFAULT;
@@ -288,6 +379,17 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 	export->export.fsal = module_in;
 	export->export.up_ops = up_ops;
 
+#ifdef USE_FSAL_CEPH_LL_CALLBACKS
+	ceph_register_recalls(export);
+#else
+	if (export->cap_trust) {
+		LogWarn(COMPONENT_FSAL,
+			"Cap_Trust needs cap recall upcalls, ignored for %s",
+			op_ctx->ctx_export->fullpath);
+		export->cap_trust = false;
+	}
+#endif
+
 	LogDebug(COMPONENT_FSAL, "Ceph module export %s.",
 		 op_ctx->ctx_export->fullpath);
 
@@ -302,7 +404,7 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 		goto error;
 	}
 
-	construct_handle(&stx, i, export, &handle);
+	construct_handle(&stx, i, export->cmount, export, &handle);
 
 	export->root = handle;
 	op_ctx->fsal_export = &export->export;
@@ -314,8 +416,11 @@ static fsal_status_t create_export(struct fsal_module *module_in,
 		ceph_ll_put(export->cmount, i);
 
 	if (export) {
-		if (export->cmount)
-			ceph_shutdown(export->cmount);
+		for (n = 0; export->cmounts && n < export->mounts; n++) {
+			if (export->cmounts[n])
+				ceph_shutdown(export->cmounts[n]);
+		}
+		gsh_free(export->cmounts);
 		gsh_free(export);
 	}
 
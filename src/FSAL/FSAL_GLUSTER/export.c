@@ -69,8 +69,15 @@ static void export_release(struct fsal_export *exp_hdl)
 
 	atomic_add_int8_t (&glfs_export->destroy_mode, 1);
 
-	/* Wait for up_thread to exit */
+	/* Wait for up_thread to exit, or stop the upcall callbacks */
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+	if (glfs_export->up_registered)
+		glusterfs_unregister_upcall(glfs_export);
+	else
+		err = pthread_join(glfs_export->up_thread, (void **)&retval);
+#else
 	err = pthread_join(glfs_export->up_thread, (void **)&retval);
+#endif
 
 	if (retval && *retval) {
 		LogDebug(COMPONENT_FSAL, "Up_thread join returned value %d",
@@ -166,6 +173,7 @@ static fsal_status_t lookup_path(struct fsal_export *export_pub,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 	*pub_handle = &objhandle->handle;
@@ -271,6 +279,7 @@ static fsal_status_t create_handle(struct fsal_export *export_pub,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 	*pub_handle = &objhandle->handle;
@@ -577,6 +586,7 @@ struct glexport_params {
 	char *glhostname;
 	char *glvolpath;
 	char *glfs_log;
+	bool upcall_trust;
 };
 
 static struct config_item export_params[] = {
@@ -589,6 +599,8 @@ static struct config_item export_params[] = {
 		      glexport_params, glvolpath),
 	CONF_ITEM_PATH("glfs_log", 1, MAXPATHLEN, GFAPI_LOG_LOCATION,
 		       glexport_params, glfs_log),
+	CONF_ITEM_BOOL("upcall_trust", false,
+		       glexport_params, upcall_trust),
 	CONFIG_EOL
 };
 
@@ -602,6 +614,27 @@ static struct config_block export_param = {
 	.blk_desc.u.blk.commit = noop_conf_commit
 };
 
+#ifdef USE_GLUSTER_DELEGATION
+/**
+ * @brief Make up the lease id of this server's export of the volume
+ *
+ * Unique to the host, the process and the export, so that servers
+ * exporting the same volume recall each other's leases.
+ */
+static void glusterfs_lease_id_init(struct glusterfs_export *glfsexport)
+{
+	uint32_t id[GLFS_LEASE_ID_SIZE / sizeof(uint32_t)];
+	struct timespec ts;
+
+	now(&ts);
+	id[0] = gethostid();
+	id[1] = getpid();
+	id[2] = ts.tv_sec;
+	id[3] = ts.tv_nsec ^ (uint32_t) (uintptr_t) glfsexport;
+	memcpy(glfsexport->lease_id, id, sizeof(id));
+}
+#endif
+
 /**
  * @brief Implements GLUSTER FSAL moduleoperation create_export
  */
@@ -698,6 +731,10 @@ fsal_status_t glusterfs_create_export(struct fsal_module *fsal_hdl,
 	glfsexport->acl_enable =
 		!op_ctx_export_has_option(EXPORT_OPTION_DISABLE_ACL);
 	glfsexport->destroy_mode = 0;
+	glfsexport->upcall_trust = params.upcall_trust;
+#ifdef USE_GLUSTER_DELEGATION
+	glusterfs_lease_id_init(glfsexport);
+#endif
 
 	op_ctx->fsal_export = &glfsexport->export;
 
@@ -743,6 +780,11 @@ fsal_status_t glusterfs_create_export(struct fsal_module *fsal_hdl,
 
 	glfsexport->export.up_ops = up_ops;
 
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+	if (glusterfs_register_upcall(glfsexport))
+		goto out;
+#endif
+
 	rc = initiate_up_thread(glfsexport);
 	if (rc != 0) {
 		LogCrit(COMPONENT_FSAL,
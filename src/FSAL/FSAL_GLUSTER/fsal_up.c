@@ -30,6 +30,7 @@
 
 #include "fsal.h"
 #include "fsal_up.h"
+#include "fridgethr.h"
 #include "gluster_internal.h"
 #include "fsal_convert.h"
 #include <sys/types.h>
@@ -37,16 +38,22 @@
 #include <utime.h>
 #include <sys/time.h>
 
-int upcall_inode_invalidate(struct glusterfs_export *glfsexport,
-			     struct glfs_object *object)
+/**
+ * @brief Build the MDCACHE key of an upcall's object
+ *
+ * @param[in]  glfsexport  Export the upcall came for
+ * @param[in]  object      Its object
+ * @param[out] globjhdl    Handle descriptor, GLAPI_HANDLE_LENGTH long
+ *
+ * @return 0, or -1 if the handle could not be made.
+ */
+static int upcall_object_key(struct glusterfs_export *glfsexport,
+			     struct glfs_object *object,
+			     unsigned char *globjhdl)
 {
 	int	     rc                             = -1;
 	glfs_t          *fs                         = NULL;
 	char            vol_uuid[GLAPI_UUID_LENGTH] = {'\0'};
-	unsigned char   globjhdl[GLAPI_HANDLE_LENGTH];
-	struct gsh_buffdesc         key;
-	const struct fsal_up_vector *event_func;
-	fsal_status_t fsal_status = {0, 0};
 
 	fs = glfsexport->gl_fs;
 	if (!fs) {
@@ -75,11 +82,30 @@ int upcall_inode_invalidate(struct glusterfs_export *glfsexport,
 	}
 
 	memcpy(globjhdl, vol_uuid, GLAPI_UUID_LENGTH);
+	rc = 0;
+
+out:
+	return rc;
+}
+
+int upcall_inode_invalidate(struct glusterfs_export *glfsexport,
+			     struct glfs_object *object)
+{
+	int	     rc                             = -1;
+	unsigned char   globjhdl[GLAPI_HANDLE_LENGTH];
+	struct gsh_buffdesc         key;
+	const struct fsal_up_vector *event_func;
+	fsal_status_t fsal_status = {0, 0};
+
+	rc = upcall_object_key(glfsexport, object, globjhdl);
+	if (rc < 0)
+		goto out;
+
 	key.addr = &globjhdl;
 	key.len = GLAPI_HANDLE_LENGTH;
 
 	LogDebug(COMPONENT_FSAL_UP, "Received event to process for %p",
-		 fs);
+		 glfsexport->gl_fs);
 
 	event_func = glfsexport->export.up_ops;
 
@@ -99,6 +125,163 @@ out:
 	return rc;
 }
 
+#ifdef USE_GLUSTER_DELEGATION
+/**
+ * @brief Recall the delegations a lease Gluster recalls backs
+ *
+ * The attributes trusted while the lease was held are dropped first,
+ * the conflicting fop changing them once the lease is given back.
+ */
+static void upcall_lease_recall(struct glusterfs_export *glfsexport,
+				struct glfs_object *object)
+{
+	unsigned char globjhdl[GLAPI_HANDLE_LENGTH];
+	const struct fsal_up_vector *event_func;
+	struct gsh_buffdesc key;
+	fsal_status_t fsal_status;
+
+	if (upcall_object_key(glfsexport, object, globjhdl) < 0)
+		return;
+
+	key.addr = &globjhdl;
+	key.len = GLAPI_HANDLE_LENGTH;
+
+	event_func = glfsexport->export.up_ops;
+
+	(void) event_func->invalidate(event_func->up_export, &key,
+				      FSAL_UP_INVALIDATE_ATTRS |
+				      FSAL_UP_INVALIDATE_CONTENT);
+
+	fsal_status = up_async_delegrecall(general_fridge,
+					   event_func->up_export, &key,
+					   NULL, NULL);
+	if (FSAL_IS_ERROR(fsal_status))
+		LogWarn(COMPONENT_FSAL_UP,
+			"Lease recall could not be queued for %p, rc %d",
+			glfsexport->gl_fs, fsal_status.major);
+}
+#endif
+
+/**
+ * @brief Process one upcall and free it
+ */
+static void glusterfs_process_upcall(struct glusterfs_export *glfsexport,
+				     struct glfs_upcall *cbk)
+{
+	struct glfs_upcall_inode    *in_arg             = NULL;
+#ifdef USE_GLUSTER_DELEGATION
+	struct glfs_upcall_lease    *lease_arg          = NULL;
+#endif
+	enum glfs_upcall_reason     reason              = 0;
+	struct glfs_object          *object             = NULL;
+	struct glfs_object          *p_object           = NULL;
+	struct glfs_object          *oldp_object        = NULL;
+
+	reason = glfs_upcall_get_reason(cbk);
+	/* Decide what type of event this is
+	 * inode update / invalidate? */
+	switch (reason) {
+	case GLFS_UPCALL_EVENT_NULL:
+		break;
+	case GLFS_UPCALL_INODE_INVALIDATE:
+		in_arg = glfs_upcall_get_event(cbk);
+
+		if (!in_arg) {
+			/* Could be ENOMEM issues. continue */
+			LogWarn(COMPONENT_FSAL_UP,
+				"Received NULL upcall event arg");
+			break;
+		}
+
+		object = glfs_upcall_inode_get_object(in_arg);
+		if (object)
+			upcall_inode_invalidate(glfsexport, object);
+		p_object = glfs_upcall_inode_get_pobject(in_arg);
+		if (p_object)
+			upcall_inode_invalidate(glfsexport, p_object);
+		oldp_object = glfs_upcall_inode_get_oldpobject(in_arg);
+		if (oldp_object)
+			upcall_inode_invalidate(glfsexport, oldp_object);
+		break;
+#ifdef USE_GLUSTER_DELEGATION
+	case GLFS_UPCALL_RECALL_LEASE:
+		lease_arg = glfs_upcall_get_event(cbk);
+
+		if (!lease_arg) {
+			LogWarn(COMPONENT_FSAL_UP,
+				"Received NULL upcall event arg");
+			break;
+		}
+
+		object = glfs_upcall_lease_get_object(lease_arg);
+		if (object)
+			upcall_lease_recall(glfsexport, object);
+		break;
+#endif
+	default:
+		LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
+		break;
+	}
+
+	glfs_free(cbk);
+}
+
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+/**
+ * @brief Upcall callback registered with glfs_upcall_register()
+ *
+ * Called on a gfapi thread as soon as the event arrives.  The MDCACHE
+ * invalidate_close queues the work, so nothing here blocks on gfapi.
+ */
+static void glusterfs_upcall_cbk(struct glfs_upcall *cbk, void *data)
+{
+	struct glusterfs_export *glfsexport = data;
+
+	if (atomic_fetch_int8_t(&glfsexport->destroy_mode)) {
+		glfs_free(cbk);
+		return;
+	}
+
+	glusterfs_process_upcall(glfsexport, cbk);
+}
+
+/**
+ * @brief Have gfapi call us for upcalls instead of polling for them
+ *
+ * @return true if registered, false to fall back to the poll thread.
+ */
+bool glusterfs_register_upcall(struct glusterfs_export *glfsexport)
+{
+	uint32_t events = GLFS_EVENT_INODE_INVALIDATE;
+	int rc;
+
+#ifdef USE_GLUSTER_DELEGATION
+	events |= GLFS_EVENT_RECALL_LEASE;
+#endif
+	rc = glfs_upcall_register(glfsexport->gl_fs, events,
+				  glusterfs_upcall_cbk, glfsexport);
+	if (rc < 0 || !(rc & GLFS_EVENT_INODE_INVALIDATE)) {
+		LogEvent(COMPONENT_FSAL_UP,
+			 "glfs_upcall_register failed for %p (%s), polling",
+			 glfsexport->gl_fs, strerror(errno));
+		return false;
+	}
+
+	glfsexport->up_registered = true;
+	return true;
+}
+
+void glusterfs_unregister_upcall(struct glusterfs_export *glfsexport)
+{
+	uint32_t events = GLFS_EVENT_INODE_INVALIDATE;
+
+#ifdef USE_GLUSTER_DELEGATION
+	events |= GLFS_EVENT_RECALL_LEASE;
+#endif
+	(void) glfs_upcall_unregister(glfsexport->gl_fs, events);
+}
+#endif /* USE_GLUSTER_UPCALL_REGISTER */
+
 void *GLUSTERFSAL_UP_Thread(void *Arg)
 {
 	struct glusterfs_export     *glfsexport         = Arg;
@@ -106,13 +289,9 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 	char                        thr_name[16];
 	int                         rc                  = 0;
 	struct glfs_upcall          *cbk                = NULL;
-	struct glfs_upcall_inode    *in_arg             = NULL;
 	enum glfs_upcall_reason     reason              = 0;
 	int                         retry               = 0;
 	int                         errsv               = 0;
-	struct glfs_object          *object             = NULL;
-	struct glfs_object          *p_object           = NULL;
-	struct glfs_object          *oldp_object        = NULL;
 
 
 	snprintf(thr_name, sizeof(thr_name),
@@ -194,42 +373,15 @@ void *GLUSTERFSAL_UP_Thread(void *Arg)
 			continue;
 		}
 
-		reason = glfs_upcall_get_reason(cbk);
-		/* Decide what type of event this is
-		 * inode update / invalidate? */
-		switch (reason) {
-		case GLFS_UPCALL_EVENT_NULL:
-			usleep(10);
-			continue;
-		case GLFS_UPCALL_INODE_INVALIDATE:
-			in_arg = glfs_upcall_get_event(cbk);
-
-			if (!in_arg) {
-				/* Could be ENOMEM issues. continue */
-				LogWarn(COMPONENT_FSAL_UP,
-					"Received NULL upcall event arg");
-				break;
-			}
-
-			object = glfs_upcall_inode_get_object(in_arg);
-			if (object)
-				upcall_inode_invalidate(glfsexport, object);
-			p_object = glfs_upcall_inode_get_pobject(in_arg);
-			if (p_object)
-				upcall_inode_invalidate(glfsexport, p_object);
-			oldp_object = glfs_upcall_inode_get_oldpobject(in_arg);
-			if (oldp_object)
-				upcall_inode_invalidate(glfsexport,
-							oldp_object);
-			break;
-		default:
-			LogWarn(COMPONENT_FSAL_UP, "Unknown event: %d", reason);
-			continue;
-		}
-		if (cbk) {
+		if (glfs_upcall_get_reason(cbk) == GLFS_UPCALL_EVENT_NULL) {
 			glfs_free(cbk);
 			cbk = NULL;
+			usleep(10);
+			continue;
 		}
+
+		glusterfs_process_upcall(glfsexport, cbk);
+		cbk = NULL;
 	}
 
 out:
@@ -242,6 +242,10 @@ int setglustercreds(struct glusterfs_export *glfs_export, uid_t *uid,
 	else
 		rc = glfs_setfsgroups(0, NULL);
 
+#ifdef USE_GLUSTER_DELEGATION
+	glusterfs_set_lease_id(glfs_export);
+#endif
+
  out:
 	return rc;
 }
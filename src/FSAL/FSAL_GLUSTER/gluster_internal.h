@@ -142,6 +142,11 @@ struct glusterfs_export {
 	bool pnfs_mds_enabled;
 	int8_t destroy_mode;
 	pthread_t up_thread; /* upcall thread */
+	bool up_registered; /* upcalls come through glfs_upcall_register */
+	bool upcall_trust; /* cache attributes until an upcall */
+#ifdef USE_GLUSTER_DELEGATION
+	glfs_leaseid_t lease_id; /* of this server's fops and leases */
+#endif
 };
 
 struct glusterfs_fd {
@@ -161,6 +166,11 @@ struct glusterfs_handle {
 	struct glusterfs_fd globalfd;
 	struct fsal_obj_handle handle;	/* public FSAL handle */
 	struct fsal_share share; /* share_reservations */
+#ifdef USE_GLUSTER_DELEGATION
+	struct glfs_fd *lease_fd;	/* holds the lease of delegations */
+	uint32_t lease_cnt;		/* delegations backed by the lease */
+	fsal_lock_t lease_type;
+#endif
 
 	/* following added for pNFS support */
 	uint64_t rd_issued;
@@ -215,6 +225,30 @@ void handle_ops_init(struct fsal_obj_ops *ops);
 
 fsal_status_t gluster2fsal_error(const int gluster_errorcode);
 
+/**
+ * @brief Let MDCACHE keep attributes until an upcall invalidates them
+ */
+static inline void
+glusterfs_attr_expire(const struct glusterfs_export *glfs_export,
+		      struct attrlist *attrs)
+{
+	if (glfs_export->upcall_trust)
+		attrs->expire_time_attr = -1;
+}
+
+#ifdef USE_GLUSTER_DELEGATION
+/**
+ * @brief Tag this thread's fops with the server's lease id
+ *
+ * Gluster then only recalls the leases of this server for fops of
+ * other servers and clients.
+ */
+static inline void glusterfs_set_lease_id(struct glusterfs_export *glfs_export)
+{
+	(void) glfs_setfsleaseid(glfs_export->lease_id);
+}
+#endif
+
 void stat2fsal_attributes(const struct stat *buffstat,
 			  struct attrlist *fsalattr);
 
@@ -275,6 +309,10 @@ nfsstat4 getdeviceinfo(struct fsal_module *fsal_hdl,
 
 /* UP thread routines */
 void *GLUSTERFSAL_UP_Thread(void *Arg);
+#ifdef USE_GLUSTER_UPCALL_REGISTER
+bool glusterfs_register_upcall(struct glusterfs_export *glfsexport);
+void glusterfs_unregister_upcall(struct glusterfs_export *glfsexport);
+#endif
 int initiate_up_thread(struct glusterfs_export *glfsexport);
 int upcall_inode_invalidate(struct glusterfs_export *glfsexport,
 			    struct glfs_object *object);
@@ -30,6 +30,7 @@
 #include "gluster_internal.h"
 #include "FSAL/fsal_commonlib.h"
 #include "fsal_convert.h"
+#include "fsal_up.h"
 #include "pnfs_utils.h"
 #include "nfs_exports.h"
 #include "sal_data.h"
@@ -57,6 +58,11 @@ static void handle_release(struct fsal_obj_handle *obj_hdl)
 
 	fsal_obj_handle_fini(&objhandle->handle);
 
+#ifdef USE_GLUSTER_DELEGATION
+	if (objhandle->lease_fd)
+		(void) glfs_close(objhandle->lease_fd);
+#endif
+
 	if (objhandle->globalfd.glfd) {
 		rc = glfs_close(objhandle->globalfd.glfd);
 		if (rc) {
@@ -134,6 +140,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 	*handle = &objhandle->handle;
@@ -299,6 +306,7 @@ static fsal_status_t create(struct fsal_obj_handle *dir_hdl,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 	*handle = &objhandle->handle;
@@ -384,6 +392,7 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 	*handle = &objhandle->handle;
@@ -396,7 +405,7 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attrib);
+						     attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -519,6 +528,7 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 	*handle = &objhandle->handle;
@@ -531,7 +541,7 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attrib);
+						     attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -629,6 +639,7 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 
 	if (attrs_out != NULL) {
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 	*handle = &objhandle->handle;
@@ -638,7 +649,7 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attrib);
+						     attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -772,6 +783,12 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 	}
 
 	stat2fsal_attributes(&buffxstat.buffstat, attrs);
+	glusterfs_attr_expire(glfs_export, attrs);
+#ifdef USE_GLUSTER_DELEGATION
+	/* Nobody else changes them under a lease */
+	if (atomic_fetch_uint32_t(&objhandle->lease_cnt) != 0)
+		attrs->expire_time_attr = -1;
+#endif
 	if (obj_hdl->type == DIRECTORY)
 		buffxstat.is_dir = true;
 	else
@@ -822,7 +839,8 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_obj_handle *destdir_hdl,
-			      const char *name)
+			      const char *name,
+			      struct attrlist *destdir_attrs_out)
 {
 	int rc = 0, credrc = 0;
 	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
@@ -881,7 +899,9 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	int rc = 0, credrc = 0;
 	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
@@ -939,7 +959,8 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name)
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
 {
 	int rc = 0, credrc = 0;
 	fsal_status_t status = { ERR_FSAL_NO_ERROR, 0 };
@@ -1170,6 +1191,11 @@ fsal_status_t find_fd(struct glusterfs_fd *my_fd,
 	if (obj_hdl->type != REGULAR_FILE)
 		return fsalstat(posix2fsal_error(EINVAL), EINVAL);
 
+#ifdef USE_GLUSTER_DELEGATION
+	glusterfs_set_lease_id(container_of(op_ctx->fsal_export,
+					    struct glusterfs_export, export));
+#endif
+
 	status = fsal_find_fd((struct fsal_fd **)&tmp2_fd, obj_hdl,
 			      (struct fsal_fd *)&myself->globalfd,
 			      &myself->share, bypass, state,
@@ -1610,7 +1636,7 @@ open:
 		status = (*new_obj)->obj_ops.setattr2(*new_obj,
 						      false,
 						      state,
-						      attrib_set);
+						      attrib_set, NULL);
 
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
@@ -1639,6 +1665,7 @@ open:
 		 * we used to create the fsal_obj_handle.
 		 */
 		posix2fsal_attributes(&sb, attrs_out);
+		glusterfs_attr_expire(glfs_export, attrs_out);
 	}
 
 
@@ -1760,24 +1787,30 @@ static fsal_status_t glusterfs_reopen2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
-/* read2
+/* readv2
  */
 
-static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
-				     bool bypass,
-				     struct state_t *state,
-				     uint64_t seek_descriptor,
-				     size_t buffer_size,
-				     void *buffer, size_t *read_amount,
-				     bool *end_of_file,
-				     struct io_info *info)
+static fsal_status_t glusterfs_readv2(struct fsal_obj_handle *obj_hdl,
+				      bool bypass,
+				      struct state_t *state,
+				      uint64_t seek_descriptor,
+				      int iov_count,
+				      struct iovec *iov,
+				      size_t *read_amount,
+				      bool *end_of_file,
+				      struct io_info *info)
 {
 	struct glusterfs_fd my_fd = {0};
 	ssize_t nb_read;
+	size_t buffer_size = 0;
 	fsal_status_t status;
 	int retval = 0;
 	bool has_lock = false;
 	bool closefd = false;
+	int i;
+
+	for (i = 0; i < iov_count; i++)
+		buffer_size += iov[i].iov_len;
 
 	if (info != NULL) {
 		/* Currently we don't support READ_PLUS */
@@ -1801,8 +1834,7 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
-	nb_read = glfs_pread(my_fd.glfd, buffer, buffer_size,
-			     seek_descriptor, 0);
+	nb_read = glfs_preadv(my_fd.glfd, iov, iov_count, seek_descriptor, 0);
 
 	if (seek_descriptor == -1 || nb_read == -1) {
 		retval = errno;
@@ -1826,7 +1858,7 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 		info->io_content.what = NFS4_CONTENT_DATA;
 		info->io_content.data.d_offset = offset + nb_read;
 		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
+		info->io_content.data.d_data.data_val = iov[0].iov_base;
 	}
 #endif
 
@@ -1842,18 +1874,39 @@ static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
 
 }
 
-/* write2
+/* read2
  */
 
-static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
-				      bool bypass,
-				      struct state_t *state,
-				      uint64_t seek_descriptor,
-				      size_t buffer_size,
-				      void *buffer,
-				      size_t *write_amount,
-				      bool *fsal_stable,
-				      struct io_info *info)
+static fsal_status_t glusterfs_read2(struct fsal_obj_handle *obj_hdl,
+				     bool bypass,
+				     struct state_t *state,
+				     uint64_t seek_descriptor,
+				     size_t buffer_size,
+				     void *buffer, size_t *read_amount,
+				     bool *end_of_file,
+				     struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return glusterfs_readv2(obj_hdl, bypass, state, seek_descriptor, 1,
+				&iov, read_amount, end_of_file, info);
+}
+
+/* writev2
+ */
+
+static fsal_status_t glusterfs_writev2(struct fsal_obj_handle *obj_hdl,
+				       bool bypass,
+				       struct state_t *state,
+				       uint64_t seek_descriptor,
+				       int iov_count,
+				       struct iovec *iov,
+				       size_t *write_amount,
+				       bool *fsal_stable,
+				       struct io_info *info)
 {
 	ssize_t nb_written;
 	fsal_status_t status;
@@ -1866,10 +1919,11 @@ static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
 
 
-	if (info != NULL) {
-		/* Currently we don't support WRITE_PLUS */
+	/* ALLOCATE and DEALLOCATE, but not WRITE_PLUS holes */
+	if (info != NULL && info->io_content.what != NFS4_CONTENT_DATA &&
+	    info->io_content.what != NFS4_CONTENT_ALLOCATE &&
+	    info->io_content.what != NFS4_CONTENT_DEALLOCATE)
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
-	}
 
 #if 0
 	/** @todo: fsid work */
@@ -1898,8 +1952,25 @@ static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
-	nb_written = glfs_pwrite(my_fd.glfd, buffer, buffer_size,
-			     seek_descriptor, ((*fsal_stable) ? O_SYNC : 0));
+	if (info == NULL || info->io_content.what == NFS4_CONTENT_DATA) {
+		nb_written = glfs_pwritev(my_fd.glfd, iov, iov_count,
+					  seek_descriptor,
+					  ((*fsal_stable) ? O_SYNC : 0));
+	} else {
+		/* A discard keeps the size */
+		if (info->io_content.what == NFS4_CONTENT_DEALLOCATE)
+			retval = glfs_discard(my_fd.glfd,
+					      info->io_content.hole.di_offset,
+					      info->io_content.hole.di_length);
+		else
+			retval = glfs_fallocate(my_fd.glfd, 0,
+					info->io_content.hole.di_offset,
+					info->io_content.hole.di_length);
+		if (retval == 0 && *fsal_stable)
+			retval = glfs_fsync(my_fd.glfd);
+		nb_written = retval == 0 ?
+			     info->io_content.hole.di_length : -1;
+	}
 
 	if (nb_written == -1) {
 		retval = errno;
@@ -1928,6 +1999,130 @@ static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+/* copy2
+ * The bricks copy the data, it doesn't come through ganesha.
+ */
+
+static fsal_status_t glusterfs_copy2(struct fsal_obj_handle *src_hdl,
+				     struct state_t *src_state,
+				     uint64_t src_offset,
+				     struct fsal_obj_handle *dst_hdl,
+				     struct state_t *dst_state,
+				     uint64_t dst_offset,
+				     uint64_t count,
+				     uint64_t *copied)
+{
+	fsal_status_t status;
+	int retval = 0;
+	struct glusterfs_fd src_fd = {0}, dst_fd = {0};
+	bool src_lock = false, dst_lock = false;
+	bool src_close = false, dst_close = false;
+	off64_t src_pos = src_offset, dst_pos = dst_offset;
+	size_t chunk;
+	ssize_t nb;
+	struct glusterfs_export *glfs_export =
+	     container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+
+	*copied = 0;
+
+	/* A copy within one file uses a single read/write fd, a second
+	 * lookup could need to reopen the global fd under the obj_lock.
+	 */
+	if (src_hdl == dst_hdl) {
+		status = find_fd(&dst_fd, dst_hdl, false, dst_state,
+				 FSAL_O_RDWR, &dst_lock, &dst_close, false);
+		src_fd = dst_fd;
+	} else {
+		status = find_fd(&src_fd, src_hdl, false, src_state,
+				 FSAL_O_READ, &src_lock, &src_close, false);
+		if (!FSAL_IS_ERROR(status))
+			status = find_fd(&dst_fd, dst_hdl, false, dst_state,
+					 FSAL_O_WRITE, &dst_lock, &dst_close,
+					 false);
+	}
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+			&op_ctx->creds->caller_gid,
+			op_ctx->creds->caller_glen,
+			op_ctx->creds->caller_garray);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		goto out;
+	}
+
+	while (count == 0 || *copied < count) {
+		chunk = 1024 * 1024 * 1024;
+		if (count != 0 && count - *copied < chunk)
+			chunk = count - *copied;
+
+		nb = glfs_copy_file_range(src_fd.glfd, &src_pos, dst_fd.glfd,
+					  &dst_pos, chunk, 0, NULL, NULL,
+					  NULL);
+		if (nb == -1) {
+			retval = errno;
+			status = fsalstat(posix2fsal_error(retval), retval);
+			break;
+		}
+
+		if (nb == 0)
+			break;
+
+		*copied += nb;
+	}
+
+	/* restore credentials */
+	retval = setglustercreds(glfs_export, NULL, NULL, 0, NULL);
+	if (retval != 0) {
+		status = gluster2fsal_error(EPERM);
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		goto out;
+	}
+
+ out:
+
+	if (src_close)
+		glusterfs_close_my_fd(&src_fd);
+
+	if (src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->obj_lock);
+
+	if (dst_close)
+		glusterfs_close_my_fd(&dst_fd);
+
+	if (dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->obj_lock);
+
+	return status;
+}
+#endif
+
+/* write2
+ */
+
+static fsal_status_t glusterfs_write2(struct fsal_obj_handle *obj_hdl,
+				      bool bypass,
+				      struct state_t *state,
+				      uint64_t seek_descriptor,
+				      size_t buffer_size,
+				      void *buffer,
+				      size_t *write_amount,
+				      bool *fsal_stable,
+				      struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return glusterfs_writev2(obj_hdl, bypass, state, seek_descriptor, 1,
+				 &iov, write_amount, fsal_stable, info);
+}
+
 /* commit2
  */
 
@@ -1998,6 +2193,186 @@ out:
 	return status;
 }
 
+/**
+ * @brief A glfs_preadv_async() or glfs_pwritev_async() in flight
+ */
+struct glusterfs_async_io {
+	struct iovec iov;
+	struct fsal_obj_handle *obj_hdl;
+	fsal_async_cb done_cb;
+	struct fsal_io_arg *io_arg;
+	void *caller_arg;
+	bool write;
+};
+
+/**
+ * @brief Completion of an asynchronous read or write
+ *
+ * Called on a gfapi thread.  gfapi holds its own reference on the glfd
+ * for the whole fop, so the fd may already have been closed.
+ */
+#ifdef USE_GLUSTER_STAT_IO_CBK
+static void glusterfs_async_io_done(struct glfs_fd *glfd, ssize_t ret,
+				    struct glfs_stat *prestat,
+				    struct glfs_stat *poststat,
+				    void *data)
+#else
+static void glusterfs_async_io_done(struct glfs_fd *glfd, ssize_t ret,
+				    void *data)
+#endif
+{
+	struct glusterfs_async_io *aio = data;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	int retval;
+
+	if (ret < 0) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+	} else {
+		aio->io_arg->io_amount = ret;
+		if (!aio->write)
+			aio->io_arg->end_of_file = ret < aio->iov.iov_len;
+	}
+
+	aio->done_cb(aio->obj_hdl, status, aio->io_arg, aio->caller_arg);
+	gsh_free(aio);
+}
+
+/**
+ * @brief Start an asynchronous read or write
+ *
+ * The fd and any lock from find_fd() are released as soon as the fop
+ * has been submitted.  READ_PLUS and WRITE_PLUS go through the
+ * synchronous methods and complete inline.
+ */
+static void glusterfs_io_async(struct fsal_obj_handle *obj_hdl,
+			       bool bypass,
+			       bool write,
+			       fsal_async_cb done_cb,
+			       struct fsal_io_arg *io_arg,
+			       void *caller_arg)
+{
+	struct glusterfs_fd my_fd = {0};
+	struct glusterfs_async_io *aio;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+	int retval;
+	struct glusterfs_export *glfs_export =
+	    container_of(op_ctx->fsal_export,
+			 struct glusterfs_export, export);
+
+	if (io_arg->info != NULL) {
+		if (write)
+			status = glusterfs_write2(obj_hdl, bypass,
+						  io_arg->state,
+						  io_arg->offset,
+						  io_arg->buffer_size,
+						  io_arg->buffer,
+						  &io_arg->io_amount,
+						  &io_arg->fsal_stable,
+						  io_arg->info);
+		else
+			status = glusterfs_read2(obj_hdl, bypass,
+						 io_arg->state,
+						 io_arg->offset,
+						 io_arg->buffer_size,
+						 io_arg->buffer,
+						 &io_arg->io_amount,
+						 &io_arg->end_of_file,
+						 io_arg->info);
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return;
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, bypass, io_arg->state,
+			 write ? FSAL_O_WRITE : FSAL_O_READ,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		done_cb(obj_hdl, status, io_arg, caller_arg);
+		return;
+	}
+
+	aio = gsh_malloc(sizeof(*aio));
+	aio->iov.iov_base = io_arg->buffer;
+	aio->iov.iov_len = io_arg->buffer_size;
+	aio->obj_hdl = obj_hdl;
+	aio->done_cb = done_cb;
+	aio->io_arg = io_arg;
+	aio->caller_arg = caller_arg;
+	aio->write = write;
+
+	/* gfapi picks up the credentials when the fop is wound */
+	retval = setglustercreds(glfs_export, &op_ctx->creds->caller_uid,
+				 &op_ctx->creds->caller_gid,
+				 op_ctx->creds->caller_glen,
+				 op_ctx->creds->caller_garray);
+	if (retval != 0) {
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+		gsh_free(aio);
+		done_cb(obj_hdl, gluster2fsal_error(EPERM), io_arg,
+			caller_arg);
+		goto out;
+	}
+
+	if (write)
+		retval = glfs_pwritev_async(my_fd.glfd, &aio->iov, 1,
+					    io_arg->offset,
+					    io_arg->fsal_stable ? O_SYNC : 0,
+					    glusterfs_async_io_done, aio);
+	else
+		retval = glfs_preadv_async(my_fd.glfd, &aio->iov, 1,
+					   io_arg->offset, 0,
+					   glusterfs_async_io_done, aio);
+
+	if (retval != 0) {
+		/* Not submitted, the callback will not run */
+		retval = errno;
+		gsh_free(aio);
+		done_cb(obj_hdl, fsalstat(posix2fsal_error(retval), retval),
+			io_arg, caller_arg);
+	}
+
+	/* restore credentials */
+	if (setglustercreds(glfs_export, NULL, NULL, 0, NULL) != 0)
+		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+
+ out:
+	if (closefd)
+		glusterfs_close_my_fd(&my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+}
+
+/* read2_async
+ */
+
+static void glusterfs_read2_async(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  fsal_async_cb done_cb,
+				  struct fsal_io_arg *read_arg,
+				  void *caller_arg)
+{
+	glusterfs_io_async(obj_hdl, bypass, false, done_cb, read_arg,
+			   caller_arg);
+}
+
+/* write2_async
+ */
+
+static void glusterfs_write2_async(struct fsal_obj_handle *obj_hdl,
+				   bool bypass,
+				   fsal_async_cb done_cb,
+				   struct fsal_io_arg *write_arg,
+				   void *caller_arg)
+{
+	glusterfs_io_async(obj_hdl, bypass, true, done_cb, write_arg,
+			   caller_arg);
+}
+
 /* lock_op2
  */
 
@@ -2159,6 +2534,121 @@ static fsal_status_t glusterfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(posix2fsal_error(retval), retval);
 }
 
+#ifdef USE_GLUSTER_DELEGATION
+/**
+ * @brief Take or give back the Gluster lease under delegations
+ *
+ * SAL gets and returns delegations through the legacy lock_op, with
+ * FSAL_LEASE_LOCK.  One lease of the server's lease id, on an fd of
+ * its own, stands for all the delegations granted on a file, so that
+ * only fops of other servers and clients have Gluster recall it.  The
+ * recall comes as a RECALL_LEASE upcall.
+ *
+ * @param[in] obj_hdl          File on which to operate
+ * @param[in] p_owner          Unused
+ * @param[in] lock_op          FSAL_OP_LOCK or FSAL_OP_UNLOCK
+ * @param[in] request_lock     Read or write lease
+ * @param[in] conflicting_lock Unused
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t glusterfs_lease_op(struct fsal_obj_handle *obj_hdl,
+					void *p_owner,
+					fsal_lock_op_t lock_op,
+					fsal_lock_param_t *request_lock,
+					fsal_lock_param_t *conflicting_lock)
+{
+	struct glusterfs_export *glfs_export =
+	    container_of(op_ctx->fsal_export, struct glusterfs_export, export);
+	struct glusterfs_handle *myself =
+	    container_of(obj_hdl, struct glusterfs_handle, handle);
+	const struct fsal_up_vector *up_ops = glfs_export->export.up_ops;
+	struct glfs_lease lease = {0};
+	struct gsh_buffdesc key;
+	bool released = false;
+	int retval = 0;
+
+	if (request_lock->lock_sle_type != FSAL_LEASE_LOCK ||
+	    obj_hdl->type != REGULAR_FILE ||
+	    (lock_op != FSAL_OP_LOCK && lock_op != FSAL_OP_UNLOCK))
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+
+	memcpy(lease.lease_id, glfs_export->lease_id, GLFS_LEASE_ID_SIZE);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	if (lock_op == FSAL_OP_UNLOCK) {
+		if (myself->lease_cnt == 0 || --myself->lease_cnt != 0)
+			goto out;
+
+		lease.cmd = GLFS_UNLK_LEASE;
+		lease.lease_type = myself->lease_type == FSAL_LOCK_W
+					? GLFS_RW_LEASE : GLFS_RD_LEASE;
+		if (glfs_lease(myself->lease_fd, &lease, NULL, NULL) != 0)
+			LogDebug(COMPONENT_FSAL, "glfs_lease unlock failed %s",
+				 strerror(errno));
+		(void) glfs_close(myself->lease_fd);
+		myself->lease_fd = NULL;
+		released = true;
+		goto out;
+	}
+
+	if (myself->lease_cnt != 0) {
+		/* SAL only shares read delegations */
+		if (request_lock->lock_type == FSAL_LOCK_W ||
+		    myself->lease_type == FSAL_LOCK_W)
+			retval = EAGAIN;
+		else
+			myself->lease_cnt++;
+		goto out;
+	}
+
+	/* As the server, the client opened the file already */
+	retval = setglustercreds(glfs_export, NULL, NULL, 0, NULL);
+	if (retval != 0) {
+		retval = EPERM;
+		goto out;
+	}
+
+	myself->lease_fd = glfs_h_open(glfs_export->gl_fs, myself->glhandle,
+				       request_lock->lock_type == FSAL_LOCK_W
+					? O_RDWR : O_RDONLY);
+	if (myself->lease_fd == NULL) {
+		retval = errno;
+		goto out;
+	}
+
+	lease.cmd = GLFS_SET_LEASE;
+	lease.lease_type = request_lock->lock_type == FSAL_LOCK_W
+				? GLFS_RW_LEASE : GLFS_RD_LEASE;
+	if (glfs_lease(myself->lease_fd, &lease, NULL, NULL) != 0) {
+		retval = errno;
+		LogDebug(COMPONENT_FSAL, "glfs_lease failed %s",
+			 strerror(retval));
+		(void) glfs_close(myself->lease_fd);
+		myself->lease_fd = NULL;
+		goto out;
+	}
+
+	myself->lease_type = request_lock->lock_type;
+	myself->lease_cnt = 1;
+
+ out:
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	if (released) {
+		/* The attributes were trusted while the lease was held */
+		key.addr = myself->globjhdl;
+		key.len = GLAPI_HANDLE_LENGTH;
+		(void) up_ops->invalidate(up_ops->up_export, &key,
+					  FSAL_UP_INVALIDATE_ATTRS |
+					  FSAL_UP_INVALIDATE_CONTENT);
+	}
+
+	return fsalstat(posix2fsal_error(retval), retval);
+}
+#endif
+
 /**
  * @brief Set attributes on an object
  *
@@ -2176,7 +2666,8 @@ static fsal_status_t glusterfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 static fsal_status_t glusterfs_setattr2(struct fsal_obj_handle *obj_hdl,
 					bool bypass,
 					struct state_t *state,
-					struct attrlist *attrib_set)
+					struct attrlist *attrib_set,
+					struct attrlist *attrs_out)
 {
 	struct glusterfs_handle *myself;
 	fsal_status_t status = {0, 0};
@@ -2611,8 +3102,18 @@ void handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = glusterfs_reopen2;
 	ops->read2 = glusterfs_read2;
 	ops->write2 = glusterfs_write2;
+	ops->readv2 = glusterfs_readv2;
+	ops->writev2 = glusterfs_writev2;
+	ops->read2_async = glusterfs_read2_async;
+	ops->write2_async = glusterfs_write2_async;
+#ifdef USE_GLUSTER_COPY_FILE_RANGE
+	ops->copy2 = glusterfs_copy2;
+#endif
 	ops->commit2 = glusterfs_commit2;
 	ops->lock_op2 = glusterfs_lock_op2;
+#ifdef USE_GLUSTER_DELEGATION
+	ops->lock_op = glusterfs_lease_op;
+#endif
 	ops->setattr2 = glusterfs_setattr2;
 	ops->close2 = glusterfs_close2;
 
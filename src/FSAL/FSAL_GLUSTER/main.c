@@ -80,6 +80,13 @@ static struct config_item glfs_params[] = {
 		       fsal_staticfsinfo_t, pnfs_mds),
 	CONF_ITEM_BOOL("pnfs_ds", true,
 		       fsal_staticfsinfo_t, pnfs_ds),
+#ifdef USE_GLUSTER_DELEGATION
+	CONF_ITEM_ENUM_BITS("Delegations",
+			    FSAL_OPTION_NO_DELEGATIONS,
+			    FSAL_OPTION_FILE_DELEGATIONS,
+			    deleg_types, fsal_staticfsinfo_t,
+			    delegations),
+#endif
 	CONFIG_EOL
 };
 
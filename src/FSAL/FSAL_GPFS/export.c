@@ -599,6 +599,12 @@ int gpfs_claim_filesystem(struct fsal_filesystem *fs, struct fsal_export *exp)
 		LogCrit(COMPONENT_THREAD, "can't set pthread's stack size");
 
 	gpfs_fs->up_ops = exp->up_ops;
+	retval = gpfs_up_pool_start(gpfs_fs,
+				    gpfs_up_params(exp->fsal)->workers,
+				    gpfs_up_params(exp->fsal)->window_ms);
+	if (retval != 0)
+		goto errout;
+
 	retval = pthread_create(&gpfs_fs->up_thread,
 				&attr_thr,
 				GPFSFSAL_UP_Thread,
@@ -609,6 +615,7 @@ int gpfs_claim_filesystem(struct fsal_filesystem *fs, struct fsal_export *exp)
 		LogCrit(COMPONENT_THREAD,
 			"Could not create GPFSFSAL_UP_Thread, error = %d (%s)",
 			retval, strerror(retval));
+		gpfs_up_pool_stop(gpfs_fs);
 		goto errout;
 	}
 
@@ -680,6 +687,7 @@ void gpfs_unclaim_filesystem(struct fsal_filesystem *fs)
 		else
 			LogFullDebug(COMPONENT_FSAL, "Thread STOP successful");
 		pthread_join(gpfs_fs->up_thread, NULL);
+		gpfs_up_pool_stop(gpfs_fs);
 		free_gpfs_filesystem(gpfs_fs);
 		fs->private_data = NULL;
 	}
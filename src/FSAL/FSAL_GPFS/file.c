@@ -518,7 +518,7 @@ fsal_status_t gpfs_open2(struct fsal_obj_handle *obj_hdl,
 		status = (*new_obj)->obj_ops.setattr2(*new_obj,
 						      false,
 						      state,
-						      attrib_set);
+						      attrib_set, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			(*new_obj)->obj_ops.release(*new_obj);
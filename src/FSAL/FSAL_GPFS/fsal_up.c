@@ -26,11 +26,426 @@
 #include "fsal_internal.h"
 #include "fsal_convert.h"
 #include "gpfs_methods.h"
+#include "abstract_atomic.h"
+#include "city.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <utime.h>
 #include <sys/time.h>
 
+/** Buckets of the pending invalidations of a shard */
+#define GPFS_UP_HASH 64
+
+/** Seconds between two reports of the upcall statistics */
+#define GPFS_UP_REPORT 60
+
+/**
+ * @brief An inode upcall waiting for a worker
+ */
+struct gpfs_up_event {
+	struct glist_head q;	/*< On the shard queue */
+	struct glist_head hq;	/*< On the pending invalidations */
+	struct timespec queued;
+	struct timespec due;	/*< Not processed before */
+	uint64_t hash;
+	int reason;
+	int flags;
+	uint32_t expire_time_attr;
+	bool invalidate;	/*< Only invalidates, can be coalesced */
+	bool close;		/*< and closes the file */
+	struct stat buf;
+	struct gpfs_file_handle handle;
+};
+
+/**
+ * @brief A worker and the upcalls of its inodes
+ *
+ * An inode always goes to the same shard, so its upcalls are
+ * processed in the order they came.
+ */
+struct gpfs_up_shard {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct glist_head queue;
+	struct glist_head pending[GPFS_UP_HASH];
+	struct gpfs_up_pool *pool;
+	uint32_t index;
+	pthread_t thread;
+};
+
+struct gpfs_up_pool {
+	struct gpfs_filesystem *gpfs_fs;
+	nsecs_elapsed_t window;	/*< How long invalidations wait */
+	bool stop;
+	/* Statistics since the last report */
+	uint64_t events;
+	uint64_t coalesced;
+	uint64_t latency;	/*< Total ns from queued to processed */
+	uint64_t latency_max;
+	uint32_t nshards;
+	struct gpfs_up_shard shards[];
+};
+
+/**
+ * @brief Whether an inode upcall only invalidates the entry
+ */
+static bool gpfs_up_invalidates(int reason, int flags, bool *close)
+{
+	*close = reason == INODE_INVALIDATE;
+
+	if (reason == INODE_INVALIDATE)
+		return true;
+
+	/* Size changes, and changes of anything update() does not take,
+	 * just invalidate.
+	 */
+	return (flags & (UP_SIZE | UP_SIZE_BIG)) ||
+	       (flags & ~(UP_SIZE | UP_NLINK | UP_MODE | UP_OWN | UP_TIMES |
+			  UP_ATIME | UP_SIZE_BIG));
+}
+
+/**
+ * @brief Process an inode upcall
+ */
+static void gpfs_up_process(struct gpfs_filesystem *gpfs_fs,
+			    struct gpfs_up_event *ev)
+{
+	const struct fsal_up_vector *event_func = gpfs_fs->up_ops;
+	struct gsh_buffdesc key;
+	struct attrlist attr;
+	uint32_t upflags = 0;
+	int flags = ev->flags;
+	fsal_status_t fsal_status;
+
+	key.addr = &ev->handle;
+	key.len = ev->handle.handle_key_size;
+
+	if (ev->invalidate) {
+		if (ev->close)
+			fsal_status = event_func->invalidate_close(
+						event_func->up_export, &key,
+						FSAL_UP_INVALIDATE_CACHE);
+		else
+			fsal_status = event_func->invalidate(
+						event_func->up_export, &key,
+						FSAL_UP_INVALIDATE_CACHE);
+		goto out;
+	}
+
+	/** @todo: This notification is completely asynchronous.  If we
+	 * happen to change some of the attributes later, we end up over
+	 * writing those with these possibly stale values as we don't
+	 * know when we get to update with these up call values. We
+	 * should probably use time stamp or let the up call always
+	 * provide UP_TIMES flag in which case we can compare the current
+	 * ctime vs up call provided ctime before updating the
+	 * attributes.
+	 *
+	 * For now, we think size attribute is more important than
+	 * others, so updates with a size change only invalidate the
+	 * attributes (see gpfs_up_invalidates) and let ganesha fetch
+	 * attributes as needed. We are careless for other attribute
+	 * changes, and we may end up with stale values until this gets
+	 * fixed!
+	 */
+
+	/* buf may not have all attributes set.  Since
+	 * posix2fsal_attributes() copies all attributes and also sets
+	 * attr.mask, correct attr.mask with valid upcall flags only
+	 * before passing the attr to update() which actually updates the
+	 * cache_inode object attributes.
+	 */
+	posix2fsal_attributes(&ev->buf, &attr);
+	/* Set the mask to what is changed */
+	attr.valid_mask = 0;
+	if (flags & UP_MODE)
+		attr.valid_mask |= ATTR_CHGTIME | ATTR_CHANGE | ATTR_MODE;
+	if (flags & UP_OWN)
+		attr.valid_mask |= ATTR_CHGTIME | ATTR_CHANGE | ATTR_OWNER;
+	if (flags & UP_TIMES)
+		attr.valid_mask |= ATTR_CHGTIME | ATTR_CHANGE | ATTR_ATIME |
+				   ATTR_CTIME | ATTR_MTIME;
+	if (flags & UP_ATIME)
+		attr.valid_mask |= ATTR_CHGTIME | ATTR_CHANGE | ATTR_ATIME;
+
+	attr.expire_time_attr = ev->expire_time_attr;
+
+	fsal_status = event_func->update(event_func->up_export, &key, &attr,
+					 upflags);
+
+	if ((flags & UP_NLINK) && (attr.numlinks == 0)) {
+		upflags = fsal_up_nlink | fsal_up_close;
+		attr.valid_mask = 0;
+		fsal_status = up_async_update(general_fridge,
+					      event_func->up_export, &key,
+					      &attr, upflags, NULL, NULL);
+	}
+
+out:
+	if (FSAL_IS_ERROR(fsal_status) &&
+	    fsal_status.major != ERR_FSAL_NOENT) {
+		LogWarn(COMPONENT_FSAL_UP,
+			"Event %d could not be processed for fd %d rc %s",
+			ev->reason, gpfs_fs->root_fd,
+			fsal_err_txt(fsal_status));
+	}
+}
+
+/**
+ * @brief Report and reset the upcall statistics
+ */
+static void gpfs_up_report(struct gpfs_up_pool *pool)
+{
+	uint64_t events = atomic_postclear_uint64_t_bits(&pool->events,
+							 UINT64_MAX);
+	uint64_t coalesced = atomic_postclear_uint64_t_bits(&pool->coalesced,
+							    UINT64_MAX);
+	uint64_t latency = atomic_postclear_uint64_t_bits(&pool->latency,
+							  UINT64_MAX);
+	uint64_t latency_max =
+		atomic_postclear_uint64_t_bits(&pool->latency_max, UINT64_MAX);
+
+	if (events == 0 && coalesced == 0)
+		return;
+
+	LogInfo(COMPONENT_FSAL_UP,
+		"GPFS fd %d upcalls: %"PRIu64" processed, %"PRIu64
+		" coalesced, queue latency avg %"PRIu64" us max %"PRIu64
+		" us",
+		pool->gpfs_fs->root_fd, events, coalesced,
+		events != 0 ? latency / events / NS_PER_USEC : 0,
+		latency_max / NS_PER_USEC);
+}
+
+static void *gpfs_up_worker(void *arg)
+{
+	struct gpfs_up_shard *shard = arg;
+	struct gpfs_up_pool *pool = shard->pool;
+	struct gpfs_up_event *ev;
+	struct timespec ts, report;
+	nsecs_elapsed_t latency;
+	char thr_name[16];
+
+	snprintf(thr_name, sizeof(thr_name), "fsal_up_w%"PRIu32,
+		 shard->index);
+	SetNameFunction(thr_name);
+
+	now(&report);
+	report.tv_sec += GPFS_UP_REPORT;
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+
+	while (!pool->stop) {
+		now(&ts);
+
+		if (shard->index == 0 && gsh_time_cmp(&ts, &report) >= 0) {
+			PTHREAD_MUTEX_unlock(&shard->mtx);
+			gpfs_up_report(pool);
+			PTHREAD_MUTEX_lock(&shard->mtx);
+			report = ts;
+			report.tv_sec += GPFS_UP_REPORT;
+			continue;
+		}
+
+		if (glist_empty(&shard->queue)) {
+			(void) pthread_cond_timedwait(&shard->cond,
+						      &shard->mtx, &report);
+			continue;
+		}
+
+		ev = glist_first_entry(&shard->queue, struct gpfs_up_event,
+				       q);
+		if (gsh_time_cmp(&ts, &ev->due) < 0) {
+			(void) pthread_cond_timedwait(&shard->cond,
+						      &shard->mtx, &ev->due);
+			continue;
+		}
+
+		glist_del(&ev->q);
+		if (!glist_null(&ev->hq))
+			glist_del(&ev->hq);
+
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+
+		latency = timespec_diff(&ev->queued, &ts);
+		(void) atomic_inc_uint64_t(&pool->events);
+		(void) atomic_add_uint64_t(&pool->latency, latency);
+		/* Racy, a lost maximum is as good as another one */
+		if (latency > atomic_fetch_uint64_t(&pool->latency_max))
+			atomic_store_uint64_t(&pool->latency_max, latency);
+
+		gpfs_up_process(pool->gpfs_fs, ev);
+		gsh_free(ev);
+
+		PTHREAD_MUTEX_lock(&shard->mtx);
+	}
+
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+
+	return NULL;
+}
+
+/**
+ * @brief Hand an inode upcall to the worker of its inode
+ *
+ * An invalidation of an inode that already has one queued is merged
+ * into it.  An update of the inode ends the merging, so no
+ * invalidation is moved ahead of an update that came before it.
+ */
+static void gpfs_up_queue(struct gpfs_up_pool *pool, int reason, int flags,
+			  struct stat *buf, struct gpfs_file_handle *handle,
+			  uint32_t expire_time_attr)
+{
+	uint64_t hash = CityHash64((char *)handle, handle->handle_key_size);
+	struct gpfs_up_shard *shard = &pool->shards[hash % pool->nshards];
+	struct glist_head *bucket =
+		&shard->pending[(hash / pool->nshards) % GPFS_UP_HASH];
+	struct glist_head *glist;
+	struct gpfs_up_event *ev, *old = NULL;
+	bool invalidate, close;
+
+	invalidate = gpfs_up_invalidates(reason, flags, &close);
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+
+	glist_for_each(glist, bucket) {
+		ev = glist_entry(glist, struct gpfs_up_event, hq);
+		if (ev->hash == hash &&
+		    ev->handle.handle_key_size == handle->handle_key_size &&
+		    memcmp(&ev->handle, handle,
+			   handle->handle_key_size) == 0) {
+			old = ev;
+			break;
+		}
+	}
+
+	if (old != NULL && invalidate) {
+		old->close |= close;
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+		(void) atomic_inc_uint64_t(&pool->coalesced);
+		return;
+	}
+
+	if (old != NULL)
+		glist_del(&old->hq);
+
+	ev = gsh_malloc(sizeof(*ev));
+	now(&ev->queued);
+	ev->due = ev->queued;
+	if (invalidate)
+		timespec_add_nsecs(pool->window, &ev->due);
+	ev->hash = hash;
+	ev->reason = reason;
+	ev->flags = flags;
+	ev->expire_time_attr = expire_time_attr;
+	ev->invalidate = invalidate;
+	ev->close = close;
+	ev->buf = *buf;
+	ev->handle = *handle;
+
+	if (invalidate)
+		glist_add_tail(bucket, &ev->hq);
+	else
+		ev->hq.next = ev->hq.prev = NULL;
+
+	glist_add_tail(&shard->queue, &ev->q);
+	pthread_cond_signal(&shard->cond);
+
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+}
+
+/**
+ * @brief Start the upcall workers of a file system
+ *
+ * @return 0 or an errno.
+ */
+int gpfs_up_pool_start(struct gpfs_filesystem *gpfs_fs, uint32_t workers,
+		       uint32_t window_ms)
+{
+	struct gpfs_up_pool *pool;
+	struct gpfs_up_shard *shard;
+	uint32_t i, j;
+	int rc = 0;
+
+	pool = gsh_calloc(1, sizeof(*pool) + workers * sizeof(*shard));
+	pool->gpfs_fs = gpfs_fs;
+	pool->window = (nsecs_elapsed_t)window_ms * NS_PER_MSEC;
+
+	for (i = 0; i < workers; i++) {
+		shard = &pool->shards[i];
+		PTHREAD_MUTEX_init(&shard->mtx, NULL);
+		PTHREAD_COND_init(&shard->cond, NULL);
+		glist_init(&shard->queue);
+		for (j = 0; j < GPFS_UP_HASH; j++)
+			glist_init(&shard->pending[j]);
+		shard->pool = pool;
+		shard->index = i;
+
+		rc = pthread_create(&shard->thread, NULL, gpfs_up_worker,
+				    shard);
+		if (rc != 0) {
+			PTHREAD_MUTEX_destroy(&shard->mtx);
+			PTHREAD_COND_destroy(&shard->cond);
+			break;
+		}
+		pool->nshards++;
+	}
+
+	gpfs_fs->up_pool = pool;
+
+	if (rc != 0) {
+		LogCrit(COMPONENT_THREAD,
+			"Could not create GPFS upcall worker, error = %d (%s)",
+			rc, strerror(rc));
+		gpfs_up_pool_stop(gpfs_fs);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Stop the upcall workers of a file system
+ *
+ * The upcall thread must be stopped.  Upcalls still queued are
+ * dropped, the file system is going away.
+ */
+void gpfs_up_pool_stop(struct gpfs_filesystem *gpfs_fs)
+{
+	struct gpfs_up_pool *pool = gpfs_fs->up_pool;
+	struct gpfs_up_shard *shard;
+	struct gpfs_up_event *ev;
+	uint32_t i;
+
+	if (pool == NULL)
+		return;
+
+	for (i = 0; i < pool->nshards; i++) {
+		shard = &pool->shards[i];
+		PTHREAD_MUTEX_lock(&shard->mtx);
+		pool->stop = true;
+		pthread_cond_signal(&shard->cond);
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+	}
+
+	for (i = 0; i < pool->nshards; i++) {
+		shard = &pool->shards[i];
+		pthread_join(shard->thread, NULL);
+
+		while ((ev = glist_first_entry(&shard->queue,
+					       struct gpfs_up_event, q))) {
+			glist_del(&ev->q);
+			gsh_free(ev);
+		}
+
+		PTHREAD_MUTEX_destroy(&shard->mtx);
+		PTHREAD_COND_destroy(&shard->cond);
+	}
+
+	gpfs_up_report(pool);
+	gsh_free(pool);
+	gpfs_fs->up_pool = NULL;
+}
+
 /**
  * @brief Up Thread
  *
@@ -54,7 +469,6 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 	int retry = 0;
 	struct gsh_buffdesc key;
 	uint32_t expire_time_attr = 0;
-	uint32_t upflags = 0;
 	int errsv = 0;
 	fsal_status_t fsal_status = {0,};
 
@@ -282,114 +696,15 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 			break;
 
 		case INODE_UPDATE:	/* Update Event */
-			{
-				struct attrlist attr;
+			LogMidDebug(COMPONENT_FSAL_UP,
+				    "inode update: flags:%x update ino %"
+				    PRId64 " n_link:%d",
+				    flags, callback.buf->st_ino,
+				    (int)callback.buf->st_nlink);
 
-				LogMidDebug(COMPONENT_FSAL_UP,
-					    "inode update: flags:%x update ino %"
-					    PRId64 " n_link:%d",
-					    flags, callback.buf->st_ino,
-					    (int)callback.buf->st_nlink);
-
-				/** @todo: This notification is completely
-				 * asynchronous.  If we happen to change some
-				 * of the attributes later, we end up over
-				 * writing those with these possibly stale
-				 * values as we don't know when we get to
-				 * update with these up call values. We should
-				 * probably use time stamp or let the up call
-				 * always provide UP_TIMES flag in which case
-				 * we can compare the current ctime vs up call
-				 * provided ctime before updating the
-				 * attributes.
-				 *
-				 * For now, we think size attribute is more
-				 * important than others, so invalidate the
-				 * attributes and let ganesha fetch attributes
-				 * as needed if this update includes a size
-				 * change. We are careless for other attribute
-				 * changes, and we may end up with stale values
-				 * until this gets fixed!
-				 */
-				if (flags & (UP_SIZE | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func->up_export, &key,
-						FSAL_UP_INVALIDATE_CACHE);
-					break;
-				}
-
-				/* Check for accepted flags, any other changes
-				   just invalidate. */
-				if (flags &
-				    ~(UP_SIZE | UP_NLINK | UP_MODE | UP_OWN |
-				     UP_TIMES | UP_ATIME | UP_SIZE_BIG)) {
-					fsal_status = event_func->invalidate(
-						event_func->up_export, &key,
-						FSAL_UP_INVALIDATE_CACHE);
-				} else {
-					/* buf may not have all attributes set.
-					 * Since posix2fsal_attributes() copies
-					 * all attributes and also sets
-					 * attr.mask, correct attr.mask with
-					 * valid upcall flags only before
-					 * passing the attr to update() which
-					 * actually updates the cache_inode
-					 * object attributes.
-					 */
-					posix2fsal_attributes(&buf, &attr);
-					/* Set the mask to what is changed */
-					attr.valid_mask = 0;
-					if (flags & UP_SIZE)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_SIZE | ATTR_SPACEUSED;
-					if (flags & UP_SIZE_BIG) {
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_SIZE | ATTR_SPACEUSED;
-						upflags |=
-						   fsal_up_update_filesize_inc |
-						   fsal_up_update_spaceused_inc;
-					}
-					if (flags & UP_MODE)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_MODE;
-					if (flags & UP_OWN)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_OWNER;
-					if (flags & UP_TIMES)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_ATIME | ATTR_CTIME |
-						    ATTR_MTIME;
-					if (flags & UP_ATIME)
-						attr.valid_mask |=
-						   ATTR_CHGTIME | ATTR_CHANGE |
-						   ATTR_ATIME;
-
-					attr.expire_time_attr =
-					    expire_time_attr;
-
-					fsal_status = event_func->
-					    update(event_func->up_export,
-						   &key, &attr, upflags);
-
-					if ((flags & UP_NLINK)
-					    && (attr.numlinks == 0)) {
-						upflags = fsal_up_nlink |
-							  fsal_up_close;
-						attr.valid_mask = 0;
-						fsal_status = up_async_update
-						    (general_fridge,
-						     event_func->up_export,
-						     &key, &attr,
-						     upflags, NULL, NULL);
-					}
-				}
-			}
-			break;
+			gpfs_up_queue(gpfs_fs->up_pool, reason, flags, &buf,
+				      &handle, expire_time_attr);
+			continue;
 
 		case THREAD_STOP:  /* We wanted to terminate this thread */
 			LogDebug(COMPONENT_FSAL_UP,
@@ -402,12 +717,9 @@ void *GPFSFSAL_UP_Thread(void *Arg)
 				    "inode invalidate: flags:%x update ino %"
 				    PRId64, flags, callback.buf->st_ino);
 
-			upflags = FSAL_UP_INVALIDATE_CACHE;
-			fsal_status = event_func->invalidate_close(
-						event_func->up_export,
-						&key,
-						upflags);
-			break;
+			gpfs_up_queue(gpfs_fs->up_pool, reason, flags, &buf,
+				      &handle, expire_time_attr);
+			continue;
 
 		case THREAD_PAUSE:
 			/* File system image is probably going away, but
@@ -9,6 +9,14 @@
 
 struct fsal_staticfsinfo_t *gpfs_staticinfo(struct fsal_module *hdl);
 
+/** Upcall workers of each file system, from the GPFS block */
+struct gpfs_up_params {
+	uint32_t workers;
+	uint32_t window_ms;	/*< How long invalidations are coalesced */
+};
+
+struct gpfs_up_params *gpfs_up_params(struct fsal_module *hdl);
+
 /* method proto linkage to handle.c for export
  */
 
@@ -45,8 +53,13 @@ struct gpfs_filesystem {
 	bool up_thread_started;
 	const struct fsal_up_vector *up_ops;
 	pthread_t up_thread; /* upcall thread */
+	struct gpfs_up_pool *up_pool; /* upcall workers */
 };
 
+int gpfs_up_pool_start(struct gpfs_filesystem *gpfs_fs, uint32_t workers,
+		       uint32_t window_ms);
+void gpfs_up_pool_stop(struct gpfs_filesystem *gpfs_fs);
+
 /*
  * Link GPFS file systems and exports
  * Supports a many-to-many relationship
@@ -152,7 +165,8 @@ fsal_status_t gpfs_close2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t gpfs_setattr2(struct fsal_obj_handle *obj_hdl,
 			    bool bypass,
 			    struct state_t *state,
-			    struct attrlist *attrib_set);
+			    struct attrlist *attrib_set,
+			    struct attrlist *attrs_out);
 fsal_status_t gpfs_open(struct fsal_obj_handle *obj_hdl,
 			fsal_openflags_t openflags);
 fsal_status_t gpfs_reopen(struct fsal_obj_handle *obj_hdl,
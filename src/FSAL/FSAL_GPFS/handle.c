@@ -253,7 +253,7 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attr_in);
+						     attr_in, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -324,7 +324,7 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attr_in);
+						     attr_in, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -399,7 +399,7 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attr_in);
+						     attr_in, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -470,7 +470,8 @@ static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_obj_handle *destdir_hdl,
-			      const char *name)
+			      const char *name,
+			      struct attrlist *destdir_attrs_out)
 {
 	fsal_status_t status;
 	struct gpfs_fsal_obj_handle *myself;
@@ -579,7 +580,9 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	fsal_status_t status;
 
@@ -848,7 +851,8 @@ static fsal_status_t setattrs(struct fsal_obj_handle *obj_hdl,
 fsal_status_t gpfs_setattr2(struct fsal_obj_handle *obj_hdl,
 				   bool bypass,
 				   struct state_t *state,
-				   struct attrlist *attrs)
+				   struct attrlist *attrs,
+				   struct attrlist *attrs_out)
 {
 	fsal_status_t status;
 
@@ -862,7 +866,8 @@ fsal_status_t gpfs_setattr2(struct fsal_obj_handle *obj_hdl,
  */
 static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name)
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
 {
 	fsal_status_t status;
 
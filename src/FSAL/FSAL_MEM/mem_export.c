@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* mem_export.c
+ * MEM FSAL export object
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "FSAL/fsal_config.h"
+#include "config_parsing.h"
+#include "nfs_exports.h"
+#include "export_mgr.h"
+#include "mem_int.h"
+
+#ifdef __FreeBSD__
+#include <sys/endian.h>
+
+#define bswap_64(x)     bswap64((x))
+#else
+#include <byteswap.h>
+#endif
+
+/* export object methods
+ */
+
+static void release(struct fsal_export *exp_hdl)
+{
+	struct mem_fsal_export *myself;
+	struct btree_node *node, *next;
+	struct mem_fsal_obj_handle *hdl;
+	struct glist_head *glist, *glistn;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	/* MDCACHE has released all of them by now */
+	for (node = btree_first(&myself->objects); node != NULL; node = next) {
+		next = btree_next(node, &myself->objects);
+		hdl = container_of(node, struct mem_fsal_obj_handle, by_id);
+		mem_free_handle(hdl);
+	}
+	btree_destroy(&myself->objects);
+
+	glist_for_each_safe(glist, glistn, &myself->unlinked) {
+		hdl = glist_entry(glist, struct mem_fsal_obj_handle, unlinked);
+		glist_del(&hdl->unlinked);
+		mem_free_handle(hdl);
+	}
+
+	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
+	free_export_ops(exp_hdl);
+
+	PTHREAD_MUTEX_destroy(&myself->unlinked_lock);
+	PTHREAD_RWLOCK_destroy(&myself->lock);
+	gsh_free(myself->export_path);
+	gsh_free(myself);
+}
+
+static fsal_status_t get_dynamic_info(struct fsal_export *exp_hdl,
+				      struct fsal_obj_handle *obj_hdl,
+				      fsal_dynamicfsinfo_t *infop)
+{
+	struct mem_fsal_export *myself;
+	uint64_t files;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	PTHREAD_RWLOCK_rdlock(&myself->lock);
+	files = btree_size(&myself->objects);
+	PTHREAD_RWLOCK_unlock(&myself->lock);
+
+	/* Only bounded by memory, report plenty of room */
+	infop->total_bytes = INT64_MAX;
+	infop->free_bytes = INT64_MAX;
+	infop->avail_bytes = INT64_MAX;
+	infop->total_files = UINT32_MAX + files;
+	infop->free_files = UINT32_MAX;
+	infop->avail_files = UINT32_MAX;
+	infop->time_delta.tv_sec = 0;
+	infop->time_delta.tv_nsec = 1;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static bool fs_supports(struct fsal_export *exp_hdl,
+			fsal_fsinfo_options_t option)
+{
+	return fsal_supports(mem_staticinfo(exp_hdl->fsal), option);
+}
+
+static uint64_t fs_maxfilesize(struct fsal_export *exp_hdl)
+{
+	return fsal_maxfilesize(mem_staticinfo(exp_hdl->fsal));
+}
+
+static uint32_t fs_maxread(struct fsal_export *exp_hdl)
+{
+	return fsal_maxread(mem_staticinfo(exp_hdl->fsal));
+}
+
+static uint32_t fs_maxwrite(struct fsal_export *exp_hdl)
+{
+	return fsal_maxwrite(mem_staticinfo(exp_hdl->fsal));
+}
+
+static uint32_t fs_maxlink(struct fsal_export *exp_hdl)
+{
+	return fsal_maxlink(mem_staticinfo(exp_hdl->fsal));
+}
+
+static uint32_t fs_maxnamelen(struct fsal_export *exp_hdl)
+{
+	return fsal_maxnamelen(mem_staticinfo(exp_hdl->fsal));
+}
+
+static uint32_t fs_maxpathlen(struct fsal_export *exp_hdl)
+{
+	return fsal_maxpathlen(mem_staticinfo(exp_hdl->fsal));
+}
+
+static struct timespec fs_lease_time(struct fsal_export *exp_hdl)
+{
+	return fsal_lease_time(mem_staticinfo(exp_hdl->fsal));
+}
+
+static fsal_aclsupp_t fs_acl_support(struct fsal_export *exp_hdl)
+{
+	return fsal_acl_support(mem_staticinfo(exp_hdl->fsal));
+}
+
+static attrmask_t fs_supported_attrs(struct fsal_export *exp_hdl)
+{
+	return fsal_supported_attrs(mem_staticinfo(exp_hdl->fsal));
+}
+
+static uint32_t fs_umask(struct fsal_export *exp_hdl)
+{
+	return fsal_umask(mem_staticinfo(exp_hdl->fsal));
+}
+
+static uint32_t fs_xattr_access_rights(struct fsal_export *exp_hdl)
+{
+	return fsal_xattr_access_rights(mem_staticinfo(exp_hdl->fsal));
+}
+
+/* extract a file handle from a buffer.
+ * The handle is two 64 bit words, only the byte order may need fixing.
+ */
+
+static fsal_status_t extract_handle(struct fsal_export *exp_hdl,
+				    fsal_digesttype_t in_type,
+				    struct gsh_buffdesc *fh_desc,
+				    int flags)
+{
+	struct mem_wire_handle *wire;
+
+	if (fh_desc->len != sizeof(struct mem_wire_handle)) {
+		LogMajor(COMPONENT_FSAL,
+			 "Size mismatch for handle.  should be %zu, got %zu",
+			 sizeof(struct mem_wire_handle), fh_desc->len);
+		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
+	}
+
+	wire = fh_desc->addr;
+	if (flags & FH_FSAL_BIG_ENDIAN) {
+#if (BYTE_ORDER != BIG_ENDIAN)
+		wire->fileid = bswap_64(wire->fileid);
+		wire->boot = bswap_64(wire->boot);
+#endif
+	} else {
+#if (BYTE_ORDER == BIG_ENDIAN)
+		wire->fileid = bswap_64(wire->fileid);
+		wire->boot = bswap_64(wire->boot);
+#endif
+	}
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+void mem_export_ops_init(struct export_ops *ops)
+{
+	ops->release = release;
+	ops->lookup_path = mem_lookup_path;
+	ops->extract_handle = extract_handle;
+	ops->create_handle = mem_create_handle;
+	ops->get_fs_dynamic_info = get_dynamic_info;
+	ops->fs_supports = fs_supports;
+	ops->fs_maxfilesize = fs_maxfilesize;
+	ops->fs_maxread = fs_maxread;
+	ops->fs_maxwrite = fs_maxwrite;
+	ops->fs_maxlink = fs_maxlink;
+	ops->fs_maxnamelen = fs_maxnamelen;
+	ops->fs_maxpathlen = fs_maxpathlen;
+	ops->fs_lease_time = fs_lease_time;
+	ops->fs_acl_support = fs_acl_support;
+	ops->fs_supported_attrs = fs_supported_attrs;
+	ops->fs_umask = fs_umask;
+	ops->fs_xattr_access_rights = fs_xattr_access_rights;
+	ops->alloc_state = mem_alloc_state;
+}
+
+static struct config_item export_params[] = {
+	CONF_ITEM_NOOP("name"),
+	CONF_ITEM_UI32("Meta_Latency", 0, 1000000, 0,
+		       mem_fsal_export, meta_latency),
+	CONF_ITEM_UI32("Data_Latency", 0, 1000000, 0,
+		       mem_fsal_export, data_latency),
+	CONFIG_EOL
+};
+
+static struct config_block export_param_block = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.mem-export%d",
+	.blk_desc.name = "FSAL",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = export_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/* create_export
+ * Create an export point and return a handle to it to be kept
+ * in the export list.  MDCACHE is stacked on top by the caller.
+ */
+
+fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
+				void *parse_node,
+				struct config_error_type *err_type,
+				const struct fsal_up_vector *up_ops)
+{
+	struct mem_fsal_export *myself;
+	int retval;
+
+	myself = gsh_calloc(1, sizeof(struct mem_fsal_export));
+
+	fsal_export_init(&myself->export);
+	mem_export_ops_init(&myself->export.exp_ops);
+
+	if (parse_node != NULL) {
+		retval = load_config_from_node(parse_node,
+					       &export_param_block,
+					       myself,
+					       true,
+					       err_type);
+		if (retval != 0) {
+			free_export_ops(&myself->export);
+			gsh_free(myself);
+			return fsalstat(ERR_FSAL_INVAL, 0);
+		}
+	}
+
+	retval = fsal_attach_export(fsal_hdl, &myself->export.exports);
+	if (retval != 0) {
+		LogMajor(COMPONENT_FSAL,
+			 "Could not attach export");
+		free_export_ops(&myself->export);
+		gsh_free(myself);
+		return fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	myself->export.fsal = fsal_hdl;
+	myself->export.up_ops = up_ops;
+	myself->export_path = gsh_strdup(op_ctx->ctx_export->fullpath);
+	PTHREAD_RWLOCK_init(&myself->lock, NULL);
+	btree_init(&myself->objects);
+	glist_init(&myself->unlinked);
+	PTHREAD_MUTEX_init(&myself->unlinked_lock, NULL);
+
+	op_ctx->fsal_export = &myself->export;
+	myself->root_handle = mem_alloc_root(myself);
+
+	LogDebug(COMPONENT_FSAL,
+		 "Created exp %p - %s, latency meta %"PRIu32" data %"PRIu32
+		 " us",
+		 myself, myself->export_path, myself->meta_latency,
+		 myself->data_latency);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
@@ -0,0 +1,1642 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* mem_handle.c
+ * MEM FSAL object handles
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "FSAL/fsal_commonlib.h"
+#include "mem_int.h"
+
+#define MEM_SETTABLE_ATTRIBUTES (					\
+	ATTR_MODE  | ATTR_OWNER | ATTR_GROUP | ATTR_ATIME	 |	\
+	ATTR_CTIME | ATTR_MTIME | ATTR_SIZE  | ATTR_MTIME_SERVER |	\
+	ATTR_ATIME_SERVER)
+
+/* Smallest data buffer of a file that has data */
+#define MEM_DATA_MIN 4096
+
+/* Atomic uint64_t that is used to generate inode numbers, unique across
+ * the exports since MDCACHE keys them by handle only.
+ */
+static uint64_t mem_inode_number;
+
+/* helpers
+ */
+
+static inline int mem_n_cmpf(const struct avltree_node *lhs,
+			     const struct avltree_node *rhs)
+{
+	struct mem_fsal_obj_handle *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_fsal_obj_handle, avl_n);
+	rk = avltree_container_of(rhs, struct mem_fsal_obj_handle, avl_n);
+
+	return strcmp(lk->name, rk->name);
+}
+
+static inline int mem_i_cmpf(const struct avltree_node *lhs,
+			     const struct avltree_node *rhs)
+{
+	struct mem_fsal_obj_handle *lk, *rk;
+
+	lk = avltree_container_of(lhs, struct mem_fsal_obj_handle, avl_i);
+	rk = avltree_container_of(rhs, struct mem_fsal_obj_handle, avl_i);
+
+	if (lk->index < rk->index)
+		return -1;
+
+	if (lk->index == rk->index)
+		return 0;
+
+	return 1;
+}
+
+/* Called with the export lock held */
+static struct mem_fsal_obj_handle *
+mem_dirent_lookup(struct mem_fsal_obj_handle *dir, const char *name)
+{
+	struct mem_fsal_obj_handle key[1];
+	struct avltree_node *node;
+
+	key->name = (char *) name;
+	node = avltree_lookup(&key->avl_n, &dir->mh.dir.avl_name);
+	if (node == NULL)
+		return NULL;
+
+	return avltree_container_of(node, struct mem_fsal_obj_handle, avl_n);
+}
+
+/* First entry of dir with a cookie of at least index */
+static struct mem_fsal_obj_handle *
+mem_dirent_seek(struct mem_fsal_obj_handle *dir, uint64_t index)
+{
+	struct avltree_node *node = dir->mh.dir.avl_index.root;
+	struct mem_fsal_obj_handle *hdl, *found = NULL;
+
+	while (node != NULL) {
+		hdl = avltree_container_of(node, struct mem_fsal_obj_handle,
+					   avl_i);
+		if (hdl->index >= index) {
+			found = hdl;
+			node = node->left;
+		} else {
+			node = node->right;
+		}
+	}
+	return found;
+}
+
+/* Called with the obj_lock held for write */
+static void mem_update_change(struct mem_fsal_obj_handle *hdl, bool modified)
+{
+	uint64_t change;
+
+	now(&hdl->attrs.ctime);
+	hdl->attrs.chgtime = hdl->attrs.ctime;
+	if (modified)
+		hdl->attrs.mtime = hdl->attrs.ctime;
+
+	/* Two changes within a clock tick still differ */
+	change = timespec_to_nsecs(&hdl->attrs.chgtime);
+	hdl->attrs.change = change > hdl->attrs.change ?
+		change : hdl->attrs.change + 1;
+}
+
+static uint32_t mem_default_mode(object_file_type_t type)
+{
+	switch (type) {
+	case DIRECTORY:
+		return 0755;
+	case SYMBOLIC_LINK:
+		return 0777;
+	default:
+		return 0600;
+	}
+}
+
+/**
+ * @brief Allocate an object, in the btree but not in a directory yet
+ *
+ * Called with the export lock held for write.  Mode, owner, group,
+ * atime and mtime are taken from attrs_in when set there.
+ */
+static struct mem_fsal_obj_handle *
+mem_alloc_handle(struct mem_fsal_export *mfe, object_file_type_t type,
+		 struct attrlist *attrs_in)
+{
+	struct mem_fsal_obj_handle *hdl;
+	attrmask_t set = attrs_in != NULL ? attrs_in->valid_mask : 0;
+	uint64_t fileid = atomic_inc_uint64_t(&mem_inode_number);
+
+	hdl = gsh_calloc(1, sizeof(struct mem_fsal_obj_handle));
+
+	hdl->mfe = mfe;
+	hdl->wire.fileid = fileid;
+	hdl->wire.boot = mem_boot;
+	hdl->by_id.key = fileid;
+	glist_init(&hdl->xattrs);
+
+	hdl->attrs.type = type;
+	hdl->attrs.filesize = 0;
+	hdl->attrs.fsid.major = op_ctx->ctx_export->export_id;
+	hdl->attrs.fsid.minor = 0;
+	hdl->attrs.fileid = fileid;
+
+	if (set & ATTR_MODE)
+		hdl->attrs.mode = attrs_in->mode & (~S_IFMT & 0xFFFF) &
+		    ~mfe->export.exp_ops.fs_umask(&mfe->export);
+	else
+		hdl->attrs.mode = mem_default_mode(type);
+
+	hdl->attrs.numlinks = type == DIRECTORY ? 2 : 1;
+
+	if (set & ATTR_OWNER)
+		hdl->attrs.owner = attrs_in->owner;
+	else
+		hdl->attrs.owner = op_ctx->creds->caller_uid;
+
+	if (set & ATTR_GROUP)
+		hdl->attrs.group = attrs_in->group;
+	else
+		hdl->attrs.group = op_ctx->creds->caller_gid;
+
+	now(&hdl->attrs.ctime);
+	hdl->attrs.chgtime = hdl->attrs.ctime;
+	hdl->attrs.atime = set & ATTR_ATIME ? attrs_in->atime
+					    : hdl->attrs.ctime;
+	hdl->attrs.mtime = set & ATTR_MTIME ? attrs_in->mtime
+					    : hdl->attrs.ctime;
+	hdl->attrs.change = timespec_to_nsecs(&hdl->attrs.chgtime);
+	hdl->attrs.valid_mask = ATTRS_POSIX;
+
+	fsal_obj_handle_init(&hdl->obj_handle, &mfe->export, type);
+	mem_handle_ops_init(&hdl->obj_handle.obj_ops);
+	hdl->obj_handle.fsid = hdl->attrs.fsid;
+	hdl->obj_handle.fileid = fileid;
+
+	if (type == DIRECTORY) {
+		avltree_init(&hdl->mh.dir.avl_name, mem_n_cmpf, 0);
+		avltree_init(&hdl->mh.dir.avl_index, mem_i_cmpf, 0);
+		hdl->mh.dir.next_i = 3;	/* 0, 1 and 2 are never cookies */
+	}
+
+	(void) btree_insert(&hdl->by_id, &mfe->objects);
+
+	return hdl;
+}
+
+/* Called with the export lock held for write */
+static void mem_insert_child(struct mem_fsal_obj_handle *dir,
+			     struct mem_fsal_obj_handle *hdl,
+			     const char *name)
+{
+	hdl->name = gsh_strdup(name);
+	hdl->parent = dir;
+	avltree_insert(&hdl->avl_n, &dir->mh.dir.avl_name);
+	hdl->index = dir->mh.dir.next_i++;
+	avltree_insert(&hdl->avl_i, &dir->mh.dir.avl_index);
+	hdl->inavl = true;
+
+	PTHREAD_RWLOCK_wrlock(&dir->obj_handle.obj_lock);
+	if (hdl->obj_handle.type == DIRECTORY)
+		dir->attrs.numlinks++;
+	mem_update_change(dir, true);
+	PTHREAD_RWLOCK_unlock(&dir->obj_handle.obj_lock);
+}
+
+/* Called with the export lock held for write */
+static void mem_remove_child(struct mem_fsal_obj_handle *dir,
+			     struct mem_fsal_obj_handle *hdl)
+{
+	avltree_remove(&hdl->avl_n, &dir->mh.dir.avl_name);
+	avltree_remove(&hdl->avl_i, &dir->mh.dir.avl_index);
+	hdl->inavl = false;
+	gsh_free(hdl->name);
+	hdl->name = NULL;
+
+	PTHREAD_RWLOCK_wrlock(&dir->obj_handle.obj_lock);
+	if (hdl->obj_handle.type == DIRECTORY)
+		dir->attrs.numlinks--;
+	mem_update_change(dir, true);
+	PTHREAD_RWLOCK_unlock(&dir->obj_handle.obj_lock);
+}
+
+/* Called with the export lock held for write, after mem_remove_child */
+static void mem_unlink_object(struct mem_fsal_obj_handle *hdl)
+{
+	btree_remove(&hdl->by_id, &hdl->mfe->objects);
+	hdl->dead = true;
+
+	PTHREAD_MUTEX_lock(&hdl->mfe->unlinked_lock);
+	glist_add_tail(&hdl->mfe->unlinked, &hdl->unlinked);
+	PTHREAD_MUTEX_unlock(&hdl->mfe->unlinked_lock);
+
+	PTHREAD_RWLOCK_wrlock(&hdl->obj_handle.obj_lock);
+	hdl->attrs.numlinks = 0;
+	mem_update_change(hdl, false);
+	PTHREAD_RWLOCK_unlock(&hdl->obj_handle.obj_lock);
+}
+
+/**
+ * @brief Set the size of a file
+ *
+ * Called with the obj_lock held for write.  What is past the old size
+ * reads as zeroes.
+ */
+static fsal_status_t mem_resize(struct mem_fsal_obj_handle *hdl,
+				uint64_t size)
+{
+	uint64_t old = hdl->attrs.filesize;
+	size_t capacity = hdl->mh.file.capacity;
+
+	if (size > (uint64_t) INT64_MAX)
+		return fsalstat(ERR_FSAL_FBIG, EFBIG);
+
+	if (size == 0) {
+		gsh_free(hdl->mh.file.data);
+		hdl->mh.file.data = NULL;
+		hdl->mh.file.capacity = 0;
+	} else if (size > capacity) {
+		if (capacity < MEM_DATA_MIN)
+			capacity = MEM_DATA_MIN;
+		while (capacity < size)
+			capacity *= 2;
+		hdl->mh.file.data = gsh_realloc(hdl->mh.file.data, capacity);
+		hdl->mh.file.capacity = capacity;
+	}
+
+	if (size > old)
+		memset(hdl->mh.file.data + old, 0, size - old);
+
+	hdl->attrs.filesize = size;
+	hdl->attrs.spaceused = size;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static void mem_copy_attrs(struct mem_fsal_obj_handle *hdl,
+			   struct attrlist *attrs_out)
+{
+	PTHREAD_RWLOCK_rdlock(&hdl->obj_handle.obj_lock);
+	fsal_copy_attrs(attrs_out, &hdl->attrs, false);
+	PTHREAD_RWLOCK_unlock(&hdl->obj_handle.obj_lock);
+}
+
+/* Called with the obj_lock held */
+static struct mem_xattr *mem_xattr_by_name(struct mem_fsal_obj_handle *hdl,
+					   const char *name)
+{
+	struct glist_head *glist;
+	struct mem_xattr *xattr;
+
+	glist_for_each(glist, &hdl->xattrs) {
+		xattr = glist_entry(glist, struct mem_xattr, list);
+		if (strcmp(xattr->name, name) == 0)
+			return xattr;
+	}
+	return NULL;
+}
+
+/* Called with the obj_lock held */
+static struct mem_xattr *mem_xattr_by_id(struct mem_fsal_obj_handle *hdl,
+					 unsigned int id)
+{
+	struct glist_head *glist;
+	struct mem_xattr *xattr;
+
+	glist_for_each(glist, &hdl->xattrs) {
+		xattr = glist_entry(glist, struct mem_xattr, list);
+		if (xattr->id == id)
+			return xattr;
+	}
+	return NULL;
+}
+
+static void mem_xattr_free(struct mem_xattr *xattr)
+{
+	gsh_free(xattr->name);
+	gsh_free(xattr);
+}
+
+void mem_free_handle(struct mem_fsal_obj_handle *myself)
+{
+	struct glist_head *glist, *glistn;
+
+	fsal_obj_handle_fini(&myself->obj_handle);
+
+	glist_for_each_safe(glist, glistn, &myself->xattrs) {
+		glist_del(glist);
+		mem_xattr_free(glist_entry(glist, struct mem_xattr, list));
+	}
+
+	if (myself->obj_handle.type == REGULAR_FILE)
+		gsh_free(myself->mh.file.data);
+	else if (myself->obj_handle.type == SYMBOLIC_LINK)
+		gsh_free(myself->mh.symlink.link_contents);
+
+	gsh_free(myself->name);
+	gsh_free(myself);
+}
+
+/* handle methods
+ */
+
+/*
+ * release
+ * Live objects stay, they are still in the namespace.  Does not take
+ * the export lock, MDCACHE may release from a readdir callback.
+ */
+
+static void release(struct fsal_obj_handle *obj_hdl)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_fsal_export *mfe;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	mfe = myself->mfe;
+
+	if (!myself->dead)
+		return;
+
+	PTHREAD_MUTEX_lock(&mfe->unlinked_lock);
+	glist_del(&myself->unlinked);
+	PTHREAD_MUTEX_unlock(&mfe->unlinked_lock);
+
+	LogFullDebug(COMPONENT_FSAL,
+		     "Releasing unlinked hdl=%p fileid=%"PRIu64,
+		     myself, myself->wire.fileid);
+
+	mem_free_handle(myself);
+}
+
+static fsal_status_t merge(struct fsal_obj_handle *orig_hdl,
+			   struct fsal_obj_handle *dupe_hdl)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	struct mem_fsal_obj_handle *orig, *dupe;
+
+	/* Lookups of a live object all return its one handle */
+	if (orig_hdl == dupe_hdl)
+		return status;
+
+	if (orig_hdl->type == REGULAR_FILE &&
+	    dupe_hdl->type == REGULAR_FILE) {
+		orig = container_of(orig_hdl, struct mem_fsal_obj_handle,
+				    obj_handle);
+		dupe = container_of(dupe_hdl, struct mem_fsal_obj_handle,
+				    obj_handle);
+
+		PTHREAD_RWLOCK_wrlock(&orig_hdl->obj_lock);
+		status = merge_share(&orig->mh.file.share,
+				     &dupe->mh.file.share);
+		PTHREAD_RWLOCK_unlock(&orig_hdl->obj_lock);
+	}
+
+	return status;
+}
+
+static fsal_status_t lookup(struct fsal_obj_handle *parent,
+			    const char *path,
+			    struct fsal_obj_handle **handle,
+			    struct attrlist *attrs_out)
+{
+	struct mem_fsal_obj_handle *myself, *hdl = NULL;
+	struct mem_fsal_export *mfe;
+
+	myself = container_of(parent, struct mem_fsal_obj_handle, obj_handle);
+	mfe = myself->mfe;
+
+	mem_latency(mfe->meta_latency);
+
+	/* readdir holds the lock across its callbacks */
+	if (op_ctx->fsal_private != parent)
+		PTHREAD_RWLOCK_rdlock(&mfe->lock);
+
+	if (strcmp(path, "..") == 0)
+		hdl = myself->parent;
+	else if (strcmp(path, ".") == 0)
+		hdl = myself;
+	else
+		hdl = mem_dirent_lookup(myself, path);
+
+	if (hdl != NULL) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Found %s/%s hdl=%p",
+			     myself->name, path, hdl);
+		*handle = &hdl->obj_handle;
+		if (attrs_out != NULL)
+			mem_copy_attrs(hdl, attrs_out);
+	}
+
+	if (op_ctx->fsal_private != parent)
+		PTHREAD_RWLOCK_unlock(&mfe->lock);
+
+	return fsalstat(hdl != NULL ? ERR_FSAL_NO_ERROR : ERR_FSAL_NOENT, 0);
+}
+
+/* Make a directory or a symlink */
+static fsal_status_t mem_create_obj(struct fsal_obj_handle *dir_hdl,
+				    const char *name,
+				    object_file_type_t type,
+				    const char *link_path,
+				    struct attrlist *attrs_in,
+				    struct fsal_obj_handle **handle,
+				    struct attrlist *attrs_out)
+{
+	struct mem_fsal_obj_handle *myself, *hdl;
+	struct mem_fsal_export *mfe;
+
+	*handle = NULL;		/* poison it */
+
+	if (dir_hdl->type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+
+	myself = container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
+	mfe = myself->mfe;
+
+	mem_latency(mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&mfe->lock);
+
+	if (mem_dirent_lookup(myself, name) != NULL) {
+		PTHREAD_RWLOCK_unlock(&mfe->lock);
+		return fsalstat(ERR_FSAL_EXIST, 0);
+	}
+
+	hdl = mem_alloc_handle(mfe, type, attrs_in);
+	if (type == SYMBOLIC_LINK) {
+		hdl->mh.symlink.link_contents = gsh_strdup(link_path);
+		hdl->attrs.filesize = strlen(link_path);
+		hdl->attrs.spaceused = hdl->attrs.filesize;
+	}
+	mem_insert_child(myself, hdl, name);
+
+	PTHREAD_RWLOCK_unlock(&mfe->lock);
+
+	*handle = &hdl->obj_handle;
+	if (attrs_out != NULL)
+		mem_copy_attrs(hdl, attrs_out);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
+			     const char *name,
+			     struct attrlist *attrs_in,
+			     struct fsal_obj_handle **handle,
+			     struct attrlist *attrs_out)
+{
+	LogDebug(COMPONENT_FSAL, "mkdir %s", name);
+
+	return mem_create_obj(dir_hdl, name, DIRECTORY, NULL, attrs_in,
+			      handle, attrs_out);
+}
+
+static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
+				 const char *name,
+				 const char *link_path,
+				 struct attrlist *attrs_in,
+				 struct fsal_obj_handle **handle,
+				 struct attrlist *attrs_out)
+{
+	LogDebug(COMPONENT_FSAL, "symlink %s -> %s", name, link_path);
+
+	return mem_create_obj(dir_hdl, name, SYMBOLIC_LINK, link_path,
+			      attrs_in, handle, attrs_out);
+}
+
+static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
+				 struct gsh_buffdesc *link_content,
+				 bool refresh)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	if (obj_hdl->type != SYMBOLIC_LINK)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	/* The contents never change */
+	link_content->len = strlen(myself->mh.symlink.link_contents) + 1;
+	link_content->addr = gsh_malloc(link_content->len);
+	memcpy(link_content->addr, myself->mh.symlink.link_contents,
+	       link_content->len);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * read_dirents
+ * The cookie of an entry is its index in the directory, which only
+ * grows, so a cookie stays valid across removals.
+ */
+
+static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
+				  fsal_cookie_t *whence,
+				  void *dir_state,
+				  fsal_readdir_cb cb,
+				  attrmask_t attrmask,
+				  bool *eof)
+{
+	struct mem_fsal_obj_handle *myself, *hdl;
+	struct avltree_node *node;
+	struct attrlist attrs;
+	fsal_cookie_t seekloc;
+
+	if (whence != NULL)
+		seekloc = *whence + 1;	/* resume after the cookie */
+	else
+		seekloc = 3;
+
+	*eof = true;
+
+	myself = container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_rdlock(&myself->mfe->lock);
+
+	/* Use fsal_private to signal to lookup that we hold the lock */
+	op_ctx->fsal_private = dir_hdl;
+
+	hdl = mem_dirent_seek(myself, seekloc);
+	while (hdl != NULL) {
+		fsal_prepare_attrs(&attrs, attrmask);
+		mem_copy_attrs(hdl, &attrs);
+
+		if (!cb(hdl->name, &hdl->obj_handle, &attrs, dir_state,
+			hdl->index)) {
+			fsal_release_attrs(&attrs);
+			*eof = false;
+			break;
+		}
+
+		fsal_release_attrs(&attrs);
+		node = avltree_next(&hdl->avl_i);
+		hdl = node == NULL ? NULL :
+		    avltree_container_of(node, struct mem_fsal_obj_handle,
+					 avl_i);
+	}
+
+	op_ctx->fsal_private = NULL;
+
+	PTHREAD_RWLOCK_unlock(&myself->mfe->lock);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
+			      struct attrlist *outattrs)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+	mem_copy_attrs(myself, outattrs);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t setattr2(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      struct state_t *state,
+			      struct attrlist *attrib_set,
+			      struct attrlist *attrs_out)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	attrmask_t set = attrib_set->valid_mask;
+	struct timespec timestamp = {0, 0};
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	if (set & ~MEM_SETTABLE_ATTRIBUTES) {
+		LogDebug(COMPONENT_FSAL,
+			 "bad mask %"PRIx64" not settable %"PRIx64,
+			 set, set & ~MEM_SETTABLE_ATTRIBUTES);
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	}
+
+	if ((set & ATTR_SIZE) && obj_hdl->type != REGULAR_FILE) {
+		LogFullDebug(COMPONENT_FSAL,
+			     "Setting size on non-regular file");
+		return fsalstat(ERR_FSAL_INVAL, EINVAL);
+	}
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	if (set & ATTR_SIZE) {
+		/* A state had its share checked when opened */
+		if (state == NULL) {
+			status = check_share_conflict(&myself->mh.file.share,
+						      FSAL_O_WRITE, bypass);
+			if (FSAL_IS_ERROR(status))
+				goto out;
+		}
+
+		status = mem_resize(myself, attrib_set->filesize);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
+	if (set & ATTR_MODE)
+		myself->attrs.mode = attrib_set->mode & (~S_IFMT & 0xFFFF) &
+		    ~op_ctx->fsal_export->exp_ops.fs_umask(op_ctx->fsal_export);
+
+	if (set & ATTR_OWNER)
+		myself->attrs.owner = attrib_set->owner;
+
+	if (set & ATTR_GROUP)
+		myself->attrs.group = attrib_set->group;
+
+	if (set & (ATTR_ATIME_SERVER | ATTR_MTIME_SERVER))
+		now(&timestamp);
+
+	if (set & ATTR_ATIME)
+		myself->attrs.atime = attrib_set->atime;
+	else if (set & ATTR_ATIME_SERVER)
+		myself->attrs.atime = timestamp;
+
+	if (set & ATTR_MTIME)
+		myself->attrs.mtime = attrib_set->mtime;
+	else if (set & ATTR_MTIME_SERVER)
+		myself->attrs.mtime = timestamp;
+
+	/* The size changing is a modification, mtime follows unless set */
+	mem_update_change(myself,
+			  (set & (ATTR_SIZE | ATTR_MTIME | ATTR_MTIME_SERVER))
+			  == ATTR_SIZE);
+
+	if (set & ATTR_CTIME)
+		myself->attrs.ctime = attrib_set->ctime;
+
+ out:
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	if (attrs_out != NULL && !FSAL_IS_ERROR(status))
+		mem_copy_attrs(myself, attrs_out);
+
+	return status;
+}
+
+/* Whether dir is hdl or below it, called with the export lock held */
+static bool mem_is_below(struct mem_fsal_obj_handle *dir,
+			 struct mem_fsal_obj_handle *hdl)
+{
+	for (; dir != NULL; dir = dir->parent)
+		if (dir == hdl)
+			return true;
+	return false;
+}
+
+static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
+				struct fsal_obj_handle *olddir_hdl,
+				const char *old_name,
+				struct fsal_obj_handle *newdir_hdl,
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
+{
+	struct mem_fsal_obj_handle *olddir, *newdir, *hdl, *dst;
+	struct mem_fsal_export *mfe;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	olddir = container_of(olddir_hdl, struct mem_fsal_obj_handle,
+			      obj_handle);
+	newdir = container_of(newdir_hdl, struct mem_fsal_obj_handle,
+			      obj_handle);
+	mfe = olddir->mfe;
+
+	mem_latency(mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&mfe->lock);
+
+	hdl = mem_dirent_lookup(olddir, old_name);
+	if (hdl == NULL) {
+		error = ERR_FSAL_NOENT;
+		goto unlock;
+	}
+
+	dst = mem_dirent_lookup(newdir, new_name);
+	if (dst == hdl)
+		goto unlock;
+
+	if (hdl->obj_handle.type == DIRECTORY && mem_is_below(newdir, hdl)) {
+		error = ERR_FSAL_INVAL;
+		goto unlock;
+	}
+
+	if (dst != NULL) {
+		if (dst->obj_handle.type == DIRECTORY) {
+			if (hdl->obj_handle.type != DIRECTORY) {
+				error = ERR_FSAL_EXIST;
+				goto unlock;
+			}
+			if (avltree_size(&dst->mh.dir.avl_name) != 0) {
+				error = ERR_FSAL_NOTEMPTY;
+				goto unlock;
+			}
+		} else if (hdl->obj_handle.type == DIRECTORY) {
+			error = ERR_FSAL_EXIST;
+			goto unlock;
+		}
+
+		mem_remove_child(newdir, dst);
+		mem_unlink_object(dst);
+	}
+
+	mem_remove_child(olddir, hdl);
+	mem_insert_child(newdir, hdl, new_name);
+
+	PTHREAD_RWLOCK_wrlock(&hdl->obj_handle.obj_lock);
+	mem_update_change(hdl, false);
+	PTHREAD_RWLOCK_unlock(&hdl->obj_handle.obj_lock);
+
+	if (olddir_attrs_out != NULL)
+		mem_copy_attrs(olddir, olddir_attrs_out);
+	if (newdir_attrs_out != NULL)
+		mem_copy_attrs(newdir, newdir_attrs_out);
+
+ unlock:
+	PTHREAD_RWLOCK_unlock(&mfe->lock);
+
+	return fsalstat(error, 0);
+}
+
+/* file_unlink
+ * unlink the named file in the directory
+ */
+
+static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
+				 struct fsal_obj_handle *obj_hdl,
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
+{
+	struct mem_fsal_obj_handle *myself, *hdl;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	myself = container_of(dir_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&myself->mfe->lock);
+
+	hdl = mem_dirent_lookup(myself, name);
+	if (hdl == NULL) {
+		error = ERR_FSAL_NOENT;
+	} else if (hdl->obj_handle.type == DIRECTORY &&
+		   avltree_size(&hdl->mh.dir.avl_name) != 0) {
+		error = ERR_FSAL_NOTEMPTY;
+	} else {
+		mem_remove_child(myself, hdl);
+		mem_unlink_object(hdl);
+		if (parent_attrs_out != NULL)
+			mem_copy_attrs(myself, parent_attrs_out);
+	}
+
+	PTHREAD_RWLOCK_unlock(&myself->mfe->lock);
+
+	return fsalstat(error, 0);
+}
+
+/**
+ * @brief Open a file with the obj_lock held for write
+ *
+ * Checks the verifier of an exclusive create, takes the share of a
+ * state or the global "fd" and truncates.
+ */
+static fsal_status_t mem_open_locked(struct mem_fsal_obj_handle *myself,
+				     struct state_t *state,
+				     fsal_openflags_t openflags,
+				     enum fsal_create_mode createmode,
+				     fsal_verifier_t verifier)
+{
+	struct mem_state_fd *mstate;
+	fsal_status_t status;
+
+	if (createmode >= FSAL_EXCLUSIVE &&
+	    createmode != FSAL_EXCLUSIVE_9P &&
+	    !check_verifier_attrlist(&myself->attrs, verifier))
+		return fsalstat(ERR_FSAL_EXIST, EEXIST);
+
+	if (state != NULL) {
+		status = check_share_conflict(&myself->mh.file.share,
+					      openflags, false);
+		if (FSAL_IS_ERROR(status))
+			return status;
+
+		update_share_counters(&myself->mh.file.share,
+				      FSAL_O_CLOSED, openflags);
+		mstate = container_of(state, struct mem_state_fd, state);
+		mstate->openflags = openflags;
+	} else {
+		myself->mh.file.openflags = openflags;
+	}
+
+	if (openflags & FSAL_O_TRUNC) {
+		(void) mem_resize(myself, 0);
+		mem_update_change(myself, true);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_errors_t mem_not_file(object_file_type_t type)
+{
+	switch (type) {
+	case DIRECTORY:
+		return ERR_FSAL_ISDIR;
+	case SYMBOLIC_LINK:
+		return ERR_FSAL_SYMLINK;
+	default:
+		return ERR_FSAL_BADTYPE;
+	}
+}
+
+/**
+ * @brief Open a file, and possibly create it
+ *
+ * If name is NULL, obj_hdl is the file itself, otherwise it is the
+ * parent directory.
+ */
+static fsal_status_t open2(struct fsal_obj_handle *obj_hdl,
+			   struct state_t *state,
+			   fsal_openflags_t openflags,
+			   enum fsal_create_mode createmode,
+			   const char *name,
+			   struct attrlist *attrib_set,
+			   fsal_verifier_t verifier,
+			   struct fsal_obj_handle **new_obj,
+			   struct attrlist *attrs_out,
+			   bool *caller_perm_check)
+{
+	struct mem_fsal_obj_handle *myself, *hdl;
+	struct mem_fsal_export *mfe;
+	struct attrlist verifier_attr;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	mfe = myself->mfe;
+
+	/* Now fixup attrs for verifier if exclusive create */
+	if (createmode >= FSAL_EXCLUSIVE) {
+		if (attrib_set == NULL) {
+			memset(&verifier_attr, 0, sizeof(verifier_attr));
+			attrib_set = &verifier_attr;
+		}
+
+		set_common_verifier(attrib_set, verifier);
+	}
+
+	mem_latency(mfe->meta_latency);
+
+	if (name == NULL) {
+		/* This is an open by handle */
+		if (obj_hdl->type != REGULAR_FILE)
+			return fsalstat(mem_not_file(obj_hdl->type), 0);
+
+		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+		status = mem_open_locked(myself, state, openflags, createmode,
+					 verifier);
+		if (!FSAL_IS_ERROR(status) && attrs_out != NULL)
+			fsal_copy_attrs(attrs_out, &myself->attrs, false);
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+		/* No permission check was done here */
+		*caller_perm_check = !FSAL_IS_ERROR(status);
+		return status;
+	}
+
+	if (obj_hdl->type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+
+	PTHREAD_RWLOCK_wrlock(&mfe->lock);
+
+	hdl = mem_dirent_lookup(myself, name);
+
+	if (hdl != NULL) {
+		if (createmode == FSAL_GUARDED) {
+			status = fsalstat(ERR_FSAL_EXIST, EEXIST);
+			goto unlock;
+		}
+		if (hdl->obj_handle.type != REGULAR_FILE) {
+			status = fsalstat(createmode == FSAL_NO_CREATE ?
+					  mem_not_file(hdl->obj_handle.type) :
+					  ERR_FSAL_EXIST, 0);
+			goto unlock;
+		}
+
+		PTHREAD_RWLOCK_wrlock(&hdl->obj_handle.obj_lock);
+		status = mem_open_locked(hdl, state, openflags, createmode,
+					 verifier);
+		PTHREAD_RWLOCK_unlock(&hdl->obj_handle.obj_lock);
+		if (FSAL_IS_ERROR(status))
+			goto unlock;
+
+		/* The permissions of an existing file were not checked */
+		*caller_perm_check = true;
+	} else {
+		if (createmode == FSAL_NO_CREATE) {
+			status = fsalstat(ERR_FSAL_NOENT, ENOENT);
+			goto unlock;
+		}
+
+		hdl = mem_alloc_handle(mfe, REGULAR_FILE, attrib_set);
+		mem_insert_child(myself, hdl, name);
+
+		/* Nobody else can see it yet, the open does not conflict */
+		PTHREAD_RWLOCK_wrlock(&hdl->obj_handle.obj_lock);
+		(void) mem_open_locked(hdl, state, openflags, FSAL_UNCHECKED,
+				       verifier);
+		if (attrib_set != NULL &&
+		    (attrib_set->valid_mask & ATTR_SIZE) != 0)
+			status = mem_resize(hdl, attrib_set->filesize);
+		PTHREAD_RWLOCK_unlock(&hdl->obj_handle.obj_lock);
+
+		*caller_perm_check = false;
+	}
+
+	*new_obj = &hdl->obj_handle;
+	if (attrs_out != NULL)
+		mem_copy_attrs(hdl, attrs_out);
+
+ unlock:
+	PTHREAD_RWLOCK_unlock(&mfe->lock);
+
+	return status;
+}
+
+static fsal_openflags_t status2(struct fsal_obj_handle *obj_hdl,
+				struct state_t *state)
+{
+	return container_of(state, struct mem_state_fd, state)->openflags;
+}
+
+static fsal_status_t reopen2(struct fsal_obj_handle *obj_hdl,
+			     struct state_t *state,
+			     fsal_openflags_t openflags)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_state_fd *mstate;
+	fsal_status_t status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	mstate = container_of(state, struct mem_state_fd, state);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	/* We can conflict with old share, so go ahead and check now. */
+	status = check_share_conflict(&myself->mh.file.share, openflags,
+				      false);
+	if (!FSAL_IS_ERROR(status)) {
+		update_share_counters(&myself->mh.file.share,
+				      mstate->openflags, openflags);
+		mstate->openflags = openflags;
+
+		if (openflags & FSAL_O_TRUNC) {
+			(void) mem_resize(myself, 0);
+			mem_update_change(myself, true);
+		}
+	}
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+static fsal_status_t read2(struct fsal_obj_handle *obj_hdl,
+			   bool bypass,
+			   struct state_t *state,
+			   uint64_t offset,
+			   size_t buffer_size,
+			   void *buffer,
+			   size_t *read_amount,
+			   bool *end_of_file,
+			   struct io_info *info)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	uint64_t size;
+
+	if (info != NULL) {
+		/* Currently we don't support READ_PLUS */
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(mem_not_file(obj_hdl->type), 0);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->data_latency);
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+
+	if (state == NULL) {
+		status = check_share_conflict(&myself->mh.file.share,
+					      FSAL_O_READ, bypass);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
+	size = myself->attrs.filesize;
+	if (offset >= size) {
+		*read_amount = 0;
+	} else {
+		*read_amount = MIN(buffer_size, size - offset);
+		memcpy(buffer, myself->mh.file.data + offset, *read_amount);
+	}
+	*end_of_file = offset + *read_amount >= size;
+
+ out:
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+static fsal_status_t write2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    size_t buffer_size,
+			    void *buffer,
+			    size_t *wrote_amount,
+			    bool *fsal_stable,
+			    struct io_info *info)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+	if (info != NULL) {
+		/* Currently we don't support WRITE_PLUS */
+		return fsalstat(ERR_FSAL_NOTSUPP, 0);
+	}
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(mem_not_file(obj_hdl->type), 0);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->data_latency);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	if (state == NULL) {
+		status = check_share_conflict(&myself->mh.file.share,
+					      FSAL_O_WRITE, bypass);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
+	if (offset + buffer_size > myself->attrs.filesize) {
+		if (offset + buffer_size < offset) {
+			status = fsalstat(ERR_FSAL_FBIG, EFBIG);
+			goto out;
+		}
+		status = mem_resize(myself, offset + buffer_size);
+		if (FSAL_IS_ERROR(status))
+			goto out;
+	}
+
+	memcpy(myself->mh.file.data + offset, buffer, buffer_size);
+	*wrote_amount = buffer_size;
+	mem_update_change(myself, true);
+
+ out:
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+/* Memory is as stable as it gets, only the latency of a flush is left */
+static fsal_status_t commit2(struct fsal_obj_handle *obj_hdl,
+			     off_t offset, size_t len)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	mem_latency(myself->mfe->data_latency);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_openflags_t status(struct fsal_obj_handle *obj_hdl)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	return obj_hdl->type == REGULAR_FILE ? myself->mh.file.openflags
+					     : FSAL_O_CLOSED;
+}
+
+/* Close the global "fd" */
+static fsal_status_t file_close(struct fsal_obj_handle *obj_hdl)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	if (obj_hdl->type != REGULAR_FILE)
+		return fsalstat(ERR_FSAL_NOT_OPENED, 0);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+	if (myself->mh.file.openflags == FSAL_O_CLOSED)
+		error = ERR_FSAL_NOT_OPENED;
+	myself->mh.file.openflags = FSAL_O_CLOSED;
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return fsalstat(error, 0);
+}
+
+static fsal_status_t close2(struct fsal_obj_handle *obj_hdl,
+			    struct state_t *state)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_state_fd *mstate;
+
+	if (state == NULL)
+		return file_close(obj_hdl);
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+	mstate = container_of(state, struct mem_state_fd, state);
+
+	if (state->state_type == STATE_TYPE_SHARE ||
+	    state->state_type == STATE_TYPE_NLM_SHARE ||
+	    state->state_type == STATE_TYPE_9P_FID) {
+		/* This is a share state, we must update the share counters */
+		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+		update_share_counters(&myself->mh.file.share,
+				      mstate->openflags, FSAL_O_CLOSED);
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+	}
+
+	mstate->openflags = FSAL_O_CLOSED;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* extended attributes
+ */
+
+static fsal_status_t list_ext_attrs(struct fsal_obj_handle *obj_hdl,
+				    unsigned int cookie,
+				    fsal_xattrent_t *xattrs_tab,
+				    unsigned int xattrs_tabsize,
+				    unsigned int *nb_returned,
+				    int *end_of_list)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct glist_head *glist;
+	struct mem_xattr *xattr;
+	unsigned int n = 0;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	*end_of_list = true;
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+
+	/* In the order of their ids */
+	glist_for_each(glist, &myself->xattrs) {
+		xattr = glist_entry(glist, struct mem_xattr, list);
+		if (xattr->id < cookie)
+			continue;
+		if (n == xattrs_tabsize) {
+			*end_of_list = false;
+			break;
+		}
+		xattrs_tab[n].xattr_id = xattr->id;
+		xattrs_tab[n].xattr_cookie = xattr->id + 1;
+		strncpy(xattrs_tab[n].xattr_name, xattr->name, MAXNAMLEN);
+		xattrs_tab[n].xattr_name[MAXNAMLEN] = '\0';
+		n++;
+	}
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	*nb_returned = n;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
+					   const char *xattr_name,
+					   unsigned int *xattr_id)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_xattr *xattr;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+	xattr = mem_xattr_by_name(myself, xattr_name);
+	if (xattr != NULL)
+		*xattr_id = xattr->id;
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return fsalstat(xattr != NULL ? ERR_FSAL_NO_ERROR : ERR_FSAL_NOENT, 0);
+}
+
+/* Called with the obj_lock held */
+static fsal_status_t mem_xattr_value(struct mem_xattr *xattr,
+				     caddr_t buffer_addr,
+				     size_t buffer_size,
+				     size_t *output_size)
+{
+	if (xattr == NULL)
+		return fsalstat(ERR_FSAL_NOENT, 0);
+
+	*output_size = xattr->len;
+	if (buffer_size < xattr->len)
+		return fsalstat(ERR_FSAL_TOOSMALL, 0);
+
+	memcpy(buffer_addr, xattr->value, xattr->len);
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
+					      const char *xattr_name,
+					      caddr_t buffer_addr,
+					      size_t buffer_size,
+					      size_t *output_size)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+	status = mem_xattr_value(mem_xattr_by_name(myself, xattr_name),
+				 buffer_addr, buffer_size, output_size);
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+static fsal_status_t getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    caddr_t buffer_addr,
+					    size_t buffer_size,
+					    size_t *output_size)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_rdlock(&obj_hdl->obj_lock);
+	status = mem_xattr_value(mem_xattr_by_id(myself, xattr_id),
+				 buffer_addr, buffer_size, output_size);
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+/* Put a new value in place of old, called with the obj_lock held */
+static void mem_xattr_replace(struct mem_fsal_obj_handle *myself,
+			      struct mem_xattr *old,
+			      const char *name,
+			      caddr_t buffer_addr,
+			      size_t buffer_size)
+{
+	struct mem_xattr *xattr;
+
+	xattr = gsh_malloc(sizeof(struct mem_xattr) + buffer_size);
+	xattr->name = gsh_strdup(name);
+	xattr->len = buffer_size;
+	memcpy(xattr->value, buffer_addr, buffer_size);
+
+	if (old != NULL) {
+		xattr->id = old->id;
+		glist_add(&old->list, &xattr->list);
+		glist_del(&old->list);
+		mem_xattr_free(old);
+	} else {
+		xattr->id = myself->next_xattr++;
+		glist_add_tail(&myself->xattrs, &xattr->list);
+	}
+
+	mem_update_change(myself, false);
+}
+
+static fsal_status_t setextattr_value(struct fsal_obj_handle *obj_hdl,
+				      const char *xattr_name,
+				      caddr_t buffer_addr,
+				      size_t buffer_size,
+				      int create)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_xattr *old;
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	old = mem_xattr_by_name(myself, xattr_name);
+	if (old != NULL && create)
+		error = ERR_FSAL_EXIST;
+	else if (old == NULL && !create)
+		error = ERR_FSAL_NOENT;
+	else
+		mem_xattr_replace(myself, old, xattr_name, buffer_addr,
+				  buffer_size);
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return fsalstat(error, 0);
+}
+
+static fsal_status_t setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
+					    unsigned int xattr_id,
+					    caddr_t buffer_addr,
+					    size_t buffer_size)
+{
+	struct mem_fsal_obj_handle *myself;
+	struct mem_xattr *old;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+
+	old = mem_xattr_by_id(myself, xattr_id);
+	if (old != NULL)
+		mem_xattr_replace(myself, old, old->name, buffer_addr,
+				  buffer_size);
+
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return fsalstat(old != NULL ? ERR_FSAL_NO_ERROR : ERR_FSAL_NOENT, 0);
+}
+
+/* Called with the obj_lock held for write */
+static fsal_status_t mem_xattr_remove(struct mem_fsal_obj_handle *myself,
+				      struct mem_xattr *xattr)
+{
+	if (xattr == NULL)
+		return fsalstat(ERR_FSAL_NOENT, 0);
+
+	glist_del(&xattr->list);
+	mem_xattr_free(xattr);
+	mem_update_change(myself, false);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static fsal_status_t remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
+					  unsigned int xattr_id)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+	status = mem_xattr_remove(myself, mem_xattr_by_id(myself, xattr_id));
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+static fsal_status_t remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
+					    const char *xattr_name)
+{
+	struct mem_fsal_obj_handle *myself;
+	fsal_status_t status;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	mem_latency(myself->mfe->meta_latency);
+
+	PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+	status = mem_xattr_remove(myself,
+				  mem_xattr_by_name(myself, xattr_name));
+	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+}
+
+static fsal_status_t handle_digest(const struct fsal_obj_handle *obj_hdl,
+				   fsal_digesttype_t output_type,
+				   struct gsh_buffdesc *fh_desc)
+{
+	const struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, const struct mem_fsal_obj_handle,
+			      obj_handle);
+
+	switch (output_type) {
+	case FSAL_DIGEST_NFSV3:
+	case FSAL_DIGEST_NFSV4:
+		if (fh_desc->len < sizeof(myself->wire)) {
+			LogMajor(COMPONENT_FSAL,
+				 "Space too small for handle.  need %zu, have %zu",
+				 sizeof(myself->wire), fh_desc->len);
+			return fsalstat(ERR_FSAL_TOOSMALL, 0);
+		}
+
+		memcpy(fh_desc->addr, &myself->wire, sizeof(myself->wire));
+		fh_desc->len = sizeof(myself->wire);
+		break;
+
+	default:
+		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
+	}
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+static void handle_to_key(struct fsal_obj_handle *obj_hdl,
+			  struct gsh_buffdesc *fh_desc)
+{
+	struct mem_fsal_obj_handle *myself;
+
+	myself = container_of(obj_hdl, struct mem_fsal_obj_handle, obj_handle);
+
+	fh_desc->addr = &myself->wire;
+	fh_desc->len = sizeof(myself->wire);
+}
+
+void mem_handle_ops_init(struct fsal_obj_ops *ops)
+{
+	ops->release = release;
+	ops->merge = merge;
+	ops->lookup = lookup;
+	ops->readdir = read_dirents;
+	ops->mkdir = makedir;
+	ops->symlink = makesymlink;
+	ops->readlink = readsymlink;
+	ops->getattrs = getattrs;
+	ops->setattr2 = setattr2;
+	ops->rename = renamefile;
+	ops->unlink = file_unlink;
+	ops->open2 = open2;
+	ops->status2 = status2;
+	ops->reopen2 = reopen2;
+	ops->read2 = read2;
+	ops->write2 = write2;
+	ops->commit2 = commit2;
+	ops->close2 = close2;
+	ops->status = status;
+	ops->close = file_close;
+	ops->list_ext_attrs = list_ext_attrs;
+	ops->getextattr_id_by_name = getextattr_id_by_name;
+	ops->getextattr_value_by_name = getextattr_value_by_name;
+	ops->getextattr_value_by_id = getextattr_value_by_id;
+	ops->setextattr_value = setextattr_value;
+	ops->setextattr_value_by_id = setextattr_value_by_id;
+	ops->remove_extattr_by_id = remove_extattr_by_id;
+	ops->remove_extattr_by_name = remove_extattr_by_name;
+	ops->handle_digest = handle_digest;
+	ops->handle_to_key = handle_to_key;
+}
+
+/* export methods that create object handles
+ */
+
+/* Called once, from create_export */
+struct mem_fsal_obj_handle *mem_alloc_root(struct mem_fsal_export *mfe)
+{
+	struct mem_fsal_obj_handle *hdl;
+	struct attrlist attrs;
+
+	memset(&attrs, 0, sizeof(attrs));
+	attrs.valid_mask = ATTR_MODE | ATTR_OWNER | ATTR_GROUP;
+	attrs.mode = 0755;
+
+	PTHREAD_RWLOCK_wrlock(&mfe->lock);
+	hdl = mem_alloc_handle(mfe, DIRECTORY, &attrs);
+	hdl->name = gsh_strdup(mfe->export_path);
+	PTHREAD_RWLOCK_unlock(&mfe->lock);
+
+	return hdl;
+}
+
+fsal_status_t mem_lookup_path(struct fsal_export *exp_hdl,
+			      const char *path,
+			      struct fsal_obj_handle **handle,
+			      struct attrlist *attrs_out)
+{
+	struct mem_fsal_export *myself;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	if (strcmp(path, myself->export_path) != 0) {
+		/* Lookup of a path other than the export's root. */
+		LogCrit(COMPONENT_FSAL,
+			"Attempt to lookup non-root path %s",
+			path);
+		return fsalstat(ERR_FSAL_NOENT, ENOENT);
+	}
+
+	*handle = &myself->root_handle->obj_handle;
+
+	if (attrs_out != NULL)
+		mem_copy_attrs(myself->root_handle, attrs_out);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/* create_handle
+ * The fileid of the handle finds the object, if it is still live.
+ */
+
+fsal_status_t mem_create_handle(struct fsal_export *exp_hdl,
+				struct gsh_buffdesc *hdl_desc,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out)
+{
+	struct mem_fsal_export *myself;
+	struct mem_wire_handle wire;
+	struct btree_node *node;
+	struct mem_fsal_obj_handle *hdl;
+
+	*handle = NULL;
+
+	myself = container_of(exp_hdl, struct mem_fsal_export, export);
+
+	if (hdl_desc->len != sizeof(wire)) {
+		LogCrit(COMPONENT_FSAL,
+			"Invalid handle size %zu expected %zu",
+			hdl_desc->len, sizeof(wire));
+		return fsalstat(ERR_FSAL_BADHANDLE, 0);
+	}
+
+	memcpy(&wire, hdl_desc->addr, sizeof(wire));
+	if (wire.boot != mem_boot)
+		return fsalstat(ERR_FSAL_STALE, ESTALE);
+
+	mem_latency(myself->meta_latency);
+
+	PTHREAD_RWLOCK_rdlock(&myself->lock);
+
+	node = btree_lookup(wire.fileid, &myself->objects);
+	if (node == NULL) {
+		PTHREAD_RWLOCK_unlock(&myself->lock);
+		LogDebug(COMPONENT_FSAL,
+			 "Could not find handle");
+		return fsalstat(ERR_FSAL_STALE, ESTALE);
+	}
+
+	hdl = container_of(node, struct mem_fsal_obj_handle, by_id);
+	*handle = &hdl->obj_handle;
+	if (attrs_out != NULL)
+		mem_copy_attrs(hdl, attrs_out);
+
+	PTHREAD_RWLOCK_unlock(&myself->lock);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+struct state_t *mem_alloc_state(struct fsal_export *exp_hdl,
+				enum state_type state_type,
+				struct state_t *related_state)
+{
+	return init_state(gsh_calloc(1, sizeof(struct mem_state_fd)),
+			  exp_hdl, state_type, related_state);
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file   mem_int.h
+ * @brief  Internal declarations of the MEM FSAL
+ *
+ * FSAL_MEM keeps a whole export in memory: directories, regular files
+ * with their data, symlinks and extended attributes.  Nothing is
+ * persistent.  It is meant to measure the protocol layers, the
+ * dispatcher, XDR, SAL and MDCACHE, without a backing filesystem in
+ * the way; Meta_Latency and Data_Latency add a fixed delay to the
+ * metadata and data calls to stand in for one.
+ */
+
+#ifndef MEM_INT_H
+#define MEM_INT_H
+
+#include "fsal.h"
+#include "fsal_types.h"
+#include "fsal_api.h"
+#include "avltree.h"
+#include "gsh_list.h"
+#include "sal_data.h"
+
+struct mem_fsal_obj_handle;
+
+struct mem_fsal_module {
+	struct fsal_module fsal;
+	struct fsal_staticfsinfo_t fs_info;
+};
+
+extern struct mem_fsal_module MEMFS;
+
+struct mem_fsal_export {
+	struct fsal_export export;
+	char *export_path;
+	struct mem_fsal_obj_handle *root_handle;
+	/** Namespace of the export, and objects */
+	pthread_rwlock_t lock;
+	/** Live objects by fileid, for create_handle */
+	struct btree objects;
+	/** Unlinked objects not released yet */
+	struct glist_head unlinked;
+	pthread_mutex_t unlinked_lock;
+	uint32_t meta_latency;	/*< Microseconds */
+	uint32_t data_latency;	/*< Microseconds */
+};
+
+/** What goes on the wire */
+struct mem_wire_handle {
+	uint64_t fileid;
+	uint64_t boot;		/*< Handles of an earlier run are stale */
+};
+
+struct mem_xattr {
+	struct glist_head list;
+	uint32_t id;
+	char *name;
+	size_t len;
+	char value[];
+};
+
+/**
+ * @brief Object of a MEM export
+ *
+ * Attributes, data and xattrs are under the obj_lock of the handle,
+ * the tree of names under the lock of the export, taken first.  Live
+ * objects are only freed with the export, the unlinked ones on their
+ * last release.
+ */
+struct mem_fsal_obj_handle {
+	struct fsal_obj_handle obj_handle;
+	struct attrlist attrs;
+	struct mem_wire_handle wire;
+	struct mem_fsal_export *mfe;
+	struct btree_node by_id;
+	struct glist_head unlinked;	/*< Once out of the namespace */
+	struct mem_fsal_obj_handle *parent;
+	char *name;
+	struct avltree_node avl_n;
+	struct avltree_node avl_i;
+	uint32_t index;		/*< Cookie in the parent */
+	bool inavl;
+	bool dead;		/*< Unlinked, for good */
+	struct glist_head xattrs;
+	uint32_t next_xattr;
+	union {
+		struct {
+			struct avltree avl_name;
+			struct avltree avl_index;
+			uint32_t next_i;
+		} dir;
+		struct {
+			struct fsal_share share;
+			fsal_openflags_t openflags;	/*< Global "fd" */
+			char *data;
+			size_t capacity;
+		} file;
+		struct {
+			char *link_contents;
+		} symlink;
+	} mh;
+};
+
+/** The state_t of an open as MEM has no fds, what it was opened for */
+struct mem_state_fd {
+	struct state_t state;
+	fsal_openflags_t openflags;
+};
+
+extern uint64_t mem_boot;
+
+struct fsal_staticfsinfo_t *mem_staticinfo(struct fsal_module *hdl);
+
+void mem_latency(uint32_t usec);
+
+void mem_handle_ops_init(struct fsal_obj_ops *ops);
+void mem_export_ops_init(struct export_ops *ops);
+
+struct mem_fsal_obj_handle *mem_alloc_root(struct mem_fsal_export *myself);
+void mem_free_handle(struct mem_fsal_obj_handle *myself);
+
+fsal_status_t mem_lookup_path(struct fsal_export *exp_hdl,
+			      const char *path,
+			      struct fsal_obj_handle **handle,
+			      struct attrlist *attrs_out);
+
+fsal_status_t mem_create_handle(struct fsal_export *exp_hdl,
+				struct gsh_buffdesc *hdl_desc,
+				struct fsal_obj_handle **handle,
+				struct attrlist *attrs_out);
+
+struct state_t *mem_alloc_state(struct fsal_export *exp_hdl,
+				enum state_type state_type,
+				struct state_t *related_state);
+
+fsal_status_t mem_create_export(struct fsal_module *fsal_hdl,
+				void *parse_node,
+				struct config_error_type *err_type,
+				const struct fsal_up_vector *up_ops);
+
+#endif /* MEM_INT_H */
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* mem_main.c
+ * Module core functions
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "fsal.h"
+#include "FSAL/fsal_init.h"
+#include "FSAL/fsal_commonlib.h"
+#include "mem_int.h"
+
+#define MEM_SUPPORTED_ATTRIBUTES (				\
+	ATTR_TYPE     | ATTR_SIZE     |				\
+	ATTR_FSID     | ATTR_FILEID   |				\
+	ATTR_MODE     | ATTR_NUMLINKS | ATTR_OWNER     |	\
+	ATTR_GROUP    | ATTR_ATIME    | ATTR_RAWDEV    |	\
+	ATTR_CTIME    | ATTR_MTIME    | ATTR_SPACEUSED |	\
+	ATTR_CHGTIME)
+
+static const char memname[] = "MEM";
+
+/* filesystem info for MEM */
+static struct fsal_staticfsinfo_t default_mem_info = {
+	.maxfilesize = INT64_MAX,
+	.maxlink = 1,
+	.maxnamelen = MAXNAMLEN,
+	.maxpathlen = MAXPATHLEN,
+	.no_trunc = true,
+	.chown_restricted = true,
+	.case_insensitive = false,
+	.case_preserving = true,
+	.link_support = false,
+	.symlink_support = true,
+	.lock_support = false,
+	.lock_support_owner = false,
+	.lock_support_async_block = false,
+	.named_attr = true,
+	.unique_handles = true,
+	.lease_time = {10, 0},
+	.acl_support = 0,
+	.cansettime = true,
+	.homogenous = true,
+	.supported_attrs = MEM_SUPPORTED_ATTRIBUTES,
+	.maxread = FSAL_MAXIOSIZE,
+	.maxwrite = FSAL_MAXIOSIZE,
+	.umask = 0,
+	.auth_exportpath_xdev = false,
+	.xattr_access_rights = 0400,	/* root=RW, owner=R */
+	.link_supports_permission_checks = false,
+};
+
+struct mem_fsal_module MEMFS;
+
+/** Makes the handles of a restarted server stale */
+uint64_t mem_boot;
+
+struct fsal_staticfsinfo_t *mem_staticinfo(struct fsal_module *hdl)
+{
+	struct mem_fsal_module *myself;
+
+	myself = container_of(hdl, struct mem_fsal_module, fsal);
+	return &myself->fs_info;
+}
+
+/**
+ * @brief Stand in for the latency of a backing filesystem
+ */
+void mem_latency(uint32_t usec)
+{
+	struct timespec delay;
+
+	if (usec == 0)
+		return;
+
+	delay.tv_sec = usec / 1000000;
+	delay.tv_nsec = (usec % 1000000) * 1000;
+	while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+		;
+}
+
+static fsal_status_t init_config(struct fsal_module *fsal_hdl,
+				 config_file_t config_struct,
+				 struct config_error_type *err_type)
+{
+	struct mem_fsal_module *myself =
+	    container_of(fsal_hdl, struct mem_fsal_module, fsal);
+
+	myself->fs_info = default_mem_info;
+	display_fsinfo(&myself->fs_info);
+	LogDebug(COMPONENT_FSAL,
+		 "FSAL INIT: Supported attributes mask = 0x%" PRIx64,
+		 myself->fs_info.supported_attrs);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Indicate support for extended operations.
+ *
+ * @retval true if extended operations are supported.
+ */
+
+static bool mem_support_ex(struct fsal_obj_handle *obj)
+{
+	return true;
+}
+
+MODULE_INIT void mem_init(void)
+{
+	struct fsal_module *myself = &MEMFS.fsal;
+
+	if (register_fsal(myself, memname, FSAL_MAJOR_VERSION,
+			  FSAL_MINOR_VERSION, FSAL_ID_NO_PNFS) != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"MEM module failed to register.");
+		return;
+	}
+
+	myself->m_ops.create_export = mem_create_export;
+	myself->m_ops.init_config = init_config;
+	myself->m_ops.support_ex = mem_support_ex;
+
+	mem_boot = time(NULL);
+}
+
+MODULE_FINI void mem_unload(void)
+{
+	if (unregister_fsal(&MEMFS.fsal) != 0)
+		LogCrit(COMPONENT_FSAL,
+			"MEM module failed to unregister.");
+}
@@ -309,12 +309,10 @@ do { \
 	opcnt++;							\
 } while (0)
 
-#define COMPOUNDV4_ARG_ADD_OP_RESTOREFH(argcompound) \
+#define COMPOUNDV4_ARG_ADD_OP_RESTOREFH(opcnt, argarray) \
 do { \
-	argcompound.argarray.argarray_val[\
-		argcompound.argarray.argarray_len].argop		\
-		= NFS4_OP_RESTOREFH;					\
-	argcompound.argarray.argarray_len += 1;				\
+	argarray[opcnt].argop = NFS4_OP_RESTOREFH;			\
+	opcnt++;							\
 } while (0)
 
 #define COMPOUNDV4_ARG_ADD_OP_READ(opcnt, argarray, inoffset, incount) \
@@ -49,16 +49,45 @@
 static clientid4 pxy_clientid;
 static pthread_mutex_t pxy_clientid_mutex = PTHREAD_MUTEX_INITIALIZER;
 static char pxy_hostname[MAXNAMLEN + 1];
-static pthread_t pxy_recv_thread;
 static pthread_t pxy_renewer_thread;
-static struct glist_head rpc_calls;
 static struct glist_head free_contexts;
-static int rpc_sock = -1;
 static uint32_t rpc_xid;
 static pthread_mutex_t listlock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t sockless = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t reconnected = PTHREAD_COND_INITIALIZER;
 static pthread_cond_t need_context = PTHREAD_COND_INITIALIZER;
 
+/** Buckets of the calls awaiting a reply, by XID, a power of two */
+#define PXY_CALL_HASH 256
+
+/** I/O contexts, so calls in flight, per connection */
+#define PXY_CONTEXTS_PER_CONN 16
+
+/*
+ * Calls sent and awaiting their reply, protected by listlock.
+ */
+static struct glist_head rpc_calls[PXY_CALL_HASH];
+
+/*
+ * A connection to the remote server.
+ *
+ * sock is only changed by the connection's receiver thread, holding
+ * both sendlock and listlock, so a sender holding sendlock writes to a
+ * socket that stays open.
+ */
+struct pxy_rpc_conn {
+	int sock;
+	unsigned int idx;
+	pthread_t recv_thread;
+	pthread_mutex_t sendlock;
+	struct pxy_client_params *info;
+};
+
+static struct pxy_rpc_conn *rpc_conns;
+static unsigned int rpc_nconns;
+static unsigned int rpc_nconnected;	/* protected by listlock */
+static uint32_t rpc_next_conn;
+
 /*
  * Protects the "free_contexts" list and the "need_context" condition.
  */
@@ -70,6 +99,7 @@ struct pxy_rpc_io_context {
 	pthread_mutex_t iolock;
 	pthread_cond_t iowait;
 	struct glist_head calls;
+	struct pxy_rpc_conn *conn;	/* Connection it was sent on */
 	uint32_t rpc_xid;
 	int iodone;
 	int ioresult;
@@ -252,6 +282,22 @@ static struct bitmap4 pxy_bitmap_getattr = {
 	.bitmap4_len = 2
 };
 
+/* Same as pxy_bitmap_getattr, plus the handle of the entries */
+static struct bitmap4 pxy_bitmap_readdir = {
+	.map[0] =
+	    (PXY_ATTR_BIT(FATTR4_TYPE) | PXY_ATTR_BIT(FATTR4_CHANGE) |
+	     PXY_ATTR_BIT(FATTR4_SIZE) | PXY_ATTR_BIT(FATTR4_FSID) |
+	     PXY_ATTR_BIT(FATTR4_FILEHANDLE) | PXY_ATTR_BIT(FATTR4_FILEID)),
+	.map[1] =
+	    (PXY_ATTR_BIT2(FATTR4_MODE) | PXY_ATTR_BIT2(FATTR4_NUMLINKS) |
+	     PXY_ATTR_BIT2(FATTR4_OWNER) | PXY_ATTR_BIT2(FATTR4_OWNER_GROUP) |
+	     PXY_ATTR_BIT2(FATTR4_SPACE_USED) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_ACCESS) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_METADATA) |
+	     PXY_ATTR_BIT2(FATTR4_TIME_MODIFY) | PXY_ATTR_BIT2(FATTR4_RAWDEV)),
+	.bitmap4_len = 2
+};
+
 static struct bitmap4 pxy_bitmap_fsinfo = {
 	.map[0] =
 	    (PXY_ATTR_BIT(FATTR4_FILES_AVAIL) | PXY_ATTR_BIT(FATTR4_FILES_FREE)
@@ -332,6 +378,17 @@ static GETATTR4resok *pxy_fill_getattr_reply(nfs_resop4 *resop, char *blob,
 	return a;
 }
 
+/* The attributes of a GETATTR ending a compound, none if they don't parse */
+static void pxy_attrs_after(struct attrlist *attrs, GETATTR4resok *atok)
+{
+	if (nfs4_Fattr_To_FSAL_attr(attrs, &atok->obj_attributes, NULL) ==
+	    NFS4_OK)
+		return;
+
+	fsal_release_attrs(attrs);
+	attrs->valid_mask = 0;
+}
+
 static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 			     u_int xid)
 {
@@ -371,6 +428,11 @@ static int pxy_got_rpc_reply(struct pxy_rpc_io_context *ctx, int sock, int sz,
 	return size;
 }
 
+static inline struct glist_head *pxy_rpc_bucket(uint32_t xid)
+{
+	return &rpc_calls[xid & (PXY_CALL_HASH - 1)];
+}
+
 static int pxy_rpc_read_reply(int sock)
 {
 	struct {
@@ -398,7 +460,7 @@ static int pxy_rpc_read_reply(int sock)
 	h.recmark &= ~(1U << 31);
 
 	PTHREAD_MUTEX_lock(&listlock);
-	glist_for_each(c, &rpc_calls) {
+	glist_for_each(c, pxy_rpc_bucket(h.xid)) {
 		struct pxy_rpc_io_context *ctx =
 		    container_of(c, struct pxy_rpc_io_context, calls);
 
@@ -425,33 +487,43 @@ static int pxy_rpc_read_reply(int sock)
 	return 0;
 }
 
-static void pxy_new_socket_ready(void)
+static void pxy_new_socket_ready(struct pxy_rpc_conn *conn)
 {
 	struct glist_head *nxt;
 	struct glist_head *c;
+	int i;
 
 	/* If there is anyone waiting for the socket then tell them
-	 * it's ready */
+	 * it's ready, the first connection also carries the client id */
 	pthread_cond_broadcast(&sockless);
+	if (conn->idx == 0)
+		pthread_cond_broadcast(&reconnected);
 
-	/* If there are any outstanding calls then tell them to resend */
-	glist_for_each_safe(c, nxt, &rpc_calls) {
-		struct pxy_rpc_io_context *ctx =
-		    container_of(c, struct pxy_rpc_io_context, calls);
+	/* If there are any calls outstanding on the old socket then tell
+	 * them to resend */
+	for (i = 0; i < PXY_CALL_HASH; i++) {
+		glist_for_each_safe(c, nxt, &rpc_calls[i]) {
+			struct pxy_rpc_io_context *ctx =
+			    container_of(c, struct pxy_rpc_io_context, calls);
+
+			if (ctx->conn != conn)
+				continue;
 
-		glist_del(c);
+			glist_del(c);
 
-		PTHREAD_MUTEX_lock(&ctx->iolock);
-		ctx->iodone = 1;
-		ctx->ioresult = -EAGAIN;
-		pthread_cond_signal(&ctx->iowait);
-		PTHREAD_MUTEX_unlock(&ctx->iolock);
+			PTHREAD_MUTEX_lock(&ctx->iolock);
+			ctx->iodone = 1;
+			ctx->ioresult = -EAGAIN;
+			pthread_cond_signal(&ctx->iowait);
+			PTHREAD_MUTEX_unlock(&ctx->iolock);
+		}
 	}
 }
 
-static int pxy_connect(struct pxy_client_params *info,
+static int pxy_connect(struct pxy_rpc_conn *conn,
 		       struct sockaddr_in *dest)
 {
+	struct pxy_client_params *info = conn->info;
 	int sock;
 
 	if (info->use_privileged_client_port) {
@@ -473,20 +545,21 @@ static int pxy_connect(struct pxy_client_params *info,
 			close(sock);
 			sock = -1;
 		} else {
-			pxy_new_socket_ready();
+			pxy_new_socket_ready(conn);
 		}
 	}
 	return sock;
 }
 
 /*
- * NB! rpc_sock can be closed by the sending thread but it will not be
- *     changing its value. Only this function will change rpc_sock which
- *     means that it can look at the value without holding the lock.
+ * NB! conn->sock can be shut down by a sending thread but it will not be
+ *     changing its value. Only this function will change conn->sock
+ *     which means that it can look at the value without holding the lock.
  */
 static void *pxy_rpc_recv(void *arg)
 {
-	struct pxy_client_params *info = arg;
+	struct pxy_rpc_conn *conn = arg;
+	struct pxy_client_params *info = conn->info;
 	struct sockaddr_in addr_rpc;
 	struct sockaddr_in *info_sock = (struct sockaddr_in *)&info->srv_addr;
 	char addr[INET_ADDRSTRLEN];
@@ -504,8 +577,8 @@ static void *pxy_rpc_recv(void *arg)
 
 		PTHREAD_MUTEX_lock(&listlock);
 		do {
-			rpc_sock = pxy_connect(info, &addr_rpc);
-			if (rpc_sock < 0) {
+			conn->sock = pxy_connect(conn, &addr_rpc);
+			if (conn->sock < 0) {
 				if (nsleeps == 0)
 					LogCrit(COMPONENT_FSAL,
 						"Cannot connect to server %s:%u",
@@ -520,16 +593,17 @@ static void *pxy_rpc_recv(void *arg)
 				PTHREAD_MUTEX_lock(&listlock);
 			} else {
 				LogDebug(COMPONENT_FSAL,
-					 "Connected after %d sleeps, resending outstanding calls",
-					 nsleeps);
+					 "Connection %u up after %d sleeps, resending outstanding calls",
+					 conn->idx, nsleeps);
+				rpc_nconnected++;
 			}
-		} while (rpc_sock < 0);
+		} while (conn->sock < 0);
 		PTHREAD_MUTEX_unlock(&listlock);
 
-		pfd.fd = rpc_sock;
+		pfd.fd = conn->sock;
 		pfd.events = POLLIN | POLLRDHUP;
 
-		while (rpc_sock >= 0) {
+		while (conn->sock >= 0) {
 			switch (poll(&pfd, 1, millisec)) {
 			case 0:
 				LogDebug(COMPONENT_FSAL,
@@ -547,16 +621,19 @@ static void *pxy_rpc_recv(void *arg)
 					LogEvent(COMPONENT_FSAL,
 						 "Socket is closed");
 				} else {
-					if (pxy_rpc_read_reply(rpc_sock) >= 0)
+					if (pxy_rpc_read_reply(conn->sock) >= 0)
 						continue;
 				}
 				break;
 			}
 
+			PTHREAD_MUTEX_lock(&conn->sendlock);
 			PTHREAD_MUTEX_lock(&listlock);
-			close(rpc_sock);
-			rpc_sock = -1;
+			close(conn->sock);
+			conn->sock = -1;
+			rpc_nconnected--;
 			PTHREAD_MUTEX_unlock(&listlock);
+			PTHREAD_MUTEX_unlock(&conn->sendlock);
 		}
 	}
 
@@ -651,7 +728,7 @@ static enum clnt_stat pxy_process_reply(struct pxy_rpc_io_context *ctx,
 static void pxy_rpc_need_sock(void)
 {
 	PTHREAD_MUTEX_lock(&listlock);
-	while (rpc_sock < 0)
+	while (rpc_nconnected == 0)
 		pthread_cond_wait(&sockless, &listlock);
 	PTHREAD_MUTEX_unlock(&listlock);
 }
@@ -665,11 +742,30 @@ static int pxy_rpc_renewer_wait(int timeout)
 	ts.tv_sec = time(NULL) + timeout;
 	ts.tv_nsec = 0;
 
-	rc = pthread_cond_timedwait(&sockless, &listlock, &ts);
+	rc = pthread_cond_timedwait(&reconnected, &listlock, &ts);
 	PTHREAD_MUTEX_unlock(&listlock);
 	return (rc == ETIMEDOUT);
 }
 
+/**
+ * @brief Pick a connected connection, round robin
+ *
+ * Called with listlock held.
+ */
+static struct pxy_rpc_conn *pxy_rpc_pick_conn(void)
+{
+	uint32_t n = atomic_inc_uint32_t(&rpc_next_conn);
+	unsigned int i;
+
+	for (i = 0; i < rpc_nconns; i++) {
+		struct pxy_rpc_conn *conn = &rpc_conns[(n + i) % rpc_nconns];
+
+		if (conn->sock >= 0)
+			return conn;
+	}
+	return NULL;
+}
+
 static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 			       const struct user_cred *cred,
 			       COMPOUND4args *args, COMPOUND4res *res)
@@ -718,34 +814,51 @@ static int pxy_compoundv4_call(struct pxy_rpc_io_context *pcontext,
 		do {
 			int bc = 0;
 			char *buf = pcontext->sendbuf;
+			struct pxy_rpc_conn *conn;
 
 			LogDebug(COMPONENT_FSAL, "%ssend XID %u with %d bytes",
 				 (first_try ? "First attempt to " : "Re"),
 				 rmsg.rm_xid, pos);
-			PTHREAD_MUTEX_lock(&listlock);
-			while (bc < pos) {
-				int wc = write(rpc_sock, buf, pos - bc);
-
-				if (wc <= 0) {
-					close(rpc_sock);
-					break;
-				}
-				bc += wc;
-				buf += wc;
-			}
 
-			if (bc == pos) {
+			/* On the list before it is sent, the reply may come
+			 * back before write returns */
+			PTHREAD_MUTEX_lock(&listlock);
+			conn = pxy_rpc_pick_conn();
+			if (conn != NULL) {
+				pcontext->conn = conn;
 				if (first_try) {
-					glist_add_tail(&rpc_calls,
-						       &pcontext->calls);
+					glist_add_tail(
+					    pxy_rpc_bucket(rmsg.rm_xid),
+					    &pcontext->calls);
 					first_try = 0;
 				}
-			} else {
-				if (!first_try)
-					glist_del(&pcontext->calls);
 			}
 			PTHREAD_MUTEX_unlock(&listlock);
 
+			if (conn != NULL) {
+				PTHREAD_MUTEX_lock(&conn->sendlock);
+				while (conn->sock >= 0 && bc < pos) {
+					int wc = write(conn->sock, buf,
+						       pos - bc);
+
+					if (wc <= 0) {
+						/* the receiver closes it */
+						shutdown(conn->sock,
+							 SHUT_RDWR);
+						break;
+					}
+					bc += wc;
+					buf += wc;
+				}
+				PTHREAD_MUTEX_unlock(&conn->sendlock);
+			}
+
+			if (bc != pos) {
+				PTHREAD_MUTEX_lock(&listlock);
+				glist_del(&pcontext->calls);
+				PTHREAD_MUTEX_unlock(&listlock);
+			}
+
 			if (bc == pos)
 				rc = pxy_process_reply(pcontext, res);
 			else
@@ -831,7 +944,7 @@ static int pxy_setclientid(clientid4 *resultclientid, uint32_t *lease_time)
 	LogEvent(COMPONENT_FSAL,
 		 "Negotiating a new ClientId with the remote server");
 
-	if (getsockname(rpc_sock, &sin, &slen))
+	if (getsockname(rpc_conns[0].sock, &sin, &slen))
 		return -errno;
 
 	snprintf(clientid_name, MAXNAMLEN, "%s(%d) - GANESHA NFSv4 Proxy",
@@ -944,9 +1057,10 @@ static void free_io_contexts(void)
 int pxy_init_rpc(const struct pxy_fsal_module *pm)
 {
 	int rc;
-	int i = 16;
+	int i;
 
-	glist_init(&rpc_calls);
+	for (i = 0; i < PXY_CALL_HASH; i++)
+		glist_init(&rpc_calls[i]);
 	glist_init(&free_contexts);
 
 /**
@@ -963,7 +1077,16 @@ int pxy_init_rpc(const struct pxy_fsal_module *pm)
 		strncpy(pxy_hostname, "NFS-GANESHA/Proxy",
 			sizeof(pxy_hostname));
 
-	for (i = 16; i > 0; i--) {
+	rpc_nconns = pm->special.srv_connections;
+	rpc_conns = gsh_calloc(rpc_nconns, sizeof(*rpc_conns));
+	for (i = 0; i < rpc_nconns; i++) {
+		rpc_conns[i].sock = -1;
+		rpc_conns[i].idx = i;
+		rpc_conns[i].info = (struct pxy_client_params *)&pm->special;
+		PTHREAD_MUTEX_init(&rpc_conns[i].sendlock, NULL);
+	}
+
+	for (i = PXY_CONTEXTS_PER_CONN * rpc_nconns; i > 0; i--) {
 		struct pxy_rpc_io_context *c =
 		    gsh_malloc(sizeof(*c) + pm->special.srv_sendsize +
 			       pm->special.srv_recvsize);
@@ -982,14 +1105,16 @@ int pxy_init_rpc(const struct pxy_fsal_module *pm)
 		glist_add(&free_contexts, &c->calls);
 	}
 
-	rc = pthread_create(&pxy_recv_thread, NULL, pxy_rpc_recv,
-			    (void *)&pm->special);
-	if (rc) {
-		LogCrit(COMPONENT_FSAL,
-			"Cannot create proxy rpc receiver thread - %s",
-			strerror(rc));
-		free_io_contexts();
-		return rc;
+	for (i = 0; i < rpc_nconns; i++) {
+		rc = pthread_create(&rpc_conns[i].recv_thread, NULL,
+				    pxy_rpc_recv, &rpc_conns[i]);
+		if (rc) {
+			LogCrit(COMPONENT_FSAL,
+				"Cannot create proxy rpc receiver thread - %s",
+				strerror(rc));
+			free_io_contexts();
+			return rc;
+		}
 	}
 
 	rc = pthread_create(&pxy_renewer_thread, NULL, pxy_clientid_renewer,
@@ -1494,15 +1619,18 @@ static fsal_status_t pxy_readlink(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t pxy_link(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_obj_handle *destdir_hdl,
-			      const char *name)
+			      const char *name,
+			      struct attrlist *destdir_attrs_out)
 {
 	int rc;
 	struct pxy_obj_handle *tgt;
 	struct pxy_obj_handle *dst;
-#define FSAL_LINK_NB_OP_ALLOC 4
+#define FSAL_LINK_NB_OP_ALLOC 5
 	nfs_argop4 argoparray[FSAL_LINK_NB_OP_ALLOC];
 	nfs_resop4 resoparray[FSAL_LINK_NB_OP_ALLOC];
 	int opcnt = 0;
+	GETATTR4resok *atok = NULL;
+	char fattr_blob[FATTR_BLOB_SZ];
 
 	/* Tests if hardlinking is allowed by configuration. */
 	if (!op_ctx->fsal_export->exp_ops.fs_supports(op_ctx->fsal_export,
@@ -1517,9 +1645,23 @@ static fsal_status_t pxy_link(struct fsal_obj_handle *obj_hdl,
 	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, dst->fh4);
 	COMPOUNDV4_ARG_ADD_OP_LINK(opcnt, argoparray, (char *)name);
 
+	/* The directory is the current filehandle after LINK */
+	if (destdir_attrs_out != NULL) {
+		atok = pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
+					      sizeof(fattr_blob));
+		COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray,
+					      pxy_bitmap_getattr);
+	}
+
 	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
 			    opcnt, argoparray, resoparray);
-	return nfsstat4_to_fsal(rc);
+	if (rc != NFS4_OK)
+		return nfsstat4_to_fsal(rc);
+
+	if (atok != NULL)
+		pxy_attrs_after(destdir_attrs_out, atok);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
 static bool xdr_readdirres(XDR *x, nfs_resop4 *rdres)
@@ -1552,7 +1694,7 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	rdok = &resoparray[opcnt].nfs_resop4_u.opreaddir.READDIR4res_u.resok4;
 	rdok->reply.entries = NULL;
 	COMPOUNDV4_ARG_ADD_OP_READDIR(opcnt, argoparray, *cookie,
-				      pxy_bitmap_getattr);
+				      pxy_bitmap_readdir);
 
 	rc = pxy_nfsv4_call(ph->obj.export, op_ctx->creds, opcnt, argoparray,
 			    resoparray);
@@ -1564,6 +1706,8 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 	for (e4 = rdok->reply.entries; e4; e4 = e4->nextentry) {
 		struct attrlist attrs;
 		char name[MAXNAMLEN + 1];
+		char fhbuf[NFS4_FHSIZE];
+		nfs_fh4 fh = { .nfs_fh4_len = 0, .nfs_fh4_val = fhbuf };
 		struct fsal_obj_handle *handle;
 		bool cb_rc;
 
@@ -1573,20 +1717,25 @@ static fsal_status_t pxy_do_readdir(struct pxy_obj_handle *ph,
 		memcpy(name, e4->name.utf8string_val, e4->name.utf8string_len);
 		name[e4->name.utf8string_len] = '\0';
 
-		if (nfs4_Fattr_To_FSAL_attr(&attrs, &e4->attrs, NULL))
+		if (nfs4_Fattr_To_FSAL_attr_fh(&attrs, &e4->attrs, &fh))
 			return fsalstat(ERR_FSAL_FAULT, 0);
 
 		*cookie = e4->cookie;
 
-		/** @todo FSF: this could be handled by getting handle as part
-		 *             of readdir attributes. However, if acl is
-		 *             requested, we might get it separately to
-		 *             avoid over large READDIR response.
+		/* The handle comes with the entry, only look it up when
+		 * the server did not return it.
 		 */
-		st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
-				     op_ctx->creds, name, &handle, NULL);
-		if (FSAL_IS_ERROR(st))
+		if (fh.nfs_fh4_len != 0)
+			st = pxy_make_object(op_ctx->fsal_export, &e4->attrs,
+					     &fh, &handle, NULL);
+		else
+			st = pxy_lookup_impl(&ph->obj, op_ctx->fsal_export,
+					     op_ctx->creds, name, &handle,
+					     NULL);
+		if (FSAL_IS_ERROR(st)) {
+			fsal_release_attrs(&attrs);
 			break;
+		}
 
 		cb_rc = cb(name, handle, &attrs, cbarg, e4->cookie);
 
@@ -1628,15 +1777,19 @@ static fsal_status_t pxy_rename(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	int rc;
 	int opcnt = 0;
-#define FSAL_RENAME_NB_OP_ALLOC 4
+#define FSAL_RENAME_NB_OP_ALLOC 7
 	nfs_argop4 argoparray[FSAL_RENAME_NB_OP_ALLOC];
 	nfs_resop4 resoparray[FSAL_RENAME_NB_OP_ALLOC];
 	struct pxy_obj_handle *src;
 	struct pxy_obj_handle *tgt;
+	GETATTR4resok *new_atok = NULL, *old_atok = NULL;
+	char new_blob[FATTR_BLOB_SZ], old_blob[FATTR_BLOB_SZ];
 
 	src = container_of(olddir_hdl, struct pxy_obj_handle, obj);
 	tgt = container_of(newdir_hdl, struct pxy_obj_handle, obj);
@@ -1646,9 +1799,38 @@ static fsal_status_t pxy_rename(struct fsal_obj_handle *obj_hdl,
 	COMPOUNDV4_ARG_ADD_OP_RENAME(opcnt, argoparray, (char *)old_name,
 				     (char *)new_name);
 
+	/* After RENAME the new directory is current, the old one saved */
+	if (olddir_hdl == newdir_hdl && newdir_attrs_out == NULL) {
+		newdir_attrs_out = olddir_attrs_out;
+		olddir_attrs_out = NULL;
+	}
+
+	if (newdir_attrs_out != NULL) {
+		new_atok = pxy_fill_getattr_reply(resoparray + opcnt, new_blob,
+						  sizeof(new_blob));
+		COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray,
+					      pxy_bitmap_getattr);
+	}
+
+	if (olddir_attrs_out != NULL) {
+		COMPOUNDV4_ARG_ADD_OP_RESTOREFH(opcnt, argoparray);
+		old_atok = pxy_fill_getattr_reply(resoparray + opcnt, old_blob,
+						  sizeof(old_blob));
+		COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray,
+					      pxy_bitmap_getattr);
+	}
+
 	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
 			    opcnt, argoparray, resoparray);
-	return nfsstat4_to_fsal(rc);
+	if (rc != NFS4_OK)
+		return nfsstat4_to_fsal(rc);
+
+	if (new_atok != NULL)
+		pxy_attrs_after(newdir_attrs_out, new_atok);
+	if (old_atok != NULL)
+		pxy_attrs_after(olddir_attrs_out, old_atok);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
 static fsal_status_t pxy_getattrs(struct fsal_obj_handle *obj_hdl,
@@ -1771,7 +1953,8 @@ static bool pxy_handle_is(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t pxy_unlink(struct fsal_obj_handle *dir_hdl,
 				struct fsal_obj_handle *obj_hdl,
-				const char *name)
+				const char *name,
+				struct attrlist *parent_attrs_out)
 {
 	int opcnt = 0;
 	int rc;
@@ -1779,33 +1962,27 @@ static fsal_status_t pxy_unlink(struct fsal_obj_handle *dir_hdl,
 #define FSAL_UNLINK_NB_OP_ALLOC 3
 	nfs_argop4 argoparray[FSAL_UNLINK_NB_OP_ALLOC];
 	nfs_resop4 resoparray[FSAL_UNLINK_NB_OP_ALLOC];
-#if GETATTR_AFTER
-	GETATTR4resok *atok;
+	GETATTR4resok *atok = NULL;
 	char fattr_blob[FATTR_BLOB_SZ];
-	struct attrlist dirattr;
-#endif
 
 	ph = container_of(dir_hdl, struct pxy_obj_handle, obj);
 	COMPOUNDV4_ARG_ADD_OP_PUTFH(opcnt, argoparray, ph->fh4);
 	COMPOUNDV4_ARG_ADD_OP_REMOVE(opcnt, argoparray, (char *)name);
 
-#if GETATTR_AFTER
-	atok =
-	    pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
-				   sizeof(fattr_blob));
-	COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray, pxy_bitmap_getattr);
-#endif
+	if (parent_attrs_out != NULL) {
+		atok = pxy_fill_getattr_reply(resoparray + opcnt, fattr_blob,
+					      sizeof(fattr_blob));
+		COMPOUNDV4_ARG_ADD_OP_GETATTR(opcnt, argoparray,
+					      pxy_bitmap_getattr);
+	}
 
 	rc = pxy_nfsv4_call(op_ctx->fsal_export, op_ctx->creds,
 			    opcnt, argoparray, resoparray);
 	if (rc != NFS4_OK)
 		return nfsstat4_to_fsal(rc);
 
-#if GETATTR_AFTER
-	if (nfs4_Fattr_To_FSAL_attr(&dirattr, &atok->obj_attributes, NULL) ==
-	    NFS4_OK)
-		ph->attributes = dirattr;
-#endif
+	if (atok != NULL)
+		pxy_attrs_after(parent_attrs_out, atok);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -38,198 +38,171 @@
 #include "handle_mapping.h"
 #include "handle_mapping_db.h"
 #include "handle_mapping_internal.h"
+#include "gsh_list.h"
+#include "common_utils.h"
 
-static hash_table_t *handle_map_hash;
-
-/* memory pool definitions */
-
-typedef struct digest_pool_entry__ {
-	nfs23_map_handle_t nfs23_digest;
-} digest_pool_entry_t;
+/* The map is split in stripes, each with its own lock
+ * and HANDLEMAP_STRIPE_BUCKETS hash chains.
+ */
+#define HANDLEMAP_STRIPE_BUCKETS 1024
 
-typedef struct handle_pool_entry__ {
+struct handle_map_entry {
+	struct glist_head list;
+	uint64_t object_id;
+	unsigned int handle_hash;
 	uint32_t fh_len;
 	char fh_data[NFS4_FHSIZE];
-} handle_pool_entry_t;
-
-pool_t *digest_pool;
-static pthread_mutex_t digest_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+};
 
-pool_t *handle_pool;
-static pthread_mutex_t handle_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct handle_map_stripe {
+	pthread_rwlock_t lock;
+	struct glist_head buckets[HANDLEMAP_STRIPE_BUCKETS];
+};
 
-/* helpers for pool allocation */
+static struct handle_map_stripe *handle_map;
+static unsigned int handle_map_nstripes;
 
-static digest_pool_entry_t *digest_alloc()
+/* Find the chain of a digest and the stripe it belongs to */
+static struct handle_map_stripe *handle_map_locate(uint64_t object_id,
+						   unsigned int handle_hash,
+						   struct glist_head **bucket)
 {
-	digest_pool_entry_t *p_new;
-
-	PTHREAD_MUTEX_lock(&digest_pool_mutex);
-	p_new = pool_alloc(digest_pool);
-	PTHREAD_MUTEX_unlock(&digest_pool_mutex);
-
-	return p_new;
+	uint32_t h = ((object_id ^ ((uint64_t) handle_hash << 32)) *
+		      0x9e3779b97f4a7c15ULL) >> 32;
+	struct handle_map_stripe *stripe;
+
+	stripe = &handle_map[h % handle_map_nstripes];
+	*bucket = &stripe->buckets[(h / handle_map_nstripes) %
+				   HANDLEMAP_STRIPE_BUCKETS];
+	return stripe;
 }
 
-static void digest_free(digest_pool_entry_t *p_digest)
+/* Look an entry up, stripe lock held */
+static struct handle_map_entry *handle_map_find(struct glist_head *bucket,
+						uint64_t object_id,
+						unsigned int handle_hash)
 {
-	memset(p_digest, 0, sizeof(digest_pool_entry_t));
+	struct glist_head *glist;
+	struct handle_map_entry *entry;
+
+	glist_for_each(glist, bucket) {
+		entry = glist_entry(glist, struct handle_map_entry, list);
+		if (entry->object_id == object_id &&
+		    entry->handle_hash == handle_hash)
+			return entry;
+	}
 
-	PTHREAD_MUTEX_lock(&digest_pool_mutex);
-	pool_free(digest_pool, p_digest);
-	PTHREAD_MUTEX_unlock(&digest_pool_mutex);
+	return NULL;
 }
 
-static handle_pool_entry_t *handle_alloc()
+static struct handle_map_entry *handle_map_entry_new(uint64_t object_id,
+						     unsigned int handle_hash,
+						     const void *data,
+						     uint32_t datalen)
 {
-	handle_pool_entry_t *p_new;
+	struct handle_map_entry *entry = gsh_malloc(sizeof(*entry));
 
-	PTHREAD_MUTEX_lock(&handle_pool_mutex);
-	p_new = pool_alloc(handle_pool);
-	PTHREAD_MUTEX_unlock(&handle_pool_mutex);
+	entry->object_id = object_id;
+	entry->handle_hash = handle_hash;
+	entry->fh_len = datalen;
+	memcpy(entry->fh_data, data, datalen);
 
-	return p_new;
+	return entry;
 }
 
-static void handle_free(handle_pool_entry_t *p_handle)
+/**
+ * @brief Insert a mapping replayed from a journal
+ */
+int handle_mapping_hash_add(uint64_t object_id, unsigned int handle_hash,
+			    const void *data, uint32_t datalen)
 {
-	memset(p_handle, 0, sizeof(handle_pool_entry_t));
+	struct handle_map_stripe *stripe;
+	struct glist_head *bucket;
+	struct handle_map_entry *entry;
 
-	PTHREAD_MUTEX_lock(&handle_pool_mutex);
-	pool_free(handle_pool, p_handle);
-	PTHREAD_MUTEX_unlock(&handle_pool_mutex);
-}
+	if (datalen >= NFS4_FHSIZE)
+		return HANDLEMAP_INVALID_PARAM;
 
-/* hash table functions */
+	stripe = handle_map_locate(object_id, handle_hash, &bucket);
 
-static uint32_t hash_digest_idx(hash_parameter_t *p_conf,
-				struct gsh_buffdesc *p_key)
-{
-	uint32_t hash;
-	digest_pool_entry_t *p_digest = (digest_pool_entry_t *) p_key->addr;
+	PTHREAD_RWLOCK_wrlock(&stripe->lock);
+
+	entry = handle_map_find(bucket, object_id, handle_hash);
+	if (entry != NULL) {
+		PTHREAD_RWLOCK_unlock(&stripe->lock);
+		return HANDLEMAP_EXISTS;
+	}
 
-	hash = ((unsigned long)p_digest->nfs23_digest.object_id ^
-		(unsigned int)p_digest->nfs23_digest.handle_hash);
-	hash = (743 * hash + 1999) % p_conf->index_size;
+	entry = handle_map_entry_new(object_id, handle_hash, data, datalen);
+	glist_add_tail(bucket, &entry->list);
 
-	return hash;
+	PTHREAD_RWLOCK_unlock(&stripe->lock);
 
+	return HANDLEMAP_SUCCESS;
 }
 
-static unsigned long hash_digest_rbt(hash_parameter_t *p_conf,
-				     struct gsh_buffdesc *p_key)
+/**
+ * @brief Remove a mapping deleted in a journal
+ */
+int handle_mapping_hash_del(uint64_t object_id, unsigned int handle_hash)
 {
-	unsigned long hash;
-	digest_pool_entry_t *p_digest = (digest_pool_entry_t *) p_key->addr;
+	struct handle_map_stripe *stripe;
+	struct glist_head *bucket;
+	struct handle_map_entry *entry;
 
-	hash = (257 * p_digest->nfs23_digest.object_id + 541);
+	stripe = handle_map_locate(object_id, handle_hash, &bucket);
 
-	return hash;
-}
+	PTHREAD_RWLOCK_wrlock(&stripe->lock);
 
-static int cmp_digest(struct gsh_buffdesc *p_key1, struct gsh_buffdesc *p_key2)
-{
-	digest_pool_entry_t *p_digest1 = (digest_pool_entry_t *) p_key1->addr;
-	digest_pool_entry_t *p_digest2 = (digest_pool_entry_t *) p_key2->addr;
-
-	/* compare object_id and handle_hash */
-
-	if (p_digest1->nfs23_digest.object_id !=
-	    p_digest2->nfs23_digest.object_id)
-		return (int)(p_digest1->nfs23_digest.object_id -
-			     p_digest2->nfs23_digest.object_id);
-	else if (p_digest1->nfs23_digest.handle_hash !=
-		 p_digest2->nfs23_digest.handle_hash)
-		return (int)p_digest1->nfs23_digest.handle_hash -
-		    (int)p_digest2->nfs23_digest.handle_hash;
-	else			/* same */
-		return 0;
-}
+	entry = handle_map_find(bucket, object_id, handle_hash);
+	if (entry != NULL)
+		glist_del(&entry->list);
 
-static int print_digest(struct gsh_buffdesc *p_val, char *outbuff)
-{
-	digest_pool_entry_t *p_digest = (digest_pool_entry_t *) p_val->addr;
-
-	return sprintf(outbuff, "%llu, %u",
-		       (unsigned long long)p_digest->nfs23_digest.object_id,
-		       p_digest->nfs23_digest.handle_hash);
-}
+	PTHREAD_RWLOCK_unlock(&stripe->lock);
 
-static int print_handle(struct gsh_buffdesc *p_val, char *outbuff)
-{
-	handle_pool_entry_t *p_handle = (handle_pool_entry_t *) p_val->addr;
+	if (entry == NULL)
+		return HANDLEMAP_STALE;
 
-	return snprintmem(outbuff, HASHTABLE_DISPLAY_STRLEN, p_handle->fh_data,
-			  p_handle->fh_len);
+	gsh_free(entry);
+	return HANDLEMAP_SUCCESS;
 }
 
-int handle_mapping_hash_add(hash_table_t *p_hash, uint64_t object_id,
-			    unsigned int handle_hash, const void *data,
-			    uint32_t datalen)
+/**
+ * @brief Call cb on every mapping
+ *
+ * Each stripe is read locked while it is walked, cb must not
+ * change the map.
+ */
+void handle_mapping_hash_foreach(handle_mapping_cb cb, void *arg)
 {
-	int rc;
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffval;
-	digest_pool_entry_t *digest;
-	handle_pool_entry_t *handle;
-
-	if (datalen >= sizeof(handle->fh_data))
-		return HANDLEMAP_INVALID_PARAM;
-
-	digest = digest_alloc();
-
-	if (!digest)
-		return HANDLEMAP_SYSTEM_ERROR;
-
-	handle = handle_alloc();
-
-	if (!handle) {
-		digest_free(digest);
-		return HANDLEMAP_SYSTEM_ERROR;
-	}
-
-	digest->nfs23_digest.object_id = object_id;
-	digest->nfs23_digest.handle_hash = handle_hash;
-	memset(handle->fh_data, 0, sizeof(handle->fh_data));
-	memcpy(handle->fh_data, data, datalen);
-	handle->fh_len = datalen;
-
-	buffkey.addr = (caddr_t) digest;
-	buffkey.len = sizeof(digest_pool_entry_t);
-
-	buffval.addr = (caddr_t) handle;
-	buffval.len = sizeof(handle_pool_entry_t);
-
-	rc = hashtable_test_and_set(handle_map_hash, &buffkey, &buffval,
-				    HASHTABLE_SET_HOW_SET_NO_OVERWRITE);
-
-	if (rc != HASHTABLE_SUCCESS) {
-		digest_free(digest);
-		handle_free(handle);
-
-		if (rc != HASHTABLE_ERROR_KEY_ALREADY_EXISTS) {
-			LogCrit(COMPONENT_FSAL,
-				"ERROR %d inserting entry to handle mapping hash table",
-				rc);
-			return HANDLEMAP_HASHTABLE_ERROR;
-		} else {
-			return HANDLEMAP_EXISTS;
+	struct handle_map_stripe *stripe;
+	struct handle_map_entry *entry;
+	struct glist_head *glist;
+	nfs23_map_handle_t digest;
+	unsigned int i, j;
+
+	memset(&digest, 0, sizeof(digest));
+	digest.len = sizeof(digest);
+	digest.type = PXY_HANDLE_MAPPED;
+
+	for (i = 0; i < handle_map_nstripes; i++) {
+		stripe = &handle_map[i];
+		PTHREAD_RWLOCK_rdlock(&stripe->lock);
+		for (j = 0; j < HANDLEMAP_STRIPE_BUCKETS; j++) {
+			glist_for_each(glist, &stripe->buckets[j]) {
+				entry = glist_entry(glist,
+						    struct handle_map_entry,
+						    list);
+				digest.object_id = entry->object_id;
+				digest.handle_hash = entry->handle_hash;
+				cb(&digest, entry->fh_data, entry->fh_len,
+				   arg);
+			}
 		}
+		PTHREAD_RWLOCK_unlock(&stripe->lock);
 	}
-
-	return HANDLEMAP_SUCCESS;
 }
 
-/* DEFAULT PARAMETERS for hash table */
-static hash_parameter_t handle_hash_config = {
-	.index_size = 67,
-	.hash_func_key = hash_digest_idx,
-	.hash_func_rbt = hash_digest_rbt,
-	.compare_key = cmp_digest,
-	.key_to_str = print_digest,
-	.val_to_str = print_handle
-};
-
 /**
  * Init handle mapping module.
  * Reloads the content of the mapping files it they exist,
@@ -238,60 +211,39 @@ static hash_parameter_t handle_hash_config = {
  */
 int HandleMap_Init(const handle_map_param_t *p_param)
 {
+	unsigned int i, j;
 	int rc;
 
-	/* first check database count */
-
-	rc = handlemap_db_count(p_param->databases_directory);
-
-	if ((rc > 0) && (rc != p_param->database_count)) {
-		LogCrit(COMPONENT_FSAL,
-			"ERROR: The number of existing databases (%u) does not match the requested DB thread count (%u)",
-			rc, p_param->database_count);
-
-		return HANDLEMAP_INVALID_PARAM;
-	} else if (rc < 0)
-		return -rc;
-
-	/* init database module */
+	/* init journal module */
 
 	rc = handlemap_db_init(p_param->databases_directory,
 			       p_param->temp_directory, p_param->database_count,
 			       p_param->synchronous_insert);
 
 	if (rc) {
-		LogCrit(COMPONENT_FSAL, "ERROR %d initializing database access",
+		LogCrit(COMPONENT_FSAL, "ERROR %d initializing journal access",
 			rc);
 		return rc;
 	}
 
-	/* initialize memory pool of digests and handles */
+	/* create the map */
 
-	digest_pool =
-	    pool_basic_init("digest_pool", sizeof(digest_pool_entry_t));
+	handle_map_nstripes = p_param->hashtable_size;
+	handle_map = gsh_calloc(handle_map_nstripes, sizeof(*handle_map));
 
-	handle_pool =
-	    pool_basic_init("handle_pool", sizeof(handle_pool_entry_t));
-
-	/* create hash table */
-
-	handle_hash_config.index_size = p_param->hashtable_size;
-
-	handle_map_hash = hashtable_init(&handle_hash_config);
-
-	if (!handle_map_hash) {
-		LogCrit(COMPONENT_FSAL,
-			"ERROR creating hash table for handle mapping");
-		return HANDLEMAP_INTERNAL_ERROR;
+	for (i = 0; i < handle_map_nstripes; i++) {
+		PTHREAD_RWLOCK_init(&handle_map[i].lock, NULL);
+		for (j = 0; j < HANDLEMAP_STRIPE_BUCKETS; j++)
+			glist_init(&handle_map[i].buckets[j]);
 	}
 
 	/* reload previous data */
 
-	rc = handlemap_db_reaload_all(handle_map_hash);
+	rc = handlemap_db_reaload_all();
 
 	if (rc) {
 		LogCrit(COMPONENT_FSAL,
-			"ERROR %d reloading handle mapping from database", rc);
+			"ERROR %d reloading handle mapping from journals", rc);
 		return rc;
 	}
 
@@ -312,63 +264,82 @@ int HandleMap_Init(const handle_map_param_t *p_param)
 int HandleMap_GetFH(const nfs23_map_handle_t *nfs23_digest,
 		    struct gsh_buffdesc *fsal_handle)
 {
-
-	int rc;
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffval;
-	digest_pool_entry_t digest;
-	struct hash_latch hl;
-
-	digest.nfs23_digest = *nfs23_digest;
-
-	buffkey.addr = (caddr_t) &digest;
-	buffkey.len = sizeof(digest_pool_entry_t);
-
-	rc = hashtable_getlatch(handle_map_hash, &buffkey, &buffval, 0, &hl);
-
-	if (rc == HASHTABLE_SUCCESS) {
-		handle_pool_entry_t *h = (handle_pool_entry_t *) buffval.addr;
-
-		if (h->fh_len < fsal_handle->len) {
-			fsal_handle->len = h->fh_len;
-			memcpy(fsal_handle->addr, h->fh_data, h->fh_len);
+	struct handle_map_stripe *stripe;
+	struct glist_head *bucket;
+	struct handle_map_entry *entry;
+	int rc = HANDLEMAP_STALE;
+
+	stripe = handle_map_locate(nfs23_digest->object_id,
+				   nfs23_digest->handle_hash, &bucket);
+
+	PTHREAD_RWLOCK_rdlock(&stripe->lock);
+
+	entry = handle_map_find(bucket, nfs23_digest->object_id,
+				nfs23_digest->handle_hash);
+	if (entry != NULL) {
+		if (entry->fh_len < fsal_handle->len) {
+			fsal_handle->len = entry->fh_len;
+			memcpy(fsal_handle->addr, entry->fh_data,
+			       entry->fh_len);
 			rc = HANDLEMAP_SUCCESS;
 		} else {
 			rc = HANDLEMAP_INTERNAL_ERROR;
 		}
-		hashtable_releaselatched(handle_map_hash, &hl);
-		return rc;
 	}
 
-	if (rc == HASHTABLE_ERROR_NO_SUCH_KEY)
-		hashtable_releaselatched(handle_map_hash, &hl);
-	return HANDLEMAP_STALE;
+	PTHREAD_RWLOCK_unlock(&stripe->lock);
+
+	return rc;
 }				/* HandleMap_GetFH */
 
 /**
  * Save the handle association if it was unknown.
+ *
+ * The journal record is appended with the stripe locked, so that the
+ * records of a digest are in the same order as the map changes.
  */
 int HandleMap_SetFH(nfs23_map_handle_t *p_in_nfs23_digest, const void *data,
 		    uint32_t len)
 {
+	struct handle_map_stripe *stripe;
+	struct glist_head *bucket;
+	struct handle_map_entry *entry;
 	int rc;
 
-	/* first, try to insert it to the hash table */
+	if (len >= NFS4_FHSIZE)
+		return HANDLEMAP_INVALID_PARAM;
+
+	stripe = handle_map_locate(p_in_nfs23_digest->object_id,
+				   p_in_nfs23_digest->handle_hash, &bucket);
 
-	rc = handle_mapping_hash_add(handle_map_hash,
-				     p_in_nfs23_digest->object_id,
+	/* cheap check first, most handles are already known */
+
+	PTHREAD_RWLOCK_rdlock(&stripe->lock);
+	entry = handle_map_find(bucket, p_in_nfs23_digest->object_id,
+				p_in_nfs23_digest->handle_hash);
+	PTHREAD_RWLOCK_unlock(&stripe->lock);
+
+	if (entry != NULL)
+		return HANDLEMAP_EXISTS;
+
+	entry = handle_map_entry_new(p_in_nfs23_digest->object_id,
 				     p_in_nfs23_digest->handle_hash, data, len);
 
-	if ((rc != 0) && (rc != HANDLEMAP_EXISTS))
-		/* error */
-		return rc;
-	else if (rc == HANDLEMAP_EXISTS)
-		/* already in database */
+	PTHREAD_RWLOCK_wrlock(&stripe->lock);
+
+	if (handle_map_find(bucket, p_in_nfs23_digest->object_id,
+			    p_in_nfs23_digest->handle_hash) != NULL) {
+		PTHREAD_RWLOCK_unlock(&stripe->lock);
+		gsh_free(entry);
 		return HANDLEMAP_EXISTS;
-	else {
-		/* insert it to DB */
-		return handlemap_db_insert(p_in_nfs23_digest, data, len);
 	}
+
+	glist_add_tail(bucket, &entry->list);
+	rc = handlemap_db_insert(p_in_nfs23_digest, data, len);
+
+	PTHREAD_RWLOCK_unlock(&stripe->lock);
+
+	return rc;
 }
 
 /**
@@ -378,42 +349,34 @@ int HandleMap_SetFH(nfs23_map_handle_t *p_in_nfs23_digest, const void *data,
  */
 int HandleMap_DelFH(nfs23_map_handle_t *p_in_nfs23_digest)
 {
+	struct handle_map_stripe *stripe;
+	struct glist_head *bucket;
+	struct handle_map_entry *entry;
 	int rc;
-	struct gsh_buffdesc buffkey, stored_buffkey;
-	struct gsh_buffdesc stored_buffval;
-
-	digest_pool_entry_t digest;
-
-	digest_pool_entry_t *p_stored_digest;
-	handle_pool_entry_t *p_stored_handle;
 
-	/* first, delete it from hash table */
+	stripe = handle_map_locate(p_in_nfs23_digest->object_id,
+				   p_in_nfs23_digest->handle_hash, &bucket);
 
-	digest.nfs23_digest = *p_in_nfs23_digest;
+	PTHREAD_RWLOCK_wrlock(&stripe->lock);
 
-	buffkey.addr = (caddr_t) &digest;
-	buffkey.len = sizeof(digest_pool_entry_t);
-
-	rc = HashTable_Del(handle_map_hash, &buffkey, &stored_buffkey,
-			   &stored_buffval);
-
-	if (rc != HASHTABLE_SUCCESS)
+	entry = handle_map_find(bucket, p_in_nfs23_digest->object_id,
+				p_in_nfs23_digest->handle_hash);
+	if (entry == NULL) {
+		PTHREAD_RWLOCK_unlock(&stripe->lock);
 		return HANDLEMAP_STALE;
+	}
 
-	p_stored_digest = (digest_pool_entry_t *) stored_buffkey.addr;
-	p_stored_handle = (handle_pool_entry_t *) stored_buffval.addr;
-
-	digest_free(p_stored_digest);
-	handle_free(p_stored_handle);
-
-	/* then, submit the request to the database */
+	glist_del(&entry->list);
+	rc = handlemap_db_delete(p_in_nfs23_digest);
 
-	return handlemap_db_delete(p_in_nfs23_digest);
+	PTHREAD_RWLOCK_unlock(&stripe->lock);
 
+	gsh_free(entry);
+	return rc;
 }
 
 /**
- * Flush pending database operations (before stopping the server).
+ * Flush pending journal writes (before stopping the server).
  */
 int HandleMap_Flush(void)
 {
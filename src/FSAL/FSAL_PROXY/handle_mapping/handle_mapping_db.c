@@ -1,769 +1,295 @@
+/**
+ * @file handle_mapping_db.c
+ *
+ * @brief Persistence of the handle map in append-only journals
+ *
+ * Every insertion or deletion appends a record to one of
+ * HandleMap_DB_Count memory mapped journals, chosen from the digest.
+ * Appends to a journal are a memcpy under its mutex, the kernel writes
+ * the pages back, or msync does when synchronous inserts are asked for
+ * and when the map is flushed.
+ *
+ * At startup the journals are replayed into the map, then rewritten
+ * with only the live mappings, so they do not keep growing over
+ * restarts and their number can change.
+ */
 #include "config.h"
 #include "handle_mapping.h"
 #include "handle_mapping_db.h"
 #include "handle_mapping_internal.h"
-#include <sqlite3.h>
+#include "log.h"
+#include "common_utils.h"
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <ctype.h>
 #include <dirent.h>
 #include <fnmatch.h>
 #include <pthread.h>
+#include "city.h"
 
-/* sqlite check macros */
-
-#define CheckTable(_p_conn_, _code_, _msg_str_, _result_) \
-do { \
-	if ((_code_) != SQLITE_OK) { \
-		LogCrit(COMPONENT_FSAL, \
-			"SQLite command failed in %s line %i", \
-			__func__, __LINE__);		\
-		LogCrit(COMPONENT_FSAL, "%s (%d)", \
-			(_msg_str_ ? _msg_str_ : sqlite3_errmsg(_p_conn_)), \
-			_code_);					\
-		if (_msg_str_) {					\
-			sqlite3_free(_msg_str_);			\
-			_msg_str_ = NULL;				\
-		}							\
-		if (_result_) {						\
-			sqlite3_free_table(_result_);			\
-			_result_ = NULL;				\
-		}							\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-#define CheckCommand(_p_conn_, _code_, _msg_str_) \
-do { \
-	if ((_code_) != SQLITE_OK) { \
-		LogCrit(COMPONENT_FSAL, \
-			"SQLite command failed in %s line %i", \
-			__func__, __LINE__);			\
-		LogCrit(COMPONENT_FSAL, "%s (%d)", \
-			(_msg_str_ ? _msg_str_ : sqlite3_errmsg(_p_conn_)), \
-			_code_);					\
-		if (_msg_str_) { \
-			sqlite3_free(_msg_str_); \
-			_msg_str_ = NULL; \
-		}			  \
-		return HANDLEMAP_DB_ERROR;	\
-	}					\
-} while (0)
-
-#define CheckPrepare(_p_conn_, _code_) \
-do { \
-	if ((_code_) != SQLITE_OK) {	\
-		LogCrit(COMPONENT_FSAL,					\
-			"SQLite prepare statement failed in %s line %i", \
-			__func__, __LINE__);				\
-		LogCrit(COMPONENT_FSAL, "%s (%d)",			\
-			sqlite3_errmsg(_p_conn_), _code_);		\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-#define CheckBind(_p_conn_, _code_, _stmt_) \
-do { \
-	if ((_code_) != SQLITE_OK) { \
-		LogCrit(COMPONENT_FSAL,				 \
-			"SQLite parameter binding failed in %s line %i", \
-			__func__, __LINE__);				\
-		LogCrit(COMPONENT_FSAL, "%s (%d)",			\
-			sqlite3_errmsg(_p_conn_), _code_);		\
-		sqlite3_clear_bindings(_stmt_);				\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-#define CheckStep(_p_conn_, _code_, _stmt_) \
-do { \
-	if ((_code_) != SQLITE_OK  && (_code_) != \
-	    SQLITE_ROW && (_code_) != SQLITE_DONE) {			\
-		LogCrit(COMPONENT_FSAL,					\
-			"SQLite command failed in %s line %i",		\
-			__func__, __LINE__);			\
-		LogCrit(COMPONENT_FSAL, "%s (%d)",			\
-			sqlite3_errmsg(_p_conn_), _code_);		\
-		sqlite3_reset(_stmt_);					\
-		return HANDLEMAP_DB_ERROR;				\
-	}								\
-} while (0)
-
-/* Type of DB operations */
-typedef enum {
-	LOAD = 1,
-	INSERT,
-	DELETE
-} db_op_type;
-
-/* DB operation arguments */
-typedef struct db_op_item__ {
-	db_op_type op_type;
-
-	/* operation info */
-
-	union {
-		struct hdlmap_tuple {
-			nfs23_map_handle_t nfs23_digest;
-			uint8_t fh4_len;
-			char fh4_data[NFS4_FHSIZE];
-		} fh_info;
-
-		hash_table_t *hash;
-	} op_arg;
-
-	/* for chained list */
-	struct db_op_item__ *p_next;
-
-} db_op_item_t;
-
-/* the queue for each DB flusher thread */
-typedef struct flusher_queue__ {
-	/* the queue for high priority operations */
-	db_op_item_t *highprio_first;
-	db_op_item_t *highprio_last;
-
-	/* the queue for low priority operations */
-	db_op_item_t *lowprio_first;
-	db_op_item_t *lowprio_last;
-
-	/* number of operations pending */
-	unsigned int nb_waiting;
-
-	pthread_mutex_t queues_mutex;
-
-	pthread_cond_t work_avail_condition;
-	pthread_cond_t work_done_condition;
-
-	/* status (used for work_done_condition) */
-	enum { NOT_READY, IDLE, WORKING, FINISHED } status;
-
-} flusher_queue_t;
-
-#define LOAD_ALL_STATEMENT  0
-#define INSERT_STATEMENT    1
-#define DELETE_STATEMENT    2
-
-#define STATEMENT_COUNT     3
-
-/* thread info */
-typedef struct db_thread_info__ {
-	pthread_t thr_id;
-	unsigned int thr_index;
-
-	flusher_queue_t work_queue;
-
-	/* SQLite database connection */
-	sqlite3 *db_conn;
-
-	/* prepared statement table */
-	sqlite3_stmt * prep_stmt[STATEMENT_COUNT];
-
-	/* this pool is accessed by submitter
-	 * and by the db thread */
-	pthread_mutex_t pool_mutex;
-	pool_t *dbop_pool;
-
-} db_thread_info_t;
+#define JOURNAL_MAGIC "GSHHMAP1"
+#define JOURNAL_MAGIC_LEN 8
 
-static char dbmap_dir[MAXPATHLEN + 1];
-static char db_tmpdir[MAXPATHLEN + 1];
-static unsigned int nb_db_threads;
-static int synchronous;
+/* A full journal grows by this much */
+#define JOURNAL_CHUNK (1024 * 1024)
 
-/* used for clean shutdown */
-static int do_terminate;
-
-/* all information and context for threads */
-static db_thread_info_t db_thread[MAX_DB];
+enum journal_op {
+	JOURNAL_INSERT = 1,
+	JOURNAL_DELETE,
+};
 
 /**
- * @brief Print memory to a a hex string
- *
- * @param[out] target   Buffer where memory is to be printed
- * @param[in]  tgt_size Size of the target buffer
- * @param[in]  source   Buffer to be printed
- * @param[in]  mem_size Size of the buffer
+ * @brief Header of a journal record
  *
- * @return The number of bytes written in the target buffer.
+ * The FSAL handle follows, padded to 8 bytes.  jr_check covers the rest
+ * of the header and the handle, so a record torn by a crash ends the
+ * replay.
  */
-int
-snprintmem(char *target, size_t tgt_size, const void *source,
-	   size_t mem_size)
-{
-
-	const unsigned char *c;	/* the current char to be printed */
-	char *str = target;	/* the current position in target buffer */
-	int wrote = 0;
-
-	for (c = (const unsigned char *)source;
-	     c < ((const unsigned char *)source + mem_size); c++) {
-		int tmp_wrote = 0;
+struct journal_rec {
+	uint64_t jr_check;
+	uint64_t jr_object_id;
+	uint32_t jr_handle_hash;
+	uint16_t jr_op;
+	uint16_t jr_fh_len;
+};
+
+struct journal {
+	pthread_mutex_t j_mutex;
+	int j_fd;
+	char *j_map;
+	size_t j_size;		/*< Size of the file and of the mapping */
+	size_t j_tail;		/*< End of the last record */
+};
 
-		if (wrote >= tgt_size) {
-			target[tgt_size - 1] = '\0';
-			break;
-		}
-
-		tmp_wrote =
-		    snprintf(str, tgt_size - wrote, "%.2X", (unsigned char)*c);
-		str += tmp_wrote;
-		wrote += tmp_wrote;
-
-	}
+static char dbmap_dir[MAXPATHLEN + 1];
+static unsigned int nb_db;
+static int synchronous;
+static long page_size;
 
-	return wrote;
+static struct journal journals[MAX_DB];
 
+static size_t journal_rec_size(uint32_t fh_len)
+{
+	return sizeof(struct journal_rec) + ((fh_len + 7) & ~7);
 }
 
-/* test if a letter is hexa */
-#define IS_HEXA(c)  \
-	((((c) >= '0') && ((c) <= '9')) || (((c) >= 'A') && ((c) <= 'F')) \
-	 || (((c) >= 'a') && ((c) <= 'f')))
-
-/* converts an hexa letter */
-#define HEXA2BYTE(c)							\
-	((unsigned char)						\
-	 (((c) >= '0') && ((c) <= '9') ?				\
-	  ((c) - '0') : (((c) >= 'A') && ((c) <= 'F') ?			\
-			 ((c) - 'A' + 10) : (((c) >= 'a') &&		\
-					     ((c) <= 'f') ?		\
-					     ((c) - 'a' + 10) : 0))))
-
-/**
- * @brief Read a hexadecimal string into memory
- *
- * @param[out] target     Where memory is to be written
- * @param[in]  tgt_size   Size of the target buffer
- * @param[in]  str_source Hexadecimal string
- *
- * @retval The number of bytes read in the source string.
- * @retval -1 on error.
- */
-
-int
-sscanmem(void *target, size_t tgt_size, const char *str_source)
+static uint64_t journal_rec_check(const struct journal_rec *rec)
 {
-
-	unsigned char *mem;	/* the current byte to be set */
-
-	const char *src;	/* pointer to the current char to be read. */
-
-	int nb_read = 0;
-
-	src = str_source;
-
-	for (mem = (unsigned char *)target;
-	     mem < ((unsigned char *)target + tgt_size); mem++) {
-
-		unsigned char tmp_val;
-
-		/* we must read 2 bytes (written in hexa) to have 1
-		   target byte value. */
-		if ((*src == '\0') || (*(src + 1) == '\0')) {
-			/* error, the source string is too small */
-			return -1;
-		}
-
-		/* they must be hexa values */
-		if (!IS_HEXA(*src) || !IS_HEXA(*(src + 1)))
-			return -1;
-
-		/* we read hexa values. */
-		tmp_val = (HEXA2BYTE(*src) << 4) + HEXA2BYTE(*(src + 1));
-
-		/* we had them to the target buffer */
-		(*mem) = tmp_val;
-
-		src += 2;
-		nb_read += 2;
-
-	}
-
-	return nb_read;
-
+	return CityHash64((const char *)&rec->jr_object_id,
+			  sizeof(*rec) - sizeof(rec->jr_check) +
+			  rec->jr_fh_len);
 }
 
-/* Initialize basic structures for a thread */
-static int init_db_thread_info(db_thread_info_t *p_thr_info,
-			       unsigned int nb_dbop_prealloc)
+static void journal_path(char *path, unsigned int idx, bool tmp)
 {
-	unsigned int i;
-
-	if (!p_thr_info)
-		return HANDLEMAP_INTERNAL_ERROR;
-
-	memset(p_thr_info, 0, sizeof(db_thread_info_t));
-
-	p_thr_info->work_queue.highprio_first = NULL;
-	p_thr_info->work_queue.highprio_last = NULL;
-	p_thr_info->work_queue.lowprio_first = NULL;
-	p_thr_info->work_queue.lowprio_last = NULL;
-
-	p_thr_info->work_queue.nb_waiting = 0;
-
-	if (pthread_mutex_init(&p_thr_info->work_queue.queues_mutex, NULL))
-		return HANDLEMAP_SYSTEM_ERROR;
-
-	if (pthread_cond_init
-	    (&p_thr_info->work_queue.work_avail_condition, NULL))
-		return HANDLEMAP_SYSTEM_ERROR;
-
-	if (pthread_cond_init
-	    (&p_thr_info->work_queue.work_done_condition, NULL))
-		return HANDLEMAP_SYSTEM_ERROR;
-
-	/* init thread status */
-	p_thr_info->work_queue.status = NOT_READY;
-
-	p_thr_info->db_conn = NULL;
-
-	for (i = 0; i < STATEMENT_COUNT; i++)
-		p_thr_info->prep_stmt[i] = NULL;
-
-	/* init memory pool */
-
-	if (pthread_mutex_init(&p_thr_info->pool_mutex, NULL))
-		return HANDLEMAP_SYSTEM_ERROR;
-
-	p_thr_info->dbop_pool =
-	    pool_basic_init("drop_pool", sizeof(db_op_item_t));
-
-	return HANDLEMAP_SUCCESS;
+	snprintf(path, MAXPATHLEN, "%s/%s.%u%s", dbmap_dir, DB_FILE_PREFIX,
+		 idx, tmp ? ".tmp" : "");
 }
 
-/* Called by a thread to initialize its database access.
- * After this call:
- *  - database connection is established
- *  - schema is created
- *  - prepared statements are ready to be used
- */
-static int init_database_access(db_thread_info_t *p_thr_info)
+static unsigned int select_journal(const nfs23_map_handle_t *p_nfs23_digest)
 {
-	char db_file[MAXPATHLEN + 1];
-	int rc;
-	char **result = NULL;
-	int rows, cols;
-	char *errmsg = NULL;
-	const char *unparsed;
-
-	/* first open the database file */
+	unsigned int h =
+	    ((p_nfs23_digest->object_id * 1049) ^ p_nfs23_digest->handle_hash) %
+	    2477;
 
-	snprintf(db_file, MAXPATHLEN, "%s/%s.%u", dbmap_dir, DB_FILE_PREFIX,
-		 p_thr_info->thr_index);
+	return h % nb_db;
+}
 
-	rc = sqlite3_open(db_file, &p_thr_info->db_conn);
+/* Resize the file and its mapping, j_mutex held */
+static int journal_resize(struct journal *j, size_t size)
+{
+	void *map;
 
-	if (rc != 0) {
-		if (p_thr_info->db_conn) {
-			LogCrit(COMPONENT_FSAL,
-				"ERROR: could not connect to SQLite3 database (file %s): %s",
-				db_file, sqlite3_errmsg(p_thr_info->db_conn));
-			sqlite3_close(p_thr_info->db_conn);
-		} else {
-			LogCrit(COMPONENT_FSAL,
-				"ERROR: could not connect to SQLite3 database (file %s): status=%d",
-				db_file, rc);
-		}
-		return HANDLEMAP_DB_ERROR;
+	if (ftruncate(j->j_fd, size) == -1) {
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: could not grow handle map journal: %s",
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
 	}
 
-	/* Now check, that the map table exists */
-	rc = sqlite3_get_table(p_thr_info->db_conn,
-			       "SELECT name FROM sqlite_master WHERE type = 'table' AND name = '"
-			       MAP_TABLE "'", &result, &rows, &cols, &errmsg);
-
-	CheckTable(p_thr_info->db_conn, rc, errmsg, result);
-
-	/* no need for the result, just the number of rows returned */
-	sqlite3_free_table(result);
-
-	if (rows != 1) {
-		/* table must be created */
-		rc = sqlite3_exec(p_thr_info->db_conn,
-				  "CREATE TABLE " MAP_TABLE " ( " OBJID_FIELD
-				  "   BIGINT NOT NULL, " HASH_FIELD
-				  "    INT NOT NULL, " HANDLE_FIELD
-				  "  TEXT, PRIMARY KEY(" OBJID_FIELD ", "
-				  HASH_FIELD ") )", NULL, NULL, &errmsg);
-
-		CheckCommand(p_thr_info->db_conn, rc, errmsg);
-
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, j->j_fd, 0);
+	if (map == MAP_FAILED) {
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: could not map handle map journal: %s",
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
 	}
 
-	/* Now, create prepared statements */
+	if (j->j_map != NULL)
+		munmap(j->j_map, j->j_size);
+	j->j_map = map;
+	j->j_size = size;
 
-	rc = sqlite3_prepare_v2(p_thr_info->db_conn,
-				"SELECT " OBJID_FIELD "," HASH_FIELD ","
-				HANDLE_FIELD " FROM " MAP_TABLE, -1,
-				&(p_thr_info->prep_stmt[LOAD_ALL_STATEMENT]),
-				&unparsed);
-
-	CheckPrepare(p_thr_info->db_conn, rc);
-
-	rc = sqlite3_prepare_v2(p_thr_info->db_conn,
-				"INSERT INTO " MAP_TABLE "(" OBJID_FIELD ","
-				HASH_FIELD "," HANDLE_FIELD
-				") VALUES (?1, ?2, ?3 )", -1,
-				&(p_thr_info->prep_stmt[INSERT_STATEMENT]),
-				&unparsed);
-
-	CheckPrepare(p_thr_info->db_conn, rc);
-
-	rc = sqlite3_prepare_v2(p_thr_info->db_conn,
-				"DELETE FROM " MAP_TABLE " WHERE " OBJID_FIELD
-				"=?1 AND " HASH_FIELD "=?2", -1,
-				&(p_thr_info->prep_stmt[DELETE_STATEMENT]),
-				&unparsed);
-
-	CheckPrepare(p_thr_info->db_conn, rc);
-
-	/* Everything is OK now ! */
 	return HANDLEMAP_SUCCESS;
+}
 
-}				/* init_database_access */
-
-static int db_load_operation(db_thread_info_t *p_info, hash_table_t *p_hash)
+/* Write a record at the tail, j_mutex held */
+static int journal_put(struct journal *j, enum journal_op op,
+		       const nfs23_map_handle_t *digest, const void *data,
+		       uint32_t len)
 {
-	/* the object id to be inserted to hash table */
-	uint64_t object_id;
-	unsigned int handle_hash;
-	const char *fsal_handle_str;
-	char fh4_data[NFS4_FHSIZE];
-	unsigned int nb_loaded = 0;
+	struct journal_rec *rec;
+	size_t need = journal_rec_size(len);
 	int rc;
-	struct timeval t1;
-	struct timeval t2;
-	struct timeval tdiff;
-
-	gettimeofday(&t1, NULL);
-
-	rc = sqlite3_step(p_info->prep_stmt[LOAD_ALL_STATEMENT]);
-	CheckStep(p_info->db_conn, rc, p_info->prep_stmt[LOAD_ALL_STATEMENT]);
-
-	/* something to read */
-	while (rc == SQLITE_ROW) {
-		object_id =
-		    sqlite3_column_int64(p_info->prep_stmt[LOAD_ALL_STATEMENT],
-					 0);
-		handle_hash =
-		    sqlite3_column_int(p_info->prep_stmt[LOAD_ALL_STATEMENT],
-				       1);
-		fsal_handle_str =
-		    sqlite3_column_text(p_info->prep_stmt[LOAD_ALL_STATEMENT],
-					2);
-
-		if (fsal_handle_str) {
-			int len = strlen(fsal_handle_str);
-
-			if ((len & 1) || len > NFS4_FHSIZE * 2) {
-				LogEvent(COMPONENT_FSAL,
-					 "Bogus handle '%s' - wrong number of symbols",
-					 fsal_handle_str);
-			} else {
-				/* convert hexa string representation
-				 * to binary data */
-				if (sscanmem(fh4_data, len / 2, fsal_handle_str)
-				    != len) {
-					LogEvent(COMPONENT_FSAL,
-						 "Bogus entry '%s' - cannot convert",
-						 fsal_handle_str);
-				} else {
-					/* now insert it to the hash table */
-					rc = handle_mapping_hash_add(
-								p_hash,
-								object_id,
-								handle_hash,
-								fh4_data,
-								len / 2);
-
-					if (rc == 0)
-						nb_loaded++;
-					else
-						LogCrit(COMPONENT_FSAL,
-							"ERROR %d adding entry to hash table <object_id=%llu, FH_hash=%u, FSAL_Handle=%s>",
-							rc,
-							(unsigned long long)
-							object_id, handle_hash,
-							fsal_handle_str);
-				}
-			}
-		} else {
-			LogEvent(COMPONENT_FSAL,
-				 "Empty handle in object %lld, hash %d",
-				 (unsigned long long)object_id, handle_hash);
-		}
-
-		rc = sqlite3_step(p_info->prep_stmt[LOAD_ALL_STATEMENT]);
-		CheckStep(p_info->db_conn, rc,
-			  p_info->prep_stmt[LOAD_ALL_STATEMENT]);
 
+	if (j->j_tail + need > j->j_size) {
+		rc = journal_resize(j, j->j_size + JOURNAL_CHUNK);
+		if (rc)
+			return rc;
 	}
 
-	/* clear results */
-	sqlite3_reset(p_info->prep_stmt[LOAD_ALL_STATEMENT]);
-
-	/* print time and item count */
-
-	gettimeofday(&t2, NULL);
-	timersub(&t2, &t1, &tdiff);
-
-	LogEvent(COMPONENT_FSAL, "Reloaded %u items in %d.%06ds", nb_loaded,
-		 (int)tdiff.tv_sec, (int)tdiff.tv_usec);
-
-	return HANDLEMAP_SUCCESS;
-
-}				/* db_load_operation */
-
-static int db_insert_operation(db_thread_info_t *p_info,
-			       struct hdlmap_tuple *data)
-{
-	int rc;
-	char handle_str[2 * NFS4_FHSIZE + 1];
-
-	rc = sqlite3_bind_int64(p_info->prep_stmt[INSERT_STATEMENT], 1,
-				data->nfs23_digest.object_id);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
-
-	rc = sqlite3_bind_int(p_info->prep_stmt[INSERT_STATEMENT], 2,
-			      data->nfs23_digest.handle_hash);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
-
-	snprintmem(handle_str, sizeof(handle_str), data->fh4_data,
-		   data->fh4_len);
+	rec = (struct journal_rec *)(j->j_map + j->j_tail);
+	rec->jr_object_id = digest->object_id;
+	rec->jr_handle_hash = digest->handle_hash;
+	rec->jr_op = op;
+	rec->jr_fh_len = len;
+	if (len != 0)
+		memcpy(rec + 1, data, len);
+	rec->jr_check = journal_rec_check(rec);
 
-	rc = sqlite3_bind_text(p_info->prep_stmt[INSERT_STATEMENT], 3,
-			       handle_str, -1, SQLITE_STATIC);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
-
-	rc = sqlite3_step(p_info->prep_stmt[INSERT_STATEMENT]);
-	CheckStep(p_info->db_conn, rc, p_info->prep_stmt[INSERT_STATEMENT]);
-
-	/* clear results */
-	sqlite3_reset(p_info->prep_stmt[INSERT_STATEMENT]);
+	j->j_tail += need;
 
 	return HANDLEMAP_SUCCESS;
+}
 
-}				/* db_insert_operation */
-
-static int db_delete_operation(db_thread_info_t *p_info,
-			       nfs23_map_handle_t *p_nfs23_digest)
+static int journal_append(enum journal_op op,
+			  const nfs23_map_handle_t *digest, const void *data,
+			  uint32_t len)
 {
+	struct journal *j = &journals[select_journal(digest)];
+	size_t start;
 	int rc;
 
-	rc = sqlite3_bind_int64(p_info->prep_stmt[DELETE_STATEMENT], 1,
-				p_nfs23_digest->object_id);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[DELETE_STATEMENT]);
-
-	rc = sqlite3_bind_int(p_info->prep_stmt[DELETE_STATEMENT], 2,
-			      p_nfs23_digest->handle_hash);
-	CheckBind(p_info->db_conn, rc, p_info->prep_stmt[DELETE_STATEMENT]);
+	PTHREAD_MUTEX_lock(&j->j_mutex);
 
-	rc = sqlite3_step(p_info->prep_stmt[DELETE_STATEMENT]);
-	CheckStep(p_info->db_conn, rc, p_info->prep_stmt[DELETE_STATEMENT]);
+	start = j->j_tail & ~(page_size - 1);
+	rc = journal_put(j, op, digest, data, len);
 
-	/* clear results */
-	sqlite3_reset(p_info->prep_stmt[DELETE_STATEMENT]);
+	if (rc == HANDLEMAP_SUCCESS && synchronous &&
+	    msync(j->j_map + start, j->j_tail - start, MS_SYNC) == -1) {
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: could not sync handle map journal: %s",
+			strerror(errno));
+		rc = HANDLEMAP_SYSTEM_ERROR;
+	}
 
-	return HANDLEMAP_SUCCESS;
+	PTHREAD_MUTEX_unlock(&j->j_mutex);
 
-}				/* db_delete_operation */
+	return rc;
+}
 
-/* push a task to the queue */
-static int dbop_push(flusher_queue_t *p_queue, db_op_item_t *p_op)
+/* Load the records of a journal into the map */
+static int journal_replay(unsigned int idx, unsigned int *count)
 {
-	PTHREAD_MUTEX_lock(&p_queue->queues_mutex);
-
-	/* add an item at the end of the queue */
-	switch (p_op->op_type) {
-	case LOAD:
-	case INSERT:
-
-		/* high priority operations */
-
-		p_op->p_next = NULL;
-
-		if (p_queue->highprio_last == NULL) {
-			/* first operation */
-			p_queue->highprio_first = p_op;
-			p_queue->highprio_last = p_op;
-		} else {
-			p_queue->highprio_last->p_next = p_op;
-			p_queue->highprio_last = p_op;
-		}
-
-		p_queue->nb_waiting++;
-
-		break;
+	char path[MAXPATHLEN + 1];
+	struct journal_rec *rec;
+	struct stat st;
+	char *map;
+	size_t off;
+	int fd;
+
+	journal_path(path, idx, false);
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno == ENOENT)
+			return HANDLEMAP_SUCCESS;
+		LogCrit(COMPONENT_FSAL, "ERROR: could not open %s: %s", path,
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
 
-	case DELETE:
+	if (fstat(fd, &st) == -1 || st.st_size < JOURNAL_MAGIC_LEN) {
+		close(fd);
+		return HANDLEMAP_SUCCESS;
+	}
 
-		/* low priority operation */
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		LogCrit(COMPONENT_FSAL, "ERROR: could not map %s: %s", path,
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
+	}
 
-		p_op->p_next = NULL;
+	if (memcmp(map, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"ERROR: %s is not a handle map journal", path);
+		munmap(map, st.st_size);
+		return HANDLEMAP_DB_ERROR;
+	}
 
-		if (p_queue->lowprio_last == NULL) {
-			/* first operation */
-			p_queue->lowprio_first = p_op;
-			p_queue->lowprio_last = p_op;
-		} else {
-			p_queue->lowprio_last->p_next = p_op;
-			p_queue->lowprio_last = p_op;
-		}
+	for (off = JOURNAL_MAGIC_LEN;
+	     off + sizeof(*rec) <= st.st_size;
+	     off += journal_rec_size(rec->jr_fh_len)) {
+		rec = (struct journal_rec *)(map + off);
 
-		p_queue->nb_waiting++;
+		if (rec->jr_fh_len >= NFS4_FHSIZE ||
+		    off + journal_rec_size(rec->jr_fh_len) > st.st_size ||
+		    rec->jr_check != journal_rec_check(rec))
+			break;
 
-		break;
+		if (rec->jr_op == JOURNAL_INSERT)
+			(void)handle_mapping_hash_add(rec->jr_object_id,
+						      rec->jr_handle_hash,
+						      rec + 1,
+						      rec->jr_fh_len);
+		else if (rec->jr_op == JOURNAL_DELETE)
+			(void)handle_mapping_hash_del(rec->jr_object_id,
+						      rec->jr_handle_hash);
+		else
+			break;
 
-	default:
-		LogCrit(COMPONENT_FSAL,
-			"ERROR in dbop_push: Invalid operation type %d",
-			p_op->op_type);
+		(*count)++;
 	}
 
-	/* there now some work available */
-	pthread_cond_signal(&p_queue->work_avail_condition);
-
-	PTHREAD_MUTEX_unlock(&p_queue->queues_mutex);
-
+	munmap(map, st.st_size);
 	return HANDLEMAP_SUCCESS;
-
 }
 
-static void *database_worker_thread(void *arg)
+/* Start a new, empty journal as <name>.tmp */
+static int journal_create(unsigned int idx)
 {
-	db_thread_info_t *p_info = (db_thread_info_t *) arg;
+	struct journal *j = &journals[idx];
+	char path[MAXPATHLEN + 1];
 	int rc;
-	db_op_item_t *to_be_done = NULL;
-	char thread_name[256];
-
-	/* initialize logging */
-	snprintf(thread_name, 256, "DB thread #%u", p_info->thr_index);
-	SetNameFunction(thread_name);
-
-	/* initialize memory management */
 
-	rc = init_database_access(p_info);
+	journal_path(path, idx, true);
 
-	if (rc != HANDLEMAP_SUCCESS) {
-		/* Failed init */
-		LogCrit(COMPONENT_FSAL,
-			"ERROR: Database initialization error %d", rc);
-		exit(rc);
+	j->j_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (j->j_fd == -1) {
+		LogCrit(COMPONENT_FSAL, "ERROR: could not create %s: %s", path,
+			strerror(errno));
+		return HANDLEMAP_SYSTEM_ERROR;
 	}
 
-	/* main loop */
-	while (1) {
-
-		/* Is "work done" or "work available" condition verified ? */
-
-		PTHREAD_MUTEX_lock(&p_info->work_queue.queues_mutex);
-
-		/* nothing to be done ? */
-		while (p_info->work_queue.highprio_first == NULL
-		       && p_info->work_queue.lowprio_first == NULL) {
-			to_be_done = NULL;
-			p_info->work_queue.status = IDLE;
-			pthread_cond_signal(&p_info->work_queue.
-					    work_done_condition);
-
-			/* if termination is requested, exit */
-			if (do_terminate) {
-				p_info->work_queue.status = FINISHED;
-				PTHREAD_MUTEX_unlock(&p_info->work_queue
-								.queues_mutex);
-				return (void *)p_info;
-			}
-
-			/* else, wait for something to do */
-			pthread_cond_wait(&p_info->work_queue.
-					  work_avail_condition,
-					  &p_info->work_queue.queues_mutex);
-
-		}
-
-		/* there is something to do:
-		 * first check the highest priority list,
-		 * then the lower priority.
-		 */
-
-		if (p_info->work_queue.highprio_first != NULL) {
-			/* take the next item in the list */
-			to_be_done = p_info->work_queue.highprio_first;
-			p_info->work_queue.highprio_first = to_be_done->p_next;
-
-			/* still any entries in the list ? */
-			if (p_info->work_queue.highprio_first == NULL)
-				p_info->work_queue.highprio_last = NULL;
-			/* it it the last entry ? */
-			else if (p_info->work_queue.highprio_first->p_next ==
-				 NULL)
-				p_info->work_queue.highprio_last =
-				    p_info->work_queue.highprio_first;
-
-			/* something to do */
-			p_info->work_queue.status = WORKING;
-		} else if (p_info->work_queue.lowprio_first != NULL) {
-			/* take the next item in the list */
-			to_be_done = p_info->work_queue.lowprio_first;
-			p_info->work_queue.lowprio_first = to_be_done->p_next;
-
-			/* still any entries in the list ? */
-			if (p_info->work_queue.lowprio_first == NULL)
-				p_info->work_queue.lowprio_last = NULL;
-			/* it it the last entry ? */
-			else if (p_info->work_queue.lowprio_first->p_next ==
-				 NULL)
-				p_info->work_queue.lowprio_last =
-				    p_info->work_queue.lowprio_first;
-
-			/* something to do */
-			p_info->work_queue.status = WORKING;
-		}
-
-		p_info->work_queue.nb_waiting--;
-
-		PTHREAD_MUTEX_unlock(&p_info->work_queue.queues_mutex);
-
-		/* PROCESS THE REQUEST */
-
-		switch (to_be_done->op_type) {
-		case LOAD:
-			db_load_operation(p_info, to_be_done->op_arg.hash);
-			break;
-
-		case INSERT:
-			db_insert_operation(p_info,
-					    &to_be_done->op_arg.fh_info);
-			break;
+	rc = journal_resize(j, JOURNAL_CHUNK);
+	if (rc)
+		return rc;
 
-		case DELETE:
-			db_delete_operation(p_info,
-					    &to_be_done->op_arg.fh_info.
-					    nfs23_digest);
-			break;
+	memcpy(j->j_map, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN);
+	j->j_tail = JOURNAL_MAGIC_LEN;
 
-		default:
-			LogCrit(COMPONENT_FSAL,
-				"ERROR: Invalid operation type %d",
-				to_be_done->op_type);
-		}
-
-		/* free the db operation item */
-		PTHREAD_MUTEX_lock(&p_info->pool_mutex);
-		pool_free(p_info->dbop_pool, to_be_done);
-		PTHREAD_MUTEX_unlock(&p_info->pool_mutex);
+	return HANDLEMAP_SUCCESS;
+}
 
-	}			/* loop forever */
+static void journal_compact_cb(const nfs23_map_handle_t *digest,
+			       const void *data, uint32_t datalen, void *arg)
+{
+	int *rc = arg;
 
-	return (void *)p_info;
+	if (*rc == HANDLEMAP_SUCCESS)
+		*rc = journal_put(&journals[select_journal(digest)],
+				  JOURNAL_INSERT, digest, data, datalen);
 }
 
 /**
- * count the number of database instances in a given directory
- * (this is used for checking that the number of db
- * matches the number of threads)
+ * count the number of journals in a given directory
  */
 int handlemap_db_count(const char *dir)
 {
@@ -821,200 +347,119 @@ int handlemap_db_count(const char *dir)
 
 }				/* handlemap_db_count */
 
-unsigned int select_db_queue(const nfs23_map_handle_t *p_nfs23_digest)
-{
-	unsigned int h =
-	    ((p_nfs23_digest->object_id * 1049) ^ p_nfs23_digest->handle_hash) %
-	    2477;
-
-	h = h % nb_db_threads;
-
-	return h;
-}
-
 /**
- * Initialize databases access
- * - init DB queues
- * - start threads
- * - establish DB connections
- * - create db schema if it was empty
+ * Initialize journals access.
+ * tmp_dir is not used, journals are compacted next to them.
  */
 int handlemap_db_init(const char *db_dir, const char *tmp_dir,
 		      unsigned int db_count, int synchronous_insert)
 {
 	unsigned int i;
-	int rc;
-
-	/* first, save the parameters */
-
-	strncpy(dbmap_dir, db_dir, MAXPATHLEN);
-	strncpy(db_tmpdir, tmp_dir, MAXPATHLEN);
 
-	if (db_count > MAX_DB)
+	if (db_count == 0 || db_count > MAX_DB)
 		return HANDLEMAP_INVALID_PARAM;
 
-	nb_db_threads = db_count;
+	strncpy(dbmap_dir, db_dir, MAXPATHLEN);
+	nb_db = db_count;
 	synchronous = synchronous_insert;
-	/* set global database engine info */
-
-	sqlite3_temp_directory = db_tmpdir;
-
-	/* initialize structures for each thread and launch it */
-
-	for (i = 0; i < nb_db_threads; i++) {
-		rc = init_db_thread_info(&db_thread[i], 100);
-		if (rc)
-			return rc;
+	page_size = sysconf(_SC_PAGESIZE);
 
-		db_thread[i].thr_index = i;
-
-		rc = pthread_create(&db_thread[i].thr_id, NULL,
-				    database_worker_thread, &db_thread[i]);
-		if (rc)
-			return HANDLEMAP_SYSTEM_ERROR;
+	for (i = 0; i < nb_db; i++) {
+		PTHREAD_MUTEX_init(&journals[i].j_mutex, NULL);
+		journals[i].j_fd = -1;
 	}
 
-	/* I'm ready to serve, my Lord ! */
 	return HANDLEMAP_SUCCESS;
 }
 
-/* wait that a thread has done all its jobs */
-static void wait_thread_jobs_finished(db_thread_info_t *p_thr_info)
-{
-
-	PTHREAD_MUTEX_lock(&p_thr_info->work_queue.queues_mutex);
-
-	/* wait until the thread has no more tasks in its queue
-	 * and it is no more working
-	 */
-	while (p_thr_info->work_queue.highprio_first != NULL
-	       || p_thr_info->work_queue.lowprio_first != NULL
-	       || p_thr_info->work_queue.status == WORKING)
-		pthread_cond_wait(&p_thr_info->work_queue.work_done_condition,
-				  &p_thr_info->work_queue.queues_mutex);
-
-	PTHREAD_MUTEX_unlock(&p_thr_info->work_queue.queues_mutex);
-
-}
-
 /**
- * Gives the order to each DB thread to reload
- * the content of its database and insert it
- * to the hash table.
- * The function blocks until all threads have loaded their data.
+ * Replays all the journals into the handle map,
+ * then rewrites them with only the live mappings.
  */
-int handlemap_db_reaload_all(hash_table_t *target_hash)
+int handlemap_db_reaload_all(void)
 {
-	unsigned int i;
-	db_op_item_t *new_task;
-	int rc;
+	char path[MAXPATHLEN + 1];
+	char tmp_path[MAXPATHLEN + 1];
+	unsigned int i, records = 0;
+	int rc, fd;
+
+	/* journals of a previous run may have been more numerous */
+	for (i = 0; i < MAX_DB; i++) {
+		rc = journal_replay(i, &records);
+		if (rc)
+			return rc;
+	}
 
-	/* give the job to all threads */
-	for (i = 0; i < nb_db_threads; i++) {
-		/* get a new db operation  */
-		PTHREAD_MUTEX_lock(&db_thread[i].pool_mutex);
+	for (i = 0; i < nb_db; i++) {
+		rc = journal_create(i);
+		if (rc)
+			return rc;
+	}
 
-		new_task = pool_alloc(db_thread[i].dbop_pool);
+	rc = HANDLEMAP_SUCCESS;
+	handle_mapping_hash_foreach(journal_compact_cb, &rc);
+	if (rc)
+		return rc;
 
-		PTHREAD_MUTEX_unlock(&db_thread[i].pool_mutex);
+	for (i = 0; i < nb_db; i++) {
+		struct journal *j = &journals[i];
 
-		/* can you fill it ? */
-		new_task->op_type = LOAD;
-		new_task->op_arg.hash = target_hash;
+		if (msync(j->j_map, j->j_tail, MS_SYNC) == -1 ||
+		    fsync(j->j_fd) == -1) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: could not sync handle map journal: %s",
+				strerror(errno));
+			return HANDLEMAP_SYSTEM_ERROR;
+		}
 
-		rc = dbop_push(&db_thread[i].work_queue, new_task);
+		journal_path(tmp_path, i, true);
+		journal_path(path, i, false);
+		if (rename(tmp_path, path) == -1) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: could not rename %s to %s: %s",
+				tmp_path, path, strerror(errno));
+			return HANDLEMAP_SYSTEM_ERROR;
+		}
+	}
 
-		if (rc)
-			return rc;
+	for (i = nb_db; i < MAX_DB; i++) {
+		journal_path(path, i, false);
+		(void)unlink(path);
 	}
 
-	/* wait for all threads to finish their job */
+	fd = open(dbmap_dir, O_RDONLY | O_DIRECTORY);
+	if (fd != -1) {
+		(void)fsync(fd);
+		close(fd);
+	}
 
-	for (i = 0; i < nb_db_threads; i++)
-		wait_thread_jobs_finished(&db_thread[i]);
+	LogEvent(COMPONENT_FSAL,
+		 "Replayed %u handle map journal records into %u journals",
+		 records, nb_db);
 
 	return HANDLEMAP_SUCCESS;
 
 }				/* handlemap_db_reaload_all */
 
 /**
- * Submit a db 'insert' request.
- * The request is inserted in the appropriate db queue.
+ * Append an 'insert' record to the appropriate journal.
  */
 int handlemap_db_insert(nfs23_map_handle_t *p_in_nfs23_digest,
 			const void *data, uint32_t len)
 {
-	unsigned int i;
-	db_op_item_t *new_task;
-	int rc;
-
-	if (!synchronous) {
-		/* which thread is going to handle this inode ? */
-
-		i = select_db_queue(p_in_nfs23_digest);
-
-		/* get a new db operation  */
-		PTHREAD_MUTEX_lock(&db_thread[i].pool_mutex);
-
-		new_task = pool_alloc(db_thread[i].dbop_pool);
-
-		PTHREAD_MUTEX_unlock(&db_thread[i].pool_mutex);
-
-		/* fill the task info */
-		new_task->op_type = INSERT;
-		new_task->op_arg.fh_info.nfs23_digest = *p_in_nfs23_digest;
-		memcpy(new_task->op_arg.fh_info.fh4_data, data, len);
-		new_task->op_arg.fh_info.fh4_len = len;
-
-		rc = dbop_push(&db_thread[i].work_queue, new_task);
-
-		if (rc)
-			return rc;
-	}
-	/* else: @todo not supported yet */
-
-	return HANDLEMAP_SUCCESS;
-
+	return journal_append(JOURNAL_INSERT, p_in_nfs23_digest, data, len);
 }
 
 /**
- * Submit a db 'delete' request.
- * The request is inserted in the appropriate db queue.
- * (always asynchronous)
+ * Append a 'delete' record to the appropriate journal.
  */
 int handlemap_db_delete(nfs23_map_handle_t *p_in_nfs23_digest)
 {
-	unsigned int i;
-	db_op_item_t *new_task;
-	int rc;
-
-	/* which thread is going to handle this inode ? */
-
-	i = select_db_queue(p_in_nfs23_digest);
-
-	/* get a new db operation  */
-	PTHREAD_MUTEX_lock(&db_thread[i].pool_mutex);
-
-	new_task = pool_alloc(db_thread[i].dbop_pool);
-
-	PTHREAD_MUTEX_unlock(&db_thread[i].pool_mutex);
-
-	/* fill the task info */
-	new_task->op_type = DELETE;
-	new_task->op_arg.fh_info.nfs23_digest = *p_in_nfs23_digest;
-
-	rc = dbop_push(&db_thread[i].work_queue, new_task);
-
-	if (rc)
-		return rc;
-
-	return HANDLEMAP_SUCCESS;
-
+	return journal_append(JOURNAL_DELETE, p_in_nfs23_digest, NULL, 0);
 }
 
 /**
- * Wait for all queues to be empty
- * and all current DB request to be done.
+ * Sync all the journals to stable storage.
  */
 int handlemap_db_flush(void)
 {
@@ -1022,29 +467,31 @@ int handlemap_db_flush(void)
 	struct timeval t1;
 	struct timeval t2;
 	struct timeval tdiff;
-	unsigned int to_sync = 0;
-
-	for (i = 0; i < nb_db_threads; i++)
-		to_sync += db_thread[i].work_queue.nb_waiting;
-
-	LogEvent(COMPONENT_FSAL,
-		 "Waiting for database synchronization (%u operations pending)",
-		 to_sync);
+	int rc = HANDLEMAP_SUCCESS;
 
 	gettimeofday(&t1, NULL);
 
-	/* wait for all threads to finish their job */
+	for (i = 0; i < nb_db; i++) {
+		struct journal *j = &journals[i];
 
-	for (i = 0; i < nb_db_threads; i++)
-		wait_thread_jobs_finished(&db_thread[i]);
+		PTHREAD_MUTEX_lock(&j->j_mutex);
+		if (j->j_map != NULL &&
+		    msync(j->j_map, j->j_tail, MS_SYNC) == -1) {
+			LogCrit(COMPONENT_FSAL,
+				"ERROR: could not sync handle map journal: %s",
+				strerror(errno));
+			rc = HANDLEMAP_SYSTEM_ERROR;
+		}
+		PTHREAD_MUTEX_unlock(&j->j_mutex);
+	}
 
 	gettimeofday(&t2, NULL);
 
 	timersub(&t2, &t1, &tdiff);
 
-	LogEvent(COMPONENT_FSAL, "Database synchronized in %d.%06ds",
+	LogEvent(COMPONENT_FSAL, "Handle map journals synchronized in %d.%06ds",
 		 (int)tdiff.tv_sec, (int)tdiff.tv_usec);
 
-	return HANDLEMAP_SUCCESS;
+	return rc;
 
 }
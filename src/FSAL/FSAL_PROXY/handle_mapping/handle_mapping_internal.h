@@ -1,14 +1,15 @@
-
 #ifndef _HANDLE_MAPPING_INTERNAL_H
 #define _HANDLE_MAPPING_INTERNAL_H
 
-#include "hashtable.h"
+#include "handle_mapping.h"
+
+typedef void (*handle_mapping_cb)(const nfs23_map_handle_t *digest,
+				  const void *data, uint32_t datalen,
+				  void *arg);
 
-int handle_mapping_hash_add(hash_table_t *p_hash, uint64_t object_id,
-			    unsigned int handle_hash, const void *data,
-			    uint32_t datalen);
-int snprintmem(char *target, size_t tgt_size, const void *source,
-	       size_t mem_size);
-int sscanmem(void *target, size_t tgt_size, const char *str_source);
+int handle_mapping_hash_add(uint64_t object_id, unsigned int handle_hash,
+			    const void *data, uint32_t datalen);
+int handle_mapping_hash_del(uint64_t object_id, unsigned int handle_hash);
+void handle_mapping_hash_foreach(handle_mapping_cb cb, void *arg);
 
 #endif
@@ -1,5 +1,5 @@
 #include "config.h"
-#include "handle_mapping_db.h"
+#include "handle_mapping.h"
 #include <sys/time.h>
 
 int main(int argc, char **argv)
@@ -23,7 +23,7 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	count = atoi(argv[2])
+	count = atoi(argv[2]);
 	if (count == 0) {
 		LogTest("usage: test_handle_mapping <db_dir> <db_count>");
 		exit(1);
@@ -31,12 +31,10 @@ int main(int argc, char **argv)
 
 	dir = argv[1];
 
-	strcpy(param.databases_directory, dir);
-	strcpy(param.temp_directory, "/tmp");
+	param.databases_directory = dir;
+	param.temp_directory = "/tmp";
 	param.database_count = count;
 	param.hashtable_size = 27;
-	param.nb_handles_prealloc = 1024;
-	param.nb_db_op_prealloc = 1024;
 	param.synchronous_insert = false;
 
 	rc = HandleMap_Init(&param);
@@ -53,13 +51,13 @@ int main(int argc, char **argv)
 
 	for (i = 0; i < 10000; i++) {
 		nfs23_map_handle_t nfs23_digest;
-		fsal_handle_t handle;
+		char handle[64];
 
-		memset(&handle, i, sizeof(fsal_handle_t));
+		memset(handle, i, sizeof(handle));
 		nfs23_digest.object_id = 12345 + i;
 		nfs23_digest.handle_hash = (1999 * i + now) % 479001599;
 
-		rc = HandleMap_SetFH(&nfs23_digest, &handle);
+		rc = HandleMap_SetFH(&nfs23_digest, handle, sizeof(handle));
 		if (rc && (rc != HANDLEMAP_EXISTS))
 			exit(rc);
 	}
@@ -75,12 +73,13 @@ int main(int argc, char **argv)
 
 	for (i = 0; i < 10000; i++) {
 		nfs23_map_handle_t nfs23_digest;
-		fsal_handle_t handle;
+		char handle[NFS4_FHSIZE];
+		struct gsh_buffdesc fh_desc = { handle, sizeof(handle) };
 
 		nfs23_digest.object_id = 12345 + i;
 		nfs23_digest.handle_hash = (1999 * i + now) % 479001599;
 
-		rc = HandleMap_GetFH(&nfs23_digest, &handle);
+		rc = HandleMap_GetFH(&nfs23_digest, &fh_desc);
 		if (rc) {
 			LogTest("Error %d retrieving handle !", rc);
 			exit(rc);
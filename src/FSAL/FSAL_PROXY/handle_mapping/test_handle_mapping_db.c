@@ -1,6 +1,109 @@
 #include "config.h"
+#include "handle_mapping.h"
 #include "handle_mapping_db.h"
 #include <sys/time.h>
+#include <pthread.h>
+
+#define NB_HANDLES 100000
+
+static unsigned int nb_threads;
+static time_t now;
+
+/* Each thread maps, looks up then removes its own NB_HANDLES handles */
+enum bench_op {
+	BENCH_SET,
+	BENCH_GET,
+	BENCH_DEL,
+};
+
+struct bench_arg {
+	unsigned int idx;
+	enum bench_op op;
+	int rc;
+};
+
+static void make_digest(nfs23_map_handle_t *digest, unsigned int i)
+{
+	memset(digest, 0, sizeof(*digest));
+	digest->len = sizeof(*digest);
+	digest->type = PXY_HANDLE_MAPPED;
+	digest->object_id = 12345 + i;
+	digest->handle_hash = (1999 * i + now) % 479001599;
+}
+
+static void *bench_thread(void *arg)
+{
+	struct bench_arg *ba = arg;
+	unsigned int i, first = ba->idx * NB_HANDLES;
+	nfs23_map_handle_t digest;
+	char handle[64];
+	char out[NFS4_FHSIZE];
+	struct gsh_buffdesc fh_desc;
+
+	for (i = first; i < first + NB_HANDLES; i++) {
+		make_digest(&digest, i);
+
+		switch (ba->op) {
+		case BENCH_SET:
+			memset(handle, i, sizeof(handle));
+			ba->rc = HandleMap_SetFH(&digest, handle,
+						 sizeof(handle));
+			if (ba->rc == HANDLEMAP_EXISTS)
+				ba->rc = HANDLEMAP_SUCCESS;
+			break;
+		case BENCH_GET:
+			fh_desc.addr = out;
+			fh_desc.len = sizeof(out);
+			ba->rc = HandleMap_GetFH(&digest, &fh_desc);
+			break;
+		case BENCH_DEL:
+			ba->rc = HandleMap_DelFH(&digest);
+			break;
+		}
+
+		if (ba->rc)
+			break;
+	}
+
+	return NULL;
+}
+
+/* Run op over all the threads and print the throughput */
+static int bench(enum bench_op op, const char *label)
+{
+	pthread_t thr[MAX_DB];
+	struct bench_arg args[MAX_DB];
+	struct timeval tv1, tv2, tvdiff;
+	unsigned int i;
+	double secs;
+
+	gettimeofday(&tv1, NULL);
+
+	for (i = 0; i < nb_threads; i++) {
+		args[i].idx = i;
+		args[i].op = op;
+		args[i].rc = 0;
+		if (pthread_create(&thr[i], NULL, bench_thread, &args[i]))
+			return HANDLEMAP_SYSTEM_ERROR;
+	}
+
+	for (i = 0; i < nb_threads; i++)
+		pthread_join(thr[i], NULL);
+
+	gettimeofday(&tv2, NULL);
+	timersub(&tv2, &tv1, &tvdiff);
+	secs = tvdiff.tv_sec + tvdiff.tv_usec / 1000000.0;
+
+	LogTest("%u threads: %u %s in %d.%06ds (%.0f ops/s)", nb_threads,
+		nb_threads * NB_HANDLES, label, (int)tvdiff.tv_sec,
+		(int)tvdiff.tv_usec, nb_threads * NB_HANDLES / secs);
+
+	for (i = 0; i < nb_threads; i++)
+		if (args[i].rc)
+			return args[i].rc;
+
+	return HANDLEMAP_SUCCESS;
+}
 
 int main(int argc, char **argv)
 {
@@ -8,66 +111,76 @@ int main(int argc, char **argv)
 	struct timeval tv1, tv2, tv3, tvdiff;
 	int count, rc;
 	char *dir;
-	time_t now;
+	handle_map_param_t param;
 
-	if (argc != 3) {
-		LogTest("usage: test_handle_mapping_db <db_dir> <db_count>");
+	/* Init logging */
+	SetNamePgm("test_handle_mapping_db");
+	SetDefaultLogging("TEST");
+	SetNameFunction("main");
+	SetNameHost("localhost");
+	InitLogging();
+
+	if (argc != 3 && argc != 4) {
+		LogTest(
+			"usage: test_handle_mapping_db <db_dir> <db_count> [threads]");
 		exit(1);
 	}
 
-	count = atoi(argv[2])
-	if (count == 0) {
-		LogTest("usage: test_handle_mapping_db <db_dir> <db_count>");
+	count = atoi(argv[2]);
+	if (count <= 0 || count > MAX_DB) {
+		LogTest(
+			"usage: test_handle_mapping_db <db_dir> <db_count> [threads]");
 		exit(1);
 	}
 
-	dir = argv[1];
+	nb_threads = argc == 4 ? atoi(argv[3]) : count;
+	if (nb_threads == 0 || nb_threads > MAX_DB)
+		nb_threads = count;
 
-	/* Init logging */
-	SetNamePgm("test_handle_mapping");
-	SetNameFileLog("/dev/tty");
-	SetNameFunction("main");
-	SetNameHost("localhost");
+	dir = argv[1];
 
-	/* count databases */
+	/* count journals */
 
 	rc = handlemap_db_count(dir);
 
 	LogTest("handlemap_db_count(%s)=%d", dir, rc);
 
-	if (rc != 0 && count != rc) {
-		LogTest(
-			"Warning: incompatible thread count %d <> database count %d",
-			count, rc);
-	}
+	memset(&param, 0, sizeof(param));
+	param.databases_directory = dir;
+	param.temp_directory = "/tmp";
+	param.database_count = count;
+	param.hashtable_size = 103;
+	param.synchronous_insert = false;
 
-	rc = handlemap_db_init(dir, "/tmp", count, 1024, false);
+	/* this replays and compacts what a previous run left */
 
-	LogTest("handlemap_db_init() = %d", rc);
-	if (rc)
-		exit(rc);
+	gettimeofday(&tv1, NULL);
 
-	rc = handlemap_db_reaload_all(NULL);
+	rc = HandleMap_Init(&param);
+
+	gettimeofday(&tv2, NULL);
+	timersub(&tv2, &tv1, &tvdiff);
 
-	LogTest("handlemap_db_reaload_all() = %d", rc);
+	LogTest("HandleMap_Init() = %d in %d.%06ds", rc, (int)tvdiff.tv_sec,
+		(int)tvdiff.tv_usec);
 	if (rc)
 		exit(rc);
 
-	gettimeofday(&tv1, NULL);
-
-	/* Now insert a set of handles */
+	/* Journal appends alone */
 
 	now = time(NULL);
 
+	gettimeofday(&tv1, NULL);
+
 	for (i = 0; i < 10000; i++) {
 		nfs23_map_handle_t nfs23_digest;
-		fsal_handle_t handle;
+		char handle[64];
 
-		memset(&handle, i, sizeof(fsal_handle_t));
-		nfs23_digest.object_id = 12345 + i;
-		nfs23_digest.handle_hash = (1999 * i + now) % 479001599;
+		memset(handle, i, sizeof(handle));
+		make_digest(&nfs23_digest, i);
 
-		rc = handlemap_db_insert(&nfs23_digest, &handle);
+		rc = handlemap_db_insert(&nfs23_digest, handle,
+					 sizeof(handle));
 		if (rc)
 			exit(rc);
 	}
@@ -76,43 +189,43 @@ int main(int argc, char **argv)
 
 	timersub(&tv2, &tv1, &tvdiff);
 
-	LogTest("%u threads inserted 10000 handles in %d.%06ds", count,
-		(int)tvdiff.tv_sec, (int)tvdiff.tv_usec);
-
-	rc = handlemap_db_flush();
-
-	gettimeofday(&tv3, NULL);
-
-	timersub(&tv3, &tv1, &tvdiff);
-	LogTest("Total time with %u threads (including flush): %d.%06ds", count,
+	LogTest("Appended 10000 insert records in %d.%06ds",
 		(int)tvdiff.tv_sec, (int)tvdiff.tv_usec);
 
-	LogTest("Now, delete operations");
-
 	for (i = 0; i < 10000; i++) {
 		nfs23_map_handle_t nfs23_digest;
 
-		nfs23_digest.object_id = 12345 + i;
-		nfs23_digest.handle_hash = (1999 * i + now) % 479001599;
+		make_digest(&nfs23_digest, i);
 
 		rc = handlemap_db_delete(&nfs23_digest);
 		if (rc)
 			exit(rc);
 	}
 
-	gettimeofday(&tv2, NULL);
-	timersub(&tv2, &tv3, &tvdiff);
+	rc = handlemap_db_flush();
 
-	LogTest("%u threads deleted 10000 handles in %d.%06ds", count,
+	gettimeofday(&tv3, NULL);
+	timersub(&tv3, &tv2, &tvdiff);
+
+	LogTest("Appended 10000 delete records in %d.%06ds (including flush)",
 		(int)tvdiff.tv_sec, (int)tvdiff.tv_usec);
 
-	rc = handlemap_db_flush();
+	/* Throughput of the map and its journals */
 
-	gettimeofday(&tv1, NULL);
-	timersub(&tv1, &tv3, &tvdiff);
-	LogTest("Delete time with %u threads (including flush): %d.%06ds",
-		count, (int)tvdiff.tv_sec, (int)tvdiff.tv_usec);
+	rc = bench(BENCH_SET, "inserts");
+	if (rc)
+		exit(rc);
+
+	rc = bench(BENCH_GET, "lookups");
+	if (rc)
+		exit(rc);
+
+	rc = bench(BENCH_DEL, "deletes");
+	if (rc)
+		exit(rc);
+
+	rc = HandleMap_Flush();
 
-	exit(0);
+	exit(rc);
 
 }
@@ -12,6 +12,7 @@ struct pxy_client_params {
 	unsigned int srv_sendsize;
 	unsigned int srv_recvsize;
 	unsigned int srv_timeout;
+	unsigned int srv_connections;
 	unsigned short srv_port;
 	unsigned int use_privileged_client_port;
 	char *remote_principal;
@@ -282,7 +282,7 @@ static struct pseudo_fsal_obj_handle
 
 	avltree_init(&hdl->avl_name, pseudofs_n_cmpf, 0 /* flags */);
 	avltree_init(&hdl->avl_index, pseudofs_i_cmpf, 0 /* flags */);
-	hdl->next_i = 2;
+	hdl->next_i = 3;	/* 0, 1 and 2 are never cookies */
 	if (parent != NULL) {
 		/* Attach myself to my parent */
 		PTHREAD_RWLOCK_wrlock(&parent->obj_handle.obj_lock);
@@ -464,9 +464,9 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	bool cb_rc;
 
 	if (whence != NULL)
-		seekloc = *whence;
+		seekloc = *whence + 1;	/* resume after the cookie */
 	else
-		seekloc = 2;    /* start from index 2, if no cookie */
+		seekloc = 3;    /* start from index 3, if no cookie */
 
 	*eof = true;
 
@@ -552,7 +552,8 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name)
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
 {
 	struct pseudo_fsal_obj_handle *myself, *hdl;
 	fsal_errors_t error = ERR_FSAL_NOENT;
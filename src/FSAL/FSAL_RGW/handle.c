@@ -36,6 +36,158 @@
 #include "nfs_exports.h"
 #include "FSAL/fsal_commonlib.h"
 
+/**
+ * @brief Write out the staged writes of a file
+ *
+ * Called with io_mutex held.
+ *
+ * @return 0 or a negative RGW error.
+ */
+
+static int rgw_flush_staged(struct rgw_export *export,
+			    struct rgw_handle *handle)
+{
+	size_t done = 0, written;
+	int rc;
+
+	while (done < handle->wlen) {
+		rc = rgw_write(export->rgw_fs, handle->rgw_fh,
+			       handle->woff + done, handle->wlen - done,
+			       &written, handle->wbuf + done,
+			       RGW_WRITE_FLAG_NONE);
+		if (rc < 0) {
+			LogDebug(COMPONENT_FSAL,
+				 "staged write of %zu bytes at %"PRIu64
+				 " failed %d",
+				 handle->wlen - done, handle->woff + done, rc);
+			handle->wlen = 0;
+			return rc;
+		}
+		if (written == 0) {
+			handle->wlen = 0;
+			return -EIO;
+		}
+		done += written;
+	}
+
+	handle->wlen = 0;
+	return 0;
+}
+
+/**
+ * @brief Stage an unstable write
+ *
+ * A write that carries on from the staged ones joins them, until
+ * write_buffer bytes are staged; they then go to RGW as one write.
+ * Any other write first flushes what is staged.
+ *
+ * Called with io_mutex held.
+ *
+ * @return true if the write was staged.
+ */
+
+static bool rgw_stage_write(struct rgw_export *export,
+			    struct rgw_handle *handle, uint64_t offset,
+			    size_t size, void *buffer, int *rc)
+{
+	*rc = 0;
+
+	if (handle->wlen != 0 && offset != handle->woff + handle->wlen) {
+		*rc = rgw_flush_staged(export, handle);
+		if (*rc < 0)
+			return false;
+	}
+
+	if (size >= export->write_buffer)
+		return false;
+
+	if (handle->wlen + size > export->write_buffer) {
+		*rc = rgw_flush_staged(export, handle);
+		if (*rc < 0)
+			return false;
+	}
+
+	if (handle->wbuf == NULL)
+		handle->wbuf = gsh_malloc(export->write_buffer);
+
+	if (handle->wlen == 0)
+		handle->woff = offset;
+
+	memcpy(handle->wbuf + handle->wlen, buffer, size);
+	handle->wlen += size;
+	return true;
+}
+
+/**
+ * @brief Drop the read ahead and the buffers of a file
+ *
+ * Staged writes must have been flushed.
+ */
+
+static void rgw_io_buffers_free(struct rgw_handle *handle)
+{
+	PTHREAD_MUTEX_lock(&handle->io_mutex);
+	gsh_free(handle->wbuf);
+	handle->wbuf = NULL;
+	handle->wlen = 0;
+	gsh_free(handle->rbuf);
+	handle->rbuf = NULL;
+	handle->rlen = 0;
+	handle->rnext = 0;
+	PTHREAD_MUTEX_unlock(&handle->io_mutex);
+}
+
+/**
+ * @brief Serve a read from the read ahead
+ *
+ * A read that starts where the previous one ended refills the read
+ * ahead with read_ahead bytes from its offset.  Called with io_mutex
+ * held.
+ *
+ * @return true if the read was served, or failed with *rc.
+ */
+
+static bool rgw_read_ahead(struct rgw_export *export,
+			   struct rgw_handle *handle, uint64_t offset,
+			   size_t size, void *buffer, size_t *read_amount,
+			   bool *end_of_file, int *rc)
+{
+	size_t avail;
+	bool hit;
+
+	*rc = 0;
+
+	hit = handle->rlen != 0 && offset >= handle->roff &&
+	      offset < handle->roff + handle->rlen &&
+	      (handle->reof || offset + size <= handle->roff + handle->rlen);
+
+	if (!hit) {
+		if (offset != handle->rnext || size >= export->read_ahead)
+			return false;
+
+		if (handle->rbuf == NULL)
+			handle->rbuf = gsh_malloc(export->read_ahead);
+
+		handle->rlen = 0;
+		*rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset,
+			       export->read_ahead, &handle->rlen,
+			       handle->rbuf, RGW_READ_FLAG_NONE);
+		if (*rc < 0) {
+			handle->rlen = 0;
+			return true;
+		}
+
+		handle->roff = offset;
+		handle->reof = handle->rlen < export->read_ahead;
+	}
+
+	avail = handle->roff + handle->rlen - offset;
+	*read_amount = MIN(size, avail);
+	memcpy(buffer, handle->rbuf + (offset - handle->roff), *read_amount);
+	*end_of_file = handle->reof && *read_amount == avail;
+	return true;
+}
+
 /**
  * @brief Release an object
  *
@@ -51,6 +203,10 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		container_of(obj_hdl, struct rgw_handle, handle);
 	struct rgw_export *export = obj->export;
 
+	if (obj->wlen != 0 && rgw_flush_staged(export, obj) < 0)
+		LogWarn(COMPONENT_FSAL,
+			"Lost staged writes of obj_hdl %p", obj_hdl);
+
 	if (obj->rgw_fh != export->rgw_fs->root_fh) {
 		/* release RGW ref */
 		(void) rgw_fh_rele(export->rgw_fs, obj->rgw_fh,
@@ -71,9 +227,12 @@ static void release(struct fsal_obj_handle *obj_hdl)
  *
  * @return FSAL status codes.
  */
-static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
-			const char *path, struct fsal_obj_handle **obj_hdl,
-			struct attrlist *attrs_out)
+static fsal_status_t lookup_int(struct fsal_obj_handle *dir_hdl,
+				const char *path,
+				struct fsal_obj_handle **obj_hdl,
+				struct attrlist *attrs_out,
+				struct stat *rcb_st, uint32_t rcb_mask,
+				uint32_t flags)
 {
 	int rc;
 	struct stat st;
@@ -89,10 +248,11 @@ static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
 	LogFullDebug(COMPONENT_FSAL,
 		"%s enter dir_hdl %p path %s", __func__, dir_hdl, path);
 
-	/* XXX presently, we can only fake attrs--maybe rgw_lookup should
-	 * take struct stat pointer OUT as libcephfs' does */
-	rc = rgw_lookup(export->rgw_fs, dir->rgw_fh, path, &rgw_fh,
-			RGW_LOOKUP_FLAG_NONE);
+	/* Attributes from a listing go into the new RGW handle, so the
+	 * getattr below need not ask RGW for them again.
+	 */
+	rc = rgw_fsal_lookup(export->rgw_fs, dir->rgw_fh, path, &rgw_fh,
+			     rcb_st, rcb_mask, flags);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
@@ -115,6 +275,14 @@ static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
 	return fsalstat(0, 0);
 }
 
+static fsal_status_t lookup(struct fsal_obj_handle *dir_hdl,
+			const char *path, struct fsal_obj_handle **obj_hdl,
+			struct attrlist *attrs_out)
+{
+	return lookup_int(dir_hdl, path, obj_hdl, attrs_out, NULL, 0,
+			  RGW_LOOKUP_FLAG_NONE);
+}
+
 struct rgw_cb_arg {
 	fsal_readdir_cb cb;
 	void *fsal_arg;
@@ -122,7 +290,12 @@ struct rgw_cb_arg {
 	attrmask_t attrmask;
 };
 
+#ifdef USE_FSAL_RGW_READDIR_ATTRS
+static bool rgw_cb(const char *name, void *arg, uint64_t offset,
+		   struct stat *st, uint32_t st_mask, uint32_t flags)
+#else
 static bool rgw_cb(const char *name, void *arg, uint64_t offset)
+#endif
 {
 	struct rgw_cb_arg *rgw_cb_arg = arg;
 	struct fsal_obj_handle *obj;
@@ -132,7 +305,15 @@ static bool rgw_cb(const char *name, void *arg, uint64_t offset)
 
 	fsal_prepare_attrs(&attrs, rgw_cb_arg->attrmask);
 
+#ifdef USE_FSAL_RGW_READDIR_ATTRS
+	/* The size and times of the entry come with the bucket listing */
+	status = lookup_int(rgw_cb_arg->dir_hdl, name, &obj, &attrs, st,
+			    st_mask, RGW_LOOKUP_FLAG_RCB |
+			    (flags & (RGW_LOOKUP_FLAG_DIR |
+				      RGW_LOOKUP_FLAG_FILE)));
+#else
 	status = lookup(rgw_cb_arg->dir_hdl, name, &obj, &attrs);
+#endif
 	if (FSAL_IS_ERROR(status))
 		return false;
 
@@ -355,6 +536,12 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 		return rgw2fsal_error(rc);
 	}
 
+	/* Staged writes are not in RGW yet, but are in the file */
+	PTHREAD_MUTEX_lock(&handle->io_mutex);
+	if (handle->wlen != 0 && handle->woff + handle->wlen > st.st_size)
+		st.st_size = handle->woff + handle->wlen;
+	PTHREAD_MUTEX_unlock(&handle->io_mutex);
+
 	posix2fsal_attributes(&st, attrs);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -376,7 +563,8 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 fsal_status_t rgw_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
 				bool bypass,
 				struct state_t *state,
-				struct attrlist *attrib_set)
+				struct attrlist *attrib_set,
+				struct attrlist *attrs_out)
 {
 
 	fsal_status_t status = {0, 0};
@@ -440,8 +628,15 @@ fsal_status_t rgw_fsal_setattr2(struct fsal_obj_handle *obj_hdl,
 	memset(&st, 0, sizeof(struct stat));
 
 	if (FSAL_TEST_MASK(attrib_set->valid_mask, ATTR_SIZE)) {
-		rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
-				attrib_set->filesize, RGW_TRUNCATE_FLAG_NONE);
+		PTHREAD_MUTEX_lock(&handle->io_mutex);
+		rc = rgw_flush_staged(export, handle);
+		handle->rlen = 0;
+		PTHREAD_MUTEX_unlock(&handle->io_mutex);
+
+		if (rc == 0)
+			rc = rgw_truncate(export->rgw_fs, handle->rgw_fh,
+					  attrib_set->filesize,
+					  RGW_TRUNCATE_FLAG_NONE);
 
 		if (rc < 0) {
 			status = rgw2fsal_error(rc);
@@ -551,7 +746,9 @@ static fsal_status_t rgw_fsal_rename(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	int rc;
 
@@ -592,7 +789,8 @@ static fsal_status_t rgw_fsal_rename(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t rgw_fsal_unlink(struct fsal_obj_handle *dir_hdl,
 				struct fsal_obj_handle *obj_hdl,
-				const char *name)
+				const char *name,
+				struct attrlist *parent_attrs_out)
 {
 	int rc;
 
@@ -1031,7 +1229,7 @@ fsal_status_t rgw_fsal_open2(struct fsal_obj_handle *obj_hdl,
 		status = (*new_obj)->obj_ops.setattr2(*new_obj,
 						      false,
 						      state,
-						      attrib_set);
+						      attrib_set, NULL);
 
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
@@ -1256,18 +1454,35 @@ fsal_status_t rgw_fsal_read2(struct fsal_obj_handle *obj_hdl,
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
 	}
 
-	/* RGW does not support a file descriptor abstraction--so
-	 * reads are handle based */
+	int rc = 0;
 
-	int rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset,
-			buffer_size, read_amount, buffer,
-			RGW_READ_FLAG_NONE);
+	PTHREAD_MUTEX_lock(&handle->io_mutex);
+
+	/* Reads see the staged writes */
+	if (handle->wlen != 0)
+		rc = rgw_flush_staged(export, handle);
+
+	if (rc == 0 && (export->read_ahead == 0 ||
+			!rgw_read_ahead(export, handle, offset, buffer_size,
+					buffer, read_amount, end_of_file,
+					&rc))) {
+		/* RGW does not support a file descriptor abstraction--so
+		 * reads are handle based */
+		rc = rgw_read(export->rgw_fs, handle->rgw_fh, offset,
+			      buffer_size, read_amount, buffer,
+			      RGW_READ_FLAG_NONE);
+		if (rc >= 0)
+			*end_of_file = (*read_amount == 0);
+	}
+
+	if (rc >= 0)
+		handle->rnext = offset + *read_amount;
+
+	PTHREAD_MUTEX_unlock(&handle->io_mutex);
 
 	if (rc < 0)
 		return rgw2fsal_error(rc);
 
-	*end_of_file = (read_amount == 0);
-
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1321,9 +1536,29 @@ fsal_status_t rgw_fsal_write2(struct fsal_obj_handle *obj_hdl,
 
 	/* XXX note no call to fsal_find_fd (or wrapper) */
 
-	int rc = rgw_write(export->rgw_fs, handle->rgw_fh, offset,
-			buffer_size, wrote_amount, buffer,
-			RGW_WRITE_FLAG_NONE);
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&handle->io_mutex);
+
+	handle->rlen = 0;
+
+	if (export->write_buffer != 0 && !*fsal_stable &&
+	    rgw_stage_write(export, handle, offset, buffer_size, buffer,
+			    &rc)) {
+		PTHREAD_MUTEX_unlock(&handle->io_mutex);
+		*wrote_amount = buffer_size;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (rc == 0 && handle->wlen != 0)
+		rc = rgw_flush_staged(export, handle);
+
+	if (rc == 0)
+		rc = rgw_write(export->rgw_fs, handle->rgw_fh, offset,
+			       buffer_size, wrote_amount, buffer,
+			       RGW_WRITE_FLAG_NONE);
+
+	PTHREAD_MUTEX_unlock(&handle->io_mutex);
 
 	LogFullDebug(COMPONENT_FSAL,
 		"%s post obj_hdl %p state %p returned %d", __func__, obj_hdl,
@@ -1374,6 +1609,12 @@ fsal_status_t rgw_fsal_commit2(struct fsal_obj_handle *obj_hdl,
 		"%s enter obj_hdl %p offset %"PRIx64" length %zx",
 		__func__, obj_hdl, (uint64_t) offset, length);
 
+	PTHREAD_MUTEX_lock(&handle->io_mutex);
+	rc = rgw_flush_staged(export, handle);
+	PTHREAD_MUTEX_unlock(&handle->io_mutex);
+	if (rc < 0)
+		return rgw2fsal_error(rc);
+
 	rc = rgw_commit(export->rgw_fs, handle->rgw_fh, offset, length,
 			RGW_FSYNC_FLAG_NONE);
 	if (rc < 0)
@@ -1454,6 +1695,18 @@ fsal_status_t rgw_fsal_close2(struct fsal_obj_handle *obj_hdl,
 		}
 	}
 
+	PTHREAD_MUTEX_lock(&handle->io_mutex);
+	rc = rgw_flush_staged(export, handle);
+	PTHREAD_MUTEX_unlock(&handle->io_mutex);
+	rgw_io_buffers_free(handle);
+
+	if (rc < 0) {
+		(void) rgw_close(export->rgw_fs, handle->rgw_fh,
+				 RGW_CLOSE_FLAG_NONE);
+		handle->openflags = FSAL_O_CLOSED;
+		return rgw2fsal_error(rc);
+	}
+
 	rc = rgw_close(export->rgw_fs, handle->rgw_fh, RGW_CLOSE_FLAG_NONE);
 	if (rc < 0)
 		return rgw2fsal_error(rc);
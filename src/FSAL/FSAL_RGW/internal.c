@@ -212,6 +212,7 @@ int construct_handle(struct rgw_export *export,
 	constructing->handle.fileid = st->st_ino;
 
 	constructing->export = export;
+	PTHREAD_MUTEX_init(&constructing->io_mutex, NULL);
 
 	*obj = constructing;
 
@@ -221,5 +222,8 @@ int construct_handle(struct rgw_export *export,
 void deconstruct_handle(struct rgw_handle *obj)
 {
 	fsal_obj_handle_fini(&obj->handle);
+	PTHREAD_MUTEX_destroy(&obj->io_mutex);
+	gsh_free(obj->wbuf);
+	gsh_free(obj->rbuf);
 	gsh_free(obj);
 }
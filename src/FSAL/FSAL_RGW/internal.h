@@ -50,6 +50,25 @@
 #error rados/rgw_file.h version unsupported (require >= 1.1.1)
 #endif
 
+/**
+ * @brief rgw_lookup, with the attributes a listing gave if any
+ *
+ * Older librgw have no way to take them, and drop them.
+ */
+static inline int rgw_fsal_lookup(struct rgw_fs *rgw_fs,
+				  struct rgw_file_handle *parent,
+				  const char *path,
+				  struct rgw_file_handle **fh,
+				  struct stat *st, uint32_t mask,
+				  uint32_t flags)
+{
+#ifdef USE_FSAL_RGW_READDIR_ATTRS
+	return rgw_lookup(rgw_fs, parent, path, fh, st, mask, flags);
+#else
+	return rgw_lookup(rgw_fs, parent, path, fh, flags);
+#endif
+}
+
 /**
  * RGW Main (global) module object
  */
@@ -82,6 +101,8 @@ struct rgw_export {
 	char *rgw_user_id;
 	char *rgw_access_key_id;
 	char *rgw_secret_access_key;
+	uint32_t write_buffer;	/*< Bytes of sequential writes staged */
+	uint32_t read_ahead;	/*< Bytes read ahead for sequential reads */
 };
 
 /**
@@ -97,6 +118,15 @@ struct rgw_handle {
 					 *< belongs to */
 	struct fsal_share share;
 	fsal_openflags_t openflags;
+	pthread_mutex_t io_mutex;	/*< Protects the buffers below */
+	char *wbuf;		/*< Staged unstable writes */
+	uint64_t woff;
+	size_t wlen;
+	char *rbuf;		/*< Read ahead */
+	uint64_t roff;
+	size_t rlen;
+	bool reof;		/*< rbuf ends at end of file */
+	uint64_t rnext;		/*< Where a sequential read goes next */
 };
 
 /**
@@ -164,6 +164,10 @@ static struct config_item export_params[] = {
 		      rgw_export, rgw_access_key_id),
 	CONF_MAND_STR("secret_access_key", 0, MAXSECRETLEN, NULL,
 		      rgw_export, rgw_secret_access_key),
+	CONF_ITEM_UI32("write_buffer", 0, FSAL_MAXIOSIZE, 4 * 1024 * 1024,
+		       rgw_export, write_buffer),
+	CONF_ITEM_UI32("read_ahead", 0, FSAL_MAXIOSIZE, 4 * 1024 * 1024,
+		       rgw_export, read_ahead),
 	CONFIG_EOL
 };
 
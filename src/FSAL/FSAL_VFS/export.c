@@ -264,15 +264,16 @@ static fsal_status_t get_quota(struct fsal_export *exp_hdl,
 		retval = errsv;
 		goto out;
 	}
+	/* Limits are in 1K quota blocks, usage in bytes */
 	pquota->bhardlimit = fs_quota.dqb_bhardlimit;
 	pquota->bsoftlimit = fs_quota.dqb_bsoftlimit;
-	pquota->curblocks = fs_quota.dqb_curspace;
+	pquota->curblocks = (fs_quota.dqb_curspace + 1023) / 1024;
 	pquota->fhardlimit = fs_quota.dqb_ihardlimit;
 	pquota->fsoftlimit = fs_quota.dqb_isoftlimit;
 	pquota->curfiles = fs_quota.dqb_curinodes;
 	pquota->btimeleft = fs_quota.dqb_btime;
 	pquota->ftimeleft = fs_quota.dqb_itime;
-	pquota->bsize = DEV_BSIZE;
+	pquota->bsize = 1024;
 
  out:
 	return fsalstat(fsal_error, retval);
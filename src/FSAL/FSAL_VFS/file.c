@@ -38,6 +38,7 @@
 #include "fsal_convert.h"
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 #include "FSAL/fsal_commonlib.h"
 #include "vfs_methods.h"
 #include "os/subr.h"
@@ -103,6 +104,95 @@ fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd)
 	return fsalstat(fsal_error, retval);
 }
 
+/**
+ * @brief Take a reference on the file's shared fd for an access mode
+ *
+ * The shared fd is opened if it is not yet.  Must be called with the
+ * obj_lock held for write.
+ *
+ * @param[in]  myself     File on which to operate
+ * @param[in]  openflags  Mode of the open state
+ * @param[out] my_fd      The open state's fd
+ *
+ * @return FSAL status.
+ */
+
+static fsal_status_t vfs_get_shared_fd(struct vfs_fsal_obj_handle *myself,
+				       fsal_openflags_t openflags,
+				       struct vfs_fd *my_fd)
+{
+	fsal_openflags_t access = openflags & FSAL_O_RDWR;
+	struct vfs_shared_fd *sfd = &myself->u.file.shared[access - 1];
+	int posix_flags = 0;
+	fsal_status_t status;
+
+	if (sfd->fd.fd < 0) {
+		fsal2posix_openflags(access, &posix_flags);
+
+		status = vfs_open_my_fd(myself, access, posix_flags, &sfd->fd);
+
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	sfd->refcnt++;
+
+	my_fd->fd = sfd->fd.fd;
+	my_fd->openflags = openflags;
+	my_fd->shared = true;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Drop an open state's reference on a shared fd
+ *
+ * The fd stays open for the next open.  Must be called with the
+ * obj_lock held for write.
+ *
+ * @param[in]     myself  File on which to operate
+ * @param[in,out] my_fd   The open state's fd
+ */
+
+static void vfs_put_shared_fd(struct vfs_fsal_obj_handle *myself,
+			      struct vfs_fd *my_fd)
+{
+	struct vfs_shared_fd *sfd =
+		&myself->u.file.shared[(my_fd->openflags & FSAL_O_RDWR) - 1];
+
+	assert(sfd->fd.fd == my_fd->fd && sfd->refcnt > 0);
+
+	sfd->refcnt--;
+
+	my_fd->fd = -1;
+	my_fd->openflags = FSAL_O_CLOSED;
+	my_fd->shared = false;
+}
+
+/**
+ * @brief Close a file's shared fds
+ *
+ * Must be called with the obj_lock held for write.
+ *
+ * @param[in] myself  File on which to operate
+ * @param[in] idle    Only close the fds no open state uses
+ */
+
+void vfs_close_shared_fds(struct vfs_fsal_obj_handle *myself, bool idle)
+{
+	int i;
+
+	for (i = 0; i < VFS_SHARED_FDS; i++) {
+		struct vfs_shared_fd *sfd = &myself->u.file.shared[i];
+
+		if (idle && sfd->refcnt != 0)
+			continue;
+
+		(void) vfs_close_my_fd(&sfd->fd);
+		sfd->refcnt = 0;
+	}
+}
+
 /**
  * @brief Function to open an fsal_obj_handle's global file descriptor.
  *
@@ -169,6 +259,9 @@ fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl)
 
 	status = vfs_close_my_fd(&myself->u.file.fd);
 
+	/* The fds parked for the next open go with it. */
+	vfs_close_shared_fds(myself, true);
+
 	PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
 	return status;
@@ -391,6 +484,27 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 					      FSAL_O_CLOSED,
 					      openflags);
 
+			if (state->state_type == STATE_TYPE_SHARE &&
+			    createmode == FSAL_NO_CREATE && !truncated &&
+			    (openflags & FSAL_O_RDWR) != 0) {
+				/* A plain NFSv4 open, it can share the fd
+				 * other opens of the file in the same access
+				 * mode use, the share reservation is ours
+				 * alone.  Locks are taken on the lock state's
+				 * own fd.
+				 */
+				status = vfs_get_shared_fd(myself, openflags,
+							   my_fd);
+
+				PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+				if (FSAL_IS_ERROR(status))
+					goto undo_share;
+
+				*caller_perm_check = true;
+				return status;
+			}
+
 			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 		} else {
 			/* We need to use the global fd to continue, and take
@@ -553,7 +667,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 		posix_flags |= O_EXCL;
 	}
 
-	dir_fd = vfs_fsal_open(myself, O_PATH | O_NOACCESS, &status.major);
+	dir_fd = vfs_fsal_path_fd(myself, &status.major);
 
 	if (dir_fd < 0)
 		return fsalstat(status.major, -dir_fd);
@@ -701,7 +815,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 		status = (*new_obj)->obj_ops.setattr2(*new_obj,
 						      false,
 						      state,
-						      attrib_set);
+						      attrib_set, NULL);
 
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
@@ -730,7 +844,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 		posix2fsal_attributes(&stat, attrs_out);
 	}
 
-	close(dir_fd);
+	vfs_fsal_path_fd_done(myself, dir_fd);
 
 	if (state != NULL) {
 		/* Prepare to take the share reservation, but only if we are
@@ -761,7 +875,7 @@ fsal_status_t vfs_open2(struct fsal_obj_handle *obj_hdl,
 
  direrr:
 
-	close(dir_fd);
+	vfs_fsal_path_fd_done(myself, dir_fd);
 	return fsalstat(posix2fsal_error(retval), retval);
 }
 
@@ -839,7 +953,13 @@ fsal_status_t vfs_reopen2(struct fsal_obj_handle *obj_hdl,
 		/* Close the existing file descriptor and copy the new
 		 * one over.
 		 */
-		vfs_close_my_fd(my_share_fd);
+		if (my_share_fd->shared) {
+			PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
+			vfs_put_shared_fd(myself, my_share_fd);
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+		} else {
+			vfs_close_my_fd(my_share_fd);
+		}
 		*my_share_fd = fd;
 	} else {
 		/* We had a failure on open - we need to revert the share.
@@ -973,6 +1093,44 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 			size_t *read_amount,
 			bool *end_of_file,
 			struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return vfs_readv2(obj_hdl, bypass, state, offset, 1, &iov,
+			  read_amount, end_of_file, info);
+}
+
+/**
+ * @brief Read data from a file into a scatter list
+ *
+ * As vfs_read2(), but uses preadv() to fill the segments directly.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in]     iov_count      Number of segments in @a iov
+ * @param[in,out] iov            Segments to which data are to be copied
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_readv2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 int iov_count,
+			 struct iovec *iov,
+			 size_t *read_amount,
+			 bool *end_of_file,
+			 struct io_info *info)
 {
 	int my_fd = -1;
 	ssize_t nb_read;
@@ -1000,7 +1158,7 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 	if (FSAL_IS_ERROR(status))
 		goto out;
 
-	nb_read = pread(my_fd, buffer, buffer_size, offset);
+	nb_read = preadv(my_fd, iov, iov_count, offset);
 
 	if (offset == -1 || nb_read == -1) {
 		retval = errno;
@@ -1024,7 +1182,7 @@ fsal_status_t vfs_read2(struct fsal_obj_handle *obj_hdl,
 		info->io_content.what = NFS4_CONTENT_DATA;
 		info->io_content.data.d_offset = offset + nb_read;
 		info->io_content.data.d_data.data_len = nb_read;
-		info->io_content.data.d_data.data_val = buffer;
+		info->io_content.data.d_data.data_val = iov[0].iov_base;
 	}
 #endif
 
@@ -1073,6 +1231,46 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 size_t *wrote_amount,
 			 bool *fsal_stable,
 			 struct io_info *info)
+{
+	struct iovec iov = {
+		.iov_base = buffer,
+		.iov_len = buffer_size,
+	};
+
+	return vfs_writev2(obj_hdl, bypass, state, offset, 1, &iov,
+			   wrote_amount, fsal_stable, info);
+}
+
+/**
+ * @brief Write data to a file from a gather list
+ *
+ * As vfs_write2(), but uses pwritev() to write the segments directly.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position at which to write
+ * @param[in]     iov_count      Number of segments in @a iov
+ * @param[in]     iov            Data to be written
+ * @param[out]    wrote_amount   Amount of data written
+ * @param[in,out] fsal_stable    In, if on, the fsal is requested to write data
+ *                               to stable store. Out, the fsal reports what
+ *                               it did.
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_writev2(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  int iov_count,
+			  struct iovec *iov,
+			  size_t *wrote_amount,
+			  bool *fsal_stable,
+			  struct io_info *info)
 {
 	ssize_t nb_written;
 	fsal_status_t status;
@@ -1082,10 +1280,11 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 	bool closefd = false;
 	fsal_openflags_t openflags = FSAL_O_WRITE;
 
-	if (info != NULL) {
-		/* Currently we don't support WRITE_PLUS */
+	/* ALLOCATE and DEALLOCATE, but not WRITE_PLUS holes */
+	if (info != NULL && info->io_content.what != NFS4_CONTENT_DATA &&
+	    info->io_content.what != NFS4_CONTENT_ALLOCATE &&
+	    info->io_content.what != NFS4_CONTENT_DEALLOCATE)
 		return fsalstat(ERR_FSAL_NOTSUPP, 0);
-	}
 
 	if (obj_hdl->fsal != obj_hdl->fs->fsal) {
 		LogDebug(COMPONENT_FSAL,
@@ -1106,7 +1305,15 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 
 	fsal_set_credentials(op_ctx->creds);
 
-	nb_written = pwrite(my_fd, buffer, buffer_size, offset);
+	if (info == NULL || info->io_content.what == NFS4_CONTENT_DATA)
+		nb_written = pwritev(my_fd, iov, iov_count, offset);
+	else if (vfs_alloc_range(my_fd, info->io_content.hole.di_offset,
+				 info->io_content.hole.di_length,
+				 info->io_content.what ==
+					NFS4_CONTENT_DEALLOCATE) == 0)
+		nb_written = info->io_content.hole.di_length;
+	else
+		nb_written = -1;
 
 	if (nb_written == -1) {
 		retval = errno;
@@ -1136,6 +1343,325 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief File descriptors of a copy or clone
+ */
+struct vfs_copy_fds {
+	int src_fd;
+	int dst_fd;
+	bool src_lock;
+	bool dst_lock;
+	bool src_close;
+	bool dst_close;
+};
+
+/**
+ * @brief Get usable file descriptors for both ends of a copy
+ *
+ * A copy within one file uses a single read/write descriptor, as looking
+ * up a second one could need to reopen the global descriptor while the
+ * first still holds the object lock.
+ */
+static fsal_status_t vfs_copy_find_fds(struct fsal_obj_handle *src_hdl,
+				       struct state_t *src_state,
+				       struct fsal_obj_handle *dst_hdl,
+				       struct state_t *dst_state,
+				       struct vfs_copy_fds *fds)
+{
+	fsal_status_t status;
+
+	memset(fds, 0, sizeof(*fds));
+	fds->src_fd = fds->dst_fd = -1;
+
+	if (src_hdl->fsal != src_hdl->fs->fsal ||
+	    dst_hdl->fsal != dst_hdl->fs->fsal) {
+		LogDebug(COMPONENT_FSAL,
+			 "FSAL %s operation for handle belonging to FSAL %s, return EXDEV",
+			 src_hdl->fsal->name, src_hdl->fs->fsal->name);
+		return fsalstat(posix2fsal_error(EXDEV), EXDEV);
+	}
+
+	if (src_hdl == dst_hdl) {
+		status = find_fd(&fds->dst_fd, dst_hdl, false, dst_state,
+				 FSAL_O_RDWR, &fds->dst_lock, &fds->dst_close,
+				 false);
+		fds->src_fd = fds->dst_fd;
+		return status;
+	}
+
+	status = find_fd(&fds->src_fd, src_hdl, false, src_state, FSAL_O_READ,
+			 &fds->src_lock, &fds->src_close, false);
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	return find_fd(&fds->dst_fd, dst_hdl, false, dst_state, FSAL_O_WRITE,
+		       &fds->dst_lock, &fds->dst_close, false);
+}
+
+static void vfs_copy_release_fds(struct fsal_obj_handle *src_hdl,
+				 struct fsal_obj_handle *dst_hdl,
+				 struct vfs_copy_fds *fds)
+{
+	if (fds->src_close)
+		close(fds->src_fd);
+
+	if (fds->src_lock)
+		PTHREAD_RWLOCK_unlock(&src_hdl->obj_lock);
+
+	if (fds->dst_close)
+		close(fds->dst_fd);
+
+	if (fds->dst_lock)
+		PTHREAD_RWLOCK_unlock(&dst_hdl->obj_lock);
+}
+
+/** Most bytes handed to the kernel per copy_file_range() */
+#define VFS_COPY_CHUNK (1024 * 1024 * 1024)
+
+/** Buffer used when the kernel can't copy */
+#define VFS_COPY_BUFFER (1024 * 1024)
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * The kernel copies with copy_file_range(), which lets the filesystem
+ * share extents or copy on its side.  When the kernel or the filesystem
+ * can't, the range goes through a buffer here instead.
+ *
+ * @param[in]  src_hdl     File to copy from
+ * @param[in]  src_state   state_t to read the source with
+ * @param[in]  src_offset  Position in the source
+ * @param[in]  dst_hdl     File to copy to
+ * @param[in]  dst_state   state_t to write the destination with
+ * @param[in]  dst_offset  Position in the destination
+ * @param[in]  count       Bytes to copy, 0 for up to the end of the source
+ * @param[out] copied      Bytes copied
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_copy2(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count,
+			uint64_t *copied)
+{
+	struct vfs_copy_fds fds;
+	fsal_status_t status;
+	off_t src_pos = src_offset;
+	off_t dst_pos = dst_offset;
+	bool in_kernel = true;
+	char *buffer = NULL;
+	size_t chunk;
+	ssize_t nb;
+	int retval;
+
+	*copied = 0;
+
+	status = vfs_copy_find_fds(src_hdl, src_state, dst_hdl, dst_state,
+				   &fds);
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		goto out;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	while (count == 0 || *copied < count) {
+		chunk = VFS_COPY_CHUNK;
+		if (count != 0 && count - *copied < chunk)
+			chunk = count - *copied;
+
+		if (in_kernel) {
+			nb = vfs_copy_range(fds.src_fd, &src_pos, fds.dst_fd,
+					    &dst_pos, chunk);
+			if (nb == -1 && *copied == 0 &&
+			    (errno == ENOSYS || errno == EXDEV ||
+			     errno == EOPNOTSUPP || errno == EINVAL)) {
+				LogFullDebug(COMPONENT_FSAL,
+					     "copy_file_range failed with %s, copying through a buffer",
+					     strerror(errno));
+				in_kernel = false;
+				buffer = gsh_malloc(VFS_COPY_BUFFER);
+				continue;
+			}
+		} else {
+			if (chunk > VFS_COPY_BUFFER)
+				chunk = VFS_COPY_BUFFER;
+			nb = pread(fds.src_fd, buffer, chunk, src_pos);
+			if (nb > 0)
+				nb = pwrite(fds.dst_fd, buffer, nb, dst_pos);
+			if (nb > 0) {
+				src_pos += nb;
+				dst_pos += nb;
+			}
+		}
+
+		if (nb == -1) {
+			retval = errno;
+			status = fsalstat(posix2fsal_error(retval), retval);
+			break;
+		}
+
+		if (nb == 0)
+			break;
+
+		*copied += nb;
+	}
+
+	fsal_restore_ganesha_credentials();
+	gsh_free(buffer);
+
+ out:
+
+	vfs_copy_release_fds(src_hdl, dst_hdl, &fds);
+
+	return status;
+}
+
+/**
+ * @brief Share a range of one file with another
+ *
+ * Uses the FICLONERANGE ioctl, so this works on filesystems with shared
+ * extents such as XFS with reflink or btrfs.
+ *
+ * @param[in] src_hdl     File to clone from
+ * @param[in] src_state   state_t to read the source with
+ * @param[in] src_offset  Position in the source
+ * @param[in] dst_hdl     File to clone to
+ * @param[in] dst_state   state_t to write the destination with
+ * @param[in] dst_offset  Position in the destination
+ * @param[in] count       Bytes to clone, 0 for up to the end of the source
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_clone2(struct fsal_obj_handle *src_hdl,
+			 struct state_t *src_state,
+			 uint64_t src_offset,
+			 struct fsal_obj_handle *dst_hdl,
+			 struct state_t *dst_state,
+			 uint64_t dst_offset,
+			 uint64_t count)
+{
+	struct vfs_copy_fds fds;
+	fsal_status_t status;
+	int retval;
+
+	status = vfs_copy_find_fds(src_hdl, src_state, dst_hdl, dst_state,
+				   &fds);
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		goto out;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	if (vfs_clone_range(fds.src_fd, src_offset, fds.dst_fd, dst_offset,
+			    count) == -1) {
+		retval = errno;
+		if (retval == ENOTTY || retval == EOPNOTSUPP)
+			status = fsalstat(ERR_FSAL_NOTSUPP, retval);
+		else
+			status = fsalstat(posix2fsal_error(retval), retval);
+	}
+
+	fsal_restore_ganesha_credentials();
+
+ out:
+
+	vfs_copy_release_fds(src_hdl, dst_hdl, &fds);
+
+	return status;
+}
+
+/**
+ * @brief Seek to data or hole
+ *
+ * Uses lseek() with SEEK_DATA or SEEK_HOLE.  No data past the offset is
+ * reported as ERR_FSAL_NXIO, without logging since READ_PLUS runs into
+ * it at the end of every sparse file.
+ *
+ * @param[in]     obj_hdl  File on which to operate
+ * @param[in]     state    state_t to use for this operation
+ * @param[in,out] info     Information about the data
+ *
+ * @return FSAL status.
+ */
+
+fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			struct io_info *info)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	int my_fd = -1;
+	off_t offset;
+	struct stat st;
+	fsal_status_t status;
+	int retval = 0;
+	int whence;
+	bool has_lock = false;
+	bool closefd = false;
+
+	switch (info->io_content.what) {
+	case NFS4_CONTENT_DATA:
+		whence = SEEK_DATA;
+		break;
+	case NFS4_CONTENT_HOLE:
+		whence = SEEK_HOLE;
+		break;
+	default:
+		return fsalstat(ERR_FSAL_UNION_NOTSUPP, 0);
+	}
+
+	status = find_fd(&my_fd, obj_hdl, false, state, FSAL_O_READ,
+			 &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	offset = lseek(my_fd, info->io_content.hole.di_offset, whence);
+
+	if (offset == -1) {
+		retval = errno;
+		if (retval == ENXIO)
+			status = fsalstat(ERR_FSAL_NXIO, retval);
+		else if (retval == EINVAL)
+			/* The filesystem doesn't know about holes */
+			status = fsalstat(ERR_FSAL_NOTSUPP, retval);
+		else
+			status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	if (fstat(my_fd, &st) == -1) {
+		retval = errno;
+		status = fsalstat(posix2fsal_error(retval), retval);
+		goto out;
+	}
+
+	info->io_content.hole.di_offset = offset;
+	info->io_eof = offset >= st.st_size;
+
+ out:
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+
+	return status;
+#else
+	return fsalstat(ERR_FSAL_NOTSUPP, 0);
+#endif
+}
+
 /**
  * @brief Commit written data
  *
@@ -1480,6 +2006,26 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 
+	if (obj_hdl->type == DIRECTORY &&
+	    !(myself->sub_ops && myself->sub_ops->getattrs)) {
+		/* stat(2) is all we need, which an O_PATH fd gives */
+		my_fd = vfs_fsal_path_fd(myself, &status.major);
+		if (my_fd < 0)
+			return fsalstat(status.major, -my_fd);
+
+		status = fetch_attrs(myself, my_fd, attrs);
+		vfs_fsal_path_fd_done(myself, my_fd);
+
+		/* Unlike open_by_handle_at, a kept fd still reaches a
+		 * removed directory. */
+		if (!FSAL_IS_ERROR(status) && attrs->numlinks == 0) {
+			status = fsalstat(ERR_FSAL_STALE, ESTALE);
+			if (attrs->request_mask & ATTR_RDATTR_ERR)
+				attrs->valid_mask = ATTR_RDATTR_ERR;
+		}
+		return status;
+	}
+
 	/* Get a usable file descriptor (don't need to bypass - FSAL_O_ANY
 	 * won't conflict with any share reservation).
 	 */
@@ -1517,6 +2063,136 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/* The sub-FSAL can't stat in bulk, or not with our privileges */
+bool vfs_no_bulkstat;
+
+/**
+ * @brief Stat the objects of a directory in bulk, where the sub-FSAL can
+ *
+ * The objects are looked up by inode, on the file system of the
+ * directory.  Those not found, whose handle no longer matches the
+ * inode's (reused), or that need more than stat(2) gives are left out.
+ *
+ * @return Which objects were filled, NULL if none.
+ */
+static bool *vfs_bulkstat_objs(int dirfd, struct fsal_obj_handle *dir_hdl,
+			       unsigned int count,
+			       struct fsal_obj_handle **objs,
+			       struct attrlist *attrs,
+			       fsal_status_t *status)
+{
+	uint64_t *inos = gsh_malloc(count * sizeof(*inos));
+	struct stat *st = gsh_malloc(count * sizeof(*st));
+	vfs_file_handle_t *fh = gsh_malloc(count * sizeof(*fh));
+	bool *done = NULL;
+	unsigned int i;
+	int rc;
+
+	for (i = 0; i < count; i++)
+		inos[i] = objs[i]->fileid;
+
+	rc = vfs_bulkstat(dirfd, count, inos, st, fh);
+	if (rc < 0 && (errno == ENOTTY || errno == EPERM))
+		vfs_no_bulkstat = true;
+	if (rc <= 0)
+		goto out;
+
+	done = gsh_calloc(count, sizeof(*done));
+	for (i = 0; i < count; i++) {
+		struct vfs_fsal_obj_handle *myself =
+			container_of(objs[i], struct vfs_fsal_obj_handle,
+				     obj_handle);
+
+		if (objs[i]->fs != dir_hdl->fs ||
+		    (myself->sub_ops && myself->sub_ops->getattrs) ||
+		    st[i].st_ino != inos[i] ||
+		    fh[i].handle_len != myself->handle->handle_len ||
+		    memcmp(fh[i].handle_data, myself->handle->handle_data,
+			   fh[i].handle_len) != 0)
+			continue;
+
+		posix2fsal_attributes(&st[i], &attrs[i]);
+		attrs[i].fsid = objs[i]->fs->fsid;
+		status[i] = fsalstat(ERR_FSAL_NO_ERROR, 0);
+		done[i] = true;
+	}
+
+ out:
+	gsh_free(fh);
+	gsh_free(st);
+	gsh_free(inos);
+	return done;
+}
+
+/**
+ * @brief Get attributes of several entries of a directory
+ *
+ * Where the sub-FSAL can stat inodes in bulk (XFS), stat them all at
+ * once.  Otherwise open the directory once and fstatat each entry by name
+ * relative to it, rather than opening each object by handle.  An entry
+ * whose name no longer leads to the same inode, or that needs more than
+ * stat(2) gives, falls back to vfs_getattr2.
+ *
+ * @param[in]     dir_hdl  Directory the objects are entries of
+ * @param[in]     count    Number of objects
+ * @param[in]     objs     Objects to query
+ * @param[in]     names    Name of each object in @a dir_hdl
+ * @param[in,out] attrs    Attributes of each object
+ * @param[out]    status   Status of each fetch
+ */
+
+void vfs_getattrs_bulk(struct fsal_obj_handle *dir_hdl,
+		       unsigned int count,
+		       struct fsal_obj_handle **objs,
+		       const char **names,
+		       struct attrlist *attrs,
+		       fsal_status_t *status)
+{
+	struct vfs_fsal_obj_handle *dir =
+		container_of(dir_hdl, struct vfs_fsal_obj_handle, obj_handle);
+	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
+	struct stat stat;
+	bool *done = NULL;
+	unsigned int i;
+	int dirfd = -1;
+
+	if (dir_hdl->fsal == dir_hdl->fs->fsal)
+		dirfd = vfs_fsal_path_fd(dir, &fsal_error);
+
+	if (dirfd < 0)
+		LogDebug(COMPONENT_FSAL, "Failed to open dir: %s",
+			 msg_fsal_err(fsal_error));
+	else if (count > 1 && !vfs_no_bulkstat)
+		done = vfs_bulkstat_objs(dirfd, dir_hdl, count, objs, attrs,
+					 status);
+
+	for (i = 0; i < count; i++) {
+		struct vfs_fsal_obj_handle *myself =
+			container_of(objs[i], struct vfs_fsal_obj_handle,
+				     obj_handle);
+
+		if (done != NULL && done[i])
+			continue;
+
+		if (dirfd < 0 || names[i] == NULL ||
+		    objs[i]->fs != dir_hdl->fs ||
+		    (myself->sub_ops && myself->sub_ops->getattrs) ||
+		    fstatat(dirfd, names[i], &stat, AT_SYMLINK_NOFOLLOW) < 0 ||
+		    stat.st_ino != objs[i]->fileid) {
+			status[i] = vfs_getattr2(objs[i], &attrs[i]);
+			continue;
+		}
+
+		posix2fsal_attributes(&stat, &attrs[i]);
+		attrs[i].fsid = objs[i]->fs->fsid;
+		status[i] = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	gsh_free(done);
+	if (dirfd >= 0)
+		vfs_fsal_path_fd_done(dir, dirfd);
+}
+
 /**
  * @brief Set attributes on an object
  *
@@ -1533,7 +2209,8 @@ fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 fsal_status_t vfs_setattr2(struct fsal_obj_handle *obj_hdl,
 			   bool bypass,
 			   struct state_t *state,
-			   struct attrlist *attrib_set)
+			   struct attrlist *attrib_set,
+			   struct attrlist *attrs_out)
 {
 	struct vfs_fsal_obj_handle *myself;
 	fsal_status_t status = {0, 0};
@@ -1827,8 +2504,190 @@ fsal_status_t vfs_close2(struct fsal_obj_handle *obj_hdl,
 				      my_fd->openflags,
 				      FSAL_O_CLOSED);
 
+		if (my_fd->shared) {
+			/* Leave the fd to the other opens, or the next */
+			vfs_put_shared_fd(myself, my_fd);
+			PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+			return fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 	}
 
 	return vfs_close_my_fd(my_fd);
 }
+
+#ifdef USE_IO_URING
+/**
+ * @brief Start an asynchronous read
+ *
+ * Submits the read to the io_uring engine; the fd and any lock from
+ * find_fd() are released as soon as the read has been submitted.  Without
+ * an engine, or for READ_PLUS, fall back to vfs_read2() and complete
+ * inline.
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share reservation,
+ *                            bypass any deny read
+ * @param[in]     done_cb     Completion callback
+ * @param[in,out] read_arg    Read arguments and results
+ * @param[in]     caller_arg  Argument for done_cb
+ */
+
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     fsal_async_cb done_cb,
+		     struct fsal_io_arg *read_arg,
+		     void *caller_arg)
+{
+	int my_fd = -1;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+
+	if (!vfs_uring_enabled() || read_arg->info != NULL ||
+	    obj_hdl->fsal != obj_hdl->fs->fsal) {
+		status = vfs_read2(obj_hdl, bypass, read_arg->state,
+				   read_arg->offset, read_arg->buffer_size,
+				   read_arg->buffer, &read_arg->io_amount,
+				   &read_arg->end_of_file, read_arg->info);
+		done_cb(obj_hdl, status, read_arg, caller_arg);
+		return;
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, bypass, read_arg->state,
+			 FSAL_O_READ, &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		done_cb(obj_hdl, status, read_arg, caller_arg);
+		return;
+	}
+
+	vfs_uring_read(my_fd, obj_hdl, done_cb, read_arg, caller_arg);
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+}
+
+/**
+ * @brief Start an asynchronous write
+ *
+ * As vfs_read2_async(), a stable write is submitted with RWF_SYNC
+ * rather than followed by an fsync.
+ *
+ * @param[in]     obj_hdl     File on which to operate
+ * @param[in]     bypass      If state doesn't indicate a share reservation,
+ *                            bypass any non-mandatory deny write
+ * @param[in]     done_cb     Completion callback
+ * @param[in,out] write_arg   Write arguments and results
+ * @param[in]     caller_arg  Argument for done_cb
+ */
+
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      fsal_async_cb done_cb,
+		      struct fsal_io_arg *write_arg,
+		      void *caller_arg)
+{
+	int my_fd = -1;
+	fsal_status_t status;
+	bool has_lock = false;
+	bool closefd = false;
+
+	if (!vfs_uring_enabled() || write_arg->info != NULL ||
+	    obj_hdl->fsal != obj_hdl->fs->fsal) {
+		status = vfs_write2(obj_hdl, bypass, write_arg->state,
+				    write_arg->offset, write_arg->buffer_size,
+				    write_arg->buffer, &write_arg->io_amount,
+				    &write_arg->fsal_stable, write_arg->info);
+		done_cb(obj_hdl, status, write_arg, caller_arg);
+		return;
+	}
+
+	/* Get a usable file descriptor */
+	status = find_fd(&my_fd, obj_hdl, bypass, write_arg->state,
+			 FSAL_O_WRITE, &has_lock, &closefd, false);
+
+	if (FSAL_IS_ERROR(status)) {
+		LogDebug(COMPONENT_FSAL,
+			 "find_fd failed %s", msg_fsal_err(status.major));
+		done_cb(obj_hdl, status, write_arg, caller_arg);
+		return;
+	}
+
+	/* The ring picks up the credentials at submission */
+	fsal_set_credentials(op_ctx->creds);
+
+	vfs_uring_write(my_fd, obj_hdl, done_cb, write_arg, caller_arg);
+
+	fsal_restore_ganesha_credentials();
+
+	if (closefd)
+		close(my_fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+}
+
+/**
+ * @brief Start an asynchronous commit
+ *
+ * @param[in] obj_hdl     File on which to operate
+ * @param[in] offset      Start of range to commit
+ * @param[in] len         Length of range to commit
+ * @param[in] done_cb     Completion callback
+ * @param[in] caller_arg  Argument for done_cb
+ */
+
+void vfs_commit2_async(struct fsal_obj_handle *obj_hdl,
+		       off_t offset,
+		       size_t len,
+		       fsal_async_cb done_cb,
+		       void *caller_arg)
+{
+	struct vfs_fsal_obj_handle *myself;
+	fsal_status_t status;
+	struct vfs_fd temp_fd = {0, -1}, *out_fd = &temp_fd;
+	bool has_lock = false;
+	bool closefd = false;
+
+	if (!vfs_uring_enabled()) {
+		status = vfs_commit2(obj_hdl, offset, len);
+		done_cb(obj_hdl, status, NULL, caller_arg);
+		return;
+	}
+
+	myself = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
+
+	/* Make sure file is open in appropriate mode.
+	 * Do not check share reservation.
+	 */
+	status = fsal_reopen_obj(obj_hdl, false, false, FSAL_O_WRITE,
+				 (struct fsal_fd *)&myself->u.file.fd,
+				 &myself->u.file.share,
+				 vfs_open_func, vfs_close_func,
+				 (struct fsal_fd **)&out_fd, &has_lock,
+				 &closefd);
+
+	if (FSAL_IS_ERROR(status)) {
+		done_cb(obj_hdl, status, NULL, caller_arg);
+		return;
+	}
+
+	fsal_set_credentials(op_ctx->creds);
+
+	vfs_uring_fsync(out_fd->fd, obj_hdl, done_cb, caller_arg);
+
+	fsal_restore_ganesha_credentials();
+
+	if (closefd)
+		close(out_fd->fd);
+
+	if (has_lock)
+		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
+}
+#endif /* USE_IO_URING */
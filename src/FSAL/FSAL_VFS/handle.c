@@ -35,6 +35,7 @@
 #ifdef LINUX
 #include <sys/sysmacros.h> /* for makedev(3) */
 #endif
+#include <dirent.h>		/* for the DT_ types */
 #include <libgen.h>		/* used for 'dirname' */
 #include <pthread.h>
 #include <string.h>
@@ -60,6 +61,129 @@ int vfs_fsal_open(struct vfs_fsal_obj_handle *hdl,
 	return vfs_open_by_handle(vfs_fs, hdl->handle, openflags, fsal_error);
 }
 
+static struct vfs_path_fd_params vfs_path_fd_params;
+
+/** Handles holding an O_PATH fd */
+static int32_t vfs_path_fds;
+
+static struct config_item vfs_path_fd_items[] = {
+	CONF_ITEM_UI32("Size", 0, 1048576, 4096,
+		       vfs_path_fd_params, size),
+	CONFIG_EOL
+};
+
+static struct vfs_readdir_params vfs_readdir_params;
+
+static struct config_item vfs_readdir_items[] = {
+	CONF_ITEM_UI32("Buffer_Size", 1024, 1048576, 32768,
+		       vfs_readdir_params, buffer_size),
+	CONFIG_EOL
+};
+
+static struct config_block vfs_readdir_param_blk = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.vfs.readdir",
+	.blk_desc.name = "VFS_READDIR",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = vfs_readdir_items,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+static struct config_block vfs_path_fd_param_blk = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.vfs.path_fd_cache",
+	.blk_desc.name = "PATH_FD_CACHE",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = vfs_path_fd_items,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/**
+ * @brief Load the PATH_FD_CACHE config block
+ *
+ * @param[in]  config_struct  Parsed configuration
+ * @param[out] err_type       Config errors
+ *
+ * @return 0 on success, -EINVAL otherwise.
+ */
+int vfs_path_fd_init(config_file_t config_struct,
+		     struct config_error_type *err_type)
+{
+	(void) load_config_from_parse(config_struct,
+				      &vfs_path_fd_param_blk,
+				      &vfs_path_fd_params,
+				      true,
+				      err_type);
+
+	return config_error_is_harmless(err_type) ? 0 : -EINVAL;
+}
+
+/**
+ * @brief Load the VFS_READDIR config block
+ *
+ * @param[in]  config_struct  Parsed configuration
+ * @param[out] err_type       Config errors
+ *
+ * @return 0 on success, -EINVAL otherwise.
+ */
+int vfs_readdir_init(config_file_t config_struct,
+		     struct config_error_type *err_type)
+{
+	(void) load_config_from_parse(config_struct,
+				      &vfs_readdir_param_blk,
+				      &vfs_readdir_params,
+				      true,
+				      err_type);
+
+	return config_error_is_harmless(err_type) ? 0 : -EINVAL;
+}
+
+/**
+ * @brief Get an O_PATH fd on a handle
+ *
+ * The first fd opened is kept on the handle until it is released, as
+ * long as fewer than Size handles hold one, so that the *at() calls of
+ * directory operations and getattrs don't each need an
+ * open_by_handle_at and a close.
+ *
+ * @param[in]  hdl         Handle to open
+ * @param[out] fsal_error  Place to return an error
+ *
+ * @return The fd, to be given back with vfs_fsal_path_fd_done(), or
+ *         -errno.
+ */
+int vfs_fsal_path_fd(struct vfs_fsal_obj_handle *hdl,
+		     fsal_errors_t *fsal_error)
+{
+	int fd = atomic_fetch_int32_t(&hdl->path_fd);
+
+	if (fd >= 0)
+		return fd;
+
+	fd = vfs_fsal_open(hdl, O_PATH | O_NOACCESS, fsal_error);
+	if (fd < 0)
+		return fd;
+
+	if ((uint32_t) atomic_inc_int32_t(&vfs_path_fds) >
+	    vfs_path_fd_params.size ||
+	    !atomic_cmpxchg_int32_t(&hdl->path_fd, -1, fd))
+		(void) atomic_dec_int32_t(&vfs_path_fds);
+
+	return fd;
+}
+
+/**
+ * @brief Done with an fd from vfs_fsal_path_fd()
+ *
+ * @param[in] hdl  Handle it is on
+ * @param[in] fd   The fd, closed unless the handle keeps it
+ */
+void vfs_fsal_path_fd_done(struct vfs_fsal_obj_handle *hdl, int fd)
+{
+	if (fd != atomic_fetch_int32_t(&hdl->path_fd))
+		close(fd);
+}
+
 /**
  * @brief Create a VFS OBJ handle
  *
@@ -91,10 +215,17 @@ struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 	hdl->dev = posix2fsal_devt(stat->st_dev);
 	hdl->up_ops = exp_hdl->up_ops;
 	hdl->obj_handle.fs = fs;
+	hdl->path_fd = -1;
 
 	if (hdl->obj_handle.type == REGULAR_FILE) {
+		int i;
+
 		hdl->u.file.fd.fd = -1;	/* no open on this yet */
 		hdl->u.file.fd.openflags = FSAL_O_CLOSED;
+		for (i = 0; i < VFS_SHARED_FDS; i++) {
+			hdl->u.file.shared[i].fd.fd = -1;
+			hdl->u.file.shared[i].fd.openflags = FSAL_O_CLOSED;
+		}
 	} else if (hdl->obj_handle.type == SYMBOLIC_LINK) {
 		ssize_t retlink;
 		size_t len = stat->st_size + 1;
@@ -267,6 +398,93 @@ static fsal_status_t lookup_with_fd(struct vfs_fsal_obj_handle *parent_hdl,
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+/**
+ * @brief Make the handle of an entry from its bulk stat
+ *
+ * As lookup_with_fd, with the stat and handle vfs_bulkstat gave, for a
+ * non-directory entry: only directories are mount points.
+ */
+static fsal_status_t lookup_bulkstat(struct vfs_fsal_obj_handle *parent_hdl,
+				     int dirfd, const char *path,
+				     struct stat *stat, vfs_file_handle_t *fh,
+				     struct fsal_obj_handle **handle,
+				     struct attrlist *attrs_out)
+{
+	struct vfs_fsal_obj_handle *hdl;
+
+	hdl = alloc_handle(dirfd, fh, parent_hdl->obj_handle.fs, stat,
+			   parent_hdl->handle, path, op_ctx->fsal_export);
+
+	if (hdl == NULL)
+		return fsalstat(ERR_FSAL_NOMEM, ENOMEM);
+
+	if (attrs_out != NULL)
+		posix2fsal_attributes(stat, attrs_out);
+
+	*handle = &hdl->obj_handle;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Make the handle of an entry from its d_type
+ *
+ * For a caller wanting no attributes: a regular file, FIFO or socket
+ * is on the directory's file system, and its type and fileid came with
+ * the entry, so it needs no fstatat.  Other types, and entries of file
+ * systems not giving d_type, go through lookup_with_fd.
+ */
+static fsal_status_t lookup_dirent_type(struct vfs_fsal_obj_handle *parent_hdl,
+					int dirfd, struct vfs_dirent *dentry,
+					struct fsal_obj_handle **handle,
+					struct attrlist *attrs_out)
+{
+	struct vfs_fsal_obj_handle *hdl;
+	vfs_file_handle_t *fh = NULL;
+	struct stat stat;
+
+	memset(&stat, 0, sizeof(stat));
+
+	switch (dentry->vd_type) {
+	case DT_REG:
+		stat.st_mode = S_IFREG;
+		break;
+	case DT_FIFO:
+		stat.st_mode = S_IFIFO;
+		break;
+	case DT_SOCK:
+		stat.st_mode = S_IFSOCK;
+		break;
+	default:
+		return lookup_with_fd(parent_hdl, dirfd, dentry->vd_name,
+				      handle, attrs_out);
+	}
+
+	stat.st_ino = dentry->vd_ino;
+	stat.st_dev = makedev(parent_hdl->dev.major, parent_hdl->dev.minor);
+
+	vfs_alloc_handle(fh);
+
+	if (vfs_name_to_handle(dirfd, parent_hdl->obj_handle.fs,
+			       dentry->vd_name, fh) < 0)
+		return posix2fsal_status(errno);
+
+	hdl = alloc_handle(dirfd, fh, parent_hdl->obj_handle.fs, &stat,
+			   parent_hdl->handle, dentry->vd_name,
+			   op_ctx->fsal_export);
+
+	if (hdl == NULL)
+		return fsalstat(ERR_FSAL_NOMEM, ENOMEM);
+
+	if (attrs_out != NULL) {
+		attrs_out->type = hdl->obj_handle.type;
+		attrs_out->fileid = stat.st_ino;
+		attrs_out->valid_mask = ATTR_TYPE | ATTR_FILEID;
+	}
+
+	*handle = &hdl->obj_handle;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /* handle methods
  */
 
@@ -302,7 +520,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 		return fsalstat(ERR_FSAL_XDEV, EXDEV);
 	}
 
-	dirfd = vfs_fsal_open(parent_hdl, O_PATH | O_NOACCESS, &fsal_error);
+	dirfd = vfs_fsal_path_fd(parent_hdl, &fsal_error);
 
 	if (dirfd < 0) {
 		LogDebug(COMPONENT_FSAL, "Failed to open parent: %s",
@@ -314,7 +532,7 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	status = lookup_with_fd(parent_hdl, dirfd, path, handle, attrs_out);
 
 
-	close(dirfd);
+	vfs_fsal_path_fd_done(parent_hdl, dirfd);
 	return status;
 }
 
@@ -329,7 +547,6 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 	mode_t unix_mode;
 	fsal_status_t status = {0, 0};
 	int retval = 0;
-	int flags = O_PATH | O_NOACCESS;
 #ifdef ENABLE_VFS_DEBUG_ACL
 	struct attrlist attrs;
 	fsal_accessflags_t access_type;
@@ -387,7 +604,7 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 
 	unix_mode = fsal2unix_mode(attrib->mode)
 	    & ~op_ctx->fsal_export->exp_ops.fs_umask(op_ctx->fsal_export);
-	dir_fd = vfs_fsal_open(myself, flags, &status.major);
+	dir_fd = vfs_fsal_path_fd(myself, &status.major);
 	if (dir_fd < 0) {
 		LogFullDebug(COMPONENT_FSAL,
 			     "vfs_fsal_open returned %s",
@@ -456,7 +673,7 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attrib);
+						     attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			LogFullDebug(COMPONENT_FSAL,
@@ -488,14 +705,14 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 		}
 	}
 
-	close(dir_fd);
+	vfs_fsal_path_fd_done(myself, dir_fd);
 
 	return status;
 
  fileerr:
 	unlinkat(dir_fd, name, 0);
  direrr:
-	close(dir_fd);
+	vfs_fsal_path_fd_done(myself, dir_fd);
  hdlerr:
 	status.major = posix2fsal_error(retval);
 	return fsalstat(status.major, retval);
@@ -515,7 +732,6 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 	fsal_status_t status = {0, 0};
 	int retval = 0;
 	dev_t unix_dev = 0;
-	int flags = O_PATH | O_NOACCESS;
 #ifdef ENABLE_VFS_DEBUG_ACL
 	struct attrlist attrs;
 	fsal_accessflags_t access_type;
@@ -600,7 +816,7 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 		goto errout;
 	}
 
-	dir_fd = vfs_fsal_open(myself, flags, &status.major);
+	dir_fd = vfs_fsal_path_fd(myself, &status.major);
 
 	if (dir_fd < 0)
 		goto errout;
@@ -663,7 +879,7 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attrib);
+						     attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			(*handle)->obj_ops.release(*handle);
@@ -692,7 +908,7 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 		}
 	}
 
-	close(dir_fd);
+	vfs_fsal_path_fd_done(myself, dir_fd);
 
 	return status;
 
@@ -701,7 +917,7 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 	unlinkat(dir_fd, name, 0);
 
  direrr:
-	close(dir_fd);		/* done with parent */
+	vfs_fsal_path_fd_done(myself, dir_fd);		/* done with parent */
 
  hdlerr:
 	status.major = posix2fsal_error(retval);
@@ -781,7 +997,7 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 		return status;
 #endif /* ENABLE_VFS_DEBUG_ACL */
 
-	dir_fd = vfs_fsal_open(myself, flags, &status.major);
+	dir_fd = vfs_fsal_path_fd(myself, &status.major);
 
 	if (dir_fd < 0)
 		return fsalstat(status.major, -dir_fd);
@@ -849,7 +1065,7 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 		 * set, go ahead and get them set now.
 		 */
 		status = (*handle)->obj_ops.setattr2(*handle, false, NULL,
-						     attrib);
+						     attrib, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			/* Release the handle we just allocated. */
 			(*handle)->obj_ops.release(*handle);
@@ -878,7 +1094,7 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 		}
 	}
 
-	close(dir_fd);
+	vfs_fsal_path_fd_done(myself, dir_fd);
 
 	return status;
 
@@ -886,7 +1102,7 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 	unlinkat(dir_fd, name, 0);
 
  direrr:
-	close(dir_fd);
+	vfs_fsal_path_fd_done(myself, dir_fd);
  hdlerr:
 	if (retval == ENOENT)
 		status.major = ERR_FSAL_STALE;
@@ -944,7 +1160,8 @@ static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_obj_handle *destdir_hdl,
-			      const char *name)
+			      const char *name,
+			      struct attrlist *destdir_attrs_out)
 {
 	struct vfs_fsal_obj_handle *myself, *destdir;
 	int srcfd, destdirfd;
@@ -1007,7 +1224,7 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 		goto fileerr;
 	}
 
-	destdirfd = vfs_fsal_open(destdir, flags, &fsal_error);
+	destdirfd = vfs_fsal_path_fd(destdir, &fsal_error);
 
 	if (destdirfd < 0) {
 		retval = destdirfd;
@@ -1026,7 +1243,7 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 		fsal_error = posix2fsal_error(retval);
 	}
 
-	close(destdirfd);
+	vfs_fsal_path_fd_done(destdir, destdirfd);
 
  fileerr:
 	if (!(obj_hdl->type == REGULAR_FILE && myself->u.file.fd.fd >= 0))
@@ -1041,11 +1258,72 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(fsal_error, retval);
 }
 
-#define BUF_SIZE 1024
+/* Entries stat'ed in one bulk call, at most */
+#define VFS_READDIR_BULK 64
+
+struct vfs_readdir_bulk {
+	uint64_t ino[VFS_READDIR_BULK];
+	struct stat st[VFS_READDIR_BULK];
+	vfs_file_handle_t fh[VFS_READDIR_BULK];
+};
+
+/**
+ * @brief Stat the next entries of a read in bulk, where the sub-FSAL can
+ *
+ * @param[in]     dirfd  The directory
+ * @param[in]     buf    The entries read
+ * @param[in]     nread  Bytes read
+ * @param[in]     base   Offset read at
+ * @param[in,out] pos    Position of the first entry in @a buf, then
+ *                       past the last one taken
+ * @param[out]    bulk   Stats and handles of the entries but . and ..,
+ *                       allocated on the first call
+ *
+ * @return Entries of @a bulk to look at, 0 if none.
+ */
+static unsigned int vfs_readdir_bulkstat(int dirfd, char *buf, int nread,
+					 off_t base, unsigned int *pos,
+					 struct vfs_readdir_bulk **bulk)
+{
+	struct vfs_dirent dentry;
+	unsigned int n = 0;
+	unsigned int bpos;
+	int rc;
+
+	if (vfs_no_bulkstat) {
+		*pos = nread;
+		return 0;
+	}
+
+	if (*bulk == NULL)
+		*bulk = gsh_calloc(1, sizeof(**bulk));
+
+	for (bpos = *pos; bpos < nread && n < VFS_READDIR_BULK;
+	     bpos += dentry.vd_reclen) {
+		if (!to_vfs_dirent(buf, bpos, &dentry, base)
+		    || strcmp(dentry.vd_name, ".") == 0
+		    || strcmp(dentry.vd_name, "..") == 0)
+			continue;
+		(*bulk)->ino[n++] = dentry.vd_ino;
+	}
+
+	*pos = bpos;
+
+	if (n == 0)
+		return 0;
+
+	rc = vfs_bulkstat(dirfd, n, (*bulk)->ino, (*bulk)->st, (*bulk)->fh);
+	if (rc < 0 && (errno == ENOTTY || errno == EPERM))
+		vfs_no_bulkstat = true;
+
+	return rc > 0 ? n : 0;
+}
+
 /**
  * read_dirents
  * read the directory and call through the callback function for
  * each entry.
+ * The directory is read VFS_READDIR Buffer_Size bytes at a time.
  * @param dir_hdl [IN] the directory to read
  * @param whence [IN] where to start (next)
  * @param dir_state [IN] pass thru of state to callback
@@ -1067,7 +1345,10 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	unsigned int bpos;
 	int nread;
 	struct vfs_dirent dentry, *dentryp = &dentry;
-	char buf[BUF_SIZE];
+	struct vfs_readdir_bulk *bulk = NULL;
+	unsigned int nbulk = 0, ix = 0, bulk_end;
+	size_t buf_size = vfs_readdir_params.buffer_size;
+	char *buf = NULL;
 
 	if (whence != NULL)
 		seekloc = (off_t) *whence;
@@ -1096,9 +1377,11 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		goto done;
 	}
 
+	buf = gsh_malloc(buf_size);
+
 	do {
 		baseloc = seekloc;
-		nread = vfs_readents(dirfd, buf, BUF_SIZE, &seekloc);
+		nread = vfs_readents(dirfd, buf, buf_size, &seekloc);
 		if (nread < 0) {
 			retval = errno;
 			status = posix2fsal_status(retval);
@@ -1106,11 +1389,20 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 		}
 		if (nread == 0)
 			break;
+		bulk_end = 0;
 		for (bpos = 0; bpos < nread;) {
 			struct fsal_obj_handle *hdl;
 			struct attrlist attrs;
 			bool cb_rc;
 
+			if (bpos >= bulk_end) {
+				bulk_end = bpos;
+				nbulk = vfs_readdir_bulkstat(dirfd, buf, nread,
+							     baseloc,
+							     &bulk_end, &bulk);
+				ix = 0;
+			}
+
 			if (!to_vfs_dirent(buf, bpos, dentryp, baseloc)
 			    || strcmp(dentryp->vd_name, ".") == 0
 			    || strcmp(dentryp->vd_name, "..") == 0)
@@ -1118,8 +1410,23 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 			fsal_prepare_attrs(&attrs, attrmask);
 
-			status = lookup_with_fd(myself, dirfd, dentryp->vd_name,
-					&hdl, &attrs);
+			if (ix < nbulk &&
+			    bulk->st[ix].st_ino == dentryp->vd_ino &&
+			    !S_ISDIR(bulk->st[ix].st_mode))
+				status = lookup_bulkstat(myself, dirfd,
+							 dentryp->vd_name,
+							 &bulk->st[ix],
+							 &bulk->fh[ix],
+							 &hdl, &attrs);
+			else if (attrmask == 0)
+				status = lookup_dirent_type(myself, dirfd,
+							    dentryp,
+							    &hdl, &attrs);
+			else
+				status = lookup_with_fd(myself, dirfd,
+							dentryp->vd_name,
+							&hdl, &attrs);
+			++ix;
 
 			if (FSAL_IS_ERROR(status)) {
 				goto done;
@@ -1141,6 +1448,8 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 
 	*eof = true;
  done:
+	gsh_free(buf);
+	gsh_free(bulk);
 	close(dirfd);
 
  out:
@@ -1151,7 +1460,9 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	struct vfs_fsal_obj_handle *olddir, *newdir, *obj;
 	int oldfd = -1, newfd = -1;
@@ -1171,7 +1482,7 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 		fsal_error = posix2fsal_error(retval);
 		goto out;
 	}
-	oldfd = vfs_fsal_open(olddir, O_PATH | O_NOACCESS, &fsal_error);
+	oldfd = vfs_fsal_path_fd(olddir, &fsal_error);
 	if (oldfd < 0) {
 		retval = -oldfd;
 		goto out;
@@ -1190,7 +1501,7 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 		goto out;
 	}
 	obj = container_of(obj_hdl, struct vfs_fsal_obj_handle, obj_handle);
-	newfd = vfs_fsal_open(newdir, O_PATH | O_NOACCESS, &fsal_error);
+	newfd = vfs_fsal_path_fd(newdir, &fsal_error);
 	if (newfd < 0) {
 		retval = -newfd;
 		goto out;
@@ -1218,9 +1529,9 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 	fsal_restore_ganesha_credentials();
  out:
 	if (oldfd >= 0)
-		close(oldfd);
+		vfs_fsal_path_fd_done(olddir, oldfd);
 	if (newfd >= 0)
-		close(newfd);
+		vfs_fsal_path_fd_done(newdir, newfd);
 	return fsalstat(fsal_error, retval);
 }
 
@@ -1353,7 +1664,8 @@ struct closefd vfs_fsal_open_and_stat(struct fsal_export *exp,
 
 static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name)
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
 {
 	struct vfs_fsal_obj_handle *myself;
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
@@ -1373,7 +1685,7 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 		fsal_error = posix2fsal_error(retval);
 		goto out;
 	}
-	fd = vfs_fsal_open(myself, O_PATH | O_NOACCESS, &fsal_error);
+	fd = vfs_fsal_path_fd(myself, &fsal_error);
 	if (fd < 0) {
 		retval = -fd;
 		goto out;
@@ -1401,7 +1713,7 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 	fsal_restore_ganesha_credentials();
 
  errout:
-	close(fd);
+	vfs_fsal_path_fd_done(myself, fd);
  out:
 	return fsalstat(fsal_error, retval);
 }
@@ -1492,6 +1804,7 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		PTHREAD_RWLOCK_wrlock(&obj_hdl->obj_lock);
 
 		st = vfs_close_my_fd(&myself->u.file.fd);
+		vfs_close_shared_fds(myself, false);
 
 		PTHREAD_RWLOCK_unlock(&obj_hdl->obj_lock);
 
@@ -1502,6 +1815,11 @@ static void release(struct fsal_obj_handle *obj_hdl)
 		}
 	}
 
+	if (myself->path_fd >= 0) {
+		close(myself->path_fd);
+		(void) atomic_dec_int32_t(&vfs_path_fds);
+	}
+
 	fsal_obj_handle_fini(obj_hdl);
 
 	if (type == SYMBOLIC_LINK) {
@@ -1547,10 +1865,21 @@ void vfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->reopen2 = vfs_reopen2;
 	ops->read2 = vfs_read2;
 	ops->write2 = vfs_write2;
+	ops->readv2 = vfs_readv2;
+	ops->writev2 = vfs_writev2;
+	ops->getattrs_bulk = vfs_getattrs_bulk;
+	ops->copy2 = vfs_copy2;
+	ops->clone2 = vfs_clone2;
+	ops->seek2 = vfs_seek2;
 	ops->commit2 = vfs_commit2;
 	ops->lock_op2 = vfs_lock_op2;
 	ops->setattr2 = vfs_setattr2;
 	ops->close2 = vfs_close2;
+#ifdef USE_IO_URING
+	ops->read2_async = vfs_read2_async;
+	ops->write2_async = vfs_write2_async;
+	ops->commit2_async = vfs_commit2_async;
+#endif
 
 	/* xattr related functions */
 	ops->list_ext_attrs = vfs_list_ext_attrs;
@@ -92,6 +92,18 @@ int vfs_readlink(struct vfs_fsal_obj_handle *myself,
 	return retval;
 }
 
+/**
+ * @brief Stat inodes in bulk, not supported here
+ *
+ * See the XFS version.
+ */
+int vfs_bulkstat(int fd, unsigned int count, const uint64_t *inos,
+		 struct stat *st, vfs_file_handle_t *fh)
+{
+	errno = ENOTTY;
+	return -1;
+}
+
 int vfs_get_root_handle(struct vfs_filesystem *vfs_fs,
 			struct vfs_fsal_export *exp)
 {
@@ -39,6 +39,8 @@
 #include "gsh_list.h"
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
+#include "fsal_handle_syscalls.h"
+#include "../vfs_methods.h"
 
 /* PANFS FSAL module private storage
  */
@@ -146,6 +148,8 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
+	if (vfs_readdir_init(config_struct, err_type) != 0)
+		return fsalstat(ERR_FSAL_INVAL, 0);
 	display_fsinfo(&panfs_me->fs_info);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
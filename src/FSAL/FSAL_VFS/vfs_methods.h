@@ -121,6 +121,22 @@ struct vfs_fd {
 	fsal_openflags_t openflags;
 	/** The kernel file descriptor. */
 	int fd;
+	/** fd is one of the file's shared fds, not ours to close */
+	bool shared;
+};
+
+/** Access modes an fd is shared in: read, write and read/write */
+#define VFS_SHARED_FDS 3
+
+/**
+ * @brief An fd the NFSv4 opens of a file in one access mode share
+ *
+ * It stays open once the last of them closes, for the next one, until
+ * the file's global fd is closed.  Protected by the obj_lock.
+ */
+struct vfs_shared_fd {
+	struct vfs_fd fd;	/*< The fd, -1 if closed */
+	uint32_t refcnt;	/*< Open states using it */
 };
 
 /*
@@ -146,10 +162,13 @@ struct vfs_fsal_obj_handle {
 #endif
 	struct vfs_subfsal_obj_ops *sub_ops;	/*< Optional subfsal ops */
 	const struct fsal_up_vector *up_ops;	/*< Upcall operations */
+	int32_t path_fd;	/*< Cached O_PATH fd, -1 if none */
 	union {
 		struct {
 			struct fsal_share share;
 			struct vfs_fd fd;
+			/** Indexed by access mode - 1 */
+			struct vfs_shared_fd shared[VFS_SHARED_FDS];
 		} file;
 		struct {
 			unsigned char *link_content;
@@ -194,6 +213,10 @@ bool vfs_valid_handle(struct gsh_buffdesc *desc);
 int vfs_readlink(struct vfs_fsal_obj_handle *myself,
 		 fsal_errors_t *fsal_error);
 
+int vfs_bulkstat(int fd, unsigned int count, const uint64_t *inos,
+		 struct stat *st, vfs_file_handle_t *fh);
+extern bool vfs_no_bulkstat;
+
 int vfs_extract_fsid(vfs_file_handle_t *fh,
 		     enum fsid_type *fsid_type,
 		     struct fsal_fsid__ *fsid);
@@ -217,6 +240,25 @@ int vfs_fsal_open(struct vfs_fsal_obj_handle *hdl,
 		  int openflags,
 		  fsal_errors_t *fsal_error);
 
+/* O_PATH fd cache, handle.c */
+struct vfs_path_fd_params {
+	uint32_t size;		/*< Most handles holding an O_PATH fd */
+};
+
+int vfs_path_fd_init(config_file_t config_struct,
+		     struct config_error_type *err_type);
+
+/* Directory reads, handle.c */
+struct vfs_readdir_params {
+	uint32_t buffer_size;	/*< Bytes of entries read at a time */
+};
+
+int vfs_readdir_init(config_file_t config_struct,
+		     struct config_error_type *err_type);
+int vfs_fsal_path_fd(struct vfs_fsal_obj_handle *hdl,
+		     fsal_errors_t *fsal_error);
+void vfs_fsal_path_fd_done(struct vfs_fsal_obj_handle *hdl, int fd);
+
 struct vfs_fsal_obj_handle *alloc_handle(int dirfd,
 					 vfs_file_handle_t *fh,
 					 struct fsal_filesystem *fs,
@@ -248,6 +290,7 @@ struct state_hdl *vfs_state_locate(struct fsal_obj_handle *obj);
 
 	/* I/O management */
 fsal_status_t vfs_close_my_fd(struct vfs_fd *my_fd);
+void vfs_close_shared_fds(struct vfs_fsal_obj_handle *myself, bool idle);
 
 fsal_status_t vfs_close(struct fsal_obj_handle *obj_hdl);
 
@@ -294,6 +337,47 @@ fsal_status_t vfs_write2(struct fsal_obj_handle *obj_hdl,
 			 bool *fsal_stable,
 			 struct io_info *info);
 
+fsal_status_t vfs_readv2(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 struct state_t *state,
+			 uint64_t offset,
+			 int iov_count,
+			 struct iovec *iov,
+			 size_t *read_amount,
+			 bool *end_of_file,
+			 struct io_info *info);
+
+fsal_status_t vfs_writev2(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  struct state_t *state,
+			  uint64_t offset,
+			  int iov_count,
+			  struct iovec *iov,
+			  size_t *wrote_amount,
+			  bool *fsal_stable,
+			  struct io_info *info);
+
+fsal_status_t vfs_copy2(struct fsal_obj_handle *src_hdl,
+			struct state_t *src_state,
+			uint64_t src_offset,
+			struct fsal_obj_handle *dst_hdl,
+			struct state_t *dst_state,
+			uint64_t dst_offset,
+			uint64_t count,
+			uint64_t *copied);
+
+fsal_status_t vfs_clone2(struct fsal_obj_handle *src_hdl,
+			 struct state_t *src_state,
+			 uint64_t src_offset,
+			 struct fsal_obj_handle *dst_hdl,
+			 struct state_t *dst_state,
+			 uint64_t dst_offset,
+			 uint64_t count);
+
+fsal_status_t vfs_seek2(struct fsal_obj_handle *obj_hdl,
+			struct state_t *state,
+			struct io_info *info);
+
 fsal_status_t vfs_commit2(struct fsal_obj_handle *obj_hdl,
 			  off_t offset,
 			  size_t len);
@@ -310,14 +394,62 @@ fsal_status_t getattr2(struct fsal_obj_handle *obj_hdl);
 fsal_status_t vfs_getattr2(struct fsal_obj_handle *obj_hdl,
 			   struct attrlist *attrs);
 
+void vfs_getattrs_bulk(struct fsal_obj_handle *dir_hdl,
+		       unsigned int count,
+		       struct fsal_obj_handle **objs,
+		       const char **names,
+		       struct attrlist *attrs,
+		       fsal_status_t *status);
+
 fsal_status_t vfs_setattr2(struct fsal_obj_handle *obj_hdl,
 			   bool bypass,
 			   struct state_t *state,
-			   struct attrlist *attrib_set);
+			   struct attrlist *attrib_set,
+			   struct attrlist *attrs_out);
 
 fsal_status_t vfs_close2(struct fsal_obj_handle *obj_hdl,
 			 struct state_t *state);
 
+#ifdef USE_IO_URING
+void vfs_read2_async(struct fsal_obj_handle *obj_hdl,
+		     bool bypass,
+		     fsal_async_cb done_cb,
+		     struct fsal_io_arg *read_arg,
+		     void *caller_arg);
+
+void vfs_write2_async(struct fsal_obj_handle *obj_hdl,
+		      bool bypass,
+		      fsal_async_cb done_cb,
+		      struct fsal_io_arg *write_arg,
+		      void *caller_arg);
+
+void vfs_commit2_async(struct fsal_obj_handle *obj_hdl,
+		       off_t offset,
+		       size_t len,
+		       fsal_async_cb done_cb,
+		       void *caller_arg);
+
+/* io_uring engine, vfs_uring.c */
+struct vfs_uring_params {
+	bool enable;		/*< Use io_uring for asynchronous I/O */
+	uint32_t queue_depth;	/*< Entries per ring */
+	uint32_t rings;		/*< Number of rings */
+};
+
+int vfs_uring_init(config_file_t config_struct,
+		   struct config_error_type *err_type);
+void vfs_uring_shutdown(void);
+bool vfs_uring_enabled(void);
+void vfs_uring_read(int fd, struct fsal_obj_handle *obj_hdl,
+		    fsal_async_cb done_cb, struct fsal_io_arg *read_arg,
+		    void *caller_arg);
+void vfs_uring_write(int fd, struct fsal_obj_handle *obj_hdl,
+		     fsal_async_cb done_cb, struct fsal_io_arg *write_arg,
+		     void *caller_arg);
+void vfs_uring_fsync(int fd, struct fsal_obj_handle *obj_hdl,
+		     fsal_async_cb done_cb, void *caller_arg);
+#endif /* USE_IO_URING */
+
 /* extended attributes management */
 fsal_status_t vfs_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
 				 unsigned int cookie,
@@ -0,0 +1,408 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file vfs_uring.c
+ * @brief io_uring I/O engine for the asynchronous VFS I/O methods
+ *
+ * A small set of rings is shared by the threads submitting I/O; each
+ * thread sticks to one ring so submissions from a worker are batched on
+ * the same submission queue.  A reaper thread per ring waits for
+ * completions and calls the FSAL completion callbacks.
+ *
+ * The file descriptor only needs to be valid until io_uring_submit()
+ * returns, the kernel holds its own reference on the file after that, so
+ * callers release their fd and locks right after submitting.
+ */
+
+#include "config.h"
+
+#ifdef USE_IO_URING
+
+#include <liburing.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "fsal.h"
+#include "fsal_convert.h"
+#include "abstract_atomic.h"
+#include "vfs_methods.h"
+
+/** @brief One ring and its reaper */
+struct vfs_uring {
+	struct io_uring ring;		/*< The ring */
+	pthread_mutex_t sq_mutex;	/*< Serializes submission */
+	pthread_t reaper;		/*< Completion thread */
+	uint32_t index;			/*< Index in vfs_urings */
+	uint32_t inflight;		/*< Submitted, not completed */
+};
+
+/** @brief An I/O in flight */
+struct vfs_uring_req {
+	struct fsal_obj_handle *obj_hdl;	/*< File the I/O is on */
+	fsal_async_cb done_cb;			/*< Completion callback */
+	struct fsal_io_arg *io_arg;		/*< I/O arguments, NULL for
+						 *  commit
+						 */
+	void *caller_arg;			/*< Callback argument */
+	bool is_read;				/*< Read or write/commit */
+};
+
+struct vfs_uring_params vfs_uring_params;
+
+static struct vfs_uring *vfs_urings;
+static uint32_t vfs_uring_count;
+static uint32_t vfs_uring_next;
+
+/** Ring used by this thread, assigned on first submission */
+static __thread struct vfs_uring *vfs_uring_mine;
+
+static struct config_item vfs_uring_items[] = {
+	CONF_ITEM_BOOL("Enable", false,
+		       vfs_uring_params, enable),
+	CONF_ITEM_UI32("Queue_Depth", 16, 32768, 256,
+		       vfs_uring_params, queue_depth),
+	CONF_ITEM_UI32("Rings", 1, 256, 4,
+		       vfs_uring_params, rings),
+	CONFIG_EOL
+};
+
+struct config_block vfs_uring_param_blk = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.fsal.vfs.io_uring",
+	.blk_desc.name = "IO_URING",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = vfs_uring_items,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+
+/**
+ * @brief Complete one I/O
+ *
+ * @param[in] req  The request
+ * @param[in] res  The cqe result, bytes moved or -errno
+ */
+static void vfs_uring_complete(struct vfs_uring_req *req, int res)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+
+	if (res < 0) {
+		status = fsalstat(posix2fsal_error(-res), -res);
+	} else if (req->io_arg != NULL) {
+		req->io_arg->io_amount = res;
+		if (req->is_read)
+			req->io_arg->end_of_file = (res == 0);
+	}
+
+	req->done_cb(req->obj_hdl, status, req->io_arg, req->caller_arg);
+
+	gsh_free(req);
+}
+
+/**
+ * @brief Reap completions of one ring
+ *
+ * A NULL user_data is the shutdown marker, the reaper exits once the I/O
+ * still in flight has completed.
+ */
+static void *vfs_uring_reaper(void *arg)
+{
+	struct vfs_uring *uring = arg;
+	struct io_uring_cqe *cqe;
+	struct vfs_uring_req *req;
+	bool stopping = false;
+	char thr_name[16];
+	int rc;
+
+	(void) snprintf(thr_name, sizeof(thr_name), "vfs_uring%u",
+			uring->index);
+	SetNameFunction(thr_name);
+
+	for (;;) {
+		rc = io_uring_wait_cqe(&uring->ring, &cqe);
+
+		if (rc == -EINTR)
+			continue;
+
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"io_uring_wait_cqe failed %s",
+				strerror(-rc));
+			break;
+		}
+
+		req = io_uring_cqe_get_data(cqe);
+		rc = cqe->res;
+		io_uring_cqe_seen(&uring->ring, cqe);
+
+		if (req == NULL) {
+			stopping = true;
+		} else {
+			vfs_uring_complete(req, rc);
+			(void) atomic_dec_uint32_t(&uring->inflight);
+		}
+
+		if (stopping && atomic_fetch_uint32_t(&uring->inflight) == 0)
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Get a submission queue entry on this thread's ring
+ *
+ * Called with the ring's sq_mutex held.  If the submission queue is full,
+ * flush it to the kernel and try again.
+ */
+static struct io_uring_sqe *vfs_uring_get_sqe(struct vfs_uring *uring)
+{
+	struct io_uring_sqe *sqe;
+
+	while ((sqe = io_uring_get_sqe(&uring->ring)) == NULL)
+		(void) io_uring_submit(&uring->ring);
+
+	return sqe;
+}
+
+static struct vfs_uring *vfs_uring_select(void)
+{
+	if (vfs_uring_mine == NULL) {
+		uint32_t idx = atomic_inc_uint32_t(&vfs_uring_next);
+
+		vfs_uring_mine = &vfs_urings[idx % vfs_uring_count];
+	}
+
+	return vfs_uring_mine;
+}
+
+/**
+ * @brief Submit an I/O
+ *
+ * @param[in] fd       File descriptor, may be closed once this returns
+ * @param[in] req      Request, freed on completion
+ * @param[in] op       IORING_OP_READ, IORING_OP_WRITE or IORING_OP_FSYNC
+ * @param[in] rw_flags RWF_* flags for writes
+ */
+static void vfs_uring_submit(int fd, struct vfs_uring_req *req, int op,
+			    int rw_flags)
+{
+	struct vfs_uring *uring = vfs_uring_select();
+	struct fsal_io_arg *io_arg = req->io_arg;
+	struct io_uring_sqe *sqe;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&uring->sq_mutex);
+
+	sqe = vfs_uring_get_sqe(uring);
+
+	switch (op) {
+	case IORING_OP_READ:
+		io_uring_prep_read(sqe, fd, io_arg->buffer,
+				   io_arg->buffer_size, io_arg->offset);
+		break;
+	case IORING_OP_WRITE:
+		io_uring_prep_write(sqe, fd, io_arg->buffer,
+				    io_arg->buffer_size, io_arg->offset);
+		sqe->rw_flags = rw_flags;
+		break;
+	case IORING_OP_FSYNC:
+		io_uring_prep_fsync(sqe, fd, 0);
+		break;
+	}
+
+	io_uring_sqe_set_data(sqe, req);
+	(void) atomic_inc_uint32_t(&uring->inflight);
+
+	/* This also submits whatever other threads sharing the ring queued
+	 * meanwhile.  Once queued the sqe can not be taken back, if the
+	 * submit fails for good it is flushed by the next one and completes
+	 * with whatever error the stale fd gets then.
+	 */
+	do {
+		rc = io_uring_submit(&uring->ring);
+	} while (rc == -EINTR || rc == -EAGAIN || rc == -EBUSY);
+
+	if (rc < 0)
+		LogCrit(COMPONENT_FSAL,
+			"io_uring_submit failed %s", strerror(-rc));
+
+	PTHREAD_MUTEX_unlock(&uring->sq_mutex);
+}
+
+static struct vfs_uring_req *vfs_uring_req_init(
+					struct fsal_obj_handle *obj_hdl,
+					fsal_async_cb done_cb,
+					struct fsal_io_arg *io_arg,
+					void *caller_arg,
+					bool is_read)
+{
+	struct vfs_uring_req *req = gsh_malloc(sizeof(*req));
+
+	req->obj_hdl = obj_hdl;
+	req->done_cb = done_cb;
+	req->io_arg = io_arg;
+	req->caller_arg = caller_arg;
+	req->is_read = is_read;
+
+	return req;
+}
+
+void vfs_uring_read(int fd, struct fsal_obj_handle *obj_hdl,
+		    fsal_async_cb done_cb, struct fsal_io_arg *read_arg,
+		    void *caller_arg)
+{
+	struct vfs_uring_req *req;
+
+	req = vfs_uring_req_init(obj_hdl, done_cb, read_arg, caller_arg, true);
+
+	vfs_uring_submit(fd, req, IORING_OP_READ, 0);
+}
+
+void vfs_uring_write(int fd, struct fsal_obj_handle *obj_hdl,
+		     fsal_async_cb done_cb, struct fsal_io_arg *write_arg,
+		     void *caller_arg)
+{
+	struct vfs_uring_req *req;
+
+	req = vfs_uring_req_init(obj_hdl, done_cb, write_arg, caller_arg,
+				 false);
+
+	vfs_uring_submit(fd, req, IORING_OP_WRITE,
+			 write_arg->fsal_stable ? RWF_SYNC : 0);
+}
+
+void vfs_uring_fsync(int fd, struct fsal_obj_handle *obj_hdl,
+		     fsal_async_cb done_cb, void *caller_arg)
+{
+	struct vfs_uring_req *req;
+
+	req = vfs_uring_req_init(obj_hdl, done_cb, NULL, caller_arg, false);
+
+	vfs_uring_submit(fd, req, IORING_OP_FSYNC, 0);
+}
+
+bool vfs_uring_enabled(void)
+{
+	return vfs_urings != NULL;
+}
+
+/**
+ * @brief Set up the rings from the IO_URING config block
+ *
+ * @param[in]  config_struct  Parsed configuration
+ * @param[out] err_type       Config errors
+ *
+ * @return 0 on success (including when disabled), -errno otherwise.
+ */
+int vfs_uring_init(config_file_t config_struct,
+		   struct config_error_type *err_type)
+{
+	uint32_t i;
+	int rc;
+
+	(void) load_config_from_parse(config_struct,
+				      &vfs_uring_param_blk,
+				      &vfs_uring_params,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type))
+		return -EINVAL;
+
+	if (!vfs_uring_params.enable || vfs_urings != NULL)
+		return 0;
+
+	vfs_urings = gsh_calloc(vfs_uring_params.rings, sizeof(*vfs_urings));
+
+	for (i = 0; i < vfs_uring_params.rings; i++) {
+		struct vfs_uring *uring = &vfs_urings[i];
+
+		uring->index = i;
+		PTHREAD_MUTEX_init(&uring->sq_mutex, NULL);
+
+		rc = io_uring_queue_init(vfs_uring_params.queue_depth,
+					 &uring->ring, 0);
+		if (rc < 0) {
+			LogCrit(COMPONENT_FSAL,
+				"io_uring_queue_init failed %s, falling back to synchronous I/O",
+				strerror(-rc));
+			PTHREAD_MUTEX_destroy(&uring->sq_mutex);
+			goto fail;
+		}
+
+		rc = pthread_create(&uring->reaper, NULL, vfs_uring_reaper,
+				    uring);
+		if (rc != 0) {
+			LogCrit(COMPONENT_FSAL,
+				"Could not create io_uring reaper %s",
+				strerror(rc));
+			io_uring_queue_exit(&uring->ring);
+			PTHREAD_MUTEX_destroy(&uring->sq_mutex);
+			rc = -rc;
+			goto fail;
+		}
+
+		vfs_uring_count++;
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"io_uring enabled with %u rings of depth %u",
+		vfs_uring_count, vfs_uring_params.queue_depth);
+
+	return 0;
+
+ fail:
+	vfs_uring_shutdown();
+	return 0;
+}
+
+/**
+ * @brief Stop the reapers and tear down the rings
+ *
+ * In flight I/O is completed before the reapers see the shutdown marker.
+ */
+void vfs_uring_shutdown(void)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t i;
+
+	for (i = 0; i < vfs_uring_count; i++) {
+		struct vfs_uring *uring = &vfs_urings[i];
+
+		PTHREAD_MUTEX_lock(&uring->sq_mutex);
+		sqe = vfs_uring_get_sqe(uring);
+		io_uring_prep_nop(sqe);
+		io_uring_sqe_set_data(sqe, NULL);
+		(void) io_uring_submit(&uring->ring);
+		PTHREAD_MUTEX_unlock(&uring->sq_mutex);
+
+		pthread_join(uring->reaper, NULL);
+		io_uring_queue_exit(&uring->ring);
+		PTHREAD_MUTEX_destroy(&uring->sq_mutex);
+	}
+
+	gsh_free(vfs_urings);
+	vfs_urings = NULL;
+	vfs_uring_count = 0;
+}
+
+#endif /* USE_IO_URING */
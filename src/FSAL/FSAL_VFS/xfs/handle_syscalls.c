@@ -32,6 +32,7 @@
 #include "fsal.h"
 #include "fsal_handle_syscalls.h"
 #include <sys/types.h>
+#include <sys/sysmacros.h>
 #include <sys/syscall.h>
 #include <xfs/xfs.h>
 #include <xfs/handle.h>
@@ -87,14 +88,65 @@ static int xfs_fsal_bulkstat_inode(int fd, xfs_ino_t ino, xfs_bstat_t *bstat)
 	return ioctl(fd, XFS_IOC_FSBULKSTAT_SINGLE, &bulkreq);
 }
 
+/**
+ * @brief Build the handle of an inode, as fd_to_handle would
+ *
+ * @param[in]  fsid  Handle of any fd on the file system
+ * @param[in]  bstat Bulkstat of the inode
+ * @param[out] fh    The handle
+ */
+static void xfs_fsal_bstat2handle(const void *fsid, const xfs_bstat_t *bstat,
+				  vfs_file_handle_t *fh)
+{
+	xfs_handle_t *hdl = (xfs_handle_t *) fh->handle_data;
+
+	/* Copy the fsid from the reference fd */
+	memcpy(&hdl->ha_fsid, fsid, sizeof(xfs_fsid_t));
+
+	/* Fill in the rest of the handle with the information
+	 * pertinent to this inode.
+	 */
+	hdl->ha_fid.fid_len = sizeof(xfs_handle_t) -
+			      sizeof(xfs_fsid_t) -
+			      sizeof(hdl->ha_fid.fid_len);
+	hdl->ha_fid.fid_pad = 0;
+	hdl->ha_fid.fid_gen = bstat->bs_gen;
+	hdl->ha_fid.fid_ino = bstat->bs_ino;
+
+	fh->handle_len = sizeof(*hdl);
+}
+
+static void xfs_fsal_bstat2stat(const xfs_bstat_t *bstat, dev_t dev,
+				struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = dev;
+	st->st_ino = bstat->bs_ino;
+	st->st_mode = bstat->bs_mode;
+	st->st_nlink = bstat->bs_nlink;
+	st->st_uid = bstat->bs_uid;
+	st->st_gid = bstat->bs_gid;
+	/* sysv encoded by the kernel */
+	st->st_rdev = makedev((bstat->bs_rdev >> 18) & 0x3fff,
+			      bstat->bs_rdev & 0x3ffff);
+	st->st_size = bstat->bs_size;
+	st->st_blksize = bstat->bs_blksize;
+	st->st_blocks = bstat->bs_blocks;
+	st->st_atim.tv_sec = bstat->bs_atime.tv_sec;
+	st->st_atim.tv_nsec = bstat->bs_atime.tv_nsec;
+	st->st_mtim.tv_sec = bstat->bs_mtime.tv_sec;
+	st->st_mtim.tv_nsec = bstat->bs_mtime.tv_nsec;
+	st->st_ctim.tv_sec = bstat->bs_ctime.tv_sec;
+	st->st_ctim.tv_nsec = bstat->bs_ctime.tv_nsec;
+}
+
 static int xfs_fsal_inode2handle(int fd, ino_t ino, vfs_file_handle_t *fh)
 {
 	xfs_bstat_t bstat;
-	xfs_handle_t *hdl = (xfs_handle_t *) fh->handle_data;
 	void *data;
 	size_t sz;
 
-	if (fh->handle_len < sizeof(*hdl)) {
+	if (fh->handle_len < sizeof(xfs_handle_t)) {
 		errno = E2BIG;
 		return -1;
 	}
@@ -106,25 +158,106 @@ static int xfs_fsal_inode2handle(int fd, ino_t ino, vfs_file_handle_t *fh)
 	    (fd_to_handle(fd, &data, &sz) < 0))
 		return -1;
 
-	/* Copy the fsid from the reference fd */
-	memcpy(&hdl->ha_fsid, data, sizeof(xfs_fsid_t));
-
-	/* Fill in the rest of the handle with the information
-	 * pertinent to this inode.
-	 */
-	hdl->ha_fid.fid_len = sizeof(xfs_handle_t) -
-			      sizeof(xfs_fsid_t) -
-			      sizeof(hdl->ha_fid.fid_len);
-	hdl->ha_fid.fid_pad = 0;
-	hdl->ha_fid.fid_gen = bstat.bs_gen;
-	hdl->ha_fid.fid_ino = bstat.bs_ino;
-
-	fh->handle_len = sizeof(*hdl);
+	xfs_fsal_bstat2handle(data, &bstat, fh);
 
 	free_handle(data, sz);
 	return 0;
 }
 
+/* Inodes asked for by one XFS_IOC_FSBULKSTAT */
+#define XFS_BULKSTAT_BATCH 64
+
+/**
+ * @brief Stat inodes of the file system in bulk
+ *
+ * XFS_IOC_FSBULKSTAT returns the next allocated inodes after a given
+ * one, and the entries of a directory mostly have inodes close to
+ * each other: each call answers a run of the inodes asked for, and at
+ * least the first of those left, found or known gone.
+ *
+ * @param[in]  fd    Directory on the file system
+ * @param[in]  count Inodes
+ * @param[in]  inos  Their numbers
+ * @param[out] st    Their stat, st_ino 0 for those gone
+ * @param[out] fh    Their handles, if not NULL
+ *
+ * @return Inodes found, -1 with errno set on error.
+ */
+int vfs_bulkstat(int fd, unsigned int count, const uint64_t *inos,
+		 struct stat *st, vfs_file_handle_t *fh)
+{
+	xfs_fsop_bulkreq_t bulkreq;
+	xfs_bstat_t *bstat;
+	struct stat dirst;
+	unsigned int *order;
+	unsigned int i, j, k;
+	void *fsid = NULL;
+	size_t sz = 0;
+	__u64 lastip;
+	__s32 ocount;
+	int found = 0, e = 0;
+
+	if (fstat(fd, &dirst) < 0)
+		return -1;
+	if (fh != NULL && fd_to_handle(fd, &fsid, &sz) < 0)
+		return -1;
+
+	order = gsh_malloc(count * sizeof(*order));
+	bstat = gsh_malloc(XFS_BULKSTAT_BATCH * sizeof(*bstat));
+
+	/* by ascending inode, few enough for an insertion sort */
+	for (i = 0; i < count; i++) {
+		st[i].st_ino = 0;
+		for (j = i; j > 0 && inos[order[j - 1]] > inos[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	i = 0;
+	while (i < count) {
+		lastip = inos[order[i]] - 1;
+		bulkreq.lastip = &lastip;
+		bulkreq.icount = XFS_BULKSTAT_BATCH;
+		bulkreq.ubuffer = bstat;
+		bulkreq.ocount = &ocount;
+		if (ioctl(fd, XFS_IOC_FSBULKSTAT, &bulkreq) < 0) {
+			e = errno;
+			found = -1;
+			goto out;
+		}
+		if (ocount <= 0)
+			break;	/* the rest are gone */
+
+		for (k = 0; k < (unsigned int) ocount && i < count; k++) {
+			/* those asked for before this one are gone */
+			while (i < count && inos[order[i]] < bstat[k].bs_ino)
+				i++;
+			/* hard links in one directory ask twice */
+			while (i < count && inos[order[i]] == bstat[k].bs_ino) {
+				j = order[i++];
+				xfs_fsal_bstat2stat(&bstat[k], dirst.st_dev,
+						    &st[j]);
+				if (fh != NULL)
+					xfs_fsal_bstat2handle(fsid, &bstat[k],
+							      &fh[j]);
+				found++;
+			}
+		}
+		while (i < count &&
+		       inos[order[i]] <= bstat[ocount - 1].bs_ino)
+			i++;
+	}
+
+ out:
+	gsh_free(bstat);
+	gsh_free(order);
+	if (fsid != NULL)
+		free_handle(fsid, sz);
+	if (found < 0)
+		errno = e;
+	return found;
+}
+
 int vfs_open_by_handle(struct vfs_filesystem *fs,
 		       vfs_file_handle_t *fh, int openflags,
 		       fsal_errors_t *fsal_error)
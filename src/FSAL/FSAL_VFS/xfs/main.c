@@ -39,6 +39,7 @@
 #include "fsal.h"
 #include "FSAL/fsal_init.h"
 #include "fsal_handle_syscalls.h"
+#include "../vfs_methods.h"
 
 /* VFS FSAL module private storage
  */
@@ -188,6 +189,14 @@ static fsal_status_t init_config(struct fsal_module *fsal_hdl,
 				      err_type);
 	if (!config_error_is_harmless(err_type))
 		return fsalstat(ERR_FSAL_INVAL, 0);
+	if (vfs_path_fd_init(config_struct, err_type) != 0)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+	if (vfs_readdir_init(config_struct, err_type) != 0)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+#ifdef USE_IO_URING
+	if (vfs_uring_init(config_struct, err_type) != 0)
+		return fsalstat(ERR_FSAL_INVAL, 0);
+#endif
 	display_fsinfo(&xfs_me->fs_info);
 	LogFullDebug(COMPONENT_FSAL,
 		     "Supported attributes constant = 0x%" PRIx64,
@@ -253,6 +262,10 @@ MODULE_FINI void xfs_unload(void)
 {
 	int retval;
 
+#ifdef USE_IO_URING
+	vfs_uring_shutdown();
+#endif
+
 	retval = unregister_fsal(&XFS.fsal);
 	if (retval != 0) {
 		fprintf(stderr, "XFS module failed to unregister");
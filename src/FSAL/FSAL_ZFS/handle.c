@@ -539,7 +539,8 @@ static fsal_status_t tank_readsymlink(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t tank_linkfile(struct fsal_obj_handle *obj_hdl,
 				   struct fsal_obj_handle *destdir_hdl,
-				   const char *name)
+				   const char *name,
+				   struct attrlist *destdir_attrs_out)
 {
 	struct zfs_fsal_obj_handle *myself, *destdir;
 	int retval = 0;
@@ -678,7 +679,9 @@ static fsal_status_t tank_rename(struct fsal_obj_handle *obj_hdl,
 				 struct fsal_obj_handle *olddir_hdl,
 				 const char *old_name,
 				 struct fsal_obj_handle *newdir_hdl,
-				 const char *new_name)
+				 const char *new_name,
+				 struct attrlist *olddir_attrs_out,
+				 struct attrlist *newdir_attrs_out)
 {
 	struct zfs_fsal_obj_handle *olddir, *newdir;
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
@@ -887,7 +890,8 @@ static fsal_status_t tank_setattrs(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t tank_unlink(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name)
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
 {
 	struct zfs_fsal_obj_handle *myself;
 	fsal_errors_t fsal_error = ERR_FSAL_NO_ERROR;
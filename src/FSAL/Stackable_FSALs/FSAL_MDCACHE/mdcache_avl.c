@@ -58,8 +58,11 @@ mdcache_avl_init(mdcache_entry_t *entry)
 {
 	avltree_init(&entry->fsobj.fsdir.avl.t, avl_dirent_hk_cmpf,
 		     0 /* flags */);
-	avltree_init(&entry->fsobj.fsdir.avl.c, avl_dirent_hk_cmpf,
+	avltree_init(&entry->fsobj.fsdir.avl.ck, avl_dirent_ck_cmpf,
 		     0 /* flags */);
+	entry->fsobj.fsdir.avl.vec = NULL;
+	entry->fsobj.fsdir.avl.nvec = 0;
+	entry->fsobj.fsdir.avl.vcap = 0;
 }
 
 static inline struct avltree_node *
@@ -82,27 +85,199 @@ avltree_inline_lookup(
 	return NULL;
 }
 
-void
-avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+static inline struct avltree_node *
+avltree_inline_ck_lookup(
+	const struct avltree_node *key,
+	const struct avltree *tree)
+{
+	struct avltree_node *node = tree->root;
+	int res = 0;
+
+	while (node) {
+		res = avl_dirent_ck_cmpf(node, key);
+		if (res == 0)
+			return node;
+		if (res > 0)
+			node = node->left;
+		else
+			node = node->right;
+	}
+	return NULL;
+}
+
+/*
+ * The name index.  A directory keeps its first MDCACHE_DIRENT_VEC_MAX
+ * children in the sorted array avl.vec, and moves them all to the tree
+ * avl.t when one more comes.  It goes back to the array only once the
+ * tree is empty again.
+ */
+
+/* Slots of the array with a hash less than k */
+static inline uint32_t
+dirent_vec_rank(const mdcache_entry_t *entry, uint64_t k)
+{
+	const struct mdcache_dirent_slot *vec = entry->fsobj.fsdir.avl.vec;
+	uint32_t lo = 0, hi = entry->fsobj.fsdir.avl.nvec, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (vec[mid].k < k)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static inline void
+dirent_vec_resize(mdcache_entry_t *entry, uint32_t vcap)
+{
+	struct mdcache_dirent_slot *vec = entry->fsobj.fsdir.avl.vec;
+
+	(void)atomic_sub_uint64_t(&cache_stp->mem_dirents,
+				  entry->fsobj.fsdir.avl.vcap * sizeof(*vec));
+	(void)atomic_add_uint64_t(&cache_stp->mem_dirents,
+				  vcap * sizeof(*vec));
+	if (vcap == 0) {
+		gsh_free(vec);
+		vec = NULL;
+	} else {
+		vec = gsh_realloc(vec, vcap * sizeof(*vec));
+	}
+	entry->fsobj.fsdir.avl.vec = vec;
+	entry->fsobj.fsdir.avl.vcap = vcap;
+}
+
+/* Move the children in the array to the tree */
+static void
+dirent_vec_promote(mdcache_entry_t *entry)
 {
+	struct mdcache_dirent_slot *vec = entry->fsobj.fsdir.avl.vec;
+	uint32_t i;
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Directory %p has more than %d children, using its tree",
+		     entry, MDCACHE_DIRENT_VEC_MAX);
+
+	for (i = 0; i < entry->fsobj.fsdir.avl.nvec; i++)
+		(void)avltree_insert(&vec[i].dirent->node_hk,
+				     &entry->fsobj.fsdir.avl.t);
+
+	entry->fsobj.fsdir.avl.nvec = 0;
+	dirent_vec_resize(entry, 0);
+}
+
+static inline mdcache_dir_entry_t *
+dirent_name_lookup(mdcache_entry_t *entry, uint64_t k)
+{
+	struct avltree *t = &entry->fsobj.fsdir.avl.t;
 	struct avltree_node *node;
+	mdcache_dir_entry_t key;
+	uint32_t i;
+
+	if (avltree_size(t) == 0) {
+		i = dirent_vec_rank(entry, k);
+		if (i < entry->fsobj.fsdir.avl.nvec &&
+		    entry->fsobj.fsdir.avl.vec[i].k == k)
+			return entry->fsobj.fsdir.avl.vec[i].dirent;
+		return NULL;
+	}
 
+	key.hk.k = k;
+	node = avltree_inline_lookup(&key.node_hk, t);
+	return node ? avltree_container_of(node, mdcache_dir_entry_t, node_hk)
+		    : NULL;
+}
+
+/* Returns the child already at v->hk.k, if any, and does not insert then */
+static mdcache_dir_entry_t *
+dirent_name_insert(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+{
+	struct avltree *t = &entry->fsobj.fsdir.avl.t;
+	struct mdcache_dirent_slot *vec;
+	struct avltree_node *node;
+	uint32_t i, n = entry->fsobj.fsdir.avl.nvec;
+
+	if (avltree_size(t) == 0) {
+		i = dirent_vec_rank(entry, v->hk.k);
+		vec = entry->fsobj.fsdir.avl.vec;
+		if (i < n && vec[i].k == v->hk.k)
+			return vec[i].dirent;
+
+		if (n < MDCACHE_DIRENT_VEC_MAX) {
+			if (n == entry->fsobj.fsdir.avl.vcap)
+				dirent_vec_resize(entry, n ? n * 2 : 4);
+			vec = entry->fsobj.fsdir.avl.vec;
+			memmove(&vec[i + 1], &vec[i], (n - i) * sizeof(*vec));
+			vec[i].k = v->hk.k;
+			vec[i].dirent = v;
+			entry->fsobj.fsdir.avl.nvec++;
+			return NULL;
+		}
+
+		dirent_vec_promote(entry);
+	}
+
+	node = avltree_insert(&v->node_hk, t);
+	return node ? avltree_container_of(node, mdcache_dir_entry_t, node_hk)
+		    : NULL;
+}
+
+static void
+dirent_name_remove(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+{
+	struct mdcache_dirent_slot *vec = entry->fsobj.fsdir.avl.vec;
+	uint32_t i, n = entry->fsobj.fsdir.avl.nvec;
+
+	if (avltree_size(&entry->fsobj.fsdir.avl.t) != 0) {
+		avltree_remove(&v->node_hk, &entry->fsobj.fsdir.avl.t);
+		return;
+	}
+
+	i = dirent_vec_rank(entry, v->hk.k);
+	if (i == n || vec[i].dirent != v)
+		return;
+
+	memmove(&vec[i], &vec[i + 1], (n - i - 1) * sizeof(*vec));
+	entry->fsobj.fsdir.avl.nvec = --n;
+
+	/* Give back the memory of a directory emptied or shrunk a lot */
+	if (n == 0)
+		dirent_vec_resize(entry, 0);
+	else if (n <= entry->fsobj.fsdir.avl.vcap / 4)
+		dirent_vec_resize(entry, entry->fsobj.fsdir.avl.vcap / 2);
+}
+
+/**
+ * @brief Mark a dirent deleted
+ *
+ * The dirent leaves the name tree.  A dirent in a chunk stays there,
+ * and in the cookie tree, so a READDIR can still resume from its
+ * cookie; it is freed with its chunk.  A detached dirent is freed now.
+ *
+ * @param[in] entry The directory
+ * @param[in] v     The dirent
+ */
+void
+avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+{
 	LogFullDebug(COMPONENT_CACHE_INODE,
 		     "Delete dir entry %p %s",
 		     v, v->name);
 
 	assert(!(v->flags & DIR_ENTRY_FLAG_DELETED));
+	assert(dirent_name_lookup(entry, v->hk.k) == v);
 
-	node = avltree_inline_lookup(&v->node_hk, &entry->fsobj.fsdir.avl.t);
-	assert(node);
-	avltree_remove(&v->node_hk, &entry->fsobj.fsdir.avl.t);
+	dirent_name_remove(entry, v);
 
 	v->flags |= DIR_ENTRY_FLAG_DELETED;
 	mdcache_key_delete(&v->ckey);
 
-	/* save cookie in deleted avl */
-	node = avltree_insert(&v->node_hk, &entry->fsobj.fsdir.avl.c);
-	assert(!node);
+	if (v->chunk == NULL) {
+		glist_del(&v->chunk_list);
+		entry->fsobj.fsdir.ndetached--;
+		mdcache_dirent_free(v);
+	}
 }
 
 /**
@@ -122,44 +297,12 @@ mdcache_avl_insert_impl(mdcache_entry_t *entry, mdcache_dir_entry_t *v,
 			int j, int j2)
 {
 	int code = -1;
-	struct avltree_node *node;
-	struct avltree *t = &entry->fsobj.fsdir.avl.t;
-	struct avltree *c = &entry->fsobj.fsdir.avl.c;
 
 	LogFullDebug(COMPONENT_CACHE_INODE,
 		     "Insert dir entry %p %s j=%d j2=%d",
 		     v, v->name, j, j2);
 
-	/* first check for a previously-deleted entry */
-	node = avltree_inline_lookup(&v->node_hk, c);
-
-	/* We must not allow persist-cookies to overrun resource
-	 * management processes.  Note this is not a limit on
-	 * directory size, but rather indirectly on the lifetime
-	 * of cookie offsets of directories under mutation. */
-	if ((!node) && (avltree_size(c) >
-			mdcache_param.dir.avl_max_deleted)) {
-		/* ie, recycle the smallest deleted entry */
-		node = avltree_first(c);
-	}
-
-	if (node) {
-		/* We can't really re-use slots safely since filenames can
-		 * have wildly differing lengths, so remove and free the
-		 * "deleted" entry.
-		 */
-		mdcache_dir_entry_t *dirent =
-		   avltree_container_of(node, mdcache_dir_entry_t, node_hk);
-
-		avltree_remove(node, c);
-		/* Don't need to free ckey; it was freed when marked deleted */
-		gsh_free(dirent);
-		node = NULL;
-	}
-
-	node = avltree_insert(&v->node_hk, t);
-
-	if (!node) {
+	if (!dirent_name_insert(entry, v)) {
 		/* success, note iterations */
 		v->hk.p = j + j2;
 		if (entry->fsobj.fsdir.avl.collisions < v->hk.p)
@@ -252,9 +395,7 @@ mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 			return code;
 		/* detect name conflict */
 		if (j == 0) {
-			(void) mdcache_avl_lookup_k(entry, v->hk.k,
-						    MDCACHE_FLAG_ONLY_ACTIVE,
-						    &v2);
+			v2 = dirent_name_lookup(entry, v->hk.k);
 			assert(v != v2);
 			if (v2 && (strcmp(v->name, v2->name) == 0)) {
 				LogDebug(COMPONENT_CACHE_INODE,
@@ -305,88 +446,114 @@ mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent)
 out:
 
 	mdcache_key_delete(&v->ckey);
-	gsh_free(v);
+	mdcache_dirent_free(v);
 	*dirent = v2;
 
 	return code;
 }
 
 /**
- * @brief Look up a dirent by k-value
+ * @brief Index a chunked dirent by its FSAL cookie
+ *
+ * @param[in] entry The directory
+ * @param[in] v     The dirent, with v->ck set
+ *
+ * @retval 0  Success
+ * @retval -1 The cookie is already indexed
+ */
+int
+mdcache_avl_insert_ck(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+{
+	struct avltree_node *node;
+
+	node = avltree_insert(&v->node_ck, &entry->fsobj.fsdir.avl.ck);
+	if (node) {
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Cookie %" PRIu64 " of %s already used in entry=%p",
+			 v->ck, v->name, entry);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Remove a dirent from the name index and the cookie tree
+ *
+ * @param[in] entry The directory
+ * @param[in] v     The dirent
+ */
+void
+mdcache_avl_remove(mdcache_entry_t *entry, mdcache_dir_entry_t *v)
+{
+	if (!(v->flags & DIR_ENTRY_FLAG_DELETED))
+		dirent_name_remove(entry, v);
+	if (v->chunk)
+		avltree_remove(&v->node_ck, &entry->fsobj.fsdir.avl.ck);
+}
+
+/**
+ * @brief Look up a chunked dirent by FSAL cookie
  *
- * Look up a dirent by k-value.  If @ref MDCACHE_FLAG_NEXT_ACTIVE is set in @a
- * flags then the dirent after the give k-value is returend (this is for
- * readdir).  If @ref MDCACHE_FLAG_ONLY_ACTIVE is set, then only the active tree
- * is searched.  Otherwise, the deleted tree is searched, and, if found, the
- * dirent after that deleted dirnet is returned.
+ * Deleted dirents are returned too, since READDIR may still resume
+ * from them.
  *
  * @param[in] entry	Directory to search in
- * @param[in] k		K-value to find
- * @param[in] flags	MDCACHE_FLAG_*
- * @param[out] dirent	Returned dirent, if found, NULL otherwise
- * @return MDCACHE_AVL_NO_ERROR if found; MDCACHE_AVL_NOT_FOUND if not found;
- * MDCACHE_AVL_LAST if next requested and found was last; and
- * MDCACHE_AVL_DELETED if all subsequent dirents are deleted.
+ * @param[in] ck	FSAL cookie to find
+ *
+ * @return The dirent, or NULL if no cached chunk holds @a ck.
  */
-enum mdcache_avl_err
-mdcache_avl_lookup_k(mdcache_entry_t *entry, uint64_t k, uint32_t flags,
-		     mdcache_dir_entry_t **dirent)
+mdcache_dir_entry_t *
+mdcache_avl_lookup_ck(mdcache_entry_t *entry, fsal_cookie_t ck)
 {
-	struct avltree *t = &entry->fsobj.fsdir.avl.t;
-	struct avltree *c = &entry->fsobj.fsdir.avl.c;
 	mdcache_dir_entry_t dirent_key[1];
-	struct avltree_node *node, *node2;
+	struct avltree_node *node;
 
-	*dirent = NULL;
-	dirent_key->hk.k = k;
+	dirent_key->ck = ck;
 
-	node = avltree_inline_lookup(&dirent_key->node_hk, t);
-	if (node) {
-		if (flags & MDCACHE_FLAG_NEXT_ACTIVE)
-			/* client wants the cookie -after- the last we sent, and
-			 * the Linux 3.0 and 3.1.0-rc7 clients misbehave if we
-			 * resend the last one */
-			node = avltree_next(node);
-		if (!node) {
-			LogFullDebug(COMPONENT_NFS_READDIR,
-				     "seek to cookie=%" PRIu64
-				     " fail (no next entry)", k);
-			return MDCACHE_AVL_LAST;
-		}
-	}
+	node = avltree_inline_ck_lookup(&dirent_key->node_ck,
+					&entry->fsobj.fsdir.avl.ck);
+	if (!node)
+		return NULL;
 
-	/* only the forward AVL is valid for conflict checking */
-	if (flags & MDCACHE_FLAG_ONLY_ACTIVE)
-		goto done;
-
-	/* Try the deleted AVL.  If a node with hk.k == v->hk.k is found,
-	 * return its least upper bound in -t-, if any. */
-	if (!node) {
-		node2 = avltree_inline_lookup(&dirent_key->node_hk, c);
-		if (node2) {
-			node = avltree_sup(&dirent_key->node_hk, t);
-			if (!node)
-				return MDCACHE_AVL_DELETED;
-		}
-		LogDebug(COMPONENT_NFS_READDIR,
-			 "node %p found deleted supremum %p", node2, node);
+	return avltree_container_of(node, mdcache_dir_entry_t, node_ck);
+}
+
+/**
+ * @brief Find the child that is a given cache entry
+ *
+ * A walk of all the children, for the rare callers that need it.
+ *
+ * @param[in] entry The directory, content_lock held
+ * @param[in] key   Key of the child
+ *
+ * @return The first dirent with that key, or NULL.
+ */
+mdcache_dir_entry_t *
+mdcache_avl_lookup_ckey(mdcache_entry_t *entry, mdcache_key_t *key)
+{
+	struct avltree_node *node;
+	mdcache_dir_entry_t *v;
+	uint32_t i;
+
+	for (i = 0; i < entry->fsobj.fsdir.avl.nvec; i++) {
+		v = entry->fsobj.fsdir.avl.vec[i].dirent;
+		if (mdcache_key_cmp(&v->ckey, key) == 0)
+			return v;
 	}
 
-done:
-	if (node) {
-		*dirent =
-		    avltree_container_of(node, mdcache_dir_entry_t, node_hk);
-		return MDCACHE_AVL_NO_ERROR;
+	for (node = avltree_first(&entry->fsobj.fsdir.avl.t); node != NULL;
+	     node = avltree_next(node)) {
+		v = avltree_container_of(node, mdcache_dir_entry_t, node_hk);
+		if (mdcache_key_cmp(&v->ckey, key) == 0)
+			return v;
 	}
 
-	return MDCACHE_AVL_NOT_FOUND;
+	return NULL;
 }
 
 mdcache_dir_entry_t *
 mdcache_avl_qp_lookup_s(mdcache_entry_t *entry, const char *name, int maxj)
 {
-	struct avltree *t = &entry->fsobj.fsdir.avl.t;
-	struct avltree_node *node;
 	mdcache_dir_entry_t *v2;
 #if AVL_HASH_MURMUR3
 	uint32_t hashbuff[4];
@@ -415,11 +582,9 @@ mdcache_avl_qp_lookup_s(mdcache_entry_t *entry, const char *name, int maxj)
 
 	for (j = 0; j < maxj; j++) {
 		v.hk.k = (v.hk.k + (j * 2));
-		node = avltree_lookup(&v.node_hk, t);
-		if (node) {
-			/* ensure that node is related to v */
-			v2 = avltree_container_of(node, mdcache_dir_entry_t,
-						  node_hk);
+		v2 = dirent_name_lookup(entry, v.hk.k);
+		if (v2) {
+			/* ensure that v2 is related to v */
 			if (strcmp(name, v2->name) == 0) {
 				assert(!(v2->flags & DIR_ENTRY_FLAG_DELETED));
 				return v2;
@@ -433,26 +598,4 @@ mdcache_avl_qp_lookup_s(mdcache_entry_t *entry, const char *name, int maxj)
 	return NULL;
 }
 
-/**
- * @brief Remove and free all dirents from a dirent tree
- *
- * @param[in] tree	Tree to remove from
- */
-void mdcache_avl_clean_tree(struct avltree *tree)
-{
-	struct avltree_node *dirent_node = NULL;
-	mdcache_dir_entry_t *dirent = NULL;
-
-	while ((dirent_node = avltree_first(tree))) {
-		dirent = avltree_container_of(dirent_node, mdcache_dir_entry_t,
-					      node_hk);
-		LogFullDebug(COMPONENT_CACHE_INODE, "Invalidate %p %s",
-			     dirent, dirent->name);
-		avltree_remove(dirent_node, tree);
-		if (dirent->ckey.kv.len)
-			mdcache_key_delete(&dirent->ckey);
-		gsh_free(dirent);
-	}
-}
-
 /** @} */
@@ -38,7 +38,7 @@
  * @page AVLOverview Overview
  *
  * Definitions supporting AVL dirent representation.  The current
- * design represents dirents as a single AVL tree ordered by a
+ * design indexes dirents by name in an AVL tree ordered by a
  * collision-resistent hash function (currently, Murmur3, which
  * appears to be several times faster than lookup3 on x86_64
  * architecture).  Quadratic probing is used to emulate perfect
@@ -46,6 +46,13 @@
  * Heuristic methods are used to detect worst-case scenarios and fall
  * back to tractable (e.g., lookup) algorthims.
  *
+ * A directory with no more than MDCACHE_DIRENT_VEC_MAX children keeps
+ * them in an array sorted by name hash instead of the tree.
+ *
+ * Dirents read by readdir are also indexed by their FSAL cookie in a
+ * second AVL tree, so that a READDIR can resume from any cookie still
+ * held in a cached chunk.
+ *
  */
 
 #ifndef MDCACHE_AVL_H
@@ -73,27 +80,35 @@ static inline int avl_dirent_hk_cmpf(const struct avltree_node *lhs,
 	return 1;
 }
 
+static inline int avl_dirent_ck_cmpf(const struct avltree_node *lhs,
+				     const struct avltree_node *rhs)
+{
+	mdcache_dir_entry_t *lk, *rk;
+
+	lk = avltree_container_of(lhs, mdcache_dir_entry_t, node_ck);
+	rk = avltree_container_of(rhs, mdcache_dir_entry_t, node_ck);
+
+	if (lk->ck < rk->ck)
+		return -1;
+
+	if (lk->ck == rk->ck)
+		return 0;
+
+	return 1;
+}
+
 void avl_dirent_set_deleted(mdcache_entry_t *entry, mdcache_dir_entry_t *v);
 void mdcache_avl_init(mdcache_entry_t *entry);
 int mdcache_avl_qp_insert(mdcache_entry_t *entry, mdcache_dir_entry_t **dirent);
+int mdcache_avl_insert_ck(mdcache_entry_t *entry, mdcache_dir_entry_t *v);
+void mdcache_avl_remove(mdcache_entry_t *entry, mdcache_dir_entry_t *v);
 
-#define MDCACHE_FLAG_NONE        0x0000
-#define MDCACHE_FLAG_NEXT_ACTIVE 0x0001
-#define MDCACHE_FLAG_ONLY_ACTIVE 0x0002
-
-enum mdcache_avl_err {
-	MDCACHE_AVL_NO_ERROR = 0,	/*< Entry was found */
-	MDCACHE_AVL_NOT_FOUND,		/*< Entry was not found */
-	MDCACHE_AVL_LAST,		/*< Requested next, but was last */
-	MDCACHE_AVL_DELETED,		/*< Entry was deleted */
-};
-
-enum mdcache_avl_err mdcache_avl_lookup_k(mdcache_entry_t *entry, uint64_t k,
-					  uint32_t flags,
-					  mdcache_dir_entry_t **dirent);
+mdcache_dir_entry_t *mdcache_avl_lookup_ckey(mdcache_entry_t *entry,
+					     mdcache_key_t *key);
+mdcache_dir_entry_t *mdcache_avl_lookup_ck(mdcache_entry_t *entry,
+					   fsal_cookie_t ck);
 mdcache_dir_entry_t *mdcache_avl_qp_lookup_s(mdcache_entry_t *entry,
 					     const char *name, int maxj);
-void mdcache_avl_clean_tree(struct avltree *tree);
 
 #endif				/* MDCACHE_AVL_H */
 
@@ -0,0 +1,373 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_bus.c
+ * @brief Invalidations multicast to the other servers of a cluster
+ *
+ * A message is one datagram, in network byte order:
+ *
+ *   magic (4), version (2), export id (2), sending node (8),
+ *   FSAL_UP_INVALIDATE_* flags (4), key length (2), unused (2), key
+ *
+ * The key is the sub-FSAL's handle_to_key, which is the same on every
+ * server for the filesystems this is meant for (Ceph, GPFS).  Messages
+ * are sent without waiting and nothing is resent; a lost one leaves
+ * the object to expire as it would without the bus.  There is no
+ * authentication, the group must be on a trusted network.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
+#include "mdcache_int.h"
+#include "mdcache_bus.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define BUS_MAGIC 0x4d444342	/* "MDCB" */
+#define BUS_VERSION 1
+#define BUS_HEADER 24
+/** Longest key sent; objects with longer keys are not */
+#define BUS_KEY_MAX 256
+
+bool mdc_bus_on;
+
+static int bus_fd = -1;
+static struct sockaddr_storage bus_group;
+static socklen_t bus_group_len;
+static uint64_t bus_node;	/*< Tells our own messages, looped back */
+static struct fridgethr *bus_fridge;
+
+static inline void put16(char *p, uint16_t v)
+{
+	v = htons(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline void put32(char *p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline void put64(char *p, uint64_t v)
+{
+	put32(p, v >> 32);
+	put32(p + 4, v);
+}
+
+static inline uint16_t get16(const char *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return ntohs(v);
+}
+
+static inline uint32_t get32(const char *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+static inline uint64_t get64(const char *p)
+{
+	return ((uint64_t) get32(p) << 32) | get32(p + 4);
+}
+
+/**
+ * @brief Send an invalidation to the group
+ *
+ * @param[in] entry  The object that changed
+ * @param[in] flags  FSAL_UP_INVALIDATE_* for the others to forget
+ */
+void mdc_bus_do_publish(mdcache_entry_t *entry, uint32_t flags)
+{
+	mdcache_key_t *key = &entry->fh_hk.key;
+	char msg[BUS_HEADER + BUS_KEY_MAX];
+	size_t len = BUS_HEADER + key->kv.len;
+
+	if (key->kv.len > BUS_KEY_MAX || op_ctx == NULL ||
+	    op_ctx->ctx_export == NULL)
+		return;
+
+	put32(msg, BUS_MAGIC);
+	put16(msg + 4, BUS_VERSION);
+	put16(msg + 6, op_ctx->ctx_export->export_id);
+	put64(msg + 8, bus_node);
+	put32(msg + 16, flags & FSAL_UP_INVALIDATE_CACHE);
+	put16(msg + 20, key->kv.len);
+	put16(msg + 22, 0);
+	memcpy(msg + BUS_HEADER, key->kv.addr, key->kv.len);
+
+	if (sendto(bus_fd, msg, len, MSG_DONTWAIT,
+		   (struct sockaddr *) &bus_group, bus_group_len) < 0) {
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "Coherency bus send failed: %s",
+			     strerror(errno));
+		return;
+	}
+
+	(void) atomic_inc_uint64_t(&cache_stp->bus_sent);
+}
+
+/**
+ * @brief Apply an invalidation from another server
+ *
+ * @param[in] msg  The datagram
+ * @param[in] len  Its length
+ */
+static void bus_apply(const char *msg, size_t len)
+{
+	struct gsh_export *export;
+	struct fsal_export *exp_hdl;
+	struct gsh_buffdesc key;
+	uint32_t flags;
+
+	if (len < BUS_HEADER || get32(msg) != BUS_MAGIC ||
+	    get16(msg + 4) != BUS_VERSION || get64(msg + 8) == bus_node)
+		return;
+
+	key.len = get16(msg + 20);
+	key.addr = (void *) (msg + BUS_HEADER);
+	flags = get32(msg + 16) & FSAL_UP_INVALIDATE_CACHE;
+	if (key.len == 0 || BUS_HEADER + key.len > len || flags == 0)
+		return;
+
+	export = get_gsh_export(get16(msg + 6));
+	if (export == NULL)
+		return;
+
+	/* Only exports cached here have anything to forget */
+	exp_hdl = export->fsal_export;
+	if (exp_hdl != NULL && exp_hdl->sub_export != NULL &&
+	    strcmp(exp_hdl->fsal->name, mdcachename) == 0) {
+		(void) mdc_up_invalidate(exp_hdl, &key, flags);
+		(void) atomic_inc_uint64_t(&cache_stp->bus_received);
+	}
+
+	put_gsh_export(export);
+}
+
+/**
+ * @brief Receive invalidations until told to stop
+ *
+ * @param[in] ctx  Thread context
+ */
+static void bus_listen(struct fridgethr_context *ctx)
+{
+	char msg[BUS_HEADER + BUS_KEY_MAX];
+	struct pollfd pfd = { .fd = bus_fd, .events = POLLIN };
+	ssize_t len;
+
+	SetNameFunction("mdc_bus");
+
+	while (!fridgethr_you_should_break(ctx)) {
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+
+		while ((len = recv(bus_fd, msg, sizeof(msg),
+				   MSG_DONTWAIT)) >= 0)
+			bus_apply(msg, len);
+	}
+}
+
+/**
+ * @brief Join the group set by Coherency_Group
+ *
+ * @return 0, or the error keeping the bus from starting.
+ */
+static int bus_join(void)
+{
+	struct addrinfo hints, *res;
+	char port[8];
+	int one = 1, hops = mdcache_param.bus.ttl;
+	int rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+	snprintf(port, sizeof(port), "%u", mdcache_param.bus.port);
+
+	rc = getaddrinfo(mdcache_param.bus.group, port, &hints, &res);
+	if (rc != 0) {
+		LogCrit(COMPONENT_CACHE_INODE,
+			"Coherency_Group %s: %s",
+			mdcache_param.bus.group, gai_strerror(rc));
+		return EINVAL;
+	}
+
+	memcpy(&bus_group, res->ai_addr, res->ai_addrlen);
+	bus_group_len = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	bus_fd = socket(bus_group.ss_family, SOCK_DGRAM, 0);
+	if (bus_fd < 0)
+		return errno;
+
+	(void) setsockopt(bus_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+			  sizeof(one));
+
+	if (bind(bus_fd, (struct sockaddr *) &bus_group, bus_group_len) < 0)
+		goto err;
+
+	if (bus_group.ss_family == AF_INET) {
+		struct ip_mreq mreq;
+
+		memset(&mreq, 0, sizeof(mreq));
+		mreq.imr_multiaddr =
+			((struct sockaddr_in *) &bus_group)->sin_addr;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if (setsockopt(bus_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+			       &mreq, sizeof(mreq)) < 0 ||
+		    setsockopt(bus_fd, IPPROTO_IP, IP_MULTICAST_TTL,
+			       &hops, sizeof(hops)) < 0)
+			goto err;
+	} else {
+		struct ipv6_mreq mreq;
+
+		memset(&mreq, 0, sizeof(mreq));
+		mreq.ipv6mr_multiaddr =
+			((struct sockaddr_in6 *) &bus_group)->sin6_addr;
+		if (setsockopt(bus_fd, IPPROTO_IPV6, IPV6_JOIN_GROUP,
+			       &mreq, sizeof(mreq)) < 0 ||
+		    setsockopt(bus_fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+			       &hops, sizeof(hops)) < 0)
+			goto err;
+	}
+
+	return 0;
+
+err:
+	rc = errno;
+	close(bus_fd);
+	bus_fd = -1;
+	return rc;
+}
+
+/**
+ * @brief Start the bus, if Coherency_Group is set
+ *
+ * @return 0, or the error keeping it from starting.
+ */
+int mdcache_bus_pkginit(void)
+{
+	struct fridgethr_params frp;
+	struct timespec ts;
+	int rc;
+
+	if (mdcache_param.bus.group == NULL)
+		return 0;
+
+	rc = bus_join();
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to join coherency bus %s port %u: %s",
+			 mdcache_param.bus.group, mdcache_param.bus.port,
+			 strerror(rc));
+		return rc;
+	}
+
+	now(&ts);
+	bus_node = ((uint64_t) getpid() << 32) ^ ts.tv_sec ^ ts.tv_nsec;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = 1;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&bus_fridge, "MDC_bus", &frp);
+	if (rc == 0)
+		rc = fridgethr_submit(bus_fridge, bus_listen, NULL);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to start coherency bus thread, error code %d.",
+			 rc);
+		close(bus_fd);
+		bus_fd = -1;
+		return rc;
+	}
+
+	mdc_bus_on = true;
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Coherency bus on %s port %u",
+		 mdcache_param.bus.group, mdcache_param.bus.port);
+
+	return 0;
+}
+
+/**
+ * @brief Stop the bus
+ */
+void mdcache_bus_pkgshutdown(void)
+{
+	int rc;
+
+	if (bus_fridge == NULL)
+		return;
+
+	mdc_bus_on = false;
+
+	rc = fridgethr_sync_command(bus_fridge, fridgethr_comm_stop, 10);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(bus_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down coherency bus thread: %d",
+			 rc);
+	}
+
+	fridgethr_destroy(bus_fridge);
+	bus_fridge = NULL;
+
+	close(bus_fd);
+	bus_fd = -1;
+}
+
+/** @} */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_bus.h
+ * @brief Invalidations multicast to the other servers of a cluster
+ *
+ * Servers exporting the same cluster filesystem join one multicast
+ * group.  Whatever changes an object here sends its key and what to
+ * forget about it to the group, and the others invalidate it as they
+ * would on an upcall, so that neither has to rely on short expiration
+ * times to see the other's changes.
+ */
+
+#ifndef MDCACHE_BUS_H
+#define MDCACHE_BUS_H
+
+#include "config.h"
+#include "abstract_atomic.h"
+#include "mdcache_int.h"
+
+extern bool mdc_bus_on;
+
+int mdcache_bus_pkginit(void);
+void mdcache_bus_pkgshutdown(void);
+
+void mdc_bus_do_publish(mdcache_entry_t *entry, uint32_t flags);
+
+/**
+ * @brief Tell the other servers an object changed
+ *
+ * @param[in] entry  The object
+ * @param[in] flags  FSAL_UP_INVALIDATE_* for them to forget
+ */
+static inline void mdc_bus_publish(mdcache_entry_t *entry, uint32_t flags)
+{
+	if (mdc_bus_on)
+		mdc_bus_do_publish(entry, flags);
+}
+
+/**
+ * @brief Distrust the attributes of a file written to
+ *
+ * The other servers are told only when the attributes were trusted, so
+ * a stream of writes sends one message per refresh of the attributes
+ * here rather than one per write.
+ *
+ * @param[in] entry  The file
+ */
+static inline void mdc_written(mdcache_entry_t *entry)
+{
+	uint32_t flags = atomic_postclear_uint32_t_bits(&entry->mde_flags,
+							MDCACHE_TRUST_ATTRS);
+
+	if (flags & MDCACHE_TRUST_ATTRS)
+		mdc_bus_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
+}
+
+#endif /* MDCACHE_BUS_H */
+
+/** @} */
@@ -49,6 +49,7 @@
 #include "FSAL/fsal_config.h"
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
+#include "mdcache_quota.h"
 #include "nfs_exports.h"
 #include "export_mgr.h"
 
@@ -156,6 +157,10 @@ static void mdcache_unexport(struct fsal_export *exp_hdl,
 
 		/* Release above ref */
 		mdcache_put(entry);
+
+		if (op_ctx->ctx_export != NULL)
+			unexport_progress(op_ctx->ctx_export,
+				&op_ctx->ctx_export->unexport_entries);
 	};
 
 	/* Unhash the root object */
@@ -186,7 +191,9 @@ static void mdcache_exp_release(struct fsal_export *exp_hdl)
 	fsal_detach_export(exp_hdl->fsal, &exp_hdl->exports);
 	free_export_ops(exp_hdl);
 
+	mdc_quota_forget_export(exp);
 	gsh_free(exp->name);
+	PTHREAD_MUTEX_destroy(&exp->statfs.lock);
 
 	gsh_free(exp);	/* elvis has left the building */
 }
@@ -194,7 +201,9 @@ static void mdcache_exp_release(struct fsal_export *exp_hdl)
 /**
  * @brief Get FS information
  *
- * Pass through to underlying FSAL.
+ * The sub-FSAL's answer for a filesystem is reused for
+ * Statfs_Cache_TTL.  Once it is older, one thread fetches it again
+ * while the others keep getting the old one.
  *
  * Note dang: Should this gather info about MDCACHE?
  *
@@ -211,13 +220,55 @@ static fsal_status_t mdcache_get_dynamic_info(struct fsal_export *exp_hdl,
 	struct fsal_export *sub_export = exp->export.sub_export;
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	uint64_t ttl = (uint64_t) mdcache_param.statfs_ttl * NS_PER_MSEC;
+	fsal_dynamicfsinfo_t info;
 	fsal_status_t status;
+	struct timespec ts;
+
+	if (ttl == 0) {
+		subcall_raw(exp,
+			status = sub_export->exp_ops.get_fs_dynamic_info(
+				sub_export, entry->sub_handle, infop)
+		       );
+		return status;
+	}
+
+	now(&ts);
+
+	PTHREAD_MUTEX_lock(&exp->statfs.lock);
+	if (exp->statfs.valid &&
+	    exp->statfs.fsid.major == obj_hdl->fsid.major &&
+	    exp->statfs.fsid.minor == obj_hdl->fsid.minor &&
+	    (exp->statfs.refreshing ||
+	     timespec_diff(&exp->statfs.fetched, &ts) < ttl)) {
+		*infop = exp->statfs.info;
+		PTHREAD_MUTEX_unlock(&exp->statfs.lock);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+	exp->statfs.refreshing = true;
+	PTHREAD_MUTEX_unlock(&exp->statfs.lock);
+
+	/* Fields the sub-FSAL doesn't fill must not come from a caller */
+	memset(&info, 0, sizeof(info));
 
 	subcall_raw(exp,
 		status = sub_export->exp_ops.get_fs_dynamic_info(
-			sub_export, entry->sub_handle, infop)
+			sub_export, entry->sub_handle, &info)
 	       );
 
+	PTHREAD_MUTEX_lock(&exp->statfs.lock);
+	exp->statfs.refreshing = false;
+	if (!FSAL_IS_ERROR(status)) {
+		exp->statfs.info = info;
+		exp->statfs.fsid = obj_hdl->fsid;
+		exp->statfs.fetched = ts;
+		exp->statfs.valid = true;
+	}
+	PTHREAD_MUTEX_unlock(&exp->statfs.lock);
+
+	if (!FSAL_IS_ERROR(status))
+		*infop = info;
+
 	return status;
 }
 
@@ -414,24 +465,36 @@ static fsal_aclsupp_t mdcache_fs_acl_support(struct fsal_export *exp_hdl)
 }
 
 /**
- * @brief Get the list of supported attributes
+ * @brief Keep what the sub-export tells of itself on every op
  *
- * MDCACHE does not provide or restrict attributes
+ * The sub-FSALs fix their supported attributes and umask when they
+ * create the export; they are asked once here, instead of through a
+ * subcall on each access check, create and attribute fetch.
  *
- * @param[in] exp_hdl	Export to query
- * @return Mask of supported attributes
+ * @param[in] exp	Export, stacked on its sub-export
  */
-static attrmask_t mdcache_fs_supported_attrs(struct fsal_export *exp_hdl)
+void mdc_export_static_info(struct mdcache_fsal_export *exp)
 {
-	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
 	struct fsal_export *sub_export = exp->export.sub_export;
-	attrmask_t result;
 
 	subcall_raw(exp,
-		result = sub_export->exp_ops.fs_supported_attrs(sub_export)
+		exp->supported_attrs =
+			sub_export->exp_ops.fs_supported_attrs(sub_export);
+		exp->umask = sub_export->exp_ops.fs_umask(sub_export)
 	       );
+}
 
-	return result;
+/**
+ * @brief Get the list of supported attributes
+ *
+ * MDCACHE does not provide or restrict attributes
+ *
+ * @param[in] exp_hdl	Export to query
+ * @return Mask of supported attributes
+ */
+static attrmask_t mdcache_fs_supported_attrs(struct fsal_export *exp_hdl)
+{
+	return mdc_export(exp_hdl)->supported_attrs;
 }
 
 /**
@@ -444,15 +507,7 @@ static attrmask_t mdcache_fs_supported_attrs(struct fsal_export *exp_hdl)
  */
 static uint32_t mdcache_fs_umask(struct fsal_export *exp_hdl)
 {
-	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
-	struct fsal_export *sub_export = exp->export.sub_export;
-	uint32_t result;
-
-	subcall_raw(exp,
-		result = sub_export->exp_ops.fs_umask(sub_export)
-	       );
-
-	return result;
+	return mdc_export(exp_hdl)->umask;
 }
 
 /**
@@ -479,32 +534,24 @@ static uint32_t mdcache_fs_xattr_access_rights(struct fsal_export *exp_hdl)
 /**
  * @brief Check quota on a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * With Quota_Cache_Size, the hard limits of the caller's cached quotas
+ * are checked first, see mdcache_quota.h.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
- * @param[in] quota_type	Type of quota (user or group)
+ * @param[in] quota_type	Blocks or inodes
  * @return FSAL status
  */
 static fsal_status_t mdcache_check_quota(struct fsal_export *exp_hdl,
 					 const char *filepath, int quota_type)
 {
-	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
-	struct fsal_export *sub_export = exp->export.sub_export;
-	fsal_status_t status;
-
-	subcall_raw(exp,
-		status = sub_export->exp_ops.check_quota(sub_export, filepath,
-							 quota_type)
-	       );
-
-	return status;
+	return mdc_quota_check(mdc_export(exp_hdl), filepath, quota_type);
 }
 
 /**
  * @brief Get quota information for a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * Answered from the quota cache when it has it, see mdcache_quota.h.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
@@ -518,22 +565,14 @@ static fsal_status_t mdcache_get_quota(struct fsal_export *exp_hdl,
 				       int quota_id,
 				       fsal_quota_t *pquota)
 {
-	struct mdcache_fsal_export *exp = mdc_export(exp_hdl);
-	struct fsal_export *sub_export = exp->export.sub_export;
-	fsal_status_t status;
-
-	subcall_raw(exp,
-		status = sub_export->exp_ops.get_quota(sub_export, filepath,
-						       quota_type, quota_id,
-						       pquota));
-
-	return status;
+	return mdc_quota_get(mdc_export(exp_hdl), filepath, quota_type,
+			     quota_id, pquota);
 }
 
 /**
  * @brief Set a quota for a file
  *
- * MDCACHE only caches metadata, so it imposes no restrictions itself.
+ * The quota cache forgets the quota once it is set.
  *
  * @param[in] exp_hdl	Export to query
  * @param[in] filepath	Path to file to query
@@ -558,6 +597,9 @@ static fsal_status_t mdcache_set_quota(struct fsal_export *exp_hdl,
 			filepath, quota_type, quota_id, pquota, presquota)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_quota_forget(exp, filepath, quota_type, quota_id);
+
 	return status;
 }
 
@@ -882,9 +924,11 @@ mdc_init_export(struct fsal_module *fsal_hdl,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
 	PTHREAD_RWLOCK_init(&myself->mdc_exp_lock, &attrs);
+	PTHREAD_MUTEX_init(&myself->statfs.lock, NULL);
 
 	op_ctx->fsal_export = &myself->export;
 	op_ctx->fsal_module = fsal_hdl;
+	mdc_export_static_info(myself);
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -38,6 +38,26 @@
  * @{
  */
 
+/**
+ * @brief Replacement policies for cache entries
+ */
+enum mdcache_lru_policy {
+	/** New entries join the main LRU */
+	MDCACHE_LRU_POLICY_LRU,
+	/** New entries are on probation until seen again after eviction */
+	MDCACHE_LRU_POLICY_2Q
+};
+
+/**
+ * @brief How the LRU thread reclaims cache entries
+ */
+enum mdcache_reaper_mode {
+	/** Entries are only reclaimed when a new one is needed */
+	MDCACHE_REAPER_BURST,
+	/** Each run frees entries from every lane, paced to allocation */
+	MDCACHE_REAPER_CONTINUOUS
+};
+
 /**
  * @brief Structure to hold MDCACHE paramaters
  */
@@ -52,22 +72,153 @@ struct mdcache_parameter {
 	/** Use getattr for directory invalidation.  Defaults to
 	    false.  Settable with Use_Getattr_Directory_Invalidation. */
 	bool getattr_dir_invalidation;
+	/** Trust the attributes of a delegated file until it is recalled
+	    or invalidated, regardless of Attr_Expiration_Time.  Defaults
+	    to false.  Settable with Delegation_Attr_Trust. */
+	bool delegation_attr_trust;
+	/** Results of access checks kept per entry, by credential and
+	    access requested, 0 to disable.  Defaults to 4, settable
+	    with Access_Cache. */
+	uint32_t access_cache;
+	/** Extended attribute values, and names found missing, kept per
+	    entry, 0 to disable.  Defaults to 8, settable with
+	    Xattr_Cache. */
+	uint32_t xattr_cache;
+	/** Largest xattr value kept, in bytes.  Defaults to 1024,
+	    settable with Xattr_Cache_Value_Max. */
+	uint32_t xattr_value_max;
+	/** Milliseconds an export's FSSTAT results are reused, 0 to
+	    disable.  Defaults to 1000, settable with Statfs_Cache_TTL. */
+	uint32_t statfs_ttl;
+	/** Quotas of users and groups remembered, over all exports, 0
+	    to disable.  Defaults to 0, settable with Quota_Cache_Size. */
+	uint32_t quota_size;
+	/** Milliseconds a quota is reused.  Defaults to 2000, settable
+	    with Quota_Cache_TTL. */
+	uint32_t quota_ttl;
 	struct {
-		/** Max size of per-directory cache of removed
-		    entries */
+		/** No longer used; removed entries stay in their chunk.
+		    Settable with Dir_Max_Deleted. */
 		uint32_t avl_max_deleted;
-		/** Max size of per-directory dirent cache */
+		/** Max number of per-directory dirents that were looked
+		    up or created but not read by readdir.  Defaults to
+		    65536, settable with Dir_Max. */
 		uint32_t avl_max;
+		/** Number of dirents read into one chunk.  Defaults to
+		    128, settable with Dir_Chunk. */
+		uint32_t avl_chunk;
+		/** Number of threads reading the next chunk ahead of
+		    readdir, 0 to disable.  Defaults to 2, settable with
+		    Dir_Readahead_Threads. */
+		uint32_t readahead_threads;
+		/** Names known not to exist, over all directories, 0 to
+		    disable.  Defaults to 0, settable with
+		    Dir_Negative_Cache_Size. */
+		uint32_t neg_size;
+		/** Seconds a name is known not to exist.  Defaults to 5,
+		    settable with Dir_Negative_Cache_TTL. */
+		uint32_t neg_ttl;
 	} dir;
+	/** Objects counted as the hottest, 0 to disable.  Defaults to
+	    0, settable with Hot_Objects. */
+	uint32_t hot_objects;
+	struct {
+		/** Bytes of small unstable writes gathered per file
+		    before they are written to the FSAL together, 0 to
+		    disable.  Defaults to 0, settable with
+		    Write_Gather_Size. */
+		uint32_t size;
+		/** Milliseconds gathered writes wait for more before
+		    they are written.  Defaults to 100, settable with
+		    Write_Gather_Delay. */
+		uint32_t delay;
+		/** Bytes gathered over all files, past which writes go
+		    straight to the FSAL, 0 for no limit.  Defaults to
+		    256MB, settable with Write_Gather_Budget. */
+		uint64_t budget;
+	} wgather;
+	struct {
+		/** Merge the commits of a file that arrive during a
+		    flush into the next one, and commit FILE_SYNC writes
+		    the same way.  Defaults to true, settable with
+		    Group_Commit. */
+		bool enable;
+		/** Microseconds a flush waits for more commits to join
+		    it.  Defaults to 0, settable with
+		    Group_Commit_Delay. */
+		uint32_t delay;
+	} gcommit;
+	struct {
+		/** Bytes read ahead of a sequential reader at once, 0 to
+		    disable.  Defaults to 0, settable with
+		    Read_Ahead_Size. */
+		uint32_t size;
+		/** Number of threads reading ahead.  Defaults to 4,
+		    settable with Read_Ahead_Threads. */
+		uint32_t threads;
+		/** Bytes read ahead over all files, past which nothing
+		    more is, 0 for no limit.  Defaults to 256MB, settable
+		    with Read_Ahead_Budget. */
+		uint64_t budget;
+	} rahead;
+	struct {
+		/** Multicast group invalidations are sent to and received
+		    from, NULL to disable.  Defaults to NULL, settable
+		    with Coherency_Group. */
+		char *group;
+		/** UDP port of the group.  Defaults to 32049, settable
+		    with Coherency_Port. */
+		uint16_t port;
+		/** Hops the invalidations may take.  Defaults to 1,
+		    settable with Coherency_TTL. */
+		uint32_t ttl;
+	} bus;
+	struct {
+		/** File the hot objects are saved to and loaded from at
+		    startup, NULL to disable.  Defaults to NULL, settable
+		    with Warm_Cache_File. */
+		char *file;
+		/** Seconds between saves, 0 to save only on shutdown.
+		    Defaults to 300, settable with
+		    Warm_Cache_Interval. */
+		uint32_t interval;
+	} warm;
+	/** Allocate entries and dirents from NUMA-local arenas of 2MB
+	    hugepages.  Defaults to false, settable with
+	    Hugepage_Arenas. */
+	bool hugepage_arenas;
 	/** High water mark for cache entries.  Defaults to 100000,
 	    settable by Entries_HWMark. */
 	uint32_t entries_hwmark;
+	/** Replacement policy for cache entries.  Defaults to lru,
+	    settable with LRU_Policy. */
+	enum mdcache_lru_policy lru_policy;
+	/** With the 2q policy, share of Entries_HWMark that entries on
+	    probation are reclaimed down to before any other entry.
+	    Defaults to 25, settable with Probation_Percent. */
+	uint32_t probation_percent;
+	/** With the 2q policy, size of the table remembering entries
+	    reclaimed from probation, as a percentage of Entries_HWMark.
+	    Defaults to 50, settable with Ghost_Percent. */
+	uint32_t ghost_percent;
+	/** High water mark for dirent chunks across all directories.
+	    Defaults to 10000, settable by Chunks_HWMark. */
+	uint32_t chunks_hwmark;
+	/** Bytes the cache may hold in entries, keys, dirents and ACLs
+	    before it reclaims them regardless of the high water marks,
+	    0 for no limit.  Defaults to 0, settable with
+	    Memory_Budget. */
+	uint64_t memory_budget;
 	/** Base interval in seconds between runs of the LRU cleaner
 	    thread. Defaults to 60, settable with LRU_Run_Interval. */
 	time_t lru_run_interval;
 	/** Whether to cache open files.  Defaults to true, settable
 	    with Cache_FDs. */
 	bool use_fd_cache;
+	/** Whether open files are closed in order of their last stateless
+	    I/O, before the lanes are walked.  Defaults to true, settable
+	    with FD_LRU. */
+	bool fd_lru;
 	/** The percentage of the system-imposed maximum of file
 	    descriptors at which Ganesha will deny requests.
 	    Defaults to 99, settable with FD_Limit_Percent. */
@@ -87,6 +238,13 @@ struct mdcache_parameter {
 	    the number of lanes.)  Defaults to 1000, settable with
 	    Reaper_Work. */
 	uint32_t reaper_work;
+	/** How entries are reclaimed.  Defaults to burst, settable with
+	    Reaper_Mode. */
+	enum mdcache_reaper_mode reaper_mode;
+	/** In continuous mode, the percentage of Entries_HWMark the
+	    LRU thread keeps the cache at.  Defaults to 90, settable
+	    with Reaper_Target_Percent. */
+	uint32_t reaper_target_percent;
 	/** The largest window (as a percentage of the system-imposed
 	    limit on FDs) of work that we will do in extremis.
 	    Defaults to 40, settable with Biggest_Window */
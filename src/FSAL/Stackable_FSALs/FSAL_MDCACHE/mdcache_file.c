@@ -35,6 +35,12 @@
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_int.h"
 #include "mdcache_lru.h"
+#include "mdcache_wgather.h"
+#include "mdcache_gcommit.h"
+#include "mdcache_rahead.h"
+#include "mdcache_hot.h"
+#include "mdcache_bus.h"
+#include "mdcache_quota.h"
 
 /**
  *
@@ -247,8 +253,7 @@ fsal_status_t mdcache_write(struct fsal_obj_handle *obj_hdl, uint64_t offset,
 	if (status.major == ERR_FSAL_DELAY)
 		mdcache_kill_entry(entry);
 	else if (!FSAL_IS_ERROR(status))
-		atomic_clear_uint32_t_bits(&entry->mde_flags,
-					MDCACHE_TRUST_ATTRS);
+		mdc_written(entry);
 
 	return status;
 }
@@ -363,8 +368,7 @@ fsal_status_t mdcache_commit(struct fsal_obj_handle *obj_hdl, off_t offset,
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
 	else
-		atomic_clear_uint32_t_bits(&entry->mde_flags,
-					   MDCACHE_TRUST_ATTRS);
+		mdc_written(entry);
 
 	return status;
 }
@@ -513,8 +517,7 @@ static fsal_status_t mdc_open2_by_name(mdcache_entry_t *mdc_parent,
 			     entry, entry->sub_handle);
 		if (openflags & FSAL_O_TRUNC) {
 			/* Invalidate the attributes since we just truncated. */
-			atomic_clear_uint32_t_bits(&entry->mde_flags,
-						   MDCACHE_TRUST_ATTRS);
+			mdc_written(entry);
 		}
 		*new_entry = entry;
 	}
@@ -629,8 +632,7 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 				 * will refresh the attributes on the next
 				 * getattrs.
 				 */
-				atomic_clear_uint32_t_bits(
-				    &new_entry->mde_flags, MDCACHE_TRUST_ATTRS);
+				mdc_written(new_entry);
 			}
 
 			return status;
@@ -650,9 +652,8 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 	 * attributes.
 	 */
 	fsal_prepare_attrs(&attrs,
-			   (op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				& ~ATTR_ACL) | ATTR_RDATTR_ERR);
+			   (mdc_supported_attrs() & ~ATTR_ACL) |
+			   ATTR_RDATTR_ERR);
 
 	subcall(
 		status = mdc_parent->sub_handle->obj_ops.open2(
@@ -696,7 +697,8 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&mdc_parent->content_lock);
+	if (createmode != FSAL_NO_CREATE)
+		mdc_quota_created(export, &attrs);
 
 	/* We will invalidate parent attrs if we did any form of create. */
 	status = mdcache_alloc_and_check_handle(export, sub_handle,
@@ -704,9 +706,7 @@ fsal_status_t mdcache_open2(struct fsal_obj_handle *obj_hdl,
 						&attrs, attrs_out,
 						"open2 ", mdc_parent, name,
 						createmode != FSAL_NO_CREATE,
-						state);
-
-	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
+						false, state);
 
 	fsal_release_attrs(&attrs);
 
@@ -789,8 +789,7 @@ fsal_status_t mdcache_reopen2(struct fsal_obj_handle *obj_hdl,
 		mdcache_kill_entry(entry);
 
 	if (truncated && !FSAL_IS_ERROR(status)) {
-		atomic_clear_uint32_t_bits(&entry->mde_flags,
-					   MDCACHE_TRUST_ATTRS);
+		mdc_written(entry);
 	}
 
 	return status;
@@ -826,11 +825,25 @@ fsal_status_t mdcache_read2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
-	subcall(
-		status = entry->sub_handle->obj_ops.read2(
-			entry->sub_handle, bypass, state, offset, buf_size,
-			buffer, read_amount, eof, info)
-	       );
+	mdc_hot_record(entry, MDC_HOT_READ, NULL, NULL);
+
+	/* The read must see the writes gathered */
+	(void) mdc_wgather_flush(entry, false);
+
+	if (info == NULL &&
+	    mdc_rahead_read(entry, bypass, state, offset, buf_size, buffer,
+			    read_amount, eof)) {
+		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	} else {
+		subcall(
+			status = entry->sub_handle->obj_ops.read2(
+				entry->sub_handle, bypass, state, offset,
+				buf_size, buffer, read_amount, eof, info)
+		       );
+	}
+
+	if (state == NULL)
+		mdcache_lru_fd_touch(entry);
 
 	if (!FSAL_IS_ERROR(status))
 		mdc_set_time_current(&entry->attrs.atime);
@@ -869,18 +882,58 @@ fsal_status_t mdcache_write2(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
+	bool group = false;
+
+	mdc_hot_record(entry, MDC_HOT_WRITE, NULL, NULL);
+
+	mdc_rahead_drop(entry);
 
+	mdc_quota_write(entry, offset, buf_size);
+
+	if (mdc_wgather_write(entry, bypass, state, offset, buf_size, buffer,
+			      *fsal_stable, info, &status)) {
+		if (!FSAL_IS_ERROR(status)) {
+			*write_amount = buf_size;
+			*fsal_stable = false;
+		}
+		goto out;
+	}
+
+	status = mdc_wgather_flush(entry, true);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	/* A FILE_SYNC write is committed along with concurrent ones */
+	if (*fsal_stable && info == NULL && mdc_gcommit_stable(entry)) {
+		group = true;
+		*fsal_stable = false;
+	}
+
+again:
 	subcall(
 		status = entry->sub_handle->obj_ops.write2(
 			entry->sub_handle, bypass, state, offset, buf_size,
 			buffer, write_amount, fsal_stable, info)
 	       );
 
+	if (group && !FSAL_IS_ERROR(status) && !*fsal_stable) {
+		status = mdc_gcommit(entry, offset, *write_amount);
+		*fsal_stable = true;
+		if (status.major == ERR_FSAL_NOTSUPP) {
+			/* No commit2(), have the write itself be stable */
+			group = false;
+			goto again;
+		}
+	}
+
+	if (state == NULL)
+		mdcache_lru_fd_touch(entry);
+
+out:
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
 	else
-		atomic_clear_uint32_t_bits(&entry->mde_flags,
-					   MDCACHE_TRUST_ATTRS);
+		mdc_written(entry);
 
 	return status;
 }
@@ -903,6 +956,8 @@ fsal_status_t mdcache_seek2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	(void) mdc_wgather_flush(entry, false);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.seek2(
 			entry->sub_handle, state, info)
@@ -960,16 +1015,18 @@ fsal_status_t mdcache_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
-	subcall(
-		status = entry->sub_handle->obj_ops.commit2(
-			entry->sub_handle, offset, len)
-	       );
+	/* What was gathered, or failed to be written, is not committed */
+	status = mdc_wgather_flush(entry, true);
+
+	if (!FSAL_IS_ERROR(status))
+		status = mdc_gcommit(entry, offset, len);
+
+	mdcache_lru_fd_touch(entry);
 
 	if (status.major == ERR_FSAL_STALE)
 		mdcache_kill_entry(entry);
 	else
-		atomic_clear_uint32_t_bits(&entry->mde_flags,
-					   MDCACHE_TRUST_ATTRS);
+		mdc_written(entry);
 
 	return status;
 }
@@ -1021,11 +1078,20 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	fsal_status_t status;
 
+	/* An error is kept for the next COMMIT */
+	(void) mdc_wgather_flush(entry, false);
+	mdc_rahead_drop(entry);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.close2(
 			  entry->sub_handle, state)
 	       );
 
+	/* The sub-FSAL may keep the fd open for the next open, let the fd
+	 * reaper close it once the file goes cold.
+	 */
+	mdcache_lru_fd_touch(entry);
+
 	if ((entry->mde_flags & MDCACHE_UNREACHABLE) &&
 	    !mdc_has_state(entry)) {
 		/* Entry was marked unreachable, and last state is gone */
@@ -1034,3 +1100,429 @@ fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 
 	return status;
 }
+
+/**
+ * @brief Context for an asynchronous I/O passed through MDCACHE
+ */
+struct mdc_async_arg {
+	mdcache_entry_t *entry;	/*< Entry the I/O is on */
+	fsal_async_cb done_cb;	/*< Caller's completion callback */
+	void *caller_arg;	/*< Caller's callback argument */
+	bool is_write;		/*< true if write or commit */
+};
+
+/**
+ * @brief Completion callback for asynchronous I/O
+ *
+ * Do the same post-processing as the synchronous versions and call back the
+ * upper layer.  This may be called from a thread that does not have an
+ * op_ctx.
+ *
+ * @param[in] sub_hdl		Sub-FSAL handle the I/O was done on
+ * @param[in] status		Status of the I/O
+ * @param[in] obj_data		struct fsal_io_arg of the I/O (or NULL)
+ * @param[in] caller_data	Our struct mdc_async_arg
+ */
+static void mdc_async_cb(struct fsal_obj_handle *sub_hdl, fsal_status_t status,
+			 void *obj_data, void *caller_data)
+{
+	struct mdc_async_arg *arg = caller_data;
+	mdcache_entry_t *entry = arg->entry;
+
+	if (arg->is_write) {
+		if (status.major == ERR_FSAL_STALE)
+			mdcache_kill_entry(entry);
+		else
+			mdc_written(entry);
+	} else {
+		if (!FSAL_IS_ERROR(status))
+			mdc_set_time_current(&entry->attrs.atime);
+		else if (status.major == ERR_FSAL_DELAY)
+			mdcache_kill_entry(entry);
+	}
+
+	arg->done_cb(&entry->obj_handle, status, obj_data, arg->caller_arg);
+
+	gsh_free(arg);
+}
+
+static struct mdc_async_arg *mdc_async_arg_init(mdcache_entry_t *entry,
+						fsal_async_cb done_cb,
+						void *caller_arg,
+						bool is_write)
+{
+	struct mdc_async_arg *arg = gsh_malloc(sizeof(*arg));
+
+	arg->entry = entry;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+	arg->is_write = is_write;
+
+	return arg;
+}
+
+/**
+ * @brief Read from a file asynchronously
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl		Object to read from
+ * @param[in] bypass		Bypass deny read
+ * @param[in] done_cb		Callback to call when done
+ * @param[in,out] read_arg	Info about the read
+ * @param[in] caller_arg	Opaque arg for callback
+ */
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *read_arg,
+			 void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg =
+		mdc_async_arg_init(entry, done_cb, caller_arg, false);
+
+	mdc_hot_record(entry, MDC_HOT_READ, NULL, NULL);
+
+	if (read_arg->state == NULL)
+		mdcache_lru_fd_touch(entry);
+
+	(void) mdc_wgather_flush(entry, false);
+
+	if (read_arg->info == NULL &&
+	    mdc_rahead_read(entry, bypass, read_arg->state, read_arg->offset,
+			    read_arg->buffer_size, read_arg->buffer,
+			    &read_arg->io_amount, &read_arg->end_of_file)) {
+		mdc_async_cb(entry->sub_handle, fsalstat(ERR_FSAL_NO_ERROR, 0),
+			     read_arg, arg);
+		return;
+	}
+
+	subcall(
+		entry->sub_handle->obj_ops.read2_async(
+			entry->sub_handle, bypass, mdc_async_cb, read_arg, arg)
+	       );
+}
+
+/**
+ * @brief Write to a file asynchronously
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl		Object to write to
+ * @param[in] bypass		Bypass any non-mandatory deny write
+ * @param[in] done_cb		Callback to call when done
+ * @param[in,out] write_arg	Info about the write
+ * @param[in] caller_arg	Opaque arg for callback
+ */
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  fsal_async_cb done_cb,
+			  struct fsal_io_arg *write_arg,
+			  void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg =
+		mdc_async_arg_init(entry, done_cb, caller_arg, true);
+	fsal_status_t status;
+
+	mdc_hot_record(entry, MDC_HOT_WRITE, NULL, NULL);
+
+	mdc_rahead_drop(entry);
+
+	mdc_quota_write(entry, write_arg->offset, write_arg->buffer_size);
+
+	if (mdc_wgather_write(entry, bypass, write_arg->state,
+			      write_arg->offset, write_arg->buffer_size,
+			      write_arg->buffer, write_arg->fsal_stable,
+			      write_arg->info, &status)) {
+		if (!FSAL_IS_ERROR(status)) {
+			write_arg->io_amount = write_arg->buffer_size;
+			write_arg->fsal_stable = false;
+		}
+		mdc_async_cb(entry->sub_handle, status, write_arg, arg);
+		return;
+	}
+
+	status = mdc_wgather_flush(entry, true);
+	if (FSAL_IS_ERROR(status)) {
+		mdc_async_cb(entry->sub_handle, status, write_arg, arg);
+		return;
+	}
+
+	if (write_arg->state == NULL)
+		mdcache_lru_fd_touch(entry);
+
+	subcall(
+		entry->sub_handle->obj_ops.write2_async(
+			entry->sub_handle, bypass, mdc_async_cb, write_arg, arg)
+	       );
+}
+
+/**
+ * @brief Commit to a file asynchronously
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl		Object to commit
+ * @param[in] offset		Offset into file
+ * @param[in] len		Length of commit
+ * @param[in] done_cb		Callback to call when done
+ * @param[in] caller_arg	Opaque arg for callback
+ */
+void mdcache_commit2_async(struct fsal_obj_handle *obj_hdl,
+			   off_t offset,
+			   size_t len,
+			   fsal_async_cb done_cb,
+			   void *caller_arg)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdc_async_arg *arg =
+		mdc_async_arg_init(entry, done_cb, caller_arg, true);
+	fsal_status_t status;
+
+	mdcache_lru_fd_touch(entry);
+
+	status = mdc_wgather_flush(entry, true);
+	if (FSAL_IS_ERROR(status)) {
+		mdc_async_cb(entry->sub_handle, status, NULL, arg);
+		return;
+	}
+
+	subcall(
+		entry->sub_handle->obj_ops.commit2_async(
+			entry->sub_handle, offset, len, mdc_async_cb, arg)
+	       );
+}
+
+/**
+ * @brief Read from a file into a scatter list
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass deny read
+ * @param[in] state	Open file state to read
+ * @param[in] offset	Offset into file
+ * @param[in] iov_count	Number of segments
+ * @param[in,out] iov	Segments to read into
+ * @param[out] read_amount	Amount read in bytes
+ * @param[out] eof	true if End of File was hit
+ * @param[in] info	io_info for READ_PLUS
+ * @return FSAL status
+ */
+fsal_status_t mdcache_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    int iov_count,
+			    struct iovec *iov,
+			    size_t *read_amount,
+			    bool *eof,
+			    struct io_info *info)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	mdc_hot_record(entry, MDC_HOT_READ, NULL, NULL);
+
+	(void) mdc_wgather_flush(entry, false);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.readv2(
+			entry->sub_handle, bypass, state, offset, iov_count,
+			iov, read_amount, eof, info)
+	       );
+
+	if (state == NULL)
+		mdcache_lru_fd_touch(entry);
+
+	if (!FSAL_IS_ERROR(status))
+		mdc_set_time_current(&entry->attrs.atime);
+	else if (status.major == ERR_FSAL_DELAY)
+		mdcache_kill_entry(entry);
+
+	return status;
+}
+
+/**
+ * @brief Write to a file from a gather list
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] obj_hdl	Object owning state
+ * @param[in] bypass	Bypass any non-mandatory deny write
+ * @param[in] state	Open file state to write
+ * @param[in] offset	Offset into file
+ * @param[in] iov_count	Number of segments
+ * @param[in] iov	Segments to write from
+ * @param[out] write_amount	Amount written in bytes
+ * @param[out] fsal_stable	true if write was to stable storage
+ * @param[in] info	io_info for WRITE_PLUS
+ * @return FSAL status
+ */
+fsal_status_t mdcache_writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     int iov_count,
+			     struct iovec *iov,
+			     size_t *write_amount,
+			     bool *fsal_stable,
+			     struct io_info *info)
+{
+	mdcache_entry_t *entry =
+		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+	bool group = false;
+	size_t len = 0;
+	int i;
+
+	mdc_hot_record(entry, MDC_HOT_WRITE, NULL, NULL);
+
+	mdc_rahead_drop(entry);
+
+	for (i = 0; i < iov_count; i++)
+		len += iov[i].iov_len;
+	mdc_quota_write(entry, offset, len);
+
+	status = mdc_wgather_flush(entry, true);
+	if (FSAL_IS_ERROR(status))
+		goto out;
+
+	/* A FILE_SYNC write is committed along with concurrent ones */
+	if (*fsal_stable && info == NULL && mdc_gcommit_stable(entry)) {
+		group = true;
+		*fsal_stable = false;
+	}
+
+again:
+	subcall(
+		status = entry->sub_handle->obj_ops.writev2(
+			entry->sub_handle, bypass, state, offset, iov_count,
+			iov, write_amount, fsal_stable, info)
+	       );
+
+	if (group && !FSAL_IS_ERROR(status) && !*fsal_stable) {
+		status = mdc_gcommit(entry, offset, *write_amount);
+		*fsal_stable = true;
+		if (status.major == ERR_FSAL_NOTSUPP) {
+			/* No commit2(), have the write itself be stable */
+			group = false;
+			goto again;
+		}
+	}
+
+	if (state == NULL)
+		mdcache_lru_fd_touch(entry);
+
+out:
+	if (status.major == ERR_FSAL_STALE)
+		mdcache_kill_entry(entry);
+	else
+		mdc_written(entry);
+
+	return status;
+}
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] src_hdl	File to copy from
+ * @param[in] src_state	Open file state to read
+ * @param[in] src_offset	Offset into the source
+ * @param[in] dst_hdl	File to copy to
+ * @param[in] dst_state	Open file state to write
+ * @param[in] dst_offset	Offset into the destination
+ * @param[in] count	Bytes to copy, 0 for up to the end of the source
+ * @param[out] copied	Bytes copied
+ * @return FSAL status
+ */
+fsal_status_t mdcache_copy2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count,
+			    uint64_t *copied)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	(void) mdc_wgather_flush(src, false);
+	(void) mdc_wgather_flush(dst, false);
+	mdc_rahead_drop(dst);
+
+	subcall(
+		status = src->sub_handle->obj_ops.copy2(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count, copied)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(src);
+		mdcache_kill_entry(dst);
+	} else {
+		mdc_written(dst);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Share a range of one file with another
+ *
+ * Delegate to sub-FSAL
+ *
+ * @param[in] src_hdl	File to clone from
+ * @param[in] src_state	Open file state to read
+ * @param[in] src_offset	Offset into the source
+ * @param[in] dst_hdl	File to clone to
+ * @param[in] dst_state	Open file state to write
+ * @param[in] dst_offset	Offset into the destination
+ * @param[in] count	Bytes to clone, 0 for up to the end of the source
+ * @return FSAL status
+ */
+fsal_status_t mdcache_clone2(struct fsal_obj_handle *src_hdl,
+			     struct state_t *src_state,
+			     uint64_t src_offset,
+			     struct fsal_obj_handle *dst_hdl,
+			     struct state_t *dst_state,
+			     uint64_t dst_offset,
+			     uint64_t count)
+{
+	mdcache_entry_t *src =
+		container_of(src_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *dst =
+		container_of(dst_hdl, mdcache_entry_t, obj_handle);
+	fsal_status_t status;
+
+	(void) mdc_wgather_flush(src, false);
+	(void) mdc_wgather_flush(dst, false);
+	mdc_rahead_drop(dst);
+
+	subcall(
+		status = src->sub_handle->obj_ops.clone2(
+			src->sub_handle, src_state, src_offset,
+			dst->sub_handle, dst_state, dst_offset, count)
+	       );
+
+	if (status.major == ERR_FSAL_STALE) {
+		mdcache_kill_entry(src);
+		mdcache_kill_entry(dst);
+	} else {
+		mdc_written(dst);
+	}
+
+	return status;
+}
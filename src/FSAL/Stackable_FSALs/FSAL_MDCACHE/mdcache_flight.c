@@ -0,0 +1,178 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_flight.c
+ * @brief Coalescing of cache misses by key
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "gsh_list.h"
+#include "mdcache_int.h"
+#include "mdcache_flight.h"
+
+#include <pthread.h>
+
+/** Number of lists the flights are hashed over */
+#define FLIGHT_PARTITIONS 64
+
+struct mdc_flight {
+	struct glist_head link;	/*< On the list of its partition */
+	const mdcache_key_t *key;	/*< The leader's, until landed */
+	pthread_cond_t cond;	/*< Signalled on landing */
+	uint32_t refs;		/*< The leader and those waiting */
+	bool landed;		/*< The leader is done */
+	fsal_status_t status;	/*< What the leader got */
+};
+
+struct flight_partition {
+	pthread_mutex_t mtx;
+	struct glist_head flights;
+	GSH_CACHE_PAD(0);
+};
+
+static struct flight_partition flight_part[FLIGHT_PARTITIONS];
+
+static inline struct flight_partition *
+flight_partition(const mdcache_key_t *key)
+{
+	return &flight_part[key->hk % FLIGHT_PARTITIONS];
+}
+
+/* Called with the partition locked */
+static void flight_put(struct mdc_flight *flight)
+{
+	if (--flight->refs != 0)
+		return;
+
+	PTHREAD_COND_destroy(&flight->cond);
+	gsh_free(flight);
+}
+
+/**
+ * @brief Take the flight for a key, or wait for the one in the air
+ *
+ * @param[in]  key     Key that missed the cache
+ * @param[out] status  What the leader got, when waited for
+ *
+ * @return The flight to land with mdc_flight_land once the entry is
+ *         cached, or NULL after waiting for another thread's.
+ */
+struct mdc_flight *mdc_flight_take(const mdcache_key_t *key,
+				   fsal_status_t *status)
+{
+	struct flight_partition *part = flight_partition(key);
+	struct mdc_flight *flight;
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	glist_for_each(glist, &part->flights) {
+		flight = glist_entry(glist, struct mdc_flight, link);
+		if (mdcache_key_cmp(flight->key, key) != 0)
+			continue;
+
+		flight->refs++;
+		while (!flight->landed)
+			pthread_cond_wait(&flight->cond, &part->mtx);
+		*status = flight->status;
+		flight_put(flight);
+
+		PTHREAD_MUTEX_unlock(&part->mtx);
+
+		(void) atomic_inc_uint64_t(&cache_stp->miss_coalesced);
+		return NULL;
+	}
+
+	flight = gsh_calloc(1, sizeof(*flight));
+	flight->key = key;
+	flight->refs = 1;
+	PTHREAD_COND_init(&flight->cond, NULL);
+	glist_add_tail(&part->flights, &flight->link);
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	return flight;
+}
+
+/**
+ * @brief Land a flight, waking those waiting for it
+ *
+ * @param[in] flight  Flight taken by mdc_flight_take
+ * @param[in] status  Status of the miss
+ */
+void mdc_flight_land(struct mdc_flight *flight, fsal_status_t status)
+{
+	struct flight_partition *part = flight_partition(flight->key);
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	glist_del(&flight->link);
+	flight->key = NULL;
+	flight->landed = true;
+	flight->status = status;
+	pthread_cond_broadcast(&flight->cond);
+	flight_put(flight);
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
+
+/**
+ * @brief Set up the flight lists
+ *
+ * @return 0.
+ */
+int mdcache_flight_pkginit(void)
+{
+	int i;
+
+	for (i = 0; i < FLIGHT_PARTITIONS; ++i) {
+		PTHREAD_MUTEX_init(&flight_part[i].mtx, NULL);
+		glist_init(&flight_part[i].flights);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Tear down the flight lists
+ */
+void mdcache_flight_pkgshutdown(void)
+{
+	int i;
+
+	for (i = 0; i < FLIGHT_PARTITIONS; ++i)
+		PTHREAD_MUTEX_destroy(&flight_part[i].mtx);
+}
+
+/** @} */
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_flight.h
+ * @brief Coalescing of cache misses by key
+ *
+ * When a handle is not cached, the first thread to miss it takes a
+ * flight for its key and asks the sub-FSAL for it; those missing the
+ * same key meanwhile wait for that flight to land and look in the
+ * cache again, instead of each asking the sub-FSAL.  After a restart,
+ * clients come back with the same hot handles at once.
+ *
+ * Misses by name need nothing of the kind: the lookup holds the content
+ * lock of the directory for write, and whoever waited for it finds the
+ * dirent the first one added.
+ */
+
+#ifndef MDCACHE_FLIGHT_H
+#define MDCACHE_FLIGHT_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+struct mdc_flight;
+
+int mdcache_flight_pkginit(void);
+void mdcache_flight_pkgshutdown(void);
+
+struct mdc_flight *mdc_flight_take(const mdcache_key_t *key,
+				   fsal_status_t *status);
+void mdc_flight_land(struct mdc_flight *flight, fsal_status_t status);
+
+#endif /* MDCACHE_FLIGHT_H */
+
+/** @} */
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_gcommit.c
+ * @brief Group commit of COMMITs and FILE_SYNC writes
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "mdcache_int.h"
+#include "mdcache_gcommit.h"
+
+#include <unistd.h>
+#include <pthread.h>
+
+/**
+ * @brief Commits of a file
+ *
+ * Everything is protected by mtx.  Each commit takes a ticket; a flush
+ * started once tickets up to N were handed out answers them all.
+ */
+
+struct mdc_gcommit {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;		/*< Signalled when a flush ends */
+	uint64_t queued;		/*< Last ticket handed out */
+	uint64_t done;			/*< Last ticket a flush answered */
+	uint64_t lo;			/*< Range asked since the flush */
+	uint64_t hi;			/*< started, UINT64_MAX for EOF */
+	bool running;			/*< A flush is in progress */
+	bool notsupp;			/*< The FSAL has no commit2() */
+	fsal_status_t status;		/*< Of the last flush */
+};
+
+static struct mdc_gcommit *mdc_gcommit_get(mdcache_entry_t *entry)
+{
+	struct mdc_gcommit *gc;
+
+	gc = atomic_fetch_voidptr((void **)&entry->gcommit);
+	if (gc != NULL)
+		return gc;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	gc = entry->gcommit;
+	if (gc == NULL) {
+		gc = gsh_calloc(1, sizeof(*gc));
+		PTHREAD_MUTEX_init(&gc->mtx, NULL);
+		PTHREAD_COND_init(&gc->cond, NULL);
+		gc->lo = UINT64_MAX;
+		atomic_store_voidptr((void **)&entry->gcommit, gc);
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	return gc;
+}
+
+/**
+ * @brief Commit a range of a file, along with concurrent commits
+ *
+ * @param[in] entry   The file
+ * @param[in] offset  Start of the range
+ * @param[in] len     Length of the range, 0 for to the end of file
+ *
+ * @return Status of the flush that covered the range.
+ */
+
+fsal_status_t mdc_gcommit(mdcache_entry_t *entry, uint64_t offset,
+			  size_t len)
+{
+	struct mdc_gcommit *gc;
+	fsal_status_t status;
+	uint64_t ticket, upto, lo, hi;
+	uint64_t end = len == 0 ? UINT64_MAX : offset + len;
+
+	if (!mdcache_param.gcommit.enable) {
+		subcall(
+			status = entry->sub_handle->obj_ops.commit2(
+				entry->sub_handle, offset, len)
+		       );
+		return status;
+	}
+
+	gc = mdc_gcommit_get(entry);
+
+	PTHREAD_MUTEX_lock(&gc->mtx);
+
+	ticket = ++gc->queued;
+	if (offset < gc->lo)
+		gc->lo = offset;
+	if (end > gc->hi)
+		gc->hi = end;
+
+	while (gc->done < ticket) {
+		if (gc->running) {
+			pthread_cond_wait(&gc->cond, &gc->mtx);
+			continue;
+		}
+
+		/* Lead the next flush, for whoever queued by then */
+		gc->running = true;
+		if (mdcache_param.gcommit.delay != 0) {
+			PTHREAD_MUTEX_unlock(&gc->mtx);
+			usleep(mdcache_param.gcommit.delay);
+			PTHREAD_MUTEX_lock(&gc->mtx);
+		}
+
+		upto = gc->queued;
+		lo = gc->lo;
+		hi = gc->hi;
+		gc->lo = UINT64_MAX;
+		gc->hi = 0;
+
+		PTHREAD_MUTEX_unlock(&gc->mtx);
+
+		subcall(
+			status = entry->sub_handle->obj_ops.commit2(
+				entry->sub_handle, lo,
+				hi == UINT64_MAX ? 0 : hi - lo)
+		       );
+
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "Committed %" PRIu64 " requests to %p: %s",
+			     upto - gc->done, entry, fsal_err_txt(status));
+
+		PTHREAD_MUTEX_lock(&gc->mtx);
+
+		(void)atomic_add_uint64_t(&cache_stp->commit_merged,
+					  upto - gc->done - 1);
+		if (status.major == ERR_FSAL_NOTSUPP)
+			gc->notsupp = true;
+		gc->status = status;
+		gc->done = upto;
+		gc->running = false;
+		pthread_cond_broadcast(&gc->cond);
+	}
+
+	/* A later flush than ours started after our request too */
+	status = gc->status;
+
+	PTHREAD_MUTEX_unlock(&gc->mtx);
+
+	return status;
+}
+
+/**
+ * @brief Whether a FILE_SYNC write to a file should be group committed
+ *
+ * Not if group commit is off, or the FSAL was found to have no commit.
+ *
+ * @param[in] entry  The file
+ */
+
+bool mdc_gcommit_stable(mdcache_entry_t *entry)
+{
+	struct mdc_gcommit *gc;
+
+	if (!mdcache_param.gcommit.enable)
+		return false;
+
+	gc = atomic_fetch_voidptr((void **)&entry->gcommit);
+
+	/* Set once, and only read here */
+	return gc == NULL || !gc->notsupp;
+}
+
+/**
+ * @brief Free what commits an entry being cleaned
+ *
+ * @param[in] entry  The entry
+ */
+
+void mdc_gcommit_free(mdcache_entry_t *entry)
+{
+	struct mdc_gcommit *gc = entry->gcommit;
+
+	if (gc == NULL)
+		return;
+
+	PTHREAD_COND_destroy(&gc->cond);
+	PTHREAD_MUTEX_destroy(&gc->mtx);
+	gsh_free(gc);
+	entry->gcommit = NULL;
+}
+
+/** @} */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_gcommit.h
+ * @brief Group commit of COMMITs and FILE_SYNC writes
+ *
+ * With Group_Commit set, commits of a file that arrive while one is
+ * being flushed wait for it to finish, and are then flushed together,
+ * by one of them, with one commit2() over the union of their ranges.
+ * All of them get the status of that flush.  FILE_SYNC writes are
+ * written UNSTABLE and committed the same way.
+ */
+
+#ifndef MDCACHE_GCOMMIT_H
+#define MDCACHE_GCOMMIT_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+fsal_status_t mdc_gcommit(mdcache_entry_t *entry, uint64_t offset,
+			  size_t len);
+bool mdc_gcommit_stable(mdcache_entry_t *entry);
+void mdc_gcommit_free(mdcache_entry_t *entry);
+
+#endif /* MDCACHE_GCOMMIT_H */
+
+/** @} */
@@ -42,6 +42,15 @@
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
 #include "mdcache_avl.h"
+#include "mdcache_wgather.h"
+#include "mdcache_rahead.h"
+#include "mdcache_hot.h"
+#include "mdcache_bus.h"
+#include "mdcache_quota.h"
+#include "city.h"
+
+/** Most entries whose attributes readdir refreshes in one sub-FSAL call */
+#define MDC_READDIR_ATTR_BATCH 32
 
 /*
  * handle methods
@@ -53,7 +62,8 @@
  * This function is a wrapper of mdcache_alloc_handle. It adds error checking
  * and logging. It also cleans objects allocated in the subfsal if it fails.
  *
- * @note the caller must hold the content lock on the parent.
+ * @note the caller must hold the content lock on the parent for write if
+ * @a locked, and must not hold it otherwise.
  *
  * This does not cause an ABBA lock conflict with the potential getattrs
  * if we lose a race to create the cache entry since our caller CAN NOT hold
@@ -69,6 +79,7 @@
  * @param[in]     parent         Parent directory to add dirent to.
  * @param[in]     name           Name of the dirent to add.
  * @param[in]     invalidate     Invalidate parent attr.
+ * @param[in]     locked         The parent's content lock is held.
  * @param[in]     state          Optional state_t representing open file.
  *
  * @note This returns an INITIAL ref'd entry on success
@@ -86,6 +97,7 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		mdcache_entry_t *parent,
 		const char *name,
 		bool invalidate,
+		bool locked,
 		struct state_t *state)
 {
 	fsal_status_t status;
@@ -110,9 +122,16 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		 */
 		atomic_clear_uint32_t_bits(&parent->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_bus_publish(parent, FSAL_UP_INVALIDATE_ATTRS |
+					FSAL_UP_INVALIDATE_CONTENT);
 	}
 
-	status = mdcache_dirent_add(parent, name, new_entry);
+	if (locked)
+		status = mdcache_dirent_add(parent, name, new_entry,
+					    invalidate);
+	else
+		status = mdcache_dirent_add_shared(parent, name, new_entry,
+						   invalidate);
 
 	if (FSAL_IS_ERROR(status)) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -124,7 +143,7 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		return status;
 	}
 
-	if (new_entry->obj_handle.type == DIRECTORY) {
+	if (locked && new_entry->obj_handle.type == DIRECTORY) {
 		/* Insert Parent's key */
 		mdc_dir_add_parent(new_entry, parent);
 	}
@@ -165,12 +184,78 @@ static fsal_status_t mdcache_lookup(struct fsal_obj_handle *parent,
 	*handle = NULL;
 
 	status = mdc_lookup(mdc_parent, name, true, &entry, attrs_out);
-	if (entry)
+	if (entry) {
+		mdc_hot_record(entry, MDC_HOT_LOOKUP, mdc_parent, name);
 		*handle = &entry->obj_handle;
+	}
 
 	return status;
 }
 
+/**
+ * @brief Look up several names from the cached dirents
+ *
+ * Each directory is searched under its content lock for read only, and
+ * the intermediate objects get no attribute fetch.  Stops at the first
+ * name that is not cached, or that is in an object the caller may not
+ * search, leaving it to lookup.
+ *
+ * @param[in]  dir_hdl Directory to start from
+ * @param[in]  count   Number of names
+ * @param[in]  names   Names to look up
+ * @param[out] done    Number of names resolved
+ * @param[out] handle  Object of the last name resolved
+ *
+ * @return FSAL status, always success.
+ */
+static fsal_status_t mdcache_lookup_components(struct fsal_obj_handle *dir_hdl,
+					       unsigned int count,
+					       const char **names,
+					       unsigned int *done,
+					       struct fsal_obj_handle **handle)
+{
+	mdcache_entry_t *dir =
+		container_of(dir_hdl, mdcache_entry_t, obj_handle);
+	mdcache_entry_t *entry;
+	fsal_accessflags_t access_mask =
+	    (FSAL_MODE_MASK_SET(FSAL_X_OK) |
+	     FSAL_ACE4_MASK_SET(FSAL_ACE_PERM_EXECUTE));
+	fsal_status_t status;
+	unsigned int i;
+
+	*handle = NULL;
+
+	for (i = 0; i < count; i++) {
+		if (dir->obj_handle.type != DIRECTORY ||
+		    !strcmp(names[i], ".") || !strcmp(names[i], ".."))
+			break;
+
+		/* Takes the attr_lock, not under the content_lock */
+		status = fsal_access(&dir->obj_handle, access_mask, NULL, NULL);
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		PTHREAD_RWLOCK_rdlock(&dir->content_lock);
+		status = mdc_try_get_cached(dir, names[i], &entry);
+		PTHREAD_RWLOCK_unlock(&dir->content_lock);
+
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		mdc_hot_record(entry, MDC_HOT_LOOKUP, dir, names[i]);
+
+		if (i != 0)
+			mdcache_put(dir);
+		dir = entry;
+	}
+
+	if (i != 0)
+		*handle = &dir->obj_handle;
+	*done = i;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /**
  * @brief Create a file
  *
@@ -199,9 +284,7 @@ static fsal_status_t mdcache_create(struct fsal_obj_handle *dir_hdl,
 	 * until asked for it (including a permission check).
 	 */
 	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+			   mdc_supported_attrs() & ~ATTR_ACL);
 
 	subcall_raw(export,
 		status = parent->sub_handle->obj_ops.create(
@@ -225,14 +308,10 @@ static fsal_status_t mdcache_create(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
-
 	status = mdcache_alloc_and_check_handle(export, sub_handle, new_obj,
 						false, &attrs, attrs_out,
 						"create ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -269,9 +348,7 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 	 * until asked for it (including a permission check).
 	 */
 	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+			   mdc_supported_attrs() & ~ATTR_ACL);
 
 	subcall_raw(export,
 		status = parent->sub_handle->obj_ops.mkdir(
@@ -295,14 +372,12 @@ static fsal_status_t mdcache_mkdir(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+	mdc_quota_created(export, &attrs);
 
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						true, &attrs, attrs_out,
 						"mkdir ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -341,9 +416,7 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 	 * until asked for it (including a permission check).
 	 */
 	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+			   mdc_supported_attrs() & ~ATTR_ACL);
 
 	subcall_raw(export,
 		status = parent->sub_handle->obj_ops.mknode(
@@ -368,14 +441,12 @@ static fsal_status_t mdcache_mknode(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+	mdc_quota_created(export, &attrs);
 
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"mknode ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -414,9 +485,7 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 	 * until asked for it (including a permission check).
 	 */
 	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+			   mdc_supported_attrs() & ~ATTR_ACL);
 
 	subcall_raw(export,
 		status = parent->sub_handle->obj_ops.symlink(
@@ -441,14 +510,12 @@ static fsal_status_t mdcache_symlink(struct fsal_obj_handle *dir_hdl,
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+	mdc_quota_created(export, &attrs);
 
 	status = mdcache_alloc_and_check_handle(export, sub_handle, handle,
 						false, &attrs, attrs_out,
 						"symlink ", parent, name, true,
-						NULL);
-
-	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+						false, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -497,55 +564,323 @@ static fsal_status_t mdcache_readlink(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief Move freshly fetched attributes into an entry
+ *
+ * Consumes @a attrs, retaining the entry's ACL if it was not fetched.
+ *
+ * @note The caller must hold the attr_lock for write
+ *
+ * @param[in] entry	Entry to update
+ * @param[in] attrs	Attributes fetched from the sub-FSAL
+ * @param[in] need_acl	The ACL was fetched
+ */
+static void mdc_update_attrs(mdcache_entry_t *entry, struct attrlist *attrs,
+			     bool need_acl)
+{
+	uint64_t acl_size = mdc_acl_size(entry->attrs.acl);
+
+	if (entry->attrs.acl != NULL) {
+		/* We used to have an ACL... */
+		if (need_acl) {
+			/* We requested update of an existing ACL, release the
+			 * old one.
+			 */
+			nfs4_acl_release_entry(entry->attrs.acl);
+		} else {
+			/* The ACL wasn't requested, move it into the
+			 * new attributes so we will retain it and make
+			 * it such that the entry attrs DO request the
+			 * ACL.
+			 */
+			attrs->acl = entry->attrs.acl;
+			attrs->valid_mask |= ATTR_ACL;
+			entry->attrs.request_mask |= ATTR_ACL;
+		}
+
+		/* ACL was released or moved to new attributes. */
+		entry->attrs.acl = NULL;
+	}
+
+	if (attrs->expire_time_attr == 0) {
+		/* FSAL did not set this, retain what was in the entry,
+		 * adapted to how much the file changed since. */
+		attrs->expire_time_attr = mdc_adapt_attr_ttl(entry, attrs);
+	}
+
+	/* Now move the new attributes into the entry. */
+	fsal_copy_attrs(&entry->attrs, attrs, true);
+	(void)atomic_sub_uint64_t(&cache_stp->mem_acls, acl_size);
+	(void)atomic_add_uint64_t(&cache_stp->mem_acls,
+				  mdc_acl_size(entry->attrs.acl));
+
+	/* Done with the attrs (we didn't need to call this since the
+	 * fsal_copy_attrs preceding consumed all the references, but we
+	 * release them anyway to make it easy to scan the code for correctness.
+	 */
+	fsal_release_attrs(attrs);
+
+	mdc_fixup_md(entry, attrs);
+
+	LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
+		    "attrs ", &entry->attrs, true);
+}
+
+/**
+ * @brief Prepare attributes to refresh an entry with
+ *
+ * The core attributes are always asked for, the times and the ACL only
+ * if some of @a want are in them.
+ *
+ * @param[out] attrs	Attributes to fill
+ * @param[in] want	Attributes needed
+ */
+static void mdc_prepare_attrs(struct attrlist *attrs, attrmask_t want)
+{
+	fsal_prepare_attrs(attrs, mdc_supported_attrs() | ATTR_RDATTR_ERR);
+
+	if (!(want & ATTR_ACL)) {
+		/* Don't request the ACL if not necessary. */
+		attrs->request_mask &= ~ATTR_ACL;
+	}
+
+	if (!(want & MDC_ATTRS_TIMES))
+		attrs->request_mask &= ~MDC_ATTRS_TIMES;
+}
+
+/**
+ * @brief Keep the attributes a modifying operation returned
+ *
+ * Consumes @a attrs, prepared by mdc_prepare_attrs.
+ *
+ * @note The caller must hold the attr_lock for write
+ *
+ * @param[in] entry	Entry to update
+ * @param[in] attrs	Attributes from the sub-FSAL
+ * @param[in] need_acl	The ACL was asked for
+ *
+ * @return true if the sub-FSAL provided them.
+ */
+static bool mdc_take_attrs(mdcache_entry_t *entry, struct attrlist *attrs,
+			   bool need_acl)
+{
+	if (attrs->valid_mask == 0 ||
+	    (attrs->valid_mask & ATTR_RDATTR_ERR) != 0) {
+		fsal_release_attrs(attrs);
+		return false;
+	}
+
+	entry->attrs.request_mask = attrs->request_mask;
+	mdc_update_attrs(entry, attrs, need_acl);
+
+	return true;
+}
+
+/**
+ * @brief Update a directory after a change of its names
+ *
+ * Keeps the attributes the sub-FSAL returned, or has them fetched again.
+ *
+ * @param[in] dir	Directory changed
+ * @param[in] attrs	Its attributes from the sub-FSAL, consumed
+ */
+static void mdc_dir_changed(mdcache_entry_t *dir, struct attrlist *attrs)
+{
+	PTHREAD_RWLOCK_wrlock(&dir->attr_lock);
+
+	if (!mdc_take_attrs(dir, attrs, false))
+		atomic_clear_uint32_t_bits(&dir->mde_flags,
+					   MDCACHE_TRUST_ATTRS);
+
+	PTHREAD_RWLOCK_unlock(&dir->attr_lock);
+
+	mdc_bus_publish(dir, FSAL_UP_INVALIDATE_ATTRS |
+			     FSAL_UP_INVALIDATE_CONTENT);
+}
+
 /**
  * @brief Create a hard link
  *
  * @param[in] obj_hdl	Object to link to.
  * @param[in] destdir_hdl	Destination dirctory into which to link
  * @param[in] name	Name of new link
+ * @param[in,out] destdir_attrs_out	Not filled
  * @return FSAL status
  */
 static fsal_status_t mdcache_link(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_obj_handle *destdir_hdl,
-			      const char *name)
+			      const char *name,
+			      struct attrlist *destdir_attrs_out)
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *dest =
 		container_of(destdir_hdl, mdcache_entry_t, obj_handle);
+	struct attrlist dest_attrs;
 	fsal_status_t status;
 
+	mdc_prepare_attrs(&dest_attrs, MDC_ATTRS_TIMES);
+
 	subcall(
 		status = entry->sub_handle->obj_ops.link(
-			entry->sub_handle, dest->sub_handle, name)
+			entry->sub_handle, dest->sub_handle, name,
+			&dest_attrs)
 	       );
 	if (FSAL_IS_ERROR(status)) {
 		LogFullDebug(COMPONENT_CACHE_INODE,
 			     "link failed %s",
 			     fsal_err_txt(status));
+		fsal_release_attrs(&dest_attrs);
 		return status;
 	}
 
-	PTHREAD_RWLOCK_wrlock(&dest->content_lock);
-
 	/* Add this entry to the directory (also takes an internal ref)
 	 */
-	status = mdcache_dirent_add(dest, name, entry);
-
-	PTHREAD_RWLOCK_unlock(&dest->content_lock);
+	status = mdcache_dirent_add_shared(dest, name, entry, true);
 
 	/* Invalidate attributes, so refresh will be forced */
 	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
-	atomic_clear_uint32_t_bits(&dest->mde_flags, MDCACHE_TRUST_ATTRS);
+	mdc_bus_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
+	mdc_dir_changed(dest, &dest_attrs);
 
 	return status;
 }
 
+/**
+ * @brief Refresh the attributes of the next entries of a readdir
+ *
+ * Fetch, with a single getattrs_bulk call to the sub-FSAL, the attributes of
+ * up to MDC_READDIR_ATTR_BATCH cached entries starting at @a node whose
+ * attributes are no longer valid.  Entries that are not cached are skipped;
+ * looking them up will fetch their attributes anyway.
+ *
+ * @note The caller must hold the content_lock of @a directory
+ *
+ * @param[in] directory	Directory being read
+ * @param[in] chunk	Chunk holding @a node
+ * @param[in] node	First dirent to consider
+ * @param[in] attrmask	Attributes the caller wants
+ *
+ * @return The dirent after the last one considered.
+ */
+static struct glist_head *mdc_readdir_refresh_attrs(mdcache_entry_t *directory,
+						    struct dir_chunk *chunk,
+						    struct glist_head *node,
+						    attrmask_t attrmask)
+{
+	struct {
+		mdcache_entry_t *entry[MDC_READDIR_ATTR_BATCH];
+		struct fsal_obj_handle *sub_handle[MDC_READDIR_ATTR_BATCH];
+		const char *name[MDC_READDIR_ATTR_BATCH];
+		struct attrlist attrs[MDC_READDIR_ATTR_BATCH];
+		fsal_status_t status[MDC_READDIR_ATTR_BATCH];
+	} *batch = NULL;
+	bool need_acl = (attrmask & ATTR_ACL) != 0;
+	unsigned int count = 0;
+	unsigned int seen;
+	unsigned int i;
+
+	for (seen = 0; node != &chunk->dirents &&
+	     seen < MDC_READDIR_ATTR_BATCH; node = node->next, ++seen) {
+		mdcache_dir_entry_t *dirent =
+			glist_entry(node, mdcache_dir_entry_t, chunk_list);
+		mdcache_entry_t *entry;
+		bool valid;
+
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED)
+			continue;
+
+		if (FSAL_IS_ERROR(mdcache_find_keyed(&dirent->ckey, &entry)))
+			continue;
+
+		PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+		valid = mdcache_is_attrs_valid(entry, attrmask);
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+		if (valid) {
+			mdcache_put(entry);
+			continue;
+		}
+
+		if (batch == NULL)
+			batch = gsh_malloc(sizeof(*batch));
+
+		batch->entry[count] = entry;
+		batch->sub_handle[count] = entry->sub_handle;
+		batch->name[count] = dirent->name;
+		mdc_prepare_attrs(&batch->attrs[count],
+				  entry->obj_handle.type == DIRECTORY ?
+				  attrmask | MDC_ATTRS_TIMES : attrmask);
+		++count;
+	}
+
+	if (count == 0)
+		return node;
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "Refreshing attributes of %u entries of dir %p", count,
+		     directory);
+
+	subcall(
+		directory->sub_handle->obj_ops.getattrs_bulk(
+			directory->sub_handle, count, batch->sub_handle,
+			batch->name, batch->attrs, batch->status)
+	       );
+
+	for (i = 0; i < count; i++) {
+		mdcache_entry_t *entry = batch->entry[i];
+		time_t oldmtime;
+
+		if (FSAL_IS_ERROR(batch->status[i])) {
+			fsal_release_attrs(&batch->attrs[i]);
+			if (batch->status[i].major == ERR_FSAL_STALE)
+				mdcache_kill_entry(entry);
+			mdcache_put(entry);
+			continue;
+		}
+
+		PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+		if (mdcache_is_attrs_valid(entry, attrmask)) {
+			/* Someone beat us to it */
+			PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+			fsal_release_attrs(&batch->attrs[i]);
+			mdcache_put(entry);
+			continue;
+		}
+
+		oldmtime = entry->attrs.mtime.tv_sec;
+		entry->attrs.request_mask = batch->attrs[i].request_mask;
+		mdc_update_attrs(entry, &batch->attrs[i], need_acl);
+
+		if (entry->obj_handle.type == DIRECTORY &&
+		    oldmtime < entry->attrs.mtime.tv_sec) {
+			/* We hold our parent's content_lock, so leave the
+			 * dirents for the next readdir of it to drop.
+			 */
+			atomic_clear_uint32_t_bits(&entry->mde_flags,
+						   MDCACHE_TRUST_CONTENT);
+		}
+
+		PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+		mdcache_put(entry);
+	}
+
+	gsh_free(batch);
+
+	return node;
+}
+
 /**
  * Read the contents of a dirctory
  *
- * If necessary, populate the dirent cache from the underlying FSAL.  Then, walk
- * the dirent cache calling the callback.
+ * Walk the dirent chunks of the directory from the cookie after @a whence,
+ * calling the callback.  Chunks that are not cached, or are stale because a
+ * name was added since they were read, are read from the underlying FSAL as
+ * the walk reaches them.  Cached entries whose attributes have expired are
+ * refreshed in batches ahead of the callback.
+ *
+ * Cookies are those of the underlying FSAL.
  *
  * @note The object passed into the callback is ref'd and must be unref'd by the
  * callback.
@@ -566,120 +901,159 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 {
 	mdcache_entry_t *directory = container_of(dir_hdl, mdcache_entry_t,
 						  obj_handle);
+	struct mdcache_fsal_export *export = mdc_cur_export();
 	mdcache_dir_entry_t *dirent = NULL;
-	struct avltree_node *dirent_node = NULL;
+	struct dir_chunk *chunk = NULL;
+	struct glist_head *node = NULL;
+	fsal_cookie_t next_ck = whence != NULL ? *whence : 0;
 	fsal_status_t status = {0, 0};
-	bool cb_result = true;
+	bool has_write = false;
+	struct dir_chunk *attrs_chunk = NULL;
+	struct glist_head *attrs_next = NULL;
 
 	if (!(directory->obj_handle.type == DIRECTORY))
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
 
-	if (directory->mde_flags & MDCACHE_BYPASS_DIRCACHE) {
-		/* Not caching dirents; pass through directly to FSAL */
-		return mdcache_readdir_uncached(directory, whence, dir_state,
-						cb, attrmask, eod_met);
-	}
+	*eod_met = false;
 
-	/* Dirent's are being cached; check to see if it needs updating */
-	if (!mdc_dircache_trusted(directory)) {
+	if (!(directory->mde_flags & MDCACHE_TRUST_CONTENT)) {
 		PTHREAD_RWLOCK_wrlock(&directory->content_lock);
-		status = mdcache_dirent_populate(directory);
-		PTHREAD_RWLOCK_unlock(&directory->content_lock);
-		if (FSAL_IS_ERROR(status)) {
-			if (status.major == ERR_FSAL_STALE) {
-				LogEvent(COMPONENT_NFS_READDIR,
-					 "FSAL returned STALE from readdir.");
-				mdcache_kill_entry(directory);
-			} else if (status.major == ERR_FSAL_OVERFLOW) {
-				/* Directory is too big.  Invalidate, set
-				 * MDCACHE_BYPASS_DIRCACHE and pass through */
-				atomic_set_uint32_t_bits(&directory->mde_flags,
-						 MDCACHE_BYPASS_DIRCACHE);
-				PTHREAD_RWLOCK_wrlock(&directory->content_lock);
-				mdcache_dirent_invalidate_all(directory);
-				PTHREAD_RWLOCK_unlock(&directory->content_lock);
-				return mdcache_readdir_uncached(directory,
-								whence,
-								dir_state,
-								cb, attrmask,
-								eod_met);
-			}
-			LogFullDebug(COMPONENT_NFS_READDIR,
-				     "mdcache_dirent_populate status=%s",
-				     fsal_err_txt(status));
-			return status;
+		has_write = true;
+		if (!(directory->mde_flags & MDCACHE_TRUST_CONTENT)) {
+			/* Still untrusted; empty it out */
+			mdcache_dirent_invalidate_all(directory);
 		}
+	} else {
+		PTHREAD_RWLOCK_rdlock(&directory->content_lock);
 	}
 
-	PTHREAD_RWLOCK_rdlock(&directory->content_lock);
-	/* Get initial starting position */
-	if (*whence > 0) {
-		enum mdcache_avl_err aerr;
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "About to readdir in mdcache_readdir: directory=%p cookie=%"
+		     PRIu64 " chunks %" PRIu32,
+		     directory, next_ck, directory->fsobj.fsdir.nchunks);
 
-		/* Not a full directory walk */
-		if (*whence < 3) {
-			/* mdcache always uses 1 and 2 for . and .. */
+	for (;;) {
+		mdcache_entry_t *entry = NULL;
+		bool cb_result;
+
+		if (chunk == NULL) {
+			/* Find the dirent after next_ck */
+			if (next_ck == 0) {
+				chunk = directory->fsobj.fsdir.first;
+				if (chunk != NULL)
+					node = chunk->dirents.next;
+			} else {
+				dirent = mdcache_avl_lookup_ck(directory,
+							       next_ck);
+				if (dirent != NULL) {
+					chunk = dirent->chunk;
+					node = dirent->chunk_list.next;
+				}
+			}
+		} else if (node == &chunk->dirents) {
+			/* End of chunk */
+			if (chunk->eod) {
+				*eod_met = true;
+				break;
+			}
+			if (chunk->num_entries == 0) {
+				/* The FSAL gave us nothing, and no eod */
+				*eod_met = true;
+				break;
+			}
+			chunk = chunk->next;
+			if (chunk != NULL)
+				node = chunk->dirents.next;
+		} else {
+			goto have_node;
+		}
+
+		if (chunk != NULL &&
+		    chunk->gen == directory->fsobj.fsdir.chunk_gen) {
+			/* Up to date */
+			mdcache_lru_touch_chunk(chunk);
+			continue;
+		}
+
+		/* Need to read the chunk after next_ck */
+		if (!has_write) {
+			/* Get a write lock and look again */
+			PTHREAD_RWLOCK_unlock(&directory->content_lock);
+			PTHREAD_RWLOCK_wrlock(&directory->content_lock);
+			has_write = true;
+			if (!(directory->mde_flags & MDCACHE_TRUST_CONTENT))
+				mdcache_dirent_invalidate_all(directory);
+			chunk = NULL;
+			attrs_chunk = NULL;
+			continue;
+		}
+
+		if (chunk != NULL) {
 			LogFullDebug(COMPONENT_NFS_READDIR,
-				     "Bad cookie");
-			status = fsalstat(ERR_FSAL_BADCOOKIE, 0);
-			goto unlock_dir;
+				     "Chunk %p of dir %p is stale", chunk,
+				     directory);
+			mdcache_free_dir_chunk(chunk);
 		}
-		aerr = mdcache_avl_lookup_k(directory, *whence,
-					    MDCACHE_FLAG_NEXT_ACTIVE, &dirent);
-		switch (aerr) {
-		case MDCACHE_AVL_NOT_FOUND:
+
+		status = mdcache_dirent_load_chunk(directory, next_ck, &chunk);
+		if (FSAL_IS_ERROR(status)) {
 			LogFullDebug(COMPONENT_NFS_READDIR,
-				     "seek to cookie=%" PRIu64 " fail",
-				     *whence);
-			status = fsalstat(ERR_FSAL_BADCOOKIE, 0);
+				     "mdcache_dirent_load_chunk status=%s",
+				     fsal_err_txt(status));
+			if (status.major == ERR_FSAL_STALE) {
+				PTHREAD_RWLOCK_unlock(&directory->content_lock);
+				LogEvent(COMPONENT_NFS_READDIR,
+					 "FSAL returned STALE from readdir.");
+				mdcache_kill_entry(directory);
+				return status;
+			}
 			goto unlock_dir;
-		case MDCACHE_AVL_LAST:
-		case MDCACHE_AVL_DELETED:
-			/* dirent was last, or all dirents after this one are
-			 * deleted */
-			LogFullDebug(COMPONENT_NFS_READDIR,
-				     "EOD because empty result");
+		}
+
+		if (chunk == NULL) {
+			/* Nothing after next_ck */
 			*eod_met = true;
-			goto unlock_dir;
-		case MDCACHE_AVL_NO_ERROR:
-			assert(dirent);
-			dirent_node = &dirent->node_hk;
 			break;
 		}
-	} else {
-		/* Start at beginning */
-		dirent_node = avltree_first(&directory->fsobj.fsdir.avl.t);
-	}
 
-	LogFullDebug(COMPONENT_NFS_READDIR,
-		     "About to readdir in mdcache_readdir: directory=%p cookie=%"
-		     PRIu64 " collisions %d",
-		     directory, *whence, directory->fsobj.fsdir.avl.collisions);
+		node = chunk->dirents.next;
+		attrs_chunk = NULL;
+		continue;
 
-	/* Now satisfy the request from the cached readdir--stop when either
-	 * the requested sequence or dirent sequence is exhausted */
-	*eod_met = false;
+have_node:
+		if ((attrmask & ~MDC_ATTRS_IMMUTABLE) != 0 &&
+		    (chunk != attrs_chunk || node == attrs_next)) {
+			/* Refresh the attributes of the next few entries
+			 * together rather than one getattrs at a time.
+			 */
+			attrs_next = mdc_readdir_refresh_attrs(directory, chunk,
+							       node, attrmask);
+			attrs_chunk = chunk;
+		}
 
-	for (; cb_result && dirent_node;
-	     dirent_node = avltree_next(dirent_node)) {
-		mdcache_entry_t *entry = NULL;
+		dirent = glist_entry(node, mdcache_dir_entry_t, chunk_list);
 
-		dirent = avltree_container_of(dirent_node,
-					      mdcache_dir_entry_t,
-					      node_hk);
+		if (dirent->flags & DIR_ENTRY_FLAG_DELETED) {
+			/* Removed since it was read */
+			next_ck = dirent->ck;
+			node = node->next;
+			continue;
+		}
 
 		/* Get actual entry */
-		status = mdc_try_get_cached(directory, dirent->name, &entry);
-
-		if (status.major == ERR_FSAL_STALE) {
-			status = mdc_lookup_uncached(directory, dirent->name,
-						     &entry, NULL);
-		}
+		status = mdcache_find_keyed(&dirent->ckey, &entry);
+		if (FSAL_IS_ERROR(status))
+			status = mdcache_locate_keyed(&dirent->ckey, export,
+						      &entry, NULL);
 		if (FSAL_IS_ERROR(status)) {
 			if (status.major == ERR_FSAL_STALE) {
-				PTHREAD_RWLOCK_unlock(&directory->content_lock);
-				mdcache_kill_entry(directory);
-				return status;
+				/* Gone since it was read; skip it */
+				LogFullDebug(COMPONENT_NFS_READDIR,
+					     "Skipping stale %s", dirent->name);
+				status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+				next_ck = dirent->ck;
+				node = node->next;
+				continue;
 			}
 			LogFullDebug(COMPONENT_NFS_READDIR,
 				     "lookup failed status=%s",
@@ -688,27 +1062,108 @@ static fsal_status_t mdcache_readdir(struct fsal_obj_handle *dir_hdl,
 		}
 
 		cb_result = cb(dirent->name, &entry->obj_handle, &entry->attrs,
-			       dir_state, dirent->hk.k);
+			       dir_state, dirent->ck);
 
 		if (!cb_result)
 			break;
-	}
 
-	LogDebug(COMPONENT_NFS_READDIR,
-		 "dirent_node = %p, in_result = %s", dirent_node,
-		 cb_result ? "TRUE" : "FALSE");
+		if (chunk->ra_ck != 0 && dirent->ck == chunk->ra_ck)
+			mdcache_readahead_chunk(directory, chunk);
 
-	if (!dirent_node && cb_result)
-		*eod_met = true;
-	else
-		*eod_met = false;
+		next_ck = dirent->ck;
+		node = node->next;
+	}
 
+	LogDebug(COMPONENT_NFS_READDIR,
+		 "next cookie = %" PRIu64 ", eod = %s", next_ck,
+		 *eod_met ? "TRUE" : "FALSE");
 
 unlock_dir:
 	PTHREAD_RWLOCK_unlock(&directory->content_lock);
 	return status;
 }
 
+/**
+ * @brief Look an access check up in the entry's cache
+ *
+ * @param[in]     entry   Entry checked
+ * @param[in,out] key     Credential and access of the check, attr_gen
+ *                        set to that of the current attributes
+ * @param[in]     mask    Attributes the check relies on
+ * @param[out]    allowed Cached access granted, if not NULL
+ * @param[out]    denied  Cached access denied, if not NULL
+ * @param[out]    status  Cached status of the check
+ *
+ * @return true if the check was found.
+ */
+static bool mdc_access_lookup(mdcache_entry_t *entry, struct mdc_access *key,
+			      attrmask_t mask, fsal_accessflags_t *allowed,
+			      fsal_accessflags_t *denied,
+			      fsal_status_t *status)
+{
+	struct mdc_access *a;
+	bool found = false;
+	uint32_t i;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	key->attr_gen = entry->attr_gen;
+
+	if (entry->access == NULL || !mdcache_is_attrs_valid(entry, mask))
+		goto out;
+
+	for (i = 0; i < mdcache_param.access_cache; i++) {
+		a = &entry->access->slot[i];
+		if (a->access_type == key->access_type &&
+		    a->attr_gen == key->attr_gen &&
+		    a->uid == key->uid && a->gid == key->gid &&
+		    a->ngroups == key->ngroups &&
+		    a->groups_hash == key->groups_hash) {
+			if (allowed != NULL)
+				*allowed = a->allowed;
+			if (denied != NULL)
+				*denied = a->denied;
+			*status = fsalstat(a->error, 0);
+			found = true;
+			break;
+		}
+	}
+
+ out:
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	return found;
+}
+
+/**
+ * @brief Keep the result of an access check
+ *
+ * The result is dropped if the attributes changed since @a key was
+ * looked up, as it may have been computed from either.
+ */
+static void mdc_access_store(mdcache_entry_t *entry, struct mdc_access *key)
+{
+	struct mdc_access_cache *cache;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	if (entry->attr_gen != key->attr_gen)
+		goto out;
+
+	cache = entry->access;
+	if (cache == NULL) {
+		cache = gsh_calloc(1, sizeof(*cache) +
+				   mdcache_param.access_cache *
+				   sizeof(cache->slot[0]));
+		entry->access = cache;
+	}
+
+	cache->slot[cache->next] = *key;
+	cache->next = (cache->next + 1) % mdcache_param.access_cache;
+
+ out:
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
+
 /**
  * @brief Check access for a given user against a given object
  *
@@ -723,6 +1178,9 @@ unlock_dir:
  * invalidate cached attributes) is a huge performance hit.  Eventually, finer
  * grained attribute validity would be a better solution
  *
+ * The results are kept by the entry, per credential, until its attributes
+ * are loaded again, so that large ACLs are not walked on every check.
+ *
  * @param[in] obj_hdl     Handle to check
  * @param[in] access_type Access requested
  * @param[out] allowed    Returned access that could be granted
@@ -740,11 +1198,51 @@ static fsal_status_t mdcache_test_access(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 
-	if (owner_skip && entry->attrs.owner == op_ctx->creds->caller_uid)
+	struct user_cred *creds = op_ctx->creds;
+	struct mdc_access key;
+	fsal_status_t status;
+	attrmask_t mask;
+
+	if (owner_skip && entry->attrs.owner == creds->caller_uid)
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 
-	return fsal_test_access(obj_hdl, access_type, allowed, denied,
-				owner_skip);
+	if (mdcache_param.access_cache == 0 || access_type == 0)
+		return fsal_test_access(obj_hdl, access_type, allowed, denied,
+					owner_skip);
+
+	/* What fsal_test_access() fetches */
+	mask = mdc_supported_attrs() & (ATTRS_CREDS | ATTR_MODE | ATTR_ACL);
+
+	memset(&key, 0, sizeof(key));
+	key.uid = creds->caller_uid;
+	key.gid = creds->caller_gid;
+	key.ngroups = creds->caller_glen;
+	if (creds->caller_glen != 0)
+		key.groups_hash = CityHash64((char *)creds->caller_garray,
+					     creds->caller_glen *
+					     sizeof(gid_t));
+	key.access_type = access_type;
+
+	if (mdc_access_lookup(entry, &key, mask, allowed, denied, &status))
+		return status;
+
+	status = fsal_test_access(obj_hdl, access_type, &key.allowed,
+				  &key.denied, owner_skip);
+
+	if (allowed != NULL)
+		*allowed = key.allowed;
+	if (denied != NULL)
+		*denied = key.denied;
+
+	/* Keep what the attributes decided: not a failure to get them,
+	 * nor the owner skipped without a check. */
+	key.error = status.major;
+	if ((status.major == ERR_FSAL_NO_ERROR ||
+	     status.major == ERR_FSAL_ACCESS) &&
+	    (key.allowed | key.denied) != 0)
+		mdc_access_store(entry, &key);
+
+	return status;
 }
 
 /**
@@ -758,13 +1256,17 @@ static fsal_status_t mdcache_test_access(struct fsal_obj_handle *obj_hdl,
  * @param[in] old_name	Current name of @a obj_hdl
  * @param[in] newdir_hdl	Directory to move @a obj_hdl to
  * @param[in] new_name	Name to rename @a obj_hdl to
+ * @param[in,out] olddir_attrs_out	Not filled
+ * @param[in,out] newdir_attrs_out	Not filled
  * @return FSAL status
  */
 static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	mdcache_entry_t *mdc_olddir =
 		container_of(olddir_hdl, mdcache_entry_t,
@@ -775,58 +1277,57 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 	mdcache_entry_t *mdc_obj =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *mdc_lookup_dst = NULL;
+	struct attrlist old_attrs, new_attrs;
 	fsal_status_t status;
 
+	PTHREAD_RWLOCK_rdlock(&mdc_newdir->content_lock);
 	status = mdc_try_get_cached(mdc_newdir, new_name, &mdc_lookup_dst);
+	PTHREAD_RWLOCK_unlock(&mdc_newdir->content_lock);
 
 	if (!FSAL_IS_ERROR(status) && (mdc_obj == mdc_lookup_dst)) {
 		/* Same source and destination */
 		goto out;
 	}
 
+	mdc_prepare_attrs(&old_attrs, MDC_ATTRS_TIMES);
+	mdc_prepare_attrs(&new_attrs, MDC_ATTRS_TIMES);
+
 	subcall(
 		status = mdc_olddir->sub_handle->obj_ops.rename(
 			mdc_obj->sub_handle, mdc_olddir->sub_handle,
-			old_name, mdc_newdir->sub_handle, new_name)
+			old_name, mdc_newdir->sub_handle, new_name,
+			&old_attrs,
+			mdc_olddir != mdc_newdir ? &new_attrs : NULL)
 	       );
 
-	if (FSAL_IS_ERROR(status))
+	if (FSAL_IS_ERROR(status)) {
+		fsal_release_attrs(&old_attrs);
+		fsal_release_attrs(&new_attrs);
 		goto out;
+	}
 
 	if (mdc_lookup_dst != NULL) {
 		/* Mark target file attributes as invalid */
 		atomic_clear_uint32_t_bits(&mdc_lookup_dst->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_bus_publish(mdc_lookup_dst, FSAL_UP_INVALIDATE_ATTRS);
 	}
 
 	/* Mark renamed file attributes as invalid */
 	atomic_clear_uint32_t_bits(&mdc_obj->mde_flags,
 				   MDCACHE_TRUST_ATTRS);
+	mdc_bus_publish(mdc_obj, FSAL_UP_INVALIDATE_ATTRS);
 
-	/* Mark directory attributes as invalid */
-	atomic_clear_uint32_t_bits(&mdc_olddir->mde_flags,
-				   MDCACHE_TRUST_ATTRS);
+	/* Update the directory attributes */
+	mdc_dir_changed(mdc_olddir, &old_attrs);
 
-	if (olddir_hdl != newdir_hdl) {
-		atomic_clear_uint32_t_bits(&mdc_newdir->mde_flags,
-					   MDCACHE_TRUST_ATTRS);
-	}
-
-	/* Now update cached dirents.  Must take locks in the correct order */
-	mdcache_src_dest_lock(mdc_olddir, mdc_newdir);
+	if (mdc_olddir != mdc_newdir)
+		mdc_dir_changed(mdc_newdir, &new_attrs);
+	else
+		fsal_release_attrs(&new_attrs);
 
+	/* Now update cached dirents, one directory at a time */
 	if (mdc_lookup_dst) {
-		/* Remove the entry from parent dir_entries avl */
-		status = mdcache_dirent_remove(mdc_newdir, new_name);
-
-		if (FSAL_IS_ERROR(status)) {
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "remove entry failed with status %s",
-				 fsal_err_txt(status));
-			/* Protected by mdcache_src_dst_lock() above */
-			mdcache_dirent_invalidate_all(mdc_newdir);
-		}
-
 		/* Mark unreachable */
 		mdc_unreachable(mdc_lookup_dst);
 	}
@@ -841,54 +1342,87 @@ static fsal_status_t mdcache_rename(struct fsal_obj_handle *obj_hdl,
 			 "Rename (%p,%s)->(%p,%s) : source and target directory  the same",
 			 mdc_olddir, old_name, mdc_newdir, new_name);
 
+		PTHREAD_RWLOCK_wrlock(&mdc_newdir->content_lock);
+
+		if (mdc_lookup_dst) {
+			/* Remove the entry from parent dir_entries avl */
+			status = mdcache_dirent_remove(mdc_newdir, new_name);
+
+			if (FSAL_IS_ERROR(status)) {
+				LogDebug(COMPONENT_CACHE_INODE,
+					 "remove entry failed with status %s",
+					 fsal_err_txt(status));
+				mdcache_dirent_invalidate_all(mdc_newdir);
+			}
+		}
+
 		status = mdcache_dirent_rename(mdc_newdir, old_name, new_name);
 		if (FSAL_IS_ERROR(status)) {
 			/* We're obviously out of date.  Throw out the cached
 			   directory */
-			/* Protected by mdcache_src_dst_lock() above */
 			mdcache_dirent_invalidate_all(mdc_newdir);
 		}
+
+		PTHREAD_RWLOCK_unlock(&mdc_newdir->content_lock);
 	} else {
 		LogDebug(COMPONENT_CACHE_INODE,
 			 "Rename (%p,%s)->(%p,%s) : moving entry", mdc_olddir,
 			 old_name, mdc_newdir, new_name);
 
-		/* We may have a cache entry for the destination
-		 * filename.  If we do, we must delete it : it is stale. */
-		status = mdcache_dirent_remove(mdc_newdir, new_name);
+		/* The new name goes in before the old one goes out, so
+		 * that a lookup meanwhile may find the object under either
+		 * name, but never trusts it missing from both.  With
+		 * nothing cached under the new name, it is staged, with
+		 * the content_lock of the new directory held for read.
+		 */
+		status = fsalstat(ERR_FSAL_EXIST, 0);
+		if (mdc_lookup_dst == NULL)
+			status = mdcache_dirent_add_shared(mdc_newdir, new_name,
+							   mdc_obj, true);
 
 		if (FSAL_IS_ERROR(status)) {
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "Remove stale dirent returned %s",
-				 fsal_err_txt(status));
-			/* Protected by mdcache_src_dst_lock() above */
-			mdcache_dirent_invalidate_all(mdc_newdir);
-		}
+			PTHREAD_RWLOCK_wrlock(&mdc_newdir->content_lock);
+
+			/* We may have a cache entry for the destination
+			 * filename.  If we do, we must delete it : it is
+			 * stale. */
+			status = mdcache_dirent_remove(mdc_newdir, new_name);
+
+			if (FSAL_IS_ERROR(status)) {
+				LogDebug(COMPONENT_CACHE_INODE,
+					 "Remove stale dirent returned %s",
+					 fsal_err_txt(status));
+				mdcache_dirent_invalidate_all(mdc_newdir);
+			}
 
-		status = mdcache_dirent_add(mdc_newdir, new_name, mdc_obj);
+			status = mdcache_dirent_add(mdc_newdir, new_name,
+						    mdc_obj, true);
 
-		if (FSAL_IS_ERROR(status)) {
-			/* We're obviously out of date.  Throw out the cached
-			   directory */
-			LogCrit(COMPONENT_CACHE_INODE, "Add dirent returned %s",
-				fsal_err_txt(status));
-			/* Protected by mdcache_src_dst_lock() above */
-			mdcache_dirent_invalidate_all(mdc_newdir);
+			if (FSAL_IS_ERROR(status)) {
+				/* We're obviously out of date.  Throw out the
+				   cached directory */
+				LogCrit(COMPONENT_CACHE_INODE,
+					"Add dirent returned %s",
+					fsal_err_txt(status));
+				mdcache_dirent_invalidate_all(mdc_newdir);
+			}
+
+			PTHREAD_RWLOCK_unlock(&mdc_newdir->content_lock);
 		}
 
 		/* Remove the old entry */
+		PTHREAD_RWLOCK_wrlock(&mdc_olddir->content_lock);
+
 		status = mdcache_dirent_remove(mdc_olddir, old_name);
 		if (FSAL_IS_ERROR(status)) {
 			LogDebug(COMPONENT_CACHE_INODE,
 				 "Remove old dirent returned %s",
 				 fsal_err_txt(status));
-			/* Protected by mdcache_src_dst_lock() above */
 			mdcache_dirent_invalidate_all(mdc_olddir);
 		}
-	}
 
-	/* unlock entries */
-	mdcache_src_dest_unlock(mdc_olddir, mdc_newdir);
+		PTHREAD_RWLOCK_unlock(&mdc_olddir->content_lock);
+	}
 
 	/* If we're moving a directory out, update parent hash */
 	if (mdc_olddir != mdc_newdir && obj_hdl->type == DIRECTORY) {
@@ -916,24 +1450,23 @@ out:
  *       attr_lock if ERR_FSAL_STALE is returned.
  *
  * @param[in] entry     The mdcache entry to refresh attributes for.
- * @param[in] need_acl  Indicates if the ACL needs updating.
+ * @param[in] want      Attributes needed, see mdc_prepare_attrs
  */
 
-fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl)
+fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, attrmask_t want)
 {
 	struct attrlist attrs;
 	fsal_status_t status = {0, 0};
+	bool need_acl = (want & ATTR_ACL) != 0;
 
-	/* We always ask for all regular attributes, even if the caller was
+	/* The mtime of a directory decides whether its dirents still hold */
+	if (entry->obj_handle.type == DIRECTORY)
+		want |= MDC_ATTRS_TIMES;
+
+	/* We always ask for the core attributes, even if the caller was
 	 * only interested in the ACL.
 	 */
-	fsal_prepare_attrs(&attrs, op_ctx->fsal_export->exp_ops.
-		fs_supported_attrs(op_ctx->fsal_export) | ATTR_RDATTR_ERR);
-
-	if (!need_acl) {
-		/* Don't request the ACL if not necessary. */
-		attrs.request_mask &= ~ATTR_ACL;
-	}
+	mdc_prepare_attrs(&attrs, want);
 
 	/* We will want all the requested attributes in the entry */
 	entry->attrs.request_mask = attrs.request_mask;
@@ -950,46 +1483,7 @@ fsal_status_t mdcache_refresh_attrs(mdcache_entry_t *entry, bool need_acl)
 		return status;
 	}
 
-	if (entry->attrs.acl != NULL) {
-		/* We used to have an ACL... */
-		if (need_acl) {
-			/* We requested update of an existing ACL, release the
-			 * old one.
-			 */
-			nfs4_acl_release_entry(entry->attrs.acl);
-		} else {
-			/* The ACL wasn't requested, move it into the
-			 * new attributes so we will retain it and make
-			 * it such that the entry attrs DO request the
-			 * ACL.
-			 */
-			attrs.acl = entry->attrs.acl;
-			attrs.valid_mask |= ATTR_ACL;
-			entry->attrs.request_mask |= ATTR_ACL;
-		}
-
-		/* ACL was released or moved to new attributes. */
-		entry->attrs.acl = NULL;
-	}
-
-	if (attrs.expire_time_attr == 0) {
-		/* FSAL did not set this, retain what was in the entry. */
-		attrs.expire_time_attr = entry->attrs.expire_time_attr;
-	}
-
-	/* Now move the new attributes into the entry. */
-	fsal_copy_attrs(&entry->attrs, &attrs, true);
-
-	/* Done with the attrs (we didn't need to call this since the
-	 * fsal_copy_attrs preceding consumed all the references, but we
-	 * release them anyway to make it easy to scan the code for correctness.
-	 */
-	fsal_release_attrs(&attrs);
-
-	mdc_fixup_md(entry, &attrs);
-
-	LogAttrlist(COMPONENT_CACHE_INODE, NIV_FULL_DEBUG,
-		    "attrs ", &entry->attrs, true);
+	mdc_update_attrs(entry, &attrs, need_acl);
 
 	return status;
 }
@@ -1012,6 +1506,8 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status = {0, 0};
 	time_t oldmtime = 0;
 
+	mdc_hot_record(entry, MDC_HOT_GETATTR, NULL, NULL);
+
 	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
 
 	if (mdcache_is_attrs_valid(entry, attrs_out->request_mask)) {
@@ -1031,8 +1527,7 @@ static fsal_status_t mdcache_getattrs(struct fsal_obj_handle *obj_hdl,
 	/* Use this to detect if we should invalidate a directory. */
 	oldmtime = entry->attrs.mtime.tv_sec;
 
-	status = mdcache_refresh_attrs(
-			entry, (attrs_out->request_mask & ATTR_ACL) != 0);
+	status = mdcache_refresh_attrs(entry, attrs_out->request_mask);
 
 	if (FSAL_IS_ERROR(status)) {
 		/* We failed to fetch any attributes. Pass that fact back to
@@ -1057,6 +1552,9 @@ unlock:
 	/* Struct copy */
 	fsal_copy_attrs(attrs_out, &entry->attrs, false);
 
+	/* The FSAL does not know yet about writes gathered */
+	mdc_wgather_attrs(entry, attrs_out);
+
 unlock_no_attrs:
 
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
@@ -1085,6 +1583,10 @@ static fsal_status_t mdcache_setattrs(struct fsal_obj_handle *obj_hdl,
 	fsal_status_t status;
 	uint64_t change;
 
+	/* A truncate must come after the writes gathered */
+	(void) mdc_wgather_flush(entry, false);
+	mdc_rahead_drop(entry);
+
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
 	change = entry->attrs.change;
@@ -1102,7 +1604,7 @@ static fsal_status_t mdcache_setattrs(struct fsal_obj_handle *obj_hdl,
 	}
 
 	status = mdcache_refresh_attrs(
-				entry, (attrs->valid_mask & ATTR_ACL) != 0);
+			entry, (attrs->valid_mask & ATTR_ACL) | MDC_ATTRS_TIMES);
 
 	if (!FSAL_IS_ERROR(status) && change == entry->attrs.change) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -1118,6 +1620,9 @@ static fsal_status_t mdcache_setattrs(struct fsal_obj_handle *obj_hdl,
 			 fsal_err_txt(status));
 	}
 
+	mdc_bus_publish(entry, FSAL_UP_INVALIDATE_ATTRS |
+			       FSAL_UP_INVALIDATE_ACL);
+
 unlock:
 
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
@@ -1134,18 +1639,38 @@ unlock:
  * @param[in] obj_hdl	Object owning state
  * @param[in] state	Open file state to set attributes on
  * @param[in] attrs	Attributes to set
+ * @param[in,out] attrs_out	Not filled
  * @return FSAL status
  */
 static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 				      bool bypass,
 				      struct state_t *state,
-				      struct attrlist *attrs)
+				      struct attrlist *attrs,
+				      struct attrlist *attrs_out)
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct attrlist post;
 	fsal_status_t status;
 	uint64_t change;
 	bool need_acl = false;
+	attrmask_t want;
+
+	/* A truncate must come after the writes gathered */
+	(void) mdc_wgather_flush(entry, false);
+	mdc_rahead_drop(entry);
+
+	/* In case of ACL enabled, any of the below attribute changes
+	 * result in change of ACL set as well.
+	 */
+	if (!op_ctx_export_has_option(EXPORT_OPTION_DISABLE_ACL) &&
+	    (FSAL_TEST_MASK(attrs->valid_mask,
+			   ATTR_MODE | ATTR_OWNER | ATTR_GROUP | ATTR_ACL))) {
+		need_acl = true;
+	}
+
+	want = MDC_ATTRS_TIMES | (need_acl ? ATTR_ACL : 0);
+	mdc_prepare_attrs(&post, want);
 
 	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
 
@@ -1153,22 +1678,17 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 
 	subcall(
 		status = entry->sub_handle->obj_ops.setattr2(
-			entry->sub_handle, bypass, state, attrs)
+			entry->sub_handle, bypass, state, attrs, &post)
 	       );
 
-	if (FSAL_IS_ERROR(status))
+	if (FSAL_IS_ERROR(status)) {
+		fsal_release_attrs(&post);
 		goto unlock;
-
-	/* In case of ACL enabled, any of the below attribute changes
-	 * result in change of ACL set as well.
-	 */
-	if (!op_ctx_export_has_option(EXPORT_OPTION_DISABLE_ACL) &&
-	    (FSAL_TEST_MASK(attrs->valid_mask,
-			   ATTR_MODE | ATTR_OWNER | ATTR_GROUP | ATTR_ACL))) {
-		need_acl = true;
 	}
 
-	status = mdcache_refresh_attrs(entry, need_acl);
+	/* Only ask for the attributes if the sub-FSAL did not return them */
+	if (!mdc_take_attrs(entry, &post, need_acl))
+		status = mdcache_refresh_attrs(entry, want);
 
 	if (!FSAL_IS_ERROR(status) && change == entry->attrs.change) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -1178,6 +1698,9 @@ static fsal_status_t mdcache_setattr2(struct fsal_obj_handle *obj_hdl,
 		entry->attrs.change = change + 1;
 	}
 
+	mdc_bus_publish(entry, FSAL_UP_INVALIDATE_ATTRS |
+			       FSAL_UP_INVALIDATE_ACL);
+
 unlock:
 
 	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
@@ -1196,21 +1719,27 @@ unlock:
  * @param[in] dir_hdl	Parent directory handle
  * @param[in] obj_hdl	Object being removed
  * @param[in] name	Name of object to remove
+ * @param[in,out] parent_attrs_out	Not filled
  * @return FSAL status
  */
 static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 				    struct fsal_obj_handle *obj_hdl,
-				    const char *name)
+				    const char *name,
+				    struct attrlist *parent_attrs_out)
 {
 	mdcache_entry_t *parent =
 		container_of(dir_hdl, mdcache_entry_t, obj_handle);
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct attrlist parent_attrs;
 	fsal_status_t status;
 
+	mdc_prepare_attrs(&parent_attrs, MDC_ATTRS_TIMES);
+
 	subcall(
 		status = parent->sub_handle->obj_ops.unlink(
-			parent->sub_handle, entry->sub_handle, name)
+			parent->sub_handle, entry->sub_handle, name,
+			&parent_attrs)
 	       );
 
 	LogFullDebug(COMPONENT_CACHE_INODE,
@@ -1221,6 +1750,7 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		LogDebug(COMPONENT_CACHE_INODE,
 			 "unlink %s returned %s",
 			  name, fsal_err_txt(status));
+		fsal_release_attrs(&parent_attrs);
 		if (status.major == ERR_FSAL_STALE)
 			(void)mdcache_kill_entry(parent);
 		else if (status.major == ERR_FSAL_NOTEMPTY &&
@@ -1234,11 +1764,11 @@ static fsal_status_t mdcache_unlink(struct fsal_obj_handle *dir_hdl,
 		(void)mdcache_dirent_remove(parent, name);
 		PTHREAD_RWLOCK_unlock(&parent->content_lock);
 
-		/* Invalidate attributes of parent and entry */
-		atomic_clear_uint32_t_bits(&parent->mde_flags,
-					   MDCACHE_TRUST_ATTRS);
+		/* Update the parent, invalidate attributes of entry */
+		mdc_dir_changed(parent, &parent_attrs);
 		atomic_clear_uint32_t_bits(&entry->mde_flags,
 					   MDCACHE_TRUST_ATTRS);
+		mdc_bus_publish(entry, FSAL_UP_INVALIDATE_ATTRS);
 	}
 
 	if (entry->obj_handle.type == DIRECTORY)
@@ -1304,10 +1834,20 @@ static bool mdcache_handle_is(struct fsal_obj_handle *obj_hdl,
 	return status;
 }
 
+/**
+ * @brief A handle digest kept in the entry
+ */
+struct mdc_digest {
+	const struct mdcache_fsal_export *export; /*< Made through */
+	size_t len;
+	char buf[];
+};
+
 /**
  * @brief Get the digest for a handle
  *
- * Just pass through to the underlying FSAL
+ * The underlying FSAL is asked once; every GETFH, LOOKUP and READDIR
+ * reply on the entry then copies its answer.
  *
  * @param[in] obj_hdl	Handle to digest
  * @param[in] out_type	Type of digest to get
@@ -1321,13 +1861,36 @@ static fsal_status_t mdcache_handle_digest(
 {
 	mdcache_entry_t *entry =
 		container_of(obj_hdl, mdcache_entry_t, obj_handle);
+	struct mdcache_fsal_export *export = mdc_cur_export();
+	void **slot = (void **) &entry->digest[out_type == FSAL_DIGEST_NFSV4];
+	struct mdc_digest *digest = atomic_fetch_voidptr(slot);
 	fsal_status_t status;
 
+	/* Handles never change, so neither do the digests */
+	if (digest != NULL && digest->export == export) {
+		if (fh_desc->len < digest->len)
+			return fsalstat(ERR_FSAL_TOOSMALL, 0);
+		memcpy(fh_desc->addr, digest->buf, digest->len);
+		fh_desc->len = digest->len;
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
 	subcall(
 		status = entry->sub_handle->obj_ops.handle_digest(
 			entry->sub_handle, out_type, fh_desc)
 	       );
 
+	/* Kept for the first export only, the others ask every time */
+	if (FSAL_IS_ERROR(status) || digest != NULL)
+		return status;
+
+	digest = gsh_malloc(sizeof(*digest) + fh_desc->len);
+	digest->export = export;
+	digest->len = fh_desc->len;
+	memcpy(digest->buf, fh_desc->addr, fh_desc->len);
+	if (!atomic_cmpxchg_voidptr(slot, NULL, digest))
+		gsh_free(digest);
+
 	return status;
 }
 
@@ -1475,8 +2038,7 @@ static nfsstat4 mdcache_layoutcommit(struct fsal_obj_handle *obj_hdl,
 	       );
 
 	if (status == NFS4_OK)
-		atomic_clear_uint32_t_bits(&entry->mde_flags,
-					   MDCACHE_TRUST_ATTRS);
+		mdc_written(entry);
 
 	return status;
 }
@@ -1561,6 +2123,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->release = mdcache_hdl_release;
 	ops->merge = mdcache_merge;
 	ops->lookup = mdcache_lookup;
+	ops->lookup_components = mdcache_lookup_components;
 	ops->readdir = mdcache_readdir;
 	ops->create = mdcache_create;
 	ops->mkdir = mdcache_mkdir;
@@ -1610,6 +2173,13 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->lock_op2 = mdcache_lock_op2;
 	ops->setattr2 = mdcache_setattr2;
 	ops->close2 = mdcache_close2;
+	ops->read2_async = mdcache_read2_async;
+	ops->write2_async = mdcache_write2_async;
+	ops->commit2_async = mdcache_commit2_async;
+	ops->readv2 = mdcache_readv2;
+	ops->writev2 = mdcache_writev2;
+	ops->copy2 = mdcache_copy2;
+	ops->clone2 = mdcache_clone2;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = mdcache_list_ext_attrs;
@@ -1663,9 +2233,7 @@ fsal_status_t mdcache_lookup_path(struct fsal_export *exp_hdl,
 	 * until asked for it (including a permission check).
 	 */
 	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+			   mdc_supported_attrs() & ~ATTR_ACL);
 
 	subcall_raw(export,
 		status = sub_export->exp_ops.lookup_path(sub_export, path,
@@ -36,6 +36,8 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sched.h>
 #include "fsal.h"
 #include "nfs_core.h"
 #include "log.h"
@@ -58,11 +60,38 @@
  * This module exports an interface for efficient lookup of cache entries
  * by file handle.  Refactored from the prior abstract HashTable
  * implementation.
+ *
+ * Lookups by key take no lock.  Changes to a partition are made under its
+ * lock with atomic stores, and an unhashed entry is only recycled or freed
+ * after cih_synchronize() has waited out every reader that might still be
+ * looking at it.
  */
 
 struct cih_lookup_table cih_fhcache;
 static bool initialized;
 
+/** This thread's lockless reader, registered on first lookup */
+__thread struct cih_reader *cih_reader_mine;
+
+/** Every reader ever registered; records are reused, never unlinked */
+static struct cih_reader *cih_readers;
+static pthread_mutex_t cih_readers_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cih_reader_key;
+
+/**
+ * @brief Give up an exited thread's reader for reuse
+ *
+ * @param[in] arg  The reader
+ */
+static void cih_reader_release(void *arg)
+{
+	struct cih_reader *reader = arg;
+
+	PTHREAD_MUTEX_lock(&cih_readers_mtx);
+	reader->in_use = false;
+	PTHREAD_MUTEX_unlock(&cih_readers_mtx);
+}
+
 /**
  * @brief Initialize the package.
  */
@@ -80,6 +109,7 @@ cih_pkginit(void)
 		&rwlock_attr,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
+	(void) pthread_key_create(&cih_reader_key, cih_reader_release);
 	cih_fhcache.npart = mdcache_param.nparts;
 	cih_fhcache.partition =
 		gsh_calloc(cih_fhcache.npart, sizeof(cih_partition_t));
@@ -88,10 +118,9 @@ cih_pkginit(void)
 		cp = &cih_fhcache.partition[ix];
 		cp->part_ix = ix;
 		PTHREAD_RWLOCK_init(&cp->lock, &rwlock_attr);
-		avltree_init(&cp->t, cih_fh_cmpf, 0 /* must be 0 */);
-		cp->cache =
+		cp->buckets =
 			gsh_calloc(cih_fhcache.cache_sz,
-				sizeof(struct avltree_node *));
+				sizeof(mdcache_entry_t *));
 	}
 	initialized = true;
 }
@@ -104,19 +133,94 @@ cih_pkgdestroy(void)
 {
 	/* Index over partitions */
 	int ix = 0;
+	uint32_t bx;
+	struct cih_reader *reader;
 
 	/* Destroy the partitions, warning if not empty */
 	for (ix = 0; ix < cih_fhcache.npart; ++ix) {
-		if (avltree_first(&cih_fhcache.partition[ix].t) != NULL)
-			LogMajor(COMPONENT_CACHE_INODE,
-				 "Cache inode AVL tree not empty");
+		for (bx = 0; bx < cih_fhcache.cache_sz; ++bx) {
+			if (cih_fhcache.partition[ix].buckets[bx] != NULL) {
+				LogMajor(COMPONENT_CACHE_INODE,
+					 "Cache inode hash table not empty");
+				break;
+			}
+		}
 		PTHREAD_RWLOCK_destroy(&cih_fhcache.partition[ix].lock);
-		gsh_free(cih_fhcache.partition[ix].cache);
+		gsh_free(cih_fhcache.partition[ix].buckets);
 	}
 	/* Destroy the partition table */
 	gsh_free(cih_fhcache.partition);
 	cih_fhcache.partition = NULL;
+
+	/* No more readers will be released into the list */
+	(void) pthread_key_delete(cih_reader_key);
+	while (cih_readers != NULL) {
+		reader = cih_readers;
+		cih_readers = reader->next;
+		gsh_free(reader);
+	}
+	cih_reader_mine = NULL;
 	initialized = false;
 }
 
+/**
+ * @brief Register this thread as a lockless reader
+ *
+ * The reader of an exited thread is reused if there is one.
+ *
+ * @return The thread's reader.
+ */
+struct cih_reader *cih_reader_register(void)
+{
+	struct cih_reader *reader;
+
+	PTHREAD_MUTEX_lock(&cih_readers_mtx);
+
+	for (reader = cih_readers; reader != NULL; reader = reader->next)
+		if (!reader->in_use)
+			break;
+
+	if (reader == NULL) {
+		reader = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+					    sizeof(*reader));
+		memset(reader, 0, sizeof(*reader));
+		reader->next = cih_readers;
+		/* Publish the reader to cih_synchronize() */
+		atomic_store_voidptr((void **)&cih_readers, reader);
+	}
+
+	reader->in_use = true;
+
+	PTHREAD_MUTEX_unlock(&cih_readers_mtx);
+
+	(void) pthread_setspecific(cih_reader_key, reader);
+	cih_reader_mine = reader;
+
+	return reader;
+}
+
+/**
+ * @brief Wait for lockless readers to be done with unhashed entries
+ *
+ * Once this returns, no reader can still be looking at an entry that was
+ * unhashed before it was called, so the entry may be recycled or freed.
+ * Read sections are a few loads long and never block, so this is cheap and
+ * may be called with any lock held.
+ */
+void cih_synchronize(void)
+{
+	struct cih_reader *reader;
+	uint64_t seq;
+
+	for (reader = atomic_fetch_voidptr((void **)&cih_readers);
+	     reader != NULL; reader = reader->next) {
+		seq = atomic_fetch_uint64_t(&reader->seq);
+		if ((seq & 1) == 0)
+			continue;
+		/* Inside a section, wait for it to leave */
+		while (atomic_fetch_uint64_t(&reader->seq) == seq)
+			sched_yield();
+	}
+}
+
 /** @} */
@@ -50,7 +50,7 @@
 #include "mdcache_int.h"
 #include "gsh_intrinsic.h"
 #include "mdcache_lru.h"
-#include "city.h"
+#include "gsh_hash.h"
 #include <libgen.h>
 #ifdef USE_LTTNG
 #include "gsh_lttng/mdcache.h"
@@ -59,14 +59,14 @@
 /**
  * @brief The table partition
  *
- * Each tree is independent, having its own lock, thus reducing thread
- * contention.
+ * Each partition is an independent hash table with its own lock, thus
+ * reducing thread contention.  The lock serializes changes to the
+ * partition; lookups through cih_get_by_key_ref() take no lock at all.
  */
 typedef struct cih_partition {
 	uint32_t part_ix;
 	pthread_rwlock_t lock;
-	struct avltree t;
-	struct avltree_node **cache;
+	mdcache_entry_t **buckets;
 #ifdef ENABLE_LOCKTRACE
 	struct {
 		char *func;
@@ -91,6 +91,24 @@ struct cih_lookup_table {
 /* Support inline lookups */
 extern struct cih_lookup_table cih_fhcache;
 
+/**
+ * @brief A lockless reader
+ *
+ * Each thread that looks entries up without the partition lock owns one of
+ * these.  Its sequence is odd while the thread is inside a read section.  An
+ * entry unlinked from the table may still be seen by readers that were in a
+ * section when it was unlinked, so it is not recycled or freed until
+ * cih_synchronize() has seen each of them leave.
+ */
+struct cih_reader {
+	uint64_t seq;
+	struct cih_reader *next;
+	bool in_use;
+	GSH_CACHE_PAD(0);
+};
+
+extern __thread struct cih_reader *cih_reader_mine;
+
 /**
  * @brief Initialize the package.
  */
@@ -101,11 +119,45 @@ void cih_pkginit(void);
  */
 void cih_pkgdestroy(void);
 
+struct cih_reader *cih_reader_register(void);
+void cih_synchronize(void);
+
+/**
+ * @brief Enter a lockless read section
+ *
+ * Entries found inside the section remain valid memory until it is left.
+ * Nothing that may block can be done inside a section.
+ *
+ * @return The reader to pass to cih_read_exit().
+ */
+static inline struct cih_reader *cih_read_enter(void)
+{
+	struct cih_reader *reader = cih_reader_mine;
+
+	if (unlikely(reader == NULL))
+		reader = cih_reader_register();
+
+	/* Full barrier, the table is read after the sequence is odd */
+	(void) atomic_inc_uint64_t(&reader->seq);
+
+	return reader;
+}
+
+/**
+ * @brief Leave a lockless read section
+ *
+ * @param[in] reader	Reader returned by cih_read_enter()
+ */
+static inline void cih_read_exit(struct cih_reader *reader)
+{
+	(void) atomic_inc_uint64_t(&reader->seq);
+}
+
 /**
  * @brief Find the correct partition for a pointer
  *
  * To lower thread contention, the table is composed of multiple
- * trees, with the tree that receives a pointer determined by a
+ * hash tables, with the table that receives a pointer determined by a
  * modulus.  This macro yields an expression that yields a pointer to
  * the correct partition.
  */
@@ -114,80 +166,70 @@ void cih_pkgdestroy(void);
 	(((lt)->partition)+(((uint64_t)k)%(lt)->npart))
 
 /**
- * @brief Compute cache slot for an entry
+ * @brief Compute the hash chain for a key
  *
- * This function computes a hash slot, taking an address modulo the
- * number of cache slotes (which should be prime).
+ * The hash picks the partition by its remainder and the chain within the
+ * partition by its quotient, modulo the number of chains (which should be
+ * prime).
  *
- * @param wt [in] The table
- * @param ptr [in] Entry address
+ * @param cp [in] The partition of the key
+ * @param k [in] Hash of the key
  *
- * @return The computed offset.
+ * @return Head of the chain.
  */
-static inline uint32_t
-cih_cache_offsetof(struct cih_lookup_table *lt, uint64_t k)
+static inline mdcache_entry_t **
+cih_bucket_of(cih_partition_t *cp, uint64_t k)
 {
-	return k % lt->cache_sz;
+	return &cp->buckets[(k / cih_fhcache.npart) % cih_fhcache.cache_sz];
 }
 
 /**
- * @brief Cache inode FH hashed comparison function.
- *
- * Entries are ordered by integer hash first, and second by bitwise
- * comparison of the corresponding file handle.
+ * @brief Search a hash chain for a key
  *
- * For key prototypes, which have no object handle, the buffer pointed to
- * by fh_k.fh_desc_k is taken to be the file handle.  Further, ONLY key
- * prototype entries may have a non-NULL value for fh_k.fh_desc_k.
+ * Safe either with the partition locked or inside a lockless read section;
+ * the links are only ever changed with atomic stores.
  *
- * @param lhs [in] First node
- * @param rhs [in] Second node
+ * @param bucket [in] The chain to search
+ * @param key [in] Key being searched for
  *
- * @retval -1: lhs compares as less than rhs
- * @retval 0: lhs and rhs compare equal
- * @retval 1: lhs is greater than rhs
+ * @return Pointer to entry if found, else NULL.
  */
-static inline int cih_fh_cmpf(const struct avltree_node *lhs,
-			      const struct avltree_node *rhs)
+static inline mdcache_entry_t *
+cih_chain_lookup(mdcache_entry_t **bucket, const mdcache_key_t *key)
 {
-	mdcache_entry_t *lk, *rk;
+	mdcache_entry_t *entry = atomic_fetch_voidptr((void **)bucket);
 
-	lk = avltree_container_of(lhs, mdcache_entry_t, fh_hk.node_k);
-	rk = avltree_container_of(rhs, mdcache_entry_t, fh_hk.node_k);
-
-	return mdcache_key_cmp(&lk->fh_hk.key, &rk->fh_hk.key);
+	while (entry) {
+		if (mdcache_key_cmp(&entry->fh_hk.key, key) == 0)
+			return entry;
+		entry = atomic_fetch_voidptr((void **)&entry->fh_hk.next);
+	}
+	return NULL;
 }
 
 /**
- * @brief Open-coded avltree lookup
- *
- * Search for an entry matching key in avltree tree.
+ * @brief Unlink an entry from its hash chain
  *
- * @todo dang this should be in the avltree implementation.  It's dangerous to
- * open-code an avltree lookup elsewhere.
+ * The entry's own link is left alone, since lockless readers may be
+ * standing on it.
  *
- * @param tree [in] The avltree to search
- * @param key [in] Entry being searched for, as an avltree node
+ * @note The partition MUST be locked for write
  *
- * @return Pointer to node if found, else NULL.
+ * @param cp [in] Partition of the entry
+ * @param entry [in] Entry to unlink
  */
-static inline struct avltree_node *
-cih_fhcache_inline_lookup(const struct avltree *tree,
-			  const struct avltree_node *key)
+static inline void
+cih_chain_remove(cih_partition_t *cp, mdcache_entry_t *entry)
 {
-	struct avltree_node *node = tree->root;
-	int res = 0;
-
-	while (node) {
-		res = cih_fh_cmpf(node, key);
-		if (res == 0)
-			return node;
-		if (res > 0)
-			node = node->left;
-		else
-			node = node->right;
-	}
-	return NULL;
+	mdcache_entry_t **link = cih_bucket_of(cp, entry->fh_hk.key.hk);
+
+	while (*link != NULL && *link != entry)
+		link = &(*link)->fh_hk.next;
+
+	if (*link != NULL)
+		atomic_store_voidptr((void **)link, entry->fh_hk.next);
+
+	entry->fh_hk.inhash = false;
 }
 
 #define CIH_HASH_NONE           0x0000
@@ -216,15 +258,11 @@ cih_hash_key(mdcache_key_t *key,
 	if (flags & CIH_HASH_KEY_PROTOTYPE) {
 		key->kv = *fh_desc;
 	} else {
-		/* XXX dups fh_desc */
-		key->kv.len = fh_desc->len;
-		key->kv.addr = gsh_malloc(fh_desc->len);
-		memcpy(key->kv.addr, fh_desc->addr, fh_desc->len);
+		mdcache_key_set_kv(key, fh_desc->addr, fh_desc->len);
 	}
 
 	/* hash it */
-	key->hk =
-	    CityHash64WithSeed(fh_desc->addr, fh_desc->len, 557);
+	key->hk = gsh_hash64(fh_desc->addr, fh_desc->len, 557);
 
 	return true;
 }
@@ -298,47 +336,48 @@ static inline mdcache_entry_t *
 cih_get_by_key_latch(mdcache_key_t *key, cih_latch_t *latch,
 		       uint32_t flags, const char *func, int line)
 {
-	mdcache_entry_t k_entry, *entry = NULL;
-	struct avltree_node *node;
-	void **cache_slot;
+	mdcache_entry_t *entry;
 
 	if (!cih_latch_entry(key, latch, flags, func, line))
 		return NULL;
 
-	k_entry.fh_hk.key = *key;
-
-	/* check cache */
-	cache_slot = (void **)
-	    &(latch->cp->cache[cih_cache_offsetof(&cih_fhcache, key->hk)]);
-	node = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
-	if (node) {
-		if (cih_fh_cmpf(&k_entry.fh_hk.node_k, node) == 0) {
-			/* got it in 1 */
-			LogDebug(COMPONENT_HASHTABLE_CACHE,
-				 "cih cache hit slot %d",
-				 cih_cache_offsetof(&cih_fhcache, key->hk));
-			goto found;
-		}
-	}
-
-	/* check AVL */
-	node = cih_fhcache_inline_lookup(&latch->cp->t, &k_entry.fh_hk.node_k);
-	if (!node) {
+	entry = cih_chain_lookup(cih_bucket_of(latch->cp, key->hk), key);
+	if (!entry) {
 		if (flags & CIH_GET_UNLOCK_ON_MISS)
 			cih_hash_release(latch);
 		LogDebug(COMPONENT_HASHTABLE_CACHE, "fdcache MISS");
-		goto out;
 	}
 
-	/* update cache */
-	atomic_store_voidptr(cache_slot, node);
+	return entry;
+}
+
+/**
+ * @brief Lookup and reference cache entry by key, without locking
+ *
+ * The reference is only taken if the entry is not already on its way to
+ * being freed.  The entry may have been removed from the table since it was
+ * found; the caller should check fh_hk.inhash once it holds the reference.
+ *
+ * @param key [in] Key being searched
+ *
+ * @return Referenced cache entry if found, else NULL
+ */
+static inline mdcache_entry_t *
+cih_get_by_key_ref(mdcache_key_t *key)
+{
+	cih_partition_t *cp = cih_partition_of_scalar(&cih_fhcache, key->hk);
+	struct cih_reader *reader = cih_read_enter();
+	mdcache_entry_t *entry;
 
-	LogDebug(COMPONENT_HASHTABLE_CACHE, "cih AVL hit slot %d",
-		 cih_cache_offsetof(&cih_fhcache, key->hk));
+	entry = cih_chain_lookup(cih_bucket_of(cp, key->hk), key);
+	if (entry && !mdcache_lru_tryref(entry))
+		entry = NULL;
+
+	cih_read_exit(reader);
+
+	if (!entry)
+		LogDebug(COMPONENT_HASHTABLE_CACHE, "fdcache MISS");
 
- found:
-	entry = avltree_container_of(node, mdcache_entry_t, fh_hk.node_k);
- out:
 	return entry;
 }
 
@@ -364,6 +403,7 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 		uint32_t flags)
 {
 	cih_partition_t *cp = latch->cp;
+	mdcache_entry_t **bucket;
 
 	/* Omit hash if you are SURE we hashed it, and that the
 	 * hash remains valid */
@@ -372,8 +412,11 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 				  fh_desc, CIH_HASH_NONE))
 			return 1;
 
-	(void)avltree_insert(&entry->fh_hk.node_k, &cp->t);
-	entry->fh_hk.inavl = true;
+	bucket = cih_bucket_of(cp, entry->fh_hk.key.hk);
+	entry->fh_hk.next = *bucket;
+	entry->fh_hk.inhash = true;
+	/* Publish the entry to lockless readers */
+	atomic_store_voidptr((void **)bucket, entry);
 #ifdef USE_LTTNG
 	tracepoint(mdcache, mdc_lru_insert, __func__, __LINE__, entry,
 		   entry->lru.refcnt);
@@ -398,22 +441,17 @@ cih_set_latched(mdcache_entry_t *entry, cih_latch_t *latch,
 static inline bool
 cih_remove_checked(mdcache_entry_t *entry)
 {
-	struct avltree_node *node;
 	cih_partition_t *cp =
 	    cih_partition_of_scalar(&cih_fhcache, entry->fh_hk.key.hk);
 	bool freed = false;
 
 	PTHREAD_RWLOCK_wrlock(&cp->lock);
-	node = cih_fhcache_inline_lookup(&cp->t, &entry->fh_hk.node_k);
-	if (entry->fh_hk.inavl && node) {
+	if (entry->fh_hk.inhash) {
 #ifdef USE_LTTNG
 		tracepoint(mdcache, mdc_lru_remove, __func__, __LINE__, entry,
 			   entry->lru.refcnt);
 #endif
-		avltree_remove(node, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
-		entry->fh_hk.inavl = false;
+		cih_chain_remove(cp, entry);
 		/* return sentinel ref */
 		freed = mdcache_lru_unref(entry, LRU_FLAG_NONE);
 	}
@@ -442,15 +480,12 @@ cih_remove_latched(mdcache_entry_t *entry, cih_latch_t *latch, uint32_t flags)
 	    cih_partition_of_scalar(&cih_fhcache, entry->fh_hk.key.hk);
 	uint32_t lflags = LRU_FLAG_NONE;
 
-	if (entry->fh_hk.inavl) {
+	if (entry->fh_hk.inhash) {
 #ifdef USE_LTTNG
 		tracepoint(mdcache, mdc_lru_remove, __func__, __LINE__, entry,
 			   entry->lru.refcnt);
 #endif
-		avltree_remove(&entry->fh_hk.node_k, &cp->t);
-		cp->cache[cih_cache_offsetof(&cih_fhcache,
-					     entry->fh_hk.key.hk)] = NULL;
-		entry->fh_hk.inavl = false;
+		cih_chain_remove(cp, entry);
 		if (flags & CIH_REMOVE_QLOCKED)
 			lflags |= LRU_UNREF_QLOCKED;
 		mdcache_lru_unref(entry, lflags);
@@ -45,11 +45,19 @@
 #include <stdbool.h>
 
 #include "nfs_exports.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
 
 #include "mdcache_lru.h"
+#include "mdcache_neg.h"
+#include "mdcache_flight.h"
 #include "mdcache_hash.h"
 #include "mdcache_avl.h"
 
+static void mdc_dirent_fold(mdcache_entry_t *dir);
+static mdcache_dir_entry_t *mdc_staged_lookup(mdcache_entry_t *dir,
+					      const char *name);
+
 static inline bool trust_negative_cache(mdcache_entry_t *parent)
 {
 	return op_ctx_export_has_option(
@@ -131,10 +139,25 @@ static mdcache_entry_t *mdcache_alloc_handle(
 	/* mdcache handlers */
 	mdcache_handle_ops_init(&result->obj_handle.obj_ops);
 	/* state */
-	if (sub_handle->type == DIRECTORY)
+	if (sub_handle->type == DIRECTORY) {
 		result->obj_handle.state_hdl = &result->fsobj.fsdir.dhdl;
-	else
+
+		/* init avl trees and dirent lists */
+		mdcache_avl_init(result);
+		glist_init(&result->fsobj.fsdir.chunks);
+		glist_init(&result->fsobj.fsdir.detached);
+		result->fsobj.fsdir.first = NULL;
+		result->fsobj.fsdir.last = NULL;
+		result->fsobj.fsdir.nchunks = 0;
+		result->fsobj.fsdir.nlinks = 0;
+		result->fsobj.fsdir.chunk_gen = 0;
+		result->fsobj.fsdir.ndetached = 0;
+		result->fsobj.fsdir.nbactive = 0;
+		result->fsobj.fsdir.staged = NULL;
+		result->fsobj.fsdir.nstaged = 0;
+	} else {
 		result->obj_handle.state_hdl = &result->fsobj.hdl;
+	}
 	state_hdl_init(result->obj_handle.state_hdl, result->obj_handle.type,
 		       &result->obj_handle);
 
@@ -195,6 +218,56 @@ void mdc_clean_entry(mdcache_entry_t *entry)
 
 }
 
+/**
+ * @brief Adapt the attribute expiration of an entry to its churn
+ *
+ * With Attr_Expiration_Max set on the current export, the expiration
+ * doubles each time fresh attributes show the file unchanged and is
+ * halved each time they show it changed, within the export's bounds.
+ *
+ * @note The caller must hold the attr_lock for write
+ *
+ * @param[in] entry  Entry being refreshed
+ * @param[in] attrs  Attributes just fetched from the sub-FSAL
+ *
+ * @return The expiration to use with @a attrs.
+ */
+int32_t
+mdc_adapt_attr_ttl(mdcache_entry_t *entry, const struct attrlist *attrs)
+{
+	int32_t ttl = entry->attrs.expire_time_attr;
+	int32_t min, max;
+	bool unchanged;
+
+	if (ttl <= 0 || op_ctx == NULL || op_ctx->ctx_export == NULL)
+		return ttl;
+
+	max = atomic_fetch_int32_t(&op_ctx->ctx_export->expire_time_attr_max);
+	if (max <= 0)
+		return ttl;
+	min = atomic_fetch_int32_t(&op_ctx->ctx_export->expire_time_attr_min);
+	if (min <= 0)
+		min = 1;
+
+	if (entry->attrs.valid_mask == ATTR_RDATTR_ERR)
+		unchanged = false;
+	else if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_CHANGE) &&
+		 FSAL_TEST_MASK(entry->attrs.valid_mask, ATTR_CHANGE))
+		unchanged = attrs->change == entry->attrs.change;
+	else
+		unchanged = gsh_time_cmp(&attrs->mtime,
+					 &entry->attrs.mtime) == 0 &&
+			    gsh_time_cmp(&attrs->ctime,
+					 &entry->attrs.ctime) == 0;
+
+	if (unchanged)
+		ttl = ttl > max / 2 ? max : ttl * 2;
+	else
+		ttl = ttl / 2 < min ? min : ttl / 2;
+
+	return ttl;
+}
+
 /**
  *
  * Check the active export mapping for this entry and update if necessary.
@@ -320,17 +393,39 @@ mdc_get_parent(struct mdcache_fsal_export *export, mdcache_entry_t *entry)
 
 void mdcache_dirent_invalidate_all(mdcache_entry_t *entry)
 {
+	struct glist_head *glist, *glistn;
+
 	/* Won't see this */
 	if (entry->obj_handle.type != DIRECTORY)
 		return;
 
-	/* First the active tree */
-	mdcache_avl_clean_tree(&entry->fsobj.fsdir.avl.t);
+	/* Staged dirents become detached, and go with them */
+	mdc_dirent_fold(entry);
+
+	/* First the chunks */
+	glist_for_each_safe(glist, glistn, &entry->fsobj.fsdir.chunks) {
+		mdcache_free_dir_chunk(glist_entry(glist, struct dir_chunk,
+						   chunks));
+	}
+
+	/* Next the detached dirents */
+	glist_for_each_safe(glist, glistn, &entry->fsobj.fsdir.detached) {
+		mdcache_dir_entry_t *dirent;
+
+		dirent = glist_entry(glist, mdcache_dir_entry_t, chunk_list);
+		LogFullDebug(COMPONENT_CACHE_INODE, "Invalidate %p %s",
+			     dirent, dirent->name);
+		mdcache_avl_remove(entry, dirent);
+		glist_del(&dirent->chunk_list);
+		if (dirent->ckey.kv.len)
+			mdcache_key_delete(&dirent->ckey);
+		mdcache_dirent_free(dirent);
+	}
+
+	entry->fsobj.fsdir.ndetached = 0;
 	entry->fsobj.fsdir.nbactive = 0;
 	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_DIR_POPULATED);
-
-	/* Next the inactive tree */
-	mdcache_avl_clean_tree(&entry->fsobj.fsdir.avl.c);
+	mdcache_neg_flush(entry);
 
 	/* Now we can trust the content */
 	atomic_set_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_CONTENT);
@@ -387,8 +482,8 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 			    CIH_HASH_KEY_PROTOTYPE);
 
 	/* Check if the entry already exists.  We allow the following race
-	 * because mdcache_lru_get has a slow path, and the latch is a
-	 * shared lock. */
+	 * because mdcache_lru_get has a slow path, and the lookup takes no
+	 * lock. */
 	status = mdcache_find_keyed(&key, entry);
 	if (!FSAL_IS_ERROR(status)) {
 		LogDebug(COMPONENT_CACHE_INODE,
@@ -487,9 +582,6 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 			atomic_clear_uint32_t_bits(&nentry->mde_flags,
 						   MDCACHE_DIR_POPULATED);
 		}
-
-		/* init avl tree */
-		mdcache_avl_init(nentry);
 		break;
 
 	case SYMBOLIC_LINK:
@@ -525,6 +617,8 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 	 */
 	nentry->attrs.request_mask = attrs_in->request_mask;
 	fsal_copy_attrs(&nentry->attrs, attrs_in, true);
+	(void)atomic_add_uint64_t(&cache_stp->mem_acls,
+				  mdc_acl_size(nentry->attrs.acl));
 
 	if (nentry->attrs.expire_time_attr == 0) {
 		nentry->attrs.expire_time_attr =
@@ -552,6 +646,9 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 		goto out;
 	}
 
+	/* Leave probation straight away if we saw this handle recently */
+	mdcache_lru_admit(nentry);
+
 	/* Map this new entry and the active export */
 	mdc_check_mapping(nentry);
 
@@ -567,6 +664,8 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 		 * the attributes, we may not have copied yet, in which case
 		 * mask and acl are 0/NULL.
 		 */
+		(void)atomic_sub_uint64_t(&cache_stp->mem_acls,
+					  mdc_acl_size(nentry->attrs.acl));
 		fsal_release_attrs(&nentry->attrs);
 
 		/* Destroy the export mapping if any */
@@ -662,29 +761,24 @@ mdcache_new_entry(struct mdcache_fsal_export *export,
 fsal_status_t
 mdcache_find_keyed(mdcache_key_t *key, mdcache_entry_t **entry)
 {
-	cih_latch_t latch;
-
 	if (key->kv.addr == NULL) {
 		LogDebug(COMPONENT_CACHE_INODE,
 			 "Attempt to use NULL key");
 		return fsalstat(ERR_FSAL_INVAL, 0);
 	}
 
-	*entry = cih_get_by_key_latch(key, &latch,
-					CIH_GET_RLOCK | CIH_GET_UNLOCK_ON_MISS,
-					__func__, __LINE__);
+	*entry = cih_get_by_key_ref(key);
 	if (likely(*entry)) {
-		fsal_status_t status;
-		/* Initial Ref on entry */
-		status = mdcache_lru_ref(*entry, LRU_REQ_INITIAL);
-		/* Release the subtree hash table lock */
-		cih_hash_release(&latch);
-		if (FSAL_IS_ERROR(status)) {
-			/* Return error instead of entry */
+		if (unlikely(!(*entry)->fh_hk.inhash)) {
+			/* Unhashed since we found it */
+			mdcache_put(*entry);
 			*entry = NULL;
-			return status;
+			return fsalstat(ERR_FSAL_NOENT, 0);
 		}
 
+		/* Initial Ref on entry, taken by the lookup */
+		(void) mdcache_lru_ref(*entry, LRU_REQ_INITIAL | LRU_REQ_TAKEN);
+
 		mdc_check_mapping(*entry);
 		(void)atomic_inc_uint64_t(&cache_stp->inode_hit);
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
@@ -694,48 +788,32 @@ mdcache_find_keyed(mdcache_key_t *key, mdcache_entry_t **entry)
 }
 
 /**
- * @brief Find or create a cache entry by it's key
- *
- * Locate a cache entry by key.  If it is not in the cache, an attempt will be
- * made to create it and insert it in the cache.
+ * @brief Ask the sub-FSAL for an entry that missed the cache, and cache it
  *
- * @param[in]     key       Cache key to use for lookup
+ * @param[in]     key       Cache key that missed
  * @param[in]     export    Export for this cache
- * @param[out]    entry     Entry, if found
+ * @param[out]    entry     Entry, if created
  * @param[in,out] attrs_out Optional attributes for newly created object
  *
- * @note This returns an INITIAL ref'd entry on success
- *
  * @return Status
  */
-fsal_status_t
-mdcache_locate_keyed(mdcache_key_t *key,
-		     struct mdcache_fsal_export *export,
-		     mdcache_entry_t **entry,
-		     struct attrlist *attrs_out)
+static fsal_status_t
+mdc_locate_miss(mdcache_key_t *key,
+		struct mdcache_fsal_export *export,
+		mdcache_entry_t **entry,
+		struct attrlist *attrs_out)
 {
 	fsal_status_t status;
 	struct fsal_obj_handle *sub_handle;
 	struct fsal_export *sub_export;
 	struct attrlist attrs;
 
-	status = mdcache_find_keyed(key, entry);
-
-	if (!FSAL_IS_ERROR(status)) {
-		status = get_optional_attrs(&(*entry)->obj_handle, attrs_out);
-		return status;
-	} else if (status.major != ERR_FSAL_NOENT) {
-		/* Actual error */
-		return status;
-	}
+	gsh_trace(TRACE_CACHE_MISS, __func__, 0, __LINE__);
 
 	/* Ask for all supported attributes except ACL (we defer fetching ACL
 	 * until asked for it (including a permission check).
 	 */
-	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+	fsal_prepare_attrs(&attrs, export->supported_attrs & ~ATTR_ACL);
 
 	sub_export = export->export.sub_export;
 
@@ -770,39 +848,166 @@ mdcache_locate_keyed(mdcache_key_t *key,
 }
 
 /**
- * @brief Create a new entry and add it to the parent's cache
+ * @brief Find or create a cache entry by it's key
+ *
+ * Locate a cache entry by key.  If it is not in the cache, an attempt will be
+ * made to create it and insert it in the cache.  Concurrent misses on the
+ * same key are answered by a single call to the sub-FSAL.
+ *
+ * @param[in]     key       Cache key to use for lookup
+ * @param[in]     export    Export for this cache
+ * @param[out]    entry     Entry, if found
+ * @param[in,out] attrs_out Optional attributes for newly created object
+ *
+ * @note This returns an INITIAL ref'd entry on success
+ *
+ * @return Status
+ */
+fsal_status_t
+mdcache_locate_keyed(mdcache_key_t *key,
+		     struct mdcache_fsal_export *export,
+		     mdcache_entry_t **entry,
+		     struct attrlist *attrs_out)
+{
+	fsal_status_t status;
+	struct mdc_flight *flight;
+
+	status = mdcache_find_keyed(key, entry);
+
+	if (!FSAL_IS_ERROR(status)) {
+		status = get_optional_attrs(&(*entry)->obj_handle, attrs_out);
+		return status;
+	} else if (status.major != ERR_FSAL_NOENT) {
+		/* Actual error */
+		return status;
+	}
+
+	flight = mdc_flight_take(key, &status);
+
+	if (flight == NULL) {
+		/* Another thread looked it up while we waited */
+		if (FSAL_IS_ERROR(status)) {
+			*entry = NULL;
+			return status;
+		}
+
+		status = mdcache_find_keyed(key, entry);
+		if (!FSAL_IS_ERROR(status))
+			return get_optional_attrs(&(*entry)->obj_handle,
+						  attrs_out);
+		if (status.major != ERR_FSAL_NOENT)
+			return status;
+
+		/* Already gone again; do it ourselves */
+		return mdc_locate_miss(key, export, entry, attrs_out);
+	}
+
+	/* A flight may have landed between the miss and the take */
+	status = mdcache_find_keyed(key, entry);
+
+	if (!FSAL_IS_ERROR(status))
+		status = get_optional_attrs(&(*entry)->obj_handle, attrs_out);
+	else if (status.major == ERR_FSAL_NOENT)
+		status = mdc_locate_miss(key, export, entry, attrs_out);
+
+	mdc_flight_land(flight, status);
+
+	return status;
+}
+
+/**
+ * @brief Allocate a dirent for a chunk
+ *
+ * @param[in] name    Name of the dirent
+ * @param[in] entry   Entry the dirent locates
+ * @param[in] cookie  FSAL cookie of the dirent
+ *
+ * @return The dirent.
+ */
+static mdcache_dir_entry_t *
+mdc_alloc_chunk_dirent(const char *name, mdcache_entry_t *entry,
+		       fsal_cookie_t cookie)
+{
+	size_t namesize = strlen(name) + 1;
+	mdcache_dir_entry_t *dirent;
+
+	dirent = mdcache_dirent_alloc(namesize);
+	dirent->flags = DIR_ENTRY_FLAG_NONE;
+	memcpy(&dirent->name, name, namesize);
+	mdcache_key_dup(&dirent->ckey, &entry->fh_hk.key);
+	dirent->ck = cookie;
+
+	return dirent;
+}
+
+/**
+ * @brief Append an indexed dirent to a chunk
+ *
+ * @param[in] chunk   Chunk being read
+ * @param[in] dirent  Dirent, already in the name tree
+ * @param[in] cookie  FSAL cookie of the dirent
+ *
+ * @return 0 on success, -1 if the cookie was already indexed.
+ */
+static int
+mdc_chunk_append(struct dir_chunk *chunk, mdcache_dir_entry_t *dirent,
+		 fsal_cookie_t cookie)
+{
+	dirent->ck = cookie;
+	dirent->chunk = chunk;
+
+	if (mdcache_avl_insert_ck(chunk->parent, dirent) < 0) {
+		dirent->chunk = NULL;
+		return -1;
+	}
+
+	glist_add_tail(&chunk->dirents, &dirent->chunk_list);
+	chunk->num_entries++;
+	return 0;
+}
+
+/**
+ * @brief Create a new entry and add it to a dirent chunk of the parent
  *
- * A new entry for @a sub_handle is created, and it is added to the dirent cache
- * of @a mdc_parent.
+ * A new entry for @a sub_handle is created, and a dirent for it is appended
+ * to @a chunk.  Whatever the cache already knew about @a cookie or @a name is
+ * reconciled with what the FSAL now says:
+ *
+ * - A chunk that already holds @a cookie overlaps this one, and is freed,
+ *   unless this cookie starts it, in which case @a chunk is linked to it
+ *   and reading stops.
+ * - A detached dirent for @a name is moved into @a chunk.
+ * - Another chunk that holds @a name is out of date, and is freed.
  *
  * @note mdc_parent MUST have it's content_lock held for writing
  *
  * @param[in]     mdc_parent  Parent entry
+ * @param[in]     chunk       Chunk being read
  * @param[in]     name        Name of new entry
  * @param[in]     sub_handle  Handle from sub-FSAL for new entry
  * @param[in]     attrs_in    Attributes for new entry
+ * @param[in]     cookie      FSAL cookie of the dirent
  *
- * @return FSAL status (ERR_FSAL_OVERFLOW if dircache full)
+ * @return FSAL status
  */
 
-fsal_status_t mdc_add_cache(mdcache_entry_t *mdc_parent,
-			    const char *name,
-			    struct fsal_obj_handle *sub_handle,
-			    struct attrlist *attrs_in)
+static fsal_status_t mdc_add_cache(mdcache_entry_t *mdc_parent,
+				   struct dir_chunk *chunk,
+				   const char *name,
+				   struct fsal_obj_handle *sub_handle,
+				   struct attrlist *attrs_in,
+				   fsal_cookie_t cookie)
 {
 	struct mdcache_fsal_export *export = mdc_cur_export();
 	fsal_status_t status;
 	mdcache_entry_t *new_entry = NULL;
-
-	if (avltree_size(&mdc_parent->fsobj.fsdir.avl.t) >
-	    mdcache_param.dir.avl_max) {
-		LogFullDebug(COMPONENT_CACHE_INODE, "Parent %p at max",
-			     mdc_parent);
-		return fsalstat(ERR_FSAL_OVERFLOW, 0);
-	}
+	mdcache_dir_entry_t *dirent, *allocated;
+	int code;
 
 	LogFullDebug(COMPONENT_CACHE_INODE, "Creating entry for %s", name);
 
+	mdc_dirent_fold(mdc_parent);
+
 	status = mdcache_new_entry(export, sub_handle, attrs_in, NULL,
 				   false, &new_entry, NULL);
 
@@ -813,18 +1018,90 @@ fsal_status_t mdc_add_cache(mdcache_entry_t *mdc_parent,
 		     "Created entry %p FSAL %s for %s",
 		     new_entry, new_entry->sub_handle->fsal->name, name);
 
-	/* Entry was found in the FSAL, add this entry to the
-	   parent directory */
-	status = mdcache_dirent_add(mdc_parent, name, new_entry);
+	/* Is this cookie already cached? */
+	dirent = mdcache_avl_lookup_ck(mdc_parent, cookie);
+	if (dirent && dirent->chunk == chunk) {
+		/* The FSAL repeated itself */
+		goto out;
+	} else if (dirent) {
+		struct dir_chunk *other = dirent->chunk;
+
+		if (other->prev == NULL && chunk->next == NULL &&
+		    !(dirent->flags & DIR_ENTRY_FLAG_DELETED) &&
+		    &dirent->chunk_list == other->dirents.next &&
+		    strcmp(dirent->name, name) == 0) {
+			/* We have reached the start of a cached chunk */
+			LogFullDebug(COMPONENT_NFS_READDIR,
+				     "Linking chunk %p to chunk %p at %s",
+				     chunk, other, name);
+			chunk->next = other;
+			other->prev = chunk;
+			mdc_parent->fsobj.fsdir.nlinks++;
+			goto out;
+		}
+
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Chunk %p overlaps chunk %p at %s, freeing it",
+			     chunk, other, name);
+		mdcache_free_dir_chunk(other);
+	}
+
+	/* Is this name already cached? */
+	dirent = mdcache_avl_qp_lookup_s(mdc_parent, name, 1);
+	if (dirent && dirent->chunk == NULL) {
+		/* Known from lookup or create; now we know its cookie */
+		if (mdcache_key_cmp(&dirent->ckey, &new_entry->fh_hk.key)) {
+			mdcache_key_delete(&dirent->ckey);
+			mdcache_key_dup(&dirent->ckey, &new_entry->fh_hk.key);
+		}
+		glist_del(&dirent->chunk_list);
+		mdc_parent->fsobj.fsdir.ndetached--;
+		if (mdc_chunk_append(chunk, dirent, cookie) < 0) {
+			/* Can't happen, we just looked */
+			glist_add_tail(&mdc_parent->fsobj.fsdir.detached,
+				       &dirent->chunk_list);
+			mdc_parent->fsobj.fsdir.ndetached++;
+		}
+		goto out_parent;
+	} else if (dirent && dirent->chunk == chunk) {
+		/* The FSAL repeated itself */
+		goto out;
+	} else if (dirent) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "%s moved from chunk %p to chunk %p, freeing it",
+			     name, dirent->chunk, chunk);
+		mdcache_free_dir_chunk(dirent->chunk);
+	}
+
+	allocated = mdc_alloc_chunk_dirent(name, new_entry, cookie);
+	dirent = allocated;
+
+	code = mdcache_avl_qp_insert(mdc_parent, &dirent);
+	if (code < 0 || dirent != allocated) {
+		/* Hash collision, or somehow still there; leave it out */
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Could not cache dirent %s in dir %p, code %d",
+			 name, mdc_parent, code);
+		goto out;
+	}
+
+	if (mdc_chunk_append(chunk, dirent, cookie) < 0) {
+		/* Can't happen, we just looked */
+		mdcache_avl_remove(mdc_parent, dirent);
+		mdcache_key_delete(&dirent->ckey);
+		mdcache_dirent_free(dirent);
+		goto out;
+	}
 
-	if (status.major == ERR_FSAL_EXIST)
-		status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	mdc_parent->fsobj.fsdir.nbactive++;
 
-	if (!FSAL_IS_ERROR(status) && new_entry->obj_handle.type == DIRECTORY) {
+out_parent:
+	if (new_entry->obj_handle.type == DIRECTORY) {
 		/* Insert Parent's key */
 		mdc_dir_add_parent(new_entry, mdc_parent);
 	}
 
+out:
 	mdcache_put(new_entry);
 
 	return status;
@@ -860,15 +1137,13 @@ fsal_status_t mdc_try_get_cached(mdcache_entry_t *mdc_parent,
 
 	*entry = NULL;
 
-	/* If parent isn't caching, return stale */
-	if (mdc_parent->mde_flags & MDCACHE_BYPASS_DIRCACHE)
-		return fsalstat(ERR_FSAL_STALE, 0);
-
 	/* If the dirent cache is untrustworthy, don't even ask it */
 	if (!(mdc_parent->mde_flags & MDCACHE_TRUST_CONTENT))
 		return fsalstat(ERR_FSAL_STALE, 0);
 
 	dirent = mdcache_avl_qp_lookup_s(mdc_parent, name, 1);
+	if (!dirent)
+		dirent = mdc_staged_lookup(mdc_parent, name);
 	if (dirent) {
 		status = mdcache_find_keyed(&dirent->ckey, entry);
 		if (!FSAL_IS_ERROR(status))
@@ -938,11 +1213,6 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 		goto out;
 	}
 
-	if (mdc_parent->mde_flags & MDCACHE_BYPASS_DIRCACHE) {
-		/* Parent isn't caching dirents; call directly */
-		goto uncached;
-	}
-
 	/* We first try avltree_lookup by name.  If that fails, we dispatch to
 	 * the FSAL. */
 	status = mdc_try_get_cached(mdc_parent, name, new_entry);
@@ -957,6 +1227,13 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 
 		status = mdc_try_get_cached(mdc_parent, name, new_entry);
 	}
+	if (status.major == ERR_FSAL_STALE &&
+	    mdcache_neg_lookup(mdc_parent, name)) {
+		/* Recently looked up and not found */
+		LogFullDebug(COMPONENT_CACHE_INODE, "Negative hit %s", name);
+		status = fsalstat(ERR_FSAL_NOENT, 0);
+		goto out;
+	}
 	if (!FSAL_IS_ERROR(status)) {
 		/* Success! Now fetch attr if requested, drop content_lock
 		 * to avoid ABBA locking situation.
@@ -999,9 +1276,11 @@ fsal_status_t mdc_lookup(mdcache_entry_t *mdc_parent, const char *name,
 	}
 
 	LogDebug(COMPONENT_CACHE_INODE, "Cache Miss detected for %s", name);
+	gsh_trace(TRACE_CACHE_MISS, __func__, 0, __LINE__);
 
-uncached:
 	status = mdc_lookup_uncached(mdc_parent, name, new_entry, attrs_out);
+	if (status.major == ERR_FSAL_NOENT)
+		mdcache_neg_insert(mdc_parent, name);
 
 out:
 	PTHREAD_RWLOCK_unlock(&mdc_parent->content_lock);
@@ -1039,9 +1318,7 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	 * until asked for it (including a permission check).
 	 */
 	fsal_prepare_attrs(&attrs,
-			   op_ctx->fsal_export->exp_ops.
-				   fs_supported_attrs(op_ctx->fsal_export)
-				   & ~ATTR_ACL);
+			   mdc_supported_attrs() & ~ATTR_ACL);
 
 	subcall(
 		status = mdc_parent->sub_handle->obj_ops.lookup(
@@ -1060,7 +1337,7 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	status = mdcache_alloc_and_check_handle(export, sub_handle, &new_obj,
 						false, &attrs, attrs_out,
 						"lookup ", mdc_parent, name,
-						true, NULL);
+						false, true, NULL);
 
 	fsal_release_attrs(&attrs);
 
@@ -1073,86 +1350,6 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 	return status;
 }
 
-/**
- * @brief Lock two directories in order
- *
- * This function gets the locks on both entries. If src and dest are
- * the same, it takes only one lock.  Locks are acquired with lowest
- * cache_entry first to avoid deadlocks.
- *
- * @param[in] src  Source directory to lock
- * @param[in] dest Destination directory to lock
- */
-
-void
-mdcache_src_dest_lock(mdcache_entry_t *src, mdcache_entry_t *dest)
-{
-	int rc;
-
-	/*
-	 * A problem found in this order
-	 * 1. mdcache_readdir holds A's content_lock, and tries to
-	 * grab B's attr_lock.
-	 * 2. mdcache_remove holds B's attr_lock, and tries to grab B's
-	 * content_lock
-	 * 3. mdcache_rename holds B's content_lock, and tries to grab the
-	 * A's content_lock (which is held by thread 1).
-	 * This change is to avoid this deadlock.
-	 */
-
-retry_lock:
-	if (src == dest)
-		PTHREAD_RWLOCK_wrlock(&src->content_lock);
-	else if (src < dest) {
-		PTHREAD_RWLOCK_wrlock(&src->content_lock);
-		rc = pthread_rwlock_trywrlock(&dest->content_lock);
-		if (rc) {
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "retry dest %p lock, src %p",
-				 dest, src);
-			PTHREAD_RWLOCK_unlock(&src->content_lock);
-			sleep(1);
-			goto retry_lock;
-		}
-	} else {
-		PTHREAD_RWLOCK_wrlock(&dest->content_lock);
-		rc = pthread_rwlock_trywrlock(&src->content_lock);
-		if (rc) {
-			LogDebug(COMPONENT_CACHE_INODE,
-				 "retry src %p lock, dest %p",
-				 src, dest);
-			PTHREAD_RWLOCK_unlock(&dest->content_lock);
-			sleep(1);
-			goto retry_lock;
-		}
-	}
-}
-
-/**
- * @brief Unlock two directories in order
- *
- * This function releases the locks on both entries. If src and dest
- * are the same, it releases the lock and returns.  Locks are released
- * with lowest cache_entry first.
- *
- * @param[in] src  Source directory to lock
- * @param[in] dest Destination directory to lock
- */
-
-void
-mdcache_src_dest_unlock(mdcache_entry_t *src, mdcache_entry_t *dest)
-{
-	if (src == dest)
-		PTHREAD_RWLOCK_unlock(&src->content_lock);
-	else if (src < dest) {
-		PTHREAD_RWLOCK_unlock(&dest->content_lock);
-		PTHREAD_RWLOCK_unlock(&src->content_lock);
-	} else {
-		PTHREAD_RWLOCK_unlock(&src->content_lock);
-		PTHREAD_RWLOCK_unlock(&dest->content_lock);
-	}
-}
-
 /**
  * @brief Find a cached directory entry
  *
@@ -1200,48 +1397,66 @@ fsal_status_t mdcache_dirent_find(mdcache_entry_t *dir, const char *name,
 }
 
 /**
+ * @brief Add a dirent to the detached list of a directory
  *
- * @brief Adds a directory entry to a cached directory.
- *
- * This function adds a new directory entry to a directory.  Directory
- * entries have only weak references, so they do not prevent recycling
- * or freeing the entry they locate.  This function may be called
- * either once (for handling creation) or iteratively in directory
- * population.
+ * The oldest detached dirents are dropped beyond Dir_Max.  When the name is
+ * new to the directory, every chunk read so far may be missing it, so they
+ * are all marked stale.
  *
  * @note Caller MUST hold the content_lock for write
  *
- * @param[in,out] parent    Cache entry of the directory being updated
- * @param[in]     name      The name to add to the entry
- * @param[in]     entry     The cache entry associated with name
- *
- * @return FSAL status
+ * @param[in,out] parent    Directory
+ * @param[in]     dirent    Dirent, already in the name tree
+ * @param[in]     new_name  The name was just created
  */
 
-fsal_status_t
-mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
-		   mdcache_entry_t *entry)
+static void
+mdc_detached_add(mdcache_entry_t *parent, mdcache_dir_entry_t *dirent,
+		 bool new_name)
 {
-	mdcache_dir_entry_t *new_dir_entry = NULL;
-	size_t namesize = strlen(name) + 1;
-	int code = 0;
+	mdcache_dir_entry_t *oldest;
 
-	LogFullDebug(COMPONENT_CACHE_INODE, "Add dir entry %s", name);
+	glist_add_tail(&parent->fsobj.fsdir.detached, &dirent->chunk_list);
+	parent->fsobj.fsdir.ndetached++;
 
-	/* Sanity check */
-	if (parent->obj_handle.type != DIRECTORY)
-		return fsalstat(ERR_FSAL_NOTDIR, 0);
+	if (new_name)
+		parent->fsobj.fsdir.chunk_gen++;
 
-	/* Don't cache if parent is not being cached */
-	if (parent->mde_flags & MDCACHE_BYPASS_DIRCACHE)
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	while (parent->fsobj.fsdir.ndetached > mdcache_param.dir.avl_max) {
+		oldest = glist_first_entry(&parent->fsobj.fsdir.detached,
+					   mdcache_dir_entry_t, chunk_list);
 
-	/* in cache avl, we always insert on pentry_parent */
-	new_dir_entry = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + namesize);
-	new_dir_entry->flags = DIR_ENTRY_FLAG_NONE;
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "Dropping detached dir entry %p %s",
+			     oldest, oldest->name);
+
+		mdcache_avl_remove(parent, oldest);
+		glist_del(&oldest->chunk_list);
+		parent->fsobj.fsdir.ndetached--;
+		parent->fsobj.fsdir.nbactive--;
+		mdcache_key_delete(&oldest->ckey);
+		mdcache_dirent_free(oldest);
+
+		/* The cache no longer knows every name */
+		atomic_clear_uint32_t_bits(&parent->mde_flags,
+					   MDCACHE_DIR_POPULATED);
+	}
+}
 
-	memcpy(&new_dir_entry->name, name, namesize);
-	mdcache_key_dup(&new_dir_entry->ckey, &entry->fh_hk.key);
+/**
+ * @brief Insert a new detached dirent in the name tree
+ *
+ * The dirent is freed if the name is already there.
+ *
+ * @note Caller MUST hold the content_lock for write
+ */
+
+static fsal_status_t
+mdc_dirent_insert(mdcache_entry_t *parent, mdcache_dir_entry_t *new_dir_entry,
+		  bool new_name)
+{
+	mdcache_dir_entry_t *allocated = new_dir_entry;
+	int code = 0;
 
 	/* add to avl */
 	code = mdcache_avl_qp_insert(parent, &new_dir_entry);
@@ -1253,32 +1468,255 @@ mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
 		return fsalstat(ERR_FSAL_EXIST, 0);
 	}
 
+	if (new_dir_entry != allocated) {
+		/* Already cached, nothing changed */
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
 	/* we're going to succeed */
 	parent->fsobj.fsdir.nbactive++;
+	mdc_detached_add(parent, new_dir_entry, new_name);
 
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
+static mdcache_dir_entry_t *
+mdc_new_dirent(const char *name, mdcache_entry_t *entry)
+{
+	mdcache_dir_entry_t *dirent;
+	size_t namesize = strlen(name) + 1;
+
+	dirent = mdcache_dirent_alloc(namesize);
+	dirent->flags = DIR_ENTRY_FLAG_NONE;
+	memcpy(&dirent->name, name, namesize);
+	mdcache_key_dup(&dirent->ckey, &entry->fh_hk.key);
+	return dirent;
+}
+
 /**
- * @brief Remove a cached directory entry
+ *
+ * @brief Adds a directory entry to a cached directory.
+ *
+ * This function adds a new directory entry to a directory, for a name found
+ * by lookup or made by create, link or rename.  Directory entries have only
+ * weak references, so they do not prevent recycling or freeing the entry
+ * they locate.  The dirent is detached: it has no cookie until a readdir
+ * reads it into a chunk.
  *
  * @note Caller MUST hold the content_lock for write
  *
- * @param[in] parent	Parent directory
- * @param[in] name	Name to remove
+ * @param[in,out] parent    Cache entry of the directory being updated
+ * @param[in]     name      The name to add to the entry
+ * @param[in]     entry     The cache entry associated with name
+ * @param[in]     new_name  The name was just created in the directory
+ *
  * @return FSAL status
  */
+
 fsal_status_t
-mdcache_dirent_remove(mdcache_entry_t *parent, const char *name)
+mdcache_dirent_add(mdcache_entry_t *parent, const char *name,
+		   mdcache_entry_t *entry, bool new_name)
 {
-	mdcache_dir_entry_t *dirent;
-	fsal_status_t status;
+	LogFullDebug(COMPONENT_CACHE_INODE, "Add dir entry %s", name);
 
-	LogFullDebug(COMPONENT_CACHE_INODE, "Remove dir entry %s", name);
+	/* Sanity check */
+	if (parent->obj_handle.type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
 
-	status = mdcache_dirent_find(parent, name, &dirent);
-	if (FSAL_IS_ERROR(status)) {
-		if (status.major == ERR_FSAL_NOENT)
+	mdc_dirent_fold(parent);
+	mdcache_neg_remove(parent, name);
+
+	/* in cache avl, we always insert on pentry_parent */
+	return mdc_dirent_insert(parent, mdc_new_dirent(name, entry),
+				 new_name);
+}
+
+static inline mdcache_dir_entry_t *
+mdc_staged_next(mdcache_dir_entry_t *dirent)
+{
+	if (dirent->chunk_list.next == NULL)
+		return NULL;
+	return glist_entry(dirent->chunk_list.next, mdcache_dir_entry_t,
+			   chunk_list);
+}
+
+/**
+ * @brief Find a staged dirent
+ *
+ * @note Caller MUST hold the content_lock for read
+ *
+ * @param[in] dir   Directory
+ * @param[in] name  Name to find
+ *
+ * @return the newest dirent staged for the name, or NULL.
+ */
+
+static mdcache_dir_entry_t *
+mdc_staged_lookup(mdcache_entry_t *dir, const char *name)
+{
+	mdcache_dir_entry_t *dirent;
+
+	for (dirent = atomic_fetch_voidptr((void **)&dir->fsobj.fsdir.staged);
+	     dirent != NULL; dirent = mdc_staged_next(dirent))
+		if (strcmp(dirent->name, name) == 0)
+			return dirent;
+	return NULL;
+}
+
+/**
+ * @brief Move the staged dirents of a directory into its name tree
+ *
+ * They are inserted oldest first, as detached dirents.  A dirent whose
+ * name got into the tree meanwhile is dropped.
+ *
+ * @note Caller MUST hold the content_lock for write
+ *
+ * @param[in,out] dir  Directory
+ */
+
+static void
+mdc_dirent_fold(mdcache_entry_t *dir)
+{
+	mdcache_dir_entry_t *dirent, *next, *oldest = NULL;
+
+	if (dir->obj_handle.type != DIRECTORY ||
+	    dir->fsobj.fsdir.staged == NULL)
+		return;
+
+	for (dirent = dir->fsobj.fsdir.staged; dirent != NULL;
+	     dirent = next) {
+		next = mdc_staged_next(dirent);
+		dirent->chunk_list.next = oldest != NULL
+					  ? &oldest->chunk_list : NULL;
+		oldest = dirent;
+	}
+	dir->fsobj.fsdir.staged = NULL;
+	dir->fsobj.fsdir.nstaged = 0;
+
+	for (dirent = oldest; dirent != NULL; dirent = next) {
+		next = mdc_staged_next(dirent);
+		(void) mdc_dirent_insert(dir, dirent, false);
+	}
+}
+
+/**
+ * @brief Stage the dirent of a new name
+ *
+ * @note Caller MUST hold the content_lock for read
+ *
+ * @retval ERR_FSAL_STALE if it takes the content_lock for write: the
+ *         name is cached for another object, or too many are staged.
+ */
+
+static fsal_status_t
+mdc_dirent_stage(mdcache_entry_t *parent, const char *name,
+		 mdcache_entry_t *entry, bool new_name)
+{
+	mdcache_dir_entry_t *dirent, *head;
+
+	dirent = mdcache_avl_qp_lookup_s(parent, name, 1);
+	if (dirent == NULL)
+		dirent = mdc_staged_lookup(parent, name);
+	if (dirent != NULL) {
+		if (mdcache_key_cmp(&dirent->ckey, &entry->fh_hk.key) != 0)
+			return fsalstat(ERR_FSAL_STALE, 0);
+		/* Already cached */
+		mdcache_neg_remove(parent, name);
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	if (atomic_inc_uint32_t(&parent->fsobj.fsdir.nstaged) >
+	    MDCACHE_DIRENT_STAGE_MAX) {
+		(void) atomic_dec_uint32_t(&parent->fsobj.fsdir.nstaged);
+		return fsalstat(ERR_FSAL_STALE, 0);
+	}
+
+	dirent = mdc_new_dirent(name, entry);
+	do {
+		head = atomic_fetch_voidptr(
+				(void **)&parent->fsobj.fsdir.staged);
+		dirent->chunk_list.next = head != NULL
+					  ? &head->chunk_list : NULL;
+	} while (!atomic_cmpxchg_voidptr((void **)&parent->fsobj.fsdir.staged,
+					 head, dirent));
+
+	/* Visible to lookups from now on */
+	mdcache_neg_remove(parent, name);
+	if (new_name)
+		(void) atomic_inc_uint64_t(&parent->fsobj.fsdir.chunk_gen);
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
+/**
+ * @brief Add the dirent of a new or found name, taking the content_lock
+ *
+ * Creates in one directory only need its content_lock for read: the
+ * dirent is pushed on the staged list of the directory without a lock,
+ * and lookups search that list after the name tree.  The next holder of
+ * the lock for write, to remove, rename, populate or invalidate, moves
+ * the staged dirents into the name tree first.  A directory, whose
+ * parent key is set here, or a name that does not stage, takes the lock
+ * for write.
+ *
+ * @note Caller MUST NOT hold the content_lock
+ *
+ * @param[in,out] parent    Cache entry of the directory being updated
+ * @param[in]     name      The name to add to the entry
+ * @param[in]     entry     The cache entry associated with name
+ * @param[in]     new_name  The name was just created in the directory
+ *
+ * @return FSAL status
+ */
+
+fsal_status_t
+mdcache_dirent_add_shared(mdcache_entry_t *parent, const char *name,
+			  mdcache_entry_t *entry, bool new_name)
+{
+	fsal_status_t status = fsalstat(ERR_FSAL_STALE, 0);
+
+	if (parent->obj_handle.type != DIRECTORY)
+		return fsalstat(ERR_FSAL_NOTDIR, 0);
+
+	if (entry->obj_handle.type != DIRECTORY) {
+		PTHREAD_RWLOCK_rdlock(&parent->content_lock);
+		status = mdc_dirent_stage(parent, name, entry, new_name);
+		PTHREAD_RWLOCK_unlock(&parent->content_lock);
+		if (status.major != ERR_FSAL_STALE)
+			return status;
+	}
+
+	PTHREAD_RWLOCK_wrlock(&parent->content_lock);
+	status = mdcache_dirent_add(parent, name, entry, new_name);
+	if (!FSAL_IS_ERROR(status) && entry->obj_handle.type == DIRECTORY)
+		mdc_dir_add_parent(entry, parent);
+	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+
+	return status;
+}
+
+/**
+ * @brief Remove a cached directory entry
+ *
+ * @note Caller MUST hold the content_lock for write
+ *
+ * @param[in] parent	Parent directory
+ * @param[in] name	Name to remove
+ * @return FSAL status
+ */
+fsal_status_t
+mdcache_dirent_remove(mdcache_entry_t *parent, const char *name)
+{
+	mdcache_dir_entry_t *dirent;
+	fsal_status_t status;
+
+	LogFullDebug(COMPONENT_CACHE_INODE, "Remove dir entry %s", name);
+
+	mdc_dirent_fold(parent);
+
+	status = mdcache_dirent_find(parent, name, &dirent);
+	if (FSAL_IS_ERROR(status)) {
+		if (status.major == ERR_FSAL_NOENT)
 			/* Wasn't there */
 			return fsalstat(ERR_FSAL_NO_ERROR, 0);
 		return status;
@@ -1315,9 +1753,8 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 		     "Rename dir entry %s to %s",
 		     oldname, newname);
 
-	/* Don't rename if parent is not being cached */
-	if (parent->mde_flags & MDCACHE_BYPASS_DIRCACHE)
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	mdc_dirent_fold(parent);
+	mdcache_neg_remove(parent, newname);
 
 	status = mdcache_dirent_find(parent, oldname, &dirent);
 	if (FSAL_IS_ERROR(status))
@@ -1343,6 +1780,7 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 
 			/* Delete dirent for oldname */
 			avl_dirent_set_deleted(parent, dirent);
+			parent->fsobj.fsdir.nbactive--;
 
 			if (oldentry) {
 				/* if it is still around, mark it gone/stale */
@@ -1362,7 +1800,7 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 	size_t newnamesize = strlen(newname) + 1;
 
 	/* try to rename--no longer in-place */
-	dirent2 = gsh_calloc(1, sizeof(mdcache_dir_entry_t) + newnamesize);
+	dirent2 = mdcache_dirent_alloc(newnamesize);
 	memcpy(dirent2->name, newname, newnamesize);
 	dirent2->flags = DIR_ENTRY_FLAG_NONE;
 	mdcache_key_dup(&dirent2->ckey, &dirent->ckey);
@@ -1381,9 +1819,13 @@ mdcache_dirent_rename(mdcache_entry_t *parent, const char *oldname,
 		 * purposes). Just abandon...
 		 */
 		/* dirent2 was never inserted */
+		parent->fsobj.fsdir.nbactive--;
 		return fsalstat(ERR_FSAL_SERVERFAULT, 0);
 	}
 
+	/* The new name has no cookie yet */
+	mdc_detached_add(parent, dirent2, true);
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
 
@@ -1395,17 +1837,19 @@ struct mdcache_populate_cb_state {
 	struct mdcache_fsal_export *export;
 	mdcache_entry_t *dir;
 	fsal_status_t *status;
-	uint64_t offset_cookie;
-	fsal_readdir_cb cb;
-	void *dir_state;
+	struct dir_chunk *chunk;
 };
 
 /**
- * @brief Handle a readdir callback on uncache dir
+ * @brief Populate a single dir entry
  *
- * Cache a sindle object, passing it up the stack to the caller.  This is for
- * handling readdir on a directory that is not being cached, for example because
- * is is too big.  Dirents are not created by this callback, just objects.
+ * This callback serves to populate a single dir entry from the
+ * readdir into the chunk being read.
+ *
+ * NOTE: Attributes are passed up from sub-FSAL, it will call
+ * fsal_release_attrs, though if we do an fsal_copy_attrs(dest, src, true), any
+ * references will have been transferred to the mdcache entry and the FSAL's
+ * fsal_release_attrs will not really have anything to do.
  *
  * @param[in]     name       Name of the directory entry
  * @param[in]     sub_handle Object for entry
@@ -1418,21 +1862,20 @@ struct mdcache_populate_cb_state {
  */
 
 static bool
-mdc_readdir_uncached_cb(const char *name, struct fsal_obj_handle *sub_handle,
-			struct attrlist *attrs, void *dir_state,
-			fsal_cookie_t cookie)
+mdc_populate_dirent(const char *name, struct fsal_obj_handle *sub_handle,
+		    struct attrlist *attrs, void *dir_state,
+		    fsal_cookie_t cookie)
 {
 	struct mdcache_populate_cb_state *state = dir_state;
 	fsal_status_t status = { 0, 0 };
 	mdcache_entry_t *directory = container_of(&state->dir->obj_handle,
 						  mdcache_entry_t, obj_handle);
-	mdcache_entry_t *new_entry = NULL;
-	bool rv;
+	struct dir_chunk *chunk = state->chunk;
 
 	/* This is in the middle of a subcall. Do a supercall */
 	supercall_raw(state->export,
-		status = mdcache_new_entry(state->export, sub_handle, attrs,
-					   NULL, false, &new_entry, NULL)
+		status = mdc_add_cache(directory, chunk, name, sub_handle,
+				       attrs, cookie)
 	);
 
 	if (FSAL_IS_ERROR(status)) {
@@ -1449,147 +1892,101 @@ mdc_readdir_uncached_cb(const char *name, struct fsal_obj_handle *sub_handle,
 		return false;
 	}
 
-	/* Call up the stack.  Do a supercall */
-	supercall_raw(state->export,
-		      rv = state->cb(name, &new_entry->obj_handle, attrs,
-				     state->dir_state, cookie)
-	);
-
-	return rv;
+	/* Stop at a full chunk, or on reaching a cached one */
+	return chunk->num_entries < mdcache_param.dir.avl_chunk &&
+	       chunk->next == NULL;
 }
 
 /**
- * Perform an uncached readdir
- *
- * Large directories do not have their dirents cached.  This performs readdir on
- * such directories, by passing the sub-FSAL's results back up through the
- * stack.
+ * @brief Link a chunk to the chunk holding the cookie it was read from
  *
- * @note The object passed into the callback is ref'd and must be unref'd by the
- * callback.
+ * The chunks are only linked if that cookie is the last of its chunk.
  *
- * @param[in] directory the directory to read
- * @param[in] whence where to start (next)
- * @param[in] dir_state pass thru of state to callback
- * @param[in] cb callback function
- * @param[in] attrmask Which attributes to fill
- * @param[out] eod_met eod marker true == end of dir
+ * @note dir MUST have it's content_lock held for writing
  *
- * @return FSAL status
+ * @param[in] dir     The directory
+ * @param[in] whence  Cookie @a chunk was read from
+ * @param[in] chunk   The chunk
  */
-fsal_status_t
-mdcache_readdir_uncached(mdcache_entry_t *directory, fsal_cookie_t *whence,
-			 void *dir_state, fsal_readdir_cb cb,
-			 attrmask_t attrmask, bool *eod_met)
+
+static void
+mdc_link_prev_chunk(mdcache_entry_t *dir, fsal_cookie_t whence,
+		    struct dir_chunk *chunk)
 {
-	fsal_status_t status = {0, 0};
-	fsal_status_t readdir_status = {0, 0};
-	struct mdcache_populate_cb_state state;
+	mdcache_dir_entry_t *dirent;
+	struct dir_chunk *prev;
 
-	state.export = mdc_cur_export();
-	state.dir = directory;
-	state.status = &status;
-	state.offset_cookie = 0; /* Uncached dirs don't use cookie */
-	state.cb = cb;
-	state.dir_state = dir_state;
+	if (whence == 0 || chunk->prev != NULL)
+		return;
 
-	subcall(
-		readdir_status = directory->sub_handle->obj_ops.readdir(
-			directory->sub_handle, whence, &state,
-			mdc_readdir_uncached_cb, attrmask, eod_met)
-	       );
+	dirent = mdcache_avl_lookup_ck(dir, whence);
+	if (dirent == NULL)
+		return;
 
-	if (FSAL_IS_ERROR(readdir_status))
-		return readdir_status;
+	prev = dirent->chunk;
+	if (prev == chunk || prev->next != NULL ||
+	    &dirent->chunk_list != prev->dirents.prev)
+		return;
 
-	return status;
+	prev->next = chunk;
+	chunk->prev = prev;
+	dir->fsobj.fsdir.nlinks++;
 }
 
 /**
- * @brief Populate a single dir entry
- *
- * This callback serves to populate a single dir entry from the
- * readdir.
+ * @brief Mark the directory populated once its chunks cover it
  *
- * NOTE: Attributes are passed up from sub-FSAL, it will call
- * fsal_release_attrs, though if we do an fsal_copy_attrs(dest, src, true), any
- * references will have been transferred to the mdcache entry and the FSAL's
- * fsal_release_attrs will not really have anything to do.
+ * That is, when the chunk read from cookie 0 is linked, chunk by chunk, to
+ * the chunk that reached the end of the directory.
  *
- * @param[in]     name       Name of the directory entry
- * @param[in]     sub_handle Object for entry
- * @param[in]     attrs      Attributes requested for the object
- * @param[in,out] dir_state  Callback state
- * @param[in]     cookie     Directory cookie
- *
- * @retval true if more entries are requested
- * @retval false if no more should be sent and the last was not processed
+ * @param[in] dir  The directory
  */
 
-static bool
-mdc_populate_dirent(const char *name, struct fsal_obj_handle *sub_handle,
-		    struct attrlist *attrs, void *dir_state,
-		    fsal_cookie_t cookie)
+static inline void
+mdc_check_populated(mdcache_entry_t *dir)
 {
-	struct mdcache_populate_cb_state *state = dir_state;
-	fsal_status_t status = { 0, 0 };
-	mdcache_entry_t *directory = container_of(&state->dir->obj_handle,
-						  mdcache_entry_t, obj_handle);
-
-	/* This is in the middle of a subcall. Do a supercall */
-	supercall_raw(state->export,
-		status = mdc_add_cache(directory, name, sub_handle, attrs)
-	);
-
-	if (FSAL_IS_ERROR(status)) {
-		*state->status = status;
-		if (status.major == ERR_FSAL_XDEV) {
-			LogInfo(COMPONENT_NFS_READDIR,
-				"Ignoring XDEV entry %s", name);
-			*state->status = fsalstat(ERR_FSAL_NO_ERROR, 0);
-			return true;
-		}
-		if ((*state->status).major == ERR_FSAL_OVERFLOW) {
-			LogFullDebug(COMPONENT_CACHE_INODE,
-				     "Lookup failed on %s in dir %p with %s",
-				     name, directory,
-				     fsal_err_txt(*state->status));
-		} else {
-			LogInfo(COMPONENT_CACHE_INODE,
-				"Lookup failed on %s in dir %p with %s",
-				name, directory, fsal_err_txt(*state->status));
-		}
-		return false;
-	}
-
-	return true;
+	if (dir->fsobj.fsdir.first != NULL && dir->fsobj.fsdir.last != NULL &&
+	    dir->fsobj.fsdir.nlinks + 1 == dir->fsobj.fsdir.nchunks)
+		atomic_set_uint32_t_bits(&dir->mde_flags,
+					 MDCACHE_DIR_POPULATED);
 }
 
 /**
  *
- * @brief Cache complete directory contents
+ * @brief Read a chunk of dirents
  *
- * This function reads a complete directory from the FSAL and caches
- * both the names and files.  The content lock must be held on the
- * directory being read.
+ * This function reads up to Dir_Chunk dirents from the FSAL, starting after
+ * cookie @a whence, and caches both the names and files.  Reading stops
+ * early on reaching a chunk that is already cached; the new chunk is linked
+ * to it.
+ *
+ * On success, @a chunkp is the chunk holding the dirents after @a whence,
+ * which may be an older one if nothing came before it, or NULL if there are
+ * no more dirents.
  *
  * @note dir MUST have it's content_lock held for writing
  *
- * @param[in] dir  Entry for the parent directory to be read
+ * @param[in]  dir     Entry for the parent directory to be read
+ * @param[in]  whence  Cookie to read after, 0 for the start
+ * @param[out] chunkp  The chunk
  *
  * @return FSAL status
  */
 
 fsal_status_t
-mdcache_dirent_populate(mdcache_entry_t *dir)
+mdcache_dirent_load_chunk(mdcache_entry_t *dir, fsal_cookie_t whence,
+			  struct dir_chunk **chunkp)
 {
 	fsal_status_t fsal_status;
 	fsal_status_t status = {0, 0};
 	bool eod = false;
 	attrmask_t attrmask;
-
+	struct dir_chunk *chunk, *next;
+	mdcache_dir_entry_t *dirent;
 	struct mdcache_populate_cb_state state;
 
+	*chunkp = NULL;
+
 	/* Only DIRECTORY entries are concerned */
 	if (dir->obj_handle.type != DIRECTORY) {
 		LogDebug(COMPONENT_NFS_READDIR,
@@ -1597,62 +1994,379 @@ mdcache_dirent_populate(mdcache_entry_t *dir)
 		return fsalstat(ERR_FSAL_NOTDIR, 0);
 	}
 
-	if ((dir->mde_flags & MDCACHE_DIR_POPULATED)
-	    && (dir->mde_flags & MDCACHE_TRUST_CONTENT)) {
-		LogFullDebug(COMPONENT_NFS_READDIR,
-			     "MDCACHE_DIR_POPULATED and MDCACHE_TRUST_CONTENT");
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
-	}
-
-	/* Invalidate all the dirents */
-	mdcache_dirent_invalidate_all(dir);
+	chunk = gsh_calloc(1, sizeof(struct dir_chunk));
+	(void)atomic_add_uint64_t(&cache_stp->mem_dirents,
+				  sizeof(struct dir_chunk));
+	glist_init(&chunk->dirents);
+	chunk->parent = dir;
+	chunk->whence = whence;
+	chunk->gen = dir->fsobj.fsdir.chunk_gen;
+	glist_add_tail(&dir->fsobj.fsdir.chunks, &chunk->chunks);
+	dir->fsobj.fsdir.nchunks++;
 
 	state.export = mdc_cur_export();
 	state.dir = dir;
 	state.status = &status;
-	state.offset_cookie = 0;
-	state.cb = NULL; /* cached dirs don't use callback */
-	state.dir_state = NULL; /* cached dirs don't use dir_state */
+	state.chunk = chunk;
 
-	attrmask = op_ctx->fsal_export->exp_ops.fs_supported_attrs(
-					op_ctx->fsal_export) | ATTR_RDATTR_ERR;
+	/* The ACL of an entry is fetched when something asks for it */
+	attrmask = (mdc_supported_attrs() & ~ATTR_ACL) | ATTR_RDATTR_ERR;
+
+	LogFullDebug(COMPONENT_NFS_READDIR,
+		     "Reading chunk %p of dir %p after cookie %" PRIu64,
+		     chunk, dir, whence);
 
 	subcall_raw(state.export,
 		fsal_status = dir->sub_handle->obj_ops.readdir(
-			dir->sub_handle, NULL, (void *)&state,
-			mdc_populate_dirent, attrmask, &eod)
+			dir->sub_handle, whence != 0 ? &whence : NULL,
+			(void *)&state, mdc_populate_dirent, attrmask, &eod)
 	       );
 	if (FSAL_IS_ERROR(fsal_status)) {
 
 		LogDebug(COMPONENT_NFS_READDIR, "FSAL readdir status=%s",
 			 fsal_err_txt(fsal_status));
+		mdcache_free_dir_chunk(chunk);
 		return fsal_status;
 	}
 
-	if (status.major == ERR_FSAL_OVERFLOW)
+	if (FSAL_IS_ERROR(status) && chunk->num_entries == 0) {
+		/* The callback failed before caching anything */
+		mdcache_free_dir_chunk(chunk);
 		return status;
+	}
 
-	/* we were supposed to read to the end.... */
-	if (!eod && mdcache_param.retry_readdir) {
+	if (!eod && !FSAL_IS_ERROR(status) && chunk->next == NULL &&
+	    chunk->num_entries < mdcache_param.dir.avl_chunk &&
+	    mdcache_param.retry_readdir) {
+		/* we were supposed to read a full chunk.... */
 		LogInfo(COMPONENT_NFS_READDIR,
 			"Readdir didn't reach eod on dir %p (status %s)",
 			&dir->sub_handle, fsal_err_txt(status));
+		mdcache_free_dir_chunk(chunk);
 		return fsalstat(ERR_FSAL_DELAY, 0);
-	} else if (eod) {
-		/* End of work */
-		atomic_set_uint32_t_bits(&dir->mde_flags,
-					 MDCACHE_DIR_POPULATED);
+	}
 
-		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+	/* A chunk that reached a cached one stops short of the end */
+	chunk->eod = eod && chunk->next == NULL;
+
+	if (chunk->num_entries == 0 && chunk->next != NULL) {
+		/* Nothing before the chunk we reached; use it instead */
+		next = chunk->next;
+		mdcache_free_dir_chunk(chunk);
+		chunk = next;
+		if (whence == 0 && dir->fsobj.fsdir.first == NULL)
+			dir->fsobj.fsdir.first = chunk;
+		mdc_link_prev_chunk(dir, whence, chunk);
+		goto out;
+	}
+
+	if (chunk->num_entries == 0 && whence != 0) {
+		/* Nothing after whence; its chunk ends the directory */
+		mdcache_free_dir_chunk(chunk);
+		dirent = mdcache_avl_lookup_ck(dir, whence);
+		if (dirent != NULL &&
+		    &dirent->chunk_list == dirent->chunk->dirents.prev &&
+		    dirent->chunk->next == NULL) {
+			if (dir->fsobj.fsdir.last != NULL &&
+			    dir->fsobj.fsdir.last != dirent->chunk)
+				mdcache_free_dir_chunk(dir->fsobj.fsdir.last);
+			dirent->chunk->eod = true;
+			dir->fsobj.fsdir.last = dirent->chunk;
+			mdc_check_populated(dir);
+		}
+		return status;
 	}
 
-	/* If !eod (and fsal_status isn't an error), then the only error path
-	 * is through a callback failure and status has been set the
-	 * mdc_populate_dirent callback */
+	if (chunk->eod) {
+		/* An older last chunk is out of date */
+		if (dir->fsobj.fsdir.last != NULL)
+			mdcache_free_dir_chunk(dir->fsobj.fsdir.last);
+		dir->fsobj.fsdir.last = chunk;
+	}
+
+	if (whence == 0 && dir->fsobj.fsdir.first == NULL)
+		dir->fsobj.fsdir.first = chunk;
+
+	if (!chunk->eod && chunk->next == NULL &&
+	    chunk->num_entries >= mdcache_param.dir.avl_chunk) {
+		/* Read ahead once the client is half way through */
+		uint32_t i = chunk->num_entries / 2;
+		struct glist_head *node = chunk->dirents.next;
+
+		while (--i > 0)
+			node = node->next;
+		chunk->ra_ck = glist_entry(node, mdcache_dir_entry_t,
+					   chunk_list)->ck;
+	}
+
+	mdc_link_prev_chunk(dir, whence, chunk);
+	mdcache_lru_insert_chunk(chunk);
+
+out:
+	mdc_check_populated(dir);
+	*chunkp = chunk;
+
+	/* Make room for what we just read */
+	mdcache_lru_reap_chunks(dir, chunk);
 
 	return status;
 }
 
+static struct fridgethr *readahead_fridge;
+
+/**
+ * @brief A background read of the chunk after a cookie
+ */
+
+struct mdc_readahead {
+	mdcache_entry_t *dir;		/*< Directory, ref'd */
+	fsal_cookie_t whence;		/*< Last cookie of the chunk before */
+	struct gsh_export *export;	/*< Export of the READDIR, ref'd */
+	struct fsal_export *fsal_export;	/*< Its MDCACHE export */
+	struct user_cred creds;		/*< Credentials of the READDIR */
+};
+
+static void mdc_readahead_free(struct mdc_readahead *ra)
+{
+	atomic_clear_uint32_t_bits(&ra->dir->mde_flags, MDCACHE_DIR_READAHEAD);
+	mdcache_put(ra->dir);
+	put_gsh_export(ra->export);
+	gsh_free(ra->creds.caller_garray);
+	gsh_free(ra);
+}
+
+/**
+ * @brief Read the chunk after a cookie, in a readahead thread
+ *
+ * Nothing is read if that chunk got cached, or the one before it stopped
+ * being the end of the cache, in the meantime.
+ *
+ * @param[in] ctx  Thread context, arg is the struct mdc_readahead
+ */
+
+static void mdc_readahead_run(struct fridgethr_context *ctx)
+{
+	struct mdc_readahead *ra = ctx->arg;
+	mdcache_entry_t *dir = ra->dir;
+	struct req_op_context *saved_ctx = op_ctx;
+	struct req_op_context req_ctx = {0};
+	mdcache_dir_entry_t *dirent;
+	struct dir_chunk *chunk;
+	fsal_status_t status;
+
+	req_ctx.creds = &ra->creds;
+	req_ctx.ctx_export = ra->export;
+	req_ctx.fsal_export = ra->fsal_export;
+	req_ctx.fsal_module = ra->fsal_export->fsal;
+	op_ctx = &req_ctx;
+
+	PTHREAD_RWLOCK_wrlock(&dir->content_lock);
+
+	dirent = mdcache_avl_lookup_ck(dir, ra->whence);
+	if ((dir->mde_flags & MDCACHE_TRUST_CONTENT) && dirent != NULL &&
+	    &dirent->chunk_list == dirent->chunk->dirents.prev &&
+	    dirent->chunk->next == NULL && !dirent->chunk->eod &&
+	    dirent->chunk->gen == dir->fsobj.fsdir.chunk_gen) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Reading ahead dir %p after cookie %" PRIu64,
+			     dir, ra->whence);
+		status = mdcache_dirent_load_chunk(dir, ra->whence, &chunk);
+		if (FSAL_IS_ERROR(status))
+			LogDebug(COMPONENT_NFS_READDIR,
+				 "Read-ahead of dir %p failed with %s",
+				 dir, fsal_err_txt(status));
+	}
+
+	PTHREAD_RWLOCK_unlock(&dir->content_lock);
+
+	op_ctx = saved_ctx;
+	mdc_readahead_free(ra);
+}
+
+/**
+ * @brief Start reading the chunk after @a chunk in the background
+ *
+ * At most one read-ahead is in flight per directory.  If all readahead
+ * threads are busy, nothing is read; readdir will read the chunk itself.
+ *
+ * @note dir MUST have it's content_lock held
+ *
+ * @param[in] dir    The directory
+ * @param[in] chunk  The chunk readdir is walking
+ */
+
+void mdcache_readahead_chunk(mdcache_entry_t *dir, struct dir_chunk *chunk)
+{
+	struct mdc_readahead *ra;
+	int rc;
+
+	if (readahead_fridge == NULL || op_ctx->ctx_export == NULL ||
+	    op_ctx->creds == NULL || chunk->eod || chunk->next != NULL ||
+	    glist_empty(&chunk->dirents))
+		return;
+
+	if (atomic_postset_uint32_t_bits(&dir->mde_flags,
+					 MDCACHE_DIR_READAHEAD) &
+	    MDCACHE_DIR_READAHEAD)
+		return;
+
+	ra = gsh_calloc(1, sizeof(*ra));
+	ra->dir = dir;
+	ra->whence = glist_entry(chunk->dirents.prev, mdcache_dir_entry_t,
+				 chunk_list)->ck;
+	ra->export = op_ctx->ctx_export;
+	ra->fsal_export = op_ctx->fsal_export;
+	ra->creds = *op_ctx->creds;
+	if (ra->creds.caller_glen != 0) {
+		ra->creds.caller_garray =
+			gsh_malloc(ra->creds.caller_glen * sizeof(gid_t));
+		memcpy(ra->creds.caller_garray, op_ctx->creds->caller_garray,
+		       ra->creds.caller_glen * sizeof(gid_t));
+	} else {
+		ra->creds.caller_garray = NULL;
+	}
+
+	if (FSAL_IS_ERROR(mdcache_get(dir))) {
+		atomic_clear_uint32_t_bits(&dir->mde_flags,
+					   MDCACHE_DIR_READAHEAD);
+		gsh_free(ra->creds.caller_garray);
+		gsh_free(ra);
+		return;
+	}
+	get_gsh_export_ref(ra->export);
+
+	rc = fridgethr_submit(readahead_fridge, mdc_readahead_run, ra);
+	if (rc != 0) {
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "No read-ahead of dir %p: %d", dir, rc);
+		mdc_readahead_free(ra);
+	}
+}
+
+/**
+ * @brief Start the readahead threads
+ *
+ * @return 0 on success, POSIX errors on failure.
+ */
+
+int mdcache_readahead_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.dir.readahead_threads == 0)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = mdcache_param.dir.readahead_threads;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_fail;
+
+	rc = fridgethr_init(&readahead_fridge, "MDC_readahead", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize readahead fridge, error code %d.",
+			 rc);
+	return rc;
+}
+
+/**
+ * @brief Stop the readahead threads
+ */
+
+void mdcache_readahead_pkgshutdown(void)
+{
+	int rc;
+
+	if (readahead_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(readahead_fridge, fridgethr_comm_stop,
+				    120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(readahead_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down readahead fridge: %d", rc);
+	}
+}
+
+/**
+ * @brief Remove and free all the dirents of a chunk
+ *
+ * The chunk itself is unlinked from its directory, but not freed, nor taken
+ * off the chunk LRU.
+ *
+ * @note The content_lock of the chunk's directory MUST be held for WRITE
+ *
+ * @param[in] chunk  The chunk
+ */
+
+void
+mdcache_clean_dir_chunk(struct dir_chunk *chunk)
+{
+	mdcache_entry_t *dir = chunk->parent;
+	struct glist_head *glist, *glistn;
+	mdcache_dir_entry_t *dirent;
+
+	glist_for_each_safe(glist, glistn, &chunk->dirents) {
+		dirent = glist_entry(glist, mdcache_dir_entry_t, chunk_list);
+		LogFullDebug(COMPONENT_CACHE_INODE, "Invalidate %p %s",
+			     dirent, dirent->name);
+		if (!(dirent->flags & DIR_ENTRY_FLAG_DELETED))
+			dir->fsobj.fsdir.nbactive--;
+		mdcache_avl_remove(dir, dirent);
+		glist_del(&dirent->chunk_list);
+		if (dirent->ckey.kv.len)
+			mdcache_key_delete(&dirent->ckey);
+		mdcache_dirent_free(dirent);
+	}
+
+	if (chunk->prev != NULL) {
+		chunk->prev->next = NULL;
+		dir->fsobj.fsdir.nlinks--;
+	}
+
+	if (chunk->next != NULL) {
+		chunk->next->prev = NULL;
+		dir->fsobj.fsdir.nlinks--;
+	}
+
+	if (dir->fsobj.fsdir.first == chunk)
+		dir->fsobj.fsdir.first = NULL;
+
+	if (dir->fsobj.fsdir.last == chunk)
+		dir->fsobj.fsdir.last = NULL;
+
+	glist_del(&chunk->chunks);
+	dir->fsobj.fsdir.nchunks--;
+
+	/* The cache no longer covers the directory */
+	atomic_clear_uint32_t_bits(&dir->mde_flags, MDCACHE_DIR_POPULATED);
+}
+
+/**
+ * @brief Take a chunk off the chunk LRU, and free it and its dirents
+ *
+ * @note The content_lock of the chunk's directory MUST be held for WRITE
+ *
+ * @param[in] chunk  The chunk
+ */
+
+void
+mdcache_free_dir_chunk(struct dir_chunk *chunk)
+{
+	mdcache_lru_remove_chunk(chunk);
+	mdcache_clean_dir_chunk(chunk);
+	(void)atomic_sub_uint64_t(&cache_stp->mem_dirents,
+				  sizeof(struct dir_chunk));
+	gsh_free(chunk);
+}
+
 /**
  * @brief Forcibly remove an entry from the cache (top half)
  *
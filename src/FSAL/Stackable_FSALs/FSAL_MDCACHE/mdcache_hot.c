@@ -0,0 +1,490 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_hot.c
+ * @brief Hottest cached objects
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "export_mgr.h"
+#include "mdcache_int.h"
+#include "mdcache_hash.h"
+#include "mdcache_lru.h"
+#include "mdcache_hot.h"
+#include "mdcache_avl.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/** Number of locks the slots are split over, by key hash */
+#define HOT_PARTITIONS 16
+/** Longest FSAL key tracked; objects with longer keys are not */
+#define HOT_KEY_SIZE 64
+/** Longest name kept for the path */
+#define HOT_NAME_SIZE 64
+/** Directories walked up at most to rebuild a path */
+#define HOT_PATH_DEPTH 64
+
+struct hot_key {
+	uint64_t hk;
+	void *fsal;
+	uint32_t len;		/*< 0 if unset */
+	char bytes[HOT_KEY_SIZE];
+};
+
+struct hot_slot {
+	struct hot_key key;	/*< The object, len 0 if the slot is unused */
+	struct hot_key parent;	/*< Directory of the last lookup */
+	char name[HOT_NAME_SIZE];	/*< Name of the last lookup */
+	uint16_t export_id;	/*< Export of the last operation */
+	uint64_t count;		/*< Operations, over-estimated by error */
+	uint64_t error;		/*< Count inherited from the evicted object */
+	uint64_t ops[MDC_HOT_OPS];	/*< Operations since it took the slot */
+};
+
+struct hot_partition {
+	pthread_mutex_t mtx;
+	struct hot_slot *slots;
+	GSH_CACHE_PAD(0);
+};
+
+static struct hot_partition hot_part[HOT_PARTITIONS];
+static uint32_t hot_nslots;	/*< Slots per partition */
+
+static inline bool hot_key_set(struct hot_key *tgt, mdcache_key_t *src)
+{
+	if (src->kv.len == 0 || src->kv.len > HOT_KEY_SIZE) {
+		tgt->len = 0;
+		return false;
+	}
+
+	tgt->hk = src->hk;
+	tgt->fsal = src->fsal;
+	tgt->len = src->kv.len;
+	memcpy(tgt->bytes, src->kv.addr, src->kv.len);
+	return true;
+}
+
+static inline bool hot_key_match(const struct hot_key *k,
+				 const mdcache_key_t *key)
+{
+	return k->hk == key->hk && k->len == key->kv.len &&
+	       k->fsal == key->fsal &&
+	       memcmp(k->bytes, key->kv.addr, k->len) == 0;
+}
+
+static inline void hot_key_get(struct hot_key *k, mdcache_key_t *key)
+{
+	key->hk = k->hk;
+	key->fsal = k->fsal;
+	key->kv.addr = k->bytes;
+	key->kv.len = k->len;
+}
+
+/**
+ * @brief Count an operation on an object
+ *
+ * The object's slot is found, or the least counted slot of its
+ * partition handed over to it.
+ *
+ * @param[in] entry   The object
+ * @param[in] op      The operation
+ * @param[in] parent  Directory @a entry was looked up in, or NULL
+ * @param[in] name    Name it was looked up by, or NULL
+ */
+void mdc_hot_do_record(mdcache_entry_t *entry, enum mdc_hot_op op,
+		       mdcache_entry_t *parent, const char *name)
+{
+	mdcache_key_t *key = &entry->fh_hk.key;
+	struct hot_partition *part;
+	struct hot_slot *slot, *min = NULL;
+	uint32_t i;
+
+	if (hot_nslots == 0 || key->kv.len > HOT_KEY_SIZE)
+		return;
+
+	part = &hot_part[key->hk % HOT_PARTITIONS];
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	for (i = 0; i < hot_nslots; i++) {
+		slot = &part->slots[i];
+		if (slot->key.len == 0) {
+			min = slot;
+			break;
+		}
+		if (hot_key_match(&slot->key, key))
+			goto found;
+		if (min == NULL || slot->count < min->count)
+			min = slot;
+	}
+
+	slot = min;
+	(void) hot_key_set(&slot->key, key);
+	slot->parent.len = 0;
+	slot->name[0] = '\0';
+	slot->error = slot->count;
+	memset(slot->ops, 0, sizeof(slot->ops));
+
+found:
+	slot->count++;
+	slot->ops[op]++;
+	if (op_ctx != NULL && op_ctx->ctx_export != NULL)
+		slot->export_id = op_ctx->ctx_export->export_id;
+	if (parent != NULL && name != NULL &&
+	    strcmp(name, ".") != 0 && strcmp(name, "..") != 0 &&
+	    hot_key_set(&slot->parent, &parent->fh_hk.key))
+		(void) strlcpy(slot->name, name, sizeof(slot->name));
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
+
+/**
+ * @brief Set up the hot object sketch
+ *
+ * Nothing is allocated when Hot_Objects is 0.
+ *
+ * @return 0 on success, or if disabled.
+ */
+int mdcache_hot_pkginit(void)
+{
+	int i;
+
+	if (mdcache_param.hot_objects == 0)
+		return 0;
+
+	hot_nslots = (mdcache_param.hot_objects + HOT_PARTITIONS - 1) /
+		     HOT_PARTITIONS;
+
+	for (i = 0; i < HOT_PARTITIONS; ++i) {
+		PTHREAD_MUTEX_init(&hot_part[i].mtx, NULL);
+		hot_part[i].slots = gsh_calloc(hot_nslots,
+					       sizeof(struct hot_slot));
+	}
+
+	LogInfo(COMPONENT_CACHE_INODE,
+		"Tracking the %" PRIu32 " hottest objects",
+		hot_nslots * HOT_PARTITIONS);
+
+	return 0;
+}
+
+/**
+ * @brief Tear down the hot object sketch
+ */
+void mdcache_hot_pkgshutdown(void)
+{
+	int i;
+
+	if (hot_nslots == 0)
+		return;
+
+	hot_nslots = 0;
+
+	for (i = 0; i < HOT_PARTITIONS; ++i) {
+		gsh_free(hot_part[i].slots);
+		hot_part[i].slots = NULL;
+		PTHREAD_MUTEX_destroy(&hot_part[i].mtx);
+	}
+}
+
+static int hot_slot_cmp(const void *a, const void *b)
+{
+	const struct hot_slot *sa = a, *sb = b;
+
+	if (sa->count != sb->count)
+		return sa->count < sb->count ? 1 : -1;
+	return 0;
+}
+
+/**
+ * @brief Copy the slots in use, most counted first
+ *
+ * @param[out] n  Number of slots copied
+ *
+ * @return The copies, to be freed, or NULL if none.
+ */
+static struct hot_slot *hot_snapshot(uint32_t *n)
+{
+	struct hot_slot *all;
+	uint32_t i, j;
+
+	*n = 0;
+	if (hot_nslots == 0)
+		return NULL;
+
+	all = gsh_malloc(sizeof(*all) * hot_nslots * HOT_PARTITIONS);
+	for (i = 0; i < HOT_PARTITIONS; i++) {
+		PTHREAD_MUTEX_lock(&hot_part[i].mtx);
+		for (j = 0; j < hot_nslots; j++)
+			if (hot_part[i].slots[j].key.len != 0)
+				all[(*n)++] = hot_part[i].slots[j];
+		PTHREAD_MUTEX_unlock(&hot_part[i].mtx);
+	}
+
+	qsort(all, *n, sizeof(*all), hot_slot_cmp);
+	return all;
+}
+
+/**
+ * @brief Walk the hottest objects, most counted first
+ *
+ * @param[in] cb   Called for each object, stops the walk if false
+ * @param[in] arg  Passed to @a cb
+ *
+ * @return Number of objects walked.
+ */
+uint32_t mdc_hot_walk(mdc_hot_walk_cb cb, void *arg)
+{
+	struct mdc_hot_obj obj;
+	struct hot_slot *all;
+	uint32_t n, i;
+
+	all = hot_snapshot(&n);
+
+	for (i = 0; i < n; i++) {
+		obj.export_id = all[i].export_id;
+		obj.key.addr = all[i].key.bytes;
+		obj.key.len = all[i].key.len;
+		obj.parent.addr = all[i].parent.bytes;
+		obj.parent.len = all[i].parent.len;
+		obj.name = all[i].name;
+		if (!cb(&obj, arg))
+			break;
+	}
+
+	gsh_free(all);
+	return i;
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Put a component in front of a path built backwards
+ *
+ * @return false if it did not fit.
+ */
+static bool hot_path_prepend(char *path, size_t *pos, const char *name)
+{
+	size_t len = strlen(name);
+
+	if (len + 1 > *pos)
+		return false;
+
+	*pos -= len;
+	memcpy(path + *pos, name, len);
+	path[--*pos] = '/';
+	return true;
+}
+
+/**
+ * @brief Name of a directory in its parent
+ *
+ * Found among the cached dirents of the parent, which may not have it.
+ *
+ * @param[in]  dir     The directory
+ * @param[out] pkey    Key of its parent, to walk on up
+ * @param[out] pbytes  Storage for @a pkey
+ * @param[out] name    The name
+ *
+ * @return true if the name was found.
+ */
+static bool hot_dir_name(mdcache_entry_t *dir, mdcache_key_t *pkey,
+			 struct hot_key *pbytes, char *name)
+{
+	mdcache_entry_t *parent;
+	mdcache_dir_entry_t *dirent;
+	bool found = false;
+
+	if (dir->obj_handle.type != DIRECTORY)
+		return false;
+
+	PTHREAD_RWLOCK_rdlock(&dir->content_lock);
+	found = hot_key_set(pbytes, &dir->fsobj.fsdir.parent);
+	PTHREAD_RWLOCK_unlock(&dir->content_lock);
+
+	if (!found)
+		return false;
+
+	hot_key_get(pbytes, pkey);
+	parent = cih_get_by_key_ref(pkey);
+	if (parent == NULL)
+		return false;
+
+	found = false;
+	PTHREAD_RWLOCK_rdlock(&parent->content_lock);
+	dirent = mdcache_avl_lookup_ckey(parent, &dir->fh_hk.key);
+	if (dirent != NULL) {
+		(void) strlcpy(name, dirent->name, HOT_NAME_SIZE);
+		found = true;
+	}
+	PTHREAD_RWLOCK_unlock(&parent->content_lock);
+
+	mdcache_put(parent);
+	return found;
+}
+
+/**
+ * @brief Rebuild the path of an object from its export root
+ *
+ * Walks up from the directory of the last lookup while the directories
+ * are cached and their names known; a path that could not be walked up
+ * to the root starts with "...".
+ *
+ * @param[in]  slot  The object
+ * @param[out] path  The path, of PATH_MAX bytes
+ *
+ * @return Start of the path in @a path.
+ */
+static char *hot_path(struct hot_slot *slot, char *path)
+{
+	struct gsh_export *export = get_gsh_export(slot->export_id);
+	uint64_t root_hk = 0;
+	size_t pos = PATH_MAX - 1;
+	mdcache_key_t key;
+	struct hot_key kbytes;
+	mdcache_entry_t *dir;
+	char name[HOT_NAME_SIZE];
+	bool known;
+	int depth;
+
+	if (export != NULL) {
+		PTHREAD_RWLOCK_rdlock(&export->lock);
+		if (export->exp_root_obj != NULL)
+			root_hk = container_of(export->exp_root_obj,
+					       mdcache_entry_t,
+					       obj_handle)->fh_hk.key.hk;
+		PTHREAD_RWLOCK_unlock(&export->lock);
+		put_gsh_export(export);
+	}
+
+	path[pos] = '\0';
+
+	if (slot->key.hk == root_hk)
+		return strcpy(path, "/");
+
+	if (slot->name[0] == '\0' || slot->parent.len == 0 ||
+	    !hot_path_prepend(path, &pos, slot->name))
+		goto unknown;
+
+	kbytes = slot->parent;
+	for (depth = 0; depth < HOT_PATH_DEPTH; depth++) {
+		if (kbytes.hk == root_hk)
+			return path + pos;
+
+		hot_key_get(&kbytes, &key);
+		dir = cih_get_by_key_ref(&key);
+		if (dir == NULL)
+			break;
+
+		known = hot_dir_name(dir, &key, &kbytes, name);
+		mdcache_put(dir);
+
+		if (!known || !hot_path_prepend(path, &pos, name))
+			break;
+	}
+
+unknown:
+	if (pos < 3)
+		pos = 3;
+	pos -= 3;
+	memcpy(path + pos, "...", 3);
+	return path + pos;
+}
+
+/**
+ * @brief Report the hottest objects
+ *
+ * For at most @a count objects, most counted first: the export, the
+ * path, the operations counted and the error bound of that count, and
+ * the lookups, getattrs, reads and writes counted since the object took
+ * its slot.
+ *
+ * @param[in]  count  Objects to report
+ * @param[out] iter   Reply
+ */
+void mdcache_dbus_show_hot(uint32_t count, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct hot_slot *all;
+	uint32_t n, i, j;
+	char *path, *p;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 CACHE_HOT_REPLY_ARRAY_TYPE,
+					 &array_iter);
+
+	all = hot_snapshot(&n);
+	if (all == NULL)
+		goto out;
+
+	if (count < n)
+		n = count;
+
+	path = gsh_malloc(PATH_MAX);
+	for (i = 0; i < n; i++) {
+		p = hot_path(&all[i], path);
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+					       &all[i].export_id);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &p);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &all[i].count);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &all[i].error);
+		for (j = 0; j < MDC_HOT_OPS; j++)
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       &all[i].ops[j]);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	gsh_free(path);
+	gsh_free(all);
+
+out:
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif /* USE_DBUS */
+
+/** @} */
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_hot.h
+ * @brief Hottest cached objects
+ *
+ * With Hot_Objects set, lookups, getattrs, reads and writes are counted
+ * per object, by cache key, in a fixed number of slots: a heavy-hitter
+ * (space-saving) sketch in which an object not in the sketch takes the
+ * slot of the least counted one and inherits its count as the error
+ * bound.  A slot also keeps the directory and name of the last lookup
+ * that found its object, from which the export-relative path is
+ * rebuilt through the cached directories when the sketch is reported
+ * with the ShowCacheInodeHot DBus method.
+ */
+
+#ifndef MDCACHE_HOT_H
+#define MDCACHE_HOT_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+enum mdc_hot_op {
+	MDC_HOT_LOOKUP,
+	MDC_HOT_GETATTR,
+	MDC_HOT_READ,
+	MDC_HOT_WRITE,
+	MDC_HOT_OPS
+};
+
+/** A hot object, as walked by mdc_hot_walk */
+struct mdc_hot_obj {
+	uint16_t export_id;	/*< Export of the last operation */
+	struct gsh_buffdesc key;	/*< FSAL key of the object */
+	struct gsh_buffdesc parent;	/*< Of the directory of the last
+					    lookup, len 0 if not known */
+	const char *name;	/*< Name of the last lookup, or "" */
+};
+
+typedef bool (*mdc_hot_walk_cb)(const struct mdc_hot_obj *obj, void *arg);
+
+int mdcache_hot_pkginit(void);
+void mdcache_hot_pkgshutdown(void);
+
+uint32_t mdc_hot_walk(mdc_hot_walk_cb cb, void *arg);
+
+void mdc_hot_do_record(mdcache_entry_t *entry, enum mdc_hot_op op,
+		       mdcache_entry_t *parent, const char *name);
+
+/**
+ * @brief Count an operation on an object
+ *
+ * @param[in] entry   The object
+ * @param[in] op      The operation
+ * @param[in] parent  Directory @a entry was looked up in, or NULL
+ * @param[in] name    Name it was looked up by, or NULL
+ */
+static inline void
+mdc_hot_record(mdcache_entry_t *entry, enum mdc_hot_op op,
+	       mdcache_entry_t *parent, const char *name)
+{
+	if (mdcache_param.hot_objects != 0)
+		mdc_hot_do_record(entry, op, parent, name);
+}
+
+#endif /* MDCACHE_HOT_H */
+
+/** @} */
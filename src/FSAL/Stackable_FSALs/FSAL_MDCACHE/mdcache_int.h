@@ -40,6 +40,10 @@
 #include "fsal_up.h"
 #include "fsal_convert.h"
 
+#ifdef USE_LTTNG
+#include "gsh_lttng/fsal.h"
+#endif
+
 typedef struct mdcache_fsal_obj_handle mdcache_entry_t;
 
 /*
@@ -56,17 +60,38 @@ struct mdcache_fsal_export {
 	struct glist_head entry_list;
 	/** Lock protecting entry_list */
 	pthread_rwlock_t mdc_exp_lock;
+	/** Last get_fs_dynamic_info of the export, for Statfs_Cache_TTL */
+	struct {
+		pthread_mutex_t lock;
+		bool valid;
+		bool refreshing;	/*< A thread is fetching it again */
+		fsal_fsid_t fsid;	/*< Filesystem it is of */
+		struct timespec fetched;
+		fsal_dynamicfsinfo_t info;
+	} statfs;
+	/** The sub-FSAL has no get_quota, see mdcache_quota.h */
+	bool quota_unsupported;
+	/** Of the sub-export, fixed once it is created */
+	attrmask_t supported_attrs;
+	uint32_t umask;
 };
 
+/** Handle bytes a key stores in itself rather than in a buffer */
+#define MDCACHE_KEY_INLINE 32
+
 /**
  * @brief Structure representing a cache key.
  *
- * Wraps an underlying FSAL-specific key.
+ * Wraps an underlying FSAL-specific key.  A key made by cih_hash_key()
+ * or mdcache_key_dup() owns its handle bytes; they are in inl when
+ * there are no more than MDCACHE_KEY_INLINE of them, so such a key
+ * must not be copied by assignment.
  */
 typedef struct mdcache_key {
 	uint64_t hk;		/* hash key */
 	void *fsal;		/*< sub-FSAL module */
 	struct gsh_buffdesc kv;		/*< fsal handle */
+	uint8_t inl[MDCACHE_KEY_INLINE];	/*< Small owned kv */
 } mdcache_key_t;
 
 static inline int mdcache_key_cmp(const struct mdcache_key *k1,
@@ -108,11 +133,13 @@ enum lru_q_id {
 	LRU_ENTRY_L1,
 	LRU_ENTRY_L2,
 	LRU_ENTRY_NOSCAN,
-	LRU_ENTRY_CLEANUP
+	LRU_ENTRY_CLEANUP,
+	LRU_ENTRY_A1IN
 };
 
 #define LRU_CLEANUP 0x00000001 /* Entry is on cleanup queue */
 #define LRU_CLEANED 0x00000002 /* Entry has been cleaned */
+#define LRU_PROBATION 0x00000004 /* Entry not yet seen twice (2q) */
 
 typedef struct mdcache_lru__ {
 	struct glist_head q;	/*< Link in the physical deque
@@ -140,6 +167,20 @@ struct mdcache_stats {
 	uint64_t inode_conf;
 	uint64_t inode_added;
 	uint64_t inode_mapping;
+	/* Bytes held by the cache, see mdcache_mem_used() */
+	uint64_t mem_entries;	/*< Entry structures */
+	uint64_t mem_keys;	/*< Handle keys not inline in their key */
+	uint64_t mem_dirents;	/*< Dirents and their chunks */
+	uint64_t mem_acls;	/*< ACLs, counted once per entry */
+	uint64_t neg_hit;	/*< Lookups answered by the negative cache */
+	uint64_t neg_added;	/*< Names added to the negative cache */
+	uint64_t mem_xattrs;	/*< Extended attribute values kept */
+	uint64_t xattr_hit;	/*< Xattr reads answered by the cache */
+	uint64_t commit_merged;	/*< Commits answered by another's flush */
+	uint64_t miss_coalesced;	/*< Misses answered by another lookup */
+	uint64_t bus_sent;	/*< Invalidations sent to the other servers */
+	uint64_t bus_received;	/*< Invalidations of theirs applied */
+	uint64_t warm_loaded;	/*< Saved hot objects loaded at startup */
 };
 
 extern struct mdcache_stats *cache_stp;
@@ -174,8 +215,71 @@ struct entry_export_map {
 #define MDCACHE_DIR_POPULATED FSAL_UP_INVALIDATE_DIR_POPULATED
 /** The entry has been removed, but not unhashed due to state */
 static const uint32_t MDCACHE_UNREACHABLE = 0x100;
-/** The directory is too big; skip the dirent cache */
-static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
+/** A read-ahead of the next dirent chunk is in flight */
+static const uint32_t MDCACHE_DIR_READAHEAD = 0x200;
+
+/**
+ * The times, apart from the core attributes a refresh always fetches.
+ * Like the ACL, they are only fetched when asked for, except for a
+ * directory.  Trusting them takes MDCACHE_TRUST_ATTRS and the last
+ * refresh having fetched them.
+ */
+#define MDC_ATTRS_TIMES (ATTR_ATIME | ATTR_CREATION | ATTR_CTIME | \
+			 ATTR_MTIME | ATTR_CHGTIME)
+
+/**
+ * What an entry never changes, good if stale: readdir needs no refresh
+ * for callers asking for these alone.
+ */
+#define MDC_ATTRS_IMMUTABLE (ATTR_TYPE | ATTR_FILEID | ATTR_FSID | \
+			     ATTR_RDATTR_ERR)
+
+struct dir_chunk;
+
+/**
+ * @brief An access check result kept by an entry
+ *
+ * Valid as long as the entry's attr_gen is that of the attributes the
+ * result was computed from.  Credentials are told apart by uid, gid
+ * and a hash of the supplementary groups.
+ */
+struct mdc_access {
+	uint64_t groups_hash;
+	uid_t uid;
+	gid_t gid;
+	uint32_t ngroups;
+	uint32_t attr_gen;
+	fsal_accessflags_t access_type;	/*< 0 for an unused slot */
+	fsal_accessflags_t allowed;
+	fsal_accessflags_t denied;
+	fsal_errors_t error;
+};
+
+struct mdc_access_cache {
+	uint32_t next;		/*< Slot replaced next */
+	struct mdc_access slot[];	/*< Access_Cache of them */
+};
+
+/**
+ * @brief An extended attribute value, or its absence, kept by an entry
+ *
+ * Valid as long as the entry's change attribute is the one it was read
+ * with.  The name and value share an allocation, the value first.
+ */
+struct mdc_xattr {
+	char *value;		/*< NULL for an unused slot */
+	char *name;		/*< Not terminated, name_len long */
+	uint64_t change;
+	size_t len;
+	uint32_t name_len;
+	fsal_errors_t error;	/*< Set for a kept failure, e.g. no such */
+	bool v42;		/*< Read by getxattrs() */
+};
+
+struct mdc_xattr_cache {
+	uint32_t next;		/*< Slot replaced next */
+	struct mdc_xattr slot[];	/*< Xattr_Cache of them */
+};
 
 
 /**
@@ -188,9 +292,13 @@ static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
  * Regarding the locking discipline:
  * (1) attr_lock protects the attrs field, the export_list, and attr_time
  *
- * (2) content_lock must be held for WRITE when modifying the AVL tree
- *     of a directory or any dirent contained therein.  It must be
- *     held for READ when accessing any of this information.
+ * (2) content_lock must be held for WRITE when modifying the AVL trees
+ *     of a directory, its dirent chunks, or any dirent contained
+ *     therein.  It must be held for READ when accessing any of this
+ *     information.  The one exception is the staged list of a
+ *     directory: a new dirent may be pushed on it with content_lock
+ *     held for READ, and the next holder for WRITE moves it into the
+ *     name tree (see mdcache_dirent_add_shared()).
  *
  * (3) content_lock must be held for WRITE when updating the cached
  *     content of a symlink or when NULLing the object.symlink pointer
@@ -221,19 +329,13 @@ static const uint32_t MDCACHE_BYPASS_DIRCACHE = 0x200;
  */
 
 struct mdcache_fsal_obj_handle {
-	/** Reader-writer lock for attributes */
-	pthread_rwlock_t attr_lock;
-	/** MDCache FSAL Handle */
-	struct fsal_obj_handle obj_handle;
-	/** Sub-FSAL handle */
-	struct fsal_obj_handle *sub_handle;
-	/** Cached attributes */
-	struct attrlist attrs;
+	/* The fields a hash lookup and a ref go through come first, so
+	 * that they take the first two cache lines of the entry. */
 	/** FH hash linkage */
 	struct {
-		struct avltree_node node_k;	/*< AVL node in tree */
+		mdcache_entry_t *next;	/*< Next entry in hash chain */
 		mdcache_key_t key;	/*< Key of this entry */
-		bool inavl;
+		bool inhash;
 	} fh_hk;
 	/** Flags for this entry */
 	uint32_t mde_flags;
@@ -245,6 +347,40 @@ struct mdcache_fsal_obj_handle {
 	time_t acl_time;
 	/** New style LRU link */
 	mdcache_lru_t lru;
+	/** Reader-writer lock for attributes */
+	pthread_rwlock_t attr_lock;
+	/** Bumped each time attrs are loaded or updated, protected by
+	    attr_lock */
+	uint32_t attr_gen;
+	/** Recent access checks, or NULL, protected by attr_lock */
+	struct mdc_access_cache *access;
+	/** Recent xattr reads, or NULL, protected by attr_lock */
+	struct mdc_xattr_cache *xattrs;
+	/** MDCache FSAL Handle */
+	struct fsal_obj_handle obj_handle;
+	/** Sub-FSAL handle */
+	struct fsal_obj_handle *sub_handle;
+	/** Cached attributes */
+	struct attrlist attrs;
+	/** Link in the fd LRU, protected by its lock */
+	struct glist_head fd_lru;
+	/** Last time stateless I/O moved the entry up the fd LRU */
+	time_t fd_used;
+	/** Unstable writes gathered on a regular file, or NULL.  Set
+	    once, freed with the entry. */
+	struct mdc_wgather *wgather;
+	/** Commits in progress on a regular file, or NULL.  Set once,
+	    freed with the entry. */
+	struct mdc_gcommit *gcommit;
+	/** Sequential read detection and data read ahead on a regular
+	    file, or NULL.  Set once, freed with the entry. */
+	struct mdc_rahead *rahead;
+	/** End of the writes counted against the owner's cached quotas,
+	    see mdc_quota_write() */
+	uint64_t quota_end;
+	/** NFSv3 and NFSv4 handle digests, or NULL.  Set once, freed
+	    with the entry. */
+	struct mdc_digest *digest[2];
 	/** Exports per entry (protected by attr_lock) */
 	struct glist_head export_list;
 	/** Atomic pointer to the first mapped export for fast path */
@@ -278,13 +414,44 @@ struct mdcache_fsal_obj_handle {
 			/** The parent of this directory ('..') */
 			mdcache_key_t parent;
 			struct {
-				/** Children */
+				/** Children, by name hash, past
+				 *  MDCACHE_DIRENT_VEC_MAX of them */
 				struct avltree t;
-				/** Persist cookies */
-				struct avltree c;
+				/** Children, by name hash, while t is
+				 *  empty */
+				struct mdcache_dirent_slot *vec;
+				/** Slots of vec in use */
+				uint32_t nvec;
+				/** Slots of vec allocated */
+				uint32_t vcap;
+				/** Chunked children, by FSAL cookie */
+				struct avltree ck;
 				/** Heuristic. Expect 0. */
 				uint32_t collisions;
 			} avl;
+			/** Chunks of dirents, in no particular order */
+			struct glist_head chunks;
+			/** Chunk read from cookie 0, if cached */
+			struct dir_chunk *first;
+			/** Chunk that reached the end of the directory */
+			struct dir_chunk *last;
+			/** Number of chunks */
+			uint32_t nchunks;
+			/** Number of chunks linked to the chunk after them */
+			uint32_t nlinks;
+			/** Bumped when a new name is added outside a chunk */
+			uint64_t chunk_gen;
+			/** Bumped to drop all negative lookups cached */
+			uint32_t neg_gen;
+			/** Dirents known from lookup or create only */
+			struct glist_head detached;
+			/** Number of detached dirents */
+			uint32_t ndetached;
+			/** Dirents of new names staged under the content_lock
+			 *  for read, newest first, linked by chunk_list.next */
+			struct mdcache_dir_entry__ *staged;
+			/** Number of staged dirents */
+			uint32_t nstaged;
 		} fsdir;		/**< DIRECTORY data */
 	} fsobj;
 };
@@ -294,22 +461,89 @@ struct mdcache_fsal_obj_handle {
  *
  * This is a cached directory entry that associates a name and cookie
  * with a cache entry.
+ *
+ * A dirent read by readdir belongs to a chunk and carries the cookie
+ * the FSAL gave it.  A dirent known only from lookup or create is
+ * detached: it has no cookie, and readdir never returns it.  A removed
+ * dirent stays in its chunk, marked deleted, so that its cookie can
+ * still be resumed from.
  */
 
 #define DIR_ENTRY_FLAG_NONE     0x0000
 #define DIR_ENTRY_FLAG_DELETED  0x0001
 
+/**
+ * @brief A child of a small directory
+ *
+ * A small directory indexes its children by name hash in an array of
+ * these, sorted by hash, rather than in its name tree: the search
+ * reads the hashes of one or two cache lines rather than chasing the
+ * tree node of each dirent.
+ */
+struct mdcache_dirent_slot {
+	uint64_t k;	/*< Name hash, v->hk.k */
+	struct mdcache_dir_entry__ *dirent;
+};
+
+/** Children a directory indexes in its array before using its tree */
+#define MDCACHE_DIRENT_VEC_MAX 32
+
+/** Dirents a directory stages before a create takes the write lock */
+#define MDCACHE_DIRENT_STAGE_MAX 64
+
 typedef struct mdcache_dir_entry__ {
-	struct avltree_node node_hk;	/*< AVL node in tree */
+	struct avltree_node node_hk;	/*< AVL node in name tree */
 	struct {
-		uint64_t k;	/*< Integer cookie */
+		uint64_t k;	/*< Name hash */
 		uint32_t p;	/*< Number of probes, an efficiency metric */
 	} hk;
+	struct avltree_node node_ck;	/*< AVL node in cookie tree */
+	fsal_cookie_t ck;	/*< FSAL cookie, if in a chunk */
+	struct dir_chunk *chunk;	/*< Chunk, or NULL if detached */
+	struct glist_head chunk_list;	/*< Link in chunk or detached list */
 	mdcache_key_t ckey;	/*< Key of cache entry */
 	uint32_t flags;		/*< Flags */
 	char name[];		/*< The NUL-terminated filename */
 } mdcache_dir_entry_t;
 
+/**
+ * @brief A run of dirents read by one FSAL readdir
+ *
+ * A chunk holds up to Dir_Chunk dirents in the order the FSAL returned
+ * them, starting after cookie @a whence.  Chunks are read lazily as
+ * readdir advances, and are reclaimed one at a time from the chunk LRU.
+ * When the chunk read from the last cookie of another is cached too,
+ * the two are linked so that readdir can walk from one to the next.
+ */
+
+struct dir_chunk {
+	/** Link in the directory's list of chunks */
+	struct glist_head chunks;
+	/** Dirents, in FSAL order */
+	struct glist_head dirents;
+	/** Directory this chunk belongs to */
+	struct mdcache_fsal_obj_handle *parent;
+	/** Chunk read from our last cookie */
+	struct dir_chunk *next;
+	/** Chunk whose last cookie we were read from */
+	struct dir_chunk *prev;
+	/** Cookie this chunk was read from, 0 for the start */
+	fsal_cookie_t whence;
+	/** Value of the directory's chunk_gen when read */
+	uint64_t gen;
+	/** Number of dirents, including deleted ones */
+	uint32_t num_entries;
+	/** Returning this cookie starts a read-ahead of the next chunk,
+	    0 for none */
+	fsal_cookie_t ra_ck;
+	/** The FSAL reached the end of the directory */
+	bool eod;
+	/** Link in the chunk LRU */
+	struct glist_head lru_q;
+	/** LRU lane of this chunk */
+	uint32_t lane;
+};
+
 /* Helpers */
 fsal_status_t mdcache_alloc_and_check_handle(
 		struct mdcache_fsal_export *export,
@@ -322,6 +556,7 @@ fsal_status_t mdcache_alloc_and_check_handle(
 		mdcache_entry_t *parent,
 		const char *name,
 		bool invalidate,
+		bool locked,
 		struct state_t *state);
 
 fsal_status_t get_optional_attrs(struct fsal_obj_handle *obj_hdl,
@@ -347,23 +582,29 @@ fsal_status_t mdc_lookup_uncached(mdcache_entry_t *mdc_parent,
 				  const char *name,
 				  mdcache_entry_t **new_entry,
 				  struct attrlist *attrs_out);
-void mdcache_src_dest_lock(mdcache_entry_t *src, mdcache_entry_t *dest);
-void mdcache_src_dest_unlock(mdcache_entry_t *src, mdcache_entry_t *dest);
 fsal_status_t mdcache_dirent_remove(mdcache_entry_t *parent, const char *name);
 fsal_status_t mdcache_dirent_add(mdcache_entry_t *parent,
 					const char *name,
-					mdcache_entry_t *entry);
+					mdcache_entry_t *entry,
+					bool new_name);
+fsal_status_t mdcache_dirent_add_shared(mdcache_entry_t *parent,
+					const char *name,
+					mdcache_entry_t *entry,
+					bool new_name);
 fsal_status_t mdcache_dirent_rename(mdcache_entry_t *parent,
 				    const char *oldname,
 				    const char *newname);
 
 void mdcache_dirent_invalidate_all(mdcache_entry_t *entry);
 
-fsal_status_t mdcache_dirent_populate(mdcache_entry_t *dir);
-fsal_status_t mdcache_readdir_uncached(mdcache_entry_t *directory, fsal_cookie_t
-				       *whence, void *dir_state,
-				       fsal_readdir_cb cb, attrmask_t attrmask,
-				       bool *eod_met);
+fsal_status_t mdcache_dirent_load_chunk(mdcache_entry_t *dir,
+					fsal_cookie_t whence,
+					struct dir_chunk **chunkp);
+void mdcache_clean_dir_chunk(struct dir_chunk *chunk);
+void mdcache_readahead_chunk(mdcache_entry_t *dir, struct dir_chunk *chunk);
+int mdcache_readahead_pkginit(void);
+void mdcache_readahead_pkgshutdown(void);
+void mdcache_free_dir_chunk(struct dir_chunk *chunk);
 void mdc_get_parent(struct mdcache_fsal_export *export,
 		    mdcache_entry_t *entry);
 
@@ -384,7 +625,21 @@ static inline struct mdcache_fsal_export *mdc_cur_export(void)
 	return mdc_export(op_ctx->fsal_export);
 }
 
+/**
+ * @brief Attributes the sub-FSAL of the current export supports
+ *
+ * Without going through fs_supported_attrs and down to the sub-FSAL.
+ */
+static inline attrmask_t mdc_supported_attrs(void)
+{
+	return mdc_cur_export()->supported_attrs;
+}
+
 void mdc_clean_entry(mdcache_entry_t *entry);
+void mdc_xattr_free(mdcache_entry_t *entry);
+void mdc_xattr_drop(mdcache_entry_t *entry);
+int32_t mdc_adapt_attr_ttl(mdcache_entry_t *entry,
+			   const struct attrlist *attrs);
 void _mdcache_kill_entry(mdcache_entry_t *entry,
 			 char *file, int line, char *function);
 
@@ -404,11 +659,22 @@ extern struct config_block mdcache_param_blk;
 		op_ctx->fsal_export = &(myexp)->export; \
 } while (0)
 
+#ifdef USE_LTTNG
+#define subcall_trace(event) \
+	tracepoint(fsal, event, __func__, __LINE__, op_ctx)
+#else
+#define subcall_trace(event)
+#endif
+
 /* Call a sub-FSAL function using it's export */
 #define subcall_raw(myexp, call) do { \
+	uint64_t __call_start = gsh_trace_start(); \
+	subcall_trace(subcall_start); \
 	op_ctx->fsal_export = (myexp)->export.sub_export; \
 	call; \
 	op_ctx->fsal_export = &(myexp)->export; \
+	subcall_trace(subcall_end); \
+	gsh_trace_done(TRACE_FSAL_CALL, __func__, __call_start, __LINE__); \
 } while (0)
 
 /* Call a sub-FSAL function using it's export */
@@ -436,12 +702,31 @@ typedef struct {
 	int		 count;
 } mdc_lock_context_t;
 
+/**
+ * @brief Give a key its own copy of handle bytes
+ *
+ * @param[in,out] key  The key
+ * @param[in]     addr The handle bytes
+ * @param[in]     len  Their length
+ */
+static inline void mdcache_key_set_kv(mdcache_key_t *key, const void *addr,
+				      size_t len)
+{
+	key->kv.len = len;
+	if (len <= MDCACHE_KEY_INLINE) {
+		key->kv.addr = key->inl;
+	} else {
+		key->kv.addr = gsh_malloc(len);
+		(void)atomic_add_uint64_t(&cache_stp->mem_keys, len);
+	}
+	memcpy(key->kv.addr, addr, len);
+}
+
 /**
  * @brief Dup a cache key.
  *
  * Deep copies the key passed in src, to tgt.  On return, tgt->kv.addr
- * is overwritten with a new buffer of length src->kv.len, and the buffer
- * is copied.
+ * is overwritten with tgt's own copy of the src->kv.len bytes.
  *
  * @param tgt [inout] Destination of copy
  * @param src [in] Source of copy
@@ -452,10 +737,7 @@ static inline void
 mdcache_key_dup(mdcache_key_t *tgt,
 		    mdcache_key_t *src)
 {
-	tgt->kv.len = src->kv.len;
-	tgt->kv.addr = gsh_malloc(src->kv.len);
-
-	memcpy(tgt->kv.addr, src->kv.addr, src->kv.len);
+	mdcache_key_set_kv(tgt, src->kv.addr, src->kv.len);
 	tgt->hk = src->hk;
 	tgt->fsal = src->fsal;
 }
@@ -488,11 +770,86 @@ mdc_dir_add_parent(mdcache_entry_t *entry, mdcache_entry_t *mdc_parent)
 static inline void
 mdcache_key_delete(mdcache_key_t *key)
 {
+	if (key->kv.addr != key->inl) {
+		(void)atomic_sub_uint64_t(&cache_stp->mem_keys, key->kv.len);
+		gsh_free(key->kv.addr);
+	}
 	key->kv.len = 0;
-	gsh_free(key->kv.addr);
 	key->kv.addr = NULL;
 }
 
+/** Longest name, with its NUL, of a dirent from mdcache_dirent_pool */
+#define MDC_DIRENT_POOL_NAME 64
+
+/** Dirents of short names, NULL unless Hugepage_Arenas */
+extern pool_t *mdcache_dirent_pool;
+
+/**
+ * @brief Allocate a dirent
+ *
+ * @param[in] namesize  Size of the name, including the terminating NUL
+ *
+ * @return The zeroed dirent.
+ */
+static inline mdcache_dir_entry_t *
+mdcache_dirent_alloc(size_t namesize)
+{
+	size_t size = sizeof(mdcache_dir_entry_t) + namesize;
+
+	(void)atomic_add_uint64_t(&cache_stp->mem_dirents, size);
+	if (mdcache_dirent_pool != NULL && namesize <= MDC_DIRENT_POOL_NAME)
+		return pool_alloc(mdcache_dirent_pool);
+	return gsh_calloc(1, size);
+}
+
+/**
+ * @brief Free a dirent allocated by mdcache_dirent_alloc()
+ *
+ * @param[in] dirent  The dirent, whose key is already deleted
+ */
+static inline void
+mdcache_dirent_free(mdcache_dir_entry_t *dirent)
+{
+	size_t namesize = strlen(dirent->name) + 1;
+
+	(void)atomic_sub_uint64_t(&cache_stp->mem_dirents,
+				  sizeof(mdcache_dir_entry_t) + namesize);
+	if (mdcache_dirent_pool != NULL && namesize <= MDC_DIRENT_POOL_NAME)
+		pool_free(mdcache_dirent_pool, dirent);
+	else
+		gsh_free(dirent);
+}
+
+/**
+ * @brief Bytes an ACL is charged to each entry caching it
+ *
+ * @param[in] acl  The ACL, or NULL
+ */
+static inline uint64_t
+mdc_acl_size(fsal_acl_t *acl)
+{
+	if (acl == NULL)
+		return 0;
+
+	return sizeof(fsal_acl_t) + acl->naces * sizeof(fsal_ace_t);
+}
+
+/**
+ * @brief Total bytes held by the cache
+ *
+ * Handles and other private state of the underlying FSAL are not seen
+ * here; the handle keys stand in for them.
+ */
+static inline uint64_t
+mdcache_mem_used(void)
+{
+	return atomic_fetch_uint64_t(&cache_stp->mem_entries) +
+	       atomic_fetch_uint64_t(&cache_stp->mem_keys) +
+	       atomic_fetch_uint64_t(&cache_stp->mem_dirents) +
+	       atomic_fetch_uint64_t(&cache_stp->mem_acls) +
+	       atomic_fetch_uint64_t(&cache_stp->mem_xattrs);
+}
+
 /**
  * @brief Update entry metadata from its attributes
  *
@@ -512,6 +869,9 @@ mdc_fixup_md(mdcache_entry_t *entry, struct attrlist *attrs)
 {
 	uint32_t flags = 0;
 
+	/* Whatever changed, access checks have to be done again */
+	entry->attr_gen++;
+
 	/* As long as the ACL was requested, and we get here, we assume no
 	 * failure to fetch ACL (differentiated from no ACL to fetch), and
 	 * thus we only look at the fact that ACL was requested to determine
@@ -583,10 +943,21 @@ mdcache_is_attrs_valid(const mdcache_entry_t *entry, attrmask_t mask)
 	if (entry->attrs.valid_mask == ATTR_RDATTR_ERR)
 		return false;
 
+	if ((mask & MDC_ATTRS_TIMES) != 0 &&
+	    (entry->attrs.request_mask & MDC_ATTRS_TIMES) == 0)
+		return false;
+
 	if (entry->obj_handle.type == DIRECTORY
 	    && mdcache_param.getattr_dir_invalidation)
 		return false;
 
+	/* No one else can change a delegated file through us, and the
+	 * delegation is recalled first if anyone tries. */
+	if (mdcache_param.delegation_attr_trust &&
+	    entry->obj_handle.type == REGULAR_FILE &&
+	    entry->fsobj.hdl.file.fdeleg_stats.fds_curr_delegations > 0)
+		return true;
+
 	if ((mask & ~ATTR_ACL) != 0 && entry->attrs.expire_time_attr == 0)
 		return false;
 
@@ -823,6 +1194,54 @@ fsal_status_t mdcache_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      fsal_lock_param_t *conflicting_lock);
 fsal_status_t mdcache_close2(struct fsal_obj_handle *obj_hdl,
 			     struct state_t *state);
+void mdcache_read2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *read_arg,
+			 void *caller_arg);
+void mdcache_write2_async(struct fsal_obj_handle *obj_hdl,
+			  bool bypass,
+			  fsal_async_cb done_cb,
+			  struct fsal_io_arg *write_arg,
+			  void *caller_arg);
+void mdcache_commit2_async(struct fsal_obj_handle *obj_hdl,
+			   off_t offset,
+			   size_t len,
+			   fsal_async_cb done_cb,
+			   void *caller_arg);
+fsal_status_t mdcache_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    int iov_count,
+			    struct iovec *iov,
+			    size_t *read_amount,
+			    bool *eof,
+			    struct io_info *info);
+fsal_status_t mdcache_writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     int iov_count,
+			     struct iovec *iov,
+			     size_t *write_amount,
+			     bool *fsal_stable,
+			     struct io_info *info);
+fsal_status_t mdcache_copy2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count,
+			    uint64_t *copied);
+fsal_status_t mdcache_clone2(struct fsal_obj_handle *src_hdl,
+			     struct state_t *src_state,
+			     uint64_t src_offset,
+			     struct fsal_obj_handle *dst_hdl,
+			     struct state_t *dst_state,
+			     uint64_t dst_offset,
+			     uint64_t count);
 
 /* extended attributes management */
 fsal_status_t mdcache_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
@@ -873,6 +1292,7 @@ void mdcache_handle_ops_init(struct fsal_obj_ops *ops);
 
 /* Export functions */
 void mdcache_export_ops_init(struct export_ops *ops);
+void mdc_export_static_info(struct mdcache_fsal_export *exp);
 fsal_status_t mdc_init_export(struct fsal_module *fsal_hdl,
 			      const struct fsal_up_vector *mdc_up_ops,
 			      const struct fsal_up_vector *super_up_ops);
@@ -880,6 +1300,10 @@ fsal_status_t mdc_init_export(struct fsal_module *fsal_hdl,
 /* Upcall functions */
 fsal_status_t mdcache_export_up_ops_init(struct fsal_up_vector *my_up_ops,
 				 const struct fsal_up_vector *super_up_ops);
+fsal_status_t mdc_up_invalidate(struct fsal_export *export,
+				struct gsh_buffdesc *handle, uint32_t flags);
+
+extern const char mdcachename[];
 
 /* Debug functions */
 #define MDC_LOG_KEY(key) do { \
@@ -52,6 +52,9 @@
 #include "log.h"
 #include "mdcache_lru.h"
 #include "mdcache_hash.h"
+#include "mdcache_wgather.h"
+#include "mdcache_gcommit.h"
+#include "mdcache_rahead.h"
 #include "abstract_atomic.h"
 #include "gsh_intrinsic.h"
 #include "sal_functions.h"
@@ -111,8 +114,10 @@ struct lru_q {
 struct lru_q_lane {
 	struct lru_q L1;
 	struct lru_q L2;
+	struct lru_q A1in;	/* on probation, 2q policy only */
 	struct lru_q noscan;	/* uncollectable, due to state */
 	struct lru_q cleanup;	/* deferred cleanup */
+	uint64_t reaped;	/* freed by the continuous reaper */
 	pthread_mutex_t mtx;
 	/* LRU thread scan position */
 	struct {
@@ -149,10 +154,66 @@ struct lru_q_lane {
  * correspondence to the "scan resistance" property of 2Q and MQ is
  * accomplished by recycling/clean loads onto the LRU of L1.  Async
  * processing onto L2 constrains oscillation in this algorithm.
+ *
+ * With the 2q policy [Johnson], a new entry instead waits on A1in, a
+ * FIFO which references do not reorder, and is reclaimed from there
+ * first.  Entries reclaimed while on probation leave their hash key in
+ * a ghost table; an entry created again for such a key has proved
+ * itself and goes straight to L1.  A single pass over a large tree
+ * thus only churns A1in and leaves the working set in L1 alone.
  */
 
 static struct lru_q_lane LRU[LRU_N_Q_LANES];
 
+/**
+ * Hash keys of entries recently reclaimed while on probation, direct
+ * mapped, so a collision just forgets the older key.
+ */
+static uint64_t *lru_ghost;
+static uint32_t lru_ghost_size;
+
+/**
+ * Regular files in order of their last I/O without a state, which the
+ * sub-FSAL does on the object's global fd, MRU at head.  Closing from
+ * the tail keeps the fds shared by stateless NFSv3 I/O open, instead
+ * of closing whatever the lane walk comes across.
+ */
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head q;
+	uint64_t size;
+} FD_LRU;
+
+/**
+ * A single lane of the dirent chunk LRU.
+ */
+
+struct lru_chunk_lane {
+	struct glist_head q;	/* LRU is at HEAD, MRU at tail */
+	pthread_mutex_t mtx;
+	 CACHE_PAD(0);
+};
+
+static struct lru_chunk_lane CHUNK_LRU[LRU_N_Q_LANES];
+
+/**
+ * Most chunks looked at per lane for one to reclaim, when the ones at
+ * the cold end belong to directories that are busy.
+ */
+#define LRU_CHUNK_SCAN 16
+
+/**
+ * Most entries lru_run_lane() skips over before it drops and retakes
+ * the lane lock, so request threads waiting on the lane get in.
+ */
+#define LRU_LANE_LOCK_BATCH 32
+
+/**
+ * The continuous reaper closes the gap to its target over this many
+ * runs, on top of keeping up with allocation.
+ */
+#define LRU_PACE_RUNS 4
+
 /**
  * The refcount mechanism distinguishes 3 key object states:
  *
@@ -194,7 +255,8 @@ static const uint32_t FD_FALLBACK_LIMIT = 0x400;
  * qlane its lane. */
 #define LRU_DQ_SAFE(lru, q) \
 	do { \
-		if ((lru)->qid == LRU_ENTRY_L1) { \
+		if ((lru)->qid == LRU_ENTRY_L1 || \
+		    (lru)->qid == LRU_ENTRY_A1IN) { \
 			struct lru_q_lane *qlane = &LRU[(lru)->lane]; \
 			if (unlikely((qlane->iter.active) && \
 				     ((&(lru)->q) == qlane->iter.glistn))) { \
@@ -207,12 +269,13 @@ static const uint32_t FD_FALLBACK_LIMIT = 0x400;
 
 #define LRU_ENTRY_L1_OR_L2(e) \
 	(((e)->lru.qid == LRU_ENTRY_L2) || \
-	 ((e)->lru.qid == LRU_ENTRY_L1))
+	 ((e)->lru.qid == LRU_ENTRY_L1) || \
+	 ((e)->lru.qid == LRU_ENTRY_A1IN))
 
 #define LRU_ENTRY_RECLAIMABLE(e, n) \
 	(LRU_ENTRY_L1_OR_L2(e) && \
 	((n) == LRU_SENTINEL_REFCOUNT+1) && \
-	 ((e)->fh_hk.inavl))
+	 ((e)->fh_hk.inhash))
 
 /**
  * @brief Initialize a single base queue.
@@ -245,9 +308,17 @@ lru_init_queues(void)
 		/* init lane queues */
 		lru_init_queue(&LRU[ix].L1, LRU_ENTRY_L1);
 		lru_init_queue(&LRU[ix].L2, LRU_ENTRY_L2);
+		lru_init_queue(&LRU[ix].A1in, LRU_ENTRY_A1IN);
 		lru_init_queue(&LRU[ix].noscan, LRU_ENTRY_NOSCAN);
 		lru_init_queue(&LRU[ix].cleanup, LRU_ENTRY_CLEANUP);
+
+		PTHREAD_MUTEX_init(&CHUNK_LRU[ix].mtx, NULL);
+		glist_init(&CHUNK_LRU[ix].q);
 	}
+
+	PTHREAD_MUTEX_init(&FD_LRU.mtx, NULL);
+	glist_init(&FD_LRU.q);
+	FD_LRU.size = 0;
 }
 
 /**
@@ -277,6 +348,9 @@ lru_queue_of(mdcache_entry_t *entry)
 	case LRU_ENTRY_L2:
 		q = &LRU[(entry->lru.lane)].L2;
 		break;
+	case LRU_ENTRY_A1IN:
+		q = &LRU[(entry->lru.lane)].A1in;
+		break;
 	case LRU_ENTRY_CLEANUP:
 		q = &LRU[(entry->lru.lane)].cleanup;
 		break;
@@ -408,6 +482,17 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 {
 	fsal_status_t status = {0, 0};
 
+	if (!glist_null(&entry->fd_lru)) {
+		PTHREAD_MUTEX_lock(&FD_LRU.mtx);
+		/* The reaper may have taken it off meanwhile */
+		if (!glist_null(&entry->fd_lru)) {
+			glist_del(&entry->fd_lru);
+			--FD_LRU.size;
+		}
+		PTHREAD_MUTEX_unlock(&FD_LRU.mtx);
+	}
+	entry->fd_used = 0;
+
 	/* Free SubFSAL resources */
 	if (entry->sub_handle) {
 		/* Make sure any FSAL global file descriptor is closed. */
@@ -425,7 +510,22 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 		entry->sub_handle = NULL;
 	}
 
+	mdc_wgather_free(entry);
+	mdc_gcommit_free(entry);
+	mdc_rahead_free(entry);
+	entry->quota_end = 0;
+
+	gsh_free(entry->access);
+	entry->access = NULL;
+	mdc_xattr_free(entry);
+
+	gsh_free(entry->digest[0]);
+	gsh_free(entry->digest[1]);
+	entry->digest[0] = entry->digest[1] = NULL;
+
 	/* Done with the attrs */
+	(void)atomic_sub_uint64_t(&cache_stp->mem_acls,
+				  mdc_acl_size(entry->attrs.acl));
 	fsal_release_attrs(&entry->attrs);
 
 	/* Clean our handle */
@@ -441,10 +541,10 @@ mdcache_lru_clean(mdcache_entry_t *entry)
 }
 
 /**
- * @brief Try to pull an entry off the queue
+ * @brief Try to pull an entry off one lane of a queue
  *
- * This function examines the end of the specified queue and if the
- * entry found there can be re-used, it returns with the entry
+ * This function examines the end of the specified queue in @a lane and
+ * if the entry found there can be re-used, it returns with the entry
  * locked.  Otherwise, it returns NULL.
  *
  * This function follows the locking discipline detailed above.  It
@@ -453,94 +553,148 @@ mdcache_lru_clean(mdcache_entry_t *entry)
  *
  * @note The caller @a MUST @a NOT hold the lane lock
  *
- * @param[in] qid  Queue to reap
+ * @param[in] lane  Lane to reap
+ * @param[in] qid   Queue to reap
+ * @param[in] keep  Leave the queue alone if it holds no more than this
  * @return Available entry if found, NULL otherwise
  */
 
-static uint32_t reap_lane;
-
-static inline mdcache_lru_t *
-lru_reap_impl(enum lru_q_id qid)
+static mdcache_lru_t *
+lru_reap_lane(uint32_t lane, enum lru_q_id qid, uint64_t keep)
 {
-	uint32_t lane;
-	struct lru_q_lane *qlane;
+	struct lru_q_lane *qlane = &LRU[lane];
 	struct lru_q *lq;
 	mdcache_lru_t *lru;
 	mdcache_entry_t *entry;
 	uint32_t refcnt;
 	cih_latch_t latch;
-	int ix;
 
-	lane = LRU_NEXT(reap_lane);
-	for (ix = 0; ix < LRU_N_Q_LANES; ++ix, lane = LRU_NEXT(reap_lane)) {
-		qlane = &LRU[lane];
-		lq = (qid == LRU_ENTRY_L1) ? &qlane->L1 : &qlane->L2;
+	switch (qid) {
+	case LRU_ENTRY_L1:
+		lq = &qlane->L1;
+		break;
+	case LRU_ENTRY_A1IN:
+		lq = &qlane->A1in;
+		break;
+	default:
+		lq = &qlane->L2;
+		break;
+	}
+
+	QLOCK(qlane);
+	if (lq->size <= keep)
+		goto unlock;
+	lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
+	if (!lru)
+		goto unlock;
+	refcnt = atomic_inc_int32_t(&lru->refcnt);
+	entry = container_of(lru, mdcache_entry_t, lru);
+	if (unlikely(refcnt != (LRU_SENTINEL_REFCOUNT + 1))) {
+		/* cant use it. */
+		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+		goto unlock;
+	}
+	/* potentially reclaimable */
+	QUNLOCK(qlane);
+	/* entry must be unreachable from CIH when recycled */
+	if (!cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
+			     __func__, __LINE__)) {
+		/* ! QLOCKED but needs to be Unref'ed */
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+		return NULL;
+	}
+	QLOCK(qlane);
+	refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+	/* there are two cases which permit reclaim,
+	 * entry is:
+	 * 1. reachable but unref'd (refcnt==2)
+	 * 2. unreachable, being removed (plus refcnt==0)
+	 *  for safety, take only the former
+	 */
+	if (!LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
+		cih_hash_release(&latch);
+		/* return the ref we took above--unref deals
+		 * correctly with reclaim case */
+		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
+		goto unlock;
+	}
 
-		QLOCK(qlane);
-		lru = glist_first_entry(&lq->q, mdcache_lru_t, q);
-		if (!lru)
-			goto next_lane;
-		refcnt = atomic_inc_int32_t(&lru->refcnt);
-		entry = container_of(lru, mdcache_entry_t, lru);
-		if (unlikely(refcnt != (LRU_SENTINEL_REFCOUNT + 1))) {
-			/* cant use it. */
-			mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
-			goto next_lane;
-		}
-		/* potentially reclaimable */
-		QUNLOCK(qlane);
-		/* entry must be unreachable from CIH when recycled */
-		if (cih_latch_entry(&entry->fh_hk.key, &latch, CIH_GET_WLOCK,
-				    __func__, __LINE__)) {
-			QLOCK(qlane);
-			refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
-			/* there are two cases which permit reclaim,
-			 * entry is:
-			 * 1. reachable but unref'd (refcnt==2)
-			 * 2. unreachable, being removed (plus refcnt==0)
-			 *  for safety, take only the former
-			 */
-			if (LRU_ENTRY_RECLAIMABLE(entry, refcnt)) {
-				/* it worked */
-				struct lru_q *q = lru_queue_of(entry);
+	/* it worked */
+	lq = lru_queue_of(entry);
 
 #ifdef USE_LTTNG
-				tracepoint(mdcache, mdc_lru_reap, __func__,
-					   __LINE__, entry,
-					   entry->lru.refcnt);
+	tracepoint(mdcache, mdc_lru_reap, __func__, __LINE__, entry,
+		   entry->lru.refcnt);
 #endif
-				cih_remove_latched(entry, &latch,
-						   CIH_REMOVE_QLOCKED);
-				LRU_DQ_SAFE(lru, q);
-				entry->lru.qid = LRU_ENTRY_NONE;
-				QUNLOCK(qlane);
-				cih_hash_release(&latch);
-				/* Note, we're not releasing our ref here.
-				 * cih_remove_latched() called
-				 * mdcache_lru_unref(), which released the
-				 * sentinal ref, leaving just the one ref we
-				 * took earlier.  Returning this as is leaves it
-				 * with a ref of 1 (ie, just the sentinal ref)
-				 * */
-				goto out;
-			}
-			cih_hash_release(&latch);
-			/* return the ref we took above--unref deals
-			 * correctly with reclaim case */
-			mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
-		} else {
-			/* ! QLOCKED but needs to be Unref'ed */
-			mdcache_lru_unref(entry, LRU_FLAG_NONE);
-			continue;
-		}
- next_lane:
-		QUNLOCK(qlane);
-	}			/* foreach lane */
+	if (lru_ghost && (lru->flags & LRU_PROBATION))
+		atomic_store_uint64_t(
+			&lru_ghost[entry->fh_hk.key.hk % lru_ghost_size],
+			entry->fh_hk.key.hk);
+	cih_remove_latched(entry, &latch, CIH_REMOVE_QLOCKED);
+	LRU_DQ_SAFE(lru, lq);
+	entry->lru.qid = LRU_ENTRY_NONE;
+	QUNLOCK(qlane);
+	cih_hash_release(&latch);
+	/* Lockless lookups that found the entry before it was unhashed
+	 * may have taken a ref; wait for them, and leave the entry to
+	 * them if they did.
+	 */
+	cih_synchronize();
+	if (atomic_fetch_int32_t(&entry->lru.refcnt)
+	    != LRU_SENTINEL_REFCOUNT) {
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+		return NULL;
+	}
+	/* Note, we're not releasing our ref here.  cih_remove_latched()
+	 * called mdcache_lru_unref(), which released the sentinal ref,
+	 * leaving just the one ref we took earlier.  Returning this as is
+	 * leaves it with a ref of 1 (ie, just the sentinal ref)
+	 */
+	return lru;
+
+ unlock:
+	QUNLOCK(qlane);
+	return NULL;
+}
+
+/**
+ * @brief Try to pull an entry off the queue
+ *
+ * Tries each lane in turn with lru_reap_lane().
+ *
+ * @note The caller @a MUST @a NOT hold the lane lock
+ *
+ * @param[in] qid   Queue to reap
+ * @param[in] keep  Skip lanes whose queue holds no more than this
+ * @return Available entry if found, NULL otherwise
+ */
+
+static uint32_t reap_lane;
+
+static inline mdcache_lru_t *
+lru_reap_impl(enum lru_q_id qid, uint64_t keep)
+{
+	mdcache_lru_t *lru;
+	int ix;
+
+	for (ix = 0; ix < LRU_N_Q_LANES; ++ix) {
+		lru = lru_reap_lane(LRU_NEXT(reap_lane), qid, keep);
+		if (lru)
+			return lru;
+	}
 
 	/* ! reclaimable */
-	lru = NULL;
- out:
-	return lru;
+	return NULL;
+}
+
+/**
+ * @brief Check whether the cache holds more than its memory budget
+ */
+static inline bool
+lru_over_budget(void)
+{
+	return mdcache_param.memory_budget != 0 &&
+	       mdcache_mem_used() > mdcache_param.memory_budget;
 }
 
 static inline mdcache_lru_t *
@@ -548,13 +702,24 @@ lru_try_reap_entry(void)
 {
 	mdcache_lru_t *lru;
 
-	if (lru_state.entries_used < lru_state.entries_hiwat)
+	if (lru_state.entries_used < lru_state.entries_hiwat &&
+	    !lru_over_budget())
 		return NULL;
 
+	/* Under 2q, probation is reclaimed down to its share first */
+	if (mdcache_param.lru_policy == MDCACHE_LRU_POLICY_2Q) {
+		lru = lru_reap_impl(LRU_ENTRY_A1IN,
+				    lru_state.probation_lane_hiwat);
+		if (lru)
+			return lru;
+	}
+
 	/* XXX dang why not start with the cleanup list? */
-	lru = lru_reap_impl(LRU_ENTRY_L2);
+	lru = lru_reap_impl(LRU_ENTRY_L2, 0);
 	if (!lru)
-		lru = lru_reap_impl(LRU_ENTRY_L1);
+		lru = lru_reap_impl(LRU_ENTRY_L1, 0);
+	if (!lru && mdcache_param.lru_policy == MDCACHE_LRU_POLICY_2Q)
+		lru = lru_reap_impl(LRU_ENTRY_A1IN, 0);
 
 	return lru;
 }
@@ -649,17 +814,411 @@ mdcache_lru_cleanup_try_push(mdcache_entry_t *entry)
 	}
 }
 
+/**
+ * @brief Put a newly read dirent chunk on the chunk LRU
+ *
+ * @note The content_lock of the chunk's directory MUST be held for WRITE
+ *
+ * @param[in] chunk  The chunk
+ */
+void
+mdcache_lru_insert_chunk(struct dir_chunk *chunk)
+{
+	struct lru_chunk_lane *qlane;
+
+	chunk->lane = lru_lane_of_entry(chunk->parent);
+	qlane = &CHUNK_LRU[chunk->lane];
+
+	QLOCK(qlane);
+	glist_add_tail(&qlane->q, &chunk->lru_q);
+	QUNLOCK(qlane);
+
+	(void) atomic_inc_uint64_t(&lru_state.chunks_used);
+}
+
+/**
+ * @brief Take a dirent chunk off the chunk LRU
+ *
+ * A chunk that never made it to the LRU is left alone.
+ *
+ * @note The content_lock of the chunk's directory MUST be held for WRITE
+ *
+ * @param[in] chunk  The chunk
+ */
+void
+mdcache_lru_remove_chunk(struct dir_chunk *chunk)
+{
+	struct lru_chunk_lane *qlane = &CHUNK_LRU[chunk->lane];
+
+	if (glist_null(&chunk->lru_q))
+		return;
+
+	QLOCK(qlane);
+	glist_del(&chunk->lru_q);
+	QUNLOCK(qlane);
+
+	(void) atomic_dec_uint64_t(&lru_state.chunks_used);
+}
+
+/**
+ * @brief Move a dirent chunk to the MRU end of its lane
+ *
+ * @note The content_lock of the chunk's directory MUST be held
+ *
+ * @param[in] chunk  The chunk
+ */
+void
+mdcache_lru_touch_chunk(struct dir_chunk *chunk)
+{
+	struct lru_chunk_lane *qlane = &CHUNK_LRU[chunk->lane];
+
+	QLOCK(qlane);
+	glist_del(&chunk->lru_q);
+	glist_add_tail(&qlane->q, &chunk->lru_q);
+	QUNLOCK(qlane);
+}
+
+/**
+ * @brief Reclaim one chunk from a lane of the chunk LRU
+ *
+ * A chunk is only reclaimed if the content_lock of its directory can be
+ * taken without waiting, or is @a locked_dir's, which the caller holds.
+ * A directory cannot be freed while its chunks are on the LRU, so the
+ * lane lock keeps the directory alive while we try its lock.
+ *
+ * @param[in] qlane       The lane
+ * @param[in] locked_dir  Directory whose content_lock the caller holds
+ * @param[in] keep        Chunk not to reclaim
+ *
+ * @return true if a chunk was reclaimed.
+ */
+static bool
+lru_reap_chunk(struct lru_chunk_lane *qlane, mdcache_entry_t *locked_dir,
+	       struct dir_chunk *keep)
+{
+	struct glist_head *glist;
+	struct dir_chunk *chunk;
+	mdcache_entry_t *dir;
+	int scanned = 0;
+
+	QLOCK(qlane);
+
+	glist_for_each(glist, &qlane->q) {
+		if (++scanned > LRU_CHUNK_SCAN)
+			break;
+
+		chunk = glist_entry(glist, struct dir_chunk, lru_q);
+		if (chunk == keep)
+			continue;
+
+		dir = chunk->parent;
+		if (dir != locked_dir &&
+		    pthread_rwlock_trywrlock(&dir->content_lock) != 0)
+			continue;
+
+		glist_del(&chunk->lru_q);
+		QUNLOCK(qlane);
+
+		(void) atomic_dec_uint64_t(&lru_state.chunks_used);
+
+		LogFullDebug(COMPONENT_CACHE_INODE_LRU,
+			     "Reclaiming chunk %p of dir %p", chunk, dir);
+
+		mdcache_clean_dir_chunk(chunk);
+		(void)atomic_sub_uint64_t(&cache_stp->mem_dirents,
+					  sizeof(struct dir_chunk));
+		gsh_free(chunk);
+
+		if (dir != locked_dir)
+			PTHREAD_RWLOCK_unlock(&dir->content_lock);
+		return true;
+	}
+
+	QUNLOCK(qlane);
+	return false;
+}
+
+static uint32_t chunk_reap_lane;
+
+/**
+ * @brief Reclaim dirent chunks down to the high water mark
+ *
+ * Stops early once a whole round of lanes yields nothing.
+ *
+ * @param[in] locked_dir  Directory whose content_lock the caller holds
+ *                        for WRITE, or NULL
+ * @param[in] keep        Chunk not to reclaim, or NULL
+ */
+void
+mdcache_lru_reap_chunks(mdcache_entry_t *locked_dir, struct dir_chunk *keep)
+{
+	uint32_t lane, misses = 0;
+
+	while ((atomic_fetch_uint64_t(&lru_state.chunks_used) >
+		lru_state.chunks_hiwat || lru_over_budget()) &&
+	       misses < LRU_N_Q_LANES) {
+		lane = LRU_NEXT(chunk_reap_lane);
+		if (lru_reap_chunk(&CHUNK_LRU[lane], locked_dir, keep))
+			misses = 0;
+		else
+			misses++;
+	}
+}
+
+/**
+ * @brief Reclaim an entry from one lane, in the order of the policy
+ *
+ * @param[in] lane  The lane
+ *
+ * @return The entry, holding only the sentinel ref, or NULL.
+ */
+static mdcache_lru_t *
+lru_reap_lane_entry(uint32_t lane)
+{
+	bool twoq = mdcache_param.lru_policy == MDCACHE_LRU_POLICY_2Q;
+	mdcache_lru_t *lru = NULL;
+
+	if (twoq)
+		lru = lru_reap_lane(lane, LRU_ENTRY_A1IN,
+				    lru_state.probation_lane_hiwat);
+	if (!lru)
+		lru = lru_reap_lane(lane, LRU_ENTRY_L2, 0);
+	if (!lru)
+		lru = lru_reap_lane(lane, LRU_ENTRY_L1, 0);
+	if (!lru && twoq)
+		lru = lru_reap_lane(lane, LRU_ENTRY_A1IN, 0);
+
+	return lru;
+}
+
+/**
+ * @brief Free entries from every lane, paced to the allocation rate
+ *
+ * Each run frees as many entries as were allocated since the previous
+ * one, plus a share of any excess over the target, spread evenly over
+ * the lanes.  Each lane lock is only held to take one entry off.
+ */
+static void
+lru_reap_paced(void)
+{
+	uint64_t used = atomic_fetch_uint64_t(&lru_state.entries_used);
+	uint64_t allocs = atomic_fetch_uint64_t(&lru_state.entries_allocs);
+	uint64_t rate = allocs - lru_state.prev_allocs;
+	uint64_t excess, quota, per_lane, ix, freed = 0;
+	mdcache_lru_t *lru;
+	uint32_t lane;
+
+	lru_state.prev_allocs = allocs;
+
+	if (used <= lru_state.entries_target)
+		return;
+
+	excess = used - lru_state.entries_target;
+	quota = rate + excess / LRU_PACE_RUNS;
+	if (quota > excess)
+		quota = excess;
+	per_lane = (quota + LRU_N_Q_LANES - 1) / LRU_N_Q_LANES;
+
+	for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+		for (ix = 0; ix < per_lane; ++ix) {
+			lru = lru_reap_lane_entry(lane);
+			if (!lru)
+				break;
+			/* Drop the sentinel ref the reaper left, freeing it */
+			mdcache_lru_unref(container_of(lru, mdcache_entry_t,
+						       lru),
+					  LRU_FLAG_NONE);
+			(void) atomic_inc_uint64_t(&LRU[lane].reaped);
+		}
+		freed += ix;
+	}
+
+	LogDebug(COMPONENT_CACHE_INODE_LRU,
+		 "Paced reaper freed %" PRIu64 " of %" PRIu64
+		 " entries over target, %" PRIu64 " allocated since last run",
+		 freed, excess, rate);
+}
+
+/**
+ * @brief Free entries until the cache is back within its memory budget
+ *
+ * Recycling in mdcache_lru_get() only keeps the footprint from growing;
+ * this gives memory back when the budget is exceeded.  At most one
+ * Reaper_Work's worth of entries is freed per lane in one call.
+ */
+static void
+lru_release_entries(void)
+{
+	mdcache_lru_t *lru;
+	size_t freed = 0;
+
+	while (lru_over_budget() &&
+	       freed < lru_state.per_lane_work * LRU_N_Q_LANES) {
+		lru = lru_try_reap_entry();
+		if (!lru)
+			break;
+		/* Drop the sentinel ref the reaper left, freeing it */
+		mdcache_lru_unref(container_of(lru, mdcache_entry_t, lru),
+				  LRU_FLAG_NONE);
+		++freed;
+	}
+
+	if (freed)
+		LogDebug(COMPONENT_CACHE_INODE_LRU,
+			 "Freed %zu entries over the memory budget, %" PRIu64
+			 " bytes in use", freed, mdcache_mem_used());
+}
+
+/**
+ * @brief Close the global fd of an entry from the lru thread
+ *
+ * @note The caller holds a reference on @a entry and has set up op_ctx
+ *
+ * @param[in] entry  The entry
+ *
+ * @return FSAL status
+ */
+static fsal_status_t lru_close_fd(mdcache_entry_t *entry)
+{
+	/** @todo FSF: hmm, this looks hairy, we need a reference
+	 *             to the export somehow?
+	 */
+	struct mdcache_fsal_export *exp =
+				atomic_fetch_voidptr(&entry->first_export);
+	fsal_status_t status;
+	bool not_support_ex;
+
+	op_ctx->fsal_export = &exp->export;
+	op_ctx->ctx_export = NULL;
+
+	not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
+						&entry->obj_handle);
+
+	if (not_support_ex) {
+		/* Acquire the content lock first; we may need to look
+		 * at fds and close it.
+		 */
+		PTHREAD_RWLOCK_wrlock(&entry->content_lock);
+	}
+
+	/* Make sure any FSAL global file descriptor is closed. */
+	status = fsal_close(&entry->obj_handle);
+
+	if (not_support_ex) {
+		/* Release the content lock. */
+		PTHREAD_RWLOCK_unlock(&entry->content_lock);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Move an entry doing stateless I/O to the MRU of the fd LRU
+ *
+ * Called after I/O without a state, which the sub-FSAL does on the
+ * global fd.  An entry is moved at most once a second, which is all the
+ * ordering the reaper needs.
+ *
+ * @note The caller holds a reference on @a entry
+ *
+ * @param[in] entry  The entry
+ */
+void mdcache_lru_fd_touch(mdcache_entry_t *entry)
+{
+	time_t now = time(NULL);
+
+	if (!mdcache_param.fd_lru ||
+	    atomic_fetch_time_t(&entry->fd_used) == now)
+		return;
+
+	atomic_store_time_t(&entry->fd_used, now);
+
+	PTHREAD_MUTEX_lock(&FD_LRU.mtx);
+	if (glist_null(&entry->fd_lru))
+		++FD_LRU.size;
+	else
+		glist_del(&entry->fd_lru);
+	glist_add(&FD_LRU.q, &entry->fd_lru);
+	PTHREAD_MUTEX_unlock(&FD_LRU.mtx);
+}
+
+/**
+ * @brief Close global fds from the cold end of the fd LRU
+ *
+ * Entries are taken off the fd LRU as they are closed; I/O puts them
+ * back.  Entries nobody holds a reference on any more are being cleaned
+ * up, which closes them anyway.
+ *
+ * @param[in] want  Most fds to close
+ *
+ * @return The number of fds closed.
+ */
+static size_t lru_close_fds(size_t want)
+{
+	struct req_op_context ctx = {0};
+	struct req_op_context *saved_ctx = op_ctx;
+	mdcache_entry_t *entry;
+	fsal_status_t status;
+	size_t closed = 0;
+	int32_t refcnt;
+
+	op_ctx = &ctx;
+
+	while (closed < want) {
+		PTHREAD_MUTEX_lock(&FD_LRU.mtx);
+		if (glist_empty(&FD_LRU.q)) {
+			PTHREAD_MUTEX_unlock(&FD_LRU.mtx);
+			break;
+		}
+		entry = glist_entry(FD_LRU.q.prev, mdcache_entry_t, fd_lru);
+		glist_del(&entry->fd_lru);
+		--FD_LRU.size;
+
+		/* Only take a reference while one is still held */
+		refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+		while (refcnt > 0 &&
+		       !atomic_cmpxchg_int32_t(&entry->lru.refcnt, refcnt,
+					       refcnt + 1))
+			refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+		PTHREAD_MUTEX_unlock(&FD_LRU.mtx);
+
+		if (refcnt <= 0)
+			continue;
+
+		atomic_store_time_t(&entry->fd_used, 0);
+
+		status = lru_close_fd(entry);
+		if (!FSAL_IS_ERROR(status))
+			++closed;
+		else if (status.major != ERR_FSAL_NOT_OPENED)
+			LogCrit(COMPONENT_CACHE_INODE_LRU,
+				"Error closing file in LRU thread: %s",
+				fsal_err_txt(status));
+
+		mdcache_lru_unref(entry, LRU_FLAG_NONE);
+	}
+
+	op_ctx = saved_ctx;
+
+	LogDebug(COMPONENT_CACHE_INODE_LRU,
+		 "Closed %zu descriptors from the fd LRU", closed);
+
+	return closed;
+}
+
 /**
  * @brief Function that executes in the lru thread to process one lane
  *
  * @param[in]     lane          The lane to process
+ * @param[in]     qid           Queue to scan, L1 or A1in
  * @param[in,out] totalclosed   Track the number of file closes
  *
  * @returns the number of files worked on (workdone)
  *
  */
 
-static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
+static inline size_t lru_run_lane(size_t lane, enum lru_q_id qid,
+				  uint64_t *const totalclosed)
 {
 	struct lru_q *q;
 	/* The amount of work done on this lane on this pass. */
@@ -675,15 +1234,14 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 	struct lru_q_lane *qlane = &LRU[lane];
 	/* entry refcnt */
 	uint32_t refcnt;
+	/* Entries skipped since the lane lock was last taken */
+	uint32_t held = 0;
 	struct req_op_context ctx = {0};
 	struct req_op_context *saved_ctx = op_ctx;
-	struct mdcache_fsal_export *exp;
-	struct fsal_export *export;
-	bool not_support_ex;
 
 	op_ctx = &ctx;
 
-	q = &qlane->L1;
+	q = (qid == LRU_ENTRY_A1IN) ? &qlane->A1in : &qlane->L1;
 
 	LogDebug(COMPONENT_CACHE_INODE_LRU,
 		 "Reaping up to %d entries from lane %zd",
@@ -714,12 +1272,19 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 			mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
 			/* but count it */
 			workdone++;
-			/* qlane LOCKED, lru refcnt is restored */
+			/* qlane LOCKED, lru refcnt is restored; the iterator
+			 * stays valid across a lock break, as it does across
+			 * the close below */
+			if (++held >= LRU_LANE_LOCK_BATCH) {
+				QUNLOCK(qlane);
+				QLOCK(qlane);
+				held = 0;
+			}
 			continue;
 		}
 
-		/* Move entry to MRU of L2 */
-		q = &qlane->L1;
+		/* Move entry to MRU of L2, an entry on probation stays so */
+		q = lru_queue_of(entry);
 		LRU_DQ_SAFE(lru, q);
 		lru->qid = LRU_ENTRY_L2;
 		q = &qlane->L2;
@@ -730,31 +1295,7 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		 * entry */
 		QUNLOCK(qlane);
 
-		/** @todo FSF: hmm, this looks hairy, we need a reference
-		 *             to the export somehow?
-		 */
-		exp = atomic_fetch_voidptr(&entry->first_export);
-		export = &exp->export;
-		op_ctx->fsal_export = export;
-		op_ctx->ctx_export = NULL;
-
-		not_support_ex = !entry->obj_handle.fsal->m_ops.support_ex(
-							&entry->obj_handle);
-
-		if (not_support_ex) {
-			/* Acquire the content lock first; we may need to look
-			 * at fds and close it.
-			 */
-			PTHREAD_RWLOCK_wrlock(&entry->content_lock);
-		}
-
-		/* Make sure any FSAL global file descriptor is closed. */
-		status = fsal_close(&entry->obj_handle);
-
-		if (not_support_ex) {
-			/* Release the content lock. */
-			PTHREAD_RWLOCK_unlock(&entry->content_lock);
-		}
+		status = lru_close_fd(entry);
 
 		if (FSAL_IS_ERROR(status)) {
 			LogCrit(COMPONENT_CACHE_INODE_LRU,
@@ -765,6 +1306,7 @@ static inline size_t lru_run_lane(size_t lane, uint64_t *const totalclosed)
 		}
 
 		QLOCK(qlane); /* QLOCKED */
+		held = 0;
 		mdcache_lru_unref(entry, LRU_UNREF_QLOCKED);
 		++workdone;
 	} /* for_each_safe lru */
@@ -870,8 +1412,18 @@ lru_run(struct fridgethr_context *ctx)
 		lru_state.futility = 0;
 	}
 
-	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "lru entries: %" PRIu64,
-		     lru_state.entries_used);
+	LogFullDebug(COMPONENT_CACHE_INODE_LRU, "lru entries: %" PRIu64
+		     " chunks: %" PRIu64,
+		     lru_state.entries_used, lru_state.chunks_used);
+
+	/* Reclaim dirent chunks that readdir left above the mark */
+	mdcache_lru_reap_chunks(NULL, NULL);
+
+	/* Free entries while still over the memory budget */
+	lru_release_entries();
+
+	if (mdcache_param.reaper_mode == MDCACHE_REAPER_CONTINUOUS)
+		lru_reap_paced();
 
 	/* Reap file descriptors.  This is a preliminary example of the
 	   L2 functionality rather than something we expect to be
@@ -915,24 +1467,49 @@ lru_run(struct fridgethr_context *ctx)
 				 "Open FDs over high water mark, reapring aggressively.");
 		}
 
+		/* The coldest fds of stateless I/O go first, the lanes
+		 * are only walked for what is still open after that.
+		 */
+		if (mdcache_param.fd_lru) {
+			totalclosed += lru_close_fds(
+				formeropen > lru_state.fds_lowat
+				? formeropen - lru_state.fds_lowat
+				: formeropen);
+			currentopen = atomic_fetch_size_t(&open_fd_count);
+			extremis = currentopen > lru_state.fds_hiwat;
+		}
+
 		/* Total fds closed between all lanes and all current runs. */
-		do {
-			workpass = 0;
-			for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
-				LogDebug(COMPONENT_CACHE_INODE_LRU,
-					 "Reaping up to %d entries from lane %zd",
-					 lru_state.per_lane_work, lane);
-
-				LogFullDebug(COMPONENT_CACHE_INODE_LRU,
-					     "formeropen=%zd totalwork=%zd workpass=%zd totalclosed:%"
-					     PRIu64, formeropen, totalwork,
-					     workpass, totalclosed);
-
-				workpass += lru_run_lane(lane, &totalclosed);
-			}
-			totalwork += workpass;
-		} while (extremis && (workpass >= lru_state.per_lane_work)
-			 && (totalwork < lru_state.biggest_window));
+		if (!mdcache_param.fd_lru ||
+		    currentopen >= lru_state.fds_lowat ||
+		    !lru_state.caching_fds) {
+			do {
+				workpass = 0;
+				for (lane = 0; lane < LRU_N_Q_LANES; ++lane) {
+					LogDebug(COMPONENT_CACHE_INODE_LRU,
+						 "Reaping up to %d entries from lane %zd",
+						 lru_state.per_lane_work, lane);
+
+					LogFullDebug(COMPONENT_CACHE_INODE_LRU,
+						     "formeropen=%zd totalwork=%zd workpass=%zd totalclosed:%"
+						     PRIu64, formeropen,
+						     totalwork, workpass,
+						     totalclosed);
+
+					if (mdcache_param.lru_policy ==
+					    MDCACHE_LRU_POLICY_2Q)
+						workpass += lru_run_lane(
+							lane, LRU_ENTRY_A1IN,
+							&totalclosed);
+					workpass += lru_run_lane(
+						lane, LRU_ENTRY_L1,
+						&totalclosed);
+				}
+				totalwork += workpass;
+			} while (extremis &&
+				 (workpass >= lru_state.per_lane_work) &&
+				 (totalwork < lru_state.biggest_window));
+		}
 
 		currentopen = atomic_fetch_size_t(&open_fd_count);
 		if (extremis
@@ -978,6 +1555,10 @@ lru_run(struct fridgethr_context *ctx)
 	if (new_thread_wait < mdcache_param.lru_run_interval / 10)
 		new_thread_wait = mdcache_param.lru_run_interval / 10;
 
+	/* The paced reaper runs every second */
+	if (mdcache_param.reaper_mode == MDCACHE_REAPER_CONTINUOUS)
+		new_thread_wait = 1;
+
 	fridgethr_setwait(ctx, new_thread_wait);
 
 	LogDebug(COMPONENT_CACHE_INODE_LRU,
@@ -1022,6 +1603,24 @@ mdcache_lru_pkginit(void)
 	   bit fishy, so come back and revisit this. */
 	lru_state.entries_hiwat = mdcache_param.entries_hwmark;
 	lru_state.entries_used = 0;
+	lru_state.chunks_hiwat = mdcache_param.chunks_hwmark;
+	lru_state.chunks_used = 0;
+	lru_state.entries_target = lru_state.entries_hiwat *
+		mdcache_param.reaper_target_percent / 100;
+	lru_state.entries_allocs = 0;
+	lru_state.prev_allocs = 0;
+	lru_state.probation_lane_hiwat = lru_state.entries_hiwat *
+		mdcache_param.probation_percent / 100 / LRU_N_Q_LANES;
+	if (lru_state.probation_lane_hiwat == 0)
+		lru_state.probation_lane_hiwat = 1;
+
+	if (mdcache_param.lru_policy == MDCACHE_LRU_POLICY_2Q) {
+		lru_ghost_size = lru_state.entries_hiwat *
+			mdcache_param.ghost_percent / 100;
+		if (lru_ghost_size == 0)
+			lru_ghost_size = 1;
+		lru_ghost = gsh_calloc(lru_ghost_size, sizeof(uint64_t));
+	}
 
 	/* Find out the system-imposed file descriptor limit */
 	if (getrlimit(RLIMIT_NOFILE, &rlim) != 0) {
@@ -1154,6 +1753,10 @@ mdcache_lru_pkgshutdown(void)
 		LogMajor(COMPONENT_CACHE_INODE_LRU,
 			 "Failed shutting down LRU thread: %d", rc);
 	}
+
+	gsh_free(lru_ghost);
+	lru_ghost = NULL;
+
 	return fsalstat(posix2fsal_error(rc), rc);
 }
 
@@ -1175,6 +1778,8 @@ alloc_cache_entry(mdcache_entry_t **entry)
 	init_rw_locks(nentry);
 
 	(void) atomic_inc_int64_t(&lru_state.entries_used);
+	(void) atomic_add_uint64_t(&cache_stp->mem_entries,
+				   sizeof(mdcache_entry_t));
 	*entry = nentry;
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
@@ -1214,6 +1819,8 @@ mdcache_lru_get(mdcache_entry_t **entry)
 			goto out;
 	}
 
+	(void) atomic_inc_uint64_t(&lru_state.entries_allocs);
+
 	/* Since the entry isn't in a queue, nobody can bump refcnt. */
 	nentry->lru.refcnt = 2;
 	nentry->lru.noscan_refcnt = 0;
@@ -1224,14 +1831,87 @@ mdcache_lru_get(mdcache_entry_t **entry)
 	tracepoint(mdcache, mdc_lru_ref,
 		   __func__, __LINE__, nentry, nentry->lru.refcnt);
 #endif
-	/* Enqueue. */
-	lru_insert_entry(nentry, &LRU[nentry->lru.lane].L1, LRU_LRU);
+	/* Enqueue.  Under 2q a new entry starts on probation, until
+	 * mdcache_lru_admit() finds its key among the ghosts. */
+	if (mdcache_param.lru_policy == MDCACHE_LRU_POLICY_2Q) {
+		atomic_set_uint32_t_bits(&nentry->lru.flags, LRU_PROBATION);
+		lru_insert_entry(nentry, &LRU[nentry->lru.lane].A1in,
+				 LRU_MRU);
+	} else {
+		atomic_clear_uint32_t_bits(&nentry->lru.flags, LRU_PROBATION);
+		lru_insert_entry(nentry, &LRU[nentry->lru.lane].L1, LRU_LRU);
+	}
 
  out:
 	*entry = nentry;
 	return status;
 }
 
+/**
+ * @brief Report the occupancy of each LRU lane
+ *
+ * @param[out] stats  Array to fill
+ * @param[in]  max    Size of @a stats
+ *
+ * @return The number of lanes reported.
+ */
+unsigned int
+mdcache_lru_lane_stats(struct mdcache_lane_stats *stats, unsigned int max)
+{
+	unsigned int ix;
+
+	for (ix = 0; ix < LRU_N_Q_LANES && ix < max; ++ix) {
+		struct lru_q_lane *qlane = &LRU[ix];
+
+		QLOCK(qlane);
+		stats[ix].l1 = qlane->L1.size;
+		stats[ix].l2 = qlane->L2.size;
+		stats[ix].a1in = qlane->A1in.size;
+		stats[ix].noscan = qlane->noscan.size;
+		stats[ix].cleanup = qlane->cleanup.size;
+		QUNLOCK(qlane);
+		stats[ix].reaped = atomic_fetch_uint64_t(&qlane->reaped);
+	}
+
+	return ix;
+}
+
+/**
+ * @brief Admit a newly hashed entry seen before out of probation
+ *
+ * Under the 2q policy, an entry whose hash key was reclaimed from
+ * probation recently is moved from A1in to the MRU of L1.  Otherwise
+ * this is a no-op.
+ *
+ * @param[in] entry  The entry, which must be hashed
+ */
+void
+mdcache_lru_admit(mdcache_entry_t *entry)
+{
+	mdcache_lru_t *lru = &entry->lru;
+	struct lru_q_lane *qlane = &LRU[lru->lane];
+	uint64_t hk = entry->fh_hk.key.hk;
+	uint64_t *ghost;
+	struct lru_q *q;
+
+	if (!lru_ghost || !(lru->flags & LRU_PROBATION))
+		return;
+
+	ghost = &lru_ghost[hk % lru_ghost_size];
+	if (atomic_fetch_uint64_t(ghost) != hk)
+		return;
+	atomic_store_uint64_t(ghost, 0);
+
+	QLOCK(qlane);
+	if (lru->qid == LRU_ENTRY_A1IN || lru->qid == LRU_ENTRY_L2) {
+		q = lru_queue_of(entry);
+		LRU_DQ_SAFE(lru, q);
+		lru_insert(lru, &qlane->L1, LRU_MRU);
+	}
+	atomic_clear_uint32_t_bits(&lru->flags, LRU_PROBATION);
+	QUNLOCK(qlane);
+}
+
 /**
  * @brief Function to let the state layer mark an entry noscan
  *
@@ -1296,10 +1976,12 @@ void mdcache_dec_noscan_ref(mdcache_entry_t *entry)
 			/* XXX skip L1 iteration fixups */
 			glist_del(&lru->q);
 			--(q->size);
-			/* add to MRU of L1 */
+			/* add to MRU of L1, state has proved the entry */
 			q = &qlane->L1;
 			lru_insert(lru, q, LRU_MRU);
 			++(q->size);
+			atomic_clear_uint32_t_bits(&lru->flags,
+						   LRU_PROBATION);
 		}
 	}
 
@@ -1335,7 +2017,8 @@ mdcache_is_noscan(mdcache_entry_t *entry)
  * This function acquires a reference on the given cache entry.
  *
  * @param[in] entry  The entry on which to get a reference
- * @param[in] flags  One of LRU_REQ_INITIAL, or LRU_FLAG_NONE
+ * @param[in] flags  One of LRU_REQ_INITIAL, or LRU_FLAG_NONE, optionally
+ *                   with LRU_REQ_TAKEN
  *
  * A flags value of LRU_REQ_INITIAL indicates an initial
  * reference.  A non-initial reference is an "extra" reference in some call
@@ -1363,19 +2046,25 @@ _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 		if (lru->flags & LRU_CLEANUP)
 			return fsalstat(ERR_FSAL_STALE, 0);
 
+	if ((flags & LRU_REQ_TAKEN) == 0) {
 #ifdef USE_LTTNG
-	refcnt =
+		refcnt =
 #endif
-		atomic_inc_int32_t(&entry->lru.refcnt);
+			atomic_inc_int32_t(&entry->lru.refcnt);
 
 #ifdef USE_LTTNG
-	tracepoint(mdcache, mdc_lru_ref,
-		   func, line, entry, refcnt);
+		tracepoint(mdcache, mdc_lru_ref,
+			   func, line, entry, refcnt);
 #endif
+	}
 
 	/* adjust LRU on initial refs */
 	if (flags & LRU_REQ_INITIAL) {
 
+		/* entries on probation are not reordered */
+		if (lru->flags & LRU_PROBATION)
+			goto out;
+
 		/* do it less */
 		if ((atomic_inc_int32_t(&entry->lru.cf) % 3) != 0)
 			goto out;
@@ -1489,11 +2178,16 @@ _mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags, const char *func,
 		if (!qlocked)
 			QUNLOCK(qlane);
 
+		/* Lockless lookups may still be looking at the entry */
+		cih_synchronize();
+
 		mdcache_lru_clean(entry);
 		pool_free(mdcache_entry_pool, entry);
 		freed = true;
 
 		(void) atomic_dec_int64_t(&lru_state.entries_used);
+		(void) atomic_sub_uint64_t(&cache_stp->mem_entries,
+					   sizeof(mdcache_entry_t));
 	}			/* refcnt == 0 */
  out:
 	return freed;
@@ -1537,6 +2231,8 @@ mdcache_lru_putback(mdcache_entry_t *entry, uint32_t flags)
 	/* We do NOT call lru_clean_entry, since it was never initialized. */
 	pool_free(mdcache_entry_pool, entry);
 	(void) atomic_dec_int64_t(&lru_state.entries_used);
+	(void) atomic_sub_uint64_t(&cache_stp->mem_entries,
+				   sizeof(mdcache_entry_t));
 
 	if (!qlocked)
 		QUNLOCK(qlane);
@@ -67,6 +67,12 @@
 struct lru_state {
 	uint64_t entries_hiwat;
 	uint64_t entries_used;
+	uint64_t chunks_hiwat;
+	uint64_t chunks_used;
+	uint64_t probation_lane_hiwat;
+	uint64_t entries_target;	/* continuous reaper keeps this many */
+	uint64_t entries_allocs;	/* entries handed out, ever */
+	uint64_t prev_allocs;	/* entries_allocs at the previous run */
 	uint32_t fds_system_imposed;
 	uint32_t fds_hard_limit;
 	uint32_t fds_hiwat;
@@ -121,6 +127,11 @@ extern pool_t *mdcache_entry_pool;
  */
 #define LRU_UNREF_STATE_LOCK_HELD 0x0010
 
+/**
+ * The reference was already taken by a lockless lookup, only adjust LRU
+ */
+#define LRU_REQ_TAKEN 0x0020
+
 /**
  * The minimum reference count for a cache entry not being recycled.
  */
@@ -138,7 +149,24 @@ fsal_status_t mdcache_lru_pkgshutdown(void);
 
 extern size_t open_fd_count;
 
+/**
+ * Occupancy of one LRU lane
+ */
+struct mdcache_lane_stats {
+	uint64_t l1;		/*< Entries on L1 */
+	uint64_t l2;		/*< Entries on L2 */
+	uint64_t a1in;		/*< Entries on probation */
+	uint64_t noscan;	/*< Entries pinned by state */
+	uint64_t cleanup;	/*< Entries awaiting cleanup */
+	uint64_t reaped;	/*< Entries the continuous reaper freed */
+};
+
+unsigned int mdcache_lru_lane_stats(struct mdcache_lane_stats *stats,
+				    unsigned int max);
+
 fsal_status_t mdcache_lru_get(mdcache_entry_t **entry);
+void mdcache_lru_admit(mdcache_entry_t *entry);
+void mdcache_lru_fd_touch(mdcache_entry_t *entry);
 #define mdcache_lru_ref(e, f) _mdcache_lru_ref(e, f, __func__, __LINE__)
 fsal_status_t _mdcache_lru_ref(mdcache_entry_t *entry, uint32_t flags,
 			       const char *func, int line);
@@ -153,6 +181,11 @@ bool _mdcache_lru_unref(mdcache_entry_t *entry, uint32_t flags,
 			const char *func, int line);
 void mdcache_lru_putback(mdcache_entry_t *entry, uint32_t flags);
 void lru_wake_thread(void);
+void mdcache_lru_insert_chunk(struct dir_chunk *chunk);
+void mdcache_lru_remove_chunk(struct dir_chunk *chunk);
+void mdcache_lru_touch_chunk(struct dir_chunk *chunk);
+void mdcache_lru_reap_chunks(mdcache_entry_t *locked_dir,
+			     struct dir_chunk *keep);
 fsal_status_t mdcache_inc_noscan_ref(mdcache_entry_t *entry);
 void mdcache_dec_noscan_ref(mdcache_entry_t *entry);
 bool mdcache_is_noscan(mdcache_entry_t *entry);
@@ -169,6 +202,30 @@ static inline fsal_status_t mdcache_get(mdcache_entry_t *entry)
 	return mdcache_lru_ref(entry, LRU_FLAG_NONE);
 }
 
+/**
+ * @brief Take a reference to an entry that may be on its way to being freed
+ *
+ * Used by lockless lookups, which may find an entry whose last reference is
+ * being dropped.  Such an entry is never revived.
+ *
+ * @param[in] entry Cache entry
+ *
+ * @return true if the reference was taken.
+ */
+static inline bool mdcache_lru_tryref(mdcache_entry_t *entry)
+{
+	int32_t refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+
+	while (refcnt > 0) {
+		if (atomic_cmpxchg_int32_t(&entry->lru.refcnt, refcnt,
+					   refcnt + 1))
+			return true;
+		refcnt = atomic_fetch_int32_t(&entry->lru.refcnt);
+	}
+
+	return false;
+}
+
 /**
  *
  * @brief Release logical reference to a cache entry
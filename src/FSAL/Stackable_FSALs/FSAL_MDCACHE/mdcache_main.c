@@ -42,13 +42,23 @@
 #include "gsh_list.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
+#include "server_stats_private.h"
 #endif
 #include "FSAL/fsal_init.h"
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_hash.h"
 #include "mdcache_lru.h"
+#include "mdcache_neg.h"
+#include "mdcache_quota.h"
+#include "mdcache_flight.h"
+#include "mdcache_bus.h"
+#include "mdcache_warm.h"
+#include "mdcache_rahead.h"
+#include "mdcache_hot.h"
+#include "stats_shm.h"
 
 pool_t *mdcache_entry_pool;
+pool_t *mdcache_dirent_pool;
 
 /* MDCACHE FSAL module private storage
  */
@@ -277,6 +287,7 @@ mdcache_fsal_create_export(struct fsal_module *sub_fsal, void *parse_node,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
 	PTHREAD_RWLOCK_init(&myself->mdc_exp_lock, &attrs);
+	PTHREAD_MUTEX_init(&myself->statfs.lock, NULL);
 
 	status = sub_fsal->m_ops.create_export(sub_fsal,
 						 parse_node,
@@ -300,6 +311,8 @@ mdcache_fsal_create_export(struct fsal_module *sub_fsal, void *parse_node,
 	op_ctx->fsal_export = &myself->export;
 	op_ctx->fsal_module = &MDCACHE.fsal;
 
+	mdc_export_static_info(myself);
+
 	return status;
 }
 
@@ -321,6 +334,21 @@ mdcache_fsal_unload(struct fsal_module *fsal_hdl)
 	/* Destroy the cache inode AVL tree */
 	cih_pkgdestroy();
 
+	mdcache_bus_pkgshutdown();
+
+	mdcache_readahead_pkgshutdown();
+
+	mdcache_neg_pkgshutdown();
+	mdcache_quota_pkgshutdown();
+	mdcache_flight_pkgshutdown();
+
+	/* Saves the hot objects, so before they go */
+	mdcache_warm_pkgshutdown();
+
+	mdcache_hot_pkgshutdown();
+
+	mdcache_rahead_pkgshutdown();
+
 	status = mdcache_lru_pkgshutdown();
 	if (FSAL_IS_ERROR(status))
 		fprintf(stderr, "MDCACHE LRU failed to shut down");
@@ -328,6 +356,10 @@ mdcache_fsal_unload(struct fsal_module *fsal_hdl)
 	/* Destroy the cache inode entry pool */
 	pool_destroy(mdcache_entry_pool);
 	mdcache_entry_pool = NULL;
+	if (mdcache_dirent_pool != NULL) {
+		pool_destroy(mdcache_dirent_pool);
+		mdcache_dirent_pool = NULL;
+	}
 
 	retval = unregister_fsal(&MDCACHE.fsal);
 	if (retval != 0)
@@ -372,6 +404,68 @@ void mdcache_fsal_init(void)
 	myself->m_ops.support_ex = mdcache_support_ex;
 }
 
+/**
+ * @brief Add the cache counters and the lanes to the stats segment
+ *
+ * See mdcache_dbus_show() and mdcache_dbus_show_lanes().
+ */
+static void mdcache_shm_stats(struct stats_shm_ctx *ctx)
+{
+	struct mdcache_lane_stats lanes[LRU_N_Q_LANES];
+	struct mdcache_lane_stats sum;
+	unsigned int n, i;
+	char name[32];
+
+#define MDC_SHM(n, v) \
+	stats_shm_value(ctx, "mdcache", n, atomic_fetch_uint64_t(&(v)))
+	MDC_SHM("cache_req", cache_st.inode_req);
+	MDC_SHM("cache_hit", cache_st.inode_hit);
+	MDC_SHM("cache_miss", cache_st.inode_miss);
+	MDC_SHM("cache_conf", cache_st.inode_conf);
+	MDC_SHM("cache_added", cache_st.inode_added);
+	MDC_SHM("cache_mapping", cache_st.inode_mapping);
+	MDC_SHM("cache_mem_entries", cache_st.mem_entries);
+	MDC_SHM("cache_mem_keys", cache_st.mem_keys);
+	MDC_SHM("cache_mem_dirents", cache_st.mem_dirents);
+	MDC_SHM("cache_mem_acls", cache_st.mem_acls);
+	MDC_SHM("cache_mem_budget", mdcache_param.memory_budget);
+	MDC_SHM("cache_neg_hits", cache_st.neg_hit);
+	MDC_SHM("cache_neg_added", cache_st.neg_added);
+	MDC_SHM("cache_mem_xattrs", cache_st.mem_xattrs);
+	MDC_SHM("cache_xattr_hits", cache_st.xattr_hit);
+	MDC_SHM("cache_commits_merged", cache_st.commit_merged);
+	MDC_SHM("cache_misses_coalesced", cache_st.miss_coalesced);
+	MDC_SHM("cache_bus_sent", cache_st.bus_sent);
+	MDC_SHM("cache_bus_received", cache_st.bus_received);
+	MDC_SHM("cache_warm_loaded", cache_st.warm_loaded);
+#undef MDC_SHM
+
+	memset(&sum, 0, sizeof(sum));
+	n = mdcache_lru_lane_stats(lanes, LRU_N_Q_LANES);
+
+#define MDC_SHM_LANE(f) do { \
+		snprintf(name, sizeof(name), "lane%u_" #f, i); \
+		stats_shm_value(ctx, "mdcache", name, lanes[i].f); \
+		sum.f += lanes[i].f; \
+	} while (0)
+	for (i = 0; i < n; i++) {
+		MDC_SHM_LANE(l1);
+		MDC_SHM_LANE(l2);
+		MDC_SHM_LANE(a1in);
+		MDC_SHM_LANE(noscan);
+		MDC_SHM_LANE(cleanup);
+		MDC_SHM_LANE(reaped);
+	}
+#undef MDC_SHM_LANE
+
+	stats_shm_value(ctx, "mdcache", "lru_l1", sum.l1);
+	stats_shm_value(ctx, "mdcache", "lru_l2", sum.l2);
+	stats_shm_value(ctx, "mdcache", "lru_a1in", sum.a1in);
+	stats_shm_value(ctx, "mdcache", "lru_noscan", sum.noscan);
+	stats_shm_value(ctx, "mdcache", "lru_cleanup", sum.cleanup);
+	stats_shm_value(ctx, "mdcache", "lru_reaped", sum.reaped);
+}
+
 /**
  * @brief Initialize the MDCACHE package.
  *
@@ -390,15 +484,46 @@ fsal_status_t mdcache_pkginit(void)
 	mdcache_entry_pool = pool_basic_init("MDCACHE Entry Pool",
 					     sizeof(mdcache_entry_t));
 
+	if (mdcache_param.hugepage_arenas) {
+		pool_arena_init(mdcache_entry_pool);
+		mdcache_dirent_pool =
+			pool_basic_init("MDCACHE Dirent Pool",
+					sizeof(mdcache_dir_entry_t) +
+					MDC_DIRENT_POOL_NAME);
+		pool_arena_init(mdcache_dirent_pool);
+	}
+
 	status = mdcache_lru_pkginit();
 	if (FSAL_IS_ERROR(status)) {
 		pool_destroy(mdcache_entry_pool);
 		mdcache_entry_pool = NULL;
+		if (mdcache_dirent_pool != NULL) {
+			pool_destroy(mdcache_dirent_pool);
+			mdcache_dirent_pool = NULL;
+		}
 		return status;
 	}
 
 	cih_pkginit();
 
+	/* Read-ahead is an optimization; carry on without it */
+	(void) mdcache_readahead_pkginit();
+
+	(void) mdcache_neg_pkginit();
+	(void) mdcache_quota_pkginit();
+	(void) mdcache_flight_pkginit();
+
+	(void) mdcache_hot_pkginit();
+	(void) mdcache_warm_pkginit();
+
+	/* So is file read-ahead */
+	(void) mdcache_rahead_pkginit();
+
+	/* And the coherency bus, without which objects just expire */
+	(void) mdcache_bus_pkginit();
+
+	stats_shm_add_provider(mdcache_shm_stats);
+
 	return status;
 }
 
@@ -438,9 +563,106 @@ void mdcache_dbus_show(DBusMessageIter *iter)
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
 					&cache_st.inode_mapping);
+	type = "cache_mem_entries";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.mem_entries);
+	type = "cache_mem_keys";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.mem_keys);
+	type = "cache_mem_dirents";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.mem_dirents);
+	type = "cache_mem_acls";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.mem_acls);
+	type = "cache_mem_budget";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&mdcache_param.memory_budget);
+	type = "cache_neg_hits";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.neg_hit);
+	type = "cache_neg_added";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.neg_added);
+	type = "cache_mem_xattrs";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.mem_xattrs);
+	type = "cache_xattr_hits";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.xattr_hit);
+	type = "cache_commits_merged";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.commit_merged);
+	type = "cache_misses_coalesced";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.miss_coalesced);
+	type = "cache_bus_sent";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.bus_sent);
+	type = "cache_bus_received";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.bus_received);
+	type = "cache_warm_loaded";
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &type);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					&cache_st.warm_loaded);
 
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
+
+/**
+ * @brief Report the occupancy of each LRU lane
+ *
+ * For each lane: entries on L1, L2, probation, noscan and cleanup, and
+ * entries the continuous reaper has freed from it.
+ */
+void mdcache_dbus_show_lanes(DBusMessageIter *iter)
+{
+	struct mdcache_lane_stats stats[LRU_N_Q_LANES];
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	unsigned int n, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	n = mdcache_lru_lane_stats(stats, LRU_N_Q_LANES);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 CACHE_LANES_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (i = 0; i < n; i++) {
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].l1);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].l2);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].a1in);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].noscan);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].cleanup);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].reaped);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
 #endif /* USE_DBUS */
 
 /** @} */
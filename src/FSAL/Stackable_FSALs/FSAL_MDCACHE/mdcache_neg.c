@@ -0,0 +1,226 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_neg.c
+ * @brief Negative lookup cache
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "mdcache_int.h"
+#include "mdcache_neg.h"
+#include "city.h"
+
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/** Number of locks the slots are striped over */
+#define NEG_PARTITIONS 16
+
+struct neg_slot {
+	uint64_t dir_hk;	/*< Hash key of the directory, 0 if unused */
+	uint64_t name_hk;	/*< Hash of the name, seeded by dir_hk */
+	uint32_t dir_gen;	/*< neg_gen of the directory when added */
+	time_t added;		/*< When the name was found missing */
+};
+
+struct neg_partition {
+	pthread_mutex_t mtx;
+	GSH_CACHE_PAD(0);
+};
+
+static struct neg_partition neg_part[NEG_PARTITIONS];
+static struct neg_slot *neg_slots;
+static uint32_t neg_nslots;
+
+/**
+ * @brief Find the slot a name maps to and lock it
+ *
+ * @param[in]  parent   The directory
+ * @param[in]  name     The name
+ * @param[out] name_hk  Hash of the name
+ *
+ * @return The slot, with its partition locked.
+ */
+static struct neg_slot *
+neg_slot_lock(mdcache_entry_t *parent, const char *name, uint64_t *name_hk)
+{
+	uint32_t ix;
+
+	*name_hk = CityHash64WithSeed(name, strlen(name),
+				      parent->fh_hk.key.hk);
+	ix = *name_hk % neg_nslots;
+	PTHREAD_MUTEX_lock(&neg_part[ix % NEG_PARTITIONS].mtx);
+	return &neg_slots[ix];
+}
+
+static inline void
+neg_slot_unlock(struct neg_slot *slot)
+{
+	uint32_t ix = slot - neg_slots;
+
+	PTHREAD_MUTEX_unlock(&neg_part[ix % NEG_PARTITIONS].mtx);
+}
+
+/**
+ * @brief Check whether a name is known not to exist
+ *
+ * @param[in] parent  The directory
+ * @param[in] name    The name
+ *
+ * @return true if a LOOKUP of @a name in @a parent failed recently and
+ *         nothing has changed the directory since.
+ *
+ * @note Caller MUST hold the content_lock of @a parent
+ */
+bool mdcache_neg_lookup(mdcache_entry_t *parent, const char *name)
+{
+	struct neg_slot *slot;
+	uint64_t name_hk;
+	time_t now = time(NULL);
+	bool found;
+
+	/* A directory that may have changed behind our back knows nothing */
+	if (neg_slots == NULL ||
+	    !(atomic_fetch_uint32_t(&parent->mde_flags) &
+	      MDCACHE_TRUST_CONTENT))
+		return false;
+
+	slot = neg_slot_lock(parent, name, &name_hk);
+	found = slot->dir_hk == parent->fh_hk.key.hk &&
+		slot->name_hk == name_hk &&
+		slot->dir_gen == atomic_fetch_uint32_t(
+					&parent->fsobj.fsdir.neg_gen) &&
+		slot->added + mdcache_param.dir.neg_ttl > now;
+	neg_slot_unlock(slot);
+
+	if (found)
+		(void) atomic_inc_uint64_t(&cache_stp->neg_hit);
+
+	return found;
+}
+
+/**
+ * @brief Remember that a name does not exist
+ *
+ * An older name mapping to the same slot is forgotten.
+ *
+ * @param[in] parent  The directory
+ * @param[in] name    The name
+ */
+void mdcache_neg_insert(mdcache_entry_t *parent, const char *name)
+{
+	struct neg_slot *slot;
+	uint64_t name_hk;
+
+	if (neg_slots == NULL)
+		return;
+
+	slot = neg_slot_lock(parent, name, &name_hk);
+	slot->dir_hk = parent->fh_hk.key.hk;
+	slot->name_hk = name_hk;
+	slot->dir_gen = atomic_fetch_uint32_t(&parent->fsobj.fsdir.neg_gen);
+	slot->added = time(NULL);
+	neg_slot_unlock(slot);
+
+	(void) atomic_inc_uint64_t(&cache_stp->neg_added);
+}
+
+/**
+ * @brief Forget that a name does not exist
+ *
+ * Called whenever the name is created in the directory.
+ *
+ * @param[in] parent  The directory
+ * @param[in] name    The name
+ */
+void mdcache_neg_remove(mdcache_entry_t *parent, const char *name)
+{
+	struct neg_slot *slot;
+	uint64_t name_hk;
+
+	if (neg_slots == NULL)
+		return;
+
+	slot = neg_slot_lock(parent, name, &name_hk);
+	if (slot->dir_hk == parent->fh_hk.key.hk && slot->name_hk == name_hk)
+		slot->dir_hk = 0;
+	neg_slot_unlock(slot);
+}
+
+/**
+ * @brief Set up the negative lookup cache
+ *
+ * Nothing is allocated when Dir_Negative_Cache_Size is 0.
+ *
+ * @return 0 on success, or if disabled.
+ */
+int mdcache_neg_pkginit(void)
+{
+	int i;
+
+	neg_nslots = mdcache_param.dir.neg_size;
+	if (neg_nslots == 0)
+		return 0;
+
+	for (i = 0; i < NEG_PARTITIONS; ++i)
+		PTHREAD_MUTEX_init(&neg_part[i].mtx, NULL);
+
+	neg_slots = gsh_calloc(neg_nslots, sizeof(struct neg_slot));
+
+	LogInfo(COMPONENT_CACHE_INODE,
+		"Negative lookup cache of %" PRIu32 " names, TTL %" PRIu32
+		" s", neg_nslots, mdcache_param.dir.neg_ttl);
+
+	return 0;
+}
+
+/**
+ * @brief Tear down the negative lookup cache
+ */
+void mdcache_neg_pkgshutdown(void)
+{
+	int i;
+
+	if (neg_slots == NULL)
+		return;
+
+	gsh_free(neg_slots);
+	neg_slots = NULL;
+
+	for (i = 0; i < NEG_PARTITIONS; ++i)
+		PTHREAD_MUTEX_destroy(&neg_part[i].mtx);
+}
+
+/** @} */
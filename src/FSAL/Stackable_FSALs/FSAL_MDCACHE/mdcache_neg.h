@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_neg.h
+ * @brief Negative lookup cache
+ *
+ * Names a LOOKUP did not find are remembered for Dir_Negative_Cache_TTL
+ * seconds in one fixed-size table shared by all directories, so lookups
+ * in directories that are not fully cached can still be answered
+ * without the FSAL.  A slot holds the hash key of the directory and a
+ * hash of the name; a newer name simply takes the slot of an older one.
+ *
+ * Creating or renaming a name through the cache removes it, and
+ * invalidating the content of a directory drops all of its names at
+ * once by bumping the directory's neg_gen.
+ */
+
+#ifndef MDCACHE_NEG_H
+#define MDCACHE_NEG_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+int mdcache_neg_pkginit(void);
+void mdcache_neg_pkgshutdown(void);
+
+bool mdcache_neg_lookup(mdcache_entry_t *parent, const char *name);
+void mdcache_neg_insert(mdcache_entry_t *parent, const char *name);
+void mdcache_neg_remove(mdcache_entry_t *parent, const char *name);
+
+/**
+ * @brief Forget every name cached as missing from a directory
+ *
+ * @param[in] parent  The directory
+ */
+static inline void
+mdcache_neg_flush(mdcache_entry_t *parent)
+{
+	(void) atomic_inc_uint32_t(&parent->fsobj.fsdir.neg_gen);
+}
+
+#endif /* MDCACHE_NEG_H */
+
+/** @} */
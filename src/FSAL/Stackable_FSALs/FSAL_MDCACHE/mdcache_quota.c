@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_quota.c
+ * @brief Quota cache
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "mdcache_int.h"
+#include "mdcache_quota.h"
+#include "city.h"
+
+#include <string.h>
+#include <pthread.h>
+#include <os/quota.h>
+
+/** Number of locks the slots are striped over */
+#define QUOTA_PARTITIONS 16
+
+struct quota_slot {
+	struct mdcache_fsal_export *exp;	/*< NULL if unused */
+	uint64_t path_hk;	/*< Hash of the path, seeded by exp */
+	int type;		/*< USRQUOTA or GRPQUOTA */
+	int id;
+	bool valid;		/*< status and quota are set */
+	bool refreshing;	/*< A thread is fetching them again */
+	struct timespec fetched;
+	fsal_status_t status;
+	fsal_quota_t quota;
+	uint64_t bytes;		/*< Added through us since fetched */
+	uint64_t files;		/*< Likewise */
+};
+
+struct quota_partition {
+	pthread_mutex_t mtx;
+	GSH_CACHE_PAD(0);
+};
+
+static struct quota_partition quota_part[QUOTA_PARTITIONS];
+static struct quota_slot *quota_slots;
+static uint32_t quota_nslots;
+
+static inline uint64_t quota_path_hk(struct mdcache_fsal_export *exp,
+				     const char *filepath)
+{
+	return CityHash64WithSeed(filepath, strlen(filepath),
+				  (uint64_t) (uintptr_t) exp);
+}
+
+/**
+ * @brief Find the slot of a quota and lock it
+ *
+ * @return The slot, with its partition locked.
+ */
+static struct quota_slot *quota_slot_lock(uint64_t path_hk, int type, int id)
+{
+	uint64_t h = path_hk ^ ((uint64_t) type << 32 | (uint32_t) id);
+	uint32_t ix = ((h * 0x9E3779B97F4A7C15ULL) >> 32) % quota_nslots;
+
+	PTHREAD_MUTEX_lock(&quota_part[ix % QUOTA_PARTITIONS].mtx);
+	return &quota_slots[ix];
+}
+
+static inline void quota_slot_unlock(struct quota_slot *slot)
+{
+	uint32_t ix = slot - quota_slots;
+
+	PTHREAD_MUTEX_unlock(&quota_part[ix % QUOTA_PARTITIONS].mtx);
+}
+
+static inline bool quota_slot_is(struct quota_slot *slot,
+				 struct mdcache_fsal_export *exp,
+				 uint64_t path_hk, int type, int id)
+{
+	return slot->exp == exp && slot->path_hk == path_hk &&
+	       slot->type == type && slot->id == id;
+}
+
+/* Whether the caller may see a quota fetched by someone else */
+static bool quota_may_share(int type, int id)
+{
+	const struct user_cred *creds = op_ctx->creds;
+	unsigned int i;
+
+	if (creds == NULL)
+		return false;
+	if (creds->caller_uid == 0)
+		return true;
+	if (type == USRQUOTA)
+		return creds->caller_uid == (uid_t) id;
+	if (type != GRPQUOTA)
+		return false;
+	if (creds->caller_gid == (gid_t) id)
+		return true;
+	for (i = 0; i < creds->caller_glen; i++)
+		if (creds->caller_garray[i] == (gid_t) id)
+			return true;
+
+	return false;
+}
+
+/* The quota with what we added since it was fetched */
+static void quota_slot_copy(struct quota_slot *slot, fsal_quota_t *pquota)
+{
+	*pquota = slot->quota;
+	if (slot->quota.bsize != 0)
+		pquota->curblocks += (slot->bytes + slot->quota.bsize - 1) /
+				     slot->quota.bsize;
+	pquota->curfiles += slot->files;
+}
+
+static fsal_status_t quota_sub_get(struct mdcache_fsal_export *exp,
+				   const char *filepath, int quota_type,
+				   int quota_id, fsal_quota_t *pquota)
+{
+	struct fsal_export *sub_export = exp->export.sub_export;
+	fsal_status_t status;
+
+	subcall_raw(exp,
+		status = sub_export->exp_ops.get_quota(sub_export, filepath,
+						       quota_type, quota_id,
+						       pquota)
+	       );
+
+	return status;
+}
+
+/**
+ * @brief Get a quota, from the cache when recent enough
+ *
+ * Answers from the sub-FSAL other than ERR_FSAL_NO_QUOTA and
+ * ERR_FSAL_NOTSUPP errors are not kept.
+ *
+ * @param[in]  exp         Export to query
+ * @param[in]  filepath    Path within the export
+ * @param[in]  quota_type  USRQUOTA or GRPQUOTA
+ * @param[in]  quota_id    User or group
+ * @param[out] pquota      The quota
+ *
+ * @return FSAL status.
+ */
+fsal_status_t mdc_quota_get(struct mdcache_fsal_export *exp,
+			    const char *filepath, int quota_type,
+			    int quota_id, fsal_quota_t *pquota)
+{
+	uint64_t ttl = (uint64_t) mdcache_param.quota_ttl * NS_PER_MSEC;
+	struct quota_slot *slot;
+	fsal_status_t status;
+	fsal_quota_t quota;
+	uint64_t path_hk;
+	struct timespec ts;
+
+	if (quota_slots == NULL || !quota_may_share(quota_type, quota_id))
+		return quota_sub_get(exp, filepath, quota_type, quota_id,
+				     pquota);
+
+	path_hk = quota_path_hk(exp, filepath);
+	now(&ts);
+
+	slot = quota_slot_lock(path_hk, quota_type, quota_id);
+	if (quota_slot_is(slot, exp, path_hk, quota_type, quota_id)) {
+		if (slot->valid &&
+		    (slot->refreshing ||
+		     timespec_diff(&slot->fetched, &ts) < ttl)) {
+			status = slot->status;
+			if (!FSAL_IS_ERROR(status))
+				quota_slot_copy(slot, pquota);
+			quota_slot_unlock(slot);
+			return status;
+		}
+	} else {
+		slot->exp = exp;
+		slot->path_hk = path_hk;
+		slot->type = quota_type;
+		slot->id = quota_id;
+		slot->valid = false;
+	}
+	slot->refreshing = true;
+	quota_slot_unlock(slot);
+
+	memset(&quota, 0, sizeof(quota));
+	status = quota_sub_get(exp, filepath, quota_type, quota_id, &quota);
+
+	if (status.major == ERR_FSAL_NOTSUPP)
+		exp->quota_unsupported = true;
+
+	slot = quota_slot_lock(path_hk, quota_type, quota_id);
+	if (quota_slot_is(slot, exp, path_hk, quota_type, quota_id)) {
+		slot->refreshing = false;
+		if (!FSAL_IS_ERROR(status) ||
+		    status.major == ERR_FSAL_NO_QUOTA ||
+		    status.major == ERR_FSAL_NOTSUPP) {
+			slot->status = status;
+			slot->quota = quota;
+			slot->fetched = ts;
+			slot->bytes = 0;
+			slot->files = 0;
+			slot->valid = true;
+		}
+	}
+	quota_slot_unlock(slot);
+
+	if (!FSAL_IS_ERROR(status))
+		*pquota = quota;
+
+	return status;
+}
+
+/* Whether a quota leaves no room for more blocks or files */
+static bool quota_over(struct mdcache_fsal_export *exp, const char *filepath,
+		       int quota_type, int quota_id, int what)
+{
+	fsal_quota_t quota;
+	fsal_status_t status;
+
+	status = mdc_quota_get(exp, filepath, quota_type, quota_id, &quota);
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	if (what == FSAL_QUOTA_BLOCKS)
+		return quota.bhardlimit != 0 &&
+		       quota.curblocks >= quota.bhardlimit;
+
+	return quota.fhardlimit != 0 && quota.curfiles >= quota.fhardlimit;
+}
+
+/**
+ * @brief Check the quotas of the caller before a create or a write
+ *
+ * Refuses once the cached quota of the caller's user or primary group
+ * is at its hard limit, then asks the sub-FSAL's own check_quota.
+ * Root is not limited.
+ *
+ * @param[in] exp         Export to check
+ * @param[in] filepath    Path within the export
+ * @param[in] quota_type  FSAL_QUOTA_BLOCKS or FSAL_QUOTA_INODES
+ *
+ * @return FSAL status, ERR_FSAL_DQUOT over a hard limit.
+ */
+fsal_status_t mdc_quota_check(struct mdcache_fsal_export *exp,
+			      const char *filepath, int quota_type)
+{
+	struct fsal_export *sub_export = exp->export.sub_export;
+	const struct user_cred *creds = op_ctx->creds;
+	fsal_status_t status;
+
+	if (quota_slots != NULL && !exp->quota_unsupported &&
+	    creds != NULL && creds->caller_uid != 0 &&
+	    (quota_over(exp, filepath, USRQUOTA, creds->caller_uid,
+			quota_type) ||
+	     quota_over(exp, filepath, GRPQUOTA, creds->caller_gid,
+			quota_type)))
+		return fsalstat(ERR_FSAL_DQUOT, EDQUOT);
+
+	subcall_raw(exp,
+		status = sub_export->exp_ops.check_quota(sub_export, filepath,
+							 quota_type)
+	       );
+
+	return status;
+}
+
+/**
+ * @brief Forget a quota, once it was set
+ */
+void mdc_quota_forget(struct mdcache_fsal_export *exp, const char *filepath,
+		      int quota_type, int quota_id)
+{
+	struct quota_slot *slot;
+	uint64_t path_hk;
+
+	if (quota_slots == NULL)
+		return;
+
+	path_hk = quota_path_hk(exp, filepath);
+	slot = quota_slot_lock(path_hk, quota_type, quota_id);
+	if (quota_slot_is(slot, exp, path_hk, quota_type, quota_id))
+		slot->exp = NULL;
+	quota_slot_unlock(slot);
+}
+
+/**
+ * @brief Forget all the quotas of an export going away
+ */
+void mdc_quota_forget_export(struct mdcache_fsal_export *exp)
+{
+	uint32_t ix;
+
+	for (ix = 0; ix < quota_nslots; ix++) {
+		PTHREAD_MUTEX_lock(&quota_part[ix % QUOTA_PARTITIONS].mtx);
+		if (quota_slots[ix].exp == exp)
+			quota_slots[ix].exp = NULL;
+		PTHREAD_MUTEX_unlock(&quota_part[ix % QUOTA_PARTITIONS].mtx);
+	}
+}
+
+static void quota_add(struct mdcache_fsal_export *exp, uint64_t path_hk,
+		      int quota_type, int quota_id, uint64_t bytes,
+		      uint64_t files)
+{
+	struct quota_slot *slot;
+
+	slot = quota_slot_lock(path_hk, quota_type, quota_id);
+	if (quota_slot_is(slot, exp, path_hk, quota_type, quota_id) &&
+	    slot->valid) {
+		slot->bytes += bytes;
+		slot->files += files;
+	}
+	quota_slot_unlock(slot);
+}
+
+/**
+ * @brief Count space or files added against the cached quotas
+ *
+ * Only the quotas of the current export's path are counted against;
+ * those not cached are fetched with the additions already in.
+ *
+ * @param[in] exp    Export the additions were made in
+ * @param[in] owner  User owning them
+ * @param[in] group  Group owning them
+ * @param[in] bytes  Space added
+ * @param[in] files  Files added
+ */
+void mdc_quota_charge(struct mdcache_fsal_export *exp, uid_t owner,
+		      gid_t group, uint64_t bytes, uint64_t files)
+{
+	uint64_t path_hk;
+
+	if (quota_slots == NULL || op_ctx->ctx_export == NULL)
+		return;
+
+	path_hk = quota_path_hk(exp, op_ctx->ctx_export->fullpath);
+	quota_add(exp, path_hk, USRQUOTA, owner, bytes, files);
+	quota_add(exp, path_hk, GRPQUOTA, group, bytes, files);
+}
+
+/**
+ * @brief Count the space a write adds to a file
+ *
+ * What lies past both the cached size and the end of the writes
+ * already counted.  Space the write fills inside the file, in holes,
+ * is left for the next fetch to find.
+ *
+ * @param[in] entry   The file
+ * @param[in] offset  Where the write starts
+ * @param[in] len     Its length
+ */
+void mdc_quota_write(mdcache_entry_t *entry, uint64_t offset, size_t len)
+{
+	uint64_t end = offset + len, cur, prev, size;
+	uid_t owner;
+	gid_t group;
+	bool known;
+
+	if (quota_slots == NULL || len == 0)
+		return;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+	known = (entry->attrs.valid_mask & (ATTR_SIZE | ATTR_OWNER |
+					    ATTR_GROUP)) ==
+		(ATTR_SIZE | ATTR_OWNER | ATTR_GROUP);
+	size = entry->attrs.filesize;
+	owner = entry->attrs.owner;
+	group = entry->attrs.group;
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	if (!known)
+		return;
+
+	do {
+		cur = atomic_fetch_uint64_t(&entry->quota_end);
+		prev = cur < size ? size : cur;
+		if (end <= prev)
+			return;
+	} while (!atomic_cmpxchg_uint64_t(&entry->quota_end, cur, end));
+
+	mdc_quota_charge(mdc_cur_export(), owner, group, end - prev, 0);
+}
+
+/**
+ * @brief Set up the quota cache
+ *
+ * Nothing is allocated when Quota_Cache_Size is 0.
+ *
+ * @return 0 on success, or if disabled.
+ */
+int mdcache_quota_pkginit(void)
+{
+	int i;
+
+	quota_nslots = mdcache_param.quota_size;
+	if (quota_nslots == 0)
+		return 0;
+
+	for (i = 0; i < QUOTA_PARTITIONS; ++i)
+		PTHREAD_MUTEX_init(&quota_part[i].mtx, NULL);
+
+	quota_slots = gsh_calloc(quota_nslots, sizeof(struct quota_slot));
+
+	LogInfo(COMPONENT_CACHE_INODE,
+		"Quota cache of %" PRIu32 " quotas, TTL %" PRIu32 " ms",
+		quota_nslots, mdcache_param.quota_ttl);
+
+	return 0;
+}
+
+/**
+ * @brief Tear down the quota cache
+ */
+void mdcache_quota_pkgshutdown(void)
+{
+	int i;
+
+	if (quota_slots == NULL)
+		return;
+
+	gsh_free(quota_slots);
+	quota_slots = NULL;
+	quota_nslots = 0;
+
+	for (i = 0; i < QUOTA_PARTITIONS; ++i)
+		PTHREAD_MUTEX_destroy(&quota_part[i].mtx);
+}
+
+/** @} */
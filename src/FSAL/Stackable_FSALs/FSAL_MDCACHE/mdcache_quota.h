@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_quota.h
+ * @brief Quota cache
+ *
+ * The quotas the sub-FSAL returned for a user or a group of an export
+ * are remembered for Quota_Cache_TTL milliseconds in one fixed-size
+ * table shared by all exports; a newer quota simply takes the slot of
+ * an older one.  The space and files added through this server since
+ * a quota was fetched are counted in its slot, so check_quota can
+ * refuse creates and writes over a hard limit without asking the
+ * sub-FSAL each time.
+ *
+ * A cached quota is only given to root, or to callers it is the quota
+ * of, user or group; the others go to the sub-FSAL, under their own
+ * credentials.
+ */
+
+#ifndef MDCACHE_QUOTA_H
+#define MDCACHE_QUOTA_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+int mdcache_quota_pkginit(void);
+void mdcache_quota_pkgshutdown(void);
+
+fsal_status_t mdc_quota_get(struct mdcache_fsal_export *exp,
+			    const char *filepath, int quota_type,
+			    int quota_id, fsal_quota_t *pquota);
+fsal_status_t mdc_quota_check(struct mdcache_fsal_export *exp,
+			      const char *filepath, int quota_type);
+void mdc_quota_forget(struct mdcache_fsal_export *exp, const char *filepath,
+		      int quota_type, int quota_id);
+void mdc_quota_forget_export(struct mdcache_fsal_export *exp);
+void mdc_quota_charge(struct mdcache_fsal_export *exp, uid_t owner,
+		      gid_t group, uint64_t bytes, uint64_t files);
+void mdc_quota_write(mdcache_entry_t *entry, uint64_t offset, size_t len);
+
+/**
+ * @brief Count a new object against the quotas of its owner
+ *
+ * @param[in] exp    Export it was created in
+ * @param[in] attrs  Its attributes, from the sub-FSAL
+ */
+static inline void mdc_quota_created(struct mdcache_fsal_export *exp,
+				     const struct attrlist *attrs)
+{
+	if (mdcache_param.quota_size != 0 &&
+	    (attrs->valid_mask & (ATTR_OWNER | ATTR_GROUP)) ==
+	    (ATTR_OWNER | ATTR_GROUP))
+		mdc_quota_charge(exp, attrs->owner, attrs->group, 0, 1);
+}
+
+#endif /* MDCACHE_QUOTA_H */
+
+/** @} */
@@ -0,0 +1,496 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_rahead.c
+ * @brief Read-ahead of files read sequentially
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+#include "export_mgr.h"
+#include "sal_functions.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+#include "mdcache_rahead.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/** Sequential READs in a row before reading ahead */
+#define MDC_RA_SEQ_MIN 2
+
+/** Seconds data read ahead may be served */
+#define MDC_RA_MAX_AGE 5
+
+struct mdc_ra_win {
+	char *buf;		/*< Read_Ahead_Size bytes, NULL if unused */
+	uint64_t offset;	/*< Offset of buf in the file */
+	size_t len;		/*< Bytes read into buf */
+	bool eof;		/*< buf ends at the end of the file */
+	time_t when;		/*< When it was read */
+};
+
+/**
+ * @brief Read-ahead state of a file
+ *
+ * Everything is protected by mtx.  win[1], if used, follows win[0].
+ */
+
+struct mdc_rahead {
+	pthread_mutex_t mtx;
+	struct state_t *stream;	/*< State of the stream, only compared */
+	uint64_t next;		/*< Where its next READ is expected */
+	uint32_t seq;		/*< READs in a row that followed on */
+	struct mdc_ra_win win[2];	/*< Data read ahead */
+	bool inflight;		/*< A read-ahead is running */
+	uint32_t gen;		/*< Bumped to throw away one in flight */
+};
+
+/**
+ * @brief A background read ahead
+ */
+
+struct mdc_ra_job {
+	mdcache_entry_t *entry;		/*< File to read, ref'd */
+	uint32_t gen;			/*< gen when started */
+	uint64_t offset;		/*< Where to read */
+	bool bypass;			/*< Bypass of the READ */
+	struct state_t *state;		/*< State of the READ, ref'd */
+	struct gsh_export *export;	/*< Export of the READ, ref'd */
+	struct fsal_export *fsal_export;	/*< Its MDCACHE export */
+	struct user_cred creds;		/*< Credentials of the READ */
+};
+
+static struct fridgethr *rahead_fridge;
+
+/** Bytes read ahead, or being read, over all files */
+static uint64_t rahead_bytes;
+
+static void mdc_ra_win_free(struct mdc_ra_win *win)
+{
+	if (win->buf == NULL)
+		return;
+
+	gsh_free(win->buf);
+	win->buf = NULL;
+	(void) atomic_sub_uint64_t(&rahead_bytes, mdcache_param.rahead.size);
+}
+
+static void mdc_ra_drop_locked(struct mdc_rahead *ra)
+{
+	mdc_ra_win_free(&ra->win[0]);
+	mdc_ra_win_free(&ra->win[1]);
+	ra->gen++;
+}
+
+static void mdc_ra_job_free(struct mdc_ra_job *job)
+{
+	mdcache_put(job->entry);
+	if (job->state != NULL)
+		dec_state_t_ref(job->state);
+	put_gsh_export(job->export);
+	gsh_free(job->creds.caller_garray);
+	gsh_free(job);
+}
+
+/**
+ * @brief Read one window ahead, in a read-ahead thread
+ *
+ * The data is kept only if nothing threw it away meanwhile and it
+ * still follows what the stream has.
+ *
+ * @param[in] ctx  Thread context, arg is the struct mdc_ra_job
+ */
+
+static void mdc_rahead_run(struct fridgethr_context *ctx)
+{
+	struct mdc_ra_job *job = ctx->arg;
+	mdcache_entry_t *entry = job->entry;
+	struct mdc_rahead *ra = entry->rahead;
+	struct root_op_context root_op_context;
+	uint32_t size = mdcache_param.rahead.size;
+	struct mdc_ra_win *win;
+	fsal_status_t status;
+	size_t amount = 0;
+	bool eof = false;
+	char *buf;
+
+	init_root_op_context(&root_op_context, job->export, job->fsal_export,
+			     0, 0, NFS_REQUEST);
+	root_op_context.req_ctx.creds = &job->creds;
+
+	buf = gsh_malloc(size);
+
+	subcall(
+		status = entry->sub_handle->obj_ops.read2(
+			entry->sub_handle, job->bypass, job->state,
+			job->offset, size, buf, &amount, &eof, NULL)
+	       );
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+
+	ra->inflight = false;
+
+	win = ra->win[0].buf == NULL ? &ra->win[0] : &ra->win[1];
+
+	if (!FSAL_IS_ERROR(status) && job->gen == ra->gen &&
+	    (amount != 0 || eof) && win->buf == NULL &&
+	    (win == &ra->win[0]
+	     ? job->offset <= ra->next && ra->next <= job->offset + amount
+	     : ra->win[0].offset + ra->win[0].len == job->offset)) {
+		win->buf = buf;
+		win->offset = job->offset;
+		win->len = amount;
+		win->eof = eof;
+		win->when = time(NULL);
+		buf = NULL;
+
+		(void) atomic_inc_uint64_t(&job->export->ra_reads);
+		(void) atomic_add_uint64_t(&job->export->ra_bytes, amount);
+	}
+
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+
+	if (FSAL_IS_ERROR(status))
+		LogDebug(COMPONENT_CACHE_INODE,
+			 "Read-ahead of %p at %" PRIu64 " failed with %s",
+			 entry, job->offset, fsal_err_txt(status));
+
+	if (buf != NULL) {
+		gsh_free(buf);
+		(void) atomic_sub_uint64_t(&rahead_bytes, size);
+	}
+
+	/* The last reference needs an op_ctx to clean the entry */
+	mdc_ra_job_free(job);
+	release_root_op_context();
+}
+
+/**
+ * @brief Start reading the window after what the stream has
+ *
+ * Nothing is started if a read-ahead is in flight, both windows are
+ * used, the end of file was read, or all the threads are busy.
+ *
+ * @note ra->mtx MUST be held
+ */
+
+static void mdc_rahead_start(mdcache_entry_t *entry, struct mdc_rahead *ra,
+			     bool bypass, struct state_t *state)
+{
+	uint32_t size = mdcache_param.rahead.size;
+	uint64_t budget = mdcache_param.rahead.budget;
+	struct mdc_ra_job *job;
+	uint64_t offset;
+	int rc;
+
+	if (ra->inflight || ra->win[1].buf != NULL)
+		return;
+
+	if (ra->win[0].buf != NULL) {
+		if (ra->win[0].eof)
+			return;
+		offset = ra->win[0].offset + ra->win[0].len;
+	} else {
+		offset = ra->next;
+	}
+
+	if (atomic_add_uint64_t(&rahead_bytes, size) > budget &&
+	    budget != 0) {
+		(void) atomic_sub_uint64_t(&rahead_bytes, size);
+		return;
+	}
+
+	if (FSAL_IS_ERROR(mdcache_get(entry))) {
+		(void) atomic_sub_uint64_t(&rahead_bytes, size);
+		return;
+	}
+
+	job = gsh_calloc(1, sizeof(*job));
+	job->entry = entry;
+	job->gen = ra->gen;
+	job->offset = offset;
+	job->bypass = bypass;
+	job->state = state;
+	if (state != NULL)
+		inc_state_t_ref(state);
+	job->export = op_ctx->ctx_export;
+	get_gsh_export_ref(job->export);
+	job->fsal_export = op_ctx->fsal_export;
+	job->creds = *op_ctx->creds;
+	if (job->creds.caller_glen != 0) {
+		job->creds.caller_garray =
+			gsh_malloc(job->creds.caller_glen * sizeof(gid_t));
+		memcpy(job->creds.caller_garray, op_ctx->creds->caller_garray,
+		       job->creds.caller_glen * sizeof(gid_t));
+	}
+
+	ra->inflight = true;
+
+	rc = fridgethr_submit(rahead_fridge, mdc_rahead_run, job);
+	if (rc != 0) {
+		LogFullDebug(COMPONENT_CACHE_INODE,
+			     "No read-ahead of %p: %d", entry, rc);
+		ra->inflight = false;
+		/* The READ holds a reference, this is not the last one */
+		mdc_ra_job_free(job);
+		(void) atomic_sub_uint64_t(&rahead_bytes, size);
+	}
+}
+
+/**
+ * @brief Copy a READ out of the windows
+ *
+ * @note ra->mtx MUST be held
+ *
+ * @return true if all of it, or all of it up to the end of file, was
+ *         there.
+ */
+
+static bool mdc_rahead_serve(struct mdc_rahead *ra, uint64_t offset,
+			     size_t size, char *buffer, size_t *read_amount,
+			     bool *eof)
+{
+	time_t now = time(NULL);
+	struct mdc_ra_win *win;
+	size_t done = 0, n;
+	uint64_t pos;
+	bool at_eof = false;
+	int i;
+
+	for (i = 0; i < 2 && done < size && !at_eof; i++) {
+		win = &ra->win[i];
+		pos = offset + done;
+
+		if (win->buf == NULL || now - win->when > MDC_RA_MAX_AGE ||
+		    pos < win->offset || pos > win->offset + win->len)
+			return false;
+
+		n = win->offset + win->len - pos;
+		if (n > size - done)
+			n = size - done;
+		memcpy(buffer + done, win->buf + (pos - win->offset), n);
+		done += n;
+		at_eof = win->eof && pos + n == win->offset + win->len;
+	}
+
+	if (done < size && !at_eof)
+		return false;
+
+	*read_amount = done;
+	*eof = at_eof;
+	return true;
+}
+
+static struct mdc_rahead *mdc_rahead_get(mdcache_entry_t *entry)
+{
+	struct mdc_rahead *ra;
+
+	ra = atomic_fetch_voidptr((void **)&entry->rahead);
+	if (ra != NULL)
+		return ra;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	ra = entry->rahead;
+	if (ra == NULL) {
+		ra = gsh_calloc(1, sizeof(*ra));
+		PTHREAD_MUTEX_init(&ra->mtx, NULL);
+		atomic_store_voidptr((void **)&entry->rahead, ra);
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	return ra;
+}
+
+/**
+ * @brief Follow a READ, and answer it from what was read ahead
+ *
+ * @param[in]  entry        File to read
+ * @param[in]  bypass       Bypass deny read
+ * @param[in]  state        Open file state to read
+ * @param[in]  offset       Offset into file
+ * @param[in]  size         Size of read buffer
+ * @param[out] buffer       Buffer to read into
+ * @param[out] read_amount  Amount read in bytes
+ * @param[out] eof          true if End of File was hit
+ *
+ * @return true if the READ was answered, false if the FSAL must do it.
+ */
+
+bool mdc_rahead_read(mdcache_entry_t *entry, bool bypass,
+		     struct state_t *state, uint64_t offset, size_t size,
+		     void *buffer, size_t *read_amount, bool *eof)
+{
+	struct mdc_rahead *ra;
+	struct mdc_ra_win *win;
+	bool served;
+
+	if (mdcache_param.rahead.size == 0 || rahead_fridge == NULL ||
+	    size == 0 || entry->obj_handle.type != REGULAR_FILE ||
+	    op_ctx->ctx_export == NULL || op_ctx->creds == NULL)
+		return false;
+
+	ra = mdc_rahead_get(entry);
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+
+	if (state == ra->stream && offset == ra->next) {
+		if (ra->seq < MDC_RA_SEQ_MIN)
+			ra->seq++;
+	} else {
+		if (state == ra->stream)
+			mdc_ra_drop_locked(ra);
+		ra->stream = state;
+		ra->seq = 1;
+	}
+	ra->next = offset + size;
+
+	served = mdc_rahead_serve(ra, offset, size, buffer, read_amount, eof);
+	if (served) {
+		(void) atomic_inc_uint64_t(&op_ctx->ctx_export->ra_hits);
+		(void) atomic_add_uint64_t(&op_ctx->ctx_export->ra_hit_bytes,
+					   *read_amount);
+	}
+
+	/* Free what the stream went past, and start on the next window */
+	win = &ra->win[0];
+	if (win->buf != NULL && !win->eof &&
+	    ra->next >= win->offset + win->len) {
+		mdc_ra_win_free(win);
+		*win = ra->win[1];
+		ra->win[1].buf = NULL;
+	}
+
+	if (win->buf != NULL &&
+	    (ra->next < win->offset ||
+	     time(NULL) - win->when > MDC_RA_MAX_AGE ||
+	     ra->next > (ra->win[1].buf != NULL
+			 ? ra->win[1].offset + ra->win[1].len
+			 : win->offset + win->len)))
+		mdc_ra_drop_locked(ra);
+
+	if (ra->seq >= MDC_RA_SEQ_MIN)
+		mdc_rahead_start(entry, ra, bypass, state);
+
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+
+	return served;
+}
+
+void mdc_rahead_do_drop(mdcache_entry_t *entry)
+{
+	struct mdc_rahead *ra = entry->rahead;
+
+	PTHREAD_MUTEX_lock(&ra->mtx);
+
+	mdc_ra_drop_locked(ra);
+	ra->seq = 0;
+
+	PTHREAD_MUTEX_unlock(&ra->mtx);
+}
+
+/**
+ * @brief Free the read-ahead state of an entry being cleaned
+ *
+ * Nothing is in flight; a read-ahead holds a reference.
+ *
+ * @param[in] entry  The entry
+ */
+
+void mdc_rahead_free(mdcache_entry_t *entry)
+{
+	struct mdc_rahead *ra = entry->rahead;
+
+	if (ra == NULL)
+		return;
+
+	mdc_ra_drop_locked(ra);
+	PTHREAD_MUTEX_destroy(&ra->mtx);
+	gsh_free(ra);
+	entry->rahead = NULL;
+}
+
+/**
+ * @brief Start the read-ahead threads
+ *
+ * @return 0 on success, POSIX errors on failure.
+ */
+
+int mdcache_rahead_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.rahead.size == 0)
+		return 0;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = mdcache_param.rahead.threads;
+	frp.thr_min = 0;
+	frp.flavor = fridgethr_flavor_worker;
+	frp.deferment = fridgethr_defer_fail;
+
+	rc = fridgethr_init(&rahead_fridge, "MDC_file_ra", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize file read-ahead fridge, error code %d.",
+			 rc);
+	return rc;
+}
+
+/**
+ * @brief Stop the read-ahead threads
+ */
+
+void mdcache_rahead_pkgshutdown(void)
+{
+	int rc;
+
+	if (rahead_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(rahead_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(rahead_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down file read-ahead fridge: %d", rc);
+	}
+}
+
+/** @} */
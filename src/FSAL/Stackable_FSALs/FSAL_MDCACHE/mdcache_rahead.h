@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_rahead.h
+ * @brief Read-ahead of files read sequentially
+ *
+ * With Read_Ahead_Size set, each READ of a regular file is checked
+ * against where the previous READ through the same state ended.  Once
+ * a few follow on, Read_Ahead_Size bytes past the end of the stream are
+ * read by a background thread into a window, and a second window is
+ * read after it, so READs are answered from memory while the next
+ * window is being read.  A window is freed once the stream goes past
+ * it.
+ *
+ * Any write, setattr, copy or clone to the file, its close, an
+ * invalidation from the FSAL, or a READ of the stream elsewhere throws
+ * away what was read ahead, and nothing is served more than a few
+ * seconds after it was read.
+ */
+
+#ifndef MDCACHE_RAHEAD_H
+#define MDCACHE_RAHEAD_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+int mdcache_rahead_pkginit(void);
+void mdcache_rahead_pkgshutdown(void);
+
+bool mdc_rahead_read(mdcache_entry_t *entry, bool bypass,
+		     struct state_t *state, uint64_t offset, size_t size,
+		     void *buffer, size_t *read_amount, bool *eof);
+void mdc_rahead_do_drop(mdcache_entry_t *entry);
+void mdc_rahead_free(mdcache_entry_t *entry);
+
+/**
+ * @brief Throw away what was read ahead of a file
+ *
+ * @param[in] entry  The file
+ */
+static inline void
+mdc_rahead_drop(mdcache_entry_t *entry)
+{
+	if (atomic_fetch_voidptr((void **)&entry->rahead) != NULL)
+		mdc_rahead_do_drop(entry);
+}
+
+#endif /* MDCACHE_RAHEAD_H */
+
+/** @} */
@@ -43,6 +43,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/param.h>
+#include <netinet/in.h>
 #include <time.h>
 #include <pthread.h>
 #include <string.h>
@@ -52,6 +53,18 @@
 
 struct mdcache_parameter mdcache_param;
 
+static struct config_item_list lru_policies[] = {
+	CONFIG_LIST_TOK("lru", MDCACHE_LRU_POLICY_LRU),
+	CONFIG_LIST_TOK("2q", MDCACHE_LRU_POLICY_2Q),
+	CONFIG_LIST_EOL
+};
+
+static struct config_item_list reaper_modes[] = {
+	CONFIG_LIST_TOK("burst", MDCACHE_REAPER_BURST),
+	CONFIG_LIST_TOK("continuous", MDCACHE_REAPER_CONTINUOUS),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item mdcache_params[] = {
 	CONF_ITEM_UI32("NParts", 1, 32633, 7,
 		       mdcache_parameter, nparts),
@@ -59,16 +72,80 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, cache_size),
 	CONF_ITEM_BOOL("Use_Getattr_Directory_Invalidation", false,
 		       mdcache_parameter, getattr_dir_invalidation),
+	CONF_ITEM_BOOL("Delegation_Attr_Trust", false,
+		       mdcache_parameter, delegation_attr_trust),
+	CONF_ITEM_UI32("Access_Cache", 0, 16, 4,
+		       mdcache_parameter, access_cache),
+	CONF_ITEM_UI32("Xattr_Cache", 0, 64, 8,
+		       mdcache_parameter, xattr_cache),
+	CONF_ITEM_UI32("Xattr_Cache_Value_Max", 0, 65536, 1024,
+		       mdcache_parameter, xattr_value_max),
+	CONF_ITEM_UI32("Statfs_Cache_TTL", 0, 60000, 1000,
+		       mdcache_parameter, statfs_ttl),
+	CONF_ITEM_UI32("Quota_Cache_Size", 0, 1024 * 1024, 0,
+		       mdcache_parameter, quota_size),
+	CONF_ITEM_UI32("Quota_Cache_TTL", 1, 60000, 2000,
+		       mdcache_parameter, quota_ttl),
 	CONF_ITEM_UI32("Dir_Max_Deleted", 1, UINT32_MAX, 65536,
 		       mdcache_parameter, dir.avl_max_deleted),
 	CONF_ITEM_UI32("Dir_Max", 1, UINT32_MAX, 65536,
 		       mdcache_parameter, dir.avl_max),
+	CONF_ITEM_UI32("Dir_Chunk", 32, 65536, 128,
+		       mdcache_parameter, dir.avl_chunk),
+	CONF_ITEM_UI32("Dir_Readahead_Threads", 0, 64, 2,
+		       mdcache_parameter, dir.readahead_threads),
+	CONF_ITEM_UI32("Dir_Negative_Cache_Size", 0, UINT32_MAX, 0,
+		       mdcache_parameter, dir.neg_size),
+	CONF_ITEM_UI32("Dir_Negative_Cache_TTL", 1, 3600, 5,
+		       mdcache_parameter, dir.neg_ttl),
+	CONF_ITEM_UI32("Hot_Objects", 0, 4096, 0,
+		       mdcache_parameter, hot_objects),
+	CONF_ITEM_UI32("Write_Gather_Size", 0, 64 * 1024 * 1024, 0,
+		       mdcache_parameter, wgather.size),
+	CONF_ITEM_UI32("Write_Gather_Delay", 1, 10000, 100,
+		       mdcache_parameter, wgather.delay),
+	CONF_ITEM_UI64("Write_Gather_Budget", 0, UINT64_MAX, 256 * 1024 * 1024,
+		       mdcache_parameter, wgather.budget),
+	CONF_ITEM_BOOL("Group_Commit", true,
+		       mdcache_parameter, gcommit.enable),
+	CONF_ITEM_UI32("Group_Commit_Delay", 0, 100000, 0,
+		       mdcache_parameter, gcommit.delay),
+	CONF_ITEM_UI32("Read_Ahead_Size", 0, 64 * 1024 * 1024, 0,
+		       mdcache_parameter, rahead.size),
+	CONF_ITEM_UI32("Read_Ahead_Threads", 1, 64, 4,
+		       mdcache_parameter, rahead.threads),
+	CONF_ITEM_UI64("Read_Ahead_Budget", 0, UINT64_MAX, 256 * 1024 * 1024,
+		       mdcache_parameter, rahead.budget),
+	CONF_ITEM_STR("Coherency_Group", 1, INET6_ADDRSTRLEN, NULL,
+		      mdcache_parameter, bus.group),
+	CONF_ITEM_UI16("Coherency_Port", 1, UINT16_MAX, 32049,
+		       mdcache_parameter, bus.port),
+	CONF_ITEM_UI32("Coherency_TTL", 1, 255, 1,
+		       mdcache_parameter, bus.ttl),
+	CONF_ITEM_PATH("Warm_Cache_File", 1, MAXPATHLEN, NULL,
+		       mdcache_parameter, warm.file),
+	CONF_ITEM_UI32("Warm_Cache_Interval", 0, 24 * 3600, 300,
+		       mdcache_parameter, warm.interval),
+	CONF_ITEM_BOOL("Hugepage_Arenas", false,
+		       mdcache_parameter, hugepage_arenas),
 	CONF_ITEM_UI32("Entries_HWMark", 1, UINT32_MAX, 100000,
 		       mdcache_parameter, entries_hwmark),
+	CONF_ITEM_TOKEN("LRU_Policy", MDCACHE_LRU_POLICY_LRU, lru_policies,
+			mdcache_parameter, lru_policy),
+	CONF_ITEM_UI32("Probation_Percent", 1, 90, 25,
+		       mdcache_parameter, probation_percent),
+	CONF_ITEM_UI32("Ghost_Percent", 1, 400, 50,
+		       mdcache_parameter, ghost_percent),
+	CONF_ITEM_UI32("Chunks_HWMark", 1, UINT32_MAX, 10000,
+		       mdcache_parameter, chunks_hwmark),
+	CONF_ITEM_UI64("Memory_Budget", 0, UINT64_MAX, 0,
+		       mdcache_parameter, memory_budget),
 	CONF_ITEM_UI32("LRU_Run_Interval", 1, 24 * 3600, 90,
 		       mdcache_parameter, lru_run_interval),
 	CONF_ITEM_BOOL("Cache_FDs", true,
 		       mdcache_parameter, use_fd_cache),
+	CONF_ITEM_BOOL("FD_LRU", true,
+		       mdcache_parameter, fd_lru),
 	CONF_ITEM_UI32("FD_Limit_Percent", 0, 100, 99,
 		       mdcache_parameter, fd_limit_percent),
 	CONF_ITEM_UI32("FD_HWMark_Percent", 0, 100, 90,
@@ -77,6 +154,10 @@ static struct config_item mdcache_params[] = {
 		       mdcache_parameter, fd_lwmark_percent),
 	CONF_ITEM_UI32("Reaper_Work", 1, 2000, 1000,
 		       mdcache_parameter, reaper_work),
+	CONF_ITEM_TOKEN("Reaper_Mode", MDCACHE_REAPER_BURST, reaper_modes,
+			mdcache_parameter, reaper_mode),
+	CONF_ITEM_UI32("Reaper_Target_Percent", 1, 100, 90,
+		       mdcache_parameter, reaper_target_percent),
 	CONF_ITEM_UI32("Biggest_Window", 1, 100, 40,
 		       mdcache_parameter, biggest_window),
 	CONF_ITEM_UI32("Required_Progress", 1, 50, 5,
@@ -37,8 +37,10 @@
 #include "nfs4_acls.h"
 #include "mdcache_hash.h"
 #include "mdcache_int.h"
+#include "mdcache_rahead.h"
+#include "mdcache_neg.h"
 
-static fsal_status_t
+fsal_status_t
 mdc_up_invalidate(struct fsal_export *export, struct gsh_buffdesc *handle,
 		  uint32_t flags)
 {
@@ -59,15 +61,27 @@ mdc_up_invalidate(struct fsal_export *export, struct gsh_buffdesc *handle,
 	status = mdcache_find_keyed(&key, &entry);
 	if (status.major == ERR_FSAL_NOENT) {
 		/* Not cached, so invalidate is a success */
+		op_ctx = save_ctx;
 		return fsalstat(ERR_FSAL_NO_ERROR, 0);
 	} else if (FSAL_IS_ERROR(status)) {
 		/* Real error */
+		op_ctx = save_ctx;
 		return status;
 	}
 
 	atomic_clear_uint32_t_bits(&entry->mde_flags,
 				   flags & FSAL_UP_INVALIDATE_CACHE);
 
+	if (flags & FSAL_UP_INVALIDATE_CACHE)
+		mdc_rahead_drop(entry);
+
+	if (flags & FSAL_UP_INVALIDATE_ATTRS)
+		mdc_xattr_drop(entry);
+
+	if ((flags & FSAL_UP_INVALIDATE_CONTENT) &&
+	    entry->obj_handle.type == DIRECTORY)
+		mdcache_neg_flush(entry);
+
 	if (flags & FSAL_UP_INVALIDATE_CLOSE)
 		status = fsal_close(&entry->obj_handle);
 
@@ -192,9 +206,13 @@ mdc_up_update(struct fsal_export *export, struct gsh_buffdesc *handle,
 		 * an asynchronous call.
 		 */
 
+		(void)atomic_sub_uint64_t(&cache_stp->mem_acls,
+					  mdc_acl_size(entry->attrs.acl));
 		nfs4_acl_release_entry(entry->attrs.acl);
 
 		entry->attrs.acl = attr->acl;
+		(void)atomic_add_uint64_t(&cache_stp->mem_acls,
+					  mdc_acl_size(entry->attrs.acl));
 		mutatis_mutandis = true;
 	}
 
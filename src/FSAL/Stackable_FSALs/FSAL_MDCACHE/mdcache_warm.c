@@ -0,0 +1,379 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_warm.c
+ * @brief Hot objects saved across restarts
+ *
+ * The objects counted by the hot object sketch (Hot_Objects) are saved
+ * to Warm_Cache_File every Warm_Cache_Interval seconds and on a clean
+ * shutdown.  Once the exports are up at the next start, a thread
+ * loads them back, hottest first: those last found by a lookup are
+ * looked up again in their directory, so the dirent is cached too, and
+ * the others are created from their key.  Clients coming back during
+ * grace then find them cached.
+ *
+ * The file is a header, then one record per object, in network byte
+ * order:
+ *
+ *   magic (4), version (2), unused (2), records (4)
+ *   export id (2), key length (2), parent key length (2),
+ *   name length (2), key, parent key, name
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
+#include "mdcache.h"
+#include "mdcache_int.h"
+#include "mdcache_hot.h"
+#include "mdcache_warm.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <arpa/inet.h>
+
+#define WARM_MAGIC 0x4d444357	/* "MDCW" */
+#define WARM_VERSION 1
+#define WARM_HEADER 12
+#define WARM_RECORD 8
+/** Longest key or name read back; hot objects have shorter ones */
+#define WARM_FIELD_MAX 256
+
+static struct fridgethr *warm_fridge;
+static bool warm_loaded;	/*< The file was read back */
+
+/**
+ * @brief Write one record of the file
+ */
+static bool warm_save_obj(const struct mdc_hot_obj *obj, void *arg)
+{
+	FILE *f = arg;
+	uint16_t hdr[4];
+
+	hdr[0] = htons(obj->export_id);
+	hdr[1] = htons(obj->key.len);
+	hdr[2] = htons(obj->parent.len);
+	hdr[3] = htons(strlen(obj->name));
+
+	return fwrite(hdr, sizeof(hdr), 1, f) == 1 &&
+	       fwrite(obj->key.addr, obj->key.len, 1, f) == 1 &&
+	       (obj->parent.len == 0 ||
+		fwrite(obj->parent.addr, obj->parent.len, 1, f) == 1) &&
+	       (hdr[3] == 0 ||
+		fwrite(obj->name, ntohs(hdr[3]), 1, f) == 1);
+}
+
+/**
+ * @brief Save the hot objects to Warm_Cache_File
+ *
+ * Written under a temporary name that replaces the file once complete,
+ * so a crash while saving leaves the last one whole.
+ */
+static void warm_save(void)
+{
+	const char *path = mdcache_param.warm.file;
+	char tmp[MAXPATHLEN];
+	uint32_t hdr[3], n;
+	FILE *f;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp))
+		return;
+
+	f = fopen(tmp, "w");
+	if (f == NULL) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Could not write %s: %s", tmp, strerror(errno));
+		return;
+	}
+
+	/* The count is filled in once the objects are written */
+	memset(hdr, 0, sizeof(hdr));
+	if (fwrite(hdr, sizeof(hdr), 1, f) != 1)
+		goto err;
+
+	n = mdc_hot_walk(warm_save_obj, f);
+
+	hdr[0] = htonl(WARM_MAGIC);
+	hdr[1] = htonl(WARM_VERSION << 16);
+	hdr[2] = htonl(n);
+	if (fseek(f, 0, SEEK_SET) != 0 ||
+	    fwrite(hdr, sizeof(hdr), 1, f) != 1)
+		goto err;
+
+	if (fclose(f) != 0 || rename(tmp, path) != 0) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Could not replace %s: %s", path, strerror(errno));
+		(void) unlink(tmp);
+		return;
+	}
+
+	LogDebug(COMPONENT_CACHE_INODE,
+		 "Saved %" PRIu32 " hot objects to %s", n, path);
+	return;
+
+err:
+	LogWarn(COMPONENT_CACHE_INODE,
+		"Could not write %s: %s", tmp, strerror(errno));
+	(void) fclose(f);
+	(void) unlink(tmp);
+}
+
+/**
+ * @brief Bring one saved object into the cache
+ *
+ * @param[in] export_id  Its export
+ * @param[in] key        Its key
+ * @param[in] parent     Key of the directory it was looked up in, or
+ *                       len 0
+ * @param[in] name       Name it was looked up by, if @a parent is set
+ *
+ * @return true if it is cached.
+ */
+static bool warm_load_obj(uint16_t export_id, struct gsh_buffdesc *key,
+			  struct gsh_buffdesc *parent, const char *name)
+{
+	struct gsh_export *export = get_gsh_export(export_id);
+	struct root_op_context root_op_context;
+	struct fsal_export *exp_hdl;
+	struct fsal_obj_handle *dir = NULL, *obj = NULL;
+	fsal_status_t status = fsalstat(ERR_FSAL_NOENT, 0);
+
+	if (export == NULL)
+		return false;
+
+	exp_hdl = export->fsal_export;
+	if (!export_ready(export) || exp_hdl == NULL ||
+	    strcmp(exp_hdl->fsal->name, mdcachename) != 0) {
+		put_gsh_export(export);
+		return false;
+	}
+
+	init_root_op_context(&root_op_context, export, exp_hdl,
+			     0, 0, UNKNOWN_REQUEST);
+
+	/* Looked up again by name, the object and its dirent come back */
+	if (parent->len != 0 && name[0] != '\0') {
+		status = exp_hdl->exp_ops.create_handle(exp_hdl, parent,
+							&dir, NULL);
+		if (!FSAL_IS_ERROR(status)) {
+			status = dir->obj_ops.lookup(dir, name, &obj, NULL);
+			dir->obj_ops.put_ref(dir);
+		}
+	}
+
+	/* Renamed or removed since, or never looked up: go by the key */
+	if (FSAL_IS_ERROR(status))
+		status = exp_hdl->exp_ops.create_handle(exp_hdl, key,
+							&obj, NULL);
+
+	if (!FSAL_IS_ERROR(status))
+		obj->obj_ops.put_ref(obj);
+
+	release_root_op_context();
+	put_gsh_export(export);
+
+	return !FSAL_IS_ERROR(status);
+}
+
+/**
+ * @brief Read the saved objects back into the cache
+ *
+ * @param[in] ctx  Thread context, to stop early on shutdown
+ */
+static void warm_load(struct fridgethr_context *ctx)
+{
+	const char *path = mdcache_param.warm.file;
+	char key[WARM_FIELD_MAX], parent[WARM_FIELD_MAX];
+	char name[WARM_FIELD_MAX + 1];
+	struct gsh_buffdesc kd, pd;
+	uint32_t hdr[3], n, i, loaded = 0;
+	uint16_t rec[4];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		if (errno != ENOENT)
+			LogWarn(COMPONENT_CACHE_INODE,
+				"Could not read %s: %s", path,
+				strerror(errno));
+		return;
+	}
+
+	if (fread(hdr, sizeof(hdr), 1, f) != 1 ||
+	    ntohl(hdr[0]) != WARM_MAGIC ||
+	    ntohl(hdr[1]) >> 16 != WARM_VERSION) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"%s is not a cache warm file, ignored", path);
+		goto out;
+	}
+
+	n = ntohl(hdr[2]);
+	for (i = 0; i < n && !fridgethr_you_should_break(ctx); i++) {
+		if (fread(rec, sizeof(rec), 1, f) != 1)
+			break;
+
+		kd.len = ntohs(rec[1]);
+		pd.len = ntohs(rec[2]);
+		if (kd.len == 0 || kd.len > WARM_FIELD_MAX ||
+		    pd.len > WARM_FIELD_MAX ||
+		    ntohs(rec[3]) > WARM_FIELD_MAX)
+			break;
+
+		name[ntohs(rec[3])] = '\0';
+		if (fread(key, kd.len, 1, f) != 1 ||
+		    (pd.len != 0 && fread(parent, pd.len, 1, f) != 1) ||
+		    (rec[3] != 0 && fread(name, ntohs(rec[3]), 1, f) != 1))
+			break;
+
+		kd.addr = key;
+		pd.addr = parent;
+		if (warm_load_obj(ntohs(rec[0]), &kd, &pd, name))
+			loaded++;
+	}
+
+	(void) atomic_add_uint64_t(&cache_stp->warm_loaded, loaded);
+
+	LogEvent(COMPONENT_CACHE_INODE,
+		 "Loaded %" PRIu32 " of %" PRIu32 " saved hot objects from %s",
+		 loaded, n, path);
+
+out:
+	(void) fclose(f);
+}
+
+/**
+ * @brief Read the file back once, then save it periodically
+ *
+ * @param[in] ctx  Thread context
+ */
+static void warm_run(struct fridgethr_context *ctx)
+{
+	SetNameFunction("mdc_warm");
+
+	if (!warm_loaded) {
+		warm_load(ctx);
+		warm_loaded = true;
+		return;
+	}
+
+	if (!fridgethr_you_should_break(ctx))
+		warm_save();
+}
+
+/**
+ * @brief Set up saving the hot objects, if Warm_Cache_File is set
+ *
+ * @return 0, or the error keeping it from starting.
+ */
+int mdcache_warm_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	if (mdcache_param.warm.file == NULL)
+		return 0;
+
+	if (mdcache_param.hot_objects == 0) {
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Warm_Cache_File needs Hot_Objects, nothing is saved");
+		return 0;
+	}
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = mdcache_param.warm.interval;
+	frp.flavor = fridgethr_flavor_looper;
+
+	rc = fridgethr_init(&warm_fridge, "MDC_warm", &frp);
+	if (rc != 0)
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to initialize cache warm fridge, error code %d.",
+			 rc);
+	return rc;
+}
+
+/**
+ * @brief Load the saved objects, in the background
+ *
+ * Called once the exports are up, since the objects are found through
+ * them.
+ */
+void mdcache_warm_start(void)
+{
+	int rc;
+
+	if (warm_fridge == NULL)
+		return;
+
+	rc = fridgethr_submit(warm_fridge, warm_run, NULL);
+	if (rc != 0)
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Unable to start cache warm thread, error code %d.",
+			 rc);
+}
+
+/**
+ * @brief Stop the thread and save the hot objects a last time
+ */
+void mdcache_warm_pkgshutdown(void)
+{
+	int rc;
+
+	if (warm_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(warm_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(warm_fridge);
+		return;
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_CACHE_INODE,
+			 "Failed shutting down cache warm fridge: %d", rc);
+	}
+
+	/* Not before the load, which would find nothing hot yet */
+	if (warm_loaded)
+		warm_save();
+
+	fridgethr_destroy(warm_fridge);
+	warm_fridge = NULL;
+}
+
+/** @} */
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_warm.h
+ * @brief Hot objects saved across restarts
+ */
+
+#ifndef MDCACHE_WARM_H
+#define MDCACHE_WARM_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+int mdcache_warm_pkginit(void);
+void mdcache_warm_pkgshutdown(void);
+
+#endif /* MDCACHE_WARM_H */
+
+/** @} */
@@ -0,0 +1,425 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_wgather.c
+ * @brief Gathering of small unstable writes
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "fsal.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "delayed_exec.h"
+#include "export_mgr.h"
+#include "sal_functions.h"
+#include "mdcache_int.h"
+#include "mdcache_lru.h"
+#include "mdcache_wgather.h"
+
+#include <string.h>
+#include <pthread.h>
+
+/**
+ * @brief Writes gathered on a file
+ *
+ * Everything is protected by mtx.  While len is not 0, the data was
+ * written with state, bypass, export and creds, and a timer is queued.
+ */
+
+struct mdc_wgather {
+	pthread_mutex_t mtx;
+	char *buf;			/*< Write_Gather_Size bytes, or NULL */
+	uint64_t offset;		/*< Offset of buf in the file */
+	size_t len;			/*< Bytes gathered */
+	struct timespec last;		/*< When the last write was gathered */
+	struct state_t *state;		/*< State of the writes, ref'd */
+	bool bypass;			/*< Bypass of the writes */
+	struct gsh_export *export;	/*< Export of the writes, ref'd */
+	struct fsal_export *fsal_export;	/*< Its MDCACHE export */
+	uint32_t nfs_vers;		/*< NFS version of the writes */
+	uint32_t nfs_minorvers;		/*< NFSv4 minor version */
+	struct user_cred creds;		/*< Credentials of the writes */
+	struct gsh_export *timer_export;	/*< Export of the timer, ref'd */
+	struct fsal_export *timer_fsal_export;	/*< Its MDCACHE export */
+	bool timer;			/*< A flush is queued */
+	fsal_status_t error;		/*< Error of a background flush */
+};
+
+/** Bytes of buffers over all files */
+static uint64_t wgather_bytes;
+
+static bool creds_equal(const struct user_cred *a, const struct user_cred *b)
+{
+	return a->caller_uid == b->caller_uid &&
+	       a->caller_gid == b->caller_gid &&
+	       a->caller_glen == b->caller_glen &&
+	       (a->caller_glen == 0 ||
+		memcmp(a->caller_garray, b->caller_garray,
+		       a->caller_glen * sizeof(gid_t)) == 0);
+}
+
+/**
+ * @brief Write out, and drop, what is gathered
+ *
+ * @note wg->mtx MUST be held
+ *
+ * @param[in] entry  The file
+ * @param[in] wg     Its gathered writes
+ *
+ * @return Status of the write.
+ */
+
+static fsal_status_t mdc_wgather_flush_locked(mdcache_entry_t *entry,
+					      struct mdc_wgather *wg)
+{
+	struct root_op_context root_op_context;
+	fsal_status_t status = {0, 0};
+	size_t done = 0, written;
+	bool stable;
+
+	if (wg->len == 0)
+		return status;
+
+	init_root_op_context(&root_op_context, wg->export, wg->fsal_export,
+			     wg->nfs_vers, wg->nfs_minorvers, NFS_REQUEST);
+	root_op_context.req_ctx.creds = &wg->creds;
+
+	while (done < wg->len) {
+		written = 0;
+		stable = false;
+
+		subcall(
+			status = entry->sub_handle->obj_ops.write2(
+				entry->sub_handle, wg->bypass, wg->state,
+				wg->offset + done, wg->len - done,
+				wg->buf + done, &written, &stable, NULL)
+		       );
+
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		if (written == 0) {
+			status = fsalstat(ERR_FSAL_IO, 0);
+			break;
+		}
+
+		done += written;
+	}
+
+	release_root_op_context();
+
+	LogFullDebug(COMPONENT_CACHE_INODE,
+		     "Wrote %zu gathered bytes at %" PRIu64 " of %p: %s",
+		     wg->len, wg->offset, entry, fsal_err_txt(status));
+
+	if (FSAL_IS_ERROR(status) && !FSAL_IS_ERROR(wg->error))
+		wg->error = status;
+
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
+
+	if (wg->state != NULL)
+		dec_state_t_ref(wg->state);
+	wg->state = NULL;
+	put_gsh_export(wg->export);
+	wg->export = NULL;
+	gsh_free(wg->creds.caller_garray);
+	wg->creds.caller_garray = NULL;
+	gsh_free(wg->buf);
+	wg->buf = NULL;
+	wg->len = 0;
+	(void) atomic_sub_uint64_t(&wgather_bytes, mdcache_param.wgather.size);
+
+	return status;
+}
+
+/**
+ * @brief Write out what is gathered once Write_Gather_Delay passed
+ *
+ * @param[in] arg  The entry, ref'd for the timer
+ */
+
+static void mdc_wgather_timer(void *arg)
+{
+	mdcache_entry_t *entry = arg;
+	struct mdc_wgather *wg = entry->wgather;
+	struct root_op_context root_op_context;
+	struct gsh_export *export;
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	export = wg->timer_export;
+	init_root_op_context(&root_op_context, export,
+			     wg->timer_fsal_export, 0, 0, NFS_REQUEST);
+	wg->timer_export = NULL;
+	wg->timer = false;
+
+	/* The error is kept for the next COMMIT */
+	(void) mdc_wgather_flush_locked(entry, wg);
+
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	/* The last reference needs an op_ctx to clean the entry */
+	mdcache_put(entry);
+	release_root_op_context();
+	put_gsh_export(export);
+}
+
+/**
+ * @brief Start gathering at @a offset
+ *
+ * @note wg->mtx MUST be held and nothing gathered
+ *
+ * @return false if over Write_Gather_Budget or no timer could be queued.
+ */
+
+static bool mdc_wgather_start(mdcache_entry_t *entry, struct mdc_wgather *wg,
+			      bool bypass, struct state_t *state,
+			      uint64_t offset)
+{
+	uint32_t size = mdcache_param.wgather.size;
+	uint64_t budget = mdcache_param.wgather.budget;
+
+	if (atomic_add_uint64_t(&wgather_bytes, size) > budget &&
+	    budget != 0) {
+		(void) atomic_sub_uint64_t(&wgather_bytes, size);
+		return false;
+	}
+
+	if (!wg->timer) {
+		if (FSAL_IS_ERROR(mdcache_get(entry))) {
+			(void) atomic_sub_uint64_t(&wgather_bytes, size);
+			return false;
+		}
+
+		wg->timer_export = op_ctx->ctx_export;
+		wg->timer_fsal_export = op_ctx->fsal_export;
+		get_gsh_export_ref(wg->timer_export);
+
+		if (delayed_submit(mdc_wgather_timer, entry,
+				   mdcache_param.wgather.delay * NS_PER_MSEC)
+		    != 0) {
+			/* The caller has a reference too, this is not the
+			 * last one.
+			 */
+			mdcache_put(entry);
+			put_gsh_export(wg->timer_export);
+			wg->timer_export = NULL;
+			(void) atomic_sub_uint64_t(&wgather_bytes, size);
+			return false;
+		}
+
+		wg->timer = true;
+	}
+
+	wg->buf = gsh_malloc(size);
+	wg->offset = offset;
+	wg->state = state;
+	if (state != NULL)
+		inc_state_t_ref(state);
+	wg->bypass = bypass;
+	wg->export = op_ctx->ctx_export;
+	get_gsh_export_ref(wg->export);
+	wg->fsal_export = op_ctx->fsal_export;
+	wg->nfs_vers = op_ctx->nfs_vers;
+	wg->nfs_minorvers = op_ctx->nfs_minorvers;
+	wg->creds = *op_ctx->creds;
+	if (wg->creds.caller_glen != 0) {
+		wg->creds.caller_garray =
+			gsh_malloc(wg->creds.caller_glen * sizeof(gid_t));
+		memcpy(wg->creds.caller_garray, op_ctx->creds->caller_garray,
+		       wg->creds.caller_glen * sizeof(gid_t));
+	} else {
+		wg->creds.caller_garray = NULL;
+	}
+
+	return true;
+}
+
+static struct mdc_wgather *mdc_wgather_get(mdcache_entry_t *entry)
+{
+	struct mdc_wgather *wg;
+
+	wg = atomic_fetch_voidptr((void **)&entry->wgather);
+	if (wg != NULL)
+		return wg;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	wg = entry->wgather;
+	if (wg == NULL) {
+		wg = gsh_calloc(1, sizeof(*wg));
+		PTHREAD_MUTEX_init(&wg->mtx, NULL);
+		atomic_store_voidptr((void **)&entry->wgather, wg);
+	}
+
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+
+	return wg;
+}
+
+/**
+ * @brief Gather a write, if it can be
+ *
+ * A write is gathered if it is UNSTABLE, plain data, smaller than
+ * Write_Gather_Size, and follows what is gathered with the same state
+ * and credentials.  Anything else gathered on the file is written first.
+ *
+ * @param[in]  entry     File to write
+ * @param[in]  bypass    Bypass any non-mandatory deny write
+ * @param[in]  state     Open file state to write
+ * @param[in]  offset    Offset into file
+ * @param[in]  buf_size  Size of write buffer
+ * @param[in]  buffer    Buffer to write from
+ * @param[in]  stable    Whether the write must be stable
+ * @param[in]  info      io_info for WRITE_PLUS
+ * @param[out] status    Status of the write, if handled
+ *
+ * @return true if the write was handled, all of it or with an error.
+ */
+
+bool mdc_wgather_write(mdcache_entry_t *entry, bool bypass,
+		       struct state_t *state, uint64_t offset,
+		       size_t buf_size, void *buffer, bool stable,
+		       struct io_info *info, fsal_status_t *status)
+{
+	uint32_t size = mdcache_param.wgather.size;
+	struct mdc_wgather *wg;
+
+	if (size == 0 || stable || info != NULL || buf_size == 0 ||
+	    buf_size >= size || entry->obj_handle.type != REGULAR_FILE ||
+	    op_ctx->ctx_export == NULL || op_ctx->creds == NULL)
+		return false;
+
+	wg = mdc_wgather_get(entry);
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	if (wg->len != 0 &&
+	    (offset != wg->offset + wg->len || wg->len + buf_size > size ||
+	     state != wg->state || bypass != wg->bypass ||
+	     op_ctx->ctx_export != wg->export ||
+	     !creds_equal(op_ctx->creds, &wg->creds)))
+		(void) mdc_wgather_flush_locked(entry, wg);
+
+	if (FSAL_IS_ERROR(wg->error)) {
+		*status = wg->error;
+		wg->error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+		PTHREAD_MUTEX_unlock(&wg->mtx);
+		return true;
+	}
+
+	if (wg->len == 0 &&
+	    !mdc_wgather_start(entry, wg, bypass, state, offset)) {
+		PTHREAD_MUTEX_unlock(&wg->mtx);
+		return false;
+	}
+
+	memcpy(wg->buf + wg->len, buffer, buf_size);
+	wg->len += buf_size;
+	now(&wg->last);
+
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	atomic_clear_uint32_t_bits(&entry->mde_flags, MDCACHE_TRUST_ATTRS);
+
+	*status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	return true;
+}
+
+fsal_status_t mdc_wgather_do_flush(mdcache_entry_t *entry, bool report)
+{
+	struct mdc_wgather *wg = entry->wgather;
+	fsal_status_t status;
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	(void) mdc_wgather_flush_locked(entry, wg);
+
+	status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	if (report) {
+		status = wg->error;
+		wg->error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	}
+
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+
+	return status;
+}
+
+void mdc_wgather_do_attrs(mdcache_entry_t *entry, struct attrlist *attrs)
+{
+	struct mdc_wgather *wg = entry->wgather;
+	uint64_t end;
+
+	PTHREAD_MUTEX_lock(&wg->mtx);
+
+	if (wg->len == 0)
+		goto out;
+
+	end = wg->offset + wg->len;
+	if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_SIZE) &&
+	    attrs->filesize < end)
+		attrs->filesize = end;
+	if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_MTIME) &&
+	    gsh_time_cmp(&attrs->mtime, &wg->last) < 0)
+		attrs->mtime = wg->last;
+	if (FSAL_TEST_MASK(attrs->valid_mask, ATTR_CTIME) &&
+	    gsh_time_cmp(&attrs->ctime, &wg->last) < 0)
+		attrs->ctime = wg->last;
+
+out:
+	PTHREAD_MUTEX_unlock(&wg->mtx);
+}
+
+/**
+ * @brief Free what gathers writes on an entry being cleaned
+ *
+ * Nothing is gathered any more; the timer holds a reference.
+ *
+ * @param[in] entry  The entry
+ */
+
+void mdc_wgather_free(mdcache_entry_t *entry)
+{
+	struct mdc_wgather *wg = entry->wgather;
+
+	if (wg == NULL)
+		return;
+
+	if (FSAL_IS_ERROR(wg->error))
+		LogWarn(COMPONENT_CACHE_INODE,
+			"Gathered writes to %p were lost: %s",
+			entry, fsal_err_txt(wg->error));
+
+	PTHREAD_MUTEX_destroy(&wg->mtx);
+	gsh_free(wg);
+	entry->wgather = NULL;
+}
+
+/** @} */
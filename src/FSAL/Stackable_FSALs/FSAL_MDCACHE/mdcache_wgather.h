@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @addtogroup FSAL_MDCACHE
+ * @{
+ */
+
+/**
+ * @file mdcache_wgather.h
+ * @brief Gathering of small unstable writes
+ *
+ * With Write_Gather_Size set, UNSTABLE writes smaller than it are
+ * copied into one buffer per file as long as each starts where the
+ * previous one ended, and are written to the FSAL in one call when the
+ * buffer fills, Write_Gather_Delay after the first of them, or before
+ * anything that must see them (COMMIT, read, setattr, close, copy).
+ *
+ * They are answered UNSTABLE with the usual write verifier, so a client
+ * keeps them until a COMMIT, and COMMIT only succeeds once they reached
+ * the FSAL.  An error writing them in the background is returned by the
+ * next COMMIT or write on the file.  Until they are written, GETATTR
+ * reports the size and times they imply.
+ */
+
+#ifndef MDCACHE_WGATHER_H
+#define MDCACHE_WGATHER_H
+
+#include "config.h"
+#include "mdcache_int.h"
+
+bool mdc_wgather_write(mdcache_entry_t *entry, bool bypass,
+		       struct state_t *state, uint64_t offset,
+		       size_t buf_size, void *buffer, bool stable,
+		       struct io_info *info, fsal_status_t *status);
+fsal_status_t mdc_wgather_do_flush(mdcache_entry_t *entry, bool report);
+void mdc_wgather_do_attrs(mdcache_entry_t *entry, struct attrlist *attrs);
+void mdc_wgather_free(mdcache_entry_t *entry);
+
+/**
+ * @brief Write the writes gathered on a file
+ *
+ * @param[in] entry   The file
+ * @param[in] report  Return, and forget, an earlier background error
+ *
+ * @return Status of the write, or of the earlier one if @a report.
+ */
+static inline fsal_status_t
+mdc_wgather_flush(mdcache_entry_t *entry, bool report)
+{
+	if (atomic_fetch_voidptr((void **)&entry->wgather) == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return mdc_wgather_do_flush(entry, report);
+}
+
+/**
+ * @brief Make attributes reflect the writes gathered on a file
+ *
+ * @param[in]     entry  The file
+ * @param[in,out] attrs  Attributes fetched for it
+ */
+static inline void
+mdc_wgather_attrs(mdcache_entry_t *entry, struct attrlist *attrs)
+{
+	if (atomic_fetch_voidptr((void **)&entry->wgather) != NULL)
+		mdc_wgather_do_attrs(entry, attrs);
+}
+
+#endif /* MDCACHE_WGATHER_H */
+
+/** @} */
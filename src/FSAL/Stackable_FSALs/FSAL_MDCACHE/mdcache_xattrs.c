@@ -39,6 +39,211 @@
 #include "fsal_convert.h"
 #include "FSAL/fsal_commonlib.h"
 #include "mdcache_int.h"
+#include "mdcache_bus.h"
+
+static inline uint64_t mdc_xattr_size(const struct mdc_xattr *x)
+{
+	return x->len + x->name_len;
+}
+
+static void mdc_xattr_clear(struct mdc_xattr *x)
+{
+	if (x->value == NULL)
+		return;
+
+	(void)atomic_sub_uint64_t(&cache_stp->mem_xattrs, mdc_xattr_size(x));
+	gsh_free(x->value);
+	memset(x, 0, sizeof(*x));
+}
+
+/**
+ * @brief Free the xattrs kept by an entry
+ *
+ * @note The caller must hold attr_lock for write, or the last reference.
+ */
+void mdc_xattr_free(mdcache_entry_t *entry)
+{
+	struct mdc_xattr_cache *cache = entry->xattrs;
+	uint32_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < mdcache_param.xattr_cache; i++)
+		mdc_xattr_clear(&cache->slot[i]);
+
+	(void)atomic_sub_uint64_t(&cache_stp->mem_xattrs,
+				  sizeof(*cache) + mdcache_param.xattr_cache *
+				  sizeof(cache->slot[0]));
+	gsh_free(cache);
+	entry->xattrs = NULL;
+}
+
+/**
+ * @brief Forget the xattrs of an entry, and any read in progress
+ *
+ * Bumping attr_gen keeps a read that started before from storing what
+ * it got.  Access checks go too, as the ACL may be an xattr.
+ */
+void mdc_xattr_drop(mdcache_entry_t *entry)
+{
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+	entry->attr_gen++;
+	mdc_xattr_free(entry);
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
+
+/**
+ * @brief An xattr changed through us
+ *
+ * Its ctime moved, and maybe its ACL, so the attributes are fetched
+ * again before anything is trusted.
+ */
+static void mdc_xattr_changed(mdcache_entry_t *entry)
+{
+	atomic_clear_uint32_t_bits(&entry->mde_flags,
+				   MDCACHE_TRUST_ATTRS | MDCACHE_TRUST_ACL);
+	mdc_xattr_drop(entry);
+	mdc_bus_publish(entry, FSAL_UP_INVALIDATE_ATTRS |
+			       FSAL_UP_INVALIDATE_ACL);
+}
+
+/**
+ * @brief Look an xattr up in the entry's cache
+ *
+ * A @a buf_size of 0 asks for the size only, as getxattr(2) does.
+ *
+ * @param[in]     entry    Entry read
+ * @param[in,out] key      Name and API of the read; change set to the
+ *                         entry's
+ * @param[out]    attr_gen attr_gen to store the result under
+ * @param[out]    buf      Buffer for the value
+ * @param[in]     buf_size Size of @a buf
+ * @param[out]    len      Size of the value
+ * @param[out]    status   Status of the read
+ *
+ * @return true if the read was answered.
+ */
+static bool mdc_xattr_lookup(mdcache_entry_t *entry, struct mdc_xattr *key,
+			     uint32_t *attr_gen, char *buf, size_t buf_size,
+			     size_t *len, fsal_status_t *status)
+{
+	struct mdc_xattr *x;
+	bool found = false;
+	uint32_t i;
+
+	PTHREAD_RWLOCK_rdlock(&entry->attr_lock);
+
+	*attr_gen = entry->attr_gen;
+	key->change = entry->attrs.change;
+
+	if (entry->xattrs == NULL ||
+	    !(entry->attrs.valid_mask & ATTR_CHANGE) ||
+	    !mdcache_is_attrs_valid(entry, ATTR_CHANGE))
+		goto out;
+
+	for (i = 0; i < mdcache_param.xattr_cache; i++) {
+		x = &entry->xattrs->slot[i];
+		if (x->value == NULL || x->change != key->change ||
+		    x->v42 != key->v42 || x->name_len != key->name_len ||
+		    memcmp(x->name, key->name, key->name_len) != 0)
+			continue;
+
+		found = true;
+		if (x->error != ERR_FSAL_NO_ERROR) {
+			*status = fsalstat(x->error, 0);
+		} else if (buf_size != 0 && x->len > buf_size) {
+			*status = fsalstat(ERR_FSAL_TOOSMALL, 0);
+		} else {
+			if (buf_size != 0)
+				memcpy(buf, x->value, x->len);
+			*len = x->len;
+			*status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+		}
+		break;
+	}
+
+ out:
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+	if (found)
+		(void)atomic_inc_uint64_t(&cache_stp->xattr_hit);
+	return found;
+}
+
+/**
+ * @brief Keep the result of an xattr read
+ *
+ * Only values and "no such attribute" are kept.  The result is dropped
+ * if the attributes changed since @a key was looked up.
+ */
+static void mdc_xattr_store(mdcache_entry_t *entry, struct mdc_xattr *key,
+			    uint32_t attr_gen, const char *value,
+			    size_t len, fsal_errors_t error)
+{
+	struct mdc_xattr_cache *cache;
+	struct mdc_xattr *x;
+	uint32_t i;
+
+	if (error != ERR_FSAL_NO_ERROR && error != ERR_FSAL_NOENT &&
+	    error != ERR_FSAL_NO_DATA)
+		return;
+
+	if (error != ERR_FSAL_NO_ERROR)
+		len = 0;
+	else if (len > mdcache_param.xattr_value_max)
+		return;
+
+	PTHREAD_RWLOCK_wrlock(&entry->attr_lock);
+
+	if (entry->attr_gen != attr_gen ||
+	    !(entry->attrs.valid_mask & ATTR_CHANGE))
+		goto out;
+
+	cache = entry->xattrs;
+	if (cache == NULL) {
+		cache = gsh_calloc(1, sizeof(*cache) +
+				   mdcache_param.xattr_cache *
+				   sizeof(cache->slot[0]));
+		(void)atomic_add_uint64_t(&cache_stp->mem_xattrs,
+					  sizeof(*cache) +
+					  mdcache_param.xattr_cache *
+					  sizeof(cache->slot[0]));
+		entry->xattrs = cache;
+	}
+
+	/* A stale copy of the same name goes first */
+	x = &cache->slot[cache->next];
+	for (i = 0; i < mdcache_param.xattr_cache; i++) {
+		if (cache->slot[i].value != NULL &&
+		    cache->slot[i].v42 == key->v42 &&
+		    cache->slot[i].name_len == key->name_len &&
+		    memcmp(cache->slot[i].name, key->name,
+			   key->name_len) == 0) {
+			x = &cache->slot[i];
+			break;
+		}
+	}
+	if (i == mdcache_param.xattr_cache)
+		cache->next = (cache->next + 1) % mdcache_param.xattr_cache;
+
+	mdc_xattr_clear(x);
+
+	/* One byte more so that an empty value is not NULL */
+	x->value = gsh_malloc(len + key->name_len + 1);
+	x->name = x->value + len;
+	if (len != 0)
+		memcpy(x->value, value, len);
+	memcpy(x->name, key->name, key->name_len);
+	x->len = len;
+	x->name_len = key->name_len;
+	x->change = key->change;
+	x->error = error;
+	x->v42 = key->v42;
+	(void)atomic_add_uint64_t(&cache_stp->mem_xattrs, mdc_xattr_size(x));
+
+ out:
+	PTHREAD_RWLOCK_unlock(&entry->attr_lock);
+}
 
 /**
  * @brief List extended attributes on a file
@@ -136,7 +341,8 @@ fsal_status_t mdcache_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 /**
  * @brief Get contents of xattr by name
  *
- * Pass through to sub-FSAL
+ * Answered from the entry's xattrs when it can, else passed through to
+ * the sub-FSAL.
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of xattr to look up
@@ -155,6 +361,15 @@ fsal_status_t mdcache_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
 	fsal_status_t status;
+	struct mdc_xattr key = { .name = (char *)name };
+	uint32_t attr_gen = 0;
+
+	if (mdcache_param.xattr_cache != 0) {
+		key.name_len = strlen(name);
+		if (mdc_xattr_lookup(handle, &key, &attr_gen, buf, buf_size,
+				     p_output_size, &status))
+			return status;
+	}
 
 	subcall(
 		status = handle->sub_handle->obj_ops.getextattr_value_by_name(
@@ -162,6 +377,12 @@ fsal_status_t mdcache_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
 				buf_size, p_output_size)
 	       );
 
+	if (mdcache_param.xattr_cache != 0 &&
+	    (FSAL_IS_ERROR(status) || buf_size != 0))
+		mdc_xattr_store(handle, &key, attr_gen, buf,
+				FSAL_IS_ERROR(status) ? 0 : *p_output_size,
+				status.major);
+
 	return status;
 }
 
@@ -193,6 +414,9 @@ fsal_status_t mdcache_setextattr_value(struct fsal_obj_handle *obj_hdl,
 			buf_size, create)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_xattr_changed(handle);
+
 	return status;
 }
 
@@ -223,6 +447,9 @@ fsal_status_t mdcache_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 				buf_size)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_xattr_changed(handle);
+
 	return status;
 }
 
@@ -248,6 +475,9 @@ fsal_status_t mdcache_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, id)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_xattr_changed(handle);
+
 	return status;
 }
 
@@ -273,13 +503,17 @@ fsal_status_t mdcache_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_xattr_changed(handle);
+
 	return status;
 }
 
 /**
  * @brief Get an Extended Attribute
  *
- * Pass through to sub-FSAL
+ * Answered from the entry's xattrs when it can, else passed through to
+ * the sub-FSAL.
  *
  * @param[in] obj_hdl	File to search
  * @param[in] name	Name of attribute
@@ -293,12 +527,37 @@ fsal_status_t mdcache_getxattrs(struct fsal_obj_handle *obj_hdl,
 		container_of(obj_hdl, struct mdcache_fsal_obj_handle,
 			     obj_handle);
 	fsal_status_t status;
+	struct mdc_xattr key = {
+		.name = name->utf8string_val,
+		.name_len = name->utf8string_len,
+		.v42 = true,
+	};
+	uint32_t attr_gen = 0;
+	size_t buf_size = value->utf8string_len;
+	size_t len = 0;
+
+	if (mdcache_param.xattr_cache != 0) {
+		if (mdc_xattr_lookup(handle, &key, &attr_gen,
+				     value->utf8string_val, buf_size, &len,
+				     &status)) {
+			if (!FSAL_IS_ERROR(status))
+				value->utf8string_len = len;
+			return status;
+		}
+	}
 
 	subcall(
 		status = handle->sub_handle->obj_ops.getxattrs(
 			handle->sub_handle, name, value)
 	       );
 
+	if (mdcache_param.xattr_cache != 0 &&
+	    (FSAL_IS_ERROR(status) || buf_size != 0))
+		mdc_xattr_store(handle, &key, attr_gen, value->utf8string_val,
+				FSAL_IS_ERROR(status) ?
+					0 : value->utf8string_len,
+				status.major);
+
 	return status;
 }
 
@@ -327,6 +586,9 @@ fsal_status_t mdcache_setxattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, type, name, value)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_xattr_changed(handle);
+
 	return status;
 }
 
@@ -352,6 +614,9 @@ fsal_status_t mdcache_removexattrs(struct fsal_obj_handle *obj_hdl,
 			handle->sub_handle, name)
 	       );
 
+	if (!FSAL_IS_ERROR(status))
+		mdc_xattr_changed(handle);
+
 	return status;
 }
 
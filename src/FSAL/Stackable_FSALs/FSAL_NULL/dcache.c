@@ -0,0 +1,1089 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/* dcache.c
+ * NULLFS data cache, on local storage in front of a slow sub-FSAL
+ *
+ * With Cache_Dir, two files of the directory, best on local NVMe,
+ * keep data of the export:
+ *
+ * blocks.<export id> caches Cache_Size bytes of blocks read from the
+ * sub-FSAL.  A block is dropped when written through NULLFS, and all
+ * of the blocks of a file when its change attribute moves.  It is
+ * not kept across restarts.
+ *
+ * journal.<export id>, with Write_Back, logs the UNSTABLE writes in
+ * place of the sub-FSAL.  A COMMIT syncs the journal, and a thread
+ * destages each write to the sub-FSAL Destage_Delay msecs later.  Any
+ * other call on a file destages its writes first, so that the
+ * sub-FSAL is all that is ever read.  What is left in the journal at
+ * startup, after a crash, is destaged before the export is used.
+ */
+
+#include "config.h"
+
+#include "fsal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "gsh_list.h"
+#include "city.h"
+#include "FSAL/fsal_commonlib.h"
+#include "nullfs_methods.h"
+#include "export_mgr.h"
+
+#define DC_MAGIC 0x4e444331	/* "NDC1" */
+
+/** Most blocks a read is served from */
+#define DC_MAX_READ_BLOCKS 64
+
+/** What goes in the journal before the handle key and the data */
+struct dc_journal_hdr {
+	uint32_t magic;
+	uint32_t len;		/*< Of the data */
+	uint64_t seq;		/*< One more than the record before */
+	uint64_t offset;	/*< Of the data in the file */
+	uint64_t hash;		/*< Of all of the record but this */
+	uint16_t key_len;	/*< Digest of the sub-FSAL handle */
+	uint16_t pad[3];
+};
+
+/** A cached block, a slot of the blocks file */
+struct dc_block {
+	struct glist_head hash;		/*< In its bucket, or the free list */
+	struct glist_head lru;		/*< Most recently used first */
+	struct glist_head obj;		/*< Blocks of hdl */
+	struct nullfs_fsal_obj_handle *hdl;	/*< NULL when free */
+	uint64_t block;		/*< Offset in the file / block size */
+	uint32_t len;		/*< Short only at end of file */
+	uint32_t refs;		/*< Readers, and a fill */
+	bool eof;		/*< The file ends with the block */
+	bool dead;		/*< To the free list with the last ref */
+};
+
+/** A write in the journal, not destaged yet */
+struct dc_record {
+	struct glist_head queue;	/*< Journal order */
+	struct glist_head obj;		/*< Records of hdl */
+	struct nullfs_fsal_obj_handle *hdl;
+	uint64_t joff;			/*< Of the data in the journal */
+	uint64_t offset;		/*< In the file */
+	uint32_t len;
+	struct timespec when;		/*< Journaled */
+};
+
+/**
+ * @brief Data cache of an export
+ *
+ * lock covers the blocks and the records, with the dc fields of the
+ * handles; jlock, taken first, the appends to the journal, which go
+ * in order.
+ */
+struct nullfs_dcache {
+	struct nullfs_fsal_export *export;
+	struct gsh_export *gsh_export;	/*< For the destage thread */
+	pthread_mutex_t lock;
+	uint32_t block_size;
+	uint32_t nblocks;
+	int blocks_fd;
+	struct dc_block *blocks;
+	struct glist_head *buckets;
+	uint32_t bucket_mask;
+	struct glist_head free;
+	struct glist_head lru;
+	/* Write_Back */
+	bool write_back;
+	bool broken;			/*< Journal failed, write through */
+	int journal_fd;
+	pthread_mutex_t jlock;
+	uint64_t journal_size;
+	uint64_t tail;			/*< End of the journal */
+	uint64_t seq;			/*< Of the next record */
+	struct glist_head queue;	/*< Of records */
+	uint32_t destaging;		/*< Handles being destaged */
+	uint32_t destage_delay;		/*< msecs */
+	pthread_cond_t kick;		/*< Destage thread */
+	pthread_cond_t destaged;	/*< A handle is done destaging */
+	bool shutdown;
+	pthread_t thread;
+};
+
+static inline uint64_t dc_hash(struct nullfs_fsal_obj_handle *hdl,
+			       uint64_t block)
+{
+	return ((uintptr_t) hdl >> 4) ^ (block * 0x9e3779b97f4a7c15ULL);
+}
+
+static struct dc_block *dc_find(struct nullfs_dcache *dc,
+				struct nullfs_fsal_obj_handle *hdl,
+				uint64_t block)
+{
+	struct glist_head *bucket, *glist;
+	struct dc_block *blk;
+
+	bucket = &dc->buckets[dc_hash(hdl, block) & dc->bucket_mask];
+	glist_for_each(glist, bucket) {
+		blk = glist_entry(glist, struct dc_block, hash);
+		if (blk->hdl == hdl && blk->block == block)
+			return blk;
+	}
+	return NULL;
+}
+
+/* Take a block off its file, to the free list if nobody reads it */
+static void dc_drop_block(struct nullfs_dcache *dc, struct dc_block *blk)
+{
+	glist_del(&blk->hash);
+	glist_del(&blk->lru);
+	glist_del(&blk->obj);
+	blk->hdl = NULL;
+
+	if (blk->refs == 0)
+		glist_add(&dc->free, &blk->hash);
+	else
+		blk->dead = true;
+}
+
+static void dc_put_block(struct nullfs_dcache *dc, struct dc_block *blk)
+{
+	if (--blk->refs == 0 && blk->dead) {
+		blk->dead = false;
+		glist_add(&dc->free, &blk->hash);
+	}
+}
+
+/* A block for a fill, taken off any file, with one ref */
+static struct dc_block *dc_get_free_block(struct nullfs_dcache *dc)
+{
+	struct glist_head *glist;
+	struct dc_block *blk = NULL;
+	int tries = 0;
+
+	if (!glist_empty(&dc->free)) {
+		blk = glist_first_entry(&dc->free, struct dc_block, hash);
+		glist_del(&blk->hash);
+	} else {
+		/* Evict the least recently used block not being read */
+		for (glist = dc->lru.prev; glist != &dc->lru && tries < 16;
+		     glist = glist->prev, tries++) {
+			blk = glist_entry(glist, struct dc_block, lru);
+			if (blk->refs == 0)
+				break;
+			blk = NULL;
+		}
+		if (blk == NULL)
+			return NULL;
+		glist_del(&blk->hash);
+		glist_del(&blk->lru);
+		glist_del(&blk->obj);
+		blk->hdl = NULL;
+	}
+
+	blk->refs = 1;
+	return blk;
+}
+
+static inline off_t dc_slot(struct nullfs_dcache *dc, struct dc_block *blk)
+{
+	return (off_t)(blk - dc->blocks) * dc->block_size;
+}
+
+/* Drop the blocks of hdl over [offset, offset + len), with dc->lock */
+static void dc_invalidate_locked(struct nullfs_dcache *dc,
+				 struct nullfs_fsal_obj_handle *hdl,
+				 uint64_t offset, uint64_t len)
+{
+	struct glist_head *glist, *glistn;
+	struct dc_block *blk;
+	uint64_t start, end;
+
+	hdl->dc.gen++;
+
+	glist_for_each_safe(glist, glistn, &hdl->dc.blocks) {
+		blk = glist_entry(glist, struct dc_block, obj);
+		start = blk->block * dc->block_size;
+		end = start + dc->block_size;
+		if (len == UINT64_MAX || (start < offset + len && end > offset))
+			dc_drop_block(dc, blk);
+	}
+}
+
+/**
+ * @brief Drop the cached blocks of a file over a range
+ *
+ * @param[in] export The nullfs export.
+ * @param[in] hdl    The file.
+ * @param[in] offset Start of the range.
+ * @param[in] len    Its length, UINT64_MAX for the whole file.
+ */
+void nullfs_dcache_invalidate(struct nullfs_fsal_export *export,
+			      struct nullfs_fsal_obj_handle *hdl,
+			      uint64_t offset, uint64_t len)
+{
+	struct nullfs_dcache *dc = export->dcache;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	dc_invalidate_locked(dc, hdl, offset, len);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+}
+
+/**
+ * @brief Drop the cached blocks of a file if it changed behind us
+ *
+ * @param[in] export The nullfs export.
+ * @param[in] hdl    The file.
+ * @param[in] attrs  Its attributes from the sub-FSAL.
+ */
+void nullfs_dcache_attrs(struct nullfs_fsal_export *export,
+			 struct nullfs_fsal_obj_handle *hdl,
+			 const struct attrlist *attrs)
+{
+	struct nullfs_dcache *dc = export->dcache;
+
+	if (dc->nblocks == 0 || !(attrs->valid_mask & ATTR_CHANGE))
+		return;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	if (hdl->dc.change != attrs->change) {
+		if (!glist_empty(&hdl->dc.blocks))
+			dc_invalidate_locked(dc, hdl, 0, UINT64_MAX);
+		hdl->dc.change = attrs->change;
+	}
+	PTHREAD_MUTEX_unlock(&dc->lock);
+}
+
+/**
+ * @brief Serve a read from the cached blocks
+ *
+ * @param[in]  export      The nullfs export.
+ * @param[in]  hdl         The file, its writes destaged.
+ * @param[in]  offset      Of the read.
+ * @param[in]  size        Of the read.
+ * @param[out] buffer      The data.
+ * @param[out] read_amount Bytes read.
+ * @param[out] eof         Whether the read reached the end of file.
+ * @param[out] gen         Generation to fill the blocks with on a miss.
+ *
+ * @return true if all of the read was cached.
+ */
+bool nullfs_dcache_read(struct nullfs_fsal_export *export,
+			struct nullfs_fsal_obj_handle *hdl,
+			uint64_t offset, size_t size, void *buffer,
+			size_t *read_amount, bool *eof, uint64_t *gen)
+{
+	struct nullfs_dcache *dc = export->dcache;
+	struct dc_block *pinned[DC_MAX_READ_BLOCKS];
+	uint64_t first, last, b, start, end, bend = 0;
+	uint32_t bs = dc->block_size;
+	size_t done = 0;
+	bool hit = true;
+	int n = 0, i;
+
+	*gen = 0;
+	if (dc->nblocks == 0 || size == 0)
+		return false;
+
+	first = offset / bs;
+	last = (offset + size - 1) / bs;
+	if (last - first >= DC_MAX_READ_BLOCKS)
+		return false;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	*gen = hdl->dc.gen;
+	for (b = first; b <= last; b++) {
+		struct dc_block *blk = dc_find(dc, hdl, b);
+
+		if (blk == NULL) {
+			hit = false;
+			break;
+		}
+		blk->refs++;
+		glist_del(&blk->lru);
+		glist_add(&dc->lru, &blk->lru);
+		pinned[n++] = blk;
+		if (blk->len < bs || blk->eof)
+			break;
+	}
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	/* A read past the end of the file is left to the sub-FSAL */
+	if (hit && n > 0) {
+		bend = pinned[n - 1]->block * bs + pinned[n - 1]->len;
+		if (offset >= bend)
+			hit = false;
+	}
+
+	for (i = 0; hit && i < n; i++) {
+		start = pinned[i]->block * bs;
+		end = start + pinned[i]->len;
+		if (start < offset)
+			start = offset;
+		if (end > offset + size)
+			end = offset + size;
+		if (pread(dc->blocks_fd, (char *)buffer + done, end - start,
+			  dc_slot(dc, pinned[i]) + start % bs) !=
+		    (ssize_t)(end - start))
+			hit = false;
+		done += end - start;
+	}
+
+	if (hit) {
+		*read_amount = done;
+		*eof = pinned[n - 1]->eof && offset + size >= bend;
+	}
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	for (i = 0; i < n; i++)
+		dc_put_block(dc, pinned[i]);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	return hit;
+}
+
+static void dc_fill_block(struct nullfs_dcache *dc,
+			  struct nullfs_fsal_obj_handle *hdl, uint64_t gen,
+			  uint64_t block, const char *data, uint32_t len,
+			  bool eof)
+{
+	struct dc_block *blk;
+	bool ok;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	if (hdl->dc.gen != gen || dc_find(dc, hdl, block) != NULL) {
+		PTHREAD_MUTEX_unlock(&dc->lock);
+		return;
+	}
+	blk = dc_get_free_block(dc);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	if (blk == NULL)
+		return;
+
+	ok = pwrite(dc->blocks_fd, data, len, dc_slot(dc, blk)) ==
+	     (ssize_t)len;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	blk->refs = 0;
+	if (ok && hdl->dc.gen == gen && dc_find(dc, hdl, block) == NULL) {
+		blk->hdl = hdl;
+		blk->block = block;
+		blk->len = len;
+		blk->eof = eof;
+		glist_add(&dc->buckets[dc_hash(hdl, block) & dc->bucket_mask],
+			  &blk->hash);
+		glist_add(&dc->lru, &blk->lru);
+		glist_add(&hdl->dc.blocks, &blk->obj);
+	} else {
+		glist_add(&dc->free, &blk->hash);
+	}
+	PTHREAD_MUTEX_unlock(&dc->lock);
+}
+
+/**
+ * @brief Cache the blocks a read from the sub-FSAL covered
+ *
+ * Only whole blocks are kept, and the last one of the file.
+ *
+ * @param[in] export The nullfs export.
+ * @param[in] hdl    The file.
+ * @param[in] gen    From nullfs_dcache_read, before the read.
+ * @param[in] offset Of the read.
+ * @param[in] buffer The data read.
+ * @param[in] amount Bytes read.
+ * @param[in] eof    Whether the sub-FSAL reported the end of file.
+ */
+void nullfs_dcache_fill(struct nullfs_fsal_export *export,
+			struct nullfs_fsal_obj_handle *hdl, uint64_t gen,
+			uint64_t offset, const void *buffer, size_t amount,
+			bool eof)
+{
+	struct nullfs_dcache *dc = export->dcache;
+	uint32_t bs = dc->block_size;
+	uint64_t b = (offset + bs - 1) / bs;
+	uint64_t end = offset + amount;
+
+	if (dc->nblocks == 0)
+		return;
+
+	for (; (b + 1) * bs <= end; b++)
+		dc_fill_block(dc, hdl, gen, b,
+			      (const char *)buffer + (b * bs - offset), bs,
+			      eof && (b + 1) * bs == end);
+
+	if (eof && b * bs < end)
+		dc_fill_block(dc, hdl, gen, b,
+			      (const char *)buffer + (b * bs - offset),
+			      end - b * bs, true);
+}
+
+/*
+ * Write back
+ */
+
+static void dc_add_ms(struct timespec *ts, uint32_t msecs)
+{
+	ts->tv_sec += msecs / 1000;
+	ts->tv_nsec += (msecs % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static uint64_t dc_record_hash(struct dc_journal_hdr *hdr, const char *key,
+			       const char *data)
+{
+	uint64_t seed = CityHash64WithSeed(key, hdr->key_len,
+					   hdr->seq ^ hdr->offset);
+
+	return CityHash64WithSeed(data, hdr->len, seed ^ hdr->len);
+}
+
+/* Write the records of a handle to the sub-FSAL, and commit them */
+static fsal_status_t dc_destage(struct nullfs_dcache *dc,
+				struct nullfs_fsal_obj_handle *hdl,
+				struct glist_head *records)
+{
+	struct root_op_context root_op_context;
+	struct fsal_obj_handle *sub = hdl->sub_handle;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	struct glist_head *glist, *glistn;
+	struct dc_record *rec;
+	char *buf = NULL;
+	size_t done, written, buf_len = 0;
+	bool stable;
+
+	if (glist_empty(records))
+		return status;
+
+	/* Written as root, through any open of the file */
+	init_root_op_context(&root_op_context, dc->gsh_export,
+			     dc->export->export.sub_export, 0, 0,
+			     NFS_REQUEST);
+
+	glist_for_each_safe(glist, glistn, records) {
+		rec = glist_entry(glist, struct dc_record, obj);
+		glist_del(&rec->obj);
+
+		if (FSAL_IS_ERROR(status))
+			goto free;
+
+		if (rec->len > buf_len) {
+			gsh_free(buf);
+			buf_len = rec->len;
+			buf = gsh_malloc(buf_len);
+		}
+
+		if (pread(dc->journal_fd, buf, rec->len, rec->joff) !=
+		    (ssize_t)rec->len) {
+			status = fsalstat(posix2fsal_error(errno), errno);
+			goto free;
+		}
+
+		for (done = 0; done < rec->len; done += written) {
+			written = 0;
+			stable = false;
+			status = sub->obj_ops.write2(sub, true, NULL,
+						     rec->offset + done,
+						     rec->len - done,
+						     buf + done, &written,
+						     &stable, NULL);
+			if (FSAL_IS_ERROR(status))
+				break;
+			if (written == 0) {
+				status = fsalstat(ERR_FSAL_IO, 0);
+				break;
+			}
+		}
+ free:
+		gsh_free(rec);
+	}
+
+	if (!FSAL_IS_ERROR(status))
+		status = sub->obj_ops.commit2(sub, 0, 0);
+
+	release_root_op_context();
+	gsh_free(buf);
+
+	if (FSAL_IS_ERROR(status) && status.major != ERR_FSAL_STALE)
+		LogCrit(COMPONENT_FSAL,
+			"Destaging writes of %p to the sub-FSAL failed: %s",
+			hdl, fsal_err_txt(status));
+
+	return status;
+}
+
+/* Take the records of hdl to destage them, with dc->lock */
+static void dc_take_locked(struct nullfs_dcache *dc,
+			   struct nullfs_fsal_obj_handle *hdl,
+			   struct glist_head *records)
+{
+	struct glist_head *glist;
+	struct dc_record *rec;
+
+	glist_for_each(glist, &hdl->dc.pending) {
+		rec = glist_entry(glist, struct dc_record, obj);
+		glist_del(&rec->queue);
+	}
+	glist_splice_tail(records, &hdl->dc.pending);
+	hdl->dc.destaging = true;
+	dc->destaging++;
+}
+
+static void dc_taken_locked(struct nullfs_dcache *dc,
+			    struct nullfs_fsal_obj_handle *hdl,
+			    fsal_status_t status)
+{
+	if (FSAL_IS_ERROR(status) && status.major != ERR_FSAL_STALE &&
+	    !FSAL_IS_ERROR(hdl->dc.error))
+		hdl->dc.error = status;
+	hdl->dc.destaging = false;
+	dc->destaging--;
+	pthread_cond_broadcast(&dc->destaged);
+}
+
+/**
+ * @brief Destage the journaled writes of a file
+ *
+ * Called before any call on the file but the writes, so that it reads
+ * what was written.
+ *
+ * @param[in] export The nullfs export.
+ * @param[in] hdl    The file.
+ *
+ * @return Status of the destaging.
+ */
+fsal_status_t nullfs_dcache_flush(struct nullfs_fsal_export *export,
+				  struct nullfs_fsal_obj_handle *hdl)
+{
+	struct nullfs_dcache *dc = export->dcache;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	struct glist_head records;
+
+	if (!dc->write_back)
+		return status;
+
+	glist_init(&records);
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	while (hdl->dc.destaging)
+		pthread_cond_wait(&dc->destaged, &dc->lock);
+	if (glist_empty(&hdl->dc.pending)) {
+		PTHREAD_MUTEX_unlock(&dc->lock);
+		return status;
+	}
+	dc_take_locked(dc, hdl, &records);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	status = dc_destage(dc, hdl, &records);
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	dc_taken_locked(dc, hdl, status);
+	pthread_cond_signal(&dc->kick);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	return status;
+}
+
+static bool dc_handle_key(struct nullfs_fsal_export *export,
+			  struct nullfs_fsal_obj_handle *hdl)
+{
+	struct nullfs_dcache *dc = export->dcache;
+	char key[NFS4_FHSIZE];
+	struct gsh_buffdesc fh_desc = {
+		.addr = key,
+		.len = sizeof(key)
+	};
+	fsal_status_t status;
+
+	if (hdl->dc.key != NULL)
+		return true;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status = hdl->sub_handle->obj_ops.handle_digest(hdl->sub_handle,
+							FSAL_DIGEST_NFSV4,
+							&fh_desc);
+	op_ctx->fsal_export = &export->export;
+
+	if (FSAL_IS_ERROR(status))
+		return false;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	if (hdl->dc.key == NULL) {
+		hdl->dc.key = gsh_malloc(fh_desc.len);
+		memcpy(hdl->dc.key, key, fh_desc.len);
+		hdl->dc.key_len = fh_desc.len;
+	}
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	return true;
+}
+
+/**
+ * @brief Journal an UNSTABLE write
+ *
+ * @param[in] export The nullfs export.
+ * @param[in] hdl    The file.
+ * @param[in] offset Of the write.
+ * @param[in] size   Of the write.
+ * @param[in] buffer The data.
+ *
+ * @return true if journaled, false if it must go to the sub-FSAL, after
+ *         nullfs_dcache_flush.
+ */
+bool nullfs_dcache_write(struct nullfs_fsal_export *export,
+			 struct nullfs_fsal_obj_handle *hdl,
+			 uint64_t offset, size_t size, void *buffer)
+{
+	struct nullfs_dcache *dc = export->dcache;
+	struct dc_journal_hdr hdr;
+	struct dc_record *rec;
+	struct iovec iov[3];
+	uint64_t reclen;
+	ssize_t rc;
+
+	if (!dc->write_back || dc->broken || size == 0 ||
+	    size > UINT32_MAX || !dc_handle_key(export, hdl))
+		return false;
+
+	reclen = sizeof(hdr) + hdl->dc.key_len + size;
+
+	PTHREAD_MUTEX_lock(&dc->jlock);
+	if (dc->broken || dc->tail + reclen > dc->journal_size) {
+		PTHREAD_MUTEX_unlock(&dc->jlock);
+		PTHREAD_MUTEX_lock(&dc->lock);
+		pthread_cond_signal(&dc->kick);
+		PTHREAD_MUTEX_unlock(&dc->lock);
+		return false;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = DC_MAGIC;
+	hdr.len = size;
+	hdr.seq = dc->seq;
+	hdr.offset = offset;
+	hdr.key_len = hdl->dc.key_len;
+	hdr.hash = dc_record_hash(&hdr, hdl->dc.key, buffer);
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = hdl->dc.key;
+	iov[1].iov_len = hdl->dc.key_len;
+	iov[2].iov_base = buffer;
+	iov[2].iov_len = size;
+
+	rc = pwritev(dc->journal_fd, iov, 3, dc->tail);
+	if (rc != (ssize_t)reclen) {
+		/* Replay stops at the hole, so no record after it */
+		LogCrit(COMPONENT_FSAL,
+			"Writing the journal failed: %s, writing through",
+			rc < 0 ? strerror(errno) : "short write");
+		dc->broken = true;
+		PTHREAD_MUTEX_unlock(&dc->jlock);
+		return false;
+	}
+
+	rec = gsh_malloc(sizeof(*rec));
+	rec->hdl = hdl;
+	rec->joff = dc->tail + sizeof(hdr) + hdl->dc.key_len;
+	rec->offset = offset;
+	rec->len = size;
+	now(&rec->when);
+
+	dc->tail += reclen;
+	dc->seq++;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	glist_add_tail(&dc->queue, &rec->queue);
+	glist_add_tail(&hdl->dc.pending, &rec->obj);
+	dc_invalidate_locked(dc, hdl, offset, size);
+	if (dc->tail > dc->journal_size / 2)
+		pthread_cond_signal(&dc->kick);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	PTHREAD_MUTEX_unlock(&dc->jlock);
+
+	return true;
+}
+
+/**
+ * @brief COMMIT the journaled writes of a file
+ *
+ * @param[in]  export The nullfs export.
+ * @param[in]  hdl    The file.
+ * @param[out] status The result.
+ *
+ * @return false if there is nothing journaled, to commit the sub-FSAL.
+ */
+bool nullfs_dcache_commit(struct nullfs_fsal_export *export,
+			  struct nullfs_fsal_obj_handle *hdl,
+			  fsal_status_t *status)
+{
+	struct nullfs_dcache *dc = export->dcache;
+	bool pending;
+
+	if (!dc->write_back)
+		return false;
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	pending = !glist_empty(&hdl->dc.pending) || hdl->dc.destaging;
+	*status = hdl->dc.error;
+	hdl->dc.error = fsalstat(ERR_FSAL_NO_ERROR, 0);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	if (FSAL_IS_ERROR(*status))
+		return true;
+
+	if (!pending)
+		return false;
+
+	/* Appends are in order, all of the file's are done */
+	if (fdatasync(dc->journal_fd) != 0)
+		*status = fsalstat(posix2fsal_error(errno), errno);
+
+	return true;
+}
+
+/**
+ * @brief Destage the writes of a released handle, and drop its blocks
+ */
+void nullfs_dcache_forget(struct nullfs_fsal_export *export,
+			  struct nullfs_fsal_obj_handle *hdl)
+{
+	struct nullfs_dcache *dc = export->dcache;
+
+	(void) nullfs_dcache_flush(export, hdl);
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	while (hdl->dc.destaging)
+		pthread_cond_wait(&dc->destaged, &dc->lock);
+	dc_invalidate_locked(dc, hdl, 0, UINT64_MAX);
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	gsh_free(hdl->dc.key);
+	hdl->dc.key = NULL;
+}
+
+/* Truncate the journal once all of it is destaged, with both locks */
+static void dc_reset_journal(struct nullfs_dcache *dc)
+{
+	if (dc->tail == 0 || !glist_empty(&dc->queue) || dc->destaging != 0)
+		return;
+
+	if (ftruncate(dc->journal_fd, 0) != 0 ||
+	    fdatasync(dc->journal_fd) != 0) {
+		LogCrit(COMPONENT_FSAL,
+			"Truncating the journal failed: %s, writing through, a restart would destage it again",
+			strerror(errno));
+		dc->broken = true;
+	}
+	dc->tail = 0;
+}
+
+static void *dc_destage_thread(void *arg)
+{
+	struct nullfs_dcache *dc = arg;
+	struct nullfs_fsal_obj_handle *hdl;
+	struct glist_head records;
+	struct dc_record *rec;
+	struct timespec due;
+	fsal_status_t status;
+
+	SetNameFunction("null_destage");
+
+	PTHREAD_MUTEX_lock(&dc->lock);
+	for (;;) {
+		if (glist_empty(&dc->queue)) {
+			if (dc->tail != 0 && dc->destaging == 0) {
+				/* jlock goes first */
+				PTHREAD_MUTEX_unlock(&dc->lock);
+				PTHREAD_MUTEX_lock(&dc->jlock);
+				PTHREAD_MUTEX_lock(&dc->lock);
+				dc_reset_journal(dc);
+				PTHREAD_MUTEX_unlock(&dc->jlock);
+				continue;
+			}
+			if (dc->shutdown)
+				break;
+			pthread_cond_wait(&dc->kick, &dc->lock);
+			continue;
+		}
+
+		rec = glist_first_entry(&dc->queue, struct dc_record, queue);
+
+		/* Let the oldest write age, unless the journal fills */
+		due = rec->when;
+		dc_add_ms(&due, dc->destage_delay);
+		if (!dc->shutdown && dc->tail <= dc->journal_size / 2 &&
+		    pthread_cond_timedwait(&dc->kick, &dc->lock, &due) !=
+		    ETIMEDOUT)
+			continue;
+
+		if (glist_empty(&dc->queue))
+			continue;
+		rec = glist_first_entry(&dc->queue, struct dc_record, queue);
+		hdl = rec->hdl;
+		if (hdl->dc.destaging) {
+			pthread_cond_wait(&dc->destaged, &dc->lock);
+			continue;
+		}
+
+		glist_init(&records);
+		dc_take_locked(dc, hdl, &records);
+		PTHREAD_MUTEX_unlock(&dc->lock);
+
+		status = dc_destage(dc, hdl, &records);
+
+		PTHREAD_MUTEX_lock(&dc->lock);
+		dc_taken_locked(dc, hdl, status);
+	}
+	PTHREAD_MUTEX_unlock(&dc->lock);
+
+	return NULL;
+}
+
+/* Destage what a crash left in the journal */
+static void dc_replay(struct nullfs_dcache *dc)
+{
+	struct fsal_export *sub_export = dc->export->export.sub_export;
+	struct root_op_context root_op_context;
+	struct dc_journal_hdr hdr;
+	struct fsal_obj_handle *obj;
+	struct gsh_buffdesc fh_desc;
+	fsal_status_t status;
+	uint64_t pos = 0, seq = 0;
+	char *buf = NULL;
+	size_t buf_len = 0, done, written;
+	bool stable;
+	int records = 0, failed = 0;
+
+	init_root_op_context(&root_op_context, dc->gsh_export, sub_export,
+			     0, 0, NFS_REQUEST);
+
+	while (pread(dc->journal_fd, &hdr, sizeof(hdr), pos) ==
+	       sizeof(hdr)) {
+		if (hdr.magic != DC_MAGIC || hdr.key_len > NFS4_FHSIZE ||
+		    hdr.len > dc->journal_size ||
+		    (records != 0 && hdr.seq != seq))
+			break;
+
+		if (hdr.key_len + hdr.len > buf_len) {
+			gsh_free(buf);
+			buf_len = hdr.key_len + hdr.len;
+			buf = gsh_malloc(buf_len);
+		}
+
+		if (pread(dc->journal_fd, buf, hdr.key_len + hdr.len,
+			  pos + sizeof(hdr)) !=
+		    (ssize_t)(hdr.key_len + hdr.len) ||
+		    dc_record_hash(&hdr, buf, buf + hdr.key_len) != hdr.hash)
+			break;
+
+		pos += sizeof(hdr) + hdr.key_len + hdr.len;
+		seq = hdr.seq + 1;
+		records++;
+
+		fh_desc.addr = buf;
+		fh_desc.len = hdr.key_len;
+		status = sub_export->exp_ops.extract_handle(sub_export,
+							    FSAL_DIGEST_NFSV4,
+							    &fh_desc, 0);
+		if (!FSAL_IS_ERROR(status))
+			status = sub_export->exp_ops.create_handle(sub_export,
+								   &fh_desc,
+								   &obj, NULL);
+		if (FSAL_IS_ERROR(status)) {
+			failed++;
+			continue;
+		}
+
+		for (done = 0; done < hdr.len; done += written) {
+			written = 0;
+			stable = false;
+			status = obj->obj_ops.write2(obj, true, NULL,
+						     hdr.offset + done,
+						     hdr.len - done,
+						     buf + hdr.key_len + done,
+						     &written, &stable, NULL);
+			if (FSAL_IS_ERROR(status) || written == 0)
+				break;
+		}
+		if (!FSAL_IS_ERROR(status) && done == hdr.len)
+			status = obj->obj_ops.commit2(obj, 0, 0);
+		if (FSAL_IS_ERROR(status) || done != hdr.len)
+			failed++;
+
+		obj->obj_ops.release(obj);
+	}
+
+	release_root_op_context();
+	gsh_free(buf);
+
+	if (records != 0 || pos != 0)
+		LogEvent(COMPONENT_FSAL,
+			 "Destaged %d writes left in the journal of export %d, %d failed",
+			 records, dc->gsh_export->export_id, failed);
+
+	dc->seq = seq;
+	dc->tail = 1;	/* Have it truncated */
+	dc_reset_journal(dc);
+}
+
+static int dc_open(const char *dir, const char *name, int export_id,
+		   int flags)
+{
+	char path[MAXPATHLEN];
+	int fd;
+
+	if (snprintf(path, sizeof(path), "%s/%s.%d", dir, name, export_id) >=
+	    sizeof(path)) {
+		LogCrit(COMPONENT_FSAL, "Cache_Dir %s is too long", dir);
+		return -1;
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | flags, 0600);
+	if (fd < 0)
+		LogCrit(COMPONENT_FSAL, "Could not open %s: %s", path,
+			strerror(errno));
+	return fd;
+}
+
+/**
+ * @brief Set up the data cache of an export with Cache_Dir
+ *
+ * Called at the end of create_export, what a crash left in the journal
+ * is destaged now.
+ *
+ * @param[in] export The nullfs export.
+ * @param[in] params Its configuration.
+ *
+ * @return Status of the operation.
+ */
+fsal_status_t nullfs_dcache_init(struct nullfs_fsal_export *export,
+				 struct nullfs_dcache_params *params)
+{
+	struct nullfs_dcache *dc = gsh_calloc(1, sizeof(*dc));
+	int export_id = op_ctx->ctx_export->export_id;
+	uint32_t i, nbuckets = 1;
+	int rc;
+
+	dc->export = export;
+	dc->gsh_export = op_ctx->ctx_export;
+	dc->block_size = params->block_size;
+	dc->nblocks = params->size / params->block_size;
+	dc->write_back = params->write_back;
+	dc->journal_size = params->journal_size;
+	dc->destage_delay = params->destage_delay;
+	dc->blocks_fd = -1;
+	dc->journal_fd = -1;
+	glist_init(&dc->free);
+	glist_init(&dc->lru);
+	glist_init(&dc->queue);
+	PTHREAD_MUTEX_init(&dc->lock, NULL);
+	PTHREAD_MUTEX_init(&dc->jlock, NULL);
+	PTHREAD_COND_init(&dc->kick, NULL);
+	PTHREAD_COND_init(&dc->destaged, NULL);
+	export->dcache = dc;
+
+	if (dc->nblocks != 0) {
+		dc->blocks_fd = dc_open(params->dir, "blocks", export_id,
+					O_TRUNC);
+		if (dc->blocks_fd < 0 ||
+		    ftruncate(dc->blocks_fd,
+			      (off_t)dc->nblocks * dc->block_size) != 0)
+			goto err;
+
+		while (nbuckets < dc->nblocks)
+			nbuckets <<= 1;
+		dc->bucket_mask = nbuckets - 1;
+		dc->buckets = gsh_malloc(nbuckets * sizeof(*dc->buckets));
+		for (i = 0; i < nbuckets; i++)
+			glist_init(&dc->buckets[i]);
+
+		dc->blocks = gsh_calloc(dc->nblocks, sizeof(*dc->blocks));
+		for (i = 0; i < dc->nblocks; i++)
+			glist_add_tail(&dc->free, &dc->blocks[i].hash);
+	}
+
+	if (dc->write_back) {
+		dc->journal_fd = dc_open(params->dir, "journal", export_id, 0);
+		if (dc->journal_fd < 0)
+			goto err;
+
+		dc_replay(dc);
+
+		rc = pthread_create(&dc->thread, NULL, dc_destage_thread, dc);
+		if (rc != 0) {
+			LogCrit(COMPONENT_FSAL,
+				"Could not start the destage thread: %s",
+				strerror(rc));
+			goto err;
+		}
+	}
+
+	LogInfo(COMPONENT_FSAL,
+		"Data cache of export %d in %s: %"PRIu32" blocks of %"PRIu32
+		" bytes, write back %s",
+		export_id, params->dir, dc->nblocks, dc->block_size,
+		dc->write_back ? "on" : "off");
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+ err:
+	dc->write_back = false;
+	nullfs_dcache_release(export);
+	return fsalstat(ERR_FSAL_INVAL, 0);
+}
+
+/**
+ * @brief Destage what is left and free the data cache of an export
+ */
+void nullfs_dcache_release(struct nullfs_fsal_export *export)
+{
+	struct nullfs_dcache *dc = export->dcache;
+
+	if (dc == NULL)
+		return;
+
+	if (dc->write_back) {
+		PTHREAD_MUTEX_lock(&dc->lock);
+		dc->shutdown = true;
+		pthread_cond_signal(&dc->kick);
+		PTHREAD_MUTEX_unlock(&dc->lock);
+		pthread_join(dc->thread, NULL);
+	}
+
+	if (dc->blocks_fd >= 0)
+		close(dc->blocks_fd);
+	if (dc->journal_fd >= 0)
+		close(dc->journal_fd);
+	gsh_free(dc->blocks);
+	gsh_free(dc->buckets);
+	PTHREAD_COND_destroy(&dc->destaged);
+	PTHREAD_COND_destroy(&dc->kick);
+	PTHREAD_MUTEX_destroy(&dc->jlock);
+	PTHREAD_MUTEX_destroy(&dc->lock);
+	gsh_free(dc);
+	export->dcache = NULL;
+}
@@ -65,6 +65,8 @@ static void release(struct fsal_export *exp_hdl)
 	myself = container_of(exp_hdl, struct nullfs_fsal_export, export);
 	sub_fsal = myself->export.sub_export->fsal;
 
+	nullfs_dcache_release(myself);
+
 	/* Release the sub_export */
 	myself->export.sub_export->exp_ops.release(myself->export.sub_export);
 	fsal_put(sub_fsal);
@@ -399,6 +401,9 @@ void nullfs_export_ops_init(struct export_ops *ops)
 
 struct nullfsal_args {
 	struct subfsal_args subfsal;
+	bool op_stats;
+	bool faults;
+	struct nullfs_dcache_params dcache;
 };
 
 static struct config_item sub_fsal_params[] = {
@@ -412,6 +417,23 @@ static struct config_item export_params[] = {
 	CONF_RELAX_BLOCK("FSAL", sub_fsal_params,
 			 noop_conf_init, subfsal_commit,
 			 nullfsal_args, subfsal),
+	CONF_ITEM_BOOL("Op_Stats", false,
+		       nullfsal_args, op_stats),
+	CONF_ITEM_BOOL("Fault_Injection", false,
+		       nullfsal_args, faults),
+	CONF_ITEM_PATH("Cache_Dir", 1, MAXPATHLEN, NULL,
+		       nullfsal_args, dcache.dir),
+	CONF_ITEM_UI32("Cache_Block_Size", 4096, 1024 * 1024, 64 * 1024,
+		       nullfsal_args, dcache.block_size),
+	CONF_ITEM_UI64("Cache_Size", 0, UINT64_MAX, 256 * 1024 * 1024,
+		       nullfsal_args, dcache.size),
+	CONF_ITEM_BOOL("Write_Back", false,
+		       nullfsal_args, dcache.write_back),
+	CONF_ITEM_UI64("Journal_Size", 1024 * 1024, 1024 * 1024 * 1024,
+		       64 * 1024 * 1024,
+		       nullfsal_args, dcache.journal_size),
+	CONF_ITEM_UI32("Destage_Delay", 0, 3600 * 1000, 1000,
+		       nullfsal_args, dcache.destage_delay),
 	CONFIG_EOL
 };
 
@@ -510,10 +532,26 @@ fsal_status_t nullfs_create_export(struct fsal_module *fsal_hdl,
 #endif				/* EXPORT_OPS_INIT */
 	myself->export.up_ops = up_ops;
 	myself->export.fsal = fsal_hdl;
+	myself->op_stats = nullfsal.op_stats;
+	myself->faults = nullfsal.faults;
 
 	/* lock myself before attaching to the fsal.
 	 * keep myself locked until done with creating myself.
 	 */
 	op_ctx->fsal_export = &myself->export;
+
+	if (nullfsal.dcache.dir != NULL) {
+		expres = nullfs_dcache_init(myself, &nullfsal.dcache);
+		gsh_free(nullfsal.dcache.dir);
+		if (FSAL_IS_ERROR(expres)) {
+			LogMajor(COMPONENT_FSAL,
+				 "Failed to set up the data cache of export %d",
+				 op_ctx->ctx_export->export_id);
+			myself->export.exp_ops.release(&myself->export);
+			op_ctx->fsal_export = NULL;
+			return expres;
+		}
+	}
+
 	return fsalstat(ERR_FSAL_NO_ERROR, 0);
 }
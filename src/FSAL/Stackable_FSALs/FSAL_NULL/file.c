@@ -56,10 +56,18 @@ fsal_status_t nullfs_open(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_OPEN, obj_hdl,
+					       NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.open(handle->sub_handle, openflags);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_OPEN, &nop);
 
 	return status;
 }
@@ -79,10 +87,14 @@ fsal_openflags_t nullfs_status(struct fsal_obj_handle *obj_hdl)
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+
+	nullfs_op_start_nofail(export, FSAL_STAT_STATUS, obj_hdl, &nop);
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_openflags_t status =
 		handle->sub_handle->obj_ops.status(handle->sub_handle);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_STATUS, &nop);
 
 	return status;
 }
@@ -106,12 +118,20 @@ fsal_status_t nullfs_read(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_READ, obj_hdl,
+					       NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.read(handle->sub_handle, offset,
 						 buffer_size, buffer,
 						 read_amount, end_of_file);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_READ, &nop);
 
 	return status;
 }
@@ -134,8 +154,15 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_WRITE, obj_hdl,
+					       NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.write(handle->sub_handle,
 						  offset,
 						  buffer_size,
@@ -143,6 +170,10 @@ fsal_status_t nullfs_write(struct fsal_obj_handle *obj_hdl,
 						  write_amount,
 						  fsal_stable);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_WRITE, &nop);
+
+	if (export->dcache != NULL)
+		nullfs_dcache_invalidate(export, handle, offset, buffer_size);
 
 	return status;
 }
@@ -164,11 +195,19 @@ fsal_status_t nullfs_commit(struct fsal_obj_handle *obj_hdl,	/* sync */
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_COMMIT,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.commit(handle->sub_handle,
 						   offset, len);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_COMMIT, &nop);
 
 	return status;
 }
@@ -194,14 +233,22 @@ fsal_status_t nullfs_lock_op(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_LOCK_OP,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.lock_op(handle->sub_handle,
 						    p_owner,
 						    lock_op,
 						    request_lock,
 						    conflicting_lock);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_LOCK_OP, &nop);
 
 	return status;
 }
@@ -223,10 +270,18 @@ fsal_status_t nullfs_close(struct fsal_obj_handle *obj_hdl)
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_CLOSE, obj_hdl,
+					       NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.close(handle->sub_handle);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_CLOSE, &nop);
 
 	return status;
 }
@@ -251,20 +306,36 @@ fsal_status_t nullfs_open2(struct fsal_obj_handle *obj_hdl,
 	struct fsal_obj_handle *sub_handle = NULL;
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_OPEN2, obj_hdl,
+					       name, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.open2(handle->sub_handle, state,
 						  openflags, createmode, name,
 						  attrs_in, verifier,
 						  &sub_handle, attrs_out,
 						  caller_perm_check);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_OPEN2, &nop);
+
+	/* Truncating an open of obj_hdl itself */
+	if (export->dcache != NULL && name == NULL &&
+	    (openflags & FSAL_O_TRUNC) && !FSAL_IS_ERROR(status))
+		nullfs_dcache_invalidate(export, handle, 0, UINT64_MAX);
 
 	if (sub_handle) {
 		/* wrap the subfsal handle in a nullfs handle. */
 		return nullfs_alloc_and_check_handle(export, sub_handle,
-						     obj_hdl->fs, new_obj,
-						     status);
+						     obj_hdl->fs,
+						     nullfs_child_path(export,
+								       obj_hdl,
+								       name),
+						     new_obj, status);
 	}
 
 	return status;
@@ -282,11 +353,15 @@ bool nullfs_check_verifier(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+
+	nullfs_op_start_nofail(export, FSAL_STAT_CHECK_VERIFIER, obj_hdl, &nop);
 	op_ctx->fsal_export = export->export.sub_export;
 	bool result =
 		handle->sub_handle->obj_ops.check_verifier(handle->sub_handle,
 							   verifier);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_CHECK_VERIFIER, &nop);
 
 	return result;
 }
@@ -303,11 +378,15 @@ fsal_openflags_t nullfs_status2(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+
+	nullfs_op_start_nofail(export, FSAL_STAT_STATUS2, obj_hdl, &nop);
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_openflags_t result =
 		handle->sub_handle->obj_ops.status2(handle->sub_handle,
 						    state);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_STATUS2, &nop);
 
 	return result;
 }
@@ -325,11 +404,23 @@ fsal_status_t nullfs_reopen2(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_REOPEN2,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.reopen2(handle->sub_handle,
 						    state, openflags);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_REOPEN2, &nop);
+
+	if (export->dcache != NULL && (openflags & FSAL_O_TRUNC) &&
+	    !FSAL_IS_ERROR(status))
+		nullfs_dcache_invalidate(export, handle, 0, UINT64_MAX);
 
 	return status;
 }
@@ -352,14 +443,37 @@ fsal_status_t nullfs_read2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_dcache_sync(export, obj_hdl);
+	uint64_t gen = 0;
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	/* READ_PLUS is left to the sub-FSAL */
+	if (export->dcache != NULL && info == NULL &&
+	    nullfs_dcache_read(export, handle, offset, buf_size, buffer,
+			       read_amount, eof, &gen))
+		return status;
+
 	/* calling subfsal method */
+	status = nullfs_op_start(export, FSAL_STAT_READ2, obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.read2(handle->sub_handle, bypass,
 						  state, offset, buf_size,
 						  buffer, read_amount, eof,
 						  info);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_READ2, &nop);
+
+	if (export->dcache != NULL && info == NULL && !FSAL_IS_ERROR(status))
+		nullfs_dcache_fill(export, handle, gen, offset, buffer,
+				   *read_amount, *eof);
 
 	return status;
 }
@@ -382,14 +496,41 @@ fsal_status_t nullfs_write2(struct fsal_obj_handle *obj_hdl,
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
 
+	struct nullfs_op nop;
+	fsal_status_t status = fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	if (export->dcache != NULL) {
+		/* UNSTABLE writes go to the journal if there is room */
+		if (!*fsal_stable && info == NULL &&
+		    nullfs_dcache_write(export, handle, offset, buf_size,
+					buffer)) {
+			*write_amount = buf_size;
+			return status;
+		}
+
+		status = nullfs_dcache_flush(export, handle);
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
 	/* calling subfsal method */
+	status = nullfs_op_start(export, FSAL_STAT_WRITE2, obj_hdl, NULL,
+				 &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.write2(handle->sub_handle, bypass,
 						  state, offset, buf_size,
 						  buffer, write_amount,
 						  fsal_stable, info);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_WRITE2, &nop);
+
+	if (export->dcache != NULL)
+		nullfs_dcache_invalidate(export, handle, offset, buf_size);
 
 	return status;
 }
@@ -407,11 +548,19 @@ fsal_status_t nullfs_seek2(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_SEEK2, obj_hdl,
+					       NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.seek2(handle->sub_handle, state,
 						  info);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_SEEK2, &nop);
 
 	return status;
 }
@@ -429,11 +578,19 @@ fsal_status_t nullfs_io_advise2(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_IO_ADVISE2,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.io_advise2(handle->sub_handle,
 						       state, hints);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_IO_ADVISE2, &nop);
 
 	return status;
 }
@@ -450,11 +607,26 @@ fsal_status_t nullfs_commit2(struct fsal_obj_handle *obj_hdl, off_t offset,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status;
+
+	/* Journaled writes are stable once the journal is synced */
+	if (export->dcache != NULL &&
+	    nullfs_dcache_commit(export, handle, &status))
+		return status;
+
+	status = nullfs_op_start(export, FSAL_STAT_COMMIT2, obj_hdl, NULL,
+				 &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.commit2(handle->sub_handle, offset,
 						    len);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_COMMIT2, &nop);
 
 	return status;
 }
@@ -475,12 +647,20 @@ fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_LOCK_OP2,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.lock_op2(handle->sub_handle, state,
 						     p_owner, lock_op, req_lock,
 						     conflicting_lock);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_LOCK_OP2, &nop);
 
 	return status;
 }
@@ -497,10 +677,354 @@ fsal_status_t nullfs_close2(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_CLOSE2,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.close2(handle->sub_handle, state);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_CLOSE2, &nop);
+
+	return status;
+}
+
+/**
+ * @brief Context for an asynchronous I/O passed through to the sub-FSAL
+ */
+struct nullfs_async_arg {
+	struct fsal_obj_handle *obj_hdl;	/*< Our handle */
+	struct nullfs_fsal_export *export;	/*< Our export */
+	fsal_async_cb done_cb;			/*< Caller's callback */
+	void *caller_arg;			/*< Caller's callback arg */
+	struct gsh_export *ctx_export;		/*< Export timed for, or NULL */
+	enum fsal_stat_op op;			/*< Call timed */
+	struct nullfs_op nop;			/*< Start of the call */
+};
+
+/**
+ * @brief Completion callback for asynchronous I/O on the sub-FSAL
+ *
+ * Translate the sub-FSAL handle back into ours and call the caller back.
+ */
+static void nullfs_async_cb(struct fsal_obj_handle *sub_hdl,
+			    fsal_status_t status, void *obj_data,
+			    void *caller_data)
+{
+	struct nullfs_async_arg *arg = caller_data;
+
+	/* Timed to the completion, which may be on another thread */
+	fault_inject_done(arg->nop.rule);
+	if (arg->ctx_export != NULL)
+		server_stats_fsal_op_done(arg->ctx_export, arg->op,
+					  arg->nop.start_time);
+
+	/* The write is in the sub-FSAL now, even on error */
+	if (arg->op == FSAL_STAT_WRITE2_ASYNC && arg->export->dcache != NULL)
+		nullfs_dcache_invalidate(arg->export,
+					 container_of(arg->obj_hdl,
+					     struct nullfs_fsal_obj_handle,
+					     obj_handle),
+					 0, UINT64_MAX);
+
+	arg->done_cb(arg->obj_hdl, status, obj_data, arg->caller_arg);
+
+	gsh_free(arg);
+}
+
+/**
+ * @brief Start an asynchronous call to the sub-FSAL
+ *
+ * @return The callback arg, or NULL when a fault rule failed the call,
+ *         in which case the caller was already called back.
+ */
+static struct nullfs_async_arg *nullfs_async_arg_init(
+					struct nullfs_fsal_export *export,
+					enum fsal_stat_op op,
+					struct fsal_obj_handle *obj_hdl,
+					fsal_async_cb done_cb,
+					void *obj_data,
+					void *caller_arg)
+{
+	struct nullfs_async_arg *arg = gsh_malloc(sizeof(*arg));
+	fsal_status_t status;
+
+	status = nullfs_op_start(export, op, obj_hdl, NULL, &arg->nop);
+	if (FSAL_IS_ERROR(status)) {
+		gsh_free(arg);
+		done_cb(obj_hdl, status, obj_data, caller_arg);
+		return NULL;
+	}
+
+	arg->obj_hdl = obj_hdl;
+	arg->export = export;
+	arg->done_cb = done_cb;
+	arg->caller_arg = caller_arg;
+	arg->ctx_export = export->op_stats ? op_ctx->ctx_export : NULL;
+	arg->op = op;
+
+	return arg;
+}
+
+void nullfs_read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			fsal_async_cb done_cb,
+			struct fsal_io_arg *read_arg,
+			void *caller_arg)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	struct nullfs_async_arg *arg =
+		nullfs_async_arg_init(export, FSAL_STAT_READ2_ASYNC, obj_hdl,
+				      done_cb, read_arg, caller_arg);
+
+	if (arg == NULL)
+		return;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops.read2_async(handle->sub_handle, bypass,
+						nullfs_async_cb, read_arg,
+						arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+void nullfs_write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *write_arg,
+			 void *caller_arg)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	struct nullfs_async_arg *arg =
+		nullfs_async_arg_init(export, FSAL_STAT_WRITE2_ASYNC, obj_hdl,
+				      done_cb, write_arg, caller_arg);
+
+	if (arg == NULL)
+		return;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops.write2_async(handle->sub_handle, bypass,
+						 nullfs_async_cb, write_arg,
+						 arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+void nullfs_commit2_async(struct fsal_obj_handle *obj_hdl,
+			  off_t offset,
+			  size_t len,
+			  fsal_async_cb done_cb,
+			  void *caller_arg)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	struct nullfs_async_arg *arg =
+		nullfs_async_arg_init(export, FSAL_STAT_COMMIT2_ASYNC, obj_hdl,
+				      done_cb, NULL, caller_arg);
+
+	if (arg == NULL)
+		return;
+
+	/* calling subfsal method */
+	op_ctx->fsal_export = export->export.sub_export;
+	handle->sub_handle->obj_ops.commit2_async(handle->sub_handle, offset,
+						  len, nullfs_async_cb, arg);
+	op_ctx->fsal_export = &export->export;
+}
+
+fsal_status_t nullfs_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    int iov_count,
+			    struct iovec *iov,
+			    size_t *read_amount,
+			    bool *eof,
+			    struct io_info *info)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_READV2,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status =
+		handle->sub_handle->obj_ops.readv2(handle->sub_handle, bypass,
+						   state, offset, iov_count,
+						   iov, read_amount, eof,
+						   info);
+	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_READV2, &nop);
+
+	return status;
+}
+
+fsal_status_t nullfs_writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     int iov_count,
+			     struct iovec *iov,
+			     size_t *write_amount,
+			     bool *fsal_stable,
+			     struct io_info *info)
+{
+	struct nullfs_fsal_obj_handle *handle =
+		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_WRITEV2,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status =
+		handle->sub_handle->obj_ops.writev2(handle->sub_handle, bypass,
+						    state, offset, iov_count,
+						    iov, write_amount,
+						    fsal_stable, info);
+	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_WRITEV2, &nop);
+
+	if (export->dcache != NULL)
+		nullfs_dcache_invalidate(export, handle, 0, UINT64_MAX);
+
+	return status;
+}
+
+fsal_status_t nullfs_copy2(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied)
+{
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_dcache_sync(export, dst_hdl);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = nullfs_op_start(export, FSAL_STAT_COPY2, src_hdl, NULL,
+				 &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status =
+		src->sub_handle->obj_ops.copy2(src->sub_handle, src_state,
+					       src_offset, dst->sub_handle,
+					       dst_state, dst_offset, count,
+					       copied);
+	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_COPY2, &nop);
+
+	if (export->dcache != NULL)
+		nullfs_dcache_invalidate(export, dst, 0, UINT64_MAX);
+
+	return status;
+}
+
+fsal_status_t nullfs_clone2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count)
+{
+	struct nullfs_fsal_obj_handle *src =
+		container_of(src_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct nullfs_fsal_obj_handle *dst =
+		container_of(dst_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_dcache_sync(export, dst_hdl);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	status = nullfs_op_start(export, FSAL_STAT_CLONE2, src_hdl, NULL,
+				 &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status =
+		src->sub_handle->obj_ops.clone2(src->sub_handle, src_state,
+						src_offset, dst->sub_handle,
+						dst_state, dst_offset, count);
+	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_CLONE2, &nop);
+
+	if (export->dcache != NULL)
+		nullfs_dcache_invalidate(export, dst, 0, UINT64_MAX);
 
 	return status;
 }
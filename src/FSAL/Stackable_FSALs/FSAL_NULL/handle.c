@@ -46,6 +46,76 @@
 /* helpers
  */
 
+/**
+ * @brief Path of an entry of a directory, for the fault rules
+ *
+ * @param[in] export The nullfs export.
+ * @param[in] parent The directory, NULL if name is the full path.
+ * @param[in] name   The entry.
+ *
+ * @return The path to keep in the handle, NULL without Fault_Injection
+ *         or if the path of the directory is not known.
+ */
+char *nullfs_child_path(struct nullfs_fsal_export *export,
+			const struct fsal_obj_handle *parent,
+			const char *name)
+{
+	struct nullfs_fsal_obj_handle *dir;
+	char *path, *slash;
+
+	if (!export->faults || name == NULL)
+		return NULL;
+
+	if (parent == NULL)
+		return gsh_strdup(name);
+
+	dir = container_of(parent, struct nullfs_fsal_obj_handle, obj_handle);
+	if (dir->path == NULL)
+		return NULL;
+
+	if (strcmp(name, ".") == 0)
+		return gsh_strdup(dir->path);
+
+	if (strcmp(name, "..") == 0) {
+		path = gsh_strdup(dir->path);
+		slash = strrchr(path, '/');
+		if (slash != NULL && slash != path)
+			*slash = '\0';
+		return path;
+	}
+
+	path = gsh_malloc(strlen(dir->path) + strlen(name) + 2);
+	sprintf(path, "%s/%s", dir->path, name);
+	return path;
+}
+
+/**
+ * @brief Apply the fault rules to a call on a handle or one of its entries
+ */
+fsal_errors_t nullfs_fault_start(struct nullfs_fsal_export *export,
+				 enum fsal_stat_op op,
+				 const struct fsal_obj_handle *obj_hdl,
+				 const char *name, bool may_fail,
+				 struct fault_rule **rule)
+{
+	struct nullfs_fsal_obj_handle *handle;
+	char buf[MAXPATHLEN];
+	const char *path = NULL;
+
+	if (obj_hdl != NULL) {
+		handle = container_of(obj_hdl, struct nullfs_fsal_obj_handle,
+				      obj_handle);
+		path = handle->path;
+		if (path != NULL && name != NULL &&
+		    (size_t)snprintf(buf, sizeof(buf), "%s/%s", path, name) <
+		    sizeof(buf))
+			path = buf;
+	}
+
+	return fault_inject_start(op_ctx->ctx_export, op, path, may_fail,
+				  rule);
+}
+
 /* handle methods
  */
 
@@ -58,13 +128,15 @@
  * @param[in] export The nullfs export used by the handle.
  * @param[in] sub_handle The handle used by the subfsal.
  * @param[in] fs The filesystem of the new handle.
+ * @param[in] path The path of the handle, now its own.
  *
  * @return The new handle, or NULL if the allocation failed.
  */
 static struct nullfs_fsal_obj_handle *nullfs_alloc_handle(
 		struct nullfs_fsal_export *export,
 		struct fsal_obj_handle *sub_handle,
-		struct fsal_filesystem *fs)
+		struct fsal_filesystem *fs,
+		char *path)
 {
 	struct nullfs_fsal_obj_handle *result;
 
@@ -82,6 +154,9 @@ static struct nullfs_fsal_obj_handle *nullfs_alloc_handle(
 	result->obj_handle.fs = fs;
 	result->obj_handle.state_hdl = sub_handle->state_hdl;
 	result->refcnt = 1;
+	result->path = path;
+	glist_init(&result->dc.blocks);
+	glist_init(&result->dc.pending);
 
 	return result;
 }
@@ -95,6 +170,8 @@ static struct nullfs_fsal_obj_handle *nullfs_alloc_handle(
  * @param[in] export The nullfs export used by the handle.
  * @param[in,out] sub_handle The handle used by the subfsal.
  * @param[in] fs The filesystem of the new handle.
+ * @param[in] path The path of the new handle from nullfs_child_path,
+ * freed on error.
  * @param[in] new_handle Address where the new allocated pointer should be
  * written.
  * @param[in] subfsal_status Result of the allocation of the subfsal handle.
@@ -105,6 +182,7 @@ fsal_status_t nullfs_alloc_and_check_handle(
 		struct nullfs_fsal_export *export,
 		struct fsal_obj_handle *sub_handle,
 		struct fsal_filesystem *fs,
+		char *path,
 		struct fsal_obj_handle **new_handle,
 		fsal_status_t subfsal_status)
 {
@@ -114,9 +192,12 @@ fsal_status_t nullfs_alloc_and_check_handle(
 	if (!FSAL_IS_ERROR(subfsal_status)) {
 		struct nullfs_fsal_obj_handle *null_handle;
 
-		null_handle = nullfs_alloc_handle(export, sub_handle, fs);
+		null_handle = nullfs_alloc_handle(export, sub_handle, fs,
+						  path);
 
 		*new_handle = &null_handle->obj_handle;
+	} else {
+		gsh_free(path);
 	}
 	return status;
 }
@@ -144,13 +225,23 @@ static fsal_status_t lookup(struct fsal_obj_handle *parent,
 	struct nullfs_fsal_export *export =
 		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
 			     export);
+	struct nullfs_op nop;
+
+	status = nullfs_op_start(export, FSAL_STAT_LOOKUP, parent, path, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
 	status = null_parent->sub_handle->obj_ops.lookup(
 			null_parent->sub_handle, path, &sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_LOOKUP, &nop);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, parent->fs,
+					     nullfs_child_path(export, parent,
+							       path),
 					     handle, status);
 }
 
@@ -174,13 +265,23 @@ static fsal_status_t create(struct fsal_obj_handle *dir_hdl,
 	*new_obj = NULL;
 
 	/* creating the file with a subfsal handle. */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_CREATE,
+					       dir_hdl, name, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.create(
+	status = nullfs_dir->sub_handle->obj_ops.create(
 		nullfs_dir->sub_handle, name, attrs_in, &sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_CREATE, &nop);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
+					     nullfs_child_path(export, dir_hdl,
+							       name),
 					     new_obj, status);
 }
 
@@ -203,13 +304,23 @@ static fsal_status_t makedir(struct fsal_obj_handle *dir_hdl,
 	struct fsal_obj_handle *sub_handle;
 
 	/* Creating the directory with a subfsal handle. */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_MKDIR, dir_hdl,
+					       name, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = parent_hdl->sub_handle->obj_ops.mkdir(
+	status = parent_hdl->sub_handle->obj_ops.mkdir(
 		parent_hdl->sub_handle, name, attrs_in, &sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_MKDIR, &nop);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
+					     nullfs_child_path(export, dir_hdl,
+							       name),
 					     new_obj, status);
 }
 
@@ -235,14 +346,24 @@ static fsal_status_t makenode(struct fsal_obj_handle *dir_hdl,
 	*new_obj = NULL;
 
 	/* Creating the node with a subfsal handle. */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_MKNODE,
+					       dir_hdl, name, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.mknode(
+	status = nullfs_dir->sub_handle->obj_ops.mknode(
 		nullfs_dir->sub_handle, name, nodetype, attrs_in,
 		&sub_handle, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_MKNODE, &nop);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
+					     nullfs_child_path(export, dir_hdl,
+							       name),
 					     new_obj, status);
 }
 
@@ -274,14 +395,24 @@ static fsal_status_t makesymlink(struct fsal_obj_handle *dir_hdl,
 	*new_obj = NULL;
 
 	/* creating the file with a subfsal handle. */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_SYMLINK,
+					       dir_hdl, name, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.symlink(
+	status = nullfs_dir->sub_handle->obj_ops.symlink(
 		nullfs_dir->sub_handle, name, link_path, attrs_in, &sub_handle,
 		attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_SYMLINK, &nop);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	return nullfs_alloc_and_check_handle(export, sub_handle, dir_hdl->fs,
+					     nullfs_child_path(export, dir_hdl,
+							       name),
 					     new_obj, status);
 }
 
@@ -296,18 +427,27 @@ static fsal_status_t readsymlink(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_READLINK,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.readlink(handle->sub_handle,
 						     link_content, refresh);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_READLINK, &nop);
 
 	return status;
 }
 
 static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_obj_handle *destdir_hdl,
-			      const char *name)
+			      const char *name,
+			      struct attrlist *destdir_attrs_out)
 {
 	struct nullfs_fsal_obj_handle *handle =
 		(struct nullfs_fsal_obj_handle *) obj_hdl;
@@ -318,10 +458,19 @@ static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_LINK, obj_hdl,
+					       NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = handle->sub_handle->obj_ops.link(
-		handle->sub_handle, nullfs_dir->sub_handle, name);
+	status = handle->sub_handle->obj_ops.link(
+		handle->sub_handle, nullfs_dir->sub_handle, name,
+		destdir_attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_LINK, &nop);
 
 	return status;
 }
@@ -349,7 +498,9 @@ static bool nullfs_readdir_cb(const char *name,
 	struct fsal_obj_handle *new_obj;
 
 	if (FSAL_IS_ERROR(nullfs_alloc_and_check_handle(state->exp, sub_handle,
-		sub_handle->fs, &new_obj, fsalstat(ERR_FSAL_NO_ERROR, 0)))) {
+		sub_handle->fs,
+		nullfs_child_path(state->exp, state->dir_hdl, name),
+		&new_obj, fsalstat(ERR_FSAL_NO_ERROR, 0)))) {
 		return false;
 	    }
 
@@ -388,15 +539,24 @@ static fsal_status_t read_dirents(struct fsal_obj_handle *dir_hdl,
 	struct nullfs_readdir_state cb_state = {
 		.cb = cb,
 		.dir_state = dir_state,
-		.exp = export
+		.exp = export,
+		.dir_hdl = dir_hdl
 	};
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_READDIR,
+					       dir_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.readdir(handle->sub_handle,
 		whence, &cb_state, nullfs_readdir_cb, attrmask, eof);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_READDIR, &nop);
 
 	return status;
 }
@@ -405,7 +565,9 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	struct nullfs_fsal_obj_handle *nullfs_olddir =
 		container_of(olddir_hdl, struct nullfs_fsal_obj_handle,
@@ -422,11 +584,20 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_RENAME,
+					       olddir_hdl, old_name, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = nullfs_olddir->sub_handle->obj_ops.rename(
+	status = nullfs_olddir->sub_handle->obj_ops.rename(
 		nullfs_obj->sub_handle, nullfs_olddir->sub_handle,
-		old_name, nullfs_newdir->sub_handle, new_name);
+		old_name, nullfs_newdir->sub_handle, new_name,
+		olddir_attrs_out, newdir_attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_RENAME, &nop);
 
 	return status;
 }
@@ -443,15 +614,75 @@ static fsal_status_t getattrs(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_GETATTRS,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.getattrs(handle->sub_handle,
 						     attrib_get);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_GETATTRS, &nop);
+
+	if (export->dcache != NULL && !FSAL_IS_ERROR(status))
+		nullfs_dcache_attrs(export, handle, attrib_get);
 
 	return status;
 }
 
+static void getattrs_bulk(struct fsal_obj_handle *dir_hdl,
+			  unsigned int count,
+			  struct fsal_obj_handle **objs,
+			  const char **names,
+			  struct attrlist *attrs,
+			  fsal_status_t *status)
+{
+	struct nullfs_fsal_obj_handle *nullfs_dir =
+		container_of(dir_hdl, struct nullfs_fsal_obj_handle,
+			     obj_handle);
+	struct fsal_obj_handle **sub_objs;
+	unsigned int i;
+
+	struct nullfs_fsal_export *export =
+		container_of(op_ctx->fsal_export, struct nullfs_fsal_export,
+			     export);
+
+	sub_objs = gsh_calloc(count, sizeof(*sub_objs));
+
+	for (i = 0; i < count; i++) {
+		sub_objs[i] = container_of(objs[i],
+					   struct nullfs_fsal_obj_handle,
+					   obj_handle)->sub_handle;
+		/* an error is kept for the COMMIT */
+		(void) nullfs_dcache_sync(export, objs[i]);
+	}
+
+	/* calling subfsal method */
+	struct nullfs_op nop;
+
+	nullfs_op_start_nofail(export, FSAL_STAT_GETATTRS_BULK, dir_hdl, &nop);
+	op_ctx->fsal_export = export->export.sub_export;
+	nullfs_dir->sub_handle->obj_ops.getattrs_bulk(nullfs_dir->sub_handle,
+						      count, sub_objs, names,
+						      attrs, status);
+	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_GETATTRS_BULK, &nop);
+
+	for (i = 0; export->dcache != NULL && i < count; i++)
+		if (!FSAL_IS_ERROR(status[i]))
+			nullfs_dcache_attrs(export,
+					    container_of(objs[i],
+						struct nullfs_fsal_obj_handle,
+						obj_handle),
+					    &attrs[i]);
+
+	gsh_free(sub_objs);
+}
+
 /*
  * NOTE: this is done under protection of the
  * attributes rwlock in the cache entry.
@@ -469,10 +700,22 @@ static fsal_status_t setattrs(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_SETATTRS,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = handle->sub_handle->obj_ops.setattrs(
+	status = handle->sub_handle->obj_ops.setattrs(
 		handle->sub_handle, attrs);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_SETATTRS, &nop);
+
+	/* A size or time change may have moved the data */
+	if (export->dcache != NULL)
+		nullfs_dcache_invalidate(export, handle, 0, UINT64_MAX);
 
 	return status;
 }
@@ -480,7 +723,8 @@ static fsal_status_t setattrs(struct fsal_obj_handle *obj_hdl,
 static fsal_status_t nullfs_setattr2(struct fsal_obj_handle *obj_hdl,
 				     bool bypass,
 				     struct state_t *state,
-				     struct attrlist *attrs)
+				     struct attrlist *attrs,
+				     struct attrlist *attrs_out)
 {
 	struct nullfs_fsal_obj_handle *handle =
 		container_of(obj_hdl, struct nullfs_fsal_obj_handle,
@@ -491,10 +735,22 @@ static fsal_status_t nullfs_setattr2(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_SETATTR2,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = handle->sub_handle->obj_ops.setattr2(
-		handle->sub_handle, bypass, state, attrs);
+	status = handle->sub_handle->obj_ops.setattr2(
+		handle->sub_handle, bypass, state, attrs, attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_SETATTR2, &nop);
+
+	/* A size or time change may have moved the data */
+	if (export->dcache != NULL)
+		nullfs_dcache_invalidate(export, handle, 0, UINT64_MAX);
 
 	return status;
 }
@@ -505,7 +761,8 @@ static fsal_status_t nullfs_setattr2(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name)
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
 {
 	struct nullfs_fsal_obj_handle *nullfs_dir =
 		container_of(dir_hdl, struct nullfs_fsal_obj_handle,
@@ -518,10 +775,19 @@ static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_UNLINK,
+					       dir_hdl, name, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = nullfs_dir->sub_handle->obj_ops.unlink(
-		nullfs_dir->sub_handle, nullfs_obj->sub_handle, name);
+	status = nullfs_dir->sub_handle->obj_ops.unlink(
+		nullfs_dir->sub_handle, nullfs_obj->sub_handle, name,
+		parent_attrs_out);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_UNLINK, &nop);
 
 	return status;
 }
@@ -546,10 +812,14 @@ static fsal_status_t handle_digest(const struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+
+	nullfs_op_start_nofail(export, FSAL_STAT_HANDLE_DIGEST, obj_hdl, &nop);
 	op_ctx->fsal_export = export->export.sub_export;
 	fsal_status_t status = handle->sub_handle->obj_ops.handle_digest(
 		handle->sub_handle, output_type, fh_desc);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_HANDLE_DIGEST, &nop);
 
 	return status;
 }
@@ -573,9 +843,13 @@ static void handle_to_key(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+
+	nullfs_op_start_nofail(export, FSAL_STAT_HANDLE_TO_KEY, obj_hdl, &nop);
 	op_ctx->fsal_export = export->export.sub_export;
 	handle->sub_handle->obj_ops.handle_to_key(handle->sub_handle, fh_desc);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_HANDLE_TO_KEY, &nop);
 }
 
 /*
@@ -594,12 +868,20 @@ static void release(struct fsal_obj_handle *obj_hdl)
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+
+	if (export->dcache != NULL)
+		nullfs_dcache_forget(export, hdl);
+
+	nullfs_op_start_nofail(export, FSAL_STAT_RELEASE, obj_hdl, &nop);
 	op_ctx->fsal_export = export->export.sub_export;
 	hdl->sub_handle->obj_ops.release(hdl->sub_handle);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_RELEASE, &nop);
 
 	/* cleaning data allocated by nullfs */
 	fsal_obj_handle_fini(&hdl->obj_handle);
+	gsh_free(hdl->path);
 	gsh_free(hdl);
 }
 
@@ -641,6 +923,14 @@ void nullfs_handle_ops_init(struct fsal_obj_ops *ops)
 	ops->lock_op2 = nullfs_lock_op2;
 	ops->setattr2 = nullfs_setattr2;
 	ops->close2 = nullfs_close2;
+	ops->read2_async = nullfs_read2_async;
+	ops->write2_async = nullfs_write2_async;
+	ops->commit2_async = nullfs_commit2_async;
+	ops->readv2 = nullfs_readv2;
+	ops->writev2 = nullfs_writev2;
+	ops->getattrs_bulk = getattrs_bulk;
+	ops->copy2 = nullfs_copy2;
+	ops->clone2 = nullfs_clone2;
 
 	/* xattr related functions */
 	ops->list_ext_attrs = nullfs_list_ext_attrs;
@@ -688,8 +978,9 @@ fsal_status_t nullfs_lookup_path(struct fsal_export *exp_hdl,
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	/* Note : nullfs filesystem = subfsal filesystem or NULL ? */
-	return nullfs_alloc_and_check_handle(exp, sub_handle, NULL, handle,
-					     status);
+	return nullfs_alloc_and_check_handle(exp, sub_handle, NULL,
+					     nullfs_child_path(exp, NULL, path),
+					     handle, status);
 }
 
 /* create_handle
@@ -719,6 +1010,14 @@ fsal_status_t nullfs_create_handle(struct fsal_export *exp_hdl,
 	/* call to subfsal lookup with the good context. */
 	fsal_status_t status;
 
+	struct nullfs_op nop;
+
+	status = nullfs_op_start(export, FSAL_STAT_CREATE_HANDLE, NULL, NULL,
+				 &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
 
 	status = export->export.sub_export->exp_ops.create_handle(
@@ -726,9 +1025,10 @@ fsal_status_t nullfs_create_handle(struct fsal_export *exp_hdl,
 			attrs_out);
 
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_CREATE_HANDLE, &nop);
 
 	/* wraping the subfsal handle in a nullfs handle. */
 	/* Note : nullfs filesystem = subfsal filesystem or NULL ? */
-	return nullfs_alloc_and_check_handle(export, sub_handle, NULL, handle,
-					     status);
+	return nullfs_alloc_and_check_handle(export, sub_handle, NULL, NULL,
+					     handle, status);
 }
@@ -1,7 +1,22 @@
 /* NULLFS methods for handles
  */
 
+#include "nfs_core.h"
+#include "server_stats.h"
+#include "err_inject.h"
+
 struct nullfs_fsal_obj_handle;
+struct nullfs_dcache;
+
+/** Data cache parameters of an export, see dcache.c */
+struct nullfs_dcache_params {
+	char *dir;		/*< Cache_Dir, NULL for no cache */
+	uint32_t block_size;
+	uint64_t size;		/*< Of the blocks, 0 for none */
+	bool write_back;
+	uint64_t journal_size;
+	uint32_t destage_delay;	/*< msecs */
+};
 
 struct next_ops {
 	struct export_ops exp_ops;	/*< Vector of operations */
@@ -19,6 +34,7 @@ struct next_ops {
 struct nullfs_readdir_state {
 	fsal_readdir_cb cb; /*< Callback to the upper layer. */
 	struct nullfs_fsal_export *exp; /*< Export of the current nullfsal. */
+	struct fsal_obj_handle *dir_hdl; /*< Directory read. */
 	void *dir_state; /*< State to be sent to the next callback. */
 };
 
@@ -32,6 +48,9 @@ void nullfs_handle_ops_init(struct fsal_obj_ops *ops);
  */
 struct nullfs_fsal_export {
 	struct fsal_export export;
+	bool op_stats;		/*< Time the calls to the sub-FSAL */
+	bool faults;		/*< Apply the fault rules to them */
+	struct nullfs_dcache *dcache;	/*< With Cache_Dir */
 	/* Other private export data goes here */
 };
 
@@ -49,9 +68,14 @@ fsal_status_t nullfs_alloc_and_check_handle(
 		struct nullfs_fsal_export *export,
 		struct fsal_obj_handle *sub_handle,
 		struct fsal_filesystem *fs,
+		char *path,
 		struct fsal_obj_handle **new_handle,
 		fsal_status_t subfsal_status);
 
+char *nullfs_child_path(struct nullfs_fsal_export *export,
+			const struct fsal_obj_handle *parent,
+			const char *name);
+
 /*
  * NULLFS internal object handle
  *
@@ -69,8 +93,176 @@ struct nullfs_fsal_obj_handle {
 	struct fsal_obj_handle *sub_handle; /*< Handle of the sub fsal.*/
 	int32_t refcnt;		/*< Reference count.  This is signed to make
 				   mistakes easy to see. */
+	char *path;		/*< For the fault rules, as looked up; NULL
+				    without Fault_Injection or when not known,
+				    stale after a rename */
+	/** For the data cache, under its lock */
+	struct {
+		struct glist_head blocks;	/*< Cached blocks */
+		struct glist_head pending;	/*< Journaled writes */
+		uint64_t gen;		/*< Bumped when blocks are dropped */
+		uint64_t change;	/*< Of the cached blocks */
+		bool destaging;
+		fsal_status_t error;	/*< Of destaging, for COMMIT */
+		char *key;		/*< Sub-FSAL digest, for the journal */
+		uint16_t key_len;
+	} dc;
+};
+
+fsal_status_t nullfs_dcache_init(struct nullfs_fsal_export *export,
+				 struct nullfs_dcache_params *params);
+void nullfs_dcache_release(struct nullfs_fsal_export *export);
+void nullfs_dcache_forget(struct nullfs_fsal_export *export,
+			  struct nullfs_fsal_obj_handle *hdl);
+fsal_status_t nullfs_dcache_flush(struct nullfs_fsal_export *export,
+				  struct nullfs_fsal_obj_handle *hdl);
+void nullfs_dcache_invalidate(struct nullfs_fsal_export *export,
+			      struct nullfs_fsal_obj_handle *hdl,
+			      uint64_t offset, uint64_t len);
+void nullfs_dcache_attrs(struct nullfs_fsal_export *export,
+			 struct nullfs_fsal_obj_handle *hdl,
+			 const struct attrlist *attrs);
+bool nullfs_dcache_read(struct nullfs_fsal_export *export,
+			struct nullfs_fsal_obj_handle *hdl,
+			uint64_t offset, size_t size, void *buffer,
+			size_t *read_amount, bool *eof, uint64_t *gen);
+void nullfs_dcache_fill(struct nullfs_fsal_export *export,
+			struct nullfs_fsal_obj_handle *hdl, uint64_t gen,
+			uint64_t offset, const void *buffer, size_t amount,
+			bool eof);
+bool nullfs_dcache_write(struct nullfs_fsal_export *export,
+			 struct nullfs_fsal_obj_handle *hdl,
+			 uint64_t offset, size_t size, void *buffer);
+bool nullfs_dcache_commit(struct nullfs_fsal_export *export,
+			  struct nullfs_fsal_obj_handle *hdl,
+			  fsal_status_t *status);
+
+/* Destage the journaled writes of a file before a call on it */
+static inline fsal_status_t nullfs_dcache_sync(
+				struct nullfs_fsal_export *export,
+				struct fsal_obj_handle *obj_hdl)
+{
+	if (export->dcache == NULL)
+		return fsalstat(ERR_FSAL_NO_ERROR, 0);
+
+	return nullfs_dcache_flush(export,
+				   container_of(obj_hdl,
+						struct nullfs_fsal_obj_handle,
+						obj_handle));
+}
+
+/** A call to the sub-FSAL in progress */
+struct nullfs_op {
+	nsecs_elapsed_t start_time;
+	struct fault_rule *rule;
 };
 
+fsal_errors_t nullfs_fault_start(struct nullfs_fsal_export *export,
+				 enum fsal_stat_op op,
+				 const struct fsal_obj_handle *obj_hdl,
+				 const char *name, bool may_fail,
+				 struct fault_rule **rule);
+
+static inline void nullfs_op_done(struct nullfs_fsal_export *exp,
+				  enum fsal_stat_op op,
+				  struct nullfs_op *nop)
+{
+	fault_inject_done(nop->rule);
+
+	if (exp->op_stats)
+		server_stats_fsal_op_done(op_ctx->ctx_export, op,
+					  nop->start_time);
+}
+
+/* Calls which see the data of the file, or replace it, once its
+ * journaled writes are destaged.
+ */
+static inline bool nullfs_dcache_syncs(enum fsal_stat_op op)
+{
+	switch (op) {
+	case FSAL_STAT_GETATTRS:
+	case FSAL_STAT_SETATTRS:
+	case FSAL_STAT_SETATTR2:
+	case FSAL_STAT_READ:
+	case FSAL_STAT_WRITE:
+	case FSAL_STAT_COMMIT:
+	case FSAL_STAT_OPEN2:
+	case FSAL_STAT_REOPEN2:
+	case FSAL_STAT_SEEK2:
+	case FSAL_STAT_READ2_ASYNC:
+	case FSAL_STAT_WRITE2_ASYNC:
+	case FSAL_STAT_READV2:
+	case FSAL_STAT_WRITEV2:
+	case FSAL_STAT_COPY2:
+	case FSAL_STAT_CLONE2:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Start a call to the sub-FSAL on obj_hdl, or on its entry name.  With
+ * Op_Stats, the time of each call goes to the histogram of its op,
+ * reported by the GetFsalLatency DBus method of exportstats.  With
+ * Fault_Injection, the rules of the FaultInject DBus object may delay
+ * or throttle the call, or fail it, then returned here.  With
+ * Cache_Dir, the calls of nullfs_dcache_syncs destage the file first.
+ */
+static inline fsal_status_t nullfs_op_start(struct nullfs_fsal_export *exp,
+					    enum fsal_stat_op op,
+					    const struct fsal_obj_handle *obj,
+					    const char *name,
+					    struct nullfs_op *nop)
+{
+	fsal_errors_t error = ERR_FSAL_NO_ERROR;
+
+	nop->start_time = 0;
+	nop->rule = NULL;
+
+	if (exp->dcache != NULL && obj != NULL && nullfs_dcache_syncs(op)) {
+		fsal_status_t status;
+
+		status = nullfs_dcache_flush(exp,
+				container_of(obj, struct nullfs_fsal_obj_handle,
+					     obj_handle));
+		if (FSAL_IS_ERROR(status))
+			return status;
+	}
+
+	if (exp->op_stats)
+		nop->start_time =
+			server_stats_fsal_op_start(op_ctx->ctx_export, op);
+
+	if (exp->faults)
+		error = nullfs_fault_start(exp, op, obj, name, true,
+					   &nop->rule);
+
+	/* The rule is done with already */
+	if (error != ERR_FSAL_NO_ERROR && exp->op_stats)
+		server_stats_fsal_op_done(op_ctx->ctx_export, op,
+					  nop->start_time);
+
+	return fsalstat(error, 0);
+}
+
+/* The same for calls that cannot return an error, only delayed */
+static inline void nullfs_op_start_nofail(struct nullfs_fsal_export *exp,
+					  enum fsal_stat_op op,
+					  const struct fsal_obj_handle *obj,
+					  struct nullfs_op *nop)
+{
+	nop->start_time = 0;
+	nop->rule = NULL;
+
+	if (exp->op_stats)
+		nop->start_time =
+			server_stats_fsal_op_start(op_ctx->ctx_export, op);
+
+	if (exp->faults)
+		(void)nullfs_fault_start(exp, op, obj, NULL, false,
+					 &nop->rule);
+}
+
 int nullfs_fsal_open(struct nullfs_fsal_obj_handle *, int, fsal_errors_t *);
 int nullfs_fsal_readlink(struct nullfs_fsal_obj_handle *, fsal_errors_t *);
 
@@ -159,6 +351,54 @@ fsal_status_t nullfs_lock_op2(struct fsal_obj_handle *obj_hdl,
 			      fsal_lock_param_t *conflicting_lock);
 fsal_status_t nullfs_close2(struct fsal_obj_handle *obj_hdl,
 			    struct state_t *state);
+void nullfs_read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			fsal_async_cb done_cb,
+			struct fsal_io_arg *read_arg,
+			void *caller_arg);
+void nullfs_write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *write_arg,
+			 void *caller_arg);
+void nullfs_commit2_async(struct fsal_obj_handle *obj_hdl,
+			  off_t offset,
+			  size_t len,
+			  fsal_async_cb done_cb,
+			  void *caller_arg);
+fsal_status_t nullfs_readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    int iov_count,
+			    struct iovec *iov,
+			    size_t *read_amount,
+			    bool *eof,
+			    struct io_info *info);
+fsal_status_t nullfs_writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     int iov_count,
+			     struct iovec *iov,
+			     size_t *write_amount,
+			     bool *fsal_stable,
+			     struct io_info *info);
+fsal_status_t nullfs_copy2(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied);
+fsal_status_t nullfs_clone2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count);
 
 /* extended attributes management */
 fsal_status_t nullfs_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
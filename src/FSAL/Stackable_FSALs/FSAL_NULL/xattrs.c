@@ -60,12 +60,20 @@ fsal_status_t nullfs_list_ext_attrs(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export, FSAL_STAT_LIST_EXT_ATTRS,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = handle->sub_handle->obj_ops.list_ext_attrs(
+	status = handle->sub_handle->obj_ops.list_ext_attrs(
 		handle->sub_handle, argcookie,
 		xattrs_tab, xattrs_tabsize,
 		p_nb_returned, end_of_list);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_LIST_EXT_ATTRS, &nop);
 
 	return status;
 }
@@ -83,11 +91,20 @@ fsal_status_t nullfs_getextattr_id_by_name(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export,
+					       FSAL_STAT_GETEXTATTR_ID_BY_NAME,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.getextattr_id_by_name(
 				handle->sub_handle, xattr_name, pxattr_id);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_GETEXTATTR_ID_BY_NAME, &nop);
 
 	return status;
 }
@@ -107,14 +124,23 @@ fsal_status_t nullfs_getextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export,
+					       FSAL_STAT_GETEXTATTR_VALUE_BY_ID,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 	handle->sub_handle->obj_ops.getextattr_value_by_id(
 				handle->sub_handle,
 				xattr_id, buffer_addr,
 				buffer_size,
 				p_output_size);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_GETEXTATTR_VALUE_BY_ID, &nop);
 
 	return status;
 }
@@ -134,8 +160,16 @@ fsal_status_t nullfs_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
-	op_ctx->fsal_export = export->export.sub_export;
+	struct nullfs_op nop;
 	fsal_status_t status =
+		nullfs_op_start(export, FSAL_STAT_GETEXTATTR_VALUE_BY_NAME,
+				obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	op_ctx->fsal_export = export->export.sub_export;
+	status =
 		handle->sub_handle->obj_ops.getextattr_value_by_name(
 				handle->sub_handle,
 				xattr_name,
@@ -143,6 +177,7 @@ fsal_status_t nullfs_getextattr_value_by_name(struct fsal_obj_handle *obj_hdl,
 				buffer_size,
 				p_output_size);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_GETEXTATTR_VALUE_BY_NAME, &nop);
 
 	return status;
 }
@@ -161,12 +196,21 @@ fsal_status_t nullfs_setextattr_value(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export,
+					       FSAL_STAT_SETEXTATTR_VALUE,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = handle->sub_handle->obj_ops.setextattr_value(
+	status = handle->sub_handle->obj_ops.setextattr_value(
 		handle->sub_handle, xattr_name,
 		buffer_addr, buffer_size,
 		create);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_SETEXTATTR_VALUE, &nop);
 
 	return status;
 }
@@ -185,13 +229,22 @@ fsal_status_t nullfs_setextattr_value_by_id(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export,
+					       FSAL_STAT_SETEXTATTR_VALUE_BY_ID,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.setextattr_value_by_id(
 				handle->sub_handle,
 				xattr_id, buffer_addr,
 				buffer_size);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_SETEXTATTR_VALUE_BY_ID, &nop);
 
 	return status;
 }
@@ -208,10 +261,19 @@ fsal_status_t nullfs_remove_extattr_by_id(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export,
+					       FSAL_STAT_REMOVE_EXTATTR_BY_ID,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status = handle->sub_handle->obj_ops.remove_extattr_by_id(
+	status = handle->sub_handle->obj_ops.remove_extattr_by_id(
 		handle->sub_handle, xattr_id);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_REMOVE_EXTATTR_BY_ID, &nop);
 
 	return status;
 }
@@ -228,11 +290,20 @@ fsal_status_t nullfs_remove_extattr_by_name(struct fsal_obj_handle *obj_hdl,
 			     export);
 
 	/* calling subfsal method */
+	struct nullfs_op nop;
+	fsal_status_t status = nullfs_op_start(export,
+					       FSAL_STAT_REMOVE_EXTATTR_BY_NAME,
+					       obj_hdl, NULL, &nop);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
 	op_ctx->fsal_export = export->export.sub_export;
-	fsal_status_t status =
+	status =
 		handle->sub_handle->obj_ops.remove_extattr_by_name(
 				handle->sub_handle, xattr_name);
 	op_ctx->fsal_export = &export->export;
+	nullfs_op_done(export, FSAL_STAT_REMOVE_EXTATTR_BY_NAME, &nop);
 
 	return status;
 }
@@ -14,6 +14,7 @@
 #include "nfs_core.h"
 #include <sys/stat.h>
 #include "FSAL/access_check.h"
+#include "nfs4_acls.h"
 #include <stdbool.h>
 #include <unistd.h>
 #include <sys/syscall.h>
@@ -419,6 +420,134 @@ static void fsal_print_access_by_acl(int naces, int ace_number,
 	LogFullDebug(COMPONENT_NFS_V4_ACL, "%s", str);
 }
 
+/* Spans a caller may match before the walk falls back to every ACE */
+#define ACL_WALK_SPANS 32
+
+/**
+ * @brief The ACEs to check for a caller, in ACL order
+ *
+ * With the index of an interned ACL, the merge of the spans of the whos
+ * the caller matches; without, every ACE.
+ */
+struct acl_walk {
+	fsal_acl_t *acl;
+	const uint32_t *order;	/*< NULL to walk every ACE */
+	uint32_t next;
+	int nspans;
+	struct fsal_acl_span spans[ACL_WALK_SPANS];
+};
+
+static const struct fsal_acl_span *
+acl_find_named(const struct fsal_acl_named *named, uint32_t n, uint32_t id)
+{
+	uint32_t lo = 0, hi = n, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (named[mid].id == id)
+			return &named[mid].span;
+		if (named[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+static void acl_walk_add(struct acl_walk *walk,
+			 const struct fsal_acl_span *span)
+{
+	int i;
+
+	if (walk->order == NULL || span == NULL || span->len == 0)
+		return;
+
+	/* A group the caller is listed in twice */
+	for (i = 0; i < walk->nspans; i++)
+		if (walk->spans[i].off == span->off)
+			return;
+
+	if (walk->nspans == ACL_WALK_SPANS) {
+		walk->order = NULL;
+		return;
+	}
+
+	walk->spans[walk->nspans++] = *span;
+}
+
+static void acl_walk_init(struct acl_walk *walk, fsal_acl_t *acl,
+			  struct user_cred *creds, bool is_dir,
+			  bool is_owner, bool is_group, bool is_root)
+{
+	const struct fsal_acl_kind *kind;
+	unsigned int i;
+
+	walk->acl = acl;
+	walk->order = NULL;
+	walk->next = 0;
+	walk->nspans = 0;
+
+	if (acl->index == NULL)
+		return;
+
+	kind = &acl->index->kind[is_dir ? 1 : 0];
+	walk->order = kind->order;
+
+	if (is_root) {
+		acl_walk_add(walk, &kind->all);
+		return;
+	}
+
+	acl_walk_add(walk, &kind->everyone);
+	if (is_owner)
+		acl_walk_add(walk, &kind->owner);
+	if (is_group)
+		acl_walk_add(walk, &kind->group);
+	acl_walk_add(walk, acl_find_named(kind->users, kind->nusers,
+					  creds->caller_uid));
+
+	if (kind->ngroups == 0)
+		return;
+
+	acl_walk_add(walk, acl_find_named(kind->groups, kind->ngroups,
+					  creds->caller_gid));
+	for (i = 0; i < creds->caller_glen; i++)
+		acl_walk_add(walk, acl_find_named(kind->groups,
+						  kind->ngroups,
+						  creds->caller_garray[i]));
+}
+
+static fsal_ace_t *acl_walk_next(struct acl_walk *walk)
+{
+	struct fsal_acl_span *span;
+	uint32_t pos = UINT32_MAX;
+	int i, best = -1;
+
+	if (walk->order == NULL) {
+		if (walk->next == walk->acl->naces)
+			return NULL;
+		return &walk->acl->aces[walk->next++];
+	}
+
+	for (i = 0; i < walk->nspans; i++) {
+		span = &walk->spans[i];
+		if (span->len != 0 && walk->order[span->off] < pos) {
+			pos = walk->order[span->off];
+			best = i;
+		}
+	}
+
+	if (best < 0)
+		return NULL;
+
+	span = &walk->spans[best];
+	span->off++;
+	span->len--;
+
+	return &walk->acl->aces[pos];
+}
+
 /**
  * @brief Check access using v4 ACL list
  *
@@ -443,6 +572,7 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	gid_t gid;
 	fsal_acl_t *pacl = NULL;
 	fsal_ace_t *pace = NULL;
+	struct acl_walk walk;
 	int ace_number = 0;
 	bool is_dir = false;
 	bool is_owner = false;
@@ -541,8 +671,10 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 	}
 	/** @todo Even if user is admin, audit/alarm checks should be done. */
 
-	for (pace = pacl->aces; pace < pacl->aces + pacl->naces; pace++) {
-		ace_number += 1;
+	acl_walk_init(&walk, pacl, creds, is_dir, is_owner, is_group, is_root);
+
+	while ((pace = acl_walk_next(&walk)) != NULL) {
+		ace_number = pace - pacl->aces + 1;
 
 		LogFullDebug(COMPONENT_NFS_V4_ACL,
 			     "ace numnber: %d ace type 0x%X perm 0x%X flag 0x%X who %u",
@@ -557,8 +689,10 @@ static fsal_status_t fsal_check_access_acl(struct user_cred *creds,
 
 		LogFullDebug(COMPONENT_NFS_V4_ACL, "allow or deny");
 
-		/* Check if this ACE is applicable. */
-		if (fsal_check_ace_applicable(pace, creds, is_dir, is_owner,
+		/* Check if this ACE is applicable, the index kept only
+		 * those that are. */
+		if (walk.order != NULL ||
+		    fsal_check_ace_applicable(pace, creds, is_dir, is_owner,
 					      is_group, is_root)) {
 			if (IS_FSAL_ACE_ALLOW(*pace)) {
 				/* Do not set bits which are already denied */
@@ -861,12 +995,61 @@ gid_t ganesha_gid;
 int ganesha_ngroups;
 gid_t *ganesha_groups = NULL;
 
+/* Longest group list remembered as applied */
+#define APPLIED_GROUPS 32
+
+/**
+ * @brief The identity last applied to this thread
+ *
+ * Requests of one user in a row then cost no switch, and the switch
+ * back to ganesha only the fsuid and fsgid ones.
+ */
+static __thread struct {
+	bool ids_valid;
+	bool groups_valid;
+	uid_t uid;
+	gid_t gid;
+	unsigned int ngroups;
+	gid_t groups[APPLIED_GROUPS];
+} applied;
+
+static void fsal_apply_ids(uid_t uid, gid_t gid)
+{
+	if (!applied.ids_valid || applied.gid != gid)
+		setgroup(gid);
+	if (!applied.ids_valid || applied.uid != uid)
+		setuser(uid);
+
+	applied.uid = uid;
+	applied.gid = gid;
+	applied.ids_valid = true;
+}
+
+static void fsal_apply_groups(unsigned int ngroups, const gid_t *groups,
+			      const char *who)
+{
+	if (applied.groups_valid && applied.ngroups == ngroups &&
+	    (ngroups == 0 ||
+	     memcmp(applied.groups, groups, ngroups * sizeof(gid_t)) == 0))
+		return;
+
+	applied.groups_valid = false;
+	if (set_threadgroups(ngroups, groups) != 0)
+		LogFatal(COMPONENT_FSAL, "Could not set %s credentials", who);
+
+	if (ngroups <= APPLIED_GROUPS) {
+		if (ngroups != 0)
+			memcpy(applied.groups, groups,
+			       ngroups * sizeof(gid_t));
+		applied.ngroups = ngroups;
+		applied.groups_valid = true;
+	}
+}
+
 void fsal_set_credentials(const struct user_cred *creds)
 {
-	if (set_threadgroups(creds->caller_glen, creds->caller_garray) != 0)
-		LogFatal(COMPONENT_FSAL, "Could not set Context credentials");
-	setgroup(creds->caller_gid);
-	setuser(creds->caller_uid);
+	fsal_apply_groups(creds->caller_glen, creds->caller_garray, "Context");
+	fsal_apply_ids(creds->caller_uid, creds->caller_gid);
 }
 
 void fsal_save_ganesha_credentials(void)
@@ -908,10 +1091,12 @@ void fsal_save_ganesha_credentials(void)
 
 void fsal_restore_ganesha_credentials(void)
 {
-	setuser(ganesha_uid);
-	setgroup(ganesha_gid);
-	if (set_threadgroups(ganesha_ngroups, ganesha_groups) != 0)
-		LogFatal(COMPONENT_FSAL, "Could not set Ganesha credentials");
+	fsal_apply_ids(ganesha_uid, ganesha_gid);
+
+	/* Back to fsuid 0, the capabilities override whatever groups
+	 * the thread has, so leave the caller's for its next request. */
+	if (ganesha_uid != 0)
+		fsal_apply_groups(ganesha_ngroups, ganesha_groups, "Ganesha");
 }
 
 /** @} */
@@ -30,6 +30,7 @@
 #include "config.h"
 
 #include <sys/types.h>
+#include <sys/param.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -345,6 +346,291 @@ nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 	return NFS4_OK;
 }
 
+/*
+ * Functions specific to LAYOUT4_FLEX_FILES layouts
+ */
+
+/**
+ * @brief Encode a numeric owner or group, as loosely coupled DSs want
+ *
+ * @param[in,out] xdrs The XDR stream
+ * @param[in]     id   The uid or gid
+ *
+ * @retval true on success.
+ */
+
+static bool xdr_ff_numeric_id(XDR *xdrs, uint32_t id)
+{
+	char buffer[11];
+	char *ptr = buffer;
+
+	(void) snprintf(buffer, sizeof(buffer), "%"PRIu32, id);
+
+	return xdr_string(xdrs, &ptr, sizeof(buffer));
+}
+
+/**
+ * @brief Convenience function to encode a flexfiles loc_body
+ *
+ * Encodes an ff_layout4 of the mirrors given.  A client writes to every
+ * mirror and reads from any; each mirror is striped over its servers.
+ *
+ * The data servers are given the anonymous stateid, so this suits
+ * loosely coupled servers, which the client reaches with the uid and
+ * gid of each server.
+ *
+ * @param[out] xdrs        XDR stream
+ * @param[in]  stripe_unit Bytes on a server before the next one, 0 when
+ *                         the mirrors have one server each
+ * @param[in]  num_mirrors Number of mirrors
+ * @param[in]  mirrors     The mirrors
+ *
+ * @return NFS status codes.
+ */
+nfsstat4 FSAL_encode_flex_file_layout(XDR *xdrs, length4 stripe_unit,
+				      const uint32_t num_mirrors,
+				      const struct fsal_ff_mirror *mirrors)
+{
+	stateid4 anonymous;
+	uint32_t i, j, one = 1;
+
+	memset(&anonymous, 0, sizeof(anonymous));
+
+	if (!xdr_length4(xdrs, &stripe_unit) ||
+	    !xdr_uint32_t(xdrs, (uint32_t *) &num_mirrors)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ff_layout4.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	for (i = 0; i < num_mirrors; i++) {
+		const struct fsal_ff_mirror *mirror = mirrors + i;
+
+		if (!xdr_uint32_t(xdrs, (uint32_t *) &mirror->num_servers)) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed encoding mirror %"PRIu32".", i);
+			return NFS4ERR_SERVERFAULT;
+		}
+
+		for (j = 0; j < mirror->num_servers; j++) {
+			const struct fsal_ff_data_server *ds =
+			    mirror->servers + j;
+			nfs_fh4 handle;
+			char buffer[NFS4_FHSIZE];
+
+			handle.nfs_fh4_val = buffer;
+			handle.nfs_fh4_len = sizeof(buffer);
+
+			if (ds->ganesha_ds) {
+				nfsstat4 nfs_status;
+
+				memset(buffer, 0, sizeof(buffer));
+				nfs_status = make_file_handle_ds(&ds->fh,
+								 ds->ds_id,
+								 &handle);
+				if (nfs_status != NFS4_OK)
+					return nfs_status;
+			} else if (ds->fh.len <= NFS4_FHSIZE) {
+				memcpy(buffer, ds->fh.addr, ds->fh.len);
+				handle.nfs_fh4_len = ds->fh.len;
+			} else {
+				LogMajor(COMPONENT_PNFS,
+					 "DS handle too big to encode!");
+				return NFS4ERR_SERVERFAULT;
+			}
+
+			if (!xdr_fsal_deviceid(xdrs, (struct pnfs_deviceid *)
+					       &ds->deviceid) ||
+			    !xdr_uint32_t(xdrs, (uint32_t *) &ds->efficiency) ||
+			    !xdr_stateid4(xdrs, &anonymous) ||
+			    !xdr_uint32_t(xdrs, &one) ||
+			    !xdr_bytes(xdrs, (char **)&handle.nfs_fh4_val,
+				       &handle.nfs_fh4_len,
+				       handle.nfs_fh4_len) ||
+			    !xdr_ff_numeric_id(xdrs, ds->uid) ||
+			    !xdr_ff_numeric_id(xdrs, ds->gid)) {
+				LogMajor(COMPONENT_PNFS,
+					 "Failed encoding server %"PRIu32
+					 " of mirror %"PRIu32".", j, i);
+				return NFS4ERR_SERVERFAULT;
+			}
+		}
+	}
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Convenience function to encode a flexfiles da_addr_body
+ *
+ * @param[out] xdrs         XDR stream
+ * @param[in]  num_hosts    Number of addresses of the server
+ * @param[in]  hosts        Its addresses
+ * @param[in]  num_versions Number of NFS versions it serves
+ * @param[in]  versions     Those versions, with their I/O sizes
+ *
+ * @return NFS status codes.
+ */
+nfsstat4 FSAL_encode_flex_file_device(XDR *xdrs, const uint32_t num_hosts,
+				      const fsal_multipath_member_t *hosts,
+				      const uint32_t num_versions,
+				      const ff_device_versions4 *versions)
+{
+	nfsstat4 nfs_status;
+	uint32_t i;
+
+	nfs_status = FSAL_encode_v4_multipath(xdrs, num_hosts, hosts);
+	if (nfs_status != NFS4_OK)
+		return nfs_status;
+
+	if (!xdr_uint32_t(xdrs, (uint32_t *) &num_versions)) {
+		LogMajor(COMPONENT_PNFS, "Failed encoding ffda_versions.");
+		return NFS4ERR_SERVERFAULT;
+	}
+
+	for (i = 0; i < num_versions; i++) {
+		if (!xdr_ff_device_versions4(xdrs,
+				(ff_device_versions4 *) versions + i)) {
+			LogMajor(COMPONENT_PNFS,
+				 "Failed encoding version %"PRIu32".", i);
+			return NFS4ERR_SERVERFAULT;
+		}
+	}
+
+	return NFS4_OK;
+}
+
+/** The flexfiles data servers clients told us about */
+static struct pnfs_ff_ds_stats ff_ds[PNFS_FF_DS_STATS_MAX];
+static uint32_t ff_ds_count;
+static uint64_t ff_ds_dropped;
+static pthread_mutex_t ff_ds_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t nfstime4_to_ns(const nfstime4 *t)
+{
+	return t->seconds * NS_PER_SEC + t->nseconds;
+}
+
+/**
+ * @brief Account the I/O of a flexfiles LAYOUTSTATS to its data server
+ *
+ * The lou_body is an ff_layoutupdate4, naming the server by its
+ * address.  Up to PNFS_FF_DS_STATS_MAX servers are kept, reports on
+ * others are counted as dropped.
+ *
+ * @param[in] args The LAYOUTSTATS arguments
+ *
+ * @retval NFS4_OK, or NFS4ERR_BADXDR if the lou_body can't be decoded.
+ */
+nfsstat4 pnfs_ff_layoutstats(const LAYOUTSTATS4args *args)
+{
+	XDR lou_body;
+	ff_layoutupdate4 update;
+	char netid[PNFS_FF_NETID_LEN], addr[PNFS_FF_ADDR_LEN];
+	char fh[NFS4_FHSIZE];
+	struct pnfs_ff_ds_stats *ds = NULL;
+	uint64_t read_ns, write_ns, max;
+	uint32_t i;
+
+	memset(&update, 0, sizeof(update));
+	update.ffl_addr.r_netid = netid;
+	update.ffl_addr.r_addr = addr;
+	update.ffl_fhandle.nfs_fh4_val = fh;
+
+	xdrmem_create(&lou_body, args->lsa_layoutupdate.lou_body.lou_body_val,
+		      args->lsa_layoutupdate.lou_body.lou_body_len,
+		      XDR_DECODE);
+
+	if (!xdr_string(&lou_body, &update.ffl_addr.r_netid,
+			sizeof(netid) - 1) ||
+	    !xdr_string(&lou_body, &update.ffl_addr.r_addr,
+			sizeof(addr) - 1) ||
+	    !xdr_bytes(&lou_body, &update.ffl_fhandle.nfs_fh4_val,
+		       &update.ffl_fhandle.nfs_fh4_len, sizeof(fh)) ||
+	    !xdr_ff_io_latency4(&lou_body, &update.ffl_read) ||
+	    !xdr_ff_io_latency4(&lou_body, &update.ffl_write) ||
+	    !xdr_nfstime4(&lou_body, &update.ffl_duration) ||
+	    !xdr_bool(&lou_body, &update.ffl_local)) {
+		xdr_destroy(&lou_body);
+		return NFS4ERR_BADXDR;
+	}
+
+	xdr_destroy(&lou_body);
+
+	read_ns = nfstime4_to_ns(&update.ffl_read.ffil_avg) *
+	    update.ffl_read.ffil_count;
+	write_ns = nfstime4_to_ns(&update.ffl_write.ffil_avg) *
+	    update.ffl_write.ffil_count;
+
+	PTHREAD_MUTEX_lock(&ff_ds_mutex);
+
+	for (i = 0; i < ff_ds_count; i++) {
+		if (strcmp(ff_ds[i].addr, addr) == 0 &&
+		    strcmp(ff_ds[i].netid, netid) == 0) {
+			ds = &ff_ds[i];
+			break;
+		}
+	}
+
+	if (ds == NULL && ff_ds_count < PNFS_FF_DS_STATS_MAX) {
+		ds = &ff_ds[ff_ds_count++];
+		strcpy(ds->netid, netid);
+		strcpy(ds->addr, addr);
+	}
+
+	if (ds == NULL) {
+		ff_ds_dropped++;
+		PTHREAD_MUTEX_unlock(&ff_ds_mutex);
+		return NFS4_OK;
+	}
+
+	ds->reports++;
+	ds->read_ops += args->lsa_read.ii_count;
+	ds->read_bytes += args->lsa_read.ii_bytes;
+	ds->write_ops += args->lsa_write.ii_count;
+	ds->write_bytes += args->lsa_write.ii_bytes;
+	ds->read_timed += update.ffl_read.ffil_count;
+	ds->read_ns += read_ns;
+	ds->write_timed += update.ffl_write.ffil_count;
+	ds->write_ns += write_ns;
+
+	max = nfstime4_to_ns(&update.ffl_read.ffil_max);
+	if (update.ffl_read.ffil_count != 0 && max > ds->read_max_ns)
+		ds->read_max_ns = max;
+
+	max = nfstime4_to_ns(&update.ffl_write.ffil_max);
+	if (update.ffl_write.ffil_count != 0 && max > ds->write_max_ns)
+		ds->write_max_ns = max;
+
+	PTHREAD_MUTEX_unlock(&ff_ds_mutex);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Copy the flexfiles data server counters
+ *
+ * @param[out] stats   Room for max servers
+ * @param[in]  max     Size of stats
+ * @param[out] dropped Reports on servers past PNFS_FF_DS_STATS_MAX
+ *
+ * @return The number of servers copied.
+ */
+uint32_t pnfs_ff_ds_stats(struct pnfs_ff_ds_stats *stats, uint32_t max,
+			  uint64_t *dropped)
+{
+	uint32_t count;
+
+	PTHREAD_MUTEX_lock(&ff_ds_mutex);
+
+	count = MIN(max, ff_ds_count);
+	memcpy(stats, ff_ds, count * sizeof(*stats));
+	*dropped = ff_ds_dropped;
+
+	PTHREAD_MUTEX_unlock(&ff_ds_mutex);
+
+	return count;
+}
+
 /**
  * @brief Convert POSIX error codes to NFS 4 error codes
  *
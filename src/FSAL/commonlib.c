@@ -78,6 +78,7 @@
 #include "fsal_convert.h"
 #include "nfs4_acls.h"
 #include "sal_data.h"
+#include "export_mgr.h"
 
 #ifdef USE_BLKID
 static struct blkid_struct_cache *cache;
@@ -2414,6 +2415,20 @@ fsal_status_t merge_share(struct fsal_share *orig_share,
  * @return FSAL status.
  */
 
+/**
+ * @brief Count a use of a global fd against the export
+ *
+ * @param[in] hit  The fd was open in a usable mode
+ */
+static inline void fsal_global_fd_stat(bool hit)
+{
+	if (op_ctx == NULL || op_ctx->ctx_export == NULL)
+		return;
+
+	(void) atomic_inc_uint64_t(hit ? &op_ctx->ctx_export->fd_hits
+				       : &op_ctx->ctx_export->fd_misses);
+}
+
 fsal_status_t fsal_reopen_obj(struct fsal_obj_handle *obj_hdl,
 			      bool check_share,
 			      bool bypass,
@@ -2534,6 +2549,7 @@ again:
 			/* Return the temp fd, with the lock only held if
 			 * share reservations were checked.
 			 */
+			fsal_global_fd_stat(false);
 			*closefd = true;
 			*has_lock = check_share;
 
@@ -2629,7 +2645,10 @@ again:
 		goto again;
 	}
 
-	/* Return the global fd, with the lock held. */
+	/* Return the global fd, with the lock held.  It was only opened
+	 * here if we had to retry.
+	 */
+	fsal_global_fd_stat(!retried);
 	*out_fd = my_fd;
 	*has_lock = true;
 
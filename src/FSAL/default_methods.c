@@ -46,6 +46,7 @@
 #include <string.h>
 #include <pthread.h>
 #include <dlfcn.h>
+#include <sys/uio.h>
 #include "log.h"
 #include "fsal.h"
 #include "nfs_core.h"
@@ -876,7 +877,8 @@ static fsal_status_t setattrs(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t linkfile(struct fsal_obj_handle *obj_hdl,
 			      struct fsal_obj_handle *destdir_hdl,
-			      const char *name)
+			      const char *name,
+			      struct attrlist *destdir_attrs_out)
 {
 	LogCrit(COMPONENT_FSAL,
 		"Invoking unsupported FSAL operation");
@@ -891,7 +893,9 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 				struct fsal_obj_handle *olddir_hdl,
 				const char *old_name,
 				struct fsal_obj_handle *newdir_hdl,
-				const char *new_name)
+				const char *new_name,
+				struct attrlist *olddir_attrs_out,
+				struct attrlist *newdir_attrs_out)
 {
 	LogCrit(COMPONENT_FSAL,
 		"Invoking unsupported FSAL operation");
@@ -904,7 +908,8 @@ static fsal_status_t renamefile(struct fsal_obj_handle *obj_hdl,
 
 static fsal_status_t file_unlink(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name)
+				 const char *name,
+				 struct attrlist *parent_attrs_out)
 {
 	LogCrit(COMPONENT_FSAL,
 		"Invoking unsupported FSAL operation");
@@ -1434,15 +1439,13 @@ static fsal_status_t write2(struct fsal_obj_handle *obj_hdl,
 }
 
 /* seek2
- * default case not supported
+ * default case not supported, READ_PLUS probes it so don't log
  */
 
 static fsal_status_t seek2(struct fsal_obj_handle *obj_hdl,
 			   struct state_t *fd,
 			   struct io_info *info)
 {
-	LogCrit(COMPONENT_FSAL,
-		"Invoking unsupported FSAL operation");
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
@@ -1495,7 +1498,8 @@ static fsal_status_t lock_op2(struct fsal_obj_handle *obj_hdl,
 static fsal_status_t setattr2(struct fsal_obj_handle *obj_hdl,
 			      bool bypass,
 			      struct state_t *state,
-			      struct attrlist *attrs)
+			      struct attrlist *attrs,
+			      struct attrlist *attrs_out)
 {
 	LogCrit(COMPONENT_FSAL,
 		"Invoking unsupported FSAL operation");
@@ -1514,6 +1518,261 @@ static fsal_status_t close2(struct fsal_obj_handle *obj_hdl,
 	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
 }
 
+/* read2_async
+ * default case is a synchronous read2 with an inline completion
+ */
+
+static void read2_async(struct fsal_obj_handle *obj_hdl,
+			bool bypass,
+			fsal_async_cb done_cb,
+			struct fsal_io_arg *read_arg,
+			void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.read2(obj_hdl, bypass, read_arg->state,
+					read_arg->offset,
+					read_arg->buffer_size,
+					read_arg->buffer,
+					&read_arg->io_amount,
+					&read_arg->end_of_file,
+					read_arg->info);
+
+	done_cb(obj_hdl, status, read_arg, caller_arg);
+}
+
+/* write2_async
+ * default case is a synchronous write2 with an inline completion
+ */
+
+static void write2_async(struct fsal_obj_handle *obj_hdl,
+			 bool bypass,
+			 fsal_async_cb done_cb,
+			 struct fsal_io_arg *write_arg,
+			 void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.write2(obj_hdl, bypass, write_arg->state,
+					 write_arg->offset,
+					 write_arg->buffer_size,
+					 write_arg->buffer,
+					 &write_arg->io_amount,
+					 &write_arg->fsal_stable,
+					 write_arg->info);
+
+	done_cb(obj_hdl, status, write_arg, caller_arg);
+}
+
+/* commit2_async
+ * default case is a synchronous commit2 with an inline completion
+ */
+
+static void commit2_async(struct fsal_obj_handle *obj_hdl,
+			  off_t offset,
+			  size_t len,
+			  fsal_async_cb done_cb,
+			  void *caller_arg)
+{
+	fsal_status_t status;
+
+	status = obj_hdl->obj_ops.commit2(obj_hdl, offset, len);
+
+	done_cb(obj_hdl, status, NULL, caller_arg);
+}
+
+/* readv2
+ * default case is read2 into a single segment, or into a bounce buffer
+ * that is then scattered into the segments
+ */
+
+static fsal_status_t readv2(struct fsal_obj_handle *obj_hdl,
+			    bool bypass,
+			    struct state_t *state,
+			    uint64_t offset,
+			    int iov_count,
+			    struct iovec *iov,
+			    size_t *read_amount,
+			    bool *end_of_file,
+			    struct io_info *info)
+{
+	fsal_status_t status;
+	size_t total = 0, left;
+	char *buffer, *pos;
+	int i;
+
+	if (iov_count == 1)
+		return obj_hdl->obj_ops.read2(obj_hdl, bypass, state, offset,
+					      iov[0].iov_len, iov[0].iov_base,
+					      read_amount, end_of_file, info);
+
+	for (i = 0; i < iov_count; i++)
+		total += iov[i].iov_len;
+
+	buffer = gsh_malloc(total);
+
+	status = obj_hdl->obj_ops.read2(obj_hdl, bypass, state, offset, total,
+					buffer, read_amount, end_of_file,
+					info);
+
+	if (!FSAL_IS_ERROR(status)) {
+		left = *read_amount;
+		pos = buffer;
+
+		for (i = 0; i < iov_count && left > 0; i++) {
+			size_t len = MIN(iov[i].iov_len, left);
+
+			memcpy(iov[i].iov_base, pos, len);
+			pos += len;
+			left -= len;
+		}
+	}
+
+	gsh_free(buffer);
+	return status;
+}
+
+/* writev2
+ * default case is write2 from a single segment, or from a bounce buffer
+ * the segments are gathered into
+ */
+
+static fsal_status_t writev2(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     struct state_t *state,
+			     uint64_t offset,
+			     int iov_count,
+			     struct iovec *iov,
+			     size_t *wrote_amount,
+			     bool *fsal_stable,
+			     struct io_info *info)
+{
+	fsal_status_t status;
+	size_t total = 0;
+	char *buffer, *pos;
+	int i;
+
+	if (iov_count == 1)
+		return obj_hdl->obj_ops.write2(obj_hdl, bypass, state, offset,
+					       iov[0].iov_len, iov[0].iov_base,
+					       wrote_amount, fsal_stable, info);
+
+	for (i = 0; i < iov_count; i++)
+		total += iov[i].iov_len;
+
+	buffer = gsh_malloc(total);
+
+	for (i = 0, pos = buffer; i < iov_count; i++) {
+		memcpy(pos, iov[i].iov_base, iov[i].iov_len);
+		pos += iov[i].iov_len;
+	}
+
+	status = obj_hdl->obj_ops.write2(obj_hdl, bypass, state, offset, total,
+					 buffer, wrote_amount, fsal_stable,
+					 info);
+
+	gsh_free(buffer);
+	return status;
+}
+
+/* getattrs_bulk
+ * default case is getattrs on each object in turn
+ */
+
+static void getattrs_bulk(struct fsal_obj_handle *dir_hdl,
+			  unsigned int count,
+			  struct fsal_obj_handle **objs,
+			  const char **names,
+			  struct attrlist *attrs,
+			  fsal_status_t *status)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		status[i] = objs[i]->obj_ops.getattrs(objs[i], &attrs[i]);
+}
+
+/* copy2
+ * default case reads and writes through a buffer
+ */
+
+#define COPY2_BUFFER_SIZE (1024 * 1024)
+
+static fsal_status_t copy2(struct fsal_obj_handle *src_hdl,
+			   struct state_t *src_state,
+			   uint64_t src_offset,
+			   struct fsal_obj_handle *dst_hdl,
+			   struct state_t *dst_state,
+			   uint64_t dst_offset,
+			   uint64_t count,
+			   uint64_t *copied)
+{
+	fsal_status_t status = {ERR_FSAL_NO_ERROR, 0};
+	size_t chunk, read_amount, wrote_amount;
+	bool eof = false;
+	bool stable;
+	void *buffer;
+
+	*copied = 0;
+	buffer = gsh_malloc(COPY2_BUFFER_SIZE);
+
+	while (!eof && (count == 0 || *copied < count)) {
+		chunk = COPY2_BUFFER_SIZE;
+		if (count != 0 && count - *copied < chunk)
+			chunk = count - *copied;
+
+		status = src_hdl->obj_ops.read2(src_hdl, false, src_state,
+						src_offset + *copied, chunk,
+						buffer, &read_amount, &eof,
+						NULL);
+		if (FSAL_IS_ERROR(status) || read_amount == 0)
+			break;
+
+		stable = false;
+		status = dst_hdl->obj_ops.write2(dst_hdl, false, dst_state,
+						 dst_offset + *copied,
+						 read_amount, buffer,
+						 &wrote_amount, &stable, NULL);
+		if (FSAL_IS_ERROR(status))
+			break;
+
+		*copied += wrote_amount;
+	}
+
+	gsh_free(buffer);
+	return status;
+}
+
+/* clone2
+ * default case not supported
+ */
+
+static fsal_status_t clone2(struct fsal_obj_handle *src_hdl,
+			    struct state_t *src_state,
+			    uint64_t src_offset,
+			    struct fsal_obj_handle *dst_hdl,
+			    struct state_t *dst_state,
+			    uint64_t dst_offset,
+			    uint64_t count)
+{
+	return fsalstat(ERR_FSAL_NOTSUPP, ENOTSUP);
+}
+
+/* lookup_components
+ * default case resolves nothing, the caller looks up every name
+ */
+
+static fsal_status_t lookup_components(struct fsal_obj_handle *dir_hdl,
+				       unsigned int count,
+				       const char **names,
+				       unsigned int *done,
+				       struct fsal_obj_handle **handle)
+{
+	*done = 0;
+	*handle = NULL;
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
+
 /* Default fsal handle object method vector.
  * copied to allocated vector at register time
  */
@@ -1581,6 +1840,15 @@ struct fsal_obj_ops def_handle_ops = {
 	.lock_op2 = lock_op2,
 	.setattr2 = setattr2,
 	.close2 = close2,
+	.read2_async = read2_async,
+	.write2_async = write2_async,
+	.commit2_async = commit2_async,
+	.readv2 = readv2,
+	.writev2 = writev2,
+	.getattrs_bulk = getattrs_bulk,
+	.copy2 = copy2,
+	.clone2 = clone2,
+	.lookup_components = lookup_components,
 };
 
 /* fsal_pnfs_ds common methods */
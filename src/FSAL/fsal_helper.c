@@ -554,7 +554,8 @@ fsal_status_t fsal_setattr(struct fsal_obj_handle *obj, bool bypass,
 	}
 
 	if (obj->fsal->m_ops.support_ex(obj)) {
-		status = obj->obj_ops.setattr2(obj, bypass, state, attr);
+		status = obj->obj_ops.setattr2(obj, bypass, state, attr,
+					       NULL);
 		if (FSAL_IS_ERROR(status)) {
 			if (status.major == ERR_FSAL_STALE) {
 				LogEvent(COMPONENT_FSAL,
@@ -664,7 +665,7 @@ fsal_status_t fsal_link(struct fsal_obj_handle *obj,
 
 	/* Rather than performing a lookup first, just try to make the
 	   link and return the FSAL's error if it fails. */
-	status = obj->obj_ops.link(obj, dest_dir, name);
+	status = obj->obj_ops.link(obj, dest_dir, name, NULL);
 	return status;
 }
 
@@ -1578,7 +1579,7 @@ fsal_remove(struct fsal_obj_handle *parent, const char *name)
 		goto out;
 #endif /* ENABLE_RFC_ACL */
 
-	status = parent->obj_ops.unlink(parent, to_remove_obj, name);
+	status = parent->obj_ops.unlink(parent, to_remove_obj, name, NULL);
 
 	if (FSAL_IS_ERROR(status)) {
 		LogFullDebug(COMPONENT_FSAL, "unlink %s failure %s",
@@ -1656,7 +1657,7 @@ fsal_status_t fsal_rename(struct fsal_obj_handle *dir_src,
 	LogFullDebug(COMPONENT_FSAL, "about to call FSAL rename");
 
 	fsal_status = dir_src->obj_ops.rename(lookup_src, dir_src, oldname,
-					      dir_dest, newname);
+					      dir_dest, newname, NULL, NULL);
 
 	LogFullDebug(COMPONENT_FSAL, "returned from FSAL rename");
 
@@ -35,7 +35,8 @@
  * store the pointer.
  *
  * Every async call requires one allocation and one queue into the
- * thread fridge.  We make the thread fridge a parameter, so an FSAL
+ * thread fridge, but for invalidates, which are queued together.  We
+ * make the thread fridge a parameter, so an FSAL
  * that's expecting to shoot out lots and lots of upcalls can make one
  * holding several threads wide.
  *
@@ -61,10 +62,26 @@
 #include "fsal_convert.h"
 #include "sal_functions.h"
 #include "pnfs_utils.h"
+#include "gsh_list.h"
+#include "city.h"
 
-/* Invalidate */
+/* Invalidate
+ *
+ * Invalidates are not a job each: they wait in a FIFO, and one of up to
+ * INVALIDATE_DRAINERS jobs calls them INVALIDATE_BATCH at a time.  While
+ * one waits, another invalidate of the same object, without a
+ * callback, only adds its flags to it, so a storm on a few handles
+ * costs MDCACHE one invalidate of each.
+ */
+
+#define INVALIDATE_BUCKETS 1024
+#define INVALIDATE_BATCH 64
+#define INVALIDATE_DRAINERS 4
 
 struct invalidate_args {
+	struct glist_head fifo;
+	struct invalidate_args *next;	/*< In its bucket, if mergeable */
+	uint64_t hash;
 	struct fsal_export *export;
 	struct gsh_buffdesc obj;
 	uint32_t flags;
@@ -73,30 +90,100 @@ struct invalidate_args {
 	char key[];
 };
 
-static void queue_invalidate(struct fridgethr_context *ctx)
+static struct {
+	pthread_mutex_t mtx;
+	struct glist_head fifo;
+	uint32_t pending;
+	uint32_t drainers;
+	struct invalidate_args *buckets[INVALIDATE_BUCKETS];
+} up_inval = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.fifo = GLIST_HEAD_INIT(up_inval.fifo),
+};
+
+static inline uint64_t invalidate_hash(struct fsal_export *export,
+				       struct gsh_buffdesc *obj)
 {
-	struct invalidate_args *args = ctx->arg;
-	fsal_status_t status;
+	return CityHash64WithSeed(obj->addr, obj->len, (uintptr_t) export);
+}
 
-	status = args->export->up_ops->invalidate(args->export, &args->obj,
-						  args->flags);
+/* Take a waiting invalidate off its bucket, under the mutex */
+static void invalidate_unhash(struct invalidate_args *args)
+{
+	struct invalidate_args **prev =
+		&up_inval.buckets[args->hash % INVALIDATE_BUCKETS];
 
-	if (args->cb)
-		args->cb(args->cb_arg, status);
+	if (args->cb != NULL)
+		return;
 
-	gsh_free(args);
+	while (*prev != args)
+		prev = &(*prev)->next;
+	*prev = args->next;
 }
 
-fsal_status_t up_async_invalidate(struct fridgethr *fr,
-				  struct fsal_export *export,
-			struct gsh_buffdesc *obj, uint32_t flags,
-			void (*cb)(void *, fsal_status_t), void *cb_arg)
+static void queue_invalidate(struct fridgethr_context *ctx)
 {
-	struct invalidate_args *args = NULL;
-	int rc = 0;
+	struct invalidate_args *batch[INVALIDATE_BATCH];
+	struct invalidate_args *args;
+	fsal_status_t status;
+	int i, n;
+
+	PTHREAD_MUTEX_lock(&up_inval.mtx);
+	while (up_inval.pending != 0) {
+		for (n = 0; n < INVALIDATE_BATCH; n++) {
+			args = glist_first_entry(&up_inval.fifo,
+						 struct invalidate_args, fifo);
+			if (args == NULL)
+				break;
+			glist_del(&args->fifo);
+			invalidate_unhash(args);
+			up_inval.pending--;
+			batch[n] = args;
+		}
+		PTHREAD_MUTEX_unlock(&up_inval.mtx);
+
+		for (i = 0; i < n; i++) {
+			args = batch[i];
+			status = args->export->up_ops->invalidate(
+					args->export, &args->obj, args->flags);
+
+			if (args->cb)
+				args->cb(args->cb_arg, status);
+
+			gsh_free(args);
+		}
+
+		PTHREAD_MUTEX_lock(&up_inval.mtx);
+	}
+	up_inval.drainers--;
+	PTHREAD_MUTEX_unlock(&up_inval.mtx);
+}
+
+/* Queue one invalidate, under the mutex; returns true if merged */
+static bool invalidate_enqueue(struct fsal_export *export,
+			       struct gsh_buffdesc *obj, uint32_t flags,
+			       void (*cb)(void *, fsal_status_t),
+			       void *cb_arg)
+{
+	struct invalidate_args *args, **bucket = NULL;
+	uint64_t hash = 0;
+
+	if (cb == NULL) {
+		hash = invalidate_hash(export, obj);
+		bucket = &up_inval.buckets[hash % INVALIDATE_BUCKETS];
+
+		for (args = *bucket; args != NULL; args = args->next)
+			if (args->hash == hash && args->export == export &&
+			    args->obj.len == obj->len &&
+			    memcmp(args->key, obj->addr, obj->len) == 0) {
+				args->flags |= flags;
+				return true;
+			}
+	}
 
 	args = gsh_malloc(sizeof(struct invalidate_args) + obj->len);
 
+	args->hash = hash;
 	args->export = export;
 	args->flags = flags;
 	args->cb = cb;
@@ -105,10 +192,105 @@ fsal_status_t up_async_invalidate(struct fridgethr *fr,
 	args->obj.addr = args->key;
 	args->obj.len = obj->len;
 
-	rc = fridgethr_submit(fr, queue_invalidate, args);
+	if (bucket != NULL) {
+		args->next = *bucket;
+		*bucket = args;
+	}
+	glist_add_tail(&up_inval.fifo, &args->fifo);
+	up_inval.pending++;
 
-	if (rc != 0)
+	return false;
+}
+
+/* Start a drainer if the waiting invalidates need one, under the mutex */
+static int invalidate_kick(struct fridgethr *fr)
+{
+	int rc;
+
+	if (up_inval.drainers >= INVALIDATE_DRAINERS ||
+	    (up_inval.drainers != 0 &&
+	     up_inval.pending <= up_inval.drainers * INVALIDATE_BATCH))
+		return 0;
+
+	rc = fridgethr_submit(fr, queue_invalidate, NULL);
+	if (rc == 0)
+		up_inval.drainers++;
+
+	return rc;
+}
+
+/* Drop the invalidates queued last, under the mutex */
+static void invalidate_unqueue(unsigned int count)
+{
+	struct invalidate_args *args;
+
+	while (count-- > 0) {
+		args = glist_entry(up_inval.fifo.prev,
+				   struct invalidate_args, fifo);
+		glist_del(&args->fifo);
+		invalidate_unhash(args);
+		up_inval.pending--;
 		gsh_free(args);
+	}
+}
+
+fsal_status_t up_async_invalidate(struct fridgethr *fr,
+				  struct fsal_export *export,
+			struct gsh_buffdesc *obj, uint32_t flags,
+			void (*cb)(void *, fsal_status_t), void *cb_arg)
+{
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&up_inval.mtx);
+
+	if (!invalidate_enqueue(export, obj, flags, cb, cb_arg)) {
+		rc = invalidate_kick(fr);
+		if (rc != 0 && up_inval.drainers == 0)
+			invalidate_unqueue(1);
+		else
+			rc = 0;
+	}
+
+	PTHREAD_MUTEX_unlock(&up_inval.mtx);
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
+
+/**
+ * @brief Queue invalidates of several objects of an export at once
+ *
+ * @param[in] fr     Fridge to run them in
+ * @param[in] export Export the objects are in
+ * @param[in] count  Number of objects
+ * @param[in] objs   Their keys
+ * @param[in] flags  FSAL_UP_INVALIDATE_* for all of them
+ *
+ * @return FSAL status; on error, none was queued.
+ */
+fsal_status_t up_async_invalidate_batch(struct fridgethr *fr,
+					struct fsal_export *export,
+					unsigned int count,
+					struct gsh_buffdesc *objs,
+					uint32_t flags)
+{
+	unsigned int i, queued = 0;
+	int rc = 0;
+
+	PTHREAD_MUTEX_lock(&up_inval.mtx);
+
+	for (i = 0; i < count; i++)
+		if (!invalidate_enqueue(export, &objs[i], flags, NULL, NULL))
+			queued++;
+
+	if (queued != 0) {
+		rc = invalidate_kick(fr);
+		if (rc != 0 && up_inval.drainers == 0)
+			invalidate_unqueue(queued);
+		else
+			rc = 0;
+	}
+
+	PTHREAD_MUTEX_unlock(&up_inval.mtx);
 
 	return fsalstat(posix2fsal_error(rc), rc);
 }
@@ -354,6 +536,75 @@ fsal_status_t up_async_layoutrecall(struct fridgethr *fr,
 	return fsalstat(posix2fsal_error(rc), rc);
 }
 
+/* Bulk layoutrecall */
+
+struct layoutrecall_bulk_args {
+	struct fsal_export *export;
+	layouttype4 layout_type;
+	bool changed;
+	layoutiomode4 io_mode;
+	bool all;
+	fsal_fsid_t fsid;
+	struct layoutrecall_spec spec;
+	void (*cb)(void *, state_status_t);
+	void *cb_arg;
+};
+
+static void queue_layoutrecall_bulk(struct fridgethr_context *ctx)
+{
+	struct layoutrecall_bulk_args *args = ctx->arg;
+	state_status_t status;
+
+	status = args->export->up_ops->layoutrecall_bulk(
+			args->export, args->layout_type, args->changed,
+			args->io_mode, args->all ? NULL : &args->fsid,
+			args->spec.how == layoutrecall_not_specced
+			? NULL : &args->spec);
+
+	if (args->cb)
+		args->cb(args->cb_arg, status);
+
+	gsh_free(args);
+}
+
+fsal_status_t up_async_layoutrecall_bulk(struct fridgethr *fr,
+					 struct fsal_export *export,
+					 layouttype4 layout_type, bool changed,
+					 layoutiomode4 io_mode,
+					 const fsal_fsid_t *fsid,
+					 struct layoutrecall_spec *spec,
+					 void (*cb)(void *, state_status_t),
+					 void *cb_arg)
+{
+	struct layoutrecall_bulk_args *args = NULL;
+	int rc = 0;
+
+	args = gsh_calloc(1, sizeof(struct layoutrecall_bulk_args));
+
+	args->export = export;
+	args->cb = cb;
+	args->cb_arg = cb_arg;
+	args->layout_type = layout_type;
+	args->changed = changed;
+	args->io_mode = io_mode;
+	args->all = fsid == NULL;
+
+	if (fsid)
+		args->fsid = *fsid;
+
+	if (spec)
+		args->spec = *spec;
+	else
+		args->spec.how = layoutrecall_not_specced;
+
+	rc = fridgethr_submit(fr, queue_layoutrecall_bulk, args);
+
+	if (rc != 0)
+		gsh_free(args);
+
+	return fsalstat(posix2fsal_error(rc), rc);
+}
+
 /* Notify Device */
 
 struct notify_device_args {
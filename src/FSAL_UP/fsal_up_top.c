@@ -351,6 +351,7 @@ static state_status_t create_file_recall(struct fsal_obj_handle *obj,
 }
 
 static void layoutrecall_one_call(void *arg);
+static void layoutrecall_bulk_call(void *arg);
 
 /**
  * @brief Data used to handle the response to CB_LAYOUTRECALL
@@ -360,11 +361,76 @@ struct layoutrecall_cb_data {
 	char stateid_other[OTHERSIZE];	/*< "Other" part of state id */
 	struct pnfs_segment segment;	/*< Segment to recall */
 	nfs_cb_argop4 arg;	/*< So we don't free */
-	nfs_client_id_t *client;	/*< The client we're calling. */
+	nfs_client_id_t *client;	/*< The client we're calling.
+					    Referenced for bulk recalls. */
 	struct timespec first_recall;	/*< Time of first recall */
 	uint32_t attempts;	/*< Number of times we've recalled */
 };
 
+static struct layoutrecall_stats recall_stats;
+
+/**
+ * @brief Report the CB_LAYOUTRECALL counters
+ *
+ * @param[out] st The counters
+ */
+
+void layoutrecall_stats(struct layoutrecall_stats *st)
+{
+	st->file = atomic_fetch_uint64_t(&recall_stats.file);
+	st->bulk = atomic_fetch_uint64_t(&recall_stats.bulk);
+	st->pending = atomic_fetch_uint64_t(&recall_stats.pending);
+	st->retries = atomic_fetch_uint64_t(&recall_stats.retries);
+	st->acked = atomic_fetch_uint64_t(&recall_stats.acked);
+	st->nomatch = atomic_fetch_uint64_t(&recall_stats.nomatch);
+	st->revoked = atomic_fetch_uint64_t(&recall_stats.revoked);
+	st->latency_ns = atomic_fetch_uint64_t(&recall_stats.latency_ns);
+	st->latency_max_ns =
+	    atomic_fetch_uint64_t(&recall_stats.latency_max_ns);
+}
+
+/**
+ * @brief Account for a recall we are done with
+ *
+ * @param[in] cb_data The recall
+ * @param[in] outcome Counter of how it ended, or NULL
+ */
+
+static void layoutrec_done(struct layoutrecall_cb_data *cb_data,
+			   uint64_t *outcome)
+{
+	struct timespec current;
+	uint64_t latency, max;
+
+	now(&current);
+	latency = timespec_diff(&cb_data->first_recall, &current);
+
+	if (outcome != NULL)
+		atomic_inc_uint64_t(outcome);
+
+	atomic_add_uint64_t(&recall_stats.latency_ns, latency);
+
+	do {
+		max = atomic_fetch_uint64_t(&recall_stats.latency_max_ns);
+	} while (latency > max &&
+		 !atomic_cmpxchg_uint64_t(&recall_stats.latency_max_ns,
+					  max, latency));
+
+	atomic_dec_uint64_t(&recall_stats.pending);
+}
+
+/**
+ * @brief Whether a recall covers a filesystem or all files
+ *
+ * @param[in] op The CB_LAYOUTRECALL
+ */
+
+static inline bool layoutrec_is_bulk(nfs_cb_argop4 *op)
+{
+	return op->nfs_cb_argop4_u.opcblayoutrecall.clora_recall.
+		lor_recalltype != LAYOUTRECALL4_FILE;
+}
+
 /**
  * @brief Initiate layout recall
  *
@@ -436,7 +502,7 @@ state_status_t layoutrecall(struct fsal_export *export,
 		CB_LAYOUTRECALL4args *cb_layoutrec;
 		layoutrecall_file4 *layout;
 
-		cb_data = gsh_malloc(sizeof(struct layoutrecall_cb_data));
+		cb_data = gsh_calloc(1, sizeof(struct layoutrecall_cb_data));
 
 		arg = &cb_data->arg;
 		arg->argop = NFS4_OP_CB_LAYOUTRECALL;
@@ -499,10 +565,44 @@ state_status_t layoutrecall(struct fsal_export *export,
 
 static void free_layoutrec(nfs_cb_argop4 *op)
 {
+	if (layoutrec_is_bulk(op))
+		return;
+
 	gsh_free(op->nfs_cb_argop4_u.opcblayoutrecall.clora_recall.
 		 layoutrecall4_u.lor_layout.lor_fh.nfs_fh4_val);
 }
 
+/**
+ * @brief Return the layouts of a bulk recall and free it
+ *
+ * @param[in] cb_data      The recall
+ * @param[in] circumstance Why the layouts are returned
+ */
+
+static void layoutrec_bulk_return(struct layoutrecall_cb_data *cb_data,
+				  enum fsal_layoutreturn_circumstance
+				  circumstance)
+{
+	CB_LAYOUTRECALL4args *cb_layoutrec =
+	    &cb_data->arg.nfs_cb_argop4_u.opcblayoutrecall;
+	bool all = cb_layoutrec->clora_recall.lor_recalltype ==
+	    LAYOUTRECALL4_ALL;
+	fsal_fsid_t fsid;
+
+	fsid.major = cb_layoutrec->clora_recall.layoutrecall4_u.lor_fsid.major;
+	fsid.minor = cb_layoutrec->clora_recall.layoutrecall4_u.lor_fsid.minor;
+
+	(void) return_owner_layouts(&cb_data->client->cid_owner,
+				    cb_layoutrec->clora_type,
+				    all ? NULL : &fsid, cb_data->segment,
+				    all ? LAYOUTRETURN4_ALL
+					: LAYOUTRETURN4_FSID,
+				    circumstance);
+
+	dec_client_id_ref(cb_data->client);
+	gsh_free(cb_data);
+}
+
 /**
  * @brief Complete a CB_LAYOUTRECALL
  *
@@ -517,16 +617,14 @@ static void free_layoutrec(nfs_cb_argop4 *op)
  * For DELAY, it backs off in plateaus, then revokes the layout if the
  * period of delay has surpassed the lease period.
  *
- * @param[in] call  The RPC call being completed
- * @param[in] hook  The hook itself
- * @param[in] arg   Supplied argument (the callback data)
- * @param[in] flags There are no flags.
- *
- * @return 0, constantly.
+ * @param[in] op     The CB_LAYOUTRECALL
+ * @param[in] status Its result
+ * @param[in] hook   The hook itself
+ * @param[in] arg    Supplied argument (the callback data)
  */
 
-static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
-				    void *arg, uint32_t flags)
+static void layoutrec_completion(nfs_cb_argop4 *op, nfsstat4 status,
+				 rpc_call_hook hook, void *arg)
 {
 	struct layoutrecall_cb_data *cb_data = arg;
 	bool deleted = false;
@@ -542,13 +640,13 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 			     0, 0, UNKNOWN_REQUEST);
 
 	LogFullDebug(COMPONENT_NFS_CB, "status %d cb_data %p",
-		     call->cbt.v_u.v4.res.status, cb_data);
+		     status, cb_data);
 
 	/* Get this out of the way up front */
 	if (hook != RPC_CALL_COMPLETE)
 		goto revoke;
 
-	if (call->cbt.v_u.v4.res.status == NFS4_OK) {
+	if (status == NFS4_OK) {
 		/**
 		 * @todo This is where you would record that a
 		 * recall was acknowledged and that a layoutreturn
@@ -562,11 +660,13 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		 * above this point in the function, or we could stash
 		 * the clientid in cb_data.
 		 */
-		free_layoutrec(&call->cbt.v_u.v4.args.argarray.argarray_val[1]);
-		nfs41_complete_single(call, hook, cb_data, flags);
+		layoutrec_done(cb_data, &recall_stats.acked);
+		free_layoutrec(op);
+		if (layoutrec_is_bulk(op))
+			dec_client_id_ref(cb_data->client);
 		gsh_free(cb_data);
 		goto out;
-	} else if (call->cbt.v_u.v4.res.status == NFS4ERR_DELAY) {
+	} else if (status == NFS4ERR_DELAY) {
 		struct timespec current;
 		nsecs_elapsed_t delay;
 
@@ -588,8 +688,10 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 
 		/* We don't free the argument here, because we'll be
 		   re-using that to make the queued call. */
-		nfs41_complete_single(call, hook, cb_data, flags);
-		delayed_submit(layoutrecall_one_call, cb_data, delay);
+		atomic_inc_uint64_t(&recall_stats.retries);
+		delayed_submit(layoutrec_is_bulk(op) ? layoutrecall_bulk_call
+						     : layoutrecall_one_call,
+			       cb_data, delay);
 		goto out;
 	}
 
@@ -599,6 +701,20 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 	 */
 
  revoke:
+	if (hook == RPC_CALL_COMPLETE && status == NFS4ERR_NOMATCHING_LAYOUT)
+		layoutrec_done(cb_data, &recall_stats.nomatch);
+	else
+		layoutrec_done(cb_data, &recall_stats.revoked);
+
+	if (layoutrec_is_bulk(op)) {
+		layoutrec_bulk_return(cb_data,
+				      hook == RPC_CALL_COMPLETE &&
+				      status == NFS4ERR_NOMATCHING_LAYOUT
+				      ? circumstance_client
+				      : circumstance_revoke);
+		goto out;
+	}
+
 	/* If we don't find the state, there's nothing to return. */
 	state = nfs4_State_Get_Pointer(cb_data->stateid_other);
 
@@ -608,8 +724,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		enum fsal_layoutreturn_circumstance circumstance;
 
 		if (hook == RPC_CALL_COMPLETE &&
-		    call->cbt.v_u.v4.res.status ==
-		    NFS4ERR_NOMATCHING_LAYOUT)
+		    status == NFS4ERR_NOMATCHING_LAYOUT)
 			circumstance = circumstance_client;
 		else
 			circumstance = circumstance_revoke;
@@ -648,8 +763,7 @@ static int32_t layoutrec_completion(rpc_call_t *call, rpc_call_hook hook,
 		dec_state_t_ref(state);
 	}
 
-	free_layoutrec(&call->cbt.v_u.v4.args.argarray.argarray_val[1]);
-	nfs41_complete_single(call, hook, cb_data, flags);
+	free_layoutrec(op);
 	gsh_free(cb_data);
 
 out:
@@ -665,8 +779,6 @@ out:
 		/* Release the owner */
 		dec_state_owner_ref(owner);
 	}
-
-	return 0;
 }
 
 /**
@@ -696,6 +808,8 @@ static void return_one_async(void *arg)
 	init_root_op_context(&root_op_context, NULL, NULL,
 			     0, 0, UNKNOWN_REQUEST);
 
+	layoutrec_done(cb_data, &recall_stats.revoked);
+
 	state = nfs4_State_Get_Pointer(cb_data->stateid_other);
 
 	ok = get_state_obj_export_owner_refs(state, &obj, &export, &owner);
@@ -716,6 +830,7 @@ static void return_one_async(void *arg)
 	}
 
 	release_root_op_context();
+	free_layoutrec(&cb_data->arg);
 	gsh_free(cb_data);
 
 	if (state != NULL) {
@@ -757,8 +872,11 @@ static void layoutrecall_one_call(void *arg)
 	init_root_op_context(&root_op_context, NULL, NULL,
 			     0, 0, UNKNOWN_REQUEST);
 
-	if (cb_data->attempts == 0)
+	if (cb_data->attempts == 0) {
 		now(&cb_data->first_recall);
+		atomic_inc_uint64_t(&recall_stats.file);
+		atomic_inc_uint64_t(&recall_stats.pending);
+	}
 
 	state = nfs4_State_Get_Pointer(cb_data->stateid_other);
 
@@ -772,10 +890,9 @@ static void layoutrecall_one_call(void *arg)
 		root_op_context.req_ctx.ctx_export = export;
 		root_op_context.req_ctx.fsal_export = export->fsal_export;
 
-		code = nfs_rpc_v41_single(cb_data->client, &cb_data->arg,
-					  &state->state_refer,
-					  layoutrec_completion,
-					  cb_data, free_layoutrec);
+		code = nfs_rpc_cb_queue(cb_data->client, &cb_data->arg,
+					&state->state_refer,
+					layoutrec_completion, cb_data);
 
 		if (code != 0) {
 			/**
@@ -811,11 +928,13 @@ static void layoutrecall_one_call(void *arg)
 			} else {
 				bool deleted = false;
 
+				layoutrec_done(cb_data, &recall_stats.revoked);
 				nfs4_return_one_state(obj,
 						      LAYOUTRETURN4_FILE,
 						      circumstance_revoke,
 						      state, cb_data->segment,
 						      0, NULL, &deleted);
+				free_layoutrec(&cb_data->arg);
 				gsh_free(cb_data);
 			}
 		} else {
@@ -825,6 +944,8 @@ static void layoutrecall_one_call(void *arg)
 		PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
 	} else {
+		layoutrec_done(cb_data, NULL);
+		free_layoutrec(&cb_data->arg);
 		gsh_free(cb_data);
 	}
 
@@ -847,6 +968,225 @@ static void layoutrecall_one_call(void *arg)
 	}
 }
 
+/**
+ * @brief Revoke the layouts of a bulk recall that could not be sent
+ *
+ * Queued like return_one_async, so as not to return layouts under the
+ * locks of the FSAL's call.
+ *
+ * @param[in] arg The recall
+ */
+
+static void return_bulk_async(void *arg)
+{
+	layoutrec_bulk_return(arg, circumstance_revoke);
+}
+
+/**
+ * @brief Send one bulk layoutrecall to one client
+ *
+ * @param[in] arg Structure holding all arguments, so we can queue
+ *                this function in delayed_exec for retry on NFS4ERR_DELAY.
+ */
+
+static void layoutrecall_bulk_call(void *arg)
+{
+	struct layoutrecall_cb_data *cb_data = arg;
+	int code;
+
+	if (cb_data->attempts == 0) {
+		now(&cb_data->first_recall);
+		atomic_inc_uint64_t(&recall_stats.bulk);
+		atomic_inc_uint64_t(&recall_stats.pending);
+	}
+
+	code = nfs_rpc_cb_queue(cb_data->client, &cb_data->arg, NULL,
+				layoutrec_completion, cb_data);
+
+	if (code != 0) {
+		/* As for a file, take the client to be gone. */
+		layoutrec_done(cb_data, &recall_stats.revoked);
+		if (cb_data->attempts == 0)
+			delayed_submit(return_bulk_async, cb_data, 0);
+		else
+			layoutrec_bulk_return(cb_data, circumstance_revoke);
+	} else {
+		++cb_data->attempts;
+	}
+}
+
+/**
+ * @brief Arguments of a bulk recall, for each client
+ */
+
+struct layoutrecall_bulk {
+	layouttype4 layout_type;
+	bool changed;
+	layoutiomode4 io_mode;
+	const fsal_fsid_t *fsid;
+	struct layoutrecall_spec *spec;
+	uint32_t sent;
+};
+
+/**
+ * @brief Whether a client holds a layout a bulk recall covers
+ *
+ * @param[in] clientid The client
+ * @param[in] bulk     The recall
+ */
+
+static bool client_has_layouts(nfs_client_id_t *clientid,
+			       struct layoutrecall_bulk *bulk)
+{
+	state_owner_t *owner = &clientid->cid_owner;
+	struct glist_head *glist;
+	bool found = false;
+
+	PTHREAD_MUTEX_lock(&owner->so_mutex);
+
+	glist_for_each(glist, &owner->so_owner.so_nfs4_owner.so_state_list) {
+		state_t *s = glist_entry(glist, state_t, state_owner_list);
+		struct fsal_obj_handle *obj;
+
+		if (s->state_type != STATE_TYPE_LAYOUT ||
+		    s->state_data.layout.state_layout_type !=
+		    bulk->layout_type)
+			continue;
+
+		if (bulk->fsid == NULL) {
+			found = true;
+			break;
+		}
+
+		if (!get_state_obj_export_owner_refs(s, &obj, NULL, NULL))
+			continue;
+
+		found = memcmp(&obj->fsid, bulk->fsid,
+			       sizeof(*bulk->fsid)) == 0;
+		obj->obj_ops.put_ref(obj);
+
+		if (found)
+			break;
+	}
+
+	PTHREAD_MUTEX_unlock(&owner->so_mutex);
+
+	return found;
+}
+
+/**
+ * @brief Send a bulk layoutrecall to a client holding layouts
+ *
+ * @param[in] clientid The client
+ * @param[in] arg      The recall
+ */
+
+static void layoutrecall_bulk_client(nfs_client_id_t *clientid, void *arg)
+{
+	struct layoutrecall_bulk *bulk = arg;
+	struct layoutrecall_cb_data *cb_data;
+	CB_LAYOUTRECALL4args *cb_layoutrec;
+
+	if (bulk->spec != NULL) {
+		switch (bulk->spec->how) {
+		case layoutrecall_howspec_exactly:
+			if (bulk->spec->u.client != clientid->cid_clientid)
+				return;
+			break;
+
+		case layoutrecall_howspec_complement:
+			if (bulk->spec->u.client == clientid->cid_clientid)
+				return;
+			break;
+
+		case layoutrecall_not_specced:
+			break;
+		}
+	}
+
+	if (!client_has_layouts(clientid, bulk))
+		return;
+
+	cb_data = gsh_calloc(1, sizeof(struct layoutrecall_cb_data));
+
+	cb_data->arg.argop = NFS4_OP_CB_LAYOUTRECALL;
+	cb_layoutrec = &cb_data->arg.nfs_cb_argop4_u.opcblayoutrecall;
+	cb_layoutrec->clora_type = bulk->layout_type;
+	cb_layoutrec->clora_iomode = bulk->io_mode;
+	cb_layoutrec->clora_changed = bulk->changed;
+
+	if (bulk->fsid != NULL) {
+		cb_layoutrec->clora_recall.lor_recalltype = LAYOUTRECALL4_FSID;
+		cb_layoutrec->clora_recall.layoutrecall4_u.lor_fsid.major =
+		    bulk->fsid->major;
+		cb_layoutrec->clora_recall.layoutrecall4_u.lor_fsid.minor =
+		    bulk->fsid->minor;
+	} else {
+		cb_layoutrec->clora_recall.lor_recalltype = LAYOUTRECALL4_ALL;
+	}
+
+	cb_data->segment.io_mode = bulk->io_mode;
+	cb_data->segment.offset = 0;
+	cb_data->segment.length = NFS4_UINT64_MAX;
+
+	inc_client_id_ref(clientid);
+	cb_data->client = clientid;
+	bulk->sent++;
+
+	layoutrecall_bulk_call(cb_data);
+}
+
+/**
+ * @brief Initiate a layout recall on a filesystem or on all files
+ *
+ * Each client holding a matching layout gets one CB_LAYOUTRECALL.  The
+ * callbacks of a client are queued and batched by the back channel,
+ * within Callback_Max_In_Flight, so the clients are called upon at
+ * once without any one of them being flooded.
+ *
+ * @param[in] export      FSAL export
+ * @param[in] layout_type The type of layout to recall
+ * @param[in] changed     Whether the layout has changed and the
+ *                        client ought to finish writes through MDS
+ * @param[in] io_mode     The iomode to recall
+ * @param[in] fsid        The filesystem, NULL for all layouts of the type
+ * @param[in] spec        Lets us be fussy about what clients we send
+ *                        to. May be NULL.
+ *
+ * @retval STATE_SUCCESS if scheduled.
+ * @retval STATE_NOT_FOUND if no client holds a matching layout.
+ */
+
+state_status_t layoutrecall_bulk(struct fsal_export *export,
+				 layouttype4 layout_type, bool changed,
+				 layoutiomode4 io_mode,
+				 const fsal_fsid_t *fsid,
+				 struct layoutrecall_spec *spec)
+{
+	struct layoutrecall_bulk bulk = {
+		.layout_type = layout_type,
+		.changed = changed,
+		.io_mode = io_mode,
+		.fsid = fsid,
+		.spec = spec,
+	};
+	struct root_op_context root_op_context;
+
+	/* The states are looked up on their own exports */
+	init_root_op_context(&root_op_context, NULL, NULL,
+			     0, 0, UNKNOWN_REQUEST);
+
+	nfs41_foreach_client(layoutrecall_bulk_client, &bulk);
+
+	release_root_op_context();
+
+	LogDebug(COMPONENT_NFS_CB,
+		 "Bulk layout recall of %s sent to %"PRIu32" clients",
+		 fsid != NULL ? "an fsid" : "all files", bulk.sent);
+
+	return bulk.sent != 0 ? STATE_SUCCESS : STATE_NOT_FOUND;
+}
+
 /**
  * @brief Data for CB_NOTIFY and CB_NOTIFY_DEVICEID response handler
  */
@@ -861,21 +1201,17 @@ struct cb_notify {
 /**
  * @brief Handle CB_NOTIFY_DEVICE response
  *
- * @param[in] call  The RPC call being completed
- * @param[in] hook  The hook itself
- * @param[in] arg   Supplied argument (the callback data)
- * @param[in] flags There are no flags.
- *
- * @return 0, constantly.
+ * @param[in] op     The CB_NOTIFY_DEVICEID
+ * @param[in] status Its result
+ * @param[in] hook   The hook itself
+ * @param[in] arg    Supplied argument (the callback data)
  */
 
-static int32_t notifydev_completion(rpc_call_t *call, rpc_call_hook hook,
-				    void *arg, uint32_t flags)
+static void notifydev_completion(nfs_cb_argop4 *op, nfsstat4 status,
+				 rpc_call_hook hook, void *arg)
 {
-	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p",
-		     call->cbt.v_u.v4.res.status, arg);
+	LogFullDebug(COMPONENT_NFS_CB, "status %d arg %p", status, arg);
 	gsh_free(arg);
-	return 0;
 }
 
 /**
@@ -934,8 +1270,8 @@ static bool devnotify_client_callback(nfs_client_id_t *clientid,
 	       &devicenotify->devid,
 	       sizeof(arg->notify_del.ndd_deviceid));
 	code =
-	    nfs_rpc_v41_single(clientid, &arg->arg, NULL, notifydev_completion,
-			       &arg->arg, NULL);
+	    nfs_rpc_cb_queue(clientid, &arg->arg, NULL, notifydev_completion,
+			     &arg->arg);
 	if (code != 0)
 		gsh_free(arg);
 
@@ -1016,16 +1352,16 @@ bool eval_deleg_revoke(struct state_t *deleg_state)
 /**
  * @brief Handle recall response
  *
- * @param[in] call  The RPC call being completed
- * @param[in] clfl_stats  client-file deleg heuristics
  * @param[in] p_cargs deleg recall context
+ * @param[in] state   Delegation state
+ * @param[in] status  Client answer to the CB_RECALL
  *
  */
 
 static enum recall_resp_action handle_recall_response(
 				struct delegrecall_context *p_cargs,
 				struct state_t *state,
-				rpc_call_t *call)
+				nfsstat4 status)
 {
 	enum recall_resp_action resp_action;
 	char str[DISPLAY_STATEID_OTHER_SIZE];
@@ -1040,7 +1376,7 @@ static enum recall_resp_action handle_recall_response(
 	struct cf_deleg_stats *clfl_stats =
 		&state->state_data.deleg.sd_clfile_stats;
 
-	switch (call->cbt.v_u.v4.res.status) {
+	switch (status) {
 	case NFS4_OK:
 		if (str_valid)
 			LogDebug(COMPONENT_NFS_CB,
@@ -1048,6 +1384,7 @@ static enum recall_resp_action handle_recall_response(
 		resp_action = DELEG_RET_WAIT;
 		clfl_stats->cfd_rs_time =
 					time(NULL);
+		deleg_heuristics_recall_ok(p_cargs->drc_clid);
 		break;
 	case NFS4ERR_BADHANDLE:
 		if (str_valid)
@@ -1075,8 +1412,7 @@ static enum recall_resp_action handle_recall_response(
 		if (str_valid)
 			LogDebug(COMPONENT_NFS_CB,
 				 "Client sent %d response, retrying recall for Delegation %s",
-				 call->cbt.v_u.v4.res.status,
-				 str);
+				 status, str);
 		resp_action = DELEG_RECALL_SCHED;
 		break;
 	}
@@ -1098,32 +1434,23 @@ free_delegrecall_context(struct delegrecall_context *deleg_ctx)
 }
 
 /**
- * @brief Handle the reply to a CB_RECALL
- *
- * @param[in] call  The RPC call being completed
- * @param[in] hook  The hook itself
- * @param[in] arg   Supplied argument (the callback data)
- * @param[in] flags There are no flags.
+ * @brief Act on the outcome of a CB_RECALL
  *
- * @return 0, constantly.
+ * @param[in] deleg_ctx Recall context, consumed
+ * @param[in] replied   Whether the client answered
+ * @param[in] status    The answer, if it did
  */
 
-static int32_t delegrecall_completion_func(rpc_call_t *call,
-					   rpc_call_hook hook, void *arg,
-					   uint32_t flags)
+static void delegrecall_complete(struct delegrecall_context *deleg_ctx,
+				 bool replied, nfsstat4 status)
 {
-	char *fh = NULL;
 	enum recall_resp_action resp_act;
 	nfsstat4 rc = NFS4_OK;
-	struct delegrecall_context *deleg_ctx = arg;
 	struct state_t *state;
 	struct fsal_obj_handle *obj = NULL;
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
 
-	LogDebug(COMPONENT_NFS_CB, "%p %s", call,
-		 (hook == RPC_CALL_COMPLETE) ? "Success" : "Failed");
-
 	state = nfs4_State_Get_Pointer(deleg_ctx->drc_stateid.other);
 
 	if (state == NULL) {
@@ -1146,29 +1473,16 @@ static int32_t delegrecall_completion_func(rpc_call_t *call,
 		LogDebug(COMPONENT_NFS_CB, "deleg_entry %s", str);
 	}
 
-	switch (hook) {
-	case RPC_CALL_COMPLETE:
-		LogMidDebug(COMPONENT_NFS_CB, "call result: %d", call->stat);
-		fh = call->cbt.v_u.v4.args.argarray.argarray_val->
-				nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_val;
-		if (call->stat != RPC_SUCCESS) {
-			LogEvent(COMPONENT_NFS_CB,
-				 "Call stat: %d, marking CB channel down",
-				 call->stat);
+	if (replied) {
+		resp_act = handle_recall_response(deleg_ctx, state, status);
+	} else {
+		/* The v4.1 back channel is torn down by the callback
+		 * queue itself.
+		 */
+		if (deleg_ctx->drc_clid->cid_minorversion == 0)
 			set_cb_chan_down(deleg_ctx->drc_clid, true);
-			resp_act = DELEG_RECALL_SCHED;
-		} else
-			resp_act = handle_recall_response(deleg_ctx,
-							  state,
-							  call);
-		break;
-	default:
-		LogEvent(COMPONENT_NFS_CB,
-			 "Unknown hook %d, marking CB channel down", hook);
-		set_cb_chan_down(deleg_ctx->drc_clid, true);
 		/* Mark the recall as failed */
 		resp_act = DELEG_RECALL_SCHED;
-		break;
 	}
 	switch (resp_act) {
 	case DELEG_RECALL_SCHED:
@@ -1214,17 +1528,116 @@ out_free_drc:
 
 out_free:
 
-	fh = call->cbt.v_u.v4.args.argarray.argarray_val->
+	if (state != NULL)
+		dec_state_t_ref(state);
+}
+
+/**
+ * @brief Handle the reply to a CB_RECALL
+ *
+ * @param[in] call  The RPC call being completed
+ * @param[in] hook  The hook itself
+ * @param[in] arg   Supplied argument (the callback data)
+ * @param[in] flags There are no flags.
+ *
+ * @return 0, constantly.
+ */
+
+static int32_t delegrecall_completion_func(rpc_call_t *call,
+					   rpc_call_hook hook, void *arg,
+					   uint32_t flags)
+{
+	char *fh = call->cbt.v_u.v4.args.argarray.argarray_val->
 				nfs_cb_argop4_u.opcbrecall.fh.nfs_fh4_val;
+
+	LogDebug(COMPONENT_NFS_CB, "%p %s", call,
+		 (hook == RPC_CALL_COMPLETE) ? "Success" : "Failed");
+
+	if (hook != RPC_CALL_COMPLETE)
+		LogEvent(COMPONENT_NFS_CB,
+			 "Unknown hook %d, marking CB channel down", hook);
+	else if (call->stat != RPC_SUCCESS)
+		LogEvent(COMPONENT_NFS_CB,
+			 "Call stat: %d, marking CB channel down",
+			 call->stat);
+	else
+		LogMidDebug(COMPONENT_NFS_CB, "call result: %d",
+			    call->cbt.v_u.v4.res.status);
+
+	delegrecall_complete(arg,
+			     hook == RPC_CALL_COMPLETE &&
+			     call->stat == RPC_SUCCESS,
+			     call->cbt.v_u.v4.res.status);
+
 	gsh_free(fh);
 	free_rpc_call(call);
 
-	if (state != NULL)
-		dec_state_t_ref(state);
-
 	return 0; /*Always return zero, the delegation is recalled or revoked */
 }
 
+/**
+ * @brief Handle the answer to a queued NFSv4.1 CB_RECALL
+ *
+ * @param[in] op     The CB_RECALL, freed here
+ * @param[in] status Its result
+ * @param[in] hook   RPC_CALL_COMPLETE if the client answered
+ * @param[in] arg    The recall context
+ */
+
+static void delegrecall_op_done(nfs_cb_argop4 *op, nfsstat4 status,
+				rpc_call_hook hook, void *arg)
+{
+	LogMidDebug(COMPONENT_NFS_CB, "hook %d status %d", hook, status);
+
+	delegrecall_complete(arg, hook == RPC_CALL_COMPLETE, status);
+
+	nfs4_freeFH(&op->nfs_cb_argop4_u.opcbrecall.fh);
+	gsh_free(op);
+}
+
+/**
+ * @brief Queue a CB_RECALL to an NFSv4.1 client
+ *
+ * Recalls of many delegations of one client, as when a directory is
+ * invalidated, are sent together by the callback queue.
+ *
+ * @param[in] obj     The file being delegated
+ * @param[in] state   The delegation
+ * @param[in] p_cargs The recall context, handed to delegrecall_op_done
+ *
+ * @retval true if the recall was queued.
+ */
+
+static bool delegrecall_queue(struct fsal_obj_handle *obj,
+			      struct state_t *state,
+			      struct delegrecall_context *p_cargs)
+{
+	nfs_cb_argop4 *argop = gsh_calloc(1, sizeof(*argop));
+
+	argop->argop = NFS4_OP_CB_RECALL;
+	COPY_STATEID(&argop->nfs_cb_argop4_u.opcbrecall.stateid, state);
+	argop->nfs_cb_argop4_u.opcbrecall.truncate = false;
+
+	if (!nfs4_FSALToFhandle(true, &argop->nfs_cb_argop4_u.opcbrecall.fh,
+				obj, p_cargs->drc_exp)) {
+		LogCrit(COMPONENT_FSAL_UP,
+			"nfs4_FSALToFhandle failed, can not process recall");
+		gsh_free(argop);
+		return false;
+	}
+
+	if (nfs_rpc_cb_queue(p_cargs->drc_clid, argop, &state->state_refer,
+			     delegrecall_op_done, p_cargs) != 0) {
+		LogCrit(COMPONENT_NFS_CB,
+			"No back channel, not issuing a recall");
+		nfs4_freeFH(&argop->nfs_cb_argop4_u.opcbrecall.fh);
+		gsh_free(argop);
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * @brief Send one delegation recall to one client.
  *
@@ -1248,6 +1661,7 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 	struct display_buffer dspbuf = {sizeof(str), str, str};
 	bool str_valid = false;
 
+	memset(argop, 0, sizeof(argop));
 	clfl_stats = &state->state_data.deleg.sd_clfile_stats;
 
 	if (isDebug(COMPONENT_FSAL_UP)) {
@@ -1264,6 +1678,12 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 
 	inc_recalls(p_cargs->drc_clid->gsh_client);
 
+	if (p_cargs->drc_clid->cid_minorversion > 0) {
+		if (delegrecall_queue(obj, state, p_cargs))
+			return;
+		goto out;
+	}
+
 	/* Attempt a recall only if channel state is UP */
 	if (get_cb_chan_down(p_cargs->drc_clid)) {
 		LogCrit(COMPONENT_NFS_CB,
@@ -1319,6 +1739,7 @@ void delegrecall_one(struct fsal_obj_handle *obj,
 out:
 
 	inc_failed_recalls(p_cargs->drc_clid->gsh_client);
+	deleg_heuristics_recall_failed(p_cargs->drc_clid);
 
 	nfs4_freeFH(&argop->nfs_cb_argop4_u.opcbrecall.fh);
 
@@ -1617,6 +2038,7 @@ struct fsal_up_vector fsal_up_top = {
 	.invalidate = invalidate,
 	.update = update,
 	.layoutrecall = layoutrecall,
+	.layoutrecall_bulk = layoutrecall_bulk,
 	.notify_device = notify_device,
 	.delegrecall = delegrecall,
 	.invalidate_close = invalidate_close
@@ -45,6 +45,9 @@
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <poll.h>
+#ifdef LINUX
+#include <sys/epoll.h>
+#endif
 #include <arpa/inet.h>		/* For inet_ntop() */
 #include "hashtable.h"
 #include "log.h"
@@ -58,6 +61,7 @@
 #include "client_mgr.h"
 #include "server_stats.h"
 #include "9p.h"
+#include "io_bufpool.h"
 #include <stdbool.h>
 
 #define P_FAMILY AF_INET6
@@ -99,64 +103,42 @@ void DispatchWork9P(request_data_t *req)
 }
 
 /**
- * _9p_socket_thread: 9p socket manager.
- *
- * This function is the main loop for the 9p socket manager.
- * One such thread exists per connection.
- *
- * @param Arg the socket number cast as a void * in pthread_create
- *
- * @return NULL
+ * @brief Set up the connection of a new 9P/TCP socket
  *
+ * @param[out] conn      The connection
+ * @param[in]  tcp_sock  Its socket
+ * @param[out] strcaller The peer address, INET6_ADDRSTRLEN long
  */
-
-void *_9p_socket_thread(void *Arg)
+static void _9p_tcp_conn_init(struct _9p_conn *conn, long int tcp_sock,
+			      char *strcaller)
 {
-	long int tcp_sock = (long int)Arg;
-	int rc = -1;
-	struct pollfd fds[1];
-	int fdcount = 1;
-	static char my_name[MAXNAMLEN + 1];
-	char strcaller[INET6_ADDRSTRLEN];
-	request_data_t *req = NULL;
-	int tag;
-	unsigned long sequence = 0;
-	unsigned int i = 0;
-	char *_9pmsg = NULL;
-	uint32_t msglen;
-
-	struct _9p_conn _9p_conn;
 	socklen_t addrpeerlen;
-
-	int readlen = 0;
-	int total_readlen = 0;
-
-	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
-	SetNameFunction(my_name);
+	unsigned int i;
+	int rc;
 
 	/* Init the struct _9p_conn structure */
-	memset(&_9p_conn, 0, sizeof(_9p_conn));
-	PTHREAD_MUTEX_init(&_9p_conn.sock_lock, NULL);
-	_9p_conn.trans_type = _9P_TCP;
-	_9p_conn.trans_data.sockfd = tcp_sock;
+	memset(conn, 0, sizeof(*conn));
+	PTHREAD_MUTEX_init(&conn->sock_lock, NULL);
+	_9p_tcp_sendq_init(conn);
+	conn->trans_type = _9P_TCP;
+	conn->trans_data.sockfd = tcp_sock;
 	for (i = 0; i < FLUSH_BUCKETS; i++) {
-		PTHREAD_MUTEX_init(&_9p_conn.flush_buckets[i].lock, NULL);
-		glist_init(&_9p_conn.flush_buckets[i].list);
+		PTHREAD_MUTEX_init(&conn->flush_buckets[i].lock, NULL);
+		glist_init(&conn->flush_buckets[i].list);
 	}
-	atomic_store_uint32_t(&_9p_conn.refcount, 0);
+	atomic_store_uint32_t(&conn->refcount, 0);
 
-	/* Init the fids pointers array */
-	memset(&_9p_conn.fids, 0, _9P_FID_PER_CONN * sizeof(struct _9p_fid *));
+	_9p_init_fids(conn);
 
 	/* Set initial msize.
 	 * Client may request a lower value during TVERSION */
-	_9p_conn.msize = _9p_param._9p_tcp_msize;
+	conn->msize = _9p_param._9p_tcp_msize;
 
-	if (gettimeofday(&_9p_conn.birth, NULL) == -1)
+	if (gettimeofday(&conn->birth, NULL) == -1)
 		LogFatal(COMPONENT_9P, "Cannot get connection's time of birth");
 
-	addrpeerlen = sizeof(_9p_conn.addrpeer);
-	rc = getpeername(tcp_sock, (struct sockaddr *)&_9p_conn.addrpeer,
+	addrpeerlen = sizeof(conn->addrpeer);
+	rc = getpeername(tcp_sock, (struct sockaddr *)&conn->addrpeer,
 			 &addrpeerlen);
 	if (rc == -1) {
 		LogMajor(COMPONENT_9P,
@@ -166,15 +148,15 @@ void *_9p_socket_thread(void *Arg)
 		strncpy(strcaller, "(unresolved)", INET6_ADDRSTRLEN);
 		strcaller[12] = '\0';
 	} else {
-		switch (_9p_conn.addrpeer.ss_family) {
+		switch (conn->addrpeer.ss_family) {
 		case AF_INET:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in *)&_9p_conn.addrpeer)->
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in *)&conn->addrpeer)->
 				  sin_addr, strcaller, INET6_ADDRSTRLEN);
 			break;
 		case AF_INET6:
-			inet_ntop(_9p_conn.addrpeer.ss_family,
-				  &((struct sockaddr_in6 *)&_9p_conn.addrpeer)->
+			inet_ntop(conn->addrpeer.ss_family,
+				  &((struct sockaddr_in6 *)&conn->addrpeer)->
 				  sin6_addr, strcaller, INET6_ADDRSTRLEN);
 			break;
 		default:
@@ -185,7 +167,98 @@ void *_9p_socket_thread(void *Arg)
 		LogEvent(COMPONENT_9P, "9p socket #%ld is connected to %s",
 			 tcp_sock, strcaller);
 	}
-	_9p_conn.client = get_gsh_client(&_9p_conn.addrpeer, false);
+	conn->client = get_gsh_client(&conn->addrpeer, false);
+}
+
+/**
+ * @brief Release a connection the workers are done with
+ *
+ * @param[in] conn The connection
+ */
+static void _9p_tcp_conn_release(struct _9p_conn *conn)
+{
+	unsigned int i;
+
+	_9p_cleanup_fids(conn);
+	_9p_tcp_sendq_release(conn);
+
+	if (conn->client != NULL)
+		put_gsh_client(conn->client);
+
+	for (i = 0; i < FLUSH_BUCKETS; i++)
+		PTHREAD_MUTEX_destroy(&conn->flush_buckets[i].lock);
+	PTHREAD_MUTEX_destroy(&conn->sock_lock);
+}
+
+/**
+ * @brief Hand a complete message to the workers
+ *
+ * @param[in] conn     The connection it came on
+ * @param[in] _9pmsg   The message, now owned by the request
+ * @param[in] sequence Sequence number of the message on the connection
+ */
+static void _9p_tcp_dispatch(struct _9p_conn *conn, char *_9pmsg,
+			     unsigned long sequence)
+{
+	request_data_t *req;
+	int tag;
+
+	server_stats_transport_done(conn->client,
+				    *(uint32_t *) _9pmsg, 1, 0,
+				    0, 0, 0);
+
+	/* Message is good. */
+	req = pool_alloc(request_pool);
+
+	req->rtype = _9P_REQUEST;
+	req->r_u._9p._9pmsg = _9pmsg;
+	req->r_u._9p.pconn = conn;
+
+	/* Add this request to the request list,
+	 * should it be flushed later. */
+	tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
+	_9p_AddFlushHook(&req->r_u._9p, tag, sequence);
+	LogFullDebug(COMPONENT_9P, "Request tag is %d\n", tag);
+
+	/* Message was OK push it */
+	DispatchWork9P(req);
+}
+
+/**
+ * _9p_socket_thread: 9p socket manager.
+ *
+ * This function is the main loop for the 9p socket manager.
+ * One such thread exists per connection when _9P_TCP_IO_Threads is 0,
+ * see _9p_io_loop otherwise.
+ *
+ * @param Arg the socket number cast as a void * in pthread_create
+ *
+ * @return NULL
+ *
+ */
+
+void *_9p_socket_thread(void *Arg)
+{
+	long int tcp_sock = (long int)Arg;
+	int rc = -1;
+	struct pollfd fds[1];
+	int fdcount = 1;
+	static char my_name[MAXNAMLEN + 1];
+	char strcaller[INET6_ADDRSTRLEN];
+	unsigned long sequence = 0;
+	char *_9pmsg = NULL;
+	char hdr[_9P_HDR_SIZE];
+	uint32_t msglen;
+
+	struct _9p_conn _9p_conn;
+
+	int readlen = 0;
+	int total_readlen = 0;
+
+	snprintf(my_name, MAXNAMLEN, "9p_sock_mgr#fd=%ld", tcp_sock);
+	SetNameFunction(my_name);
+
+	_9p_tcp_conn_init(&_9p_conn, tcp_sock, strcaller);
 
 	/* Set up the structure used by poll */
 	memset((char *)fds, 0, sizeof(struct pollfd));
@@ -225,24 +298,25 @@ void *_9p_socket_thread(void *Arg)
 		if (!(fds[0].revents & (POLLIN | POLLRDNORM)))
 			continue;
 
-		/* Prepare to read the message */
-		_9pmsg = gsh_malloc(_9p_conn.msize);
-
 		/* An incoming 9P request: the msg has a 4 bytes header
 		   showing the size of the msg including the header */
-		readlen = recv(fds[0].fd, _9pmsg,
+		readlen = recv(fds[0].fd, hdr,
 			       _9P_HDR_SIZE, MSG_WAITALL);
 		if (readlen != _9P_HDR_SIZE)
 			goto badmsg;
 
-		msglen = *(uint32_t *) _9pmsg;
-		if (msglen > _9p_conn.msize) {
+		memcpy(&msglen, hdr, _9P_HDR_SIZE);
+		if (msglen < _9P_STD_HDR_SIZE || msglen > _9p_conn.msize) {
 			LogCrit(COMPONENT_9P,
-				"Message size too big! got %u, max = %u",
+				"Bad message size! got %u, max = %u",
 				msglen, _9p_conn.msize);
 			goto end;
 		}
 
+		/* Only as large as the message */
+		_9pmsg = io_buf_alloc(msglen);
+		memcpy(_9pmsg, hdr, _9P_HDR_SIZE);
+
 		LogFullDebug(COMPONENT_9P,
 			     "Received 9P/TCP message of size %u from client %s on socket %lu",
 			     msglen, strcaller, tcp_sock);
@@ -263,28 +337,7 @@ void *_9p_socket_thread(void *Arg)
 				goto badmsg;
 		}	/* while */
 
-		server_stats_transport_done(_9p_conn.client,
-					    total_readlen, 1, 0,
-					    0, 0, 0);
-
-		/* Message is good. */
-		req = pool_alloc(request_pool);
-
-		req->rtype = _9P_REQUEST;
-		req->r_u._9p._9pmsg = _9pmsg;
-		req->r_u._9p.pconn = &_9p_conn;
-
-		/* Add this request to the request list,
-		 * should it be flushed later. */
-		tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE +
-				_9P_TYPE_SIZE);
-		_9p_AddFlushHook(&req->r_u._9p, tag,
-				 sequence++);
-		LogFullDebug(COMPONENT_9P,
-			     "Request tag is %d\n", tag);
-
-		/* Message was OK push it */
-		DispatchWork9P(req);
+		_9p_tcp_dispatch(&_9p_conn, _9pmsg, sequence++);
 
 		/* Not our buffer anymore */
 		_9pmsg = NULL;
@@ -321,21 +374,337 @@ end:
 	/* Free buffer if we encountered an error
 	 * before we could give it to a worker */
 	if (_9pmsg)
-		gsh_free(_9pmsg);
+		io_buf_free(_9pmsg);
 
 	while (atomic_fetch_uint32_t(&_9p_conn.refcount)) {
 		LogEvent(COMPONENT_9P, "Waiting for workers to release pconn");
 		sleep(1);
 	}
 
-	_9p_cleanup_fids(&_9p_conn);
-
-	if (_9p_conn.client != NULL)
-		put_gsh_client(_9p_conn.client);
+	_9p_tcp_conn_release(&_9p_conn);
 
 	pthread_exit(NULL);
 }				/* _9p_socket_thread */
 
+#ifdef LINUX
+/**
+ * @defgroup _9p_io 9P/TCP I/O threads
+ *
+ * With _9P_TCP_IO_Threads set, the connections are shared out between
+ * that many threads, each waiting on its own epoll set.  A thread reads
+ * whatever arrived on its ready sockets without blocking, reassembles
+ * the messages, and hands the complete ones to the workers as the
+ * socket threads do.  Replies are still sent by the workers, the
+ * I/O thread only releases those sent with MSG_ZEROCOPY once the
+ * kernel reports on the error queue that it is done with them.
+ *
+ * A closed connection is kept until the workers release it, its socket
+ * is only shut down meanwhile so that its descriptor is not reused
+ * under them.
+ *
+ * @{
+ */
+
+/** Messages read from a socket before the others get their turn */
+#define _9P_IO_BATCH 16
+
+/** Events taken from the epoll set at once */
+#define _9P_IO_EVENTS 64
+
+/**
+ * @brief A connection served by an I/O thread
+ */
+struct _9p_tcp_sock {
+	struct _9p_conn conn;
+	struct glist_head closing;	/*< On the closing list of its thread */
+	char *msg;			/*< Message being reassembled */
+	uint32_t msglen;		/*< Its length, once the header is in */
+	uint32_t readlen;		/*< Bytes of it read so far */
+	char hdr[_9P_HDR_SIZE];		/*< Header read before msg exists */
+	unsigned long sequence;
+	char strcaller[INET6_ADDRSTRLEN];
+};
+
+struct _9p_io_thread {
+	int epfd;
+	pthread_t thrid;
+	struct glist_head closing;	/*< Waiting for the workers */
+};
+
+static struct _9p_io_thread *_9p_io_threads;
+static uint32_t _9p_io_next;
+
+/**
+ * @brief Read what arrived on a socket
+ *
+ * @param[in] sock The socket
+ *
+ * @return false if the connection is to be closed.
+ */
+static bool _9p_tcp_sock_read(struct _9p_tcp_sock *sock)
+{
+	long int fd = sock->conn.trans_data.sockfd;
+	ssize_t readlen;
+	int batch = 0;
+
+	while (batch < _9P_IO_BATCH) {
+		if (sock->msg == NULL) {
+			/* An incoming 9P request: the msg has a 4 bytes header
+			   showing the size of the msg including the header */
+			readlen = recv(fd, sock->hdr + sock->readlen,
+				       _9P_HDR_SIZE - sock->readlen,
+				       MSG_DONTWAIT);
+			if (readlen <= 0)
+				goto out;
+
+			sock->readlen += readlen;
+			if (sock->readlen < _9P_HDR_SIZE)
+				continue;
+
+			memcpy(&sock->msglen, sock->hdr, _9P_HDR_SIZE);
+			if (sock->msglen < _9P_STD_HDR_SIZE ||
+			    sock->msglen > sock->conn.msize) {
+				LogCrit(COMPONENT_9P,
+					"Bad message size from client %s on socket %ld! got %u, max = %u",
+					sock->strcaller, fd, sock->msglen,
+					sock->conn.msize);
+				return false;
+			}
+
+			/* Only as large as the message */
+			sock->msg = io_buf_alloc(sock->msglen);
+			memcpy(sock->msg, sock->hdr, _9P_HDR_SIZE);
+		}
+
+		readlen = recv(fd, sock->msg + sock->readlen,
+			       sock->msglen - sock->readlen, MSG_DONTWAIT);
+		if (readlen <= 0)
+			goto out;
+
+		sock->readlen += readlen;
+		if (sock->readlen < sock->msglen)
+			continue;
+
+		LogFullDebug(COMPONENT_9P,
+			     "Received 9P/TCP message of size %u from client %s on socket %ld",
+			     sock->msglen, sock->strcaller, fd);
+
+		_9p_tcp_dispatch(&sock->conn, sock->msg, sock->sequence++);
+
+		/* Not our buffer anymore */
+		sock->msg = NULL;
+		sock->readlen = 0;
+		batch++;
+	}
+
+	return true;
+
+out:
+	if (readlen < 0 &&
+	    (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return true;
+
+	if (readlen == 0)
+		LogEvent(COMPONENT_9P,
+			 "Client %s on socket %ld has shut down and closed, total read = %u",
+			 sock->strcaller, fd, sock->readlen);
+	else
+		LogEvent(COMPONENT_9P,
+			 "Read error client %s on socket %ld errno=%d, total read = %u",
+			 sock->strcaller, fd, errno, sock->readlen);
+
+	return false;
+}
+
+/**
+ * @brief Stop serving a connection
+ *
+ * @param[in] io   Its I/O thread
+ * @param[in] sock The connection
+ */
+static void _9p_tcp_sock_close(struct _9p_io_thread *io,
+			       struct _9p_tcp_sock *sock)
+{
+	long int fd = sock->conn.trans_data.sockfd;
+
+	LogEvent(COMPONENT_9P, "Closing connection on socket %ld", fd);
+
+	(void)epoll_ctl(io->epfd, EPOLL_CTL_DEL, fd, NULL);
+	(void)shutdown(fd, SHUT_RDWR);
+
+	/* Free buffer if we encountered an error
+	 * before we could give it to a worker */
+	if (sock->msg != NULL)
+		io_buf_free(sock->msg);
+	sock->msg = NULL;
+
+	glist_add_tail(&io->closing, &sock->closing);
+}
+
+/**
+ * @brief Free the closed connections the workers released
+ *
+ * @param[in] io The I/O thread
+ */
+static void _9p_io_reap(struct _9p_io_thread *io)
+{
+	struct glist_head *glist, *glistn;
+	struct _9p_tcp_sock *sock;
+
+	glist_for_each_safe(glist, glistn, &io->closing) {
+		sock = glist_entry(glist, struct _9p_tcp_sock, closing);
+
+		if (atomic_fetch_uint32_t(&sock->conn.refcount) != 0)
+			continue;
+
+		glist_del(&sock->closing);
+		close(sock->conn.trans_data.sockfd);
+		_9p_tcp_conn_release(&sock->conn);
+		gsh_free(sock);
+	}
+}
+
+/**
+ * @brief Main loop of an I/O thread
+ *
+ * @param[in] arg Its struct _9p_io_thread
+ *
+ * @return NULL, never.
+ */
+static void *_9p_io_loop(void *arg)
+{
+	struct _9p_io_thread *io = arg;
+	struct epoll_event events[_9P_IO_EVENTS];
+	struct _9p_tcp_sock *sock;
+	char my_name[MAXNAMLEN + 1];
+	uint32_t ev;
+	bool ok;
+	int n, i;
+
+	snprintf(my_name, MAXNAMLEN, "9p_io#%ld",
+		 (long int)(io - _9p_io_threads));
+	SetNameFunction(my_name);
+
+	for (;;) {
+		/* Poll the closed connections until they are released */
+		n = epoll_wait(io->epfd, events, _9P_IO_EVENTS,
+			       glist_empty(&io->closing) ? -1 : 1000);
+		if (n == -1) {
+			if (errno != EINTR)
+				LogCrit(COMPONENT_9P,
+					"Got error %d (%s) while waiting on 9P sockets",
+					errno, strerror(errno));
+			continue;
+		}
+
+		for (i = 0; i < n; i++) {
+			sock = events[i].data.ptr;
+			ev = events[i].events;
+
+			/* Zerocopy completions are reported as errors */
+			ok = !(ev & EPOLLERR) ||
+			     _9p_tcp_zerocopy_done(&sock->conn);
+
+			/* Read what is left before noticing a hang up */
+			if (ok && (ev & EPOLLIN))
+				ok = _9p_tcp_sock_read(sock);
+			else if (ev & (EPOLLHUP | EPOLLRDHUP))
+				ok = false;
+
+			if (!ok)
+				_9p_tcp_sock_close(io, sock);
+		}
+
+		if (!glist_empty(&io->closing))
+			_9p_io_reap(io);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start the I/O threads
+ *
+ * @param[in] attr_thr Attributes of the threads
+ */
+static void _9p_io_init(pthread_attr_t *attr_thr)
+{
+	struct _9p_io_thread *io;
+	uint32_t i;
+	int rc;
+
+	_9p_io_threads = gsh_calloc(_9p_param._9p_tcp_io_threads,
+				    sizeof(*_9p_io_threads));
+
+	for (i = 0; i < _9p_param._9p_tcp_io_threads; i++) {
+		io = &_9p_io_threads[i];
+		glist_init(&io->closing);
+
+		io->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (io->epfd == -1)
+			LogFatal(COMPONENT_9P_DISPATCH,
+				 "Could not create 9P epoll set, error = %d (%s)",
+				 errno, strerror(errno));
+
+		rc = pthread_create(&io->thrid, attr_thr, _9p_io_loop, io);
+		if (rc != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create 9p I/O thread, error = %d (%s)",
+				 rc, strerror(rc));
+	}
+
+	LogEvent(COMPONENT_9P_DISPATCH, "%u 9P I/O threads started",
+		 _9p_param._9p_tcp_io_threads);
+}
+
+/**
+ * @brief Give a new connection to an I/O thread
+ *
+ * @param[in] tcp_sock The accepted socket
+ */
+static void _9p_io_add(long int tcp_sock)
+{
+	struct _9p_io_thread *io;
+	struct _9p_tcp_sock *sock;
+	struct epoll_event ev;
+
+	io = &_9p_io_threads[_9p_io_next++ % _9p_param._9p_tcp_io_threads];
+
+	sock = gsh_calloc(1, sizeof(*sock));
+	_9p_tcp_conn_init(&sock->conn, tcp_sock, sock->strcaller);
+	glist_init(&sock->closing);
+
+#ifdef _9P_TCP_ZEROCOPY
+	if (_9p_param._9p_tcp_zerocopy_threshold != 0) {
+		int one = 1;
+
+		if (setsockopt(tcp_sock, SOL_SOCKET, SO_ZEROCOPY, &one,
+			       sizeof(one)) == 0)
+			sock->conn.zerocopy = true;
+		else
+			LogInfo(COMPONENT_9P_DISPATCH,
+				"No zerocopy on 9p socket #%ld, error = %d (%s)",
+				tcp_sock, errno, strerror(errno));
+	}
+#endif
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.ptr = sock;
+
+	if (epoll_ctl(io->epfd, EPOLL_CTL_ADD, tcp_sock, &ev) == -1) {
+		LogCrit(COMPONENT_9P_DISPATCH,
+			"Could not add 9p socket #%ld to epoll set, error = %d (%s)",
+			tcp_sock, errno, strerror(errno));
+		close(tcp_sock);
+		_9p_tcp_conn_release(&sock->conn);
+		gsh_free(sock);
+	}
+}
+
+/** @} */
+#endif /* LINUX */
+
 /**
  * _9p_create_socket_V4 : create the socket and bind for 9P using
  * the available V4 interfaces on the host. This is not the default
@@ -576,6 +945,11 @@ void *_9p_dispatcher_thread(void *Arg)
 		LogDebug(COMPONENT_9P_DISPATCH,
 			 "can't set pthread's join state");
 
+#ifdef LINUX
+	if (_9p_param._9p_tcp_io_threads != 0)
+		_9p_io_init(&attr_thr);
+#endif
+
 	LogEvent(COMPONENT_9P_DISPATCH, "9P dispatcher started");
 
 	while (true) {
@@ -587,6 +961,13 @@ void *_9p_dispatcher_thread(void *Arg)
 			continue;
 		}
 
+#ifdef LINUX
+		if (_9p_io_threads != NULL) {
+			_9p_io_add(newsock);
+			continue;
+		}
+#endif
+
 		/* Starting the thread dedicated to signal handling */
 		rc = pthread_create(&tcp_thrid, &attr_thr,
 				    _9p_socket_thread, (void *)newsock);
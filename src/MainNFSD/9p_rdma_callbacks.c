@@ -115,6 +115,47 @@ void _9p_rdma_callback_disconnect(msk_trans_t *trans)
 	_9p_rdma_cleanup_conn(trans);
 }
 
+/**
+ * @brief Give an output buffer back to the queue
+ */
+static void _9p_rdma_put_outbuf(struct _9p_rdma_priv *priv,
+				msk_data_t *dataout)
+{
+	PTHREAD_MUTEX_lock(&priv->outqueue->lock);
+	dataout->next = priv->outqueue->data;
+	priv->outqueue->data = dataout;
+	pthread_cond_signal(&priv->outqueue->cond);
+	PTHREAD_MUTEX_unlock(&priv->outqueue->lock);
+}
+
+/**
+ * @brief Process a message copied out of its receive buffer, and send
+ * the reply
+ *
+ * The message was checked by _9p_rdma_callback_recv.
+ */
+static void _9p_rdma_process_buffer(struct _9p_request_data *req9p,
+				    msk_trans_t *trans,
+				    struct _9p_rdma_priv *priv,
+				    msk_data_t *dataout)
+{
+	int rc;
+
+	rc = _9p_process_buffer(req9p, dataout->data, &dataout->size);
+	if (rc != 1) {
+		LogMajor(COMPONENT_9P,
+			 "Could not process 9P buffer on trans %p", trans);
+	} else if (msk_post_send(trans, dataout, _9p_rdma_callback_send,
+				 _9p_rdma_callback_send_err, NULL) != 0) {
+		LogMajor(COMPONENT_9P,
+			 "Could not send buffer on trans %p", trans);
+		rc = -1;
+	}
+
+	if (rc != 1)
+		_9p_rdma_put_outbuf(priv, dataout);
+}
+
 void _9p_rdma_process_request(struct _9p_request_data *req9p)
 {
 	uint32_t msglen;
@@ -136,9 +177,19 @@ void _9p_rdma_process_request(struct _9p_request_data *req9p)
 	dataout->next = NULL;
 	PTHREAD_MUTEX_unlock(&priv->outqueue->lock);
 
+	/* The reply is built in place in the registered send buffer, RREAD
+	 * data included, see _9p_read */
 	dataout->size = 0;
 	dataout->mr = priv->pernic->outmr;
 
+	/* Small messages were copied out of their receive buffer, which
+	 * is back on the receive queue already */
+	if (req9p->data == NULL) {
+		_9p_rdma_process_buffer(req9p, trans, priv, dataout);
+		_9p_DiscardFlushHook(req9p);
+		return;
+	}
+
 	/* Use buffer received via RDMA as a 9P message */
 	req9p->_9pmsg = req9p->data->data;
 	msglen = *(uint32_t *)req9p->_9pmsg;
@@ -150,6 +201,7 @@ void _9p_rdma_process_request(struct _9p_request_data *req9p)
 		/* send a rerror ? */
 		msk_post_recv(trans, req9p->data, _9p_rdma_callback_recv,
 			      _9p_rdma_callback_recv_err, NULL);
+		_9p_rdma_put_outbuf(priv, dataout);
 	} else {
 		LogFullDebug(COMPONENT_9P,
 			     "Received 9P/RDMA message of size %u",
@@ -181,11 +233,7 @@ void _9p_rdma_process_request(struct _9p_request_data *req9p)
 				 req9p->pconn->trans_data.rdma_trans);
 			/* Give the buffer back right away
 			 * since no buffer is being sent */
-			PTHREAD_MUTEX_lock(&priv->outqueue->lock);
-			dataout->next = priv->outqueue->data;
-			priv->outqueue->data = dataout;
-			pthread_cond_signal(&priv->outqueue->cond);
-			PTHREAD_MUTEX_unlock(&priv->outqueue->lock);
+			_9p_rdma_put_outbuf(priv, dataout);
 		}
 	}
 	_9p_DiscardFlushHook(req9p);
@@ -196,6 +244,7 @@ void _9p_rdma_callback_recv(msk_trans_t *trans, msk_data_t *data, void *arg)
 	request_data_t *req = NULL;
 	u16 tag = 0;
 	char *_9pmsg = NULL;
+	uint32_t size = data->size;
 
 	req = pool_alloc(request_pool);
 
@@ -204,14 +253,32 @@ void _9p_rdma_callback_recv(msk_trans_t *trans, msk_data_t *data, void *arg)
 	req->r_u._9p.pconn = _9p_rdma_priv_of(trans)->pconn;
 	req->r_u._9p.data = data;
 
+	/* A small well formed message is copied so that its receive buffer
+	 * goes back to the shared receive queue now: the requests in flight
+	 * are not bounded by _9P_RDMA_Inpool_size.  The others keep their
+	 * buffer until processed.  TWRITE is never copied, the FSAL writes
+	 * its data straight from the registered receive buffer. */
+	if (size >= _9P_STD_HDR_SIZE &&
+	    size <= _9p_param._9p_rdma_copy_threshold &&
+	    *(uint32_t *) data->data == size &&
+	    *(u8 *) (data->data + _9P_HDR_SIZE) != _9P_TWRITE) {
+		_9pmsg = gsh_malloc(size);
+		memcpy(_9pmsg, data->data, size);
+		req->r_u._9p._9pmsg = _9pmsg;
+		req->r_u._9p.data = NULL;
+		msk_post_recv(trans, data, _9p_rdma_callback_recv,
+			      _9p_rdma_callback_recv_err, NULL);
+	} else {
+		_9pmsg = data->data;
+	}
+
 	/* Add this request to the request list, should it be flushed later. */
-	_9pmsg = data->data;
 	tag = *(u16 *) (_9pmsg + _9P_HDR_SIZE + _9P_TYPE_SIZE);
 	_9p_AddFlushHook(&req->r_u._9p, tag, req->r_u._9p.pconn->sequence++);
 
 	DispatchWork9P(req);
 	server_stats_transport_done(_9p_rdma_priv_of(trans)->pconn->client,
-				    data->size, 1, 0,
+				    size, 1, 0,
 				    0, 0, 0);
 
 }				/* _9p_rdma_callback_recv */
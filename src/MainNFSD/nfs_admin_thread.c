@@ -42,6 +42,8 @@
 #include "export_mgr.h"
 #include "fsal.h"
 #include "netgroup_cache.h"
+#include "stats_shm.h"
+#include "nfs_proto_functions.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
 #endif
@@ -176,6 +178,101 @@ static struct gsh_dbus_method method_grace_period = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Dbus method starting a grace period on some exports only
+ *
+ * @param[in]  args  Export id, whether all the exports of its
+ *                   filesystem, and event:IP-address as for grace, or
+ *                   an empty string
+ * @param[out] reply Status
+ */
+
+static bool admin_dbus_grace_export(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	char *errormsg = "Started grace period";
+	bool success = true;
+	DBusMessageIter iter;
+	nfs_grace_start_t gsp = { .nodeid = -1, .event = EVENT_TAKE_IP };
+	struct gsh_export *export;
+	dbus_uint16_t export_id;
+	dbus_bool_t whole_fs;
+	char *input = NULL;
+	char *ip;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT16) {
+		errormsg =
+		    "Grace export takes 3 arguments: export id, whole filesystem, event:IP-address.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &export_id);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_BOOLEAN) {
+		errormsg = "Grace export arg 2 not a boolean.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &whole_fs);
+
+	if (!dbus_message_iter_next(args) ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "Grace export arg 3 not a string.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &input);
+
+	export = get_gsh_export(export_id);
+	if (export == NULL) {
+		errormsg = "No such export";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s %d", errormsg, export_id);
+		goto out;
+	}
+
+	ip = index(input, ':');
+	if (ip != NULL) {
+		gsp.event = atoi(input);
+		gsp.ipaddr = ip + 1;
+		if (gsp.event == EVENT_TAKE_NODEID)
+			gsp.nodeid = atoi(gsp.ipaddr);
+	} else {
+		gsp.ipaddr = input;
+	}
+
+	nfs4_start_export_grace(export, whole_fs,
+				input[0] != '\0' ? &gsp : NULL);
+	put_gsh_export(export);
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_grace_export = {
+	.name = "grace_export",
+	.method = admin_dbus_grace_export,
+	.args = {{
+		  .name = "export_id",
+		  .type = "q",
+		  .direction = "in"},
+		 {
+		  .name = "whole_fs",
+		  .type = "b",
+		  .direction = "in"},
+		 IPADDR_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 /**
  * @brief Dbus method for shutting down Ganesha
  *
@@ -285,12 +382,65 @@ static struct gsh_dbus_method method_purge_netgroups = {
 		 END_ARG_LIST}
 };
 
+/**
+ * @brief Dbus method for dumping the trace rings
+ *
+ * @param[in]  args  File to dump to
+ * @param[out] reply Status
+ */
+static bool admin_dbus_trace_dump(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	char *errormsg = "Trace dumped";
+	bool success = true;
+	DBusMessageIter iter;
+	char *path = NULL;
+	int rc;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args == NULL ||
+	    dbus_message_iter_get_arg_type(args) != DBUS_TYPE_STRING) {
+		errormsg = "Trace dump takes a file path.";
+		success = false;
+		LogWarn(COMPONENT_DBUS, "%s", errormsg);
+		goto out;
+	}
+	dbus_message_iter_get_basic(args, &path);
+
+	rc = gsh_trace_dump(path);
+	if (rc != 0) {
+		errormsg = rc == ENOTSUP ? "Tracing is off" : strerror(rc);
+		success = false;
+		LogWarn(COMPONENT_DBUS, "Trace dump to %s failed: %s",
+			path, errormsg);
+	}
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return success;
+}
+
+static struct gsh_dbus_method method_trace_dump = {
+	.name = "trace_dump",
+	.method = admin_dbus_trace_dump,
+	.args = {
+		 {.name = "path",
+		  .type = "s",
+		  .direction = "in",
+		 },
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *admin_methods[] = {
 	&method_shutdown,
 	&method_grace_period,
+	&method_grace_export,
 	&method_get_grace,
 	&method_purge_gids,
 	&method_purge_netgroups,
+	&method_trace_dump,
 	NULL
 };
 
@@ -301,11 +451,49 @@ static struct gsh_dbus_signal heartbeat_signal = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_signal grace_lifted_signal = {
+	.name = GRACE_LIFTED_NAME,
+	.signal = NULL,
+	.args = {GRACE_LIFTED_ARG,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_signal *admin_signals[] = {
 	&heartbeat_signal,
+	&grace_lifted_signal,
 	NULL
 };
 
+/**
+ * @brief Broadcast that grace was lifted before its end
+ *
+ * Queued once by nfs4_reclaim_complete, run by the dbus thread.
+ *
+ * @param[in] arg Number of clients that reclaimed, freed here
+ */
+int dbus_grace_lifted_cb(void *arg)
+{
+	dbus_uint32_t *clients = arg;
+	int err;
+
+	err = gsh_dbus_broadcast(DBUS_PATH GRACE_LIFTED_NAME,
+				 DBUS_ADMIN_IFACE,
+				 GRACE_LIFTED_NAME,
+				 DBUS_TYPE_UINT32,
+				 clients,
+				 DBUS_TYPE_INVALID);
+	gsh_free(clients);
+
+	if (err) {
+		LogCrit(COMPONENT_DBUS,
+			"grace lifted broadcast failed. err:%d",
+			err);
+		return BCAST_STATUS_WARN;
+	}
+
+	return BCAST_STATUS_OK;
+}
+
 static struct gsh_dbus_interface admin_interface = {
 	.name = DBUS_ADMIN_IFACE,
 	.props = NULL,
@@ -353,9 +541,12 @@ static void do_shutdown(void)
 {
 	int rc = 0;
 	bool disorderly = false;
+	uint32_t i;
 
 	LogEvent(COMPONENT_MAIN, "NFS EXIT: stopping NFS service");
 
+	nfs_handoff_shutdown();
+
 	LogEvent(COMPONENT_MAIN, "Stopping delayed executor.");
 	delayed_shutdown();
 	LogEvent(COMPONENT_MAIN, "Delayed executor stopped.");
@@ -372,6 +563,16 @@ static void do_shutdown(void)
 			 "State asynchronous request system shut down.");
 	}
 
+	LogEvent(COMPONENT_MAIN, "Stopping asynchronous copy threads");
+	rc = nfs4_copy_pkgshutdown();
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Error shutting down asynchronous copies: %d", rc);
+		disorderly = true;
+	} else {
+		LogEvent(COMPONENT_THREAD, "Asynchronous copies shut down.");
+	}
+
 	LogEvent(COMPONENT_MAIN, "Stopping request listener threads.");
 	nfs_rpc_dispatch_stop();
 
@@ -396,6 +597,20 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "Request threads shut down.");
 	}
 
+	for (i = 0; i < n_decoder_fridges; i++) {
+		rc = fridgethr_sync_command(decoder_fridges[i],
+					    fridgethr_comm_stop, 120);
+		if (rc == ETIMEDOUT) {
+			fridgethr_cancel(decoder_fridges[i]);
+			disorderly = true;
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_THREAD,
+				 "Failed to shut down decoder thread fridge %u: %d!",
+				 i, rc);
+			disorderly = true;
+		}
+	}
+
 	LogEvent(COMPONENT_MAIN, "Stopping worker threads");
 
 	rc = worker_shutdown();
@@ -429,6 +644,9 @@ static void do_shutdown(void)
 		LogEvent(COMPONENT_THREAD, "Reaper thread shut down.");
 	}
 
+	ng_cache_shutdown();
+	stats_shm_shutdown();
+
 	LogEvent(COMPONENT_MAIN, "Removing all exports.");
 	remove_all_exports();
 
@@ -448,6 +666,8 @@ static void do_shutdown(void)
 	}
 
 	unlink(pidfile_path);
+
+	flush_log_facilities();
 }
 
 void *admin_thread(void *UnusedArg)
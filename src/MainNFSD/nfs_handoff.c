@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs_handoff.c
+ * @brief   Handing the service over to a new server process
+ *
+ * With Handoff_Socket set, a running server listens on that unix
+ * socket.  A server starting with the same setting connects to it
+ * before binding its ports; the running one passes its bound UDP and
+ * TCP sockets (SCM_RIGHTS), with the connections waiting in their
+ * listen queues, then the names of its live NFSv4 clients, and shuts
+ * down.  The new server serves on the same sockets, keeps the rpcbind
+ * registrations, and its grace period waits for those clients only.
+ *
+ * The stream is a header, with the tags of the sockets, then records
+ * of a type and length, up to an end record.  Records of types a
+ * server doesn't know are skipped, so newer servers may add some.
+ *
+ * Opens and locks are not handed over: they live in the FSAL objects
+ * and files of the old process, and go with it; clients reclaim them.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "log.h"
+#include "abstract_atomic.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+
+#define NFS_pcp nfs_param.core_param
+
+#define HANDOFF_MAGIC 0x4753484f	/* "GSHO" */
+#define HANDOFF_VERSION 1
+#define HANDOFF_MAX_FDS (2 * P_COUNT)
+/** Seconds the new server waits for each part of the stream */
+#define HANDOFF_TIMEOUT 30
+
+struct handoff_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t nfds;
+	uint8_t tags[HANDOFF_MAX_FDS];	/*< As from nfs_rpc_bound_sockets */
+};
+
+enum handoff_rec_type {
+	HANDOFF_REC_END = 0,
+	HANDOFF_REC_V4_CLIENT = 1,	/*< Recovery name of a client */
+};
+
+struct handoff_rec {
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t len;		/*< Of the data following */
+};
+
+static int handoff_fd = -1;	/*< Listening */
+static ino_t handoff_ino;
+static uint32_t handed_off;
+
+/* Clients handed over, until the recovery list is loaded */
+static char **handoff_names;
+static uint32_t handoff_count;
+static bool handoff_received;
+
+static int handoff_write(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int handoff_read(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void handoff_set_addr(struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strncpy(addr->sun_path, NFS_pcp.handoff_socket,
+		sizeof(addr->sun_path) - 1);
+}
+
+/* Send the sockets, then the clients */
+static int handoff_send(int fd)
+{
+	char cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+	struct handoff_hdr hdr;
+	struct handoff_rec rec;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int fds[HANDOFF_MAX_FDS];
+	char **names;
+	uint32_t count, i;
+	int rc = 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = HANDOFF_MAGIC;
+	hdr.version = HANDOFF_VERSION;
+	hdr.nfds = nfs_rpc_bound_sockets(fds, hdr.tags, HANDOFF_MAX_FDS);
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (hdr.nfds > 0) {
+		memset(cbuf, 0, sizeof(cbuf));
+		msg.msg_control = cbuf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * hdr.nfds);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * hdr.nfds);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * hdr.nfds);
+	}
+
+	if (sendmsg(fd, &msg, MSG_NOSIGNAL) != (ssize_t) sizeof(hdr))
+		return -1;
+
+	names = nfs4_recovery_live_clids(&count);
+	for (i = 0; i < count; i++) {
+		memset(&rec, 0, sizeof(rec));
+		rec.type = HANDOFF_REC_V4_CLIENT;
+		rec.len = strlen(names[i]);
+		if (rc == 0 &&
+		    (handoff_write(fd, &rec, sizeof(rec)) != 0 ||
+		     handoff_write(fd, names[i], rec.len) != 0))
+			rc = -1;
+		gsh_free(names[i]);
+	}
+	gsh_free(names);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = HANDOFF_REC_END;
+	if (rc == 0)
+		rc = handoff_write(fd, &rec, sizeof(rec));
+
+	if (rc == 0)
+		LogEvent(COMPONENT_INIT,
+			 "Handed %"PRIu16" sockets and %"PRIu32
+			 " clients to the next server",
+			 hdr.nfds, count);
+
+	return rc;
+}
+
+/* Only root, or our own user, may take the service over */
+static bool handoff_peer_ok(int fd)
+{
+	struct ucred cr;
+	socklen_t len = sizeof(cr);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cr, &len) != 0)
+		return false;
+
+	if (cr.uid != 0 && cr.uid != geteuid()) {
+		LogWarn(COMPONENT_INIT,
+			"Refusing handoff to pid %d of uid %u",
+			(int) cr.pid, (unsigned int) cr.uid);
+		return false;
+	}
+
+	return true;
+}
+
+static void *handoff_thread(void *arg)
+{
+	int fd;
+
+	SetNameFunction("handoff");
+
+	for (;;) {
+		fd = accept4(handoff_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			/* Closed at shutdown */
+			break;
+		}
+
+		if (!handoff_peer_ok(fd)) {
+			close(fd);
+			continue;
+		}
+
+		if (handoff_send(fd) != 0) {
+			LogCrit(COMPONENT_INIT,
+				"Handoff to the next server failed: %s",
+				strerror(errno));
+			close(fd);
+			continue;
+		}
+
+		atomic_store_uint32_t(&handed_off, 1);
+		close(fd);
+		admin_halt();
+		break;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Wait for the server that will replace us
+ *
+ * Called once serving.  The path is taken from the server we replaced,
+ * if any.
+ */
+void nfs_handoff_listen(void)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	pthread_attr_t attr;
+	pthread_t thrid;
+	int fd;
+
+	if (NFS_pcp.handoff_socket == NULL)
+		return;
+
+	handoff_set_addr(&addr);
+	(void) unlink(addr.sun_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 ||
+	    bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+	    chmod(addr.sun_path, 0600) != 0 ||
+	    stat(addr.sun_path, &st) != 0 ||
+	    listen(fd, 1) != 0) {
+		LogCrit(COMPONENT_INIT, "Cannot listen on %s for handoff: %s",
+			addr.sun_path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return;
+	}
+
+	handoff_fd = fd;
+	handoff_ino = st.st_ino;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thrid, &attr, handoff_thread, NULL) != 0) {
+		LogCrit(COMPONENT_INIT, "Cannot start the handoff thread");
+		nfs_handoff_shutdown();
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/**
+ * @brief Stop listening for a handoff
+ *
+ * The path is left to the next server when we handed over to it.
+ */
+void nfs_handoff_shutdown(void)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (handoff_fd < 0)
+		return;
+
+	/* Wakes the handoff thread */
+	(void) shutdown(handoff_fd, SHUT_RDWR);
+	close(handoff_fd);
+	handoff_fd = -1;
+
+	handoff_set_addr(&addr);
+	if (!nfs_handoff_done() && stat(addr.sun_path, &st) == 0 &&
+	    st.st_ino == handoff_ino)
+		(void) unlink(addr.sun_path);
+}
+
+/**
+ * @brief Whether our sockets now belong to the next server
+ */
+bool nfs_handoff_done(void)
+{
+	return atomic_fetch_uint32_t(&handed_off) != 0;
+}
+
+/* Read the client records, up to the end */
+static int handoff_recv_records(int fd)
+{
+	struct handoff_rec rec;
+	uint32_t room = 0;
+	char *data;
+
+	for (;;) {
+		if (handoff_read(fd, &rec, sizeof(rec)) != 0)
+			return -1;
+		if (rec.type == HANDOFF_REC_END)
+			return 0;
+		if (rec.len >= PATH_MAX)
+			return -1;
+
+		data = gsh_malloc(rec.len + 1);
+		if (handoff_read(fd, data, rec.len) != 0) {
+			gsh_free(data);
+			return -1;
+		}
+		data[rec.len] = '\0';
+
+		if (rec.type != HANDOFF_REC_V4_CLIENT) {
+			/* From a newer server */
+			gsh_free(data);
+			continue;
+		}
+
+		if (handoff_count == room) {
+			room = room ? room * 2 : 64;
+			handoff_names = gsh_realloc(handoff_names,
+						    room * sizeof(char *));
+		}
+		handoff_names[handoff_count++] = data;
+	}
+}
+
+/**
+ * @brief Take over from a running server
+ *
+ * Called between Allocate_sockets and Bind_sockets.  Does nothing if
+ * no server listens on Handoff_Socket.
+ */
+void nfs_handoff_receive(void)
+{
+	char cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+	struct timeval tv = { .tv_sec = HANDOFF_TIMEOUT };
+	struct sockaddr_un addr;
+	struct handoff_hdr hdr;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int fds[HANDOFF_MAX_FDS];
+	int nfds = 0, adopted = 0;
+	ssize_t n;
+	int fd, i;
+
+	if (NFS_pcp.handoff_socket == NULL)
+		return;
+
+	handoff_set_addr(&addr);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return;
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		LogInfo(COMPONENT_INIT, "No server to take over on %s",
+			addr.sun_path);
+		close(fd);
+		return;
+	}
+
+	(void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	do {
+		n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	} while (n < 0 && errno == EINTR);
+
+	for (cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL; cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET ||
+		    cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+	}
+
+	if (n > 0 && (size_t) n < sizeof(hdr) &&
+	    handoff_read(fd, (char *) &hdr + n, sizeof(hdr) - n) == 0)
+		n = sizeof(hdr);
+
+	if (n != (ssize_t) sizeof(hdr) || hdr.magic != HANDOFF_MAGIC ||
+	    hdr.nfds != nfds || (msg.msg_flags & MSG_CTRUNC)) {
+		LogCrit(COMPONENT_INIT, "Bad handoff from the running server");
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+		close(fd);
+		return;
+	}
+
+	for (i = 0; i < nfds; i++)
+		if (nfs_rpc_adopt_socket(hdr.tags[i], fds[i]) == 0)
+			adopted++;
+
+	if (handoff_recv_records(fd) == 0) {
+		handoff_received = true;
+	} else {
+		LogCrit(COMPONENT_INIT,
+			"Client list of the running server cut short, using the recovery records");
+		for (i = 0; i < handoff_count; i++)
+			gsh_free(handoff_names[i]);
+		gsh_free(handoff_names);
+		handoff_names = NULL;
+		handoff_count = 0;
+	}
+
+	close(fd);
+
+	LogEvent(COMPONENT_INIT,
+		 "Took over %d of %d sockets and %"PRIu32
+		 " clients from the server of version %"PRIu16,
+		 adopted, nfds, handoff_count, hdr.version);
+}
+
+/**
+ * @brief Narrow the reclaim list to the clients handed over
+ *
+ * Called once the recovery records are loaded.
+ */
+void nfs_handoff_clids(void)
+{
+	uint32_t i;
+
+	if (!handoff_received)
+		return;
+
+	nfs4_recovery_handoff(handoff_names, handoff_count);
+
+	for (i = 0; i < handoff_count; i++)
+		gsh_free(handoff_names[i]);
+	gsh_free(handoff_names);
+	handoff_names = NULL;
+	handoff_count = 0;
+	handoff_received = false;
+}
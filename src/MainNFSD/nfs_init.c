@@ -71,6 +71,10 @@
 #include "netgroup_cache.h"
 #include "pnfs_utils.h"
 #include "mdcache.h"
+#include "io_bufpool.h"
+#include "server_stats.h"
+#include "stats_shm.h"
+#include "err_inject.h"
 
 
 /* global information exported to all layers (as extern vars) */
@@ -108,6 +112,36 @@ char *config_path = GANESHA_CONFIG_PATH;
 
 char *pidfile_path = GANESHA_PIDFILE_PATH;
 
+/**
+ * @brief Milliseconds since ServerBootTime
+ */
+uint64_t nfs_uptime_ms(void)
+{
+	struct timespec ts;
+
+	now(&ts);
+	return timespec_diff(&ServerBootTime, &ts) / NS_PER_MSEC;
+}
+
+/**
+ * @brief Log the time taken by a startup phase
+ *
+ * Each call times the phase since the previous one, so that the
+ * startup of a large configuration can be broken down from the log.
+ *
+ * @param[in] phase  Name of the phase just done
+ */
+void nfs_startup_phase(const char *phase)
+{
+	static uint64_t last_ms;
+	uint64_t ms = nfs_uptime_ms();
+
+	LogEvent(COMPONENT_INIT,
+		 "Startup phase %s took %"PRIu64" ms, %"PRIu64" ms since start",
+		 phase, ms - last_ms, ms);
+	last_ms = ms;
+}
+
 /**
  * @brief Reread the configuration file to accomplish update of options.
  *
@@ -197,6 +231,7 @@ static void *sigmgr_thread(void *UnusedArg)
 		if (signal_caught == SIGHUP) {
 			LogEvent(COMPONENT_MAIN,
 				 "SIGHUP_HANDLER: Received SIGHUP.... initiating export list reload");
+			reopen_log_facilities();
 			reread_config();
 			svcauth_gss_release_cred();
 		}
@@ -262,6 +297,10 @@ void nfs_print_param_config(void)
 	       (uint64_t) nfs_param.core_param.decoder_fridge_expiration_delay);
 	printf("\tDecoder_Fridge_Block_Timeout = %" PRIu64 " ;\n",
 	       (uint64_t) nfs_param.core_param.decoder_fridge_block_timeout);
+	printf("\tDecoder_Spin_Time = %u ;\n",
+	       nfs_param.core_param.decoder_spin);
+	printf("\tWorker_Spin_Time = %u ;\n",
+	       nfs_param.core_param.worker_spin);
 	printf("\tBlocked_Lock_Poller_Interval = %" PRIu64 " ;\n",
 	       (uint64_t) nfs_param.core_param.blocked_lock_poller_interval);
 
@@ -357,6 +396,32 @@ int nfs_set_param_from_conf(config_file_t parse_tree,
 		return -1;
 	}
 
+#ifdef _USE_NFS_RDMA
+	(void) load_config_from_parse(parse_tree,
+				      &rdma_param,
+				      &nfs_param.rdma_param,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing NFS/RDMA configuration");
+		return -1;
+	}
+#endif
+
+#ifdef USE_RPC_TLS
+	(void) load_config_from_parse(parse_tree,
+				      &tls_param,
+				      &nfs_param.tls_param,
+				      true,
+				      err_type);
+	if (!config_error_is_harmless(err_type)) {
+		LogCrit(COMPONENT_INIT,
+			"Error while parsing RPC-over-TLS configuration");
+		return -1;
+	}
+#endif
+
 #ifdef _USE_9P
 	(void) load_config_from_parse(parse_tree,
 				      &_9p_param_blk,
@@ -553,8 +618,24 @@ static void nfs_Start_threads(void)
  * @param[in] p_start_info Unused
  */
 
+/**
+ * @brief Find the largest READ or WRITE size of an export
+ */
+static bool max_export_io(struct gsh_export *export, void *state)
+{
+	uint64_t *max_io = state;
+
+	if (export->MaxRead > *max_io)
+		*max_io = export->MaxRead;
+	if (export->MaxWrite > *max_io)
+		*max_io = export->MaxWrite;
+
+	return true;
+}
+
 static void nfs_Init(const nfs_start_info_t *p_start_info)
 {
+	uint64_t max_io = 0;
 #ifdef _HAVE_GSSAPI
 	gss_buffer_desc gss_service_buf;
 	OM_uint32 maj_stat, min_stat;
@@ -566,8 +647,16 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	gsh_dbus_pkginit();
 	dbus_export_init();
 	dbus_client_init();
+	dbus_fault_init();
+	nfs_startup_phase("dbus");
 #endif
 
+	gsh_trace_pkginit(nfs_param.core_param.trace_records,
+			  nfs_param.core_param.trace_dump_path);
+
+	server_stats_topn_init();
+	stats_shm_start();
+
 	/* acls cache may be needed by exports_pkginit */
 	LogDebug(COMPONENT_INIT, "Now building NFSv4 ACL cache");
 	if (nfs4_acls_init() != 0)
@@ -577,6 +666,20 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	/* finish the job with exports by caching the root entries
 	 */
 	exports_pkginit();
+	nfs_startup_phase("export roots");
+
+	/* Warm the cache up while clients reclaim */
+	mdcache_warm_start();
+
+	/* Size the I/O buffer pool from the exports' MaxRead/MaxWrite,
+	 * and the largest 9P/TCP message
+	 */
+	(void) foreach_gsh_export(max_export_io, &max_io);
+#ifdef _USE_9P
+	if (_9p_param._9p_tcp_msize > max_io)
+		max_io = _9p_param._9p_tcp_msize;
+#endif
+	io_bufpool_init(max_io);
 
 	nfs41_session_pool =
 	    pool_basic_init("NFSv4.1 session pool", sizeof(nfs41_session_t));
@@ -648,6 +751,7 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	/* RPC Initialisation - exits on failure */
 	nfs_Init_svc();
 	LogInfo(COMPONENT_INIT, "RPC ressources successfully initialized");
+	nfs_startup_phase("rpc");
 
 	/* Admin initialisation */
 	nfs_Init_admin_thread();
@@ -723,6 +827,7 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 	}
 	LogInfo(COMPONENT_INIT,
 		"NFSv4 Session Id cache successfully initialized");
+	nfs_startup_phase("state caches");
 
 #ifdef _USE_9P
 	LogDebug(COMPONENT_INIT, "Now building 9P resources");
@@ -741,26 +846,35 @@ static void nfs_Init(const nfs_start_info_t *p_start_info)
 
 	LogInfo(COMPONENT_INIT,
 		"NFSv4 pseudo file system successfully initialized");
+	nfs_startup_phase("pseudofs");
 
 	/* Save Ganesha thread credentials with Frank's routine for later use */
 	fsal_save_ganesha_credentials();
 
-	/* Create stable storage directory, this needs to be done before
+	/* Set up stable storage, this needs to be done before
 	 * starting the recovery thread.
 	 */
-	nfs4_create_recov_dir();
+	nfs4_recovery_init();
+	nfs_startup_phase("recovery init");
 
 	/* read in the client IDs */
 	nfs4_load_recov_clids(NULL);
+	nfs_handoff_clids();
+	nfs_startup_phase("recovery clients");
 
 	/* Start grace period */
 	nfs4_start_grace(NULL);
 
 	/* callback dispatch */
 	nfs_rpc_cb_pkginit();
+
+	/* NFSv4.2 asynchronous copies */
+	if (nfs4_copy_pkginit() != 0)
+		LogFatal(COMPONENT_INIT, "Could not start copy threads");
 #ifdef _USE_CB_SIMULATOR
 	nfs_rpc_cbsim_pkginit();
 #endif				/*  _USE_CB_SIMULATOR */
+	nfs_startup_phase("callbacks");
 
 }				/* nfs_Init */
 
@@ -877,6 +991,10 @@ void nfs_start(nfs_start_info_t *p_start_info)
 
 	/* Spawns service threads */
 	nfs_Start_threads();
+	nfs_startup_phase("threads");
+
+	/* Wait for the server to replace us */
+	nfs_handoff_listen();
 
 #ifdef _USE_NLM
 	if (nfs_param.core_param.enable_NLM) {
@@ -898,9 +1016,10 @@ void nfs_start(nfs_start_info_t *p_start_info)
 	/* Regular exit */
 	LogEvent(COMPONENT_MAIN, "NFS EXIT: regular exit");
 
-	/* if not in grace period, clean up the old state directory */
-	if (!nfs_in_grace())
-		nfs4_clean_old_recov_dir(v4_old_dir);
+	/* if not in grace period, clean up the old state directory, unless
+	 * the next server took over the records */
+	if (!nfs_in_grace() && !nfs_handoff_done())
+		nfs4_end_grace();
 
 	Cleanup();
 
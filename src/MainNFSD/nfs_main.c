@@ -62,6 +62,8 @@
 #define TRACEPOINT_DEFINE
 #define TRACEPOINT_PROBE_DYNAMIC_LINKAGE
 
+#include "gsh_lttng/fridgethr.h"
+#include "gsh_lttng/fsal.h"
 #include "gsh_lttng/logger.h"
 #include "gsh_lttng/mdcache.h"
 #include "gsh_lttng/nfs_rpc.h"
@@ -420,6 +422,8 @@ int main(int argc, char *argv[])
 			gsh_free(errstr);
 	}
 
+	nfs_startup_phase("config parse");
+
 	if (read_log_config(config_struct, &err_type) < 0) {
 		LogCrit(COMPONENT_INIT,
 			 "Error while parsing log configuration");
@@ -430,6 +434,7 @@ int main(int argc, char *argv[])
 	 * the list available at exports parsing time.
 	 */
 	start_fsals();
+	nfs_startup_phase("fsals");
 
 	/* parse configuration file */
 
@@ -447,6 +452,8 @@ int main(int argc, char *argv[])
 			"Failed to initialize server packages");
 		goto fatal_die;
 	}
+	nfs_startup_phase("server packages");
+
 	/* Load Data Server entries from parsed file
 	 * returns the number of DS entries.
 	 */
@@ -470,6 +477,7 @@ int main(int argc, char *argv[])
 		LogWarn(COMPONENT_INIT,
 			"No export entries found in configuration file !!!");
 	report_config_errors(&err_type, NULL, config_errs_to_log);
+	nfs_startup_phase("exports");
 
 	/* freeing syntax tree : */
 
@@ -21,7 +21,8 @@
 
 /**
  * @file nfs_reaper_thread.c
- * @brief check for expired clients and whack them.
+ * @brief End the grace period, reap cached open owners, trim the DRCs
+ *        of idle connections and the pools.
  */
 
 #include "config.h"
@@ -33,106 +34,28 @@
 #include "nfs_proto_functions.h"
 #include "nfs_core.h"
 #include "log.h"
-#include "fridgethr.h"
+#include "delayed_exec.h"
+#include "abstract_mem.h"
 
 #define REAPER_DELAY 10
 
 unsigned int reaper_delay = REAPER_DELAY;
 
-static struct fridgethr *reaper_fridge;
+/** Runs the reaper every reaper_delay seconds on the timing wheels */
+static struct delayed_timer reaper_timer;
+/** Held while the reaper runs, protects reaper_stopping */
+static pthread_mutex_t reaper_mtx = PTHREAD_MUTEX_INITIALIZER;
+static bool reaper_stopping;
 
-static int reap_hash_table(hash_table_t *ht_reap)
-{
-	struct rbt_head *head_rbt;
-	struct hash_data *addr = NULL;
-	uint32_t i;
-	struct rbt_node *pn;
-	nfs_client_id_t *client_id;
-	nfs_client_record_t *client_rec;
-	int count = 0;
-
-	/* For each bucket of the requested hashtable */
-	for (i = 0; i < ht_reap->parameter.index_size; i++) {
-		head_rbt = &ht_reap->partitions[i].rbt;
-
-restart:
-		/* acquire mutex */
-		PTHREAD_RWLOCK_wrlock(&ht_reap->partitions[i].lock);
-
-		/* go through all entries in the red-black-tree */
-		RBT_LOOP(head_rbt, pn) {
-			char str[LOG_BUFF_LEN];
-			struct display_buffer dspbuf = {sizeof(str), str, str};
-			bool str_valid = false;
-
-			addr = RBT_OPAQ(pn);
-			client_id = addr->val.addr;
-
-			count++;
-
-			PTHREAD_MUTEX_lock(&client_id->cid_mutex);
-
-			if (valid_lease(client_id)) {
-				PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
-				RBT_INCREMENT(pn);
-				continue;
-			}
-
-			if (isDebug(COMPONENT_CLIENTID)) {
-				display_client_id_rec(&dspbuf, client_id);
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Expire index %d %s", i, str);
-				str_valid = true;
-			}
-
-			/* Get the client record */
-			client_rec = client_id->cid_client_record;
-
-			/* get a ref to client_id as we might drop the
-			 * last reference with expiring.
-			 */
-			inc_client_id_ref(client_id);
-
-			/* if record is STALE, the linkage to client_record is
-			 * removed already. Acquire a ref on client record
-			 * before we drop the mutex on clientid
-			 */
-			if (client_rec != NULL)
-				inc_client_record_ref(client_rec);
-			PTHREAD_MUTEX_unlock(&client_id->cid_mutex);
-			if (client_rec != NULL)
-				PTHREAD_MUTEX_lock(&client_rec->cr_mutex);
-
-			PTHREAD_RWLOCK_unlock(&ht_reap->partitions[i].lock);
-			nfs_client_id_expire(client_id, false);
-
-			if (client_rec != NULL) {
-				PTHREAD_MUTEX_unlock(&client_rec->cr_mutex);
-				dec_client_record_ref(client_rec);
-			}
-
-			if (isFullDebug(COMPONENT_CLIENTID)) {
-				if (!str_valid)
-					display_printf(&dspbuf, "clientid %p",
-						       client_id);
-
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Reaper done, expired {%s}", str);
-			}
-
-			/* drop our reference to the client_id */
-			dec_client_id_ref(client_id);
-
-			goto restart;
-		}
-		PTHREAD_RWLOCK_unlock(&ht_reap->partitions[i].lock);
-	}
-	return count;
-}
+/**
+ * @brief Open owners uncached before letting others at the list
+ */
+#define REAP_OPEN_OWNERS_BATCH 64
 
 static int reap_expired_open_owners(void)
 {
 	int count = 0;
+	int batch = 0;
 	time_t tnow = time(NULL);
 	time_t texpire;
 	state_owner_t *owner;
@@ -144,8 +67,18 @@ static int reap_expired_open_owners(void)
 	 * the mutex while walking this list, it is impossible for another
 	 * thread to get a primary reference to these owners while we
 	 * process, and thus prevent them from expiring.
+	 *
+	 * Every batch the mutex is dropped so that OPEN and CLOSE are
+	 * not held up behind a long walk; since we always restart from
+	 * the head of the list, nothing is missed.
 	 */
 	while (true) {
+		if (++batch > REAP_OPEN_OWNERS_BATCH) {
+			PTHREAD_MUTEX_unlock(&cached_open_owners_lock);
+			batch = 1;
+			PTHREAD_MUTEX_lock(&cached_open_owners_lock);
+		}
+
 		owner = glist_first_entry(&cached_open_owners, state_owner_t,
 				so_owner.so_nfs4_owner.so_cache_entry);
 
@@ -202,24 +135,29 @@ static struct reaper_state reaper_state = {
 	.in_grace = false
 };
 
-static void reaper_run(struct fridgethr_context *ctx)
+static void reaper_run(void *arg)
 {
-	struct reaper_state *rst = ctx->arg;
+	struct reaper_state *rst = arg;
+
+	PTHREAD_MUTEX_lock(&reaper_mtx);
+	if (reaper_stopping) {
+		PTHREAD_MUTEX_unlock(&reaper_mtx);
+		return;
+	}
 
-	SetNameFunction("reaper");
 	rst->in_grace = nfs_in_grace();
 
 	if (!rst->old_state_cleaned) {
 		/* if not in grace period, clean up the old state */
 		if (!rst->in_grace) {
-			nfs4_clean_old_recov_dir(v4_old_dir);
+			nfs4_end_grace();
 			rst->old_state_cleaned = true;
 		}
 	}
 
 	if (isDebug(COMPONENT_CLIENTID) && ((rst->count > 0) || !rst->logged)) {
 		LogDebug(COMPONENT_CLIENTID,
-			 "Now checking NFS4 clients for expiration");
+			 "Now checking NFS4 open owners for expiration");
 
 		rst->logged = (rst->count == 0);
 
@@ -231,58 +169,40 @@ static void reaper_run(struct fridgethr_context *ctx)
 #endif
 	}
 
-	rst->count =
-	    (reap_hash_table(ht_confirmed_client_id) +
-	     reap_hash_table(ht_unconfirmed_client_id));
+	/* Expired leases are not looked for, see arm_lease_timer */
+	rst->count = reap_expired_open_owners();
+
+	nfs_rpc_trim_idle_xprts();
 
-	rst->count += reap_expired_open_owners();
+	pool_trim_all();
+
+	(void)delayed_timer_arm(&reaper_timer, reaper_delay * NS_PER_SEC);
+	PTHREAD_MUTEX_unlock(&reaper_mtx);
 }
 
 int reaper_init(void)
 {
-	struct fridgethr_params frp;
-	int rc = 0;
-
 	if (nfs_param.nfsv4_param.lease_lifetime < (2 * REAPER_DELAY))
 		reaper_delay = nfs_param.nfsv4_param.lease_lifetime / 2;
 
-	memset(&frp, 0, sizeof(struct fridgethr_params));
-	frp.thr_max = 1;
-	frp.thr_min = 1;
-	frp.thread_delay = reaper_delay;
-	frp.flavor = fridgethr_flavor_looper;
-
-	rc = fridgethr_init(&reaper_fridge, "reaper", &frp);
-	if (rc != 0) {
-		LogMajor(COMPONENT_CLIENTID,
-			 "Unable to initialize reaper fridge, error code %d.",
-			 rc);
-		return rc;
-	}
-
-	rc = fridgethr_submit(reaper_fridge, reaper_run, &reaper_state);
-	if (rc != 0) {
-		LogMajor(COMPONENT_CLIENTID,
-			 "Unable to start reaper thread, error code %d.", rc);
-		return rc;
-	}
+	reaper_stopping = false;
+	delayed_timer_init(&reaper_timer, reaper_run, &reaper_state);
+	(void)delayed_timer_arm(&reaper_timer, 0);
 
 	return 0;
 }
 
+/**
+ * @brief Stop the reaper
+ *
+ * Waits for a pass in progress.
+ */
 int reaper_shutdown(void)
 {
-	int rc = fridgethr_sync_command(reaper_fridge,
-					fridgethr_comm_stop,
-					120);
-
-	if (rc == ETIMEDOUT) {
-		LogMajor(COMPONENT_CLIENTID,
-			 "Shutdown timed out, cancelling threads.");
-		fridgethr_cancel(reaper_fridge);
-	} else if (rc != 0) {
-		LogMajor(COMPONENT_CLIENTID,
-			 "Failed shutting down reaper thread: %d", rc);
-	}
-	return rc;
+	PTHREAD_MUTEX_lock(&reaper_mtx);
+	reaper_stopping = true;
+	(void)delayed_timer_cancel(&reaper_timer);
+	PTHREAD_MUTEX_unlock(&reaper_mtx);
+
+	return 0;
 }
@@ -54,6 +54,8 @@
 #include "nfs4.h"
 #include "gss_credcache.h"
 #include "sal_data.h"
+#include "sal_functions.h"
+#include "delayed_exec.h"
 #include <misc/timespec.h>
 
 const struct __netid_nc_table netid_nc_table[9] = {
@@ -993,101 +995,6 @@ int32_t nfs_rpc_abort_call(rpc_call_t *call)
 	return 0;
 }
 
-/**
- * @brief Construct a CB_COMPOUND for v41
- *
- * This function constructs a compound with a CB_SEQUENCE and one
- * other operation.
- *
- * @param[in] session Session on whose back channel we make the call
- * @param[in] op      The operation to add
- * @param[in] refer   Referral data, NULL if none
- * @param[in] slot    Slot number to use
- *
- * @return The constructed call or NULL.
- */
-static rpc_call_t *construct_single_call(nfs41_session_t *session,
-					 nfs_cb_argop4 *op,
-					 struct state_refer *refer,
-					 slotid4 slot, slotid4 highest_slot)
-{
-	rpc_call_t *call = alloc_rpc_call();
-	nfs_cb_argop4 sequenceop;
-	CB_SEQUENCE4args *sequence = &sequenceop.nfs_cb_argop4_u.opcbsequence;
-	const uint32_t minor = session->clientid_record->cid_minorversion;
-
-	call->chan = &session->cb_chan;
-	cb_compound_init_v4(&call->cbt, 2, minor, 0, NULL, 0);
-
-	memset(sequence, 0, sizeof(CB_SEQUENCE4args));
-	sequenceop.argop = NFS4_OP_CB_SEQUENCE;
-
-	memcpy(sequence->csa_sessionid, session->session_id,
-	       NFS4_SESSIONID_SIZE);
-	sequence->csa_sequenceid = session->cb_slots[slot].sequence;
-	sequence->csa_slotid = slot;
-	sequence->csa_highest_slotid = highest_slot;
-	sequence->csa_cachethis = false;
-
-	if (refer) {
-		referring_call_list4 *list;
-		referring_call4 *ref_call = NULL;
-
-		list = gsh_calloc(1, sizeof(referring_call_list4));
-
-		ref_call = gsh_malloc(sizeof(referring_call4));
-
-		sequence->
-		    csa_referring_call_lists.csa_referring_call_lists_len = 1;
-		sequence->
-		    csa_referring_call_lists.csa_referring_call_lists_val =
-		    list;
-		memcpy(list->rcl_sessionid, refer->session,
-		       sizeof(NFS4_SESSIONID_SIZE));
-		list->rcl_referring_calls.rcl_referring_calls_len = 1;
-		list->rcl_referring_calls.rcl_referring_calls_val = ref_call;
-		ref_call->rc_sequenceid = refer->sequence;
-		ref_call->rc_slotid = refer->slot;
-	} else {
-		sequence->csa_referring_call_lists.
-		    csa_referring_call_lists_len = 0;
-		sequence->csa_referring_call_lists.
-		    csa_referring_call_lists_val = NULL;
-	}
-	cb_compound_add_op(&call->cbt, &sequenceop);
-	cb_compound_add_op(&call->cbt, op);
-
-	return call;
-}
-
-/**
- * @brief Free a CB call and sequence
- *
- * @param[in] call The call to free
- *
- * @return The constructed call or NULL.
- */
-static void free_single_call(rpc_call_t *call)
-{
-	CB_SEQUENCE4args *sequence =
-	    (&call->cbt.v_u.v4.args.argarray.argarray_val[0].nfs_cb_argop4_u.
-	     opcbsequence);
-
-	if (sequence->csa_referring_call_lists.csa_referring_call_lists_val) {
-		if (sequence->csa_referring_call_lists.
-		    csa_referring_call_lists_val->
-		    rcl_referring_calls.rcl_referring_calls_val) {
-			gsh_free(sequence->csa_referring_call_lists.
-				 csa_referring_call_lists_val->
-				 rcl_referring_calls.
-				 rcl_referring_calls_val);
-		}
-		gsh_free(sequence->csa_referring_call_lists.
-			 csa_referring_call_lists_val);
-	}
-	free_rpc_call(call);
-}
-
 /**
  * @brief Find a callback slot
  *
@@ -1113,7 +1020,7 @@ static bool find_cb_slot(nfs41_session_t *session, bool wait, slotid4 *slot,
  retry:
 	for (cur = 0;
 	     cur < MIN(session->back_channel_attrs.ca_maxrequests,
-		       NFS41_NB_SLOTS);
+		       NFS41_MAX_CB_SLOTS);
 	     ++cur) {
 
 		if (!(session->cb_slots[cur].in_use) && (!found)) {
@@ -1171,99 +1078,476 @@ static void release_cb_slot(nfs41_session_t *session, slotid4 slot, bool sent)
 }
 
 /**
- * @brief Send v4.1 CB_COMPOUND with a single operation
- *
- * This actually sends two opearations, a CB_SEQUENCE and the supplied
- * operation.  It works as a convenience function to handle the
- * details of CB_SEQUENCE management, finding a connection with a
- * working back channel, and so forth.
- *
- * @note This should work for most practical purposes, but is not
- * ideal.  What we ought to have is a per-clientid queue that
- * operations can be submitted to that will be sent when a
- * back-channel is re-established, with a per-session queue for
- * operations that were sent but had the back-channel fail before the
- * response was received.
- *
- * @param[in] clientid       Client record
- * @param[in] op             The operation to perform
- * @param[in] refer          Referral tracking info (or NULL)
- * @param[in] completion     Completion function for this operation
- * @param[in] completion_arg Argument provided to completion hook
- * @param[in] free_op        Function to free elements of the op (may be
- *                           NULL.) Only called on error, so it should
- *                           also be called explicitly from the completion
- *                           function.
- *
- * @return POSIX error codes.
+ * @brief An operation waiting in a client's callback queue
+ */
+
+struct cb_queued_op {
+	struct glist_head list;	/*< Link in the client queue or batch */
+	nfs_cb_argop4 *op;	/*< The operation, owned by the caller */
+	struct state_refer refer;	/*< Call that created the state */
+	bool has_refer;		/*< Whether refer is set */
+	nfs_cb_op_done done;	/*< Completion for this operation */
+	void *arg;		/*< Argument to done */
+};
+
+/**
+ * @brief Operations sent together in one CB_COMPOUND
+ */
+
+struct cb_batch {
+	nfs_client_id_t *clientid;	/*< Client, referenced */
+	nfs41_session_t *session;	/*< Session, referenced */
+	slotid4 slot;		/*< Back channel slot in use */
+	uint32_t nops;		/*< Operations after the CB_SEQUENCE */
+	struct glist_head ops;	/*< The cb_queued_op */
+};
+
+/**
+ * @brief Most operations sent in one CB_COMPOUND, besides the
+ *        CB_SEQUENCE, whatever the client allows
+ */
+#define CB_BATCH_MAX_OPS 16
+
+static void cb_queue_flush(void *arg);
+static int32_t cb_batch_completion(rpc_call_t *call, rpc_call_hook hook,
+				   void *arg, uint32_t flags);
+
+/**
+ * @brief Build the referring call lists of a batch
+ *
+ * One list is built per session that created states the batch
+ * operations are about.
+ *
+ * @param[out] sequence CB_SEQUENCE arguments of the batch
+ * @param[in]  batch    The batch
+ */
+
+static void cb_batch_refer(CB_SEQUENCE4args *sequence, struct cb_batch *batch)
+{
+	referring_call_list4 *lists = NULL;
+	referring_call_list4 *list;
+	referring_call4 *ref_call;
+	struct cb_queued_op *qop;
+	struct glist_head *glist;
+	uint32_t nlists = 0;
+	uint32_t i;
+
+	glist_for_each(glist, &batch->ops) {
+		qop = glist_entry(glist, struct cb_queued_op, list);
+
+		if (!qop->has_refer)
+			continue;
+
+		if (lists == NULL)
+			lists = gsh_calloc(batch->nops, sizeof(*lists));
+
+		for (i = 0; i < nlists; i++)
+			if (memcmp(lists[i].rcl_sessionid, qop->refer.session,
+				   NFS4_SESSIONID_SIZE) == 0)
+				break;
+
+		list = &lists[i];
+
+		if (i == nlists) {
+			memcpy(list->rcl_sessionid, qop->refer.session,
+			       NFS4_SESSIONID_SIZE);
+			list->rcl_referring_calls.rcl_referring_calls_val =
+			    gsh_calloc(batch->nops, sizeof(referring_call4));
+			nlists++;
+		}
+
+		ref_call = &list->rcl_referring_calls.rcl_referring_calls_val
+			[list->rcl_referring_calls.rcl_referring_calls_len++];
+		ref_call->rc_sequenceid = qop->refer.sequence;
+		ref_call->rc_slotid = qop->refer.slot;
+	}
+
+	sequence->csa_referring_call_lists.csa_referring_call_lists_len =
+	    nlists;
+	sequence->csa_referring_call_lists.csa_referring_call_lists_val =
+	    lists;
+}
+
+/**
+ * @brief Construct the CB_COMPOUND of a batch
+ *
+ * @param[in] batch        The batch, with its operations
+ * @param[in] highest_slot Highest slot in use
+ *
+ * @return The constructed call.
  */
-int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
-		       struct state_refer *refer,
-		       int32_t (*completion)(rpc_call_t *, rpc_call_hook,
-					     void *arg, uint32_t flags),
-		       void *completion_arg,
-		       void (*free_op)(nfs_cb_argop4 *op))
+
+static rpc_call_t *construct_batch_call(struct cb_batch *batch,
+					slotid4 highest_slot)
+{
+	nfs41_session_t *session = batch->session;
+	rpc_call_t *call = alloc_rpc_call();
+	nfs_cb_argop4 sequenceop;
+	CB_SEQUENCE4args *sequence = &sequenceop.nfs_cb_argop4_u.opcbsequence;
+	const uint32_t minor = session->clientid_record->cid_minorversion;
+	struct cb_queued_op *qop;
+	struct glist_head *glist;
+
+	call->chan = &session->cb_chan;
+	cb_compound_init_v4(&call->cbt, batch->nops + 1, minor, 0, NULL, 0);
+
+	memset(sequence, 0, sizeof(CB_SEQUENCE4args));
+	sequenceop.argop = NFS4_OP_CB_SEQUENCE;
+
+	memcpy(sequence->csa_sessionid, session->session_id,
+	       NFS4_SESSIONID_SIZE);
+	sequence->csa_sequenceid = session->cb_slots[batch->slot].sequence;
+	sequence->csa_slotid = batch->slot;
+	sequence->csa_highest_slotid = highest_slot;
+	sequence->csa_cachethis = false;
+
+	cb_batch_refer(sequence, batch);
+
+	cb_compound_add_op(&call->cbt, &sequenceop);
+
+	glist_for_each(glist, &batch->ops) {
+		qop = glist_entry(glist, struct cb_queued_op, list);
+		cb_compound_add_op(&call->cbt, qop->op);
+	}
+
+	call->call_hook = cb_batch_completion;
+
+	return call;
+}
+
+/**
+ * @brief Free a batch CB_COMPOUND and its CB_SEQUENCE
+ *
+ * @param[in] call The call to free
+ */
+
+static void free_batch_call(rpc_call_t *call)
+{
+	CB_SEQUENCE4args *sequence =
+	    (&call->cbt.v_u.v4.args.argarray.argarray_val[0].nfs_cb_argop4_u.
+	     opcbsequence);
+	referring_call_list4 *lists =
+	    sequence->csa_referring_call_lists.csa_referring_call_lists_val;
+	uint32_t i;
+
+	for (i = 0;
+	     i < sequence->csa_referring_call_lists.csa_referring_call_lists_len;
+	     i++)
+		gsh_free(lists[i].rcl_referring_calls.rcl_referring_calls_val);
+
+	gsh_free(lists);
+	free_rpc_call(call);
+}
+
+/**
+ * @brief Complete operations that could not be sent
+ *
+ * @param[in] ops List of cb_queued_op, emptied
+ */
+
+static void cb_ops_abort(struct glist_head *ops)
+{
+	struct cb_queued_op *qop;
+
+	while ((qop = glist_first_entry(ops, struct cb_queued_op, list))) {
+		glist_del(&qop->list);
+		qop->done(qop->op, NFS4ERR_DELAY, RPC_CALL_ABORT, qop->arg);
+		gsh_free(qop);
+	}
+}
+
+/**
+ * @brief Handle the reply to a batch CB_COMPOUND
+ *
+ * Each operation is completed with its own result.  Operations the
+ * client never got to, because an earlier one failed, complete with
+ * NFS4ERR_DELAY so that they are sent again.
+ *
+ * @param[in] call  The call
+ * @param[in] hook  RPC_CALL_COMPLETE if the client replied
+ * @param[in] arg   The batch
+ * @param[in] flags Unused
+ *
+ * @return 0.
+ */
+
+static int32_t cb_batch_completion(rpc_call_t *call, rpc_call_hook hook,
+				   void *arg, uint32_t flags)
+{
+	struct cb_batch *batch = arg;
+	nfs_client_id_t *clientid = batch->clientid;
+	CB_COMPOUND4res *res = &call->cbt.v_u.v4.res;
+	struct cb_queued_op *qop;
+	uint32_t i = 1;
+	nfsstat4 status;
+	bool flush = false;
+
+	/* A call on a channel that was already gone completes without
+	 * a reply.
+	 */
+	if (call->stat != RPC_SUCCESS)
+		hook = RPC_CALL_ABORT;
+
+	LogFullDebug(COMPONENT_NFS_CB,
+		     "batch of %" PRIu32 " ops on slot %" PRIu32
+		     ": hook %d status %d", batch->nops, batch->slot,
+		     hook, res->status);
+
+	release_cb_slot(batch->session, batch->slot, true);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_cb.v41.cb_queue_mutex);
+	clientid->cid_cb.v41.cb_inflight -= batch->nops;
+	if (!glist_empty(&clientid->cid_cb.v41.cb_queue) &&
+	    !clientid->cid_cb.v41.cb_flushing) {
+		clientid->cid_cb.v41.cb_flushing = true;
+		flush = true;
+	}
+	PTHREAD_MUTEX_unlock(&clientid->cid_cb.v41.cb_queue_mutex);
+
+	while ((qop = glist_first_entry(&batch->ops, struct cb_queued_op,
+					list))) {
+		glist_del(&qop->list);
+
+		if (hook != RPC_CALL_COMPLETE)
+			status = NFS4ERR_DELAY;
+		else if (i < res->resarray.resarray_len)
+			/* Every CB result starts with its status */
+			status = res->resarray.resarray_val[i]
+					.nfs_cb_resop4_u.opcbrecall.status;
+		else if (res->resarray.resarray_len <= 1 &&
+			 res->status != NFS4_OK)
+			/* The CB_SEQUENCE itself failed */
+			status = res->status;
+		else
+			status = NFS4ERR_DELAY;
+
+		qop->done(qop->op, status, hook, qop->arg);
+		gsh_free(qop);
+		i++;
+	}
+
+	free_batch_call(call);
+	dec_session_ref(batch->session);
+	gsh_free(batch);
+
+	/* The flush inherits the client reference of the batch */
+	if (flush)
+		(void) delayed_submit(cb_queue_flush, clientid, 0);
+	else
+		dec_client_id_ref(clientid);
+
+	return 0;
+}
+
+/**
+ * @brief Send queued operations of a client
+ *
+ * Take as many operations off the queue as the client and the in
+ * flight limit allow, and send them in one CB_COMPOUND on a free slot.
+ *
+ * @note The client cb_queue_mutex MUST be held
+ *
+ * @param[in]  clientid The client
+ * @param[out] any_up   Set if a session has a back channel up
+ *
+ * @retval true if a batch was sent.
+ * @retval false if no back channel slot was free.
+ */
+
+static bool cb_batch_send(nfs_client_id_t *clientid, bool *any_up)
 {
 	struct glist_head *glist;
 	nfs41_session_t *session;
-	int scan;
+	struct cb_batch *batch;
+	struct cb_queued_op *qop;
+	rpc_call_t *call;
+	slotid4 slot = 0;
+	slotid4 highest_slot = 0;
+	uint32_t max_ops;
 
-	if (clientid->cid_minorversion == 0)
-		return EINVAL;
+	glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
+		session = glist_entry(glist, nfs41_session_t, session_link);
 
-	for (scan = 0; scan < 2; ++scan) {
-		/**@ todo ??? pthread_mutex_lock(&found->cid_mutex); */
-		glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
-			session = glist_entry(glist, nfs41_session_t,
-					      session_link);
+		if (!(session->flags & session_bc_up))
+			continue;
 
-			if (!(session->flags & session_bc_up))
-				continue;
+		*any_up = true;
 
-			rpc_call_channel_t *chan = &session->cb_chan;
+		if (!find_cb_slot(session, false, &slot, &highest_slot))
+			continue;
 
-			slotid4 slot = 0;
-			slotid4 highest_slot = 0;
-			rpc_call_t *call = NULL;
+		max_ops = session->back_channel_attrs.ca_maxoperations > 1
+			? session->back_channel_attrs.ca_maxoperations - 1
+			: 1;
+		max_ops = MIN(max_ops, CB_BATCH_MAX_OPS);
+		max_ops = MIN(max_ops, nfs_param.nfsv4_param.cb_max_inflight -
+				       clientid->cid_cb.v41.cb_inflight);
+
+		batch = gsh_calloc(1, sizeof(*batch));
+		batch->clientid = clientid;
+		batch->session = session;
+		batch->slot = slot;
+		glist_init(&batch->ops);
+
+		while (batch->nops < max_ops &&
+		       (qop = glist_first_entry(&clientid->cid_cb.v41.cb_queue,
+						struct cb_queued_op, list))) {
+			glist_del(&qop->list);
+			glist_add_tail(&batch->ops, &qop->list);
+			batch->nops++;
+		}
 
-			if (!(find_cb_slot(session, scan == 1, &slot,
-					   &highest_slot))) {
-				continue;
-			}
-
-			call = construct_single_call(session, op, refer, slot,
-						     highest_slot);
-
-			call->call_hook = completion;
-			if (nfs_rpc_submit_call(call, completion_arg,
-						NFS_RPC_FLAG_NONE) != 0) {
-				/* Clean up... */
-				free_single_call(call);
-				release_cb_slot(session, slot, false);
-				PTHREAD_MUTEX_lock(&chan->mtx);
-				_nfs_rpc_destroy_chan(chan);
-				session->flags &= ~session_bc_up;
-				PTHREAD_MUTEX_unlock(&chan->mtx);
-			} else
-				return 0;
+		call = construct_batch_call(batch, highest_slot);
+
+		inc_session_ref(session);
+		inc_client_id_ref(clientid);
+		clientid->cid_cb.v41.cb_inflight += batch->nops;
+
+		if (nfs_rpc_submit_call(call, batch, NFS_RPC_FLAG_NONE) != 0) {
+			clientid->cid_cb.v41.cb_inflight -= batch->nops;
+			dec_client_id_ref(clientid);
+			dec_session_ref(session);
+			/* Put the operations back, in order */
+			glist_splice_tail(&batch->ops,
+					  &clientid->cid_cb.v41.cb_queue);
+			glist_splice_tail(&clientid->cid_cb.v41.cb_queue,
+					  &batch->ops);
+			free_batch_call(call);
+			gsh_free(batch);
+			release_cb_slot(session, slot, false);
+			PTHREAD_MUTEX_lock(&session->cb_chan.mtx);
+			_nfs_rpc_destroy_chan(&session->cb_chan);
+			session->flags &= ~session_bc_up;
+			PTHREAD_MUTEX_unlock(&session->cb_chan.mtx);
+			continue;
 		}
-		/**@ todo ??? pthread_mutex_unlock(&found->cid_mutex); */
+
+		return true;
 	}
 
-	return ENOTCONN;
+	return false;
 }
 
 /**
- * @brief Free information associated with any 'single' call
+ * @brief Send the operations queued on a client
+ *
+ * Run from the delayed executor, so that operations queued while the
+ * back channel slots are busy go out together.  Holds a reference on
+ * the client, released here.
+ *
+ * @param[in] arg The client
  */
 
-void nfs41_complete_single(rpc_call_t *call, rpc_call_hook hook, void *arg,
-			   uint32_t flags)
+static void cb_queue_flush(void *arg)
 {
-	release_cb_slot(call->chan->source.session,
-			call->cbt.v_u.v4.args.argarray.argarray_val[0]
-			.nfs_cb_argop4_u.opcbsequence.csa_slotid, true);
-	free_single_call(call);
+	nfs_client_id_t *clientid = arg;
+	struct glist_head aborted;
+	bool any_up = false;
+
+	glist_init(&aborted);
+
+	PTHREAD_MUTEX_lock(&clientid->cid_cb.v41.cb_queue_mutex);
+
+	while (!glist_empty(&clientid->cid_cb.v41.cb_queue) &&
+	       clientid->cid_cb.v41.cb_inflight <
+	       nfs_param.nfsv4_param.cb_max_inflight &&
+	       cb_batch_send(clientid, &any_up))
+		;
+
+	/* With nothing in flight, no completion would ever send what is
+	 * left, either because there is no back channel or because its
+	 * slots are all taken.
+	 */
+	if (clientid->cid_cb.v41.cb_inflight == 0)
+		glist_splice_tail(&aborted, &clientid->cid_cb.v41.cb_queue);
+
+	clientid->cid_cb.v41.cb_flushing = false;
+
+	PTHREAD_MUTEX_unlock(&clientid->cid_cb.v41.cb_queue_mutex);
+
+	if (!glist_empty(&aborted)) {
+		LogDebug(COMPONENT_NFS_CB,
+			 "No back channel %s for client %" PRIx64,
+			 any_up ? "slot" : "up", clientid->cid_clientid);
+		cb_ops_abort(&aborted);
+	}
+
+	dec_client_id_ref(clientid);
+}
+
+/**
+ * @brief Queue a v4.1 callback operation
+ *
+ * The operation goes on a per-client queue.  Queued operations are
+ * coalesced into CB_COMPOUNDs of as many operations as the client's
+ * back channel allows, one per free back channel slot, with at most
+ * Callback_Max_In_Flight operations outstanding for the client.  The
+ * CB_SEQUENCE of each compound carries the referring calls of all its
+ * operations.
+ *
+ * The completion is called without locks held, from another thread,
+ * with the status of this operation.  If the client never answered,
+ * hook is not RPC_CALL_COMPLETE.  The operation must stay valid until
+ * then and is not freed here.
+ *
+ * @param[in] clientid Client record
+ * @param[in] op       The operation to perform
+ * @param[in] refer    Referral tracking info (or NULL)
+ * @param[in] done     Completion for this operation
+ * @param[in] arg      Argument provided to done
+ *
+ * @retval 0 if queued.
+ * @retval EINVAL for a v4.0 client.
+ * @retval ENOTCONN if the client has no back channel.
+ */
+
+int nfs_rpc_cb_queue(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
+		     struct state_refer *refer, nfs_cb_op_done done,
+		     void *arg)
+{
+	struct cb_queued_op *qop;
+	struct glist_head *glist;
+	bool up = false;
+	bool flush = false;
+
+	if (clientid->cid_minorversion == 0)
+		return EINVAL;
+
+	/**@ todo ??? pthread_mutex_lock(&found->cid_mutex); */
+	glist_for_each(glist, &clientid->cid_cb.v41.cb_session_list) {
+		if (glist_entry(glist, nfs41_session_t, session_link)->flags
+		    & session_bc_up) {
+			up = true;
+			break;
+		}
+	}
+
+	if (!up)
+		return ENOTCONN;
+
+	qop = gsh_calloc(1, sizeof(*qop));
+	qop->op = op;
+	if (refer) {
+		qop->refer = *refer;
+		qop->has_refer = true;
+	}
+	qop->done = done;
+	qop->arg = arg;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_cb.v41.cb_queue_mutex);
+	glist_add_tail(&clientid->cid_cb.v41.cb_queue, &qop->list);
+	if (!clientid->cid_cb.v41.cb_flushing) {
+		clientid->cid_cb.v41.cb_flushing = true;
+		flush = true;
+	}
+	PTHREAD_MUTEX_unlock(&clientid->cid_cb.v41.cb_queue_mutex);
+
+	if (flush) {
+		inc_client_id_ref(clientid);
+		(void) delayed_submit(cb_queue_flush, clientid, 0);
+	}
+
+	return 0;
 }
 
 /**
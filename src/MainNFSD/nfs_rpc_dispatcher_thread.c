@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 #include <fcntl.h>
 #include <sys/file.h>		/* for having FNDELAY */
 #include <sys/select.h>
@@ -62,6 +63,17 @@
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "fridgethr.h"
+#include "server_stats.h"
+#include "client_mgr.h"
+#include <os/subr.h>
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#include "server_stats_private.h"
+#endif
+
+#ifdef USE_LTTNG
+#include "gsh_lttng/nfs_rpc.h"
+#endif
 
 #define NFS_pcp nfs_param.core_param
 #define NFS_options NFS_pcp.core_options
@@ -86,7 +98,19 @@ struct rpc_evchan {
 
 static struct rpc_evchan rpc_evchan[N_EVENT_CHAN];
 
+/* The extra NFS listeners of TCP_Listeners, each with its own channel */
+static struct rpc_evchan *listener_evchan;
+static uint32_t n_listeners;
+static int *listener_socket;
+
+/* The extra UDP sockets of UDP_Listeners, P_COUNT for each channel */
+static struct rpc_evchan *udp_evchan;
+static uint32_t n_udp_listeners;
+static int *udp_listener_socket;
+
 struct fridgethr *req_fridge;	/*< Decoder thread pool */
+struct fridgethr **decoder_fridges;
+uint32_t n_decoder_fridges;
 struct nfs_req_st nfs_req_st;	/*< Shared request queues */
 
 const char *req_q_s[N_REQ_QUEUES] = {
@@ -197,6 +221,10 @@ static void unregister_rpc(void)
 	}
 }
 
+/* Sockets handed over bound by the previous server */
+static bool udp_adopted[P_COUNT];
+static bool tcp_adopted[P_COUNT];
+
 static inline bool nfs_protocol_enabled(protos p)
 {
 	bool nfsv3 = NFS_options & CORE_OPTION_NFSV3;
@@ -243,6 +271,7 @@ static inline bool nfs_protocol_enabled(protos p)
 static void close_rpc_fd(void)
 {
 	protos p;
+	uint32_t i;
 
 	for (p = P_NFS; p < P_COUNT; p++) {
 		if (udp_socket[p] != -1)
@@ -252,67 +281,178 @@ static void close_rpc_fd(void)
 	}
 	if (vsock)
 		close(tcp_socket[P_NFS_VSOCK]);
+	for (i = 0; i < n_listeners; i++)
+		if (listener_socket[i] != -1)
+			close(listener_socket[i]);
+	for (i = 0; i < n_udp_listeners * P_COUNT; i++)
+		if (udp_listener_socket[i] != -1)
+			close(udp_listener_socket[i]);
 }
 
-void Create_udp(protos prot)
+/**
+ * @brief The bound UDP and TCP sockets, to hand to the next server
+ *
+ * @param[out] fds  The sockets
+ * @param[out] tags Their protocol, shifted by one, or'ed with 1 for UDP
+ * @param[in]  max  Room in both
+ *
+ * @return The number of sockets.
+ */
+uint32_t nfs_rpc_bound_sockets(int *fds, uint8_t *tags, uint32_t max)
+{
+	uint32_t n = 0;
+	protos p;
+
+	for (p = P_NFS; p < P_COUNT && n + 2 <= max; p++) {
+		if (!nfs_protocol_enabled(p))
+			continue;
+		if (udp_socket[p] != -1) {
+			fds[n] = udp_socket[p];
+			tags[n++] = p << 1 | 1;
+		}
+		if (tcp_socket[p] != -1) {
+			fds[n] = tcp_socket[p];
+			tags[n++] = p << 1;
+		}
+	}
+
+	return n;
+}
+
+/**
+ * @brief Use a socket handed over by the previous server
+ *
+ * Called between Allocate_sockets and Bind_sockets: the socket takes
+ * the place of the fresh one, and is not bound again.  The listen
+ * queue, with the connections it holds, is kept.
+ *
+ * @param[in] tag As from nfs_rpc_bound_sockets
+ * @param[in] fd  The socket, closed here
+ *
+ * @return 0, or -1 if the server doesn't have such a socket.
+ */
+int nfs_rpc_adopt_socket(uint8_t tag, int fd)
 {
-	udp_xprt[prot] =
-	    svc_dg_create(udp_socket[prot],
-			  nfs_param.core_param.rpc.max_send_buffer_size,
-			  nfs_param.core_param.rpc.max_recv_buffer_size);
-	if (udp_xprt[prot] == NULL)
+	protos p = tag >> 1;
+	bool udp = tag & 1;
+	int *sock = udp ? &udp_socket[p] : &tcp_socket[p];
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof(ss);
+	int rc = -1;
+
+	if (p >= P_COUNT || !nfs_protocol_enabled(p) || *sock == -1)
+		goto out;
+
+	/* Same family as the sockets we allocated */
+	if (getsockname(fd, (struct sockaddr *)&ss, &len) != 0 ||
+	    ss.ss_family != (v6disabled ? AF_INET : AF_INET6))
+		goto out;
+
+	if (dup2(fd, *sock) < 0) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Cannot take over %s %s socket, error %d(%s)",
+			tags[p], udp ? "udp" : "tcp", errno, strerror(errno));
+		goto out;
+	}
+
+	if (udp)
+		udp_adopted[p] = true;
+	else
+		tcp_adopted[p] = true;
+	rc = 0;
+
+ out:
+	close(fd);
+	return rc;
+}
+
+/**
+ * @brief Make the SVCXPRT of a bound UDP socket
+ *
+ * @param[in] fd   The socket
+ * @param[in] chan Event channel receiving on it
+ * @param[in] prot Protocol it serves
+ */
+static SVCXPRT *create_udp_xprt(int fd, uint32_t chan, protos prot)
+{
+	SVCXPRT *xprt;
+
+	xprt = svc_dg_create(fd,
+			     nfs_param.core_param.rpc.max_send_buffer_size,
+			     nfs_param.core_param.rpc.max_recv_buffer_size);
+	if (xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/UDP SVCXPRT",
 			 tags[prot]);
 
 	/* Hook xp_getreq */
-	(void)SVC_CONTROL(udp_xprt[prot], SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
+	(void)SVC_CONTROL(xprt, SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(udp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
 	/* Setup private data */
-	(udp_xprt[prot])->xp_u1 =
-		alloc_gsh_xprt_private(udp_xprt[prot],
-				       XPRT_PRIVATE_FLAG_NONE);
+	xprt->xp_u1 = alloc_gsh_xprt_private(xprt, XPRT_PRIVATE_FLAG_NONE);
 
 	/* bind xprt to channel--unregister it from the global event
 	 * channel (if applicable) */
-	(void)svc_rqst_evchan_reg(rpc_evchan[UDP_EVENT_CHAN].chan_id,
-				  udp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(chan, xprt, SVC_RQST_FLAG_XPRT_UREG);
+
+	return xprt;
 }
 
-void Create_tcp(protos prot)
+void Create_udp(protos prot)
 {
-	tcp_xprt[prot] =
-		svc_vc_create2(tcp_socket[prot],
-			       nfs_param.core_param.rpc.max_send_buffer_size,
-			       nfs_param.core_param.rpc.max_recv_buffer_size,
-			       SVC_VC_CREATE_LISTEN);
-	if (tcp_xprt[prot] == NULL)
+	udp_xprt[prot] = create_udp_xprt(udp_socket[prot],
+					 rpc_evchan[UDP_EVENT_CHAN].chan_id,
+					 prot);
+}
+
+/**
+ * @brief Make the listening SVCXPRT of a bound TCP socket
+ *
+ * @param[in] fd   The socket
+ * @param[in] chan Event channel accepting its connections
+ * @param[in] prot Protocol it serves
+ */
+static SVCXPRT *create_tcp_listener(int fd, uint32_t chan, protos prot)
+{
+	SVCXPRT *xprt;
+
+	xprt = svc_vc_create2(fd,
+			      nfs_param.core_param.rpc.max_send_buffer_size,
+			      nfs_param.core_param.rpc.max_recv_buffer_size,
+			      SVC_VC_CREATE_LISTEN);
+	if (xprt == NULL)
 		LogFatal(COMPONENT_DISPATCH, "Cannot allocate %s/TCP SVCXPRT",
 			 tags[prot]);
 
 	/* bind xprt to channel--unregister it from the global event
 	 * channel (if applicable) */
-	(void)svc_rqst_evchan_reg(rpc_evchan[TCP_RDVS_CHAN].chan_id,
-				  tcp_xprt[prot], SVC_RQST_FLAG_XPRT_UREG);
+	(void)svc_rqst_evchan_reg(chan, xprt, SVC_RQST_FLAG_XPRT_UREG);
 
 	/* Hook xp_getreq */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
+	(void)SVC_CONTROL(xprt, SVCSET_XP_GETREQ, nfs_rpc_getreq_ng);
 
 	/* Hook xp_recv_user_data -- allocate new xprts to event channels */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_RECV_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_RECV_USER_DATA,
 			  nfs_rpc_recv_user_data);
 
 	/* Hook xp_free_user_data (finalize/free private data) */
-	(void)SVC_CONTROL(tcp_xprt[prot], SVCSET_XP_FREE_USER_DATA,
+	(void)SVC_CONTROL(xprt, SVCSET_XP_FREE_USER_DATA,
 			  nfs_rpc_free_user_data);
 
 	/* Setup private data */
-	(tcp_xprt[prot])->xp_u1 =
-		alloc_gsh_xprt_private(tcp_xprt[prot],
-				       XPRT_PRIVATE_FLAG_NONE);
+	xprt->xp_u1 = alloc_gsh_xprt_private(xprt, XPRT_PRIVATE_FLAG_NONE);
+
+	return xprt;
+}
+
+void Create_tcp(protos prot)
+{
+	tcp_xprt[prot] = create_tcp_listener(tcp_socket[prot],
+					     rpc_evchan[TCP_RDVS_CHAN].chan_id,
+					     prot);
 }
 
 void create_vsock(void)
@@ -351,6 +491,101 @@ void create_vsock(void)
 				       XPRT_PRIVATE_FLAG_NONE);
 }
 
+/**
+ * @brief Open the extra NFS listeners of TCP_Listeners
+ *
+ * Each is bound to the address of the NFS TCP socket with SO_REUSEPORT,
+ * so the kernel spreads the incoming connections over them, and accepts
+ * on its own event channel.
+ */
+static void create_nfs_listeners(void)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	uint32_t i;
+	int fd;
+
+	if (getsockname(tcp_socket[P_NFS], (struct sockaddr *)&addr,
+			&addrlen) != 0)
+		LogFatal(COMPONENT_DISPATCH,
+			 "Cannot get the %s tcp socket address, error %d (%s)",
+			 tags[P_NFS], errno, strerror(errno));
+
+	for (i = 0; i < n_listeners; i++) {
+		fd = socket(addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+		if (fd == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate a tcp socket for %s, error %d(%s)",
+				 tags[P_NFS], errno, strerror(errno));
+		listener_socket[i] = fd;
+
+		if (tcp_socket_setopts(fd, P_NFS))
+			LogFatal(COMPONENT_DISPATCH,
+				 "Error setting socket option for proto %d, %s",
+				 P_NFS, tags[P_NFS]);
+
+		if (bind(fd, (struct sockaddr *)&addr, addrlen) != 0)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot bind %s tcp listener %u, error %d (%s)",
+				 tags[P_NFS], i + 1, errno, strerror(errno));
+
+		(void)create_tcp_listener(fd, listener_evchan[i].chan_id,
+					  P_NFS);
+	}
+
+	LogInfo(COMPONENT_DISPATCH, "%u %s tcp listeners",
+		n_listeners + 1, tags[P_NFS]);
+}
+
+static int udp_socket_setopts(int fd, int p);
+
+/**
+ * @brief Open the extra UDP sockets of UDP_Listeners for a protocol
+ *
+ * Each is bound to the address of the UDP socket of the protocol with
+ * SO_REUSEPORT, so the kernel spreads the datagrams of the clients
+ * over them, and receives on its own event channel.
+ *
+ * @param[in] prot Protocol
+ */
+static void create_udp_listeners(protos prot)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	uint32_t i;
+	int fd;
+
+	if (getsockname(udp_socket[prot], (struct sockaddr *)&addr,
+			&addrlen) != 0)
+		LogFatal(COMPONENT_DISPATCH,
+			 "Cannot get the %s udp socket address, error %d (%s)",
+			 tags[prot], errno, strerror(errno));
+
+	for (i = 0; i < n_udp_listeners; i++) {
+		fd = socket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+		if (fd == -1)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot allocate a udp socket for %s, error %d(%s)",
+				 tags[prot], errno, strerror(errno));
+		udp_listener_socket[i * P_COUNT + prot] = fd;
+
+		if (udp_socket_setopts(fd, prot))
+			LogFatal(COMPONENT_DISPATCH,
+				 "Error setting socket option for proto %d, %s",
+				 prot, tags[prot]);
+
+		if (bind(fd, (struct sockaddr *)&addr, addrlen) != 0)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot bind %s udp socket %u, error %d (%s)",
+				 tags[prot], i + 1, errno, strerror(errno));
+
+		(void)create_udp_xprt(fd, udp_evchan[i].chan_id, prot);
+	}
+
+	LogInfo(COMPONENT_DISPATCH, "%u %s udp sockets",
+		n_udp_listeners + 1, tags[prot]);
+}
+
 /**
  * @brief Create the SVCXPRT for each protocol in use
  */
@@ -363,7 +598,11 @@ void Create_SVCXPRTs(void)
 		if (nfs_protocol_enabled(p)) {
 			Create_udp(p);
 			Create_tcp(p);
+			if (n_udp_listeners > 0)
+				create_udp_listeners(p);
 		}
+	if (nfs_protocol_enabled(P_NFS) && n_listeners > 0)
+		create_nfs_listeners();
 #ifdef RPC_VSOCK
 	if (vsock)
 		create_vsock();
@@ -407,7 +646,7 @@ static int Bind_sockets_V6(void)
 				return -1;
 			}
 
-			rc = bind(udp_socket[p],
+			rc = udp_adopted[p] ? 0 : bind(udp_socket[p],
 			      (struct sockaddr *)pdatap->bindaddr_udp6.addr.buf,
 				  (socklen_t) pdatap->si_udp6.si_alen);
 			if (rc == -1) {
@@ -441,7 +680,7 @@ static int Bind_sockets_V6(void)
 				return -1;
 			}
 
-			rc = bind(tcp_socket[p],
+			rc = tcp_adopted[p] ? 0 : bind(tcp_socket[p],
 				  (struct sockaddr *)
 				   pdatap->bindaddr_tcp6.addr.buf,
 				 (socklen_t) pdatap->si_tcp6.si_alen);
@@ -495,7 +734,7 @@ static int Bind_sockets_V4(void)
 				return -1;
 			}
 
-			rc = bind(udp_socket[p],
+			rc = udp_adopted[p] ? 0 : bind(udp_socket[p],
 				  (struct sockaddr *)
 				  pdatap->bindaddr_udp6.addr.buf,
 				  (socklen_t) pdatap->si_udp6.si_alen);
@@ -530,7 +769,7 @@ static int Bind_sockets_V4(void)
 				return -1;
 			}
 
-			rc = bind(tcp_socket[p],
+			rc = tcp_adopted[p] ? 0 : bind(tcp_socket[p],
 				  (struct sockaddr *)
 				  pdatap->bindaddr_tcp6.addr.buf,
 				  (socklen_t) pdatap->si_tcp6.si_alen);
@@ -601,39 +840,38 @@ void Bind_sockets(void)
 }
 
 /**
- * @brief Function to set the socket options on the allocated
- *	  udp and tcp sockets
+ * @brief Set the options of a TCP socket
  *
+ * The NFS sockets share their port when there are TCP_Listeners.
  */
-static int alloc_socket_setopts(int p)
+static int tcp_socket_setopts(int fd, int p)
 {
 	int one = 1;
 	const struct nfs_core_param *nfs_cp = &nfs_param.core_param;
 
-	/* Use SO_REUSEADDR in order to avoid wait
-	 * the 2MSL timeout */
-	if (setsockopt(udp_socket[p],
+	if (setsockopt(fd,
 		       SOL_SOCKET, SO_REUSEADDR,
 		       &one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
-			"Bad udp socket options for %s, error %d(%s)",
+			"Bad tcp socket option reuseaddr for %s, error %d(%s)",
 			tags[p], errno, strerror(errno));
 
 		return -1;
 	}
 
-	if (setsockopt(tcp_socket[p],
-		       SOL_SOCKET, SO_REUSEADDR,
-		       &one, sizeof(one))) {
+#ifdef SO_REUSEPORT
+	if (p == P_NFS && nfs_cp->tcp_listeners > 1 &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) {
 		LogWarn(COMPONENT_DISPATCH,
-			"Bad tcp socket option reuseaddr for %s, error %d(%s)",
+			"Bad tcp socket option reuseport for %s, error %d(%s)",
 			tags[p], errno, strerror(errno));
 
 		return -1;
 	}
+#endif
 
 	if (nfs_cp->enable_tcp_keepalive) {
-		if (setsockopt(tcp_socket[p],
+		if (setsockopt(fd,
 			       SOL_SOCKET, SO_KEEPALIVE,
 			       &one, sizeof(one))) {
 			LogWarn(COMPONENT_DISPATCH,
@@ -644,7 +882,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepcnt) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPCNT,
+			if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT,
 				       &nfs_cp->tcp_keepcnt,
 				       sizeof(nfs_cp->tcp_keepcnt))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -656,7 +894,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepidle) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP, TCP_KEEPIDLE,
+			if (setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE,
 				       &nfs_cp->tcp_keepidle,
 				       sizeof(nfs_cp->tcp_keepidle))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -668,7 +906,7 @@ static int alloc_socket_setopts(int p)
 		}
 
 		if (nfs_cp->tcp_keepintvl) {
-			if (setsockopt(tcp_socket[p], IPPROTO_TCP,
+			if (setsockopt(fd, IPPROTO_TCP,
 				       TCP_KEEPINTVL, &nfs_cp->tcp_keepintvl,
 				       sizeof(nfs_cp->tcp_keepintvl))) {
 				LogWarn(COMPONENT_DISPATCH,
@@ -680,9 +918,44 @@ static int alloc_socket_setopts(int p)
 		}
 	}
 
+	return 0;
+}
+
+/**
+ * @brief Set the options of a UDP socket
+ *
+ * The UDP sockets share their port when there are UDP_Listeners.
+ */
+static int udp_socket_setopts(int fd, int p)
+{
+	int one = 1;
+
+	/* Use SO_REUSEADDR in order to avoid wait
+	 * the 2MSL timeout */
+	if (setsockopt(fd,
+		       SOL_SOCKET, SO_REUSEADDR,
+		       &one, sizeof(one))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad udp socket options for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+
+#ifdef SO_REUSEPORT
+	if (nfs_param.core_param.udp_listeners > 1 &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Bad udp socket option reuseport for %s, error %d(%s)",
+			tags[p], errno, strerror(errno));
+
+		return -1;
+	}
+#endif
+
 	/* We prefer using non-blocking socket
 	 * in the specific case */
-	if (fcntl(udp_socket[p], F_SETFL, FNDELAY) == -1) {
+	if (fcntl(fd, F_SETFL, FNDELAY) == -1) {
 		LogWarn(COMPONENT_DISPATCH,
 			"Cannot set udp socket for %s as non blocking, error %d(%s)",
 			tags[p], errno, strerror(errno));
@@ -693,6 +966,22 @@ static int alloc_socket_setopts(int p)
 	return 0;
 }
 
+/**
+ * @brief Function to set the socket options on the allocated
+ *	  udp and tcp sockets
+ *
+ */
+static int alloc_socket_setopts(int p)
+{
+	if (udp_socket_setopts(udp_socket[p], p))
+		return -1;
+
+	if (tcp_socket_setopts(tcp_socket[p], p))
+		return -1;
+
+	return 0;
+}
+
 /**
  * @brief Allocate the tcp and udp sockets for the nfs daemon
  * using V4 interfaces
@@ -855,7 +1144,9 @@ void Clean_RPC(void)
    * @todo Consider the need to call Svc_dg_destroy for UDP & ?? for
    * TCP based services
    */
-	unregister_rpc();
+	/* The next server keeps the registrations */
+	if (!nfs_handoff_done())
+		unregister_rpc();
 	close_rpc_fd();
 }
 
@@ -993,6 +1284,54 @@ void nfs_Init_svc(void)
 		/* XXX bail?? */
 	}
 
+#ifdef SO_REUSEPORT
+	n_listeners = nfs_param.core_param.tcp_listeners - 1;
+#else
+	if (nfs_param.core_param.tcp_listeners > 1)
+		LogWarn(COMPONENT_DISPATCH,
+			"No SO_REUSEPORT, TCP_Listeners ignored");
+#endif
+	if (n_listeners > 0) {
+		listener_evchan = gsh_calloc(n_listeners,
+					     sizeof(struct rpc_evchan));
+		listener_socket = gsh_malloc(n_listeners * sizeof(int));
+	}
+	for (ix = 0; ix < n_listeners; ++ix) {
+		listener_socket[ix] = -1;
+		code = svc_rqst_new_evchan(&listener_evchan[ix].chan_id,
+					   NULL /* u_data */,
+					   SVC_RQST_FLAG_NONE);
+		if (code)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot create TI-RPC listener event channel (%d, %d)",
+				 ix, code);
+	}
+
+#ifdef SO_REUSEPORT
+	n_udp_listeners = nfs_param.core_param.udp_listeners - 1;
+#else
+	if (nfs_param.core_param.udp_listeners > 1)
+		LogWarn(COMPONENT_DISPATCH,
+			"No SO_REUSEPORT, UDP_Listeners ignored");
+#endif
+	if (n_udp_listeners > 0) {
+		udp_evchan = gsh_calloc(n_udp_listeners,
+					sizeof(struct rpc_evchan));
+		udp_listener_socket = gsh_malloc(n_udp_listeners * P_COUNT *
+						 sizeof(int));
+	}
+	for (ix = 0; ix < n_udp_listeners * P_COUNT; ++ix)
+		udp_listener_socket[ix] = -1;
+	for (ix = 0; ix < n_udp_listeners; ++ix) {
+		code = svc_rqst_new_evchan(&udp_evchan[ix].chan_id,
+					   NULL /* u_data */,
+					   SVC_RQST_FLAG_NONE);
+		if (code)
+			LogFatal(COMPONENT_DISPATCH,
+				 "Cannot create TI-RPC udp event channel (%d, %d)",
+				 ix, code);
+	}
+
 	/* Get the netconfig entries from /etc/netconfig */
 	netconfig_udpv4 = (struct netconfig *)getnetconfigent("udp");
 	if (netconfig_udpv4 == NULL)
@@ -1032,6 +1371,9 @@ void nfs_Init_svc(void)
 	/* Allocate the UDP and TCP sockets for the RPC */
 	Allocate_sockets();
 
+	/* Or take those of the server we replace */
+	nfs_handoff_receive();
+
 	if ((NFS_options & CORE_OPTION_NFSV3) != 0) {
 		/* Some log that can be useful when debug ONC/RPC
 		 * and RPCSEC_GSS matter */
@@ -1071,6 +1413,10 @@ void nfs_Init_svc(void)
 		Create_SVCXPRTs();
 	}
 
+#ifdef USE_RPC_TLS
+	nfs_rpc_tls_init();
+#endif
+
 #ifdef _HAVE_GSSAPI
 	/* Acquire RPCSEC_GSS basis if needed */
 	if (nfs_param.krb5_param.active_krb5) {
@@ -1143,9 +1489,27 @@ void nfs_rpc_dispatch_threads(pthread_attr_t *attr_thr)
 				 "Could not create rpc_dispatcher_thread #%u, error = %d (%s)",
 				 ix, errno, strerror(errno));
 	}
+	for (ix = 0; ix < n_listeners; ++ix) {
+		code = pthread_create(&listener_evchan[ix].thread_id, attr_thr,
+				      rpc_dispatcher_thread,
+				      (void *)&listener_evchan[ix].chan_id);
+		if (code != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create listener rpc_dispatcher_thread #%u, error = %d (%s)",
+				 ix, errno, strerror(errno));
+	}
+	for (ix = 0; ix < n_udp_listeners; ++ix) {
+		code = pthread_create(&udp_evchan[ix].thread_id, attr_thr,
+				      rpc_dispatcher_thread,
+				      (void *)&udp_evchan[ix].chan_id);
+		if (code != 0)
+			LogFatal(COMPONENT_THREAD,
+				 "Could not create udp rpc_dispatcher_thread #%u, error = %d (%s)",
+				 ix, errno, strerror(errno));
+	}
 	LogInfo(COMPONENT_THREAD,
 		"%d rpc dispatcher threads were started successfully",
-		N_EVENT_CHAN);
+		N_EVENT_CHAN + n_listeners + n_udp_listeners);
 }
 
 void nfs_rpc_dispatch_stop(void)
@@ -1156,6 +1520,12 @@ void nfs_rpc_dispatch_stop(void)
 		svc_rqst_thrd_signal(rpc_evchan[ix].chan_id,
 				     SVC_RQST_SIGNAL_SHUTDOWN);
 	}
+	for (ix = 0; ix < n_listeners; ++ix)
+		svc_rqst_thrd_signal(listener_evchan[ix].chan_id,
+				     SVC_RQST_SIGNAL_SHUTDOWN);
+	for (ix = 0; ix < n_udp_listeners; ++ix)
+		svc_rqst_thrd_signal(udp_evchan[ix].chan_id,
+				     SVC_RQST_SIGNAL_SHUTDOWN);
 }
 
 /**
@@ -1173,9 +1543,14 @@ void nfs_rpc_dispatch_stop(void)
  *
  * @return Always returns 0.
  */
+/* The accepted connections, for their statistics */
+static pthread_mutex_t xprts_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head xprts = GLIST_HEAD_INIT(xprts);
+
 static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
 				    const u_int flags, void *u_data)
 {
+	gsh_xprt_private_t *xu;
 	static uint32_t next_chan = TCP_EVCHAN_0;
 	static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
 	uint32_t tchan;
@@ -1188,14 +1563,20 @@ static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
 		next_chan = TCP_EVCHAN_0;
 
 	/* setup private data (freed when xprt is destroyed) */
-	newxprt->xp_u1 =
-	    alloc_gsh_xprt_private(newxprt, XPRT_PRIVATE_FLAG_NONE);
+	xu = alloc_gsh_xprt_private(newxprt, XPRT_PRIVATE_FLAG_NONE);
+	xu->active = xu->created;
+	newxprt->xp_u1 = xu;
 
-	/* NB: xu->drc is allocated on first request--we need shared
-	 * TCP DRC for v3, but per-connection for v4 */
+	/* NB: xu->drc and xu->perms_cache are allocated on first
+	 * request, most of a large client population is idle; we need
+	 * shared TCP DRC for v3, but per-connection for v4 */
 
 	PTHREAD_MUTEX_unlock(&mtx);
 
+	PTHREAD_MUTEX_lock(&xprts_mtx);
+	glist_add_tail(&xprts, &xu->xprts);
+	PTHREAD_MUTEX_unlock(&xprts_mtx);
+
 	(void)svc_rqst_evchan_reg(rpc_evchan[tchan].chan_id, newxprt,
 				  SVC_RQST_FLAG_NONE);
 
@@ -1209,99 +1590,373 @@ static u_int nfs_rpc_recv_user_data(SVCXPRT *xprt, SVCXPRT *newxprt,
  */
 static void nfs_rpc_free_user_data(SVCXPRT *xprt)
 {
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *)xprt->xp_u1;
+
+	if (xu && xu->xprts.next != NULL) {
+		PTHREAD_MUTEX_lock(&xprts_mtx);
+		glist_del(&xu->xprts);
+		PTHREAD_MUTEX_unlock(&xprts_mtx);
+	}
+
 	if (xprt->xp_u2) {
 		nfs_dupreq_put_drc(xprt, xprt->xp_u2, DRC_FLAG_RELEASE);
 		xprt->xp_u2 = NULL;
 	}
+	if (xu && xu->perms_cache != NULL)
+		export_perms_cache_free(xu->perms_cache);
+	if (xu && xu->client != NULL)
+		put_gsh_client(xu->client);
 	free_gsh_xprt_private(xprt);
 }
 
+/**
+ * @brief Drop the references the connections keep on an export
+ *
+ * @param[in] export Export being removed
+ */
+void nfs_rpc_drop_export(struct gsh_export *export)
+{
+	struct glist_head *glist;
+	gsh_xprt_private_t *xu;
+
+	PTHREAD_MUTEX_lock(&xprts_mtx);
+	glist_for_each(glist, &xprts) {
+		xu = glist_entry(glist, gsh_xprt_private_t, xprts);
+		if (xu->perms_cache != NULL)
+			export_perms_cache_drop(xu->perms_cache, export);
+	}
+	PTHREAD_MUTEX_unlock(&xprts_mtx);
+}
+
+/**
+ * @brief The access decisions of a connection, NULL if not one
+ *
+ * Allocated by the first request that looks for them.
+ *
+ * @param[in] xprt Transport of the request
+ */
+struct export_perms_cache *nfs_rpc_xprt_perms_cache(SVCXPRT *xprt)
+{
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *)xprt->xp_u1;
+	struct export_perms_cache *cache;
+
+	/* only the accepted connections are on the list */
+	if (xu == NULL || xu->xprts.next == NULL)
+		return NULL;
+
+	cache = atomic_fetch_voidptr((void **)&xu->perms_cache);
+	if (likely(cache != NULL))
+		return cache;
+
+	cache = export_perms_cache_alloc();
+	if (!atomic_cmpxchg_voidptr((void **)&xu->perms_cache, NULL, cache)) {
+		/* another request of the connection was first */
+		export_perms_cache_free(cache);
+		cache = atomic_fetch_voidptr((void **)&xu->perms_cache);
+	}
+
+	return cache;
+}
+
+/**
+ * @brief Trim the DRCs of the connections gone idle
+ *
+ * Called by the reaper.  A connection no request came on for
+ * DRC_TCP_Idle_Trim seconds keeps only its small private data and the
+ * DRC header; replies and tables come back with the next requests.
+ */
+void nfs_rpc_trim_idle_xprts(void)
+{
+	time_t idle = nfs_param.core_param.drc.tcp.idle_trim;
+	time_t now = time(NULL);
+	struct glist_head *g;
+	gsh_xprt_private_t *xu;
+	uint32_t trimmed = 0, xprts = 0;
+	drc_t *drc;
+
+	if (idle == 0)
+		return;
+
+	/* the DRC of a listed connection is not released until it is
+	 * off the list
+	 */
+	PTHREAD_MUTEX_lock(&xprts_mtx);
+	glist_for_each(g, &xprts) {
+		xu = glist_entry(g, gsh_xprt_private_t, xprts);
+		if (now - atomic_fetch_time_t(&xu->active) < idle ||
+		    atomic_fetch_uint32_t(&xu->xprt->xp_requests) != 0)
+			continue;
+		drc = atomic_fetch_voidptr(&xu->xprt->xp_u2);
+		if (drc == NULL)
+			continue;
+		trimmed += nfs_dupreq_trim_idle(drc, idle);
+		++xprts;
+	}
+	PTHREAD_MUTEX_unlock(&xprts_mtx);
+
+	if (trimmed > 0)
+		LogDebug(COMPONENT_DISPATCH,
+			 "Trimmed %" PRIu32
+			 " cached replies of %" PRIu32 " idle connections",
+			 trimmed, xprts);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the accepted connections
+ *
+ * For each: the peer address, socket, seconds since it was accepted,
+ * requests decoded and in flight, whether it is stalled now, the times
+ * it was stalled and the ns it spent stalled, the bytes the kernel
+ * received and sent on it, and the bytes waiting in its receive and
+ * send queues.  Then the seconds since its last request, the requests
+ * its DRC caches, and the bytes the connection holds in the server,
+ * its DRC included but not the TI-RPC buffers.
+ *
+ * @param[out] iter Reply
+ */
+
+void nfs_rpc_dbus_xprts(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct glist_head *g;
+	gsh_xprt_private_t *xu;
+	struct timespec ts;
+	struct sock_stats sst;
+	sockaddr_t addr;
+	char addrbuf[SOCK_NAME_MAX + 1];
+	char *addrp = addrbuf;
+	uint32_t fd, inflight, stalls, drc_entries;
+	uint64_t age, rpcs, stall_ns, idle, held;
+	drc_t *drc;
+	dbus_bool_t stalled;
+
+	now(&ts);
+	dbus_append_timestamp(iter, &ts);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 XPRTS_REPLY_ARRAY_TYPE, &array_iter);
+
+	PTHREAD_MUTEX_lock(&xprts_mtx);
+	glist_for_each(g, &xprts) {
+		xu = glist_entry(g, gsh_xprt_private_t, xprts);
+
+		if (copy_xprt_addr(&addr, xu->xprt))
+			sprint_sockaddr(&addr, addrbuf, sizeof(addrbuf));
+		else
+			strcpy(addrbuf, "<unresolved>");
+		fd = xu->xprt->xp_fd;
+		inflight = atomic_fetch_uint32_t(&xu->xprt->xp_requests);
+		age = time(NULL) - xu->created;
+		rpcs = atomic_fetch_uint64_t(&xu->rpcs);
+		idle = time(NULL) - atomic_fetch_time_t(&xu->active);
+		held = sizeof(*xu);
+		if (atomic_fetch_voidptr((void **)&xu->perms_cache) != NULL)
+			held += sizeof(struct export_perms_cache);
+		drc_entries = 0;
+		drc = atomic_fetch_voidptr(&xu->xprt->xp_u2);
+		if (drc != NULL)
+			held += nfs_dupreq_drc_mem(drc, &drc_entries);
+		if (sock_stats(xu->xprt->xp_fd, &sst) != 0)
+			memset(&sst, 0, sizeof(sst));
+
+		PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
+		stalled = (xu->flags & XPRT_PRIVATE_FLAG_STALLED) != 0;
+		stalls = xu->stalls;
+		stall_ns = xu->stall_ns;
+		if (stalled)
+			stall_ns += timespec_diff(&xu->stalled, &ts);
+		PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &addrp);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &fd);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &age);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &rpcs);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &inflight);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_BOOLEAN,
+					       &stalled);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &stalls);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stall_ns);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sst.bytes_in);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sst.bytes_out);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &sst.recv_q);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &sst.send_q);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &idle);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &drc_entries);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &held);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	PTHREAD_MUTEX_unlock(&xprts_mtx);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif /* USE_DBUS */
+
 uint32_t nfs_rpc_outstanding_reqs_est(void)
 {
 	static uint32_t ctr;
 	static uint32_t nreqs;
 	struct req_q_pair *qpair;
 	uint32_t treqs;
+	uint32_t rq;
 	int ix;
 
 	if ((atomic_inc_uint32_t(&ctr) % 10) != 0)
 		return atomic_fetch_uint32_t(&nreqs);
 
 	treqs = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		treqs += atomic_fetch_uint32_t(&qpair->producer.size);
-		treqs += atomic_fetch_uint32_t(&qpair->consumer.size);
+	for (rq = 0; rq < nfs_req_st.reqs.n_runq; ++rq) {
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &(nfs_req_st.reqs.runq[rq].nfs_request_q
+				  .qset[ix]);
+			treqs += req_q_ring_size(&qpair->ring);
+			treqs += atomic_fetch_uint32_t(&qpair->overflow.size);
+		}
 	}
+	if (nfs_param.core_param.fair_queue)
+		treqs += nfs_rpc_fairq_size();
 
 	atomic_store_uint32_t(&nreqs, treqs);
 	return treqs;
 }
 
+/**
+ * @brief Requests counted against a transport's quota
+ *
+ * With fair queuing these are the requests its client host has queued,
+ * across all of its transports, so backpressure is per tenant.
+ */
+static inline uint32_t stallq_xprt_reqs(SVCXPRT *xprt)
+{
+	if (nfs_param.core_param.fair_queue)
+		return nfs_rpc_fairq_backlog(xprt);
+	return xprt->xp_requests;
+}
+
 static inline bool stallq_should_unstall(SVCXPRT *xprt)
 {
-	return ((xprt->xp_requests
+	return ((stallq_xprt_reqs(xprt)
 		 < nfs_param.core_param.dispatch_max_reqs_xprt / 2)
 		|| (xprt->xp_flags & SVC_XPRT_FLAG_DESTROYED));
 }
 
-void thr_stallq(struct fridgethr_context *thr_ctx)
+/**
+ * @brief Take a transport off the stallq and resume its reads
+ *
+ * Called with the stallq mutex and the transport's xp_lock held, drops
+ * the reference the stallq held.
+ */
+static void stallq_unstall(SVCXPRT *xprt, gsh_xprt_private_t *xu)
+{
+	struct timespec ts;
+
+	LogDebug(COMPONENT_DISPATCH, "unstalling stalled xprt %p", xprt);
+
+	now(&ts);
+	xu->stall_ns += timespec_diff(&xu->stalled, &ts);
+	glist_del(&xu->stallq);
+	atomic_dec_uint32_t(&nfs_req_st.stallq.stalled);
+	atomic_clear_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_STALLED);
+	(void)svc_rqst_rearm_events(xprt, SVC_RQST_FLAG_NONE);
+	PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+
+	/* drop stallq ref */
+	gsh_xprt_unref(xprt, XPRT_PRIVATE_FLAG_LOCKED, __func__, __LINE__);
+}
+
+/**
+ * @brief Resume the stalled transports that are below their low mark
+ *
+ * Called by the workers as each request completes and gives its credit
+ * back, so a transport resumes as soon as it may, without polling.
+ */
+void nfs_rpc_return_credit(void)
 {
 	gsh_xprt_private_t *xu;
 	struct glist_head *l;
 	SVCXPRT *xprt;
 
-	while (1) {
-		thread_delay_ms(1000);
-		PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
+	if (likely(atomic_fetch_uint32_t(&nfs_req_st.stallq.stalled) == 0))
+		return;
+
+	PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
  restart:
-		if (nfs_req_st.stallq.stalled == 0) {
-			nfs_req_st.stallq.active = false;
-			PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
-			break;
-		}
+	glist_for_each(l, &nfs_req_st.stallq.q) {
+		xu = glist_entry(l, gsh_xprt_private_t, stallq);
+		xprt = xu->xprt;
 
-		glist_for_each(l, &nfs_req_st.stallq.q) {
-			xu = glist_entry(l, gsh_xprt_private_t, stallq);
-			xprt = xu->xprt;
+		if (!stallq_should_unstall(xprt))
+			continue;
 
-			/* handle stalled xprts that idle out */
-			if (stallq_should_unstall(xprt)) {
-				/* lock ordering
-				 * (cf. nfs_rpc_cond_stall_xprt) */
-				PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
-				/* !LOCKED */
-				LogDebug(COMPONENT_DISPATCH,
-					 "unstalling stalled xprt %p", xprt);
-				PTHREAD_MUTEX_lock(&xprt->xp_lock);
-				PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
-				/* check that we're still stalled */
-				if (xu->flags & XPRT_PRIVATE_FLAG_STALLED) {
-					glist_del(&xu->stallq);
-					--(nfs_req_st.stallq.stalled);
-					atomic_clear_uint16_t_bits(&xu->flags,
-						XPRT_PRIVATE_FLAG_STALLED);
-					(void)svc_rqst_rearm_events(
-						xprt, SVC_RQST_FLAG_NONE);
-					/* drop stallq ref */
-					gsh_xprt_unref(
-						xprt, XPRT_PRIVATE_FLAG_LOCKED,
-						__func__, __LINE__);
-				}
-				goto restart;
-			}
-		}
+		/* lock ordering (cf. nfs_rpc_cond_stall_xprt), the stallq
+		 * ref keeps xprt around meanwhile */
 		PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+		PTHREAD_MUTEX_lock(&xprt->xp_lock);
+		PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
+
+		/* check that we're still stalled */
+		if (xu->flags & XPRT_PRIVATE_FLAG_STALLED) {
+			stallq_unstall(xprt, xu);
+			PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
+		} else {
+			PTHREAD_MUTEX_unlock(&xprt->xp_lock);
+		}
+		goto restart;
 	}
+	PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+}
 
-	LogDebug(COMPONENT_DISPATCH, "stallq idle, thread exit");
+/**
+ * @brief Decoder pool for a transport
+ *
+ * With Decoder_Affinity, the pool pinned to the domain of the CPU that
+ * took the transport's last packet, its request then goes to the run
+ * queue of that domain too.
+ */
+static struct fridgethr *nfs_rpc_decoder_fridge(SVCXPRT *xprt)
+{
+#ifdef SO_INCOMING_CPU
+	socklen_t len = sizeof(int);
+	int domain;
+	int cpu;
+
+	if (n_decoder_fridges == 0)
+		return req_fridge;
+
+	if (getsockopt(xprt->xp_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu,
+		       &len) != 0)
+		return req_fridge;
+
+	domain = fridgethr_affinity_domain(nfs_req_st.reqs.affinity, cpu);
+	if (domain < 0)
+		return req_fridge;
+
+	return decoder_fridges[domain % n_decoder_fridges];
+#else
+	return req_fridge;
+#endif
 }
 
 static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 {
 	gsh_xprt_private_t *xu;
-	bool activate = false;
-	uint32_t nreqs = xprt->xp_requests;
+	uint32_t nreqs = stallq_xprt_reqs(xprt);
 
 	/* check per-xprt quota */
 	if (likely(nreqs < nfs_param.core_param.dispatch_max_reqs_xprt)) {
@@ -1329,31 +1984,30 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 	LogDebug(COMPONENT_DISPATCH, "xprt %p has %u reqs, marking stalled",
 		 xprt, nreqs);
 
-	/* ok, need to stall */
+	/* ok, need to stall; its reads stay disarmed until a completing
+	 * request brings it back under the low mark */
 	PTHREAD_MUTEX_lock(&nfs_req_st.stallq.mtx);
 
 	glist_add_tail(&nfs_req_st.stallq.q, &xu->stallq);
-	++(nfs_req_st.stallq.stalled);
+	atomic_inc_uint32_t(&nfs_req_st.stallq.stalled);
+	++(xu->stalls);
+	now(&xu->stalled);
 	atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_STALLED);
-	PTHREAD_MUTEX_unlock(&xprt->xp_lock);
 
-	/* if no thread is servicing the stallq, start one */
-	if (!nfs_req_st.stallq.active) {
-		nfs_req_st.stallq.active = true;
-		activate = true;
+	/* the last credit may have come back before it was on the stallq */
+	if (stallq_should_unstall(xprt)) {
+		glist_del(&xu->stallq);
+		atomic_dec_uint32_t(&nfs_req_st.stallq.stalled);
+		--(xu->stalls);
+		atomic_clear_uint16_t_bits(&xu->flags,
+					   XPRT_PRIVATE_FLAG_STALLED);
+		PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+		PTHREAD_MUTEX_unlock(&xprt->xp_lock);
+		return false;
 	}
-	PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
-
-	if (activate) {
-		int rc = 0;
 
-		LogDebug(COMPONENT_DISPATCH, "starting stallq service thread");
-		rc = fridgethr_submit(req_fridge, thr_stallq,
-				      NULL /* no arg */);
-		if (rc != 0)
-			LogCrit(COMPONENT_DISPATCH,
-				"Failed to start stallq: %d", rc);
-	}
+	PTHREAD_MUTEX_unlock(&nfs_req_st.stallq.mtx);
+	PTHREAD_MUTEX_unlock(&xprt->xp_lock);
 
 	/* stalled */
 	return true;
@@ -1362,7 +2016,10 @@ static bool nfs_rpc_cond_stall_xprt(SVCXPRT *xprt)
 void nfs_rpc_queue_init(void)
 {
 	struct fridgethr_params reqparams;
+	struct req_runq *runq;
 	struct req_q_pair *qpair;
+	uint32_t nslots = 1;
+	uint32_t rq;
 	int rc = 0;
 	int ix;
 
@@ -1377,6 +2034,9 @@ void nfs_rpc_queue_init(void)
 	reqparams.deferment = fridgethr_defer_block;
 	reqparams.block_delay =
 		nfs_param.core_param.decoder_fridge_block_timeout;
+	/* submit to idle decoders without the fridge mutex */
+	reqparams.fast_slots = 1024;
+	reqparams.spin_us = nfs_param.core_param.decoder_spin;
 
 	/* decoder thread pool */
 	rc = fridgethr_init(&req_fridge, "decoder", &reqparams);
@@ -1384,24 +2044,81 @@ void nfs_rpc_queue_init(void)
 		LogFatal(COMPONENT_DISPATCH,
 			 "Unable to initialize decoder thread pool: %d", rc);
 
-	/* queues */
-	pthread_spin_init(&nfs_req_st.reqs.sp, PTHREAD_PROCESS_PRIVATE);
+	/* one run queue per affinity domain the workers are pinned to,
+	 * or a single shared one */
+	nfs_req_st.reqs.affinity = nfs_param.core_param.worker_affinity;
+	nfs_req_st.reqs.n_runq =
+		fridgethr_affinity_domains(nfs_req_st.reqs.affinity);
+	if (nfs_req_st.reqs.n_runq == 1)
+		nfs_req_st.reqs.affinity = fridgethr_affinity_none;
+	nfs_req_st.reqs.runq = gsh_calloc(nfs_req_st.reqs.n_runq,
+					  sizeof(struct req_runq));
 	nfs_req_st.reqs.size = 0;
-	for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
-		qpair = &(nfs_req_st.reqs.nfs_request_q.qset[ix]);
-		qpair->s = req_q_s[ix];
-		nfs_rpc_q_init(&qpair->producer);
-		nfs_rpc_q_init(&qpair->consumer);
+
+	/* queues; size the rings to hold every request the dispatcher
+	 * throttle admits, so overflow is the exception */
+	while (nslots * nfs_req_st.reqs.n_runq <
+	       nfs_param.core_param.dispatch_max_reqs)
+		nslots <<= 1;
+	if (nslots < 64)
+		nslots = 64;
+
+	for (rq = 0; rq < nfs_req_st.reqs.n_runq; ++rq) {
+		runq = &nfs_req_st.reqs.runq[rq];
+		for (ix = 0; ix < N_REQ_QUEUES; ++ix) {
+			qpair = &(runq->nfs_request_q.qset[ix]);
+			qpair->s = req_q_s[ix];
+			req_q_ring_init(&qpair->ring,
+					gsh_calloc(nslots,
+						   sizeof(struct req_q_slot)),
+					nslots);
+			nfs_rpc_q_init(&qpair->overflow);
+		}
+
+		/* waitq */
+		pthread_spin_init(&runq->sp, PTHREAD_PROCESS_PRIVATE);
+		glist_init(&runq->wait_list);
+		runq->waiters = 0;
 	}
 
-	/* waitq */
-	glist_init(&nfs_req_st.reqs.wait_list);
-	nfs_req_st.reqs.waiters = 0;
+	LogInfo(COMPONENT_DISPATCH,
+		"%u request run queue(s) of %u slots per class",
+		nfs_req_st.reqs.n_runq, nslots);
+
+	/* decoders pinned alongside the workers of each run queue, for
+	 * the transports whose packets arrive there */
+	if (nfs_param.core_param.decoder_affinity
+	    && nfs_req_st.reqs.n_runq > 1) {
+		char name[32];
+
+		n_decoder_fridges = nfs_req_st.reqs.n_runq;
+		decoder_fridges = gsh_calloc(n_decoder_fridges,
+					     sizeof(struct fridgethr *));
+		reqparams.thr_min = 0;
+		reqparams.affinity = nfs_req_st.reqs.affinity;
+		reqparams.one_domain = true;
+
+		for (rq = 0; rq < n_decoder_fridges; ++rq) {
+			reqparams.domain = rq;
+			snprintf(name, sizeof(name), "decoder%u", rq);
+			rc = fridgethr_init(&decoder_fridges[rq], name,
+					    &reqparams);
+			if (rc != 0)
+				LogFatal(COMPONENT_DISPATCH,
+					 "Unable to initialize decoder thread pool %u: %d",
+					 rq, rc);
+		}
+	} else if (nfs_param.core_param.decoder_affinity) {
+		LogEvent(COMPONENT_DISPATCH,
+			 "Decoder_Affinity needs Worker_Affinity, ignored");
+	}
+
+	if (nfs_param.core_param.fair_queue)
+		nfs_rpc_fairq_init();
 
 	/* stallq */
 	gsh_mutex_init(&nfs_req_st.stallq.mtx, NULL);
 	glist_init(&nfs_req_st.stallq.q);
-	nfs_req_st.stallq.active = false;
 	nfs_req_st.stallq.stalled = 0;
 }
 
@@ -1418,11 +2135,80 @@ uint32_t get_dequeue_count(void)
 	return dequeued_reqs;
 }
 
+/**
+ * @brief Run queue of the CPU the caller is running on
+ *
+ * @param[out] idx Index of the run queue
+ *
+ * @return The run queue.
+ */
+
+static inline struct req_runq *nfs_rpc_cur_runq(uint32_t *idx)
+{
+	int domain = -1;
+
+	if (nfs_req_st.reqs.n_runq > 1)
+		domain = fridgethr_affinity_domain(nfs_req_st.reqs.affinity,
+						   sched_getcpu());
+	if (domain < 0)
+		domain = 0;
+	*idx = domain % nfs_req_st.reqs.n_runq;
+	return &nfs_req_st.reqs.runq[*idx];
+}
+
+/**
+ * @brief Wake one worker waiting on a run queue
+ *
+ * @param[in] runq The run queue
+ *
+ * @return true if a worker was woken.
+ */
+
+static bool nfs_rpc_wake_runq(struct req_runq *runq)
+{
+	wait_q_entry_t *wqe;
+
+	if (atomic_fetch_uint32_t(&runq->waiters) == 0)
+		return false;
+
+	/* SPIN LOCKED */
+	pthread_spin_lock(&runq->sp);
+	if (runq->waiters == 0) {
+		/* ! SPIN LOCKED */
+		pthread_spin_unlock(&runq->sp);
+		return false;
+	}
+
+	wqe = glist_first_entry(&runq->wait_list, wait_q_entry_t, waitq);
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "runq %p waiters %u signal wqe %p",
+		     runq, runq->waiters, wqe);
+
+	/* release 1 waiter */
+	glist_del(&wqe->waitq);
+	--(runq->waiters);
+	--(wqe->waiters);
+	/* ! SPIN LOCKED */
+	pthread_spin_unlock(&runq->sp);
+	PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
+	/* XXX reliable handoff */
+	wqe->flags |= Wqe_LFlag_SyncDone;
+	if (wqe->flags & Wqe_LFlag_WaitSync)
+		pthread_cond_signal(&wqe->lwe.cv);
+	PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+	return true;
+}
+
 void nfs_rpc_enqueue_req(request_data_t *reqdata)
 {
+	struct req_runq *runq;
 	struct req_q_set *nfs_request_q;
 	struct req_q_pair *qpair;
 	struct req_q *q;
+	uint32_t home, ix;
+	bool fair = false;
+	bool high_latency = false;
 
 #if defined(HAVE_BLKIN)
 	BLKIN_TIMESTAMP(
@@ -1431,7 +2217,9 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-enter");
 #endif
 
-	nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
+	/* queue locally, to be executed on a warm cache */
+	runq = nfs_rpc_cur_runq(&home);
+	nfs_request_q = &runq->nfs_request_q;
 
 	switch (reqdata->rtype) {
 	case NFS_REQUEST:
@@ -1443,10 +2231,15 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 			qpair = &(nfs_request_q->qset[REQ_Q_MOUNT]);
 			break;
 		}
-		if (NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead))
+		high_latency =
+		    NFS_LOOKAHEAD_HIGH_LATENCY(reqdata->r_u.req.lookahead);
+		if (high_latency)
 			qpair = &(nfs_request_q->qset[REQ_Q_HIGH_LATENCY]);
 		else
 			qpair = &(nfs_request_q->qset[REQ_Q_LOW_LATENCY]);
+		/* requests resuming from async I/O were already admitted */
+		fair = nfs_param.core_param.fair_queue &&
+		    !(reqdata->async_flags & ASYNC_PROC_EXIT);
 		break;
 	case NFS_CALL:
 		qpair = &(nfs_request_q->qset[REQ_Q_CALL]);
@@ -1465,12 +2258,25 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 	/* this one is real, timestamp it
 	 */
 	now(&reqdata->time_queued);
-	/* always append to producer queue */
-	q = &qpair->producer;
-	pthread_spin_lock(&q->sp);
-	glist_add_tail(&q->q, &reqdata->req_q);
-	++(q->size);
-	pthread_spin_unlock(&q->sp);
+	reqdata->q_class = qpair - nfs_request_q->qset;
+	(void) atomic_inc_uint64_t(
+			&nfs_req_st.stats[reqdata->q_class].enqueued);
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, enqueue, reqdata, qpair->s);
+#endif
+	/* append to the ring, unless it is full or has already spilled;
+	 * in the latter case keep spilling until the consumers drain the
+	 * ring, so the overflow list cannot be starved */
+	q = &qpair->overflow;
+	if (fair)
+		nfs_rpc_fairq_enqueue(reqdata, high_latency);
+	else if (atomic_fetch_uint32_t(&q->size) != 0
+		 || !req_q_ring_push(&qpair->ring, reqdata)) {
+		pthread_spin_lock(&q->sp);
+		glist_add_tail(&q->q, &reqdata->req_q);
+		++(q->size);
+		pthread_spin_unlock(&q->sp);
+	}
 
 	(void) atomic_inc_uint32_t(&enqueued_reqs);
 
@@ -1489,41 +2295,17 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 		"enqueue-exit");
 #endif
 	LogDebug(COMPONENT_DISPATCH,
-		 "enqueued req, q %p (%s %p:%p) size is %d (enq %u deq %u)",
-		 q, qpair->s, &qpair->producer, &qpair->consumer, q->size,
+		 "enqueued req, q %p (%s) ring %u overflow %u (enq %u deq %u)",
+		 qpair, qpair->s, req_q_ring_size(&qpair->ring), q->size,
 		 enqueued_reqs, dequeued_reqs);
 
-	/* potentially wakeup some thread */
-
-	/* global waitq */
-	{
-		wait_q_entry_t *wqe;
-
-		/* SPIN LOCKED */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		if (nfs_req_st.reqs.waiters) {
-			wqe = glist_first_entry(&nfs_req_st.reqs.wait_list,
-						wait_q_entry_t, waitq);
-
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "nfs_req_st.reqs.waiters %u signal wqe %p (for q %p)",
-				     nfs_req_st.reqs.waiters, wqe, q);
-
-			/* release 1 waiter */
-			glist_del(&wqe->waitq);
-			--(nfs_req_st.reqs.waiters);
-			--(wqe->waiters);
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
-			PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
-			/* XXX reliable handoff */
-			wqe->flags |= Wqe_LFlag_SyncDone;
-			if (wqe->flags & Wqe_LFlag_WaitSync)
-				pthread_cond_signal(&wqe->lwe.cv);
-			PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
-		} else
-			/* ! SPIN LOCKED */
-			pthread_spin_unlock(&nfs_req_st.reqs.sp);
+	/* potentially wakeup some thread, preferably a local one; a
+	 * remote worker steals the request */
+	for (ix = 0; ix < nfs_req_st.reqs.n_runq; ++ix) {
+		runq = &nfs_req_st.reqs.runq[(home + ix) %
+					     nfs_req_st.reqs.n_runq];
+		if (nfs_rpc_wake_runq(runq))
+			break;
 	}
 
  out:
@@ -1533,74 +2315,51 @@ void nfs_rpc_enqueue_req(request_data_t *reqdata)
 /* static inline */
 request_data_t *nfs_rpc_consume_req(struct req_q_pair *qpair)
 {
-	request_data_t *reqdata = NULL;
+	request_data_t *reqdata;
 
-	pthread_spin_lock(&qpair->consumer.sp);
-	if (qpair->consumer.size > 0) {
-		reqdata =
-		    glist_first_entry(&qpair->consumer.q, request_data_t,
-				      req_q);
-		glist_del(&reqdata->req_q);
-		--(qpair->consumer.size);
-		pthread_spin_unlock(&qpair->consumer.sp);
+	reqdata = req_q_ring_pop(&qpair->ring);
+	if (reqdata)
 		goto out;
-	} else {
-		char *s = NULL;
-		uint32_t csize = ~0U;
-		uint32_t psize = ~0U;
-
-		pthread_spin_lock(&qpair->producer.sp);
-		if (isFullDebug(COMPONENT_DISPATCH)) {
-			s = (char *)qpair->s;
-			csize = qpair->consumer.size;
-			psize = qpair->producer.size;
-		}
-		if (qpair->producer.size > 0) {
-			/* splice */
-			glist_splice_tail(&qpair->consumer.q,
-					  &qpair->producer.q);
-			qpair->consumer.size = qpair->producer.size;
-			qpair->producer.size = 0;
-			/* consumer.size > 0 */
-			pthread_spin_unlock(&qpair->producer.sp);
-			reqdata =
-			    glist_first_entry(&qpair->consumer.q,
-					      request_data_t, req_q);
-			glist_del(&reqdata->req_q);
-			--(qpair->consumer.size);
-			pthread_spin_unlock(&qpair->consumer.sp);
-			if (s)
-				LogFullDebug(COMPONENT_DISPATCH,
-					     "try splice, qpair %s consumer qsize=%u producer qsize=%u",
-					     s, csize, psize);
-			goto out;
-		}
 
-		pthread_spin_unlock(&qpair->producer.sp);
-		pthread_spin_unlock(&qpair->consumer.sp);
+	if (atomic_fetch_uint32_t(&qpair->overflow.size) == 0)
+		goto out;
 
-		if (s)
-			LogFullDebug(COMPONENT_DISPATCH,
-				     "try splice, qpair %s consumer qsize=%u producer qsize=%u",
-				     s, csize, psize);
+	pthread_spin_lock(&qpair->overflow.sp);
+	if (qpair->overflow.size > 0) {
+		reqdata =
+		    glist_first_entry(&qpair->overflow.q, request_data_t,
+				      req_q);
+		glist_del(&reqdata->req_q);
+		--(qpair->overflow.size);
 	}
+	pthread_spin_unlock(&qpair->overflow.sp);
+
+	LogFullDebug(COMPONENT_DISPATCH,
+		     "ring empty, qpair %s overflow qsize=%u",
+		     qpair->s, qpair->overflow.size);
  out:
 	return reqdata;
 }
 
-request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+/**
+ * @brief Take a request from one run queue
+ *
+ * @param[in] runq The run queue
+ *
+ * @return The request, or NULL if every class is empty.
+ */
+
+static request_data_t *nfs_rpc_consume_runq(struct req_runq *runq)
 {
+	struct req_q_set *nfs_request_q = &runq->nfs_request_q;
 	request_data_t *reqdata = NULL;
-	struct req_q_set *nfs_request_q = &nfs_req_st.reqs.nfs_request_q;
 	struct req_q_pair *qpair;
 	uint32_t ix, slot;
-	struct timespec timeout;
 
 	/* XXX: the following stands in for a more robust/flexible
 	 * weighting function */
 
 	/* slot in 1..4 */
- retry_deq:
 	slot = (nfs_rpc_q_next_slot() % 4);
 	for (ix = 0; ix < 4; ++ix) {
 		switch (slot) {
@@ -1627,8 +2386,7 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 		}
 
 		LogFullDebug(COMPONENT_DISPATCH,
-			     "dequeue_req try qpair %s %p:%p", qpair->s,
-			     &qpair->producer, &qpair->consumer);
+			     "dequeue_req try qpair %s %p", qpair->s, qpair);
 
 		/* anything? */
 		reqdata = nfs_rpc_consume_req(qpair);
@@ -1642,48 +2400,145 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 
 	}			/* for */
 
+	return reqdata;
+}
+
+/**
+ * @brief Account the time a request spent queued
+ *
+ * @param[in] reqdata The request just dequeued
+ */
+
+static void nfs_rpc_dequeue_stats(request_data_t *reqdata)
+{
+	struct req_q_stats *st = &nfs_req_st.stats[reqdata->q_class];
+	struct timespec ts;
+	nsecs_elapsed_t wait;
+	uint64_t us;
+	uint32_t bucket = 0;
+
+	now(&ts);
+	wait = timespec_diff(&reqdata->time_queued, &ts);
+	us = wait / NS_PER_USEC;
+	if (us != 0)
+		bucket = 64 - __builtin_clzll(us);
+	if (bucket >= REQ_Q_WAIT_BUCKETS)
+		bucket = REQ_Q_WAIT_BUCKETS - 1;
+
+	(void) atomic_inc_uint64_t(&st->dequeued);
+	(void) atomic_add_uint64_t(&st->wait, wait);
+	(void) atomic_inc_uint64_t(&st->wait_hist[bucket]);
+	/* Racy, a lost maximum is as good as another one */
+	if (wait > atomic_fetch_uint64_t(&st->wait_max))
+		atomic_store_uint64_t(&st->wait_max, wait);
+}
+
+request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
+{
+	struct fridgethr_context *ctx =
+		container_of(worker, struct fridgethr_context, wd);
+	request_data_t *reqdata = NULL;
+	struct req_runq *runq;
+	uint32_t home, ix;
+	struct timespec timeout, spin_start = {0, 0};
+	uint32_t spin = fridgethr_getspin(ctx);
+	bool throttled = false;
+	int rc;
+
+	/* workers pinned to a domain serve its run queue first */
+	home = (ctx->domain < 0) ? 0 : ctx->domain % nfs_req_st.reqs.n_runq;
+
+ retry_deq:
+	/* then steal from the neighbours */
+	for (ix = 0; ix < nfs_req_st.reqs.n_runq; ++ix) {
+		runq = &nfs_req_st.reqs.runq[(home + ix) %
+					     nfs_req_st.reqs.n_runq];
+		reqdata = nfs_rpc_consume_runq(runq);
+		if (reqdata) {
+			if (ix != 0)
+				LogFullDebug(COMPONENT_DISPATCH,
+					     "worker %u stole from runq %u",
+					     worker->worker_index,
+					     (home + ix) %
+					     nfs_req_st.reqs.n_runq);
+			break;
+		}
+		/* the fair queue is shared by all the run queues */
+		if (ix == 0 && nfs_param.core_param.fair_queue) {
+			reqdata = nfs_rpc_fairq_dequeue(&throttled);
+			if (reqdata) {
+				(void) atomic_inc_uint32_t(&dequeued_reqs);
+				break;
+			}
+		}
+	}
+
+	/* poll for Worker_Spin_Time before sleeping */
+	if (!reqdata && !throttled && spin > 0) {
+		now(&timeout);
+		if (spin_start.tv_sec == 0 && spin_start.tv_nsec == 0)
+			spin_start = timeout;
+		if (timespec_diff(&spin_start, &timeout) < spin * 1000ULL
+		    && !fridgethr_you_should_break(ctx))
+			goto retry_deq;
+	}
+
 	/* wait */
 	if (!reqdata) {
-		struct fridgethr_context *ctx =
-			container_of(worker, struct fridgethr_context, wd);
 		wait_q_entry_t *wqe = &worker->wqe;
 
+		runq = &nfs_req_st.reqs.runq[home];
 		assert(wqe->waiters == 0); /* wqe is not on any wait queue */
 		PTHREAD_MUTEX_lock(&wqe->lwe.mtx);
 		wqe->flags = Wqe_LFlag_WaitSync;
 		wqe->waiters = 1;
 		/* XXX functionalize */
-		pthread_spin_lock(&nfs_req_st.reqs.sp);
-		glist_add_tail(&nfs_req_st.reqs.wait_list, &wqe->waitq);
-		++(nfs_req_st.reqs.waiters);
-		pthread_spin_unlock(&nfs_req_st.reqs.sp);
+		pthread_spin_lock(&runq->sp);
+		glist_add_tail(&runq->wait_list, &wqe->waitq);
+		++(runq->waiters);
+		pthread_spin_unlock(&runq->sp);
 		while (!(wqe->flags & Wqe_LFlag_SyncDone)) {
-			timeout.tv_sec = time(NULL) + 5;
-			timeout.tv_nsec = 0;
-			pthread_cond_timedwait(&wqe->lwe.cv, &wqe->lwe.mtx,
-					       &timeout);
-			if (fridgethr_you_should_break(ctx)) {
+			if (throttled) {
+				/* queued requests are waiting on a rate
+				 * limit, look again shortly */
+				clock_gettime(CLOCK_REALTIME, &timeout);
+				timespec_add_nsecs(FAIRQ_THROTTLE_WAIT_NS,
+						   &timeout);
+			} else {
+				timeout.tv_sec = time(NULL) + 5;
+				timeout.tv_nsec = 0;
+			}
+			rc = pthread_cond_timedwait(&wqe->lwe.cv,
+						    &wqe->lwe.mtx,
+						    &timeout);
+			if (fridgethr_you_should_break(ctx) ||
+			    (throttled && rc == ETIMEDOUT)) {
 				/* We are returning;
 				 * so take us out of the waitq */
-				pthread_spin_lock(&nfs_req_st.reqs.sp);
+				pthread_spin_lock(&runq->sp);
 				if (wqe->waitq.next != NULL
 				    || wqe->waitq.prev != NULL) {
 					/* Element is still in wqitq,
 					 * remove it */
 					glist_del(&wqe->waitq);
-					--(nfs_req_st.reqs.waiters);
+					--(runq->waiters);
 					--(wqe->waiters);
 					wqe->flags &=
 					    ~(Wqe_LFlag_WaitSync |
 					      Wqe_LFlag_SyncDone);
 				}
-				pthread_spin_unlock(&nfs_req_st.reqs.sp);
+				pthread_spin_unlock(&runq->sp);
 				PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
+				if (throttled && rc == ETIMEDOUT &&
+				    !fridgethr_you_should_break(ctx)) {
+					throttled = false;
+					goto retry_deq;
+				}
 				return NULL;
 			}
 		}
 
-		/* XXX wqe was removed from nfs_req_st.waitq
+		/* XXX wqe was removed from the run queue's waitq
 		 * (by signalling thread) */
 		wqe->flags &= ~(Wqe_LFlag_WaitSync | Wqe_LFlag_SyncDone);
 		PTHREAD_MUTEX_unlock(&wqe->lwe.mtx);
@@ -1705,6 +2560,10 @@ request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker)
 		&reqdata->r_u.req.xprt->blkin.endp,
 		"dequeue-req");
 #endif
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, dequeue, reqdata, worker->worker_index);
+#endif
+	nfs_rpc_dequeue_stats(reqdata);
 	return reqdata;
 }
 
@@ -1904,6 +2763,10 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		&reqdata->r_u.req.svc.bl_trace, &xprt->blkin.endp, "pre-recv");
 #endif
 
+	reqdata->latency_sample = server_stats_latency_sample();
+	if (reqdata->latency_sample)
+		now(&reqdata->time_received);
+
 	recv_status = SVC_RECV(&reqdata->r_u.req.svc);
 
 #if defined(HAVE_BLKIN)
@@ -1972,6 +2835,23 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		goto done;
 	}
 
+#ifdef USE_RPC_TLS
+	/* STARTTLS, answered, and the handshake run, right here */
+	if (reqdata->r_u.req.svc.rq_msg.cb_cred.oa_flavor == AUTH_TLS) {
+		stat = nfs_rpc_tls_probe(reqdata);
+		DISP_RUNLOCK(xprt);
+		goto done;
+	}
+
+	if (nfs_rpc_tls_refused(reqdata)) {
+		LogInfo(COMPONENT_DISPATCH,
+			"Rejecting call without TLS on socket %d",
+			xprt->xp_fd);
+		svcerr_auth(&reqdata->r_u.req.svc, AUTH_TOOWEAK);
+		goto finish;
+	}
+#endif
+
 	/* XXX so long as nfs_rpc_get_funcdesc calls is_rpc_call_valid
 	 * and fails if that call fails, there is no reason to call that
 	 * function again, below */
@@ -2051,6 +2931,15 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 		goto finish;
 	}
 
+	if (xprt->xp_u1) {
+		gsh_xprt_private_t *xu = xprt->xp_u1;
+		time_t t = time(NULL);
+
+		(void) atomic_inc_uint64_t(&xu->rpcs);
+		if (atomic_fetch_time_t(&xu->active) != t)
+			atomic_store_time_t(&xu->active, t);
+	}
+
 	if (context) {
 		/* already running worker thread, do not enqueue */
 		DISP_RUNLOCK(xprt);
@@ -2069,6 +2958,10 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	stat = SVC_STAT(xprt);
 	DISP_RUNLOCK(xprt);
 
+	/* A UDP socket may hold more datagrams, read on until it is empty */
+	if (stat == XPRT_IDLE && xprt->xp_type == XPRT_UDP)
+		stat = XPRT_MOREREQS;
+
  done:
 	/* if recv failed, request is not enqueued */
 	if (!enqueued)
@@ -2077,12 +2970,18 @@ enum xprt_stat thr_decode_rpc_request(void *context, SVCXPRT *xprt)
 	return stat;
 }
 
-static inline bool thr_continue_decoding(SVCXPRT *xprt, enum xprt_stat stat)
+/* A UDP socket is read at most UDP_Batch times for one wakeup */
+static inline bool thr_continue_decoding(SVCXPRT *xprt, enum xprt_stat stat,
+					 uint32_t decoded)
 {
 	if (unlikely(xprt->xp_requests
 		     > nfs_param.core_param.dispatch_max_reqs_xprt))
 		return false;
 
+	if (xprt->xp_type == XPRT_UDP &&
+	    decoded >= nfs_param.core_param.udp_batch)
+		return false;
+
 	return (stat == XPRT_MOREREQS);
 }
 
@@ -2090,12 +2989,13 @@ void thr_decode_rpc_requests(struct fridgethr_context *thr_ctx)
 {
 	enum xprt_stat stat;
 	SVCXPRT *xprt = (SVCXPRT *) thr_ctx->arg;
+	uint32_t decoded = 0;
 
 	LogFullDebug(COMPONENT_RPC, "enter xprt=%p", xprt);
 
 	do {
 		stat = thr_decode_rpc_request(NULL, xprt);
-	} while (thr_continue_decoding(xprt, stat));
+	} while (thr_continue_decoding(xprt, stat, ++decoded));
 
 	LogDebug(COMPONENT_DISPATCH, "exiting, stat=%s", xprt_stat_s[stat]);
 
@@ -2240,7 +3140,8 @@ static bool nfs_rpc_getreq_ng(SVCXPRT *xprt /*, int chan_id */)
 	LogFullDebug(COMPONENT_DISPATCH, "before fridgethr_get");
 
 	/* schedule a thread to decode */
-	code = fridgethr_submit(req_fridge, thr_decode_rpc_requests, xprt);
+	code = fridgethr_submit(nfs_rpc_decoder_fridge(xprt),
+				thr_decode_rpc_requests, xprt);
 	if (code == ETIMEDOUT) {
 		LogFullDebug(COMPONENT_RPC,
 			     "Decode dispatch timed out, rearming. xprt=%p",
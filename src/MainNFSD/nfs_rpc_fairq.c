@@ -0,0 +1,511 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/**
+ * @file nfs_rpc_fairq.c
+ * @brief Weighted fair queuing of NFS requests across tenants
+ *
+ * When Fair_Queue is enabled, LOW_LATENCY and HIGH_LATENCY requests do
+ * not go straight to the request rings.  They are queued on a flow per
+ * client host and export, and workers take them in deficit round robin
+ * order.  Each flow is charged the payload of its READs and WRITEs plus
+ * a fixed cost per request, and earns a quantum proportional to its
+ * export's FairShare_Weight each round.  Within a flow, LOW_LATENCY
+ * requests are served before HIGH_LATENCY ones.
+ *
+ * An export's Max_Ops_Per_Sec and Max_Bytes_Per_Sec are enforced with
+ * token buckets: a flow whose export has run dry is passed over until
+ * the bucket refills.
+ *
+ * The queued requests of a client host are also its backlog for
+ * nfs_rpc_cond_stall_xprt(), so a client that floods the server is
+ * stalled on its own transports while other tenants keep flowing.
+ */
+
+#include "config.h"
+#include <pthread.h>
+#include <arpa/inet.h>
+#include "log.h"
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "gsh_rpc.h"
+#include "nfs_core.h"
+#include "nfs_fh.h"
+#include "nfs_proto_data.h"
+#include "export_mgr.h"
+#include "nfs_exports.h"
+
+/** Flow and tenant hash buckets, a power of two */
+#define FQ_HASH_SIZE 1024
+
+/** Bytes a request is charged on top of its payload */
+#define FQ_OP_COST 4096
+
+/** Bytes of quantum per unit of FairShare_Weight */
+#define FQ_QUANTUM 1024
+
+/** Token bucket resolution, tokens are kept in millionths */
+#define FQ_TOKEN_SCALE 1000000
+
+/**
+ * @brief A client host, owning the flows of all its exports
+ */
+
+struct fq_tenant {
+	struct glist_head hash_link;
+	uint64_t client;	/*< Hash of the client address */
+	uint32_t backlog;	/*< Requests queued on its flows */
+	uint32_t nflows;
+};
+
+/**
+ * @brief Requests of one client host on one export
+ */
+
+struct fq_flow {
+	struct glist_head hash_link;
+	struct glist_head active_link;	/*< Position in the round */
+	struct glist_head ll;	/*< LOW_LATENCY requests, served first */
+	struct glist_head hl;	/*< HIGH_LATENCY requests */
+	uint64_t client;
+	uint16_t export_id;
+	struct gsh_export *export;	/*< Reference held, or NULL */
+	struct fq_tenant *tenant;
+	int64_t deficit;
+};
+
+static struct {
+	pthread_spinlock_t sp;
+	struct glist_head active;	/*< Flows with requests queued */
+	struct glist_head flows[FQ_HASH_SIZE];
+	struct glist_head tenants[FQ_HASH_SIZE];
+	uint32_t size;
+	struct timespec epoch;
+} fq;
+
+void nfs_rpc_fairq_init(void)
+{
+	int ix;
+
+	pthread_spin_init(&fq.sp, PTHREAD_PROCESS_PRIVATE);
+	glist_init(&fq.active);
+	for (ix = 0; ix < FQ_HASH_SIZE; ix++) {
+		glist_init(&fq.flows[ix]);
+		glist_init(&fq.tenants[ix]);
+	}
+	fq.size = 0;
+	now(&fq.epoch);
+}
+
+/**
+ * @brief Hash of the client host behind a transport
+ */
+
+static uint64_t fq_client_key(SVCXPRT *xprt)
+{
+	sockaddr_t addr;
+
+	if (!copy_xprt_addr(&addr, xprt))
+		return 0;
+	return hash_sockaddr(&addr, true);
+}
+
+/**
+ * @brief Extract the export and payload of a decoded request
+ *
+ * @param[in]  req       The request
+ * @param[out] export_id Export of its first file handle, if any
+ * @param[out] bytes     READ and WRITE payload
+ *
+ * @return true if an export was found.
+ */
+
+static bool fq_classify(nfs_request_t *req, uint16_t *export_id,
+			uint64_t *bytes)
+{
+	nfs_arg_t *arg = &req->arg_nfs;
+	bool found = false;
+	u_int ix;
+
+	*bytes = 0;
+
+	if (req->svc.rq_msg.cb_prog != nfs_param.core_param.program[P_NFS])
+		return false;
+
+	switch (req->svc.rq_msg.cb_vers) {
+	case NFS_V3:
+	{
+		/* Every NFSv3 argument but NULL's begins with the file
+		 * handle it operates on, alone or in a diropargs3. */
+		nfs_fh3 *fh = (nfs_fh3 *) arg;
+		file_handle_v3_t *v3;
+
+		if (req->svc.rq_msg.cb_proc == NFSPROC3_NULL)
+			return false;
+		if (req->svc.rq_msg.cb_proc == NFSPROC3_READ)
+			*bytes = arg->arg_read3.count;
+		else if (req->svc.rq_msg.cb_proc == NFSPROC3_WRITE)
+			*bytes = arg->arg_write3.data.data_len;
+
+		v3 = (file_handle_v3_t *) fh->data.data_val;
+		if (v3 != NULL && fh->data.data_len >= sizeof(*v3) &&
+		    v3->fhversion == GANESHA_FH_VERSION) {
+			*export_id = ntohs(v3->exportid);
+			found = true;
+		}
+		break;
+	}
+	case NFS_V4:
+	{
+		COMPOUND4args *c = &arg->arg_compound4;
+		nfs_argop4 *op;
+		file_handle_v4_t *v4;
+
+		for (ix = 0; ix < c->argarray.argarray_len; ix++) {
+			op = &c->argarray.argarray_val[ix];
+			switch (op->argop) {
+			case NFS4_OP_PUTFH:
+				v4 = (file_handle_v4_t *)
+				    op->nfs_argop4_u.opputfh.object.nfs_fh4_val;
+				if (found || v4 == NULL ||
+				    op->nfs_argop4_u.opputfh.object.nfs_fh4_len
+				    < sizeof(*v4) ||
+				    v4->fhversion != GANESHA_FH_VERSION)
+					break;
+				*export_id = ntohs(v4->id.exports);
+				found = true;
+				break;
+			case NFS4_OP_READ:
+				*bytes += op->nfs_argop4_u.opread.count;
+				break;
+			case NFS4_OP_WRITE:
+				*bytes +=
+				    op->nfs_argop4_u.opwrite.data.data_len;
+				break;
+			default:
+				break;
+			}
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	return found;
+}
+
+static inline nsecs_elapsed_t fq_now(void)
+{
+	struct timespec ts;
+
+	now(&ts);
+	return timespec_diff(&fq.epoch, &ts);
+}
+
+/**
+ * @brief Refill one token bucket
+ */
+
+static inline void fq_refill(int64_t *tokens, uint64_t rate, uint64_t usecs)
+{
+	int64_t max = rate * FQ_TOKEN_SCALE;
+
+	*tokens += usecs * rate;
+	if (*tokens > max)
+		*tokens = max;
+}
+
+/**
+ * @brief Check an export's rate limits
+ *
+ * Called with the fair queue locked, which also protects the buckets.
+ *
+ * @return true if a request may be dispatched now.
+ */
+
+static bool fq_export_admit(struct gsh_export *exp, nsecs_elapsed_t stamp)
+{
+	uint64_t max_ops = atomic_fetch_uint64_t(&exp->fq_max_ops);
+	uint64_t max_bytes = atomic_fetch_uint64_t(&exp->fq_max_bytes);
+	uint64_t usecs;
+
+	if (max_ops == 0 && max_bytes == 0)
+		return true;
+
+	/* a bucket never holds more than one second of tokens */
+	if (stamp - exp->fq_stamp > NS_PER_SEC)
+		exp->fq_stamp = stamp - NS_PER_SEC;
+	usecs = (stamp - exp->fq_stamp) / NS_PER_USEC;
+	exp->fq_stamp += usecs * NS_PER_USEC;
+
+	if (max_ops != 0) {
+		fq_refill(&exp->fq_ops_tokens, max_ops, usecs);
+		if (exp->fq_ops_tokens <= 0)
+			return false;
+	}
+	if (max_bytes != 0) {
+		fq_refill(&exp->fq_bytes_tokens, max_bytes, usecs);
+		if (exp->fq_bytes_tokens <= 0)
+			return false;
+	}
+	return true;
+}
+
+static inline void fq_export_charge(struct gsh_export *exp, uint64_t bytes)
+{
+	/* Requests may overdraw the buckets; the debt delays the next. */
+	if (atomic_fetch_uint64_t(&exp->fq_max_ops) != 0)
+		exp->fq_ops_tokens -= FQ_TOKEN_SCALE;
+	if (atomic_fetch_uint64_t(&exp->fq_max_bytes) != 0)
+		exp->fq_bytes_tokens -= bytes * FQ_TOKEN_SCALE;
+}
+
+static inline uint32_t fq_hash(uint64_t client, uint16_t export_id)
+{
+	return (client ^ (export_id * 0x9e3779b97f4a7c15ULL)) &
+		(FQ_HASH_SIZE - 1);
+}
+
+static struct fq_tenant *fq_tenant_lookup(uint64_t client)
+{
+	struct glist_head *glist;
+	struct fq_tenant *t;
+
+	glist_for_each(glist, &fq.tenants[client & (FQ_HASH_SIZE - 1)]) {
+		t = glist_entry(glist, struct fq_tenant, hash_link);
+		if (t->client == client)
+			return t;
+	}
+	return NULL;
+}
+
+static struct fq_flow *fq_flow_lookup(uint64_t client, uint16_t export_id)
+{
+	struct glist_head *glist;
+	struct fq_flow *f;
+
+	glist_for_each(glist, &fq.flows[fq_hash(client, export_id)]) {
+		f = glist_entry(glist, struct fq_flow, hash_link);
+		if (f->client == client && f->export_id == export_id)
+			return f;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Queue a request on its tenant's flow
+ *
+ * @param[in] reqdata      Decoded NFS request
+ * @param[in] high_latency Request is in the HIGH_LATENCY class
+ */
+
+void nfs_rpc_fairq_enqueue(request_data_t *reqdata, bool high_latency)
+{
+	nfs_request_t *req = &reqdata->r_u.req;
+	uint64_t client = fq_client_key(req->svc.rq_xprt);
+	struct gsh_export *exp = NULL;
+	struct fq_tenant *tenant = NULL;
+	struct fq_flow *flow = NULL;
+	struct fq_tenant *t;
+	struct fq_flow *f;
+	uint16_t export_id = 0;
+	uint64_t bytes;
+
+	if (fq_classify(req, &export_id, &bytes))
+		exp = export_perms_cache_export(
+			nfs_rpc_xprt_perms_cache(req->svc.rq_xprt), export_id);
+	if (exp == NULL)
+		export_id = 0;
+
+	reqdata->fq_bytes = bytes;
+
+	/* allocate outside the lock, in case this is a new flow */
+	flow = gsh_calloc(1, sizeof(*flow));
+	tenant = gsh_calloc(1, sizeof(*tenant));
+
+	pthread_spin_lock(&fq.sp);
+
+	f = fq_flow_lookup(client, export_id);
+	if (f == NULL) {
+		t = fq_tenant_lookup(client);
+		if (t == NULL) {
+			t = tenant;
+			tenant = NULL;
+			t->client = client;
+			glist_add_tail(
+				&fq.tenants[client & (FQ_HASH_SIZE - 1)],
+				&t->hash_link);
+		}
+		f = flow;
+		flow = NULL;
+		f->client = client;
+		f->export_id = export_id;
+		f->export = exp;
+		exp = NULL;	/* the flow keeps the reference */
+		f->tenant = t;
+		glist_init(&f->ll);
+		glist_init(&f->hl);
+		glist_add_tail(&fq.flows[fq_hash(client, export_id)],
+			       &f->hash_link);
+		glist_add_tail(&fq.active, &f->active_link);
+		++(t->nflows);
+	}
+
+	glist_add_tail(high_latency ? &f->hl : &f->ll, &reqdata->req_q);
+	++(f->tenant->backlog);
+	++(fq.size);
+
+	pthread_spin_unlock(&fq.sp);
+
+	gsh_free(flow);
+	gsh_free(tenant);
+	if (exp != NULL)
+		put_gsh_export(exp);
+}
+
+/**
+ * @brief Take the next request in deficit round robin order
+ *
+ * @param[out] throttled Set if requests are queued but every flow
+ *                       holding them is over its export's rate limit
+ *
+ * @return The request, or NULL.
+ */
+
+request_data_t *nfs_rpc_fairq_dequeue(bool *throttled)
+{
+	request_data_t *reqdata = NULL;
+	struct fq_flow *done = NULL;
+	struct fq_tenant *gone = NULL;
+	struct glist_head *head;
+	nsecs_elapsed_t stamp = 0;
+	uint32_t weight, passed = 0, nactive = 0;
+	struct glist_head *glist;
+	struct fq_flow *f;
+	uint64_t cost;
+
+	*throttled = false;
+
+	if (atomic_fetch_uint32_t(&fq.size) == 0)
+		return NULL;
+
+	pthread_spin_lock(&fq.sp);
+
+	glist_for_each(glist, &fq.active)
+		++nactive;
+
+	while (!glist_empty(&fq.active)) {
+		f = glist_first_entry(&fq.active, struct fq_flow,
+				      active_link);
+		head = glist_empty(&f->ll) ? &f->hl : &f->ll;
+		reqdata = glist_first_entry(head, request_data_t, req_q);
+
+		if (f->export != NULL) {
+			if (stamp == 0)
+				stamp = fq_now();
+			if (!fq_export_admit(f->export, stamp)) {
+				/* over its limit, try the next flow */
+				reqdata = NULL;
+				glist_del(&f->active_link);
+				glist_add_tail(&fq.active, &f->active_link);
+				if (++passed >= nactive) {
+					*throttled = true;
+					break;
+				}
+				continue;
+			}
+		}
+
+		cost = FQ_OP_COST + reqdata->fq_bytes;
+		if (f->deficit < (int64_t) cost) {
+			/* end of this flow's turn, it earns a quantum */
+			weight = (f->export != NULL)
+			    ? atomic_fetch_uint32_t(&f->export->fq_weight)
+			    : FAIRSHARE_WEIGHT_DEFAULT;
+			f->deficit += (int64_t) weight * FQ_QUANTUM;
+			passed = 0;
+			reqdata = NULL;
+			glist_del(&f->active_link);
+			glist_add_tail(&fq.active, &f->active_link);
+			continue;
+		}
+
+		glist_del(&reqdata->req_q);
+		f->deficit -= cost;
+		--(f->tenant->backlog);
+		--(fq.size);
+		if (f->export != NULL)
+			fq_export_charge(f->export, reqdata->fq_bytes);
+
+		if (glist_empty(&f->ll) && glist_empty(&f->hl)) {
+			/* idle flows keep no credit */
+			glist_del(&f->active_link);
+			glist_del(&f->hash_link);
+			if (--(f->tenant->nflows) == 0) {
+				gone = f->tenant;
+				glist_del(&gone->hash_link);
+			}
+			done = f;
+		}
+		break;
+	}
+
+	pthread_spin_unlock(&fq.sp);
+
+	if (done != NULL) {
+		if (done->export != NULL)
+			put_gsh_export(done->export);
+		gsh_free(done);
+	}
+	gsh_free(gone);
+
+	return reqdata;
+}
+
+/**
+ * @brief Requests queued by the client host behind a transport
+ */
+
+uint32_t nfs_rpc_fairq_backlog(SVCXPRT *xprt)
+{
+	uint64_t client = fq_client_key(xprt);
+	struct fq_tenant *t;
+	uint32_t backlog = 0;
+
+	pthread_spin_lock(&fq.sp);
+	t = fq_tenant_lookup(client);
+	if (t != NULL)
+		backlog = t->backlog;
+	pthread_spin_unlock(&fq.sp);
+
+	return backlog;
+}
+
+/**
+ * @brief Requests queued across all flows
+ */
+
+uint32_t nfs_rpc_fairq_size(void)
+{
+	return atomic_fetch_uint32_t(&fq.size);
+}
@@ -38,8 +38,10 @@
 #include "solaris_port.h"
 #endif
 
+#include <stdio.h>
 #include "gsh_rpc.h"
 #include "nfs_init.h"
+#include "nfs_core.h"
 
 /**
  * rpc_rdma_disconnect_callback: placeholder
@@ -60,6 +62,10 @@ rpc_rdma_disconnect_callback(SVCXPRT *xprt)
  *
  * The completion queue epoll thread is shared among all children.
  *
+ * The queues, credits and inline sizes come from the NFS_RDMA block.
+ * Credits need a posted receive each, so they are kept within
+ * Rq_Depth; with Use_SRQ, Rq_Depth is shared by all the connections.
+ *
  * @param[in] xa	must be init first
  *
  * @return NULL
@@ -67,22 +73,36 @@ rpc_rdma_disconnect_callback(SVCXPRT *xprt)
 void *
 nfs_rdma_dispatcher_thread(void *nullarg)
 {
+	nfs_rdma_parameter_t *param = &nfs_param.rdma_param;
+	static char port[sizeof("65535")];
 	struct rpc_rdma_attr xa = {
 		.statistics_prefix = NULL,
 		.node = "::",
-		.port = "20049",
+		.port = port,
 		.disconnect_cb = rpc_rdma_disconnect_callback,
 		.request_cb = thr_decode_rpc_request,
-		.sq_depth = 32,			/* default was 50 */
-		.max_send_sge = 32,		/* minimum 2 */
-		.rq_depth = 32,			/* default was 50 */
-		.max_recv_sge = 31,		/* minimum 1 */
-		.backlog = 10,			/* minimum 2 */
-		.credits = 30,			/* default 10 */
+		.sq_depth = param->sq_depth,
+		.max_send_sge = param->max_send_sge,
+		.rq_depth = param->rq_depth,
+		.max_recv_sge = param->max_recv_sge,
+		.backlog = param->backlog,
+		.credits = param->credits,
 		.destroy_on_disconnect = true,
-		.use_srq = false,
+		.use_srq = param->use_srq,
 	};
-	SVCXPRT *l_xprt = rpc_rdma_create(&xa);
+	SVCXPRT *l_xprt;
+
+	snprintf(port, sizeof(port), "%"PRIu16, param->port);
+
+	if (!param->use_srq && xa.credits > xa.rq_depth) {
+		LogWarn(COMPONENT_DISPATCH,
+			"NFS/RDMA Credits %"PRIu32" above Rq_Depth %"PRIu32
+			", using %"PRIu32,
+			param->credits, param->rq_depth, param->rq_depth);
+		xa.credits = param->rq_depth;
+	}
+
+	l_xprt = rpc_rdma_create(&xa);
 
 	if (!l_xprt) {
 		LogCrit(COMPONENT_DISPATCH,
@@ -90,18 +110,21 @@ nfs_rdma_dispatcher_thread(void *nullarg)
 		return NULL;
 	}
 	LogEvent(COMPONENT_DISPATCH,
-		"NFS/RDMA engine initialized");
+		"NFS/RDMA engine initialized on port %s, %"PRIu32
+		" credits, %s receive queue, inline %"PRIu32"/%"PRIu32,
+		port, xa.credits, param->use_srq ? "shared" : "per connection",
+		param->inline_recv, param->inline_send);
 
 	/* All clones and large allocations are done in this loop,
 	 * avoiding contention in the heap(s), serialized by the
 	 * connection_requests queue.
 	 */
 	while (l_xprt->xp_refs > 0) {
-		/* values used in Mooshika were 8*1024, 4*8*1024;
-		 * should be configurable.
-		 */
-		SVCXPRT *c_xprt = svc_rdma_create(l_xprt, 4*1024, 4*1024,
-							SVC_XPRT_FLAG_NONE);
+		/* values used in Mooshika were 8*1024, 4*8*1024 */
+		SVCXPRT *c_xprt = svc_rdma_create(l_xprt,
+						  param->inline_send,
+						  param->inline_recv,
+						  SVC_XPRT_FLAG_NONE);
 		if (!c_xprt) {
 			/* message already logged */
 			continue;
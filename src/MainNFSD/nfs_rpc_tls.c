@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file    nfs_rpc_tls.c
+ * @brief   RPC-over-TLS (RFC 9289) on the TCP connections
+ *
+ * A client asks with a NULL call carrying the AUTH_TLS credential; the
+ * reply verifier "STARTTLS" tells it to go on with the TLS handshake,
+ * which the decoder thread runs on the socket before it is rearmed.
+ * OpenSSL then hands the session keys to kernel TLS (TCP_ULP "tls",
+ * TLS_TX and TLS_RX), so TI-RPC reads and writes plain RPC records on
+ * the same socket while the kernel, or the NIC, encrypts them.
+ *
+ * The connection is dropped if the kernel won't take both directions:
+ * TI-RPC cannot go through an SSL object.  Alerts and key updates
+ * coming on a kTLS socket fail the read, and drop it as well.
+ */
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include "log.h"
+#include "gsh_rpc.h"
+#include "nfs_core.h"
+
+#define TLS_param nfs_param.tls_param
+
+/* ALPN of RPC-over-TLS */
+static const unsigned char tls_alpn_sunrpc[] = "\x06sunrpc";
+
+/* Reply verifier body of an AUTH_TLS probe */
+static char tls_starttls[] = "STARTTLS";
+
+static SSL_CTX *tls_ctx;
+
+static void tls_log_errors(const char *what)
+{
+	char buf[256];
+	unsigned long err;
+
+	while ((err = ERR_get_error()) != 0) {
+		ERR_error_string_n(err, buf, sizeof(buf));
+		LogWarn(COMPONENT_DISPATCH, "%s: %s", what, buf);
+	}
+}
+
+static int tls_alpn_select(SSL *ssl, const unsigned char **out,
+			   unsigned char *outlen, const unsigned char *in,
+			   unsigned int inlen, void *arg)
+{
+	if (SSL_select_next_proto((unsigned char **) out, outlen,
+				  tls_alpn_sunrpc,
+				  sizeof(tls_alpn_sunrpc) - 1, in, inlen)
+	    != OPENSSL_NPN_NEGOTIATED)
+		return SSL_TLSEXT_ERR_ALERT_FATAL;
+
+	return SSL_TLSEXT_ERR_OK;
+}
+
+/**
+ * @brief Load the certificate and key of the server
+ *
+ * Does nothing unless RPC_TLS is enabled; exits if they can't be used.
+ */
+void nfs_rpc_tls_init(void)
+{
+	if (!TLS_param.enable)
+		return;
+
+	if (TLS_param.cert_file == NULL || TLS_param.key_file == NULL)
+		LogFatal(COMPONENT_INIT,
+			 "RPC_TLS needs Certificate_File and Private_Key_File");
+
+	tls_ctx = SSL_CTX_new(TLS_server_method());
+	if (tls_ctx == NULL) {
+		tls_log_errors("SSL_CTX_new");
+		LogFatal(COMPONENT_INIT, "Could not set up RPC-over-TLS");
+	}
+
+	/* RFC 9289 asks for TLS 1.3; no tickets, nothing may follow the
+	 * handshake that TI-RPC would read as a record.
+	 */
+	SSL_CTX_set_min_proto_version(tls_ctx, TLS1_3_VERSION);
+	SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS |
+				     SSL_OP_NO_RENEGOTIATION);
+	SSL_CTX_set_num_tickets(tls_ctx, 0);
+	SSL_CTX_set_alpn_select_cb(tls_ctx, tls_alpn_select, NULL);
+
+	if (SSL_CTX_use_certificate_chain_file(tls_ctx,
+					       TLS_param.cert_file) != 1 ||
+	    SSL_CTX_use_PrivateKey_file(tls_ctx, TLS_param.key_file,
+					SSL_FILETYPE_PEM) != 1 ||
+	    SSL_CTX_check_private_key(tls_ctx) != 1) {
+		tls_log_errors(TLS_param.cert_file);
+		LogFatal(COMPONENT_INIT,
+			 "Could not load RPC-over-TLS certificate %s and key %s",
+			 TLS_param.cert_file, TLS_param.key_file);
+	}
+
+	if (TLS_param.ca_file != NULL) {
+		if (SSL_CTX_load_verify_locations(tls_ctx, TLS_param.ca_file,
+						  NULL) != 1) {
+			tls_log_errors(TLS_param.ca_file);
+			LogFatal(COMPONENT_INIT,
+				 "Could not load RPC-over-TLS CA file %s",
+				 TLS_param.ca_file);
+		}
+		SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_PEER |
+				   SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+	}
+
+	LogInfo(COMPONENT_INIT, "RPC-over-TLS enabled with %s",
+		TLS_param.cert_file);
+}
+
+/* Wait for the socket as the handshake asks, until the deadline */
+static bool tls_wait(int fd, int err, time_t deadline)
+{
+	struct pollfd pfd = {
+		.fd = fd,
+		.events = err == SSL_ERROR_WANT_WRITE ? POLLOUT : POLLIN,
+	};
+	time_t left = deadline - time(NULL);
+	int rc;
+
+	if (left <= 0)
+		return false;
+
+	do {
+		rc = poll(&pfd, 1, left * 1000);
+	} while (rc < 0 && errno == EINTR);
+
+	return rc > 0 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
+
+/* Run the server side of the handshake, and move the keys into kTLS */
+static bool tls_accept(SVCXPRT *xprt)
+{
+	time_t deadline = time(NULL) + TLS_param.handshake_timeout;
+	int fd = xprt->xp_fd;
+	int flags = fcntl(fd, F_GETFL);
+	bool ok = false;
+	SSL *ssl;
+	int rc, err;
+
+	ssl = SSL_new(tls_ctx);
+	if (ssl == NULL || SSL_set_fd(ssl, fd) != 1) {
+		tls_log_errors("SSL_new");
+		goto out;
+	}
+
+	/* Non-blocking, for the deadline to hold */
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Could not set socket %d non-blocking: %s",
+			fd, strerror(errno));
+		goto out;
+	}
+
+	for (;;) {
+		rc = SSL_accept(ssl);
+		if (rc == 1)
+			break;
+		err = SSL_get_error(ssl, rc);
+		if ((err != SSL_ERROR_WANT_READ &&
+		     err != SSL_ERROR_WANT_WRITE) ||
+		    !tls_wait(fd, err, deadline)) {
+			tls_log_errors("SSL_accept");
+			LogInfo(COMPONENT_DISPATCH,
+				"TLS handshake failed on socket %d", fd);
+			goto restore;
+		}
+	}
+
+	if (BIO_get_ktls_send(SSL_get_wbio(ssl)) != 1 ||
+	    BIO_get_ktls_recv(SSL_get_rbio(ssl)) != 1) {
+		LogWarn(COMPONENT_DISPATCH,
+			"Kernel TLS not available on socket %d, dropping it",
+			fd);
+		goto restore;
+	}
+
+	ok = true;
+
+ restore:
+	(void) fcntl(fd, F_SETFL, flags);
+ out:
+	/* No SSL_shutdown: the session lives on in the kernel */
+	SSL_free(ssl);
+	return ok;
+}
+
+/**
+ * @brief Answer an AUTH_TLS probe, then start TLS on the connection
+ *
+ * Called by the decoder with the call header read.  Probes that
+ * aren't a NULL call on a TCP connection not yet using TLS, or come
+ * while RPC_TLS is disabled, are refused with AUTH_BADCRED.
+ *
+ * @param[in] reqdata The probe
+ *
+ * @return The state of the transport, XPRT_DIED when the handshake
+ *         failed.
+ */
+enum xprt_stat nfs_rpc_tls_probe(request_data_t *reqdata)
+{
+	struct svc_req *req = &reqdata->r_u.req.svc;
+	SVCXPRT *xprt = reqdata->r_u.req.xprt;
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+	if (tls_ctx == NULL || xprt->xp_type != XPRT_TCP || xu == NULL ||
+	    req->rq_msg.cb_proc != NULLPROC ||
+	    (xu->flags & XPRT_PRIVATE_FLAG_TLS)) {
+		svcerr_auth(req, AUTH_BADCRED);
+		return SVC_STAT(xprt);
+	}
+
+	if (!SVC_GETARGS(req, (xdrproc_t) xdr_void, NULL,
+			 &reqdata->r_u.req.lookahead)) {
+		svcerr_decode(req);
+		return SVC_STAT(xprt);
+	}
+
+	req->rq_msg.RPCM_ack.ar_verf.oa_flavor = AUTH_NONE;
+	req->rq_msg.RPCM_ack.ar_verf.oa_base = tls_starttls;
+	req->rq_msg.RPCM_ack.ar_verf.oa_length = sizeof(tls_starttls) - 1;
+
+	if (!svc_sendreply(req, (xdrproc_t) xdr_void, NULL))
+		return XPRT_DIED;
+
+	if (!tls_accept(xprt))
+		return XPRT_DIED;
+
+	atomic_set_uint16_t_bits(&xu->flags, XPRT_PRIVATE_FLAG_TLS);
+
+	LogDebug(COMPONENT_DISPATCH, "Socket %d now uses TLS", xprt->xp_fd);
+
+	return XPRT_IDLE;
+}
+
+/**
+ * @brief Whether a call needs TLS it doesn't have
+ *
+ * With Required, all but NULL calls must come on a TLS connection.
+ */
+bool nfs_rpc_tls_refused(request_data_t *reqdata)
+{
+	SVCXPRT *xprt = reqdata->r_u.req.xprt;
+	gsh_xprt_private_t *xu = (gsh_xprt_private_t *) xprt->xp_u1;
+
+	if (!TLS_param.enable || !TLS_param.required ||
+	    reqdata->r_u.req.svc.rq_msg.cb_proc == NULLPROC)
+		return false;
+
+	return xu == NULL || !(xu->flags & XPRT_PRIVATE_FLAG_TLS);
+}
@@ -59,6 +59,7 @@
 #include "export_mgr.h"
 #include "server_stats.h"
 #include "uid2grp.h"
+#include "io_bufpool.h"
 
 #ifdef USE_LTTNG
 #include "gsh_lttng/nfs_rpc.h"
@@ -71,6 +72,9 @@ pool_t *request_pool;
 
 static struct fridgethr *worker_fridge;
 
+/* Set once the first reply is sent, for the startup timings */
+static uint32_t first_reply_sent;
+
 const nfs_function_desc_t invalid_funcdesc = {
 	.service_function = nfs_null,
 	.free_function = nfs_null_free,
@@ -282,7 +286,7 @@ const nfs_function_desc_t nfs4_func_desc[] = {
 	 .service_function = nfs4_Compound,
 	 .free_function = nfs4_Compound_Free,
 	 .xdr_decode_func = (xdrproc_t) xdr_COMPOUND4args,
-	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res,
+	 .xdr_encode_func = (xdrproc_t) xdr_COMPOUND4res_extended,
 	 .funcname = "nfs4_Comp",
 	 .dispatch_behaviour = CAN_BE_DUP}
 };
@@ -702,13 +706,333 @@ const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *reqnfs)
 	return funcdesc;
 }
 
+/**
+ * @brief Free the arguments and the request context of a request
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in] slocked		Whether the xprt send lock is held
+ */
+static void nfs_rpc_release_request(request_data_t *reqdata, bool slocked)
+{
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+
+	/* XXX no need for xprt slock across SVC_FREEARGS */
+	DISP_SUNLOCK(xprt);
+
+	/* Free the allocated resources once the work is done */
+	/* Free the arguments */
+	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
+	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
+		if (!SVC_FREEARGS(&reqdata->r_u.req.svc,
+				  reqdesc->xdr_decode_func,
+				  (caddr_t) arg_nfs)) {
+			LogCrit(COMPONENT_DISPATCH,
+				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
+				reqdesc->funcname);
+		}
+	}
+
+	/* Finalize the request. */
+	if (res_nfs)
+		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
+
+	gsh_arena_release(&reqdata->arena);
+
+	if (gsh_trace_mask != 0) {
+		struct timespec done;
+
+		now(&done);
+		gsh_trace(TRACE_REQ_DONE, __func__,
+			  timespec_diff(&ServerBootTime, &done) -
+			  op_ctx->start_time,
+			  reqdata->r_u.req.svc.rq_msg.rm_xid);
+	}
+
+	SetClientIP(NULL);
+	cpu_profile_op(NULL, -1);
+	if (op_ctx->client != NULL) {
+		put_gsh_client(op_ctx->client);
+		op_ctx->client = NULL;
+	}
+	if (op_ctx->ctx_export != NULL) {
+		put_gsh_export(op_ctx->ctx_export);
+		op_ctx->ctx_export = NULL;
+	}
+	clean_credentials();
+	op_ctx = NULL;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, end, reqdata);
+#endif
+}
+
+/**
+ * @brief Send the reply for a processed request and release it
+ *
+ * This is the tail of request processing, run either directly from
+ * nfs_rpc_execute() or when resuming a request that was suspended on
+ * asynchronous I/O.  The request must have been a new (non-duplicate)
+ * request.
+ *
+ * @param[in,out] reqdata	NFS request
+ * @param[in] rc		Result of the service function
+ */
+static void nfs_rpc_complete_request(request_data_t *reqdata, int rc)
+{
+	const char *client_ip = "<unknown client>";
+	const nfs_function_desc_t *reqdesc = reqdata->r_u.req.funcdesc;
+	nfs_res_t *res_nfs = reqdata->r_u.req.res_nfs;
+	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
+	bool slocked = false;
+	struct timespec executed;
+
+	if (op_ctx->client != NULL)
+		client_ip = op_ctx->client->hostaddr_str;
+
+	if (op_ctx->latency_sample)
+		now(&executed);
+
+/* NFSv4 stats are handled in nfs4_compound()
+ */
+	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
+	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
+		server_stats_nfs_done(reqdata, rc, false);
+
+	/* If request is dropped, no return to the client */
+	if (rc == NFS_REQ_DROP) {
+		/* The request was dropped */
+		LogDebug(COMPONENT_DISPATCH,
+			 "Drop request rpc_xid=%" PRIu32
+			 ", program %" PRIu32
+			 ", version %" PRIu32
+			 ", function %" PRIu32,
+			 reqdata->r_u.req.svc.rq_msg.rm_xid,
+			 reqdata->r_u.req.svc.rq_msg.cb_prog,
+			 reqdata->r_u.req.svc.rq_msg.cb_vers,
+			 reqdata->r_u.req.svc.rq_msg.cb_proc);
+
+		/* If the request is not normally cached, then the entry
+		 * will be removed later.  We only remove a reply that is
+		 * normally cached that has been dropped.
+		 */
+		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
+		    != DUPREQ_SUCCESS) {
+			LogCrit(COMPONENT_DISPATCH,
+				"Attempt to delete duplicate request failed on line %d",
+				__LINE__);
+		}
+		goto freeargs;
+	} else {
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "Before svc_sendreply on socket %d", xprt->xp_fd);
+
+		DISP_SLOCK(xprt);
+
+		/* encoding the result on xdr output */
+		if (!svc_sendreply(&reqdata->r_u.req.svc,
+				   reqdesc->xdr_encode_func,
+				   (caddr_t) res_nfs)) {
+			LogDebug(COMPONENT_DISPATCH,
+				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request."
+				 " rpcxid=%" PRIu32
+				 " socket=%d function:%s client:%s"
+				 " program:%" PRIu32
+				 " nfs version:%" PRIu32
+				 " proc:%" PRIu32
+				 " errno: %d",
+				 reqdata->r_u.req.svc.rq_msg.rm_xid,
+				 xprt->xp_fd,
+				 reqdesc->funcname,
+				 client_ip,
+				 reqdata->r_u.req.svc.rq_msg.cb_prog,
+				 reqdata->r_u.req.svc.rq_msg.cb_vers,
+				 reqdata->r_u.req.svc.rq_msg.cb_proc,
+				 errno);
+			if (xprt->xp_type != XPRT_UDP)
+				svc_destroy(xprt);
+			goto freeargs;
+		}
+
+		LogFullDebug(COMPONENT_DISPATCH,
+			     "After svc_sendreply on socket %d", xprt->xp_fd);
+
+		if (unlikely(atomic_fetch_uint32_t(&first_reply_sent) == 0) &&
+		    atomic_postinc_uint32_t(&first_reply_sent) == 0)
+			LogEvent(COMPONENT_DISPATCH,
+				 "First request served %"PRIu64" ms since start",
+				 nfs_uptime_ms());
+
+		if (op_ctx->latency_sample)
+			server_stats_latency_done(reqdata, &executed);
+	}			/* rc == NFS_REQ_DROP */
+
+	/* Finish any request not already deleted */
+	if (reqdata->r_u.req.svc.rq_u1 != (void *)DUPREQ_NOCACHE) {
+		(void) nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, dupreq_finish, reqdata);
+#endif
+	}
+
+ freeargs:
+	nfs_rpc_release_request(reqdata, slocked);
+}
+
+/**
+ * @brief Suspend a request waiting on asynchronous I/O
+ *
+ * Called once the service function has returned NFS_REQ_ASYNC_WAIT.
+ * Whichever of this and nfs_rpc_async_complete() runs second owns the
+ * request from then on.
+ *
+ * @param[in] reqdata	NFS request
+ *
+ * @retval true if the request was suspended, reqdata must not be touched.
+ * @retval false if the I/O already completed, resume inline.
+ */
+static bool nfs_rpc_async_suspend(request_data_t *reqdata)
+{
+	uint32_t flags;
+
+	flags = atomic_postset_uint32_t_bits(&reqdata->async_flags,
+					     ASYNC_PROC_DONE);
+
+	return !(flags & ASYNC_PROC_EXIT);
+}
+
+/**
+ * @brief Wait for asynchronous I/O, resuming the request inline if possible
+ *
+ * @param[in] reqdata	NFS request
+ *
+ * @return NFS_REQ_ASYNC_WAIT if the request was suspended, otherwise the
+ *         final result of the request.
+ */
+static int nfs_rpc_async_wait(request_data_t *reqdata)
+{
+	int rc = NFS_REQ_ASYNC_WAIT;
+
+	while (rc == NFS_REQ_ASYNC_WAIT) {
+		/* Give up the thread context before the request can be
+		 * picked up by another worker.
+		 */
+		SetClientIP(NULL);
+		cpu_profile_op(NULL, -1);
+		op_ctx = NULL;
+
+		if (nfs_rpc_async_suspend(reqdata))
+			return NFS_REQ_ASYNC_WAIT;
+
+		/* The I/O completed before we got here, keep going */
+		op_ctx = &reqdata->req_ctx;
+		if (op_ctx->client != NULL)
+			SetClientIP(op_ctx->client->hostaddr_str);
+		cpu_profile_op(reqdata->r_u.req.funcdesc->funcname,
+			       op_ctx->ctx_export != NULL
+			       ? op_ctx->ctx_export->export_id : -1);
+
+		reqdata->async_flags = 0;
+		rc = reqdata->resume(reqdata);
+	}
+
+	return rc;
+}
+
+/**
+ * @brief Signal completion of the asynchronous I/O a request waits on
+ *
+ * Called from the FSAL completion callback.  If the request has already
+ * been suspended, it is queued again to be resumed by a worker thread.
+ *
+ * @param[in] reqdata	NFS request
+ */
+void nfs_rpc_async_complete(request_data_t *reqdata)
+{
+	uint32_t flags;
+
+	flags = atomic_postset_uint32_t_bits(&reqdata->async_flags,
+					     ASYNC_PROC_EXIT);
+
+	if (flags & ASYNC_PROC_DONE)
+		nfs_rpc_enqueue_req(reqdata);
+}
+
+/**
+ * @brief Resume a request suspended on asynchronous I/O
+ *
+ * @param[in,out] reqdata	NFS request
+ *
+ * @return NFS_REQ_ASYNC_WAIT if the request was suspended again.
+ */
+static int nfs_rpc_resume(request_data_t *reqdata)
+{
+	int rc;
+
+	op_ctx = &reqdata->req_ctx;
+	if (op_ctx->client != NULL)
+		SetClientIP(op_ctx->client->hostaddr_str);
+	cpu_profile_op(reqdata->r_u.req.funcdesc->funcname,
+		       op_ctx->ctx_export != NULL
+		       ? op_ctx->ctx_export->export_id : -1);
+
+	reqdata->async_flags = 0;
+	rc = reqdata->resume(reqdata);
+
+	if (rc == NFS_REQ_ASYNC_WAIT) {
+		rc = nfs_rpc_async_wait(reqdata);
+		if (rc == NFS_REQ_ASYNC_WAIT)
+			return rc;
+	}
+
+	nfs_rpc_complete_request(reqdata, rc);
+	return rc;
+}
+
+/**
+ * @brief Get the client of a connection
+ *
+ * The first request of a connection looks its client up and pins it
+ * on the connection; those after it just take a reference.
+ *
+ * @param[in] xu   Private data of the connection
+ * @param[in] addr Its peer
+ *
+ * @return The client, with a reference, or NULL.
+ */
+static struct gsh_client *xprt_gsh_client(gsh_xprt_private_t *xu,
+					  sockaddr_t *addr)
+{
+	struct gsh_client *cl;
+
+	cl = atomic_fetch_voidptr((void **)&xu->client);
+	if (cl == NULL) {
+		/* The reference of the pin */
+		cl = get_gsh_client(addr, false);
+		if (cl == NULL)
+			return NULL;
+		if (!atomic_cmpxchg_voidptr((void **)&xu->client, NULL, cl)) {
+			put_gsh_client(cl);
+			cl = atomic_fetch_voidptr((void **)&xu->client);
+		}
+	}
+	inc_gsh_client_refcount(cl);
+	return cl;
+}
+
 /**
  * @brief Main RPC dispatcher routine
  *
  * @param[in,out] reqdata	NFS request
  *
+ * @return NFS_REQ_ASYNC_WAIT if the request was suspended on asynchronous
+ *         I/O, in which case reqdata now belongs to the completion and must
+ *         not be touched; otherwise the request is complete.
  */
-void nfs_rpc_execute(request_data_t *reqdata)
+int nfs_rpc_execute(request_data_t *reqdata)
 {
 	const char *client_ip = "<unknown client>";
 	const char *progname = "unknown";
@@ -716,9 +1040,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	nfs_arg_t *arg_nfs = &reqdata->r_u.req.arg_nfs;
 	SVCXPRT *xprt = reqdata->r_u.req.svc.rq_xprt;
 	nfs_res_t *res_nfs;
-	struct export_perms export_perms;
-	struct user_cred user_credentials;
-	struct req_op_context req_ctx;
+	struct export_perms *export_perms = &reqdata->export_perms;
 	dupreq_status_t dpq_status;
 	struct timespec timer_start;
 	enum auth_stat auth_rc;
@@ -742,14 +1064,17 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 	/* set up the request context
 	 */
-	memset(&export_perms, 0, sizeof(export_perms));
-	memset(&req_ctx, 0, sizeof(req_ctx));
-	op_ctx = &req_ctx;
-	op_ctx->creds = &user_credentials;
+	memset(export_perms, 0, sizeof(*export_perms));
+	memset(&reqdata->req_ctx, 0, sizeof(reqdata->req_ctx));
+	gsh_arena_init(&reqdata->arena);
+	reqdata->async_flags = 0;
+	op_ctx = &reqdata->req_ctx;
+	op_ctx->creds = &reqdata->user_credentials;
 	op_ctx->caller_addr = (sockaddr_t *)svc_getrpccaller(xprt);
 	op_ctx->nfs_vers = reqdata->r_u.req.svc.rq_msg.cb_vers;
 	op_ctx->req_type = reqdata->rtype;
-	op_ctx->export_perms = &export_perms;
+	op_ctx->export_perms = export_perms;
+	op_ctx->perms_cache = nfs_rpc_xprt_perms_cache(xprt);
 
 	/* Set up initial export permissions that don't allow anything. */
 	export_check_access();
@@ -763,6 +1088,18 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	op_ctx->queue_wait =
 	    op_ctx->start_time - timespec_diff(&ServerBootTime,
 					       &reqdata->time_queued);
+	op_ctx->latency_sample = reqdata->latency_sample;
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, context, reqdata, op_ctx,
+		   reqdata->r_u.req.svc.rq_msg.rm_xid);
+#endif
+
+	gsh_trace(TRACE_REQ_START, __func__,
+		  (uint64_t) reqdata->r_u.req.svc.rq_msg.cb_prog << 32 |
+		  reqdata->r_u.req.svc.rq_msg.rm_xid,
+		  reqdata->r_u.req.svc.rq_msg.cb_vers << 16 |
+		  reqdata->r_u.req.svc.rq_msg.cb_proc);
 
 	/* Initialized user_credentials */
 	init_credentials();
@@ -777,7 +1114,12 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 * xprt private data. */
 
 	port = get_port(op_ctx->caller_addr);
-	op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
+	if (op_ctx->perms_cache != NULL)
+		/* a connection, all from one client */
+		op_ctx->client = xprt_gsh_client(xprt->xp_u1,
+						 op_ctx->caller_addr);
+	else
+		op_ctx->client = get_gsh_client(op_ctx->caller_addr, false);
 	if (op_ctx->client == NULL) {
 		LogDebug(COMPONENT_DISPATCH,
 			 "Cannot get client block for Program %" PRIu32
@@ -808,10 +1150,19 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		&reqdata->r_u.req.svc.rq_xprt->blkin.endp,
 		"rpc_execute-have-clientid");
 #endif
-	/* If req is uncacheable, or if req is v41+, nfs_dupreq_start will do
-	 * nothing but allocate a result object and mark the request (ie, the
-	 * path is short, lockless, and does no hash/search). */
-	dpq_status = nfs_dupreq_start(&reqdata->r_u.req, &reqdata->r_u.req.svc);
+	/* NFSv4.1+ replays are answered from the session slot table, so
+	 * those requests never touch the DRC; they only get a result object
+	 * and a mark.  Otherwise nfs_dupreq_start does the same for any
+	 * uncacheable request, and looks up everything else. */
+	if (nfs_dupreq_bypass(&reqdata->r_u.req)) {
+		nfs_dupreq_nocache(&reqdata->r_u.req, &reqdata->r_u.req.svc);
+		dpq_status = DUPREQ_SUCCESS;
+	} else
+		dpq_status = nfs_dupreq_start(&reqdata->r_u.req,
+					      &reqdata->r_u.req.svc);
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, dupreq_start, reqdata, dpq_status);
+#endif
 	res_nfs = reqdata->r_u.req.res_nfs;
 	if (dpq_status == DUPREQ_SUCCESS) {
 		/* A new request, continue processing it. */
@@ -929,7 +1280,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				goto req_error;
 			}
 
-			op_ctx->ctx_export = get_gsh_export(exportid);
+			op_ctx->ctx_export =
+				export_perms_cache_export(op_ctx->perms_cache,
+							  exportid);
 
 			if (op_ctx->ctx_export == NULL) {
 				LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1016,7 +1369,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				 * can respond to ASYNC calls.
 				 */
 			} else {
-				op_ctx->ctx_export = get_gsh_export(exportid);
+				op_ctx->ctx_export =
+				    export_perms_cache_export(
+						op_ctx->perms_cache, exportid);
 
 				if (op_ctx->ctx_export == NULL) {
 					LogInfoAlt(COMPONENT_DISPATCH,
@@ -1062,7 +1417,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		export_check_access();
 
-		if ((export_perms.options & EXPORT_OPTION_ACCESS_MASK) == 0) {
+		if ((export_perms->options & EXPORT_OPTION_ACCESS_MASK) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Client %s is not allowed to access Export_Id %d %s"
 				", vers=%" PRIu32
@@ -1077,7 +1432,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			goto auth_failure;
 		}
 
-		if ((EXPORT_OPTION_NFSV3 & export_perms.options) == 0) {
+		if ((EXPORT_OPTION_NFSV3 & export_perms->options) == 0) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" not allowed on Export_Id %d %s for client %s",
@@ -1093,9 +1448,9 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
 		/* Check transport type */
 		if (((xprt_type == XPRT_UDP)
-		     && ((export_perms.options & EXPORT_OPTION_UDP) == 0))
+		     && ((export_perms->options & EXPORT_OPTION_UDP) == 0))
 		    || ((xprt_type == XPRT_TCP)
-			&& ((export_perms.options & EXPORT_OPTION_TCP) == 0))) {
+			&& ((export_perms->options & EXPORT_OPTION_TCP) == 0))) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"%s Version %" PRIu32
 				" over %s not allowed on Export_Id %d %s for client %s",
@@ -1129,7 +1484,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		/* Check if client is using a privileged port,
 		 * but only for NFS protocol */
 		if ((reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
-		 && (export_perms.options & EXPORT_OPTION_PRIVILEGED_PORT)
+		 && (export_perms->options & EXPORT_OPTION_PRIVILEGED_PORT)
 		 && (port >= IPPORT_RESERVED)) {
 			LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 				"Non-reserved Port %d is not allowed on Export_Id %d %s for client %s",
@@ -1148,7 +1503,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	 */
 	if (op_ctx->ctx_export != NULL
 	    && (reqdesc->dispatch_behaviour & MAKES_IO)
-	    && !(export_perms.options & EXPORT_OPTION_RW_ACCESS)) {
+	    && !(export_perms->options & EXPORT_OPTION_RW_ACCESS)) {
 		/* Request of type MDONLY_RO were rejected at the
 		 * nfs_rpc_dispatcher level.
 		 * This is done by replying EDQUOT
@@ -1180,7 +1535,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		}
 	} else if (op_ctx->ctx_export != NULL
 		   && (reqdesc->dispatch_behaviour & MAKES_WRITE)
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_WRITE_ACCESS
 			| EXPORT_OPTION_MD_WRITE_ACCESS)) == 0) {
 		if (reqdata->r_u.req.svc.rq_msg.cb_prog == NFS_program[P_NFS])
@@ -1207,7 +1562,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 			rc = NFS_REQ_DROP;
 		}
 	} else if (op_ctx->ctx_export != NULL
-		   && (export_perms.options
+		   && (export_perms->options
 		       & (EXPORT_OPTION_READ_ACCESS
 			 | EXPORT_OPTION_MD_READ_ACCESS)) == 0) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
@@ -1227,7 +1582,7 @@ void nfs_rpc_execute(request_data_t *reqdata)
 				/* If NEEDS_CRED and not NEEDS_EXPORT,
 				 * don't squash
 				 */
-				export_perms.options = EXPORT_OPTION_ROOT;
+				export_perms->options = EXPORT_OPTION_ROOT;
 			}
 
 			if (nfs_req_creds(&reqdata->r_u.req.svc) != NFS4_OK) {
@@ -1266,6 +1621,10 @@ void nfs_rpc_execute(request_data_t *reqdata)
 
  null_op:
 
+		cpu_profile_op(reqdesc->funcname,
+			       op_ctx->ctx_export != NULL
+			       ? op_ctx->ctx_export->export_id : -1);
+
 #ifdef USE_LTTNG
 		tracepoint(nfs_rpc, op_start, reqdata,
 			   reqdesc->funcname,
@@ -1296,6 +1655,12 @@ void nfs_rpc_execute(request_data_t *reqdata)
 		rc = reqdesc->service_function(arg_nfs, &reqdata->r_u.req.svc,
 					res_nfs);
 
+		if (rc == NFS_REQ_ASYNC_WAIT) {
+			rc = nfs_rpc_async_wait(reqdata);
+			if (rc == NFS_REQ_ASYNC_WAIT)
+				return rc;
+		}
+
 #ifdef USE_LTTNG
 	tracepoint(nfs_rpc, op_end, reqdata);
 #endif
@@ -1312,76 +1677,8 @@ void nfs_rpc_execute(request_data_t *reqdata)
  req_error:
 #endif /* _USE_NFS3 */
 
-/* NFSv4 stats are handled in nfs4_compound()
- */
-	if (reqdata->r_u.req.svc.rq_msg.cb_prog != NFS_program[P_NFS]
-	    || reqdata->r_u.req.svc.rq_msg.cb_vers != NFS_V4)
-		server_stats_nfs_done(reqdata, rc, false);
-
-	/* If request is dropped, no return to the client */
-	if (rc == NFS_REQ_DROP) {
-		/* The request was dropped */
-		LogDebug(COMPONENT_DISPATCH,
-			 "Drop request rpc_xid=%" PRIu32
-			 ", program %" PRIu32
-			 ", version %" PRIu32
-			 ", function %" PRIu32,
-			 reqdata->r_u.req.svc.rq_msg.rm_xid,
-			 reqdata->r_u.req.svc.rq_msg.cb_prog,
-			 reqdata->r_u.req.svc.rq_msg.cb_vers,
-			 reqdata->r_u.req.svc.rq_msg.cb_proc);
-
-		/* If the request is not normally cached, then the entry
-		 * will be removed later.  We only remove a reply that is
-		 * normally cached that has been dropped.
-		 */
-		if (nfs_dupreq_delete(&reqdata->r_u.req.svc)
-		    != DUPREQ_SUCCESS) {
-			LogCrit(COMPONENT_DISPATCH,
-				"Attempt to delete duplicate request failed on line %d",
-				__LINE__);
-		}
-		goto freeargs;
-	} else {
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "Before svc_sendreply on socket %d", xprt->xp_fd);
-
-		DISP_SLOCK(xprt);
-
-		/* encoding the result on xdr output */
-		if (!svc_sendreply(&reqdata->r_u.req.svc,
-				   reqdesc->xdr_encode_func,
-				   (caddr_t) res_nfs)) {
-			LogDebug(COMPONENT_DISPATCH,
-				 "NFS DISPATCHER: FAILURE: Error while calling svc_sendreply on a new request."
-				 " rpcxid=%" PRIu32
-				 " socket=%d function:%s client:%s"
-				 " program:%" PRIu32
-				 " nfs version:%" PRIu32
-				 " proc:%" PRIu32
-				 " errno: %d",
-				 reqdata->r_u.req.svc.rq_msg.rm_xid,
-				 xprt->xp_fd,
-				 reqdesc->funcname,
-				 client_ip,
-				 reqdata->r_u.req.svc.rq_msg.cb_prog,
-				 reqdata->r_u.req.svc.rq_msg.cb_vers,
-				 reqdata->r_u.req.svc.rq_msg.cb_proc,
-				 errno);
-			if (xprt->xp_type != XPRT_UDP)
-				svc_destroy(xprt);
-			goto freeargs;
-		}
-
-		LogFullDebug(COMPONENT_DISPATCH,
-			     "After svc_sendreply on socket %d", xprt->xp_fd);
-
-	}			/* rc == NFS_REQ_DROP */
-
-	/* Finish any request not already deleted */
-	if (dpq_status == DUPREQ_SUCCESS)
-		dpq_status = nfs_dupreq_finish(&reqdata->r_u.req.svc, res_nfs);
-	goto freeargs;
+	nfs_rpc_complete_request(reqdata, rc);
+	return rc;
 
 	/* Reject the request for authentication reason (incompatible
 	 * file handle) */
@@ -1409,43 +1706,8 @@ void nfs_rpc_execute(request_data_t *reqdata)
 	}
 
  freeargs:
-
-	/* XXX no need for xprt slock across SVC_FREEARGS */
-	DISP_SUNLOCK(xprt);
-
-	/* Free the allocated resources once the work is done */
-	/* Free the arguments */
-	if ((reqdata->r_u.req.svc.rq_msg.cb_vers == 2)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 3)
-	 || (reqdata->r_u.req.svc.rq_msg.cb_vers == 4)) {
-		if (!SVC_FREEARGS(&reqdata->r_u.req.svc,
-				  reqdesc->xdr_decode_func,
-				  (caddr_t) arg_nfs)) {
-			LogCrit(COMPONENT_DISPATCH,
-				"NFS DISPATCHER: FAILURE: Bad SVC_FREEARGS for %s",
-				reqdesc->funcname);
-		}
-	}
-
-	/* Finalize the request. */
-	if (res_nfs)
-		nfs_dupreq_rele(&reqdata->r_u.req.svc, reqdesc);
-
-	SetClientIP(NULL);
-	if (op_ctx->client != NULL) {
-		put_gsh_client(op_ctx->client);
-		op_ctx->client = NULL;
-	}
-	if (op_ctx->ctx_export != NULL) {
-		put_gsh_export(op_ctx->ctx_export);
-		op_ctx->ctx_export = NULL;
-	}
-	clean_credentials();
-	op_ctx = NULL;
-
-#ifdef USE_LTTNG
-	tracepoint(nfs_rpc, end, reqdata);
-#endif
+	nfs_rpc_release_request(reqdata, slocked);
+	return rc;
 }
 
 #ifdef _USE_9P
@@ -1486,7 +1748,12 @@ static void _9p_execute(request_data_t *reqdata)
 static void _9p_free_reqdata(struct _9p_request_data *req9p)
 {
 	if (req9p->pconn->trans_type == _9P_TCP)
+		io_buf_free(req9p->_9pmsg);
+#ifdef _USE_9P_RDMA
+	else if (req9p->data == NULL)
+		/* Copied out of its receive buffer */
 		gsh_free(req9p->_9pmsg);
+#endif
 
 	/* decrease connection refcount */
 	(void) atomic_dec_uint32_t(&req9p->pconn->refcount);
@@ -1536,18 +1803,45 @@ static void worker_thread_finalizer(struct fridgethr_context *ctx)
  * @param[in] ctx Fridge thread context
  */
 
+/**
+ * @brief Charge the time since the last mark to a worker counter
+ *
+ * @param[in,out] mark    Time of the last mark, updated
+ * @param[in,out] counter nfs_req_st.workers.busy or idle
+ */
+
+static inline void worker_clock(uint64_t *mark, uint64_t *counter)
+{
+	uint64_t t = gsh_trace_clock();
+
+	(void) atomic_add_uint64_t(counter, t - *mark);
+	*mark = t;
+}
+
 static void worker_run(struct fridgethr_context *ctx)
 {
 	struct nfs_worker_data *worker_data = &ctx->wd;
 	request_data_t *reqdata;
+	uint64_t mark = gsh_trace_clock();
+	bool busy = false;
 
 	/* Worker's loop */
 	while (!fridgethr_you_should_break(ctx)) {
+		if (busy) {
+			worker_clock(&mark, &nfs_req_st.workers.busy);
+			(void) atomic_dec_uint32_t(&nfs_req_st.workers.active);
+			busy = false;
+		}
+
 		reqdata = nfs_rpc_dequeue_req(worker_data);
+		worker_clock(&mark, &nfs_req_st.workers.idle);
 
 		if (!reqdata)
 			continue;
 
+		busy = true;
+		(void) atomic_inc_uint32_t(&nfs_req_st.workers.active);
+
 /* need to do a getpeername(2) on the socket fd before we dive into the
  * rpc_execute.  9p is messy but we do have the fd....
  */
@@ -1558,6 +1852,23 @@ static void worker_run(struct fridgethr_context *ctx)
 				"Unexpected unknown request");
 			break;
 		case NFS_REQUEST:
+			if (reqdata->async_flags & ASYNC_PROC_EXIT) {
+				/* Asynchronous I/O completed, the request
+				 * has already been executed up to the point
+				 * it was suspended.  Even if the xprt has
+				 * been destroyed, the request must be resumed
+				 * to release the resources it holds.
+				 */
+				LogDebug(COMPONENT_DISPATCH,
+					 "Resuming NFS request, reqdata=%p xprt=%p",
+					 reqdata,
+					 reqdata->r_u.req.svc.rq_xprt);
+				if (nfs_rpc_resume(reqdata) ==
+				    NFS_REQ_ASYNC_WAIT)
+					continue;
+				break;
+			}
+
 			/* check for destroyed xprts */
 			if (reqdata->r_u.req.svc.rq_xprt->
 			    xp_flags & SVC_XPRT_FLAG_DESTROYED) {
@@ -1572,7 +1883,12 @@ static void worker_run(struct fridgethr_context *ctx)
 				 reqdata,
 				 reqdata->r_u.req.svc.rq_xprt,
 				 reqdata->r_u.req.svc.rq_xprt->xp_requests);
-			nfs_rpc_execute(reqdata);
+			if (nfs_rpc_execute(reqdata) == NFS_REQ_ASYNC_WAIT) {
+				/* Suspended, the request will be queued
+				 * again when its I/O completes.
+				 */
+				continue;
+			}
 			break;
 
 		case NFS_CALL:
@@ -1598,6 +1914,7 @@ static void worker_run(struct fridgethr_context *ctx)
 			gsh_xprt_unref(reqdata->r_u.req.svc.rq_xprt,
 				       XPRT_PRIVATE_FLAG_DECREQ, __func__,
 				       __LINE__);
+			nfs_rpc_return_credit();
 			break;
 		case NFS_CALL:
 			break;
@@ -1616,6 +1933,11 @@ static void worker_run(struct fridgethr_context *ctx)
 
 		pool_free(request_pool, reqdata);
 	}
+
+	if (busy) {
+		worker_clock(&mark, &nfs_req_st.workers.busy);
+		(void) atomic_dec_uint32_t(&nfs_req_st.workers.active);
+	}
 }
 
 int worker_init(void)
@@ -1631,6 +1953,10 @@ int worker_init(void)
 	frp.thread_finalize = worker_thread_finalizer;
 	frp.wake_threads = nfs_rpc_queue_awaken;
 	frp.wake_threads_arg = &nfs_req_st;
+	/* pinned workers serve the run queue of their domain */
+	frp.affinity = nfs_req_st.reqs.affinity;
+	/* polled in nfs_rpc_dequeue_req */
+	frp.spin_us = nfs_param.core_param.worker_spin;
 
 	rc = fridgethr_init(&worker_fridge, "Wrk", &frp);
 	if (rc != 0) {
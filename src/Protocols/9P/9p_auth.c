@@ -67,9 +67,6 @@ int _9p_auth(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		 (u32) *msgtag, *afid, (int) *uname_len, uname_str,
 		 (int) *aname_len, aname_str, *n_aname);
 
-	if (*afid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
 	/* This message is not implemented yet, return ENOTSUPP */
 	return _9p_rerror(req9p, msgtag, EOPNOTSUPP, plenout, preply);
 }
@@ -74,10 +74,7 @@ int _9p_getlock(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		 (unsigned long long)*length, *proc_id, *client_id_len,
 		 client_id_str);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	/* pfid = req9p->pconn->fids[*fid] ; */
+	/* pfid = _9p_getfid(req9p->pconn, *fid) ; */
 
 	/** @todo This function does nothing for the moment.
 	 * Make it compliant with fcntl( F_GETLCK, ... */
@@ -41,6 +41,8 @@
 #include "nfs_dupreq.h"
 #include "nfs_file_handle.h"
 #include "server_stats.h"
+#include "common_utils.h"
+#include "io_bufpool.h"
 
 /* opcode to function array */
 const struct _9p_function_desc _9pfuncdesc[] = {
@@ -103,43 +105,383 @@ int _9p_not_2000L(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	return -1;
 }				/* _9p_not_2000L */
 
-static ssize_t tcp_conn_send(struct _9p_conn *conn, const void *buf, size_t len,
-			     int flags)
+/**
+ * @brief A 9P/TCP reply owned by its connection until sent
+ */
+struct _9p_tcp_reply {
+	struct glist_head list;		/*< On send_queue or zc_pending */
+	char *data;			/*< From the I/O buffer pool */
+	u32 len;
+	uint32_t zc_first;		/*< Its zerocopy sends, first */
+	uint32_t zc_last;		/*< and last */
+	uint32_t zc_done;		/*< Those the kernel is done with */
+	bool zc_sending;		/*< zc_last not known yet */
+};
+
+static void tcp_reply_free(struct _9p_tcp_reply *reply)
+{
+	io_buf_free(reply->data);
+	gsh_free(reply);
+}
+
+static void tcp_reply_free_list(struct glist_head *list)
+{
+	struct glist_head *glist, *glistn;
+
+	glist_for_each_safe(glist, glistn, list) {
+		glist_del(glist);
+		tcp_reply_free(glist_entry(glist, struct _9p_tcp_reply, list));
+	}
+}
+
+/**
+ * @brief Set up the send queue of a 9P/TCP connection
+ */
+void _9p_tcp_sendq_init(struct _9p_conn *conn)
+{
+	glist_init(&conn->send_queue);
+	glist_init(&conn->zc_pending);
+}
+
+/**
+ * @brief Release the replies left on a closed 9P/TCP connection
+ *
+ * The socket is closed, what the kernel still holds of the zerocopy
+ * replies is not sent anymore.
+ */
+void _9p_tcp_sendq_release(struct _9p_conn *conn)
+{
+	tcp_reply_free_list(&conn->send_queue);
+	tcp_reply_free_list(&conn->zc_pending);
+}
+
+/**
+ * @brief Send iovecs whole
+ *
+ * @param[in]  fd       Socket
+ * @param[in]  iov      What to send, consumed
+ * @param[in]  cnt      Number of iovecs
+ * @param[in]  flags    For sendmsg
+ * @param[out] zc_sends Sends made with MSG_ZEROCOPY
+ *
+ * @return Bytes sent, -1 on error.
+ */
+static ssize_t tcp_conn_sendv(long int fd, struct iovec *iov, int cnt,
+			      int flags, uint32_t *zc_sends)
 {
-	ssize_t ret;
+	struct msghdr msg;
+	ssize_t ret, total = 0;
+	size_t left;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = cnt;
+	*zc_sends = 0;
+
+	while (msg.msg_iovlen > 0) {
+		ret = sendmsg(fd, &msg, flags);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+#ifdef _9P_TCP_ZEROCOPY
+			/* No memory left to pin the pages, copy them */
+			if (errno == ENOBUFS && (flags & MSG_ZEROCOPY)) {
+				flags &= ~MSG_ZEROCOPY;
+				continue;
+			}
+#endif
+			return -1;
+		}
+
+#ifdef _9P_TCP_ZEROCOPY
+		if (flags & MSG_ZEROCOPY)
+			(*zc_sends)++;
+#endif
+		total += ret;
+
+		/* Skip what went */
+		left = ret;
+		while (msg.msg_iovlen > 0 && left >= msg.msg_iov->iov_len) {
+			left -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen > 0) {
+			msg.msg_iov->iov_base =
+				(char *)msg.msg_iov->iov_base + left;
+			msg.msg_iov->iov_len -= left;
+		}
+	}
+
+	return total;
+}
+
+/* Whether the kernel is done with all the zerocopy sends of a reply */
+static bool tcp_reply_zc_done(struct _9p_tcp_reply *reply)
+{
+	return !reply->zc_sending &&
+	       reply->zc_done == reply->zc_last - reply->zc_first + 1;
+}
+
+/**
+ * @brief Send a reply on a 9P/TCP connection
+ *
+ * The reply is queued on the connection.  Unless another worker is
+ * sending on it, this one then sends the queue until it is empty, up
+ * to _9P_TCP_SEND_BATCH replies in one sendmsg, so that the replies
+ * finished meanwhile by the other workers go out together.  Replies of
+ * _9P_TCP_Zerocopy_Threshold bytes or more go alone with MSG_ZEROCOPY,
+ * and are kept until _9p_tcp_zerocopy_done() hears that the kernel is
+ * done with them.
+ *
+ * @param[in] conn  The connection
+ * @param[in] reply The reply, now owned by the connection
+ */
+static void tcp_conn_send(struct _9p_conn *conn, struct _9p_tcp_reply *reply)
+{
+	uint32_t threshold = _9p_param._9p_tcp_zerocopy_threshold;
+	struct iovec iov[_9P_TCP_SEND_BATCH];
+	struct glist_head *glist, *glistn;
+	struct glist_head sent;
+	struct _9p_tcp_reply *r, *zc;
+	uint32_t zc_sends;
+	ssize_t ret, len;
+	int cnt;
 
 	PTHREAD_MUTEX_lock(&conn->sock_lock);
-	ret = send(conn->trans_data.sockfd, buf, len, flags);
+
+	glist_add_tail(&conn->send_queue, &reply->list);
+	if (conn->sending) {
+		PTHREAD_MUTEX_unlock(&conn->sock_lock);
+		return;
+	}
+	conn->sending = true;
+
+	while (!glist_empty(&conn->send_queue)) {
+		glist_init(&sent);
+		zc = NULL;
+		cnt = 0;
+		len = 0;
+
+		glist_for_each_safe(glist, glistn, &conn->send_queue) {
+			r = glist_entry(glist, struct _9p_tcp_reply, list);
+
+			if (conn->zerocopy && threshold != 0 &&
+			    r->len >= threshold) {
+				if (cnt != 0)
+					break;
+				zc = r;
+			}
+
+			glist_del(&r->list);
+			iov[cnt].iov_base = r->data;
+			iov[cnt].iov_len = r->len;
+			len += r->len;
+			cnt++;
+
+			if (zc != NULL)
+				break;
+
+			glist_add_tail(&sent, &r->list);
+			if (cnt == _9P_TCP_SEND_BATCH)
+				break;
+		}
+
+		if (zc != NULL) {
+			/* Its completions may come before the send returns,
+			 * all those not of the earlier replies are its own.
+			 */
+			zc->zc_first = conn->zc_next;
+			zc->zc_done = 0;
+			zc->zc_sending = true;
+			glist_add_tail(&conn->zc_pending, &zc->list);
+		}
+
+		PTHREAD_MUTEX_unlock(&conn->sock_lock);
+
+		ret = tcp_conn_sendv(conn->trans_data.sockfd, iov, cnt,
+#ifdef _9P_TCP_ZEROCOPY
+				     zc != NULL ? MSG_ZEROCOPY : 0,
+#else
+				     0,
+#endif
+				     &zc_sends);
+		if (ret != len) {
+			LogMajor(COMPONENT_9P,
+				 "Could not send 9P/TCP reply correclty on socket #%lu",
+				 conn->trans_data.sockfd);
+			server_stats_transport_done(conn->client,
+						    0, 0, 0,
+						    0, 0, cnt);
+		} else {
+			server_stats_transport_done(conn->client,
+						    0, 0, 0,
+						    ret, cnt, 0);
+		}
+
+		tcp_reply_free_list(&sent);
+
+		PTHREAD_MUTEX_lock(&conn->sock_lock);
+
+		if (zc != NULL) {
+			zc->zc_last = zc->zc_first + zc_sends - 1;
+			zc->zc_sending = false;
+			conn->zc_next += zc_sends;
+			if (tcp_reply_zc_done(zc)) {
+				glist_del(&zc->list);
+				tcp_reply_free(zc);
+			}
+		}
+	}
+
+	conn->sending = false;
 	PTHREAD_MUTEX_unlock(&conn->sock_lock);
+}
 
-	if (ret < 0)
-		server_stats_transport_done(conn->client,
-					    0, 0, 0,
-					    0, 0, 1);
-	else
-		server_stats_transport_done(conn->client,
-					    0, 0, 0,
-					    ret, 1, 0);
-	return ret;
+#ifdef _9P_TCP_ZEROCOPY
+/**
+ * @brief Count zerocopy sends the kernel is done with
+ *
+ * Called with sock_lock held.
+ *
+ * @param[in]  conn The connection
+ * @param[in]  lo   First send
+ * @param[in]  hi   Last send
+ * @param[out] done Replies the kernel is done with
+ */
+static void tcp_conn_zc_ack(struct _9p_conn *conn, uint32_t lo, uint32_t hi,
+			    struct glist_head *done)
+{
+	struct glist_head *glist, *glistn;
+	struct _9p_tcp_reply *r;
+	uint32_t seq = lo;
+
+	for (;;) {
+		/* The one being sent, if any, is the last */
+		glist_for_each(glist, &conn->zc_pending) {
+			r = glist_entry(glist, struct _9p_tcp_reply, list);
+			if (r->zc_sending ||
+			    seq - r->zc_first <= r->zc_last - r->zc_first) {
+				r->zc_done++;
+				break;
+			}
+		}
+		if (seq++ == hi)
+			break;
+	}
+
+	glist_for_each_safe(glist, glistn, &conn->zc_pending) {
+		r = glist_entry(glist, struct _9p_tcp_reply, list);
+		if (tcp_reply_zc_done(r)) {
+			glist_del(&r->list);
+			glist_add_tail(done, &r->list);
+		}
+	}
+}
+#endif
+
+/**
+ * @brief Release the zerocopy replies the kernel is done with
+ *
+ * Called by the I/O thread of the connection when its socket has an
+ * error pending, which is how the kernel reports them.
+ *
+ * @param[in] conn The connection
+ *
+ * @return false if there was none, the error is a real one.
+ */
+bool _9p_tcp_zerocopy_done(struct _9p_conn *conn)
+{
+#ifdef _9P_TCP_ZEROCOPY
+	char control[128];
+	struct sock_extended_err *serr;
+	struct glist_head done;
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	bool any = false;
+
+	glist_init(&done);
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(conn->trans_data.sockfd, &msg,
+			    MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			break;
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+		     cm = CMSG_NXTHDR(&msg, cm)) {
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_errno != 0 ||
+			    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			PTHREAD_MUTEX_lock(&conn->sock_lock);
+			/* The kernel copied anyway, stop pinning pages */
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				conn->zerocopy = false;
+			tcp_conn_zc_ack(conn, serr->ee_info, serr->ee_data,
+					&done);
+			PTHREAD_MUTEX_unlock(&conn->sock_lock);
+			any = true;
+		}
+	}
+
+	tcp_reply_free_list(&done);
+
+	return any;
+#else
+	return false;
+#endif
+}
+
+/**
+ * @brief Room for the reply to a 9P/TCP message
+ *
+ * TREAD and TREADDIR replies carry up to count bytes; others fit in
+ * _9P_TCP_MSIZE.  Never more than msize.
+ */
+static u32 _9p_reply_size(struct _9p_request_data *req9p)
+{
+	char *msgdata = req9p->_9pmsg;
+	u32 msglen = *(u32 *) msgdata;
+	u8 msgtype = *(u8 *) (msgdata + _9P_HDR_SIZE);
+	u32 size = _9P_TCP_MSIZE;
+	u32 count;
+
+	/* size[4] type[1] tag[2] fid[4] offset[8] count[4] */
+	if ((msgtype == _9P_TREAD || msgtype == _9P_TREADDIR) &&
+	    msglen >= _9P_STD_HDR_SIZE + 4 + 8 + 4) {
+		memcpy(&count, msgdata + _9P_STD_HDR_SIZE + 4 + 8,
+		       sizeof(count));
+		if (count > size - _9P_ROOM_RREAD)
+			size = count + _9P_ROOM_RREAD;
+	}
+
+	return size < req9p->pconn->msize ? size : req9p->pconn->msize;
 }
 
 void _9p_tcp_process_request(struct _9p_request_data *req9p)
 {
-	u32 outdatalen = 0;
+	struct _9p_tcp_reply *reply;
+	u32 outdatalen;
 	int rc = 0;
-	char replydata[_9P_MSG_SIZE];
 
-	rc = _9p_process_buffer(req9p, replydata, &outdatalen);
+	reply = gsh_malloc(sizeof(*reply));
+	outdatalen = _9p_reply_size(req9p);
+	reply->data = io_buf_alloc(outdatalen);
+
+	rc = _9p_process_buffer(req9p, reply->data, &outdatalen);
 	if (rc != 1) {
 		LogMajor(COMPONENT_9P,
 			 "Could not process 9P buffer on socket #%lu",
 			 req9p->pconn->trans_data.sockfd);
+		tcp_reply_free(reply);
 	} else {
-		if (tcp_conn_send(req9p->pconn, replydata, outdatalen, 0) !=
-		    outdatalen)
-			LogMajor(COMPONENT_9P,
-				 "Could not send 9P/TCP reply correclty on socket #%lu",
-				 req9p->pconn->trans_data.sockfd);
+		reply->len = outdatalen;
+		tcp_conn_send(req9p->pconn, reply);
 	}
 	_9p_DiscardFlushHook(req9p);
 }				/* _9p_process_request */
@@ -151,6 +493,7 @@ int _9p_process_buffer(struct _9p_request_data *req9p, char *replydata,
 	u32 msglen;
 	u8 msgtype;
 	int rc = 0;
+	struct timespec start;
 
 	msgdata = req9p->_9pmsg;
 
@@ -170,17 +513,20 @@ int _9p_process_buffer(struct _9p_request_data *req9p, char *replydata,
 	LogFullDebug(COMPONENT_9P, "9P msg: length=%u type (%u|%s)", msglen,
 		     (u32) msgtype, _9pfuncdesc[msgtype].funcname);
 
-	/* Temporarily set outlen to maximum message size. This value will be
+	/* Temporarily set outlen to the room of the reply buffer, or to
+	 * maximum message size if the caller left it 0. This value will be
 	 * used inside the protocol functions for additional bound checking,
 	 * and then replaced by the actual message size, (see _9p_checkbound())
 	 */
-	*poutlen = req9p->pconn->msize;
+	if (*poutlen == 0)
+		*poutlen = req9p->pconn->msize;
 
 	/* Call the 9P service function */
+	now(&start);
 	rc = _9pfuncdesc[msgtype].service_function(req9p, poutlen, replydata);
 
 	/* Record 9P statistics */
-	server_stats_9p_done(msgtype, req9p);
+	server_stats_9p_done(msgtype, req9p, &start);
 
 	_9p_release_opctx();
 	op_ctx = NULL; /* poison the op context to disgard it */
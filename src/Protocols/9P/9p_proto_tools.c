@@ -441,9 +441,156 @@ int _9p_tools_clunk(struct _9p_fid *pfid)
 	return 0;
 }
 
+void _9p_init_fids(struct _9p_conn *conn)
+{
+	memset(&conn->fids, 0, sizeof(conn->fids));
+	PTHREAD_RWLOCK_init(&conn->fids.lock, NULL);
+}
+
+static inline uint32_t _9p_fid_hash(u32 fid, uint32_t size)
+{
+	uint32_t h = fid * 0x9E3779B1;
+
+	return (h ^ (h >> 16)) & (size - 1);
+}
+
+/**
+ * @brief Find the slot of a fid, or the free slot it would go in
+ *
+ * The map must be locked and have slots.
+ */
+static struct _9p_fid_slot *_9p_fid_slot(struct _9p_fid_map *map, u32 fid)
+{
+	uint32_t i = _9p_fid_hash(fid, map->size);
+
+	while (map->slots[i].pfid != NULL && map->slots[i].fid != fid)
+		i = (i + 1) & (map->size - 1);
+
+	return &map->slots[i];
+}
+
+/**
+ * @brief Move the fids of a map to new slots
+ *
+ * The map must be write locked.
+ */
+static void _9p_fid_resize(struct _9p_fid_map *map, uint32_t size)
+{
+	struct _9p_fid_slot *old = map->slots;
+	uint32_t oldsize = map->size;
+	uint32_t i;
+
+	map->slots = gsh_calloc(size, sizeof(*map->slots));
+	map->size = size;
+
+	for (i = 0; i < oldsize; i++)
+		if (old[i].pfid != NULL)
+			*_9p_fid_slot(map, old[i].fid) = old[i];
+
+	gsh_free(old);
+}
+
+struct _9p_fid *_9p_getfid(struct _9p_conn *conn, u32 fid)
+{
+	struct _9p_fid *pfid = NULL;
+
+	PTHREAD_RWLOCK_rdlock(&conn->fids.lock);
+
+	if (conn->fids.size != 0)
+		pfid = _9p_fid_slot(&conn->fids, fid)->pfid;
+
+	PTHREAD_RWLOCK_unlock(&conn->fids.lock);
+
+	return pfid;
+}
+
+/**
+ * @brief Whether a fid can be set without going over _9P_FID_PER_CONN
+ *
+ * Racy, concurrent requests may overshoot by a few fids.
+ */
+bool _9p_canaddfid(struct _9p_conn *conn, u32 fid)
+{
+	bool room;
+
+	PTHREAD_RWLOCK_rdlock(&conn->fids.lock);
+
+	room = conn->fids.count < _9P_FID_PER_CONN ||
+	       _9p_fid_slot(&conn->fids, fid)->pfid != NULL;
+
+	PTHREAD_RWLOCK_unlock(&conn->fids.lock);
+
+	return room;
+}
+
+/**
+ * @brief Set a fid, or remove it with a NULL pfid
+ *
+ * Removal shifts the following slots of the probe sequence back, so that
+ * no tombstone is needed.
+ */
+void _9p_setfid(struct _9p_conn *conn, u32 fid, struct _9p_fid *pfid)
+{
+	struct _9p_fid_map *map = &conn->fids;
+	struct _9p_fid_slot *slot;
+	uint32_t mask, i, j, k;
+
+	PTHREAD_RWLOCK_wrlock(&map->lock);
+
+	if (pfid != NULL) {
+		/* Keep the load under 3/4 */
+		if (map->size == 0)
+			_9p_fid_resize(map, _9P_FID_MAP_MIN);
+		else if ((map->count + 1) * 4 > map->size * 3)
+			_9p_fid_resize(map, map->size * 2);
+
+		slot = _9p_fid_slot(map, fid);
+		if (slot->pfid == NULL)
+			map->count++;
+		slot->fid = fid;
+		slot->pfid = pfid;
+		goto out;
+	}
+
+	if (map->size == 0)
+		goto out;
+
+	slot = _9p_fid_slot(map, fid);
+	if (slot->pfid == NULL)
+		goto out;
+
+	mask = map->size - 1;
+	i = slot - map->slots;
+	for (j = (i + 1) & mask; map->slots[j].pfid != NULL;
+	     j = (j + 1) & mask) {
+		k = _9p_fid_hash(map->slots[j].fid, map->size);
+		/* Leave the slot if its home is cyclically in (i, j] */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		map->slots[i] = map->slots[j];
+		i = j;
+	}
+	map->slots[i].pfid = NULL;
+	map->count--;
+
+	/* Give the memory back as the fids go */
+	if (map->count == 0) {
+		gsh_free(map->slots);
+		map->slots = NULL;
+		map->size = 0;
+	} else if (map->size > _9P_FID_MAP_MIN &&
+		   map->count * 8 < map->size) {
+		_9p_fid_resize(map, map->size / 2);
+	}
+
+out:
+	PTHREAD_RWLOCK_unlock(&map->lock);
+}
+
 void _9p_cleanup_fids(struct _9p_conn *conn)
 {
-	int i;
+	struct _9p_fid_map *map = &conn->fids;
+	uint32_t i;
 
 	/* Allocate op_ctx, is should always be NULL here
 	 * Note we only need it if there is a non-null fid,
@@ -451,15 +598,22 @@ void _9p_cleanup_fids(struct _9p_conn *conn)
 	 */
 	op_ctx = gsh_calloc(1, sizeof(struct req_op_context));
 
-	for (i = 0; i < _9P_FID_PER_CONN; i++) {
-		if (conn->fids[i]) {
-			_9p_init_opctx(conn->fids[i], NULL);
-			_9p_tools_clunk(conn->fids[i]);
+	/* The workers are done with the connection, no need to lock */
+	for (i = 0; i < map->size; i++) {
+		if (map->slots[i].pfid) {
+			_9p_init_opctx(map->slots[i].pfid, NULL);
+			_9p_tools_clunk(map->slots[i].pfid);
 			_9p_release_opctx();
-			conn->fids[i] = NULL;	/* poison the entry */
+			map->slots[i].pfid = NULL;	/* poison the entry */
 		}
 	}
 
 	gsh_free(op_ctx);
 	op_ctx = NULL;
+
+	gsh_free(map->slots);
+	map->slots = NULL;
+	map->size = 0;
+	map->count = 0;
+	PTHREAD_RWLOCK_destroy(&map->lock);
 }
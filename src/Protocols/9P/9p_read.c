@@ -72,10 +72,7 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TREAD: tag=%u fid=%u offset=%llu count=%u",
 		 (u32) *msgtag, *fid, (unsigned long long)*offset, *count);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_getfid(req9p->pconn, *fid);
 
 	/* Make sure the requested amount of data respects negotiated msize */
 	if (*count + _9P_ROOM_RREAD > req9p->pconn->msize)
@@ -90,7 +87,8 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	_9p_init_opctx(pfid, req9p);
 
 	/* Start building the reply already
-	 * So we don't need to use an intermediate data buffer
+	 * So we don't need to use an intermediate data buffer:
+	 * on RDMA the FSAL reads into the registered send buffer
 	 */
 	_9p_setinitptr(cursor, preply, _9P_RREAD);
 	_9p_setptr(cursor, msgtag, u16);
@@ -138,7 +136,7 @@ int _9p_read(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		} else {
 			op_ctx->client = client;
 
-			server_stats_io_done(*count, read_size,
+			server_stats_io_done(pfid->pentry, *count, read_size,
 					     FSAL_IS_ERROR(fsal_status), false);
 		}
 
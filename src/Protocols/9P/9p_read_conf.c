@@ -40,7 +40,7 @@ static struct config_item _9p_params[] = {
 		       _9p_param, _9p_tcp_port),
 	CONF_ITEM_UI16("_9P_RDMA_Port", 1, UINT16_MAX, _9P_RDMA_PORT,
 		       _9p_param, _9p_rdma_port),
-	CONF_ITEM_UI32("_9P_TCP_Msize", 1024, UINT32_MAX, _9P_TCP_MSIZE,
+	CONF_ITEM_UI32("_9P_TCP_Msize", 1024, _9P_MSIZE_MAX, _9P_TCP_MSIZE,
 		       _9p_param, _9p_tcp_msize),
 	CONF_ITEM_UI32("_9P_RDMA_Msize", 1024, UINT32_MAX, _9P_RDMA_MSIZE,
 		       _9p_param, _9p_rdma_msize),
@@ -51,6 +51,14 @@ static struct config_item _9p_params[] = {
 	CONF_ITEM_UI16("_9P_RDMA_Outpool_Size", 1, UINT16_MAX,
 		       _9P_RDMA_OUTPOOL_SIZE,
 		       _9p_param, _9p_rdma_outpool_size),
+	CONF_ITEM_UI32("_9P_RDMA_Copy_Threshold", 0, 65536,
+		       _9P_RDMA_COPY_THRESHOLD,
+		       _9p_param, _9p_rdma_copy_threshold),
+	CONF_ITEM_UI32("_9P_TCP_IO_Threads", 0, 256, _9P_TCP_IO_THREADS,
+		       _9p_param, _9p_tcp_io_threads),
+	CONF_ITEM_UI32("_9P_TCP_Zerocopy_Threshold", 0, UINT32_MAX,
+		       _9P_TCP_ZEROCOPY_THRESHOLD,
+		       _9p_param, _9p_tcp_zerocopy_threshold),
 	CONFIG_EOL
 };
 
@@ -55,7 +55,9 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	char *wnames_str;
 	fsal_status_t fsal_status;
 	struct fsal_obj_handle *pentry = NULL;
-	char name[MAXNAMLEN+1];
+	char names[_9P_MAXWELEM][MAXNAMLEN+1];
+	const char *pnames[_9P_MAXWELEM];
+	unsigned int done;
 
 	u16 *nwqid;
 
@@ -71,13 +73,10 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	LogDebug(COMPONENT_9P, "TWALK: tag=%u fid=%u newfid=%u nwname=%u",
 		 (u32) *msgtag, *fid, *newfid, *nwname);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
+	if (!_9p_canaddfid(req9p->pconn, *newfid))
+		return _9p_rerror(req9p, msgtag, EMFILE, plenout, preply);
 
-	if (*newfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_getfid(req9p->pconn, *fid);
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid fid=%u", *fid);
@@ -98,30 +97,55 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		pnewfid->pentry->obj_ops.get_ref(pnewfid->pentry);
 	} else {
 		/* the walk is in fact a lookup */
-		pentry = pfid->pentry;
+		if (*nwname > _9P_MAXWELEM) {
+			gsh_free(pnewfid);
+			return _9p_rerror(req9p, msgtag, EINVAL,
+					  plenout, preply);
+		}
 
 		for (i = 0; i < *nwname; i++) {
 			_9p_getstr(cursor, wnames_len, wnames_str);
-			if (*wnames_len >= sizeof(name)) {
+			if (*wnames_len >= sizeof(names[i])) {
 				gsh_free(pnewfid);
 				return _9p_rerror(req9p, msgtag, ENAMETOOLONG,
 						  plenout, preply);
 			}
-			snprintf(name, sizeof(name), "%.*s", *wnames_len,
-				 wnames_str);
+			snprintf(names[i], sizeof(names[i]), "%.*s",
+				 *wnames_len, wnames_str);
+			pnames[i] = names[i];
 
 			LogDebug(COMPONENT_9P,
 				 "TWALK (lookup): tag=%u fid=%u newfid=%u (component %u/%u :%s)",
 				 (u32) *msgtag, *fid, *newfid, i + 1, *nwname,
-				 name);
+				 names[i]);
+		}
+
+		/* Resolve the leading names the FSAL has at hand in one
+		 * call, exec path searches walk the same directories over
+		 * and over.  refcount +1 */
+		pentry = pfid->pentry;
+		fsal_status = pentry->obj_ops.lookup_components(
+					pentry, *nwname, pnames, &done,
+					&pnewfid->pentry);
+		if (FSAL_IS_ERROR(fsal_status)) {
+			gsh_free(pnewfid);
+			return _9p_rerror(req9p, msgtag,
+					  _9p_tools_errno(fsal_status),
+					  plenout, preply);
+		}
+		if (done != 0)
+			pentry = pnewfid->pentry;
 
+		for (i = done; i < *nwname; i++) {
 			if (pnewfid->pentry == pentry)
 				pnewfid->pentry = NULL;
 
 			/* refcount +1 */
-			fsal_status = fsal_lookup(pentry, name,
+			fsal_status = fsal_lookup(pentry, names[i],
 						  &pnewfid->pentry, NULL);
 			if (FSAL_IS_ERROR(fsal_status)) {
+				if (pentry != pfid->pentry)
+					pentry->obj_ops.put_ref(pentry);
 				gsh_free(pnewfid);
 				return _9p_rerror(req9p, msgtag,
 						  _9p_tools_errno(fsal_status),
@@ -138,7 +162,7 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 
 		pnewfid->ppentry = pfid->pentry;
 
-		strncpy(pnewfid->name, name, MAXNAMLEN);
+		strncpy(pnewfid->name, names[*nwname - 1], MAXNAMLEN);
 
 		/* gdata ref is not hold : the pfid, which use same gdata */
 		/*  will be clunked after pnewfid */
@@ -201,7 +225,7 @@ int _9p_walk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	pnewfid->state->state_refcount = 1;
 
 	/* keep info on new fid */
-	req9p->pconn->fids[*newfid] = pnewfid;
+	_9p_setfid(req9p->pconn, *newfid, pnewfid);
 
 	/* As much qid as requested fid */
 	nwqid = nwname;
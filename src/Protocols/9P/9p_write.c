@@ -74,15 +74,14 @@ int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 	_9p_getptr(cursor, offset, u64);
 	_9p_getptr(cursor, count, u32);
 
+	/* The data is written from the message itself, on RDMA that is
+	 * the registered receive buffer */
 	databuffer = cursor;
 
 	LogDebug(COMPONENT_9P, "TWRITE: tag=%u fid=%u offset=%llu count=%u",
 		 (u32) *msgtag, *fid, (unsigned long long)*offset, *count);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_getfid(req9p->pconn, *fid);
 
 	/* Make sure the requested amount of data respects negotiated msize */
 	if (*count + _9P_ROOM_TWRITE > req9p->pconn->msize)
@@ -159,7 +158,7 @@ int _9p_write(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		} else {
 			op_ctx->client = client;
 
-			server_stats_io_done(size,
+			server_stats_io_done(pfid->pentry, size,
 					     written_size,
 					     FSAL_IS_ERROR(fsal_status),
 					     true);
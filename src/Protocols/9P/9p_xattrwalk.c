@@ -87,13 +87,10 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 			 "TXATTRWALK (component): tag=%u fid=%u attrfid=%u name=%.*s",
 			 (u32) *msgtag, *fid, *attrfid, *name_len, name_str);
 
-	if (*fid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
+	if (!_9p_canaddfid(req9p->pconn, *attrfid))
+		return _9p_rerror(req9p, msgtag, EMFILE, plenout, preply);
 
-	if (*attrfid >= _9P_FID_PER_CONN)
-		return _9p_rerror(req9p, msgtag, ERANGE, plenout, preply);
-
-	pfid = req9p->pconn->fids[*fid];
+	pfid = _9p_getfid(req9p->pconn, *fid);
 	/* Check that it is a valid fid */
 	if (pfid == NULL || pfid->pentry == NULL) {
 		LogDebug(COMPONENT_9P, "request on invalid fid=%u", *fid);
@@ -211,7 +208,7 @@ int _9p_xattrwalk(struct _9p_request_data *req9p, u32 *plenout, char *preply)
 		}
 	}
 
-	req9p->pconn->fids[*attrfid] = pxattrfid;
+	_9p_setfid(req9p->pconn, *attrfid, pxattrfid);
 
 	/* Increments refcount as we're manually making a new copy */
 	pfid->pentry->obj_ops.get_ref(pfid->pentry);
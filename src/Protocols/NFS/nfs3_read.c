@@ -44,13 +44,14 @@
 #include "server_stats.h"
 #include "export_mgr.h"
 #include "sal_functions.h"
+#include "io_bufpool.h"
 
 static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 			uint32_t read_size, struct fsal_obj_handle *obj,
 			int eof)
 {
 	if ((read_size == 0) && (data != NULL)) {
-		gsh_free(data);
+		io_buf_free(data);
 		data = NULL;
 	}
 
@@ -67,6 +68,123 @@ static void nfs_read_ok(struct svc_req *req, nfs_res_t *res, char *data,
 	res->res_read3.status = NFS3_OK;
 }
 
+/**
+ * @brief Finish a READ once the I/O is done
+ *
+ * @param[in]  req         SVC request related to this call
+ * @param[out] res         Structure to contain the result of the call
+ * @param[in]  obj         File read, the reference is released
+ * @param[in]  fsal_status Result of the read
+ * @param[in]  data        Read buffer
+ * @param[in]  size        Requested size
+ * @param[in]  read_size   Amount of data read
+ * @param[in]  eof_met     Whether end of file was reached
+ * @param[in]  anonymous   Whether anonymous I/O was started on the file
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+static int nfs3_complete_read(struct svc_req *req, nfs_res_t *res,
+			      struct fsal_obj_handle *obj,
+			      fsal_status_t fsal_status, void *data,
+			      size_t size, size_t read_size, bool eof_met,
+			      bool anonymous)
+{
+	int rc = NFS_REQ_OK;
+
+	if (anonymous)
+		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
+
+	if (!FSAL_IS_ERROR(fsal_status)) {
+		nfs_read_ok(req, res, data, read_size, obj, eof_met);
+		goto out;
+	}
+
+	io_buf_free(data);
+	read_size = 0;
+
+	/* If we are here, there was an error */
+	if (nfs_RetryableError(fsal_status.major)) {
+		rc = NFS_REQ_DROP;
+		goto out;
+	}
+
+	res->res_read3.status = nfs3_Errno_status(fsal_status);
+
+	nfs_SetPostOpAttr(obj,
+			  &res->res_read3.READ3res_u.resfail.file_attributes,
+			  NULL);
+
+ out:
+	server_stats_io_done(obj, size, read_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     false);
+
+	/* return references */
+	obj->obj_ops.put_ref(obj);
+
+	return rc;
+}
+
+/**
+ * @brief State of a READ waiting on asynchronous I/O
+ */
+struct nfs3_read_data {
+	struct fsal_obj_handle *obj;	/*< File being read */
+	nfs_res_t *res;			/*< Result of the call */
+	fsal_status_t status;		/*< Result of the read */
+	struct fsal_io_arg read_arg;	/*< Arguments of the read */
+	bool anonymous;			/*< Anonymous I/O was started */
+};
+
+/**
+ * @brief Completion callback for an asynchronous READ
+ *
+ * May be called from an FSAL thread, so only record the result and
+ * hand the request back to a worker.
+ */
+static void nfs3_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *obj_data, void *caller_data)
+{
+	request_data_t *reqdata = caller_data;
+	struct nfs3_read_data *read_data = reqdata->proc_data;
+
+	/* Fixup FSAL_SHARE_DENIED status */
+	if (ret.major == ERR_FSAL_SHARE_DENIED)
+		ret = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	read_data->status = ret;
+
+	nfs_rpc_async_complete(reqdata);
+}
+
+/**
+ * @brief Resume a READ once its asynchronous I/O completed
+ *
+ * @param[in] reqdata  The suspended request
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+static int nfs3_read_resume(request_data_t *reqdata)
+{
+	struct nfs3_read_data *read_data = reqdata->proc_data;
+	struct fsal_io_arg *read_arg = &read_data->read_arg;
+	int rc;
+
+	reqdata->proc_data = NULL;
+
+	rc = nfs3_complete_read(&reqdata->r_u.req.svc, read_data->res,
+				read_data->obj, read_data->status,
+				read_arg->buffer, read_arg->buffer_size,
+				read_arg->io_amount, read_arg->end_of_file,
+				read_data->anonymous);
+
+	gsh_free(read_data);
+
+	return rc;
+}
+
 /**
  *
  * @brief The NFSPROC3_READ
@@ -95,6 +213,7 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	bool eof_met = false;
 	int rc = NFS_REQ_OK;
 	bool sync = false;
+	bool anonymous;
 	uint64_t MaxRead = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead);
 	uint64_t MaxOffsetRead =
 		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetRead);
@@ -205,77 +324,77 @@ int nfs3_read(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		rc = NFS_REQ_OK;
 		goto out;
 	} else {
-		data = gsh_malloc(size);
+		data = io_buf_alloc(size);
+
+		/* Opens of an immutable export deny nothing and there are
+		 * no writes to wait for, no share to check.
+		 */
+		anonymous = !op_ctx_export_has_option(EXPORT_OPTION_IMMUTABLE);
 
-		res->res_read3.status = nfs3_Errno_state(
-				state_share_anonymous_io_start(
-					obj,
-					OPEN4_SHARE_ACCESS_READ,
-					SHARE_BYPASS_READ));
+		if (anonymous)
+			res->res_read3.status = nfs3_Errno_state(
+					state_share_anonymous_io_start(
+						obj,
+						OPEN4_SHARE_ACCESS_READ,
+						SHARE_BYPASS_READ));
 
 		if (res->res_read3.status != NFS3_OK) {
 			rc = NFS_REQ_OK;
-			gsh_free(data);
+			io_buf_free(data);
 			goto out;
 		}
 
 		if (obj->fsal->m_ops.support_ex(obj)) {
-			/* Call the new fsal_read2 */
+			/* Start the new asynchronous read, the request is
+			 * completed in nfs3_read_resume().
+			 */
+			struct nfs3_read_data *read_data;
+			request_data_t *reqdata = nfs_req_to_reqdata(req);
+
+			read_data = gsh_calloc(1, sizeof(*read_data));
+			read_data->obj = obj;
+			read_data->res = res;
 			/** @todo for now pass NULL state */
-			fsal_status = fsal_read2(obj,
-						  true,
-						  NULL,
-						  offset,
-						  size,
-						  &read_size,
-						  data,
-						  &eof_met,
-						  NULL);
-		} else {
-			/* Call legacy fsal_rdwr */
-			fsal_status = fsal_rdwr(obj,
-						FSAL_IO_READ,
-						offset,
-						size,
-						&read_size,
-						data,
-						&eof_met,
-						&sync,
-						NULL);
+			read_data->read_arg.state = NULL;
+			read_data->read_arg.offset = offset;
+			read_data->read_arg.buffer_size = size;
+			read_data->read_arg.buffer = data;
+			read_data->read_arg.info = NULL;
+			read_data->anonymous = anonymous;
+
+			reqdata->proc_data = read_data;
+			reqdata->resume = nfs3_read_resume;
+
+			obj->obj_ops.read2_async(obj, true, nfs3_read_cb,
+						 &read_data->read_arg,
+						 reqdata);
+			return NFS_REQ_ASYNC_WAIT;
 		}
 
-		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
-
-		if (!FSAL_IS_ERROR(fsal_status)) {
-			nfs_read_ok(req, res, data, read_size, obj, eof_met);
-			rc = NFS_REQ_OK;
-			goto out;
-		}
-		gsh_free(data);
+		/* Call legacy fsal_rdwr */
+		fsal_status = fsal_rdwr(obj,
+					FSAL_IO_READ,
+					offset,
+					size,
+					&read_size,
+					data,
+					&eof_met,
+					&sync,
+					NULL);
+
+		return nfs3_complete_read(req, res, obj, fsal_status, data,
+					  size, read_size, eof_met, anonymous);
 	}
 
-	/* If we are here, there was an error */
-	if (nfs_RetryableError(fsal_status.major)) {
-		rc = NFS_REQ_DROP;
-		goto out;
-	}
-
-	res->res_read3.status = nfs3_Errno_status(fsal_status);
-
-	nfs_SetPostOpAttr(obj,
-			  &res->res_read3.READ3res_u.resfail.file_attributes,
-			  NULL);
-
-	rc = NFS_REQ_OK;
-
  out:
+	server_stats_io_done(obj, size, 0,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     false);
+
 	/* return references */
 	if (obj)
 		obj->obj_ops.put_ref(obj);
 
-	server_stats_io_done(size, read_size,
-			     (rc == NFS_REQ_OK) ? true : false,
-			     false);
 	return rc;
 }				/* nfs3_read */
 
@@ -290,6 +409,6 @@ void nfs3_read_free(nfs_res_t *res)
 {
 	if ((res->res_read3.status == NFS3_OK)
 	    && (res->res_read3.READ3res_u.resok.data.data_len != 0)) {
-		gsh_free(res->res_read3.READ3res_u.resok.data.data_val);
+		io_buf_free(res->res_read3.READ3res_u.resok.data.data_val);
 	}
 }
@@ -52,8 +52,6 @@ fsal_errors_t nfs3_readdir_callback(void *opaque,
 				    uint64_t cookie,
 				    enum cb_state cb_state);
 
-static void free_entry3s(entry3 *entry3s);
-
 /**
  * @brief Opaque bookkeeping structure for NFSv3 readdir
  *
@@ -62,13 +60,8 @@ static void free_entry3s(entry3 *entry3s);
  */
 
 struct nfs3_readdir_cb_data {
-	entry3 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
-	size_t count;		/*< The count of complete entries stored in the
-				   buffer */
-	size_t total_entries;	/*< The total number of entries in the
-				   array */
+	struct nfs_dirent_stream ds;	/*< The entries, encoded */
+	size_t total_entries;	/*< The most entries to return */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
 };
@@ -126,7 +119,7 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	fsal_status_t fsal_status = {0, 0};
 	fsal_status_t fsal_status_gethandle = {0, 0};
 	int rc = NFS_REQ_OK;
-	struct nfs3_readdir_cb_data tracker = { NULL };
+	struct nfs3_readdir_cb_data tracker = { .ds.buf = NULL };
 	bool use_cookie_verifier = op_ctx_export_has_option(
 					EXPORT_OPTION_USE_COOKIE_VERIFIER);
 
@@ -181,13 +174,12 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 	count = arg->arg_readdir3.count;
 	cookie = arg->arg_readdir3.cookie;
-	estimated_num_entries =
-	    MIN(count / (sizeof(entry3) - sizeof(char *)), 120);
+	estimated_num_entries = 120;
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "---> nfs3_readdir: count=%lu  cookie=%" PRIu64
 		     " estimated_num_entries=%lu",
 		     count, cookie, estimated_num_entries);
-	if (estimated_num_entries == 0) {
+	if (count <= NFS3_READDIR_RESOK_SIZE) {
 		res->res_readdir3.status = NFS3ERR_TOOSMALL;
 		rc = NFS_REQ_OK;
 		goto out;
@@ -241,10 +233,8 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		}
 	}
 
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entry3));
+	nfs_dirent_stream_init(&tracker.ds, count - NFS3_READDIR_RESOK_SIZE);
 	tracker.total_entries = estimated_num_entries;
-	tracker.mem_left = count - sizeof(READDIR3resok);
-	tracker.count = 0;
 	tracker.error = NFS3_OK;
 
 	/* Adjust the cookie we supply to fsal */
@@ -324,13 +314,13 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		     PRIu64 ")",
 		     fsal_cookie);
 
-	if ((num_entries == 0) && (cookie > 1)) {
-		RES_READDIR3_OK->reply.entries = NULL;
+	RES_READDIR3_OK->reply.entries = NULL;
+	nfs_dirent_stream_take(&tracker.ds, &RES_READDIR3_OK->reply.encoded,
+			       &RES_READDIR3_OK->reply.encoded_len);
+	if ((num_entries == 0) && (cookie > 1))
 		RES_READDIR3_OK->reply.eof = TRUE;
-	} else {
-		RES_READDIR3_OK->reply.entries = tracker.entries;
+	else
 		RES_READDIR3_OK->reply.eof = eod_met;
-	}
 	nfs_SetPostOpAttr(dir_obj, &RES_READDIR3_OK->dir_attributes, NULL);
 	memcpy(RES_READDIR3_OK->cookieverf, cookie_verifier,
 	       sizeof(cookieverf3));
@@ -347,12 +337,7 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		parent_dir_obj->obj_ops.put_ref(parent_dir_obj);
 
 	/* Deallocate memory in the event of an error */
-	if (((res->res_readdir3.status != NFS3_OK) || (rc != NFS_REQ_OK) ||
-	    ((num_entries == 0) && (cookie > 1))) &&
-	    (tracker.entries != NULL)) {
-		free_entry3s(tracker.entries);
-		RES_READDIR3_OK->reply.entries = NULL;
-	}
+	nfs_dirent_stream_release(&tracker.ds);
 
 	return rc;
 }				/* nfs3_readdir */
@@ -365,23 +350,18 @@ int nfs3_readdir(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
  */
 void nfs3_readdir_free(nfs_res_t *resp)
 {
-	if ((resp->res_readdir3.status == NFS3_OK)
-	    && (resp->res_readdir3.READDIR3res_u.resok.reply.entries != NULL)) {
-		free_entry3s(resp->res_readdir3.READDIR3res_u.resok.reply.
-			     entries);
-	}
+	if (resp->res_readdir3.status == NFS3_OK)
+		gsh_free(resp->res_readdir3.READDIR3res_u.resok.reply.encoded);
 }
 
 /**
- * @brief Populate entry3s when called from fsal_readdir
+ * @brief Encode an entry3 when called from fsal_readdir
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entry3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * This function is a callback passed to fsal_readdir.  It encodes
+ * the entry straight into the reply's stream of entries.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdir_cb_data that is
- *                    gives the location of the array and other
- *                    bookeeping information
+ *                    gives the stream and other bookeeping information
  * @param name [in] The filename for the current obj
  * @param handle [in] The current obj's filehandle
  * @param attrs [in] The current obj's attributes
@@ -398,53 +378,30 @@ fsal_errors_t nfs3_readdir_callback(void *opaque,
 	/* Not-so-opaque pointer to callback data` */
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs3_readdir_cb_data *tracker = cb_parms->opaque;
-	/* Length of the current filename */
-	size_t namelen = strlen(cb_parms->name);
-	entry3 *e3 = tracker->entries + tracker->count;
-	size_t need =
-	    sizeof(entry3) + ((namelen + 3) & ~3) + 4 - sizeof(char *) -
-	    sizeof(entry3 *);
-
-	if (tracker->count == tracker->total_entries) {
+	struct nfs_dirent_stream *ds = &tracker->ds;
+	fileid3 fileid = obj->fileid;
+	filename3 name = (filename3) cb_parms->name;
+	cookie3 entry_cookie = cookie;
+
+	if (ds->count == tracker->total_entries) {
 		cb_parms->in_result = false;
 		return ERR_FSAL_NO_ERROR;
 	}
-	if (tracker->mem_left < need) {
-		if (tracker->count == 0)
+
+	if (!nfs_dirent_stream_start(ds) ||
+	    !xdr_fileid3(&ds->xdrs, &fileid) ||
+	    !xdr_filename3(&ds->xdrs, &name) ||
+	    !xdr_cookie3(&ds->xdrs, &entry_cookie)) {
+		/* Past count */
+		nfs_dirent_stream_end(ds, false);
+		if (ds->count == 0)
 			tracker->error = NFS3ERR_TOOSMALL;
 
 		cb_parms->in_result = false;
 		return ERR_FSAL_NO_ERROR;
 	}
 
-	e3->fileid = obj->fileid;
-	e3->name = gsh_strdup(cb_parms->name);
-	e3->cookie = cookie;
-
-	if (tracker->count > 0)
-		tracker->entries[tracker->count - 1].nextentry = e3;
-
-	tracker->mem_left -= need;
-	++(tracker->count);
+	nfs_dirent_stream_end(ds, true);
 	cb_parms->in_result = true;
 	return ERR_FSAL_NO_ERROR;
 }				/* */
-
-/**
- * @brief Clean up memory allocated to serve NFSv3 READDIR
- *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
- *
- * @param entry3s [in] Pointer to first obj
- */
-
-static void free_entry3s(entry3 *entry3s)
-{
-	entry3 *entry = NULL;
-
-	for (entry = entry3s; entry != NULL; entry = entry->nextentry)
-		gsh_free(entry->name);
-
-	gsh_free(entry3s);
-}
@@ -53,8 +53,6 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 					       uint64_t cookie,
 					       enum cb_state cb_state);
 
-static void free_entryplus3s(entryplus3 *entryplus3s);
-
 /**
  * @brief Opaque bookkeeping structure for NFSPROC3_READDIRPLUS
  *
@@ -63,13 +61,8 @@ static void free_entryplus3s(entryplus3 *entryplus3s);
  */
 
 struct nfs3_readdirplus_cb_data {
-	entryplus3 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
-	size_t count;		/*< The count of complete entries stored in the
-				   buffer */
-	size_t total_entries;	/*< The number of entires we allocated for
-				   the array. */
+	struct nfs_dirent_stream ds;	/*< The entries, encoded */
+	size_t total_entries;	/*< The most entries to return */
 	nfsstat3 error;		/*< Set to a value other than NFS_OK if the
 				   callback function finds a fatal error. */
 };
@@ -123,12 +116,12 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	fsal_status_t fsal_status_gethandle = {0, 0};
 	int rc = NFS_REQ_OK;
 	struct nfs3_readdirplus_cb_data tracker = {
-		.entries = NULL,
-		.mem_left = 0,
-		.count = 0,
+		.ds.buf = NULL,
 		.error = NFS3_OK,
 	};
 	struct attrlist attrs_dir, attrs_parent;
+	dirlistplus3 * const reply =
+	    &res->res_readdirplus3.READDIRPLUS3res_u.resok.reply;
 	bool use_cookie_verifier = op_ctx_export_has_option(
 					EXPORT_OPTION_USE_COOKIE_VERIFIER);
 
@@ -164,26 +157,23 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		goto out;
 	}
 
-	tracker.mem_left = (arg->arg_readdirplus3.maxcount * 9) / 10;
 	begin_cookie = arg->arg_readdirplus3.cookie;
-
-	tracker.mem_left -= sizeof(READDIRPLUS3resok);
-
-	/* Estimate assuming that we're going to send no names and no handles.
-	 * Don't count space for pointers for nextentry or
-	 * name_handle.data.data_val in entryplus3
-	 */
-	estimated_num_entries = MIN((tracker.mem_left + sizeof(entryplus3 *))
-				    / (sizeof(entryplus3) - sizeof(char *) * 2),
-				    50);
-
+	estimated_num_entries = 50;
 	tracker.total_entries = estimated_num_entries;
 
 	LogFullDebug(COMPONENT_NFS_READDIR,
-		     "nfs3_readdirplus: dircount=%u begin_cookie=%" PRIu64
-		     " estimated_num_entries=%lu, mem_left=%zd",
-		     arg->arg_readdirplus3.dircount, begin_cookie,
-		     estimated_num_entries, tracker.mem_left);
+		     "nfs3_readdirplus: dircount=%u maxcount=%u begin_cookie=%"
+		     PRIu64 " estimated_num_entries=%lu",
+		     arg->arg_readdirplus3.dircount,
+		     arg->arg_readdirplus3.maxcount, begin_cookie,
+		     estimated_num_entries);
+
+	if (arg->arg_readdirplus3.maxcount <= NFS3_READDIR_RESOK_SIZE) {
+		res->res_readdirplus3.status = NFS3ERR_TOOSMALL;
+		LogFullDebug(COMPONENT_NFS_READDIR,
+			     "Response too small");
+		goto out;
+	}
 
 	/* Convert file handle into a vnode */
 	dir_obj = nfs3_FhandleToCache(&(arg->arg_readdirplus3.dir),
@@ -250,6 +240,7 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries = NULL;
+	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.encoded = NULL;
 	res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof = FALSE;
 
 	/* Fudge cookie for "." and "..", if necessary */
@@ -258,8 +249,9 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	else
 		fsal_cookie = 0;
 
-	/* Allocate space for entries */
-	tracker.entries = gsh_calloc(estimated_num_entries, sizeof(entryplus3));
+	/* The entries may take what maxcount leaves */
+	nfs_dirent_stream_init(&tracker.ds, arg->arg_readdirplus3.maxcount -
+					    NFS3_READDIR_RESOK_SIZE);
 
 	if (begin_cookie == 0) {
 		/* Fill in "." */
@@ -330,17 +322,13 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		     "Readdirplus3 -> Call to fsal_readdir( cookie=%"
 		     PRIu64 ")", fsal_cookie);
 
-	if ((num_entries == 0) && (begin_cookie > 1)) {
-		res->res_readdirplus3.status = NFS3_OK;
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
-		    NULL;
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof = TRUE;
-	} else {
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.entries =
-		    tracker.entries;
-		res->res_readdirplus3.READDIRPLUS3res_u.resok.reply.eof =
-		    eod_met;
-	}
+	nfs_dirent_stream_take(&tracker.ds, &reply->encoded,
+			       &reply->encoded_len);
+
+	if ((num_entries == 0) && (begin_cookie > 1))
+		reply->eof = TRUE;
+	else
+		reply->eof = eod_met;
 
 	nfs_SetPostOpAttr(dir_obj,
 			  &res->res_readdirplus3.READDIRPLUS3res_u.resok.
@@ -374,9 +362,7 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	if (dir_obj)
 		dir_obj->obj_ops.put_ref(dir_obj);
 
-	if (((res->res_readdir3.status != NFS3_OK) || (rc != NFS_REQ_OK))
-	    && (tracker.entries != NULL))
-		free_entryplus3s(tracker.entries);
+	nfs_dirent_stream_release(&tracker.ds);
 
 	return rc;
 }				/* nfs3_readdirplus */
@@ -392,21 +378,19 @@ int nfs3_readdirplus(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 void nfs3_readdirplus_free(nfs_res_t *resp)
 {
 #define RESREADDIRPLUSREPLY resp->res_readdirplus3.READDIRPLUS3res_u.resok.reply
-	if ((resp->res_readdirplus3.status == NFS3_OK)
-	    && (RESREADDIRPLUSREPLY.entries != NULL))
-		free_entryplus3s(RESREADDIRPLUSREPLY.entries);
+	if (resp->res_readdirplus3.status == NFS3_OK)
+		gsh_free(RESREADDIRPLUSREPLY.encoded);
 }
 
 /**
- * @brief Populate entryplus3s when called from fsal_readdir
+ * @brief Encode an entryplus3 when called from fsal_readdir
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entryplys3 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * This function is a callback passed to fsal_readdir.  It encodes
+ * the entry, with its handle and attributes, straight into the
+ * reply's stream of entries.
  *
  * @param opaque [in] Pointer to a struct nfs3_readdirplus_cb_data that is
- *                    gives the location of the array and other
- *                    bookeeping information
+ *                    gives the stream and other bookeeping information
  * @param name [in] The filename for the current obj
  * @param handle [in] The current obj's filehandle
  * @param attrs [in] The current obj's attributes
@@ -423,94 +407,56 @@ fsal_errors_t nfs3_readdirplus_callback(void *opaque,
 	/* Not-so-opaque pointer to callback data` */
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs3_readdirplus_cb_data *tracker = cb_parms->opaque;
-	/* Length of the current filename */
-	size_t namelen = strlen(cb_parms->name);
-	entryplus3 *ep3 = tracker->entries + tracker->count;
-
-	if (tracker->count == tracker->total_entries) {
+	struct nfs_dirent_stream *ds = &tracker->ds;
+	char handle[NFS3_FHSIZE];
+	fileid3 fileid = obj->fileid;
+	filename3 name = (filename3) cb_parms->name;
+	cookie3 entry_cookie = cookie;
+	post_op_attr name_attributes = { .attributes_follow = FALSE };
+	post_op_fh3 name_handle = { .handle_follows = FALSE };
+
+	if (ds->count == tracker->total_entries) {
 		cb_parms->in_result = false;
 		return ERR_FSAL_NO_ERROR;
 	}
-	/* This is a pessimistic check, which assumes that we're going
-	 * to send attributes and full size handle - if it fails then
-	 * we're close enough to the buffer size limit and t's time to
-	 * stop anyway */
-	if (tracker->mem_left
-	    < (sizeof(entryplus3) + namelen + NFS3_FHSIZE)) {
-		if (tracker->count == 0)
-			tracker->error = NFS3ERR_TOOSMALL;
-
-		cb_parms->in_result = false;
-		return ERR_FSAL_NO_ERROR;
-	}
-
-	ep3->fileid = obj->fileid;
-	ep3->name = gsh_strdup(cb_parms->name);
-	ep3->cookie = cookie;
-
-	/* Account for file name + length + cookie */
-	tracker->mem_left -= sizeof(ep3->cookie) + ((namelen + 3) & ~3) + 4;
 
 	if (cb_parms->attr_allowed) {
-		ep3->name_handle.handle_follows = TRUE;
+		name_handle.handle_follows = TRUE;
+		name_handle.post_op_fh3_u.handle.data.data_val = handle;
 
-		if (!nfs3_FSALToFhandle(true,
-					&ep3->name_handle.post_op_fh3_u.handle,
+		if (!nfs3_FSALToFhandle(false,
+					&name_handle.post_op_fh3_u.handle,
 					obj,
 					op_ctx->ctx_export)) {
 			tracker->error = NFS3ERR_SERVERFAULT;
-			gsh_free(ep3->name);
 			cb_parms->in_result = false;
 			return ERR_FSAL_NO_ERROR;
 		}
 
-		/* Account for filehande + length + follows + nextentry */
-		tracker->mem_left -=
-		    ep3->name_handle.post_op_fh3_u.handle.data.data_len + 12;
-
-		ep3->name_attributes.attributes_follow = true;
+		name_attributes.attributes_follow = TRUE;
 
 		nfs3_FSALattr_To_Fattr(
 			obj, attr,
-			&ep3->name_attributes.post_op_attr_u.attributes);
-	} else {
-		ep3->name_handle.handle_follows = false;
-		ep3->name_attributes.attributes_follow = false;
-		tracker->mem_left -= sizeof(ep3->name_handle.handle_follows);
+			&name_attributes.post_op_attr_u.attributes);
 	}
 
-	if (ep3->name_attributes.attributes_follow)
-		tracker->mem_left -= sizeof(ep3->name_attributes);
-	else
-		tracker->mem_left -=
-		    sizeof(ep3->name_attributes.attributes_follow);
+	if (!nfs_dirent_stream_start(ds) ||
+	    !xdr_fileid3(&ds->xdrs, &fileid) ||
+	    !xdr_filename3(&ds->xdrs, &name) ||
+	    !xdr_cookie3(&ds->xdrs, &entry_cookie) ||
+	    !xdr_post_op_attr(&ds->xdrs, &name_attributes) ||
+	    !xdr_post_op_fh3(&ds->xdrs, &name_handle)) {
+		/* Past maxcount */
+		nfs_dirent_stream_end(ds, false);
+		if (ds->count == 0)
+			tracker->error = NFS3ERR_TOOSMALL;
 
-	if (tracker->count > 0)
-		tracker->entries[tracker->count - 1].nextentry = ep3;
+		cb_parms->in_result = false;
+		return ERR_FSAL_NO_ERROR;
+	}
 
-	++(tracker->count);
+	nfs_dirent_stream_end(ds, true);
 	cb_parms->in_result = true;
 
 	return ERR_FSAL_NO_ERROR;
 }				/* nfs3_readdirplus_callback */
-
-/**
- * @brief Clean up memory allocated to serve NFSv3 READDIRPLUS
- *
- * This function traverses the list of entries, freeing all names
- * allocated in the callback function, then frees the list itself.
- *
- * @param entryplus3s [in] Pointer to first obj
- */
-
-static void free_entryplus3s(entryplus3 *entryplus3s)
-{
-	entryplus3 *entry = NULL;
-
-	for (entry = entryplus3s; entry != NULL; entry = entry->nextentry) {
-		gsh_free(entry->name);
-		gsh_free(entry->name_handle.post_op_fh3_u.handle.data.data_val);
-	}
-
-	gsh_free(entryplus3s);
-}
@@ -47,6 +47,133 @@
 #include "export_mgr.h"
 #include "sal_functions.h"
 
+/**
+ * @brief Finish a WRITE once the I/O is done
+ *
+ * @param[out] res          Structure to contain the result of the call
+ * @param[in]  obj          File written, the reference is released
+ * @param[in]  fsal_status  Result of the write
+ * @param[in]  size         Requested size
+ * @param[in]  written_size Amount of data written
+ * @param[in]  sync         Whether the data was committed
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+static int nfs3_complete_write(nfs_res_t *res, struct fsal_obj_handle *obj,
+			       fsal_status_t fsal_status, size_t size,
+			       size_t written_size, bool sync)
+{
+	int rc = NFS_REQ_OK;
+
+	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		/* If we are here, there was an error */
+		LogFullDebug(COMPONENT_NFSPROTO,
+			     "failed write: fsal_status=%s",
+			     fsal_err_txt(fsal_status));
+
+		written_size = 0;
+
+		if (nfs_RetryableError(fsal_status.major)) {
+			rc = NFS_REQ_DROP;
+			goto out;
+		}
+
+		res->res_write3.status = nfs3_Errno_status(fsal_status);
+
+		nfs_SetWccData(NULL, obj,
+			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
+	} else {
+		/* Build Weak Cache Coherency data */
+		nfs_SetWccData(NULL, obj,
+			       &res->res_write3.WRITE3res_u.resok.file_wcc);
+
+		/* Set the written size */
+		res->res_write3.WRITE3res_u.resok.count = written_size;
+
+		/* How do we commit data ? */
+		if (sync)
+			res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
+		else
+			res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
+
+		/* Set the write verifier */
+		memcpy(res->res_write3.WRITE3res_u.resok.verf,
+		       NFS3_write_verifier,
+		       sizeof(writeverf3));
+
+		res->res_write3.status = NFS3_OK;
+	}
+
+ out:
+	server_stats_io_done(obj, size, written_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     true);
+
+	/* return references */
+	obj->obj_ops.put_ref(obj);
+
+	return rc;
+}
+
+/**
+ * @brief State of a WRITE waiting on asynchronous I/O
+ */
+struct nfs3_write_data {
+	struct fsal_obj_handle *obj;	/*< File being written */
+	nfs_res_t *res;			/*< Result of the call */
+	fsal_status_t status;		/*< Result of the write */
+	struct fsal_io_arg write_arg;	/*< Arguments of the write */
+};
+
+/**
+ * @brief Completion callback for an asynchronous WRITE
+ *
+ * May be called from an FSAL thread, so only record the result and
+ * hand the request back to a worker.
+ */
+static void nfs3_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			  void *obj_data, void *caller_data)
+{
+	request_data_t *reqdata = caller_data;
+	struct nfs3_write_data *write_data = reqdata->proc_data;
+
+	/* Fixup ERR_FSAL_SHARE_DENIED status */
+	if (ret.major == ERR_FSAL_SHARE_DENIED)
+		ret = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	write_data->status = ret;
+
+	nfs_rpc_async_complete(reqdata);
+}
+
+/**
+ * @brief Resume a WRITE once its asynchronous I/O completed
+ *
+ * @param[in] reqdata  The suspended request
+ *
+ * @retval NFS_REQ_OK if successful
+ * @retval NFS_REQ_DROP if failed but retryable
+ */
+static int nfs3_write_resume(request_data_t *reqdata)
+{
+	struct nfs3_write_data *write_data = reqdata->proc_data;
+	struct fsal_io_arg *write_arg = &write_data->write_arg;
+	int rc;
+
+	reqdata->proc_data = NULL;
+
+	rc = nfs3_complete_write(write_data->res, write_data->obj,
+				 write_data->status, write_arg->buffer_size,
+				 write_arg->io_amount, write_arg->fsal_stable);
+
+	gsh_free(write_data);
+
+	return rc;
+}
+
 /**
  *
  * @brief The NFSPROC3_WRITE
@@ -229,80 +356,58 @@ int nfs3_write(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	}
 
 	if (obj->fsal->m_ops.support_ex(obj)) {
-		/* Call the new fsal_write */
-		/** @todo for now pass NULL state */
-		fsal_status = fsal_write2(obj,
-					  true,
-					  NULL,
-					  offset,
-					  size,
-					  &written_size,
-					  data,
-					  &sync,
-					  NULL);
-	} else {
-		/* Call legacy fsal_rdwr */
-		fsal_status = fsal_rdwr(obj,
-					FSAL_IO_WRITE,
-					offset,
-					size,
-					&written_size,
-					data,
-					&eof_met,
-					&sync,
-					NULL);
-	}
-
-	state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
-
-	if (FSAL_IS_ERROR(fsal_status)) {
-		/* If we are here, there was an error */
-		LogFullDebug(COMPONENT_NFSPROTO,
-			     "failed write: fsal_status=%s",
-			     fsal_err_txt(fsal_status));
-
-		if (nfs_RetryableError(fsal_status.major)) {
-			rc = NFS_REQ_DROP;
-			goto out;
+		/* Start the new asynchronous write, the request is
+		 * completed in nfs3_write_resume().
+		 */
+		struct nfs3_write_data *write_data;
+		request_data_t *reqdata = nfs_req_to_reqdata(req);
+
+		if (op_ctx->export_perms->options & EXPORT_OPTION_COMMIT) {
+			/* Force sync if export requires it */
+			sync = true;
 		}
 
-		res->res_write3.status = nfs3_Errno_status(fsal_status);
-
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resfail.file_wcc);
-
-		rc = NFS_REQ_OK;
-	} else {
-		/* Build Weak Cache Coherency data */
-		nfs_SetWccData(NULL, obj,
-			       &res->res_write3.WRITE3res_u.resok.file_wcc);
-
-		/* Set the written size */
-		res->res_write3.WRITE3res_u.resok.count = written_size;
-
-		/* How do we commit data ? */
-		if (sync)
-			res->res_write3.WRITE3res_u.resok.committed = FILE_SYNC;
-		else
-			res->res_write3.WRITE3res_u.resok.committed = UNSTABLE;
-
-		/* Set the write verifier */
-		memcpy(res->res_write3.WRITE3res_u.resok.verf,
-		       NFS3_write_verifier,
-		       sizeof(writeverf3));
-
-		res->res_write3.status = NFS3_OK;
+		write_data = gsh_calloc(1, sizeof(*write_data));
+		write_data->obj = obj;
+		write_data->res = res;
+		/** @todo for now pass NULL state */
+		write_data->write_arg.state = NULL;
+		write_data->write_arg.offset = offset;
+		write_data->write_arg.buffer_size = size;
+		write_data->write_arg.buffer = data;
+		write_data->write_arg.fsal_stable = sync;
+		write_data->write_arg.info = NULL;
+
+		reqdata->proc_data = write_data;
+		reqdata->resume = nfs3_write_resume;
+
+		obj->obj_ops.write2_async(obj, true, nfs3_write_cb,
+					  &write_data->write_arg, reqdata);
+		return NFS_REQ_ASYNC_WAIT;
 	}
 
-	rc = NFS_REQ_OK;
+	/* Call legacy fsal_rdwr */
+	fsal_status = fsal_rdwr(obj,
+				FSAL_IO_WRITE,
+				offset,
+				size,
+				&written_size,
+				data,
+				&eof_met,
+				&sync,
+				NULL);
+
+	return nfs3_complete_write(res, obj, fsal_status, size, written_size,
+				   sync);
 
  out:
+	server_stats_io_done(obj, size, written_size,
+			     (rc == NFS_REQ_OK) ? true : false,
+			     true);
+
 	/* return references */
 	obj->obj_ops.put_ref(obj);
 
-	server_stats_io_done(size, written_size,
-			     (rc == NFS_REQ_OK) ? true : false,
-			     true);
 	return rc;
 
 }				/* nfs3_write */
@@ -367,8 +367,8 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_COPY] = {
 				.name = "OP_COPY",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_copy,
+				.free_res = nfs4_op_copy_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_COPY_NOTIFY] = {
 				.name = "OP_COPY_NOTIFY",
@@ -397,13 +397,13 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_CANCEL] = {
 				.name = "OP_OFFLOAD_CANCEL",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_cancel,
+				.free_res = nfs4_op_offload_cancel_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_OFFLOAD_STATUS] = {
 				.name = "OP_OFFLOAD_STATUS",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_offload_status,
+				.free_res = nfs4_op_offload_status_Free,
 				.exp_perm_flags = 0},
 	[NFS4_OP_READ_PLUS] = {
 				.name = "OP_READ_PLUS",
@@ -422,8 +422,8 @@ static const struct nfs4_op_desc optabv4[] = {
 				.exp_perm_flags = 0},
 	[NFS4_OP_CLONE] = {
 				.name = "OP_CLONE",
-				.funct = nfs4_op_notsupp,
-				.free_res = nfs4_op_notsupp_Free,
+				.funct = nfs4_op_clone,
+				.free_res = nfs4_op_clone_Free,
 				.exp_perm_flags = 0},
 
 	/* NFSv4.3 */
@@ -458,201 +458,404 @@ nfs_opnum4 LastOpcode[] = {
 	NFS4_OP_REMOVEXATTR
 };
 
+/* Largest reply a session slot keeps for replay */
+#define NFS41_MAX_CACHED_REPLY (64 * 1024)
+
+/* Per-thread scratch buffer replies are encoded into before caching */
+static __thread char *nfs41_reply_scratch;
+
+/* First and largest size of the stream a reply is encoded into */
+#define NFS4_STREAM_INITIAL (8 * 1024)
+#define NFS4_STREAM_MAX (64 * 1024 * 1024)
+
 /**
- * @brief The NFS PROC4 COMPOUND
+ * @brief Keep a COMPOUND reply in a session slot for replay
  *
- * Implements the NFS PROC4 COMPOUND.  This routine processes the
- * content of the nfsv4 operation list and composes the result.  On
- * this aspect it is a little similar to a dispatch routine.
- * Operation and functions necessary to process them are defined in
- * the optabv4 array.
+ * The reply is encoded once into a scratch buffer and copied into an
+ * allocation of exactly its size, so the slot holds neither the result
+ * structure nor anything it references.  A reply that does not fit in
+ * NFS41_MAX_CACHED_REPLY is not cached, and a replay of it gets
+ * NFS4ERR_RETRY_UNCACHED_REP.
  *
+ * @param[in,out] cache The slot's cached reply
+ * @param[in]     res   The reply to keep
+ */
+static void nfs4_Compound_SaveReply(struct nfs41_cached_reply *cache,
+				    struct COMPOUND4res_extended *res)
+{
+	XDR xdrs;
+	bool ok;
+
+	gsh_free(cache->buf);
+	cache->buf = NULL;
+	cache->len = 0;
+
+	if (nfs41_reply_scratch == NULL)
+		nfs41_reply_scratch = gsh_malloc(NFS41_MAX_CACHED_REPLY);
+
+	xdrmem_create(&xdrs, nfs41_reply_scratch, NFS41_MAX_CACHED_REPLY,
+		      XDR_ENCODE);
+	ok = xdr_COMPOUND4res_extended(&xdrs, res);
+	if (ok) {
+		cache->len = XDR_GETPOS(&xdrs);
+		cache->buf = gsh_malloc(cache->len);
+		memcpy(cache->buf, nfs41_reply_scratch, cache->len);
+		cache->status = res->res_compound4.status;
+	}
+	XDR_DESTROY(&xdrs);
+
+	LogFullDebug(COMPONENT_SESSIONS,
+		     "Save result in session replay cache %p len=%u%s",
+		     cache, cache->len, ok ? "" : " (too large, not cached)");
+}
+
+/**
+ * @brief Encode the result of NFS4PROC_COMPOUND
  *
- *  @param[in]  arg        Generic nfs arguments
- *  @param[in]  req        NFSv4 request structure
- *  @param[out] res        NFSv4 reply structure
+ * A slot replay sends the reply cached by the slot as is.  A streamed
+ * reply is sent as encoded, followed by the results it had no room for.
  *
- *  @see nfs4_op_<*> functions
- *  @see nfs4_GetPseudoFs
+ * @param[in] xdrs  XDR stream
+ * @param[in] objp  The result
  *
- * @retval NFS_REQ_OKAY if a result is sent.
- * @retval NFS_REQ_DROP if we pretend we never saw the request.
+ * @retval true on success.
  */
-
-int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
+bool xdr_COMPOUND4res_extended(XDR *xdrs, struct COMPOUND4res_extended *objp)
 {
-	unsigned int i = 0;
-	int status = NFS4_OK;
-	compound_data_t data;
-	nfs_opnum4 opcode;
-	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
-	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
-	/* Array of op arguments */
-	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
-	nfs_resop4 *resarray;
-	nsecs_elapsed_t op_start_time;
-	struct timespec ts;
-	int perm_flags;
-	char *tagname = NULL;
-	char *notag = "NO TAG";
+	COMPOUND4res *res = &objp->res_compound4;
+	uint32_t i;
 
-	if (compound4_minor > 2) {
-		LogCrit(COMPONENT_NFS_V4, "Bad Minor Version %d",
-			compound4_minor);
+	if (xdrs->x_op != XDR_ENCODE || objp->res_replay.buf == NULL)
+		return xdr_COMPOUND4res(xdrs, res);
 
-		res->res_compound4.status = NFS4ERR_MINOR_VERS_MISMATCH;
-		res->res_compound4.resarray.resarray_len = 0;
-		return NFS_REQ_OK;
+	if (!XDR_PUTBYTES(xdrs, objp->res_replay.buf, objp->res_replay.len))
+		return false;
+
+	for (i = objp->res_streamed; i < res->resarray.resarray_len; i++) {
+		if (!xdr_nfs_resop4(xdrs, &res->resarray.resarray_val[i]))
+			return false;
 	}
 
-	/* Keeping the same tag as in the arguments */
-	res->res_compound4.tag.utf8string_len =
-	    arg->arg_compound4.tag.utf8string_len;
-	if (res->res_compound4.tag.utf8string_len > 0) {
+	return true;
+}
 
-		res->res_compound4.tag.utf8string_val =
-		    gsh_malloc(res->res_compound4.tag.utf8string_len + 1);
+/* Status, tag and count of results, in front of the results */
+static u_int nfs4_Compound_header_len(COMPOUND4res *res)
+{
+	return 3 * BYTES_PER_XDR_UNIT +
+	       ((res->tag.utf8string_len + BYTES_PER_XDR_UNIT - 1) &
+		~(BYTES_PER_XDR_UNIT - 1));
+}
 
-		memcpy(res->res_compound4.tag.utf8string_val,
-		       arg->arg_compound4.tag.utf8string_val,
-		       res->res_compound4.tag.utf8string_len);
+/* Double the reply stream, keeping what it holds up to pos */
+static void nfs4_Compound_stream_grow(compound_data_t *data, u_int pos)
+{
+	XDR_DESTROY(&data->reply_xdrs);
+	data->reply_size *= 2;
+	data->reply_buf = gsh_realloc(data->reply_buf, data->reply_size);
+	xdrmem_create(&data->reply_xdrs, data->reply_buf, data->reply_size,
+		      XDR_ENCODE);
+	xdr_setpos(&data->reply_xdrs, pos);
+}
 
-		res->res_compound4.tag.utf8string_val[res->res_compound4.tag.
-						      utf8string_len] = '\0';
+/**
+ * @brief Encode the results completed so far into the reply stream
+ *
+ * With Stream_Compound_Reply, the results before @a upto not yet
+ * streamed are encoded in order, each released right after.  The
+ * stream grows as needed; a result that would take it past
+ * NFS4_STREAM_MAX stays in resarray, as do the ones after it, and they
+ * are encoded from there when the reply is sent.
+ *
+ * @param[in,out] data  Compound data
+ * @param[in]     upto  Number of leading results completed
+ */
+static void nfs4_Compound_stream(compound_data_t *data, uint32_t upto)
+{
+	COMPOUND4res *res = &data->res->res_compound4;
+	nfs_resop4 *resarray = res->resarray.resarray_val;
+	u_int pos;
 
-		/* Check if the tag is a valid utf8 string */
-		status =
-		    nfs4_utf8string2dynamic(&(res->res_compound4.tag),
-					    UTF8_SCAN_ALL, &tagname);
-		if (status != 0) {
-			status = NFS4ERR_INVAL;
-			res->res_compound4.status = status;
-			res->res_compound4.resarray.resarray_len = 0;
-			return NFS_REQ_OK;
-		}
-	} else {
-		res->res_compound4.tag.utf8string_val = NULL;
-		tagname = notag;
+	if (!nfs_param.nfsv4_param.stream_compound_reply ||
+	    data->stream_stop || data->streamed >= upto)
+		return;
+
+	if (data->reply_buf == NULL) {
+		data->reply_size = NFS4_STREAM_INITIAL;
+		data->reply_buf = gsh_malloc(data->reply_size);
+		xdrmem_create(&data->reply_xdrs, data->reply_buf,
+			      data->reply_size, XDR_ENCODE);
+		/* The header is written once the status is known */
+		xdr_setpos(&data->reply_xdrs, nfs4_Compound_header_len(res));
 	}
 
-	/* Managing the operation list */
-	LogDebug(COMPONENT_NFS_V4,
-		 "COMPOUND: There are %d operations, res = %p, tag = %s",
-		 argarray_len, res, tagname);
+	while (data->streamed < upto) {
+		pos = xdr_getpos(&data->reply_xdrs);
 
-	if (tagname != notag)
-		gsh_free(tagname);
+		if (xdr_nfs_resop4(&data->reply_xdrs,
+				   &resarray[data->streamed])) {
+			nfs4_Compound_FreeOne(&resarray[data->streamed]);
+			data->streamed++;
+			continue;
+		}
 
-	/* Check for empty COMPOUND request */
-	if (argarray_len == 0) {
-		LogMajor(COMPONENT_NFS_V4,
-			 "An empty COMPOUND (no operation in it) was received");
+		if (data->reply_size >= NFS4_STREAM_MAX) {
+			xdr_setpos(&data->reply_xdrs, pos);
+			data->stream_stop = true;
+			return;
+		}
 
-		res->res_compound4.status = NFS4_OK;
-		res->res_compound4.resarray.resarray_len = 0;
-		return NFS_REQ_OK;
+		nfs4_Compound_stream_grow(data, pos);
 	}
+}
 
-	/* Check for too long request */
-	if (argarray_len > 100) {
-		LogMajor(COMPONENT_NFS_V4,
-			 "A COMPOUND with too many operations (%d) was received",
-			 argarray_len);
+/**
+ * @brief Complete the reply stream and hand it to the result
+ *
+ * @param[in,out] data  Compound data
+ */
+static void nfs4_Compound_stream_end(compound_data_t *data)
+{
+	struct COMPOUND4res_extended *res = &data->res->res_compound4_extended;
+	COMPOUND4res *res4 = &res->res_compound4;
+	u_int len;
 
-		res->res_compound4.status = NFS4ERR_RESOURCE;
-		res->res_compound4.resarray.resarray_len = 0;
-		return NFS_REQ_OK;
+	nfs4_Compound_stream(data, res4->resarray.resarray_len);
+
+	if (data->reply_buf == NULL)
+		return;
+
+	/* The header goes in the room kept for it at the start */
+	len = xdr_getpos(&data->reply_xdrs);
+	xdr_setpos(&data->reply_xdrs, 0);
+	(void) xdr_nfsstat4(&data->reply_xdrs, &res4->status);
+	(void) xdr_utf8str_cs(&data->reply_xdrs, &res4->tag);
+	(void) xdr_u_int(&data->reply_xdrs, &res4->resarray.resarray_len);
+	XDR_DESTROY(&data->reply_xdrs);
+
+	res->res_replay.buf = data->reply_buf;
+	res->res_replay.len = len;
+	res->res_replay.status = res4->status;
+	res->res_streamed = data->streamed;
+	data->reply_buf = NULL;
+}
+
+/**
+ * @brief Start asynchronous I/O for the current operation
+ *
+ * Called by an operation right before handing I/O to the FSAL.  The
+ * operation then returns, and @a resume is called with @a op_data in
+ * data->op_data to finish it once the I/O completed.
+ *
+ * @param[in,out] data     Compound data
+ * @param[in]     resume   Finishes the operation
+ * @param[in]     op_data  Private data of the operation
+ */
+void nfs4_op_async_start(compound_data_t *data, nfs4_op_function_t resume,
+			 void *op_data)
+{
+	data->op_resume = resume;
+	data->op_data = op_data;
+	(void) atomic_inc_uint32_t(&data->async_io);
+}
+
+/**
+ * @brief Signal completion of asynchronous I/O started by an operation
+ *
+ * May be called from an FSAL thread.  The last completion hands the
+ * request back to a worker.
+ *
+ * @param[in] data  Compound data
+ */
+void nfs4_op_async_done(compound_data_t *data)
+{
+	if (atomic_dec_uint32_t(&data->async_io) == 0)
+		nfs_rpc_async_complete(nfs_req_to_reqdata(data->req));
+}
+
+/**
+ * @brief Check whether an operation may run ahead of a pending READ
+ *
+ * These operations only read, and change nothing but the current and
+ * saved filehandles, so they can be started before an earlier READ
+ * completed and simply be discarded if that READ fails.
+ *
+ * @param[in] opcode  Operation
+ *
+ * @retval true if the operation does not depend on earlier READs.
+ */
+static bool nfs4_op_pipelines(nfs_opnum4 opcode)
+{
+	switch (opcode) {
+	case NFS4_OP_ACCESS:
+	case NFS4_OP_GETATTR:
+	case NFS4_OP_GETFH:
+	case NFS4_OP_LOOKUP:
+	case NFS4_OP_PUTFH:
+	case NFS4_OP_PUTPUBFH:
+	case NFS4_OP_PUTROOTFH:
+	case NFS4_OP_READ:
+	case NFS4_OP_RESTOREFH:
+	case NFS4_OP_SAVEFH:
+		return true;
+	default:
+		return false;
 	}
+}
 
-	/* Initialisation of the compound request internal's data */
-	memset(&data, 0, sizeof(data));
-	op_ctx->nfs_minorvers = compound4_minor;
+/**
+ * @brief Record an NFSv4 operation in the trace ring of the thread
+ *
+ * @param[in] opcode      Operation
+ * @param[in] start_time  When it started, in ns since server boot
+ * @param[in] status      Its status
+ */
+static void trace_nfs4_op(nfs_opnum4 opcode, nsecs_elapsed_t start_time,
+			  int status)
+{
+	struct timespec ts;
 
-	/* Minor version related stuff */
-	data.minorversion = compound4_minor;
-	data.req = req;
+	if (gsh_trace_mask == 0)
+		return;
 
-	/* Building the client credential field */
-	if (nfs_rpc_req2client_cred(req, &(data.credential)) == -1)
-		return NFS_REQ_DROP;	/* Malformed credential */
+	now(&ts);
+	gsh_trace(TRACE_NFS4_OP, __func__,
+		  timespec_diff(&ServerBootTime, &ts) - start_time,
+		  (uint32_t) status << 16 | opcode);
+}
 
-	/* Keeping the same tag as in the arguments */
-	res->res_compound4.tag.utf8string_len =
-	    arg->arg_compound4.tag.utf8string_len;
+/**
+ * @brief Finish the operations that waited on asynchronous I/O
+ *
+ * The operations are finished in order, each within the export it was
+ * issued in.  If one of them failed, the results of everything after it
+ * are discarded and the COMPOUND ends there.
+ *
+ * @param[in,out] data  Compound data
+ *
+ * @return Status to complete the COMPOUND with, NFS4_OK to carry on
+ *         from data->oppos.
+ */
+static int nfs4_Compound_async_finish(compound_data_t *data)
+{
+	nfs_res_t *res = data->res;
+	nfs_resop4 *resarray = res->res_compound4.resarray.resarray_val;
+	struct gsh_export *export = op_ctx->ctx_export;
+	struct fsal_export *fsal_export = op_ctx->fsal_export;
+	int status = NFS4_OK;
+	uint32_t failed = 0;
+	uint32_t last;
+	uint32_t n;
 
-	/* Allocating the reply nfs_resop4 */
-	res->res_compound4.resarray.resarray_val =
-		gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+	for (n = 0; n < data->async_count; n++) {
+		struct nfs4_async_op *aop = &data->async_ops[n];
+		int op_status;
 
-	res->res_compound4.resarray.resarray_len = argarray_len;
-	resarray = res->res_compound4.resarray.resarray_val;
+		op_ctx->ctx_export = aop->export;
+		op_ctx->fsal_export = aop->export->fsal_export;
+		data->opcode = aop->opcode;
+		data->op_start_time = aop->start_time;
+		data->op_data = aop->op_data;
 
-	/* Manage errors NFS4ERR_OP_NOT_IN_SESSION and NFS4ERR_NOT_ONLY_OP.
-	 * These checks apply only to 4.1 */
-	if (compound4_minor > 0) {
+		op_status = aop->resume(&data->argarray[aop->pos], data,
+					&resarray[aop->pos]);
 
-		/* Check for valid operation to start an NFS v4.1 COMPOUND:
-		 */
-		if (argarray[0].argop != NFS4_OP_ILLEGAL
-		    && argarray[0].argop != NFS4_OP_SEQUENCE
-		    && argarray[0].argop != NFS4_OP_EXCHANGE_ID
-		    && argarray[0].argop != NFS4_OP_CREATE_SESSION
-		    && argarray[0].argop != NFS4_OP_DESTROY_SESSION
-		    && argarray[0].argop != NFS4_OP_BIND_CONN_TO_SESSION
-		    && argarray[0].argop != NFS4_OP_DESTROY_CLIENTID) {
-			status = NFS4ERR_OP_NOT_IN_SESSION;
-			res->res_compound4.status = status;
-			res->res_compound4.resarray.resarray_len = 0;
-			return NFS_REQ_OK;
-		}
+#ifdef USE_LTTNG
+		tracepoint(nfs_rpc, v4op_end, aop->pos,
+			   data->argarray[aop->pos].argop,
+			   optabv4[aop->opcode].name);
+#endif
 
-		if (argarray_len > 1) {
-			/* If not prepended by OP4_SEQUENCE, OP4_EXCHANGE_ID
-			 * should be the only request in the compound see
-			 * 18.35.3. and test EID8 for details
-			 *
-			 * If not prepended bu OP4_SEQUENCE, OP4_CREATE_SESSION
-			 * should be the only request in the compound see
-			 * 18.36.3 and test CSESS23 for details
-			 *
-			 * If the COMPOUND request does not start with SEQUENCE,
-			 * and if DESTROY_SESSION is not the sole operation,
-			 * then server MUST return  NFS4ERR_NOT_ONLY_OP. See
-			 * 18.37.3 nd test DSESS9005 for details
-			 */
-			if (argarray[0].argop == NFS4_OP_EXCHANGE_ID ||
-			    argarray[0].argop == NFS4_OP_CREATE_SESSION ||
-			    argarray[0].argop == NFS4_OP_DESTROY_CLIENTID ||
-			    argarray[0].argop == NFS4_OP_DESTROY_SESSION ||
-			    argarray[0].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
-				status = NFS4ERR_NOT_ONLY_OP;
-				res->res_compound4.status = status;
-				res->res_compound4.resarray.resarray_len = 0;
-				return NFS_REQ_OK;
-			}
-		}
+		resarray[aop->pos].nfs_resop4_u.opaccess.status = op_status;
 
-		/* If the COMPOUND request starts with SEQUENCE, and if the
-		 * sessionids specified in SEQUENCE and DESTROY_SESSION are the
-		 * same, then DESTROY_SESSION MUST be the final operation in the
-		 * COMPOUND request.
-		 */
-		if (argarray_len > 2 && argarray[0].argop == NFS4_OP_SEQUENCE
-		    && argarray[1].argop == NFS4_OP_DESTROY_SESSION
-		    && strncmp(argarray[0].nfs_argop4_u.opsequence.sa_sessionid,
-			       argarray[1].nfs_argop4_u.opdestroy_session.
-			       dsa_sessionid,
-			       NFS4_SESSIONID_SIZE) == 0) {
-			status = NFS4ERR_NOT_ONLY_OP;
-			res->res_compound4.status = status;
-			res->res_compound4.resarray.resarray_len = 0;
-			return NFS_REQ_OK;
+		server_stats_nfsv4_op_done(aop->opcode, aop->start_time,
+					   op_status);
+		trace_nfs4_op(aop->opcode, aop->start_time, op_status);
+
+		put_gsh_export(aop->export);
+
+		if (op_status != NFS4_OK && status == NFS4_OK) {
+			LogDebug(COMPONENT_NFS_V4,
+				 "Status of %s in position %d = %s",
+				 optabv4[aop->opcode].name, aop->pos,
+				 nfsstat4_to_str(op_status));
+			status = op_status;
+			failed = aop->pos;
 		}
 	}
 
-	for (i = 0; i < argarray_len; i++) {
+	op_ctx->ctx_export = export;
+	op_ctx->fsal_export = fsal_export;
+	data->async_count = 0;
+
+	if (status == NFS4_OK) {
+		status = data->async_status;
+		data->async_status = NFS4_OK;
+		return status;
+	}
+
+	/* The operations after the failed one should never have been
+	 * run, throw their results away.
+	 */
+	last = MIN(data->oppos, res->res_compound4.resarray.resarray_len);
+
+	for (n = failed + 1; n < last; n++)
+		nfs4_Compound_FreeOne(&resarray[n]);
+
+	res->res_compound4.resarray.resarray_len = failed + 1;
+
+	return status;
+}
+
+/**
+ * @brief Process the operations of a COMPOUND
+ *
+ * Processes the operations from data->oppos onward, then completes the
+ * COMPOUND.  If an operation has to wait on asynchronous I/O, it calls
+ * nfs4_op_async_start() and processing stops until nfs4_Compound_resume()
+ * is called.  In an NFSv4.1 COMPOUND, up to Compound_Pipeline_Depth READs
+ * may wait at once, the operations in between being run meanwhile.
+ *
+ * @param[in,out] data  Compound data, cleaned up once the COMPOUND completes
+ *
+ * @retval NFS_REQ_OK if a result is sent.
+ * @retval NFS_REQ_ASYNC_WAIT if an operation is waiting on I/O.
+ */
+static int nfs4_Compound_ops(compound_data_t *data)
+{
+	unsigned int i = 0;
+	int status = NFS4_OK;
+	nfs_opnum4 opcode;
+	nfs_res_t *res = data->res;
+	const uint32_t compound4_minor = data->minorversion;
+	const uint32_t argarray_len = data->argarray_len;
+	/* Array of op arguments */
+	nfs_argop4 * const argarray = data->argarray;
+	nfs_resop4 *resarray = res->res_compound4.resarray.resarray_val;
+	struct timespec ts;
+	int perm_flags;
+
+	/* Hold the I/O count up while operations are being issued */
+	data->async_io = 1;
+
+	if (data->async_count != 0) {
+		/* All the I/O we waited on completed */
+		status = nfs4_Compound_async_finish(data);
+		if (status != NFS4_OK)
+			goto done;
+
+		nfs4_Compound_stream(data, data->oppos);
+	}
+
+	for (i = data->oppos; i < argarray_len; i++) {
+		if (data->async_count != 0 &&
+		    !nfs4_op_pipelines(argarray[i].argop)) {
+			/* This one has to wait for the earlier READs */
+			goto wait;
+		}
+
 		/* Used to check if OP_SEQUENCE is the first operation */
-		data.oppos = i;
+		data->oppos = i;
 
 		/* Verify BIND_CONN_TO_SESSION is not used in a compound
 		 * with length > 1.
@@ -665,15 +868,17 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 		/* time each op */
 		now(&ts);
-		op_start_time = timespec_diff(&ServerBootTime, &ts);
+		data->op_start_time = timespec_diff(&ServerBootTime, &ts);
 		opcode = argarray[i].argop;
 
 		/* Handle opcode overflow */
 		if (opcode > LastOpcode[compound4_minor])
 			opcode = 0;
 
-		if (compound4_minor > 0 && data.session != NULL &&
-		    data.session->fore_channel_attrs.ca_maxoperations == i) {
+		data->opcode = opcode;
+
+		if (compound4_minor > 0 && data->session != NULL &&
+		    data->session->fore_channel_attrs.ca_maxoperations == i) {
 			status = NFS4ERR_TOO_MANY_OPS;
 			goto bad_op_state;
 		}
@@ -684,7 +889,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		    optabv4[opcode].exp_perm_flags & EXPORT_OPTION_ACCESS_MASK;
 
 		if (perm_flags != 0) {
-			status = nfs4_Is_Fh_Empty(&data.currentFH);
+			status = nfs4_Is_Fh_Empty(&data->currentFH);
 			if (status != NFS4_OK) {
 				LogDebug(COMPONENT_NFS_V4,
 					 "Status of %s for CurrentFH in position %d = %s",
@@ -740,23 +945,52 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 			   optabv4[opcode].name);
 #endif
 
+		cpu_profile_op(optabv4[opcode].name,
+			       op_ctx->ctx_export != NULL
+			       ? op_ctx->ctx_export->export_id : -1);
+
 		status = (optabv4[opcode].funct) (&argarray[i],
-						  &data,
+						  data,
 						  &resarray[i]);
 
+		if (data->op_resume != NULL) {
+			/* The operation is waiting on asynchronous I/O */
+			struct nfs4_async_op *aop =
+				&data->async_ops[data->async_count++];
+
+			aop->resume = data->op_resume;
+			aop->op_data = data->op_data;
+			aop->export = op_ctx->ctx_export;
+			get_gsh_export_ref(aop->export);
+			aop->pos = i;
+			aop->opcode = opcode;
+			aop->start_time = data->op_start_time;
+			data->op_resume = NULL;
+			data->op_data = NULL;
+
+			if (opcode == NFS4_OP_READ && compound4_minor > 0 &&
+			    data->async_count <
+			    nfs_param.nfsv4_param.compound_pipeline_depth)
+				continue;
+
+			i++;
+			goto wait;
+		}
+
 #ifdef USE_LTTNG
 		tracepoint(nfs_rpc, v4op_end, i, argarray[i].argop,
 			   optabv4[opcode].name);
 #endif
 
-		LogCompoundFH(&data);
+		LogCompoundFH(data);
 
 		/* All the operation, like NFS4_OP_ACESS, have a first replyied
 		 * field called .status
 		 */
 		resarray[i].nfs_resop4_u.opaccess.status = status;
 
-		server_stats_nfsv4_op_done(opcode, op_start_time, status);
+		server_stats_nfsv4_op_done(opcode, data->op_start_time, status);
+		trace_nfs4_op(opcode, data->op_start_time, status);
 
 		if (status != NFS4_OK) {
 			/* An error occured, we do not manage the other requests
@@ -775,7 +1009,7 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 		/* Check Req size */
 
 		/* NFS_V4.1 specific stuff */
-		if (data.use_drc) {
+		if (data->use_drc) {
 			/* Replay cache, only true for SEQUENCE or
 			 * CREATE_SESSION w/o SEQUENCE. Since will only be set
 			 * in those cases, no need to check operation or
@@ -784,17 +1018,40 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 
 			/* Free the reply allocated above */
 			gsh_free(res->res_compound4.resarray.resarray_val);
+			res->res_compound4.resarray.resarray_val = NULL;
+			res->res_compound4.resarray.resarray_len = 0;
 
-			/* Copy the reply from the cache */
-			res->res_compound4_extended = *data.cached_res;
-			status = ((COMPOUND4res *) data.cached_res)->status;
+			/* Send the cached reply as it was encoded.  Take a
+			 * copy, the slot may be reused before it is sent.
+			 */
+			res->res_compound4_extended.res_replay.len =
+			    data->cached_res->len;
+			res->res_compound4_extended.res_replay.buf =
+			    gsh_malloc(data->cached_res->len);
+			memcpy(res->res_compound4_extended.res_replay.buf,
+			       data->cached_res->buf, data->cached_res->len);
+			status = data->cached_res->status;
 			LogFullDebug(COMPONENT_SESSIONS,
 				     "Use session replay cache %p result %s",
-				     data.cached_res, nfsstat4_to_str(status));
+				     data->cached_res, nfsstat4_to_str(status));
 			break;	/* Exit the for loop */
 		}
+
+		/* Results are streamed once the READs before are done */
+		if (data->async_count == 0)
+			nfs4_Compound_stream(data, i + 1);
 	}			/* for */
 
+	if (data->async_count != 0) {
+		/* Earlier READs are still in progress, complete the
+		 * COMPOUND only once they are finished.
+		 */
+		data->async_status = status;
+		i = res->res_compound4.resarray.resarray_len;
+		goto wait;
+	}
+
+ done:
 	server_stats_compound_done(argarray_len, status);
 
 	/* Complete the reply, in particular, tell where you stopped if
@@ -802,49 +1059,286 @@ int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
 	 */
 	res->res_compound4.status = status;
 
+	if (!data->use_drc)
+		nfs4_Compound_stream_end(data);
+
 	/* Manage session's DRC: keep NFS4.1 replay for later use, but don't
 	 * save a replayed result again.
 	 */
-	if (data.cached_res != NULL && !data.use_drc) {
+	if (data->cached_res != NULL && !data->use_drc) {
 		/* Pointer has been set by nfs4_op_sequence and points to slot
 		 * to cache result in.
 		 */
-		LogFullDebug(COMPONENT_SESSIONS,
-			     "Save result in session replay cache %p sizeof nfs_res_t=%d",
-			     data.cached_res, (int)sizeof(nfs_res_t));
-
-		/* Indicate to nfs4_Compound_Free that this reply is cached. */
-		res->res_compound4_extended.res_cached = true;
-
-		/* If the cache is already in use, free it. */
-		if (data.cached_res->res_cached) {
-			data.cached_res->res_cached = false;
-			nfs4_Compound_Free((nfs_res_t *) data.cached_res);
-		}
-
-		/* Save the result in the cache. */
-		*data.cached_res = res->res_compound4_extended;
+		nfs4_Compound_SaveReply(data->cached_res,
+					&res->res_compound4_extended);
 	}
 
 	/* If we have reserved a lease, update it and release it */
-	if (data.preserved_clientid != NULL) {
+	if (data->preserved_clientid != NULL) {
 		/* Update and release lease */
-		PTHREAD_MUTEX_lock(&data.preserved_clientid->cid_mutex);
+		PTHREAD_MUTEX_lock(&data->preserved_clientid->cid_mutex);
 
-		update_lease(data.preserved_clientid);
+		update_lease(data->preserved_clientid);
 
-		PTHREAD_MUTEX_unlock(&data.preserved_clientid->cid_mutex);
+		PTHREAD_MUTEX_unlock(&data->preserved_clientid->cid_mutex);
 	}
 
 	if (status != NFS4_OK)
 		LogDebug(COMPONENT_NFS_V4, "End status = %s lastindex = %d",
 			 nfsstat4_to_str(status), i);
 
-	compound_data_Free(&data);
+	compound_data_Free(data);
+
+	return NFS_REQ_OK;
+
+ wait:
+	/* Carry on from operation i once the I/O completed, dropping our
+	 * hold lets the last completion hand the request back.
+	 */
+	data->oppos = i;
+	nfs4_op_async_done(data);
+
+	return NFS_REQ_ASYNC_WAIT;
+}
+
+/**
+ * @brief Resume a COMPOUND waiting on asynchronous I/O
+ *
+ * @param[in] reqdata  The suspended request
+ *
+ * @retval NFS_REQ_OK if a result is sent.
+ * @retval NFS_REQ_ASYNC_WAIT if an operation is waiting on I/O again.
+ */
+static int nfs4_Compound_resume(request_data_t *reqdata)
+{
+	compound_data_t *data = reqdata->proc_data;
+	int rc;
+
+	rc = nfs4_Compound_ops(data);
+
+	if (rc != NFS_REQ_ASYNC_WAIT)
+		reqdata->proc_data = NULL;
+
+	return rc;
+}
+
+/**
+ * @brief The NFS PROC4 COMPOUND
+ *
+ * Implements the NFS PROC4 COMPOUND.  This routine processes the
+ * content of the nfsv4 operation list and composes the result.  On
+ * this aspect it is a little similar to a dispatch routine.
+ * Operation and functions necessary to process them are defined in
+ * the optabv4 array.
+ *
+ *
+ *  @param[in]  arg        Generic nfs arguments
+ *  @param[in]  req        NFSv4 request structure
+ *  @param[out] res        NFSv4 reply structure
+ *
+ *  @see nfs4_op_<*> functions
+ *  @see nfs4_GetPseudoFs
+ *
+ * @retval NFS_REQ_OKAY if a result is sent.
+ * @retval NFS_REQ_DROP if we pretend we never saw the request.
+ */
+
+int nfs4_Compound(nfs_arg_t *arg, struct svc_req *req, nfs_res_t *res)
+{
+	int status = NFS4_OK;
+	compound_data_t *data;
+	request_data_t *reqdata;
+	int rc;
+	const uint32_t compound4_minor = arg->arg_compound4.minorversion;
+	const uint32_t argarray_len = arg->arg_compound4.argarray.argarray_len;
+	/* Array of op arguments */
+	nfs_argop4 * const argarray = arg->arg_compound4.argarray.argarray_val;
+	char *tagname = NULL;
+	char *notag = "NO TAG";
+
+	if (compound4_minor > 2) {
+		LogCrit(COMPONENT_NFS_V4, "Bad Minor Version %d",
+			compound4_minor);
+
+		res->res_compound4.status = NFS4ERR_MINOR_VERS_MISMATCH;
+		res->res_compound4.resarray.resarray_len = 0;
+		return NFS_REQ_OK;
+	}
+
+	/* Keeping the same tag as in the arguments */
+	res->res_compound4.tag.utf8string_len =
+	    arg->arg_compound4.tag.utf8string_len;
+	if (res->res_compound4.tag.utf8string_len > 0) {
+
+		res->res_compound4.tag.utf8string_val =
+		    gsh_malloc(res->res_compound4.tag.utf8string_len + 1);
+
+		memcpy(res->res_compound4.tag.utf8string_val,
+		       arg->arg_compound4.tag.utf8string_val,
+		       res->res_compound4.tag.utf8string_len);
+
+		res->res_compound4.tag.utf8string_val[res->res_compound4.tag.
+						      utf8string_len] = '\0';
+
+		/* Check if the tag is a valid utf8 string */
+		status =
+		    nfs4_utf8string2arena(nfs_req_arena(req),
+					  &(res->res_compound4.tag),
+					  UTF8_SCAN_ALL, &tagname);
+		if (status != 0) {
+			status = NFS4ERR_INVAL;
+			res->res_compound4.status = status;
+			res->res_compound4.resarray.resarray_len = 0;
+			return NFS_REQ_OK;
+		}
+	} else {
+		res->res_compound4.tag.utf8string_val = NULL;
+		tagname = notag;
+	}
+
+	/* Managing the operation list */
+	LogDebug(COMPONENT_NFS_V4,
+		 "COMPOUND: There are %d operations, res = %p, tag = %s",
+		 argarray_len, res, tagname);
+
+	/* Check for empty COMPOUND request */
+	if (argarray_len == 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "An empty COMPOUND (no operation in it) was received");
+
+		res->res_compound4.status = NFS4_OK;
+		res->res_compound4.resarray.resarray_len = 0;
+		return NFS_REQ_OK;
+	}
+
+	/* Check for too long request */
+	if (argarray_len > 100) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "A COMPOUND with too many operations (%d) was received",
+			 argarray_len);
+
+		res->res_compound4.status = NFS4ERR_RESOURCE;
+		res->res_compound4.resarray.resarray_len = 0;
+		return NFS_REQ_OK;
+	}
+
+	/* Initialisation of the compound request internal's data, it
+	 * outlives this call if an operation waits on asynchronous I/O.
+	 */
+	data = gsh_arena_calloc(nfs_req_arena(req), sizeof(*data));
+	op_ctx->nfs_minorvers = compound4_minor;
+
+	/* Minor version related stuff */
+	data->minorversion = compound4_minor;
+	data->req = req;
+	data->argarray = argarray;
+	data->argarray_len = argarray_len;
+	data->res = res;
+
+	/* Building the client credential field */
+	if (nfs_rpc_req2client_cred(req, &(data->credential)) == -1)
+		return NFS_REQ_DROP;	/* Malformed credential */
+
+	/* The current and saved filehandles start empty */
+	data->currentFH.nfs_fh4_val =
+		gsh_arena_calloc(nfs_req_arena(req), NFS4_FHSIZE);
+	data->savedFH.nfs_fh4_val =
+		gsh_arena_calloc(nfs_req_arena(req), NFS4_FHSIZE);
+
+	/* Keeping the same tag as in the arguments */
+	res->res_compound4.tag.utf8string_len =
+	    arg->arg_compound4.tag.utf8string_len;
+
+	/* Allocating the reply nfs_resop4 */
+	res->res_compound4.resarray.resarray_val =
+		gsh_calloc(argarray_len, sizeof(struct nfs_resop4));
+
+	res->res_compound4.resarray.resarray_len = argarray_len;
+
+	/* Manage errors NFS4ERR_OP_NOT_IN_SESSION and NFS4ERR_NOT_ONLY_OP.
+	 * These checks apply only to 4.1 */
+	if (compound4_minor > 0) {
+
+		/* Check for valid operation to start an NFS v4.1 COMPOUND:
+		 */
+		if (argarray[0].argop != NFS4_OP_ILLEGAL
+		    && argarray[0].argop != NFS4_OP_SEQUENCE
+		    && argarray[0].argop != NFS4_OP_EXCHANGE_ID
+		    && argarray[0].argop != NFS4_OP_CREATE_SESSION
+		    && argarray[0].argop != NFS4_OP_DESTROY_SESSION
+		    && argarray[0].argop != NFS4_OP_BIND_CONN_TO_SESSION
+		    && argarray[0].argop != NFS4_OP_DESTROY_CLIENTID) {
+			status = NFS4ERR_OP_NOT_IN_SESSION;
+			res->res_compound4.status = status;
+			res->res_compound4.resarray.resarray_len = 0;
+			goto out;
+		}
+
+		if (argarray_len > 1) {
+			/* If not prepended by OP4_SEQUENCE, OP4_EXCHANGE_ID
+			 * should be the only request in the compound see
+			 * 18.35.3. and test EID8 for details
+			 *
+			 * If not prepended bu OP4_SEQUENCE, OP4_CREATE_SESSION
+			 * should be the only request in the compound see
+			 * 18.36.3 and test CSESS23 for details
+			 *
+			 * If the COMPOUND request does not start with SEQUENCE,
+			 * and if DESTROY_SESSION is not the sole operation,
+			 * then server MUST return  NFS4ERR_NOT_ONLY_OP. See
+			 * 18.37.3 nd test DSESS9005 for details
+			 */
+			if (argarray[0].argop == NFS4_OP_EXCHANGE_ID ||
+			    argarray[0].argop == NFS4_OP_CREATE_SESSION ||
+			    argarray[0].argop == NFS4_OP_DESTROY_CLIENTID ||
+			    argarray[0].argop == NFS4_OP_DESTROY_SESSION ||
+			    argarray[0].argop == NFS4_OP_BIND_CONN_TO_SESSION) {
+				status = NFS4ERR_NOT_ONLY_OP;
+				res->res_compound4.status = status;
+				res->res_compound4.resarray.resarray_len = 0;
+				goto out;
+			}
+		}
+
+		/* If the COMPOUND request starts with SEQUENCE, and if the
+		 * sessionids specified in SEQUENCE and DESTROY_SESSION are the
+		 * same, then DESTROY_SESSION MUST be the final operation in the
+		 * COMPOUND request.
+		 */
+		if (argarray_len > 2 && argarray[0].argop == NFS4_OP_SEQUENCE
+		    && argarray[1].argop == NFS4_OP_DESTROY_SESSION
+		    && strncmp(argarray[0].nfs_argop4_u.opsequence.sa_sessionid,
+			       argarray[1].nfs_argop4_u.opdestroy_session.
+			       dsa_sessionid,
+			       NFS4_SESSIONID_SIZE) == 0) {
+			status = NFS4ERR_NOT_ONLY_OP;
+			res->res_compound4.status = status;
+			res->res_compound4.resarray.resarray_len = 0;
+			goto out;
+		}
+	}
+
+	rc = nfs4_Compound_ops(data);
+
+	if (rc == NFS_REQ_ASYNC_WAIT) {
+		/* An operation is waiting on asynchronous I/O, the compound
+		 * is carried on by nfs4_Compound_resume().
+		 */
+		reqdata = nfs_req_to_reqdata(req);
+		reqdata->proc_data = data;
+		reqdata->resume = nfs4_Compound_resume;
+	}
+
+	return rc;
+
+ out:
+	compound_data_Free(data);
 
 	return NFS_REQ_OK;
 }				/* nfs4_Compound */
 
+
+
 /**
  *
  * @brief Free the result for one NFS4_OP
@@ -881,11 +1375,12 @@ void nfs4_Compound_Free(nfs_res_t *res)
 	if (isFullDebug(COMPONENT_SESSIONS))
 		component = COMPONENT_SESSIONS;
 
-	if (res->res_compound4_extended.res_cached) {
+	if (res->res_compound4_extended.res_replay.buf) {
 		LogFullDebug(component,
-			     "Skipping free of NFS4 result %p",
+			     "Free replayed NFS4 result %p",
 			     res);
-		return;
+		gsh_free(res->res_compound4_extended.res_replay.buf);
+		res->res_compound4_extended.res_replay.buf = NULL;
 	}
 
 	LogFullDebug(component,
@@ -893,7 +1388,9 @@ void nfs4_Compound_Free(nfs_res_t *res)
 		     res,
 		     res->res_compound4.resarray.resarray_len);
 
-	for (i = 0; i < res->res_compound4.resarray.resarray_len; i++) {
+	/* Streamed results were released once encoded */
+	for (i = res->res_compound4_extended.res_streamed;
+	     i < res->res_compound4.resarray.resarray_len; i++) {
 		nfs_resop4 *val = &res->res_compound4.resarray.resarray_val[i];
 
 		if (val) {
@@ -920,6 +1417,13 @@ void nfs4_Compound_Free(nfs_res_t *res)
  */
 void compound_data_Free(compound_data_t *data)
 {
+	/* A reply stream not handed to the result */
+	if (data->reply_buf != NULL) {
+		XDR_DESTROY(&data->reply_xdrs);
+		gsh_free(data->reply_buf);
+		data->reply_buf = NULL;
+	}
+
 	/* Release refcounted cache entries */
 	if (data->current_obj) {
 		set_current_entry(data, NULL);
@@ -957,13 +1461,6 @@ void compound_data_Free(compound_data_t *data)
 		put_gsh_export(data->saved_export);
 		data->saved_export = NULL;
 	}
-
-	if (data->currentFH.nfs_fh4_val != NULL)
-		gsh_free(data->currentFH.nfs_fh4_val);
-
-	if (data->savedFH.nfs_fh4_val != NULL)
-		gsh_free(data->savedFH.nfs_fh4_val);
-
 }				/* compound_data_Free */
 
 /**
@@ -0,0 +1,958 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file nfs4_op_copy.c
+ * @brief NFSv4.2 COPY, CLONE, OFFLOAD_STATUS and OFFLOAD_CANCEL
+ *
+ * Intra-server copies are handed to the FSAL copy2 and clone2
+ * methods.  Small or synchronous copies are done before replying, the
+ * others run on the copy fridge and are reported to the client with
+ * CB_OFFLOAD.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "fsal.h"
+#include "nfs_core.h"
+#include "sal_functions.h"
+#include "nfs_proto_functions.h"
+#include "nfs_proto_tools.h"
+#include "nfs_convert.h"
+#include "nfs_file_handle.h"
+#include "nfs_rpc_callback.h"
+#include "export_mgr.h"
+#include "fridgethr.h"
+#include "common_utils.h"
+
+/** Bytes an asynchronous copy moves between checks for cancellation */
+#define COPY_ASYNC_CHUNK (64 * 1024 * 1024)
+
+/**
+ * @brief Copy running in the background
+ *
+ * A job is on copy_jobs from its start until the client learns its
+ * result, through CB_OFFLOAD or OFFLOAD_STATUS, or cancels it.  The
+ * references to the export, files and states are dropped as soon as
+ * the copy is over.
+ */
+
+struct copy_job {
+	struct glist_head list;	/*< Link in copy_jobs */
+	stateid4 stateid;	/*< Callback stateid given to the client */
+	nfs_client_id_t *clientid;	/*< Client that asked for the copy */
+	struct gsh_export *export;	/*< Export of both files */
+	struct fsal_obj_handle *src_obj;	/*< File copied from */
+	struct fsal_obj_handle *dst_obj;	/*< File copied to */
+	state_t *src_state;	/*< Source state, NULL for special stateids */
+	state_t *dst_state;	/*< Destination state, as above */
+	uint64_t src_offset;	/*< Start of the range in the source */
+	uint64_t dst_offset;	/*< Start of the range in the destination */
+	uint64_t count;		/*< Bytes to copy, 0 up to the end */
+	uint64_t copied;	/*< Bytes copied so far */
+	nfsstat4 status;	/*< Result, once done */
+	verifier4 verifier;	/*< Write verifier after the copy */
+	bool done;		/*< The copy is over */
+	bool cancelled;		/*< OFFLOAD_CANCEL was received */
+	bool cb_pending;	/*< CB_OFFLOAD is in flight */
+	nfs_cb_argop4 cb_arg;	/*< The CB_OFFLOAD */
+	nfs_fh4 fh;		/*< Destination handle for CB_OFFLOAD */
+	char fh_buf[NFS4_FHSIZE];	/*< Storage for fh */
+};
+
+static struct fridgethr *copy_fridge;
+static pthread_mutex_t copy_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head copy_jobs = GLIST_HEAD_INIT(copy_jobs);
+static uint64_t copy_job_counter;
+
+/**
+ * @brief End of a byte range, saturating
+ *
+ * @param[in] offset Start of the range
+ * @param[in] count  Length of the range, 0 up to the end of the file
+ *
+ * @return Offset past the range.
+ */
+
+static inline uint64_t copy_range_end(uint64_t offset, uint64_t count)
+{
+	if (count == 0 || offset + count < offset)
+		return UINT64_MAX;
+
+	return offset + count;
+}
+
+/**
+ * @brief Check the stateid used for one side of a copy
+ *
+ * This mirrors the checks of READ and WRITE.  On success, @a state
+ * holds a reference to the state found, or is NULL for a special
+ * stateid, in which case anonymous I/O has been started.
+ *
+ * @param[in]  data    Compound request's data
+ * @param[in]  obj     The file
+ * @param[in]  stateid Stateid sent by the client
+ * @param[in]  access  OPEN4_SHARE_ACCESS_READ or _WRITE
+ * @param[out] state   The state found
+ * @param[in]  tag     Operation name for the logs
+ *
+ * @return NFSv4 status.
+ */
+
+static nfsstat4 copy_check_state(compound_data_t *data,
+				 struct fsal_obj_handle *obj,
+				 stateid4 *stateid, int access,
+				 state_t **state, const char *tag)
+{
+	state_t *state_found = NULL;
+	state_t *state_open = NULL;
+	struct state_deleg *sdeleg;
+	fsal_status_t fsal_status;
+	nfsstat4 status;
+
+	*state = NULL;
+
+	status = nfs4_Check_Stateid(stateid, obj, &state_found, data,
+				    STATEID_SPECIAL_ANY, 0, false, tag);
+
+	if (status != NFS4_OK)
+		return status;
+
+	if (state_found == NULL) {
+		/* Special stateid, check for share conflicts */
+		status = nfs4_Errno_state(
+			state_share_anonymous_io_start(obj, access,
+						       SHARE_BYPASS_NONE));
+		if (status != NFS4_OK)
+			return status;
+
+		goto access;
+	}
+
+	switch (state_found->state_type) {
+	case STATE_TYPE_SHARE:
+		state_open = state_found;
+		break;
+
+	case STATE_TYPE_LOCK:
+		state_open = state_found->state_data.lock.openstate;
+		break;
+
+	case STATE_TYPE_DELEG:
+		sdeleg = &state_found->state_data.deleg;
+		if ((access == OPEN4_SHARE_ACCESS_WRITE &&
+		     !(sdeleg->sd_type & OPEN_DELEGATE_WRITE)) ||
+		    sdeleg->sd_state != DELEG_GRANTED) {
+			LogDebug(COMPONENT_STATE,
+				 "%s delegation type:%d state:%d",
+				 tag, sdeleg->sd_type, sdeleg->sd_state);
+			status = NFS4ERR_BAD_STATEID;
+			goto out;
+		}
+		break;
+
+	case STATE_TYPE_LAYOUT:
+		break;
+
+	default:
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s with invalid stateid of type %d",
+			 tag, (int)state_found->state_type);
+		status = NFS4ERR_BAD_STATEID;
+		goto out;
+	}
+
+	if (state_open != NULL &&
+	    (state_open->state_data.share.share_access & access) == 0) {
+		LogDebug(COMPONENT_NFS_V4_LOCK,
+			 "%s stateid lacks share access %d", tag, access);
+		status = NFS4ERR_OPENMODE;
+		goto out;
+	}
+
+ access:
+
+	fsal_status = obj->obj_ops.test_access(
+		obj,
+		access == OPEN4_SHARE_ACCESS_WRITE ? FSAL_WRITE_ACCESS
+						   : FSAL_READ_ACCESS,
+		NULL, NULL, true);
+
+	if (!FSAL_IS_ERROR(fsal_status)) {
+		*state = state_found;
+		return NFS4_OK;
+	}
+
+	status = nfs4_Errno_status(fsal_status);
+
+	if (state_found == NULL)
+		state_share_anonymous_io_done(obj, access);
+
+ out:
+
+	if (state_found != NULL)
+		dec_state_t_ref(state_found);
+
+	return status;
+}
+
+/**
+ * @brief Release what copy_check_state took
+ *
+ * @param[in] obj    The file
+ * @param[in] state  State returned by copy_check_state
+ * @param[in] access Access given to copy_check_state
+ */
+
+static void copy_release_state(struct fsal_obj_handle *obj, state_t *state,
+			       int access)
+{
+	if (state != NULL)
+		dec_state_t_ref(state);
+	else
+		state_share_anonymous_io_done(obj, access);
+}
+
+/**
+ * @brief Checks common to COPY and CLONE
+ *
+ * The source is the saved filehandle and the destination the current
+ * one, both regular files of the same export.
+ *
+ * @param[in]  data       Compound request's data
+ * @param[in]  src_sid    Source stateid
+ * @param[in]  dst_sid    Destination stateid
+ * @param[in]  src_offset Start of the source range
+ * @param[in]  dst_offset Start of the destination range
+ * @param[in]  count      Length of the ranges
+ * @param[out] src_state  Source state
+ * @param[out] dst_state  Destination state
+ * @param[in]  tag        Operation name for the logs
+ *
+ * @return NFSv4 status.
+ */
+
+static nfsstat4 copy_check_args(compound_data_t *data, stateid4 *src_sid,
+				stateid4 *dst_sid, uint64_t src_offset,
+				uint64_t dst_offset, uint64_t count,
+				state_t **src_state, state_t **dst_state,
+				const char *tag)
+{
+	struct fsal_obj_handle *src = data->saved_obj;
+	struct fsal_obj_handle *dst = data->current_obj;
+	uint64_t MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+	nfsstat4 status;
+
+	if (data->minorversion < 2)
+		return NFS4ERR_NOTSUPP;
+
+	status = nfs4_sanity_check_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	status = nfs4_sanity_check_saved_FH(data, REGULAR_FILE, false);
+	if (status != NFS4_OK)
+		return status;
+
+	if (data->saved_export != op_ctx->ctx_export)
+		return NFS4ERR_XDEV;
+
+	if (!dst->fsal->m_ops.support_ex(dst))
+		return NFS4ERR_NOTSUPP;
+
+	if (src == dst &&
+	    src_offset < copy_range_end(dst_offset, count) &&
+	    dst_offset < copy_range_end(src_offset, count))
+		return NFS4ERR_INVAL;
+
+	if (MaxOffsetWrite < UINT64_MAX && count != 0 &&
+	    copy_range_end(dst_offset, count) > MaxOffsetWrite) {
+		LogEvent(COMPONENT_NFS_V4,
+			 "A client tryed to violate max file size %"
+			 PRIu64 " for exportid #%hu",
+			 MaxOffsetWrite, op_ctx->ctx_export->export_id);
+		return NFS4ERR_FBIG;
+	}
+
+	status = copy_check_state(data, src, src_sid,
+				  OPEN4_SHARE_ACCESS_READ, src_state, tag);
+	if (status != NFS4_OK)
+		return status;
+
+	status = copy_check_state(data, dst, dst_sid,
+				  OPEN4_SHARE_ACCESS_WRITE, dst_state, tag);
+	if (status != NFS4_OK)
+		copy_release_state(src, *src_state, OPEN4_SHARE_ACCESS_READ);
+
+	return status;
+}
+
+/**
+ * @brief Fetch the write verifier of the current export
+ *
+ * @param[out] verf The verifier
+ */
+
+static void copy_get_verifier(verifier4 verf)
+{
+	struct gsh_buffdesc verf_desc;
+
+	verf_desc.addr = verf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+}
+
+/**
+ * @brief Free a copy job no longer on copy_jobs
+ *
+ * @param[in] job The job
+ */
+
+static void copy_job_free(struct copy_job *job)
+{
+	dec_client_id_ref(job->clientid);
+	gsh_free(job);
+}
+
+/**
+ * @brief Find the job of a client by callback stateid
+ *
+ * Must be called with copy_jobs_mutex held.
+ *
+ * @param[in] clientid The client
+ * @param[in] stateid  The callback stateid
+ *
+ * @return The job or NULL.
+ */
+
+static struct copy_job *copy_job_lookup(nfs_client_id_t *clientid,
+					stateid4 *stateid)
+{
+	struct glist_head *glist;
+	struct copy_job *job;
+
+	glist_for_each(glist, &copy_jobs) {
+		job = glist_entry(glist, struct copy_job, list);
+		if (job->clientid == clientid &&
+		    memcmp(job->stateid.other, stateid->other,
+			   sizeof(stateid->other)) == 0)
+			return job;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Handle the CB_OFFLOAD response
+ *
+ * A job the client did not hear about stays on copy_jobs for
+ * OFFLOAD_STATUS.
+ *
+ * @param[in] op     The CB_OFFLOAD
+ * @param[in] status Its result
+ * @param[in] hook   The hook itself
+ * @param[in] arg    The job
+ */
+
+static void copy_cb_completion(nfs_cb_argop4 *op, nfsstat4 status,
+			       rpc_call_hook hook, void *arg)
+{
+	struct copy_job *job = arg;
+	bool forget;
+
+	LogFullDebug(COMPONENT_NFS_CB, "status %d job %p", status, job);
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	job->cb_pending = false;
+	forget = hook == RPC_CALL_COMPLETE || job->cancelled;
+	if (forget)
+		glist_del(&job->list);
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	if (forget)
+		copy_job_free(job);
+}
+
+/**
+ * @brief Run an asynchronous copy
+ *
+ * @param[in] ctx Thread context, holding the job
+ */
+
+static void copy_job_run(struct fridgethr_context *ctx)
+{
+	struct copy_job *job = ctx->arg;
+	struct root_op_context root_op_context;
+	CB_OFFLOAD4args *cb_offload;
+	offload_info4 *info;
+	fsal_status_t fsal_status = {0, 0};
+	uint64_t chunk, copied;
+	bool cancelled = false;
+	bool forget;
+
+	init_root_op_context(&root_op_context, job->export,
+			     job->export->fsal_export, NFS_V4, 2,
+			     NFS_REQUEST);
+
+	do {
+		chunk = COPY_ASYNC_CHUNK;
+		if (job->count != 0 && job->count - job->copied < chunk)
+			chunk = job->count - job->copied;
+
+		copied = 0;
+		fsal_status = job->src_obj->obj_ops.copy2(
+			job->src_obj, job->src_state,
+			job->src_offset + job->copied,
+			job->dst_obj, job->dst_state,
+			job->dst_offset + job->copied,
+			chunk, &copied);
+
+		atomic_add_uint64_t(&job->copied, copied);
+
+		PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+		cancelled = job->cancelled;
+		PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+	} while (!FSAL_IS_ERROR(fsal_status) && !cancelled &&
+		 copied == chunk &&
+		 (job->count == 0 || job->copied < job->count));
+
+	job->status = nfs4_Errno_status(fsal_status);
+	copy_get_verifier(job->verifier);
+
+	LogDebug(COMPONENT_NFS_V4,
+		 "Copy job %p %s after %" PRIu64 " bytes, status %s",
+		 job, cancelled ? "cancelled" : "done", job->copied,
+		 nfsstat4_to_str(job->status));
+
+	copy_release_state(job->src_obj, job->src_state,
+			   OPEN4_SHARE_ACCESS_READ);
+	copy_release_state(job->dst_obj, job->dst_state,
+			   OPEN4_SHARE_ACCESS_WRITE);
+	job->src_obj->obj_ops.put_ref(job->src_obj);
+	job->dst_obj->obj_ops.put_ref(job->dst_obj);
+
+	release_root_op_context();
+	put_gsh_export(job->export);
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	job->done = true;
+	forget = job->cancelled;
+	if (forget)
+		glist_del(&job->list);
+	else
+		job->cb_pending = true;
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	if (forget) {
+		copy_job_free(job);
+		return;
+	}
+
+	job->cb_arg.argop = NFS4_OP_CB_OFFLOAD;
+	cb_offload = &job->cb_arg.nfs_cb_argop4_u.opcboffload;
+	cb_offload->coa_fh = job->fh;
+	cb_offload->coa_stateid = job->stateid;
+	info = &cb_offload->coa_offload_info;
+	info->coa_status = job->status;
+	if (job->status == NFS4_OK) {
+		info->offload_info4_u.coa_resok4.wr_ids = 0;
+		info->offload_info4_u.coa_resok4.wr_count = job->copied;
+		info->offload_info4_u.coa_resok4.wr_committed = UNSTABLE4;
+		memcpy(info->offload_info4_u.coa_resok4.wr_writeverf,
+		       job->verifier, sizeof(verifier4));
+	} else {
+		info->offload_info4_u.coa_bytes_copied = job->copied;
+	}
+
+	if (nfs_rpc_cb_queue(job->clientid, &job->cb_arg, NULL,
+			     copy_cb_completion, job) != 0) {
+		/* Leave the result to OFFLOAD_STATUS */
+		PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+		job->cb_pending = false;
+		PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+	}
+}
+
+/**
+ * @brief Start an asynchronous copy
+ *
+ * On success the job takes over the states it is given, on failure
+ * they are left to the caller.
+ *
+ * @param[in]  data      Compound request's data
+ * @param[in]  arg_COPY  The COPY arguments
+ * @param[in]  src_state Source state
+ * @param[in]  dst_state Destination state
+ * @param[out] stateid   Callback stateid of the job
+ *
+ * @return NFSv4 status.
+ */
+
+static nfsstat4 copy_start_job(compound_data_t *data, COPY4args *arg_COPY,
+			       state_t *src_state, state_t *dst_state,
+			       stateid4 *stateid)
+{
+	struct copy_job *job;
+	uint32_t epoch = (uint32_t) ServerEpoch;
+	uint64_t counter;
+	int rc;
+
+	job = gsh_calloc(1, sizeof(*job));
+
+	counter = atomic_inc_uint64_t(&copy_job_counter);
+	job->stateid.seqid = 1;
+	memcpy(job->stateid.other, &epoch, sizeof(epoch));
+	memcpy(job->stateid.other + sizeof(epoch), &counter,
+	       sizeof(counter));
+
+	job->clientid = data->session->clientid_record;
+	inc_client_id_ref(job->clientid);
+	job->export = op_ctx->ctx_export;
+	get_gsh_export_ref(job->export);
+	job->src_obj = data->saved_obj;
+	job->src_obj->obj_ops.get_ref(job->src_obj);
+	job->dst_obj = data->current_obj;
+	job->dst_obj->obj_ops.get_ref(job->dst_obj);
+	job->src_state = src_state;
+	job->dst_state = dst_state;
+	job->src_offset = arg_COPY->ca_src_offset;
+	job->dst_offset = arg_COPY->ca_dst_offset;
+	job->count = arg_COPY->ca_count;
+	job->fh.nfs_fh4_val = job->fh_buf;
+	job->fh.nfs_fh4_len = data->currentFH.nfs_fh4_len;
+	memcpy(job->fh_buf, data->currentFH.nfs_fh4_val,
+	       data->currentFH.nfs_fh4_len);
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	glist_add_tail(&copy_jobs, &job->list);
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	rc = fridgethr_submit(copy_fridge, copy_job_run, job);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to submit copy job: %d", rc);
+		PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+		glist_del(&job->list);
+		PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+		job->src_obj->obj_ops.put_ref(job->src_obj);
+		job->dst_obj->obj_ops.put_ref(job->dst_obj);
+		put_gsh_export(job->export);
+		copy_job_free(job);
+		return NFS4ERR_DELAY;
+	}
+
+	*stateid = job->stateid;
+	return NFS4_OK;
+}
+
+/**
+ * @brief The NFS4_OP_COPY operation
+ *
+ * This functions handles the NFS4_OP_COPY operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.  Only copies within
+ * an export are supported.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862, p. 65
+ */
+
+int nfs4_op_copy(struct nfs_argop4 *op, compound_data_t *data,
+		 struct nfs_resop4 *resp)
+{
+	COPY4args * const arg_COPY = &op->nfs_argop4_u.opcopy;
+	COPY4res * const res_COPY = &resp->nfs_resop4_u.opcopy;
+	COPY4resok *resok = &res_COPY->COPY4res_u.cr_resok4;
+	write_response4 *wr = &resok->cr_response;
+	state_t *src_state = NULL;
+	state_t *dst_state = NULL;
+	fsal_status_t fsal_status;
+	uint64_t copied = 0;
+	uint64_t sync_max = nfs_param.nfsv4_param.copy_sync_max;
+
+	resp->resop = NFS4_OP_COPY;
+
+	if (arg_COPY->ca_source_server.ca_source_server_len != 0) {
+		/* Inter-server copy */
+		res_COPY->cr_status = NFS4ERR_NOTSUPP;
+		return res_COPY->cr_status;
+	}
+
+	res_COPY->cr_status = copy_check_args(data, &arg_COPY->ca_src_stateid,
+					      &arg_COPY->ca_dst_stateid,
+					      arg_COPY->ca_src_offset,
+					      arg_COPY->ca_dst_offset,
+					      arg_COPY->ca_count, &src_state,
+					      &dst_state, "COPY");
+
+	if (res_COPY->cr_status != NFS4_OK)
+		return res_COPY->cr_status;
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "src_offset = %" PRIu64 " dst_offset = %" PRIu64
+		     " count = %" PRIu64 " synchronous = %d",
+		     arg_COPY->ca_src_offset, arg_COPY->ca_dst_offset,
+		     arg_COPY->ca_count, arg_COPY->ca_synchronous);
+
+	resok->cr_requirements.cr_consecutive = true;
+
+	if (!arg_COPY->ca_synchronous &&
+	    (arg_COPY->ca_count == 0 || arg_COPY->ca_count > sync_max) &&
+	    (data->session->flags & session_bc_up)) {
+		res_COPY->cr_status = copy_start_job(data, arg_COPY,
+						     src_state, dst_state,
+						     &wr->wr_callback_id);
+		if (res_COPY->cr_status != NFS4_OK)
+			goto out;
+
+		wr->wr_ids = 1;
+		wr->wr_count = 0;
+		wr->wr_committed = UNSTABLE4;
+		copy_get_verifier(wr->wr_writeverf);
+		resok->cr_requirements.cr_synchronous = false;
+		return res_COPY->cr_status;
+	}
+
+	fsal_status = data->saved_obj->obj_ops.copy2(data->saved_obj,
+						     src_state,
+						     arg_COPY->ca_src_offset,
+						     data->current_obj,
+						     dst_state,
+						     arg_COPY->ca_dst_offset,
+						     arg_COPY->ca_count,
+						     &copied);
+
+	if (FSAL_IS_ERROR(fsal_status) && copied == 0) {
+		res_COPY->cr_status = nfs4_Errno_status(fsal_status);
+		goto out;
+	}
+
+	/* A copy failing half way through reports what was copied */
+	wr->wr_ids = 0;
+	wr->wr_count = copied;
+	wr->wr_committed = UNSTABLE4;
+	copy_get_verifier(wr->wr_writeverf);
+	resok->cr_requirements.cr_synchronous = true;
+
+ out:
+
+	copy_release_state(data->saved_obj, src_state,
+			   OPEN4_SHARE_ACCESS_READ);
+	copy_release_state(data->current_obj, dst_state,
+			   OPEN4_SHARE_ACCESS_WRITE);
+
+	return res_COPY->cr_status;
+}
+
+/**
+ * @brief Free memory allocated for COPY result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_copy_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_CLONE operation
+ *
+ * This functions handles the NFS4_OP_CLONE operation in NFSv4.2. This
+ * function can be called only from nfs4_Compound.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862, p. 69
+ */
+
+int nfs4_op_clone(struct nfs_argop4 *op, compound_data_t *data,
+		  struct nfs_resop4 *resp)
+{
+	CLONE4args * const arg_CLONE = &op->nfs_argop4_u.opclone;
+	CLONE4res * const res_CLONE = &resp->nfs_resop4_u.opclone;
+	state_t *src_state = NULL;
+	state_t *dst_state = NULL;
+	fsal_status_t fsal_status;
+
+	resp->resop = NFS4_OP_CLONE;
+
+	res_CLONE->cl_status = copy_check_args(data,
+					       &arg_CLONE->cl_src_stateid,
+					       &arg_CLONE->cl_dst_stateid,
+					       arg_CLONE->cl_src_offset,
+					       arg_CLONE->cl_dst_offset,
+					       arg_CLONE->cl_count, &src_state,
+					       &dst_state, "CLONE");
+
+	if (res_CLONE->cl_status != NFS4_OK)
+		return res_CLONE->cl_status;
+
+	fsal_status = data->saved_obj->obj_ops.clone2(data->saved_obj,
+						      src_state,
+						      arg_CLONE->cl_src_offset,
+						      data->current_obj,
+						      dst_state,
+						      arg_CLONE->cl_dst_offset,
+						      arg_CLONE->cl_count);
+
+	res_CLONE->cl_status = nfs4_Errno_status(fsal_status);
+
+	copy_release_state(data->saved_obj, src_state,
+			   OPEN4_SHARE_ACCESS_READ);
+	copy_release_state(data->current_obj, dst_state,
+			   OPEN4_SHARE_ACCESS_WRITE);
+
+	return res_CLONE->cl_status;
+}
+
+/**
+ * @brief Free memory allocated for CLONE result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_clone_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_STATUS operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_STATUS operation in
+ * NFSv4.2. This function can be called only from nfs4_Compound.  The
+ * job is forgotten once its result has been reported.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862, p. 67
+ */
+
+int nfs4_op_offload_status(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_STATUS4args * const arg_STATUS =
+		&op->nfs_argop4_u.opoffload_status;
+	OFFLOAD_STATUS4res * const res_STATUS =
+		&resp->nfs_resop4_u.opoffload_status;
+	OFFLOAD_STATUS4resok *resok =
+		&res_STATUS->OFFLOAD_STATUS4res_u.osr_resok4;
+	struct copy_job *job;
+	bool forget = false;
+
+	resp->resop = NFS4_OP_OFFLOAD_STATUS;
+
+	if (data->minorversion < 2) {
+		res_STATUS->osr_status = NFS4ERR_NOTSUPP;
+		return res_STATUS->osr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+
+	job = copy_job_lookup(data->session->clientid_record,
+			      &arg_STATUS->osa_stateid);
+
+	if (job == NULL) {
+		PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+		res_STATUS->osr_status = NFS4ERR_BAD_STATEID;
+		return res_STATUS->osr_status;
+	}
+
+	resok->osr_count = atomic_fetch_uint64_t(&job->copied);
+	if (job->done) {
+		resok->osr_complete_len = 1;
+		resok->osr_complete = job->status;
+		forget = !job->cb_pending;
+		if (forget)
+			glist_del(&job->list);
+	} else {
+		resok->osr_complete_len = 0;
+	}
+
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	if (forget)
+		copy_job_free(job);
+
+	res_STATUS->osr_status = NFS4_OK;
+	return res_STATUS->osr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_STATUS result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief The NFS4_OP_OFFLOAD_CANCEL operation
+ *
+ * This functions handles the NFS4_OP_OFFLOAD_CANCEL operation in
+ * NFSv4.2. This function can be called only from nfs4_Compound.  A
+ * running copy stops at its next chunk and sends no CB_OFFLOAD.
+ *
+ * @param[in]     op    Arguments for nfs4_op
+ * @param[in,out] data  Compound request's data
+ * @param[out]    resp  Results for nfs4_op
+ *
+ * @return per RFC7862, p. 66
+ */
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *op, compound_data_t *data,
+			   struct nfs_resop4 *resp)
+{
+	OFFLOAD_CANCEL4args * const arg_CANCEL =
+		&op->nfs_argop4_u.opoffload_cancel;
+	OFFLOAD_CANCEL4res * const res_CANCEL =
+		&resp->nfs_resop4_u.opoffload_cancel;
+	struct copy_job *job;
+	bool forget = false;
+
+	resp->resop = NFS4_OP_OFFLOAD_CANCEL;
+
+	if (data->minorversion < 2) {
+		res_CANCEL->ocr_status = NFS4ERR_NOTSUPP;
+		return res_CANCEL->ocr_status;
+	}
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+
+	job = copy_job_lookup(data->session->clientid_record,
+			      &arg_CANCEL->oca_stateid);
+
+	if (job == NULL) {
+		PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+		res_CANCEL->ocr_status = NFS4ERR_BAD_STATEID;
+		return res_CANCEL->ocr_status;
+	}
+
+	job->cancelled = true;
+	forget = job->done && !job->cb_pending;
+	if (forget)
+		glist_del(&job->list);
+
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	if (forget)
+		copy_job_free(job);
+
+	res_CANCEL->ocr_status = NFS4_OK;
+	return res_CANCEL->ocr_status;
+}
+
+/**
+ * @brief Free memory allocated for OFFLOAD_CANCEL result
+ *
+ * @param[in,out] resp nfs4_op results
+ */
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp)
+{
+	/* Nothing to be done */
+}
+
+/**
+ * @brief Start the thread fridge running asynchronous copies
+ *
+ * @return 0 on success, errno otherwise.
+ */
+
+int nfs4_copy_pkginit(void)
+{
+	struct fridgethr_params frp;
+	int rc;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 4;
+	frp.deferment = fridgethr_defer_queue;
+
+	rc = fridgethr_init(&copy_fridge, "Copy", &frp);
+
+	if (rc != 0)
+		LogMajor(COMPONENT_NFS_V4,
+			 "Unable to initialize copy thread fridge: %d", rc);
+
+	return rc;
+}
+
+/**
+ * @brief Stop the asynchronous copies
+ *
+ * Running copies are cancelled and finish their current chunk.
+ *
+ * @return 0 on success, errno otherwise.
+ */
+
+int nfs4_copy_pkgshutdown(void)
+{
+	struct glist_head *glist, *glistn;
+	struct copy_job *job;
+	int rc;
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	glist_for_each(glist, &copy_jobs) {
+		job = glist_entry(glist, struct copy_job, list);
+		job->cancelled = true;
+	}
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	rc = fridgethr_sync_command(copy_fridge, fridgethr_comm_stop, 120);
+
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(copy_fridge);
+		return rc;
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_NFS_V4,
+			 "Failed shutting down copy threads: %d", rc);
+		return rc;
+	}
+
+	PTHREAD_MUTEX_lock(&copy_jobs_mutex);
+	glist_for_each_safe(glist, glistn, &copy_jobs) {
+		job = glist_entry(glist, struct copy_job, list);
+		if (job->cb_pending)
+			continue;
+		glist_del(&job->list);
+		copy_job_free(job);
+	}
+	PTHREAD_MUTEX_unlock(&copy_jobs_mutex);
+
+	return 0;
+}
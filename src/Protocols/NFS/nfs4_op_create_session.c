@@ -86,7 +86,7 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	struct display_buffer dspbuf_clientid4 = {
 		sizeof(str_clientid4), str_clientid4, str_clientid4};
 	/* Return code from clientid calls */
-	int i, rc = 0;
+	int rc = 0;
 	/* Component for logging */
 	log_components_t component = COMPONENT_CLIENTID;
 	/* Abbreviated alias for arguments */
@@ -196,7 +196,8 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		 */
 		if ((arg_CREATE_SESSION4->csa_sequence + 1 ==
 		     found->cid_create_session_sequence)
-		    && (found->cid_create_session_slot.cache_used)) {
+		    && (found->cid_create_session_slot.cache_used)
+		    && (found->cid_create_session_slot.cached_result.buf)) {
 			data->use_drc = true;
 			data->cached_res =
 			    &found->cid_create_session_slot.cached_result;
@@ -324,8 +325,19 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 	nfs41_session->cb_program = 0;
 	PTHREAD_MUTEX_init(&nfs41_session->cb_mutex, NULL);
 	PTHREAD_COND_init(&nfs41_session->cb_cond, NULL);
-	for (i = 0; i < NFS41_NB_SLOTS; i++)
-		PTHREAD_MUTEX_init(&nfs41_session->slots[i].lock, NULL);
+
+	/* As many slots as the client asks for, within
+	 * Max_Session_Slots, allocated as they get used.
+	 */
+	nfs41_session->fore_channel_attrs.ca_maxrequests =
+		MAX(1, MIN(nfs41_session->fore_channel_attrs.ca_maxrequests,
+			   nfs_param.nfsv4_param.max_session_slots));
+	nfs41_session->slots =
+		gsh_calloc(nfs41_session->fore_channel_attrs.ca_maxrequests,
+			   sizeof(*nfs41_session->slots));
+	nfs41_session->back_channel_attrs.ca_maxrequests =
+		MIN(nfs41_session->back_channel_attrs.ca_maxrequests,
+		    NFS41_MAX_CB_SLOTS);
 
 	/* Take reference to clientid record on behalf the session. */
 	inc_client_id_ref(found);
@@ -336,8 +348,6 @@ int nfs4_op_create_session(struct nfs_argop4 *op, compound_data_t *data,
 		  &nfs41_session->session_link);
 	PTHREAD_MUTEX_unlock(&found->cid_mutex);
 
-	/* Set ca_maxrequests */
-	nfs41_session->fore_channel_attrs.ca_maxrequests = NFS41_NB_SLOTS;
 	nfs41_Build_sessionid(&clientid, nfs41_session->session_id);
 
 	res_CREATE_SESSION4ok->csr_sequence = arg_CREATE_SESSION4->csa_sequence;
@@ -173,6 +173,14 @@ int nfs4_op_exchange_id(struct nfs_argop4 *op, compound_data_t *data,
 
 	PTHREAD_MUTEX_lock(&client_record->cr_mutex);
 
+	/* An expired clientid of this client still has state being
+	 * released, the client would meet it reclaiming.
+	 */
+	if (atomic_fetch_int32_t(&client_record->cr_expiring) != 0) {
+		res_EXCHANGE_ID4->eir_status = NFS4ERR_DELAY;
+		goto out;
+	}
+
 	conf = client_record->cr_confirmed_rec;
 
 	if (conf != NULL) {
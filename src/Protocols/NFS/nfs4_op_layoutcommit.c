@@ -84,6 +84,8 @@ int nfs4_op_layoutcommit(struct nfs_argop4 *op, compound_data_t *data,
 	XDR lou_body;
 	/* The beginning of the stream */
 	unsigned int beginning = 0;
+	/* Whether the client holds a RW segment */
+	bool have_rw = false;
 
 	resp->resop = NFS4_OP_LAYOUTCOMMIT;
 
@@ -150,6 +152,21 @@ int nfs4_op_layoutcommit(struct nfs_argop4 *op, compound_data_t *data,
 		segment = glist_entry(glist,
 				      state_layout_segment_t,
 				      sls_state_segments);
+		if (segment->sls_segment.io_mode == LAYOUTIOMODE4_RW) {
+			have_rw = true;
+			break;
+		}
+	}
+
+	glist_for_each(glist, &layout_state->state_data.layout.state_segments) {
+		segment = glist_entry(glist,
+				      state_layout_segment_t,
+				      sls_state_segments);
+
+		/* Nothing was written through READ segments */
+		if (have_rw &&
+		    segment->sls_segment.io_mode == LAYOUTIOMODE4_READ)
+			continue;
 
 		arg.segment = segment->sls_segment;
 		arg.fsal_seg_data = segment->sls_fsal_data;
@@ -45,6 +45,7 @@
 #include "fsal.h"
 #include "fsal_api.h"
 #include "fsal_pnfs.h"
+#include "pnfs_utils.h"
 #include "sal_data.h"
 #include "sal_functions.h"
 
@@ -263,6 +264,8 @@ static nfsstat4 one_segment(struct fsal_obj_handle *obj,
 	nfsstat4 nfs_status = 0;
 	/* Return from state calls */
 	state_status_t state_status = 0;
+	/* The encoded loc_body, kept with the segment */
+	struct gsh_buffdesc body;
 	/* Size of a loc_body buffer */
 	size_t loc_body_size = MIN(
 	    op_ctx->fsal_export->exp_ops.fs_loc_body_size(op_ctx->fsal_export),
@@ -305,10 +308,14 @@ static nfsstat4 one_segment(struct fsal_obj_handle *obj,
 	current->lo_length = res->segment.length;
 	current->lo_iomode = res->segment.io_mode;
 
+	body.addr = current->lo_content.loc_body.loc_body_val;
+	body.len = current->lo_content.loc_body.loc_body_len;
+
 	state_status = state_add_segment(layout_state,
 					 &res->segment,
 					 res->fsal_seg_data,
-					 res->return_on_close);
+					 res->return_on_close,
+					 &body);
 
 	if (state_status != STATE_SUCCESS) {
 		nfs_status = nfs4_Errno_state(state_status);
@@ -332,6 +339,75 @@ static nfsstat4 one_segment(struct fsal_obj_handle *obj,
 	return nfs_status;
 }
 
+/**
+ *
+ * @brief Grant again a segment the client already holds
+ *
+ * Clients ask again and again for small ranges of a file they hold a
+ * layout on.  The layout the FSAL encoded for a segment is kept with
+ * it, so a request the segment covers is answered from there.
+ *
+ * @param[in]  obj          File handle
+ * @param[in]  layout_state The layout state
+ * @param[in]  args         Arguments of LAYOUTGET
+ * @param[out] current      The layout to fill
+ *
+ * @return true if a segment covers the request and was copied.
+ */
+
+static bool cached_segment(struct fsal_obj_handle *obj,
+			   state_t *layout_state,
+			   const LAYOUTGET4args *args, layout4 *current)
+{
+	struct glist_head *glist;
+	state_layout_segment_t *segment;
+	struct pnfs_segment *seg;
+	bool found = false;
+
+	/* A request to the end of file wants a segment to the end */
+	uint64_t end = args->loga_length == NFS4_UINT64_MAX ||
+		       args->loga_length > NFS4_UINT64_MAX - args->loga_offset
+			? NFS4_UINT64_MAX
+			: args->loga_offset + args->loga_length;
+
+	PTHREAD_RWLOCK_rdlock(&obj->state_hdl->state_lock);
+
+	glist_for_each(glist, &layout_state->state_data.layout.state_segments) {
+		segment = glist_entry(glist, state_layout_segment_t,
+				      sls_state_segments);
+		seg = &segment->sls_segment;
+
+		if (segment->sls_body == NULL ||
+		    segment->sls_body_len > args->loga_maxcount ||
+		    (args->loga_iomode == LAYOUTIOMODE4_RW &&
+		     seg->io_mode != LAYOUTIOMODE4_RW) ||
+		    seg->offset > args->loga_offset)
+			continue;
+
+		if (seg->length != NFS4_UINT64_MAX &&
+		    (end == NFS4_UINT64_MAX ||
+		     seg->offset + seg->length < end))
+			continue;
+
+		current->lo_offset = seg->offset;
+		current->lo_length = seg->length;
+		current->lo_iomode = seg->io_mode;
+		current->lo_content.loc_type = args->loga_layout_type;
+		current->lo_content.loc_body.loc_body_len =
+			segment->sls_body_len;
+		current->lo_content.loc_body.loc_body_val =
+			gsh_malloc(segment->sls_body_len);
+		memcpy(current->lo_content.loc_body.loc_body_val,
+		       segment->sls_body, segment->sls_body_len);
+		found = true;
+		break;
+	}
+
+	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
+
+	return found;
+}
+
 /**
  * @brief The NFS4_OP_LAYOUTGET operation
  *
@@ -370,6 +446,8 @@ int nfs4_op_layoutget(struct nfs_argop4 *op, compound_data_t *data,
 	/* Maximum number of segments this FSAL will ever return for a
 	   single LAYOUTGET */
 	int max_segment_count = 0;
+	/* Length asked of the FSAL */
+	length4 length = arg_LAYOUTGET4->loga_length;
 
 	resp->resop = NFS4_OP_LAYOUTGET;
 
@@ -415,6 +493,27 @@ int nfs4_op_layoutget(struct nfs_argop4 *op, compound_data_t *data,
 	 */
 	layouts = gsh_calloc(max_segment_count, sizeof(layout4));
 
+	if (cached_segment(data->current_obj, layout_state, arg_LAYOUTGET4,
+			   layouts)) {
+		LogFullDebug(COMPONENT_PNFS,
+			     "LAYOUTGET %"PRIu64"~%"PRIu64
+			     " granted from a held segment",
+			     arg_LAYOUTGET4->loga_offset,
+			     arg_LAYOUTGET4->loga_length);
+		numlayouts = 1;
+		goto granted;
+	}
+
+	/* A request from where the last one ended is likely the next of
+	 * a sequential writer (or reader), ask the FSAL for the rest of
+	 * the file instead of another piece of it.
+	 */
+	if (nfs_param.nfsv4_param.layout_sequential_whole_file &&
+	    arg_LAYOUTGET4->loga_offset != 0 &&
+	    arg_LAYOUTGET4->loga_offset ==
+			layout_state->state_data.layout.sequential_end)
+		length = NFS4_UINT64_MAX;
+
 	arg.type = arg_LAYOUTGET4->loga_layout_type;
 	arg.minlength = arg_LAYOUTGET4->loga_minlength;
 	arg.export_id = op_ctx->ctx_export->export_id;
@@ -436,7 +535,7 @@ int nfs4_op_layoutget(struct nfs_argop4 *op, compound_data_t *data,
 		   arguments */
 		res.segment.io_mode = arg_LAYOUTGET4->loga_iomode;
 		res.segment.offset = arg_LAYOUTGET4->loga_offset;
-		res.segment.length = arg_LAYOUTGET4->loga_length;
+		res.segment.length = length;
 
 		/* Clear anything from a previous segment */
 		res.fsal_seg_data = NULL;
@@ -460,6 +559,13 @@ int nfs4_op_layoutget(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	} while (!res.last_segment);
 
+	layout_state->state_data.layout.sequential_end =
+		res.segment.length == NFS4_UINT64_MAX ||
+		res.segment.length > NFS4_UINT64_MAX - res.segment.offset
+			? NFS4_UINT64_MAX
+			: res.segment.offset + res.segment.length;
+
+ granted:
 	/* Update stateid.seqid and copy to current */
 	update_stateid(layout_state,
 		       &res_LAYOUTGET4->LAYOUTGET4res_u.logr_resok4.
@@ -562,12 +668,12 @@ int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 	/* NFSv4.2 status code */
 	nfsstat4 nfs_status = 0;
 
-	LogEvent(COMPONENT_PNFS,
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTSTATS offset %" PRIu64 " length %" PRIu64,
 		 arg_LAYOUTSTATS4->lsa_offset,
 		 arg_LAYOUTSTATS4->lsa_length);
 
-	LogEvent(COMPONENT_PNFS,
+	LogDebug(COMPONENT_PNFS,
 		 "LAYOUTSTATS read count %u bytes %" PRIu64
 		 " write count %u bytes %" PRIu64,
 		 arg_LAYOUTSTATS4->lsa_read.ii_count,
@@ -575,7 +681,9 @@ int nfs4_op_layoutstats(struct nfs_argop4 *op, compound_data_t *data,
 		 arg_LAYOUTSTATS4->lsa_write.ii_count,
 		 arg_LAYOUTSTATS4->lsa_write.ii_bytes);
 
-	/** @todo: what else do we want to do with the stats ???  */
+	/* Flexfiles clients report on each data server they use */
+	if (arg_LAYOUTSTATS4->lsa_layoutupdate.lou_type == LAYOUT4_FLEX_FILES)
+		nfs_status = pnfs_ff_layoutstats(arg_LAYOUTSTATS4);
 
 	res_LAYOUTSTATS4->lsr_status = nfs_status;
 
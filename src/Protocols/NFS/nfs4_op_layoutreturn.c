@@ -82,27 +82,12 @@ int nfs4_op_layoutreturn(struct nfs_argop4 *op, compound_data_t *data,
 	bool deleted = false;
 	/* State specified in the case of LAYOUTRETURN4_FILE */
 	state_t *layout_state = NULL;
-	/* State owner associated with this clientid, for bulk returns */
-	state_owner_t *clientid_owner = NULL;
-	/* Linked list node for iteration */
-	struct glist_head *glist = NULL;
-	/* Saved next node for safe iteration */
-	struct glist_head *glistn = NULL;
 	/* Tag to identify caller in tate log messages */
 	const char *tag = "LAYOUTRETURN";
 	/* Segment selecting which segments to return. */
 	struct pnfs_segment spec = { 0, 0, 0 };
 	/* Remember if we need to do fsid based return */
 	bool return_fsid = false;
-	/* Referenced file */
-	struct fsal_obj_handle *obj = NULL;
-	/* Referenced export */
-	struct gsh_export *export = NULL;
-	/* Root op context for returning fsid or all layouts */
-	struct root_op_context root_op_context;
-	/* Keep track of so_mutex */
-	bool so_mutex_locked = false;
-	state_t *first;
 
 	resp->resop = NFS4_OP_LAYOUTRETURN;
 
@@ -210,134 +195,14 @@ int nfs4_op_layoutreturn(struct nfs_argop4 *op, compound_data_t *data,
 		spec.offset = 0;
 		spec.length = NFS4_UINT64_MAX;
 
-		clientid_owner = &data->session->clientid_record->cid_owner;
-
-		/* Initialize req_ctx */
-		init_root_op_context(&root_op_context, NULL, NULL,
-				     0, 0, UNKNOWN_REQUEST);
-
-		/* We need the safe version because return_one_state
-		 * can delete the current state.
-		 *
-		 * Since we can not hold so_mutex (which protects the list)
-		 * the entire time, we will have to restart here after
-		 * dropping the mutex.
-		 *
-		 * Since we push each entry to the end of the list, we will
-		 * not need to continually examine entries that need to be
-		 * skipped, except for one final pass.
-		 *
-		 * An example flow might be:
-		 * skip 1
-		 * skip 2
-		 * do some work on 3
-		 * restart
-		 * skip 4
-		 * do some work on 5
-		 * restart
-		 * skip 1
-		 * skip 2
-		 * skip 4
-		 * done
-		 */
-
- again:
-
-		PTHREAD_MUTEX_lock(&clientid_owner->so_mutex);
-		so_mutex_locked = true;
-		first = NULL;
-
-		glist_for_each_safe(glist, glistn,
-				    &clientid_owner->so_owner.so_nfs4_owner.
-				     so_state_list) {
-			layout_state = glist_entry(glist,
-						   state_t,
-						   state_owner_list);
-			if (first == NULL)
-				first = layout_state;
-			else if (first == layout_state)
-				break;
-
-			/* Move to end of list in case of error to ease
-			 * retries and push off dealing with non-layout
-			 * states (which should only be delegations).
-			 */
-			glist_del(&layout_state->state_owner_list);
-			glist_add_tail(&clientid_owner->
-					   so_owner.so_nfs4_owner.so_state_list,
-				       &layout_state->state_owner_list);
-
-			if (layout_state->state_type != STATE_TYPE_LAYOUT)
-				continue;
-
-			if (!get_state_obj_export_owner_refs(layout_state, &obj,
-							     &export, NULL)) {
-				/* This state is associated with a file or
-				 * export that is going stale, skip it (it
-				 * will be cleaned up as part of the stale
-				 * entry or export processing. */
-				continue;
-			}
-
-			/* Set up the root op context for this state */
-			root_op_context.req_ctx.clientid =
-			    &clientid_owner->so_owner.so_nfs4_owner.so_clientid;
-			root_op_context.req_ctx.ctx_export = export;
-			root_op_context.req_ctx.fsal_export =
-							export->fsal_export;
-
-			/* Take a reference on the state_t */
-			inc_state_t_ref(layout_state);
-
-			/* Now we need to drop so_mutex to continue the
-			 * processing.
-			 */
-			PTHREAD_MUTEX_unlock(&clientid_owner->so_mutex);
-			so_mutex_locked = false;
-
-			if (return_fsid) {
-				if (!memcmp(&fsid, &data->current_obj->fsid,
-					    sizeof(fsid))) {
-					put_gsh_export(export);
-					dec_state_t_ref(layout_state);
-
-					/* Since we had to drop so_mutex, the
-					 * list may have changed under us, we
-					 * MUST start over.
-					 */
-					goto again;
-				}
-			}
-
-			PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
-
-			res_LAYOUTRETURN4->lorr_status = nfs4_return_one_state(
-			    obj,
-			    arg_LAYOUTRETURN4->lora_layoutreturn.lr_returntype,
-			    arg_LAYOUTRETURN4->lora_reclaim ?
-				circumstance_reclaim : circumstance_client,
-			    layout_state,
-			    spec,
-			    0,
-			    NULL,
-			    &deleted);
-
-			PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
-
-			/* Release the state_t reference */
-			dec_state_t_ref(layout_state);
-
-			if (res_LAYOUTRETURN4->lorr_status != NFS4_OK)
-				break;
-
-			/* Since we had to drop so_mutex, the list may have
-			 * changed under us, we MUST start over.
-			 */
-			goto again;
-		}
-
-		if (so_mutex_locked)
-			PTHREAD_MUTEX_lock(&clientid_owner->so_mutex);
+		res_LAYOUTRETURN4->lorr_status = return_owner_layouts(
+		    &data->session->clientid_record->cid_owner,
+		    arg_LAYOUTRETURN4->lora_layout_type,
+		    return_fsid ? &fsid : NULL,
+		    spec,
+		    arg_LAYOUTRETURN4->lora_layoutreturn.lr_returntype,
+		    arg_LAYOUTRETURN4->lora_reclaim ?
+			circumstance_reclaim : circumstance_client);
 
 		/* Poison the current stateid */
 		data->current_stateid_valid = false;
@@ -350,26 +215,6 @@ int nfs4_op_layoutreturn(struct nfs_argop4 *op, compound_data_t *data,
 		res_LAYOUTRETURN4->lorr_status = NFS4ERR_INVAL;
 	}
 
-	if (arg_LAYOUTRETURN4->lora_layoutreturn.lr_returntype ==
-							LAYOUTRETURN4_FSID
-	    ||
-	    arg_LAYOUTRETURN4->lora_layoutreturn.lr_returntype ==
-							LAYOUTRETURN4_ALL
-	    ) {
-		/* Release the root op context we setup above */
-		release_root_op_context();
-	}
-
-	if (obj != NULL) {
-		/* Release object ref */
-		obj->obj_ops.put_ref(obj);
-	}
-
-	if (export != NULL) {
-		/* Release the export */
-		put_gsh_export(export);
-	}
-
 	return res_LAYOUTRETURN4->lorr_status;
 }				/* nfs41_op_layoutreturn */
 
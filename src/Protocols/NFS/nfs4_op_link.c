@@ -92,9 +92,10 @@ int nfs4_op_link(struct nfs_argop4 *op, compound_data_t *data,
 	 */
 
 	/* Validate and convert the UFT8 objname to a regular string */
-	res_LINK4->status = nfs4_utf8string2dynamic(&arg_LINK4->newname,
-						    UTF8_SCAN_ALL,
-						    &newname);
+	res_LINK4->status = nfs4_utf8string2arena(nfs_req_arena(data->req),
+						  &arg_LINK4->newname,
+						  UTF8_SCAN_ALL,
+						  &newname);
 
 	if (res_LINK4->status != NFS4_OK)
 		goto out;
@@ -120,9 +121,6 @@ int nfs4_op_link(struct nfs_argop4 *op, compound_data_t *data,
 
  out:
 
-	if (newname)
-		gsh_free(newname);
-
 	return res_LINK4->status;
 }				/* nfs4_op_link */
 
@@ -88,9 +88,10 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 	}
 
 	/* Validate and convert the UFT8 objname to a regular string */
-	res_LOOKUP4->status = nfs4_utf8string2dynamic(&arg_LOOKUP4->objname,
-						      UTF8_SCAN_ALL,
-						      &name);
+	res_LOOKUP4->status = nfs4_utf8string2arena(nfs_req_arena(data->req),
+						    &arg_LOOKUP4->objname,
+						    UTF8_SCAN_ALL,
+						    &name);
 
 	if (res_LOOKUP4->status != NFS4_OK)
 		goto out;
@@ -231,8 +232,6 @@ int nfs4_op_lookup(struct nfs_argop4 *op, compound_data_t *data,
 	if (file_obj)
 		file_obj->obj_ops.put_ref(file_obj);
 
-	gsh_free(name);
-
 	return res_LOOKUP4->status;
 }				/* nfs4_op_lookup */
 
@@ -1047,6 +1047,8 @@ static void do_delegation(OPEN4args *arg_OPEN4, OPEN4res *res_OPEN4,
 	/* This will be updated later if we actually delegate */
 	resok->delegation.delegation_type = OPEN_DELEGATE_NONE;
 
+	deleg_heuristics_open(ostate, clientid, arg_OPEN4->share_access);
+
 	/* Client doesn't want a delegation. */
 	if (arg_OPEN4->share_access & OPEN4_SHARE_ACCESS_WANT_NO_DELEG) {
 		resok->delegation.open_delegation4_u.
@@ -1842,6 +1844,12 @@ int nfs4_op_open(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
+	/* Nothing writes an immutable export, so nothing needs denying;
+	 * its anonymous READs then need not check shares either.
+	 */
+	if (op_ctx_export_has_option(EXPORT_OPTION_IMMUTABLE))
+		arg_OPEN4->share_deny = OPEN4_SHARE_DENY_NONE;
+
 	if (data->current_obj->fsal->m_ops.support_ex(data->current_obj)) {
 		/* Utilize the extended FSAL APU functionality to
 		 * perform the open.
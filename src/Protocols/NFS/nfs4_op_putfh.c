@@ -57,6 +57,22 @@ static int nfs4_ds_putfh(compound_data_t *data)
 	LogFullDebug(COMPONENT_FILEHANDLE, "NFS4 Handle 0x%X export id %d",
 		v4_handle->fhflags1, ntohs(v4_handle->id.exports));
 
+	fh_desc.len = v4_handle->fs_len;
+	fh_desc.addr = &v4_handle->fsopaque;
+
+	/* Same server as the previous PUTFH of the compound: keep its
+	 * references, its permissions were checked then.
+	 */
+	pds = op_ctx->fsal_pnfs_ds;
+	if (pds != NULL && pds->id_servers == ntohs(v4_handle->id.servers)
+	    && op_ctx->ctx_export == pds->mds_export
+	    && pds->pnfs_ds_status == PNFS_DS_READY) {
+		set_current_entry(data, NULL);
+		data->current_filetype = REGULAR_FILE;
+		return pnfs_ds_handle(pds, &fh_desc, v4_handle->fhflags1,
+				      &data->current_ds);
+	}
+
 	/* Find any existing server by the "id" from the handle,
 	 * before releasing the old DS (to prevent thrashing).
 	 */
@@ -117,16 +133,13 @@ static int nfs4_ds_putfh(compound_data_t *data)
 			return status;
 	}
 
-	fh_desc.len = v4_handle->fs_len;
-	fh_desc.addr = &v4_handle->fsopaque;
-
 	/* Leave the current_entry as NULL, but indicate a
 	 * regular file.
 	 */
 	data->current_filetype = REGULAR_FILE;
 
-	return pds->s_ops.make_ds_handle(pds, &fh_desc, &data->current_ds,
-					 v4_handle->fhflags1);
+	return pnfs_ds_handle(pds, &fh_desc, v4_handle->fhflags1,
+			      &data->current_ds);
 }
 
 static int nfs4_mds_putfh(compound_data_t *data)
@@ -146,10 +159,21 @@ static int nfs4_mds_putfh(compound_data_t *data)
 	LogFullDebugOpaque(COMPONENT_FILEHANDLE, "NFS4 FSAL Handle %s",
 			   LEN_FH_STR, v4_handle->fsopaque, v4_handle->fs_len);
 
+	/* The compound mostly stays in the export, keep its reference */
+	if (op_ctx->ctx_export != NULL &&
+	    op_ctx->ctx_export->export_id == ntohs(v4_handle->id.exports) &&
+	    export_ready(op_ctx->ctx_export) &&
+	    op_ctx->fsal_pnfs_ds == NULL) {
+		exporting = op_ctx->ctx_export;
+		changed = false;
+		goto same_export;
+	}
+
 	/* Find any existing export by the "id" from the handle,
 	 * before releasing the old export (to prevent thrashing).
 	 */
-	exporting = get_gsh_export(ntohs(v4_handle->id.exports));
+	exporting = export_perms_cache_export(op_ctx->perms_cache,
+					      ntohs(v4_handle->id.exports));
 	if (exporting == NULL) {
 		LogInfoAlt(COMPONENT_DISPATCH, COMPONENT_EXPORT,
 			   "NFS4 Request from client (%s) has invalid export identifier %d",
@@ -174,6 +198,7 @@ static int nfs4_mds_putfh(compound_data_t *data)
 		op_ctx->fsal_pnfs_ds = NULL;
 	}
 
+ same_export:
 	/* Clear out current entry for now */
 	set_current_entry(data, NULL);
 
@@ -262,10 +287,6 @@ int nfs4_op_putfh(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_PUTFH4->status != NFS4_OK)
 		return res_PUTFH4->status;
 
-	/* If no currentFH were set, allocate one */
-	if (data->currentFH.nfs_fh4_val == NULL)
-		nfs4_AllocateFH(&data->currentFH);
-
 	/* Copy the filehandle from the arg structure */
 	data->currentFH.nfs_fh4_len = arg_PUTFH4->object.nfs_fh4_len;
 	memcpy(data->currentFH.nfs_fh4_val, arg_PUTFH4->object.nfs_fh4_val,
@@ -130,7 +130,7 @@ int nfs4_op_putrootfh(struct nfs_argop4 *op, compound_data_t *data,
 	file_obj->obj_ops.put_ref(file_obj);
 
 	/* Convert it to a file handle */
-	if (!nfs4_FSALToFhandle(data->currentFH.nfs_fh4_val == NULL,
+	if (!nfs4_FSALToFhandle(false,
 				&data->currentFH,
 				data->current_obj,
 				op_ctx->ctx_export)) {
@@ -47,6 +47,304 @@
 #include "fsal_pnfs.h"
 #include "server_stats.h"
 #include "export_mgr.h"
+#include "io_bufpool.h"
+
+/** Most segments in one READ_PLUS reply */
+#define READ_PLUS_MAX_SEGMENTS 64
+
+/** Size and alignment of the blocks the zero detector looks at */
+#define READ_PLUS_ZERO_BLOCK 4096
+
+/**
+ * @brief READ_PLUS reply being built
+ *
+ * Data segments are packed one after the other from the start of the
+ * read buffer, so the first data segment owns the buffer.
+ */
+struct read_plus_segs {
+	contents *segs;		/*< Segments, READ_PLUS_MAX_SEGMENTS of them */
+	count4 count;		/*< Segments used */
+	char *buf;		/*< Read buffer */
+	size_t used;		/*< Bytes of buf holding data segments */
+	uint64_t holes;		/*< Bytes of holes found with seek2 */
+	uint64_t zeroes;	/*< Bytes of zero blocks found in the data */
+};
+
+/**
+ * @brief Build a one segment READ_PLUS reply from an io_info
+ *
+ * For FSALs answering READ_PLUS themselves in io_info.
+ *
+ * @param[out] rplus  READ_PLUS reply
+ * @param[in]  info   What the FSAL returned
+ * @param[in]  buffer Read buffer, freed if the segment is a hole
+ * @param[in]  eof    Whether the end of file was reached
+ */
+static void nfs4_read_plus_from_info(read_plus_res4 *rplus,
+				     struct io_info *info, void *buffer,
+				     bool eof)
+{
+	contents *contentp = gsh_malloc(sizeof(*contentp));
+
+	*contentp = info->io_content;
+	if (contentp->what == NFS4_CONTENT_HOLE)
+		io_buf_free(buffer);
+
+	rplus->rpr_contents = contentp;
+	rplus->rpr_contents_count = 1;
+	rplus->rpr_eof = eof;
+}
+
+/**
+ * @brief Add a hole to a READ_PLUS reply
+ *
+ * @param[in,out] rp     Reply being built
+ * @param[in]     offset Start of the hole
+ * @param[in]     length Length of the hole
+ *
+ * @return false if the reply has no room left.
+ */
+static bool read_plus_add_hole(struct read_plus_segs *rp, uint64_t offset,
+			       uint64_t length)
+{
+	contents *last = rp->count ? &rp->segs[rp->count - 1] : NULL;
+
+	if (last != NULL && last->what == NFS4_CONTENT_HOLE &&
+	    last->hole.di_offset + last->hole.di_length == offset) {
+		last->hole.di_length += length;
+		return true;
+	}
+
+	if (rp->count == READ_PLUS_MAX_SEGMENTS)
+		return false;
+
+	last = &rp->segs[rp->count++];
+	last->what = NFS4_CONTENT_HOLE;
+	last->hole.di_offset = offset;
+	last->hole.di_length = length;
+
+	return true;
+}
+
+/**
+ * @brief Add data to a READ_PLUS reply
+ *
+ * The data must already be at buf + used.
+ *
+ * @param[in,out] rp     Reply being built
+ * @param[in]     offset File offset of the data
+ * @param[in]     length Length of the data
+ *
+ * @return false if the reply has no room left.
+ */
+static bool read_plus_add_data(struct read_plus_segs *rp, uint64_t offset,
+			       size_t length)
+{
+	contents *last = rp->count ? &rp->segs[rp->count - 1] : NULL;
+
+	if (last != NULL && last->what == NFS4_CONTENT_DATA &&
+	    last->data.d_offset + last->data.d_data.data_len == offset) {
+		last->data.d_data.data_len += length;
+		rp->used += length;
+		return true;
+	}
+
+	if (rp->count == READ_PLUS_MAX_SEGMENTS)
+		return false;
+
+	last = &rp->segs[rp->count++];
+	last->what = NFS4_CONTENT_DATA;
+	last->data.d_offset = offset;
+	last->data.d_data.data_len = length;
+	last->data.d_data.data_val = rp->buf + rp->used;
+	rp->used += length;
+
+	return true;
+}
+
+/**
+ * @brief Whether a block is all zeroes
+ */
+static inline bool read_plus_is_zero(const char *p, size_t len)
+{
+	return p[0] == 0 && memcmp(p, p + 1, len - 1) == 0;
+}
+
+/**
+ * @brief Add data just read to a READ_PLUS reply
+ *
+ * The data is at buf + used.  With @a detect, aligned blocks of zeroes
+ * become holes and the rest is packed down over them.
+ *
+ * @param[in,out] rp     Reply being built
+ * @param[in]     offset File offset of the data
+ * @param[in]     length Length of the data
+ * @param[in]     detect Whether to look for blocks of zeroes
+ *
+ * @return Bytes added to the reply, short if it ran out of room.
+ */
+static size_t read_plus_add_read(struct read_plus_segs *rp, uint64_t offset,
+				 size_t length, bool detect)
+{
+	char *p = rp->buf + rp->used;
+	size_t done = 0;
+	size_t blk;
+
+	if (!detect)
+		return read_plus_add_data(rp, offset, length) ? length : 0;
+
+	while (done < length) {
+		blk = READ_PLUS_ZERO_BLOCK -
+		      (offset + done) % READ_PLUS_ZERO_BLOCK;
+		if (blk > length - done)
+			blk = length - done;
+
+		if (blk == READ_PLUS_ZERO_BLOCK &&
+		    read_plus_is_zero(p + done, blk)) {
+			if (!read_plus_add_hole(rp, offset + done, blk))
+				break;
+			rp->zeroes += blk;
+		} else {
+			/* Pack the data down over any zeroes skipped */
+			if (rp->buf + rp->used != p + done)
+				memmove(rp->buf + rp->used, p + done, blk);
+			if (!read_plus_add_data(rp, offset + done, blk))
+				break;
+		}
+
+		done += blk;
+	}
+
+	return done;
+}
+
+/**
+ * @brief Read a range as data and hole segments
+ *
+ * Holes are found with the FSAL's seek2 and not read.  When the FSAL
+ * cannot seek holes the whole range is read, and with
+ * Read_Plus_Zero_Detect its blocks of zeroes are reported as holes.
+ * The reply may stop short of the range if it runs out of segments.
+ *
+ * @param[in]     obj    File to read
+ * @param[in]     bypass Whether to bypass deny read
+ * @param[in]     state  State to read with
+ * @param[in]     offset Start of the range
+ * @param[in]     size   Length of the range
+ * @param[in,out] rp     Reply being built
+ * @param[out]    eof    Whether the reply reaches the end of file
+ *
+ * @return FSAL status.
+ */
+static fsal_status_t nfs4_read_plus_sparse(struct fsal_obj_handle *obj,
+					   bool bypass, state_t *state,
+					   uint64_t offset, uint64_t size,
+					   struct read_plus_segs *rp,
+					   bool *eof)
+{
+	fsal_status_t status;
+	struct attrlist attrs;
+	struct io_info info;
+	uint64_t filesize, end, pos, data_start, data_end;
+	size_t read_size, requested, added;
+	bool seek = true;
+	bool eof_met;
+	bool detect = nfs_param.nfsv4_param.read_plus_zero_detect;
+
+	fsal_prepare_attrs(&attrs, ATTR_SIZE);
+	status = obj->obj_ops.getattrs(obj, &attrs);
+	filesize = attrs.filesize;
+	fsal_release_attrs(&attrs);
+
+	if (FSAL_IS_ERROR(status))
+		return status;
+
+	end = offset + size;
+	if (end > filesize || end < offset)
+		end = filesize;
+
+	pos = offset;
+
+	while (pos < end) {
+		data_start = pos;
+		data_end = end;
+
+		if (seek) {
+			memset(&info, 0, sizeof(info));
+			info.io_content.what = NFS4_CONTENT_DATA;
+			info.io_content.hole.di_offset = pos;
+			status = obj->obj_ops.seek2(obj, state, &info);
+
+			if (status.major == ERR_FSAL_NXIO) {
+				/* Nothing but a hole up to the end */
+				data_start = end;
+			} else if (FSAL_IS_ERROR(status)) {
+				/* Read everything from here on */
+				seek = false;
+			} else if (info.io_content.hole.di_offset < end) {
+				data_start = info.io_content.hole.di_offset;
+			} else {
+				data_start = end;
+			}
+		}
+
+		if (seek && data_start < end) {
+			memset(&info, 0, sizeof(info));
+			info.io_content.what = NFS4_CONTENT_HOLE;
+			info.io_content.hole.di_offset = data_start;
+			status = obj->obj_ops.seek2(obj, state, &info);
+
+			if (!FSAL_IS_ERROR(status) &&
+			    info.io_content.hole.di_offset > data_start &&
+			    info.io_content.hole.di_offset < end)
+				data_end = info.io_content.hole.di_offset;
+		}
+
+		if (data_start > pos) {
+			if (!read_plus_add_hole(rp, pos, data_start - pos))
+				break;
+			rp->holes += data_start - pos;
+			pos = data_start;
+			continue;
+		}
+
+		requested = data_end - pos;
+		read_size = 0;
+		eof_met = false;
+		status = fsal_read2(obj, bypass, state, pos, requested,
+				    &read_size, rp->buf + rp->used, &eof_met,
+				    NULL);
+
+		if (FSAL_IS_ERROR(status)) {
+			if (rp->count == 0)
+				return status;
+			/* Return what we have so far */
+			break;
+		}
+
+		if (read_size == 0) {
+			/* The file shrank */
+			filesize = pos;
+			break;
+		}
+
+		added = read_plus_add_read(rp, pos, read_size,
+					   detect && !seek);
+		pos += added;
+
+		if (added < read_size)
+			break;
+
+		if (eof_met && read_size < requested) {
+			filesize = pos;
+			break;
+		}
+	}
+
+	*eof = pos >= filesize;
+
+	return fsalstat(ERR_FSAL_NO_ERROR, 0);
+}
 
 /**
  * @brief Read on a pNFS pNFS data server
@@ -86,7 +384,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = io_buf_alloc(arg_READ4->count);
 
 	res_READ4->READ4res_u.resok4.data.data_val = buffer;
 
@@ -101,7 +399,7 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
 				&eof);
 
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		io_buf_free(buffer);
 		res_READ4->READ4res_u.resok4.data.data_val = NULL;
 	}
 
@@ -130,11 +428,11 @@ static int op_dsread(struct nfs_argop4 *op, compound_data_t *data,
  */
 
 static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
-			 struct nfs_resop4 *resp, struct io_info *info)
+			 struct nfs_resop4 *resp, struct io_info *info,
+			 read_plus_res4 *rplus)
 {
 	READ4args * const arg_READ4 = &op->nfs_argop4_u.opread;
 	READ_PLUS4res * const res_RPLUS = &resp->nfs_resop4_u.opread_plus;
-	contents *contentp = &res_RPLUS->rpr_resok4.rpr_contents;
 	/* NFSv4 return code */
 	nfsstat4 nfs_status = 0;
 	/* Buffer into which data is to be read */
@@ -145,19 +443,15 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 	/* Don't bother calling the FSAL if the read length is 0. */
 
 	if (arg_READ4->count == 0) {
-		res_RPLUS->rpr_resok4.rpr_contents_count = 1;
-		res_RPLUS->rpr_resok4.rpr_eof = FALSE;
-		contentp->what = NFS4_CONTENT_DATA;
-		contentp->data.d_offset = arg_READ4->offset;
-		contentp->data.d_data.data_len =  0;
-		contentp->data.d_data.data_val = NULL;
+		rplus->rpr_contents_count = 0;
+		rplus->rpr_eof = FALSE;
 		res_RPLUS->rpr_status = NFS4_OK;
 		return res_RPLUS->rpr_status;
 	}
 
 	/* Construct the FSAL file handle */
 
-	buffer = gsh_malloc_aligned(4096, arg_READ4->count);
+	buffer = io_buf_alloc(arg_READ4->count);
 
 	nfs_status = data->current_ds->dsh_ops.read_plus(
 				data->current_ds,
@@ -171,32 +465,156 @@ static int op_dsread_plus(struct nfs_argop4 *op, compound_data_t *data,
 
 	res_RPLUS->rpr_status = nfs_status;
 	if (nfs_status != NFS4_OK) {
-		gsh_free(buffer);
+		io_buf_free(buffer);
 		return res_RPLUS->rpr_status;
 	}
 
-	contentp->what = info->io_content.what;
-	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
-	res_RPLUS->rpr_resok4.rpr_eof = eof;
+	nfs4_read_plus_from_info(rplus, info, buffer, eof);
+
+	return res_RPLUS->rpr_status;
+}
+
 
-	if (info->io_content.what == NFS4_CONTENT_HOLE) {
-		contentp->hole.di_offset = info->io_content.hole.di_offset;
-		contentp->hole.di_length = info->io_content.hole.di_length;
+/**
+ * @brief Fill in the READ result once the I/O is done
+ *
+ * @param[in]  obj          File read
+ * @param[out] res_READ4    READ result
+ * @param[in]  fsal_status  Result of the read
+ * @param[in]  offset       Offset of the read
+ * @param[in]  bufferdata   Read buffer, freed on error
+ * @param[in]  read_size    Amount of data read
+ * @param[in]  eof_met      Whether the FSAL reported end of file
+ */
+static void nfs4_read_io_done(struct fsal_obj_handle *obj, READ4res *res_READ4,
+			      fsal_status_t fsal_status, uint64_t offset,
+			      void *bufferdata, size_t read_size, bool eof_met)
+{
+	if (FSAL_IS_ERROR(fsal_status)) {
+		res_READ4->status = nfs4_Errno_status(fsal_status);
+		io_buf_free(bufferdata);
+		res_READ4->READ4res_u.resok4.data.data_val = NULL;
+		return;
 	}
-	if (info->io_content.what == NFS4_CONTENT_DATA) {
-		contentp->data.d_offset = info->io_content.data.d_offset;
-		contentp->data.d_data.data_len =
-					info->io_content.data.d_data.data_len;
-		contentp->data.d_data.data_val =
-					info->io_content.data.d_data.data_val;
+
+	if (!eof_met) {
+		/** @todo FSF: add a config option for this behavior?
+		 */
+		/* Need to check against filesize for ESXi clients */
+		struct attrlist attrs;
+
+		fsal_prepare_attrs(&attrs, ATTR_SIZE);
+
+		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
+			eof_met = (offset + read_size) >= attrs.filesize;
+
+		/* Done with the attrs */
+		fsal_release_attrs(&attrs);
 	}
-	return res_RPLUS->rpr_status;
+
+	res_READ4->READ4res_u.resok4.data.data_len = read_size;
+	res_READ4->READ4res_u.resok4.data.data_val = bufferdata;
+
+	LogFullDebug(COMPONENT_NFS_V4,
+		     "NFS4_OP_READ: offset = %" PRIu64
+		     " read length = %zu eof=%u", offset, read_size, eof_met);
+
+	/* Is EOF met or not ? */
+	res_READ4->READ4res_u.resok4.eof = eof_met;
+
+	/* Say it is ok */
+	res_READ4->status = NFS4_OK;
 }
 
+/**
+ * @brief State of a READ waiting on asynchronous I/O
+ */
+struct nfs4_read_data {
+	compound_data_t *data;		/*< COMPOUND the READ is part of */
+	READ4res *res_READ4;		/*< READ result */
+	struct fsal_obj_handle *obj;	/*< File being read */
+	state_t *state_found;		/*< State reference to release */
+	state_t *state_open;		/*< State reference to release */
+	state_owner_t *owner;		/*< Owner reference to release */
+	bool anonymous_started;		/*< Anonymous I/O to finish */
+	fsal_status_t status;		/*< Result of the read */
+	struct fsal_io_arg read_arg;	/*< Arguments of the read */
+};
+
+/**
+ * @brief Completion callback for an asynchronous READ
+ *
+ * May be called from an FSAL thread, so only record the result and
+ * hand the request back to a worker.
+ */
+static void nfs4_read_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			 void *obj_data, void *caller_data)
+{
+	struct nfs4_read_data *read_data = caller_data;
+
+	/* Fixup FSAL_SHARE_DENIED status */
+	if (ret.major == ERR_FSAL_SHARE_DENIED)
+		ret = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	read_data->status = ret;
+
+	nfs4_op_async_done(read_data->data);
+}
+
+/**
+ * @brief Finish a READ once its asynchronous I/O completed
+ *
+ * @param[in]     op    The nfs4_op arguments
+ * @param[in,out] data  The compound request's data
+ * @param[out]    resp  The nfs4_op results
+ *
+ * @return Errors as specified by RFC3550 RFC5661 p. 371.
+ */
+static int nfs4_read_resume(struct nfs_argop4 *op, compound_data_t *data,
+			    struct nfs_resop4 *resp)
+{
+	struct nfs4_read_data *read_data = data->op_data;
+	struct fsal_io_arg *read_arg = &read_data->read_arg;
+	READ4res * const res_READ4 = read_data->res_READ4;
+	size_t read_size;
+
+	data->op_data = NULL;
+
+	nfs4_read_io_done(read_data->obj, res_READ4, read_data->status,
+			  read_arg->offset, read_arg->buffer,
+			  read_arg->io_amount, read_arg->end_of_file);
+
+	read_size = FSAL_IS_ERROR(read_data->status) ? 0 : read_arg->io_amount;
+
+	if (!read_data->anonymous_started && data->minorversion == 0)
+		op_ctx->clientid = NULL;
+
+	if (read_data->anonymous_started)
+		state_share_anonymous_io_done(read_data->obj,
+					      OPEN4_SHARE_ACCESS_READ);
+
+	server_stats_io_done(read_data->obj, read_arg->buffer_size, read_size,
+			     (res_READ4->status == NFS4_OK) ? true : false,
+			     false);
+
+	if (read_data->owner != NULL)
+		dec_state_owner_ref(read_data->owner);
+
+	if (read_data->state_found != NULL)
+		dec_state_t_ref(read_data->state_found);
+
+	if (read_data->state_open != NULL)
+		dec_state_t_ref(read_data->state_open);
+
+	read_data->obj->obj_ops.put_ref(read_data->obj);
+	gsh_free(read_data);
+
+	return res_READ4->status;
+}
 
 static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		    struct nfs_resop4 *resp, fsal_io_direction_t io,
-		    struct io_info *info)
+		    struct io_info *info, read_plus_res4 *rplus)
 {
 	READ4args * const arg_READ4 = &op->nfs_argop4_u.opread;
 	READ4res * const res_READ4 = &resp->nfs_resop4_u.opread;
@@ -213,10 +631,8 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	bool anonymous_started = false;
 	state_owner_t *owner = NULL;
 	bool bypass = false;
-	uint64_t MaxRead = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead);
-	uint64_t MaxOffsetRead =
-			atomic_fetch_uint64_t(
-				&op_ctx->ctx_export->MaxOffsetRead);
+	uint64_t MaxRead;
+	uint64_t MaxOffsetRead;
 
 	/* Say we are managing NFS4_OP_READ */
 	resp->resop = NFS4_OP_READ;
@@ -229,13 +645,18 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		if (io == FSAL_IO_READ)
 			return op_dsread(op, data, resp);
 		else
-			return op_dsread_plus(op, data, resp, info);
+			return op_dsread_plus(op, data, resp, info, rplus);
 	}
 
 	res_READ4->status = nfs4_sanity_check_FH(data, REGULAR_FILE, true);
 	if (res_READ4->status != NFS4_OK)
 		return res_READ4->status;
 
+	/* Not before the DS check, a DS may have no ctx_export */
+	MaxRead = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxRead);
+	MaxOffsetRead =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetRead);
+
 	obj = data->current_obj;
 	/* Check stateid correctness and get pointer to state (also
 	   checks for special stateids) */
@@ -359,6 +780,12 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 			res_READ4->status = NFS4ERR_BAD_STATEID;
 			goto out;
 		}
+	} else if (op_ctx_export_has_option(EXPORT_OPTION_IMMUTABLE)) {
+		/* Nothing writes an immutable export and its opens deny
+		 * nothing, there is no share to check.
+		 */
+		state_open = NULL;
+		bypass = true;
 	} else {
 		/* Special stateid, no open state, check to see if any
 		   share conflicts */
@@ -448,9 +875,9 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 	}
 
 	/* Some work is to be done */
-	bufferdata = gsh_malloc_aligned(4096, size);
+	bufferdata = io_buf_alloc(size);
 
-	if (!anonymous_started && data->minorversion == 0) {
+	if (state_found != NULL && data->minorversion == 0) {
 		owner = get_state_owner_ref(state_found);
 		if (owner != NULL) {
 			op_ctx->clientid =
@@ -458,6 +885,70 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
+	if (obj->fsal->m_ops.support_ex(obj) && io == FSAL_IO_READ) {
+		/* Start the new asynchronous read, the operation is
+		 * finished in nfs4_read_resume().
+		 */
+		struct nfs4_read_data *read_data;
+
+		read_data = gsh_calloc(1, sizeof(*read_data));
+		read_data->data = data;
+		read_data->res_READ4 = res_READ4;
+		/* The following operations may change the current object
+		 * before the read completes.
+		 */
+		obj->obj_ops.get_ref(obj);
+		read_data->obj = obj;
+		read_data->state_found = state_found;
+		read_data->state_open = state_open;
+		read_data->owner = owner;
+		read_data->anonymous_started = anonymous_started;
+		read_data->read_arg.state = state_found;
+		read_data->read_arg.offset = offset;
+		read_data->read_arg.buffer_size = size;
+		read_data->read_arg.buffer = bufferdata;
+		read_data->read_arg.info = NULL;
+
+		nfs4_op_async_start(data, nfs4_read_resume, read_data);
+
+		obj->obj_ops.read2_async(obj, bypass, nfs4_read_cb,
+					 &read_data->read_arg, read_data);
+		return NFS4_OK;
+	}
+
+	if (obj->fsal->m_ops.support_ex(obj) && io == FSAL_IO_READ_PLUS) {
+		struct read_plus_segs rp = {
+			.segs = gsh_malloc(READ_PLUS_MAX_SEGMENTS *
+					   sizeof(contents)),
+			.buf = bufferdata,
+		};
+
+		fsal_status = nfs4_read_plus_sparse(obj, bypass, state_found,
+						    offset, size, &rp,
+						    &eof_met);
+
+		if (FSAL_IS_ERROR(fsal_status) || rp.used == 0)
+			io_buf_free(bufferdata);
+
+		if (FSAL_IS_ERROR(fsal_status)) {
+			gsh_free(rp.segs);
+			res_READ4->status = nfs4_Errno_status(fsal_status);
+		} else {
+			rplus->rpr_contents = rp.segs;
+			rplus->rpr_contents_count = rp.count;
+			rplus->rpr_eof = eof_met;
+			read_size = rp.used;
+			server_stats_read_plus_done(rp.used, rp.holes,
+						    rp.zeroes);
+			res_READ4->status = NFS4_OK;
+		}
+
+		if (!anonymous_started && data->minorversion == 0)
+			op_ctx->clientid = NULL;
+
+		goto done;
+	}
+
 	if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_read2 */
 		fsal_status = fsal_read2(obj, bypass, state_found, offset, size,
@@ -469,50 +960,22 @@ static int nfs4_read(struct nfs_argop4 *op, compound_data_t *data,
 					bufferdata, &eof_met, &sync, info);
 	}
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		res_READ4->status = nfs4_Errno_status(fsal_status);
-		gsh_free(bufferdata);
-		res_READ4->READ4res_u.resok4.data.data_val = NULL;
-		goto done;
-	}
-
-	if (!eof_met) {
-		/** @todo FSF: add a config option for this behavior?
-		 */
-		/* Need to check against filesize for ESXi clients */
-		struct attrlist attrs;
-
-		fsal_prepare_attrs(&attrs, ATTR_SIZE);
-
-		if (!FSAL_IS_ERROR(obj->obj_ops.getattrs(obj, &attrs)))
-			eof_met = (offset + read_size) >= attrs.filesize;
+	nfs4_read_io_done(obj, res_READ4, fsal_status, offset, bufferdata,
+			  read_size, eof_met);
 
-		/* Done with the attrs */
-		fsal_release_attrs(&attrs);
-	}
+	if (io == FSAL_IO_READ_PLUS && res_READ4->status == NFS4_OK)
+		nfs4_read_plus_from_info(rplus, info, bufferdata,
+					 res_READ4->READ4res_u.resok4.eof);
 
 	if (!anonymous_started && data->minorversion == 0)
 		op_ctx->clientid = NULL;
 
-	res_READ4->READ4res_u.resok4.data.data_len = read_size;
-	res_READ4->READ4res_u.resok4.data.data_val = bufferdata;
-
-	LogFullDebug(COMPONENT_NFS_V4,
-		     "NFS4_OP_READ: offset = %" PRIu64
-		     " read length = %zu eof=%u", offset, read_size, eof_met);
-
-	/* Is EOF met or not ? */
-	res_READ4->READ4res_u.resok4.eof = eof_met;
-
-	/* Say it is ok */
-	res_READ4->status = NFS4_OK;
-
  done:
 
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_READ);
 
-	server_stats_io_done(size, read_size,
+	server_stats_io_done(obj, size, read_size,
 			     (res_READ4->status == NFS4_OK) ? true : false,
 			     false);
 
@@ -548,7 +1011,7 @@ int nfs4_op_read(struct nfs_argop4 *op, compound_data_t *data,
 {
 	int err;
 
-	err = nfs4_read(op, data, resp, FSAL_IO_READ, NULL);
+	err = nfs4_read(op, data, resp, FSAL_IO_READ, NULL, NULL);
 
 	return err;
 }
@@ -568,7 +1031,7 @@ void nfs4_op_read_Free(nfs_resop4 *res)
 
 	if (resp->status == NFS4_OK)
 		if (resp->READ4res_u.resok4.data.data_val != NULL)
-			gsh_free(resp->READ4res_u.resok4.data.data_val);
+			io_buf_free(resp->READ4res_u.resok4.data.data_val);
 }
 
 /**
@@ -592,43 +1055,51 @@ int nfs4_op_read_plus(struct nfs_argop4 *op, compound_data_t *data,
 	/* Response */
 	READ_PLUS4res * const res_RPLUS = &resp->nfs_resop4_u.opread_plus;
 	READ4res *res_READ4 = &res.nfs_resop4_u.opread;
-	contents *contentp = &res_RPLUS->rpr_resok4.rpr_contents;
+	read_plus_res4 rplus;
 
 	resp->resop = NFS4_OP_READ_PLUS;
 
-	nfs4_read(op, data, &res, FSAL_IO_READ_PLUS, &info);
+	memset(&info, 0, sizeof(info));
+	memset(&rplus, 0, sizeof(rplus));
+
+	nfs4_read(op, data, &res, FSAL_IO_READ_PLUS, &info, &rplus);
 
 	res_RPLUS->rpr_status = res_READ4->status;
 	if (res_RPLUS->rpr_status != NFS4_OK)
 		return res_RPLUS->rpr_status;
 
-	contentp->what = info.io_content.what;
-	res_RPLUS->rpr_resok4.rpr_contents_count = 1;
-	res_RPLUS->rpr_resok4.rpr_eof =
-			res_READ4->READ4res_u.resok4.eof;
+	res_RPLUS->rpr_resok4 = rplus;
 
-	if (info.io_content.what == NFS4_CONTENT_HOLE) {
-		contentp->hole.di_offset = info.io_content.hole.di_offset;
-		contentp->hole.di_length = info.io_content.hole.di_length;
-	}
-	if (info.io_content.what == NFS4_CONTENT_DATA) {
-		contentp->data.d_offset = info.io_content.data.d_offset;
-		contentp->data.d_data.data_len =
-					info.io_content.data.d_data.data_len;
-		contentp->data.d_data.data_val =
-					info.io_content.data.d_data.data_val;
-	}
 	return res_RPLUS->rpr_status;
 }
 
+/**
+ * @brief Free data allocated for READ_PLUS result.
+ *
+ * The first data segment starts the read buffer, the others point into
+ * it.
+ *
+ * @param[in,out] res  Results fo nfs4_op
+ */
 void nfs4_op_read_plus_Free(nfs_resop4 *res)
 {
 	READ_PLUS4res *resp = &res->nfs_resop4_u.opread_plus;
-	contents *conp = &resp->rpr_resok4.rpr_contents;
+	contents *conp;
+	count4 i;
+
+	if (resp->rpr_status != NFS4_OK)
+		return;
+
+	for (i = 0; i < resp->rpr_resok4.rpr_contents_count; i++) {
+		conp = &resp->rpr_resok4.rpr_contents[i];
+		if (conp->what == NFS4_CONTENT_DATA) {
+			if (conp->data.d_data.data_val != NULL)
+				io_buf_free(conp->data.d_data.data_val);
+			break;
+		}
+	}
 
-	if (resp->rpr_status == NFS4_OK && conp->what == NFS4_CONTENT_DATA)
-		if (conp->data.d_data.data_val != NULL)
-			gsh_free(conp->data.d_data.data_val);
+	gsh_free(resp->rpr_resok4.rpr_contents);
 }
 
 /**
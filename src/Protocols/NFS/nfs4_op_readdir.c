@@ -43,13 +43,8 @@
  */
 
 struct nfs4_readdir_cb_data {
-	entry4 *entries;	/*< The array holding individual entries */
-	size_t mem_left;	/*< The amount of memory remaining before we
-				   hit maxcount */
-	size_t count;		/*< The count of complete entries stored in the
-				   buffer */
-	size_t total_entries;	/*< The total number of entries available
-				   in the array */
+	struct nfs_dirent_stream ds;	/*< The entries, encoded */
+	size_t total_entries;	/*< The most entries to return */
 	nfsstat4 error;		/*< Set to a value other than NFS4_OK if the
 				   callback function finds a fatal error. */
 	struct bitmap4 *req_attr;	/*< The requested attributes */
@@ -78,15 +73,14 @@ static void restore_data(struct nfs4_readdir_cb_data *tracker)
 }
 
 /**
- * @brief Populate entry4s when called from fsal_readdir
+ * @brief Encode an entry4 when called from fsal_readdir
  *
- * This function is a callback passed to fsal_readdir.  It
- * fills in a pre-allocated array of entry4 structures and allocates
- * space for the name and attributes.  This space must be freed.
+ * This function is a callback passed to fsal_readdir.  It encodes
+ * the entry and its attributes straight into the reply's stream of
+ * entries.
  *
  * @param[in,out] opaque A struct nfs4_readdir_cb_data that stores the
- *                       location of the array and other bookeeping
- *                       information
+ *                       stream and other bookeeping information
  * @param[in]     obj	 Current file
  * @param[in]     attrs  The current file's attributes
  * @param[in]     cookie The readdir cookie for the current entry
@@ -101,7 +95,6 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 {
 	struct fsal_readdir_cb_parms *cb_parms = opaque;
 	struct nfs4_readdir_cb_data *tracker = cb_parms->opaque;
-	size_t namelen = 0;
 	char val_fh[NFS4_FHSIZE];
 	nfs_fh4 entryFH = {
 		.nfs_fh4_len = 0,
@@ -110,7 +103,11 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 	struct xdr_attrs_args args;
 	compound_data_t *data = tracker->data;
 	nfsstat4 rdattr_error = NFS4_OK;
-	entry4 *tracker_entry = tracker->entries + tracker->count;
+	struct nfs_dirent_stream *ds = &tracker->ds;
+	char attr_vals[NFS4_ATTRVALS_BUFFLEN];
+	fattr4 attrs = { .attr_vals.attrlist4_val = NULL };
+	bool attrs_allocated = false;
+	component4 name;
 	fsal_status_t fsal_status;
 	fsal_accessflags_t access_mask_attr = 0;
 
@@ -121,7 +118,7 @@ fsal_errors_t nfs4_readdir_callback(void *opaque,
 		return ERR_FSAL_NO_ERROR;
 	}
 
-	if (tracker->total_entries == tracker->count)
+	if (tracker->total_entries == ds->count)
 		goto not_inresult;
 
 	/* Test if this is a junction.
@@ -276,42 +273,8 @@ not_junction:
 	/* Now process the entry */
 	memset(val_fh, 0, NFS4_FHSIZE);
 
-	/* Bits that don't require allocation */
-	if (tracker->mem_left < sizeof(entry4)) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
-
-	tracker->mem_left -= sizeof(entry4);
-	tracker_entry->cookie = cookie;
-	tracker_entry->nextentry = NULL;
-
-	/* The filename.  We don't use str2utf8 because that has an
-	 * additional copy into a buffer before copying into the
-	 * destination.
-	 */
-	namelen = strlen(cb_parms->name);
-
-	if (tracker->mem_left < (namelen + 1)) {
-		if (tracker->count == 0)
-			tracker->error = NFS4ERR_TOOSMALL;
-
-		goto failure;
-	}
-
-	tracker->mem_left -= (namelen + 1);
-	tracker_entry->name.utf8string_len = namelen;
-	tracker_entry->name.utf8string_val = gsh_malloc(namelen + 1);
-
-	memcpy(tracker_entry->name.utf8string_val,
-	       cb_parms->name,
-	       namelen);
-
-	/* If we carried an error from above, now that we have
-	 * the name set up, go ahead and try and put error in
-	 * results.
+	/* If we carried an error from above, go ahead and try and put
+	 * error in results.
 	 */
 	if (rdattr_error != NFS4_OK) {
 		LogDebug(COMPONENT_NFS_READDIR,
@@ -366,9 +329,8 @@ not_junction:
 	args.fileid = obj->fileid;
 	args.fsid = obj->fsid;
 
-	if (nfs4_FSALattr_To_Fattr(&args,
-				   tracker->req_attr,
-				   &tracker_entry->attrs) != 0) {
+	if (nfs4_FSALattr_To_Fattr_buf(&args, tracker->req_attr, &attrs,
+				       attr_vals) != 0) {
 		LogCrit(COMPONENT_NFS_READDIR,
 			"nfs4_FSALattr_To_Fattr failed to convert attr");
 		goto server_fault;
@@ -386,32 +348,31 @@ not_junction:
 	if (rdattr_error != NFS4_OK) {
 		if (!attribute_is_set(tracker->req_attr, FATTR4_RDATTR_ERROR)) {
 			tracker->error = rdattr_error;
-			goto failure;
+			goto not_inresult;
 		}
 
-		if (nfs4_Fattr_Fill_Error(&tracker_entry->attrs,
-					  rdattr_error) == -1)
+		attrs_allocated = true;
+		if (nfs4_Fattr_Fill_Error(&attrs, rdattr_error) == -1)
 			goto server_fault;
 	}
 
-	if (tracker->mem_left <
-	    ((tracker_entry->attrs.attrmask.bitmap4_len * sizeof(uint32_t))
-	     + (tracker_entry->attrs.attr_vals.attrlist4_len))) {
-		if (tracker->count == 0)
+	/* The filename goes in as it is, without a copy */
+	name.utf8string_len = strlen(cb_parms->name);
+	name.utf8string_val = (char *)cb_parms->name;
+
+	if (!nfs_dirent_stream_start(ds) ||
+	    !xdr_nfs_cookie4(&ds->xdrs, &cookie) ||
+	    !xdr_component4(&ds->xdrs, &name) ||
+	    !xdr_fattr4(&ds->xdrs, &attrs)) {
+		/* Past maxcount */
+		nfs_dirent_stream_end(ds, false);
+		if (ds->count == 0)
 			tracker->error = NFS4ERR_TOOSMALL;
 
-		goto failure;
+		goto not_inresult;
 	}
 
-	tracker->mem_left -= tracker_entry->attrs.attrmask.bitmap4_len *
-			     sizeof(uint32_t);
-
-	tracker->mem_left -= tracker_entry->attrs.attr_vals.attrlist4_len;
-
-	if (tracker->count != 0)
-		tracker->entries[tracker->count - 1].nextentry = tracker_entry;
-
-	++(tracker->count);
+	nfs_dirent_stream_end(ds, true);
 	cb_parms->in_result = true;
 	goto out;
 
@@ -419,47 +380,16 @@ not_junction:
 
 	tracker->error = NFS4ERR_SERVERFAULT;
 
- failure:
-
-	if (tracker_entry->attrs.attr_vals.attrlist4_val != NULL) {
-		gsh_free(tracker_entry->attrs.attr_vals.attrlist4_val);
-		tracker_entry->attrs.attr_vals.attrlist4_val = NULL;
-	}
-
-	if (tracker_entry->name.utf8string_val != NULL) {
-		gsh_free(tracker_entry->name.utf8string_val);
-		tracker_entry->name.utf8string_val = NULL;
-	}
-
  not_inresult:
 
 	cb_parms->in_result = false;
 
  out:
 
-	return ERR_FSAL_NO_ERROR;
-}
-
-/**
- * @brief Free a list of entry4s
- *
- * This function frees a list of entry4s and all dependent strctures.
- *
- * @param[in,out] entries The entries to be freed
- */
+	if (attrs_allocated)
+		gsh_free(attrs.attr_vals.attrlist4_val);
 
-static void free_entries(entry4 *entries)
-{
-	entry4 *entry = NULL;
-
-	for (entry = entries; entry != NULL; entry = entry->nextentry) {
-		if (entry->attrs.attr_vals.attrlist4_val != NULL)
-			gsh_free(entry->attrs.attr_vals.attrlist4_val);
-
-		if (entry->name.utf8string_val != NULL)
-			gsh_free(entry->name.utf8string_val);
-	}
-	gsh_free(entries);
+	return ERR_FSAL_NO_ERROR;
 }
 
 /**
@@ -484,12 +414,11 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	bool eod_met = false;
 	unsigned long dircount = 0;
 	unsigned long maxcount = 0;
-	entry4 *entries = NULL;
 	verifier4 cookie_verifier;
 	uint64_t cookie = 0;
 	unsigned int estimated_num_entries = 0;
 	unsigned int num_entries = 0;
-	struct nfs4_readdir_cb_data tracker;
+	struct nfs4_readdir_cb_data tracker = { .ds.buf = NULL };
 	fsal_status_t fsal_status = {0, 0};
 	attrmask_t attrmask;
 	bool use_cookie_verifier = op_ctx_export_has_option(
@@ -509,7 +438,7 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* get the characteristic value for readdir operation */
 	dircount = arg_READDIR4->dircount;
-	maxcount = (arg_READDIR4->maxcount * 9) / 10;
+	maxcount = arg_READDIR4->maxcount;
 	cookie = arg_READDIR4->cookie;
 
 	/* Dircount is considered meaningless by many nfsv4 client (like the
@@ -545,10 +474,11 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
-	/* If maxcount is too short (14 should be enough for an empty
-	 * directory) return NFS4ERR_TOOSMALL
+	/* If maxcount is too short even for an empty directory return
+	 * NFS4ERR_TOOSMALL
 	 */
-	if (maxcount < 14 || estimated_num_entries == 0) {
+	if (maxcount <= NFS4_READDIR_RESOK_SIZE ||
+	    estimated_num_entries == 0) {
 		res_READDIR4->status = NFS4ERR_TOOSMALL;
 		LogFullDebug(COMPONENT_NFS_READDIR,
 			     "Response too small");
@@ -610,18 +540,20 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 
 	/* Prepare to read the entries */
 
-	entries = gsh_calloc(estimated_num_entries, sizeof(entry4));
-	tracker.entries = entries;
-	tracker.mem_left = maxcount - sizeof(READDIR4resok);
-	tracker.count = 0;
+	nfs_dirent_stream_init(&tracker.ds, maxcount - NFS4_READDIR_RESOK_SIZE);
 	tracker.error = NFS4_OK;
 	tracker.req_attr = &arg_READDIR4->attr_request;
 	tracker.data = data;
 
 	/* Assume we need at least the NFS v3 attr.
 	 * Any attr is sufficient for permission checking.
+	 * Clients listing names and types (ls, find) ask for nothing
+	 * that changes, which the cache has even if stale.
 	 */
-	attrmask = ATTRS_NFS3;
+	if (check_for_immutable_attr(tracker.req_attr))
+		attrmask = ATTR_TYPE | ATTR_FILEID | ATTR_FSID;
+	else
+		attrmask = ATTRS_NFS3;
 
 	/* If ACL is requested, we need to add that for permission checking. */
 	if (attribute_is_set(tracker.req_attr, FATTR4_ACL))
@@ -656,16 +588,14 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 		goto out;
 	}
 
-	if (tracker.count != 0) {
-		/* Put the entry's list in the READDIR reply if
-		 * there were any.
-		 */
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = entries;
-	} else {
-		gsh_free(entries);
-		entries = NULL;
-		res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
-	}
+	/* Put the encoded entries in the READDIR reply if there were
+	 * any.
+	 */
+	res_READDIR4->READDIR4res_u.resok4.reply.entries = NULL;
+	nfs_dirent_stream_take(
+		&tracker.ds,
+		&res_READDIR4->READDIR4res_u.resok4.reply.encoded,
+		&res_READDIR4->READDIR4res_u.resok4.reply.encoded_len);
 
 	/* This slight bit of oddness is caused by most booleans
 	 * throughout Ganesha being of C99's bool type (taking the values
@@ -685,8 +615,7 @@ int nfs4_op_readdir(struct nfs_argop4 *op, compound_data_t *data,
 	res_READDIR4->status = NFS4_OK;
 
  out:
-	if ((res_READDIR4->status != NFS4_OK) && (entries != NULL))
-		free_entries(entries);
+	nfs_dirent_stream_release(&tracker.ds);
 
 	LogFullDebug(COMPONENT_NFS_READDIR,
 		     "Returning %s",
@@ -707,5 +636,6 @@ void nfs4_op_readdir_Free(nfs_resop4 *res)
 {
 	READDIR4res *resp = &res->nfs_resop4_u.opreaddir;
 
-	free_entries(resp->READDIR4res_u.resok4.reply.entries);
+	if (resp->status == NFS4_OK)
+		gsh_free(resp->READDIR4res_u.resok4.reply.encoded);
 }				/* nfs4_op_readdir_Free */
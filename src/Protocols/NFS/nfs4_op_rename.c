@@ -73,16 +73,18 @@ int nfs4_op_rename(struct nfs_argop4 *op, compound_data_t *data,
 	res_RENAME4->status = NFS4_OK;
 
 	/* Read and validate oldname and newname from uft8 strings. */
-	res_RENAME4->status = nfs4_utf8string2dynamic(&arg_RENAME4->oldname,
-						      UTF8_SCAN_ALL,
-						      &oldname);
+	res_RENAME4->status = nfs4_utf8string2arena(nfs_req_arena(data->req),
+						    &arg_RENAME4->oldname,
+						    UTF8_SCAN_ALL,
+						    &oldname);
 
 	if (res_RENAME4->status != NFS4_OK)
 		goto out;
 
-	res_RENAME4->status = nfs4_utf8string2dynamic(&arg_RENAME4->newname,
-						      UTF8_SCAN_ALL,
-						      &newname);
+	res_RENAME4->status = nfs4_utf8string2arena(nfs_req_arena(data->req),
+						    &arg_RENAME4->newname,
+						    UTF8_SCAN_ALL,
+						    &newname);
 
 	if (res_RENAME4->status != NFS4_OK)
 		goto out;
@@ -133,12 +135,6 @@ int nfs4_op_rename(struct nfs_argop4 *op, compound_data_t *data,
 	res_RENAME4->status = nfs4_Errno_status(fsal_status);
 
  out:
-	if (oldname)
-		gsh_free(oldname);
-
-	if (newname)
-		gsh_free(newname);
-
 	return res_RENAME4->status;
 }
 
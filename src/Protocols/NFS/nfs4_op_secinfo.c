@@ -72,9 +72,10 @@ int nfs4_op_secinfo(struct nfs_argop4 *op, compound_data_t *data,
 	/* Read name from uft8 strings, if one is empty then returns
 	 * NFS4ERR_INVAL
 	 */
-	res_SECINFO4->status = nfs4_utf8string2dynamic(&arg_SECINFO4->name,
-						       UTF8_SCAN_ALL,
-						       &secinfo_fh_name);
+	res_SECINFO4->status = nfs4_utf8string2arena(nfs_req_arena(data->req),
+						     &arg_SECINFO4->name,
+						     UTF8_SCAN_ALL,
+						     &secinfo_fh_name);
 
 	if (res_SECINFO4->status != NFS4_OK)
 		goto out;
@@ -296,9 +297,6 @@ int nfs4_op_secinfo(struct nfs_argop4 *op, compound_data_t *data,
 	if (obj_src)
 		obj_src->obj_ops.put_ref(obj_src);
 
-	if (secinfo_fh_name)
-		gsh_free(secinfo_fh_name);
-
 	return res_SECINFO4->status;
 }				/* nfs4_op_secinfo */
 
@@ -136,6 +136,14 @@ int nfs4_op_setclientid(struct nfs_argop4 *op, compound_data_t *data,
 
 	PTHREAD_MUTEX_lock(&client_record->cr_mutex);
 
+	/* An expired clientid of this client still has state being
+	 * released, the client would meet it reclaiming.
+	 */
+	if (atomic_fetch_int32_t(&client_record->cr_expiring) != 0) {
+		res_SETCLIENTID4->status = NFS4ERR_DELAY;
+		goto out;
+	}
+
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN];
 		struct display_buffer dspbuf = {sizeof(str), str, str};
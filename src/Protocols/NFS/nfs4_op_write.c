@@ -146,6 +146,129 @@ static int op_dswrite_plus(struct nfs_argop4 *op, compound_data_t *data,
  * @return per RFC5661, p. 376
  */
 
+/**
+ * @brief Fill in the WRITE result once the I/O is done
+ *
+ * @param[out] res_WRITE4   WRITE result
+ * @param[in]  fsal_status  Result of the write
+ * @param[in]  written_size Amount of data written
+ * @param[in]  sync         Whether the data was committed
+ */
+static void nfs4_write_io_done(WRITE4res *res_WRITE4,
+			       fsal_status_t fsal_status,
+			       size_t written_size, bool sync)
+{
+	struct gsh_buffdesc verf_desc;
+
+	if (FSAL_IS_ERROR(fsal_status)) {
+		LogDebug(COMPONENT_NFS_V4, "write returned %s",
+			 fsal_err_txt(fsal_status));
+		res_WRITE4->status = nfs4_Errno_status(fsal_status);
+		return;
+	}
+
+	/* Set the returned value */
+	if (sync)
+		res_WRITE4->WRITE4res_u.resok4.committed = FILE_SYNC4;
+	else
+		res_WRITE4->WRITE4res_u.resok4.committed = UNSTABLE4;
+
+	res_WRITE4->WRITE4res_u.resok4.count = written_size;
+
+	verf_desc.addr = res_WRITE4->WRITE4res_u.resok4.writeverf;
+	verf_desc.len = sizeof(verifier4);
+	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
+							&verf_desc);
+
+	res_WRITE4->status = NFS4_OK;
+}
+
+/**
+ * @brief State of a WRITE waiting on asynchronous I/O
+ */
+struct nfs4_write_data {
+	compound_data_t *data;		/*< COMPOUND the WRITE is part of */
+	WRITE4res *res_WRITE4;		/*< WRITE result */
+	struct fsal_obj_handle *obj;	/*< File being written */
+	state_t *state_found;		/*< State reference to release */
+	state_t *state_open;		/*< State reference to release */
+	state_owner_t *owner;		/*< Owner reference to release */
+	bool anonymous_started;		/*< Anonymous I/O to finish */
+	fsal_status_t status;		/*< Result of the write */
+	struct fsal_io_arg write_arg;	/*< Arguments of the write */
+};
+
+/**
+ * @brief Completion callback for an asynchronous WRITE
+ *
+ * May be called from an FSAL thread, so only record the result and
+ * hand the request back to a worker.
+ */
+static void nfs4_write_cb(struct fsal_obj_handle *obj, fsal_status_t ret,
+			  void *obj_data, void *caller_data)
+{
+	struct nfs4_write_data *write_data = caller_data;
+
+	/* Fixup ERR_FSAL_SHARE_DENIED status */
+	if (ret.major == ERR_FSAL_SHARE_DENIED)
+		ret = fsalstat(ERR_FSAL_LOCKED, 0);
+
+	write_data->status = ret;
+
+	nfs4_op_async_done(write_data->data);
+}
+
+/**
+ * @brief Finish a WRITE once its asynchronous I/O completed
+ *
+ * @param[in]     op    The nfs4_op arguments
+ * @param[in,out] data  The compound request's data
+ * @param[out]    resp  The nfs4_op results
+ *
+ * @return Errors as specified by RFC3530 RFC5661 p. 376.
+ */
+static int nfs4_write_resume(struct nfs_argop4 *op, compound_data_t *data,
+			     struct nfs_resop4 *resp)
+{
+	struct nfs4_write_data *write_data = data->op_data;
+	struct fsal_io_arg *write_arg = &write_data->write_arg;
+	WRITE4res * const res_WRITE4 = write_data->res_WRITE4;
+	size_t written_size;
+
+	data->op_data = NULL;
+
+	written_size = FSAL_IS_ERROR(write_data->status)
+				? 0 : write_arg->io_amount;
+
+	nfs4_write_io_done(res_WRITE4, write_data->status, written_size,
+			   write_arg->fsal_stable);
+
+	if (!write_data->anonymous_started && data->minorversion == 0)
+		op_ctx->clientid = NULL;
+
+	if (write_data->anonymous_started)
+		state_share_anonymous_io_done(write_data->obj,
+					      OPEN4_SHARE_ACCESS_WRITE);
+
+	server_stats_io_done(write_data->obj, write_arg->buffer_size,
+			     written_size,
+			     (res_WRITE4->status == NFS4_OK) ? true : false,
+			     true);
+
+	if (write_data->owner != NULL)
+		dec_state_owner_ref(write_data->owner);
+
+	if (write_data->state_found != NULL)
+		dec_state_t_ref(write_data->state_found);
+
+	if (write_data->state_open != NULL)
+		dec_state_t_ref(write_data->state_open);
+
+	gsh_free(write_data);
+
+	return res_WRITE4->status;
+}
+
 static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		     struct nfs_resop4 *resp, fsal_io_direction_t io,
 		     struct io_info *info)
@@ -166,10 +289,8 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	bool anonymous_started = false;
 	struct gsh_buffdesc verf_desc;
 	state_owner_t *owner = NULL;
-	uint64_t MaxWrite =
-		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxWrite);
-	uint64_t MaxOffsetWrite =
-		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+	uint64_t MaxWrite;
+	uint64_t MaxOffsetWrite;
 
 	/* Lock are not supported */
 	resp->resop = NFS4_OP_WRITE;
@@ -191,12 +312,17 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 	if (res_WRITE4->status != NFS4_OK)
 		return res_WRITE4->status;
 
+	/* Not before the DS check, a DS may have no ctx_export */
+	MaxWrite = atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxWrite);
+	MaxOffsetWrite =
+		atomic_fetch_uint64_t(&op_ctx->ctx_export->MaxOffsetWrite);
+
 	/* if quota support is active, then we should check is the FSAL
-	   allows inode creation or not */
+	   allows block allocation or not */
 	fsal_status = op_ctx->fsal_export->exp_ops.check_quota(
 						op_ctx->fsal_export,
 						op_ctx->ctx_export->fullpath,
-						FSAL_QUOTA_INODES);
+						FSAL_QUOTA_BLOCKS);
 
 	if (FSAL_IS_ERROR(fsal_status)) {
 		res_WRITE4->status = NFS4ERR_DQUOT;
@@ -358,8 +484,9 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		 * must restrict him
 		 */
 
+		/* The range of an ALLOCATE or DEALLOCATE is not data */
 		if (info == NULL ||
-		    info->io_content.what != NFS4_CONTENT_HOLE) {
+		    info->io_content.what == NFS4_CONTENT_DATA) {
 			LogFullDebug(COMPONENT_NFS_V4,
 				     "write requested size = %" PRIu64
 				     " write allowed size = %" PRIu64,
@@ -402,6 +529,39 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 		}
 	}
 
+	if (obj->fsal->m_ops.support_ex(obj) && io == FSAL_IO_WRITE) {
+		/* Start the new asynchronous write, the operation is
+		 * finished in nfs4_write_resume().
+		 */
+		struct nfs4_write_data *write_data;
+
+		if (op_ctx->export_perms->options & EXPORT_OPTION_COMMIT) {
+			/* Force sync if export requires it */
+			sync = true;
+		}
+
+		write_data = gsh_calloc(1, sizeof(*write_data));
+		write_data->data = data;
+		write_data->res_WRITE4 = res_WRITE4;
+		write_data->obj = obj;
+		write_data->state_found = state_found;
+		write_data->state_open = state_open;
+		write_data->owner = owner;
+		write_data->anonymous_started = anonymous_started;
+		write_data->write_arg.state = state_found;
+		write_data->write_arg.offset = offset;
+		write_data->write_arg.buffer_size = size;
+		write_data->write_arg.buffer = bufferdata;
+		write_data->write_arg.fsal_stable = sync;
+		write_data->write_arg.info = NULL;
+
+		nfs4_op_async_start(data, nfs4_write_resume, write_data);
+
+		obj->obj_ops.write2_async(obj, false, nfs4_write_cb,
+					  &write_data->write_arg, write_data);
+		return NFS4_OK;
+	}
+
 	if (obj->fsal->m_ops.support_ex(obj)) {
 		/* Call the new fsal_write */
 		fsal_status = fsal_write2(obj, false, state_found, offset, size,
@@ -413,37 +573,21 @@ static int nfs4_write(struct nfs_argop4 *op, compound_data_t *data,
 					bufferdata, &eof_met, &sync, info);
 	}
 
-	if (FSAL_IS_ERROR(fsal_status)) {
-		LogDebug(COMPONENT_NFS_V4, "write returned %s",
-			 fsal_err_txt(fsal_status));
-		res_WRITE4->status = nfs4_Errno_status(fsal_status);
-		goto done;
-	}
+	nfs4_write_io_done(res_WRITE4, fsal_status, written_size, sync);
 
 	if (!anonymous_started && data->minorversion == 0)
 		op_ctx->clientid = NULL;
 
-	/* Set the returned value */
-	if (sync)
-		res_WRITE4->WRITE4res_u.resok4.committed = FILE_SYNC4;
-	else
-		res_WRITE4->WRITE4res_u.resok4.committed = UNSTABLE4;
-
-	res_WRITE4->WRITE4res_u.resok4.count = written_size;
-
-	verf_desc.addr = res_WRITE4->WRITE4res_u.resok4.writeverf;
-	verf_desc.len = sizeof(verifier4);
-	op_ctx->fsal_export->exp_ops.get_write_verifier(op_ctx->fsal_export,
-							&verf_desc);
-
-	res_WRITE4->status = NFS4_OK;
-
  done:
 
 	if (anonymous_started)
 		state_share_anonymous_io_done(obj, OPEN4_SHARE_ACCESS_WRITE);
 
-	server_stats_io_done(size, written_size,
+	/* No data moved for an ALLOCATE or DEALLOCATE */
+	if (info != NULL && info->io_content.what != NFS4_CONTENT_DATA)
+		size = written_size = 0;
+
+	server_stats_io_done(obj, size, written_size,
 			     (res_WRITE4->status == NFS4_OK) ? true : false,
 			     true);
 
@@ -369,36 +369,36 @@ static fattr_xdr_result decode_supported_attrs(XDR *xdr,
  * FATTR4_TYPE
  */
 
-static fattr_xdr_result encode_type(XDR *xdr, struct xdr_attrs_args *args)
+/* Returns 0 for types that have no NFSv4 equivalent */
+static uint32_t fattr4_type(object_file_type_t type)
 {
-	uint32_t file_type;
-
-	switch (args->attrs->type) {
+	switch (type) {
 	case REGULAR_FILE:
 	case EXTENDED_ATTR:
-		file_type = NF4REG;	/* Regular file */
-		break;
+		return NF4REG;	/* Regular file */
 	case DIRECTORY:
-		file_type = NF4DIR;	/* Directory */
-		break;
+		return NF4DIR;	/* Directory */
 	case BLOCK_FILE:
-		file_type = NF4BLK;	/* Special File - block device */
-		break;
+		return NF4BLK;	/* Special File - block device */
 	case CHARACTER_FILE:
-		file_type = NF4CHR;	/* Special File - character device */
-		break;
+		return NF4CHR;	/* Special File - character device */
 	case SYMBOLIC_LINK:
-		file_type = NF4LNK;	/* Symbolic Link */
-		break;
+		return NF4LNK;	/* Symbolic Link */
 	case SOCKET_FILE:
-		file_type = NF4SOCK;	/* Special File - socket */
-		break;
+		return NF4SOCK;	/* Special File - socket */
 	case FIFO_FILE:
-		file_type = NF4FIFO;	/* Special File - fifo */
-		break;
+		return NF4FIFO;	/* Special File - fifo */
 	default:		/* includes NO_FILE_TYPE & FS_JUNCTION: */
-		return FATTR_XDR_FAILED;	/* silently skip bogus? */
+		return 0;
 	}			/* switch( pattr->type ) */
+}
+
+static fattr_xdr_result encode_type(XDR *xdr, struct xdr_attrs_args *args)
+{
+	uint32_t file_type = fattr4_type(args->attrs->type);
+
+	if (file_type == 0)
+		return FATTR_XDR_FAILED;	/* silently skip bogus? */
 	if (!xdr_u_int32_t(xdr, &file_type))
 		return FATTR_XDR_FAILED;
 	return FATTR_XDR_SUCCESS;
@@ -588,18 +588,23 @@ static fattr_xdr_result decode_namedattrsupport(XDR *xdr,
  * FATTR4_FSID
  */
 
-static fattr_xdr_result encode_fsid(XDR *xdr, struct xdr_attrs_args *args)
+static void fattr4_fsid(struct xdr_attrs_args *args, fsid4 *fsid)
 {
-	fsid4 fsid = {0, 0};
-
 	if (args->data != NULL &&
 	    op_ctx_export_has_option_set(EXPORT_OPTION_FSID_SET)) {
-		fsid.major = op_ctx->ctx_export->filesystem_id.major;
-		fsid.minor = op_ctx->ctx_export->filesystem_id.minor;
+		fsid->major = op_ctx->ctx_export->filesystem_id.major;
+		fsid->minor = op_ctx->ctx_export->filesystem_id.minor;
 	} else {
-		fsid.major = args->fsid.major;
-		fsid.minor = args->fsid.minor;
+		fsid->major = args->fsid.major;
+		fsid->minor = args->fsid.minor;
 	}
+}
+
+static fattr_xdr_result encode_fsid(XDR *xdr, struct xdr_attrs_args *args)
+{
+	fsid4 fsid;
+
+	fattr4_fsid(args, &fsid);
 
 	if (!xdr_u_int64_t(xdr, &fsid.major))
 		return FATTR_XDR_FAILED;
@@ -3368,24 +3373,242 @@ int nfs4_Fattr_Fill_Error(fattr4 *Fattr, nfsstat4 rdattr_error)
 	}
 }
 
+/*
+ * Encode plans
+ *
+ * Clients ask for the same few bitmaps over and over, so the list of
+ * attributes to encode for a bitmap is worked out once and kept in a
+ * small per thread cache.  Runs of attributes with a fixed size
+ * encoding, which make up most of what Linux clients ask for in GETATTR
+ * and READDIR, are written straight into the XDR buffer after a single
+ * bounds check.
+ */
+
+/** Writes a fixed size attribute, NULL if it can't be encoded */
+typedef int32_t *(*fattr4_put_t)(int32_t *buf, struct xdr_attrs_args *args);
+
+static inline int32_t *put_u64(int32_t *buf, uint64_t val)
+{
+	IXDR_PUT_U_INT32(buf, (uint32_t) (val >> 32));
+	IXDR_PUT_U_INT32(buf, (uint32_t) val);
+	return buf;
+}
+
+static inline int32_t *put_time(int32_t *buf, struct timespec *ts)
+{
+	buf = put_u64(buf, ts->tv_sec);
+	IXDR_PUT_U_INT32(buf, (uint32_t) ts->tv_nsec);
+	return buf;
+}
+
+static int32_t *put_type(int32_t *buf, struct xdr_attrs_args *args)
+{
+	uint32_t file_type = fattr4_type(args->attrs->type);
+
+	if (file_type == 0)
+		return NULL;
+	IXDR_PUT_U_INT32(buf, file_type);
+	return buf;
+}
+
+static int32_t *put_change(int32_t *buf, struct xdr_attrs_args *args)
+{
+	return put_u64(buf, args->attrs->change);
+}
+
+static int32_t *put_filesize(int32_t *buf, struct xdr_attrs_args *args)
+{
+	return put_u64(buf, args->attrs->filesize);
+}
+
+static int32_t *put_fsid(int32_t *buf, struct xdr_attrs_args *args)
+{
+	fsid4 fsid;
+
+	fattr4_fsid(args, &fsid);
+	buf = put_u64(buf, fsid.major);
+	return put_u64(buf, fsid.minor);
+}
+
+static int32_t *put_rdattr_error(int32_t *buf, struct xdr_attrs_args *args)
+{
+	IXDR_PUT_U_INT32(buf, args->rdattr_error);
+	return buf;
+}
+
+static int32_t *put_fileid(int32_t *buf, struct xdr_attrs_args *args)
+{
+	return put_u64(buf, args->fileid);
+}
+
+static int32_t *put_mode(int32_t *buf, struct xdr_attrs_args *args)
+{
+	IXDR_PUT_U_INT32(buf, fsal2unix_mode(args->attrs->mode));
+	return buf;
+}
+
+static int32_t *put_numlinks(int32_t *buf, struct xdr_attrs_args *args)
+{
+	IXDR_PUT_U_INT32(buf, args->attrs->numlinks);
+	return buf;
+}
+
+static int32_t *put_rawdev(int32_t *buf, struct xdr_attrs_args *args)
+{
+	IXDR_PUT_U_INT32(buf, args->attrs->rawdev.major);
+	IXDR_PUT_U_INT32(buf, args->attrs->rawdev.minor);
+	return buf;
+}
+
+static int32_t *put_spaceused(int32_t *buf, struct xdr_attrs_args *args)
+{
+	return put_u64(buf, args->attrs->spaceused);
+}
+
+static int32_t *put_accesstime(int32_t *buf, struct xdr_attrs_args *args)
+{
+	return put_time(buf, &args->attrs->atime);
+}
+
+static int32_t *put_metatime(int32_t *buf, struct xdr_attrs_args *args)
+{
+	return put_time(buf, &args->attrs->ctime);
+}
+
+static int32_t *put_modifytime(int32_t *buf, struct xdr_attrs_args *args)
+{
+	return put_time(buf, &args->attrs->mtime);
+}
+
+static int32_t *put_mounted_on_fileid(int32_t *buf,
+				      struct xdr_attrs_args *args)
+{
+	return put_u64(buf, args->mounted_on_fileid);
+}
+
+/* Same encoding as the fattr4tab encoders, which remain the reference */
+static const struct {
+	fattr4_put_t put;
+	unsigned int bytes;
+} fattr4_fixed[FATTR4_MOUNTED_ON_FILEID + 1] = {
+	[FATTR4_TYPE] = {put_type, 4},
+	[FATTR4_CHANGE] = {put_change, 8},
+	[FATTR4_SIZE] = {put_filesize, 8},
+	[FATTR4_FSID] = {put_fsid, 16},
+	[FATTR4_RDATTR_ERROR] = {put_rdattr_error, 4},
+	[FATTR4_FILEID] = {put_fileid, 8},
+	[FATTR4_MODE] = {put_mode, 4},
+	[FATTR4_NUMLINKS] = {put_numlinks, 4},
+	[FATTR4_RAWDEV] = {put_rawdev, 8},
+	[FATTR4_SPACE_USED] = {put_spaceused, 8},
+	[FATTR4_TIME_ACCESS] = {put_accesstime, 12},
+	[FATTR4_TIME_METADATA] = {put_metatime, 12},
+	[FATTR4_TIME_MODIFY] = {put_modifytime, 12},
+	[FATTR4_MOUNTED_ON_FILEID] = {put_mounted_on_fileid, 8},
+};
+
+#define FATTR4_PLAN_MAX_ATTRS (BITMAP4_MAPLEN * 32)
+#define FATTR4_PLAN_CACHE_SIZE 8
+
+struct fattr4_step {
+	uint8_t first;		/*< First attribute of the step in attrs */
+	uint8_t count;		/*< Attributes in a fixed size run, 0 for
+				    one attribute using its encoder */
+	uint16_t bytes;		/*< Size of a fixed size run */
+};
+
+struct fattr4_plan {
+	struct bitmap4 request;	/*< Requested attributes */
+	int max_attr_idx;	/*< Highest attribute allowed */
+	struct bitmap4 result;	/*< Attributes encoded unless one of them
+				    turns out to be unsupported */
+	uint8_t nattrs;		/*< Attributes to encode */
+	uint8_t nsteps;		/*< Steps to encode them in */
+	uint8_t attrs[FATTR4_PLAN_MAX_ATTRS];
+	struct fattr4_step steps[FATTR4_PLAN_MAX_ATTRS];
+};
+
+static __thread struct fattr4_plan fattr4_plans[FATTR4_PLAN_CACHE_SIZE];
+
+static void fattr4_plan_build(struct fattr4_plan *plan, struct bitmap4 *Bitmap,
+			      int max_attr_idx)
+{
+	struct fattr4_step *step = NULL;
+	unsigned int bytes;
+	int attr;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->request = *Bitmap;
+	plan->max_attr_idx = max_attr_idx;
+
+	for (attr = next_attr_from_bitmap(Bitmap, -1);
+	     attr != -1 && attr <= max_attr_idx;
+	     attr = next_attr_from_bitmap(Bitmap, attr)) {
+		bytes = attr <= FATTR4_MOUNTED_ON_FILEID
+			? fattr4_fixed[attr].bytes : 0;
+
+		if (bytes != 0 && step != NULL && step->count != 0) {
+			/* Extend the current fixed size run */
+			step->count++;
+			step->bytes += bytes;
+		} else {
+			step = &plan->steps[plan->nsteps++];
+			step->first = plan->nattrs;
+			step->count = bytes != 0 ? 1 : 0;
+			step->bytes = bytes;
+		}
+
+		plan->attrs[plan->nattrs++] = attr;
+		(void) set_attribute_in_bitmap(&plan->result, attr);
+	}
+}
+
 /**
- * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
+ * @brief Get the encode plan for a bitmap
  *
- * Converts FSAL Attributes to NFSv4 Fattr buffer.
+ * @param[in] Bitmap        Requested attributes
+ * @param[in] max_attr_idx  Highest attribute of the minor version
+ *
+ * @return The plan, valid until the next call from this thread.
+ */
+static const struct fattr4_plan *fattr4_plan_get(struct bitmap4 *Bitmap,
+						 int max_attr_idx)
+{
+	struct fattr4_plan *plan;
+	uint32_t hash = max_attr_idx;
+	u_int i;
+
+	for (i = 0; i < Bitmap->bitmap4_len; i++)
+		hash = hash * 0x9e3779b1 + Bitmap->map[i];
+
+	plan = &fattr4_plans[(hash ^ (hash >> 16)) % FATTR4_PLAN_CACHE_SIZE];
+
+	if (plan->max_attr_idx == max_attr_idx &&
+	    plan->request.bitmap4_len == Bitmap->bitmap4_len &&
+	    memcmp(plan->request.map, Bitmap->map,
+		   Bitmap->bitmap4_len * sizeof(uint32_t)) == 0)
+		return plan;
+
+	fattr4_plan_build(plan, Bitmap, max_attr_idx);
+
+	return plan;
+}
+
+/**
+ * @brief Converts FSAL Attributes to NFSv4 Fattr, in the caller's buffer
  *
  * @param[in]  args    XDR attribute arguments
  * @param[in]  Bitmap  Bitmap of attributes being requested
- * @param[out] Fattr   NFSv4 Fattr buffer
- *		       Memory for bitmap_val and attr_val is
- *                     dynamically allocated,
- *		       caller is responsible for freeing it.
+ * @param[out] Fattr   NFSv4 Fattr, its attr_vals in vals, or NULL if
+ *                     there are none
+ * @param[in]  vals    Room for the values, NFS4_ATTRVALS_BUFFLEN bytes
  *
  * @return -1 if failed, 0 if successful.
- *
  */
 
-int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
-			   fattr4 *Fattr)
+int nfs4_FSALattr_To_Fattr_buf(struct xdr_attrs_args *args,
+			       struct bitmap4 *Bitmap, fattr4 *Fattr,
+			       char *vals)
 {
 	int attribute_to_set = 0;
 	int max_attr_idx;
@@ -3393,6 +3616,12 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	fsal_dynamicfsinfo_t dynamicinfo;
 	XDR attr_body;
 	fattr_xdr_result xdr_res;
+	const struct fattr4_plan *plan;
+	const struct fattr4_step *step;
+	const uint8_t *attrs;
+	int32_t *buf;
+	bool noop = false;
+	u_int count, n, s;
 
 	/* basic init */
 	memset(Fattr, 0, sizeof(*Fattr));
@@ -3400,7 +3629,7 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (Bitmap->bitmap4_len == 0)
 		return 0;	/* they ask for nothing, they get nothing */
 
-	Fattr->attr_vals.attrlist4_val = gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
+	Fattr->attr_vals.attrlist4_val = vals;
 
 	max_attr_idx = nfs4_max_attr_index(args->data);
 	LogFullDebug(COMPONENT_NFS_V4, "Maximum allowed attr index = %d",
@@ -3414,56 +3643,125 @@ int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
 	if (args->dynamicinfo == NULL)
 		args->dynamicinfo = &dynamicinfo;
 
-	for (attribute_to_set = next_attr_from_bitmap(Bitmap, -1);
-	     attribute_to_set != -1;
-	     attribute_to_set =
-	     next_attr_from_bitmap(Bitmap, attribute_to_set)) {
-		if (attribute_to_set > max_attr_idx)
-			break;	/* skip out of bounds */
+	plan = fattr4_plan_get(Bitmap, max_attr_idx);
+	Fattr->attrmask = plan->result;
 
-		xdr_res = fattr4tab[attribute_to_set].encode(&attr_body, args);
-		if (xdr_res == FATTR_XDR_SUCCESS) {
-			bool res = set_attribute_in_bitmap(&Fattr->attrmask,
-							   attribute_to_set);
-			assert(res);
-			LogFullDebug(COMPONENT_NFS_V4,
-				     "Encoded attr %d, name = %s",
-				     attribute_to_set,
-				     fattr4tab[attribute_to_set].name);
-		} else if (xdr_res == FATTR_XDR_NOOP) {
-			LogFullDebug(COMPONENT_NFS_V4,
-				     "Attr not supported %d name=%s",
-				     attribute_to_set,
-				     fattr4tab[attribute_to_set].name);
-			continue;
-		} else {
-			LogFullDebug(COMPONENT_NFS_V4,
-				     "Encode FAILED for attr %d, name = %s",
-				     attribute_to_set,
-				     fattr4tab[attribute_to_set].name);
+	for (s = 0; s < plan->nsteps; s++) {
+		step = &plan->steps[s];
+		attrs = &plan->attrs[step->first];
+		count = 1;
+
+		if (step->count != 0) {
+			buf = XDR_INLINE(&attr_body, step->bytes);
+			if (buf != NULL) {
+				for (n = 0; n < step->count && buf != NULL; n++)
+					buf = fattr4_fixed[attrs[n]].put(buf,
+									 args);
+				if (buf != NULL)
+					continue;
+
+				LogFullDebug(COMPONENT_NFS_V4,
+					     "Encode FAILED for attr %d, name = %s",
+					     attrs[n - 1],
+					     fattr4tab[attrs[n - 1]].name);
+				goto err;
+			}
 
-			/* signal fail so if(LastOffset > 0) works right */
-			goto err;
+			/* Not enough room left, let the encoders fail */
+			count = step->count;
 		}
-		/* mark the attribute in the bitmap should be new bitmap btw */
+
+		for (n = 0; n < count; n++) {
+			attribute_to_set = attrs[n];
+			xdr_res = fattr4tab[attribute_to_set].encode(&attr_body,
+								     args);
+			if (xdr_res == FATTR_XDR_SUCCESS) {
+				LogFullDebug(COMPONENT_NFS_V4,
+					     "Encoded attr %d, name = %s",
+					     attribute_to_set,
+					     fattr4tab[attribute_to_set].name);
+			} else if (xdr_res == FATTR_XDR_NOOP) {
+				LogFullDebug(COMPONENT_NFS_V4,
+					     "Attr not supported %d name=%s",
+					     attribute_to_set,
+					     fattr4tab[attribute_to_set].name);
+				clear_attribute_in_bitmap(&Fattr->attrmask,
+							  attribute_to_set);
+				noop = true;
+			} else {
+				LogFullDebug(COMPONENT_NFS_V4,
+					     "Encode FAILED for attr %d, name = %s",
+					     attribute_to_set,
+					     fattr4tab[attribute_to_set].name);
+
+				/* signal fail so if(LastOffset > 0) works
+				 * right
+				 */
+				goto err;
+			}
+		}
+	}
+
+	if (noop) {
+		/* Drop the words left empty by unsupported attributes */
+		while (Fattr->attrmask.bitmap4_len > 0 &&
+		       Fattr->attrmask.map[Fattr->attrmask.bitmap4_len - 1]
+		       == 0)
+			Fattr->attrmask.bitmap4_len--;
 	}
+
 	LastOffset = xdr_getpos(&attr_body);	/* dumb but for now */
 	xdr_destroy(&attr_body);
 
-	if (LastOffset == 0) {	/* no supported attrs so we can free */
+	if (LastOffset == 0) {	/* no supported attrs */
 		assert(Fattr->attrmask.bitmap4_len == 0);
-		gsh_free(Fattr->attr_vals.attrlist4_val);
 		Fattr->attr_vals.attrlist4_val = NULL;
 	}
 	Fattr->attr_vals.attrlist4_len = LastOffset;
 	return 0;
 
  err:
-	gsh_free(Fattr->attr_vals.attrlist4_val);
 	Fattr->attr_vals.attrlist4_val = NULL;
 	return -1;
 }
 
+/**
+ * @brief Converts FSAL Attributes to NFSv4 Fattr buffer.
+ *
+ * Converts FSAL Attributes to NFSv4 Fattr buffer.
+ *
+ * @param[in]  args    XDR attribute arguments
+ * @param[in]  Bitmap  Bitmap of attributes being requested
+ * @param[out] Fattr   NFSv4 Fattr buffer
+ *		       Memory for bitmap_val and attr_val is
+ *                     dynamically allocated,
+ *		       caller is responsible for freeing it.
+ *
+ * @return -1 if failed, 0 if successful.
+ *
+ */
+
+int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *args, struct bitmap4 *Bitmap,
+			   fattr4 *Fattr)
+{
+	char *vals;
+	int rc;
+
+	if (Bitmap->bitmap4_len == 0) {
+		/* they ask for nothing, they get nothing */
+		memset(Fattr, 0, sizeof(*Fattr));
+		return 0;
+	}
+
+	vals = gsh_malloc(NFS4_ATTRVALS_BUFFLEN);
+	rc = nfs4_FSALattr_To_Fattr_buf(args, Bitmap, Fattr, vals);
+
+	if (Fattr->attr_vals.attrlist4_val == NULL)
+		gsh_free(vals);
+
+	return rc;
+}
+
 /**
  *
  * nfs3_Sattr_To_FSALattr: Converts NFSv3 Sattr to FSAL Attributes.
@@ -4198,6 +4496,24 @@ int nfs4_Fattr_To_FSAL_attr(struct attrlist *FSAL_attr, fattr4 *Fattr,
 	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, NULL, NULL, data);
 }
 
+/**
+ * @brief Convert NFSv4 attributes and get the file handle among them
+ *
+ * @param[out] FSAL_attr FSAL attributes
+ * @param[in]  Fattr     NFSv4 attributes
+ * @param[out] hdl4      File handle, nfs_fh4_val must point to a buffer of
+ *                       NFS4_FHSIZE bytes.  nfs_fh4_len is left untouched
+ *                       if FATTR4_FILEHANDLE is not in Fattr.
+ *
+ * @return NFS4_OK if successful, NFS4ERR codes if not.
+ */
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *FSAL_attr, fattr4 *Fattr,
+			       nfs_fh4 *hdl4)
+{
+	memset(FSAL_attr, 0, sizeof(struct attrlist));
+	return Fattr4_To_FSAL_attr(FSAL_attr, Fattr, hdl4, NULL, NULL);
+}
+
 /**
  *
  * nfs4_Fattr_To_fsinfo: Decode filesystem info out of NFSv4 attributes.
@@ -4220,6 +4536,20 @@ int nfs4_Fattr_To_fsinfo(fsal_dynamicfsinfo_t *dinfo, fattr4 *Fattr)
 	return Fattr4_To_FSAL_attr(NULL, Fattr, NULL, dinfo, NULL);
 }
 
+/* Check the length of an XDR string before unpacking it */
+static nfsstat4 nfs4_utf8string_check(const utf8string *input,
+				      utf8_scantype_t scan)
+{
+	if (input->utf8string_val == NULL || input->utf8string_len == 0)
+		return NFS4ERR_INVAL;
+
+	if ((scan == UTF8_SCAN_SYMLINK && input->utf8string_len > MAXPATHLEN) ||
+	    (scan != UTF8_SCAN_SYMLINK && input->utf8string_len > MAXNAMLEN))
+		return NFS4ERR_NAMETOOLONG;
+
+	return NFS4_OK;
+}
+
 /* nfs4_utf8string2dynamic
  * unpack the input string from the XDR into a null term'd string
  * scan for bad chars
@@ -4229,16 +4559,13 @@ nfsstat4 nfs4_utf8string2dynamic(const utf8string *input,
 				 utf8_scantype_t scan,
 				 char **obj_name)
 {
-	nfsstat4 status = NFS4_OK;
+	nfsstat4 status;
 
 	*obj_name = NULL;
 
-	if (input->utf8string_val == NULL || input->utf8string_len == 0)
-		return NFS4ERR_INVAL;
-
-	if ((scan == UTF8_SCAN_SYMLINK && input->utf8string_len > MAXPATHLEN) ||
-	    (scan != UTF8_SCAN_SYMLINK && input->utf8string_len > MAXNAMLEN))
-		return NFS4ERR_NAMETOOLONG;
+	status = nfs4_utf8string_check(input, scan);
+	if (status != NFS4_OK)
+		return status;
 
 	char *name = gsh_malloc(input->utf8string_len + 1);
 
@@ -4253,6 +4580,36 @@ nfsstat4 nfs4_utf8string2dynamic(const utf8string *input,
 	return status;
 }
 
+/* nfs4_utf8string2arena
+ * same as nfs4_utf8string2dynamic, but the string is carved from an
+ * arena and must not be freed
+ */
+
+nfsstat4 nfs4_utf8string2arena(struct gsh_arena *arena,
+			       const utf8string *input,
+			       utf8_scantype_t scan,
+			       char **obj_name)
+{
+	nfsstat4 status;
+	char *name;
+
+	*obj_name = NULL;
+
+	status = nfs4_utf8string_check(input, scan);
+	if (status != NFS4_OK)
+		return status;
+
+	name = gsh_arena_alloc(arena, input->utf8string_len + 1);
+
+	memcpy(name, input->utf8string_val, input->utf8string_len);
+	name[input->utf8string_len] = '\0';
+	if (scan != UTF8_SCAN_NONE)
+		status = path_filter(name, scan);
+	if (status == NFS4_OK)
+		*obj_name = name;
+	return status;
+}
+
 /**
  * @brief: is a directory's sticky bit set?
  *
@@ -4272,3 +4629,82 @@ bool is_sticky_bit_set(struct fsal_obj_handle *obj,
 
 	return true;
 }
+
+/**
+ * @brief Start encoding the entries of a READDIR reply
+ *
+ * @param[out] ds   The stream
+ * @param[in]  room Bytes the entries may take, not 0
+ */
+void nfs_dirent_stream_init(struct nfs_dirent_stream *ds, u_int room)
+{
+	ds->buf = gsh_malloc(room);
+	ds->mark = 0;
+	ds->count = 0;
+	xdrmem_create(&ds->xdrs, ds->buf, room, XDR_ENCODE);
+}
+
+/**
+ * @brief Begin an entry, with its "value follows"
+ *
+ * @retval false if out of room; end the entry anyway.
+ */
+bool nfs_dirent_stream_start(struct nfs_dirent_stream *ds)
+{
+	bool_t follows = TRUE;
+
+	return xdr_bool(&ds->xdrs, &follows);
+}
+
+/**
+ * @brief End an entry
+ *
+ * @param[in,out] ds    The stream
+ * @param[in]     whole Whether it was all encoded, or must be dropped
+ */
+void nfs_dirent_stream_end(struct nfs_dirent_stream *ds, bool whole)
+{
+	if (whole) {
+		ds->mark = xdr_getpos(&ds->xdrs);
+		ds->count++;
+	} else {
+		(void) xdr_setpos(&ds->xdrs, ds->mark);
+	}
+}
+
+/**
+ * @brief Hand the entries over to the reply
+ *
+ * @param[in,out] ds          The stream, released
+ * @param[out]    encoded     The entries, NULL if none
+ * @param[out]    encoded_len Their length
+ */
+void nfs_dirent_stream_take(struct nfs_dirent_stream *ds, char **encoded,
+			    u_int *encoded_len)
+{
+	xdr_destroy(&ds->xdrs);
+
+	if (ds->count == 0) {
+		gsh_free(ds->buf);
+		*encoded = NULL;
+		*encoded_len = 0;
+	} else {
+		*encoded = ds->buf;
+		*encoded_len = ds->mark;
+	}
+
+	ds->buf = NULL;
+}
+
+/**
+ * @brief Drop the entries, if not taken
+ */
+void nfs_dirent_stream_release(struct nfs_dirent_stream *ds)
+{
+	if (ds->buf == NULL)
+		return;
+
+	xdr_destroy(&ds->xdrs);
+	gsh_free(ds->buf);
+	ds->buf = NULL;
+}
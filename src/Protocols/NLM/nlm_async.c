@@ -24,6 +24,7 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <errno.h>
 #include <pthread.h>
 #include <rpc/types.h>
 #include <rpc/nettype.h>
@@ -35,9 +36,6 @@
 #include "nlm_util.h"
 #include "nlm_async.h"
 
-pthread_mutex_t nlm_async_resp_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t nlm_async_resp_cond = PTHREAD_COND_INITIALIZER;
-
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 			    nfs_res_t *pres)
 {
@@ -112,152 +110,179 @@ xdrproc_t nlm_reply_proc[] = {
 	[NLMPROC4_UNLOCK_RES] = (xdrproc_t) xdr_nlm4_res,
 };
 
-static void *resp_key;
-
 static const int MAX_ASYNC_RETRY = 2;
 
-/* Client routine  to send the asynchrnous response,
- * key is used to wait for a response
+/**
+ * @brief Connect the callback client of a host
+ *
+ * Called with the host's slc_mutex held.  The client stays on the host
+ * and carries all the callbacks to it until a call fails.
+ *
+ * @return RPC_SUCCESS, RPC_UNKNOWNADDR if worth a retry, -1 otherwise.
+ */
+static int nlm_callback_clnt(state_nlm_client_t *host)
+{
+	int retval;
+
+	LogFullDebug(COMPONENT_NLM,
+		     "gsh_clnt_create %s",
+		     host->slc_nsm_client->ssc_nlm_caller_name);
+
+	if (host->slc_client_type == XPRT_TCP) {
+		int fd;
+		struct sockaddr_in6 server_addr;
+		struct netbuf *buf, local_buf;
+		struct addrinfo *result;
+		struct addrinfo hints;
+		char port_str[20];
+
+		fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
+		if (fd < 0)
+			return -1;
+
+		memcpy(&server_addr,
+		       &(host->slc_server_addr),
+		       sizeof(struct sockaddr_in6));
+		server_addr.sin6_port = 0;
+
+		if (bind(fd,
+			 (struct sockaddr *)&server_addr,
+			  sizeof(server_addr)) == -1) {
+			LogMajor(COMPONENT_NLM, "Cannot bind");
+			close(fd);
+			return -1;
+		}
+
+		buf = rpcb_find_mapped_addr(
+		     (char *) xprt_type_to_str(
+					host->slc_client_type),
+		     NLMPROG, NLM4_VERS,
+		     host->slc_nsm_client->ssc_nlm_caller_name);
+		/* handle error here, for example,
+		 * client side blocking rpc call
+		 */
+		if (buf == NULL) {
+			LogMajor(COMPONENT_NLM,
+				 "Cannot create NLM async %s connection to client %s",
+				 xprt_type_to_str(
+					host->slc_client_type),
+				 host->slc_nsm_client->
+				 ssc_nlm_caller_name);
+			close(fd);
+			return -1;
+		}
+
+		memset(&hints, 0, sizeof(struct addrinfo));
+		hints.ai_family = AF_INET6;	/* only INET6 */
+		hints.ai_socktype = SOCK_STREAM; /* TCP */
+		hints.ai_protocol = 0;	/* Any protocol */
+		hints.ai_canonname = NULL;
+		hints.ai_addr = NULL;
+		hints.ai_next = NULL;
+
+		/* convert port to string format */
+		sprintf(port_str, "%d",
+			htons(((struct sockaddr_in *)
+				buf->buf)->sin_port));
+
+		/* buf with inet is only needed for the port */
+		gsh_free(buf->buf);
+		gsh_free(buf);
+
+		/* get the IPv4 mapped IPv6 address */
+		retval = getaddrinfo(host->slc_nsm_client->
+				     ssc_nlm_caller_name,
+				     port_str,
+				     &hints,
+				     &result);
+
+		/* retry for spurious EAI_NONAME errors */
+		if (retval == EAI_NONAME ||
+		    retval == EAI_AGAIN) {
+			LogEvent(COMPONENT_NLM,
+				 "failed to resolve %s to an address: %s",
+				 host->slc_nsm_client->
+				 ssc_nlm_caller_name,
+				 gai_strerror(retval));
+			/* getaddrinfo() failed, retry */
+			usleep(1000);
+			return RPC_UNKNOWNADDR;
+		} else if (retval != 0) {
+			LogMajor(COMPONENT_NLM,
+				 "failed to resolve %s to an address: %s",
+				 host->slc_nsm_client->
+				 ssc_nlm_caller_name,
+				 gai_strerror(retval));
+			return -1;
+		}
+
+		/* setup the netbuf with in6 address */
+		local_buf.buf = result->ai_addr;
+		local_buf.len = local_buf.maxlen =
+		    result->ai_addrlen;
+
+		host->slc_callback_clnt =
+		    clnt_vc_ncreate(fd, &local_buf, NLMPROG,
+				    NLM4_VERS, 0, 0);
+		freeaddrinfo(result);
+	} else {
+
+		host->slc_callback_clnt = gsh_clnt_create(
+		    host->slc_nsm_client->ssc_nlm_caller_name,
+		    NLMPROG,
+		    NLM4_VERS,
+		    (char *) xprt_type_to_str(
+				host->slc_client_type));
+	}
+
+	if (host->slc_callback_clnt == NULL) {
+		LogMajor(COMPONENT_NLM,
+			 "Cannot create NLM async %s connection to client %s",
+			 xprt_type_to_str(host->
+					  slc_client_type),
+			 host->slc_nsm_client->
+			 ssc_nlm_caller_name);
+		return -1;
+	}
+
+	/* split auth (for authnone, idempotent) */
+	host->slc_callback_auth = authnone_create();
+
+	return RPC_SUCCESS;
+}
+
+/**
+ * @brief Send an asynchronous message to a client
+ *
+ * The call is a one way send; a response the client sends back comes in
+ * as a request of its own (for GRANTED_MSG, nlm4_Granted_Res completes
+ * the grant), so nothing waits for it here.
+ *
+ * @param[in] proc   NLM procedure
+ * @param[in] host   Client to send to
+ * @param[in] inarg  Arguments of the procedure
+ *
+ * @return RPC_SUCCESS if sent.
  */
-int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
+int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg)
 {
 	struct timeval tout = { 0, 10 };
-	int retval, retry;
-	struct timeval start, now;
-	struct timespec timeout;
+	int retval = -1, retry;
 
 	for (retry = 0; retry < MAX_ASYNC_RETRY; retry++) {
+		PTHREAD_MUTEX_lock(&host->slc_mutex);
+
 		if (host->slc_callback_clnt == NULL) {
-			LogFullDebug(COMPONENT_NLM,
-				     "gsh_clnt_create %s",
-				     host->slc_nsm_client->ssc_nlm_caller_name);
-
-			if (host->slc_client_type == XPRT_TCP) {
-				int fd;
-				struct sockaddr_in6 server_addr;
-				struct netbuf *buf, local_buf;
-				struct addrinfo *result;
-				struct addrinfo hints;
-				char port_str[20];
-
-				fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP);
-				if (fd < 0)
-					return -1;
-
-				memcpy(&server_addr,
-				       &(host->slc_server_addr),
-				       sizeof(struct sockaddr_in6));
-				server_addr.sin6_port = 0;
-
-				if (bind(fd,
-					 (struct sockaddr *)&server_addr,
-					  sizeof(server_addr)) == -1) {
-					LogMajor(COMPONENT_NLM, "Cannot bind");
-					close(fd);
-					return -1;
-				}
-
-				buf = rpcb_find_mapped_addr(
-				     (char *) xprt_type_to_str(
-							host->slc_client_type),
-				     NLMPROG, NLM4_VERS,
-				     host->slc_nsm_client->ssc_nlm_caller_name);
-				/* handle error here, for example,
-				 * client side blocking rpc call
-				 */
-				if (buf == NULL) {
-					LogMajor(COMPONENT_NLM,
-						 "Cannot create NLM async %s connection to client %s",
-						 xprt_type_to_str(
-							host->slc_client_type),
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name);
-					close(fd);
-					return -1;
-				}
-
-				memset(&hints, 0, sizeof(struct addrinfo));
-				hints.ai_family = AF_INET6;	/* only INET6 */
-				hints.ai_socktype = SOCK_STREAM; /* TCP */
-				hints.ai_protocol = 0;	/* Any protocol */
-				hints.ai_canonname = NULL;
-				hints.ai_addr = NULL;
-				hints.ai_next = NULL;
-
-				/* convert port to string format */
-				sprintf(port_str, "%d",
-					htons(((struct sockaddr_in *)
-						buf->buf)->sin_port));
-
-				/* buf with inet is only needed for the port */
-				gsh_free(buf->buf);
-				gsh_free(buf);
-
-				/* get the IPv4 mapped IPv6 address */
-				retval = getaddrinfo(host->slc_nsm_client->
-						     ssc_nlm_caller_name,
-						     port_str,
-						     &hints,
-						     &result);
-
-				/* retry for spurious EAI_NONAME errors */
-				if (retval == EAI_NONAME ||
-				    retval == EAI_AGAIN) {
-					LogEvent(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name,
-						 gai_strerror(retval));
-					/* getaddrinfo() failed, retry */
-					retval = RPC_UNKNOWNADDR;
-					usleep(1000);
-					continue;
-				} else if (retval != 0) {
-					LogMajor(COMPONENT_NLM,
-						 "failed to resolve %s to an address: %s",
-						 host->slc_nsm_client->
-						 ssc_nlm_caller_name,
-						 gai_strerror(retval));
-					return -1;
-				}
-
-				/* setup the netbuf with in6 address */
-				local_buf.buf = result->ai_addr;
-				local_buf.len = local_buf.maxlen =
-				    result->ai_addrlen;
-
-				host->slc_callback_clnt =
-				    clnt_vc_ncreate(fd, &local_buf, NLMPROG,
-						    NLM4_VERS, 0, 0);
-				freeaddrinfo(result);
-			} else {
-
-				host->slc_callback_clnt = gsh_clnt_create(
-				    host->slc_nsm_client->ssc_nlm_caller_name,
-				    NLMPROG,
-				    NLM4_VERS,
-				    (char *) xprt_type_to_str(
-						host->slc_client_type));
-			}
+			retval = nlm_callback_clnt(host);
 
-			if (host->slc_callback_clnt == NULL) {
-				LogMajor(COMPONENT_NLM,
-					 "Cannot create NLM async %s connection to client %s",
-					 xprt_type_to_str(host->
-							  slc_client_type),
-					 host->slc_nsm_client->
-					 ssc_nlm_caller_name);
-				return -1;
+			if (retval != RPC_SUCCESS) {
+				PTHREAD_MUTEX_unlock(&host->slc_mutex);
+				if (retval == RPC_UNKNOWNADDR)
+					continue;
+				break;
 			}
-
-			/* split auth (for authnone, idempotent) */
-			host->slc_callback_auth = authnone_create();
 		}
 
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = key;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-
 		LogFullDebug(COMPONENT_NLM, "About to make clnt_call");
 
 		retval = clnt_call(host->slc_callback_clnt,
@@ -272,6 +297,7 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 		LogFullDebug(COMPONENT_NLM, "Done with clnt_call");
 
 		if (retval == RPC_TIMEDOUT || retval == RPC_SUCCESS) {
+			PTHREAD_MUTEX_unlock(&host->slc_mutex);
 			retval = RPC_SUCCESS;
 			break;
 		}
@@ -283,60 +309,13 @@ int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key)
 
 		gsh_clnt_destroy(host->slc_callback_clnt);
 		host->slc_callback_clnt = NULL;
+		PTHREAD_MUTEX_unlock(&host->slc_mutex);
 	}
 
-	if (retry == MAX_ASYNC_RETRY) {
+	if (retry == MAX_ASYNC_RETRY)
 		LogMajor(COMPONENT_NLM,
 			 "NLM async Client exceeded retry count %d",
 			 MAX_ASYNC_RETRY);
-		PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-		resp_key = NULL;
-		PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-		return retval;
-	}
-
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-
-	if (resp_key != NULL) {
-		/* Wait for 5 seconds or a signal */
-		gettimeofday(&start, NULL);
-		gettimeofday(&now, NULL);
-		timeout.tv_sec = 5 + start.tv_sec;
-		timeout.tv_nsec = 0;
-
-		LogFullDebug(COMPONENT_NLM,
-			     "About to wait for signal for key %p", resp_key);
-
-		while (resp_key != NULL && now.tv_sec < (start.tv_sec + 5)) {
-			int rc;
-
-			rc = pthread_cond_timedwait(&nlm_async_resp_cond,
-						    &nlm_async_resp_mutex,
-						    &timeout);
-			LogFullDebug(COMPONENT_NLM,
-				     "pthread_cond_timedwait returned %d",
-				     rc);
-			gettimeofday(&now, NULL);
-		}
-		LogFullDebug(COMPONENT_NLM, "Done waiting");
-	}
-
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
 
 	return retval;
 }
-
-void nlm_signal_async_resp(void *key)
-{
-	PTHREAD_MUTEX_lock(&nlm_async_resp_mutex);
-
-	if (resp_key == key) {
-		resp_key = NULL;
-		pthread_cond_signal(&nlm_async_resp_cond);
-		LogFullDebug(COMPONENT_NLM, "Signaled condition variable");
-	} else {
-		LogFullDebug(COMPONENT_NLM, "Didn't signal condition variable");
-	}
-
-	PTHREAD_MUTEX_unlock(&nlm_async_resp_mutex);
-}
@@ -184,8 +184,7 @@ static void nlm4_send_grant_msg(state_async_queue_t *arg)
 
 	retval = nlm_send_async(NLMPROC4_GRANTED_MSG,
 				nlm_arg->nlm_async_host,
-				&nlm_arg->nlm_async_args.nlm_async_grant,
-				nlm_arg->nlm_async_key);
+				&nlm_arg->nlm_async_args.nlm_async_grant);
 
 	dec_nlm_client_ref(nlm_arg->nlm_async_host);
 
@@ -614,7 +613,6 @@ state_status_t nlm_granted_callback(struct fsal_obj_handle *obj,
 	arg->state_async_func = nlm4_send_grant_msg;
 	arg->state_async_data.state_nlm_async_data.nlm_async_host =
 	    nlm_grant_client;
-	arg->state_async_data.state_nlm_async_data.nlm_async_key = cookie_entry;
 	inarg = &arg->state_async_data.state_nlm_async_data.nlm_async_args.
 		nlm_async_grant;
 
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <time.h>
 #include <rpc/types.h>
 #include <rpc/nettype.h>
 #include <sys/socket.h>
@@ -13,12 +15,30 @@
 #define STR_SIZE 100
 
 #define USAGE "usage: %s [-p <port>] -l <local address> " \
-	"-m <monitor host> -r <remote address> -s <state>\n"
+	"-m <monitor host> -s <state>\n" \
+	"\t{-r <remote address> | -f <file of remote addresses>}\n" \
+	"\t[-c <concurrent notifies>] [-t <tries>] [-w <seconds per try>]\n" \
+	"\t[-n <notifies per second>]\n"
 
 #define ERR_MSG1 "%s address too long\n"
 
-/* Default timeout can be changed using clnt_control() */
-static struct timeval TIMEOUT = { 25, 0 };
+/* Try timeout, can be changed with -w */
+static struct timeval TIMEOUT = { 5, 0 };
+
+static int port;
+static int state;
+static char mon_client[STR_SIZE];
+static char local_addr_s[STR_SIZE];
+static int tries = 3;
+static int rate;
+
+/* The remote addresses, handed out to the senders in turn */
+static char **remotes;
+static int nremotes;
+static int next_remote;
+static int failed;
+static struct timespec next_send;
+static pthread_mutex_t remotes_mtx = PTHREAD_MUTEX_INITIALIZER;
 
 /* This function is dragged in by the use of abstract_mem.h, so
  * we define a simple version that does a printf rather than
@@ -34,7 +54,7 @@ void LogMallocFailure(const char *file, int line, const char *function,
 void *
 nsm_notify_1(notify *argp, CLIENT *clnt)
 {
-	static char clnt_res;
+	static __thread char clnt_res;
 	AUTH *nsm_auth;
 
 	nsm_auth = authnone_create();
@@ -49,24 +69,178 @@ nsm_notify_1(notify *argp, CLIENT *clnt)
 	return (void *)&clnt_res;
 }
 
-int main(int argc, char **argv)
+/**
+ * @brief Notify one remote host
+ *
+ * @return 0 if the host acknowledged the notify.
+ */
+static int notify_one(const char *remote_addr_s)
 {
-	int c;
-	int port = 0;
-	int state = 0, sflag = 0;
-	char mon_client[STR_SIZE], mflag = 0;
-	char remote_addr_s[STR_SIZE], rflag = 0;
-	char local_addr_s[STR_SIZE], lflag = 0;
 	notify arg;
 	CLIENT *clnt;
 	struct netbuf *buf;
-	char port_str[20];
-
 	struct sockaddr_in local_addr;
+	int fd, try, rc = 1;
+
+	/* create a udp socket */
+	fd = socket(PF_INET, SOCK_DGRAM|SOCK_NONBLOCK, IPPROTO_UDP);
+	if (fd < 0) {
+		fprintf(stderr, "socket call failed. errno=%d\n", errno);
+		return 1;
+	}
+
+	/* set up the sockaddr for local endpoint, the concurrent senders
+	 * cannot share a port */
+	memset(&local_addr, 0, sizeof(struct sockaddr_in));
+	local_addr.sin_family = PF_INET;
+	local_addr.sin_port = htons(port);
+	local_addr.sin_addr.s_addr = inet_addr(local_addr_s);
+
+	if (bind(fd, (struct sockaddr *)&local_addr,
+			sizeof(struct sockaddr)) < 0) {
+		fprintf(stderr, "bind call failed. errno=%d\n", errno);
+		close(fd);
+		return 1;
+	}
+
+	/* find the port for SM service of the remote server */
+	buf = rpcb_find_mapped_addr(
+				"udp",
+				SM_PROG, SM_VERS,
+				(char *)remote_addr_s);
+
+	/* handle error here, for example,
+	 * client side blocking rpc call
+	 */
+	if (buf == NULL) {
+		fprintf(stderr, "no statd found on %s\n", remote_addr_s);
+		close(fd);
+		return 1;
+	}
+
+	clnt = clnt_dg_ncreate(fd, buf, SM_PROG,
+			SM_VERS, 0, 0);
+
+	arg.my_name = mon_client;
+	arg.state = state;
+
+	for (try = 0; try < tries && rc != 0; try++) {
+		if (nsm_notify_1(&arg, clnt) != NULL)
+			rc = 0;
+		else if (try + 1 < tries)
+			/* Back off before trying again */
+			sleep(1 << try);
+	}
+
+	if (rc != 0)
+		fprintf(stderr, "%s did not answer SM_NOTIFY after %d tries\n",
+			remote_addr_s, tries);
+
+	/* free resources */
+	gsh_free(buf->buf);
+	gsh_free(buf);
+	clnt_destroy(clnt);
+
+	close(fd);
+
+	return rc;
+}
+
+/**
+ * @brief Wait for the next send slot of the -n rate
+ */
+static void rate_wait(void)
+{
+	struct timespec slot, now;
+
+	if (rate == 0)
+		return;
+
+	pthread_mutex_lock(&remotes_mtx);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (next_send.tv_sec < now.tv_sec ||
+	    (next_send.tv_sec == now.tv_sec &&
+	     next_send.tv_nsec < now.tv_nsec))
+		next_send = now;
+	slot = next_send;
+	next_send.tv_nsec += 1000000000L / rate;
+	if (next_send.tv_nsec >= 1000000000L) {
+		next_send.tv_sec++;
+		next_send.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_unlock(&remotes_mtx);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &slot, NULL)
+	       == EINTR)
+		;
+}
+
+/**
+ * @brief Notify the remote hosts until there is none left
+ */
+static void *sender(void *arg)
+{
+	int i;
+
+	for (;;) {
+		pthread_mutex_lock(&remotes_mtx);
+		i = next_remote++;
+		pthread_mutex_unlock(&remotes_mtx);
 
-	int fd;
+		if (i >= nremotes)
+			return NULL;
 
-	while ((c = getopt(argc, argv, "p:r:m:l:s:")) != EOF)
+		rate_wait();
+
+		if (notify_one(remotes[i]) != 0)
+			(void)__sync_fetch_and_add(&failed, 1);
+	}
+}
+
+/**
+ * @brief Read the remote addresses, one per line
+ *
+ * Blank lines and lines starting with # are skipped.
+ */
+static void read_remotes(const char *path)
+{
+	FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	char line[STR_SIZE + 2];
+	char *addr;
+	int size = 0;
+
+	if (f == NULL) {
+		fprintf(stderr, "cannot open %s. errno=%d\n", path, errno);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		addr = strtok(line, " \t\n");
+		if (addr == NULL || addr[0] == '#')
+			continue;
+
+		if (nremotes == size) {
+			size = size ? size * 2 : 64;
+			remotes = gsh_realloc(remotes,
+					      size * sizeof(*remotes));
+		}
+		remotes[nremotes++] = gsh_strdup(addr);
+	}
+
+	if (f != stdin)
+		fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	int c, i;
+	int sflag = 0, mflag = 0, lflag = 0, rflag = 0;
+	int concurrency = 16;
+	pthread_t *threads;
+	char *remote_addr_s = NULL;
+	char *remote_file = NULL;
+
+	while ((c = getopt(argc, argv, "p:r:m:l:s:f:c:t:w:n:")) != EOF)
 		switch (c) {
 		case 'p':
 			port = atoi(optarg);
@@ -88,7 +262,11 @@ int main(int argc, char **argv)
 				fprintf(stderr, ERR_MSG1, "remote address");
 				exit(1);
 			}
-			strcpy(remote_addr_s, optarg);
+			remote_addr_s = optarg;
+			rflag = 1;
+			break;
+		case 'f':
+			remote_file = optarg;
 			rflag = 1;
 			break;
 		case 'l':
@@ -99,6 +277,18 @@ int main(int argc, char **argv)
 			strcpy(local_addr_s, optarg);
 			lflag = 1;
 			break;
+		case 'c':
+			concurrency = atoi(optarg);
+			break;
+		case 't':
+			tries = atoi(optarg);
+			break;
+		case 'w':
+			TIMEOUT.tv_sec = atoi(optarg);
+			break;
+		case 'n':
+			rate = atoi(optarg);
+			break;
 		case '?':
 		default:
 			fprintf(stderr, USAGE, argv[0]);
@@ -106,63 +296,39 @@ int main(int argc, char **argv)
 			break;
 	}
 
-	if ((sflag + lflag + mflag + rflag) != 4) {
+	if ((sflag + lflag + mflag + rflag) != 4 ||
+	    (remote_addr_s != NULL && remote_file != NULL) ||
+	    concurrency < 1 || tries < 1 || TIMEOUT.tv_sec < 1 || rate < 0) {
 		fprintf(stderr, USAGE, argv[0]);
 		exit(1);
 	}
 
+	if (remote_file == NULL)
+		return notify_one(remote_addr_s);
 
-	/* create a udp socket */
-	fd = socket(PF_INET, SOCK_DGRAM|SOCK_NONBLOCK, IPPROTO_UDP);
-	if (fd < 0) {
-		fprintf(stderr, "socket call failed. errno=%d\n", errno);
-		exit(1);
-	}
-
-	/* set up the sockaddr for local endpoint */
-	memset(&local_addr, 0, sizeof(struct sockaddr_in));
-	local_addr.sin_family = PF_INET;
-	local_addr.sin_port = htons(port);
-	local_addr.sin_addr.s_addr = inet_addr(local_addr_s);
-
-	if (bind(fd, (struct sockaddr *)&local_addr,
-			sizeof(struct sockaddr)) < 0) {
-		fprintf(stderr, "bind call failed. errno=%d\n", errno);
-		exit(1);
-	}
+	read_remotes(remote_file);
 
-	/* find the port for SM service of the remote server */
-	buf = rpcb_find_mapped_addr(
-				"udp",
-				SM_PROG, SM_VERS,
-				remote_addr_s);
+	/* A fixed port only works for one sender at a time */
+	if (port != 0)
+		concurrency = 1;
+	if (concurrency > nremotes)
+		concurrency = nremotes;
 
-	/* handle error here, for example,
-	 * client side blocking rpc call
-	 */
-	if (buf == NULL) {
-		close(fd);
-		exit(1);
+	threads = gsh_calloc(concurrency, sizeof(*threads));
+	for (i = 0; i < concurrency; i++) {
+		if (pthread_create(&threads[i], NULL, sender, NULL) != 0) {
+			fprintf(stderr, "pthread_create failed. errno=%d\n",
+				errno);
+			exit(1);
+		}
 	}
 
-	/* convert port to string format */
-	sprintf(port_str, "%d",
-		htons(((struct sockaddr_in *)
-		buf->buf)->sin_port));
-
-	clnt = clnt_dg_ncreate(fd, buf, SM_PROG,
-			SM_VERS, 0, 0);
-
-	arg.my_name = mon_client;
-	arg.state = state;
-	nsm_notify_1(&arg, clnt);
-
-	/* free resources */
-	gsh_free(buf->buf);
-	gsh_free(buf);
-	clnt_destroy(clnt);
+	for (i = 0; i < concurrency; i++)
+		pthread_join(threads[i], NULL);
 
-	close(fd);
+	if (failed != 0)
+		fprintf(stderr, "%d of %d hosts were not notified\n",
+			failed, nremotes);
 
-	return 0;
+	return failed != 0;
 }
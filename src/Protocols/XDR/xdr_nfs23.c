@@ -13,6 +13,74 @@ static struct nfs_request_lookahead dummy_lookahead = {
 	.write = 0
 };
 
+/* Inline fast paths for the attributes and arguments of the hot NFSv3
+ * operations.  When XDR_INLINE() hands out the whole object from the
+ * current buffer it is moved with one bounds check; otherwise, as when
+ * it straddles two buffers of a record, the field by field code below
+ * is used.
+ */
+
+/** XDR units of a fattr3 */
+#define FATTR3_UNITS 21
+
+/** XDR units of a wcc_attr */
+#define WCC_ATTR_UNITS 6
+
+#define IXDR_PUT_NFS3_UINT64(buf, v)				\
+	do {							\
+		IXDR_PUT_U_LONG((buf), (uint32_t) ((v) >> 32));	\
+		IXDR_PUT_U_LONG((buf), (uint32_t) (v));		\
+	} while (0)
+
+#define IXDR_GET_NFS3_UINT64(buf, v)				\
+	do {							\
+		(v) = (uint64_t) (uint32_t) IXDR_GET_U_LONG(buf) << 32;	\
+		(v) |= (uint32_t) IXDR_GET_U_LONG(buf);		\
+	} while (0)
+
+static inline int32_t *fattr3_put(int32_t *buf, const fattr3 *objp)
+{
+	IXDR_PUT_U_LONG(buf, objp->type);
+	IXDR_PUT_U_LONG(buf, objp->mode);
+	IXDR_PUT_U_LONG(buf, objp->nlink);
+	IXDR_PUT_U_LONG(buf, objp->uid);
+	IXDR_PUT_U_LONG(buf, objp->gid);
+	IXDR_PUT_NFS3_UINT64(buf, objp->size);
+	IXDR_PUT_NFS3_UINT64(buf, objp->used);
+	IXDR_PUT_U_LONG(buf, objp->rdev.specdata1);
+	IXDR_PUT_U_LONG(buf, objp->rdev.specdata2);
+	IXDR_PUT_NFS3_UINT64(buf, objp->fsid);
+	IXDR_PUT_NFS3_UINT64(buf, objp->fileid);
+	IXDR_PUT_U_LONG(buf, objp->atime.tv_sec);
+	IXDR_PUT_U_LONG(buf, objp->atime.tv_nsec);
+	IXDR_PUT_U_LONG(buf, objp->mtime.tv_sec);
+	IXDR_PUT_U_LONG(buf, objp->mtime.tv_nsec);
+	IXDR_PUT_U_LONG(buf, objp->ctime.tv_sec);
+	IXDR_PUT_U_LONG(buf, objp->ctime.tv_nsec);
+	return buf;
+}
+
+static inline void fattr3_get(int32_t *buf, fattr3 *objp)
+{
+	objp->type = IXDR_GET_U_LONG(buf);
+	objp->mode = IXDR_GET_U_LONG(buf);
+	objp->nlink = IXDR_GET_U_LONG(buf);
+	objp->uid = IXDR_GET_U_LONG(buf);
+	objp->gid = IXDR_GET_U_LONG(buf);
+	IXDR_GET_NFS3_UINT64(buf, objp->size);
+	IXDR_GET_NFS3_UINT64(buf, objp->used);
+	objp->rdev.specdata1 = IXDR_GET_U_LONG(buf);
+	objp->rdev.specdata2 = IXDR_GET_U_LONG(buf);
+	IXDR_GET_NFS3_UINT64(buf, objp->fsid);
+	IXDR_GET_NFS3_UINT64(buf, objp->fileid);
+	objp->atime.tv_sec = IXDR_GET_U_LONG(buf);
+	objp->atime.tv_nsec = IXDR_GET_U_LONG(buf);
+	objp->mtime.tv_sec = IXDR_GET_U_LONG(buf);
+	objp->mtime.tv_nsec = IXDR_GET_U_LONG(buf);
+	objp->ctime.tv_sec = IXDR_GET_U_LONG(buf);
+	objp->ctime.tv_nsec = IXDR_GET_U_LONG(buf);
+}
+
 bool xdr_nfspath2(xdrs, objp)
 register XDR *xdrs;
 nfspath2 *objp;
@@ -487,6 +555,20 @@ fattr3 *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = XDR_INLINE(xdrs, FATTR3_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			fattr3_put(buf, objp);
+			return (true);
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = XDR_INLINE(xdrs, FATTR3_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			fattr3_get(buf, objp);
+			return (true);
+		}
+	}
+
 	if (!xdr_ftype3(xdrs, &objp->type))
 		return (false);
 	if (!xdr_mode3(xdrs, &objp->mode))
@@ -527,6 +609,16 @@ post_op_attr *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
+	if (xdrs->x_op == XDR_ENCODE && objp->attributes_follow) {
+		buf = XDR_INLINE(xdrs,
+				 (1 + FATTR3_UNITS) * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			IXDR_PUT_BOOL(buf, TRUE);
+			fattr3_put(buf, &objp->post_op_attr_u.attributes);
+			return (true);
+		}
+	}
+
 	if (!xdr_bool(xdrs, &objp->attributes_follow))
 		return (false);
 	switch (objp->attributes_follow) {
@@ -553,6 +645,28 @@ wcc_attr *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = XDR_INLINE(xdrs, WCC_ATTR_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			IXDR_PUT_NFS3_UINT64(buf, objp->size);
+			IXDR_PUT_U_LONG(buf, objp->mtime.tv_sec);
+			IXDR_PUT_U_LONG(buf, objp->mtime.tv_nsec);
+			IXDR_PUT_U_LONG(buf, objp->ctime.tv_sec);
+			IXDR_PUT_U_LONG(buf, objp->ctime.tv_nsec);
+			return (true);
+		}
+	} else if (xdrs->x_op == XDR_DECODE) {
+		buf = XDR_INLINE(xdrs, WCC_ATTR_UNITS * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			IXDR_GET_NFS3_UINT64(buf, objp->size);
+			objp->mtime.tv_sec = IXDR_GET_U_LONG(buf);
+			objp->mtime.tv_nsec = IXDR_GET_U_LONG(buf);
+			objp->ctime.tv_sec = IXDR_GET_U_LONG(buf);
+			objp->ctime.tv_nsec = IXDR_GET_U_LONG(buf);
+			return (true);
+		}
+	}
+
 	if (!xdr_size3(xdrs, &objp->size))
 		return (false);
 	if (!xdr_nfstime3(xdrs, &objp->mtime))
@@ -1082,6 +1196,13 @@ ACCESS3args *objp;
 
 	if (!xdr_nfs_fh3(xdrs, &objp->object))
 		return (false);
+	if (xdrs->x_op == XDR_DECODE) {
+		buf = XDR_INLINE(xdrs, BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			objp->access = IXDR_GET_U_LONG(buf);
+			return (true);
+		}
+	}
 	if (!xdr_nfs3_uint32(xdrs, &objp->access))
 		return (false);
 	return (true);
@@ -1098,6 +1219,18 @@ ACCESS3resok *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
+	if (xdrs->x_op == XDR_ENCODE && objp->obj_attributes.attributes_follow) {
+		buf = XDR_INLINE(xdrs,
+				 (2 + FATTR3_UNITS) * BYTES_PER_XDR_UNIT);
+		if (buf != NULL) {
+			IXDR_PUT_BOOL(buf, TRUE);
+			buf = fattr3_put(buf, &objp->obj_attributes.
+					 post_op_attr_u.attributes);
+			IXDR_PUT_U_LONG(buf, objp->access);
+			return (true);
+		}
+	}
+
 	if (!xdr_post_op_attr(xdrs, &objp->obj_attributes))
 		return (false);
 	if (!xdr_nfs3_uint32(xdrs, &objp->access))
@@ -1238,10 +1371,18 @@ READ3args *objp;
 
 	if (!xdr_nfs_fh3(xdrs, &objp->file))
 		return (false);
-	if (!xdr_offset3(xdrs, &objp->offset))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->count))
-		return (false);
+	buf = NULL;
+	if (xdrs->x_op == XDR_DECODE)
+		buf = XDR_INLINE(xdrs, 3 * BYTES_PER_XDR_UNIT);
+	if (buf != NULL) {
+		IXDR_GET_NFS3_UINT64(buf, objp->offset);
+		objp->count = IXDR_GET_U_LONG(buf);
+	} else {
+		if (!xdr_offset3(xdrs, &objp->offset))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->count))
+			return (false);
+	}
 	lkhd->flags = NFS_LOOKAHEAD_READ;
 	(lkhd->read)++;
 	return (true);
@@ -1258,13 +1399,25 @@ READ3resok *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
-	if (!xdr_post_op_attr(xdrs, &objp->file_attributes))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->count))
-		return (false);
-	if (!xdr_bool(xdrs, &objp->eof))
-		return (false);
-	if (!xdr_bytes
+	buf = NULL;
+	if (xdrs->x_op == XDR_ENCODE && objp->file_attributes.attributes_follow)
+		buf = XDR_INLINE(xdrs,
+				 (3 + FATTR3_UNITS) * BYTES_PER_XDR_UNIT);
+	if (buf != NULL) {
+		IXDR_PUT_BOOL(buf, TRUE);
+		buf = fattr3_put(buf, &objp->file_attributes.
+				 post_op_attr_u.attributes);
+		IXDR_PUT_U_LONG(buf, objp->count);
+		IXDR_PUT_BOOL(buf, objp->eof);
+	} else {
+		if (!xdr_post_op_attr(xdrs, &objp->file_attributes))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->count))
+			return (false);
+		if (!xdr_bool(xdrs, &objp->eof))
+			return (false);
+	}
+	if (!xdr_io_data
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
 		return (false);
@@ -1344,12 +1497,21 @@ WRITE3args *objp;
 
 	if (!xdr_nfs_fh3(xdrs, &objp->file))
 		return (false);
-	if (!xdr_offset3(xdrs, &objp->offset))
-		return (false);
-	if (!xdr_count3(xdrs, &objp->count))
-		return (false);
-	if (!xdr_stable_how(xdrs, &objp->stable))
-		return (false);
+	buf = NULL;
+	if (xdrs->x_op == XDR_DECODE)
+		buf = XDR_INLINE(xdrs, 4 * BYTES_PER_XDR_UNIT);
+	if (buf != NULL) {
+		IXDR_GET_NFS3_UINT64(buf, objp->offset);
+		objp->count = IXDR_GET_U_LONG(buf);
+		objp->stable = IXDR_GET_ENUM(buf, stable_how);
+	} else {
+		if (!xdr_offset3(xdrs, &objp->offset))
+			return (false);
+		if (!xdr_count3(xdrs, &objp->count))
+			return (false);
+		if (!xdr_stable_how(xdrs, &objp->stable))
+			return (false);
+	}
 	if (!xdr_bytes
 	    (xdrs, (char **)&objp->data.data_val,
 	     &objp->data.data_len, XDR_BYTES_MAXLEN_IO))
@@ -1372,6 +1534,16 @@ WRITE3resok *objp;
 
 	if (!xdr_wcc_data(xdrs, &objp->file_wcc))
 		return (false);
+	if (xdrs->x_op == XDR_ENCODE) {
+		buf = XDR_INLINE(xdrs, (2 * BYTES_PER_XDR_UNIT)
+				 + NFS3_WRITEVERFSIZE);
+		if (buf != NULL) {
+			IXDR_PUT_U_LONG(buf, objp->count);
+			IXDR_PUT_ENUM(buf, objp->committed);
+			memcpy(buf, objp->verf, NFS3_WRITEVERFSIZE);
+			return (true);
+		}
+	}
 	if (!xdr_count3(xdrs, &objp->count))
 		return (false);
 	if (!xdr_stable_how(xdrs, &objp->committed))
@@ -2232,6 +2404,9 @@ dirlist3 *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
+	if (xdrs->x_op == XDR_ENCODE && objp->encoded != NULL)
+		return xdr_dirents_encoded(xdrs, objp->encoded,
+					   objp->encoded_len, &objp->eof);
 	if (!xdr_pointer
 	    (xdrs, (char **)&objp->entries, sizeof(entry3),
 	     (xdrproc_t) xdr_entry3))
@@ -2369,6 +2544,9 @@ dirlistplus3 *objp;
 	register long __attribute__ ((__unused__)) * buf;
 #endif
 
+	if (xdrs->x_op == XDR_ENCODE && objp->encoded != NULL)
+		return xdr_dirents_encoded(xdrs, objp->encoded,
+					   objp->encoded_len, &objp->eof);
 	if (!xdr_pointer
 	    (xdrs, (char **)&objp->entries, sizeof(entryplus3),
 	     (xdrproc_t) xdr_entryplus3))
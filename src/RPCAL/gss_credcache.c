@@ -137,6 +137,25 @@ static int use_memcache;
 static struct gssd_k5_kt_princ *gssd_k5_kt_princ_list;
 static pthread_mutex_t ple_mtx = PTHREAD_MUTEX_INITIALIZER;
 
+/* Serializes getting new credentials, so only one thread does it */
+static pthread_mutex_t ple_refresh_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The ple found for a host and service, so that checking credentials
+ * still good needs neither a krb5 context nor a keytab scan.
+ */
+struct gssd_machine_cred {
+	struct gssd_machine_cred *next;
+	struct gssd_k5_kt_princ *ple;
+	char *service;
+	char hostname[];
+};
+
+static struct gssd_machine_cred *gssd_machine_creds;
+
+/* Each thread keeps its krb5 context, initializing one reads krb5.conf */
+static __thread krb5_context gssd_k5_context;
+
 static char *gssd_k5_err_msg(krb5_context context, krb5_error_code code);
 static int gssd_get_single_krb5_cred(krb5_context context, krb5_keytab kt,
 				     struct gssd_k5_kt_princ *ple,
@@ -820,6 +839,49 @@ static char *gssd_k5_err_msg(krb5_context context, krb5_error_code code)
 #endif
 }
 
+/*
+ * Find the ple of a host and service, NULL if not known yet
+ */
+static struct gssd_k5_kt_princ *find_machine_cred(const char *hostname,
+						  const char *service)
+{
+	struct gssd_machine_cred *mc;
+	struct gssd_k5_kt_princ *ple = NULL;
+
+	PTHREAD_MUTEX_lock(&ple_mtx);
+
+	for (mc = gssd_machine_creds; mc != NULL; mc = mc->next) {
+		if (strcmp(mc->hostname, hostname) == 0 &&
+		    strcmp(mc->service, service) == 0) {
+			ple = mc->ple;
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&ple_mtx);
+
+	return ple;
+}
+
+static void add_machine_cred(const char *hostname, const char *service,
+			     struct gssd_k5_kt_princ *ple)
+{
+	struct gssd_machine_cred *mc;
+
+	if (find_machine_cred(hostname, service) != NULL)
+		return;
+
+	mc = gsh_malloc(sizeof(*mc) + strlen(hostname) + 1);
+	strcpy(mc->hostname, hostname);
+	mc->service = gsh_strdup(service);
+	mc->ple = ple;
+
+	PTHREAD_MUTEX_lock(&ple_mtx);
+	mc->next = gssd_machine_creds;
+	gssd_machine_creds = mc;
+	PTHREAD_MUTEX_unlock(&ple_mtx);
+}
+
 /* Public Interfaces */
 
 char *ccachesearch[GSSD_MAX_CCACHE_SEARCH + 1];
@@ -837,6 +899,8 @@ int gssd_refresh_krb5_machine_credential(char *hostname,
 	int retval = 0;
 	char *k5err = NULL;
 	const char *svcnames[5] = { "$", "root", "nfs", "host", NULL };
+	const char *svckey = service != NULL ? service : "*";
+	bool found = false;
 
 	/*
 	 * If a specific service name was specified, use it.
@@ -849,16 +913,29 @@ int gssd_refresh_krb5_machine_credential(char *hostname,
 	if (hostname == NULL && ple == NULL)
 		return EINVAL;
 
-	code = krb5_init_context(&context);
-	if (code) {
-		k5err = gssd_k5_err_msg(NULL, code);
-		printerr(0, "ERROR: %s: %s while initializing krb5 context\n",
-			 __func__, k5err);
-		retval = code;
-		gsh_free(k5err);
-		goto out_wo_context;
+	if (ple == NULL) {
+		ple = find_machine_cred(hostname, svckey);
+		found = ple != NULL;
 	}
 
+	/* Credentials still good, the common case */
+	if (ple != NULL && ple->ccname && ple->endtime > time(0))
+		return 0;
+
+	if (gssd_k5_context == NULL) {
+		code = krb5_init_context(&gssd_k5_context);
+		if (code) {
+			k5err = gssd_k5_err_msg(NULL, code);
+			printerr(0,
+				 "ERROR: %s: %s while initializing krb5 context\n",
+				 __func__, k5err);
+			gsh_free(k5err);
+			gssd_k5_context = NULL;
+			return code;
+		}
+	}
+	context = gssd_k5_context;
+
 	code = krb5_kt_resolve(context, keytabfile, &kt);
 	if (code != 0) {
 		k5err = gssd_k5_err_msg(context, code);
@@ -899,12 +976,17 @@ int gssd_refresh_krb5_machine_credential(char *hostname,
 			goto out;
 		}
 	}
+
+	/* Threads that waited find the credentials just obtained */
+	PTHREAD_MUTEX_lock(&ple_refresh_mtx);
 	retval = gssd_get_single_krb5_cred(context, kt, ple, 0);
+	PTHREAD_MUTEX_unlock(&ple_refresh_mtx);
+
+	if (retval == 0 && hostname != NULL && !found)
+		add_machine_cred(hostname, svckey, ple);
  out:
 	if (kt)
 		krb5_kt_close(context, kt);
-	krb5_free_context(context);
- out_wo_context:
 	return retval;
 }
 
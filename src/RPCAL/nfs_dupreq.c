@@ -39,6 +39,7 @@
 #include <time.h>
 #include <pthread.h>
 #include <assert.h>
+#include <sched.h>
 
 /* XXX prune: */
 #include "log.h"
@@ -50,8 +51,6 @@
 #include "gsh_intrinsic.h"
 #include "wait_queue.h"
 
-#define DUPREQ_BAD_ADDR1 0x01	/* safe for marked pointers, etc */
-#define DUPREQ_NOCACHE   0x02
 #define DUPREQ_MAX_RETRIES 5
 
 #define NFS_pcp nfs_param.core_param
@@ -118,110 +117,329 @@ struct drc_st {
 static struct drc_st *drc_st;
 
 /**
- * @brief Comparison function for duplicate request entries.
+ * @page DRC_PART DRC partitions
+ *
+ * Each DRC is split into npart cache-line-aligned partitions, chosen by
+ * the entry key.  A partition holds its entries in a linear-probing
+ * table and an LRU list, both under the partition mutex; nothing in the
+ * start/finish path takes a DRC-wide lock.
+ *
+ * The retransmit check in nfs_dupreq_start probes the table without
+ * the mutex.  To keep the entries it may see alive, a lookup counts
+ * itself into one of two reader counters, picked by the partition
+ * epoch.  Entries unlinked from the table keep their hashtable ref on
+ * the partition limbo list; once enough have piled up, the unlinking
+ * thread advances the epoch, waits for the readers of the previous
+ * epoch to drain, and only then drops those refs.
+ */
+
+/* unlinked entries to collect before reclaiming them */
+#define DRC_LIMBO_BATCH 16
+
+#define DRC_STATS_STRIPES 16
+
+static struct drc_stats_stripe {
+	struct drc_stats st;
+	GSH_CACHE_PAD(0);
+} drc_stats_stripe[DRC_STATS_STRIPES];
+
+#define DRC_STAT_ADD(key, ctr, n)					\
+	(void)atomic_add_uint64_t(					\
+		&drc_stats_stripe[(key) & (DRC_STATS_STRIPES - 1)].st.ctr, \
+		(n))
+
+/**
+ * @brief Compute the slot key of a duplicate request entry
  *
- * @param[in] lhs An integer
- * @param[in] rhs Another integer
+ * @param[in] dk  The entry, with hin and hk filled in
  *
- * @return -1 if the left-hand is smaller than the right, 0 if they
- * are equal, and 1 if the left-hand is larger.
+ * @return The key, never 0 or DRC_SLOT_TOMB.
  */
-static inline int uint32_cmpf(uint32_t lhs, uint32_t rhs)
+static inline uint64_t dupreq_key(dupreq_entry_t *dk)
 {
-	if (lhs < rhs)
-		return -1;
+	uint64_t key = dk->hk ^
+		((uint64_t)dk->hin.tcp.rq_xid * 0x9e3779b97f4a7c15ULL);
 
-	if (lhs == rhs)
-		return 0;
+	if (dk->hin.drc->type == DRC_UDP_V234)
+		key ^= hash_sockaddr(&dk->hin.addr, false);
 
-	return 1;
+	if (unlikely(key <= DRC_SLOT_TOMB))
+		key += 2;
+
+	return key;
 }
 
 /**
- * @brief Comparison function for duplicate request entries.
+ * @brief Check whether a cached entry is a retransmit of another
  *
- * @param[in] lhs An integer
- * @param[in] rhs Another integer
+ * @param[in] dv  The cached entry
+ * @param[in] dk  The entry for the incoming request
  *
- * @return -1 if the left-hand is smaller than the right, 0 if they
- * are equal, and 1 if the left-hand is larger.
+ * @return true if they are the same request.
  */
-static inline int uint64_cmpf(uint64_t lhs, uint64_t rhs)
+static inline bool dupreq_match(dupreq_entry_t *dv, dupreq_entry_t *dk)
 {
-	if (lhs < rhs)
-		return -1;
+	if (dv->hin.tcp.rq_xid != dk->hin.tcp.rq_xid || dv->hk != dk->hk)
+		return false;
 
-	if (lhs == rhs)
-		return 0;
+	if (dk->hin.drc->type == DRC_UDP_V234)
+		return sockaddr_cmpf(&dv->hin.addr, &dk->hin.addr, false) == 0;
 
-	return 1;
+	return true;
+}
+
+static inline struct drc_part *drc_part_of(drc_t *drc, uint64_t key)
+{
+	return &drc->part[(uint32_t)key % drc->npart];
+}
+
+static inline uint32_t drc_home_slot(struct drc_part *part, uint64_t key)
+{
+	return (uint32_t)(key >> 32) & part->mask;
+}
+
+/* slots in use past which an insert first makes room */
+static inline uint32_t drc_part_limit(struct drc_part *part)
+{
+	return part->mask + 1 - ((part->mask + 1) >> 2);
 }
 
 /**
- * @brief Comparison function for entries in a shared DRC
+ * @brief Enter a lock-free lookup of a partition
  *
- * @param[in] lhs  Left-hand-side
- * @param[in] rhs  Right-hand-side
+ * @param[in] part  The partition
  *
- * @return -1,0,1.
+ * @return The reader counter to pass to drc_read_exit().
  */
-static inline int dupreq_shared_cmpf(const struct opr_rbtree_node *lhs,
-				     const struct opr_rbtree_node *rhs)
+static inline uint32_t drc_read_enter(struct drc_part *part)
 {
-	dupreq_entry_t *lk, *rk;
-
-	lk = opr_containerof(lhs, dupreq_entry_t, rbt_k);
-	rk = opr_containerof(rhs, dupreq_entry_t, rbt_k);
-
-	switch (sockaddr_cmpf(&lk->hin.addr, &rk->hin.addr, false)) {
-	case -1:
-		return -1;
-	case 0:
-		switch (uint32_cmpf(lk->hin.tcp.rq_xid, rk->hin.tcp.rq_xid)) {
-		case -1:
-			return -1;
-		case 0:
-			return uint64_cmpf(lk->hk, rk->hk);
-		default:
+	uint32_t epoch;
+
+	for (;;) {
+		epoch = atomic_fetch_uint32_t(&part->epoch);
+		(void)atomic_inc_uint32_t(&part->readers[epoch & 1]);
+		/* counted against the epoch we are actually in */
+		if (likely(atomic_fetch_uint32_t(&part->epoch) == epoch))
+			return epoch & 1;
+		(void)atomic_dec_uint32_t(&part->readers[epoch & 1]);
+	}
+}
+
+static inline void drc_read_exit(struct drc_part *part, uint32_t rix)
+{
+	(void)atomic_dec_uint32_t(&part->readers[rix]);
+}
+
+/**
+ * @brief Look up a request in a partition
+ *
+ * May be called without the partition lock from within
+ * drc_read_enter()/drc_read_exit(); a concurrent insert may then be
+ * missed, but a returned entry is always a true match.
+ *
+ * @param[in] part  The partition
+ * @param[in] dk    The entry for the incoming request
+ *
+ * @return The cached entry, or NULL.
+ */
+static dupreq_entry_t *drc_part_lookup(struct drc_part *part,
+				       dupreq_entry_t *dk)
+{
+	struct drc_slot *slots = atomic_fetch_voidptr((void **)&part->slot);
+	uint32_t ix = drc_home_slot(part, dk->key);
+	uint32_t n;
+
+	/* not allocated yet, or trimmed */
+	if (slots == NULL)
+		return NULL;
+
+	for (n = 0; n <= part->mask; ++n, ix = (ix + 1) & part->mask) {
+		struct drc_slot *slot = &slots[ix];
+		uint64_t key = atomic_fetch_uint64_t(&slot->key);
+		dupreq_entry_t *dv;
+
+		if (key == 0)
 			break;
-		}		/* xid */
-		break;
-	default:
-		break;
-	}			/* addr+port */
+		if (key != dk->key)
+			continue;
+		dv = atomic_fetch_voidptr((void **)&slot->dv);
+		if (dv && dupreq_match(dv, dk))
+			return dv;
+	}
 
-	return 1;
+	return NULL;
 }
 
 /**
- * @brief Comparison function for entries in a per-connection (TCP) DRC
+ * @brief Enter an entry in a partition's table (locked)
  *
- * @param[in] lhs  Left-hand-side
- * @param[in] rhs  Right-hand-side
+ * The caller has made sure a free slot exists.
+ */
+static void drc_slot_insert(struct drc_part *part, dupreq_entry_t *dv)
+{
+	uint32_t ix = drc_home_slot(part, dv->key);
+	struct drc_slot *slot;
+
+	for (;; ix = (ix + 1) & part->mask) {
+		slot = &part->slot[ix];
+		if (slot->key == 0 || slot->key == DRC_SLOT_TOMB)
+			break;
+	}
+
+	if (slot->key == 0)
+		++(part->used);
+	++(part->size);
+	atomic_store_voidptr((void **)&slot->dv, dv);
+	atomic_store_uint64_t(&slot->key, dv->key);
+}
+
+/**
+ * @brief Rebuild a partition's table from its LRU (locked)
  *
- * @return -1,0,1.
+ * Clears out the tombstones.  Lock-free lookups running meanwhile may
+ * miss, which only sends them to the locked path.
  */
-static inline int dupreq_tcp_cmpf(const struct opr_rbtree_node *lhs,
-				  const struct opr_rbtree_node *rhs)
+static void drc_part_rehash(struct drc_part *part)
 {
-	dupreq_entry_t *lk, *rk;
+	dupreq_entry_t *dv;
+	uint32_t ix;
 
-	LogDebug(COMPONENT_DUPREQ, "%s", __func__);
+	for (ix = 0; ix <= part->mask; ++ix) {
+		atomic_store_uint64_t(&part->slot[ix].key, 0);
+		atomic_store_voidptr((void **)&part->slot[ix].dv, NULL);
+	}
+	part->used = 0;
+	part->size = 0;
+
+	TAILQ_FOREACH(dv, &part->lru, fifo_q)
+		drc_slot_insert(part, dv);
+}
+
+/**
+ * @brief Unlink an entry from a partition (locked)
+ *
+ * The entry goes to the limbo list, still holding its hashtable ref.
+ *
+ * @return false if the entry was no longer in the table.
+ */
+static bool drc_part_remove(struct drc_part *part, dupreq_entry_t *dv)
+{
+	uint32_t ix = drc_home_slot(part, dv->key);
+	struct drc_slot *slot = NULL;
+	uint32_t n;
 
-	lk = opr_containerof(lhs, dupreq_entry_t, rbt_k);
-	rk = opr_containerof(rhs, dupreq_entry_t, rbt_k);
+	for (n = 0; n <= part->mask; ++n, ix = (ix + 1) & part->mask) {
+		if (part->slot[ix].key == 0)
+			break;
+		if (part->slot[ix].dv == dv) {
+			slot = &part->slot[ix];
+			break;
+		}
+	}
+	if (!slot)
+		return false;
 
-	if (lk->hin.tcp.rq_xid < rk->hin.tcp.rq_xid)
-		return -1;
+	atomic_store_uint64_t(&slot->key, DRC_SLOT_TOMB);
+	atomic_store_voidptr((void **)&slot->dv, NULL);
 
-	if (lk->hin.tcp.rq_xid == rk->hin.tcp.rq_xid) {
-		LogDebug(COMPONENT_DUPREQ,
-			 "xids eq %" PRIu32 ", ck1 %" PRIu64 " ck2 %" PRIu64,
-			 lk->hin.tcp.rq_xid, lk->hk, rk->hk);
-		return uint64_cmpf(lk->hk, rk->hk);
+	/* tombstones just before an empty slot end no probe sequence */
+	while (slot->key == DRC_SLOT_TOMB &&
+	       part->slot[(ix + 1) & part->mask].key == 0) {
+		atomic_store_uint64_t(&slot->key, 0);
+		--(part->used);
+		ix = (ix - 1) & part->mask;
+		slot = &part->slot[ix];
 	}
+	--(part->size);
+
+	TAILQ_REMOVE(&part->lru, dv, fifo_q);
+	TAILQ_INSERT_TAIL(&part->limbo, dv, fifo_q);
+	++(part->nlimbo);
 
-	return 1;
+	return true;
+}
+
+/**
+ * @brief Wait out the lock-free lookups already running (locked)
+ */
+static void drc_part_quiesce(struct drc_part *part)
+{
+	uint32_t rix = atomic_postinc_uint32_t(&part->epoch) & 1;
+
+	while (atomic_fetch_uint32_t(&part->readers[rix]) != 0)
+		sched_yield();
+}
+
+/**
+ * @brief Hand over limbo entries no lookup can still see (locked)
+ *
+ * @param[in]  part   The partition
+ * @param[in]  force  Reclaim even a short limbo list
+ * @param[out] out    List to move the reclaimed entries to
+ */
+static void drc_part_reclaim(struct drc_part *part, bool force,
+			     struct drc_part_limbo *out)
+{
+	dupreq_entry_t *dv;
+
+	if (part->nlimbo == 0 || (!force && part->nlimbo < DRC_LIMBO_BATCH))
+		return;
+
+	drc_part_quiesce(part);
+
+	while ((dv = TAILQ_FIRST(&part->limbo)) != NULL) {
+		TAILQ_REMOVE(&part->limbo, dv, fifo_q);
+		TAILQ_INSERT_TAIL(out, dv, fifo_q);
+	}
+	part->nlimbo = 0;
+}
+
+/**
+ * @brief Give a partition its table, on its first insert (locked)
+ */
+static void drc_part_slots(struct drc_part *part)
+{
+	struct drc_slot *slots = gsh_calloc(part->mask + 1,
+					    sizeof(struct drc_slot));
+
+	part->used = 0;
+	atomic_store_voidptr((void **)&part->slot, slots);
+}
+
+/**
+ * @brief Set up the partitions of a DRC
+ *
+ * Each partition gets its share of the size bounds, and a table of at
+ * least cachesz slots with room for twice its share of hiwat.  The
+ * tables are allocated on the first insert: most connections of a big
+ * client population never send a request worth caching.
+ *
+ * @param[in] drc  The DRC, with npart, cachesz, maxsize and hiwat set
+ */
+static void drc_init_parts(drc_t *drc)
+{
+	uint32_t maxsize = (drc->maxsize + drc->npart - 1) / drc->npart;
+	uint32_t hiwat = (drc->hiwat + drc->npart - 1) / drc->npart;
+	uint32_t nslots = 16;
+	int ix;
+
+	while (nslots < drc->cachesz || nslots < 2 * hiwat)
+		nslots <<= 1;
+
+	drc->part = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+				       drc->npart * sizeof(struct drc_part));
+	memset(drc->part, 0, drc->npart * sizeof(struct drc_part));
+
+	for (ix = 0; ix < drc->npart; ++ix) {
+		struct drc_part *part = &drc->part[ix];
+
+		PTHREAD_MUTEX_init(&part->mtx, NULL);
+		part->mask = nslots - 1;
+		part->maxsize = maxsize;
+		part->hiwat = hiwat;
+		TAILQ_INIT(&part->lru);
+		TAILQ_INIT(&part->limbo);
+	}
 }
 
 /**
@@ -250,7 +468,6 @@ static inline int drc_recycle_cmpf(const struct opr_rbtree_node *lhs,
 static inline void init_shared_drc(void)
 {
 	drc_t *drc = &drc_st->udp_drc;
-	int ix, code __attribute__ ((unused)) = 0;
 
 	drc->type = DRC_UDP_V234;
 	drc->refcnt = 0;
@@ -263,23 +480,7 @@ static inline void init_shared_drc(void)
 
 	gsh_mutex_init(&drc->mtx, NULL);
 
-	/* init dict */
-	code =
-	    rbtx_init(&drc->xt, dupreq_shared_cmpf, drc->npart,
-		      RBT_X_FLAG_ALLOC | RBT_X_FLAG_CACHE_WT);
-	assert(!code);
-
-	/* completed requests */
-	TAILQ_INIT(&drc->dupreq_q);
-
-	/* init closed-form "cache" partition */
-	for (ix = 0; ix < drc->npart; ++ix) {
-		struct rbtree_x_part *xp = &(drc->xt.tree[ix]);
-
-		drc->xt.cachesz = drc->cachesz;
-		xp->cache =
-		    gsh_calloc(drc->cachesz, sizeof(struct opr_rbtree_node *));
-	}
+	drc_init_parts(drc);
 }
 
 /**
@@ -370,12 +571,12 @@ static inline enum drc_type get_drc_type(struct svc_req *req)
 static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 {
 	drc_t *drc = pool_alloc(tcp_drc_pool);
-	int ix, code __attribute__ ((unused)) = 0;
 
 	drc->type = dtype;	/* DRC_TCP_V3 or DRC_TCP_V4 */
 	drc->refcnt = 0;
 	drc->retwnd = 0;
 	drc->d_u.tcp.recycle_time = 0;
+	drc->d_u.tcp.last_used = time(NULL);
 	drc->maxsize = nfs_param.core_param.drc.tcp.size;
 	drc->cachesz = nfs_param.core_param.drc.tcp.cachesz;
 	drc->npart = nfs_param.core_param.drc.tcp.npart;
@@ -383,45 +584,41 @@ static inline drc_t *alloc_tcp_drc(enum drc_type dtype)
 
 	PTHREAD_MUTEX_init(&drc->mtx, NULL);
 
-	/* init dict */
-	code =
-	    rbtx_init(&drc->xt, dupreq_tcp_cmpf, drc->npart,
-		      RBT_X_FLAG_ALLOC | RBT_X_FLAG_CACHE_WT);
-	assert(!code);
-
-	/* completed requests */
-	TAILQ_INIT(&drc->dupreq_q);
+	drc_init_parts(drc);
 
 	/* recycling DRC */
 	TAILQ_INIT_ENTRY(drc, d_u.tcp.recycle_q);
 
-	/* init "cache" partition */
-	for (ix = 0; ix < drc->npart; ++ix) {
-		struct rbtree_x_part *xp = &(drc->xt.tree[ix]);
-
-		drc->xt.cachesz = drc->cachesz;
-		xp->cache =
-		    gsh_calloc(drc->cachesz, sizeof(struct opr_rbtree_node *));
-	}
-
 	return drc;
 }
 
+static inline void dupreq_entry_put(dupreq_entry_t *dv);
+
 /**
  * @brief Deep-free a per-connection (TCP) duplicate request cache
  *
  * @param[in] drc  The DRC to dispose
  *
- * Assumes that the DRC has been allocated from the tcp_drc_pool.
+ * Assumes that the DRC has been allocated from the tcp_drc_pool.  With
+ * no refs left, nothing can be looking at its partitions, and only the
+ * limbo lists can still hold entries.
  */
 static inline void free_tcp_drc(drc_t *drc)
 {
+	dupreq_entry_t *dv;
 	int ix;
 
 	for (ix = 0; ix < drc->npart; ++ix) {
-		if (drc->xt.tree[ix].cache)
-			gsh_free(drc->xt.tree[ix].cache);
+		struct drc_part *part = &drc->part[ix];
+
+		while ((dv = TAILQ_FIRST(&part->limbo)) != NULL) {
+			TAILQ_REMOVE(&part->limbo, dv, fifo_q);
+			dupreq_entry_put(dv);
+		}
+		gsh_free(part->slot);
+		PTHREAD_MUTEX_destroy(&part->mtx);
 	}
+	gsh_free(drc->part);
 	PTHREAD_MUTEX_destroy(&drc->mtx);
 	LogFullDebug(COMPONENT_DUPREQ, "free TCP drc %p", drc);
 	pool_free(tcp_drc_pool, drc);
@@ -436,7 +633,7 @@ static inline void free_tcp_drc(drc_t *drc)
  */
 static inline uint32_t nfs_dupreq_ref_drc(drc_t *drc)
 {
-	return ++(drc->refcnt); /* locked */
+	return atomic_inc_uint32_t(&drc->refcnt);
 }
 
 /**
@@ -448,7 +645,7 @@ static inline uint32_t nfs_dupreq_ref_drc(drc_t *drc)
  */
 static inline uint32_t nfs_dupreq_unref_drc(drc_t *drc)
 {
-	return --(drc->refcnt); /* locked */
+	return atomic_dec_uint32_t(&drc->refcnt);
 }
 
 #define DRC_ST_LOCK()				\
@@ -521,6 +718,35 @@ static inline void drc_free_expired(void)
 	DRC_ST_UNLOCK();
 }
 
+/**
+ * @brief Note a request on a TCP DRC, for nfs_dupreq_trim_idle()
+ */
+static inline void drc_touch(drc_t *drc)
+{
+	time_t now = time(NULL);
+
+	/* one store a second, the rest only read the line */
+	if (atomic_fetch_time_t(&drc->d_u.tcp.last_used) != now)
+		atomic_store_time_t(&drc->d_u.tcp.last_used, now);
+}
+
+/**
+ * @brief Key a TCP DRC by the client host only
+ *
+ * @param[in,out] addr Address of the peer
+ */
+static inline void drc_clear_port(sockaddr_t *addr)
+{
+	switch (addr->ss_family) {
+	case AF_INET:
+		((struct sockaddr_in *)addr)->sin_port = 0;
+		break;
+	case AF_INET6:
+		((struct sockaddr_in6 *)addr)->sin6_port = 0;
+		break;
+	}
+}
+
 /**
  * @brief Find and reference a DRC to process the supplied svc_req.
  *
@@ -537,11 +763,11 @@ nfs_dupreq_get_drc(struct svc_req *req)
 
 	switch (dtype) {
 	case DRC_UDP_V234:
+		/* The shared DRC is never recycled, so it is not
+		 * refcounted.
+		 */
 		LogFullDebug(COMPONENT_DUPREQ, "ref shared UDP DRC");
 		drc = &(drc_st->udp_drc);
-		DRC_ST_LOCK();
-		(void)nfs_dupreq_ref_drc(drc);
-		DRC_ST_UNLOCK();
 		goto out;
 retry:
 	case DRC_TCP_V4:
@@ -551,10 +777,14 @@ retry:
 		 */
 		drc = (drc_t *)req->rq_xprt->xp_u2;
 		if (drc) {
-			/* found, no danger of removal */
+			/* found, no danger of removal: the xprt ref
+			 * keeps refcnt above zero.
+			 */
 			LogFullDebug(COMPONENT_DUPREQ, "ref DRC=%p for xprt=%p",
 				     drc, req->rq_xprt);
-			PTHREAD_MUTEX_lock(&drc->mtx);	/* LOCKED */
+			(void)nfs_dupreq_ref_drc(drc);
+			drc_touch(drc);
+			goto out;
 		} else {
 			drc_t drc_k;
 			struct rbtree_x_part *t = NULL;
@@ -569,6 +799,8 @@ retry:
 			 * no xprt lock required.
 			 */
 			(void)copy_xprt_addr(&drc_k.d_u.tcp.addr, req->rq_xprt);
+			if (nfs_param.core_param.drc.tcp.per_client)
+				drc_clear_port(&drc_k.d_u.tcp.addr);
 
 			drc_k.d_u.tcp.hk =
 			    CityHash64WithSeed((char *)&drc_k.d_u.tcp.addr,
@@ -660,6 +892,7 @@ retry:
 
 	/* call path ref */
 	(void)nfs_dupreq_ref_drc(drc);
+	drc_touch(drc);
 	PTHREAD_MUTEX_unlock(&drc->mtx);
 
 	if (drc_check_expired)
@@ -681,8 +914,25 @@ out:
  */
 void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags)
 {
-	if (!(flags & DRC_FLAG_LOCKED))
+	uint32_t refcnt;
+
+	if (drc->type == DRC_UDP_V234) {
+		if (flags & DRC_FLAG_LOCKED)
+			PTHREAD_MUTEX_unlock(&drc->mtx);
+		return;
+	}
+
+	if (!(flags & DRC_FLAG_LOCKED)) {
+		/* quick path: not the last ref, no lock needed */
+		refcnt = atomic_fetch_uint32_t(&drc->refcnt);
+		while (refcnt > 1) {
+			if (atomic_cmpxchg_uint32_t(&drc->refcnt, refcnt,
+						    refcnt - 1))
+				return;
+			refcnt = atomic_fetch_uint32_t(&drc->refcnt);
+		}
 		PTHREAD_MUTEX_lock(&drc->mtx);
+	}
 	/* drc LOCKED */
 
 	if (drc->refcnt == 0) {
@@ -704,9 +954,8 @@ void nfs_dupreq_put_drc(SVCXPRT *xprt, drc_t *drc, uint32_t flags)
 		if (drc->refcnt != 0) /* quick path */
 			break;
 
-		/* note t's lock order wrt drc->mtx is the opposite of
-		 * drc->xt[*].lock. Drop and reacquire locks in correct
-		 * order.
+		/* drc_st->mtx is taken before drc->mtx.  Drop and
+		 * reacquire locks in correct order.
 		 */
 		PTHREAD_MUTEX_unlock(&drc->mtx);
 		DRC_ST_LOCK();
@@ -895,59 +1144,81 @@ static inline void dupreq_entry_put(dupreq_entry_t *dv)
  * @brief advance retwnd.
  *
  * If (drc)->retwnd is 0, advance its value to RETWND_START_BIAS, else
- * increase its value by 2 (corrects to 1) iff !full.
+ * increase its value by 2 (corrects to 1) iff !full.  Racing updates
+ * may be lost; the window is only a heuristic.
  *
  * @param[in] drc The duplicate request cache
  */
-#define drc_inc_retwnd(drc)					\
-	do {							\
-		if ((drc)->retwnd == 0)				\
-			(drc)->retwnd = RETWND_START_BIAS;	\
-		else						\
-			if ((drc)->retwnd < (drc)->maxsize)	\
-				(drc)->retwnd += 2;		\
-	} while (0)
+static inline void drc_inc_retwnd(drc_t *drc)
+{
+	uint32_t retwnd = atomic_fetch_uint32_t(&drc->retwnd);
+
+	if (retwnd == 0)
+		atomic_store_uint32_t(&drc->retwnd, RETWND_START_BIAS);
+	else if (retwnd < drc->maxsize)
+		(void)atomic_add_uint32_t(&drc->retwnd, 2);
+}
 
 /**
  * @brief conditionally decrement retwnd.
  *
- * If (drc)->retwnd > 0, decrease its value by 1.
+ * If (drc)->retwnd > 0, decrease its value by 1.  Reads first, so the
+ * common case of an empty window does not dirty the cache line.
  *
  * @param[in] drc The duplicate request cache
  */
-#define drc_dec_retwnd(drc)			\
-	do {					\
-		if ((drc)->retwnd > 0)		\
-			--((drc)->retwnd);	\
-	} while (0)
+static inline void drc_dec_retwnd(drc_t *drc)
+{
+	uint32_t retwnd = atomic_fetch_uint32_t(&drc->retwnd);
+
+	while (retwnd > 0 &&
+	       !atomic_cmpxchg_uint32_t(&drc->retwnd, retwnd, retwnd - 1))
+		retwnd = atomic_fetch_uint32_t(&drc->retwnd);
+}
 
 /**
  * @brief retire request predicate.
  *
  * Calculate whether a request may be retired from the provided duplicate
- * request cache.
+ * request cache partition.
  *
- * @param[in] drc The duplicate request cache
+ * @param[in] drc  The duplicate request cache
+ * @param[in] part The partition
  *
  * @return true if a request may be retired, else false.
  */
-static inline bool drc_should_retire(drc_t *drc)
+static inline bool drc_should_retire(drc_t *drc, struct drc_part *part)
 {
 	/* do not exeed the hard bound on cache size */
-	if (unlikely(drc->size > drc->maxsize))
+	if (unlikely(part->size > part->maxsize))
 		return true;
 
 	/* otherwise, are we permitted to retire requests */
-	if (unlikely(drc->retwnd > 0))
+	if (unlikely(atomic_fetch_uint32_t(&drc->retwnd) > 0))
 		return false;
 
-	/* finally, retire if drc->size is above intended high water mark */
-	if (unlikely(drc->size > drc->hiwat))
+	/* finally, retire if part->size is above intended high water mark */
+	if (unlikely(part->size > part->hiwat))
 		return true;
 
 	return false;
 }
 
+/**
+ * @brief Drop the hashtable refs of reclaimed entries
+ *
+ * @param[in] reclaim  Entries handed over by drc_part_reclaim()
+ */
+static inline void drc_put_reclaimed(struct drc_part_limbo *reclaim)
+{
+	dupreq_entry_t *dv;
+
+	while ((dv = TAILQ_FIRST(reclaim)) != NULL) {
+		TAILQ_REMOVE(reclaim, dv, fifo_q);
+		dupreq_entry_put(dv);
+	}
+}
+
 static inline bool nfs_dupreq_v4_cacheable(nfs_request_t *reqnfs)
 {
 	COMPOUND4args *arg_c4 = (COMPOUND4args *)&reqnfs->arg_nfs;
@@ -967,6 +1238,44 @@ static inline bool nfs_dupreq_v4_cacheable(nfs_request_t *reqnfs)
 	return true;
 }
 
+/**
+ * @brief Answer a retransmit from its cached entry
+ *
+ * Called with the entry either found under the partition lock or
+ * protected by drc_read_enter().
+ *
+ * @param[in] reqnfs  The NFS request data
+ * @param[in] req     The retransmitted request
+ * @param[in] dv      The cached entry
+ *
+ * @retval DUPREQ_EXISTS if the cached reply can be sent.
+ * @retval DUPREQ_BEING_PROCESSED if the original is still running, or
+ *         was deleted.
+ */
+static dupreq_status_t nfs_dupreq_hit(nfs_request_t *reqnfs,
+				      struct svc_req *req,
+				      dupreq_entry_t *dv)
+{
+	dupreq_status_t status;
+
+	PTHREAD_MUTEX_lock(&dv->mtx);
+	if (unlikely(dv->state != DUPREQ_COMPLETE)) {
+		status = DUPREQ_BEING_PROCESSED;
+	} else {
+		/* satisfy req from the DRC, incref, extend window */
+		req->rq_u1 = dv;
+		reqnfs->res_nfs = req->rq_u2 = dv->res;
+		status = DUPREQ_EXISTS;
+		dupreq_entry_get(dv);
+	}
+	PTHREAD_MUTEX_unlock(&dv->mtx);
+
+	if (status == DUPREQ_EXISTS)
+		drc_inc_retwnd(dv->hin.drc);
+
+	return status;
+}
+
 /**
  * @brief Start a duplicate request transaction
  *
@@ -985,6 +1294,9 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 {
 	dupreq_status_t status = DUPREQ_SUCCESS;
 	dupreq_entry_t *dv = NULL, *dk = NULL;
+	struct drc_part_limbo reclaim;
+	struct drc_part *part;
+	uint32_t rix, forced = 0;
 	drc_t *drc;
 	enum drc_type dtype = get_drc_type(req);
 
@@ -1044,81 +1356,105 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *reqnfs,
 	}
 
 	dk->hk = req->rq_cksum; /* TI-RPC computed checksum */
+	dk->key = dupreq_key(dk);
 	dk->state = DUPREQ_START;
 	dk->timestamp = time(NULL);
 
-	{
-		struct opr_rbtree_node *nv;
-		struct rbtree_x_part *t =
-		    rbtx_partition_of_scalar(&drc->xt, dk->hk);
-		PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
-		nv = rbtree_x_cached_lookup(&drc->xt, t, &dk->rbt_k, dk->hk);
-		if (nv) {
-			/* cached request */
-			nfs_dupreq_free_dupreq(dk);
-			dv = opr_containerof(nv, dupreq_entry_t, rbt_k);
-			PTHREAD_MUTEX_lock(&dv->mtx);
-			if (unlikely(dv->state == DUPREQ_START)) {
-				status = DUPREQ_BEING_PROCESSED;
-			} else {
-				/* satisfy req from the DRC, incref,
-				   extend window */
-				req->rq_u1 = dv;
-				reqnfs->res_nfs = req->rq_u2 = dv->res;
-				status = DUPREQ_EXISTS;
-				dupreq_entry_get(dv);
-			}
-			PTHREAD_MUTEX_unlock(&dv->mtx);
-
-			if (status == DUPREQ_EXISTS) {
-				PTHREAD_MUTEX_lock(&drc->mtx);
-				drc_inc_retwnd(drc);
-				PTHREAD_MUTEX_unlock(&drc->mtx);
-			}
+	part = drc_part_of(drc, dk->key);
 
-			LogDebug(COMPONENT_DUPREQ,
-				 "dupreq hit dv=%p, dv xid=%" PRIu32
-				 " cksum %" PRIu64 " state=%s",
-				 dv, dv->hin.tcp.rq_xid, dv->hk,
-				 dupreq_state_table[dv->state]);
-		} else {
-			/* new request */
-			req->rq_u1 = dk;
-			dk->res = alloc_nfs_res();
-			reqnfs->res_nfs = req->rq_u2 = dk->res;
+	/* retransmit check, without the partition lock */
+	rix = drc_read_enter(part);
+	dv = drc_part_lookup(part, dk);
+	if (dv)
+		status = nfs_dupreq_hit(reqnfs, req, dv);
+	drc_read_exit(part, rix);
 
-			/* cache--can exceed drc->maxsize */
-			(void)rbtree_x_cached_insert(&drc->xt, t,
-						&dk->rbt_k, dk->hk);
+	if (dv) {
+		DRC_STAT_ADD(dk->key, lockfree_hits, 1);
+		goto hit;
+	}
 
-			/* dupreq ref count starts with 2; one for the caller
-			 * and another for staying in the hash table.
-			 */
-			dk->refcnt = 2;
+	TAILQ_INIT(&reclaim);
+	PTHREAD_MUTEX_lock(&part->mtx);	/* partition lock */
 
-			/* add to q tail */
-			PTHREAD_MUTEX_lock(&drc->mtx);
-			TAILQ_INSERT_TAIL(&drc->dupreq_q, dk, fifo_q);
-			++(drc->size);
-			PTHREAD_MUTEX_unlock(&drc->mtx);
+	/* a retransmit may have been entered since */
+	dv = drc_part_lookup(part, dk);
+	if (dv) {
+		status = nfs_dupreq_hit(reqnfs, req, dv);
+		PTHREAD_MUTEX_unlock(&part->mtx);
+		goto hit;
+	}
 
-			LogFullDebug(COMPONENT_DUPREQ,
-				     "starting dk=%p xid=%" PRIu32
-				     " on DRC=%p state=%s, status=%s, "
-				     "refcnt=%d, drc->size=%d",
-				     dk, dk->hin.tcp.rq_xid, drc,
-				     dupreq_state_table[dk->state],
-				     dupreq_status_table[status],
-				     dk->refcnt, drc->size);
+	/* new request; make room in the table first, retiring the oldest
+	 * entries if it really is full of them.  The cache can otherwise
+	 * exceed part->maxsize.
+	 */
+	if (part->slot == NULL)
+		drc_part_slots(part);
+	while (part->used >= drc_part_limit(part)) {
+		if (part->size < part->used / 2) {
+			drc_part_rehash(part);
+			continue;
 		}
-		PTHREAD_MUTEX_unlock(&t->mtx);
+		(void)drc_part_remove(part, TAILQ_FIRST(&part->lru));
+		++forced;
 	}
+	drc_part_reclaim(part, false, &reclaim);
+
+	req->rq_u1 = dk;
+	dk->res = alloc_nfs_res();
+	reqnfs->res_nfs = req->rq_u2 = dk->res;
+
+	/* dupreq ref count starts with 2; one for the caller
+	 * and another for staying in the hash table.
+	 */
+	dk->refcnt = 2;
+
+	drc_slot_insert(part, dk);
+	TAILQ_INSERT_TAIL(&part->lru, dk, fifo_q);
+
+	LogFullDebug(COMPONENT_DUPREQ,
+		     "starting dk=%p xid=%" PRIu32
+		     " on DRC=%p state=%s, status=%s, "
+		     "refcnt=%d, part->size=%d",
+		     dk, dk->hin.tcp.rq_xid, drc,
+		     dupreq_state_table[dk->state],
+		     dupreq_status_table[status],
+		     dk->refcnt, part->size);
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	DRC_STAT_ADD(dk->key, misses, 1);
+	if (forced) {
+		DRC_STAT_ADD(dk->key, retired, forced);
+		while (forced-- > 0)
+			nfs_dupreq_put_drc(NULL, drc, DRC_FLAG_NONE);
+	}
+	drc_put_reclaimed(&reclaim);
+
+	return status;
+
+hit:
+	if (status == DUPREQ_EXISTS)
+		DRC_STAT_ADD(dk->key, hits, 1);
+	else
+		DRC_STAT_ADD(dk->key, in_progress, 1);
+
+	/* dv is only pinned for DUPREQ_EXISTS, log from dk */
+	LogDebug(COMPONENT_DUPREQ,
+		 "dupreq hit dv=%p, dv xid=%" PRIu32
+		 " cksum %" PRIu64 " status=%s",
+		 dv, dk->hin.tcp.rq_xid, dk->hk,
+		 dupreq_status_table[status]);
+
+	/* the call path ref went with dk */
+	nfs_dupreq_free_dupreq(dk);
+	nfs_dupreq_put_drc(req->rq_xprt, drc, DRC_FLAG_NONE);
 
 	return status;
 
 no_cache:
-	req->rq_u1 = (void *)DUPREQ_NOCACHE;
-	reqnfs->res_nfs = req->rq_u2 = alloc_nfs_res();
+	nfs_dupreq_nocache(reqnfs, req);
 	return DUPREQ_SUCCESS;
 }
 
@@ -1152,9 +1488,11 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 {
 	dupreq_entry_t *ov = NULL, *dv = (dupreq_entry_t *)req->rq_u1;
 	dupreq_status_t status = DUPREQ_SUCCESS;
-	struct rbtree_x_part *t;
+	struct drc_part_limbo reclaim;
+	struct drc_part *part;
+	struct timespec start, end;
 	drc_t *drc = NULL;
-	int16_t cnt = 0;
+	int16_t cnt = 0, ix;
 
 	/* do nothing if req is marked no-cache */
 	if (dv == (void *)DUPREQ_NOCACHE)
@@ -1171,82 +1509,55 @@ dupreq_status_t nfs_dupreq_finish(struct svc_req *req, nfs_res_t *res_nfs)
 	drc = dv->hin.drc;
 	PTHREAD_MUTEX_unlock(&dv->mtx);
 
-	/* cond. remove from q head */
-	PTHREAD_MUTEX_lock(&drc->mtx);
+	part = drc_part_of(drc, dv->key);
 
 	LogFullDebug(COMPONENT_DUPREQ,
 		     "completing dv=%p xid=%" PRIu32
-		     " on DRC=%p state=%s, status=%s, refcnt=%d, drc->size=%d",
+		     " on DRC=%p state=%s, status=%s, refcnt=%d, part->size=%d",
 		dv, dv->hin.tcp.rq_xid, drc,
 		dupreq_state_table[dv->state], dupreq_status_table[status],
-		dv->refcnt, drc->size);
+		dv->refcnt, part->size);
 
 	/* (all) finished requests count against retwnd */
 	drc_dec_retwnd(drc);
 
-	/* conditionally retire entries */
-dq_again:
-	if (drc_should_retire(drc)) {
-		ov = TAILQ_FIRST(&drc->dupreq_q);
-		if (likely(ov)) {
-			/* remove dict entry */
-			t = rbtx_partition_of_scalar(&drc->xt, ov->hk);
-			uint64_t ov_hk = ov->hk;
-
-			/* Need to acquire partition lock, but the lock
-			 * order is partition lock followed by drc lock.
-			 * Drop drc lock and reacquire it!
-			 */
-			PTHREAD_MUTEX_unlock(&drc->mtx);
-			PTHREAD_MUTEX_lock(&t->mtx);	/* partition lock */
-			PTHREAD_MUTEX_lock(&drc->mtx);
-
-			/* Since we dropped drc lock and reacquired it,
-			 * the drc dupreq list may have changed. Get the
-			 * dupreq entry from the list again.
-			 */
-			ov = TAILQ_FIRST(&drc->dupreq_q);
-
-			/* Make sure that we are removing the entry we
-			 * expected (imperfect, but harmless).
-			 */
-			if (ov == NULL || ov->hk != ov_hk) {
-				PTHREAD_MUTEX_unlock(&t->mtx);
-				goto unlock;
-			}
+	/* unlocked peek, most requests retire nothing */
+	if (!drc_should_retire(drc, part))
+		goto out;
 
-			/* remove q entry */
-			TAILQ_REMOVE(&drc->dupreq_q, ov, fifo_q);
-			--(drc->size);
-			/* release dv's ref */
-			nfs_dupreq_put_drc(NULL, drc, DRC_FLAG_LOCKED);
-			/* drc->mtx gets unlocked in the above call! */
+	now(&start);
+	TAILQ_INIT(&reclaim);
 
-			rbtree_x_cached_remove(&drc->xt, t, &ov->rbt_k, ov->hk);
+	/* conditionally retire entries, oldest first */
+	PTHREAD_MUTEX_lock(&part->mtx);	/* partition lock */
+	while (cnt <= DUPREQ_MAX_RETRIES && drc_should_retire(drc, part)) {
+		ov = TAILQ_FIRST(&part->lru);
+		if (unlikely(!ov))
+			break;
 
-			PTHREAD_MUTEX_unlock(&t->mtx);
+		(void)drc_part_remove(part, ov);
+		++cnt;
 
-			LogDebug(COMPONENT_DUPREQ,
-				 "retiring ov=%p xid=%" PRIu32
-				 " on DRC=%p state=%s, status=%s, refcnt=%d",
-				 ov, ov->hin.tcp.rq_xid,
-				 ov->hin.drc, dupreq_state_table[dv->state],
-				 dupreq_status_table[status], ov->refcnt);
+		LogDebug(COMPONENT_DUPREQ,
+			 "retiring ov=%p xid=%" PRIu32
+			 " on DRC=%p state=%s, status=%s, refcnt=%d",
+			 ov, ov->hin.tcp.rq_xid,
+			 ov->hin.drc, dupreq_state_table[ov->state],
+			 dupreq_status_table[status], ov->refcnt);
+	}
+	drc_part_reclaim(part, false, &reclaim);
+	PTHREAD_MUTEX_unlock(&part->mtx);
 
-			/* release hashtable ref count */
-			dupreq_entry_put(ov);
+	/* release the retired entries' refs on drc */
+	for (ix = 0; ix < cnt; ++ix)
+		nfs_dupreq_put_drc(NULL, drc, DRC_FLAG_NONE);
 
-			/* conditionally retire another */
-			if (cnt++ < DUPREQ_MAX_RETRIES) {
-				PTHREAD_MUTEX_lock(&drc->mtx);
-				goto dq_again; /* calls drc_should_retire() */
-			}
-			goto out;
-		}
-	}
+	/* release their hashtable refs */
+	drc_put_reclaimed(&reclaim);
 
- unlock:
-	PTHREAD_MUTEX_unlock(&drc->mtx);
+	now(&end);
+	DRC_STAT_ADD(dv->key, retired, cnt);
+	DRC_STAT_ADD(dv->key, retire_ns, timespec_diff(&start, &end));
 
  out:
 	return status;
@@ -1272,7 +1583,9 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 {
 	dupreq_entry_t *dv = (dupreq_entry_t *)req->rq_u1;
 	dupreq_status_t status = DUPREQ_SUCCESS;
-	struct rbtree_x_part *t;
+	struct drc_part_limbo reclaim;
+	struct drc_part *part;
+	bool removed;
 	drc_t *drc;
 
 	/* do nothing if req is marked no-cache */
@@ -1296,23 +1609,23 @@ dupreq_status_t nfs_dupreq_delete(struct svc_req *req)
 		     dv->refcnt);
 
 	/* XXX dv holds a ref on drc */
-	t = rbtx_partition_of_scalar(&drc->xt, dv->hk);
-
-	PTHREAD_MUTEX_lock(&t->mtx);
-	rbtree_x_cached_remove(&drc->xt, t, &dv->rbt_k, dv->hk);
-	PTHREAD_MUTEX_unlock(&t->mtx);
-
-	PTHREAD_MUTEX_lock(&drc->mtx);
-
-	TAILQ_REMOVE(&drc->dupreq_q, dv, fifo_q);
-	--(drc->size);
-
-	/* release dv's ref on drc and unlock */
-	nfs_dupreq_put_drc(req->rq_xprt, drc, DRC_FLAG_LOCKED);
-	/* !LOCKED */
+	part = drc_part_of(drc, dv->key);
+	TAILQ_INIT(&reclaim);
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+	/* the entry may have been retired already */
+	removed = drc_part_remove(part, dv);
+	drc_part_reclaim(part, false, &reclaim);
+	PTHREAD_MUTEX_unlock(&part->mtx);
+
+	if (removed) {
+		DRC_STAT_ADD(dv->key, retired, 1);
+		/* release dv's ref on drc */
+		nfs_dupreq_put_drc(req->rq_xprt, drc, DRC_FLAG_NONE);
+	}
 
-	/* we removed the dupreq from hashtable, release a ref */
-	dupreq_entry_put(dv);
+	/* the hashtable ref is released once dv leaves limbo */
+	drc_put_reclaimed(&reclaim);
 
  out:
 	return status;
@@ -1354,6 +1667,130 @@ void nfs_dupreq_rele(struct svc_req *req, const nfs_function_desc_t *func)
 		SVCAUTH_RELEASE(req->rq_auth, req);
 }
 
+/**
+ * @brief Give back the memory of an idle per-connection DRC
+ *
+ * Retires the completed requests of a TCP DRC no request came on for
+ * idle seconds, and frees the tables left empty; they are reallocated
+ * on the next insert.  Nothing retransmits after that long.
+ *
+ * @param[in] drc   The DRC, kept by the caller's transport
+ * @param[in] idle  Seconds
+ *
+ * @return The requests retired.
+ */
+uint32_t nfs_dupreq_trim_idle(drc_t *drc, time_t idle)
+{
+	struct drc_part_limbo reclaim;
+	struct drc_slot *slots;
+	dupreq_entry_t *dv, *next;
+	uint32_t total = 0, cnt;
+	int ix;
+
+	if (drc->type == DRC_UDP_V234 ||
+	    time(NULL) - atomic_fetch_time_t(&drc->d_u.tcp.last_used) < idle)
+		return 0;
+
+	for (ix = 0; ix < drc->npart; ++ix) {
+		struct drc_part *part = &drc->part[ix];
+
+		/* unlocked peek, most are trimmed already */
+		if (atomic_fetch_voidptr((void **)&part->slot) == NULL)
+			continue;
+
+		TAILQ_INIT(&reclaim);
+		slots = NULL;
+		cnt = 0;
+
+		PTHREAD_MUTEX_lock(&part->mtx);
+		for (dv = TAILQ_FIRST(&part->lru); dv != NULL; dv = next) {
+			next = TAILQ_NEXT(dv, fifo_q);
+			/* a stale DUPREQ_START only keeps the entry */
+			if (dv->state != DUPREQ_COMPLETE)
+				continue;
+			(void)drc_part_remove(part, dv);
+			++cnt;
+		}
+		if (part->size == 0) {
+			/* lookups from now on see no table */
+			slots = part->slot;
+			atomic_store_voidptr((void **)&part->slot, NULL);
+			if (part->nlimbo == 0)
+				drc_part_quiesce(part);
+		}
+		drc_part_reclaim(part, true, &reclaim);
+		PTHREAD_MUTEX_unlock(&part->mtx);
+
+		gsh_free(slots);
+
+		/* the retired entries' refs on drc, then their own */
+		total += cnt;
+		while (cnt-- > 0)
+			nfs_dupreq_put_drc(NULL, drc, DRC_FLAG_NONE);
+		drc_put_reclaimed(&reclaim);
+	}
+
+	if (total > 0) {
+		DRC_STAT_ADD(drc->d_u.tcp.hk, retired, total);
+		LogFullDebug(COMPONENT_DUPREQ,
+			     "trimmed %" PRIu32 " requests of idle drc %p",
+			     total, drc);
+	}
+
+	return total;
+}
+
+/**
+ * @brief Memory a TCP DRC holds, for reporting
+ *
+ * Read without the locks.  Cached replies count for their nfs_res_t
+ * only, not the data they point to.
+ *
+ * @param[in]  drc     The DRC
+ * @param[out] entries Requests it holds
+ *
+ * @return Bytes.
+ */
+size_t nfs_dupreq_drc_mem(drc_t *drc, uint32_t *entries)
+{
+	size_t bytes = sizeof(drc_t) + drc->npart * sizeof(struct drc_part);
+	uint32_t n = 0;
+	int ix;
+
+	for (ix = 0; ix < drc->npart; ++ix) {
+		struct drc_part *part = &drc->part[ix];
+
+		n += atomic_fetch_uint32_t(&part->size);
+		if (atomic_fetch_voidptr((void **)&part->slot) != NULL)
+			bytes += (part->mask + 1) * sizeof(struct drc_slot);
+	}
+
+	*entries = n;
+	return bytes + n * (sizeof(dupreq_entry_t) + sizeof(nfs_res_t));
+}
+
+/**
+ * @brief Sum the duplicate request cache counters
+ *
+ * @param[out] st  The totals
+ */
+void nfs_dupreq_stats(struct drc_stats *st)
+{
+	int ix;
+
+	memset(st, 0, sizeof(*st));
+	for (ix = 0; ix < DRC_STATS_STRIPES; ++ix) {
+		struct drc_stats *ss = &drc_stats_stripe[ix].st;
+
+		st->hits += atomic_fetch_uint64_t(&ss->hits);
+		st->lockfree_hits += atomic_fetch_uint64_t(&ss->lockfree_hits);
+		st->in_progress += atomic_fetch_uint64_t(&ss->in_progress);
+		st->misses += atomic_fetch_uint64_t(&ss->misses);
+		st->retired += atomic_fetch_uint64_t(&ss->retired);
+		st->retire_ns += atomic_fetch_uint64_t(&ss->retire_ns);
+	}
+}
+
 /**
  * @brief Shutdown the dupreq2 package.
  */
@@ -189,7 +189,7 @@ static hash_parameter_t session_id_param = {
 	.compare_key = compare_session_id,
 	.key_to_str = display_session_id_key,
 	.val_to_str = display_session_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_LOCKLESS,
 };
 
 /**
@@ -237,9 +237,19 @@ int32_t inc_session_ref(nfs41_session_t *session)
 	return refcnt;
 }
 
+/**
+ * @brief Increment the session refcount in the hash table
+ *
+ * @param[in] val Buffer pointing to the session
+ */
+static void Hash_inc_session_ref(struct gsh_buffdesc *val)
+{
+	inc_session_ref(val->addr);
+}
+
 int32_t dec_session_ref(nfs41_session_t *session)
 {
-	int i;
+	uint32_t i;
 	int32_t refcnt = atomic_dec_int32_t(&session->refcount);
 
 	if (refcnt == 0) {
@@ -252,10 +262,22 @@ int32_t dec_session_ref(nfs41_session_t *session)
 
 		/* Decrement our reference to the clientid record */
 		dec_client_id_ref(session->clientid_record);
-		/* Destroy this session's mutexes and condition variable */
+		/* Destroy this session's mutexes and condition variable,
+		 * and drop the replies cached by its slots.
+		 */
 
-		for (i = 0; i < NFS41_NB_SLOTS; i++)
-			PTHREAD_MUTEX_destroy(&session->slots[i].lock);
+		for (i = 0; i < session->fore_channel_attrs.ca_maxrequests;
+		     i++) {
+			nfs41_session_slot_t *slot = session->slots[i];
+
+			if (slot == NULL)
+				continue;
+
+			PTHREAD_MUTEX_destroy(&slot->lock);
+			gsh_free(slot->cached_result.buf);
+			gsh_free(slot);
+		}
+		gsh_free(session->slots);
 
 		PTHREAD_COND_destroy(&session->cb_cond);
 		PTHREAD_MUTEX_destroy(&session->cb_mutex);
@@ -271,6 +293,36 @@ int32_t dec_session_ref(nfs41_session_t *session)
 	return refcnt;
 }
 
+/**
+ * @brief Get a slot of a session, allocating it on first use
+ *
+ * @param[in] session The session
+ * @param[in] slotid  The slot, below ca_maxrequests
+ *
+ * @return The slot.
+ */
+nfs41_session_slot_t *nfs41_session_slot(nfs41_session_t *session,
+					 slotid4 slotid)
+{
+	void **entry = (void **)&session->slots[slotid];
+	nfs41_session_slot_t *slot = atomic_fetch_voidptr(entry);
+
+	if (slot != NULL)
+		return slot;
+
+	slot = gsh_calloc(1, sizeof(*slot));
+	PTHREAD_MUTEX_init(&slot->lock, NULL);
+
+	if (!atomic_cmpxchg_voidptr(entry, NULL, slot)) {
+		/* Another request of the client got there first */
+		PTHREAD_MUTEX_destroy(&slot->lock);
+		gsh_free(slot);
+		slot = atomic_fetch_voidptr(entry);
+	}
+
+	return slot;
+}
+
 /**
  * @brief Set a session into the session hashtable.
  *
@@ -331,7 +383,6 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 {
 	struct gsh_buffdesc key;
 	struct gsh_buffdesc val;
-	struct hash_latch latch;
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
 	bool str_valid = false;
@@ -346,9 +397,8 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 	key.addr = sessionid;
 	key.len = NFS4_SESSIONID_SIZE;
 
-	code = hashtable_getlatch(ht_session_id, &key, &val, false, &latch);
+	code = hashtable_getref(ht_session_id, &key, &val, Hash_inc_session_ref);
 	if (code != HASHTABLE_SUCCESS) {
-		hashtable_releaselatched(ht_session_id, &latch);
 		if (str_valid)
 			LogFullDebug(COMPONENT_SESSIONS,
 				     "Session %s Not Found", str);
@@ -356,9 +406,6 @@ int nfs41_Session_Get_Pointer(char sessionid[NFS4_SESSIONID_SIZE],
 	}
 
 	*session_data = val.addr;
-	inc_session_ref(*session_data);	/* XXX more locks? */
-
-	hashtable_releaselatched(ht_session_id, &latch);
 
 	if (str_valid)
 		LogFullDebug(COMPONENT_SESSIONS, "Session %s Found", str);
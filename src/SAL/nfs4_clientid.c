@@ -49,6 +49,7 @@
 #include "abstract_atomic.h"
 #include "city.h"
 #include "client_mgr.h"
+#include "fridgethr.h"
 
 /**
  * @brief Hashtable used to cache NFSv4 clientids
@@ -344,10 +345,15 @@ void free_client_id(nfs_client_id_t *clientid)
 		clientid->cid_recov_dir = NULL;
 	}
 
+	/* Cached CREATE_SESSION reply, if any */
+	gsh_free(clientid->cid_create_session_slot.cached_result.buf);
+
 	PTHREAD_MUTEX_destroy(&clientid->cid_mutex);
 	PTHREAD_MUTEX_destroy(&clientid->cid_owner.so_mutex);
 	if (clientid->cid_minorversion == 0)
 		PTHREAD_MUTEX_destroy(&clientid->cid_cb.v40.cb_chan.mtx);
+	else
+		PTHREAD_MUTEX_destroy(&clientid->cid_cb.v41.cb_queue_mutex);
 
 	put_gsh_client(clientid->gsh_client);
 
@@ -542,6 +548,10 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 		PTHREAD_MUTEX_init(&client_rec->cid_cb.v40.cb_chan.mtx, NULL);
 		client_rec->cid_cb.v40.cb_chan_down = true;
 		client_rec->first_path_down_resp_time = 0;
+	} else {
+		glist_init(&client_rec->cid_cb.v41.cb_queue);
+		PTHREAD_MUTEX_init(&client_rec->cid_cb.v41.cb_queue_mutex,
+				   NULL);
 	}
 
 	if (clientid == 0)
@@ -550,6 +560,8 @@ nfs_client_id_t *create_client_id(clientid4 clientid,
 	client_rec->cid_confirmed = UNCONFIRMED_CLIENT_ID;
 	client_rec->cid_clientid = clientid;
 	client_rec->cid_last_renew = time(NULL);
+	delayed_timer_init(&client_rec->cid_lease_timer, lease_expired,
+			   client_rec);
 	client_rec->cid_client_record = client_record;
 	client_rec->cid_credential = *credential;
 
@@ -632,6 +644,10 @@ clientid_status_t nfs_client_id_insert(nfs_client_id_t *clientid)
 	/* Take a reference to the unconfirmed clientid for the hash table. */
 	(void)inc_client_id_ref(clientid);
 
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+	arm_lease_timer(clientid, nfs_param.nfsv4_param.lease_lifetime);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
 	if (isFullDebug(COMPONENT_CLIENTID) &&
 	    isFullDebug(COMPONENT_HASHTABLE)) {
 		LogFullDebug(COMPONENT_CLIENTID,
@@ -855,19 +871,26 @@ bool clientid_has_state(nfs_client_id_t *clientid)
 	return live_state;
 }
 
+/** Owners released by each pass of a background teardown */
+#define CLIENT_ID_TEARDOWN_BATCH 256
+
 /**
- * @brief Client expires, need to take care of owners
+ * @brief Mark a client id expired, or stale, and unhash it
  *
- * If there is a client_record attached to the clientid,
- * this function assumes caller holds record->cr_mutex and holds a
- * reference to record also.
+ * The client record lets go of the clientid.  When @a recordp is not
+ * NULL, the clientid is to be torn down in the background: the
+ * reference of the clientid to its record passes to the caller, with
+ * cr_expiring counting the teardown.
  *
- * @param[in] clientid The client id to expire
- * @param[in] make_stale  Set if client id expire is due to ip move.
+ * @param[in]  clientid   The client id to expire
+ * @param[in]  make_stale Set if client id expire is due to ip move.
+ * @param[out] recordp    The record, or NULL if none
  *
- * @return true if the clientid is successfully expired.
+ * @return false if the clientid was already expired.
  */
-bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
+static bool client_id_mark_expired(nfs_client_id_t *clientid,
+				   bool make_stale,
+				   nfs_client_record_t **recordp)
 {
 	int rc;
 	struct gsh_buffdesc buffkey;
@@ -877,12 +900,7 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	nfs_client_record_t *record;
 	char str[LOG_BUFF_LEN];
 	struct display_buffer dspbuf = {sizeof(str), str, str};
-	bool str_valid = false;
-	struct root_op_context root_op_context;
-
-	/* Initialize req_ctx */
-	init_root_op_context(&root_op_context, NULL, NULL,
-			     0, 0, UNKNOWN_REQUEST);
+	bool lease_armed;
 
 	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
 	if (clientid->cid_confirmed == EXPIRED_CLIENT_ID) {
@@ -893,7 +911,6 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 		}
 
 		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
-		release_root_op_context();
 		return false;
 	}
 
@@ -920,10 +937,18 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 		if (record->cr_unconfirmed_rec == clientid)
 			record->cr_unconfirmed_rec = NULL;
 
-		/* the linkage was removed, update refcount */
-		dec_client_record_ref(record);
+		/* the linkage was removed, update refcount, or pass it
+		 * to the teardown
+		 */
+		if (recordp != NULL)
+			(void) atomic_inc_int32_t(&record->cr_expiring);
+		else
+			dec_client_record_ref(record);
 	}
 
+	if (recordp != NULL)
+		*recordp = record;
+
 	if (make_stale) {
 		/* Keep clientid hashed, but mark it as stale */
 		clientid->cid_confirmed = STALE_CLIENT_ID;
@@ -931,9 +956,14 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	} else {
 		/* unhash clientids that are truly expired */
 		clientid->cid_confirmed = EXPIRED_CLIENT_ID;
+		lease_armed = delayed_timer_cancel(&clientid->cid_lease_timer);
 
 		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
 
+		/* The hash table still holds its reference */
+		if (lease_armed)
+			dec_client_id_ref(clientid);
+
 		buffkey.addr = &clientid->cid_clientid;
 		buffkey.len = sizeof(clientid->cid_clientid);
 
@@ -955,6 +985,31 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 		}
 	}
 
+	return true;
+}
+
+/**
+ * @brief Release the state of a client id marked expired
+ *
+ * Lock owners go first, then layouts, open owners, delegations,
+ * callback channel and sessions.  Done in passes, each releasing at
+ * most @a budget owners and starting over where the last one stopped,
+ * since released owners leave the lists.
+ *
+ * @param[in]     clientid   The client id expired
+ * @param[in]     make_stale Set if client id expire is due to ip move.
+ * @param[in,out] budget     Owners left to release in this pass
+ *
+ * @return true once all is released, and the hash table reference to
+ *         the clientid dropped.
+ */
+static bool client_id_teardown(nfs_client_id_t *clientid, bool make_stale,
+			       uint32_t *budget)
+{
+	char str[LOG_BUFF_LEN];
+	struct display_buffer dspbuf = {sizeof(str), str, str};
+	bool str_valid = false;
+
 	/* Traverse the client's lock owners, and release all
 	 * locks and owners.
 	 *
@@ -977,6 +1032,12 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 			break;
 		}
 
+		if (*budget == 0) {
+			PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+			return false;
+		}
+		(*budget)--;
+
 		/* Move owner to end of list in case it doesn't get
 		 * freed when we decrement the refcount.
 		 */
@@ -1034,6 +1095,12 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 			break;
 		}
 
+		if (*budget == 0) {
+			PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+			return false;
+		}
+		(*budget)--;
+
 		/* Move owner to end of list in case it doesn't get
 		 * freed when we decrement the refcount.
 		 */
@@ -1097,7 +1164,9 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 	}
 
 	if (clientid->cid_recov_dir != NULL && !make_stale) {
-		nfs4_rm_clid(clientid->cid_recov_dir, v4_recov_dir, 0);
+		/* A client that expires will not reclaim anymore */
+		nfs4_reclaim_complete(clientid);
+		nfs4_rm_clid(clientid);
 		gsh_free(clientid->cid_recov_dir);
 		clientid->cid_recov_dir = NULL;
 	}
@@ -1122,7 +1191,114 @@ bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
 			     str);
 	}
 
+	return true;
+}
+
+/**
+ * @brief Client expires, need to take care of owners
+ *
+ * If there is a client_record attached to the clientid,
+ * this function assumes caller holds record->cr_mutex and holds a
+ * reference to record also.
+ *
+ * @param[in] clientid The client id to expire
+ * @param[in] make_stale  Set if client id expire is due to ip move.
+ *
+ * @return true if the clientid is successfully expired.
+ */
+bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale)
+{
+	struct root_op_context root_op_context;
+	uint32_t budget = UINT32_MAX;
+	bool expired;
+
+	/* Initialize req_ctx */
+	init_root_op_context(&root_op_context, NULL, NULL,
+			     0, 0, UNKNOWN_REQUEST);
+
+	expired = client_id_mark_expired(clientid, make_stale, NULL);
+	if (expired)
+		(void) client_id_teardown(clientid, make_stale, &budget);
+
 	release_root_op_context();
+	return expired;
+}
+
+/** A client id torn down in the background */
+struct client_id_teardown {
+	nfs_client_id_t *clientid;
+	nfs_client_record_t *record;	/*< Its cr_expiring counts us */
+	bool make_stale;
+};
+
+/* One pass, then the end of the teardown if it is done */
+static bool client_id_teardown_pass(struct client_id_teardown *td,
+				    uint32_t budget)
+{
+	struct root_op_context root_op_context;
+	bool done;
+
+	init_root_op_context(&root_op_context, NULL, NULL,
+			     0, 0, UNKNOWN_REQUEST);
+	done = client_id_teardown(td->clientid, td->make_stale, &budget);
+	release_root_op_context();
+
+	if (!done)
+		return false;
+
+	if (td->record != NULL) {
+		(void) atomic_dec_int32_t(&td->record->cr_expiring);
+		dec_client_record_ref(td->record);
+	}
+
+	dec_client_id_ref(td->clientid);
+	gsh_free(td);
+
+	return true;
+}
+
+static void client_id_teardown_job(struct fridgethr_context *ctx)
+{
+	struct client_id_teardown *td = ctx->arg;
+
+	/* The next pass goes behind the work queued meanwhile */
+	if (!client_id_teardown_pass(td, CLIENT_ID_TEARDOWN_BATCH) &&
+	    fridgethr_submit(state_async_fridge, client_id_teardown_job,
+			     td) != 0)
+		(void) client_id_teardown_pass(td, UINT32_MAX);
+}
+
+/**
+ * @brief Client expires, its state released in the background
+ *
+ * As nfs_client_id_expire, but only the clientid is expired before
+ * returning; its owners, layouts, delegations and sessions are then
+ * released on the state async thread, some at a time.  The client
+ * record keeps counting the teardown in cr_expiring, for the client
+ * to be told to wait rather than meet its own old state.
+ *
+ * @param[in] clientid The client id to expire
+ * @param[in] make_stale  Set if client id expire is due to ip move.
+ *
+ * @return true if the clientid is successfully expired.
+ */
+bool nfs_client_id_expire_async(nfs_client_id_t *clientid, bool make_stale)
+{
+	struct client_id_teardown *td = gsh_malloc(sizeof(*td));
+
+	if (!client_id_mark_expired(clientid, make_stale, &td->record)) {
+		gsh_free(td);
+		return false;
+	}
+
+	inc_client_id_ref(clientid);
+	td->clientid = clientid;
+	td->make_stale = make_stale;
+
+	if (fridgethr_submit(state_async_fridge, client_id_teardown_job,
+			     td) != 0)
+		(void) client_id_teardown_pass(td, UINT32_MAX);
+
 	return true;
 }
 
@@ -1231,7 +1407,8 @@ clientid_status_t nfs_client_id_get_confirmed(clientid4 clientid,
 }
 
 static hash_parameter_t cid_confirmed_hash_param = {
-	.index_size = PRIME_STATE,
+	.index_size = PRIME_CLIENT_ID,
+	.cache_entry_count = CLIENT_ID_CACHE_SIZE,
 	.hash_func_key = client_id_value_hash_func,
 	.hash_func_rbt = client_id_rbt_hash_func,
 	.hash_func_both = NULL,
@@ -1239,12 +1416,13 @@ static hash_parameter_t cid_confirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Confirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_LOCKLESS,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
 static hash_parameter_t cid_unconfirmed_hash_param = {
-	.index_size = PRIME_STATE,
+	.index_size = PRIME_CLIENT_ID,
+	.cache_entry_count = CLIENT_ID_CACHE_SIZE,
 	.hash_func_key = client_id_value_hash_func,
 	.hash_func_rbt = client_id_rbt_hash_func,
 	.hash_func_both = NULL,
@@ -1252,12 +1430,13 @@ static hash_parameter_t cid_unconfirmed_hash_param = {
 	.key_to_str = display_client_id_key,
 	.val_to_str = display_client_id_val,
 	.ht_name = "Unconfirmed Client ID",
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_LOCKLESS,
 	.ht_log_component = COMPONENT_CLIENTID,
 };
 
 static hash_parameter_t cr_hash_param = {
-	.index_size = PRIME_STATE,
+	.index_size = PRIME_CLIENT_ID,
+	.cache_entry_count = CLIENT_ID_CACHE_SIZE,
 	.hash_func_key = client_record_value_hash_func,
 	.hash_func_rbt = client_record_rbt_hash_func,
 	.hash_func_both = NULL,
@@ -1306,6 +1485,8 @@ int nfs_Init_client_id(void)
 
 	client_id_pool =
 	    pool_basic_init("NFS4 Client ID Pool", sizeof(nfs_client_id_t));
+	if (nfs_param.core_param.state_hugepage_arenas)
+		pool_arena_init(client_id_pool);
 
 	return CLIENT_ID_SUCCESS;
 }
@@ -1655,6 +1836,7 @@ nfs_client_record_t *get_client_record(const char *const value,
 	record->cr_client_val_len = len;
 	record->cr_confirmed_rec = NULL;
 	record->cr_unconfirmed_rec = NULL;
+	record->cr_expiring = 0;
 	memcpy(record->cr_client_val, value, len);
 	record->cr_pnfs_flags = pnfs_flags;
 	record->cr_server_addr = server_addr;
@@ -1787,4 +1969,55 @@ nfs41_foreach_client_callback(bool(*cb) (nfs_client_id_t *cl, void *state),
 	}
 }
 
+/**
+ * @brief Call a function on each confirmed 4.1 client, in this thread
+ *
+ * The clients are referenced under the partition locks, and the calls
+ * made once they are all dropped.  The state stays the caller's.
+ *
+ * @param cb    [IN] Callback function
+ * @param state [IN] param block to pass
+ */
+
+void nfs41_foreach_client(void (*cb)(nfs_client_id_t *cl, void *state),
+			  void *state)
+{
+	hash_table_t *ht = ht_confirmed_client_id;
+	nfs_client_id_t **clients = NULL;
+	size_t count = 0, size = 0, i;
+	struct rbt_node *pn;
+
+	for (i = 0; i < ht->parameter.index_size; i++) {
+		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
+
+		RBT_LOOP(&ht->partitions[i].rbt, pn) {
+			struct hash_data *pdata = RBT_OPAQ(pn);
+			nfs_client_id_t *pclientid = pdata->val.addr;
+
+			RBT_INCREMENT(pn);
+
+			if (pclientid->cid_minorversion == 0)
+				continue;
+
+			if (count == size) {
+				size = size ? size * 2 : 64;
+				clients = gsh_realloc(clients,
+						      size * sizeof(*clients));
+			}
+
+			inc_client_id_ref(pclientid);
+			clients[count++] = pclientid;
+		}
+
+		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+	}
+
+	for (i = 0; i < count; i++) {
+		cb(clients[i], state);
+		dec_client_id_ref(clients[i]);
+	}
+
+	gsh_free(clients);
+}
+
 /** @} */
@@ -66,6 +66,85 @@ static unsigned int _valid_lease(nfs_client_id_t *clientid)
 	return 0;
 }
 
+/**
+ * @brief Arm the timer that expires a lease
+ *
+ * The caller must hold cid_mutex.  The armed timer holds a reference
+ * to the clientid.  Every hashed clientid not expired has its timer
+ * armed, or a reservation whose release arms it, so the reaper need
+ * not look for expired leases.
+ *
+ * @param[in] clientid The client record
+ * @param[in] seconds  Left of the lease
+ */
+void arm_lease_timer(nfs_client_id_t *clientid, unsigned int seconds)
+{
+	/* A second more, leases are kept in seconds of time() and the
+	   wheels run on the monotonic clock */
+	if (!delayed_timer_arm(&clientid->cid_lease_timer,
+			       (seconds + 1) * NS_PER_SEC))
+		inc_client_id_ref(clientid);
+}
+
+/**
+ * @brief Expire a lease whose timer ran out
+ *
+ * A lease renewed or reserved meanwhile is left alone,
+ * its timer armed again if need be.
+ *
+ * @param[in] arg The clientid, whose reference from the timer we own
+ */
+void lease_expired(void *arg)
+{
+	nfs_client_id_t *clientid = arg;
+	nfs_client_record_t *client_rec;
+	unsigned int valid;
+
+	PTHREAD_MUTEX_lock(&clientid->cid_mutex);
+
+	valid = _valid_lease(clientid);
+	if (valid != 0) {
+		/* Our reference passes to the timer armed again */
+		if (clientid->cid_lease_reservations == 0 &&
+		    !delayed_timer_pending(&clientid->cid_lease_timer)) {
+			(void)delayed_timer_arm(&clientid->cid_lease_timer,
+						(valid + 1) * NS_PER_SEC);
+			PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+			return;
+		}
+		PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+		dec_client_id_ref(clientid);
+		return;
+	}
+
+	if (isFullDebug(COMPONENT_CLIENTID)) {
+		char str[LOG_BUFF_LEN];
+		struct display_buffer dspbuf = {sizeof(str), str, str};
+
+		display_client_id_rec(&dspbuf, clientid);
+		LogFullDebug(COMPONENT_CLIENTID, "Lease timer expires %s", str);
+	}
+
+	/* A ref on the client record, held under its cr_mutex, before
+	   we drop cid_mutex */
+	client_rec = clientid->cid_client_record;
+	if (client_rec != NULL)
+		inc_client_record_ref(client_rec);
+	PTHREAD_MUTEX_unlock(&clientid->cid_mutex);
+
+	if (client_rec != NULL)
+		PTHREAD_MUTEX_lock(&client_rec->cr_mutex);
+
+	nfs_client_id_expire_async(clientid, false);
+
+	if (client_rec != NULL) {
+		PTHREAD_MUTEX_unlock(&client_rec->cr_mutex);
+		dec_client_record_ref(client_rec);
+	}
+
+	dec_client_id_ref(clientid);
+}
+
 /**
  * @brief Check if lease is valid
  *
@@ -145,8 +224,12 @@ void update_lease(nfs_client_id_t *clientid)
 	clientid->cid_lease_reservations--;
 
 	/* Renew lease when last reservation is released */
-	if (clientid->cid_lease_reservations == 0)
+	if (clientid->cid_lease_reservations == 0) {
 		clientid->cid_last_renew = time(NULL);
+		if (clientid->cid_confirmed != EXPIRED_CLIENT_ID)
+			arm_lease_timer(clientid,
+					nfs_param.nfsv4_param.lease_lifetime);
+	}
 
 	if (isFullDebug(COMPONENT_CLIENTID)) {
 		char str[LOG_BUFF_LEN];
@@ -41,6 +41,7 @@
 #include "sal_functions.h"
 #include "nfs_proto_functions.h"
 #include "nfs_core.h"
+#include "city.h"
 
 hash_table_t *ht_nfs4_owner;
 
@@ -243,9 +244,24 @@ int compare_nfs4_owner_key(struct gsh_buffdesc *buff1,
 }
 
 /**
- * @brief Compute the hash index for an NFSv4 owner
+ * @brief Hash an NFSv4 owner
+ *
+ * Clients number their owners with counters, which a sum of the bytes
+ * packs into a few values, so hash the whole owner.
+ *
+ * @param[in] pkey The owner
  *
- * @todo Destroy this function and replace it with a real hash.
+ * @return The hash.
+ */
+static inline uint64_t nfs4_owner_hash(state_owner_t *pkey)
+{
+	return CityHash64WithSeed(pkey->so_owner_val, pkey->so_owner_len,
+				  pkey->so_owner.so_nfs4_owner.so_clientid +
+				  pkey->so_type);
+}
+
+/**
+ * @brief Compute the hash index for an NFSv4 owner
  *
  * @param[in] hparam Hash parameter
  * @param[in] key    The key
@@ -255,23 +271,10 @@ int compare_nfs4_owner_key(struct gsh_buffdesc *buff1,
 uint32_t nfs4_owner_value_hash_func(hash_parameter_t *hparam,
 				    struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i = 0;
-	unsigned char c = 0;
-	uint32_t res = 0;
+	uint32_t res;
 
-	state_owner_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++) {
-		c = ((char *)pkey->so_owner_val)[i];
-		sum += c;
-	}
-
-	res =
-	    ((uint32_t) pkey->so_owner.so_nfs4_owner.so_clientid +
-	     (uint32_t) sum + pkey->so_owner_len +
-	     (uint32_t) pkey->so_type) % (uint32_t) hparam->index_size;
+	res = (nfs4_owner_hash(key->addr) >> 32) %
+	      (uint32_t) hparam->index_size;
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "value = %" PRIu32, res);
@@ -282,8 +285,6 @@ uint32_t nfs4_owner_value_hash_func(hash_parameter_t *hparam,
 /**
  * @brief Compute the RBT hash for an NFSv4 owner
  *
- * @todo Destroy this function and replace it with a real hash.
- *
  * @param[in] hparam Hash parameter
  * @param[in] key    The key
  *
@@ -292,22 +293,7 @@ uint32_t nfs4_owner_value_hash_func(hash_parameter_t *hparam,
 uint64_t nfs4_owner_rbt_hash_func(hash_parameter_t *hparam,
 				  struct gsh_buffdesc *key)
 {
-	state_owner_t *pkey = key->addr;
-
-	unsigned int sum = 0;
-	unsigned int i = 0;
-	unsigned char c = 0;
-	uint64_t res = 0;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++) {
-		c = ((char *)pkey->so_owner_val)[i];
-		sum += c;
-	}
-
-	res =
-	    (uint64_t) pkey->so_owner.so_nfs4_owner.so_clientid +
-	    (uint64_t) sum + pkey->so_owner_len + (uint64_t) pkey->so_type;
+	uint64_t res = nfs4_owner_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "rbt = %" PRIu64, res);
@@ -343,7 +329,7 @@ void free_nfs4_owner(state_owner_t *owner)
 }
 
 static hash_parameter_t nfs4_owner_param = {
-	.index_size = PRIME_STATE,
+	.index_size = PRIME_OWNER,
 	.hash_func_key = nfs4_owner_value_hash_func,
 	.hash_func_rbt = nfs4_owner_rbt_hash_func,
 	.compare_key = compare_nfs4_owner_key,
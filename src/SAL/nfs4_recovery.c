@@ -34,23 +34,146 @@
 #include "nfs_core.h"
 #include "nfs4.h"
 #include "sal_functions.h"
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <fcntl.h>
 #include <ctype.h>
+#include <stdlib.h>
 #include "bsd-base64.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "city.h"
+#include "export_mgr.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
-#define NFS_V4_RECOV_DIR "v4recov"
-#define NFS_V4_OLD_DIR "v4old"
-
-char v4_recov_dir[PATH_MAX];
-char v4_old_dir[PATH_MAX];
 time_t current_grace;
 pthread_mutex_t grace_mutex = PTHREAD_MUTEX_INITIALIZER;        /*< Mutex */
 struct glist_head clid_list = GLIST_HEAD_INIT(clid_list);  /*< Clients */
 
+/**
+ * @brief Buckets of clid_list hashed by client name
+ *
+ * Every reclaiming client looks itself up in clid_list under the
+ * grace_mutex, so after a failover with many clients a walk of the whole
+ * list per lookup made reclaim quadratic.  Protected by grace_mutex.
+ */
+#define CLID_HASH_SIZE 4093
+static struct glist_head clid_hash[CLID_HASH_SIZE];
+static bool clid_hash_ready;
+
+static inline struct glist_head *clid_hash_bucket(const char *name)
+{
+	return &clid_hash[CityHash64(name, strlen(name)) % CLID_HASH_SIZE];
+}
+
+/**
+ * @brief Clients in clid_list, and how many of them completed reclaim
+ *
+ * Grace is lifted early once they are equal.  Protected by grace_mutex.
+ */
+static uint32_t clid_count;
+static uint32_t reclaim_completes;
+
+/**
+ * @brief Grace periods of single exports
+ *
+ * Each nfs4_start_export_grace gets the next generation; exports of
+ * generations up to export_grace_lifted are out of grace whatever
+ * their start.  export_grace_end is when the last of them ends, the
+ * earliest a client may still reclaim on some export.  Written under
+ * grace_mutex, read atomically.
+ */
+static uint32_t export_grace_next;
+static uint32_t export_grace_lifted;
+static time_t export_grace_end;
+
+/**
+ * @brief Add a client to clid_list, grace_mutex held
+ *
+ * @param[in] clid_ent Client entry
+ */
+static void clid_list_add(clid_entry_t *clid_ent)
+{
+	glist_add(&clid_list, &clid_ent->cl_list);
+	glist_add(clid_hash_bucket(clid_ent->cl_name), &clid_ent->cl_hash);
+	clid_count++;
+}
+
+/**
+ * @brief Find a client in clid_list, grace_mutex held
+ *
+ * @param[in] name Client name
+ *
+ * @return The entry or NULL.
+ */
+static clid_entry_t *clid_list_find(const char *name)
+{
+	struct glist_head *node;
+	clid_entry_t *clid_ent;
+	int i;
+
+	if (!clid_hash_ready) {
+		for (i = 0; i < CLID_HASH_SIZE; i++)
+			glist_init(&clid_hash[i]);
+		clid_hash_ready = true;
+	}
+
+	glist_for_each(node, clid_hash_bucket(name)) {
+		clid_ent = glist_entry(node, clid_entry_t, cl_hash);
+		LogDebug(COMPONENT_CLIENTID, "compare %s to %s",
+			 clid_ent->cl_name, name);
+		if (!strncmp(clid_ent->cl_name, name, PATH_MAX))
+			return clid_ent;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief End grace if every client we know of completed reclaim
+ *
+ * NLM clients reclaim without telling us when they are done, so grace
+ * always runs to its end with NLM enabled.  Called with grace_mutex
+ * held.
+ */
+static void nfs_try_lift_grace(void)
+{
+#ifdef USE_DBUS
+	dbus_uint32_t *clients;
+#endif
+
+	if (nfs_param.core_param.enable_NLM ||
+	    reclaim_completes != clid_count)
+		return;
+
+	if (export_grace_lifted != export_grace_next) {
+		atomic_store_uint32_t(&export_grace_lifted, export_grace_next);
+		atomic_store_time_t(&export_grace_end, 0);
+		LogEvent(COMPONENT_STATE,
+			 "NFS Server lifting GRACE of the exports, all %"PRIu32" clients reclaimed",
+			 clid_count);
+	}
+
+	if (atomic_fetch_time_t(&current_grace) == 0)
+		return;
+
+	atomic_store_time_t(&current_grace, 0);
+
+	LogEvent(COMPONENT_STATE,
+		 "NFS Server lifting GRACE, all %"PRIu32" clients reclaimed, %"PRIu64" ms since start",
+		 clid_count, nfs_uptime_ms());
+
+#ifdef USE_DBUS
+	clients = gsh_malloc(sizeof(*clients));
+	*clients = clid_count;
+	add_dbus_broadcast(dbus_grace_lifted_cb, clients, 0, 1);
+#endif
+}
+
+/**
+ * @brief Where client records are kept, chosen by RecoveryBackend
+ */
+static const struct nfs4_recovery_backend *recovery_backend = &fs_backend;
+
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp);
 static void nfs_release_nlm_state(char *release_ip);
 static void nfs_release_v4_client(char *ip);
@@ -66,6 +189,8 @@ static void nfs_release_v4_client(char *ip);
  */
 void nfs4_start_grace(nfs_grace_start_t *gsp)
 {
+	bool release_v4 = false;
+
 	if (nfs_param.nfsv4_param.graceless) {
 		LogEvent(COMPONENT_STATE,
 			 "NFS Server skipping GRACE (Graceless is true)");
@@ -105,17 +230,136 @@ void nfs4_start_grace(nfs_grace_start_t *gsp)
 		else {
 			nfs_release_nlm_state(gsp->ipaddr);
 			if (gsp->event == EVENT_RELEASE_IP)
-				nfs_release_v4_client(gsp->ipaddr);
+				release_v4 = true;
 			else
 				nfs4_load_recov_clids_nolock(gsp);
 		}
+	} else if (gsp == NULL) {
+		/* At startup, nothing to wait for without old clients */
+		nfs_try_lift_grace();
+	}
+	PTHREAD_MUTEX_unlock(&grace_mutex);
+
+	/* Expiring the client takes grace_mutex to note that it will not
+	 * reclaim.
+	 */
+	if (release_v4)
+		nfs_release_v4_client(gsp->ipaddr);
+}
+
+struct export_grace_start {
+	struct fsal_filesystem *fs;
+	time_t start;
+	uint32_t gen;
+	uint32_t count;
+};
+
+static void export_grace_set(struct gsh_export *export,
+			     struct export_grace_start *egs)
+{
+	atomic_store_uint32_t(&export->exp_grace_gen, egs->gen);
+	atomic_store_time_t(&export->exp_grace_start, egs->start);
+	egs->count++;
+}
+
+static bool export_grace_same_fs(struct gsh_export *export, void *state)
+{
+	struct export_grace_start *egs = state;
+
+	PTHREAD_RWLOCK_rdlock(&export->lock);
+	if (export->exp_root_obj != NULL &&
+	    export->exp_root_obj->fs == egs->fs)
+		export_grace_set(export, egs);
+	PTHREAD_RWLOCK_unlock(&export->lock);
+
+	return true;
+}
+
+/**
+ * @brief Start a grace period on some exports only
+ *
+ * For an export moved to this node, or the filesystem under it failed
+ * over: new opens and locks wait on those exports alone, while the
+ * others serve as usual.  A take over event also loads the clients of
+ * the other node, so that they may reclaim.
+ *
+ * @param[in] export   The export
+ * @param[in] whole_fs Also the other exports on its filesystem
+ * @param[in] gsp      Take over information, or NULL
+ */
+void nfs4_start_export_grace(struct gsh_export *export, bool whole_fs,
+			     nfs_grace_start_t *gsp)
+{
+	struct export_grace_start egs = { .start = time(NULL) };
+
+	if (nfs_param.nfsv4_param.graceless) {
+		LogEvent(COMPONENT_STATE,
+			 "NFS Server skipping GRACE (Graceless is true)");
+		return;
 	}
+
+	PTHREAD_MUTEX_lock(&grace_mutex);
+
+	egs.gen = ++export_grace_next;
+
+	PTHREAD_RWLOCK_rdlock(&export->lock);
+	if (whole_fs && export->exp_root_obj != NULL)
+		egs.fs = export->exp_root_obj->fs;
+	PTHREAD_RWLOCK_unlock(&export->lock);
+
+	if (egs.fs != NULL)
+		(void) foreach_gsh_export(export_grace_same_fs, &egs);
+	else
+		export_grace_set(export, &egs);
+
+	atomic_store_time_t(&export_grace_end,
+			    egs.start + nfs_param.nfsv4_param.grace_period);
+
+	LogEvent(COMPONENT_STATE,
+		 "Export %d%s Now IN GRACE, duration %d, %"PRIu32" exports",
+		 export->export_id, egs.fs != NULL ? " and its filesystem" : "",
+		 (int)nfs_param.nfsv4_param.grace_period, egs.count);
+
+	if (gsp != NULL &&
+	    (gsp->event == EVENT_TAKE_NODEID || gsp->event == EVENT_TAKE_IP)) {
+		LogEvent(COMPONENT_STATE,
+			 "NFS Server recovery event %d nodeid %d ip %s",
+			 gsp->event, gsp->nodeid, gsp->ipaddr);
+		nfs4_load_recov_clids_nolock(gsp);
+	}
+
 	PTHREAD_MUTEX_unlock(&grace_mutex);
 }
 
+/**
+ * @brief Check if an export is in a grace period of its own
+ *
+ * @param[in] export The export
+ */
+bool nfs_export_in_grace(struct gsh_export *export)
+{
+	time_t start = atomic_fetch_time_t(&export->exp_grace_start);
+
+	if (start == 0 ||
+	    atomic_fetch_uint32_t(&export->exp_grace_gen) <=
+	    atomic_fetch_uint32_t(&export_grace_lifted))
+		return false;
+
+	return start + nfs_param.nfsv4_param.grace_period > time(NULL);
+}
+
+/* Whether any client may still reclaim, on some export or all */
+static bool nfs_any_grace(void)
+{
+	return nfs_in_grace() ||
+	       atomic_fetch_time_t(&export_grace_end) > time(NULL);
+}
+
 /**
  * @brief Check if we are in the grace period
  *
+ * The server as a whole, or the export of the request.
+ *
  * @retval true if so.
  * @retval false if not.
  */
@@ -130,9 +374,18 @@ int nfs_in_grace(void)
 	in_grace = ((atomic_fetch_time_t(&current_grace) +
 		     nfs_param.nfsv4_param.grace_period) > time(NULL));
 
+	if (!in_grace && op_ctx != NULL && op_ctx->ctx_export != NULL &&
+	    nfs_export_in_grace(op_ctx->ctx_export)) {
+		LogDebug(COMPONENT_STATE, "Export %d IN GRACE",
+			 op_ctx->ctx_export->export_id);
+		return 1;
+	}
+
 	if (in_grace != last_grace) {
-		LogEvent(COMPONENT_STATE, "NFS Server Now %s",
-			 in_grace ? "IN GRACE" : "NOT IN GRACE");
+		LogEvent(COMPONENT_STATE,
+			 "NFS Server Now %s, %"PRIu64" ms since start",
+			 in_grace ? "IN GRACE" : "NOT IN GRACE",
+			 nfs_uptime_ms());
 		last_grace = in_grace;
 	} else if (in_grace) {
 		LogDebug(COMPONENT_STATE, "NFS Server IN GRACE");
@@ -285,154 +538,111 @@ void nfs4_create_clid_name41(nfs_client_record_t *cl_rec,
 }
 
 /**
- * @brief Create an entry in the recovery directory
+ * @brief Add a client to the reclaim list
  *
- * This entry alows the client to reclaim state after a server
- * reboot/restart.
+ * Called by the recovery backends while loading, grace_mutex held.
  *
- * @param[in] clientid Client record
+ * @param[in] cl_name Client name
+ *
+ * @return The entry, to which revoked handles may be added.
  */
-void nfs4_add_clid(nfs_client_id_t *clientid)
+clid_entry_t *nfs4_add_clid_entry(char *cl_name)
 {
-	int err = 0;
-	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
-	int length, position = 0;
+	clid_entry_t *new_ent;
 
-	if (clientid->cid_minorversion > 0)
-		nfs4_create_clid_name41(clientid->cid_client_record, clientid);
+	/* A client may be recorded twice, in the old and current records,
+	 * it must be counted once.
+	 */
+	new_ent = clid_list_find(cl_name);
+	if (new_ent != NULL)
+		return new_ent;
+
+	new_ent = gsh_malloc(sizeof(clid_entry_t));
+	glist_init(&new_ent->cl_rfh_list);
+	new_ent->cl_reclaim_complete = false;
+	strcpy(new_ent->cl_name, cl_name);
+	clid_list_add(new_ent);
+	LogDebug(COMPONENT_CLIENTID, "added %s to clid list",
+		 new_ent->cl_name);
+
+	return new_ent;
+}
+
+/**
+ * @brief Add a revoked handle to a client of the reclaim list
+ *
+ * @param[in] clid_ent Client entry
+ * @param[in] rfh_name Base64 encoded handle
+ *
+ * @return The new entry.
+ */
+rdel_fh_t *nfs4_add_rfh_entry(clid_entry_t *clid_ent, char *rfh_name)
+{
+	rdel_fh_t *new_ent = gsh_malloc(sizeof(rdel_fh_t));
 
-	/* break clientid down if it is greater than max dir name */
-	/* and create a directory hierachy to represent the clientid. */
-	snprintf(path, sizeof(path), "%s", v4_recov_dir);
+	new_ent->rdfh_handle_str = gsh_strdup(rfh_name);
+	glist_add(&clid_ent->cl_rfh_list, &new_ent->rdfh_list);
+	LogFullDebug(COMPONENT_CLIENTID, "revoked handle: %s",
+		     new_ent->rdfh_handle_str);
 
-	length = strlen(clientid->cid_recov_dir);
-	while (position < length) {
-		/* if the (remaining) clientid is shorter than 255 */
-		/* create the last level of dir and break out */
-		int len = strlen(&clientid->cid_recov_dir[position]);
+	return new_ent;
+}
 
-		if (len <= NAME_MAX) {
-			strcat(path, "/");
-			strncat(path, &clientid->cid_recov_dir[position], len);
-			err = mkdir(path, 0700);
-			break;
+/**
+ * @brief Empty the reclaim list, grace_mutex held
+ */
+static void nfs4_free_clid_list(void)
+{
+	clid_entry_t *clid_ent;
+	rdel_fh_t *rfh_ent;
+
+	while ((clid_ent = glist_first_entry(&clid_list, clid_entry_t,
+					     cl_list)) != NULL) {
+		while ((rfh_ent = glist_first_entry(&clid_ent->cl_rfh_list,
+						    rdel_fh_t,
+						    rdfh_list)) != NULL) {
+			glist_del(&rfh_ent->rdfh_list);
+			gsh_free(rfh_ent->rdfh_handle_str);
+			gsh_free(rfh_ent);
 		}
-		/* if (remaining) clientid is longer than 255, */
-		/* get the next 255 bytes and create a subdir */
-		strncpy(segment, &clientid->cid_recov_dir[position], NAME_MAX);
-		strcat(path, "/");
-		strncat(path, segment, NAME_MAX);
-		err = mkdir(path, 0700);
-		if (err == -1 && errno != EEXIST)
-			break;
-		position += NAME_MAX;
+		glist_del(&clid_ent->cl_list);
+		glist_del(&clid_ent->cl_hash);
+		gsh_free(clid_ent);
 	}
 
-	if (err == -1 && errno != EEXIST) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to create client in recovery dir (%s), errno=%d",
-			 path, errno);
-	} else {
-		LogDebug(COMPONENT_CLIENTID, "Created client dir [%s]", path);
-	}
+	clid_count = 0;
+	reclaim_completes = 0;
 }
 
 /**
- * @brief Remove the revoked file handles created under a specific
- * client-id path on the stable storage.
+ * @brief Create an entry in the stable storage
+ *
+ * This entry alows the client to reclaim state after a server
+ * reboot/restart.
  *
- * @param[in] path Path of the client-id on the stable storage.
+ * @param[in] clientid Client record
  */
-
-void nfs4_rm_revoked_handles(char *path)
+void nfs4_add_clid(nfs_client_id_t *clientid)
 {
-	DIR *dp;
-	struct dirent *dentp;
-	char del_path[PATH_MAX];
-
-	dp = opendir(path);
-	if (dp == NULL) {
-		LogEvent(COMPONENT_CLIENTID, "opendir %s failed errno=%d",
-			path, errno);
-		return;
-	}
-	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
-		if (!strcmp(dentp->d_name, ".") ||
-				!strcmp(dentp->d_name, "..") ||
-				dentp->d_name[0] != '\x1') {
-			continue;
-		}
-
-		snprintf(del_path, sizeof(del_path), "%s/%s",
-			 path, dentp->d_name);
+	if (clientid->cid_minorversion > 0)
+		nfs4_create_clid_name41(clientid->cid_client_record, clientid);
 
-		if (unlink(del_path) < 0) {
-			LogEvent(COMPONENT_CLIENTID,
-					"unlink of %s failed errno: %d",
-					del_path,
-					errno);
-		}
-	}
-	(void)closedir(dp);
+	recovery_backend->add_clid(clientid);
 }
 
 /**
- * @brief Remove a client entry from the recovery directory
+ * @brief Remove a client entry from the stable storage
  *
  * This function would be called when a client expires.
  *
- * @param[in] recov_dir Recovery directory
+ * @param[in] clientid Client record
  */
-void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
+void nfs4_rm_clid(nfs_client_id_t *clientid)
 {
-	int err;
-	char *path;
-	char *segment;
-	int len, segment_len;
-	int total_len;
-
-	if (recov_dir == NULL)
-		return;
-
-	len = strlen(recov_dir);
-	if (position == len) {
-		/* We are at the tail directory of the clid,
-		 * remove revoked handles, if any.
-		 */
-		nfs4_rm_revoked_handles(parent_path);
+	if (clientid->cid_recov_dir == NULL)
 		return;
-	}
-	segment = gsh_malloc(NAME_MAX+1);
-
-	memset(segment, 0, NAME_MAX+1);
-	strncpy(segment, &recov_dir[position], NAME_MAX);
-	segment_len = strlen(segment);
 
-	/* allocate enough memory for the new part of the string */
-	/* which is parent path + '/' + new segment */
-	total_len = strlen(parent_path) + segment_len + 2;
-	path = gsh_malloc(total_len);
-
-	memset(path, 0, total_len);
-	(void) snprintf(path, total_len, "%s/%s",
-			parent_path, segment);
-	/* free setment as it has no use now */
-	gsh_free(segment);
-
-	/* recursively remove the directory hirerchy which represent the
-	 *clientid
-	 */
-	nfs4_rm_clid(recov_dir, path, position+segment_len);
-
-	err = rmdir(path);
-	if (err == -1) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to remove client recovery dir (%s), errno=%d",
-			 path, errno);
-	} else {
-		LogDebug(COMPONENT_CLIENTID, "Removed client dir [%s]", path);
-	}
-	gsh_free(path);
+	recovery_backend->rm_clid(clientid);
 }
 
 /**
@@ -444,7 +654,6 @@ void nfs4_rm_clid(const char *recov_dir, char *parent_path, int position)
  */
 void  nfs4_chk_clid_impl(nfs_client_id_t *clientid, clid_entry_t **clid_ent_arg)
 {
-	struct glist_head *node;
 	clid_entry_t *clid_ent;
 	*clid_ent_arg = NULL;
 
@@ -457,33 +666,24 @@ void  nfs4_chk_clid_impl(nfs_client_id_t *clientid, clid_entry_t **clid_ent_arg)
 		return;
 
 	/*
-	 * loop through the list and try to find this client.  if we
-	 * find it, mark it to allow reclaims.  perhaps the client should
-	 * be removed from the list at this point to make the list shorter?
+	 * look through the client's bucket and try to find this client.
+	 * if we find it, mark it to allow reclaims.
 	 */
-	glist_for_each(node, &clid_list) {
-		clid_ent = glist_entry(node, clid_entry_t, cl_list);
-		LogDebug(COMPONENT_CLIENTID, "compare %s to %s",
-			 clid_ent->cl_name, clientid->cid_recov_dir);
-		if (!strncmp(clid_ent->cl_name,
-			     clientid->cid_recov_dir,
-			     PATH_MAX)) {
-			if (isDebug(COMPONENT_CLIENTID)) {
-				char str[LOG_BUFF_LEN];
-				struct display_buffer dspbuf = {
-					sizeof(str), str, str};
-
-				display_client_id_rec(&dspbuf, clientid);
-
-				LogFullDebug(COMPONENT_CLIENTID,
-					     "Allowed to reclaim ClientId %s",
-					     str);
-			}
-			clientid->cid_allow_reclaim = 1;
-			*clid_ent_arg = clid_ent;
-			return;
-		}
+	clid_ent = clid_list_find(clientid->cid_recov_dir);
+	if (clid_ent == NULL)
+		return;
+
+	if (isDebug(COMPONENT_CLIENTID)) {
+		char str[LOG_BUFF_LEN];
+		struct display_buffer dspbuf = {sizeof(str), str, str};
+
+		display_client_id_rec(&dspbuf, clientid);
+
+		LogFullDebug(COMPONENT_CLIENTID,
+			     "Allowed to reclaim ClientId %s", str);
 	}
+	clientid->cid_allow_reclaim = 1;
+	*clid_ent_arg = clid_ent;
 }
 
 void  nfs4_chk_clid(nfs_client_id_t *clientid)
@@ -491,433 +691,62 @@ void  nfs4_chk_clid(nfs_client_id_t *clientid)
 	clid_entry_t *dummy_clid_ent;
 
 	/* If we aren't in grace period, then reclaim is not possible */
-	if (!nfs_in_grace())
+	if (!nfs_any_grace())
 		return;
 	PTHREAD_MUTEX_lock(&grace_mutex);
 	nfs4_chk_clid_impl(clientid, &dummy_clid_ent);
 	PTHREAD_MUTEX_unlock(&grace_mutex);
 }
 
-static void free_heap(char *path, char *new_path, char *build_clid)
-{
-	if (path)
-		gsh_free(path);
-	if (new_path)
-		gsh_free(new_path);
-	if (build_clid)
-		gsh_free(build_clid);
-}
-
 /**
- * @brief Copy and Populate revoked delegations for this client.
+ * @brief Note that a client will not reclaim any more state
  *
- * Even after delegation revoke, it is possible for the client to
- * contiue its leas and other operatoins. Sever saves revoked delegations
- * in the memory so client will not be granted same delegation with
- * DELEG_CUR ; but it is possible that the server might reboot and has
- * no record of the delegatin. This list helps to reject delegations
- * client is obtaining through DELEG_PREV.
+ * Called on RECLAIM_COMPLETE and when a client expires.  Once every
+ * client of the reclaim list is done, grace is lifted without waiting
+ * for the end of the grace period.
  *
- * @param[in] clientid Clientid that is being created.
- * @param[in] path Path of the directory structure.
- * @param[in] Target dir to copy.
- * @param[in] del Delete after populating
+ * @param[in] clientid Client record
  */
-
-void nfs4_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
-				char *path,
-				char *tgtdir,
-				bool del)
+void nfs4_reclaim_complete(nfs_client_id_t *clientid)
 {
-	struct dirent *dentp;
-	DIR *dp;
-	rdel_fh_t *new_ent;
-
-	glist_init(&clid_ent->cl_rfh_list);
-	/* Read the contents from recov dir of this clientid. */
-	dp = opendir(path);
-	if (dp == NULL) {
-		LogEvent(COMPONENT_CLIENTID, "opendir %s failed errno=%d",
-			path, errno);
-		return;
-	}
-
-	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
-		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
-			continue;
-		/* All the revoked filehandles stored with \x1 prefix */
-		if (dentp->d_name[0] != '\x1') {
-			/* Something wrong; it should not happen */
-			LogMidDebug(COMPONENT_CLIENTID,
-				"%s showed up along with revoked FHs. Skipping",
-				dentp->d_name);
-			continue;
-		}
-
-		if (tgtdir) {
-			char lopath[PATH_MAX];
-			int fd;
-
-			snprintf(lopath, sizeof(lopath), "%s/", tgtdir);
-			strncat(lopath, dentp->d_name, strlen(dentp->d_name));
-			fd = creat(lopath, 0700);
-			if (fd < 0) {
-				LogEvent(COMPONENT_CLIENTID,
-					"Failed to copy revoked handle file %s to %s errno:%d\n",
-				dentp->d_name, tgtdir, errno);
-			} else {
-				close(fd);
-			}
-		}
-
-		new_ent = gsh_malloc(sizeof(rdel_fh_t));
-
-		/* Ignore the beginning \x1 and copy the rest (file handle) */
-		new_ent->rdfh_handle_str = gsh_strdup(dentp->d_name+1);
-
-		glist_add(&clid_ent->cl_rfh_list, &new_ent->rdfh_list);
-		LogFullDebug(COMPONENT_CLIENTID,
-			"revoked handle: %s",
-			new_ent->rdfh_handle_str);
+	clid_entry_t *clid_ent;
 
-		/* Since the handle is loaded into memory, go ahead and
-		 * delete it from the stable storage.
-		 */
-		if (del) {
-			char del_path[PATH_MAX];
+	if (clientid->cid_recov_dir == NULL || !nfs_any_grace())
+		return;
 
-			snprintf(del_path, sizeof(del_path), "%s/%s",
-				 path, dentp->d_name);
+	PTHREAD_MUTEX_lock(&grace_mutex);
 
-			if (unlink(del_path) < 0) {
-				LogEvent(COMPONENT_CLIENTID,
-						"unlink of %s failed errno: %d",
-						del_path,
-						errno);
-			}
-		}
+	clid_ent = clid_list_find(clientid->cid_recov_dir);
+	if (clid_ent != NULL && !clid_ent->cl_reclaim_complete) {
+		clid_ent->cl_reclaim_complete = true;
+		reclaim_completes++;
+		LogDebug(COMPONENT_CLIENTID,
+			 "%s done reclaiming, %"PRIu32" of %"PRIu32,
+			 clid_ent->cl_name, reclaim_completes, clid_count);
+		nfs_try_lift_grace();
 	}
 
-	(void)closedir(dp);
+	PTHREAD_MUTEX_unlock(&grace_mutex);
 }
 
 
-/**
- * @brief Create the client reclaim list
- *
- * When not doing a take over, first open the old state dir and read
- * in those entries.  The reason for the two directories is in case of
- * a reboot/restart during grace period.  Next, read in entries from
- * the recovery directory and then move them into the old state
- * directory.  if called due to a take over, nodeid will be nonzero.
- * in this case, add that node's clientids to the existing list.  Then
- * move those entries into the old state directory.
- *
- * @param[in] dp       Recovery directory
- * @param[in] srcdir   Path to the source directory on failover
- * @param[in] takeover Whether this is a takeover.
- *
- * @return POSIX error codes.
- */
-static int nfs4_read_recov_clids(DIR *dp,
-				 const char *parent_path,
-				 char *clid_str,
-				 char *tgtdir,
-				 int takeover)
-{
-	struct dirent *dentp;
-	DIR *subdp;
-	clid_entry_t *new_ent;
-	char *path = NULL;
-	char *new_path = NULL;
-	char *build_clid = NULL;
-	int rc = 0;
-	int num = 0;
-	char *ptr, *ptr2;
-	char temp[10];
-	int cid_len, len;
-	int segment_len;
-	int total_len;
-	int total_tgt_len;
-	int total_clid_len;
-
-	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
-		/* don't add '.' and '..' entry */
-		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
-			continue;
-
-		/* Skip names that start with '\x1' as they are files
-		 * representing revoked file handles
-		 */
-		if (dentp->d_name[0] == '\x1')
-			continue;
-
-		num++;
-		new_path = NULL;
-
-		/* construct the path by appending the subdir for the
-		 * next readdir. This recursion keeps reading the
-		 * subdirectory until reaching the end.
-		 */
-		segment_len = strlen(dentp->d_name);
-		total_len = segment_len + 2 + strlen(parent_path);
-		path = gsh_malloc(total_len);
-
-		memset(path, 0, total_len);
-
-		strcpy(path, parent_path);
-		strcat(path, "/");
-		strncat(path, dentp->d_name, segment_len);
-		/* if tgtdir is not NULL, we need to build
-		 * nfs4old/currentnode
-		 */
-		if (tgtdir) {
-			total_tgt_len = segment_len + 2 +
-					strlen(tgtdir);
-			new_path = gsh_malloc(total_tgt_len);
-
-			memset(new_path, 0, total_tgt_len);
-			strcpy(new_path, tgtdir);
-			strcat(new_path, "/");
-			strncat(new_path, dentp->d_name, segment_len);
-			rc = mkdir(new_path, 0700);
-			if ((rc == -1) && (errno != EEXIST)) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "mkdir %s faied errno=%d",
-					 new_path, errno);
-			}
-		}
-		/* keep building the clientid str by cursively */
-		/* reading the directory structure */
-		if (clid_str)
-			total_clid_len = segment_len + 1 +
-					 strlen(clid_str);
-		else
-			total_clid_len = segment_len + 1;
-		build_clid = gsh_malloc(total_clid_len);
-
-		memset(build_clid, 0, total_clid_len);
-		if (clid_str)
-			strcpy(build_clid, clid_str);
-		strncat(build_clid, dentp->d_name, segment_len);
-		subdp = opendir(path);
-		if (subdp == NULL) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "opendir %s failed errno=%d",
-				 dentp->d_name, errno);
-			free_heap(path, new_path, build_clid);
-			/* this shouldn't happen, but we should skip
-			 * the entry to avoid infinite loops
-			 */
-			continue;
-		}
-
-		if (tgtdir)
-			rc = nfs4_read_recov_clids(subdp,
-						   path,
-						   build_clid,
-						   new_path,
-						   takeover);
-		else
-			rc = nfs4_read_recov_clids(subdp,
-						   path,
-						   build_clid,
-						   NULL,
-						   takeover);
-
-		/* close the sub directory */
-		(void)closedir(subdp);
-
-		if (new_path)
-			gsh_free(new_path);
-
-		/* after recursion, if the subdir has no non-hidden
-		 * directory this is the end of this clientid str. Add
-		 * the clientstr to the list.
-		 */
-		if (rc == 0) {
-			/* the clid format is
-			 * <IP>-(clid-len:long-form-clid-in-string-form)
-			 * make sure this reconstructed string is valid
-			 * by comparing clid-len and the actual
-			 * long-form-clid length in the string. This is
-			 * to prevent getting incompleted strings that
-			 * might exist due to program crash.
-			 */
-			if (strlen(build_clid) >= PATH_MAX) {
-				LogEvent(COMPONENT_CLIENTID,
-					"invalid clid format: %s, too long",
-					build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			ptr = strchr(build_clid, '(');
-			if (ptr == NULL) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "invalid clid format: %s",
-					 build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			ptr2 = strchr(ptr, ':');
-			if (ptr2 == NULL) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "invalid clid format: %s",
-					 build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			len = ptr2-ptr-1;
-			if (len >= 9) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "invalid clid format: %s",
-					 build_clid);
-				free_heap(path, NULL, build_clid);
-				continue;
-			}
-			strncpy(temp, ptr+1, len);
-			temp[len] = 0;
-			cid_len = atoi(temp);
-			len = strlen(ptr2);
-			if ((len == (cid_len+2)) && (ptr2[len-1] == ')')) {
-				new_ent = gsh_malloc(sizeof(clid_entry_t));
-
-				nfs4_cp_pop_revoked_delegs(new_ent,
-							path,
-							tgtdir,
-							!takeover);
-				strcpy(new_ent->cl_name, build_clid);
-				glist_add(&clid_list,
-					  &new_ent->cl_list);
-				LogDebug(COMPONENT_CLIENTID,
-					 "added %s to clid list",
-					 new_ent->cl_name);
-			}
-		}
-		gsh_free(build_clid);
-		/* If this is not for takeover, remove the directory
-		 * hierarchy  that represent the current clientid
-		 */
-		if (!takeover) {
-			rc = rmdir(path);
-			if (rc == -1) {
-				LogEvent(COMPONENT_CLIENTID,
-					 "Failed to rmdir (%s), errno=%d",
-					 path, errno);
-			}
-		}
-		gsh_free(path);
-	}
-
-	return num;
-}
-
 /**
  * @brief Load clients for recovery, with no lock
  *
- * @param[in] nodeid Node, on takeover
+ * When not doing a take over, the list is rebuilt from this node's
+ * records.  On a take over, the other node's clients are added to it.
+ *
+ * @param[in] gsp Grace period start information, NULL at startup
  */
 static void nfs4_load_recov_clids_nolock(nfs_grace_start_t *gsp)
 {
-	DIR *dp;
-	struct clid_entry *clid_entry;
-	int rc;
-	char path[PATH_MAX];
-
 	LogDebug(COMPONENT_STATE, "Load recovery cli %p", gsp);
 
-	if (gsp == NULL) {
-		/* when not doing a takeover, start with an empty list */
-		while ((clid_entry = glist_first_entry(&clid_list,
-						       struct clid_entry,
-						       cl_list)) != NULL) {
-			glist_del(&clid_entry->cl_list);
-			gsh_free(clid_entry);
-		}
-
-		dp = opendir(v4_old_dir);
-		if (dp == NULL) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to open v4 recovery dir (%s), errno=%d",
-				 v4_old_dir, errno);
-			return;
-		}
-		rc = nfs4_read_recov_clids(dp, v4_old_dir, NULL, NULL, 0);
-		if (rc == -1) {
-			(void)closedir(dp);
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to read v4 recovery dir (%s)",
-				 v4_old_dir);
-			return;
-		}
-		(void)closedir(dp);
-
-		dp = opendir(v4_recov_dir);
-		if (dp == NULL) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to open v4 recovery dir (%s), errno=%d",
-				 v4_recov_dir, errno);
-			return;
-		}
-
-		rc = nfs4_read_recov_clids(dp, v4_recov_dir,
-					   NULL, v4_old_dir, 0);
-		if (rc == -1) {
-			(void)closedir(dp);
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to read v4 recovery dir (%s)",
-				 v4_recov_dir);
-			return;
-		}
-		rc = closedir(dp);
-		if (rc == -1) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to close v4 recovery dir (%s), errno=%d",
-				 v4_recov_dir, errno);
-		}
-
-	} else {
-		if (gsp->event == EVENT_UPDATE_CLIENTS)
-			snprintf(path, sizeof(path), "%s", v4_recov_dir);
+	/* when not doing a takeover, start with an empty list */
+	if (gsp == NULL)
+		nfs4_free_clid_list();
 
-		else if (gsp->event == EVENT_TAKE_IP)
-			snprintf(path, sizeof(path), "%s/%s/%s",
-				 NFS_V4_RECOV_ROOT, gsp->ipaddr,
-				 NFS_V4_RECOV_DIR);
-
-		else if (gsp->event == EVENT_TAKE_NODEID)
-			snprintf(path, sizeof(path), "%s/%s/node%d",
-				 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_DIR,
-				 gsp->nodeid);
-
-		else
-			return;
-
-		LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d dir (%s)",
-			 gsp->nodeid, path);
-
-		dp = opendir(path);
-		if (dp == NULL) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to open v4 recovery dir (%s), errno=%d",
-				 path, errno);
-			return;
-		}
-
-		rc = nfs4_read_recov_clids(dp, path, NULL, v4_old_dir, 1);
-		if (rc == -1) {
-			(void)closedir(dp);
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to read v4 recovery dir (%s)", path);
-			return;
-		}
-		rc = closedir(dp);
-		if (rc == -1) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to close v4 recovery dir (%s), errno=%d",
-				 path, errno);
-		}
-	}
+	recovery_backend->recovery_read_clids(gsp);
 }
 
 /**
@@ -934,122 +763,145 @@ void nfs4_load_recov_clids(nfs_grace_start_t *gsp)
 	PTHREAD_MUTEX_unlock(&grace_mutex);
 }
 
+static int clid_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
 /**
- * @brief Clean up recovery directory
+ * @brief Narrow the reclaim list to the clients handed over
+ *
+ * Called at startup, after the records are loaded, when the previous
+ * server handed over its live client list: clients it didn't hold will
+ * not reclaim, so grace need not wait for them.  Clients missing from
+ * the records are added.  The revoked handles of those kept remain.
+ *
+ * @param[in] names Recovery names of the clients, sorted here
+ * @param[in] count Number of names
  */
-void nfs4_clean_old_recov_dir(char *parent_path)
+void nfs4_recovery_handoff(char **names, uint32_t count)
 {
-	DIR *dp;
-	struct dirent *dentp;
-	char *path = NULL;
-	int rc;
-	int total_len;
-
-	dp = opendir(parent_path);
-	if (dp == NULL) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to open old v4 recovery dir (%s), errno=%d",
-			 v4_old_dir, errno);
-		return;
-	}
+	struct glist_head *node, *noden;
+	clid_entry_t *clid_ent;
+	rdel_fh_t *rfh_ent;
+	uint32_t i, dropped = 0;
 
-	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
-		/* don't remove '.' and '..' entry */
-		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
-			continue;
+	qsort(names, count, sizeof(char *), clid_name_cmp);
 
-		/* If there is a filename starting with '\x1', then it is
-		 * a revoked handle, go ahead and remove it.
-		 */
-		if (dentp->d_name[0] == '\x1') {
-			char del_path[PATH_MAX];
-
-			snprintf(del_path, sizeof(del_path), "%s/%s",
-				 parent_path, dentp->d_name);
+	PTHREAD_MUTEX_lock(&grace_mutex);
 
-			if (unlink(del_path) < 0) {
-				LogEvent(COMPONENT_CLIENTID,
-						"unlink of %s failed errno: %d",
-						del_path,
-						errno);
-			}
+	glist_for_each_safe(node, noden, &clid_list) {
+		char *name;
 
+		clid_ent = glist_entry(node, clid_entry_t, cl_list);
+		name = clid_ent->cl_name;
+		if (bsearch(&name, names, count, sizeof(char *),
+			    clid_name_cmp) != NULL)
 			continue;
+
+		while ((rfh_ent = glist_first_entry(&clid_ent->cl_rfh_list,
+						    rdel_fh_t,
+						    rdfh_list)) != NULL) {
+			glist_del(&rfh_ent->rdfh_list);
+			gsh_free(rfh_ent->rdfh_handle_str);
+			gsh_free(rfh_ent);
 		}
+		glist_del(&clid_ent->cl_list);
+		glist_del(&clid_ent->cl_hash);
+		if (clid_ent->cl_reclaim_complete)
+			reclaim_completes--;
+		gsh_free(clid_ent);
+		clid_count--;
+		dropped++;
+	}
 
-		/* This is a directory, we need process files in it! */
-		total_len = strlen(parent_path) + strlen(dentp->d_name) + 2;
-		path = gsh_malloc(total_len);
+	for (i = 0; i < count; i++)
+		if (strlen(names[i]) < PATH_MAX)
+			(void) nfs4_add_clid_entry(names[i]);
 
-		snprintf(path, total_len, "%s/%s", parent_path, dentp->d_name);
+	PTHREAD_MUTEX_unlock(&grace_mutex);
 
-		nfs4_clean_old_recov_dir(path);
-		rc = rmdir(path);
-		if (rc == -1) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to remove %s, errno=%d", path, errno);
-		}
-		gsh_free(path);
-	}
-	(void)closedir(dp);
+	LogEvent(COMPONENT_STATE,
+		 "Reclaim list set to the %"PRIu32" handed over clients, %"
+		 PRIu32" records dropped", clid_count, dropped);
 }
 
 /**
- * @brief Create the recovery directory
+ * @brief Recovery names of the confirmed clients
+ *
+ * For the next server, on a handoff.
  *
- * The recovery directory may not exist yet, so create it.  This
- * should only need to be done once (if at all).  Also, the location
- * of the directory could be configurable.
+ * @param[out] count Number of names
+ *
+ * @return The names, to free with their array.
  */
-void nfs4_create_recov_dir(void)
+char **nfs4_recovery_live_clids(uint32_t *count)
 {
-	int err;
+	hash_table_t *ht = ht_confirmed_client_id;
+	struct rbt_head *head_rbt;
+	struct rbt_node *pn;
+	struct hash_data *pdata;
+	nfs_client_id_t *cp;
+	char **names = NULL;
+	uint32_t n = 0, room = 0;
+	int i;
 
-	err = mkdir(NFS_V4_RECOV_ROOT, 0755);
-	if (err == -1 && errno != EEXIST) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to create v4 recovery dir (%s), errno=%d",
-			 NFS_V4_RECOV_ROOT, errno);
-	}
+	for (i = 0; i < ht->parameter.index_size; i++) {
+		PTHREAD_RWLOCK_rdlock(&ht->partitions[i].lock);
+		head_rbt = &ht->partitions[i].rbt;
 
-	snprintf(v4_recov_dir, sizeof(v4_recov_dir), "%s/%s", NFS_V4_RECOV_ROOT,
-		 NFS_V4_RECOV_DIR);
-	err = mkdir(v4_recov_dir, 0755);
-	if (err == -1 && errno != EEXIST) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to create v4 recovery dir(%s), errno=%d",
-			 v4_recov_dir, errno);
-	}
+		RBT_LOOP(head_rbt, pn) {
+			pdata = RBT_OPAQ(pn);
+			cp = (nfs_client_id_t *) pdata->val.addr;
 
-	snprintf(v4_old_dir, sizeof(v4_old_dir), "%s/%s", NFS_V4_RECOV_ROOT,
-		 NFS_V4_OLD_DIR);
-	err = mkdir(v4_old_dir, 0755);
-	if (err == -1 && errno != EEXIST) {
-		LogEvent(COMPONENT_CLIENTID,
-			 "Failed to create v4 recovery dir(%s), errno=%d",
-			 v4_old_dir, errno);
-	}
-	if (nfs_param.core_param.clustered) {
-		snprintf(v4_recov_dir, sizeof(v4_recov_dir), "%s/%s/node%d",
-			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_DIR, g_nodeid);
-
-		err = mkdir(v4_recov_dir, 0755);
-		if (err == -1 && errno != EEXIST) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to create v4 recovery dir(%s), errno=%d",
-				 v4_recov_dir, errno);
+			PTHREAD_MUTEX_lock(&cp->cid_mutex);
+			if (cp->cid_confirmed == CONFIRMED_CLIENT_ID &&
+			    cp->cid_recov_dir != NULL) {
+				if (n == room) {
+					room = room ? room * 2 : 64;
+					names = gsh_realloc(names, room *
+							    sizeof(char *));
+				}
+				names[n++] = gsh_strdup(cp->cid_recov_dir);
+			}
+			PTHREAD_MUTEX_unlock(&cp->cid_mutex);
+			RBT_INCREMENT(pn);
 		}
+		PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
+	}
 
-		snprintf(v4_old_dir, sizeof(v4_old_dir), "%s/%s/node%d",
-			 NFS_V4_RECOV_ROOT, NFS_V4_OLD_DIR, g_nodeid);
+	*count = n;
+	return names;
+}
 
-		err = mkdir(v4_old_dir, 0755);
-		if (err == -1 && errno != EEXIST) {
-			LogEvent(COMPONENT_CLIENTID,
-				 "Failed to create v4 recovery dir(%s), errno=%d",
-				 v4_old_dir, errno);
-		}
+/**
+ * @brief Drop the records of the previous server instance
+ *
+ * Called once the grace period is over, when no client can reclaim
+ * from them anymore.
+ */
+void nfs4_end_grace(void)
+{
+	recovery_backend->end_grace();
+}
+
+/**
+ * @brief Set up the stable storage of the configured recovery backend
+ *
+ * This needs to be done before the client ids are loaded.
+ */
+void nfs4_recovery_init(void)
+{
+	switch (nfs_param.nfsv4_param.recovery_backend) {
+	case RECOVERY_BACKEND_FS:
+		recovery_backend = &fs_backend;
+		break;
+	case RECOVERY_BACKEND_LOG:
+		recovery_backend = &log_backend;
+		break;
 	}
+
+	recovery_backend->recovery_init();
 }
 
 /**
@@ -1061,9 +913,6 @@ void nfs4_create_recov_dir(void)
 void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 {
 	char rhdlstr[NAME_MAX];
-	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
-	int length, position = 0;
-	int fd;
 	int retval;
 
 	/* Convert nfs_fh4_val into base64 encoded string */
@@ -1088,34 +937,7 @@ void nfs4_record_revoke(nfs_client_id_t *delr_clid, nfs_fh4 *delr_handle)
 	}
 	PTHREAD_MUTEX_unlock(&delr_clid->cid_mutex);
 
-	/* Parse through the clientid directory structure */
-	assert(delr_clid->cid_recov_dir != NULL);
-
-	snprintf(path, sizeof(path), "%s", v4_recov_dir);
-	length = strlen(delr_clid->cid_recov_dir);
-	while (position < length) {
-		int len = strlen(&delr_clid->cid_recov_dir[position]);
-
-		if (len <= NAME_MAX) {
-			strcat(path, "/");
-			strncat(path, &delr_clid->cid_recov_dir[position], len);
-			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
-			strncat(path, rhdlstr, strlen(rhdlstr));
-			fd = creat(path, 0700);
-			if (fd < 0) {
-				LogEvent(COMPONENT_CLIENTID,
-					"Failed to record revoke errno:%d\n",
-					errno);
-			} else {
-				close(fd);
-			}
-			return;
-		}
-		strncpy(segment, &delr_clid->cid_recov_dir[position], NAME_MAX);
-		strcat(path, "/");
-		strncat(path, segment, NAME_MAX);
-		position += NAME_MAX;
-	}
+	recovery_backend->add_revoke_fh(delr_clid, rhdlstr);
 }
 
 /**
@@ -1344,13 +1166,13 @@ static void nfs_release_v4_client(char *ip)
 
 				PTHREAD_RWLOCK_unlock(&ht->partitions[i].lock);
 
-				/* nfs_client_id_expire requires cr_mutex
-				 * if not decoupled alread
+				/* nfs_client_id_expire_async requires
+				 * cr_mutex if not decoupled alread
 				 */
 				if (recp)
 					PTHREAD_MUTEX_lock(&recp->cr_mutex);
 
-				nfs_client_id_expire(cp, true);
+				nfs_client_id_expire_async(cp, true);
 
 				if (recp) {
 					PTHREAD_MUTEX_unlock(&recp->cr_mutex);
@@ -1030,6 +1030,8 @@ void state_export_release_nfs4_state(void)
 		obj->obj_ops.put_ref(obj);
 		dec_state_owner_ref(owner);
 		dec_state_t_ref(state);
+		unexport_progress(op_ctx->ctx_export,
+				  &op_ctx->ctx_export->unexport_state);
 		if (errcnt < STATE_ERR_MAX) {
 			/* Loop again, but since we droped the export lock, we
 			 * must restart.
@@ -1111,6 +1113,8 @@ void state_export_release_nfs4_state(void)
 		obj->obj_ops.put_ref(obj);
 		dec_state_owner_ref(owner);
 		dec_state_t_ref(state);
+		unexport_progress(op_ctx->ctx_export,
+				  &op_ctx->ctx_export->unexport_state);
 	}
 
 	if (hold_export_lock)
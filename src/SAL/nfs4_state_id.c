@@ -60,7 +60,7 @@
 #include "nfs_file_handle.h"
 #include "sal_functions.h"
 #include "nfs_proto_tools.h"
-#include "city.h"
+#include "gsh_hash.h"
 
 struct state_t *nfs4_State_Get_State_Obj(struct state_obj *state_obj,
 					 state_owner_t *owner);
@@ -71,6 +71,31 @@ struct state_t *nfs4_State_Get_State_Obj(struct state_obj *state_obj,
 hash_table_t *ht_state_id;
 hash_table_t *ht_state_obj;
 
+/**
+ * @brief Slot of the stateid cache
+ *
+ * The cache is a plain array indexed by the hash of stateid.other, so a
+ * stateid presented on READ or WRITE is usually found by touching a
+ * single slot rather than by hashing into ht_state_id, taking a latch
+ * and walking a red-black tree.  A slot holds the last state set with
+ * that index; ht_state_id stays authoritative and is searched on a
+ * miss.  The full other is compared, so a stateid whose state was freed
+ * and whose slot was reused never matches.
+ *
+ * A state is only put in a slot when it is added to ht_state_id and is
+ * taken out before it is removed from it, so a state found in a slot
+ * still holds the table's reference and a reference can safely be
+ * taken under the slot lock.
+ */
+struct stateid_slot {
+	pthread_spinlock_t ss_lock;	/*< Protects the slot */
+	char ss_other[OTHERSIZE];	/*< stateid.other of ss_state */
+	state_t *ss_state;		/*< Cached state or NULL */
+};
+
+static struct stateid_slot *stateid_slots;
+static uint32_t stateid_slots_size;
+
 /**
  * @brief All-zeroes stateid4.other
  */
@@ -276,6 +301,27 @@ static inline uint32_t compute_stateid_hash_value(uint32_t *stateid)
 	return stateid[1] ^ stateid[2];
 }
 
+/**
+ * @brief Find the stateid cache slot of a stateid
+ *
+ * @param[in] other stateid4.other
+ *
+ * @return The slot, or NULL if the cache is disabled.
+ */
+static inline struct stateid_slot *stateid_slot(char *other)
+{
+	uint32_t words[3];
+
+	if (stateid_slots == NULL)
+		return NULL;
+
+	/* other is not necessarily aligned */
+	memcpy(words, other, OTHERSIZE);
+
+	return &stateid_slots[compute_stateid_hash_value(words) %
+			      stateid_slots_size];
+}
+
 /**
  * @brief Hash index for a stateid
  *
@@ -322,7 +368,7 @@ static hash_parameter_t state_id_param = {
 	.compare_key = compare_state_id,
 	.key_to_str = display_state_id_key,
 	.val_to_str = display_state_id_val,
-	.flags = HT_FLAG_CACHE,
+	.flags = HT_FLAG_LOCKLESS,
 	.ht_log_component = COMPONENT_STATE,
 	.ht_name = "State ID Table"
 };
@@ -378,8 +424,8 @@ uint32_t state_obj_value_hash_func(hash_parameter_t *hparam,
 	res = ((uint32_t) pkey->state_owner->so_owner.so_nfs4_owner.so_clientid
 	      + (uint32_t) sum + pkey->state_owner->so_owner_len
 	      + (uint32_t) pkey->state_owner->so_type
-	      + (uint32_t) CityHash64WithSeed(pkey->state_obj.digest,
-					      pkey->state_obj.len, 557))
+	      + (uint32_t) gsh_hash64(pkey->state_obj.digest,
+				      pkey->state_obj.len, 557))
 	      % (uint32_t) hparam->index_size;
 
 	if (isDebug(COMPONENT_HASHTABLE))
@@ -415,8 +461,8 @@ uint64_t state_obj_rbt_hash_func(hash_parameter_t *hparam,
 	res = (uint64_t) pkey->state_owner->so_owner.so_nfs4_owner.so_clientid
 	      + (uint64_t) sum + pkey->state_owner->so_owner_len
 	      + (uint64_t) pkey->state_owner->so_type
-	      + (uint64_t) CityHash64WithSeed(pkey->state_obj.digest,
-					      pkey->state_obj.len, 557);
+	      + (uint64_t) gsh_hash64(pkey->state_obj.digest,
+				      pkey->state_obj.len, 557);
 
 	if (isDebug(COMPONENT_HASHTABLE))
 		LogFullDebug(COMPONENT_STATE, "rbt = %" PRIu64, res);
@@ -462,6 +508,19 @@ int nfs4_Init_state_id(void)
 		return -1;
 	}
 
+	stateid_slots_size = nfs_param.nfsv4_param.stateid_cache_size;
+
+	if (stateid_slots_size != 0) {
+		uint32_t i;
+
+		stateid_slots = gsh_calloc(stateid_slots_size,
+					   sizeof(*stateid_slots));
+
+		for (i = 0; i < stateid_slots_size; i++)
+			pthread_spin_init(&stateid_slots[i].ss_lock,
+					  PTHREAD_PROCESS_PRIVATE);
+	}
+
 	return 0;
 }
 
@@ -523,6 +582,42 @@ void dec_nfs4_state_ref(struct state_t *state)
 		LogFullDebug(COMPONENT_STATE, "Deleted %s", str);
 }
 
+/**
+ * @brief Put a state in its stateid cache slot
+ *
+ * @param[in] state The state, already in ht_state_id
+ */
+static void stateid_slot_set(state_t *state)
+{
+	struct stateid_slot *slot = stateid_slot(state->stateid_other);
+
+	if (slot == NULL)
+		return;
+
+	pthread_spin_lock(&slot->ss_lock);
+	memcpy(slot->ss_other, state->stateid_other, OTHERSIZE);
+	slot->ss_state = state;
+	pthread_spin_unlock(&slot->ss_lock);
+}
+
+/**
+ * @brief Take a state out of its stateid cache slot
+ *
+ * @param[in] state The state, still in ht_state_id
+ */
+static void stateid_slot_clear(state_t *state)
+{
+	struct stateid_slot *slot = stateid_slot(state->stateid_other);
+
+	if (slot == NULL)
+		return;
+
+	pthread_spin_lock(&slot->ss_lock);
+	if (slot->ss_state == state)
+		slot->ss_state = NULL;
+	pthread_spin_unlock(&slot->ss_lock);
+}
+
 /**
  * @brief Set a state into the stateid hashtable.
  *
@@ -558,8 +653,10 @@ int nfs4_State_Set(state_t *state)
 
 	/* If stateid is a LOCK or SHARE state, we also index by entry/owner */
 	if (state->state_type != STATE_TYPE_LOCK &&
-	    state->state_type != STATE_TYPE_SHARE)
+	    state->state_type != STATE_TYPE_SHARE) {
+		stateid_slot_set(state);
 		return 1;
+	}
 
 	buffkey.addr = state;
 	buffkey.len = sizeof(state_t);
@@ -616,9 +713,21 @@ int nfs4_State_Set(state_t *state)
 		return 0;
 	}
 
+	stateid_slot_set(state);
+
 	return 1;
 }
 
+/**
+ * @brief Increment the state refcount in the hash table
+ *
+ * @param[in] val Buffer pointing to the state
+ */
+static void Hash_inc_state_t_ref(struct gsh_buffdesc *val)
+{
+	inc_state_t_ref(val->addr);
+}
+
 /**
  * @brief Get the state from the stateid
  *
@@ -631,30 +740,37 @@ struct state_t *nfs4_State_Get_Pointer(char *other)
 	struct gsh_buffdesc buffkey;
 	struct gsh_buffdesc buffval;
 	hash_error_t rc;
-	struct hash_latch latch;
 	struct state_t *state;
+	struct stateid_slot *slot = stateid_slot(other);
+
+	if (slot != NULL) {
+		pthread_spin_lock(&slot->ss_lock);
+
+		state = slot->ss_state;
+
+		if (state != NULL &&
+		    memcmp(slot->ss_other, other, OTHERSIZE) == 0) {
+			/* Take a reference under the slot lock */
+			inc_state_t_ref(state);
+			pthread_spin_unlock(&slot->ss_lock);
+			return state;
+		}
+
+		pthread_spin_unlock(&slot->ss_lock);
+	}
 
 	buffkey.addr = other;
 	buffkey.len = OTHERSIZE;
 
-	rc = hashtable_getlatch(ht_state_id, &buffkey, &buffval, true, &latch);
+	rc = hashtable_getref(ht_state_id, &buffkey, &buffval,
+			      Hash_inc_state_t_ref);
 
 	if (rc != HASHTABLE_SUCCESS) {
-		if (rc == HASHTABLE_ERROR_NO_SUCH_KEY)
-			hashtable_releaselatched(ht_state_id, &latch);
 		LogDebug(COMPONENT_STATE, "HashTable_Get returned %d", rc);
 		return NULL;
 	}
 
-	state = buffval.addr;
-
-	/* Take a reference under latch */
-	inc_state_t_ref(state);
-
-	/* Release latch */
-	hashtable_releaselatched(ht_state_id, &latch);
-
-	return state;
+	return buffval.addr;
 }
 
 /**
@@ -742,6 +858,11 @@ bool nfs4_State_Del(state_t *state)
 	buffkey.addr = state->stateid_other;
 	buffkey.len = OTHERSIZE;
 
+	/* Out of the cache first, it must never hold a state that is no
+	 * longer in ht_state_id.
+	 */
+	stateid_slot_clear(state);
+
 	err = HashTable_Del(ht_state_id, &buffkey, &old_key, &old_value);
 
 	if (err == HASHTABLE_ERROR_NO_SUCH_KEY) {
@@ -45,6 +45,7 @@
 #include "log.h"
 #include "client_mgr.h"
 #include "fsal.h"
+#include "city.h"
 
 /**
  * @brief NSM clients
@@ -625,9 +626,20 @@ int compare_nlm_owner_key(struct gsh_buffdesc *buff1,
 }
 
 /**
- * @brief Calculate hash index for an NLM owner key
+ * @brief Hash an NLM owner
  *
- * @todo Replace with a good hash function.
+ * @param[in] pkey The owner
+ *
+ * @return The hash.
+ */
+static inline uint64_t nlm_owner_hash(state_owner_t *pkey)
+{
+	return CityHash64WithSeed(pkey->so_owner_val, pkey->so_owner_len,
+				  pkey->so_owner.so_nlm_owner.so_nlm_svid);
+}
+
+/**
+ * @brief Calculate hash index for an NLM owner key
  *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
@@ -637,32 +649,19 @@ int compare_nlm_owner_key(struct gsh_buffdesc *buff1,
 uint32_t nlm_owner_value_hash_func(hash_parameter_t *hparam,
 				   struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i;
 	unsigned long res;
-	state_owner_t *pkey = key->addr;
 
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++)
-		sum += (unsigned char)pkey->so_owner_val[i];
-
-	res =
-	    (unsigned long)(pkey->so_owner.so_nlm_owner.so_nlm_svid) +
-	    (unsigned long)sum + (unsigned long)pkey->so_owner_len;
+	res = (nlm_owner_hash(key->addr) >> 32) % hparam->index_size;
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "value = %lu",
-			     res % hparam->index_size);
-
-	return (unsigned long)(res % hparam->index_size);
+		LogFullDebug(COMPONENT_STATE, "value = %lu", res);
 
+	return res;
 }
 
 /**
  * @brief Calculate RBT hash for an NLM owner key
  *
- * @todo Replace with a good hash function.
- *
  * @param[in]  hparam Hash params
  * @param[out] key    Key to hash
  *
@@ -671,21 +670,10 @@ uint32_t nlm_owner_value_hash_func(hash_parameter_t *hparam,
 uint64_t nlm_owner_rbt_hash_func(hash_parameter_t *hparam,
 				 struct gsh_buffdesc *key)
 {
-	unsigned int sum = 0;
-	unsigned int i;
-	unsigned long res;
-	state_owner_t *pkey = key->addr;
-
-	/* Compute the sum of all the characters */
-	for (i = 0; i < pkey->so_owner_len; i++)
-		sum += (unsigned char)pkey->so_owner_val[i];
-
-	res =
-	    (unsigned long)(pkey->so_owner.so_nlm_owner.so_nlm_svid) +
-	    (unsigned long)sum + (unsigned long)pkey->so_owner_len;
+	uint64_t res = nlm_owner_hash(key->addr);
 
 	if (isDebug(COMPONENT_HASHTABLE))
-		LogFullDebug(COMPONENT_STATE, "rbt = %lu", res);
+		LogFullDebug(COMPONENT_STATE, "rbt = %" PRIu64, res);
 
 	return res;
 }				/* state_id_rbt_hash_func */
@@ -711,7 +699,7 @@ static hash_parameter_t nlm_client_hash_param = {
 };
 
 static hash_parameter_t nlm_owner_hash_param = {
-	.index_size = PRIME_STATE,
+	.index_size = PRIME_OWNER,
 	.hash_func_key = nlm_owner_value_hash_func,
 	.hash_func_rbt = nlm_owner_rbt_hash_func,
 	.compare_key = compare_nlm_owner_key,
@@ -1045,6 +1033,10 @@ void free_nlm_client(state_nlm_client_t *client)
 	if (client->slc_nlm_caller_name != NULL)
 		gsh_free(client->slc_nlm_caller_name);
 
+	if (client->slc_callback_clnt != NULL)
+		gsh_clnt_destroy(client->slc_callback_clnt);
+
+	PTHREAD_MUTEX_destroy(&client->slc_mutex);
 	gsh_free(client);
 }
 
@@ -1252,6 +1244,7 @@ state_nlm_client_t *get_nlm_client(care_t care, SVCXPRT *xprt,
 
 	/* Copy everything over */
 	memcpy(pclient, &key, sizeof(key));
+	PTHREAD_MUTEX_init(&pclient->slc_mutex, NULL);
 
 	pclient->slc_nlm_caller_name = gsh_strdup(key.slc_nlm_caller_name);
 
@@ -37,7 +37,7 @@
 #include <ctype.h>
 #include <netdb.h>
 
-#include "city.h"
+#include "gsh_hash.h"
 #include "sal_functions.h"
 #include "nsm.h"
 #include "log.h"
@@ -179,8 +179,8 @@ uint32_t nlm_state_value_hash_func(hash_parameter_t *hparam,
 
 	/* We hash based on the owner pointer, and the object key.  This depends
 	 * on them being sequential in memory. */
-	hk = CityHash64WithSeed(addr, sizeof(pkey->state_owner)
-				+ sizeof(pkey->state_obj), 557);
+	hk = gsh_hash64(addr, sizeof(pkey->state_owner)
+			+ sizeof(pkey->state_obj), 557);
 
 	if (pkey->state_type == STATE_TYPE_NLM_SHARE)
 		hk = ~hk;
@@ -211,8 +211,8 @@ uint64_t nlm_state_rbt_hash_func(hash_parameter_t *hparam,
 
 	/* We hash based on the owner pointer, and the object key.  This depends
 	 * on them being sequential in memory. */
-	hk = CityHash64WithSeed(addr, sizeof(pkey->state_owner) +
-				sizeof(pkey->state_obj), 557);
+	hk = gsh_hash64(addr, sizeof(pkey->state_owner) +
+			sizeof(pkey->state_obj), 557);
 
 	if (pkey->state_type == STATE_TYPE_NLM_SHARE)
 		hk = ~hk;
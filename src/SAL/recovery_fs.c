@@ -0,0 +1,780 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file recovery_fs.c
+ * @brief NFSv4 recovery in a directory tree
+ *
+ * Each client is a directory (a chain of directories for names longer
+ * than NAME_MAX) under v4recov, and each delegation revoked from it a
+ * file named with a \x1 prefix in that directory.  At grace start the
+ * tree is moved to v4old, which is removed when grace ends.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#define NFS_V4_RECOV_DIR "v4recov"
+#define NFS_V4_OLD_DIR "v4old"
+
+static char v4_recov_dir[PATH_MAX];
+static char v4_old_dir[PATH_MAX];
+
+/**
+ * @brief Create an entry in the recovery directory
+ *
+ * This entry alows the client to reclaim state after a server
+ * reboot/restart.
+ *
+ * @param[in] clientid Client record
+ */
+static void fs_add_clid(nfs_client_id_t *clientid)
+{
+	int err = 0;
+	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
+	int length, position = 0;
+
+	/* break clientid down if it is greater than max dir name */
+	/* and create a directory hierachy to represent the clientid. */
+	snprintf(path, sizeof(path), "%s", v4_recov_dir);
+
+	length = strlen(clientid->cid_recov_dir);
+	while (position < length) {
+		/* if the (remaining) clientid is shorter than 255 */
+		/* create the last level of dir and break out */
+		int len = strlen(&clientid->cid_recov_dir[position]);
+
+		if (len <= NAME_MAX) {
+			strcat(path, "/");
+			strncat(path, &clientid->cid_recov_dir[position], len);
+			err = mkdir(path, 0700);
+			break;
+		}
+		/* if (remaining) clientid is longer than 255, */
+		/* get the next 255 bytes and create a subdir */
+		strncpy(segment, &clientid->cid_recov_dir[position], NAME_MAX);
+		strcat(path, "/");
+		strncat(path, segment, NAME_MAX);
+		err = mkdir(path, 0700);
+		if (err == -1 && errno != EEXIST)
+			break;
+		position += NAME_MAX;
+	}
+
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create client in recovery dir (%s), errno=%d",
+			 path, errno);
+	} else {
+		LogDebug(COMPONENT_CLIENTID, "Created client dir [%s]", path);
+	}
+}
+
+/**
+ * @brief Remove the revoked file handles created under a specific
+ * client-id path on the stable storage.
+ *
+ * @param[in] path Path of the client-id on the stable storage.
+ */
+
+static void fs_rm_revoked_handles(char *path)
+{
+	DIR *dp;
+	struct dirent *dentp;
+	char del_path[PATH_MAX];
+
+	dp = opendir(path);
+	if (dp == NULL) {
+		LogEvent(COMPONENT_CLIENTID, "opendir %s failed errno=%d",
+			path, errno);
+		return;
+	}
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		if (!strcmp(dentp->d_name, ".") ||
+				!strcmp(dentp->d_name, "..") ||
+				dentp->d_name[0] != '\x1') {
+			continue;
+		}
+
+		snprintf(del_path, sizeof(del_path), "%s/%s",
+			 path, dentp->d_name);
+
+		if (unlink(del_path) < 0) {
+			LogEvent(COMPONENT_CLIENTID,
+					"unlink of %s failed errno: %d",
+					del_path,
+					errno);
+		}
+	}
+	(void)closedir(dp);
+}
+
+/**
+ * @brief Remove a client entry from the recovery directory
+ *
+ * This function would be called when a client expires.
+ *
+ * @param[in] recov_dir   Client name
+ * @param[in] parent_path Directory holding the next segment of the name
+ * @param[in] position    Offset of the next segment in the name
+ */
+static void fs_rm_clid_impl(const char *recov_dir, char *parent_path,
+			    int position)
+{
+	int err;
+	char *path;
+	char *segment;
+	int len, segment_len;
+	int total_len;
+
+	if (recov_dir == NULL)
+		return;
+
+	len = strlen(recov_dir);
+	if (position == len) {
+		/* We are at the tail directory of the clid,
+		 * remove revoked handles, if any.
+		 */
+		fs_rm_revoked_handles(parent_path);
+		return;
+	}
+	segment = gsh_malloc(NAME_MAX+1);
+
+	memset(segment, 0, NAME_MAX+1);
+	strncpy(segment, &recov_dir[position], NAME_MAX);
+	segment_len = strlen(segment);
+
+	/* allocate enough memory for the new part of the string */
+	/* which is parent path + '/' + new segment */
+	total_len = strlen(parent_path) + segment_len + 2;
+	path = gsh_malloc(total_len);
+
+	memset(path, 0, total_len);
+	(void) snprintf(path, total_len, "%s/%s",
+			parent_path, segment);
+	/* free setment as it has no use now */
+	gsh_free(segment);
+
+	/* recursively remove the directory hirerchy which represent the
+	 *clientid
+	 */
+	fs_rm_clid_impl(recov_dir, path, position+segment_len);
+
+	err = rmdir(path);
+	if (err == -1) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to remove client recovery dir (%s), errno=%d",
+			 path, errno);
+	} else {
+		LogDebug(COMPONENT_CLIENTID, "Removed client dir [%s]", path);
+	}
+	gsh_free(path);
+}
+
+static void fs_rm_clid(nfs_client_id_t *clientid)
+{
+	fs_rm_clid_impl(clientid->cid_recov_dir, v4_recov_dir, 0);
+}
+
+static void free_heap(char *path, char *new_path, char *build_clid)
+{
+	if (path)
+		gsh_free(path);
+	if (new_path)
+		gsh_free(new_path);
+	if (build_clid)
+		gsh_free(build_clid);
+}
+
+/**
+ * @brief Copy and Populate revoked delegations for this client.
+ *
+ * Even after delegation revoke, it is possible for the client to
+ * contiue its leas and other operatoins. Sever saves revoked delegations
+ * in the memory so client will not be granted same delegation with
+ * DELEG_CUR ; but it is possible that the server might reboot and has
+ * no record of the delegatin. This list helps to reject delegations
+ * client is obtaining through DELEG_PREV.
+ *
+ * @param[in] clid_ent Reclaim list entry of the client.
+ * @param[in] path Path of the directory structure.
+ * @param[in] Target dir to copy.
+ * @param[in] del Delete after populating
+ */
+
+static void fs_cp_pop_revoked_delegs(clid_entry_t *clid_ent,
+				     char *path,
+				     char *tgtdir,
+				     bool del)
+{
+	struct dirent *dentp;
+	DIR *dp;
+
+	/* Read the contents from recov dir of this clientid. */
+	dp = opendir(path);
+	if (dp == NULL) {
+		LogEvent(COMPONENT_CLIENTID, "opendir %s failed errno=%d",
+			path, errno);
+		return;
+	}
+
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
+			continue;
+		/* All the revoked filehandles stored with \x1 prefix */
+		if (dentp->d_name[0] != '\x1') {
+			/* Something wrong; it should not happen */
+			LogMidDebug(COMPONENT_CLIENTID,
+				"%s showed up along with revoked FHs. Skipping",
+				dentp->d_name);
+			continue;
+		}
+
+		if (tgtdir) {
+			char lopath[PATH_MAX];
+			int fd;
+
+			snprintf(lopath, sizeof(lopath), "%s/", tgtdir);
+			strncat(lopath, dentp->d_name, strlen(dentp->d_name));
+			fd = creat(lopath, 0700);
+			if (fd < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+					"Failed to copy revoked handle file %s to %s errno:%d\n",
+				dentp->d_name, tgtdir, errno);
+			} else {
+				close(fd);
+			}
+		}
+
+		/* Ignore the beginning \x1 and copy the rest (file handle) */
+		nfs4_add_rfh_entry(clid_ent, dentp->d_name+1);
+
+		/* Since the handle is loaded into memory, go ahead and
+		 * delete it from the stable storage.
+		 */
+		if (del) {
+			char del_path[PATH_MAX];
+
+			snprintf(del_path, sizeof(del_path), "%s/%s",
+				 path, dentp->d_name);
+
+			if (unlink(del_path) < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+						"unlink of %s failed errno: %d",
+						del_path,
+						errno);
+			}
+		}
+	}
+
+	(void)closedir(dp);
+}
+
+
+/**
+ * @brief Create the client reclaim list
+ *
+ * When not doing a take over, first open the old state dir and read
+ * in those entries.  The reason for the two directories is in case of
+ * a reboot/restart during grace period.  Next, read in entries from
+ * the recovery directory and then move them into the old state
+ * directory.  if called due to a take over, nodeid will be nonzero.
+ * in this case, add that node's clientids to the existing list.  Then
+ * move those entries into the old state directory.
+ *
+ * @param[in] dp       Recovery directory
+ * @param[in] srcdir   Path to the source directory on failover
+ * @param[in] takeover Whether this is a takeover.
+ *
+ * @return POSIX error codes.
+ */
+static int fs_read_recov_clids_impl(DIR *dp,
+				    const char *parent_path,
+				    char *clid_str,
+				    char *tgtdir,
+				    int takeover)
+{
+	struct dirent *dentp;
+	DIR *subdp;
+	clid_entry_t *new_ent;
+	char *path = NULL;
+	char *new_path = NULL;
+	char *build_clid = NULL;
+	int rc = 0;
+	int num = 0;
+	char *ptr, *ptr2;
+	char temp[10];
+	int cid_len, len;
+	int segment_len;
+	int total_len;
+	int total_tgt_len;
+	int total_clid_len;
+
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		/* don't add '.' and '..' entry */
+		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
+			continue;
+
+		/* Skip names that start with '\x1' as they are files
+		 * representing revoked file handles
+		 */
+		if (dentp->d_name[0] == '\x1')
+			continue;
+
+		num++;
+		new_path = NULL;
+
+		/* construct the path by appending the subdir for the
+		 * next readdir. This recursion keeps reading the
+		 * subdirectory until reaching the end.
+		 */
+		segment_len = strlen(dentp->d_name);
+		total_len = segment_len + 2 + strlen(parent_path);
+		path = gsh_malloc(total_len);
+
+		memset(path, 0, total_len);
+
+		strcpy(path, parent_path);
+		strcat(path, "/");
+		strncat(path, dentp->d_name, segment_len);
+		/* if tgtdir is not NULL, we need to build
+		 * nfs4old/currentnode
+		 */
+		if (tgtdir) {
+			total_tgt_len = segment_len + 2 +
+					strlen(tgtdir);
+			new_path = gsh_malloc(total_tgt_len);
+
+			memset(new_path, 0, total_tgt_len);
+			strcpy(new_path, tgtdir);
+			strcat(new_path, "/");
+			strncat(new_path, dentp->d_name, segment_len);
+			rc = mkdir(new_path, 0700);
+			if ((rc == -1) && (errno != EEXIST)) {
+				LogEvent(COMPONENT_CLIENTID,
+					 "mkdir %s faied errno=%d",
+					 new_path, errno);
+			}
+		}
+		/* keep building the clientid str by cursively */
+		/* reading the directory structure */
+		if (clid_str)
+			total_clid_len = segment_len + 1 +
+					 strlen(clid_str);
+		else
+			total_clid_len = segment_len + 1;
+		build_clid = gsh_malloc(total_clid_len);
+
+		memset(build_clid, 0, total_clid_len);
+		if (clid_str)
+			strcpy(build_clid, clid_str);
+		strncat(build_clid, dentp->d_name, segment_len);
+		subdp = opendir(path);
+		if (subdp == NULL) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "opendir %s failed errno=%d",
+				 dentp->d_name, errno);
+			free_heap(path, new_path, build_clid);
+			/* this shouldn't happen, but we should skip
+			 * the entry to avoid infinite loops
+			 */
+			continue;
+		}
+
+		if (tgtdir)
+			rc = fs_read_recov_clids_impl(subdp,
+						      path,
+						      build_clid,
+						      new_path,
+						      takeover);
+		else
+			rc = fs_read_recov_clids_impl(subdp,
+						      path,
+						      build_clid,
+						      NULL,
+						      takeover);
+
+		/* close the sub directory */
+		(void)closedir(subdp);
+
+		if (new_path)
+			gsh_free(new_path);
+
+		/* after recursion, if the subdir has no non-hidden
+		 * directory this is the end of this clientid str. Add
+		 * the clientstr to the list.
+		 */
+		if (rc == 0) {
+			/* the clid format is
+			 * <IP>-(clid-len:long-form-clid-in-string-form)
+			 * make sure this reconstructed string is valid
+			 * by comparing clid-len and the actual
+			 * long-form-clid length in the string. This is
+			 * to prevent getting incompleted strings that
+			 * might exist due to program crash.
+			 */
+			if (strlen(build_clid) >= PATH_MAX) {
+				LogEvent(COMPONENT_CLIENTID,
+					"invalid clid format: %s, too long",
+					build_clid);
+				free_heap(path, NULL, build_clid);
+				continue;
+			}
+			ptr = strchr(build_clid, '(');
+			if (ptr == NULL) {
+				LogEvent(COMPONENT_CLIENTID,
+					 "invalid clid format: %s",
+					 build_clid);
+				free_heap(path, NULL, build_clid);
+				continue;
+			}
+			ptr2 = strchr(ptr, ':');
+			if (ptr2 == NULL) {
+				LogEvent(COMPONENT_CLIENTID,
+					 "invalid clid format: %s",
+					 build_clid);
+				free_heap(path, NULL, build_clid);
+				continue;
+			}
+			len = ptr2-ptr-1;
+			if (len >= 9) {
+				LogEvent(COMPONENT_CLIENTID,
+					 "invalid clid format: %s",
+					 build_clid);
+				free_heap(path, NULL, build_clid);
+				continue;
+			}
+			strncpy(temp, ptr+1, len);
+			temp[len] = 0;
+			cid_len = atoi(temp);
+			len = strlen(ptr2);
+			if ((len == (cid_len+2)) && (ptr2[len-1] == ')')) {
+				new_ent = nfs4_add_clid_entry(build_clid);
+				fs_cp_pop_revoked_delegs(new_ent,
+							 path,
+							 tgtdir,
+							 !takeover);
+			}
+		}
+		gsh_free(build_clid);
+		/* If this is not for takeover, remove the directory
+		 * hierarchy  that represent the current clientid
+		 */
+		if (!takeover) {
+			rc = rmdir(path);
+			if (rc == -1) {
+				LogEvent(COMPONENT_CLIENTID,
+					 "Failed to rmdir (%s), errno=%d",
+					 path, errno);
+			}
+		}
+		gsh_free(path);
+	}
+
+	return num;
+}
+
+/**
+ * @brief Load clients for recovery from the directory tree
+ *
+ * @param[in] gsp Grace period start information, NULL at startup
+ */
+static void fs_read_recov_clids(nfs_grace_start_t *gsp)
+{
+	DIR *dp;
+	int rc;
+	char path[PATH_MAX];
+
+	if (gsp == NULL) {
+		dp = opendir(v4_old_dir);
+		if (dp == NULL) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to open v4 recovery dir (%s), errno=%d",
+				 v4_old_dir, errno);
+			return;
+		}
+		rc = fs_read_recov_clids_impl(dp, v4_old_dir, NULL, NULL, 0);
+		if (rc == -1) {
+			(void)closedir(dp);
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to read v4 recovery dir (%s)",
+				 v4_old_dir);
+			return;
+		}
+		(void)closedir(dp);
+
+		dp = opendir(v4_recov_dir);
+		if (dp == NULL) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to open v4 recovery dir (%s), errno=%d",
+				 v4_recov_dir, errno);
+			return;
+		}
+
+		rc = fs_read_recov_clids_impl(dp, v4_recov_dir,
+					   NULL, v4_old_dir, 0);
+		if (rc == -1) {
+			(void)closedir(dp);
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to read v4 recovery dir (%s)",
+				 v4_recov_dir);
+			return;
+		}
+		rc = closedir(dp);
+		if (rc == -1) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to close v4 recovery dir (%s), errno=%d",
+				 v4_recov_dir, errno);
+		}
+
+	} else {
+		if (gsp->event == EVENT_UPDATE_CLIENTS)
+			snprintf(path, sizeof(path), "%s", v4_recov_dir);
+
+		else if (gsp->event == EVENT_TAKE_IP)
+			snprintf(path, sizeof(path), "%s/%s/%s",
+				 NFS_V4_RECOV_ROOT, gsp->ipaddr,
+				 NFS_V4_RECOV_DIR);
+
+		else if (gsp->event == EVENT_TAKE_NODEID)
+			snprintf(path, sizeof(path), "%s/%s/node%d",
+				 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_DIR,
+				 gsp->nodeid);
+
+		else
+			return;
+
+		LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d dir (%s)",
+			 gsp->nodeid, path);
+
+		dp = opendir(path);
+		if (dp == NULL) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to open v4 recovery dir (%s), errno=%d",
+				 path, errno);
+			return;
+		}
+
+		rc = fs_read_recov_clids_impl(dp, path, NULL, v4_old_dir, 1);
+		if (rc == -1) {
+			(void)closedir(dp);
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to read v4 recovery dir (%s)", path);
+			return;
+		}
+		rc = closedir(dp);
+		if (rc == -1) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to close v4 recovery dir (%s), errno=%d",
+				 path, errno);
+		}
+	}
+}
+
+/**
+ * @brief Clean up recovery directory
+ *
+ * @param[in] parent_path Directory to empty
+ */
+static void fs_clean_old_recov_dir(char *parent_path)
+{
+	DIR *dp;
+	struct dirent *dentp;
+	char *path = NULL;
+	int rc;
+	int total_len;
+
+	dp = opendir(parent_path);
+	if (dp == NULL) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to open old v4 recovery dir (%s), errno=%d",
+			 v4_old_dir, errno);
+		return;
+	}
+
+	for (dentp = readdir(dp); dentp != NULL; dentp = readdir(dp)) {
+		/* don't remove '.' and '..' entry */
+		if (!strcmp(dentp->d_name, ".") || !strcmp(dentp->d_name, ".."))
+			continue;
+
+		/* If there is a filename starting with '\x1', then it is
+		 * a revoked handle, go ahead and remove it.
+		 */
+		if (dentp->d_name[0] == '\x1') {
+			char del_path[PATH_MAX];
+
+			snprintf(del_path, sizeof(del_path), "%s/%s",
+				 parent_path, dentp->d_name);
+
+			if (unlink(del_path) < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+						"unlink of %s failed errno: %d",
+						del_path,
+						errno);
+			}
+
+			continue;
+		}
+
+		/* This is a directory, we need process files in it! */
+		total_len = strlen(parent_path) + strlen(dentp->d_name) + 2;
+		path = gsh_malloc(total_len);
+
+		snprintf(path, total_len, "%s/%s", parent_path, dentp->d_name);
+
+		fs_clean_old_recov_dir(path);
+		rc = rmdir(path);
+		if (rc == -1) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to remove %s, errno=%d", path, errno);
+		}
+		gsh_free(path);
+	}
+	(void)closedir(dp);
+}
+
+static void fs_end_grace(void)
+{
+	fs_clean_old_recov_dir(v4_old_dir);
+}
+
+/**
+ * @brief Create the recovery directory
+ *
+ * The recovery directory may not exist yet, so create it.  This
+ * should only need to be done once (if at all).  Also, the location
+ * of the directory could be configurable.
+ */
+static void fs_create_recov_dir(void)
+{
+	int err;
+
+	err = mkdir(NFS_V4_RECOV_ROOT, 0755);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s), errno=%d",
+			 NFS_V4_RECOV_ROOT, errno);
+	}
+
+	snprintf(v4_recov_dir, sizeof(v4_recov_dir), "%s/%s", NFS_V4_RECOV_ROOT,
+		 NFS_V4_RECOV_DIR);
+	err = mkdir(v4_recov_dir, 0755);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir(%s), errno=%d",
+			 v4_recov_dir, errno);
+	}
+
+	snprintf(v4_old_dir, sizeof(v4_old_dir), "%s/%s", NFS_V4_RECOV_ROOT,
+		 NFS_V4_OLD_DIR);
+	err = mkdir(v4_old_dir, 0755);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir(%s), errno=%d",
+			 v4_old_dir, errno);
+	}
+	if (nfs_param.core_param.clustered) {
+		snprintf(v4_recov_dir, sizeof(v4_recov_dir), "%s/%s/node%d",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_DIR, g_nodeid);
+
+		err = mkdir(v4_recov_dir, 0755);
+		if (err == -1 && errno != EEXIST) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to create v4 recovery dir(%s), errno=%d",
+				 v4_recov_dir, errno);
+		}
+
+		snprintf(v4_old_dir, sizeof(v4_old_dir), "%s/%s/node%d",
+			 NFS_V4_RECOV_ROOT, NFS_V4_OLD_DIR, g_nodeid);
+
+		err = mkdir(v4_old_dir, 0755);
+		if (err == -1 && errno != EEXIST) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to create v4 recovery dir(%s), errno=%d",
+				 v4_old_dir, errno);
+		}
+	}
+}
+
+/**
+ * @brief Record revoked filehandle under the client.
+ *
+ * @param[in] delr_clid Client record
+ * @param[in] rhdlstr   Base64 encoded handle of the revoked file.
+ */
+static void fs_add_revoke_fh(nfs_client_id_t *delr_clid, const char *rhdlstr)
+{
+	char path[PATH_MAX] = {0}, segment[NAME_MAX + 1] = {0};
+	int length, position = 0;
+	int fd;
+
+	/* Parse through the clientid directory structure */
+	assert(delr_clid->cid_recov_dir != NULL);
+
+	snprintf(path, sizeof(path), "%s", v4_recov_dir);
+	length = strlen(delr_clid->cid_recov_dir);
+	while (position < length) {
+		int len = strlen(&delr_clid->cid_recov_dir[position]);
+
+		if (len <= NAME_MAX) {
+			strcat(path, "/");
+			strncat(path, &delr_clid->cid_recov_dir[position], len);
+			strcat(path, "/\x1"); /* Prefix 1 to converted fh */
+			strncat(path, rhdlstr, strlen(rhdlstr));
+			fd = creat(path, 0700);
+			if (fd < 0) {
+				LogEvent(COMPONENT_CLIENTID,
+					"Failed to record revoke errno:%d\n",
+					errno);
+			} else {
+				close(fd);
+			}
+			return;
+		}
+		strncpy(segment, &delr_clid->cid_recov_dir[position], NAME_MAX);
+		strcat(path, "/");
+		strncat(path, segment, NAME_MAX);
+		position += NAME_MAX;
+	}
+}
+
+const struct nfs4_recovery_backend fs_backend = {
+	.recovery_init = fs_create_recov_dir,
+	.recovery_read_clids = fs_read_recov_clids,
+	.add_clid = fs_add_clid,
+	.rm_clid = fs_rm_clid,
+	.add_revoke_fh = fs_add_revoke_fh,
+	.end_grace = fs_end_grace,
+};
+
+/** @} */
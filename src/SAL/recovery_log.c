@@ -0,0 +1,690 @@
+/*
+ * vim:noexpandtab:shiftwidth=8:tabstop=8:
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @addtogroup SAL
+ * @{
+ */
+
+/**
+ * @file recovery_log.c
+ * @brief NFSv4 recovery in an append-only log
+ *
+ * Confirming or expiring a client, or revoking one of its delegations,
+ * appends a record to v4log.  Concurrent appends are written and synced
+ * together, so a burst of clients costs a few syncs rather than a
+ * directory operation each.
+ *
+ * At grace start the log is read in one pass, the surviving clients are
+ * written compacted to v4log.old, and v4log is emptied so that the
+ * clients record themselves again as they come back.  v4log.old plays
+ * the part of the v4old directory of the fs backend and is removed when
+ * grace ends.
+ */
+
+#include "config.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "nfs4.h"
+#include "sal_functions.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "city.h"
+
+#define NFS_V4_RECOV_LOG "v4log"
+#define NFS_V4_OLD_LOG "v4log.old"
+
+#define LOG_REPLAY_HASH_SIZE 4093
+
+enum recov_log_type {
+	RECOV_LOG_ADD = 1,	/*< Client confirmed */
+	RECOV_LOG_RM,		/*< Client expired */
+	RECOV_LOG_REVOKE,	/*< Delegation revoked from the client */
+};
+
+/**
+ * @brief Header of a log record
+ *
+ * The client name follows, then the encoded handle of a
+ * RECOV_LOG_REVOKE.  rl_check covers the rest of the header and the
+ * payload, so a record torn by a crash ends the replay.
+ */
+struct recov_log_rec {
+	uint64_t rl_check;
+	uint16_t rl_type;
+	uint16_t rl_fh_len;
+	uint32_t rl_name_len;
+};
+
+/**
+ * @brief A growing buffer of records
+ */
+struct recov_log_buf {
+	char *lb_buf;
+	size_t lb_len;
+	size_t lb_size;
+};
+
+static char v4_log[PATH_MAX];
+static char v4_old_log[PATH_MAX];
+
+/**
+ * @brief Group commit of v4log
+ *
+ * Records are queued in rl_queue.  The first appender to find no write
+ * in flight becomes the writer: it swaps in the spare buffer, then
+ * writes and syncs everything queued so far with rl_mutex dropped.  The
+ * other appenders wait until rl_synced covers their record, and one of
+ * them takes over the next batch.
+ */
+static struct {
+	pthread_mutex_t rl_mutex;
+	pthread_cond_t rl_cond;
+	int rl_fd;
+	struct recov_log_buf rl_queue;	/*< Records waiting for a write */
+	struct recov_log_buf rl_spare;	/*< Swapped in while writing */
+	uint64_t rl_queued;	/*< Records queued */
+	uint64_t rl_synced;	/*< Records on stable storage */
+	bool rl_writing;
+} recov_log = {
+	.rl_mutex = PTHREAD_MUTEX_INITIALIZER,
+	.rl_cond = PTHREAD_COND_INITIALIZER,
+	.rl_fd = -1,
+};
+
+/**
+ * @brief Client gathered while replaying logs
+ */
+struct log_clid {
+	struct glist_head lc_list;
+	struct glist_head lc_hash;
+	struct glist_head lc_rfh_list;	/*< rdel_fh_t */
+	bool lc_old;		/*< Recorded in the old log */
+	bool lc_cur;		/*< Recorded in the current log */
+	char lc_name[];
+};
+
+struct log_replay {
+	struct glist_head lr_list;
+	struct glist_head lr_hash[LOG_REPLAY_HASH_SIZE];
+};
+
+static uint64_t log_rec_check(struct recov_log_rec *rec, const char *payload)
+{
+	return CityHash64WithSeed(payload, rec->rl_name_len + rec->rl_fh_len,
+				  ((uint64_t) rec->rl_type << 48) |
+				  ((uint64_t) rec->rl_fh_len << 32) |
+				  rec->rl_name_len);
+}
+
+/**
+ * @brief Add a record to a buffer
+ *
+ * @param[in,out] lb   The buffer
+ * @param[in]     type Record type
+ * @param[in]     name Client name
+ * @param[in]     fh   Encoded handle, or NULL
+ */
+static void log_buf_put(struct recov_log_buf *lb, enum recov_log_type type,
+			const char *name, const char *fh)
+{
+	struct recov_log_rec rec;
+	size_t need;
+
+	rec.rl_type = type;
+	rec.rl_name_len = strlen(name);
+	rec.rl_fh_len = fh != NULL ? strlen(fh) : 0;
+	need = sizeof(rec) + rec.rl_name_len + rec.rl_fh_len;
+
+	if (lb->lb_len + need > lb->lb_size) {
+		lb->lb_size = lb->lb_size * 2 + need + 4096;
+		lb->lb_buf = gsh_realloc(lb->lb_buf, lb->lb_size);
+	}
+
+	memcpy(lb->lb_buf + lb->lb_len + sizeof(rec), name, rec.rl_name_len);
+	if (rec.rl_fh_len != 0)
+		memcpy(lb->lb_buf + lb->lb_len + sizeof(rec) + rec.rl_name_len,
+		       fh, rec.rl_fh_len);
+	rec.rl_check = log_rec_check(&rec,
+				     lb->lb_buf + lb->lb_len + sizeof(rec));
+	memcpy(lb->lb_buf + lb->lb_len, &rec, sizeof(rec));
+	lb->lb_len += need;
+}
+
+/**
+ * @brief Write a buffer out and sync it
+ *
+ * @return 0 or an errno.
+ */
+static int log_write_sync(int fd, const char *buf, size_t len)
+{
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = write(fd, buf, len);
+		if (rc == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		buf += rc;
+		len -= rc;
+	}
+
+	if (fdatasync(fd) == -1)
+		return errno;
+
+	return 0;
+}
+
+/**
+ * @brief Write out the queued records, rl_mutex held
+ *
+ * The mutex is dropped during the write.
+ */
+static void log_flush(void)
+{
+	struct recov_log_buf batch = recov_log.rl_queue;
+	uint64_t target = recov_log.rl_queued;
+	int rc;
+
+	recov_log.rl_writing = true;
+	recov_log.rl_queue = recov_log.rl_spare;
+	recov_log.rl_queue.lb_len = 0;
+	memset(&recov_log.rl_spare, 0, sizeof(recov_log.rl_spare));
+
+	PTHREAD_MUTEX_unlock(&recov_log.rl_mutex);
+
+	rc = log_write_sync(recov_log.rl_fd, batch.lb_buf, batch.lb_len);
+	if (rc != 0)
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to write recovery log (%s), errno=%d",
+			v4_log, rc);
+	else
+		LogFullDebug(COMPONENT_CLIENTID,
+			     "Synced %zu bytes of recovery log", batch.lb_len);
+
+	PTHREAD_MUTEX_lock(&recov_log.rl_mutex);
+
+	recov_log.rl_spare = batch;
+	recov_log.rl_synced = target;
+	recov_log.rl_writing = false;
+	pthread_cond_broadcast(&recov_log.rl_cond);
+}
+
+/**
+ * @brief Append a record to v4log and wait for it to be synced
+ *
+ * @param[in] type Record type
+ * @param[in] name Client name
+ * @param[in] fh   Encoded handle, or NULL
+ */
+static void log_append(enum recov_log_type type, const char *name,
+		       const char *fh)
+{
+	uint64_t seq;
+
+	PTHREAD_MUTEX_lock(&recov_log.rl_mutex);
+
+	if (recov_log.rl_fd == -1) {
+		PTHREAD_MUTEX_unlock(&recov_log.rl_mutex);
+		return;
+	}
+
+	log_buf_put(&recov_log.rl_queue, type, name, fh);
+	seq = ++recov_log.rl_queued;
+
+	while (recov_log.rl_synced < seq) {
+		if (recov_log.rl_writing)
+			pthread_cond_wait(&recov_log.rl_cond,
+					  &recov_log.rl_mutex);
+		else
+			log_flush();
+	}
+
+	PTHREAD_MUTEX_unlock(&recov_log.rl_mutex);
+}
+
+/**
+ * @brief Empty v4log once its records are safe in v4log.old
+ */
+static void log_truncate(void)
+{
+	PTHREAD_MUTEX_lock(&recov_log.rl_mutex);
+
+	while (recov_log.rl_writing)
+		pthread_cond_wait(&recov_log.rl_cond, &recov_log.rl_mutex);
+
+	if (recov_log.rl_fd != -1 && ftruncate(recov_log.rl_fd, 0) == -1)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to truncate recovery log (%s), errno=%d",
+			 v4_log, errno);
+
+	PTHREAD_MUTEX_unlock(&recov_log.rl_mutex);
+}
+
+static struct log_replay *log_replay_alloc(void)
+{
+	struct log_replay *lr = gsh_malloc(sizeof(*lr));
+	int i;
+
+	glist_init(&lr->lr_list);
+	for (i = 0; i < LOG_REPLAY_HASH_SIZE; i++)
+		glist_init(&lr->lr_hash[i]);
+
+	return lr;
+}
+
+static void log_clid_free_rfh(struct log_clid *lc)
+{
+	rdel_fh_t *rfh;
+
+	while ((rfh = glist_first_entry(&lc->lc_rfh_list, rdel_fh_t,
+					rdfh_list)) != NULL) {
+		glist_del(&rfh->rdfh_list);
+		gsh_free(rfh->rdfh_handle_str);
+		gsh_free(rfh);
+	}
+}
+
+/**
+ * @brief Find a client of the replay, optionally adding it
+ *
+ * @param[in] lr     The replay
+ * @param[in] name   Client name
+ * @param[in] len    Length of the name
+ * @param[in] create Whether to add a missing client
+ *
+ * @return The client or NULL.
+ */
+static struct log_clid *log_replay_find(struct log_replay *lr,
+					const char *name, size_t len,
+					bool create)
+{
+	struct glist_head *bucket, *node;
+	struct log_clid *lc;
+
+	bucket = &lr->lr_hash[CityHash64(name, len) % LOG_REPLAY_HASH_SIZE];
+
+	glist_for_each(node, bucket) {
+		lc = glist_entry(node, struct log_clid, lc_hash);
+		if (strlen(lc->lc_name) == len && !memcmp(lc->lc_name, name, len))
+			return lc;
+	}
+
+	if (!create)
+		return NULL;
+
+	lc = gsh_calloc(1, sizeof(*lc) + len + 1);
+	memcpy(lc->lc_name, name, len);
+	glist_init(&lc->lc_rfh_list);
+	glist_add_tail(&lr->lr_list, &lc->lc_list);
+	glist_add(bucket, &lc->lc_hash);
+
+	return lc;
+}
+
+/**
+ * @brief Apply the records of a log to a replay
+ *
+ * An expired client only disappears if the old log does not have it,
+ * as a client of the previous instance may still reclaim if this one
+ * restarts during grace.
+ *
+ * @param[in] lr   The replay
+ * @param[in] path Log to read
+ * @param[in] old  Whether this is the old log
+ */
+static void log_replay_file(struct log_replay *lr, const char *path, bool old)
+{
+	struct recov_log_rec rec;
+	struct log_clid *lc;
+	struct stat st;
+	struct glist_head *node;
+	rdel_fh_t *rfh;
+	char *buf, *payload, *fh;
+	size_t off = 0, len = 0, num = 0;
+	ssize_t rc;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno != ENOENT)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to open recovery log (%s), errno=%d",
+				 path, errno);
+		return;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to stat recovery log (%s), errno=%d",
+			 path, errno);
+		close(fd);
+		return;
+	}
+
+	/* Read the whole log at once */
+	buf = gsh_malloc(st.st_size + 1);
+	while (len < (size_t) st.st_size) {
+		rc = read(fd, buf + len, st.st_size - len);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+		len += rc;
+	}
+	close(fd);
+
+	while (off + sizeof(rec) <= len) {
+		memcpy(&rec, buf + off, sizeof(rec));
+		payload = buf + off + sizeof(rec);
+
+		if (rec.rl_type < RECOV_LOG_ADD ||
+		    rec.rl_type > RECOV_LOG_REVOKE ||
+		    rec.rl_name_len == 0 || rec.rl_name_len >= PATH_MAX ||
+		    rec.rl_fh_len >= NAME_MAX ||
+		    off + sizeof(rec) + rec.rl_name_len + rec.rl_fh_len > len ||
+		    log_rec_check(&rec, payload) != rec.rl_check) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Recovery log (%s) damaged at offset %zu, ignoring the rest",
+				 path, off);
+			break;
+		}
+
+		off += sizeof(rec) + rec.rl_name_len + rec.rl_fh_len;
+		num++;
+
+		lc = log_replay_find(lr, payload, rec.rl_name_len,
+				     rec.rl_type == RECOV_LOG_ADD);
+		if (lc == NULL)
+			continue;
+
+		switch ((enum recov_log_type) rec.rl_type) {
+		case RECOV_LOG_ADD:
+			if (old)
+				lc->lc_old = true;
+			else
+				lc->lc_cur = true;
+			break;
+
+		case RECOV_LOG_RM:
+			lc->lc_cur = false;
+			if (!lc->lc_old)
+				log_clid_free_rfh(lc);
+			break;
+
+		case RECOV_LOG_REVOKE:
+			if (!lc->lc_old && !lc->lc_cur)
+				break;
+			fh = payload + rec.rl_name_len;
+			glist_for_each(node, &lc->lc_rfh_list) {
+				rfh = glist_entry(node, rdel_fh_t, rdfh_list);
+				if (strlen(rfh->rdfh_handle_str) ==
+				    rec.rl_fh_len &&
+				    !memcmp(rfh->rdfh_handle_str, fh,
+					    rec.rl_fh_len))
+					break;
+			}
+			if (node != &lc->lc_rfh_list)
+				break;
+			rfh = gsh_malloc(sizeof(*rfh));
+			rfh->rdfh_handle_str = gsh_malloc(rec.rl_fh_len + 1);
+			memcpy(rfh->rdfh_handle_str, fh, rec.rl_fh_len);
+			rfh->rdfh_handle_str[rec.rl_fh_len] = '\0';
+			glist_add_tail(&lc->lc_rfh_list, &rfh->rdfh_list);
+			break;
+		}
+	}
+
+	gsh_free(buf);
+
+	LogDebug(COMPONENT_CLIENTID, "Replayed %zu records of %s", num, path);
+}
+
+/**
+ * @brief Hand the clients of a replay to the reclaim list
+ *
+ * @param[in] lr The replay, freed
+ * @param[in] fd If not -1, where to write the clients compacted
+ *
+ * @return 0 or an errno from writing fd.
+ */
+static int log_replay_done(struct log_replay *lr, int fd)
+{
+	struct recov_log_buf out = { NULL, 0, 0 };
+	struct log_clid *lc;
+	struct glist_head *node;
+	clid_entry_t *clid_ent;
+	rdel_fh_t *rfh;
+	int rc = 0;
+
+	while ((lc = glist_first_entry(&lr->lr_list, struct log_clid,
+				       lc_list)) != NULL) {
+		if (lc->lc_old || lc->lc_cur) {
+			clid_ent = nfs4_add_clid_entry(lc->lc_name);
+			if (fd != -1)
+				log_buf_put(&out, RECOV_LOG_ADD, lc->lc_name,
+					    NULL);
+
+			glist_for_each(node, &lc->lc_rfh_list) {
+				rfh = glist_entry(node, rdel_fh_t, rdfh_list);
+				(void) nfs4_add_rfh_entry(clid_ent,
+							  rfh->rdfh_handle_str);
+				if (fd != -1)
+					log_buf_put(&out, RECOV_LOG_REVOKE,
+						    lc->lc_name,
+						    rfh->rdfh_handle_str);
+			}
+		}
+
+		log_clid_free_rfh(lc);
+		glist_del(&lc->lc_list);
+		gsh_free(lc);
+	}
+
+	gsh_free(lr);
+
+	if (fd != -1)
+		rc = log_write_sync(fd, out.lb_buf, out.lb_len);
+
+	gsh_free(out.lb_buf);
+
+	return rc;
+}
+
+/**
+ * @brief Sync the directory holding the logs after a rename
+ */
+static void log_sync_dir(void)
+{
+	int fd = open(NFS_V4_RECOV_ROOT, O_RDONLY | O_DIRECTORY);
+
+	if (fd == -1)
+		return;
+
+	(void) fsync(fd);
+	close(fd);
+}
+
+/**
+ * @brief Load clients for recovery from the logs
+ *
+ * @param[in] gsp Grace period start information, NULL at startup
+ */
+static void log_read_recov_clids(nfs_grace_start_t *gsp)
+{
+	struct log_replay *lr = log_replay_alloc();
+	char path[PATH_MAX];
+	int fd, rc;
+
+	if (gsp == NULL) {
+		log_replay_file(lr, v4_old_log, true);
+		log_replay_file(lr, v4_log, false);
+
+		/* Keep the clients in the old log, in case we restart
+		 * during grace, and start the current one afresh.
+		 */
+		snprintf(path, sizeof(path), "%s.tmp", v4_old_log);
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (fd == -1)
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to create recovery log (%s), errno=%d",
+				 path, errno);
+
+		rc = log_replay_done(lr, fd);
+		if (fd == -1)
+			return;
+
+		close(fd);
+
+		if (rc != 0) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to write recovery log (%s), errno=%d",
+				 path, rc);
+			(void) unlink(path);
+			return;
+		}
+
+		if (rename(path, v4_old_log) == -1) {
+			LogEvent(COMPONENT_CLIENTID,
+				 "Failed to rename %s to %s, errno=%d",
+				 path, v4_old_log, errno);
+			(void) unlink(path);
+			return;
+		}
+
+		log_sync_dir();
+		log_truncate();
+		return;
+	}
+
+	if (gsp->event == EVENT_UPDATE_CLIENTS)
+		snprintf(path, sizeof(path), "%s", v4_log);
+
+	else if (gsp->event == EVENT_TAKE_IP)
+		snprintf(path, sizeof(path), "%s/%s/%s",
+			 NFS_V4_RECOV_ROOT, gsp->ipaddr, NFS_V4_RECOV_LOG);
+
+	else if (gsp->event == EVENT_TAKE_NODEID)
+		snprintf(path, sizeof(path), "%s/%s.node%d",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_LOG, gsp->nodeid);
+
+	else {
+		gsh_free(lr);
+		return;
+	}
+
+	LogEvent(COMPONENT_CLIENTID, "Recovery for nodeid %d log (%s)",
+		 gsp->nodeid, path);
+
+	log_replay_file(lr, path, false);
+
+	/* Add the clients taken over to our old log */
+	fd = open(v4_old_log, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (fd == -1)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to open recovery log (%s), errno=%d",
+			 v4_old_log, errno);
+
+	rc = log_replay_done(lr, fd);
+	if (fd == -1)
+		return;
+
+	if (rc != 0)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to write recovery log (%s), errno=%d",
+			 v4_old_log, rc);
+	close(fd);
+}
+
+static void log_add_clid(nfs_client_id_t *clientid)
+{
+	log_append(RECOV_LOG_ADD, clientid->cid_recov_dir, NULL);
+}
+
+static void log_rm_clid(nfs_client_id_t *clientid)
+{
+	log_append(RECOV_LOG_RM, clientid->cid_recov_dir, NULL);
+}
+
+static void log_add_revoke_fh(nfs_client_id_t *delr_clid, const char *rhdlstr)
+{
+	assert(delr_clid->cid_recov_dir != NULL);
+
+	log_append(RECOV_LOG_REVOKE, delr_clid->cid_recov_dir, rhdlstr);
+}
+
+static void log_end_grace(void)
+{
+	if (unlink(v4_old_log) == -1 && errno != ENOENT)
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to remove old recovery log (%s), errno=%d",
+			 v4_old_log, errno);
+}
+
+/**
+ * @brief Open the recovery log
+ */
+static void log_recovery_init(void)
+{
+	int err;
+
+	err = mkdir(NFS_V4_RECOV_ROOT, 0755);
+	if (err == -1 && errno != EEXIST) {
+		LogEvent(COMPONENT_CLIENTID,
+			 "Failed to create v4 recovery dir (%s), errno=%d",
+			 NFS_V4_RECOV_ROOT, errno);
+	}
+
+	if (nfs_param.core_param.clustered) {
+		snprintf(v4_log, sizeof(v4_log), "%s/%s.node%d",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_LOG, g_nodeid);
+		snprintf(v4_old_log, sizeof(v4_old_log), "%s/%s.node%d",
+			 NFS_V4_RECOV_ROOT, NFS_V4_OLD_LOG, g_nodeid);
+	} else {
+		snprintf(v4_log, sizeof(v4_log), "%s/%s",
+			 NFS_V4_RECOV_ROOT, NFS_V4_RECOV_LOG);
+		snprintf(v4_old_log, sizeof(v4_old_log), "%s/%s",
+			 NFS_V4_RECOV_ROOT, NFS_V4_OLD_LOG);
+	}
+
+	recov_log.rl_fd = open(v4_log, O_WRONLY | O_CREAT | O_APPEND, 0600);
+	if (recov_log.rl_fd == -1)
+		LogCrit(COMPONENT_CLIENTID,
+			"Failed to open recovery log (%s), errno=%d",
+			v4_log, errno);
+}
+
+const struct nfs4_recovery_backend log_backend = {
+	.recovery_init = log_recovery_init,
+	.recovery_read_clids = log_read_recov_clids,
+	.add_clid = log_add_clid,
+	.rm_clid = log_rm_clid,
+	.add_revoke_fh = log_add_revoke_fh,
+	.end_grace = log_end_grace,
+};
+
+/** @} */
@@ -346,10 +346,83 @@ bool init_deleg_heuristics(struct fsal_obj_handle *obj)
 	statistics->fds_avg_hold = 0;
 	statistics->fds_num_opens = 0;
 	statistics->fds_first_open = 0;
+	statistics->fds_write_opens = 0;
+	statistics->fds_writer = 0;
+	statistics->fds_multi_writer = false;
 
 	return true;
 }
 
+/**
+ * @brief Record the access pattern of an OPEN on a file
+ *
+ * Keep track of whether the file has been opened for write, and by how
+ * many clients, so the aggressive delegation policy can tell files that
+ * are read-only or have a single writer from shared ones.
+ *
+ * @note The state_lock MUST be held for read
+ *
+ * @param[in] ostate       File state
+ * @param[in] client       Client doing the OPEN
+ * @param[in] share_access Access asked for by the OPEN
+ */
+void deleg_heuristics_open(struct state_hdl *ostate, nfs_client_id_t *client,
+			   uint32_t share_access)
+{
+	struct file_deleg_stats *statistics = &ostate->file.fdeleg_stats;
+
+	if (!(share_access & OPEN4_SHARE_ACCESS_WRITE))
+		return;
+
+	if (statistics->fds_write_opens++ == 0)
+		statistics->fds_writer = client->cid_clientid;
+	else if (statistics->fds_writer != client->cid_clientid)
+		statistics->fds_multi_writer = true;
+}
+
+/* A client that fails a recall gets no delegations under the aggressive
+ * policy for DELEG_BACKOFF_MIN seconds, doubled for each further failure
+ * up to DELEG_BACKOFF_MAX.
+ */
+#define DELEG_BACKOFF_MIN 30
+#define DELEG_BACKOFF_MAX 1800
+
+/**
+ * @brief Update client delegation heuristics on a failed recall
+ *
+ * @param[in] client Client that failed to answer a recall
+ */
+void deleg_heuristics_recall_failed(nfs_client_id_t *client)
+{
+	time_t backoff = DELEG_BACKOFF_MIN;
+	uint32_t i;
+
+	PTHREAD_MUTEX_lock(&client->cid_mutex);
+
+	for (i = client->num_failed_recalls++;
+	     i > 0 && backoff < DELEG_BACKOFF_MAX; i--)
+		backoff *= 2;
+
+	if (backoff > DELEG_BACKOFF_MAX)
+		backoff = DELEG_BACKOFF_MAX;
+
+	client->deleg_backoff = time(NULL) + backoff;
+
+	PTHREAD_MUTEX_unlock(&client->cid_mutex);
+}
+
+/**
+ * @brief Update client delegation heuristics on a successful recall
+ *
+ * @param[in] client Client that answered a recall
+ */
+void deleg_heuristics_recall_ok(nfs_client_id_t *client)
+{
+	PTHREAD_MUTEX_lock(&client->cid_mutex);
+	client->num_failed_recalls = 0;
+	PTHREAD_MUTEX_unlock(&client->cid_mutex);
+}
+
 /* Most clients retry NFS operations after 5 seconds. The following
  * should be good enough to avoid starving a client's open
  */
@@ -427,6 +500,32 @@ bool should_we_grant_deleg(struct state_hdl *ostate, nfs_client_id_t *client,
 	    time(NULL) - file_stats->fds_last_recall < RECALL2DELEG_TIME)
 		return false;
 
+	if (atomic_fetch_uint32_t(&op_ctx->ctx_export->deleg_policy) ==
+	    DELEG_POLICY_AGGRESSIVE) {
+		/* Let an unreliable client back in once its backoff is
+		 * over, rather than never.
+		 */
+		if (time(NULL) < client->deleg_backoff) {
+			LogFullDebug(COMPONENT_STATE,
+				     "Client is backing off, not granting delegation");
+			return false;
+		}
+
+		/* A read delegation on a file several clients write to
+		 * would soon be recalled.
+		 */
+		if (!(open_state->state_data.share.share_access &
+		      OPEN4_SHARE_ACCESS_WRITE) &&
+		    file_stats->fds_multi_writer) {
+			LogFullDebug(COMPONENT_STATE,
+				     "File has several writers, not granting read delegation");
+			return false;
+		}
+
+		LogDebug(COMPONENT_STATE, "Let's delegate!!");
+		return true;
+	}
+
 	/* Check if this is a misbehaving or unreliable client */
 	if (client->num_revokes > 2) /* more than 2 revokes */
 		return false;
@@ -60,12 +60,15 @@
  * @param[in] segment         Layout segment itself granted by the FSAL
  * @param[in] fsal_data       Pointer to FSAL-specific data for this segment.
  * @param[in] return_on_close True for automatic return on last close
+ * @param[in] body            Encoded loc_body of the segment, kept for
+ *                            LAYOUTGETs it covers, may be NULL
  *
  * @return STATE_SUCCESS on completion, other values of state_status_t
  *         on failure.
  */
 state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
-				 void *fsal_data, bool return_on_close)
+				 void *fsal_data, bool return_on_close,
+				 const struct gsh_buffdesc *body)
 {
 	/* Pointer to the new segment being added to the state */
 	state_layout_segment_t *new_segment = NULL;
@@ -88,6 +91,12 @@ state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
 	new_segment->sls_state = state;
 	new_segment->sls_segment = *segment;
 
+	if (body != NULL && body->len != 0) {
+		new_segment->sls_body = gsh_malloc(body->len);
+		memcpy(new_segment->sls_body, body->addr, body->len);
+		new_segment->sls_body_len = body->len;
+	}
+
 	glist_add_tail(&state->state_data.layout.state_segments,
 		       &new_segment->sls_state_segments);
 
@@ -112,6 +121,7 @@ state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
 state_status_t state_delete_segment(state_layout_segment_t *segment)
 {
 	glist_del(&segment->sls_state_segments);
+	gsh_free(segment->sls_body);
 	gsh_free(segment);
 	return STATE_SUCCESS;
 }
@@ -269,4 +279,110 @@ void revoke_owner_layouts(state_owner_t *client_owner)
 	}
 }
 
+/** A layout state picked by return_owner_layouts, with its references */
+struct owner_layout {
+	state_t *state;
+	struct fsal_obj_handle *obj;
+	struct gsh_export *export;
+};
+
+/**
+ * @brief Return the layouts of a client owner on an fsid or everywhere
+ *
+ * The states are taken off so_state_list under so_mutex first, so that
+ * a state left in place by a partial return is not found again.  Stops
+ * at the first error.
+ *
+ * @param[in] client_owner The clientid owner
+ * @param[in] type         Layout type to return
+ * @param[in] fsid         Filesystem to return layouts on, NULL for all
+ * @param[in] spec         Segment to return of each layout
+ * @param[in] return_type  LAYOUTRETURN4_FSID or LAYOUTRETURN4_ALL
+ * @param[in] circumstance Why the layouts are returned
+ *
+ * @return NFS4_OK or the error of the return that failed.
+ */
+nfsstat4 return_owner_layouts(state_owner_t *client_owner, layouttype4 type,
+			      const fsal_fsid_t *fsid,
+			      struct pnfs_segment spec,
+			      layoutreturn_type4 return_type,
+			      enum fsal_layoutreturn_circumstance circumstance)
+{
+	struct root_op_context root_op_context;
+	struct owner_layout *layouts = NULL;
+	size_t count = 0, size = 0, i;
+	struct glist_head *glist;
+	nfsstat4 status = NFS4_OK;
+
+	init_root_op_context(&root_op_context, NULL, NULL,
+			     0, 0, UNKNOWN_REQUEST);
+	root_op_context.req_ctx.clientid =
+	    &client_owner->so_owner.so_nfs4_owner.so_clientid;
+
+	PTHREAD_MUTEX_lock(&client_owner->so_mutex);
+
+	glist_for_each(glist,
+		       &client_owner->so_owner.so_nfs4_owner.so_state_list) {
+		state_t *state = glist_entry(glist, state_t, state_owner_list);
+		struct owner_layout *l;
+
+		if (state->state_type != STATE_TYPE_LAYOUT ||
+		    state->state_data.layout.state_layout_type != type)
+			continue;
+
+		if (count == size) {
+			size = size ? size * 2 : 16;
+			layouts = gsh_realloc(layouts, size * sizeof(*layouts));
+		}
+
+		l = &layouts[count];
+
+		/* A state whose file or export is going stale is cleaned
+		 * up with them.
+		 */
+		if (!get_state_obj_export_owner_refs(state, &l->obj,
+						     &l->export, NULL))
+			continue;
+
+		if (fsid != NULL &&
+		    memcmp(fsid, &l->obj->fsid, sizeof(*fsid)) != 0) {
+			put_gsh_export(l->export);
+			l->obj->obj_ops.put_ref(l->obj);
+			continue;
+		}
+
+		inc_state_t_ref(state);
+		l->state = state;
+		count++;
+	}
+
+	PTHREAD_MUTEX_unlock(&client_owner->so_mutex);
+
+	for (i = 0; i < count; i++) {
+		struct owner_layout *l = &layouts[i];
+		bool deleted = false;
+
+		if (status == NFS4_OK) {
+			root_op_context.req_ctx.ctx_export = l->export;
+			root_op_context.req_ctx.fsal_export =
+			    l->export->fsal_export;
+
+			PTHREAD_RWLOCK_wrlock(&l->obj->state_hdl->state_lock);
+			status = nfs4_return_one_state(l->obj, return_type,
+						       circumstance, l->state,
+						       spec, 0, NULL, &deleted);
+			PTHREAD_RWLOCK_unlock(&l->obj->state_hdl->state_lock);
+		}
+
+		dec_state_t_ref(l->state);
+		put_gsh_export(l->export);
+		l->obj->obj_ops.put_ref(l->obj);
+	}
+
+	release_root_op_context();
+	gsh_free(layouts);
+
+	return status;
+}
+
 /** @} */
@@ -50,6 +50,10 @@
 /*#include "nlm_util.h"*/
 #include "export_mgr.h"
 
+#ifdef USE_LTTNG
+#include "gsh_lttng/state.h"
+#endif
+
 /**
  * @page state_lock_entry_locking state_lock_entry_t locking rule
  *
@@ -82,15 +86,95 @@ static struct glist_head state_all_locks = GLIST_HEAD_INIT(state_all_locks);
 pthread_mutex_t all_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
+/** Number of partitions of the blocked lock list */
+#define BLOCKED_LOCK_PARTITIONS 17
+
+/**
+ * @brief A partition of the locks blocked in FSAL
+ *
+ * Blocked locks are partitioned by file, so blocking, granting and FSAL
+ * upcalls on different files don't serialize on one mutex, and an upcall
+ * only searches the locks blocked on files sharing its partition.
+ */
+struct blocked_locks_partition {
+	pthread_mutex_t mtx;	/*< Mutex protecting this partition */
+	struct glist_head list;	/*< Blocked locks (state_block_data_t) */
+	uint32_t poll_count;	/*< Locks on list of type STATE_BLOCK_POLL */
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
+
 /**
  * @brief All locks blocked in FSAL
  */
-struct glist_head state_blocked_locks = GLIST_HEAD_INIT(state_blocked_locks);
+static struct blocked_locks_partition
+	state_blocked_locks[BLOCKED_LOCK_PARTITIONS];
+
+/**
+ * @brief Find the blocked lock partition of a file
+ *
+ * @param[in] obj File
+ *
+ * @return The partition.
+ */
+static inline struct blocked_locks_partition *
+blocked_locks_part(struct fsal_obj_handle *obj)
+{
+	return &state_blocked_locks[((uintptr_t) obj >> 6) %
+				    BLOCKED_LOCK_PARTITIONS];
+}
+
+/**
+ * @brief Put a blocked lock on its partition's list
+ *
+ * @param[in,out] block_data Block data of the lock
+ */
+static void blocked_lock_insert(state_block_data_t *block_data)
+{
+	struct blocked_locks_partition *part =
+		blocked_locks_part(block_data->sbd_lock_entry->sle_obj);
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+
+	glist_add_tail(&part->list, &block_data->sbd_list);
+	if (block_data->sbd_block_type == STATE_BLOCK_POLL)
+		part->poll_count++;
+
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
+
+/**
+ * @brief Take a blocked lock off its partition's list
+ *
+ * The partition mutex must be held.  The lock may already be off the
+ * list.
+ *
+ * @param[in,out] part       Partition of the lock
+ * @param[in,out] block_data Block data of the lock
+ */
+static void blocked_lock_unlink(struct blocked_locks_partition *part,
+				state_block_data_t *block_data)
+{
+	if (block_data->sbd_list.next == NULL)
+		return;
+
+	glist_del(&block_data->sbd_list);
+	if (block_data->sbd_block_type == STATE_BLOCK_POLL)
+		part->poll_count--;
+}
 
 /**
- * @brief Mutex to protect lock lists
+ * @brief Take a blocked lock off its partition's list
+ *
+ * @param[in] lock_entry Blocked lock
  */
-pthread_mutex_t blocked_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void blocked_lock_remove(state_lock_entry_t *lock_entry)
+{
+	struct blocked_locks_partition *part =
+		blocked_locks_part(lock_entry->sle_obj);
+
+	PTHREAD_MUTEX_lock(&part->mtx);
+	blocked_lock_unlink(part, lock_entry->sle_block_data);
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
 
 /**
  * @brief Owner of state with no defined owner
@@ -143,6 +227,7 @@ static hash_table_t *ht_lock_cookies;
 state_status_t state_lock_init(void)
 {
 	state_status_t status = STATE_SUCCESS;
+	int i;
 
 	ht_lock_cookies = hashtable_init(&cookie_param);
 	if (ht_lock_cookies == NULL) {
@@ -151,10 +236,18 @@ state_status_t state_lock_init(void)
 		return status;
 	}
 
+	for (i = 0; i < BLOCKED_LOCK_PARTITIONS; i++) {
+		PTHREAD_MUTEX_init(&state_blocked_locks[i].mtx, NULL);
+		glist_init(&state_blocked_locks[i].list);
+	}
+
 	status = state_async_init();
 
 	state_owner_pool =
-		pool_basic_init("NFSv4 state owners", sizeof(state_owner_t));
+		pool_cached_init("NFSv4 state owners", sizeof(state_owner_t),
+				 STATE_OWNER_POOL_CPU_MAX);
+	if (nfs_param.core_param.state_hugepage_arenas)
+		pool_arena_init(state_owner_pool);
 
 	return status;
 }
@@ -409,7 +502,7 @@ static bool LogList(const char *reason, struct fsal_obj_handle *obj,
 /**
  * @brief Log blocked locks on list
  *
- * Must hold blocked_locks_mutex.
+ * Must hold the mutex of the blocked lock partition.
  *
  * @param[in] reason Arbitrary string
  * @param[in] obj  File
@@ -548,6 +641,365 @@ void dump_all_locks(const char *label)
 #endif
 }
 
+/******************************************************************************
+ *
+ * Functions to manage the interval tree indexing a file's lock list
+ *
+ * The lock list stays the authority on which locks a file holds and in
+ * what order they were added; the tree only lets the paths that need
+ * the locks overlapping a range (conflict checks, merging, unlocking)
+ * find them in O(log n + m) instead of walking every lock on the file.
+ *
+ ******************************************************************************/
+
+/** Number of overlapping locks returned without allocating */
+#define LOCK_INDEX_INLINE 16
+
+/**
+ * @brief Locks found by a lock index search
+ */
+struct lock_index_result {
+	state_lock_entry_t **entries;	/*< Overlapping locks, in list order */
+	size_t count;			/*< Number of entries found */
+	size_t size;			/*< Size of entries */
+	state_lock_entry_t *inline_entries[LOCK_INDEX_INLINE];
+};
+
+static inline int32_t lock_index_height(state_lock_entry_t *node)
+{
+	return node != NULL ? node->sle_idx.sli_height : 0;
+}
+
+/**
+ * @brief Recompute the height and max end of a node from its children
+ *
+ * @param[in,out] node Node to fix up
+ */
+static void lock_index_fixup(state_lock_entry_t *node)
+{
+	state_lock_entry_t *left = node->sle_idx.sli_left;
+	state_lock_entry_t *right = node->sle_idx.sli_right;
+	int32_t hl = lock_index_height(left);
+	int32_t hr = lock_index_height(right);
+
+	node->sle_idx.sli_height = (hl > hr ? hl : hr) + 1;
+	node->sle_idx.sli_max_end = node->sle_idx.sli_end;
+
+	if (left != NULL && left->sle_idx.sli_max_end > node->sle_idx.sli_max_end)
+		node->sle_idx.sli_max_end = left->sle_idx.sli_max_end;
+
+	if (right != NULL &&
+	    right->sle_idx.sli_max_end > node->sle_idx.sli_max_end)
+		node->sle_idx.sli_max_end = right->sle_idx.sli_max_end;
+}
+
+static state_lock_entry_t *lock_index_rotate_left(state_lock_entry_t *node)
+{
+	state_lock_entry_t *right = node->sle_idx.sli_right;
+
+	node->sle_idx.sli_right = right->sle_idx.sli_left;
+	right->sle_idx.sli_left = node;
+	lock_index_fixup(node);
+	lock_index_fixup(right);
+
+	return right;
+}
+
+static state_lock_entry_t *lock_index_rotate_right(state_lock_entry_t *node)
+{
+	state_lock_entry_t *left = node->sle_idx.sli_left;
+
+	node->sle_idx.sli_left = left->sle_idx.sli_right;
+	left->sle_idx.sli_right = node;
+	lock_index_fixup(node);
+	lock_index_fixup(left);
+
+	return left;
+}
+
+/**
+ * @brief Restore the AVL balance of a subtree
+ *
+ * @param[in] node Root of a subtree whose children are balanced
+ *
+ * @return New root of the subtree.
+ */
+static state_lock_entry_t *lock_index_balance(state_lock_entry_t *node)
+{
+	state_lock_entry_t *child;
+	int32_t balance;
+
+	lock_index_fixup(node);
+
+	balance = lock_index_height(node->sle_idx.sli_left) -
+		  lock_index_height(node->sle_idx.sli_right);
+
+	if (balance > 1) {
+		child = node->sle_idx.sli_left;
+		if (lock_index_height(child->sle_idx.sli_left) <
+		    lock_index_height(child->sle_idx.sli_right))
+			node->sle_idx.sli_left = lock_index_rotate_left(child);
+		return lock_index_rotate_right(node);
+	}
+
+	if (balance < -1) {
+		child = node->sle_idx.sli_right;
+		if (lock_index_height(child->sle_idx.sli_right) <
+		    lock_index_height(child->sle_idx.sli_left))
+			node->sle_idx.sli_right = lock_index_rotate_right(child);
+		return lock_index_rotate_left(node);
+	}
+
+	return node;
+}
+
+/**
+ * @brief Order of two locks in the index
+ *
+ * Locks are ordered by start, ties broken by list order so every entry
+ * has a distinct key.
+ */
+static inline bool lock_index_before(state_lock_entry_t *a,
+				     state_lock_entry_t *b)
+{
+	if (a->sle_lock.lock_start != b->sle_lock.lock_start)
+		return a->sle_lock.lock_start < b->sle_lock.lock_start;
+
+	return a->sle_seq < b->sle_seq;
+}
+
+static state_lock_entry_t *lock_index_insert(state_lock_entry_t *node,
+					     state_lock_entry_t *entry)
+{
+	if (node == NULL)
+		return entry;
+
+	if (lock_index_before(entry, node))
+		node->sle_idx.sli_left =
+			lock_index_insert(node->sle_idx.sli_left, entry);
+	else
+		node->sle_idx.sli_right =
+			lock_index_insert(node->sle_idx.sli_right, entry);
+
+	return lock_index_balance(node);
+}
+
+static state_lock_entry_t *lock_index_remove_min(state_lock_entry_t *node,
+						 state_lock_entry_t **min)
+{
+	if (node->sle_idx.sli_left == NULL) {
+		*min = node;
+		return node->sle_idx.sli_right;
+	}
+
+	node->sle_idx.sli_left =
+		lock_index_remove_min(node->sle_idx.sli_left, min);
+
+	return lock_index_balance(node);
+}
+
+static state_lock_entry_t *lock_index_remove(state_lock_entry_t *node,
+					     state_lock_entry_t *entry)
+{
+	state_lock_entry_t *min, *right;
+
+	if (node == NULL)
+		return NULL;
+
+	if (node == entry) {
+		right = node->sle_idx.sli_right;
+		if (right == NULL)
+			return node->sle_idx.sli_left;
+
+		right = lock_index_remove_min(right, &min);
+		min->sle_idx.sli_left = node->sle_idx.sli_left;
+		min->sle_idx.sli_right = right;
+		return lock_index_balance(min);
+	}
+
+	if (lock_index_before(entry, node))
+		node->sle_idx.sli_left =
+			lock_index_remove(node->sle_idx.sli_left, entry);
+	else
+		node->sle_idx.sli_right =
+			lock_index_remove(node->sle_idx.sli_right, entry);
+
+	return lock_index_balance(node);
+}
+
+/**
+ * @brief Add an entry to the index of its file
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] ostate File state
+ * @param[in,out] entry  Entry already on ostate's lock list
+ */
+static void lock_index_add(struct state_hdl *ostate,
+			   state_lock_entry_t *entry)
+{
+	entry->sle_idx.sli_left = NULL;
+	entry->sle_idx.sli_right = NULL;
+	entry->sle_idx.sli_end = lock_end(&entry->sle_lock);
+	entry->sle_idx.sli_max_end = entry->sle_idx.sli_end;
+	entry->sle_idx.sli_height = 1;
+	entry->sle_idx.sli_indexed = true;
+
+	if (ostate->file.lock_export == NULL)
+		ostate->file.lock_export = entry->sle_export;
+	else if (ostate->file.lock_export != entry->sle_export)
+		ostate->file.lock_exports_mixed = true;
+
+	ostate->file.lock_index = lock_index_insert(ostate->file.lock_index,
+						    entry);
+}
+
+/**
+ * @brief Remove an entry from the index of its file
+ *
+ * Must be called before the range of an indexed entry is changed, and
+ * lock_index_add called again afterwards.
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] entry Entry to remove
+ */
+static void lock_index_del(state_lock_entry_t *entry)
+{
+	struct state_hdl *ostate = entry->sle_obj->state_hdl;
+
+	if (!entry->sle_idx.sli_indexed)
+		return;
+
+	ostate->file.lock_index = lock_index_remove(ostate->file.lock_index,
+						    entry);
+	entry->sle_idx.sli_indexed = false;
+
+	if (ostate->file.lock_index == NULL) {
+		ostate->file.lock_export = NULL;
+		ostate->file.lock_exports_mixed = false;
+	}
+}
+
+/**
+ * @brief Append an entry to the lock list of a file and index it
+ *
+ * @note The state_lock MUST be held for write
+ *
+ * @param[in,out] ostate File state
+ * @param[in,out] entry  Entry to add
+ */
+static void lock_list_add(struct state_hdl *ostate,
+			  state_lock_entry_t *entry)
+{
+	glist_add_tail(&ostate->file.lock_list, &entry->sle_list);
+	entry->sle_seq = ++ostate->file.lock_seq;
+	lock_index_add(ostate, entry);
+}
+
+static void lock_index_collect(struct lock_index_result *result,
+			       state_lock_entry_t *entry)
+{
+	state_lock_entry_t **entries;
+
+	if (result->count == result->size) {
+		entries = gsh_malloc(result->size * 2 * sizeof(*entries));
+		memcpy(entries, result->entries,
+		       result->count * sizeof(*entries));
+		if (result->entries != result->inline_entries)
+			gsh_free(result->entries);
+		result->entries = entries;
+		result->size *= 2;
+	}
+
+	result->entries[result->count++] = entry;
+}
+
+static void lock_index_search(state_lock_entry_t *node,
+			      uint64_t start, uint64_t end,
+			      struct lock_index_result *result)
+{
+	while (node != NULL && node->sle_idx.sli_max_end >= start) {
+		lock_index_search(node->sle_idx.sli_left, start, end, result);
+
+		/* Everything from here on starts after the range */
+		if (node->sle_lock.lock_start > end)
+			return;
+
+		if (node->sle_idx.sli_end >= start)
+			lock_index_collect(result, node);
+
+		node = node->sle_idx.sli_right;
+	}
+}
+
+static int lock_index_seq_cmp(const void *a, const void *b)
+{
+	const state_lock_entry_t *ea = *(state_lock_entry_t * const *)a;
+	const state_lock_entry_t *eb = *(state_lock_entry_t * const *)b;
+
+	if (ea->sle_seq < eb->sle_seq)
+		return -1;
+
+	return ea->sle_seq > eb->sle_seq;
+}
+
+/**
+ * @brief Find the locks of a file overlapping a range
+ *
+ * The locks are returned in lock list order, so callers see them in the
+ * same order a walk of the lock list would.  The result must be
+ * released with lock_index_done.
+ *
+ * @note The state_lock MUST be held
+ *
+ * @param[in]  ostate File state to search
+ * @param[in]  start  First byte of the range
+ * @param[in]  end    Last byte of the range
+ * @param[out] result Overlapping locks
+ */
+static void lock_index_find(struct state_hdl *ostate,
+			    uint64_t start, uint64_t end,
+			    struct lock_index_result *result)
+{
+	result->entries = result->inline_entries;
+	result->count = 0;
+	result->size = LOCK_INDEX_INLINE;
+
+	lock_index_search(ostate->file.lock_index, start, end, result);
+
+	if (result->count > 1)
+		qsort(result->entries, result->count,
+		      sizeof(*result->entries), lock_index_seq_cmp);
+}
+
+/**
+ * @brief Gather every lock of a list that has no index
+ *
+ * @param[in]  list   List to gather
+ * @param[out] result Locks on list
+ */
+static void lock_index_find_list(struct glist_head *list,
+				 struct lock_index_result *result)
+{
+	struct glist_head *glist;
+
+	result->entries = result->inline_entries;
+	result->count = 0;
+	result->size = LOCK_INDEX_INLINE;
+
+	glist_for_each(glist, list)
+		lock_index_collect(result,
+				   glist_entry(glist, state_lock_entry_t,
+					       sle_list));
+}
+
+static inline void lock_index_done(struct lock_index_result *result)
+{
+	if (result->entries != result->inline_entries)
+		gsh_free(result->entries);
+}
+
 /******************************************************************************
  *
  * Functions to manage lock entries and lock list
@@ -697,9 +1149,7 @@ static void lock_entry_dec_ref(state_lock_entry_t *lock_entry)
 		/* Release block data if present */
 		if (lock_entry->sle_block_data != NULL) {
 			/* need to remove from the state_blocked_locks list */
-			PTHREAD_MUTEX_lock(&blocked_locks_mutex);
-			glist_del(&lock_entry->sle_block_data->sbd_list);
-			PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+			blocked_lock_remove(lock_entry);
 			gsh_free(lock_entry->sle_block_data);
 		}
 #ifdef DEBUG_SAL
@@ -770,6 +1220,7 @@ static void remove_from_locklist(state_lock_entry_t *lock_entry)
 	}
 
 	lock_entry->sle_owner = NULL;
+	lock_index_del(lock_entry);
 	glist_del(&lock_entry->sle_list);
 	lock_entry_dec_ref(lock_entry);
 }
@@ -789,12 +1240,16 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 						 state_owner_t *owner,
 						 fsal_lock_param_t *lock)
 {
-	struct glist_head *glist;
+	struct lock_index_result overlaps;
 	state_lock_entry_t *found_entry = NULL;
+	state_lock_entry_t *conflict_entry = NULL;
 	uint64_t found_entry_end, range_end = lock_end(lock);
+	size_t i;
 
-	glist_for_each(glist, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	lock_index_find(ostate, lock->lock_start, range_end, &overlaps);
+
+	for (i = 0; i < overlaps.count; i++) {
+		found_entry = overlaps.entries[i];
 
 		LogEntry("Checking", found_entry);
 
@@ -817,19 +1272,22 @@ static state_lock_entry_t *get_overlapping_entry(struct state_hdl *ostate,
 			    && different_owners(found_entry->sle_owner, owner)
 			    ) {
 				/* found a conflicting lock, return it */
-				return found_entry;
+				conflict_entry = found_entry;
+				break;
 			}
 		}
 	}
 
-	return NULL;
+	lock_index_done(&overlaps);
+
+	return conflict_entry;
 }
 
 /**
  * @brief Add a lock, potentially merging with existing locks
  *
- * We need to iterate over the full lock list and remove
- * any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0 lock_entry
+ * We need to find every lock touching or overlapping the new one and
+ * remove any mapping entry. And l_offset = 0 and sle_lock.lock_length = 0 lock_entry
  * implies remove all entries
  *
  * @note The state_lock MUST be held for write
@@ -844,13 +1302,31 @@ static void merge_lock_entry(struct state_hdl *ostate,
 	state_lock_entry_t *check_entry_right;
 	uint64_t check_entry_end;
 	uint64_t lock_entry_end;
-	struct glist_head *glist;
-	struct glist_head *glistn;
+	uint64_t query_start, query_end;
+	struct lock_index_result overlaps;
+	bool indexed = lock_entry->sle_idx.sli_indexed;
+	size_t i;
 
 	/* lock_entry might be STATE_NON_BLOCKING or STATE_GRANTING */
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		check_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	/* lock_entry may already be on the lock list, its range is about
+	 * to change so it must leave the index until the merge is done.
+	 */
+	lock_index_del(lock_entry);
+
+	/* Locks that just touch lock_entry are merged too */
+	query_start = lock_entry->sle_lock.lock_start;
+	if (query_start > 0)
+		query_start--;
+
+	query_end = lock_end(&lock_entry->sle_lock);
+	if (query_end < UINT64_MAX)
+		query_end++;
+
+	lock_index_find(ostate, query_start, query_end, &overlaps);
+
+	for (i = 0; i < overlaps.count; i++) {
+		check_entry = overlaps.entries[i];
 
 		/* Skip entry being merged - it could be in the list */
 		if (check_entry == lock_entry)
@@ -891,14 +1367,16 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				/* Need to split old lock */
 				check_entry_right =
 				    state_lock_entry_t_dup(check_entry);
-				glist_add_tail(&ostate->file.lock_list,
-					       &(check_entry_right->sle_list));
 			} else {
 				/* No split, just shrink, make the logic below
 				 * work on original lock
 				 */
 				check_entry_right = check_entry;
 			}
+
+			/* Old lock's range changes, reindex it below */
+			lock_index_del(check_entry);
+
 			if (lock_entry_end < check_entry_end) {
 				/* Need to shrink old lock from beginning
 				 * (right lock if split)
@@ -923,6 +1401,12 @@ static void merge_lock_entry(struct state_hdl *ostate,
 				    check_entry->sle_lock.lock_start;
 				LogEntry("Merge shrunk left", check_entry);
 			}
+
+			if (check_entry_right != check_entry)
+				lock_list_add(ostate, check_entry_right);
+
+			lock_index_add(ostate, check_entry);
+
 			/* Done splitting/shrinking old lock */
 			continue;
 		}
@@ -949,6 +1433,11 @@ static void merge_lock_entry(struct state_hdl *ostate,
 		LogEntry("Merging removing", check_entry);
 		remove_from_locklist(check_entry);
 	}
+
+	lock_index_done(&overlaps);
+
+	if (indexed)
+		lock_index_add(ostate, lock_entry);
 }
 
 /**
@@ -1058,8 +1547,11 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
 /**
  * @brief Subtract a lock from a list of locks
  *
- * This function possibly splits entries in the list.
+ * This function possibly splits entries in the list.  When the list is
+ * the lock list of a file, ostate is passed so only the locks in the
+ * file's index that overlap the lock are visited.
  *
+ * @param[in]     ostate  File state owning list, or NULL
  * @param[in]     owner   Lock owner
  * @param[in]     state   Associated lock state
  * @param[in]     lock    Lock to remove
@@ -1068,7 +1560,8 @@ static state_status_t subtract_lock_from_entry(state_lock_entry_t *found_entry,
  *
  * @return State status.
  */
-static state_status_t subtract_lock_from_list(state_owner_t *owner,
+static state_status_t subtract_lock_from_list(struct state_hdl *ostate,
+					      state_owner_t *owner,
 					      bool state_applies,
 					      int32_t state,
 					      fsal_lock_param_t *lock,
@@ -1078,16 +1571,26 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 	state_lock_entry_t *found_entry;
 	struct glist_head split_lock_list, remove_list;
 	struct glist_head *glist, *glistn;
+	struct lock_index_result overlaps;
 	state_status_t status = STATE_SUCCESS;
 	bool removed_one = false;
+	size_t i;
 
 	*removed = false;
 
 	glist_init(&split_lock_list);
 	glist_init(&remove_list);
 
-	glist_for_each_safe(glist, glistn, list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	if (ostate != NULL) {
+		lock_index_find(ostate, lock->lock_start, lock_end(lock),
+				&overlaps);
+	} else {
+		/* Not a file lock list, gather the whole list */
+		lock_index_find_list(list, &overlaps);
+	}
+
+	for (i = 0; i < overlaps.count; i++) {
+		found_entry = overlaps.entries[i];
 
 		if (owner != NULL
 		    && different_owners(found_entry->sle_owner, owner))
@@ -1115,6 +1618,9 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 					     &removed_one);
 		*removed |= removed_one;
 
+		if (removed_one)
+			lock_index_del(found_entry);
+
 		if (status != STATE_SUCCESS) {
 			/* We ran out of memory while splitting,
 			 * deal with it outside loop
@@ -1133,16 +1639,31 @@ static state_status_t subtract_lock_from_list(state_owner_t *owner,
 			found_entry =
 			    glist_entry(glist, state_lock_entry_t, sle_list);
 			glist_del(&found_entry->sle_list);
-			glist_add_tail(list, &(found_entry->sle_list));
+			if (ostate != NULL)
+				lock_list_add(ostate, found_entry);
+			else
+				glist_add_tail(list, &(found_entry->sle_list));
 		}
 	} else {
 		/* free the enttries on the remove_list */
 		free_list(&remove_list);
 
 		/* now add the split lock list */
-		glist_add_list_tail(list, &split_lock_list);
+		if (ostate != NULL) {
+			glist_for_each_safe(glist, glistn, &split_lock_list) {
+				found_entry = glist_entry(glist,
+							  state_lock_entry_t,
+							  sle_list);
+				glist_del(&found_entry->sle_list);
+				lock_list_add(ostate, found_entry);
+			}
+		} else {
+			glist_add_list_tail(list, &split_lock_list);
+		}
 	}
 
+	lock_index_done(&overlaps);
+
 	LogFullDebug(COMPONENT_STATE,
 		     "List of all locks for list=%p returning %d", list,
 		     status);
@@ -1171,7 +1692,7 @@ static state_status_t subtract_list_from_list(struct fsal_obj_handle *obj,
 	glist_for_each_safe(glist, glistn, source) {
 		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
 
-		status = subtract_lock_from_list(NULL, false, 0,
+		status = subtract_lock_from_list(NULL, NULL, false, 0,
 						 &found_entry->sle_lock,
 						 &removed, target);
 		if (status != STATE_SUCCESS)
@@ -1187,7 +1708,7 @@ static state_status_t subtract_list_from_list(struct fsal_obj_handle *obj,
  *
  ******************************************************************************/
 
-static void grant_blocked_locks(struct state_hdl *);
+static void grant_blocked_locks(struct state_hdl *, fsal_lock_param_t *);
 
 /**
  * @brief Display lock cookie in hash table
@@ -1693,6 +2214,11 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 	/* Mark lock as granted */
 	lock_entry->sle_blocked = STATE_NON_BLOCKING;
 
+#ifdef USE_LTTNG
+	tracepoint(state, lock_granted, __func__, __LINE__,
+		   lock_entry->sle_obj, lock_entry);
+#endif
+
 	/* Merge any touching or overlapping locks into this one. */
 	LogEntry("Granted immediate, merging locks for", lock_entry);
 
@@ -1700,7 +2226,7 @@ void grant_blocked_lock_immediate(struct state_hdl *ostate,
 	LogEntry("Immediate Granted entry", lock_entry);
 
 	/* A lock downgrade could unblock blocked locks */
-	grant_blocked_locks(ostate);
+	grant_blocked_locks(ostate, &lock_entry->sle_lock);
 }
 
 /**
@@ -1732,6 +2258,11 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 		/* Mark lock as granted */
 		lock_entry->sle_blocked = STATE_NON_BLOCKING;
 
+#ifdef USE_LTTNG
+		tracepoint(state, lock_granted, __func__, __LINE__, obj,
+			   lock_entry);
+#endif
+
 		/* Merge any touching or overlapping locks into this one. */
 		LogEntry("Granted, merging locks for", lock_entry);
 		merge_lock_entry(obj->state_hdl, lock_entry);
@@ -1739,7 +2270,7 @@ void state_complete_grant(state_cookie_entry_t *cookie_entry)
 		LogEntry("Granted entry", lock_entry);
 
 		/* A lock downgrade could unblock blocked locks */
-		grant_blocked_locks(obj->state_hdl);
+		grant_blocked_locks(obj->state_hdl, &lock_entry->sle_lock);
 	}
 
 	/* Free cookie and unblock lock.
@@ -1814,11 +2345,7 @@ void try_to_grant_lock(state_lock_entry_t *lock_entry)
 		/* At this point, we no longer need the entry on the
 		 * blocked lock list.
 		 */
-		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
-
-		glist_del(&lock_entry->sle_block_data->sbd_list);
-
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+		blocked_lock_remove(lock_entry);
 
 		if (status == STATE_SUCCESS)
 			return;
@@ -1854,16 +2381,26 @@ void process_blocked_lock_upcall(state_block_data_t *block_data)
 }
 
 /**
- * @brief Attempt to grant all blocked locks on a file
+ * @brief Attempt to grant the blocked locks waiting on a range of a file
+ *
+ * Only a blocked lock overlapping the range that was released or
+ * downgraded can have stopped conflicting, so only those are tried.
+ * Locks blocked by something outside Ganesha are left to the blocked
+ * lock poller.
+ *
+ * @note The state_lock MUST be held for write
  *
  * @param[in] ostate File state
+ * @param[in] lock   Range that became available, NULL for the whole file
  */
 
-static void grant_blocked_locks(struct state_hdl *ostate)
+static void grant_blocked_locks(struct state_hdl *ostate,
+				fsal_lock_param_t *lock)
 {
 	state_lock_entry_t *found_entry;
-	struct glist_head *glist, *glistn;
+	struct lock_index_result waiters;
 	struct fsal_export *export = op_ctx->ctx_export->fsal_export;
+	size_t i, n = 0;
 
 	if (!ostate)
 		return;
@@ -1874,23 +2411,43 @@ static void grant_blocked_locks(struct state_hdl *ostate)
 	if (export->exp_ops.fs_supports(export, fso_lock_support_async_block))
 		return;
 
-	glist_for_each_safe(glist, glistn, &ostate->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
+	lock_index_find(ostate,
+			lock != NULL ? lock->lock_start : 0,
+			lock != NULL ? lock_end(lock) : UINT64_MAX,
+			&waiters);
+
+	/* Keep just the waiters, and hold them while granting since a
+	 * grant can merge away other entries of the list.
+	 */
+	for (i = 0; i < waiters.count; i++) {
+		found_entry = waiters.entries[i];
 
 		if (found_entry->sle_blocked != STATE_NLM_BLOCKING
 		    && found_entry->sle_blocked != STATE_NFSV4_BLOCKING)
 			continue;
 
-		/* Found a blocked entry for this file,
-		 * see if we can place the lock.
+		lock_entry_inc_ref(found_entry);
+		waiters.entries[n++] = found_entry;
+	}
+
+	for (i = 0; i < n; i++) {
+		found_entry = waiters.entries[i];
+
+		/* Found a blocked entry for this file, see if it is still
+		 * waiting and if we can place the lock.
 		 */
-		if (get_overlapping_entry(ostate, found_entry->sle_owner,
-					  &found_entry->sle_lock) != NULL)
-			continue;
+		if ((found_entry->sle_blocked == STATE_NLM_BLOCKING
+		     || found_entry->sle_blocked == STATE_NFSV4_BLOCKING)
+		    && get_overlapping_entry(ostate, found_entry->sle_owner,
+					     &found_entry->sle_lock) == NULL) {
+			/* Found an entry that might work, try to grant it. */
+			try_to_grant_lock(found_entry);
+		}
 
-		/* Found an entry that might work, try to grant it. */
-		try_to_grant_lock(found_entry);
+		lock_entry_dec_ref(found_entry);
 	}
+
+	lock_index_done(&waiters);
 }
 
 /**
@@ -2050,12 +2607,16 @@ state_status_t state_release_grant(state_cookie_entry_t *cookie_entry)
 	state_lock_entry_t *lock_entry;
 	struct fsal_obj_handle *obj;
 	state_status_t status = STATE_SUCCESS;
+	fsal_lock_param_t released;
 
 	lock_entry = cookie_entry->sce_lock_entry;
 	obj = cookie_entry->sce_obj;
 
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
+	/* Freeing the cookie may free lock_entry */
+	released = lock_entry->sle_lock;
+
 	/* We need to make sure lock is only "granted" once...
 	 * It's (remotely) possible that due to latency, we might end up
 	 * processing two GRANTED_RSP calls at the same time.
@@ -2095,7 +2656,7 @@ state_status_t state_release_grant(state_cookie_entry_t *cookie_entry)
 	free_cookie(cookie_entry, true);
 
 	/* Check to see if we can grant any blocked locks. */
-	grant_blocked_locks(obj->state_hdl);
+	grant_blocked_locks(obj->state_hdl, &released);
 
 	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
@@ -2501,6 +3062,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 {
 	bool allow = true, overlap = false;
 	struct glist_head *glist;
+	struct lock_index_result overlaps;
 	state_lock_entry_t *found_entry;
 	uint64_t found_entry_end;
 	uint64_t range_end = lock_end(lock);
@@ -2510,6 +3072,7 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 	state_status_t status = 0;
 	fsal_openflags_t openflags;
 	bool async;
+	size_t i;
 
 	/* If the FSAL doesn't support multiple file descriptors, we must
 	 * use the legacy fsal_open. Otherwise, the FSAL will manage
@@ -2545,37 +3108,53 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 
 	PTHREAD_RWLOCK_wrlock(&obj->state_hdl->state_lock);
 
+	/* Only the locks overlapping the request can matter below */
+	lock_index_find(obj->state_hdl, lock->lock_start, range_end,
+			&overlaps);
+
+	/* Need to reject lock request if this lock owner already has a lock
+	 * on this file via a different export.  That takes a lock through
+	 * another export being on the list, so the list only needs walking
+	 * when one is.
+	 */
+	if (obj->state_hdl->file.lock_exports_mixed ||
+	    (obj->state_hdl->file.lock_export != NULL &&
+	     obj->state_hdl->file.lock_export != op_ctx->ctx_export)) {
+		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
+			found_entry =
+			    glist_entry(glist, state_lock_entry_t, sle_list);
+
+			if (found_entry->sle_export == op_ctx->ctx_export
+			    || different_owners(found_entry->sle_owner, owner))
+				continue;
+
+			LogEvent(COMPONENT_STATE,
+				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
+				 found_entry->sle_export->export_id,
+				 found_entry->sle_export->fullpath,
+				 op_ctx->ctx_export->export_id,
+				 op_ctx->ctx_export->fullpath);
+
+			LogEntry("Found lock entry belonging to another export",
+				 found_entry);
+
+			status = STATE_INVALID_ARGUMENT;
+			goto out_unlock;
+		}
+	}
+
 	if (blocking != STATE_NON_BLOCKING) {
 		/* First search for a blocked request. Client can ignore the
 		 * blocked request and keep sending us new lock request again
 		 * and again. So if we have a mapping blocked request return
 		 * that
 		 */
-		glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-			found_entry =
-			    glist_entry(glist, state_lock_entry_t, sle_list);
+		for (i = 0; i < overlaps.count; i++) {
+			found_entry = overlaps.entries[i];
 
 			if (different_owners(found_entry->sle_owner, owner))
 				continue;
 
-			/* Need to reject lock request if this lock owner
-			 * already has a lock on this file via a different
-			 * export.
-			 */
-			if (found_entry->sle_export != op_ctx->ctx_export) {
-				LogEvent(COMPONENT_STATE,
-					 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-					 found_entry->sle_export->export_id,
-					 found_entry->sle_export->fullpath,
-					 op_ctx->ctx_export->export_id,
-					 op_ctx->ctx_export->fullpath);
-				LogEntry(
-					"Found lock entry belonging to another export",
-					found_entry);
-				status = STATE_INVALID_ARGUMENT;
-				goto out_unlock;
-			}
-
 			if (found_entry->sle_blocked != blocking)
 				continue;
 
@@ -2592,26 +3171,8 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		}
 	}
 
-	glist_for_each(glist, &obj->state_hdl->file.lock_list) {
-		found_entry = glist_entry(glist, state_lock_entry_t, sle_list);
-		/* Need to reject lock request if this lock owner already has
-		 * a lock on this file via a different export.
-		 */
-		if (found_entry->sle_export != op_ctx->ctx_export
-		    && !different_owners(found_entry->sle_owner, owner)) {
-			LogEvent(COMPONENT_STATE,
-				 "Lock Owner Export Conflict, Lock held for export %d (%s), request for export %d (%s)",
-				 found_entry->sle_export->export_id,
-				 found_entry->sle_export->fullpath,
-				 op_ctx->ctx_export->export_id,
-				 op_ctx->ctx_export->fullpath);
-
-			LogEntry("Found lock entry belonging to another export",
-				 found_entry);
-
-			status = STATE_INVALID_ARGUMENT;
-			goto out_unlock;
-		}
+	for (i = 0; i < overlaps.count; i++) {
+		found_entry = overlaps.entries[i];
 
 		/* Don't skip blocked locks for fairness */
 		found_entry_end = lock_end(&found_entry->sle_lock);
@@ -2801,11 +3362,10 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("New lock", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
+		lock_list_add(obj->state_hdl, found_entry);
 
 		/* A lock downgrade could unblock blocked locks */
-		grant_blocked_locks(obj->state_hdl);
+		grant_blocked_locks(obj->state_hdl, &found_entry->sle_lock);
 	} else if (status == STATE_LOCK_CONFLICT) {
 		LogEntry("Conflict in FSAL for", found_entry);
 
@@ -2834,14 +3394,14 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 		/* Insert entry into lock list */
 		LogEntry("FSAL block for", found_entry);
 
-		glist_add_tail(&obj->state_hdl->file.lock_list,
-			       &found_entry->sle_list);
-
-		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+#ifdef USE_LTTNG
+		tracepoint(state, lock_blocked, __func__, __LINE__, obj,
+			   found_entry);
+#endif
 
-		glist_add_tail(&state_blocked_locks, &block_data->sbd_list);
+		lock_list_add(obj->state_hdl, found_entry);
 
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+		blocked_lock_insert(block_data);
 	} else {
 		LogMajor(COMPONENT_STATE, "Unable to lock FSAL, error=%s",
 			 state_err_str(status));
@@ -2851,6 +3411,8 @@ state_status_t state_lock(struct fsal_obj_handle *obj,
 	}
 
  out_unlock:
+	lock_index_done(&overlaps);
+
 	PTHREAD_RWLOCK_unlock(&obj->state_hdl->state_lock);
 
 	return status;
@@ -2908,8 +3470,8 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 				   nsm_state, lock);
 
 	/* Release the lock from cache inode lock list for entry */
-	status = subtract_lock_from_list(owner, state_applies, nsm_state, lock,
-					 &removed,
+	status = subtract_lock_from_list(obj->state_hdl, owner, state_applies,
+					 nsm_state, lock, &removed,
 					 &obj->state_hdl->file.lock_list);
 
 	/* If the lock list has become zero; decrement the pin ref count pt
@@ -2958,7 +3520,8 @@ state_status_t state_unlock(struct fsal_obj_handle *obj,
 		empty =
 		    LogList("Lock List", obj, &obj->state_hdl->file.lock_list);
 
-	grant_blocked_locks(obj->state_hdl);
+	/* Wake the waiters on the unlocked range */
+	grant_blocked_locks(obj->state_hdl, lock);
 
 
 	if (isFullDebug(COMPONENT_STATE) && isFullDebug(COMPONENT_MEMLEAKS)
@@ -3020,7 +3583,7 @@ state_status_t state_cancel(struct fsal_obj_handle *obj,
 		cancel_blocked_lock(obj, found_entry);
 
 		/* Check to see if we can grant any blocked locks. */
-		grant_blocked_locks(obj->state_hdl);
+		grant_blocked_locks(obj->state_hdl, lock);
 
 		break;
 	}
@@ -3524,6 +4087,9 @@ void state_export_unlock_all(void)
 		dec_state_owner_ref(owner);
 		obj->obj_ops.put_ref(obj);
 
+		unexport_progress(op_ctx->ctx_export,
+				  &op_ctx->ctx_export->unexport_state);
+
 		if (!state_unlock_err_ok(status)) {
 			/* Increment the error count and try the next lock,
 			 * with any luck the memory pressure which is causing
@@ -3542,27 +4108,26 @@ void state_export_unlock_all(void)
 }
 
 /**
- * @brief Poll any blocked locks of type STATE_BLOCK_POLL
- *
- * @param[in] ctx Fridge Thread Context
+ * @brief Poll the blocked locks of type STATE_BLOCK_POLL in a partition
  *
+ * @param[in] part Partition to poll
  */
-
-void blocked_lock_polling(struct fridgethr_context *ctx)
+static void blocked_lock_poll_part(struct blocked_locks_partition *part)
 {
 	state_lock_entry_t *found_entry;
 	struct glist_head *glist;
 	state_block_data_t *pblock;
 
-	SetNameFunction("lk_poll");
+	/* Most partitions have nothing to poll, don't bother locking */
+	if (atomic_fetch_uint32_t(&part->poll_count) == 0)
+		return;
 
-	PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+	PTHREAD_MUTEX_lock(&part->mtx);
 
 	if (isFullDebug(COMPONENT_STATE) && isFullDebug(COMPONENT_MEMLEAKS))
-		LogBlockedList("Blocked Lock List",
-			       NULL, &state_blocked_locks);
+		LogBlockedList("Blocked Lock List", NULL, &part->list);
 
-	glist_for_each(glist, &state_blocked_locks) {
+	glist_for_each(glist, &part->list) {
 		pblock = glist_entry(glist, state_block_data_t, sbd_list);
 
 		found_entry = pblock->sbd_lock_entry;
@@ -3588,7 +4153,24 @@ void blocked_lock_polling(struct fridgethr_context *ctx)
 		LogEntry("Blocked Lock found", found_entry);
 	}			/* glist_for_each_safe */
 
-	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
+
+/**
+ * @brief Poll any blocked locks of type STATE_BLOCK_POLL
+ *
+ * @param[in] ctx Fridge Thread Context
+ *
+ */
+
+void blocked_lock_polling(struct fridgethr_context *ctx)
+{
+	int i;
+
+	SetNameFunction("lk_poll");
+
+	for (i = 0; i < BLOCKED_LOCK_PARTITIONS; i++)
+		blocked_lock_poll_part(&state_blocked_locks[i]);
 }
 
 /**
@@ -3606,10 +4188,11 @@ static void find_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 	state_lock_entry_t *found_entry;
 	struct glist_head *glist;
 	state_block_data_t *pblock;
+	struct blocked_locks_partition *part = blocked_locks_part(obj);
 
-	PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+	PTHREAD_MUTEX_lock(&part->mtx);
 
-	glist_for_each(glist, &state_blocked_locks) {
+	glist_for_each(glist, &part->list) {
 		pblock = glist_entry(glist, state_block_data_t, sbd_list);
 
 		found_entry = pblock->sbd_lock_entry;
@@ -3643,16 +4226,15 @@ static void find_blocked_lock_upcall(struct fsal_obj_handle *obj, void *owner,
 
 		LogEntry("Blocked Lock found", found_entry);
 
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+		PTHREAD_MUTEX_unlock(&part->mtx);
 
 		return;
 	}			/* glist_for_each_safe */
 
 	if (isFullDebug(COMPONENT_STATE) && isFullDebug(COMPONENT_MEMLEAKS))
-		LogBlockedList("Blocked Lock List",
-			       NULL, &state_blocked_locks);
+		LogBlockedList("Blocked Lock List", NULL, &part->list);
 
-	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+	PTHREAD_MUTEX_unlock(&part->mtx);
 
 	/* We must be out of sync with FSAL, this is fatal */
 	LogLockDesc(COMPONENT_STATE, NIV_MAJ, "Blocked Lock Not Found for",
@@ -3708,43 +4290,39 @@ bool state_lock_wipe(struct state_hdl *hstate)
 	return true;
 }
 
-void cancel_all_nlm_blocked(void)
+/**
+ * @brief Cancel all the blocked locks in a partition
+ *
+ * @param[in]     part            Partition to cancel
+ * @param[in,out] root_op_context Context to cancel under
+ */
+static void cancel_blocked_part(struct blocked_locks_partition *part,
+				struct root_op_context *root_op_context)
 {
 	state_lock_entry_t *found_entry;
 	state_block_data_t *pblock;
-	struct root_op_context root_op_context;
-
-	/* Initialize context */
-	init_root_op_context(&root_op_context, NULL, NULL, 0, 0, NFS_REQUEST);
 
-	LogDebug(COMPONENT_STATE, "Cancel all blocked locks");
-
-	PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+	PTHREAD_MUTEX_lock(&part->mtx);
 
-	pblock = glist_first_entry(&state_blocked_locks,
+	pblock = glist_first_entry(&part->list,
 				   state_block_data_t,
 				   sbd_list);
 
-	if (pblock == NULL) {
-		LogFullDebug(COMPONENT_STATE, "No blocked locks");
-		goto out;
-	}
-
 	while (pblock != NULL) {
 		found_entry = pblock->sbd_lock_entry;
 
 		/* Remove lock from blocked list */
-		glist_del(&pblock->sbd_list);
+		blocked_lock_unlink(part, pblock);
 
 		lock_entry_inc_ref(found_entry);
 
-		PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
+		PTHREAD_MUTEX_unlock(&part->mtx);
 
-		root_op_context.req_ctx.ctx_export = found_entry->sle_export;
-		root_op_context.req_ctx.fsal_export =
-			root_op_context.req_ctx.ctx_export->fsal_export;
+		root_op_context->req_ctx.ctx_export = found_entry->sle_export;
+		root_op_context->req_ctx.fsal_export =
+			root_op_context->req_ctx.ctx_export->fsal_export;
 
-		get_gsh_export_ref(root_op_context.req_ctx.ctx_export);
+		get_gsh_export_ref(root_op_context->req_ctx.ctx_export);
 
 		/** @todo also look at the LRU ref for pentry */
 
@@ -3760,21 +4338,34 @@ void cancel_all_nlm_blocked(void)
 
 		LogEntry("Canceled Lock", found_entry);
 
-		put_gsh_export(root_op_context.req_ctx.ctx_export);
+		put_gsh_export(root_op_context->req_ctx.ctx_export);
 
 		lock_entry_dec_ref(found_entry);
 
-		PTHREAD_MUTEX_lock(&blocked_locks_mutex);
+		PTHREAD_MUTEX_lock(&part->mtx);
 
 		/* Get next item off list */
-		pblock = glist_first_entry(&state_blocked_locks,
+		pblock = glist_first_entry(&part->list,
 					   state_block_data_t,
 					   sbd_list);
 	}
 
-out:
+	PTHREAD_MUTEX_unlock(&part->mtx);
+}
+
+void cancel_all_nlm_blocked(void)
+{
+	struct root_op_context root_op_context;
+	int i;
+
+	/* Initialize context */
+	init_root_op_context(&root_op_context, NULL, NULL, 0, 0, NFS_REQUEST);
+
+	LogDebug(COMPONENT_STATE, "Cancel all blocked locks");
+
+	for (i = 0; i < BLOCKED_LOCK_PARTITIONS; i++)
+		cancel_blocked_part(&state_blocked_locks[i], &root_op_context);
 
-	PTHREAD_MUTEX_unlock(&blocked_locks_mutex);
 	release_root_op_context();
 }
 
@@ -0,0 +1,392 @@
+/*
+ * btree - Implements a B+tree on 64 bit keys, with intrusive nodes.
+ *
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This file is part of libtree which is free software; you can
+ * redistribute it and/or modify it under the terms of the GNU Lesser
+ * General Public License as published by the Free Software
+ * Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the LICENSE file for license rights and limitations.
+ */
+
+/*
+ * The nodes live in the leaves, the inner pages hold separators: the
+ * keys under child[i] are at least key[i - 1] and less than key[i].
+ * Insertion splits full pages and removal refills pages at the minimum
+ * on the way down, so neither goes back up the tree.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avltree.h"
+
+#define BTREE_KEYS 15
+#define BTREE_MIN (BTREE_KEYS / 2)
+#define BTREE_ALIGN 64
+
+struct btree_page {
+	uint32_t n;		/* keys in use */
+	uint32_t leaf;
+	uint64_t key[BTREE_KEYS];
+	union {
+		struct btree_page *child[BTREE_KEYS + 1];
+		struct btree_node *node[BTREE_KEYS];
+	};
+};
+
+static struct btree_page *new_page(int leaf)
+{
+	void *page;
+
+	if (posix_memalign(&page, BTREE_ALIGN, sizeof(struct btree_page)))
+		abort();
+
+	memset(page, 0, sizeof(struct btree_page));
+	((struct btree_page *)page)->leaf = leaf;
+	return page;
+}
+
+/* Keys of the page less than or equal to key */
+static inline unsigned int rank_le(const struct btree_page *p, uint64_t key)
+{
+	unsigned int i = 0;
+
+	while (i < p->n && p->key[i] <= key)
+		i++;
+	return i;
+}
+
+/* Keys of the page less than key */
+static inline unsigned int rank_lt(const struct btree_page *p, uint64_t key)
+{
+	unsigned int i = 0;
+
+	while (i < p->n && p->key[i] < key)
+		i++;
+	return i;
+}
+
+static inline void shift_keys(struct btree_page *p, unsigned int to,
+			      unsigned int from, unsigned int n)
+{
+	memmove(&p->key[to], &p->key[from], n * sizeof(p->key[0]));
+}
+
+static inline void shift_nodes(struct btree_page *p, unsigned int to,
+			       unsigned int from, unsigned int n)
+{
+	memmove(&p->node[to], &p->node[from], n * sizeof(p->node[0]));
+}
+
+static inline void shift_children(struct btree_page *p, unsigned int to,
+				  unsigned int from, unsigned int n)
+{
+	memmove(&p->child[to], &p->child[from], n * sizeof(p->child[0]));
+}
+
+/* Split the full child i of parent, which is not full */
+static void split_child(struct btree_page *parent, unsigned int i)
+{
+	struct btree_page *c = parent->child[i];
+	struct btree_page *r = new_page(c->leaf);
+	uint64_t sep;
+
+	if (c->leaf) {
+		unsigned int keep = (BTREE_KEYS + 1) / 2;
+
+		r->n = BTREE_KEYS - keep;
+		memcpy(r->key, &c->key[keep], r->n * sizeof(r->key[0]));
+		memcpy(r->node, &c->node[keep], r->n * sizeof(r->node[0]));
+		c->n = keep;
+		sep = r->key[0];
+	} else {
+		unsigned int keep = BTREE_KEYS / 2;
+
+		r->n = BTREE_KEYS - keep - 1;
+		memcpy(r->key, &c->key[keep + 1], r->n * sizeof(r->key[0]));
+		memcpy(r->child, &c->child[keep + 1],
+		       (r->n + 1) * sizeof(r->child[0]));
+		c->n = keep;
+		sep = c->key[keep];
+	}
+
+	shift_keys(parent, i + 1, i, parent->n - i);
+	shift_children(parent, i + 2, i + 1, parent->n - i);
+	parent->key[i] = sep;
+	parent->child[i + 1] = r;
+	parent->n++;
+}
+
+static void borrow_left(struct btree_page *p, unsigned int i)
+{
+	struct btree_page *c = p->child[i];
+	struct btree_page *l = p->child[i - 1];
+
+	shift_keys(c, 1, 0, c->n);
+	if (c->leaf) {
+		shift_nodes(c, 1, 0, c->n);
+		c->key[0] = l->key[l->n - 1];
+		c->node[0] = l->node[l->n - 1];
+		p->key[i - 1] = c->key[0];
+	} else {
+		shift_children(c, 1, 0, c->n + 1);
+		c->key[0] = p->key[i - 1];
+		c->child[0] = l->child[l->n];
+		p->key[i - 1] = l->key[l->n - 1];
+	}
+	l->n--;
+	c->n++;
+}
+
+static void borrow_right(struct btree_page *p, unsigned int i)
+{
+	struct btree_page *c = p->child[i];
+	struct btree_page *r = p->child[i + 1];
+
+	if (c->leaf) {
+		c->key[c->n] = r->key[0];
+		c->node[c->n] = r->node[0];
+		shift_nodes(r, 0, 1, r->n - 1);
+	} else {
+		c->key[c->n] = p->key[i];
+		c->child[c->n + 1] = r->child[0];
+		shift_children(r, 0, 1, r->n);
+	}
+	c->n++;
+	p->key[i] = c->leaf ? r->key[1] : r->key[0];
+	shift_keys(r, 0, 1, r->n - 1);
+	r->n--;
+}
+
+/* Merge child i + 1 of p into child i, both at the minimum */
+static void merge(struct btree_page *p, unsigned int i)
+{
+	struct btree_page *l = p->child[i];
+	struct btree_page *r = p->child[i + 1];
+
+	if (l->leaf) {
+		memcpy(&l->key[l->n], r->key, r->n * sizeof(r->key[0]));
+		memcpy(&l->node[l->n], r->node, r->n * sizeof(r->node[0]));
+		l->n += r->n;
+	} else {
+		l->key[l->n] = p->key[i];
+		memcpy(&l->key[l->n + 1], r->key, r->n * sizeof(r->key[0]));
+		memcpy(&l->child[l->n + 1], r->child,
+		       (r->n + 1) * sizeof(r->child[0]));
+		l->n += r->n + 1;
+	}
+	free(r);
+
+	shift_keys(p, i, i + 1, p->n - i - 1);
+	shift_children(p, i + 1, i + 2, p->n - i - 1);
+	p->n--;
+}
+
+/* Get child i of p above the minimum, return where its keys now are */
+static unsigned int fill_child(struct btree_page *p, unsigned int i)
+{
+	if (i > 0 && p->child[i - 1]->n > BTREE_MIN) {
+		borrow_left(p, i);
+		return i;
+	}
+	if (i < p->n && p->child[i + 1]->n > BTREE_MIN) {
+		borrow_right(p, i);
+		return i;
+	}
+	if (i < p->n) {
+		merge(p, i);
+		return i;
+	}
+	merge(p, i - 1);
+	return i - 1;
+}
+
+struct btree_node *btree_first(const struct btree *tree)
+{
+	struct btree_page *p = tree->root;
+	int h;
+
+	if (p == NULL)
+		return NULL;
+
+	for (h = tree->height; h > 1; h--)
+		p = p->child[0];
+	return p->node[0];
+}
+
+/*
+ * O(log n), from the root: remembers the subtree right of the path
+ * to fall back on when the leaf has no key past node's.
+ */
+struct btree_node *btree_next(const struct btree_node *node,
+			      const struct btree *tree)
+{
+	struct btree_page *p = tree->root, *alt = NULL;
+	uint64_t key = node->key;
+	unsigned int i;
+	int h, alt_h = 0;
+
+	if (p == NULL)
+		return NULL;
+
+	for (h = tree->height; h > 1; h--) {
+		i = rank_le(p, key);
+		if (i < p->n) {
+			alt = p->child[i + 1];
+			alt_h = h - 1;
+		}
+		p = p->child[i];
+	}
+
+	i = rank_le(p, key);
+	if (i < p->n)
+		return p->node[i];
+	if (alt == NULL)
+		return NULL;
+
+	for (; alt_h > 1; alt_h--)
+		alt = alt->child[0];
+	return alt->node[0];
+}
+
+uint64_t btree_size(const struct btree *tree)
+{
+	return tree->size;
+}
+
+struct btree_node *btree_lookup(uint64_t key, const struct btree *tree)
+{
+	const struct btree_page *p = tree->root;
+	unsigned int i;
+	int h;
+
+	if (p == NULL)
+		return NULL;
+
+	for (h = tree->height; h > 1; h--)
+		p = p->child[rank_le(p, key)];
+
+	i = rank_lt(p, key);
+	return i < p->n && p->key[i] == key ? p->node[i] : NULL;
+}
+
+/*
+ * Returns the node already in the tree with the same key, if any,
+ * and does not insert then.
+ */
+struct btree_node *btree_insert(struct btree_node *node, struct btree *tree)
+{
+	uint64_t key = node->key;
+	struct btree_page *p;
+	unsigned int i;
+	int h;
+
+	if (tree->root == NULL) {
+		tree->root = new_page(1);
+		tree->height = 1;
+	} else if (tree->root->n == BTREE_KEYS) {
+		p = new_page(0);
+		p->child[0] = tree->root;
+		split_child(p, 0);
+		tree->root = p;
+		tree->height++;
+	}
+
+	p = tree->root;
+	for (h = tree->height; h > 1; h--) {
+		i = rank_le(p, key);
+		if (p->child[i]->n == BTREE_KEYS) {
+			split_child(p, i);
+			if (key >= p->key[i])
+				i++;
+		}
+		p = p->child[i];
+	}
+
+	i = rank_lt(p, key);
+	if (i < p->n && p->key[i] == key)
+		return p->node[i];
+
+	shift_keys(p, i + 1, i, p->n - i);
+	shift_nodes(p, i + 1, i, p->n - i);
+	p->key[i] = key;
+	p->node[i] = node;
+	p->n++;
+	tree->size++;
+	return NULL;
+}
+
+void btree_remove(struct btree_node *node, struct btree *tree)
+{
+	uint64_t key = node->key;
+	struct btree_page *p = tree->root, *c;
+	unsigned int i;
+	int h;
+
+	if (p == NULL)
+		return;
+
+	for (h = tree->height; h > 1; h--) {
+		i = rank_le(p, key);
+		if (p->child[i]->n == BTREE_MIN)
+			i = fill_child(p, i);
+		c = p->child[i];
+		if (p == tree->root && p->n == 0) {
+			/* Merged its last two children */
+			tree->root = c;
+			tree->height--;
+			free(p);
+		}
+		p = c;
+	}
+
+	i = rank_lt(p, key);
+	if (i == p->n || p->key[i] != key)
+		return;
+
+	assert(p->node[i] == node);
+	shift_keys(p, i, i + 1, p->n - i - 1);
+	shift_nodes(p, i, i + 1, p->n - i - 1);
+	p->n--;
+	tree->size--;
+
+	if (p->n == 0) {
+		/* Only the root leaf gets empty */
+		free(p);
+		tree->root = NULL;
+		tree->height = 0;
+	}
+}
+
+void btree_init(struct btree *tree)
+{
+	tree->root = NULL;
+	tree->height = 0;
+	tree->size = 0;
+}
+
+static void free_pages(struct btree_page *p, int h)
+{
+	unsigned int i;
+
+	if (h > 1)
+		for (i = 0; i <= p->n; i++)
+			free_pages(p->child[i], h - 1);
+	free(p);
+}
+
+/* Frees the pages, not the nodes */
+void btree_destroy(struct btree *tree)
+{
+	if (tree->root != NULL)
+		free_pages(tree->root, tree->height);
+	btree_init(tree);
+}
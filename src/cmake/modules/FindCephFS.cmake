@@ -77,6 +77,27 @@ else (NOT CEPH_FS)
   else(NOT CEPH_FS_LOOKUP_ROOT)
     set(USE_FSAL_CEPH_LL_LOOKUP_ROOT ON)
   endif(NOT CEPH_FS_LOOKUP_ROOT)
+  check_library_exists(cephfs ceph_ll_nonblocking_readv_writev ${CEPHFS_LIBRARY_DIR} CEPH_FS_NONBLOCKING_RW)
+  if(NOT CEPH_FS_NONBLOCKING_RW)
+    message("Cannot find ceph_ll_nonblocking_readv_writev.  Disabling CEPH fsal asynchronous I/O")
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_RW OFF)
+  else(NOT CEPH_FS_NONBLOCKING_RW)
+    set(USE_FSAL_CEPH_LL_NONBLOCKING_RW ON)
+  endif(NOT CEPH_FS_NONBLOCKING_RW)
+  check_library_exists(cephfs ceph_ll_lookup_inode ${CEPHFS_LIBRARY_DIR} CEPH_FS_LOOKUP_INODE)
+  if(NOT CEPH_FS_LOOKUP_INODE)
+    message("Cannot find ceph_ll_lookup_inode.  Disabling CEPH fsal multiple mounts per export")
+    set(USE_FSAL_CEPH_LL_LOOKUP_INODE OFF)
+  else(NOT CEPH_FS_LOOKUP_INODE)
+    set(USE_FSAL_CEPH_LL_LOOKUP_INODE ON)
+  endif(NOT CEPH_FS_LOOKUP_INODE)
+  check_library_exists(cephfs ceph_ll_register_callbacks ${CEPHFS_LIBRARY_DIR} CEPH_FS_CALLBACKS)
+  if(NOT CEPH_FS_CALLBACKS)
+    message("Cannot find ceph_ll_register_callbacks.  Disabling CEPH fsal cap recall upcalls")
+    set(USE_FSAL_CEPH_LL_CALLBACKS OFF)
+  else(NOT CEPH_FS_CALLBACKS)
+    set(USE_FSAL_CEPH_LL_CALLBACKS ON)
+  endif(NOT CEPH_FS_CALLBACKS)
   set(CMAKE_REQUIRED_INCLUDES ${CEPHFS_INCLUDE_DIR})
   check_symbol_exists(CEPH_STATX_INO "cephfs/libcephfs.h" CEPH_FS_CEPH_STATX)
   if(NOT CEPH_FS_CEPH_STATX)
@@ -102,4 +123,7 @@ mark_as_advanced(CEPHFS_LIBRARY_DIR)
 mark_as_advanced(USE_FSAL_CEPH_MKNOD)
 mark_as_advanced(USE_FSAL_CEPH_SETLK)
 mark_as_advanced(USE_FSAL_CEPH_LL_LOOKUP_ROOT)
+mark_as_advanced(USE_FSAL_CEPH_LL_NONBLOCKING_RW)
+mark_as_advanced(USE_FSAL_CEPH_LL_CALLBACKS)
+mark_as_advanced(USE_FSAL_CEPH_LL_LOOKUP_INODE)
 mark_as_advanced(USE_FSAL_CEPH_STATX)
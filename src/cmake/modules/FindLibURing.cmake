@@ -0,0 +1,29 @@
+# - Find liburing
+# Find the io_uring userspace library and headers
+# This module defines
+#  LIBURING_INCLUDE_DIR, where to find liburing.h
+#  LIBURING_LIBRARIES, libraries to link against to use liburing.
+#  LIBURING_FOUND, If false, do not try to use liburing.
+#
+# Set LIBURING_PREFIX on the command line if liburing is not installed
+# in a standard place.
+
+find_path(LIBURING_INCLUDE_DIR
+  NAMES liburing.h
+  HINTS ${LIBURING_PREFIX}/include
+  )
+
+find_library(LIBURING_LIBRARY
+  NAMES uring
+  HINTS ${LIBURING_PREFIX}/lib64 ${LIBURING_PREFIX}/lib
+  )
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LibURing DEFAULT_MSG
+  LIBURING_LIBRARY LIBURING_INCLUDE_DIR)
+
+if(LIBURING_FOUND)
+  set(LIBURING_LIBRARIES ${LIBURING_LIBRARY})
+endif(LIBURING_FOUND)
+
+mark_as_advanced(LIBURING_INCLUDE_DIR LIBURING_LIBRARY)
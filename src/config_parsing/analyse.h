@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include "gsh_list.h"
 
 /**
@@ -67,12 +68,15 @@ struct config_node {
 
 /*
  * File list
- * Every config_node points to a pathname in this list
+ * Every config_node points to a pathname in this list.
+ * st, as the file was when opened, tells whether a cached
+ * parse is still current.
  */
 
 struct file_list {
 	struct file_list *next;
 	char *pathname;
+	struct stat st;
 };
 
 /*
@@ -97,12 +101,15 @@ struct token_tab {
  */
 
 struct bufstack;  /* defined in conf_lex.l */
+struct config_index;  /* defined in config_parsing.c */
 
 struct config_root {
 	struct config_node root;
 	char *conf_dir;
 	struct file_list *files;
 	struct token_tab *tokens;
+	struct config_index *index;	/* top level blocks by name */
+	bool reusable;		/* parsed clean, may be cached when freed */
 };
 
 /*
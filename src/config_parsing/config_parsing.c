@@ -31,12 +31,191 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <pthread.h>
 #include "config_parsing.h"
 #include "analyse.h"
 #include "abstract_mem.h"
 #include "conf_yacc.h"
 #include "log.h"
 #include "fsal_convert.h"
+#include "common_utils.h"
+
+/**
+ * @brief Index of the top level blocks of a parse tree
+ *
+ * Built on the first lookup by block name, in one pass over the
+ * tree, so each of the block processors run on the tree does not
+ * walk all the other blocks.  A name keeps its blocks in file order.
+ */
+
+#define CONFIG_INDEX_SIZE 251
+
+struct config_index_entry {
+	struct config_index_entry *next;
+	const char *name;
+	struct config_node **nodes;
+	unsigned int count;
+	unsigned int size;
+};
+
+struct config_index {
+	struct config_index_entry *buckets[CONFIG_INDEX_SIZE];
+};
+
+/**
+ * @brief The last clean parse tree freed
+ *
+ * config_ParseFile hands it out again while none of its files have
+ * changed, so a reload or a series of AddExport calls on the same
+ * files parse them once.  A tree is only used by one caller at a time.
+ */
+
+static pthread_mutex_t config_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct config_root *config_cache;
+
+static unsigned int config_name_hash(const char *name)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	while (*name != '\0') {
+		hash ^= (unsigned char)tolower((unsigned char)*name++);
+		hash *= 1099511628211ULL;
+	}
+	return hash % CONFIG_INDEX_SIZE;
+}
+
+static void config_index_build(struct config_root *tree)
+{
+	struct config_index *index;
+	struct config_index_entry *entry;
+	struct config_node *node;
+	struct glist_head *ns;
+	unsigned int h;
+
+	index = gsh_calloc(1, sizeof(struct config_index));
+	glist_for_each(ns, &tree->root.u.nterm.sub_nodes) {
+		node = glist_entry(ns, struct config_node, node);
+		if (node->type != TYPE_BLOCK)
+			continue;
+		h = config_name_hash(node->u.nterm.name);
+		for (entry = index->buckets[h]; entry != NULL;
+		     entry = entry->next)
+			if (strcasecmp(entry->name, node->u.nterm.name) == 0)
+				break;
+		if (entry == NULL) {
+			entry = gsh_calloc(1, sizeof(*entry));
+			entry->name = node->u.nterm.name;
+			entry->next = index->buckets[h];
+			index->buckets[h] = entry;
+		}
+		if (entry->count == entry->size) {
+			entry->size = entry->size == 0 ? 4 : entry->size * 2;
+			entry->nodes = gsh_realloc(entry->nodes,
+						   entry->size *
+						   sizeof(struct config_node *));
+		}
+		entry->nodes[entry->count++] = node;
+	}
+	tree->index = index;
+}
+
+/**
+ * @brief Top level blocks of a name
+ *
+ * @return the index entry, NULL if there are none.
+ */
+
+static struct config_index_entry *config_index_lookup(struct config_root *tree,
+						      const char *name)
+{
+	struct config_index_entry *entry;
+
+	if (tree->index == NULL)
+		config_index_build(tree);
+	for (entry = tree->index->buckets[config_name_hash(name)];
+	     entry != NULL; entry = entry->next)
+		if (strcasecmp(entry->name, name) == 0)
+			return entry;
+	return NULL;
+}
+
+static void config_index_free(struct config_index *index)
+{
+	struct config_index_entry *entry, *next;
+	int i;
+
+	for (i = 0; i < CONFIG_INDEX_SIZE; i++)
+		for (entry = index->buckets[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			gsh_free(entry->nodes);
+			gsh_free(entry);
+		}
+	gsh_free(index);
+}
+
+static void config_free_root(struct config_root *root)
+{
+	if (root->index != NULL)
+		config_index_free(root->index);
+	free_parse_tree(root);
+}
+
+static void config_reset_found(struct config_node *node)
+{
+	struct glist_head *ns;
+
+	node->found = false;
+	if (node->type == TYPE_TERM)
+		return;
+	glist_for_each(ns, &node->u.nterm.sub_nodes)
+		config_reset_found(glist_entry(ns, struct config_node, node));
+}
+
+static bool config_file_changed(struct file_list *file)
+{
+	struct stat st;
+
+	if (stat(file->pathname, &st) != 0)
+		return true;
+	return st.st_dev != file->st.st_dev ||
+	       st.st_ino != file->st.st_ino ||
+	       st.st_size != file->st.st_size ||
+	       st.st_mtim.tv_sec != file->st.st_mtim.tv_sec ||
+	       st.st_mtim.tv_nsec != file->st.st_mtim.tv_nsec ||
+	       st.st_ctim.tv_sec != file->st.st_ctim.tv_sec ||
+	       st.st_ctim.tv_nsec != file->st.st_ctim.tv_nsec;
+}
+
+/**
+ * @brief Take the cached parse of file_path if it is current
+ */
+
+static struct config_root *config_cache_get(const char *file_path)
+{
+	struct config_root *root;
+	struct file_list *file;
+
+	PTHREAD_MUTEX_lock(&config_cache_lock);
+	root = config_cache;
+	if (root != NULL && strcmp(root->root.filename, file_path) == 0)
+		config_cache = NULL;
+	else
+		root = NULL;
+	PTHREAD_MUTEX_unlock(&config_cache_lock);
+	if (root == NULL)
+		return NULL;
+
+	for (file = root->files; file != NULL; file = file->next)
+		if (config_file_changed(file)) {
+			config_free_root(root);
+			return NULL;
+		}
+	config_reset_found(&root->root);
+	LogDebug(COMPONENT_CONFIG,
+		 "Reusing the parse of %s, its files are unchanged",
+		 file_path);
+	return root;
+}
 
 /* config_ParseFile:
  * Reads the content of a configuration file and
@@ -48,8 +227,13 @@ config_file_t config_ParseFile(char *file_path,
 {
 	struct parser_state st;
 	struct config_root *root;
+	uint32_t prev_errs = err_type->errors;
 	int rc;
 
+	root = config_cache_get(file_path);
+	if (root != NULL)
+		return (config_file_t)root;
+
 	memset(&st, 0, sizeof(struct parser_state));
 	st.err_type = err_type;
 	rc = ganeshun_yy_init_parser(file_path, &st);
@@ -67,6 +251,9 @@ config_file_t config_ParseFile(char *file_path,
 	print_parse_tree(stderr, root);
 #endif
 	ganeshun_yy_cleanup_parser(&st);
+	if (rc == 0 && config_error_no_error(err_type) &&
+	    err_type->errors == prev_errs)
+		root->reusable = true;
 	return (config_file_t)root;
 }
 
@@ -87,10 +274,20 @@ void config_Print(FILE * output, config_file_t config)
 
 void config_Free(config_file_t config)
 {
-	if (config != NULL)
-		free_parse_tree((struct config_root *)config);
-	return;
+	struct config_root *root = (struct config_root *)config;
+	struct config_root *old;
 
+	if (root == NULL)
+		return;
+	if (root->reusable) {
+		PTHREAD_MUTEX_lock(&config_cache_lock);
+		old = config_cache;
+		config_cache = root;
+		PTHREAD_MUTEX_unlock(&config_cache_lock);
+		root = old;
+	}
+	if (root != NULL)
+		config_free_root(root);
 }
 
 /**
@@ -1395,6 +1592,61 @@ config_file_t get_parse_root(void *node)
 	return (config_file_t)root;
 }
 
+static uint64_t config_hash_str(uint64_t hash, const char *str)
+{
+	/* FNV-1a, the terminating NUL separates the strings */
+	do {
+		hash ^= (unsigned char)*str;
+		hash *= 1099511628211ULL;
+	} while (*str++ != '\0');
+
+	return hash;
+}
+
+static uint64_t config_hash_node(uint64_t hash, struct config_node *node)
+{
+	struct glist_head *ns;
+
+	hash ^= node->type;
+	hash *= 1099511628211ULL;
+
+	if (node->type == TYPE_TERM) {
+		if (node->u.term.op_code != NULL)
+			hash = config_hash_str(hash, node->u.term.op_code);
+		if (node->u.term.varvalue != NULL)
+			hash = config_hash_str(hash, node->u.term.varvalue);
+		return hash;
+	}
+
+	hash = config_hash_str(hash, node->u.nterm.name);
+	glist_for_each(ns, &node->u.nterm.sub_nodes)
+		hash = config_hash_node(hash,
+					glist_entry(ns, struct config_node,
+						    node));
+	return hash;
+}
+
+/**
+ * @brief Fingerprint of a block of the parse tree
+ *
+ * Covers the names and values of the block and all its sub-blocks,
+ * not where they are in the file.
+ *
+ * @param node [IN] pointer to a TYPE_BLOCK node.
+ * @param seed [IN] folded into the fingerprint
+ *
+ * @return the fingerprint, never 0.
+ */
+
+uint64_t config_block_hash(void *node, uint64_t seed)
+{
+	uint64_t hash;
+
+	assert(((struct config_node *)node)->type == TYPE_BLOCK);
+	hash = config_hash_node(14695981039346656037ULL ^ seed, node);
+	return hash != 0 ? hash : 1;
+}
+
 /**
  * @brief Data structures for walking parse trees
  *
@@ -1731,10 +1983,12 @@ int find_config_nodes(config_file_t config, char *expr_str,
 		      struct config_error_type *err_type)
 {
 	struct config_root *tree = (struct config_root *)config;
+	struct config_index_entry *entry = NULL;
 	struct glist_head *ns;
 	struct config_node *sub_node;
 	struct config_node *top;
 	struct expr_parse *expr, *expr_head = NULL;
+	unsigned int i;
 	struct config_node_list *list = NULL, *list_tail = NULL;
 	char *ep;
 	int rc = EINVAL;
@@ -1752,27 +2006,31 @@ int find_config_nodes(config_file_t config, char *expr_str,
 		goto out;
 	expr = expr_head;
 	*node_list = NULL;
+	/* The top level blocks come from the index, the sub-blocks
+	 * from the list of their parent.
+	 */
+	entry = config_index_lookup(tree, expr->name);
+	i = 0;
+	ns = &top->u.nterm.sub_nodes;
 again:
-	glist_for_each(ns, &top->u.nterm.sub_nodes) {
-#ifdef DS_ONLY_WAS
-		/* recent changes to parsing may prevent this,
-		 * but retain code here for future reference.
-		 * -- WAS
-		 */
-		if (ns == NULL) {
-			config_proc_error(top, err_type,
-				 "Missing sub_node for (%s)",
-				 expr_str);
-			break;
+	for (;;) {
+		if (top == &tree->root) {
+			if (entry == NULL || i >= entry->count)
+				break;
+			sub_node = entry->nodes[i++];
+		} else {
+			ns = ns->next;
+			if (ns == &top->u.nterm.sub_nodes)
+				break;
+			sub_node = glist_entry(ns, struct config_node, node);
 		}
-#endif
-		sub_node = glist_entry(ns, struct config_node, node);
 		if (strcasecmp(expr->name, sub_node->u.nterm.name) == 0 &&
 		    sub_node->type == TYPE_BLOCK &&
 		    match_block(sub_node, expr)) {
 			if (expr->next != NULL) {
 				top = sub_node;
 				expr = expr->next;
+				ns = &top->u.nterm.sub_nodes;
 				goto again;
 			}
 			list = gsh_calloc(1, sizeof(struct config_node_list));
@@ -1874,8 +2132,9 @@ int load_config_from_parse(config_file_t config,
 {
 	struct config_root *tree = (struct config_root *)config;
 	struct config_node *node = NULL;
-	struct glist_head *ns;
+	struct config_index_entry *entry;
 	char *blkname = conf_blk->blk_desc.name;
+	unsigned int i;
 	int found = 0;
 	int prev_errs = err_type->errors;
 	void *blk_mem = NULL;
@@ -1904,26 +2163,24 @@ int load_config_from_parse(config_file_t config,
 			return -1;
 		}
 	}
-	glist_for_each(ns, &tree->root.u.nterm.sub_nodes) {
-		node = glist_entry(ns, struct config_node, node);
-		if (node->type == TYPE_BLOCK &&
-		    strcasecmp(blkname, node->u.nterm.name) == 0) {
-			if (found > 0 &&
-			    (conf_blk->blk_desc.flags & CONFIG_UNIQUE)) {
+	entry = config_index_lookup(tree, blkname);
+	for (i = 0; entry != NULL && i < entry->count; i++) {
+		node = entry->nodes[i];
+		if (found > 0 &&
+		    (conf_blk->blk_desc.flags & CONFIG_UNIQUE)) {
+			config_proc_error(node, err_type,
+					  "Only one %s block allowed",
+					  blkname);
+		} else {
+			if (!proc_block(node,
+					&conf_blk->blk_desc,
+					blk_mem,
+					err_type))
 				config_proc_error(node, err_type,
-						  "Only one %s block allowed",
+						  "Errors processing block (%s)",
 						  blkname);
-			} else {
-				if (!proc_block(node,
-						&conf_blk->blk_desc,
-						blk_mem,
-						err_type))
-					config_proc_error(node, err_type,
-							  "Errors processing block (%s)",
-							  blkname);
-				else
-					found++;
-			}
+			else
+				found++;
 		}
 	}
 	if (found == 0) {
@@ -45,6 +45,7 @@
 #include "log.h"
 #include "nfs_rpc_callback.h"
 #include "gsh_dbus.h"
+#include "fridgethr.h"
 #include <os/memstream.h>
 #include "dbus_priv.h"
 
@@ -94,6 +95,20 @@ struct _dbus_thread_state {
 
 static struct _dbus_thread_state thread_state;
 
+/*
+ * Method calls are run off the DBus thread: those only reading, the
+ * Get and Show methods, in parallel by DBus_Workers threads, and the
+ * others one at a time, in the order they came in.
+ */
+static struct fridgethr *dbus_read_fridge;
+static struct fridgethr *dbus_admin_fridge;
+
+struct dbus_call {
+	DBusConnection *conn;
+	DBusMessage *msg;
+	struct gsh_dbus_interface **interfaces;
+};
+
 static inline int dbus_callout_cmpf(const struct avltree_node *lhs,
 				    const struct avltree_node *rhs)
 {
@@ -205,6 +220,7 @@ void init_dbus_broadcast(void)
 
 void gsh_dbus_pkginit(void)
 {
+	struct fridgethr_params frp;
 	char regbuf[128];
 	int code = 0;
 
@@ -213,6 +229,12 @@ void gsh_dbus_pkginit(void)
 	avltree_init(&thread_state.callouts, dbus_callout_cmpf,
 		     0 /* must be 0 */);
 
+	/* the methods are run, and reply, from several threads */
+	if (!dbus_threads_init_default()) {
+		LogCrit(COMPONENT_DBUS, "dbus_threads_init_default failed");
+		goto out;
+	}
+
 	dbus_error_init(&thread_state.dbus_err);	/* sigh */
 	thread_state.dbus_conn =
 	    dbus_bus_get(DBUS_BUS_SYSTEM, &thread_state.dbus_err);
@@ -245,6 +267,22 @@ void gsh_dbus_pkginit(void)
 
 	init_dbus_broadcast();
 
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = nfs_param.core_param.dbus_workers;
+	frp.deferment = fridgethr_defer_queue;
+	if (fridgethr_init(&dbus_read_fridge, "dbus_read", &frp) != 0) {
+		LogMajor(COMPONENT_DBUS,
+			 "Unable to start the DBus workers, methods run on the DBus thread");
+		dbus_read_fridge = NULL;
+	}
+
+	frp.thr_max = 1;
+	if (fridgethr_init(&dbus_admin_fridge, "dbus_admin", &frp) != 0) {
+		LogMajor(COMPONENT_DBUS,
+			 "Unable to start the DBus admin thread, methods run on the DBus thread");
+		dbus_admin_fridge = NULL;
+	}
+
 	thread_state.initialized = true;
 
  out:
@@ -466,19 +504,18 @@ void dbus_append_timestamp(DBusMessageIter *iterp, struct timespec *timestamp)
 	dbus_message_iter_close_container(iterp, &ts_iter);
 }
 
-static DBusHandlerResult dbus_message_entrypoint(DBusConnection *conn,
-						 DBusMessage *msg,
-						 void *user_data)
+static DBusHandlerResult dbus_message_run(DBusConnection *conn,
+					  DBusMessage *msg,
+					  struct gsh_dbus_interface **interfaces)
 {
 	const char *interface = dbus_message_get_interface(msg);
 	const char *method = dbus_message_get_member(msg);
-	struct gsh_dbus_interface **interfaces = user_data;
 	DBusMessage *reply = NULL;
 	DBusError error;
 	DBusMessageIter args, *argsp;
 	bool success = false;
 	DBusHandlerResult result = DBUS_HANDLER_RESULT_HANDLED;
-	static uint32_t serial = 1;
+	dbus_uint32_t serial;
 
 	dbus_error_init(&error);
 	if (interface == NULL)
@@ -550,10 +587,68 @@ static DBusHandlerResult dbus_message_entrypoint(DBusConnection *conn,
 	if (reply)
 		dbus_message_unref(reply);
 	dbus_error_free(&error);
-	serial++;
 	return result;
 }
 
+static void dbus_call_run(struct fridgethr_context *ctx)
+{
+	struct dbus_call *call = ctx->arg;
+
+	(void) dbus_message_run(call->conn, call->msg, call->interfaces);
+	dbus_message_unref(call->msg);
+	dbus_connection_unref(call->conn);
+	gsh_free(call);
+}
+
+/**
+ * @brief Whether a method only reads, and may run with others
+ */
+static bool dbus_method_reads(const char *interface, const char *method)
+{
+	if (!strcmp(interface, DBUS_INTERFACE_INTROSPECTABLE))
+		return true;
+
+	if (method == NULL)
+		return true;
+
+	if (!strcmp(interface, DBUS_INTERFACE_PROPERTIES))
+		return strcmp(method, "Set") != 0;
+
+	return !strncmp(method, "Get", 3) || !strncmp(method, "Show", 4) ||
+	       !strcmp(method, "Introspect");
+}
+
+static DBusHandlerResult dbus_message_entrypoint(DBusConnection *conn,
+						 DBusMessage *msg,
+						 void *user_data)
+{
+	const char *interface = dbus_message_get_interface(msg);
+	struct fridgethr *fr;
+	struct dbus_call *call;
+
+	if (interface == NULL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+	fr = dbus_method_reads(interface, dbus_message_get_member(msg))
+		? dbus_read_fridge : dbus_admin_fridge;
+	if (fr == NULL)
+		return dbus_message_run(conn, msg, user_data);
+
+	call = gsh_malloc(sizeof(*call));
+	call->conn = dbus_connection_ref(conn);
+	call->msg = dbus_message_ref(msg);
+	call->interfaces = user_data;
+
+	if (fridgethr_submit(fr, dbus_call_run, call) != 0) {
+		dbus_message_unref(call->msg);
+		dbus_connection_unref(call->conn);
+		gsh_free(call);
+		return dbus_message_run(conn, msg, user_data);
+	}
+
+	return DBUS_HANDLER_RESULT_HANDLED;
+}
+
 static void path_unregistered_func(DBusConnection *connection, void *user_data)
 {
 	/* connection was finalized -- do nothing */
@@ -655,6 +750,15 @@ void gsh_dbus_pkgshutdown(void)
 	}
 	avltree_init(&thread_state.callouts, dbus_callout_cmpf, 0);
 
+	if (dbus_read_fridge != NULL &&
+	    fridgethr_sync_command(dbus_read_fridge, fridgethr_comm_stop,
+				   120) == 0)
+		fridgethr_destroy(dbus_read_fridge);
+	if (dbus_admin_fridge != NULL &&
+	    fridgethr_sync_command(dbus_admin_fridge, fridgethr_comm_stop,
+				   120) == 0)
+		fridgethr_destroy(dbus_admin_fridge);
+
 	/* shutdown bus */
 	if (thread_state.dbus_conn)
 		dbus_connection_close(thread_state.dbus_conn);
@@ -730,6 +834,8 @@ void *gsh_dbus_thread(void *arg)
 						    &(bcast_item->
 						      dbus_bcast_q),
 						    &dbus_bcast_item_compare);
+			} else {
+				gsh_free(bcast_item);
 			}
 		}
 		PTHREAD_MUTEX_unlock(&dbus_bcast_lock);
@@ -0,0 +1,565 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * -------------
+ */
+
+/*
+ * Latency of the object operations through the whole MDCACHE stack,
+ * on the export given, so on whatever FSAL the config puts under it
+ * (VFS and PSEUDO are the ones meant).  Each test runs its operation
+ * from --threads threads, --count times per thread, and prints one
+ * JSON object per line: the operation, the threads, the count, the
+ * operations per second, the mean and the 50th, 90th, 99th and 99.9th
+ * percentile and max latencies in ns, and a histogram of the
+ * latencies, "hist"[i] being those in [2^i, 2^(i+1)) ns.
+ *
+ * An operation the FSAL does not support (files and data on PSEUDO)
+ * is reported with "skipped": true.
+ *
+ * bench_fsal --config vfs.conf --export 77 --threads 4 --out vfs.json
+ */
+
+#include <sys/types.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include "gtest/gtest.h"
+#include <boost/program_options.hpp>
+
+extern "C" {
+/* Ganesha headers */
+#include "nfs_lib.h"
+#include "export_mgr.h"
+#include "nfs_exports.h"
+#include "sal_data.h"
+#include "fsal.h"
+}
+
+namespace {
+
+  char* ganesha_conf = nullptr;
+  char* lpath = nullptr;
+  int dlevel = -1;
+  uint16_t export_id = 77;
+  int nthreads = 1;
+  int count = 10000;
+  int nfiles = 1000;
+  size_t io_size = 4096;
+  uint64_t file_size = 1 << 20;
+  std::ostream *out = &std::cout;
+
+  struct req_op_context req_ctx;
+  struct user_cred user_credentials;
+  struct attrlist object_attributes;
+
+  struct gsh_export* a_export = nullptr;
+  struct fsal_obj_handle *root_entry = nullptr;
+  struct fsal_obj_handle *test_root = nullptr;
+
+  /* The directories looked up and stat'ed */
+  std::vector<struct fsal_obj_handle *> objs;
+  std::vector<std::string> names;
+
+  /* The objects made by CREATE, per thread, for UNLINK */
+  std::vector<std::vector<struct fsal_obj_handle *>> created;
+  std::atomic<bool> create_files(true);
+
+  /* The file each thread reads and writes, NULL on PSEUDO */
+  std::vector<struct fsal_obj_handle *> io_files;
+
+  typedef std::chrono::steady_clock bench_clock;
+
+  int ganesha_server() {
+    /* XXX */
+    return nfs_libmain(
+      ganesha_conf,
+      lpath,
+      dlevel
+      );
+  }
+
+  bool supported(fsal_status_t status) {
+    return status.major != ERR_FSAL_NOTSUPP;
+  }
+
+  /*
+   * Run op(thread, i) count times in each of nthreads threads, which
+   * returns false once it is not supported, and report the latencies.
+   */
+  template <typename Op>
+  void bench(const char *name, Op op) {
+    std::vector<std::vector<uint64_t>> lat(nthreads);
+    std::vector<std::thread> threads;
+    std::atomic<bool> skipped(false);
+
+    auto t0 = bench_clock::now();
+
+    for (int t = 0; t < nthreads; t++) {
+      threads.emplace_back([&, t] {
+	  struct req_op_context ctx = req_ctx;
+
+	  /* stashed in tls */
+	  op_ctx = &ctx;
+	  lat[t].reserve(count);
+
+	  for (int i = 0; i < count; i++) {
+	    auto start = bench_clock::now();
+
+	    if (!op(t, i)) {
+	      skipped = true;
+	      break;
+	    }
+	    lat[t].push_back(
+	      std::chrono::duration_cast<std::chrono::nanoseconds>(
+		bench_clock::now() - start).count());
+	  }
+	  op_ctx = nullptr;
+	});
+    }
+    for (auto& thread : threads)
+      thread.join();
+
+    double secs = std::chrono::duration<double>(bench_clock::now() -
+						 t0).count();
+    std::vector<uint64_t> all;
+    std::vector<uint64_t> hist(64);
+    double sum = 0;
+
+    for (auto& l : lat)
+      all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    for (auto ns : all) {
+      sum += ns;
+      hist[ns ? 63 - __builtin_clzll(ns) : 0]++;
+    }
+    while (hist.size() > 1 && hist.back() == 0)
+      hist.pop_back();
+
+    auto pct = [&](double p) -> uint64_t {
+      return all.empty() ? 0 : all[(size_t)(p * (all.size() - 1))];
+    };
+
+    *out << "{\"op\": \"" << name << "\", \"threads\": " << nthreads
+	 << ", \"count\": " << all.size();
+    if (skipped && all.empty()) {
+      *out << ", \"skipped\": true}" << std::endl;
+      return;
+    }
+    *out << ", \"ops_per_sec\": " << (uint64_t)(all.size() / secs)
+	 << ", \"mean\": " << (uint64_t)(sum / all.size())
+	 << ", \"p50\": " << pct(0.5)
+	 << ", \"p90\": " << pct(0.9)
+	 << ", \"p99\": " << pct(0.99)
+	 << ", \"p999\": " << pct(0.999)
+	 << ", \"max\": " << all.back()
+	 << ", \"hist\": [";
+    for (size_t i = 0; i < hist.size(); i++)
+      *out << (i ? ", " : "") << hist[i];
+    *out << "]}" << std::endl;
+  }
+
+  /* Spreads the threads over the directories */
+  size_t pick(int t, int i) {
+    return ((uint64_t)t * 7919 + (uint64_t)i * 104729) % objs.size();
+  }
+
+  char *io_buf(char fill) {
+    static thread_local std::vector<char> buf;
+
+    buf.resize(io_size, fill);
+    return buf.data();
+  }
+
+  bool readdir_cb(const char *name, struct fsal_obj_handle *obj,
+		  struct attrlist *attrs, void *dir_state,
+		  fsal_cookie_t cookie) {
+    (*(int *)dir_state)++;
+    obj->obj_ops.put_ref(obj);
+    return true;
+  }
+
+} /* namespace */
+
+TEST(BENCH_FSAL, INIT)
+{
+  fsal_status_t status;
+
+  a_export = get_gsh_export(export_id);
+  ASSERT_NE(a_export, nullptr);
+
+  status = nfs_export_get_root_entry(a_export, &root_entry);
+  ASSERT_EQ(status.major, 0);
+  ASSERT_NE(root_entry, nullptr);
+
+  /* Ganesha call paths need real or forged context info */
+  memset(&user_credentials, 0, sizeof(struct user_cred));
+  memset(&req_ctx, 0, sizeof(struct req_op_context));
+  memset(&object_attributes, 0, sizeof(object_attributes));
+
+  req_ctx.ctx_export = a_export;
+  req_ctx.fsal_export = a_export->fsal_export;
+  req_ctx.creds = &user_credentials;
+
+  /* stashed in tls */
+  op_ctx = &req_ctx;
+
+  FSAL_SET_MASK(object_attributes.valid_mask,
+		ATTR_MODE | ATTR_OWNER | ATTR_GROUP);
+  object_attributes.mode = 0755;
+  object_attributes.owner = 667;
+  object_attributes.group = 766;
+
+  created.resize(nthreads);
+  io_files.resize(nthreads);
+}
+
+TEST(BENCH_FSAL, CREATE_ROOT)
+{
+  fsal_status_t status;
+  char name[32];
+
+  status = root_entry->obj_ops.mkdir(root_entry, "bench_fsal",
+				    &object_attributes, &test_root,
+				    nullptr);
+  ASSERT_EQ(status.major, 0);
+  ASSERT_NE(test_root, nullptr);
+
+  for (int i = 0; i < nfiles; i++) {
+    struct fsal_obj_handle *obj = nullptr;
+
+    snprintf(name, sizeof(name), "d%d", i);
+    status = test_root->obj_ops.mkdir(test_root, name, &object_attributes,
+				      &obj, nullptr);
+    ASSERT_EQ(status.major, 0);
+    objs.push_back(obj);
+    names.push_back(name);
+  }
+}
+
+TEST(BENCH_FSAL, LOOKUP)
+{
+  bench("lookup", [](int t, int i) {
+      size_t n = pick(t, i);
+      struct fsal_obj_handle *found = nullptr;
+      fsal_status_t status;
+
+      status = test_root->obj_ops.lookup(test_root, names[n].c_str(),
+					 &found, nullptr);
+      EXPECT_EQ(status.major, 0);
+      EXPECT_EQ(found, objs[n]);
+      if (found)
+	found->obj_ops.put_ref(found);
+      return true;
+    });
+}
+
+TEST(BENCH_FSAL, GETATTR)
+{
+  bench("getattr", [](int t, int i) {
+      struct fsal_obj_handle *obj = objs[pick(t, i)];
+      struct attrlist attrs;
+      fsal_status_t status;
+
+      fsal_prepare_attrs(&attrs, ATTRS_POSIX);
+      status = obj->obj_ops.getattrs(obj, &attrs);
+      EXPECT_EQ(status.major, 0);
+      fsal_release_attrs(&attrs);
+      return true;
+    });
+}
+
+TEST(BENCH_FSAL, READDIR)
+{
+  bench("readdir", [](int t, int i) {
+      fsal_status_t status;
+      bool eof = false;
+      int n = 0;
+
+      /* The whole directory, the callback never stops it */
+      status = test_root->obj_ops.readdir(test_root, nullptr, &n,
+					  readdir_cb, ATTRS_POSIX, &eof);
+      EXPECT_EQ(status.major, 0);
+      EXPECT_TRUE(eof);
+      EXPECT_EQ(n, nfiles);
+      return true;
+    });
+}
+
+TEST(BENCH_FSAL, CREATE)
+{
+  bench("create", [](int t, int i) {
+      struct fsal_obj_handle *obj = nullptr;
+      fsal_status_t status;
+      bool caller_perm_check = false;
+      char name[32];
+
+      snprintf(name, sizeof(name), "c%d_%d", t, i);
+      if (create_files) {
+	status = test_root->obj_ops.open2(test_root, nullptr, FSAL_O_RDWR,
+					  FSAL_UNCHECKED, name,
+					  &object_attributes, nullptr, &obj,
+					  nullptr, &caller_perm_check);
+	if (supported(status)) {
+	  EXPECT_EQ(status.major, 0);
+	  if (obj)
+	    obj->obj_ops.close(obj);
+	} else {
+	  /* PSEUDO has directories only */
+	  create_files = false;
+	}
+      }
+      if (!create_files) {
+	status = test_root->obj_ops.mkdir(test_root, name,
+					  &object_attributes, &obj,
+					  nullptr);
+	EXPECT_EQ(status.major, 0);
+      }
+      if (obj)
+	created[t].push_back(obj);
+      return true;
+    });
+}
+
+TEST(BENCH_FSAL, UNLINK)
+{
+  bench("unlink", [](int t, int i) {
+      struct fsal_obj_handle *obj;
+      fsal_status_t status;
+      char name[32];
+
+      if (i >= (int)created[t].size())
+	return false;
+
+      obj = created[t][i];
+      snprintf(name, sizeof(name), "c%d_%d", t, i);
+      status = test_root->obj_ops.unlink(test_root, obj, name);
+      EXPECT_EQ(status.major, 0);
+      obj->obj_ops.put_ref(obj);
+      return true;
+    });
+}
+
+TEST(BENCH_FSAL, CREATE_IO_FILES)
+{
+  std::vector<char> buf(io_size, 'g');
+  fsal_status_t status;
+  char name[32];
+
+  for (int t = 0; t < nthreads; t++) {
+    struct fsal_obj_handle *obj = nullptr;
+    bool caller_perm_check = false;
+    size_t wrote;
+    bool stable;
+
+    snprintf(name, sizeof(name), "io%d", t);
+    status = test_root->obj_ops.open2(test_root, nullptr, FSAL_O_RDWR,
+				      FSAL_UNCHECKED, name,
+				      &object_attributes, nullptr, &obj,
+				      nullptr, &caller_perm_check);
+    if (!supported(status))
+      return;
+    ASSERT_EQ(status.major, 0);
+    io_files[t] = obj;
+
+    /* Fill it, so reads return data */
+    for (uint64_t off = 0; off < file_size; off += io_size) {
+      status = obj->obj_ops.write2(obj, false, nullptr, off, io_size,
+				   buf.data(), &wrote, &stable, nullptr);
+      ASSERT_EQ(status.major, 0);
+    }
+  }
+}
+
+TEST(BENCH_FSAL, READ)
+{
+  bench("read", [](int t, int i) {
+      struct fsal_obj_handle *obj = io_files[t];
+      size_t nread;
+      bool eof;
+      fsal_status_t status;
+
+      if (obj == nullptr)
+	return false;
+
+      status = obj->obj_ops.read2(obj, false, nullptr,
+				  (i * io_size) % file_size, io_size,
+				  io_buf('r'), &nread, &eof, nullptr);
+      EXPECT_EQ(status.major, 0);
+      return true;
+    });
+}
+
+TEST(BENCH_FSAL, WRITE)
+{
+  bench("write", [](int t, int i) {
+      struct fsal_obj_handle *obj = io_files[t];
+      size_t wrote;
+      bool stable;
+      fsal_status_t status;
+
+      if (obj == nullptr)
+	return false;
+
+      status = obj->obj_ops.write2(obj, false, nullptr,
+				   (i * io_size) % file_size, io_size,
+				   io_buf('w'), &wrote, &stable, nullptr);
+      EXPECT_EQ(status.major, 0);
+      return true;
+    });
+}
+
+TEST(BENCH_FSAL, CLEANUP)
+{
+  char name[32];
+
+  for (int t = 0; t < nthreads; t++) {
+    struct fsal_obj_handle *obj = io_files[t];
+
+    if (obj == nullptr)
+      continue;
+    obj->obj_ops.close(obj);
+    snprintf(name, sizeof(name), "io%d", t);
+    test_root->obj_ops.unlink(test_root, obj, name);
+    obj->obj_ops.put_ref(obj);
+  }
+
+  for (int i = 0; i < nfiles; i++) {
+    test_root->obj_ops.unlink(test_root, objs[i], names[i].c_str());
+    objs[i]->obj_ops.put_ref(objs[i]);
+  }
+
+  root_entry->obj_ops.unlink(root_entry, test_root, "bench_fsal");
+  test_root->obj_ops.put_ref(test_root);
+}
+
+int main(int argc, char *argv[])
+{
+  int code = 0;
+  std::ofstream out_file;
+
+  using namespace std;
+  using namespace std::literals;
+  namespace po = boost::program_options;
+
+  po::options_description opts("program options");
+  po::variables_map vm;
+
+  try {
+
+    opts.add_options()
+      ("config", po::value<string>(),
+	"path to Ganesha conf file")
+
+      ("logfile", po::value<string>(),
+	"log to the provided file path")
+
+      ("export", po::value<uint16_t>(),
+	"id of export on which to operate (must exist)")
+
+      ("debug", po::value<string>(),
+	"ganesha debug level")
+
+      ("threads", po::value<int>(),
+	"threads running each operation (1)")
+
+      ("count", po::value<int>(),
+	"operations per thread (10000)")
+
+      ("files", po::value<int>(),
+	"entries of the directory looked up and read (1000)")
+
+      ("io-size", po::value<size_t>(),
+	"bytes per read and write (4096)")
+
+      ("out", po::value<string>(),
+	"write the results to this file rather than stdout")
+      ;
+
+    po::variables_map::iterator vm_iter;
+    po::store(po::parse_command_line(argc, argv, opts), vm);
+    po::notify(vm);
+
+    // use config vars--leaves them on the stack
+    vm_iter = vm.find("config");
+    if (vm_iter != vm.end()) {
+      ganesha_conf = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("logfile");
+    if (vm_iter != vm.end()) {
+      lpath = (char*) vm_iter->second.as<std::string>().c_str();
+    }
+    vm_iter = vm.find("debug");
+    if (vm_iter != vm.end()) {
+      dlevel = ReturnLevelAscii(
+	(char*) vm_iter->second.as<std::string>().c_str());
+    }
+    vm_iter = vm.find("export");
+    if (vm_iter != vm.end()) {
+      export_id = vm_iter->second.as<uint16_t>();
+    }
+    vm_iter = vm.find("threads");
+    if (vm_iter != vm.end()) {
+      nthreads = std::max(vm_iter->second.as<int>(), 1);
+    }
+    vm_iter = vm.find("count");
+    if (vm_iter != vm.end()) {
+      count = std::max(vm_iter->second.as<int>(), 1);
+    }
+    vm_iter = vm.find("files");
+    if (vm_iter != vm.end()) {
+      nfiles = std::max(vm_iter->second.as<int>(), 1);
+    }
+    vm_iter = vm.find("io-size");
+    if (vm_iter != vm.end()) {
+      io_size = std::max(vm_iter->second.as<size_t>(), (size_t)1);
+      file_size = std::max(file_size, (uint64_t)io_size);
+      file_size -= file_size % io_size;
+    }
+    vm_iter = vm.find("out");
+    if (vm_iter != vm.end()) {
+      out_file.open(vm_iter->second.as<std::string>());
+      out = &out_file;
+    }
+
+    ::testing::InitGoogleTest(&argc, argv);
+
+    std::thread ganesha(ganesha_server);
+    std::this_thread::sleep_for(5s);
+
+    code  = RUN_ALL_TESTS();
+    ganesha.join();
+  }
+
+  catch(po::error& e) {
+    cout << "Error parsing opts " << e.what() << endl;
+  }
+
+  catch(...) {
+    cout << "Unhandled exception in main()" << endl;
+  }
+
+  return code;
+}
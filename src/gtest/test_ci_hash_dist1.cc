@@ -41,6 +41,8 @@ extern "C" {
 #include "nfs_exports.h"
 #include "sal_data.h"
 #include "fsal.h"
+#include "city.h"
+#include "gsh_hash.h"
 }
 
 namespace bf = boost::filesystem;
@@ -118,6 +120,81 @@ TEST(CI_HASH_DIST1, CREATE_ROOT)
   ASSERT_NE(test_root, nullptr);
 }
 
+/* Spread of the handle keys over the cih partitions, and hash speed */
+TEST(CI_HASH_DIST1, HANDLE_HASH)
+{
+  const int nobjs = 10000;
+  const int nparts = 127;
+  const int rounds = 100;
+  std::vector<struct fsal_obj_handle *> objs;
+  std::vector<struct gsh_buffdesc> keys;
+  fsal_status_t status;
+  char name[32];
+
+  ASSERT_NE(test_root, nullptr);
+
+  for (int i = 0; i < nobjs; i++) {
+    struct fsal_obj_handle *obj = nullptr;
+    struct gsh_buffdesc key;
+
+    snprintf(name, sizeof(name), "d%d", i);
+    status = test_root->obj_ops.mkdir(test_root, name, &object_attributes,
+				      &obj, nullptr);
+    ASSERT_EQ(status.major, 0);
+    obj->obj_ops.handle_to_key(obj, &key);
+    objs.push_back(obj);
+    keys.push_back(key);
+  }
+
+  std::vector<int> gsh(nparts), city(nparts);
+
+  for (auto& key : keys) {
+    gsh[gsh_hash64(key.addr, key.len, 557) % nparts]++;
+    city[CityHash64WithSeed((char *)key.addr, key.len, 557) % nparts]++;
+  }
+
+  /* chi-square over nparts - 1 degrees of freedom, about 126 +- 16 */
+  double expect = (double)nobjs / nparts, chi_gsh = 0, chi_city = 0;
+
+  for (int i = 0; i < nparts; i++) {
+    chi_gsh += (gsh[i] - expect) * (gsh[i] - expect) / expect;
+    chi_city += (city[i] - expect) * (city[i] - expect) / expect;
+  }
+
+  std::cout << gsh_hash_impl() << " chi2 " << chi_gsh
+	    << ", city chi2 " << chi_city << std::endl;
+  EXPECT_LT(chi_gsh, 2 * nparts);
+
+  uint64_t sum = 0;
+  auto t0 = std::chrono::steady_clock::now();
+
+  for (int r = 0; r < rounds; r++)
+    for (auto& key : keys)
+      sum += gsh_hash64(key.addr, key.len, r);
+
+  auto t1 = std::chrono::steady_clock::now();
+
+  for (int r = 0; r < rounds; r++)
+    for (auto& key : keys)
+      sum += CityHash64WithSeed((char *)key.addr, key.len, r);
+
+  auto t2 = std::chrono::steady_clock::now();
+
+  std::cout << gsh_hash_impl() << " "
+	    << std::chrono::duration<double, std::nano>(t1 - t0).count()
+	       / (rounds * nobjs)
+	    << " ns/key, city "
+	    << std::chrono::duration<double, std::nano>(t2 - t1).count()
+	       / (rounds * nobjs)
+	    << " ns/key (" << sum % 2 << ")" << std::endl;
+
+  for (int i = 0; i < nobjs; i++) {
+    snprintf(name, sizeof(name), "d%d", i);
+    test_root->obj_ops.unlink(test_root, objs[i], name);
+    objs[i]->obj_ops.put_ref(objs[i]);
+  }
+}
+
 int main(int argc, char *argv[])
 {
   int code = 0;
@@ -46,26 +46,34 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 #include "hashtable.h"
 #include "log.h"
 #include "abstract_atomic.h"
 #include "common_utils.h"
 #include <assert.h>
 
+/** All the hash tables, for hashtable_foreach */
+static struct glist_head hash_tables = GLIST_HEAD_INIT(hash_tables);
+static pthread_mutex_t hash_tables_mtx = PTHREAD_MUTEX_INITIALIZER;
+
 /**
- * @brief Total size of the cache page configured for a table
- *
- * This function returns the size of the cache page for the given hash
- * table, based on the configured entry count.
+ * @brief Allocate an empty partition cache
  *
- * @param[in] ht The hash table to query
+ * @param[in] size Number of slots
  *
- * @return The cache page size
+ * @return The cache
  */
-static inline size_t
-cache_page_size(const hash_table_t *ht)
+static inline struct hash_cache *
+cache_alloc(uint32_t size)
 {
-	return (ht->parameter.cache_entry_count) * sizeof(struct rbt_node *);
+	struct hash_cache *cache;
+
+	cache = gsh_calloc(1, sizeof(*cache) +
+			   size * sizeof(struct rbt_node *));
+	cache->size = size;
+
+	return cache;
 }
 
 /**
@@ -74,16 +82,199 @@ cache_page_size(const hash_table_t *ht)
  * This function returns the offset into a cache array of the given
  * hash value.
  *
- * @param[in] ht      The hash table to query
+ * @param[in] cache   The cache to query
  * @param[in] rbthash The hash value to look up
  *
  * @return the offset into the cache at which the hash value might be
  *         found
  */
 static inline int
-cache_offsetof(struct hash_table *ht, uint64_t rbthash)
+cache_offsetof(struct hash_cache *cache, uint64_t rbthash)
 {
-	return rbthash % ht->parameter.cache_entry_count;
+	return rbthash % cache->size;
+}
+
+/**
+ * @brief A lockless reader
+ *
+ * Each thread that looks up an HT_FLAG_LOCKLESS table without the
+ * partition lock owns one of these.  Its sequence is odd while the
+ * thread is inside a read section.  A node taken out of the cache
+ * may still be seen by readers that were in a section at the time, so
+ * it is not changed, freed or handed back to the caller until
+ * ht_synchronize() has seen each of them leave.
+ */
+struct ht_reader {
+	uint64_t seq;
+	struct ht_reader *next;
+	bool in_use;
+	GSH_CACHE_PAD(0);
+};
+
+static __thread struct ht_reader *ht_reader_mine;
+
+/** Every reader ever registered; records are reused, never unlinked */
+static struct ht_reader *ht_readers;
+static pthread_mutex_t ht_readers_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ht_reader_key;
+static pthread_once_t ht_reader_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Give up an exited thread's reader for reuse
+ *
+ * @param[in] arg  The reader
+ */
+static void ht_reader_release(void *arg)
+{
+	struct ht_reader *reader = arg;
+
+	PTHREAD_MUTEX_lock(&ht_readers_mtx);
+	reader->in_use = false;
+	PTHREAD_MUTEX_unlock(&ht_readers_mtx);
+}
+
+static void ht_reader_key_init(void)
+{
+	(void) pthread_key_create(&ht_reader_key, ht_reader_release);
+}
+
+/**
+ * @brief Register this thread as a lockless reader
+ *
+ * The reader of an exited thread is reused if there is one.
+ *
+ * @return The thread's reader.
+ */
+static struct ht_reader *ht_reader_register(void)
+{
+	struct ht_reader *reader;
+
+	PTHREAD_MUTEX_lock(&ht_readers_mtx);
+
+	for (reader = ht_readers; reader != NULL; reader = reader->next)
+		if (!reader->in_use)
+			break;
+
+	if (reader == NULL) {
+		reader = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+					    sizeof(*reader));
+		memset(reader, 0, sizeof(*reader));
+		reader->next = ht_readers;
+		/* Publish the reader to ht_synchronize() */
+		atomic_store_voidptr((void **)&ht_readers, reader);
+	}
+
+	reader->in_use = true;
+
+	PTHREAD_MUTEX_unlock(&ht_readers_mtx);
+
+	(void) pthread_setspecific(ht_reader_key, reader);
+	ht_reader_mine = reader;
+
+	return reader;
+}
+
+/**
+ * @brief Wait for lockless readers to be done with uncached nodes
+ *
+ * Once this returns, no reader can still be looking at a node that was
+ * taken out of the cache before it was called.  Read sections are a
+ * key comparison and a reference long, so this may be called with the
+ * partition lock held.
+ */
+static void ht_synchronize(void)
+{
+	struct ht_reader *reader;
+	uint64_t seq;
+
+	for (reader = atomic_fetch_voidptr((void **)&ht_readers);
+	     reader != NULL; reader = reader->next) {
+		seq = atomic_fetch_uint64_t(&reader->seq);
+		if ((seq & 1) == 0)
+			continue;
+		/* Inside a section, wait for it to leave */
+		while (atomic_fetch_uint64_t(&reader->seq) == seq)
+			sched_yield();
+	}
+}
+
+/**
+ * @brief Take a node out of the cache of its partition
+ *
+ * For an HT_FLAG_LOCKLESS table, waits out the readers that may have
+ * found it there, even if it has since been evicted by another node.
+ * The partition must be write locked.
+ *
+ * @param[in] ht        The hash table
+ * @param[in] partition The node's partition
+ * @param[in] node      The node
+ */
+static void
+cache_forget(struct hash_table *ht, struct hash_partition *partition,
+	     struct rbt_node *node)
+{
+	struct hash_cache *cache = partition->cache;
+	void **cache_slot;
+
+	if (!cache)
+		return;
+
+	cache_slot = (void **)
+	    &cache->slots[cache_offsetof(cache, RBT_VALUE(node))];
+
+	if (atomic_fetch_voidptr(cache_slot) == node) {
+		LogFullDebug(COMPONENT_HASHTABLE_CACHE, "hash clear slot %d",
+			     cache_offsetof(cache, RBT_VALUE(node)));
+		atomic_store_voidptr(cache_slot, NULL);
+	}
+
+	if (ht->parameter.flags & HT_FLAG_LOCKLESS)
+		ht_synchronize();
+}
+
+/**
+ * @brief Grow the cache of a partition that outgrew it
+ *
+ * The new cache, about twice as big, takes over the nodes cached in
+ * the old one, so lookups keep hitting.  The cost is paid once per
+ * doubling of the partition.  The partition must be write locked.
+ *
+ * @param[in] ht        The hash table
+ * @param[in] partition The partition
+ */
+static void
+cache_grow(struct hash_table *ht, struct hash_partition *partition)
+{
+	struct hash_cache *old = partition->cache;
+	struct hash_cache *new;
+	struct rbt_node *node;
+	uint32_t i;
+
+	if (old == NULL || old->size >= HT_CACHE_MAX ||
+	    partition->count <= 2 * (size_t) old->size)
+		return;
+
+	new = cache_alloc(MIN(2 * old->size + 1, HT_CACHE_MAX));
+
+	for (i = 0; i < old->size; i++) {
+		node = old->slots[i];
+		if (node != NULL)
+			new->slots[cache_offsetof(new, RBT_VALUE(node))] = node;
+	}
+
+	atomic_store_voidptr((void **)&partition->cache, new);
+
+	/* Lockless readers may still be looking at the old one */
+	if (ht->parameter.flags & HT_FLAG_LOCKLESS)
+		ht_synchronize();
+
+	gsh_free(old);
+
+	LogDebug(COMPONENT_HASHTABLE,
+		 "%s partition %td: %zu entries, cache grown to %" PRIu32
+		 " slots",
+		 ht->parameter.ht_name ? ht->parameter.ht_name : "hash table",
+		 partition - ht->partitions, partition->count, new->size);
 }
 
 /**
@@ -144,6 +335,9 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 	/* The current partition */
 	struct hash_partition *partition = &(ht->partitions[index]);
 
+	/* Its cache, stable while the partition is locked */
+	struct hash_cache *cache = partition->cache;
+
 	/* The root of the red black tree matching this index */
 	struct rbt_head *root = NULL;
 
@@ -159,14 +353,14 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 
 	*node = NULL;
 
-	if (partition->cache) {
+	if (cache) {
 		void **cache_slot = (void **)
-		    &(partition->cache[cache_offsetof(ht, rbthash)]);
+		    &(cache->slots[cache_offsetof(cache, rbthash)]);
 		cursor = atomic_fetch_voidptr(cache_slot);
 		LogFullDebug(COMPONENT_HASHTABLE_CACHE,
 			     "hash %s index %" PRIu32 " slot %d",
 			     (cursor) ? "hit" : "miss", index,
-			     cache_offsetof(ht, rbthash));
+			     cache_offsetof(cache, rbthash));
 		if (cursor) {
 			data = RBT_OPAQ(cursor);
 			if (ht->parameter.
@@ -197,10 +391,10 @@ key_locate(struct hash_table *ht, const struct gsh_buffdesc *key,
 		if (ht->parameter.
 		    compare_key((struct gsh_buffdesc *)key,
 				&(data->key)) == 0) {
-			if (partition->cache) {
+			if (cache) {
 				void **cache_slot = (void **)
-				    &(partition->
-				      cache[cache_offsetof(ht, rbthash)]);
+				    &(cache->
+				      slots[cache_offsetof(cache, rbthash)]);
 				atomic_store_voidptr(cache_slot, cursor);
 			}
 			found = true;
@@ -317,6 +511,11 @@ hashtable_init(struct hash_param *hparam)
 			(sizeof(struct hash_partition) *
 			 hparam->index_size));
 
+	if (hparam->flags & HT_FLAG_LOCKLESS) {
+		hparam->flags |= HT_FLAG_CACHE;
+		(void) pthread_once(&ht_reader_once, ht_reader_key_init);
+	}
+
 	/* Fixup entry size */
 	if (hparam->flags & HT_FLAG_CACHE) {
 		if (!hparam->cache_entry_count)
@@ -338,13 +537,19 @@ hashtable_init(struct hash_param *hparam)
 
 		/* Allocate a cache if requested */
 		if (hparam->flags & HT_FLAG_CACHE)
-			partition->cache = gsh_calloc(1, cache_page_size(ht));
+			partition->cache =
+				cache_alloc(hparam->cache_entry_count);
 
 		completed++;
 	}
 
-	ht->node_pool = pool_basic_init(NULL, sizeof(rbt_node_t));
-	ht->data_pool = pool_basic_init(NULL, sizeof(struct hash_data));
+	ht->node_pool = pool_basic_init(hparam->ht_name, sizeof(rbt_node_t));
+	ht->data_pool = pool_basic_init(hparam->ht_name,
+					sizeof(struct hash_data));
+
+	PTHREAD_MUTEX_lock(&hash_tables_mtx);
+	glist_add_tail(&hash_tables, &ht->tables);
+	PTHREAD_MUTEX_unlock(&hash_tables_mtx);
 
 	pthread_rwlockattr_destroy(&rwlockattr);
 	return ht;
@@ -393,6 +598,10 @@ hashtable_destroy(struct hash_table *ht,
 	if (hrc != HASHTABLE_SUCCESS)
 		goto out;
 
+	PTHREAD_MUTEX_lock(&hash_tables_mtx);
+	glist_del(&ht->tables);
+	PTHREAD_MUTEX_unlock(&hash_tables_mtx);
+
 	for (index = 0; index < ht->parameter.index_size; ++index) {
 		if (ht->partitions[index].cache) {
 			gsh_free(ht->partitions[index].cache);
@@ -629,6 +838,10 @@ hashtable_setlatched(struct hash_table *ht,
 				     latch->index, latch->rbt_hash);
 		}
 
+		/* Lockless readers must not see the pair change */
+		cache_forget(ht, &ht->partitions[latch->index],
+			     latch->locator);
+
 		if (stored_key)
 			*stored_key = descriptors->key;
 
@@ -663,6 +876,8 @@ hashtable_setlatched(struct hash_table *ht,
 	/* Only in the non-overwrite case */
 	++ht->partitions[latch->index].count;
 
+	cache_grow(ht, &ht->partitions[latch->index]);
+
 	rc = HASHTABLE_SUCCESS;
 
  out:
@@ -741,31 +956,8 @@ void hashtable_deletelatched(struct hash_table *ht,
 	if (stored_val)
 		*stored_val = data->val;
 
-	/* Clear cache */
-	if (partition->cache) {
-		uint32_t offset = cache_offsetof(ht, latch->rbt_hash);
-		struct rbt_node *cnode = partition->cache[offset];
-
-		if (cnode) {
-#if COMPARE_BEFORE_CLEAR_CACHE
-			struct hash_data *data1 = RBT_OPAQ(cnode);
-			struct hash_data *data2 = RBT_OPAQ(latch->locator);
-
-			if (ht->parameter.
-			    compare_key(&(data1->key), &(data2->key))
-			    == 0) {
-				LogFullDebug(COMPONENT_HASHTABLE_CACHE,
-					     "hash clear index %d slot %" PRIu64
-					     latch->index, offset);
-				partition->cache[offset] = NULL;
-			}
-#else
-			LogFullDebug(COMPONENT_HASHTABLE_CACHE,
-				     "hash clear slot %d", offset);
-			partition->cache[offset] = NULL;
-#endif
-		}
-	}
+	/* Clear cache, before the caller may free the value */
+	cache_forget(ht, partition, latch->locator);
 
 	/* Now remove the entry */
 	RBT_UNLINK(&partition->rbt, latch->locator);
@@ -802,6 +994,14 @@ hashtable_delall(struct hash_table *ht,
 
 		PTHREAD_RWLOCK_wrlock(&ht->partitions[index].lock);
 
+		if (ht->partitions[index].cache) {
+			memset(ht->partitions[index].cache->slots, 0,
+			       ht->partitions[index].cache->size *
+			       sizeof(struct rbt_node *));
+			if (ht->parameter.flags & HT_FLAG_LOCKLESS)
+				ht_synchronize();
+		}
+
 		/* Continue until there are no more entries in the red-black
 		   tree */
 		while ((cursor = RBT_LEFTMOST(root)) != NULL) {
@@ -911,6 +1111,63 @@ hashtable_log(log_components_t component, struct hash_table *ht)
 	}
 }
 
+/**
+ * @brief Get the occupancy of a hash table
+ *
+ * @param[in]  ht The hashtable
+ * @param[out] st Its entries, tree sizes and cache slots
+ */
+
+void
+hashtable_get_stats(struct hash_table *ht, hash_stat_t *st)
+{
+	struct hash_partition *partition;
+	uint32_t i;
+
+	memset(st, 0, sizeof(*st));
+	st->partitions = ht->parameter.index_size;
+	st->min_rbt_num_node = SIZE_MAX;
+
+	for (i = 0; i < ht->parameter.index_size; i++) {
+		partition = &ht->partitions[i];
+
+		PTHREAD_RWLOCK_rdlock(&partition->lock);
+		st->entries += partition->count;
+		st->min_rbt_num_node = MIN(st->min_rbt_num_node,
+					   partition->count);
+		st->max_rbt_num_node = MAX(st->max_rbt_num_node,
+					   partition->count);
+		if (partition->cache)
+			st->cache_slots += partition->cache->size;
+		PTHREAD_RWLOCK_unlock(&partition->lock);
+	}
+
+	if (st->partitions != 0)
+		st->average_rbt_num_node = st->entries / st->partitions;
+	else
+		st->min_rbt_num_node = 0;
+}
+
+/**
+ * @brief Call @a cb on each hash table
+ *
+ * The tables are not destroyed while @a cb runs.
+ *
+ * @param[in] cb  The function to call
+ * @param[in] arg Its second argument
+ */
+
+void
+hashtable_foreach(void (*cb)(struct hash_table *, void *), void *arg)
+{
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&hash_tables_mtx);
+	glist_for_each(glist, &hash_tables)
+		cb(glist_entry(glist, struct hash_table, tables), arg);
+	PTHREAD_MUTEX_unlock(&hash_tables_mtx);
+}
+
 /**
  * @brief Set a pair (key,value) into the Hash Table
  *
@@ -970,6 +1227,63 @@ hashtable_test_and_set(struct hash_table *ht,
 	return rc;
 }
 
+/**
+ * @brief Look up a value in the cache without the partition lock
+ *
+ * @param[in]  ht      An HT_FLAG_LOCKLESS hash table
+ * @param[in]  key     The key to find
+ * @param[out] val     The value found
+ * @param[in]  get_ref Function taking a reference on the value
+ *
+ * @retval HASHTABLE_SUCCESS if found, with a reference taken
+ * @retval HASHTABLE_ERROR_NO_SUCH_KEY if not in the cache
+ */
+static hash_error_t
+hashtable_getref_lockless(hash_table_t *ht, struct gsh_buffdesc *key,
+			  struct gsh_buffdesc *val,
+			  void (*get_ref)(struct gsh_buffdesc *))
+{
+	struct ht_reader *reader = ht_reader_mine;
+	struct hash_partition *partition;
+	struct hash_cache *cache;
+	struct rbt_node *node;
+	struct hash_data *data;
+	uint32_t index;
+	uint64_t rbt_hash;
+	hash_error_t rc;
+
+	rc = compute(ht, key, &index, &rbt_hash);
+	if (rc != HASHTABLE_SUCCESS)
+		return rc;
+
+	if (unlikely(reader == NULL))
+		reader = ht_reader_register();
+
+	partition = &ht->partitions[index];
+	rc = HASHTABLE_ERROR_NO_SUCH_KEY;
+
+	/* Full barrier, the cache is read after the sequence is odd */
+	(void) atomic_inc_uint64_t(&reader->seq);
+
+	cache = atomic_fetch_voidptr((void **)&partition->cache);
+	node = atomic_fetch_voidptr((void **)
+			&cache->slots[cache_offsetof(cache, rbt_hash)]);
+
+	if (node != NULL && RBT_VALUE(node) == rbt_hash) {
+		data = RBT_OPAQ(node);
+		if (ht->parameter.compare_key(key, &data->key) == 0) {
+			*val = data->val;
+			if (get_ref != NULL)
+				get_ref(val);
+			rc = HASHTABLE_SUCCESS;
+		}
+	}
+
+	(void) atomic_inc_uint64_t(&reader->seq);
+
+	return rc;
+}
+
 /**
  * @brief Look up a value and take a reference
  *
@@ -978,6 +1292,10 @@ hashtable_test_and_set(struct hash_table *ht,
  * a reference before releasing the partition lock.  It is implemented
  * as a wrapper around hashtable_getlatched.
  *
+ * On an HT_FLAG_LOCKLESS table the cache is tried first, without the
+ * lock; the reference is then taken while the value cannot leave the
+ * table, which holds its own, so get_ref must not block.
+ *
  * @param[in]  ht      The hash store to be searched
  * @param[in]  key     A buffer descriptore locating the key to find
  * @param[out] val     A buffer descriptor locating the value found
@@ -996,6 +1314,12 @@ hashtable_getref(hash_table_t *ht, struct gsh_buffdesc *key,
 	/* Stored return code */
 	hash_error_t rc = 0;
 
+	if (ht->parameter.flags & HT_FLAG_LOCKLESS) {
+		rc = hashtable_getref_lockless(ht, key, val, get_ref);
+		if (rc != HASHTABLE_ERROR_NO_SUCH_KEY)
+			return rc;
+	}
+
 	rc = hashtable_getlatch(ht, key, val, false, &latch);
 
 	switch (rc) {
@@ -91,175 +91,150 @@ bool idmapper_init(void)
 }
 
 /**
- * @brief Encode a UID or GID as a string
+ * @brief Look up the name of a UID or GID
  *
- * @param[in,out] xdrs  XDR stream to which to encode
  * @param[in]     id    UID or GID
  * @param[in]     group True if this is a GID, false for a UID
+ * @param[in,out] name  Its addr is a buffer of IDMAP_NAME_MAX bytes,
+ *                      gets the name
  *
- * @retval true on success.
- * @retval false on failure.
+ * @retval true if the ID is known.
+ * @retval false if not, name is then the one to report instead.
  */
 
-static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
+static bool id2name(uint32_t id, bool group, struct gsh_buffdesc *name)
 {
-	const struct gsh_buffdesc *found;
-	uint32_t not_a_size_t;
-	bool success = false;
-
-	if (nfs_param.nfsv4_param.only_numeric_owners) {
-		/* 2**32 is 10 digits long in decimal */
-		struct gsh_buffdesc name;
-		char namebuf[11];
-
-		name.addr = namebuf;
-		sprintf(namebuf, "%"PRIu32, id);
-		name.len = strlen(namebuf);
-		not_a_size_t = name.len;
-		return inline_xdr_bytes(xdrs, (char **)&name.addr,
-					&not_a_size_t, UINT32_MAX);
-	}
+	char *namebuff = name->addr;
+	bool looked_up = false;
+	int rc;
 
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-	if (group)
-		success = idmapper_lookup_by_gid(id, &found);
-	else
-		success = idmapper_lookup_by_uid(id, &found, NULL);
-
-	if (likely(success)) {
-		not_a_size_t = found->len;
-
-		/* Fully qualified owners are always stored in the
-		   hash table, no matter what our lookup method. */
-		success =
-		    inline_xdr_bytes(xdrs, (char **)&found->addr, &not_a_size_t,
-				     UINT32_MAX);
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		return success;
-	} else {
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		int rc;
+	if (nfs_param.nfsv4_param.use_getpwnam) {
+		const char *found = NULL;
+		char *buf;
+		size_t len;
 		int size;
-		bool looked_up = false;
-		char *namebuff = NULL;
-		struct gsh_buffdesc new_name;
-
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			if (group)
-				size = sysconf(_SC_GETGR_R_SIZE_MAX);
-			else
-				size = sysconf(_SC_GETPW_R_SIZE_MAX);
-			if (size == -1)
-				size = PWENT_BEST_GUESS_LEN;
-			new_name.len = size;
-			size += owner_domain.len + 2;
-		} else {
-			size = NFS4_MAX_DOMAIN_LEN + 2;
-		}
-
-		namebuff = alloca(size);
 
-		new_name.addr = namebuff;
+		if (group)
+			size = sysconf(_SC_GETGR_R_SIZE_MAX);
+		else
+			size = sysconf(_SC_GETPW_R_SIZE_MAX);
+		if (size == -1)
+			size = PWENT_BEST_GUESS_LEN;
 
-		if (nfs_param.nfsv4_param.use_getpwnam) {
-			char *cursor;
-			bool nulled;
+		buf = alloca(size);
 
-			if (group) {
-				struct group g;
-				struct group *gres;
+		if (group) {
+			struct group g;
+			struct group *gres;
 
-				rc = getgrgid_r(id, &g, namebuff, new_name.len,
-						&gres);
-				nulled = (gres == NULL);
-			} else {
-				struct passwd p;
-				struct passwd *pres;
+			rc = getgrgid_r(id, &g, buf, size, &gres);
+			if (rc == 0 && gres != NULL)
+				found = gres->gr_name;
+		} else {
+			struct passwd p;
+			struct passwd *pres;
 
-				rc = getpwuid_r(id, &p, namebuff, new_name.len,
-						&pres);
-				nulled = (pres == NULL);
-			}
+			rc = getpwuid_r(id, &p, buf, size, &pres);
+			if (rc == 0 && pres != NULL)
+				found = pres->pw_name;
+		}
 
-			if ((rc == 0) && !nulled) {
-				new_name.len = strlen(namebuff);
-				cursor = namebuff + new_name.len;
-				*(cursor++) = '@';
-				++new_name.len;
-				memcpy(cursor, owner_domain.addr,
-				       owner_domain.len);
-				new_name.len += owner_domain.len;
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "getgrgid_r" : "getpwuid_r"),
-					rc);
-			}
+		if (found != NULL &&
+		    strlen(found) + 1 + owner_domain.len <= IDMAP_NAME_MAX) {
+			len = strlen(found);
+			memcpy(namebuff, found, len);
+			namebuff[len++] = '@';
+			memcpy(namebuff + len, owner_domain.addr,
+			       owner_domain.len);
+			name->len = len + owner_domain.len;
+			looked_up = true;
 		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "getgrgid_r" : "getpwuid_r"), rc);
+		}
+	} else {
 #ifdef USE_NFSIDMAP
-			if (group) {
-				rc = nfs4_gid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			} else {
-				rc = nfs4_uid_to_name(id, owner_domain.addr,
-						      namebuff,
-						      NFS4_MAX_DOMAIN_LEN + 1);
-			}
-			if (rc == 0) {
-				new_name.len = strlen(namebuff);
-				looked_up = true;
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"%s failed with code %d.",
-					(group ? "nfs4_gid_to_name" :
-					"nfs4_uid_to_name"), rc);
-			}
-#else				/* USE_NFSIDMAP */
-			looked_up = false;
-#endif				/* !USE_NFSIDMAP */
+		if (group) {
+			rc = nfs4_gid_to_name(id, owner_domain.addr, namebuff,
+					      IDMAP_NAME_MAX);
+		} else {
+			rc = nfs4_uid_to_name(id, owner_domain.addr, namebuff,
+					      IDMAP_NAME_MAX);
+		}
+		if (rc == 0) {
+			name->len = strlen(namebuff);
+			looked_up = true;
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"%s failed with code %d.",
+				(group ? "nfs4_gid_to_name" :
+				"nfs4_uid_to_name"), rc);
 		}
+#endif				/* USE_NFSIDMAP */
+	}
 
-		if (!looked_up) {
-			if (nfs_param.nfsv4_param.allow_numeric_owners) {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using numeric %s",
-					id, (group ? "group" : "owner"));
-				/* 2**32 is 10 digits long in decimal */
-				sprintf(namebuff, "%"PRIu32, id);
-				new_name.len = strlen(namebuff);
-			} else {
-				LogInfo(COMPONENT_IDMAPPER,
-					"Lookup for %d failed, using nobody.",
-					id);
-				memcpy(new_name.addr, "nobody", 6);
-				new_name.len = 6;
-			}
+	if (!looked_up) {
+		if (nfs_param.nfsv4_param.allow_numeric_owners) {
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using numeric %s",
+				id, (group ? "group" : "owner"));
+			/* 2**32 is 10 digits long in decimal */
+			name->len = sprintf(namebuff, "%"PRIu32, id);
+		} else {
+			LogInfo(COMPONENT_IDMAPPER,
+				"Lookup for %d failed, using nobody.", id);
+			memcpy(namebuff, "nobody", 6);
+			name->len = 6;
 		}
+	}
 
-		/* Add to the cache and encode the result. */
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(&new_name, id);
-		else
-			success = idmapper_add_user(&new_name, id, NULL, false);
-
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (unlikely(!success)) {
-			LogMajor(COMPONENT_IDMAPPER, "%s failed.",
-				 group ? "idmapper_add_group" :
-				 "idmaper_add_user");
+	return looked_up;
+}
+
+/**
+ * @brief Encode a UID or GID as a string
+ *
+ * @param[in,out] xdrs  XDR stream to which to encode
+ * @param[in]     id    UID or GID
+ * @param[in]     group True if this is a GID, false for a UID
+ *
+ * @retval true on success.
+ * @retval false on failure.
+ */
+
+static bool xdr_encode_nfs4_princ(XDR *xdrs, uint32_t id, bool group)
+{
+	enum idmap_map map = group ? IDMAP_GID : IDMAP_UID;
+	char namebuff[IDMAP_NAME_MAX];
+	struct gsh_buffdesc name = {
+		.addr = namebuff,
+		.len = 0
+	};
+	uint32_t not_a_size_t;
+	enum idmap_hit hit;
+	bool known;
+
+	if (nfs_param.nfsv4_param.only_numeric_owners) {
+		/* 2**32 is 10 digits long in decimal */
+		name.len = sprintf(namebuff, "%"PRIu32, id);
+	} else if (idmapper_lookup_xdr(map, id, namebuff, &not_a_size_t)) {
+		/* Already encoded, length and padding included */
+		return XDR_PUTBYTES(xdrs, namebuff, not_a_size_t);
+	} else {
+		hit = idmapper_lookup_id(map, id, &name);
+		if (hit == IDMAP_MISS) {
+			known = id2name(id, group, &name);
+			idmapper_add_id(map, id, &name, !known);
+		} else {
+			known = hit == IDMAP_HIT;
 		}
-		not_a_size_t = new_name.len;
-		return inline_xdr_bytes(xdrs, (char **)&new_name.addr,
-					&not_a_size_t, UINT32_MAX);
+		idmapper_add_xdr(map, id, &name, !known);
 	}
+
+	not_a_size_t = name.len;
+	return inline_xdr_bytes(xdrs, (char **)&name.addr, &not_a_size_t,
+				UINT32_MAX);
 }
 
 /**
@@ -381,7 +356,6 @@ static int name_to_gid(const char *name, gid_t *gid)
  * @param[in]  name       C string of name
  * @param[in]  len        Length of name
  * @param[out] id         ID found
- * @param[in]  anon       ID to use in case of nobody
  * @param[in]  group      Whether this a group lookup
  * @param[out] gss_gid    Found GID
  * @param[out] gss_uid    Found UID
@@ -391,8 +365,7 @@ static int name_to_gid(const char *name, gid_t *gid)
  * @return true on success, false not making the grade
  */
 static bool pwentname2id(char *name, size_t len, uint32_t *id,
-			 const uint32_t anon, bool group, gid_t *gid,
-			 bool *got_gid, char *at)
+			 bool group, gid_t *gid, bool *got_gid, char *at)
 {
 	if (at != NULL) {
 		if (strcmp(at + 1, owner_domain.addr) != 0) {
@@ -470,7 +443,6 @@ static bool pwentname2id(char *name, size_t len, uint32_t *id,
  * @param[in]  name       C string of name
  * @param[in]  len        Length of name
  * @param[out] id         ID found
- * @param[in]  anon       ID to use in case of nobody
  * @param[in]  group      Whether this a group lookup
  * @param[out] gss_gid    Found GID
  * @param[out] gss_uid    Found UID
@@ -481,8 +453,7 @@ static bool pwentname2id(char *name, size_t len, uint32_t *id,
  */
 
 static bool idmapname2id(char *name, size_t len, uint32_t *id,
-			 const uint32_t anon, bool group, gid_t *gid,
-			 bool *got_gid, char *at)
+			 bool group, gid_t *gid, bool *got_gid, char *at)
 {
 #ifdef USE_NFSIDMAP
 	int rc;
@@ -506,6 +477,30 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 #endif				/* USE_NFSIDMAP */
 }
 
+/**
+ * @brief Look a name up with the configured mapper
+ *
+ * @param[in]  name    C string of name, may be changed
+ * @param[in]  len     Length of name
+ * @param[out] id      ID found
+ * @param[in]  group   Whether this a group lookup
+ * @param[out] gid     Found GID
+ * @param[out] got_gid Found a GID.
+ *
+ * @return true on success, false if the name is not known
+ */
+
+static bool name_resolve(char *name, size_t len, uint32_t *id, bool group,
+			 gid_t *gid, bool *got_gid)
+{
+	char *at = memchr(name, '@', len);
+
+	if (at == NULL || nfs_param.nfsv4_param.use_getpwnam)
+		return pwentname2id(name, len, id, group, gid, got_gid, at);
+
+	return idmapname2id(name, len, id, group, gid, got_gid, at);
+}
+
 /**
  * @brief Convert a name to an ID
  *
@@ -520,75 +515,41 @@ static bool idmapname2id(char *name, size_t len, uint32_t *id,
 static bool name2id(const struct gsh_buffdesc *name, uint32_t *id, bool group,
 		    const uint32_t anon)
 {
-	bool success;
-
-	PTHREAD_RWLOCK_rdlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-	if (group)
-		success = idmapper_lookup_by_gname(name, id);
-	else
-		success = idmapper_lookup_by_uname(name, id, NULL, false);
-	PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-			      &idmapper_user_lock);
-
-	if (success)
+	enum idmap_map map = group ? IDMAP_GNAME : IDMAP_UNAME;
+	enum idmap_hit hit;
+	gid_t gid;
+	bool got_gid = false;
+	/* Something we can mutate and count on as terminated */
+	char *namebuff;
+	bool at;
+
+	hit = idmapper_lookup_name(map, name, id, NULL, NULL);
+	if (hit == IDMAP_HIT)
 		return true;
-	else {
-		gid_t gid;
-		bool got_gid = false;
-		/* Something we can mutate and count on as terminated */
-		char *namebuff = alloca(name->len + 1);
-		char *at;
-		bool looked_up = false;
-
-		memcpy(namebuff, name->addr, name->len);
-		*(namebuff + name->len) = '\0';
-		at = memchr(namebuff, '@', name->len);
-
-		if (at == NULL) {
-			if (pwentname2id
-			    (namebuff, name->len, id, anon, group, &gid,
-			     &got_gid, NULL))
-				looked_up = true;
-			else if (atless2id(namebuff, name->len, id, anon))
-				looked_up = true;
-			else
-				return false;
-		} else if (nfs_param.nfsv4_param.use_getpwnam) {
-			looked_up =
-			    pwentname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		} else {
-			looked_up =
-			    idmapname2id(namebuff, name->len, id, anon, group,
-					 &gid, &got_gid, at);
-		}
 
-		if (!looked_up) {
-			LogInfo(COMPONENT_IDMAPPER,
-				"All lookups failed for %s, using anonymous.",
-				namebuff);
-			*id = anon;
-		}
+	namebuff = alloca(name->len + 1);
+	memcpy(namebuff, name->addr, name->len);
+	*(namebuff + name->len) = '\0';
+	at = memchr(namebuff, '@', name->len) != NULL;
 
-		PTHREAD_RWLOCK_wrlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
-		if (group)
-			success = idmapper_add_group(name, *id);
-		else
-			success =
-			    idmapper_add_user(name, *id, got_gid ? &gid : NULL,
-					      false);
+	if (hit == IDMAP_MISS) {
+		if (name_resolve(namebuff, name->len, id, group, &gid,
+				 &got_gid)) {
+			idmapper_add_name(map, name, *id,
+					  got_gid ? &gid : NULL, false);
+			return true;
+		}
+		/* Not known to the mapper, ask it again only on expiry */
+		idmapper_add_name(map, name, 0, NULL, true);
+	}
 
-		PTHREAD_RWLOCK_unlock(group ? &idmapper_group_lock :
-				      &idmapper_user_lock);
+	if (!at)
+		return atless2id(namebuff, name->len, id, anon);
 
-		if (!success)
-			LogMajor(COMPONENT_IDMAPPER, "%s(%s %u) failed",
-				 (group ? "gidmap_add" : "uidmap_add"),
-				 namebuff, *id);
-		return true;
-	}
+	LogInfo(COMPONENT_IDMAPPER,
+		"All lookups failed for %s, using anonymous.", namebuff);
+	*id = anon;
+	return true;
 }
 
 /**
@@ -648,9 +609,9 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 #ifdef USE_NFSIDMAP
 	uid_t gss_uid = -1;
 	gid_t gss_gid = -1;
-	const gid_t *gss_gidres = NULL;
+	bool gid_set = false;
+	enum idmap_hit hit;
 	int rc;
-	bool success;
 	struct gsh_buffdesc princbuff = {
 		.addr = principal,
 		.len = strlen(principal)
@@ -661,19 +622,20 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 		return false;
 
 #ifdef USE_NFSIDMAP
-	PTHREAD_RWLOCK_rdlock(&idmapper_user_lock);
-	success =
-	    idmapper_lookup_by_uname(&princbuff, &gss_uid, &gss_gidres, true);
+	hit = idmapper_lookup_name(IDMAP_PRINC, &princbuff, &gss_uid, &gss_gid,
+				   &gid_set);
+#ifdef _MSPAC_SUPPORT
+	/* The PAC may know who the mapper does not */
+	if (hit == IDMAP_NEGATIVE && (gd->flags & SVC_RPC_GSS_FLAG_MSPAC))
+		hit = IDMAP_MISS;
+#endif
+	if (hit == IDMAP_NEGATIVE)
+		return false;
 
 	/* We do need uid and gid. If gid is not in the cache, treat it as a
 	 * failure.
 	 */
-	if (success && gss_gidres != NULL)
-		gss_gid = *gss_gidres;
-	else
-		success = false;
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
-	if (unlikely(!success)) {
+	if (unlikely(hit == IDMAP_MISS || !gid_set)) {
 		if ((princbuff.len >= 4)
 		    && (!memcmp(princbuff.addr, "nfs/", 4)
 			|| !memcmp(princbuff.addr, "root/", 5)
@@ -764,22 +726,16 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 				goto principal_found;
 #endif
 
+			idmapper_add_name(IDMAP_PRINC, &princbuff, 0, NULL,
+					  true);
 			return false;
 		}
 #ifdef _MSPAC_SUPPORT
  principal_found:
 #endif
 
-		PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
-		success =
-		    idmapper_add_user(&princbuff, gss_uid, &gss_gid, true);
-		PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
-
-		if (!success) {
-			LogMajor(COMPONENT_IDMAPPER,
-				 "idmapper_add_user(%s, %d, %d) failed",
-				 principal, gss_uid, gss_gid);
-		}
+		idmapper_add_name(IDMAP_PRINC, &princbuff, gss_uid, &gss_gid,
+				  false);
 	}
 
 	*uid = gss_uid;
@@ -793,4 +749,53 @@ bool principal2uid(char *principal, uid_t *uid, gid_t *gid)
 }
 #endif
 
+/**
+ * @brief Look a cached entry up again and replace it
+ *
+ * Run by the idmapper_cache.c refresh threads for entries about to
+ * expire.  An entry the lookup fails for is left to expire, a passing
+ * failure of the directory service does not make it negative.
+ *
+ * @param[in] map  The map of the entry
+ * @param[in] name Its name, for the by-name maps
+ * @param[in] id   Its ID, for the by-ID maps
+ */
+
+void idmapper_refresh(enum idmap_map map, const struct gsh_buffdesc *name,
+		      uint32_t id)
+{
+	char idbuff[IDMAP_NAME_MAX];
+	struct gsh_buffdesc found = {
+		.addr = idbuff,
+		.len = 0
+	};
+	char *namebuff;
+	uint32_t new_id;
+	gid_t gid;
+	bool got_gid = false;
+
+	if (map == IDMAP_UID || map == IDMAP_GID) {
+		if (id2name(id, map == IDMAP_GID, &found))
+			idmapper_add_id(map, id, &found, false);
+		return;
+	}
+
+	namebuff = alloca(name->len + 1);
+	memcpy(namebuff, name->addr, name->len);
+	*(namebuff + name->len) = '\0';
+
+	if (map != IDMAP_PRINC) {
+		if (name_resolve(namebuff, name->len, &new_id,
+				 map == IDMAP_GNAME, &gid, &got_gid))
+			idmapper_add_name(map, name, new_id,
+					  got_gid ? &gid : NULL, false);
+		return;
+	}
+
+#ifdef USE_NFSIDMAP
+	if (nfs4_gss_princ_to_ids("krb5", namebuff, &new_id, &gid) == 0)
+		idmapper_add_name(map, name, new_id, &gid, false);
+#endif
+}
+
 /** @} */
@@ -30,239 +30,314 @@
 /**
  * @file    idmapper_cache.c
  * @brief   Id mapping cache functions
+ *
+ * One hash table per direction of mapping, see enum idmap_map.  The
+ * buckets of a table are split between partitions with a lock each,
+ * so lookups of different names or IDs seldom share a lock.
+ *
+ * Entries expire, after Idmap_Cache_Expiration seconds or, for those
+ * recording a failed lookup, Idmap_Negative_Expiration.  A hit in the
+ * last quarter of the life of an entry hands its refresh to the
+ * idmapper fridge, so an entry in use is replaced before it expires
+ * and requests do not wait on the directory service for it.
+ *
+ * In front of the UID and GID maps, direct mapped tables keep the
+ * names as put on the wire, length word and padding included, for
+ * the attribute encoder to copy.
  */
 #include "config.h"
 #include "log.h"
 #include "config_parsing.h"
 #include <string.h>
-#include <pwd.h>
-#include <grp.h>
+#include <time.h>
+#include <arpa/inet.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
 #include "common_utils.h"
-#include "avltree.h"
-#include "idmapper.h"
 #include "abstract_atomic.h"
+#include "city.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
+#include "idmapper.h"
 
-/**
- * @brief User entry in the IDMapper cache
- */
+/** Buckets of each map, a power of 2 */
+#define IDMAP_BUCKETS 1024
 
-struct cache_user {
-	struct gsh_buffdesc uname;	/*< Username */
-	uid_t uid;		/*< Corresponding UID */
-	gid_t gid;		/*< Corresponding GID */
-	bool gid_set;		/*< if the GID has been set */
-	struct avltree_node uname_node;	/*< Node in the name tree */
-	struct avltree_node uid_node;	/*< Node in the UID tree */
-	bool in_uidtree;		/* true iff this is in uid_tree */
-};
+/** Partitions of each map, a power of 2 */
+#define IDMAP_PARTS 32
 
 /**
- * @brief Group entry in the IDMapper cache
+ * @brief A mapping in the cache
+ *
+ * The key is the name for the by-name maps, the ID for the others.
  */
 
-struct cache_group {
-	struct gsh_buffdesc gname;	/*< Group name */
-	gid_t gid;		/*< Group ID */
-	struct avltree_node gname_node;	/*< Node in the name tree */
-	struct avltree_node gid_node;	/*< Node in the GID tree */
+struct idmap_entry {
+	struct idmap_entry *next;	/*< In the bucket */
+	uint64_t hash;
+	uint32_t id;		/*< UID or GID */
+	gid_t gid;		/*< Of a user or principal, if gid_set */
+	bool gid_set;
+	bool negative;		/*< The lookup failed */
+	uint32_t refreshing;	/*< A refresh is queued */
+	time_t refresh;		/*< Hits from then on refresh, 0 never */
+	time_t expire;		/*< 0 never */
+	struct gsh_buffdesc name;
 };
 
-/**
- * @brief Number of entires in the UID cache, should be prime.
- */
+struct idmap_table {
+	pthread_rwlock_t locks[IDMAP_PARTS];
+	struct idmap_entry *buckets[IDMAP_BUCKETS];
+};
 
-#define id_cache_size 1009
+static struct idmap_table idmap_tables[IDMAP_MAPS];
+
+/** Slots of each table of encoded names, a power of 2 */
+#define IDMAP_XDR_SLOTS 2048
 
 /**
- * @brief UID cache, may only be accessed with idmapper_user_lock
- * held.  If idmapper_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief A UID or GID name as put on the wire
  */
 
-static struct avltree_node *uid_cache[id_cache_size];
+struct idmap_xdr {
+	pthread_spinlock_t lock;
+	uint32_t id;
+	uint32_t len;		/*< Of xdr, 0 if unused */
+	time_t expire;		/*< 0 never */
+	char xdr[IDMAP_XDR_MAX];
+};
+
+/** UIDs, then GIDs */
+static struct idmap_xdr idmap_xdr_slots[2][IDMAP_XDR_SLOTS];
 
 /**
- * @brief GID cache, may only be accessed with idmapper_group_lock
- * held.  If idmapper_group_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
+ * @brief Runs the refreshes, NULL if it could not be started
  */
 
-static struct avltree_node *gid_cache[id_cache_size];
+static struct fridgethr *idmap_fridge;
 
 /**
- * @brief Lock that protects the idmapper user cache
+ * @brief A queued refresh
  */
 
-pthread_rwlock_t idmapper_user_lock = PTHREAD_RWLOCK_INITIALIZER;
+struct idmap_job {
+	enum idmap_map map;
+	uint32_t id;
+	struct gsh_buffdesc name;
+};
 
-/**
- * @brief Lock that protects the idmapper group cache
- */
+static inline bool idmap_by_id(enum idmap_map map)
+{
+	return map == IDMAP_UID || map == IDMAP_GID;
+}
 
-pthread_rwlock_t idmapper_group_lock = PTHREAD_RWLOCK_INITIALIZER;
+static inline uint64_t idmap_hash(enum idmap_map map,
+				  const struct gsh_buffdesc *name,
+				  uint32_t id)
+{
+	if (idmap_by_id(map))
+		return id * 0x9e3779b97f4a7c15ULL;
 
-/**
- * @brief Tree of users, by name
- */
+	return CityHash64(name->addr, name->len);
+}
 
-static struct avltree uname_tree;
+static inline uint32_t idmap_bucket(uint64_t hash)
+{
+	return (hash >> 32) & (IDMAP_BUCKETS - 1);
+}
 
-/**
- * @brief Tree of users, by ID
- */
+static inline pthread_rwlock_t *idmap_lock(struct idmap_table *table,
+					   uint32_t bucket)
+{
+	return &table->locks[bucket & (IDMAP_PARTS - 1)];
+}
 
-static struct avltree uid_tree;
+static inline bool idmap_match(enum idmap_map map,
+			       const struct idmap_entry *entry, uint64_t hash,
+			       const struct gsh_buffdesc *name, uint32_t id)
+{
+	if (entry->hash != hash)
+		return false;
 
-/**
- * @brief Tree of groups, by name
- */
-static struct avltree gname_tree;
+	if (idmap_by_id(map))
+		return entry->id == id;
 
-/**
- * @brief Tree of groups, by ID
- */
+	return entry->name.len == name->len &&
+	       memcmp(entry->name.addr, name->addr, name->len) == 0;
+}
+
+static inline bool idmap_expired(const struct idmap_entry *entry,
+				 time_t now)
+{
+	return entry->expire != 0 && entry->expire <= now;
+}
 
-static struct avltree gid_tree;
+static void idmap_refresh_run(struct fridgethr_context *ctx)
+{
+	struct idmap_job *job = ctx->arg;
+
+	idmapper_refresh(job->map, &job->name, job->id);
+	gsh_free(job);
+}
 
 /**
- * @brief Compare two buffers
- *
- * Handle the case where one buffer is a left sub-buffer of another
- * buffer by counting the longer one as larger.
+ * @brief Queue the refresh of an entry, once
  *
- * @param[in] buff1 A buffer
- * @param[in] buffa Another buffer
- *
- * @retval -1 if buff1 is less than buffa
- * @retval 0 if buff1 and buffa are equal
- * @retval 1 if buff1 is greater than buffa
+ * @note The partition of the entry is locked.  If the refresh fails
+ *       the entry is left to expire.
  */
 
-static inline int buffdesc_comparator(const struct gsh_buffdesc *buffa,
-				      const struct gsh_buffdesc *buff1)
+static void idmap_queue_refresh(enum idmap_map map, struct idmap_entry *entry)
 {
-	int mr = memcmp(buff1->addr, buffa->addr, MIN(buff1->len,
-						      buffa->len));
-	if (unlikely(mr == 0)) {
-		if (buff1->len < buffa->len)
-			return -1;
-		else if (buff1->len > buffa->len)
-			return 1;
-		else
-			return 0;
-	} else {
-		return mr;
+	struct idmap_job *job;
+	size_t len = idmap_by_id(map) ? 0 : entry->name.len;
+
+	if (idmap_fridge == NULL ||
+	    atomic_postset_uint32_t_bits(&entry->refreshing, 1) != 0)
+		return;
+
+	job = gsh_malloc(sizeof(*job) + len);
+	job->map = map;
+	job->id = entry->id;
+	job->name.addr = (char *)job + sizeof(*job);
+	job->name.len = len;
+	memcpy(job->name.addr, entry->name.addr, len);
+
+	if (fridgethr_submit(idmap_fridge, idmap_refresh_run, job) != 0) {
+		LogDebug(COMPONENT_IDMAPPER, "Could not queue a refresh");
+		gsh_free(job);
 	}
 }
 
 /**
- * @brief Comparison for user names
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * @brief Look an entry up and copy it out
+ *
+ * @param[in]  map   The map
+ * @param[in]  name  The name, for the by-name maps
+ * @param[in]  id    The ID, for the by-ID maps
+ * @param[out] found The entry, name excepted
+ * @param[out] buf   Of IDMAP_NAME_MAX bytes, gets the name of a by-ID
+ *                   entry
  */
 
-static int uname_comparator(const struct avltree_node *node1,
-			    const struct avltree_node *nodea)
+static enum idmap_hit idmap_lookup(enum idmap_map map,
+				   const struct gsh_buffdesc *name,
+				   uint32_t id, struct idmap_entry *found,
+				   char *buf)
 {
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uname_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uname_node);
-
-	return buffdesc_comparator(&user1->uname, &usera->uname);
+	struct idmap_table *table = &idmap_tables[map];
+	uint64_t hash = idmap_hash(map, name, id);
+	uint32_t bucket = idmap_bucket(hash);
+	pthread_rwlock_t *lock = idmap_lock(table, bucket);
+	struct idmap_entry *entry;
+	enum idmap_hit hit = IDMAP_MISS;
+	time_t now = time(NULL);
+
+	PTHREAD_RWLOCK_rdlock(lock);
+
+	for (entry = table->buckets[bucket]; entry != NULL;
+	     entry = entry->next) {
+		if (!idmap_match(map, entry, hash, name, id))
+			continue;
+
+		if (idmap_expired(entry, now))
+			break;
+
+		*found = *entry;
+		if (buf != NULL)
+			memcpy(buf, entry->name.addr, entry->name.len);
+
+		if (entry->negative) {
+			hit = IDMAP_NEGATIVE;
+		} else {
+			if (entry->refresh != 0 && entry->refresh <= now)
+				idmap_queue_refresh(map, entry);
+			hit = IDMAP_HIT;
+		}
+		break;
+	}
+
+	PTHREAD_RWLOCK_unlock(lock);
+
+	return hit;
 }
 
 /**
- * @brief Comparison for UIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
+ * @brief Insert an entry, replacing the one of the same key
  *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
+ * Expired entries met in the bucket are dropped on the way.
  */
 
-static int uid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static void idmap_insert(enum idmap_map map, struct idmap_entry *new)
 {
-	struct cache_user *user1 =
-	    avltree_container_of(node1, struct cache_user,
-				 uid_node);
-	struct cache_user *usera =
-	    avltree_container_of(nodea, struct cache_user,
-				 uid_node);
-
-	if (user1->uid < usera->uid)
-		return -1;
-	else if (user1->uid > usera->uid)
-		return 1;
-	else
-		return 0;
-}
+	struct idmap_table *table = &idmap_tables[map];
+	uint32_t bucket = idmap_bucket(new->hash);
+	pthread_rwlock_t *lock = idmap_lock(table, bucket);
+	struct idmap_entry **prev, *entry;
+	time_t now = time(NULL);
+
+	PTHREAD_RWLOCK_wrlock(lock);
+
+	prev = &table->buckets[bucket];
+	while ((entry = *prev) != NULL) {
+		if (idmap_expired(entry, now) ||
+		    idmap_match(map, entry, new->hash, &new->name, new->id)) {
+			*prev = entry->next;
+			gsh_free(entry);
+		} else {
+			prev = &entry->next;
+		}
+	}
 
-/**
- * @brief Comparison for group names
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
+	new->next = table->buckets[bucket];
+	table->buckets[bucket] = new;
 
-static inline int gname_comparator(const struct avltree_node *node1,
-				   const struct avltree_node *nodea)
+	PTHREAD_RWLOCK_unlock(lock);
+}
+
+static inline struct idmap_xdr *idmap_xdr_slot(enum idmap_map map,
+					       uint32_t id)
 {
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gname_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gname_node);
-
-	return buffdesc_comparator(&group1->gname, &groupa->gname);
+	return &idmap_xdr_slots[map == IDMAP_GID]
+			       [idmap_bucket(idmap_hash(map, NULL, id)) &
+				(IDMAP_XDR_SLOTS - 1)];
 }
 
-/**
- * @brief Comparison for GIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
+static void idmap_xdr_drop(enum idmap_map map, uint32_t id)
+{
+	struct idmap_xdr *slot = idmap_xdr_slot(map, id);
+
+	pthread_spin_lock(&slot->lock);
+	if (slot->id == id)
+		slot->len = 0;
+	pthread_spin_unlock(&slot->lock);
+}
 
-static int gid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static struct idmap_entry *idmap_new(enum idmap_map map,
+				     const struct gsh_buffdesc *name,
+				     uint32_t id, bool negative)
 {
-	struct cache_group *group1 =
-	    avltree_container_of(node1, struct cache_group,
-				 gid_node);
-	struct cache_group *groupa =
-	    avltree_container_of(nodea, struct cache_group,
-				 gid_node);
-
-	if (group1->gid < groupa->gid)
-		return -1;
-	else if (group1->gid > groupa->gid)
-		return 1;
-	else
-		return 0;
+	uint32_t ttl = negative ?
+		nfs_param.nfsv4_param.idmap_negative_expiration :
+		nfs_param.nfsv4_param.idmap_cache_expiration;
+	struct idmap_entry *new;
+	time_t now = time(NULL);
+
+	new = gsh_calloc(1, sizeof(*new) + name->len);
+	new->name.addr = (char *)new + sizeof(*new);
+	new->name.len = name->len;
+	memcpy(new->name.addr, name->addr, name->len);
+	new->id = id;
+	new->hash = idmap_hash(map, name, id);
+	new->negative = negative;
+
+	if (ttl != 0) {
+		new->expire = now + ttl;
+		if (!negative)
+			new->refresh = new->expire - ttl / 4;
+	}
+
+	return new;
 }
 
 /**
@@ -271,398 +346,204 @@ static int gid_comparator(const struct avltree_node *node1,
 
 void idmapper_cache_init(void)
 {
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	struct fridgethr_params frp;
+	int map, i;
+
+	for (map = 0; map < IDMAP_MAPS; map++)
+		for (i = 0; i < IDMAP_PARTS; i++)
+			PTHREAD_RWLOCK_init(&idmap_tables[map].locks[i], NULL);
+
+	for (i = 0; i < IDMAP_XDR_SLOTS; i++) {
+		pthread_spin_init(&idmap_xdr_slots[0][i].lock,
+				  PTHREAD_PROCESS_PRIVATE);
+		pthread_spin_init(&idmap_xdr_slots[1][i].lock,
+				  PTHREAD_PROCESS_PRIVATE);
+	}
 
-	avltree_init(&gname_tree, gname_comparator, 0);
-	avltree_init(&gid_tree, gid_comparator, 0);
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 2;
+	frp.deferment = fridgethr_defer_queue;
+
+	if (fridgethr_init(&idmap_fridge, "idmapper", &frp) != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to start the refresh threads, entries will only expire");
+		idmap_fridge = NULL;
+	}
 }
 
 /**
- * @brief Add a user entry to the cache
+ * @brief Look up a name
  *
- * @note The caller must hold idmapper_user_lock for write.
+ * @param[in]  map     IDMAP_UNAME, IDMAP_PRINC or IDMAP_GNAME
+ * @param[in]  name    The name
+ * @param[out] id      The UID or GID
+ * @param[out] gid     The GID of a user or principal, may be NULL
+ * @param[out] gid_set Whether there is one, may be NULL
  *
- * @param[in] name The user name
- * @param[in] uid  The user ID
- * @param[in] gid  Optional.  Set to NULL if no gid is known.
- * @param[in] gss_princ true when name is gss principal.
- *                      The uid to name map is not added for gss principals.
- *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
+ * @return Whether the name is cached, and whether as unknown.
  */
 
-bool idmapper_add_user(const struct gsh_buffdesc *name, uid_t uid,
-		       const gid_t *gid, bool gss_princ)
+enum idmap_hit idmapper_lookup_name(enum idmap_map map,
+				    const struct gsh_buffdesc *name,
+				    uint32_t *id, gid_t *gid, bool *gid_set)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_user *old;
-	struct cache_user *new;
-
-	new = gsh_malloc(sizeof(struct cache_user) + name->len);
-
-	new->uname.addr = (char *)new + sizeof(struct cache_user);
-	new->uname.len = name->len;
-	new->uid = uid;
-	memcpy(new->uname.addr, name->addr, name->len);
-	if (gid) {
-		new->gid = *gid;
-		new->gid_set = true;
-	} else {
-		new->gid = -1;
-		new->gid_set = false;
-	}
-	new->in_uidtree = (gss_princ) ? false : true;
-
-	/*
-	 * There are 3 cases why we find an existing cache entry.
-	 *
-	 * Case 1:
-	 * The threads that lookup by-name or by-id use the read lock.
-	 * If they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping.
-	 *
-	 * Case 2:
-	 * It is also possible that name got a different id or an id got
-	 * a different name causing us to find an existing entry when we
-	 * are trying to add an entry. This case calls for removing the
-	 * stale entry and update with this new entry.
-	 *
-	 * Case 3:
-	 * The username to id mapping could be from plain nfs idmapping
-	 * in which case we will not have a valid gid. If this is for a
-	 * kerberos principal mapping, we will have uid and gid but we
-	 * will not have "uid to name" cache entry (the reverse
-	 * mapping). This case requires us to combine the old entry and
-	 * the new entry!
-	 *
-	 * Note that the 3rd case happens if and only if IDMAPD_DOMAIN
-	 * and LOCAL_REALMS are set to the same value!
-	 */
-	found_name = avltree_insert(&new->uname_node, &uname_tree);
-	if (unlikely(found_name)) {
-		old = avltree_container_of(found_name, struct cache_user,
-					   uname_node);
-		/* Combine old into new if uid's match */
-		if (old->uid == new->uid) {
-			if (!new->gid_set && old->gid_set) {
-				new->gid = old->gid;
-				new->gid_set = true;
-			}
-			if (!new->in_uidtree && old->in_uidtree)
-				new->in_uidtree = true;
-		}
+	struct idmap_entry found;
+	enum idmap_hit hit = idmap_lookup(map, name, 0, &found, NULL);
 
-		/* Remove the old and insert the new */
-		avltree_remove(found_name, &uname_tree);
-		if (old->in_uidtree) {
-			uid_cache[old->uid % id_cache_size] = NULL;
-			avltree_remove(&old->uid_node, &uid_tree);
-		}
-		gsh_free(old);
-		found_name = avltree_insert(&new->uname_node, &uname_tree);
-		assert(found_name == NULL);
-	}
+	if (hit != IDMAP_HIT)
+		return hit;
 
-	if (!new->in_uidtree) /* all done */
-		return true;
-
-	found_id = avltree_insert(&new->uid_node, &uid_tree);
-	if (unlikely(found_id)) {
-		old = avltree_container_of(found_id, struct cache_user,
-					   uid_node);
-		uid_cache[old->uid % id_cache_size] = NULL;
-		avltree_remove(found_id, &uid_tree);
-		avltree_remove(&old->uname_node, &uname_tree);
-		gsh_free(old);
-		found_id = avltree_insert(&new->uid_node, &uid_tree);
-		assert(found_id == NULL);
-	}
-	uid_cache[uid % id_cache_size] = &new->uid_node;
+	*id = found.id;
+	if (gid != NULL && found.gid_set)
+		*gid = found.gid;
+	if (gid_set != NULL)
+		*gid_set = found.gid_set;
 
-	return true;
+	return hit;
 }
 
 /**
- * @brief Add a group entry to the cache
+ * @brief Look up an ID
  *
- * @note The caller must hold idmapper_group_lock for write.
+ * A negative entry still gives a name, the one to report instead.
  *
- * @param[in] name The user name
- * @param[in] gid  The group id
+ * @param[in]  map  IDMAP_UID or IDMAP_GID
+ * @param[in]  id   The UID or GID
+ * @param[out] name Its addr is a buffer of IDMAP_NAME_MAX bytes, gets
+ *                  the name
  *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
+ * @return Whether the ID is cached, and whether as unknown.
  */
 
-bool idmapper_add_group(const struct gsh_buffdesc *name, const gid_t gid)
+enum idmap_hit idmapper_lookup_id(enum idmap_map map, uint32_t id,
+				  struct gsh_buffdesc *name)
 {
-	struct avltree_node *found_name;
-	struct avltree_node *found_id;
-	struct cache_group *tmp;
-	struct cache_group *new;
-
-	new = gsh_malloc(sizeof(struct cache_group) + name->len);
-
-	new->gname.addr = (char *)new + sizeof(struct cache_group);
-	new->gname.len = name->len;
-	new->gid = gid;
-	memcpy(new->gname.addr, name->addr, name->len);
-
-	/*
-	 * The threads that lookup by-name or by-id use the read lock. If
-	 * they don't find an entry, then they release the read lock,
-	 * acquire the write lock and then add the entry. So it is
-	 * possible that multiple threads may fail to find an entry at
-	 * one point and they all try to add. In this case, we will be
-	 * trying to insert same name,id mapping. It is also possible
-	 * that name got a different id or an id got a different name
-	 * causing us to find an existing entry when we are trying to
-	 * add an entry!
-	 *
-	 * If we find an existing entry, we remove it from both the name
-	 * and the id AVL trees, and then add the new entry.
-	 */
-	found_name = avltree_insert(&new->gname_node, &gname_tree);
-	if (unlikely(found_name)) {
-		tmp = avltree_container_of(found_name, struct cache_group,
-					   gname_node);
-		avltree_remove(found_name, &gname_tree);
-		avltree_remove(&tmp->gid_node, &gid_tree);
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		gsh_free(tmp);
-		found_name = avltree_insert(&new->gname_node, &gname_tree);
-		assert(found_name == NULL);
-	}
+	struct idmap_entry found;
+	enum idmap_hit hit = idmap_lookup(map, NULL, id, &found, name->addr);
 
-	found_id = avltree_insert(&new->gid_node, &gid_tree);
-	if (unlikely(found_id)) {
-		tmp = avltree_container_of(found_id, struct cache_group,
-					   gid_node);
-
-		gid_cache[tmp->gid % id_cache_size] = NULL;
-		avltree_remove(found_id, &gid_tree);
-		avltree_remove(&tmp->gname_node, &gname_tree);
-		gsh_free(tmp);
-		found_id = avltree_insert(&new->gid_node, &gid_tree);
-		assert(found_id == NULL);
-	}
-	gid_cache[gid % id_cache_size] = &new->gid_node;
+	if (hit != IDMAP_MISS)
+		name->len = found.name.len;
 
-	return true;
+	return hit;
 }
 
 /**
- * @brief Look up a user by name
- *
- * @note The caller must hold idmapper_user_lock for read.
+ * @brief Cache a name
  *
- * @param[in]  name The user name to look up.
- * @param[out] uid  The user ID found.  May be NULL if the caller
- *                  isn't interested in the UID.  (This seems
- *                  unlikely.)
- * @param[out] gid  The GID for the user, or NULL if there is
- *                  none. The caller may specify NULL if it isn't
- *                  interested.
- *
- * @retval true on success.
- * @retval false if we need to try, try again.
+ * @param[in] map      IDMAP_UNAME, IDMAP_PRINC or IDMAP_GNAME
+ * @param[in] name     The name
+ * @param[in] id       Its UID or GID
+ * @param[in] gid      GID of a user or principal, NULL if none
+ * @param[in] negative The name is unknown to the mapper
  */
 
-bool idmapper_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
-			      const gid_t **gid, bool gss_princ)
+void idmapper_add_name(enum idmap_map map, const struct gsh_buffdesc *name,
+		       uint32_t id, const gid_t *gid, bool negative)
 {
-	struct cache_user prototype = {
-		.uname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.uname_node,
-							 &uname_tree);
-	struct cache_user *found_user;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
+	struct idmap_entry *new;
 
-	found_user =
-	    avltree_container_of(found_node, struct cache_user, uname_node);
-	if (!gss_princ) {
-		/* I assume that if someone likes this user enough to look it
-		   up by name, they'll like it enough to look it up by ID
-		   later.
+	if (negative && nfs_param.nfsv4_param.idmap_negative_expiration == 0)
+		return;
 
-		   If the name is gss principal it does not have entry
-		   in uid tree */
-
-		cache_slot = (void **)
-			&uid_cache[found_user->uid % id_cache_size];
-		atomic_store_voidptr(cache_slot, &found_user->uid_node);
+	new = idmap_new(map, name, id, negative);
+	if (gid != NULL) {
+		new->gid = *gid;
+		new->gid_set = true;
 	}
 
-	if (likely(uid))
-		*uid = found_user->uid;
-
-	if (unlikely(gid))
-		*gid = (found_user->gid_set ? &found_user->gid : NULL);
-
-	return true;
+	idmap_insert(map, new);
 }
 
 /**
- * @brief Look up a user by ID
- *
- * @note The caller must hold idmapper_user_lock for read.
+ * @brief Cache an ID
  *
- * @param[in]  uid  The user ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name.)
- * @param[out] gid  The GID for the user, or NULL if there is
- *                  none. The caller may specify NULL if it isn't
- *                  interested.
- *
- * @retval true on success.
- * @retval false if we weren't so successful.
+ * @param[in] map      IDMAP_UID or IDMAP_GID
+ * @param[in] id       The UID or GID
+ * @param[in] name     Its name, or the one to report if negative
+ * @param[in] negative The ID is unknown to the mapper
  */
 
-bool idmapper_lookup_by_uid(const uid_t uid, const struct gsh_buffdesc **name,
-			    const gid_t **gid)
+void idmapper_add_id(enum idmap_map map, uint32_t id,
+		     const struct gsh_buffdesc *name, bool negative)
 {
-	struct cache_user prototype = {
-		.uid = uid
-	};
-	void **cache_slot = (void **)&uid_cache[uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_user *found_user;
-	bool found = false;
+	/* What was encoded from an older entry goes */
+	idmap_xdr_drop(map, id);
 
-	if (likely(found_node)) {
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
-		if (found_user->uid == uid)
-			found = true;
-	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
-
-		atomic_store_voidptr(cache_slot, found_node);
-		found_user = avltree_container_of(found_node,
-						  struct cache_user,
-						  uid_node);
-	}
+	if (name->len > IDMAP_NAME_MAX ||
+	    (negative && nfs_param.nfsv4_param.idmap_negative_expiration == 0))
+		return;
 
-	if (likely(name))
-		*name = &found_user->uname;
-
-	if (gid)
-		*gid = (found_user->gid_set ? &found_user->gid : NULL);
-
-	return true;
+	idmap_insert(map, idmap_new(map, name, id, negative));
 }
 
 /**
- * @brief Lookup a group by name
+ * @brief Look up the wire form of the name of an ID
  *
- * @note The caller must hold idmapper_group_lock for read.
+ * @param[in]  map IDMAP_UID or IDMAP_GID
+ * @param[in]  id  The UID or GID
+ * @param[out] buf Of IDMAP_XDR_MAX bytes, gets the XDR opaque
+ * @param[out] len Its length
  *
- * @param[in]  name The user name to look up.
- * @param[out] gid  The group ID found.  May be NULL if the caller
- *                  isn't interested in the GID.  (This seems
- *                  unlikely, since you can't get anything else from
- *                  this function.)
- *
- * @retval true on success.
- * @retval false if we need to try, try again.
+ * @return true if found.
  */
 
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *name, uid_t *gid)
+bool idmapper_lookup_xdr(enum idmap_map map, uint32_t id, char *buf,
+			 uint32_t *len)
 {
-	struct cache_group prototype = {
-		.gname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.gname_node,
-							 &gname_tree);
-	struct cache_group *found_group;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
-
-	found_group =
-	    avltree_container_of(found_node, struct cache_group, gname_node);
+	struct idmap_xdr *slot = idmap_xdr_slot(map, id);
+	bool found = false;
 
-	/* I assume that if someone likes this group enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
+	pthread_spin_lock(&slot->lock);
 
-	cache_slot = (void **)&gid_cache[found_group->gid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_group->gid_node);
+	if (slot->id == id && slot->len != 0 &&
+	    (slot->expire == 0 || slot->expire > time(NULL))) {
+		*len = slot->len;
+		memcpy(buf, slot->xdr, slot->len);
+		found = true;
+	}
 
-	if (likely(gid))
-		*gid = found_group->gid;
-	else
-		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
+	pthread_spin_unlock(&slot->lock);
 
-	return true;
+	return found;
 }
 
 /**
- * @brief Look up a group by ID
- *
- * @note The caller must hold idmapper_group_lock for read.
+ * @brief Keep the wire form of the name of an ID
  *
- * @param[in]  gid  The group ID to look up.
- * @param[out] name The user name to look up. (May be NULL if the user
- *                  doesn't care about the name, which would be weird.)
+ * Names too long for a slot are not kept.
  *
- * @retval true on success.
- * @retval false if we're most unfortunate.
+ * @param[in] map      IDMAP_UID or IDMAP_GID
+ * @param[in] id       The UID or GID
+ * @param[in] name     Its name, as reported
+ * @param[in] negative The ID is unknown to the mapper
  */
 
-bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
+void idmapper_add_xdr(enum idmap_map map, uint32_t id,
+		      const struct gsh_buffdesc *name, bool negative)
 {
-	struct cache_group prototype = {
-		.gid = gid
-	};
-	void **cache_slot = (void **)&gid_cache[gid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_group *found_group;
-	bool found = false;
-
-	if (likely(found_node)) {
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
-		if (found_group->gid == gid)
-			found = true;
-	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.gid_node, &gid_tree);
-		if (unlikely(!found_node))
-			return false;
-
-		atomic_store_voidptr(cache_slot, found_node);
-		found_group = avltree_container_of(found_node,
-						   struct cache_group,
-						   gid_node);
-	}
-
-	if (likely(name))
-		*name = &found_group->gname;
-	else
-		LogDebug(COMPONENT_IDMAPPER, "Caller is being weird.");
-
-	return true;
+	struct idmap_xdr *slot = idmap_xdr_slot(map, id);
+	uint32_t ttl = negative ?
+		nfs_param.nfsv4_param.idmap_negative_expiration :
+		nfs_param.nfsv4_param.idmap_cache_expiration;
+	uint32_t pad = (BYTES_PER_XDR_UNIT - name->len % BYTES_PER_XDR_UNIT) %
+		       BYTES_PER_XDR_UNIT;
+	uint32_t len = BYTES_PER_XDR_UNIT + name->len + pad;
+	uint32_t word = htonl(name->len);
+
+	if (name->len > IDMAP_XDR_MAX || len > IDMAP_XDR_MAX ||
+	    (negative && ttl == 0))
+		return;
+
+	pthread_spin_lock(&slot->lock);
+
+	slot->id = id;
+	slot->len = len;
+	slot->expire = ttl != 0 ? time(NULL) + ttl : 0;
+	memcpy(slot->xdr, &word, BYTES_PER_XDR_UNIT);
+	memcpy(slot->xdr + BYTES_PER_XDR_UNIT, name->addr, name->len);
+	memset(slot->xdr + BYTES_PER_XDR_UNIT + name->len, 0, pad);
+
+	pthread_spin_unlock(&slot->lock);
 }
 
 /**
@@ -671,44 +552,34 @@ bool idmapper_lookup_by_gid(const gid_t gid, const struct gsh_buffdesc **name)
 
 void idmapper_clear_cache(void)
 {
-	struct avltree_node *node;
-
-	PTHREAD_RWLOCK_wrlock(&idmapper_user_lock);
-	PTHREAD_RWLOCK_wrlock(&idmapper_group_lock);
-
-	memset(uid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-	memset(gid_cache, 0, id_cache_size * sizeof(struct avltree_node *));
-
-	for (node = avltree_first(&uname_tree);
-	     node != NULL;
-	     node = avltree_first(&uname_tree)) {
-		struct cache_user *user;
-
-		user = avltree_container_of(node,
-					    struct cache_user, uname_node);
-		avltree_remove(&user->uname_node, &uname_tree);
-		avltree_remove(&user->uid_node, &uid_tree);
-		gsh_free(user);
+	struct idmap_table *table;
+	struct idmap_entry *entry;
+	struct idmap_xdr *slot;
+	pthread_rwlock_t *lock;
+	int map;
+	uint32_t bucket;
+
+	for (bucket = 0; bucket < IDMAP_XDR_SLOTS; bucket++) {
+		for (map = 0; map < 2; map++) {
+			slot = &idmap_xdr_slots[map][bucket];
+			pthread_spin_lock(&slot->lock);
+			slot->len = 0;
+			pthread_spin_unlock(&slot->lock);
+		}
 	}
 
-	assert(avltree_first(&uid_tree) == NULL);
-
-	for (node = avltree_first(&gname_tree);
-	     node != NULL;
-	     node = avltree_first(&gname_tree)) {
-		struct cache_group *group;
-
-		group = avltree_container_of(node,
-					     struct cache_group, gname_node);
-		avltree_remove(&group->gname_node, &gname_tree);
-		avltree_remove(&group->gid_node, &gid_tree);
-		gsh_free(group);
+	for (map = 0; map < IDMAP_MAPS; map++) {
+		table = &idmap_tables[map];
+		for (bucket = 0; bucket < IDMAP_BUCKETS; bucket++) {
+			lock = idmap_lock(table, bucket);
+			PTHREAD_RWLOCK_wrlock(lock);
+			while ((entry = table->buckets[bucket]) != NULL) {
+				table->buckets[bucket] = entry->next;
+				gsh_free(entry);
+			}
+			PTHREAD_RWLOCK_unlock(lock);
+		}
 	}
-
-	assert(avltree_first(&gid_tree) == NULL);
-
-	PTHREAD_RWLOCK_unlock(&idmapper_group_lock);
-	PTHREAD_RWLOCK_unlock(&idmapper_user_lock);
 }
 
 /** @} */
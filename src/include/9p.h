@@ -35,7 +35,11 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sys/select.h>
+#include <sys/socket.h>
 #include <fcntl.h>
+#ifdef LINUX
+#include <linux/errqueue.h>
+#endif
 
 #include "9p_types.h"
 #include "fsal_types.h"
@@ -53,10 +57,25 @@
 
 #define _9P_LOCK_CLIENT_LEN 64
 
-#define _9P_FID_PER_CONN        1024
+/* Most fids a connection may hold at once */
+#define _9P_FID_PER_CONN        65536
+
+/* Slots of a fid map when its first fid is set */
+#define _9P_FID_MAP_MIN 16
+
+/* Most 9P/TCP replies sent together by one sendmsg */
+#define _9P_TCP_SEND_BATCH 64
+
+/* Whether 9P/TCP replies may be sent with MSG_ZEROCOPY */
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && \
+	defined(SO_EE_ORIGIN_ZEROCOPY)
+#define _9P_TCP_ZEROCOPY
+#endif
 
-/* _9P_MSG_SIZE: maximum message size for 9P/TCP */
-#define _9P_MSG_SIZE 70000
+/* _9P_MSIZE_MAX: largest msize for 9P/TCP, the top I/O buffer class.
+ * Buffers are sized for each message, not for msize.
+ */
+#define _9P_MSIZE_MAX (64 * 1024 * 1024)
 
 #define _9P_HDR_SIZE  4
 #define _9P_TYPE_SIZE 1
@@ -349,6 +368,24 @@ struct _9p_flush_bucket {
 	struct glist_head list;
 };
 
+struct _9p_fid_slot {
+	u32 fid;
+	struct _9p_fid *pfid;	/*< NULL for a free slot */
+};
+
+/**
+ * @brief Fids of a connection, by fid number
+ *
+ * Open addressing with linear probing.  The slots are allocated with the
+ * first fid, and grow and shrink with the fids in use.
+ */
+struct _9p_fid_map {
+	pthread_rwlock_t lock;
+	uint32_t size;		/*< Slots, a power of 2, or 0 */
+	uint32_t count;		/*< Slots in use */
+	struct _9p_fid_slot *slots;
+};
+
 #define FLUSH_BUCKETS 32
 
 struct _9p_conn {
@@ -363,10 +400,16 @@ struct _9p_conn {
 	struct gsh_client *client;
 	struct timeval birth;	/* This is useful if same sockfd is
 				   reused on socket's close/open */
-	struct _9p_fid *fids[_9P_FID_PER_CONN];
+	struct _9p_fid_map fids;
 	struct _9p_flush_bucket flush_buckets[FLUSH_BUCKETS];
 	unsigned long sequence;
 	pthread_mutex_t sock_lock;
+	struct glist_head send_queue;	/*< TCP replies waiting to be sent */
+	struct glist_head zc_pending;	/*< Sent with MSG_ZEROCOPY, the
+					    kernel still using them */
+	uint32_t zc_next;		/*< Number of the next zerocopy send */
+	bool sending;			/*< A worker sends send_queue */
+	bool zerocopy;			/*< SO_ZEROCOPY set on the socket */
 	struct sockaddr_storage addrpeer;
 	struct export_perms export_perms;
 	unsigned int msize;
@@ -617,6 +660,18 @@ do {                                                   \
  */
 #define _9P_RDMA_BACKLOG 10
 
+/**
+ * @brief Default number of 9P/TCP I/O threads
+ */
+#define _9P_TCP_IO_THREADS 4
+#define _9P_TCP_ZEROCOPY_THRESHOLD 0
+
+/**
+ * @brief Default size up to which 9P/RDMA requests are copied out of
+ * their receive buffer
+ */
+#define _9P_RDMA_COPY_THRESHOLD 4096
+
 
 /**
  * @brief 9p configuration
@@ -646,6 +701,20 @@ struct _9p_param {
 	    Defaults to _9P_RDMA_OUTPOOL_SIZE,
 	    settable by _9P_RDMA_OutPool_Size */
 	uint16_t _9p_rdma_outpool_size;
+	/** 9P/RDMA requests up to that size are copied so that their
+	    receive buffer is reposted at once, 0 for none.
+	    Defaults to _9P_RDMA_COPY_THRESHOLD,
+	    settable by _9P_RDMA_Copy_Threshold */
+	uint32_t _9p_rdma_copy_threshold;
+	/** Threads reading the 9P/TCP sockets, 0 for one thread per
+	    connection.  Linux only.  Defaults to _9P_TCP_IO_THREADS,
+	    settable by _9P_TCP_IO_Threads */
+	uint32_t _9p_tcp_io_threads;
+	/** 9P/TCP replies of that size or larger are sent with
+	    MSG_ZEROCOPY, 0 for none.  Linux only, with I/O threads.
+	    Defaults to _9P_TCP_ZEROCOPY_THRESHOLD,
+	    settable by _9P_TCP_Zerocopy_Threshold */
+	uint32_t _9p_tcp_zerocopy_threshold;
 
 };
 
@@ -713,6 +782,10 @@ int _9p_tools_get_req_context_by_name(int uname_len, char *uname_str,
 int _9p_tools_errno(fsal_status_t fsal_status);
 void _9p_openflags2FSAL(u32 *inflags, fsal_openflags_t *outflags);
 int _9p_tools_clunk(struct _9p_fid *pfid);
+void _9p_init_fids(struct _9p_conn *conn);
+struct _9p_fid *_9p_getfid(struct _9p_conn *conn, u32 fid);
+void _9p_setfid(struct _9p_conn *conn, u32 fid, struct _9p_fid *pfid);
+bool _9p_canaddfid(struct _9p_conn *conn, u32 fid);
 void _9p_cleanup_fids(struct _9p_conn *conn);
 
 static inline unsigned int _9p_openflags_to_share_access(u32 *inflags)
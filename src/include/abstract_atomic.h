@@ -72,6 +72,7 @@
 #define _ABSTRACT_ATOMIC_H
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
 
 #undef GCC_SYNC_FUNCTIONS
@@ -2470,4 +2471,114 @@ static inline void atomic_store_uint8_t(uint8_t *var, uint8_t val)
 	(void)__sync_lock_test_and_set(var, val);
 }
 #endif
+
+/**
+ * @brief Atomically compare and swap a uint64_t
+ *
+ * This function stores val in the variable indicated by the supplied
+ * pointer if and only if it currently holds cmp.
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     cmp The value var is expected to hold
+ * @param[in]     val The value to store
+ *
+ * @return true if the swap took place.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cmpxchg_uint64_t(uint64_t *var, uint64_t cmp,
+					   uint64_t val)
+{
+	return __atomic_compare_exchange_n(var, &cmp, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cmpxchg_uint64_t(uint64_t *var, uint64_t cmp,
+					   uint64_t val)
+{
+	return __sync_bool_compare_and_swap(var, cmp, val);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap an int32_t
+ *
+ * This function stores val in the variable indicated by the supplied
+ * pointer if and only if it currently holds cmp.
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     cmp The value var is expected to hold
+ * @param[in]     val The value to store
+ *
+ * @return true if the swap took place.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cmpxchg_int32_t(int32_t *var, int32_t cmp,
+					  int32_t val)
+{
+	return __atomic_compare_exchange_n(var, &cmp, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cmpxchg_int32_t(int32_t *var, int32_t cmp,
+					  int32_t val)
+{
+	return __sync_bool_compare_and_swap(var, cmp, val);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a uint32_t
+ *
+ * This function stores val in the variable indicated by the supplied
+ * pointer if and only if it currently holds cmp.
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     cmp The value var is expected to hold
+ * @param[in]     val The value to store
+ *
+ * @return true if the swap took place.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cmpxchg_uint32_t(uint32_t *var, uint32_t cmp,
+					   uint32_t val)
+{
+	return __atomic_compare_exchange_n(var, &cmp, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cmpxchg_uint32_t(uint32_t *var, uint32_t cmp,
+					   uint32_t val)
+{
+	return __sync_bool_compare_and_swap(var, cmp, val);
+}
+#endif
+
+/**
+ * @brief Atomically compare and swap a void *
+ *
+ * This function stores val in the variable indicated by the supplied
+ * pointer if and only if it currently holds cmp.
+ *
+ * @param[in,out] var Pointer to the variable to modify
+ * @param[in]     cmp The value var is expected to hold
+ * @param[in]     val The value to store
+ *
+ * @return true if the swap took place.
+ */
+
+#ifdef GCC_ATOMIC_FUNCTIONS
+static inline bool atomic_cmpxchg_voidptr(void **var, void *cmp, void *val)
+{
+	return __atomic_compare_exchange_n(var, &cmp, val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#elif defined(GCC_SYNC_FUNCTIONS)
+static inline bool atomic_cmpxchg_voidptr(void **var, void *cmp, void *val)
+{
+	return __sync_bool_compare_and_swap(var, cmp, val);
+}
+#endif
 #endif				/* !_ABSTRACT_ATOMIC_H */
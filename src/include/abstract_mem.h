@@ -42,7 +42,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "log.h"
+#include "gsh_list.h"
+#include "cpu_profile.h"
+#include "mem_account.h"
 
 /**
  * @page GeneralAllocator General Allocator Shim
@@ -54,6 +60,9 @@
  * present.)  So long as the interface remains the same, these
  * functions can be switched out using ifdef for versions that do more
  * memory tracking or that call allocators with other names.
+ *
+ * Built with USE_MEM_ACCOUNTING they keep count of the memory held by
+ * each subsystem, see mem_account.h.
  */
 
 /**
@@ -75,14 +84,15 @@ static inline void *
 gsh_malloc__(size_t n,
 	     const char *file, int line, const char *function)
 {
-	void *p = malloc(n);
+	void *p = malloc(n + MEM_ACCOUNT_PREFIX);
 
 	if (p == NULL) {
 		LogMallocFailure(file, line, function, "gsh_malloc");
 		abort();
 	}
 
-	return p;
+	cpu_profile_alloc(n);
+	return mem_account_set(p, MEM_ACCOUNT_PREFIX, n, file);
 }
 
 #define gsh_malloc(n) gsh_malloc__(n, __FILE__, __LINE__, __func__)
@@ -106,12 +116,15 @@ static inline void *
 gsh_malloc_aligned__(size_t a, size_t n,
 		     const char *file, int line, const char *function)
 {
+	/* The header takes a whole alignment unit */
+	size_t offset = MEM_ACCOUNT_PREFIX == 0 ? 0 :
+			a > MEM_ACCOUNT_PREFIX ? a : MEM_ACCOUNT_PREFIX;
 	void *p;
 
 #ifdef __APPLE__
-	p = valloc(n);
+	p = valloc(n + offset);
 #else
-	if (posix_memalign(&p, a, n) != 0)
+	if (posix_memalign(&p, a, n + offset) != 0)
 		p = NULL;
 #endif
 	if (p == NULL) {
@@ -119,7 +132,8 @@ gsh_malloc_aligned__(size_t a, size_t n,
 		abort();
 	}
 
-	return p;
+	cpu_profile_alloc(n);
+	return mem_account_set(p, offset, n, file);
 }
 
 #define gsh_malloc_aligned(a, n) \
@@ -142,14 +156,20 @@ static inline void *
 gsh_calloc__(size_t n, size_t s,
 	     const char *file, int line, const char *function)
 {
-	void *p = calloc(n, s);
+	void *p = NULL;
+
+	if (MEM_ACCOUNT_PREFIX == 0)
+		p = calloc(n, s);
+	else if (s == 0 || n <= (SIZE_MAX - MEM_ACCOUNT_PREFIX) / s)
+		p = calloc(1, n * s + MEM_ACCOUNT_PREFIX);
 
 	if (p == NULL) {
 		LogMallocFailure(file, line, function, "gsh_calloc");
 		abort();
 	}
 
-	return p;
+	cpu_profile_alloc(n * s);
+	return mem_account_set(p, MEM_ACCOUNT_PREFIX, n * s, file);
 }
 
 #define gsh_calloc(n, s) gsh_calloc__(n, s, __FILE__, __LINE__, __func__)
@@ -160,6 +180,7 @@ gsh_calloc__(size_t n, size_t s,
  * This function resizes the buffer indicated by the supplied pointer
  * to the given size.  The block may be moved in this process.  On
  * failure, the original block is retained at its original address.
+ * An aligned block may come back unaligned.
  *
  * This function aborts if no memory is available to resize.
  *
@@ -175,13 +196,31 @@ static inline void *
 gsh_realloc__(void *p, size_t n,
 	      const char *file, int line, const char *function)
 {
-	void *p2 = realloc(p, n);
+	void *p2, *base;
+	size_t offset;
+
+	if (MEM_ACCOUNT_PREFIX == 0 ||
+	    (p != NULL && mem_account_hdr(p) == NULL)) {
+		/* Blocks from other allocators are left to them */
+		p2 = realloc(p, n);
+	} else if (n == 0) {
+		free(mem_account_clear(p));
+		p2 = NULL;
+	} else {
+		base = p != NULL ? mem_account_clear(p) : NULL;
+		offset = p != NULL ? (size_t) ((char *) p - (char *) base)
+				   : MEM_ACCOUNT_PREFIX;
+		p2 = realloc(base, n + offset);
+		if (p2 != NULL)
+			p2 = mem_account_set(p2, offset, n, file);
+	}
 
 	if (n != 0 && p2 == NULL) {
 		LogMallocFailure(file, line, function, "gsh_realloc");
 		abort();
 	}
 
+	cpu_profile_alloc(n);
 	return p2;
 }
 
@@ -205,14 +244,17 @@ gsh_realloc__(void *p, size_t n,
 static inline char *
 gsh_strdup__(const char *s, const char *file, int line, const char *function)
 {
-	char *p = strdup(s);
+	size_t n = strlen(s) + 1;
+	char *p = malloc(n + MEM_ACCOUNT_PREFIX);
 
 	if (p == NULL) {
 		LogMallocFailure(file, line, function, "gsh_strdup");
 		abort();
 	}
 
-	return p;
+	cpu_profile_alloc(n);
+	p = mem_account_set(p, MEM_ACCOUNT_PREFIX, n, file);
+	return memcpy(p, s, n);
 }
 
 #define gsh_strdup(s) gsh_strdup__(s, __FILE__, __LINE__, __func__)
@@ -268,7 +310,7 @@ gsh_strldup__(const char *s, size_t length, size_t *copied,
 static inline void
 gsh_free(void *p)
 {
-	free(p);
+	free(mem_account_clear(p));
 }
 
 /**
@@ -284,7 +326,7 @@ gsh_free(void *p)
 static inline void
 gsh_free_size(void *p, size_t n __attribute__ ((unused)))
 {
-	free(p);
+	free(mem_account_clear(p));
 }
 
 /**
@@ -299,25 +341,96 @@ gsh_free_size(void *p, size_t n __attribute__ ((unused)))
  * This allows for flexible growth in the future.
  */
 
+/**
+ * @brief Free objects of a cached pool kept for one CPU
+ *
+ * Objects are chained through their first word.  The counters are
+ * only changed under the lock.
+ */
+struct pool_cpu_cache {
+	pthread_mutex_t lock;
+	void *head;
+	uint32_t count;
+	uint32_t low; /*< Fewest objects on the list since the last trim */
+	uint64_t allocs;
+	uint64_t hits; /*< Allocations served from the list */
+	uint64_t frees;
+	uint64_t trimmed; /*< Objects given back by pool_trim */
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
+
+/**
+ * @brief Set up an object the first time it leaves the allocator
+ */
+typedef void (*pool_constructor_t)(void *object);
+
+/**
+ * @brief Tear down an object before it goes back to the allocator
+ */
+typedef void (*pool_destructor_t)(void *object);
+
+struct pool_arena;
+
 typedef struct pool {
 	char *name; /*< The name of the pool */
 	size_t object_size; /*< The size of the objects created */
+	struct pool_cpu_cache *cpus; /*< Free objects, NULL if not cached */
+	uint32_t ncpus; /*< Entries in cpus */
+	uint32_t cpu_max; /*< Most free objects kept in each entry */
+	pool_constructor_t constructor;
+	pool_destructor_t destructor;
+	struct pool_arena *arena; /*< Hugepage slabs, NULL for the heap */
+	struct glist_head pools; /*< Entry in the list of cached pools */
 } pool_t;
 
+/** Free objects a pool keeps per CPU unless told otherwise */
+#define POOL_CPU_MAX 32
+
 /**
- * @brief Create a basic object pool
- *
- * This function creates a new object pool, given a name, object size,
- * constructor and destructor.
- *
- * This particular implementation throws the name away, but other
- * implementations that do tracking or keep counts of allocated or
- * de-allocated objects will likely wish to use it in log messages.
- *
- * This initializer function is expected to abort if it fails.
+ * @brief Counters of a pool, summed over its CPUs
+ */
+struct pool_stats {
+	uint64_t allocs;
+	uint64_t hits;
+	uint64_t frees;
+	uint64_t cached; /*< Free objects kept now */
+	uint64_t trimmed;
+	uint64_t slabs; /*< Arena slabs mapped now */
+	uint64_t huge_slabs; /*< Of those, on reserved hugepages */
+};
+
+void pool_register(pool_t *pool);
+void pool_unregister(pool_t *pool);
+void pool_trim(pool_t *pool);
+void pool_trim_all(void);
+void pool_get_stats(pool_t *pool, struct pool_stats *stats);
+void pool_foreach(void (*cb)(pool_t *pool, void *arg), void *arg);
+void pool_arena_init(pool_t *pool);
+void pool_arena_destroy(pool_t *pool);
+void *pool_arena_alloc(pool_t *pool);
+void pool_arena_free(pool_t *pool, void *object);
+
+/**
+ * @brief Create an object pool that keeps freed objects for reuse
+ *
+ * Up to @a cpu_max freed objects are kept on each of one free list per
+ * CPU, so objects that come and go at a high rate are recycled without
+ * going back to the allocator, and threads on different CPUs do not
+ * contend for the lists.  A thread always uses the same list.  Objects
+ * that stay on a list through a whole pass of pool_trim_all are given
+ * back to the allocator.
+ *
+ * Without a constructor, objects are zeroed each time they are
+ * allocated.  With one, it runs only on objects new from the
+ * allocator and a recycled object comes back as it was freed but for
+ * its first word, which is zeroed, so the caller must leave it ready
+ * for reuse.  The destructor runs when the
+ * object really goes back to the allocator.
  *
  * @param[in] name             The name of this pool
  * @param[in] object_size      The size of objects to allocate
+ * @param[in] cpu_max          Most free objects kept per CPU, 0 for none
+ * @param[in] constructor      Set up new objects, or NULL
+ * @param[in] destructor       Tear down released objects, or NULL
  * @param[in] file             Calling source file
  * @param[in] line             Calling source line
  * @param[in] function         Calling source function
@@ -330,25 +443,113 @@ typedef struct pool {
  */
 
 static inline pool_t *
-pool_basic_init__(const char *name, size_t object_size,
-		  const char *file, int line, const char *function)
+pool_init__(const char *name, size_t object_size, uint32_t cpu_max,
+	    pool_constructor_t constructor, pool_destructor_t destructor,
+	    const char *file, int line, const char *function)
 {
-	pool_t *pool = (pool_t *) gsh_malloc__(sizeof(pool_t), file, line,
-					function);
+	pool_t *pool = (pool_t *) gsh_calloc__(1, sizeof(pool_t), file, line,
+					       function);
+	long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	uint32_t i;
 
 	pool->object_size = object_size;
+	pool->constructor = constructor;
+	pool->destructor = destructor;
+	glist_init(&pool->pools);
 
 	if (name)
 		pool->name = gsh_strdup__(name, file, line, function);
-	else
-		pool->name = NULL;
+
+	if (cpu_max == 0 || object_size < sizeof(void *))
+		return pool;
+
+	pool->ncpus = ncpus > 0 ? ncpus : 1;
+	pool->cpu_max = cpu_max;
+	pool->cpus = gsh_malloc_aligned__(GSH_CACHE_LINE_SIZE,
+					  pool->ncpus * sizeof(*pool->cpus),
+					  file, line, function);
+	memset(pool->cpus, 0, pool->ncpus * sizeof(*pool->cpus));
+
+	for (i = 0; i < pool->ncpus; i++)
+		pthread_mutex_init(&pool->cpus[i].lock, NULL);
+
+	pool_register(pool);
 
 	return pool;
 }
 
+#define pool_init(name, object_size, cpu_max, constructor, destructor) \
+	pool_init__(name, object_size, cpu_max, constructor, destructor, \
+		    __FILE__, __LINE__, __func__)
+
+/**
+ * @brief Create a basic object pool
+ *
+ * A pool of zeroed objects keeping POOL_CPU_MAX free objects per CPU,
+ * see pool_init__.
+ *
+ * This initializer function is expected to abort if it fails.
+ *
+ * @param[in] name             The name of this pool
+ * @param[in] object_size      The size of objects to allocate
+ * @param[in] file             Calling source file
+ * @param[in] line             Calling source line
+ * @param[in] function         Calling source function
+ *
+ * @return A pointer to the pool object.
+ */
+
+static inline pool_t *
+pool_basic_init__(const char *name, size_t object_size,
+		  const char *file, int line, const char *function)
+{
+	return pool_init__(name, object_size, POOL_CPU_MAX, NULL, NULL,
+			   file, line, function);
+}
+
 #define pool_basic_init(name, object_size) \
 	pool_basic_init__(name, object_size, __FILE__, __LINE__, __func__)
 
+/**
+ * @brief Create a pool of zeroed objects keeping @a cpu_max per CPU
+ */
+
+#define pool_cached_init(name, object_size, cpu_max) \
+	pool_init__(name, object_size, cpu_max, NULL, NULL, \
+		    __FILE__, __LINE__, __func__)
+
+/**
+ * @brief Free list of a cached pool used by the calling thread
+ *
+ * Threads are spread over the lists by a hash of their id; worker
+ * threads mostly stay on one CPU, so this keeps a list per CPU.
+ */
+
+static inline struct pool_cpu_cache *
+pool_cpu_cache(pool_t *pool)
+{
+	uint64_t h = (uint64_t) (uintptr_t) pthread_self() *
+		     0x9E3779B97F4A7C15ULL;
+
+	return &pool->cpus[(h >> 32) % pool->ncpus];
+}
+
+/**
+ * @brief Give an object back to the allocator
+ */
+
+static inline void
+pool_release(pool_t *pool, void *object)
+{
+	if (pool->destructor != NULL)
+		pool->destructor(object);
+
+	if (pool->arena != NULL)
+		pool_arena_free(pool, object);
+	else
+		gsh_free(object);
+}
+
 /**
  * @brief Destroy a memory pool
  *
@@ -361,6 +562,24 @@ pool_basic_init__(const char *name, size_t object_size,
 static inline void
 pool_destroy(pool_t *pool)
 {
+	uint32_t i;
+	void *object;
+
+	if (pool->cpus != NULL)
+		pool_unregister(pool);
+
+	for (i = 0; i < pool->ncpus; i++) {
+		while ((object = pool->cpus[i].head) != NULL) {
+			pool->cpus[i].head = *(void **) object;
+			pool_release(pool, object);
+		}
+		pthread_mutex_destroy(&pool->cpus[i].lock);
+	}
+
+	if (pool->arena != NULL)
+		pool_arena_destroy(pool);
+
+	gsh_free(pool->cpus);
 	gsh_free(pool->name);
 	gsh_free(pool);
 }
@@ -369,10 +588,9 @@ pool_destroy(pool_t *pool)
  * @brief Allocate an object from a pool
  *
  * This function allocates a single object from the pool and returns a
- * pointer to it.  If a constructor was specified at pool creation, it
- * is called on that pointer.  This function must be thread safe.  If
- * the underlying pool abstraction requires a lock, this function must
- * take and release it.
+ * pointer to it.  The object is zeroed, unless the pool has a
+ * constructor, which is run on objects new from the allocator.  This
+ * function is thread safe.
  *
  * This function returns void pointers.  Programmers who wish for more
  * type safety can easily create static inline wrappers (alloc_client
@@ -392,7 +610,42 @@ pool_destroy(pool_t *pool)
 static inline void *
 pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 {
-	return gsh_calloc__(1, pool->object_size, file, line, function);
+	struct pool_cpu_cache *cc;
+	void *object = NULL;
+
+	if (pool->cpus != NULL) {
+		cc = pool_cpu_cache(pool);
+		pthread_mutex_lock(&cc->lock);
+		cc->allocs++;
+		object = cc->head;
+		if (object != NULL) {
+			cc->head = *(void **) object;
+			cc->count--;
+			cc->hits++;
+			if (cc->count < cc->low)
+				cc->low = cc->count;
+		}
+		pthread_mutex_unlock(&cc->lock);
+
+		if (object != NULL) {
+			if (pool->constructor == NULL)
+				memset(object, 0, pool->object_size);
+			else
+				*(void **) object = NULL;
+			return object;
+		}
+	}
+
+	if (pool->arena != NULL)
+		object = pool_arena_alloc(pool);
+	else
+		object = gsh_calloc__(1, pool->object_size, file, line,
+				      function);
+
+	if (pool->constructor != NULL)
+		pool->constructor(object);
+
+	return object;
 }
 
 #define pool_alloc(pool) \
@@ -401,11 +654,10 @@ pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 /**
  * @brief Return an entry to a pool
  *
- * This function returns a single object to the pool.  If a destructor
- * was defined at pool creation time, it is called before the object
- * is freed.  This function must be thread-safe.  If the underlying
- * pool abstract requires a lock, this function must take and release
- * it.
+ * This function returns a single object to the pool, which keeps it
+ * for reuse if the free list of the calling CPU has room.  Otherwise
+ * the destructor, if any, is run and the object freed.  This function
+ * is thread-safe.
  *
  * @param[in] pool   Pool to which to return the object
  * @param[in] object Object to return.  This is a void pointer.
@@ -417,7 +669,25 @@ pool_alloc__(pool_t *pool, const char *file, int line, const char *function)
 static inline void
 pool_free(pool_t *pool, void *object)
 {
-	gsh_free(object);
+	struct pool_cpu_cache *cc;
+
+	if (pool->cpus != NULL) {
+		cc = pool_cpu_cache(pool);
+		pthread_mutex_lock(&cc->lock);
+		cc->frees++;
+		if (cc->count < pool->cpu_max) {
+			*(void **) object = cc->head;
+			cc->head = object;
+			cc->count++;
+			object = NULL;
+		}
+		pthread_mutex_unlock(&cc->lock);
+
+		if (object == NULL)
+			return;
+	}
+
+	pool_release(pool, object);
 }
 
 #endif /* ABSTRACT_MEM_H */
@@ -237,4 +237,39 @@ void splaytree_replace(struct splaytree_node *old, struct splaytree_node *newe,
 int splaytree_init(struct splaytree *tree, splaytree_cmp_fn_t cmp,
 		   unsigned long flags);
 
+/*
+ * B+tree on 64 bit keys
+ *
+ * The nodes embed only their key, the tree keeps keys and node
+ * pointers in pages of four cache lines: a lookup reads two lines of
+ * keys per level, and with 15 keys a page it is 6 levels deep for a
+ * million nodes where an AVL tree is 20 to 28.  Meant for read-mostly
+ * indexes with unique integer keys.  Pages are allocated on insert and
+ * freed on remove, a failed allocation aborts.
+ */
+#define btree_container_of(node, type, member)			\
+	((type *)((char *)(node) - offsetof(type, member)))
+
+struct btree_node {
+	uint64_t key;		/* set before insert, not changed after */
+};
+
+struct btree_page;
+
+struct btree {
+	struct btree_page *root;
+	int height;		/* levels of pages, 0 when empty */
+	uint64_t size;
+};
+
+struct btree_node *btree_first(const struct btree *tree);
+struct btree_node *btree_next(const struct btree_node *node,
+			      const struct btree *tree);
+uint64_t btree_size(const struct btree *tree);
+struct btree_node *btree_lookup(uint64_t key, const struct btree *tree);
+struct btree_node *btree_insert(struct btree_node *node, struct btree *tree);
+void btree_remove(struct btree_node *node, struct btree *tree);
+void btree_init(struct btree *tree);
+void btree_destroy(struct btree *tree);
+
 #endif				/* _LIBTREE_H */
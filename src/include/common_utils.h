@@ -16,9 +16,14 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <errno.h>
 
 #include "gsh_types.h"
 #include "log.h"
+#include "gsh_trace.h"
+#ifdef USE_LOCK_PROFILE
+#include "lock_profile.h"
+#endif
 
 /**
  * BUILD_BUG_ON - break compile if a condition is true.
@@ -131,6 +136,56 @@ extern int portable_clock_gettime(struct timespec *ts);
 		}							\
 	} while (0)
 
+/**
+ * @brief Take a lock, tracing how long we waited for it
+ *
+ * The lock is only tried first when tracing is on, or always when
+ * profiling locks, where the call site also accounts the lock.
+ *
+ * @param[out] _rc     Return code of the lock call
+ * @param[in]  _lock   The lock
+ * @param[in]  _try    Call trying the lock
+ * @param[in]  _block  Call waiting for the lock
+ */
+#ifdef USE_LOCK_PROFILE
+#define TRACED_LOCK(_rc, _lock, _try, _block)				\
+	do {								\
+		static struct lock_site __site = LOCK_SITE_INIT(_lock);	\
+		uint64_t __wait_start, __start = lock_profile_clock();	\
+									\
+		_rc = (_try);						\
+		if (_rc == EBUSY) {					\
+			__wait_start = gsh_trace_start();		\
+			_rc = (_block);					\
+			gsh_trace_done(TRACE_LOCK_WAIT, __func__,	\
+				       __wait_start, __LINE__);		\
+			if (_rc == 0)					\
+				lock_profile_acquired(&__site, _lock,	\
+						      __start, true);	\
+		} else if (_rc == 0) {					\
+			lock_profile_acquired(&__site, _lock, __start,	\
+					      false);			\
+		}							\
+	} while (0)
+
+#define PROFILED_UNLOCK(_lock) lock_profile_release(_lock)
+#else
+#define TRACED_LOCK(_rc, _lock, _try, _block)				\
+	do {								\
+		uint64_t __wait_start;					\
+									\
+		_rc = gsh_trace_mask != 0 ? (_try) : EBUSY;		\
+		if (_rc == EBUSY) {					\
+			__wait_start = gsh_trace_start();		\
+			_rc = (_block);					\
+			gsh_trace_done(TRACE_LOCK_WAIT, __func__,	\
+				       __wait_start, __LINE__);		\
+		}							\
+	} while (0)
+
+#define PROFILED_UNLOCK(_lock)
+#endif
+
 /**
  * @brief Logging write-lock
  *
@@ -141,7 +196,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_wrlock(_lock);			\
+		TRACED_LOCK(rc, _lock, pthread_rwlock_trywrlock(_lock),	\
+			    pthread_rwlock_wrlock(_lock));		\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got write lock on %p (%s) "	\
@@ -166,7 +222,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_rwlock_rdlock(_lock);			\
+		TRACED_LOCK(rc, _lock, pthread_rwlock_tryrdlock(_lock),	\
+			    pthread_rwlock_rdlock(_lock));		\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Got read lock on %p (%s) "	\
@@ -191,6 +248,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		PROFILED_UNLOCK(_lock);					\
 		rc = pthread_rwlock_unlock(_lock);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
@@ -216,7 +274,8 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
-		rc = pthread_mutex_lock(_mtx);				\
+		TRACED_LOCK(rc, _mtx, pthread_mutex_trylock(_mtx),	\
+			    pthread_mutex_lock(_mtx));			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
 				     "Acquired mutex %p (%s) at %s:%d",	\
@@ -241,6 +300,7 @@ extern int portable_clock_gettime(struct timespec *ts);
 	do {								\
 		int rc;							\
 									\
+		PROFILED_UNLOCK(_mtx);					\
 		rc = pthread_mutex_unlock(_mtx);			\
 		if (rc == 0) {						\
 			LogFullDebug(COMPONENT_RW_LOCK,			\
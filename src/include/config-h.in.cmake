@@ -52,14 +52,27 @@
 #cmakedefine HAVE_XATTR_H 1
 #cmakedefine HAVE_DAEMON 1
 #cmakedefine USE_LTTNG 1
+#cmakedefine USE_IO_URING 1
+#cmakedefine USE_RPC_TLS 1
 #cmakedefine ENABLE_VFS_DEBUG_ACL 1
 #cmakedefine ENABLE_RFC_ACL 1
 #cmakedefine USE_GLUSTER_SYMLINK_MOUNT 1
+#cmakedefine USE_GLUSTER_COPY_FILE_RANGE 1
+#cmakedefine USE_GLUSTER_UPCALL_REGISTER 1
+#cmakedefine USE_GLUSTER_DELEGATION 1
+#cmakedefine USE_GLUSTER_STAT_IO_CBK 1
+#cmakedefine USE_FSAL_RGW_READDIR_ATTRS 1
 #cmakedefine USE_FSAL_CEPH_MKNOD 1
 #cmakedefine USE_FSAL_CEPH_SETLK 1
 #cmakedefine USE_FSAL_CEPH_LL_LOOKUP_ROOT 1
+#cmakedefine USE_FSAL_CEPH_LL_NONBLOCKING_RW 1
+#cmakedefine USE_FSAL_CEPH_LL_CALLBACKS 1
+#cmakedefine USE_FSAL_CEPH_LL_LOOKUP_INODE 1
 #cmakedefine USE_FSAL_CEPH_STATX 1
 #cmakedefine ENABLE_LOCKTRACE 1
+#cmakedefine USE_LOCK_PROFILE 1
+#cmakedefine USE_CPU_PROFILE 1
+#cmakedefine USE_MEM_ACCOUNTING 1
 #cmakedefine SANITIZE_ADDRESS 1
 
 #define NFS_GANESHA 1
@@ -850,6 +850,9 @@ void config_Free(config_file_t config);
 /* Find the root of the parse tree given a TYPE_BLOCK node */
 config_file_t get_parse_root(void *node);
 
+/* Fingerprint of a TYPE_BLOCK node and its contents */
+uint64_t config_block_hash(void *node, uint64_t seed);
+
 struct config_node_list {
 	void *tree_node;
 	struct config_node_list *next;
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file   cpu_profile.h
+ * @brief  Stack samples and allocations by NFS operation
+ *
+ * Built with USE_CPU_PROFILE, each thread tags the operation it works
+ * on, with its export.  Once StartCpuProfile of the exportstats DBus
+ * interface is called, SIGPROF samples the stack of the thread using
+ * the CPU, and GetCpuProfile returns the samples as collapsed stacks
+ * rooted at their operation, ready for flamegraph.pl.  The calls to
+ * gsh_malloc and friends are counted by operation all along.
+ */
+
+#ifndef CPU_PROFILE_H
+#define CPU_PROFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef USE_CPU_PROFILE
+
+/** What a thread works on */
+struct cpu_profile_tag {
+	const char *op;		/*< Static name, NULL between requests */
+	int32_t export_id;	/*< -1 for none */
+	uint64_t allocs;	/*< Since op was set */
+	uint64_t alloc_bytes;
+};
+
+extern __thread struct cpu_profile_tag cpu_profile_tag;
+
+void cpu_profile_account(void);
+int cpu_profile_start(uint32_t hz, uint32_t samples);
+void cpu_profile_stop(void);
+
+#ifdef USE_DBUS
+#include <dbus/dbus.h>
+
+void cpu_profile_dbus(DBusMessageIter *iter, bool by_export,
+		      bool by_client);
+#endif
+
+/**
+ * @brief Tag the operation the thread starts
+ *
+ * @param[in] op         Name of the operation, a string that stays
+ * @param[in] export_id  Its export, -1 for none
+ */
+static inline void cpu_profile_op(const char *op, int32_t export_id)
+{
+	if (cpu_profile_tag.allocs != 0)
+		cpu_profile_account();
+
+	cpu_profile_tag.export_id = export_id;
+	cpu_profile_tag.op = op;
+}
+
+static inline void cpu_profile_alloc(size_t n)
+{
+	cpu_profile_tag.allocs++;
+	cpu_profile_tag.alloc_bytes += n;
+}
+
+#else /* USE_CPU_PROFILE */
+
+static inline void cpu_profile_op(const char *op, int32_t export_id)
+{
+}
+
+static inline void cpu_profile_alloc(size_t n)
+{
+}
+
+#endif /* USE_CPU_PROFILE */
+
+#endif /* CPU_PROFILE_H */
@@ -37,6 +37,13 @@
  * would make the internal logic rather snarly and the initialization
  * parameters even more recondite.
  *
+ * Tasks are kept in hierarchical timing wheels, one per CPU each with
+ * its own executor thread, so arming and cancelling a timer are O(1)
+ * and only contend with the other users of the same CPU.  A timer is
+ * never run early, and late by at most one tick of the wheel
+ * (DELAYED_TICK_SHIFT, about a millisecond) plus the wait for the
+ * tasks ahead of it on its wheel.
+ *
  * @{
  */
 
@@ -52,11 +59,48 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "gsh_types.h"
+#include "gsh_list.h"
+#include "abstract_atomic.h"
+
+/** A tick of the wheels is 2^DELAYED_TICK_SHIFT nanoseconds */
+#define DELAYED_TICK_SHIFT 20
+
+struct delayed_wheel;
+
+/**
+ * @brief A timer
+ *
+ * Embedded in its user, set up with delayed_timer_init.  Arming and
+ * cancelling one timer must be serialized by its user, the callback
+ * may run concurrently with either.
+ */
+struct delayed_timer {
+	struct glist_head link;		/*< In its slot of the wheel */
+	void (*func)(void *);
+	void *arg;
+	uint64_t expires;		/*< Tick at which to run */
+	struct delayed_wheel *wheel;	/*< Wheel it is armed on, or NULL */
+	uint16_t slot;			/*< Level and slot on the wheel */
+	bool autofree;			/*< Freed once run, delayed_submit */
+};
 
 void delayed_start(void);
 void delayed_shutdown(void);
 int delayed_submit(void (*)(void *), void *, nsecs_elapsed_t);
 
+void delayed_timer_init(struct delayed_timer *timer, void (*func)(void *),
+			void *arg);
+bool delayed_timer_arm(struct delayed_timer *timer, nsecs_elapsed_t delay);
+bool delayed_timer_cancel(struct delayed_timer *timer);
+
+/**
+ * @brief Whether a timer is armed and not yet run
+ */
+static inline bool delayed_timer_pending(struct delayed_timer *timer)
+{
+	return atomic_fetch_voidptr((void **)&timer->wheel) != NULL;
+}
+
 #endif				/* DELAYED_EXEC_H */
 
 /** @} */
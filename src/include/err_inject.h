@@ -24,10 +24,29 @@
 #ifndef ERR_INJECT_H
 #define ERR_INJECT_H
 
+#include <stdbool.h>
+#include "fsal_types.h"
+
 #ifdef _ERROR_INJECTION
 extern int worker_delay_time;
 extern int next_worker_delay_time;
 int init_error_injector(void);
 #endif
 
+/* Fault rules, applied to the sub-FSAL calls of FSAL_NULL exports with
+ * Fault_Injection, set through the org.ganesha.nfsd.faults interface.
+ */
+
+struct fault_rule;
+struct gsh_export;
+
+fsal_errors_t fault_inject_start(struct gsh_export *export, int op,
+				 const char *path, bool may_fail,
+				 struct fault_rule **rule);
+void fault_inject_done(struct fault_rule *rule);
+
+#ifdef USE_DBUS
+void dbus_fault_init(void);
+#endif
+
 #endif				/* ERR_INJECT_H */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file   export_index.h
+ * @brief  Compiled client list of an export
+ *
+ * The index finds the first entry of an export's client list that
+ * matches a client address, as a walk of the list would, without the
+ * walk: host addresses are hashed, networks sit in a prefix trie, and
+ * only netgroup and wildcard entries ahead of the address match are
+ * tried one by one.  Decisions are cached per client address.
+ *
+ * An index is built from a complete client list and never changes;
+ * when the list changes, the index is replaced.  Both are protected by
+ * the export lock.
+ */
+
+#ifndef EXPORT_INDEX_H
+#define EXPORT_INDEX_H
+
+#include <stdbool.h>
+#include "gsh_list.h"
+#include "gsh_rpc.h"
+#include "nfs_exports.h"
+
+struct export_client_index;
+
+/**
+ * @brief Whether a netgroup or wildcard entry matches a client
+ */
+typedef bool (*export_name_match_t)(exportlist_client_entry_t *client,
+				    sockaddr_t *hostaddr);
+
+struct export_client_index *export_index_build(struct glist_head *clients);
+void export_index_free(struct export_client_index *index);
+exportlist_client_entry_t *export_index_match(
+					struct export_client_index *index,
+					sockaddr_t *hostaddr,
+					export_name_match_t name_match);
+
+#endif /* EXPORT_INDEX_H */
@@ -36,9 +36,11 @@
  * @brief Export manager
  */
 
+#include <unistd.h>
 #include "gsh_list.h"
 #include "avltree.h"
 #include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
 #include "fsal.h"
 
 #ifndef EXPORT_MGR_H
@@ -49,6 +51,40 @@ enum export_status {
 	EXPORT_STALE,		/*< export is no longer valid */
 };
 
+/** Where the background unexport of an export is */
+enum unexport_phase {
+	UNEXPORT_NONE,		/*< not unexported, or synchronously */
+	UNEXPORT_QUEUED,	/*< unreachable, waiting for the thread */
+	UNEXPORT_STATE,		/*< releasing locks, states and shares */
+	UNEXPORT_CACHE,		/*< releasing the cache entries */
+};
+
+/** Objects an unexport in the background lets go of between pauses */
+#define UNEXPORT_CHUNK 1024
+/** The pause, in microseconds */
+#define UNEXPORT_PAUSE_US 1000
+
+enum deleg_policy {
+	DELEG_POLICY_CONSERVATIVE,	/*< grant whatever does not conflict,
+					    never again to a client that had
+					    delegations revoked */
+	DELEG_POLICY_AGGRESSIVE,	/*< grant read delegations on files
+					    not shared by writers, back off
+					    from clients failing recalls */
+};
+
+/** Slots an export spreads its references over, once in the export
+    manager.  Threads take theirs round robin. */
+#define EXPORT_REF_SLOTS 64
+
+/** Added to each slot when its references go back to refcnt */
+#define EXPORT_REF_SEALED (INT64_C(1) << 62)
+
+struct export_ref_slot {
+	int64_t refs;
+	char pad[64 - sizeof(int64_t)];	/*< A cache line each */
+};
+
 /**
  * @brief Represents an export.
  *
@@ -61,6 +97,12 @@ struct gsh_export {
 	struct glist_head exp_list;
 	/** gsh_exports are kept in an AVL tree by export_id */
 	struct avltree_node node_k;
+	/** Exports of the same path or pseudo path, and the node of that
+	    path in the export path tries.  Protected by export_by_id.lock */
+	struct glist_head path_list;
+	struct glist_head pseudo_list;
+	struct export_path_node *path_node;
+	struct export_path_node *pseudo_node;
 	/** List of NFS v4 state belonging to this export */
 	struct glist_head exp_state_list;
 	/** List of locks belonging to this export */
@@ -71,6 +113,8 @@ struct gsh_export {
 	struct glist_head exp_root_list;
 	/** List of exports to be mounted or cleaned up */
 	struct glist_head exp_work;
+	/** Entry in the list of background unexports */
+	struct glist_head exp_unexport;
 	/** List of exports mounted on this export */
 	struct glist_head mounted_exports_list;
 	/** This export is a node in the list of mounted_exports */
@@ -79,6 +123,8 @@ struct gsh_export {
 	struct fsal_obj_handle *exp_root_obj;
 	/** CFG Allowed clients - update protected by lock */
 	struct glist_head clients;
+	/** Compiled clients, replaced with them, protected by lock */
+	struct export_client_index *client_index;
 	/** Entry for the junction of this export.  Protected by lock */
 	struct fsal_obj_handle *exp_junction_obj;
 	/** The export this export sits on. Protected by lock */
@@ -109,14 +155,21 @@ struct gsh_export {
 	uint64_t MaxOffsetRead;
 	/** CFG: Filesystem ID for overriding fsid from FSAL - ????? */
 	fsal_fsid_t filesystem_id;
-	/** References to this export */
+	/** References to this export.  While the export is in the export
+	    manager, they are counted in the slot of the thread taking or
+	    releasing them, so that a busy export doesn't bounce one
+	    cache line between all the cores. */
 	int64_t refcnt;
+	struct export_ref_slot *ref_slots;
 	/** Read/Write lock protecting export */
 	pthread_rwlock_t lock;
 	/** CFG: available mount options - update protected by lock */
 	struct export_perms export_perms;
 	/** The last time the export stats were updated */
 	nsecs_elapsed_t last_update;
+	/** Fingerprint of the EXPORT block last committed, with the
+	    EXPORT_DEFAULTS it was committed under */
+	uint64_t config_hash;
 	/** CFG: Export non-permission options - atomic changeable option */
 	uint32_t options;
 	/** CFG: Export non-permission options set - atomic changeable option */
@@ -124,6 +177,49 @@ struct gsh_export {
 	/** CFG: Expiration time interval in seconds for attributes.  Settable
 	    with Attr_Expiration_Time. - atomic changeable option */
 	int32_t expire_time_attr;
+	/** CFG: Bounds in seconds within which MDCACHE doubles the
+	    attribute expiration of unchanged files and halves that of
+	    changed ones, no adapting if the maximum is 0.  Settable with
+	    Attr_Expiration_Min and Attr_Expiration_Max - atomic
+	    changeable option */
+	int32_t expire_time_attr_min;
+	int32_t expire_time_attr_max;
+	/** CFG: Share of the fair queue, relative to other exports.
+	    Settable with FairShare_Weight - atomic changeable option */
+	uint32_t fq_weight;
+	/** CFG: Requests per second, 0 for no limit.  Settable with
+	    Max_Ops_Per_Sec - atomic changeable option */
+	uint64_t fq_max_ops;
+	/** CFG: READ and WRITE bytes per second, 0 for no limit.  Settable
+	    with Max_Bytes_Per_Sec - atomic changeable option */
+	uint64_t fq_max_bytes;
+	/** CFG: How delegations are handed out, one of enum deleg_policy.
+	    Settable with Delegation_Policy - atomic changeable option */
+	uint32_t deleg_policy;
+	/** Token buckets enforcing the limits above, and when they were
+	    last refilled.  Protected by the fair queue lock. */
+	int64_t fq_ops_tokens;
+	int64_t fq_bytes_tokens;
+	nsecs_elapsed_t fq_stamp;
+	/** Uses of an object's global fd that found it open in a usable
+	    mode, and those that had to open it.  Atomic. */
+	uint64_t fd_hits;
+	uint64_t fd_misses;
+	/** Reads ahead of sequential READs and the bytes they read, and
+	    the READs answered from them and their bytes.  Atomic. */
+	uint64_t ra_reads;
+	uint64_t ra_bytes;
+	uint64_t ra_hits;
+	uint64_t ra_hit_bytes;
+	/** Progress of a background unexport: the locks, states and
+	    shares, then the cache entries let go of.  Atomic. */
+	uint64_t unexport_state;
+	uint64_t unexport_entries;
+	uint32_t unexport_phase;	/*< enum unexport_phase, atomic */
+	/** Grace period of this export alone, see nfs4_start_export_grace.
+	    When it started, 0 if never, and its generation.  Atomic. */
+	time_t exp_grace_start;
+	uint32_t exp_grace_gen;
 	/** CFG: Export_Id for this export - static option */
 	uint16_t export_id;
 
@@ -131,6 +227,9 @@ struct gsh_export {
 	bool has_pnfs_ds;		/*< id_servers matches export_id */
 };
 
+/** Default FairShare_Weight of an export */
+#define FAIRSHARE_WEIGHT_DEFAULT 100
+
 static inline bool op_ctx_export_has_option(uint32_t option)
 {
 	return atomic_fetch_uint32_t(&op_ctx->ctx_export->options) & option;
@@ -161,6 +260,9 @@ void put_gsh_export(struct gsh_export *a_export);
 void remove_gsh_export(uint16_t export_id);
 bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 			void *state);
+bool foreach_gsh_export_snapshot(bool(*cb) (struct gsh_export *exp,
+					     void *state),
+				 void *state);
 
 /**
  * @brief Advisory check of export readiness.
@@ -180,11 +282,60 @@ static inline bool export_ready(struct gsh_export *a_export)
 	return a_export->export_status == EXPORT_READY;
 }
 
+extern __thread uint32_t export_ref_thread;
+void export_ref_thread_init(void);
+
+/**
+ * @brief Count references in the slot of the thread
+ *
+ * @return false if the export doesn't count in slots, or no longer.
+ */
+static inline bool export_ref_slot_add(struct gsh_export *a_export,
+				       int64_t n)
+{
+	struct export_ref_slot *slots =
+		atomic_fetch_voidptr((void **)&a_export->ref_slots);
+
+	if (slots == NULL)
+		return false;
+
+	if (unlikely(export_ref_thread == 0))
+		export_ref_thread_init();
+
+	/* A sealed slot is off by EXPORT_REF_SEALED */
+	return atomic_add_int64_t(&slots[export_ref_thread - 1].refs, n) - n
+		< EXPORT_REF_SEALED / 2;
+}
+
 static inline void get_gsh_export_ref(struct gsh_export *a_export)
 {
-	(void) atomic_inc_int64_t(&a_export->refcnt);
+	if (!export_ref_slot_add(a_export, 1))
+		(void) atomic_inc_int64_t(&a_export->refcnt);
+}
+
+/**
+ * @brief Count an object an unexport let go of
+ *
+ * Pauses after each UNEXPORT_CHUNK of them when unexporting in the
+ * background, leaving the locks taken to the other threads.
+ *
+ * @param[in] a_export The export
+ * @param[in] done     Its counter of such objects
+ */
+static inline void unexport_progress(struct gsh_export *a_export,
+				     uint64_t *done)
+{
+	if (atomic_inc_uint64_t(done) % UNEXPORT_CHUNK == 0 &&
+	    atomic_fetch_uint32_t(&a_export->unexport_phase) != UNEXPORT_NONE)
+		usleep(UNEXPORT_PAUSE_US);
 }
 
+bool unexport_pending(uint16_t export_id);
+void foreach_unexport_pending(void (*cb)(struct gsh_export *exp,
+					 void *state),
+			      void *state);
+void unexport_async_shutdown(void);
+
 void export_revert(struct gsh_export *a_export);
 void export_add_to_mount_work(struct gsh_export *a_export);
 void export_add_to_unexport_work_locked(struct gsh_export *a_export);
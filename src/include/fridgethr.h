@@ -45,12 +45,16 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "gsh_list.h"
+#include "gsh_intrinsic.h"
 #include "wait_queue.h"
 
 struct fridgethr;
 
 /*< Decoder thread pool */
 extern struct fridgethr *req_fridge;
+/*< Decoder thread pools pinned to each affinity domain, may be none */
+extern struct fridgethr **decoder_fridges;
+extern uint32_t n_decoder_fridges;
 
 /**
  * @brief Per-worker data.  Some of this will be destroyed.
@@ -85,6 +89,8 @@ struct fridgethr_entry {
 		void *arg;	/*< Functions argument */
 
 		pthread_t id;	/*< Thread ID */
+		int domain;	/*< Affinity domain the thread is pinned
+				   to, -1 if it is not pinned */
 		uint32_t uflags; /*< Flags (for any use) */
 		bool woke;	/*< Set to false on first run and if wait
 				   in fridgethr_freeze didn't time out. */
@@ -128,6 +134,20 @@ typedef enum {
 				      return an error on timeout. */
 } fridgethr_defer_t;
 
+/**
+ * @brief Placement of fridge threads on CPUs
+ *
+ * A domain is one CPU or one NUMA node out of those the process may
+ * run on, numbered densely from zero.
+ */
+
+typedef enum {
+	fridgethr_affinity_none = 0, /*< Let the scheduler place threads */
+	fridgethr_affinity_cpu = 1, /*< Pin each thread to one CPU */
+	fridgethr_affinity_node = 2 /*< Pin each thread to the CPUs of one
+				       NUMA node */
+} fridgethr_affinity_t;
+
 /**
  * @brief Parameters set at fridgethr_init
  */
@@ -179,6 +199,25 @@ struct fridgethr_params {
 	void (*wake_threads)(void *);
 	/* Argument for wake_threads */
 	void *wake_threads_arg;
+	/**
+	 * Pin threads round-robin across the affinity domains as they
+	 * are created.  The domain is recorded in the thread context.
+	 */
+	fridgethr_affinity_t affinity;
+	/** Pin all the threads to the one domain below instead */
+	bool one_domain;
+	uint32_t domain;
+	/**
+	 * Slots, a power of two, of a lock-free ring through which
+	 * fridgethr_submit hands jobs to idle threads without taking
+	 * the fridge mutex.  0 for none.  Worker flavor, Linux only.
+	 */
+	uint32_t fast_slots;
+	/**
+	 * Microseconds an idle thread polls for new work before it
+	 * sleeps.  See fridgethr_getspin for loopers.
+	 */
+	uint32_t spin_us;
 };
 
 /**
@@ -189,6 +228,18 @@ struct fridgethr_work {
 	void (*func)(struct fridgethr_context *); /*< Function being
 						      executed */
 	void *arg; /*< Functions argument */
+	struct timespec queued; /*< When it was queued */
+};
+
+/**
+ * @brief Slot of the lock-free submission ring
+ *
+ * Same scheme as req_q_ring: seq tells whose turn the slot is.
+ */
+struct fridgethr_slot {
+	uint64_t seq;
+	void (*func)(struct fridgethr_context *);
+	void *arg;
 };
 
 /**
@@ -216,6 +267,7 @@ struct fridgethr {
 	uint32_t nidle;		/*< Number of idle threads */
 	uint32_t flags;		/*< Fridge-wide flags */
 	fridgethr_comm_t command;	/*< Command state */
+	uint32_t next_domain;	/*< Domain to pin the next thread to */
 	void (*cb_func)(void *);	/*< Callback on command completion */
 	void *cb_arg;		/*< Argument for completion callback */
 	pthread_mutex_t *cb_mtx;	/*< Mutex for completion condition
@@ -233,6 +285,32 @@ struct fridgethr {
 					      thread. */
 		} block;
 	} deferment;
+	struct glist_head fridges; /*< Link in the list of all fridges */
+	uint64_t submitted;	/*< Jobs submitted */
+	uint64_t deferred;	/*< Jobs queued or blocked for a thread */
+	uint64_t wait;		/*< ns deferred jobs waited, summed */
+	uint64_t wait_max;	/*< ns the longest deferred job waited */
+	/**
+	 * Lock-free submission.  Idle threads spin on the ring and then
+	 * park on wakeseq, a futex, counted in waiting and parked; they
+	 * are on neither idle_q nor nidle.
+	 */
+	struct {
+		struct fridgethr_slot *slot;	/*< NULL if not enabled */
+		uint64_t mask;
+		GSH_CACHE_PAD(0);
+		uint64_t head;		/*< next slot to fill */
+		GSH_CACHE_PAD(1);
+		uint64_t tail;		/*< next slot to drain */
+		GSH_CACHE_PAD(2);
+		uint32_t waiting;	/*< Threads spinning or parked */
+		uint32_t parked;	/*< Of which asleep on wakeseq */
+		uint32_t wakeseq;	/*< Bumped to wake parked threads */
+		uint32_t deferred;	/*< Jobs on work_q and submitters
+					   blocked, which send waiting
+					   threads the old way */
+		GSH_CACHE_PAD(3);
+	} fast;
 };
 
 #define fridgethr_flag_none 0x0000 /*< Null flag */
@@ -242,6 +320,8 @@ struct fridgethr {
 
 int fridgethr_init(struct fridgethr **, const char *,
 		   const struct fridgethr_params *);
+unsigned int fridgethr_affinity_domains(fridgethr_affinity_t);
+int fridgethr_affinity_domain(fridgethr_affinity_t, int);
 void fridgethr_destroy(struct fridgethr *);
 
 int fridgethr_submit(struct fridgethr *, void (*)(struct fridgethr_context *),
@@ -261,9 +341,16 @@ int fridgethr_populate(struct fridgethr *, void (*)(struct fridgethr_context *),
 
 void fridgethr_setwait(struct fridgethr_context *ctx, time_t thread_delay);
 time_t fridgethr_getwait(struct fridgethr_context *ctx);
+uint32_t fridgethr_getspin(struct fridgethr_context *ctx);
 
 void fridgethr_cancel(struct fridgethr *fr);
 
+#ifdef USE_DBUS
+#include <dbus/dbus.h>
+
+void fridgethr_dbus_stats(DBusMessageIter *iter);
+#endif
+
 extern struct fridgethr *general_fridge;
 int general_fridge_init(void);
 int general_fridge_shutdown(void);
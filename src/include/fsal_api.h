@@ -311,7 +311,7 @@ struct state_t;
  * cycle at which point we will move to 6.0.
  */
 
-#define FSAL_MAJOR_VERSION 5
+#define FSAL_MAJOR_VERSION 6
 
 /**
  * @brief Minor Version
@@ -337,6 +337,7 @@ struct fsal_pnfs_ds;
 struct fsal_pnfs_ds_ops;
 struct fsal_ds_handle;
 struct fsal_dsh_ops;
+struct iovec;
 
 #ifndef SEEK_SET
 #define SEEK_SET 0
@@ -366,6 +367,44 @@ struct io_hints {
 	uint32_t hints;
 };
 
+/**
+ * @brief Completion callback for asynchronous FSAL operations
+ *
+ * An FSAL that implements one of the asynchronous methods (read2_async,
+ * write2_async, commit2_async) calls this exactly once when the
+ * operation has completed, either from the calling thread (synchronous
+ * completion) or from any other thread of its choosing.
+ *
+ * The callback is not allowed to assume that op_ctx is valid; anything it
+ * needs must be reachable from its arguments.
+ *
+ * @param[in] obj         Object the operation was performed on
+ * @param[in] ret         Status of the operation
+ * @param[in] obj_data    Operation specific data (struct fsal_io_arg for I/O)
+ * @param[in] caller_data Opaque data passed in by the caller
+ */
+typedef void (*fsal_async_cb)(struct fsal_obj_handle *obj, fsal_status_t ret,
+			      void *obj_data, void *caller_data);
+
+/**
+ * @brief Arguments and results of an asynchronous read or write
+ *
+ * The structure is owned by the caller and must stay valid until the
+ * completion callback has been invoked.
+ */
+struct fsal_io_arg {
+	struct state_t *state;	/*< state_t to use for this operation */
+	uint64_t offset;	/*< Position of the I/O */
+	size_t buffer_size;	/*< Size of buffer */
+	void *buffer;		/*< Data buffer */
+	size_t io_amount;	/*< Out: amount of data read or written */
+	union {
+		bool end_of_file;	/*< Out: EOF reached on read */
+		bool fsal_stable;	/*< In/Out: stability of write */
+	};
+	struct io_info *info;	/*< more information about the data */
+};
+
 /**
  * @brief request op context
  *
@@ -418,9 +457,11 @@ struct req_op_context {
 	struct export_perms *export_perms;	/*< Effective export perms */
 	nsecs_elapsed_t start_time;	/*< start time of this op/request */
 	nsecs_elapsed_t queue_wait;	/*< time in wait queue */
+	bool latency_sample;		/*< request timeline is sampled */
 	void *fsal_private;		/*< private for FSAL use */
 	struct fsal_module *fsal_module;	/*< current fsal module */
 	struct fsal_pnfs_ds *fsal_pnfs_ds;	/*< current pNFS DS */
+	struct export_perms_cache *perms_cache;	/*< Of the connection */
 	/* add new context members here */
 };
 
@@ -1632,12 +1673,15 @@ struct fsal_obj_ops {
  * @param[in] obj_hdl     Object to be linked to
  * @param[in] destdir_hdl Directory in which to create the link
  * @param[in] name        Name for link
+ * @param[in,out] destdir_attrs_out  Optional attributes of @a destdir_hdl
+ *                                   afterwards, see setattr2
  *
  * @return FSAL status
  */
 	 fsal_status_t (*link)(struct fsal_obj_handle *obj_hdl,
 			       struct fsal_obj_handle *destdir_hdl,
-			       const char *name);
+			       const char *name,
+			       struct attrlist *destdir_attrs_out);
 
 /**
  * @brief get fs_locations
@@ -1662,6 +1706,11 @@ struct fsal_obj_ops {
  * @param[in] old_name   Old name
  * @param[in] newdir_hdl New parent directory
  * @param[in] new_name   New name
+ * @param[in,out] olddir_attrs_out  Optional attributes of @a olddir_hdl
+ *                                  afterwards, see setattr2
+ * @param[in,out] newdir_attrs_out  Optional attributes of @a newdir_hdl
+ *                                  afterwards, not asked for when it is
+ *                                  @a olddir_hdl
  *
  * @return FSAL status
  */
@@ -1669,7 +1718,9 @@ struct fsal_obj_ops {
 				 struct fsal_obj_handle *olddir_hdl,
 				 const char *old_name,
 				 struct fsal_obj_handle *newdir_hdl,
-				 const char *new_name);
+				 const char *new_name,
+				 struct attrlist *olddir_attrs_out,
+				 struct attrlist *newdir_attrs_out);
 /**
  * @brief Remove a name from a directory
  *
@@ -1679,12 +1730,15 @@ struct fsal_obj_ops {
  * @param[in] dir_hdl The directory from which to remove the name
  * @param[in] obj_hdl The object being removed
  * @param[in] name    The name to remove
+ * @param[in,out] parent_attrs_out  Optional attributes of @a dir_hdl
+ *                                  afterwards, see setattr2
  *
  * @return FSAL status.
  */
 	 fsal_status_t (*unlink)(struct fsal_obj_handle *dir_hdl,
 				 struct fsal_obj_handle *obj_hdl,
-				 const char *name);
+				 const char *name,
+				 struct attrlist *parent_attrs_out);
 
 /**@}*/
 
@@ -2577,18 +2631,27 @@ struct fsal_obj_ops {
  * resources held by the set attributes. The FSAL layer MAY have added an
  * inherited ACL.
  *
+ * If @a attrs_out is not NULL and the backend answered the change with
+ * the attributes of the object, the FSAL fills it on success as
+ * getattrs would, so that the caller need not ask for them again.  An
+ * FSAL that would need another call for them leaves its valid_mask 0.
+ * The same goes for the directory attributes returned by link, rename
+ * and unlink.
+ *
  * @param[in] obj_hdl    File on which to operate
  * @param[in] bypass     If state doesn't indicate a share reservation,
  *                       bypass any non-mandatory deny write
  * @param[in] state      state_t to use for this operation
  * @param[in] attrib_set Attributes to set
+ * @param[in,out] attrs_out  Optional attributes of @a obj_hdl afterwards
  *
  * @return FSAL status.
  */
 	 fsal_status_t (*setattr2)(struct fsal_obj_handle *obj_hdl,
 				   bool bypass,
 				   struct state_t *state,
-				   struct attrlist *attrib_set);
+				   struct attrlist *attrib_set,
+				   struct attrlist *attrs_out);
 
 /**
  * @brief Manage closing a file when a state is no longer needed.
@@ -2606,6 +2669,288 @@ struct fsal_obj_ops {
 	 fsal_status_t (*close2)(struct fsal_obj_handle *obj_hdl,
 				 struct state_t *state);
 
+/**@}*/
+
+/**@{*/
+
+/**
+ * Asynchronous I/O methods
+ *
+ * These methods allow a request to be suspended while the backend is busy,
+ * instead of blocking a worker thread for the whole duration of the I/O.
+ * The default implementations call read2, write2 and commit2 and invoke
+ * the completion callback inline, so an FSAL need not provide them unless
+ * it has a truly asynchronous backend.
+ */
+
+/**
+ * @brief Read data from a file asynchronously
+ *
+ * This function has the same semantics as read2, except that the results
+ * are returned in @a read_arg and the completion is signalled through
+ * @a done_cb.  The callback MAY be invoked before this function returns.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     done_cb        Callback to call when I/O is done
+ * @param[in,out] read_arg       Info about read, passed back in callback
+ * @param[in]     caller_arg     Opaque arg from the caller for callback
+ */
+	 void (*read2_async)(struct fsal_obj_handle *obj_hdl,
+			     bool bypass,
+			     fsal_async_cb done_cb,
+			     struct fsal_io_arg *read_arg,
+			     void *caller_arg);
+
+/**
+ * @brief Write data to a file asynchronously
+ *
+ * This function has the same semantics as write2, except that the results
+ * are returned in @a write_arg and the completion is signalled through
+ * @a done_cb.  The callback MAY be invoked before this function returns.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     done_cb        Callback to call when I/O is done
+ * @param[in,out] write_arg      Info about write, passed back in callback
+ * @param[in]     caller_arg     Opaque arg from the caller for callback
+ */
+	 void (*write2_async)(struct fsal_obj_handle *obj_hdl,
+			      bool bypass,
+			      fsal_async_cb done_cb,
+			      struct fsal_io_arg *write_arg,
+			      void *caller_arg);
+
+/**
+ * @brief Commit written data asynchronously
+ *
+ * This function has the same semantics as commit2.  The obj_data passed to
+ * @a done_cb is NULL.
+ *
+ * @param[in] obj_hdl          File on which to operate
+ * @param[in] offset           Start of range to commit
+ * @param[in] len              Length of range to commit
+ * @param[in] done_cb          Callback to call when commit is done
+ * @param[in] caller_arg       Opaque arg from the caller for callback
+ */
+	 void (*commit2_async)(struct fsal_obj_handle *obj_hdl,
+			       off_t offset,
+			       size_t len,
+			       fsal_async_cb done_cb,
+			       void *caller_arg);
+
+/**@}*/
+
+/**@{*/
+
+/**
+ * Vectored I/O methods
+ *
+ * These methods let the caller hand over a scatter/gather list instead
+ * of a single flat buffer.  The default implementations pass a single
+ * segment straight to read2 or write2 and bounce anything else through
+ * a temporary buffer, so an FSAL need only provide them if its backend
+ * has a native vectored interface.
+ */
+
+/**
+ * @brief Read data from a file into a scatter list
+ *
+ * This function has the same semantics as read2, except that the data
+ * are placed into the @a iov_count segments of @a iov in order.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any deny read
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position from which to read
+ * @param[in]     iov_count      Number of segments in @a iov
+ * @param[in,out] iov            Segments to which data are to be copied
+ * @param[out]    read_amount    Amount of data read
+ * @param[out]    end_of_file    true if the end of file has been reached
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*readv2)(struct fsal_obj_handle *obj_hdl,
+				 bool bypass,
+				 struct state_t *state,
+				 uint64_t offset,
+				 int iov_count,
+				 struct iovec *iov,
+				 size_t *read_amount,
+				 bool *end_of_file,
+				 struct io_info *info);
+
+/**
+ * @brief Write data to a file from a gather list
+ *
+ * This function has the same semantics as write2, except that the data
+ * are taken from the @a iov_count segments of @a iov in order.
+ *
+ * @param[in]     obj_hdl        File on which to operate
+ * @param[in]     bypass         If state doesn't indicate a share reservation,
+ *                               bypass any non-mandatory deny write
+ * @param[in]     state          state_t to use for this operation
+ * @param[in]     offset         Position at which to write
+ * @param[in]     iov_count      Number of segments in @a iov
+ * @param[in]     iov            Data to be written
+ * @param[out]    wrote_amount   Amount of data written
+ * @param[in,out] fsal_stable    In, if on, the fsal is requested to write data
+ *                               to stable store. Out, the fsal reports what
+ *                               it did.
+ * @param[in,out] info           more information about the data
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*writev2)(struct fsal_obj_handle *obj_hdl,
+				  bool bypass,
+				  struct state_t *state,
+				  uint64_t offset,
+				  int iov_count,
+				  struct iovec *iov,
+				  size_t *wrote_amount,
+				  bool *fsal_stable,
+				  struct io_info *info);
+
+/**@}*/
+
+/**@{*/
+
+/**
+ * Bulk attribute methods
+ */
+
+/**
+ * @brief Get attributes of several entries of a directory
+ *
+ * This function has the same semantics as getattrs, applied to each of
+ * @a count objects that are all entries of @a dir_hdl.  The name of each
+ * object in @a dir_hdl is passed so that an FSAL can fetch the attributes
+ * relative to the directory in a single pass rather than one handle at a
+ * time.  A failure for one object is reported in its slot of @a status
+ * and does not affect the others.
+ *
+ * As with getattrs, the caller sets request_mask in each of @a attrs and
+ * is responsible for releasing them.
+ *
+ * @param[in]     dir_hdl        Directory the objects are entries of
+ * @param[in]     count          Number of objects
+ * @param[in]     objs           Objects to query
+ * @param[in]     names          Name of each object in @a dir_hdl
+ * @param[in,out] attrs          Attributes of each object
+ * @param[out]    status         Status of each fetch
+ */
+	 void (*getattrs_bulk)(struct fsal_obj_handle *dir_hdl,
+			       unsigned int count,
+			       struct fsal_obj_handle **objs,
+			       const char **names,
+			       struct attrlist *attrs,
+			       fsal_status_t *status);
+
+/**@}*/
+
+/**@{*/
+
+/**
+ * Copy offload methods
+ */
+
+/**
+ * @brief Copy a range of one file into another
+ *
+ * This function copies @a count bytes at @a src_offset in @a src_hdl to
+ * @a dst_offset in @a dst_hdl without the data going through the
+ * caller.  A @a count of 0 copies up to the end of the source.  The copy
+ * may be short only when the end of the source is reached.  Like
+ * write2, the copied data need not be on stable storage when this
+ * returns.  The files may be the same, but the ranges must not overlap.
+ *
+ * The default implementation reads and writes through a buffer; an
+ * FSAL whose backend can copy on its side should provide its own.
+ *
+ * @param[in]  src_hdl     File to copy from
+ * @param[in]  src_state   state_t to read the source with
+ * @param[in]  src_offset  Position in the source
+ * @param[in]  dst_hdl     File to copy to
+ * @param[in]  dst_state   state_t to write the destination with
+ * @param[in]  dst_offset  Position in the destination
+ * @param[in]  count       Number of bytes to copy
+ * @param[out] copied      Number of bytes copied
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*copy2)(struct fsal_obj_handle *src_hdl,
+				struct state_t *src_state,
+				uint64_t src_offset,
+				struct fsal_obj_handle *dst_hdl,
+				struct state_t *dst_state,
+				uint64_t dst_offset,
+				uint64_t count,
+				uint64_t *copied);
+
+/**
+ * @brief Share a range of one file with another
+ *
+ * This function makes the @a count bytes at @a dst_offset in @a dst_hdl
+ * share the storage of the range at @a src_offset in @a src_hdl, as
+ * with a reflink.  A @a count of 0 clones up to the end of the source.
+ * The whole range is cloned or nothing is.  Backends without shared
+ * extents return ERR_FSAL_NOTSUPP, which is the default.
+ *
+ * @param[in] src_hdl     File to clone from
+ * @param[in] src_state   state_t to read the source with
+ * @param[in] src_offset  Position in the source
+ * @param[in] dst_hdl     File to clone to
+ * @param[in] dst_state   state_t to write the destination with
+ * @param[in] dst_offset  Position in the destination
+ * @param[in] count       Number of bytes to clone
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*clone2)(struct fsal_obj_handle *src_hdl,
+				 struct state_t *src_state,
+				 uint64_t src_offset,
+				 struct fsal_obj_handle *dst_hdl,
+				 struct state_t *dst_state,
+				 uint64_t dst_offset,
+				 uint64_t count);
+
+/**@}*/
+
+/**@{*/
+
+/**
+ * Multi-component lookup
+ */
+
+/**
+ * @brief Look up several names in turn, where it is cheap
+ *
+ * This function looks up @a names[0] in @a dir_hdl, @a names[1] in the
+ * object found, and so on, with the checks of fsal_lookup for every
+ * directory searched.  It may stop at any name, for instance the first
+ * one it would have to ask the backend about, and the caller looks up
+ * the rest one at a time.  That caller also gets the error, if there is
+ * one, so stopping is never an error here.  "." and ".." are left to the
+ * caller.  The default resolves nothing.
+ *
+ * @param[in]  dir_hdl Directory to start from
+ * @param[in]  count   Number of names
+ * @param[in]  names   Names to look up
+ * @param[out] done    Number of names resolved
+ * @param[out] handle  Object of names[*done - 1], ref'd, if *done is not 0
+ *
+ * @return FSAL status.
+ */
+	 fsal_status_t (*lookup_components)(struct fsal_obj_handle *dir_hdl,
+					    unsigned int count,
+					    const char **names,
+					    unsigned int *done,
+					    struct fsal_obj_handle **handle);
+
 /**@}*/
 };
 
@@ -3040,6 +3385,9 @@ enum pnfs_ds_status {
 	PNFS_DS_STALE,			/*< is no longer valid */
 };
 
+/** Slots of the DS handle cache of a pDS, a power of 2 */
+#define PNFS_DS_HANDLE_CACHE 64
+
 struct fsal_pnfs_ds {
 	struct glist_head server;	/*< Link in list of Data Servers under
 					   the same FSAL. */
@@ -3056,6 +3404,9 @@ struct fsal_pnfs_ds {
 	int32_t refcount;		/*< Reference count */
 	uint16_t id_servers;		/*< Identifier */
 	uint8_t pnfs_ds_status;		/*< current condition */
+	struct fsal_ds_handle *dsh_cache[PNFS_DS_HANDLE_CACHE];
+					/*< Recent DS handles by wire handle,
+					    with a reference, under lock */
 };
 
 /**
@@ -3075,6 +3426,10 @@ struct fsal_ds_handle {
 	struct fsal_dsh_ops dsh_ops;	/*< Operations vector */
 
 	int64_t refcount;		/*< Reference count */
+	int key_flags;			/*< fhflags1 it was made with */
+	uint8_t key_len;		/*< Length of key */
+	uint8_t key[NFS4_FHSIZE];	/*< Wire handle it was made from, for
+					    the cache of the pDS */
 };
 
 /**
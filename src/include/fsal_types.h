@@ -200,11 +200,14 @@ typedef struct fsal_ace__ {
 	} who;
 } fsal_ace_t;
 
+struct fsal_acl_index;
+
 typedef struct fsal_acl__ {
 	uint32_t naces;
 	fsal_ace_t *aces;
 	pthread_rwlock_t lock;
 	uint32_t ref;
+	struct fsal_acl_index *index;	/* Built when interned, or NULL */
 } fsal_acl_t;
 
 typedef struct fsal_acl_data__ {
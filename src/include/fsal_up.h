@@ -108,6 +108,21 @@ struct layoutrecall_spec {
 	} u;
 };
 
+/** Counters of the CB_LAYOUTRECALLs sent */
+struct layoutrecall_stats {
+	uint64_t file;		/*< LAYOUTRECALL4_FILE sent */
+	uint64_t bulk;		/*< LAYOUTRECALL4_FSID and _ALL sent */
+	uint64_t pending;	/*< Sent and not done with */
+	uint64_t retries;	/*< Sent again after NFS4ERR_DELAY */
+	uint64_t acked;		/*< Answered NFS4_OK */
+	uint64_t nomatch;	/*< Answered NFS4ERR_NOMATCHING_LAYOUT */
+	uint64_t revoked;	/*< Done with by revoking the layouts */
+	uint64_t latency_ns;	/*< Sum from the first send to being done */
+	uint64_t latency_max_ns;
+};
+
+void layoutrecall_stats(struct layoutrecall_stats *st);
+
 /** @} */
 
 static const uint32_t FSAL_UP_INVALIDATE_ATTRS = 0x01;
@@ -220,6 +235,31 @@ struct fsal_up_vector {
 				       void *cookie,
 				       struct layoutrecall_spec *spec);
 
+	/** Recall the layouts on a filesystem, or all of them
+	 *
+	 * One CB_LAYOUTRECALL4_FSID, or _ALL, goes to each client
+	 * holding a layout of the type there, instead of one per file
+	 * and client.  No cookie comes back: the FSAL sees the returns
+	 * of the layouts as they come.
+	 *
+	 * @param[in] export	FSAL export owning ops
+	 * @param[in] layout_type  The type of layout to recall
+	 * @param[in] changed      Whether the layout has changed and the
+	 *                         client ought to finish writes through MDS
+	 * @param[in] io_mode      The iomode to recall
+	 * @param[in] fsid         The filesystem, NULL to recall all the
+	 *                         layouts of the type
+	 * @param[in] spec         Lets us be fussy about what clients we send
+	 *                         to. May be NULL.
+	 *
+	 */
+	state_status_t (*layoutrecall_bulk)(struct fsal_export *exp,
+					    layouttype4 layout_type,
+					    bool changed,
+					    layoutiomode4 io_mode,
+					    const fsal_fsid_t *fsid,
+					    struct layoutrecall_spec *spec);
+
 	/** Remove or change a deviceid
 	 *
 	 * @param[in] notify_type  Change or remove
@@ -271,6 +311,11 @@ fsal_status_t up_async_invalidate(struct fridgethr *fr,
 				  struct gsh_buffdesc *obj, uint32_t flags,
 				  void (*cb)(void *, fsal_status_t),
 				  void *cb_arg);
+fsal_status_t up_async_invalidate_batch(struct fridgethr *fr,
+					struct fsal_export *exp,
+					unsigned int count,
+					struct gsh_buffdesc *objs,
+					uint32_t flags);
 fsal_status_t up_async_update(struct fridgethr *fr,
 			      struct fsal_export *exp,
 			      struct gsh_buffdesc *obj, struct attrlist *attr,
@@ -298,6 +343,14 @@ fsal_status_t up_async_layoutrecall(struct fridgethr *fr,
 				    struct layoutrecall_spec *spec,
 				    void (*cb)(void *, state_status_t),
 				    void *cb_arg);
+fsal_status_t up_async_layoutrecall_bulk(struct fridgethr *fr,
+					 struct fsal_export *exp,
+					 layouttype4 layout_type, bool changed,
+					 layoutiomode4 io_mode,
+					 const fsal_fsid_t *fsid,
+					 struct layoutrecall_spec *spec,
+					 void (*cb)(void *, state_status_t),
+					 void *cb_arg);
 fsal_status_t up_async_notify_device(struct fridgethr *fr,
 				     struct fsal_export *exp,
 				     notify_deviceid_type4 notify_type,
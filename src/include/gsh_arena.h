@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file   gsh_arena.h
+ * @brief  Bump allocator for memory living as long as a request
+ *
+ * Allocations are carved one after the other out of a buffer embedded
+ * in the arena, then out of chunks taken from the heap once it is
+ * full.  Nothing is freed individually, gsh_arena_release() gives
+ * everything back at once.
+ */
+
+#ifndef GSH_ARENA_H
+#define GSH_ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+#include "abstract_mem.h"
+
+/** Size of the buffer embedded in the arena */
+#define GSH_ARENA_INLINE 2048
+
+/** Size of the chunks taken from the heap once the buffer is full */
+#define GSH_ARENA_CHUNK 4096
+
+/** Alignment of every allocation */
+#define GSH_ARENA_ALIGN 16
+
+struct gsh_arena_chunk {
+	struct gsh_arena_chunk *next;	/*< Chunks of the arena */
+	char data[] __attribute__ ((aligned(GSH_ARENA_ALIGN)));
+};
+
+struct gsh_arena {
+	char *next;		/*< First free byte */
+	char *end;		/*< End of the buffer allocations come from */
+	struct gsh_arena_chunk *chunks;	/*< Chunks taken from the heap */
+	char buf[GSH_ARENA_INLINE]
+		__attribute__ ((aligned(GSH_ARENA_ALIGN)));
+};
+
+/**
+ * @brief Set up an empty arena
+ *
+ * @param[out] arena  The arena
+ */
+static inline void gsh_arena_init(struct gsh_arena *arena)
+{
+	arena->next = arena->buf;
+	arena->end = arena->buf + sizeof(arena->buf);
+	arena->chunks = NULL;
+}
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * Like gsh_malloc(), this never fails.
+ *
+ * @param[in,out] arena  The arena
+ * @param[in]     size   Bytes to allocate
+ *
+ * @return The memory, valid until the arena is released.
+ */
+static inline void *gsh_arena_alloc(struct gsh_arena *arena, size_t size)
+{
+	struct gsh_arena_chunk *chunk;
+	void *p;
+
+	size = (size + GSH_ARENA_ALIGN - 1) & ~((size_t) GSH_ARENA_ALIGN - 1);
+
+	if (size <= (size_t) (arena->end - arena->next)) {
+		p = arena->next;
+		arena->next += size;
+		return p;
+	}
+
+	if (size > GSH_ARENA_CHUNK / 2) {
+		/* Big enough to get a chunk of its own, keep carving the
+		 * current one.
+		 */
+		chunk = gsh_malloc(sizeof(*chunk) + size);
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		return chunk->data;
+	}
+
+	chunk = gsh_malloc(sizeof(*chunk) + GSH_ARENA_CHUNK);
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->next = chunk->data + size;
+	arena->end = chunk->data + GSH_ARENA_CHUNK;
+
+	return chunk->data;
+}
+
+/**
+ * @brief Allocate zeroed memory from an arena
+ *
+ * @param[in,out] arena  The arena
+ * @param[in]     size   Bytes to allocate
+ *
+ * @return The memory, valid until the arena is released.
+ */
+static inline void *gsh_arena_calloc(struct gsh_arena *arena, size_t size)
+{
+	return memset(gsh_arena_alloc(arena, size), 0, size);
+}
+
+/**
+ * @brief Give back everything allocated from an arena
+ *
+ * The arena is left empty and may be used again.
+ *
+ * @param[in,out] arena  The arena
+ */
+static inline void gsh_arena_release(struct gsh_arena *arena)
+{
+	struct gsh_arena_chunk *chunk;
+
+	while (arena->chunks != NULL) {
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		gsh_free(chunk);
+	}
+
+	gsh_arena_init(arena);
+}
+
+#endif /* GSH_ARENA_H */
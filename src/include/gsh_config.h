@@ -118,10 +118,15 @@ typedef enum protos {
  */
 #define DRC_TCP_CHECKSUM true
 
+/**
+ * @brief Default value for core_param.drc.tcp.idle_trim
+ */
+#define DRC_TCP_IDLE_TRIM 600	/* 10m */
+
 /**
  * @brief Default value for core_param.drc.udp.npart
  */
-#define DRC_UDP_NPART 7
+#define DRC_UDP_NPART 16
 
 /**
  * @brief Default value for core_param.drc.udp.size
@@ -232,6 +237,19 @@ typedef struct nfs_core_param {
 	    specific transport.  Defaults to 512 and settable by
 	    Dispatch_Max_Reqs_Xprt. */
 	uint32_t dispatch_max_reqs_xprt;
+	/** Placement of worker threads, a fridgethr_affinity_t.  With
+	    anything but none, workers are pinned and each CPU or NUMA
+	    node gets its own request queues.  Defaults to none and
+	    settable by Worker_Affinity. */
+	uint32_t worker_affinity;
+	/** Whether to decode a transport's requests on a decoder pinned
+	    to the Worker_Affinity domain its packets arrive on.  Defaults
+	    to false and settable by Decoder_Affinity. */
+	bool decoder_affinity;
+	/** Whether to queue LOW_LATENCY and HIGH_LATENCY requests fairly
+	    across client hosts and exports, and apply per-tenant
+	    backpressure.  Defaults to false and settable by Fair_Queue. */
+	bool fair_queue;
 	/** Parameters controlling the Duplicate Request Cache.  */
 	struct {
 		/** Whether to disable the DRC entirely.  Defaults to
@@ -275,6 +293,17 @@ typedef struct nfs_core_param {
 			    DRC_TCP_CHECKSUM and settable by
 			    DRC_TCP_Checksum. */
 			bool checksum;
+			/** Whether the connections of a client host
+			    (nconnect, reconnections from a new port)
+			    share one DRC.  Defaults to false and
+			    settable by DRC_TCP_Per_Client. */
+			bool per_client;
+			/** Seconds without a request after which a
+			    connection's DRC gives back its replies
+			    and tables, 0 to keep them.  Defaults to
+			    DRC_TCP_IDLE_TRIM and settable by
+			    DRC_TCP_Idle_Trim. */
+			uint32_t idle_trim;
 		} tcp;
 		/** Parameters controlling UDP DRC behavior. */
 		struct {
@@ -346,6 +375,13 @@ typedef struct nfs_core_param {
 	    accept a task before erroring.  Settable with
 	    Decoder_Fridge_Block_Timeout. */
 	time_t decoder_fridge_block_timeout;
+	/** How long (in microseconds) an idle decoder thread polls for
+	    a new transport before it sleeps.  Settable with
+	    Decoder_Spin_Time. */
+	uint32_t decoder_spin;
+	/** How long (in microseconds) an idle worker polls its run
+	    queue before it sleeps.  Settable with Worker_Spin_Time. */
+	uint32_t worker_spin;
 	/** Polling interval for blocked lock polling thread. */
 	time_t blocked_lock_poller_interval;
 	/** Protocols to support.  Should probably be renamed.
@@ -368,6 +404,20 @@ typedef struct nfs_core_param {
 	bool enable_RQUOTA;
 	/** Whether to use fast stats.  Defaults to false. */
 	bool enable_FASTSTATS;
+	/** Sample the timeline of one request in this many into the
+	    latency histograms, 0 disables sampling.  Settable with
+	    Latency_Sample_Rate. */
+	uint32_t latency_sample_rate;
+	/** Events kept in the trace ring of each thread, 0 turns tracing
+	    off.  Settable with Trace_Records. */
+	uint32_t trace_records;
+	/** Where the trace rings are dumped on a crash, the pid is
+	    appended.  Settable with Trace_Dump_Path. */
+	char *trace_dump_path;
+	/** Length in seconds of the windows over which the busiest
+	    clients and files are tracked, 0 turns tracking off.
+	    Settable with Top_N_Window. */
+	uint32_t top_n_window;
 	/** Whether tcp sockets should use SO_KEEPALIVE */
 	bool enable_tcp_keepalive;
 	/** Maximum number of TCP probes before dropping the connection */
@@ -376,6 +426,17 @@ typedef struct nfs_core_param {
 	uint32_t tcp_keepidle;
 	/** Time between each keepalive probe */
 	uint32_t tcp_keepintvl;
+	/** NFS TCP listening sockets sharing the port with SO_REUSEPORT,
+	    each accepting on its own dispatcher thread.  Defaults to 1
+	    and settable by TCP_Listeners. */
+	uint32_t tcp_listeners;
+	/** UDP sockets of each protocol sharing its port with
+	    SO_REUSEPORT, each receiving on its own dispatcher thread.
+	    Defaults to 1 and settable by UDP_Listeners. */
+	uint32_t udp_listeners;
+	/** Most datagrams read from a UDP socket for one wakeup.
+	    Defaults to 1 and settable by UDP_Batch. */
+	uint32_t udp_batch;
 	/** Whether to use short NFS file handle to accommodate VMware
 	    NFS client. Enable this if you have a VMware NFSv3 client.
 	    VMware NFSv3 client has a max limit of 56 byte file handles!
@@ -385,13 +446,50 @@ typedef struct nfs_core_param {
 	    calling getgroups() when "Manage_Gids = TRUE" is
 	    used in a export entry. */
 	time_t manage_gids_expiration;
+	/** Seconds between two enumerations of the netgroups used by the
+	    exports, 0 to look every client up with innetgr().  Defaults
+	    to 0, settable with Netgroup_Preload_Interval. */
+	uint32_t netgroup_preload_interval;
+	/** Threads looking up the export roots at startup, 1 to look
+	    them up one after the other.  Defaults to 16, settable with
+	    Export_Init_Threads. */
+	uint32_t export_init_threads;
+	/** Allocate state owners and client ids from NUMA-local arenas
+	    of 2MB hugepages.  Defaults to false, settable with
+	    State_Hugepage_Arenas. */
+	bool state_hugepage_arenas;
+	/** Name of the shared memory segment the counters are published
+	    in, NULL for none.  Settable with Stats_Shm_Name. */
+	char *stats_shm_name;
+	/** Seconds between two updates of the segment.  Defaults to 1,
+	    settable with Stats_Shm_Interval. */
+	uint32_t stats_shm_interval;
+	/** Exports and clients the segment has room for.  Default to
+	    1024 and 4096, settable with Stats_Shm_Exports and
+	    Stats_Shm_Clients. */
+	uint32_t stats_shm_exports;
+	uint32_t stats_shm_clients;
+	/** Unix socket a server starting with the same setting takes the
+	    sockets and clients over on, NULL for none.  Settable with
+	    Handoff_Socket. */
+	char *handoff_socket;
 	/** Path to the directory containing server specific
 	    modules.  In particular, this is where FSALs live. */
 	char *ganesha_modules_loc;
 	/* Frequency of dbus health heartbeat in ms. Set to 0 to disable */
 	uint32_t heartbeat_freq;
+	/** Threads running the DBus methods that only read, the Get and
+	    Show ones.  Settable with DBus_Workers. */
+	uint32_t dbus_workers;
 	/* Whether to use device major/minor for fsid. Defaults to false. */
 	bool fsid_device;
+	/** Address space reserved for each size class of the READ/WRITE
+	    buffer pool, 0 disables the pool.  Settable with
+	    IO_Buffer_Pool_Size. */
+	uint64_t io_buffer_pool_size;
+	/** Buffers of each size class a thread keeps for reuse.
+	    Settable with IO_Buffer_Thread_Cache. */
+	uint32_t io_buffer_thread_cache;
 } nfs_core_parameter_t;
 
 /** @} */
@@ -422,10 +520,42 @@ typedef struct nfs_core_param {
  */
 #define IDMAPCONF_DEFAULT "/etc/idmapd.conf"
 
+/**
+ * @brief Default seconds the idmapper keeps a mapping, and a failed
+ *        lookup
+ */
+#define IDMAP_CACHE_EXPIRATION_DEFAULT 900
+#define IDMAP_NEGATIVE_EXPIRATION_DEFAULT 60
+
 /**
  * @brief Default value of deleg_recall_retry_delay.
  */
 #define DELEG_RECALL_RETRY_DELAY_DEFAULT 1
+#define STATEID_CACHE_SIZE_DEFAULT 16381
+
+/**
+ * @brief Default number of v4.1 callback operations outstanding per
+ *        client
+ */
+#define CB_MAX_INFLIGHT_DEFAULT 64
+
+/**
+ * @brief Default number of forechannel slots of a v4.1 session
+ */
+#define MAX_SESSION_SLOTS_DEFAULT 64
+
+/**
+ * @brief Default size of the largest NFSv4.2 COPY done before replying
+ */
+#define COPY_SYNC_MAX_DEFAULT (64 * 1024 * 1024)
+
+/**
+ * @brief Where the clients allowed to reclaim are recorded
+ */
+enum recovery_backend {
+	RECOVERY_BACKEND_FS,	/*< A directory per client */
+	RECOVERY_BACKEND_LOG,	/*< An append-only log of client records */
+};
 
 typedef struct nfs_version4_parameter {
 	/** Whether to disable the NFSv4 grace period.  Defaults to
@@ -458,6 +588,14 @@ typedef struct nfs_version4_parameter {
 	    Only_Numeric_Owners. NB., this is permissible for a server
 	    implementation (RFC 5661). */
 	bool only_numeric_owners;
+	/** Seconds the idmapper keeps a mapping, 0 for ever.  Defaults
+	    to IDMAP_CACHE_EXPIRATION_DEFAULT and settable with
+	    Idmap_Cache_Expiration. */
+	uint32_t idmap_cache_expiration;
+	/** Seconds the idmapper keeps a failed lookup, 0 to not keep
+	    it.  Defaults to IDMAP_NEGATIVE_EXPIRATION_DEFAULT and
+	    settable with Idmap_Negative_Expiration. */
+	uint32_t idmap_negative_expiration;
 	/** Whether to allow delegations. Defaults to false and settable
 	    with Delegations */
 	bool allow_delegations;
@@ -467,10 +605,128 @@ typedef struct nfs_version4_parameter {
 	bool pnfs_mds;
 	/** Whether this a pNFS DS server. Defaults to false */
 	bool pnfs_ds;
+	/** Number of slots in the table caching stateid lookups, 0 to
+	    only use the stateid hash table.  Defaults to
+	    STATEID_CACHE_SIZE_DEFAULT and settable with
+	    Stateid_Cache_Size. */
+	uint32_t stateid_cache_size;
+	/** Stable storage of the client records.  Defaults to
+	    RECOVERY_BACKEND_FS and settable with RecoveryBackend. */
+	enum recovery_backend recovery_backend;
+	/** Most NFSv4.1 callback operations sent to a client and not yet
+	    answered.  Defaults to CB_MAX_INFLIGHT_DEFAULT and settable
+	    with Callback_Max_In_Flight. */
+	uint32_t cb_max_inflight;
+	/** Most READs of one NFSv4.1 COMPOUND waiting on the FSAL at
+	    once, 1 to run the operations strictly one after the other.
+	    Defaults to 1 and settable with Compound_Pipeline_Depth. */
+	uint32_t compound_pipeline_depth;
+	/** Largest NFSv4.2 COPY done before replying, larger ones run
+	    in the background and end with CB_OFFLOAD.  Defaults to
+	    COPY_SYNC_MAX_DEFAULT and settable with Copy_Sync_Max. */
+	uint64_t copy_sync_max;
+	/** Whether READ_PLUS looks for blocks of zeroes in the data of
+	    files whose FSAL cannot find holes.  Defaults to false and
+	    settable with Read_Plus_Zero_Detect. */
+	bool read_plus_zero_detect;
+	/** Whether a LAYOUTGET starting where the previous one of the
+	    client for the file ended asks the FSAL for the rest of the
+	    file.  Defaults to false and settable with
+	    Layout_Sequential_Whole_File. */
+	bool layout_sequential_whole_file;
+	/** Most forechannel slots, i.e. requests in flight, of an
+	    NFSv4.1 session.  Defaults to MAX_SESSION_SLOTS_DEFAULT and
+	    settable with Max_Session_Slots. */
+	uint32_t max_session_slots;
+	/** Whether the result of each operation of a COMPOUND is
+	    encoded into the reply as soon as it completes, and released.
+	    Defaults to false and settable with Stream_Compound_Reply. */
+	bool stream_compound_reply;
 } nfs_version4_parameter_t;
 
 /** @} */
 
+#ifdef _USE_NFS_RDMA
+/**
+ * @defgroup config_rdma Structure and defaults for NFS_RDMA
+ *
+ * @{
+ */
+
+#define NFS_RDMA_PORT 20049
+#define NFS_RDMA_DEPTH_DEFAULT 32
+#define NFS_RDMA_CREDITS_DEFAULT 30
+#define NFS_RDMA_INLINE_DEFAULT 4096
+
+typedef struct nfs_rdma_parameter {
+	/** Port NFS/RDMA listens on.  Defaults to NFS_RDMA_PORT and
+	    settable with Port. */
+	uint16_t port;
+	/** Send queue depth of a connection.  Settable with Sq_Depth. */
+	uint32_t sq_depth;
+	/** Receives posted for a connection, or for all of them with
+	    Use_SRQ.  Settable with Rq_Depth. */
+	uint32_t rq_depth;
+	/** Scatter/gather entries of a send.  Settable with
+	    Max_Send_Sge. */
+	uint32_t max_send_sge;
+	/** Scatter/gather entries of a receive.  Settable with
+	    Max_Recv_Sge. */
+	uint32_t max_recv_sge;
+	/** Connection requests waiting to be accepted.  Settable with
+	    Backlog. */
+	uint32_t backlog;
+	/** RPC-over-RDMA credits granted to a client, its requests in
+	    flight.  Settable with Credits. */
+	uint32_t credits;
+	/** Whether the connections share one receive queue.  Settable
+	    with Use_SRQ. */
+	bool use_srq;
+	/** Largest inline call received.  Settable with
+	    Inline_Recv_Size. */
+	uint32_t inline_recv;
+	/** Largest inline reply sent.  Settable with
+	    Inline_Send_Size. */
+	uint32_t inline_send;
+} nfs_rdma_parameter_t;
+
+/** @} */
+#endif				/* _USE_NFS_RDMA */
+
+#ifdef USE_RPC_TLS
+/**
+ * @defgroup config_tls Structure and defaults for RPC_TLS
+ *
+ * @{
+ */
+
+#define RPC_TLS_HANDSHAKE_TIMEOUT 10
+
+typedef struct nfs_tls_parameter {
+	/** Whether clients may start TLS on their TCP connections.
+	    Defaults to false and settable with Enable. */
+	bool enable;
+	/** Whether calls other than NULL need a TLS connection.
+	    Defaults to false and settable with Required. */
+	bool required;
+	/** PEM certificate chain of the server.  Settable with
+	    Certificate_File. */
+	char *cert_file;
+	/** PEM private key of the certificate.  Settable with
+	    Private_Key_File. */
+	char *key_file;
+	/** PEM CAs the client certificates must come from; without it,
+	    clients don't show one.  Settable with CA_File. */
+	char *ca_file;
+	/** Seconds a handshake may take.  Defaults to
+	    RPC_TLS_HANDSHAKE_TIMEOUT and settable with
+	    Handshake_Timeout. */
+	uint32_t handshake_timeout;
+} nfs_tls_parameter_t;
+
+/** @} */
+#endif				/* USE_RPC_TLS */
+
 typedef struct nfs_param {
 	/** NFS Core parameters, settable in the NFS_Core_Param
 	    stanza. */
@@ -481,6 +737,14 @@ typedef struct nfs_param {
 	/** kerberos configuration.  Settable in the NFS_KRB5 stanza. */
 	nfs_krb5_parameter_t krb5_param;
 #endif				/* _HAVE_GSSAPI */
+#ifdef _USE_NFS_RDMA
+	/** NFS/RDMA transport.  Settable in the NFS_RDMA stanza. */
+	nfs_rdma_parameter_t rdma_param;
+#endif				/* _USE_NFS_RDMA */
+#ifdef USE_RPC_TLS
+	/** RPC-over-TLS.  Settable in the RPC_TLS stanza. */
+	nfs_tls_parameter_t tls_param;
+#endif				/* USE_RPC_TLS */
 } nfs_parameter_t;
 
 extern nfs_parameter_t nfs_param;
@@ -63,6 +63,7 @@
  * and signals.
  */
 #define HEARTBEAT_NAME "heartbeat"
+#define GRACE_LIFTED_NAME "grace_lifted"
 
 #define DBUS_PATH "/org/ganesha/nfsd/"
 #define DBUS_ADMIN_IFACE "org.ganesha.nfsd.admin"
@@ -74,6 +75,13 @@
 	.direction = "out"   \
 }
 
+#define GRACE_LIFTED_ARG     \
+{                            \
+	.name = "clients",   \
+	.type = "u",         \
+	.direction = "out"   \
+}
+
 #define STATUS_REPLY      \
 {                         \
 	.name = "status", \
@@ -203,6 +211,9 @@ void del_dbus_broadcast(struct dbus_bcast_item *to_remove);
 int dbus_heartbeat_cb(void *arg);
 void init_heartbeat(void);
 
+/* grace lifted function call back */
+int dbus_grace_lifted_cb(void *arg);
+
 void gsh_dbus_pkginit(void);
 void gsh_dbus_pkgshutdown(void);
 void *gsh_dbus_thread(void *arg);
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file   gsh_hash.h
+ * @brief  Fast hash of in-memory lookup keys
+ *
+ * gsh_hash64() hashes with the CRC32C instruction where the CPU has
+ * one and with CityHash64WithSeed() otherwise, picked on first use.
+ * The two give different values, so a gsh_hash64() value must never
+ * leave the process: not in a file handle, not on disk, not to another
+ * node.  Use CityHash64() for those.
+ *
+ * Colliding keys are easy to forge for the CRC32C hash, keep it for
+ * keys the server makes.  Owner names, client ids and the like stay on
+ * CityHash64WithSeed().
+ */
+
+#ifndef GSH_HASH_H
+#define GSH_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint64_t (*gsh_hash64_func_t)(const void *buf, size_t len,
+				      uint64_t seed);
+
+extern gsh_hash64_func_t gsh_hash64_func;
+
+/**
+ * @brief Hash a lookup key
+ *
+ * @param[in] buf  The key
+ * @param[in] len  Its length
+ * @param[in] seed Seed, to get different hashes of the same key
+ *
+ * @return The hash.
+ */
+static inline uint64_t gsh_hash64(const void *buf, size_t len, uint64_t seed)
+{
+	return gsh_hash64_func(buf, len, seed);
+}
+
+uint64_t gsh_hash64_city(const void *buf, size_t len, uint64_t seed);
+#if defined(__x86_64__)
+uint64_t gsh_hash64_crc32c(const void *buf, size_t len, uint64_t seed);
+#endif
+
+const char *gsh_hash_impl(void);
+
+#endif /* GSH_HASH_H */
@@ -0,0 +1,90 @@
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER fridgethr
+
+#if !defined(GANESHA_LTTNG_FRIDGETHR_TP_H) || \
+	defined(TRACEPOINT_HEADER_MULTI_READ)
+#define GANESHA_LTTNG_FRIDGETHR_TP_H
+
+#include <lttng/tracepoint.h>
+
+/**
+ * @brief Trace a job submitted to a fridge
+ *
+ * @param[in] fridge	Name of the fridge
+ * @param[in] func	Job function
+ * @param[in] arg	Job argument
+ */
+TRACEPOINT_EVENT(
+	fridgethr,
+	submit,
+	TP_ARGS(const char *, fridge,
+		void *, func,
+		void *, arg),
+	TP_FIELDS(
+		ctf_string(fridge, fridge)
+		ctf_integer_hex(void *, func, func)
+		ctf_integer_hex(void *, arg, arg)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	fridgethr,
+	submit,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a fridge thread starting a job
+ *
+ * @param[in] fridge	Name of the fridge
+ * @param[in] func	Job function
+ * @param[in] arg	Job argument
+ */
+TRACEPOINT_EVENT(
+	fridgethr,
+	run_start,
+	TP_ARGS(const char *, fridge,
+		void *, func,
+		void *, arg),
+	TP_FIELDS(
+		ctf_string(fridge, fridge)
+		ctf_integer_hex(void *, func, func)
+		ctf_integer_hex(void *, arg, arg)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	fridgethr,
+	run_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a fridge thread finishing a job
+ *
+ * @param[in] fridge	Name of the fridge
+ * @param[in] func	Job function
+ * @param[in] arg	Job argument
+ */
+TRACEPOINT_EVENT(
+	fridgethr,
+	run_end,
+	TP_ARGS(const char *, fridge,
+		void *, func,
+		void *, arg),
+	TP_FIELDS(
+		ctf_string(fridge, fridge)
+		ctf_integer_hex(void *, func, func)
+		ctf_integer_hex(void *, arg, arg)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	fridgethr,
+	run_end,
+	TRACE_INFO)
+
+#endif /* GANESHA_LTTNG_FRIDGETHR_TP_H */
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "gsh_lttng/fridgethr.h"
+
+#include <lttng/tracepoint-event.h>
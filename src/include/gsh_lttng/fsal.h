@@ -0,0 +1,65 @@
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER fsal
+
+#if !defined(GANESHA_LTTNG_FSAL_TP_H) || \
+	defined(TRACEPOINT_HEADER_MULTI_READ)
+#define GANESHA_LTTNG_FSAL_TP_H
+
+#include <lttng/tracepoint.h>
+
+/**
+ * @brief Trace MDCACHE calling into the FSAL below it
+ *
+ * @param[in] function	Name of the MDCACHE function making the call
+ * @param[in] line	Line number of call
+ * @param[in] ctx	op_ctx of the request, see nfs_rpc:context
+ */
+TRACEPOINT_EVENT(
+	fsal,
+	subcall_start,
+	TP_ARGS(const char *, function,
+		int, line,
+		void *, ctx),
+	TP_FIELDS(
+		ctf_string(function, function)
+		ctf_integer(int, line, line)
+		ctf_integer_hex(void *, ctx, ctx)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	fsal,
+	subcall_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the return of a call into the FSAL below MDCACHE
+ *
+ * @param[in] function	Name of the MDCACHE function making the call
+ * @param[in] line	Line number of call
+ * @param[in] ctx	op_ctx of the request
+ */
+TRACEPOINT_EVENT(
+	fsal,
+	subcall_end,
+	TP_ARGS(const char *, function,
+		int, line,
+		void *, ctx),
+	TP_FIELDS(
+		ctf_string(function, function)
+		ctf_integer(int, line, line)
+		ctf_integer_hex(void *, ctx, ctx)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	fsal,
+	subcall_end,
+	TRACE_INFO)
+
+#endif /* GANESHA_LTTNG_FSAL_TP_H */
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "gsh_lttng/fsal.h"
+
+#include <lttng/tracepoint-event.h>
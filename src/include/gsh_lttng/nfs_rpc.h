@@ -149,6 +149,158 @@ TRACEPOINT_LOGLEVEL(
 	v4op_end,
 	TRACE_INFO)
 
+/**
+ * @brief Trace the timeline of a sampled request
+ *
+ * @param req        - the address of the request
+ * @param export_id  - export the request was accounted to, -1 for none
+ * @param decode     - nsecs from receive to queued
+ * @param queue      - nsecs waiting for a worker
+ * @param execute    - nsecs in the service function
+ * @param reply      - nsecs to encode and send the reply
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	timeline,
+	TP_ARGS(request_data_t *, req,
+		int, export_id,
+		uint64_t, decode,
+		uint64_t, queue,
+		uint64_t, execute,
+		uint64_t, reply),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer(int, export_id, export_id)
+		ctf_integer(uint64_t, decode, decode)
+		ctf_integer(uint64_t, queue, queue)
+		ctf_integer(uint64_t, execute, execute)
+		ctf_integer(uint64_t, reply, reply)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	timeline,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a request put on a worker queue
+ *
+ * @param req    - the address of the request
+ * @param queue  - name of the queue
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	enqueue,
+	TP_ARGS(request_data_t *, req,
+		const char *, queue),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_string(queue, queue)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	enqueue,
+	TRACE_INFO)
+
+/**
+ * @brief Trace a request taken off a queue by a worker
+ *
+ * @param req     - the address of the request
+ * @param worker  - index of the worker
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	dequeue,
+	TP_ARGS(request_data_t *, req,
+		uint32_t, worker),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer(uint32_t, worker, worker)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	dequeue,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the op_ctx a request runs with
+ *
+ * Ties the events carrying an op_ctx (fsal:*) to the request.
+ *
+ * @param req  - the address of the request
+ * @param ctx  - its op_ctx
+ * @param xid  - its rpc xid
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	context,
+	TP_ARGS(request_data_t *, req,
+		void *, ctx,
+		uint32_t, xid),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer_hex(void *, ctx, ctx)
+		ctf_integer(uint32_t, xid, xid)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	context,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the lookup of a request in the duplicate request cache
+ *
+ * @param req     - the address of the request
+ * @param status  - dupreq_status_t of the lookup
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	dupreq_start,
+	TP_ARGS(request_data_t *, req,
+		int, status),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+		ctf_integer(int, status, status)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	dupreq_start,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the result of a request being saved in the DRC
+ *
+ * @param req     - the address of the request
+ */
+
+TRACEPOINT_EVENT(
+	nfs_rpc,
+	dupreq_finish,
+	TP_ARGS(request_data_t *, req),
+	TP_FIELDS(
+		ctf_integer_hex(request_data_t *, req, req)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	nfs_rpc,
+	dupreq_finish,
+	TRACE_INFO)
+
 #endif /* GANESHA_LTTNG_NFS_RPC_H */
 
 #undef TRACEPOINT_INCLUDE
@@ -64,6 +64,62 @@ TRACEPOINT_LOGLEVEL(
 	delete,
 	TRACE_INFO)
 
+/**
+ * @brief Trace a lock that has to wait for a conflicting one
+ *
+ * @param[in] function	Name of function blocking the lock
+ * @param[in] line	Line number of call
+ * @param[in] obj	obj being locked
+ * @param[in] lock	lock entry that waits
+ */
+TRACEPOINT_EVENT(
+	state,
+	lock_blocked,
+	TP_ARGS(const char *, function,
+		int, line,
+		void *, obj,
+		void *, lock),
+	TP_FIELDS(
+		ctf_string(function, function)
+		ctf_integer(int, line, line)
+		ctf_integer_hex(void *, obj, obj)
+		ctf_integer_hex(void *, lock, lock)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	state,
+	lock_blocked,
+	TRACE_INFO)
+
+/**
+ * @brief Trace the grant of a lock that was blocked
+ *
+ * @param[in] function	Name of function granting the lock
+ * @param[in] line	Line number of call
+ * @param[in] obj	obj being locked
+ * @param[in] lock	lock entry granted
+ */
+TRACEPOINT_EVENT(
+	state,
+	lock_granted,
+	TP_ARGS(const char *, function,
+		int, line,
+		void *, obj,
+		void *, lock),
+	TP_FIELDS(
+		ctf_string(function, function)
+		ctf_integer(int, line, line)
+		ctf_integer_hex(void *, obj, obj)
+		ctf_integer_hex(void *, lock, lock)
+	)
+)
+
+TRACEPOINT_LOGLEVEL(
+	state,
+	lock_granted,
+	TRACE_INFO)
+
 #endif /* GANESHA_LTTNG_STATE_TP_H */
 
 #undef TRACEPOINT_INCLUDE
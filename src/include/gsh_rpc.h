@@ -137,6 +137,10 @@ typedef struct nfs_krb5_param {
 void log_sperror_gss(char *, OM_uint32, OM_uint32);
 const char *str_gc_proc(rpc_gss_proc_t);
 
+#ifndef AUTH_TLS
+#define AUTH_TLS 7		/* RPC-over-TLS probe, RFC 9289 */
+#endif
+
 /* Private data associated with a new TI-RPC (TCP) SVCXPRT (transport
  * connection), ie, xprt->xp_u1.
  */
@@ -144,6 +148,7 @@ const char *str_gc_proc(rpc_gss_proc_t);
 /* uint16_t actually used */
 #define XPRT_PRIVATE_FLAG_DECODING 0x0008
 #define XPRT_PRIVATE_FLAG_STALLED 0x0010	/* ie, -on stallq- */
+#define XPRT_PRIVATE_FLAG_TLS 0x0020	/* records in kernel TLS */
 
 /* uint32_t instructions */
 #define XPRT_PRIVATE_FLAG_LOCKED	SVC_XPRT_FLAG_LOCKED
@@ -151,20 +156,35 @@ const char *str_gc_proc(rpc_gss_proc_t);
 #define XPRT_PRIVATE_FLAG_INCREQ	0x00040000
 #define XPRT_PRIVATE_FLAG_DECREQ	0x00080000
 
+struct export_perms_cache;
+struct gsh_client;
+
 typedef struct gsh_xprt_private {
 	SVCXPRT *xprt;
 	struct glist_head stallq;
 	uint16_t flags;
+	/* Connection statistics, for the accepted connections */
+	struct glist_head xprts;	/*< Link in the list of connections */
+	time_t created;
+	uint64_t rpcs;		/*< Requests decoded */
+	time_t active;		/*< When the last one was */
+	uint32_t stalls;	/*< Times it was put on the stallq */
+	uint64_t stall_ns;	/*< Time spent on the stallq, summed */
+	struct timespec stalled;	/*< When it was last stalled */
+	struct export_perms_cache *perms_cache;	/*< Connections only, from
+						    the first request */
+	struct gsh_client *client;	/*< Pinned by the first request */
 } gsh_xprt_private_t;
 
 static inline gsh_xprt_private_t *alloc_gsh_xprt_private(SVCXPRT *xprt,
 							 uint32_t flags)
 {
 	gsh_xprt_private_t *xu = (gsh_xprt_private_t *)
-		gsh_malloc(sizeof(gsh_xprt_private_t));
+		gsh_calloc(1, sizeof(gsh_xprt_private_t));
 
 	xu->xprt = xprt;
 	xu->flags = flags;
+	xu->created = time(NULL);
 
 	return xu;
 }
@@ -333,4 +353,95 @@ CLIENT *gsh_clnt_create(char *, unsigned long, unsigned long, char *);
 void gsh_clnt_destroy(CLIENT *);
 
 extern tirpc_pkg_params ntirpc_pp;
+
+/**
+ * @brief Release the segment list built by xdr_io_data()
+ *
+ * The data itself still belongs to the result structure, which is freed
+ * once the reply has been sent.
+ */
+static inline void xdr_io_data_release(struct xdr_uio *uio, u_int flags)
+{
+	gsh_free(uio);
+}
+
+/**
+ * @brief Encode or decode READ data without copying it on encode
+ *
+ * On encode, the data are attached to the outgoing record as an external
+ * segment rather than being copied into the stream by xdr_bytes; only the
+ * length and the XDR padding go through the stream itself.  If the
+ * transport cannot take segments this falls back to a plain copy.  Decode
+ * and free are handled exactly as xdr_bytes.
+ *
+ * @param[in]     xdrs     XDR stream
+ * @param[in,out] data_val Data buffer
+ * @param[in,out] data_len Data length
+ * @param[in]     maxsize  Largest length accepted
+ *
+ * @retval true on success.
+ */
+static inline bool xdr_io_data(XDR *xdrs, char **data_val, u_int *data_len,
+			       u_int maxsize)
+{
+	static const char zero[BYTES_PER_XDR_UNIT];
+	struct xdr_uio *uio;
+	struct xdr_vio *vio;
+	u_int pad;
+
+	if (xdrs->x_op != XDR_ENCODE || *data_len == 0)
+		return inline_xdr_bytes(xdrs, data_val, data_len, maxsize);
+
+	if (*data_len > maxsize)
+		return false;
+
+	if (!inline_xdr_u_int32_t(xdrs, data_len))
+		return false;
+
+	uio = gsh_calloc(1, sizeof(struct xdr_uio) + sizeof(struct xdr_vio));
+	uio->uio_release = xdr_io_data_release;
+	uio->uio_count = 1;
+	uio->uio_references = 1;
+
+	vio = &uio->uio_vio[0];
+	vio->vio_base = (uint8_t *) *data_val;
+	vio->vio_head = vio->vio_base;
+	vio->vio_tail = vio->vio_base + *data_len;
+	vio->vio_wrap = vio->vio_tail;
+
+	if (!XDR_PUTBUFS(xdrs, uio, UIO_FLAG_NONE)) {
+		gsh_free(uio);
+		if (!XDR_PUTBYTES(xdrs, *data_val, *data_len))
+			return false;
+	}
+
+	pad = (BYTES_PER_XDR_UNIT - (*data_len % BYTES_PER_XDR_UNIT))
+		% BYTES_PER_XDR_UNIT;
+
+	if (pad != 0 && !XDR_PUTBYTES(xdrs, zero, pad))
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Encode directory entries put in XDR form beforehand
+ *
+ * Each entry in the buffer starts with its TRUE "value follows"; this
+ * ends the list and adds eof.  Only for encoding.
+ */
+static inline bool xdr_dirents_encoded(XDR *xdrs, char *buf, u_int len,
+				       bool_t *eof)
+{
+	bool_t more = FALSE;
+
+	if (len != 0 && !XDR_PUTBYTES(xdrs, buf, len))
+		return false;
+
+	if (!inline_xdr_bool(xdrs, &more))
+		return false;
+
+	return inline_xdr_bool(xdrs, eof);
+}
+
 #endif /* GSH_RPC_H */
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_stats_shm.h
+ * @brief Layout of the shared memory stats segment
+ *
+ * With Stats_Shm_Name set, the server publishes its counters in a
+ * POSIX shared memory segment of that name, rewritten every
+ * Stats_Shm_Interval seconds.  The segment starts with a header that
+ * locates its sections, each an array of records of a fixed size.
+ *
+ * The header's seq is odd while the server rewrites the segment.  A
+ * reader loads seq, copies what it wants, and loads seq again; unless
+ * both loads returned the same even value it must start over.
+ *
+ * Readers check magic and version, and reach records through the
+ * offset and record size of their section only, so that new fields
+ * may be added at the end of a record within a version.  Magic is
+ * cleared when the server shuts down.
+ *
+ * This header only depends on <stdint.h>, for tools to include.
+ */
+
+#ifndef GSH_STATS_SHM_H
+#define GSH_STATS_SHM_H
+
+#include <stdint.h>
+
+#define GSH_STATS_SHM_MAGIC 0x47534853	/* "GSHS" */
+#define GSH_STATS_SHM_VERSION 1
+
+/** Size of the names in records, NUL included */
+#define GSH_STATS_SHM_NAME_LEN 64
+
+/**
+ * Latency histograms are log-linear: values below 2^sub_bits have a
+ * bucket each, and above that each power of two is split in 2^sub_bits
+ * buckets, see gsh_stats_shm_bucket_value().
+ */
+#define GSH_STATS_SHM_HIST_SUB_BITS 3
+#define GSH_STATS_SHM_HIST_BUCKETS 312
+
+/** Protocols of the counters of an export, a client or the server */
+enum gsh_stats_shm_proto {
+	GSH_STATS_SHM_NFSV3,
+	GSH_STATS_SHM_NFSV40,
+	GSH_STATS_SHM_NFSV41,
+	GSH_STATS_SHM_NFSV42,
+	GSH_STATS_SHM_NLM4,
+	GSH_STATS_SHM_MNT,
+	GSH_STATS_SHM_RQUOTA,
+	GSH_STATS_SHM_9P,
+	GSH_STATS_SHM_PROTOS
+};
+
+/** Requests, or NFSv4 compounds, of a protocol */
+struct gsh_stats_shm_op {
+	uint64_t total;
+	uint64_t errors;
+	uint64_t dups;		/*< Answered from the duplicate request cache */
+	uint64_t latency_ns;	/*< Summed over the requests */
+	uint64_t max_ns;
+	uint64_t queue_ns;	/*< Summed time waiting for a worker */
+};
+
+/** Reads or writes of a protocol */
+struct gsh_stats_shm_io {
+	struct gsh_stats_shm_op op;
+	uint64_t requested;	/*< Bytes */
+	uint64_t transferred;
+};
+
+struct gsh_stats_shm_counters {
+	struct gsh_stats_shm_op proto[GSH_STATS_SHM_PROTOS];
+	struct gsh_stats_shm_io read[GSH_STATS_SHM_PROTOS];
+	struct gsh_stats_shm_io write[GSH_STATS_SHM_PROTOS];
+};
+
+struct gsh_stats_shm_export {
+	uint32_t export_id;
+	uint32_t reserved;
+	char path[2 * GSH_STATS_SHM_NAME_LEN];	/*< Truncated */
+	struct gsh_stats_shm_counters c;
+};
+
+struct gsh_stats_shm_client {
+	char addr[GSH_STATS_SHM_NAME_LEN];
+	struct gsh_stats_shm_counters c;
+};
+
+/** A named counter, module.name */
+struct gsh_stats_shm_value {
+	char name[GSH_STATS_SHM_NAME_LEN];
+	uint64_t value;
+};
+
+struct gsh_stats_shm_hist {
+	char name[GSH_STATS_SHM_NAME_LEN];
+	uint64_t count;
+	uint64_t max_ns;
+	uint64_t bucket[GSH_STATS_SHM_HIST_BUCKETS];
+};
+
+enum gsh_stats_shm_section_id {
+	GSH_STATS_SHM_GLOBAL,	/*< One gsh_stats_shm_counters */
+	GSH_STATS_SHM_EXPORTS,	/*< gsh_stats_shm_export */
+	GSH_STATS_SHM_CLIENTS,	/*< gsh_stats_shm_client */
+	GSH_STATS_SHM_VALUES,	/*< gsh_stats_shm_value */
+	GSH_STATS_SHM_HISTS,	/*< gsh_stats_shm_hist */
+	GSH_STATS_SHM_SECTIONS
+};
+
+struct gsh_stats_shm_section {
+	uint64_t offset;	/*< From the start of the segment */
+	uint32_t count;		/*< Records filled */
+	uint32_t max;		/*< Records there is room for */
+	uint32_t size;		/*< Of a record */
+	uint32_t dropped;	/*< Records left out for want of room */
+};
+
+struct gsh_stats_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;		/*< Of the segment */
+	uint64_t seq;
+	uint64_t updated_ns;	/*< Realtime of the last rewrite */
+	uint64_t started_ns;	/*< Realtime the server started */
+	uint32_t pid;
+	uint32_t interval;	/*< Seconds between rewrites */
+	uint32_t hist_sub_bits;
+	uint32_t hist_buckets;
+	struct gsh_stats_shm_section section[GSH_STATS_SHM_SECTIONS];
+};
+
+/**
+ * @brief Highest value in nsecs counted in a histogram bucket
+ */
+static inline uint64_t gsh_stats_shm_bucket_value(unsigned int idx)
+{
+	const unsigned int sub = 1 << GSH_STATS_SHM_HIST_SUB_BITS;
+	unsigned int shift;
+
+	if (idx < sub)
+		return idx;
+
+	shift = idx / sub - 1;
+
+	return ((uint64_t) (sub + idx % sub) << shift) + (1ULL << shift) - 1;
+}
+
+#endif /* GSH_STATS_SHM_H */
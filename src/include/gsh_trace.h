@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file   gsh_trace.h
+ * @brief  Flight recorder of binary trace events
+ *
+ * Every thread records fixed size events into a ring of its own, the
+ * oldest events being overwritten.  Recording formats nothing and
+ * takes no lock.  The rings are dumped to a file on request (DBus
+ * admin method trace_dump) or when the server crashes, and decoded
+ * offline by scripts/ganesha_trace.py.
+ */
+
+#ifndef GSH_TRACE_H
+#define GSH_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/**
+ * @brief Trace events
+ *
+ * The meaning of arg and arg32 in the records of each event.  Do not
+ * renumber, the decoder knows them by value.
+ */
+enum gsh_trace_event {
+	TRACE_NONE = 0,
+	TRACE_REQ_START = 1,	/*< arg: prog << 32 | xid,
+				    arg32: vers << 16 | proc */
+	TRACE_REQ_DONE = 2,	/*< arg: ns spent, arg32: xid */
+	TRACE_NFS4_OP = 3,	/*< arg: ns spent,
+				    arg32: status << 16 | opcode */
+	TRACE_FSAL_CALL = 4,	/*< arg: ns spent, arg32: line */
+	TRACE_LOCK_WAIT = 5,	/*< arg: ns waited, arg32: line */
+	TRACE_CACHE_MISS = 6,	/*< arg: 0, arg32: line */
+};
+
+struct gsh_trace_rec {
+	uint64_t ts;		/*< CLOCK_MONOTONIC, in ns */
+	const char *site;	/*< Function that recorded the event */
+	uint64_t arg;		/*< Event specific */
+	uint32_t event;		/*< enum gsh_trace_event */
+	uint32_t arg32;		/*< Event specific */
+};
+
+struct gsh_trace_ring {
+	uint64_t count;			/*< Events recorded so far */
+	struct gsh_trace_rec *recs;	/*< gsh_trace_mask + 1 records */
+};
+
+/** Records per ring - 1, 0 when tracing is off */
+extern uint32_t gsh_trace_mask;
+
+extern __thread struct gsh_trace_ring *gsh_trace_ring;
+
+struct gsh_trace_ring *gsh_trace_new_ring(void);
+void gsh_trace_pkginit(uint32_t records, const char *crash_path);
+int gsh_trace_dump(const char *path);
+
+static inline uint64_t gsh_trace_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Record an event
+ *
+ * @param[in] event  enum gsh_trace_event
+ * @param[in] site   Function recording it, a string that outlives us
+ * @param[in] arg    Event specific
+ * @param[in] arg32  Event specific
+ */
+static inline void gsh_trace(uint32_t event, const char *site, uint64_t arg,
+			     uint32_t arg32)
+{
+	struct gsh_trace_ring *ring = gsh_trace_ring;
+	struct gsh_trace_rec *rec;
+
+	if (gsh_trace_mask == 0)
+		return;
+
+	if (ring == NULL)
+		ring = gsh_trace_new_ring();
+
+	rec = &ring->recs[ring->count & gsh_trace_mask];
+	rec->ts = gsh_trace_clock();
+	rec->site = site;
+	rec->arg = arg;
+	rec->event = event;
+	rec->arg32 = arg32;
+	ring->count++;
+}
+
+/**
+ * @brief Start timing an event
+ *
+ * @return The start time, 0 when tracing is off.
+ */
+static inline uint64_t gsh_trace_start(void)
+{
+	if (gsh_trace_mask == 0)
+		return 0;
+
+	return gsh_trace_clock();
+}
+
+/**
+ * @brief Record an event timed from gsh_trace_start()
+ */
+static inline void gsh_trace_done(uint32_t event, const char *site,
+				  uint64_t start, uint32_t arg32)
+{
+	if (start == 0)
+		return;
+
+	gsh_trace(event, site, gsh_trace_clock() - start, arg32);
+}
+
+#endif /* GSH_TRACE_H */
@@ -77,6 +77,11 @@ typedef int (*val_display_function_t)(struct gsh_buffdesc *, char *);
 #define HT_FLAG_NONE 0x0000	/*< Null hash table flags */
 #define HT_FLAG_CACHE 0x0001	/*< Indicates that caching should be
 				   enabled */
+#define HT_FLAG_LOCKLESS 0x0002	/*< hashtable_getref looks the cache up
+				   without the partition lock.  The
+				   table must hold a reference on each
+				   value it stores.  Implies
+				   HT_FLAG_CACHE. */
 
 /**
  * @brief Hash parameters
@@ -87,7 +92,10 @@ typedef int (*val_display_function_t)(struct gsh_buffdesc *, char *);
 
 struct hash_param {
 	uint32_t flags; /*< Create flags */
-	uint32_t cache_entry_count; /*< 2^10 <= Power of 2 <= 2^15 */
+	uint32_t cache_entry_count; /*< Initial cache slots per
+					partition, the cache grows with
+					the partition up to
+					HT_CACHE_MAX */
 	uint32_t index_size;	/*< Number of partition trees, this MUST
 				   be a prime number. */
 	index_function_t hash_func_key;	/*< Partition function,
@@ -128,6 +136,7 @@ struct hash_param {
  */
 
 typedef struct hash_stat {
+	size_t partitions; /*< Number of partitions */
 	size_t entries; /*< Number of entries in the hash table */
 	size_t min_rbt_num_node; /*< Minimum size (in number of nodes) of the
 				     rbt used. */
@@ -135,8 +144,25 @@ typedef struct hash_stat {
 				     rbt used. */
 	size_t average_rbt_num_node; /*< Average size (in number of nodes) of
 				       the rbt used. */
+	size_t cache_slots; /*< Cache slots over all the partitions */
 } hash_stat_t;
 
+/** Most cache slots of a partition, 2MB of pointers */
+#define HT_CACHE_MAX 262143
+
+/**
+ * @brief Direct-mapped cache of a partition
+ *
+ * Replaced by one about twice as big whenever the partition holds more
+ * than two entries per slot, so it keeps up with a table that grows
+ * far beyond its expected size.
+ */
+
+struct hash_cache {
+	uint32_t size; /*< Number of slots */
+	struct rbt_node *slots[];
+};
+
 /**
  * @brief Represents an individual partition
  *
@@ -148,7 +174,8 @@ struct hash_partition {
 	size_t count; /*< Numer of entries in this partition */
 	struct rbt_head rbt; /*< The red-black tree */
 	pthread_rwlock_t lock; /*< Lock for this partition */
-	struct rbt_node **cache; /*< Expected entry cache */
+	struct hash_cache *cache; /*< Expected entry cache */
+	GSH_CACHE_PAD(0);
 };
 
 /**
@@ -162,6 +189,7 @@ typedef struct hash_table {
 					 HashTable */
 	pool_t *node_pool; /*< Pool of RBT nodes */
 	pool_t *data_pool; /*< Pool of buffer pairs */
+	struct glist_head tables; /*< Entry in the list of all tables */
 	struct hash_partition partitions[]; /*< Parameter.index_size
 						partitions of the hash
 						table. */
@@ -228,6 +256,8 @@ hash_error_t hashtable_delall(struct hash_table *,
 				      struct gsh_buffdesc));
 
 void hashtable_log(log_components_t, struct hash_table *);
+void hashtable_get_stats(struct hash_table *, hash_stat_t *);
+void hashtable_foreach(void (*)(struct hash_table *, void *), void *);
 
 /* These are very simple wrappers around the primitives */
 
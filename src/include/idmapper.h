@@ -47,6 +47,12 @@
 /* Arbitrary string buffer lengths */
 #define PWENT_BEST_GUESS_LEN 1024
 
+/** Longest name the cache keeps for a UID or GID */
+#define IDMAP_NAME_MAX 1024
+
+/** Longest UID or GID name the cache keeps encoded, as an XDR opaque */
+#define IDMAP_XDR_MAX 64
+
 /**
  * @brief Shared between idmapper.c and idmapper_cache.c.  If you
  * aren't in idmapper.c, leave these symbols alone.
@@ -54,19 +60,36 @@
  * @{
  */
 
-extern pthread_rwlock_t idmapper_user_lock;
-extern pthread_rwlock_t idmapper_group_lock;
+enum idmap_map {
+	IDMAP_UNAME,		/*< User name to UID and GID */
+	IDMAP_PRINC,		/*< GSS principal to UID and GID */
+	IDMAP_GNAME,		/*< Group name to GID */
+	IDMAP_UID,		/*< UID to user name */
+	IDMAP_GID,		/*< GID to group name */
+	IDMAP_MAPS
+};
+
+enum idmap_hit {
+	IDMAP_MISS,		/*< Not cached, or expired */
+	IDMAP_HIT,
+	IDMAP_NEGATIVE,		/*< Cached as unknown to the mapper */
+};
 
 void idmapper_cache_init(void);
-bool idmapper_add_user(const struct gsh_buffdesc *, uid_t, const gid_t *,
-		       bool);
-bool idmapper_add_group(const struct gsh_buffdesc *, gid_t);
-bool idmapper_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
-			      const gid_t **, bool);
-bool idmapper_lookup_by_uid(const uid_t, const struct gsh_buffdesc **,
-			    const gid_t **);
-bool idmapper_lookup_by_gname(const struct gsh_buffdesc *, uid_t *);
-bool idmapper_lookup_by_gid(const gid_t, const struct gsh_buffdesc **);
+enum idmap_hit idmapper_lookup_name(enum idmap_map,
+				    const struct gsh_buffdesc *, uint32_t *,
+				    gid_t *, bool *);
+enum idmap_hit idmapper_lookup_id(enum idmap_map, uint32_t,
+				  struct gsh_buffdesc *);
+void idmapper_add_name(enum idmap_map, const struct gsh_buffdesc *,
+		       uint32_t, const gid_t *, bool);
+void idmapper_add_id(enum idmap_map, uint32_t, const struct gsh_buffdesc *,
+		     bool);
+bool idmapper_lookup_xdr(enum idmap_map, uint32_t, char *, uint32_t *);
+void idmapper_add_xdr(enum idmap_map, uint32_t, const struct gsh_buffdesc *,
+		      bool);
+void idmapper_refresh(enum idmap_map, const struct gsh_buffdesc *,
+		      uint32_t);
 /** @} */
 
 bool idmapper_init(void);
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file io_bufpool.h
+ * @brief Size-class pool of page-aligned READ/WRITE data buffers
+ *
+ * Buffers come from one virtual reservation per power-of-two size
+ * class, so the class of a buffer is known from its address alone and
+ * io_buf_free() needs no size.  Each buffer remembers the NUMA node
+ * that first touched it and is returned to that node's free list. A
+ * small per-thread cache sits in front of the node lists.
+ *
+ * Requests larger than the largest class, or made once a class is
+ * exhausted, fall back to gsh_malloc_aligned(); io_buf_free() handles
+ * both kinds of buffer.
+ */
+
+#ifndef IO_BUFPOOL_H
+#define IO_BUFPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** Smallest size class, one page */
+#define IO_BUF_MIN_SHIFT 12
+
+/** Most size classes, 4K through 64M */
+#define IO_BUF_MAX_CLASSES 15
+
+/** Most buffers a thread may cache per size class */
+#define IO_BUF_TCACHE_MAX 16
+
+struct io_bufpool_class_stats {
+	uint64_t size;		/*< Buffer size of this class */
+	uint64_t capacity;	/*< Buffers the reservation can hold */
+	uint64_t created;	/*< Buffers carved out so far */
+	uint64_t in_use;	/*< Buffers currently handed out */
+	uint64_t hiwat;		/*< Most buffers ever in use at once */
+	uint64_t allocs;	/*< Allocations served by this class */
+	uint64_t misses;	/*< Allocations that fell back to malloc */
+};
+
+void io_bufpool_init(uint64_t max_io);
+void *io_buf_alloc(size_t size);
+void io_buf_free(void *buf);
+unsigned int io_bufpool_stats(struct io_bufpool_class_stats *stats,
+			      unsigned int max);
+
+#endif /* IO_BUFPOOL_H */
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file   lock_profile.h
+ * @brief  Contention profile of the PTHREAD_ lock wrappers
+ *
+ * Built with USE_LOCK_PROFILE, every call site of PTHREAD_MUTEX_lock,
+ * PTHREAD_RWLOCK_rdlock and PTHREAD_RWLOCK_wrlock counts the times it
+ * took its lock, the times it had to wait for it, and how long it
+ * waited and then held it.  The counters are reported by the
+ * GetLockProfile DBus method of the exportstats interface.
+ */
+
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gsh_intrinsic.h"
+#include "abstract_atomic.h"
+#include "gsh_trace.h"
+
+/**
+ * @brief Counters of a lock call site
+ *
+ * Times are in ticks of lock_profile_clock().
+ */
+struct lock_site {
+	const char *file;
+	const char *name;	/*< The lock expression */
+	int line;
+	uint32_t registered;
+	struct lock_site *next;	/*< All the sites that took a lock */
+	uint64_t acquired;
+	uint64_t contended;	/*< Acquisitions that had to wait */
+	uint64_t wait;
+	uint64_t wait_max;
+	uint64_t hold;
+	uint64_t hold_max;
+};
+
+#define LOCK_SITE_INIT(_lock) {			\
+	.file = __FILE__,			\
+	.name = #_lock,				\
+	.line = __LINE__,			\
+}
+
+/** Locks a thread may hold at once and still have their hold timed */
+#define LOCK_PROFILE_HELD 32
+
+struct lock_held {
+	void *lock;
+	struct lock_site *site;
+	uint64_t since;
+};
+
+extern __thread struct lock_held lock_held[LOCK_PROFILE_HELD];
+extern __thread uint32_t lock_nheld;
+
+void lock_profile_register(struct lock_site *site);
+void lock_profile_reset(void);
+
+#ifdef USE_DBUS
+#include <dbus/dbus.h>
+
+void lock_profile_dbus(DBusMessageIter *iter);
+#endif
+
+/**
+ * @brief Cheap timestamp
+ *
+ * The TSC where there is one, nanoseconds otherwise.
+ */
+static inline uint64_t lock_profile_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return gsh_trace_clock();
+#endif
+}
+
+static inline void lock_profile_max(uint64_t *max, uint64_t val)
+{
+	/* Racy, a lost maximum is as good as another one */
+	if (val > atomic_fetch_uint64_t(max))
+		atomic_store_uint64_t(max, val);
+}
+
+/**
+ * @brief Account a lock just taken
+ *
+ * @param[in] site   Call site that took it
+ * @param[in] lock   The lock
+ * @param[in] start  lock_profile_clock() before trying the lock
+ * @param[in] waited Whether the lock was busy
+ */
+static inline void lock_profile_acquired(struct lock_site *site, void *lock,
+					 uint64_t start, bool waited)
+{
+	uint64_t now = lock_profile_clock();
+	struct lock_held *held;
+
+	if (unlikely(!atomic_fetch_uint32_t(&site->registered)))
+		lock_profile_register(site);
+
+	(void)atomic_inc_uint64_t(&site->acquired);
+	if (waited) {
+		(void)atomic_inc_uint64_t(&site->contended);
+		(void)atomic_add_uint64_t(&site->wait, now - start);
+		lock_profile_max(&site->wait_max, now - start);
+	}
+
+	if (lock_nheld == LOCK_PROFILE_HELD)
+		return;
+
+	held = &lock_held[lock_nheld++];
+	held->lock = lock;
+	held->site = site;
+	held->since = now;
+}
+
+/**
+ * @brief Account a lock about to be released
+ *
+ * The hold time goes to the site that took the lock.
+ */
+static inline void lock_profile_release(void *lock)
+{
+	uint32_t i = lock_nheld;
+	uint64_t hold;
+
+	while (i > 0) {
+		if (lock_held[--i].lock != lock)
+			continue;
+
+		hold = lock_profile_clock() - lock_held[i].since;
+		(void)atomic_add_uint64_t(&lock_held[i].site->hold, hold);
+		lock_profile_max(&lock_held[i].site->hold_max, hold);
+		lock_held[i] = lock_held[--lock_nheld];
+		return;
+	}
+}
+
+#endif /* LOCK_PROFILE_H */
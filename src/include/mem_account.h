@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file   mem_account.h
+ * @brief  Memory held by each subsystem
+ *
+ * Built with USE_MEM_ACCOUNTING, gsh_malloc and friends put a small
+ * header in front of each block, naming the subsystem of the source
+ * file that allocated it and the size asked for, so that gsh_free can
+ * take the block off the right counters.  Pool objects are charged to
+ * the file allocating them, but for those of the hugepage arenas,
+ * which are not counted.  GetMemoryStats of the exportstats DBus
+ * interface and the mem.* values of the stats segment report the
+ * blocks and bytes live for each subsystem.
+ *
+ * Blocks from gsh_malloc must then be released with gsh_free, never
+ * free(), while gsh_free still takes blocks from other allocators; it
+ * knows them from the missing magic, reading in front of them, which
+ * AddressSanitizer reports.
+ */
+
+#ifndef MEM_ACCOUNT_H
+#define MEM_ACCOUNT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+enum mem_tag {
+	MEM_TAG_OTHER,
+	MEM_TAG_MDCACHE,
+	MEM_TAG_SAL,
+	MEM_TAG_DRC,
+	MEM_TAG_XDR,
+	MEM_TAG_RPC,
+	MEM_TAG_FSAL,
+	MEM_TAG_PROTOCOLS,
+	MEM_TAG_COUNT
+};
+
+#ifdef USE_MEM_ACCOUNTING
+
+#define MEM_ACCOUNT_MAGIC 0x4d454d41	/* "MEMA" */
+
+/**
+ * @brief In front of each block
+ *
+ * The magic ends right before the block: in front of a block from
+ * glibc malloc lie the high bytes of its chunk size, always zero.
+ */
+struct mem_account_hdr {
+	uint64_t size;		/*< Asked for */
+	uint16_t tag;
+	uint8_t shift;		/*< Of the distance from the start */
+	uint8_t reserved;
+	uint32_t magic;
+};
+
+/** Room taken in front of the blocks, keeping malloc's alignment */
+#define MEM_ACCOUNT_PREFIX sizeof(struct mem_account_hdr)
+
+enum mem_tag mem_account_tag(const char *file);
+void mem_account_add(enum mem_tag tag, size_t n);
+void mem_account_sub(enum mem_tag tag, size_t n);
+
+#ifdef USE_DBUS
+#include <dbus/dbus.h>
+
+void mem_account_dbus(DBusMessageIter *iter);
+#endif
+
+struct stats_shm_ctx;
+
+void mem_account_shm_fill(struct stats_shm_ctx *ctx);
+
+/**
+ * @brief Header of a block, NULL if not from gsh_malloc
+ */
+static inline struct mem_account_hdr *mem_account_hdr(void *p)
+{
+	struct mem_account_hdr *hdr = (struct mem_account_hdr *) p - 1;
+
+	if (p == NULL || hdr->magic != MEM_ACCOUNT_MAGIC)
+		return NULL;
+
+	return hdr;
+}
+
+/**
+ * @brief Charge a new block to the subsystem of the file
+ *
+ * @param[in] base   What the allocator returned
+ * @param[in] offset Where the block starts, a power of 2, at least
+ *                   MEM_ACCOUNT_PREFIX
+ * @param[in] n      Size asked for
+ * @param[in] file   Allocating source file
+ *
+ * @return The block.
+ */
+static inline void *mem_account_set(void *base, size_t offset, size_t n,
+				    const char *file)
+{
+	struct mem_account_hdr *hdr;
+	void *p = (char *) base + offset;
+
+	hdr = (struct mem_account_hdr *) p - 1;
+	hdr->size = n;
+	hdr->tag = mem_account_tag(file);
+	hdr->shift = __builtin_ctzl(offset);
+	hdr->reserved = 0;
+	hdr->magic = MEM_ACCOUNT_MAGIC;
+
+	mem_account_add(hdr->tag, n);
+
+	return p;
+}
+
+/**
+ * @brief Take a block off its counters
+ *
+ * @return What to give back to the allocator.
+ */
+static inline void *mem_account_clear(void *p)
+{
+	struct mem_account_hdr *hdr = mem_account_hdr(p);
+
+	if (hdr == NULL)
+		return p;
+
+	mem_account_sub(hdr->tag, hdr->size);
+	hdr->magic = 0;
+
+	return (char *) p - ((size_t) 1 << hdr->shift);
+}
+
+#else /* USE_MEM_ACCOUNTING */
+
+#define MEM_ACCOUNT_PREFIX 0
+
+struct mem_account_hdr;
+
+static inline struct mem_account_hdr *mem_account_hdr(void *p)
+{
+	return NULL;
+}
+
+static inline void *mem_account_set(void *base, size_t offset, size_t n,
+				    const char *file)
+{
+	return base;
+}
+
+static inline void *mem_account_clear(void *p)
+{
+	return p;
+}
+
+#endif /* USE_MEM_ACCOUNTING */
+
+#endif /* MEM_ACCOUNT_H */
@@ -24,6 +24,7 @@
 #ifndef NETGROUP_CACHE_H
 #define NETGROUP_CACHE_H
 void ng_cache_init(void);
+void ng_cache_shutdown(void);
 void ng_clear_cache(void);
 bool ng_innetgr(const char *group, const char *host);
 #endif
@@ -770,6 +770,9 @@ typedef struct entry3 entry3;
 struct dirlist3 {
 	entry3 *entries;
 	bool_t eof;
+	/* Entries encoded by nfs3_readdir, sent instead of entries */
+	char *encoded;
+	u_int encoded_len;
 };
 typedef struct dirlist3 dirlist3;
 
@@ -816,6 +819,9 @@ typedef struct entryplus3 entryplus3;
 struct dirlistplus3 {
 	entryplus3 *entries;
 	bool_t eof;
+	/* Entries encoded by nfs3_readdirplus, sent instead of entries */
+	char *encoded;
+	u_int encoded_len;
 };
 typedef struct dirlistplus3 dirlistplus3;
 
@@ -40,6 +40,46 @@ typedef int fsal_acl_status_t;
 #define NFS_V4_ACL_INIT_ENTRY_FAILED  6
 #define NFS_V4_ACL_NOT_FOUND  7
 
+/**
+ * @brief ACEs of one who, as a run of the index's order array
+ */
+struct fsal_acl_span {
+	uint32_t off;
+	uint32_t len;
+};
+
+/** The ACEs naming one user or group */
+struct fsal_acl_named {
+	uint32_t id;
+	struct fsal_acl_span span;
+};
+
+/**
+ * @brief The ACEs of an ACL that may apply to one type of object
+ *
+ * Only ALLOW and DENY ACEs applicable to the type are kept, in ACL
+ * order within each who, as positions in the ACL's aces.  An ACE whose
+ * permissions earlier ACEs of its who all cover is left out: it could
+ * not change the outcome.  The ACEs applying to some caller are the
+ * merge of the spans of the whos it matches.
+ */
+struct fsal_acl_kind {
+	struct fsal_acl_span all;	/*< Any who, for root */
+	struct fsal_acl_span owner;	/*< OWNER@ */
+	struct fsal_acl_span group;	/*< GROUP@ */
+	struct fsal_acl_span everyone;	/*< EVERYONE@ */
+	struct fsal_acl_named *users;	/*< Sorted by uid */
+	uint32_t nusers;
+	struct fsal_acl_named *groups;	/*< Sorted by gid */
+	uint32_t ngroups;
+	uint32_t *order;
+};
+
+/** An interned ACL, compiled for file [0] and directory [1] checks */
+struct fsal_acl_index {
+	struct fsal_acl_kind kind[2];
+};
+
 fsal_acl_t *nfs4_acl_alloc();
 fsal_ace_t *nfs4_ace_alloc(int nace);
 
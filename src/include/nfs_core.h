@@ -40,6 +40,7 @@
 
 #include "sal_data.h"
 #include "gsh_config.h"
+#include "gsh_arena.h"
 
 #ifdef _USE_9P
 #include "9p.h"
@@ -105,12 +106,53 @@ typedef enum request_type {
 #endif				/* _USE_9P */
 } request_type_t;
 
-typedef struct request_data {
+typedef struct request_data request_data_t;
+
+/**
+ * @brief Resume a request suspended on asynchronous I/O
+ *
+ * Called from a worker thread, with op_ctx restored, once the I/O the
+ * request was waiting on has completed.
+ *
+ * @param[in] reqdata  The suspended request
+ *
+ * @return NFS_REQ_OK, NFS_REQ_DROP or NFS_REQ_ASYNC_WAIT to wait again.
+ */
+typedef int (*nfs_resume_func_t)(request_data_t *reqdata);
+
+/* Asynchronous request state (request_data_t.async_flags) */
+#define ASYNC_PROC_DONE 0x01	/*< Service function returned async wait */
+#define ASYNC_PROC_EXIT 0x02	/*< Asynchronous I/O completed */
+
+struct request_data {
 	struct glist_head req_q;	/* chaining of pending requests */
 	struct timespec time_queued;	/*< The time at which a request was
 					 *  added to the worker thread queue.
 					 */
+	struct timespec time_received;	/*< The time at which a sampled
+					 *  request was received.
+					 */
+	bool latency_sample;		/*< The request's timeline is
+					 *  sampled
+					 */
 	request_type_t rtype;
+	uint32_t q_class;		/*< REQ_Q_* it was last queued on */
+	uint32_t async_flags;		/*< ASYNC_PROC_* state */
+	nfs_resume_func_t resume;	/*< Called to resume a suspended
+					 *  request
+					 */
+	void *proc_data;		/*< Protocol private data kept across
+					 *  a suspension
+					 */
+	uint64_t fq_bytes;		/*< Payload the fair queue charges */
+	/* The request context lives here rather than on the worker's stack
+	 * so that it survives a suspension. */
+	struct req_op_context req_ctx;
+	struct export_perms export_perms;
+	struct user_cred user_credentials;
+	/* Scratch memory of the service function, released along with
+	 * the request once the reply is sent. */
+	struct gsh_arena arena;
 
 	union request_content {
 		rpc_call_t call;
@@ -119,7 +161,7 @@ typedef struct request_data {
 		struct _9p_request_data _9p;
 #endif
 	} r_u;
-} request_data_t;
+};
 
 extern pool_t *request_pool;
 
@@ -127,6 +169,9 @@ extern pool_t *request_pool;
 extern struct timespec ServerBootTime;
 extern time_t ServerEpoch;
 
+uint64_t nfs_uptime_ms(void);
+void nfs_startup_phase(const char *phase);
+
 extern verifier4 NFS4_write_verifier;	/*< NFS V4 write verifier */
 extern writeverf3 NFS3_write_verifier;	/*< NFS V3 write verifier */
 
@@ -161,12 +206,72 @@ void nfs_rpc_dispatch_stop(void);
 
 request_data_t *nfs_rpc_dequeue_req(nfs_worker_data_t *worker);
 void nfs_rpc_enqueue_req(request_data_t *req);
+void nfs_rpc_return_credit(void);
 uint32_t get_dequeue_count(void);
 uint32_t get_enqueue_count(void);
+uint32_t nfs_rpc_outstanding_reqs_est(void);
+void nfs_rpc_drop_export(struct gsh_export *export);
+struct export_perms_cache *nfs_rpc_xprt_perms_cache(SVCXPRT *xprt);
+void nfs_rpc_trim_idle_xprts(void);
+uint32_t nfs_rpc_bound_sockets(int *fds, uint8_t *tags, uint32_t max);
+int nfs_rpc_adopt_socket(uint8_t tag, int fd);
+
+/* in nfs_handoff.c */
+
+void nfs_handoff_receive(void);
+void nfs_handoff_clids(void);
+void nfs_handoff_listen(void);
+void nfs_handoff_shutdown(void);
+bool nfs_handoff_done(void);
+
+#ifdef USE_RPC_TLS
+/* in nfs_rpc_tls.c */
+
+void nfs_rpc_tls_init(void);
+enum xprt_stat nfs_rpc_tls_probe(request_data_t *reqdata);
+bool nfs_rpc_tls_refused(request_data_t *reqdata);
+#endif
+
+/* in nfs_rpc_fairq.c */
+
+/** How long an idle worker waits before looking at rate limited flows
+ *  again */
+#define FAIRQ_THROTTLE_WAIT_NS (10 * NS_PER_MSEC)
+
+void nfs_rpc_fairq_init(void);
+void nfs_rpc_fairq_enqueue(request_data_t *reqdata, bool high_latency);
+request_data_t *nfs_rpc_fairq_dequeue(bool *throttled);
+uint32_t nfs_rpc_fairq_backlog(SVCXPRT *xprt);
+uint32_t nfs_rpc_fairq_size(void);
 
 /* in nfs_worker_thread.c */
 
-void nfs_rpc_execute(request_data_t *req);
+int nfs_rpc_execute(request_data_t *req);
+void nfs_rpc_async_complete(request_data_t *reqdata);
+
+/**
+ * @brief Get the request_data_t containing an NFS svc_req
+ *
+ * @param[in] req  The svc_req passed to a service function
+ *
+ * @return The request.
+ */
+static inline request_data_t *nfs_req_to_reqdata(struct svc_req *req)
+{
+	return container_of(req, request_data_t, r_u.req.svc);
+}
+
+/**
+ * @brief Get the scratch arena of an NFS request
+ *
+ * @param[in] req  The svc_req passed to a service function
+ *
+ * @return The arena, released once the reply is sent.
+ */
+static inline struct gsh_arena *nfs_req_arena(struct svc_req *req)
+{
+	return &nfs_req_to_reqdata(req)->arena;
+}
 const nfs_function_desc_t *nfs_rpc_get_funcdesc(nfs_request_t *);
 
 int worker_init(void);
@@ -180,6 +285,12 @@ extern struct config_block nfs_ip_name;
 extern struct config_block krb5_param;
 #endif
 extern struct config_block version4_param;
+#ifdef _USE_NFS_RDMA
+extern struct config_block rdma_param;
+#endif
+#ifdef USE_RPC_TLS
+extern struct config_block tls_param;
+#endif
 
 /* in nfs_admin_thread.c */
 
@@ -39,6 +39,7 @@
 #include "nfs4.h"
 #include "nfs_core.h"
 #include <misc/rbtree_x.h>
+#include "gsh_intrinsic.h"
 #include <misc/queue.h>
 
 enum drc_type {
@@ -47,6 +48,9 @@ enum drc_type {
 	DRC_UDP_V234 /*< UDP is strongly discouraged in RFC 3530bis */
 };
 
+#define DUPREQ_BAD_ADDR1 0x01	/* safe for marked pointers, etc */
+#define DUPREQ_NOCACHE   0x02
+
 #define DRC_FLAG_NONE 0x0000
 #define DRC_FLAG_HASH 0x0001
 #define DRC_FLAG_CKSUM 0x0002
@@ -56,15 +60,52 @@ enum drc_type {
 #define DRC_FLAG_RECYCLE 0x0020
 #define DRC_FLAG_RELEASE 0x0040
 
+struct dupreq_entry;
+
+/**
+ * @brief A slot of a DRC partition's open-addressing table
+ *
+ * key is 0 for a slot that ends a probe sequence and DRC_SLOT_TOMB for
+ * one whose entry was removed.  Lookups read slots without the
+ * partition lock, so a slot is only ever rewritten as a whole, dv
+ * before key.
+ */
+struct drc_slot {
+	uint64_t key;
+	struct dupreq_entry *dv;
+};
+
+#define DRC_SLOT_TOMB 1
+
+/**
+ * @brief One stripe of a duplicate request cache
+ *
+ * Inserts and removals take mtx; lookups do not, they only count
+ * themselves in readers.  Entries unlinked from the table wait on the
+ * limbo list until no lookup can still be looking at them.
+ */
+struct drc_part {
+	pthread_mutex_t mtx;
+	struct drc_slot *slot;
+	uint32_t mask;		/*< table slots - 1 */
+	uint32_t size;		/*< live entries */
+	uint32_t used;		/*< live entries plus tombstones */
+	uint32_t maxsize;	/*< hard bound on size */
+	uint32_t hiwat;		/*< size we try to retire down to */
+	uint32_t epoch;		/*< selects the readers counter */
+	uint32_t readers[2];	/*< lock-free lookups in progress */
+	uint32_t nlimbo;
+	/* completed and in-progress requests, oldest first */
+	TAILQ_HEAD(drc_part_lru, dupreq_entry) lru;
+	TAILQ_HEAD(drc_part_limbo, dupreq_entry) limbo;
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
+
 typedef struct drc {
 	enum drc_type type;
-	struct rbtree_x xt;
-	/* Define the tail queue */
-	TAILQ_HEAD(drc_tailq, dupreq_entry) dupreq_q;
+	struct drc_part *part;
 	pthread_mutex_t mtx;
 	uint32_t npart;
 	uint32_t cachesz;
-	uint32_t size;
 	uint32_t maxsize;
 	uint32_t hiwat;
 	uint32_t flags;
@@ -77,6 +118,7 @@ typedef struct drc {
 
 			TAILQ_ENTRY(drc) recycle_q; /* XXX drc */
 			time_t recycle_time;
+			time_t last_used; /* last request, for the idle trim */
 			uint64_t hk; /* hash key */
 		} tcp;
 	} d_u;
@@ -89,8 +131,7 @@ typedef enum dupreq_state {
 } dupreq_state_t;
 
 struct dupreq_entry {
-	struct opr_rbtree_node rbt_k;
-	/* Define the tail queue */
+	/* partition LRU, then limbo */
 	TAILQ_ENTRY(dupreq_entry) fifo_q;
 	pthread_mutex_t mtx;
 	struct {
@@ -105,6 +146,7 @@ struct dupreq_entry {
 		uint32_t rq_proc;
 	} hin;
 	uint64_t hk;		/* hash key */
+	uint64_t key;		/* slot key, from hk, xid and addr */
 	dupreq_state_t state;
 	uint32_t refcnt;
 	nfs_res_t *res;
@@ -133,6 +175,53 @@ typedef enum dupreq_status {
 	DUPREQ_ERROR,
 } dupreq_status_t;
 
+/**
+ * @brief Duplicate request cache counters
+ */
+struct drc_stats {
+	uint64_t hits;		/*< retransmits answered from the cache */
+	uint64_t lockfree_hits;	/*< of those, found without a lock */
+	uint64_t in_progress;	/*< retransmits of requests still running */
+	uint64_t misses;	/*< new requests entered in the cache */
+	uint64_t retired;	/*< entries retired or deleted */
+	uint64_t retire_ns;	/*< time spent retiring entries */
+};
+
+/**
+ * @brief Check whether a request never goes through the DRC
+ *
+ * NFSv4.1+ COMPOUNDs get exactly-once semantics from the session slot
+ * table, so they skip nfs_dupreq_start and nfs_dupreq_finish entirely.
+ *
+ * @param[in] reqnfs  The NFS request data, arguments decoded
+ *
+ * @return true if the request bypasses the DRC.
+ */
+static inline bool nfs_dupreq_bypass(nfs_request_t *reqnfs)
+{
+	struct svc_req *req = &reqnfs->svc;
+
+	return req->rq_msg.cb_prog == nfs_param.core_param.program[P_NFS]
+		&& req->rq_msg.cb_vers == NFS_V4
+		&& req->rq_msg.cb_proc == NFSPROC4_COMPOUND
+		&& reqnfs->arg_nfs.arg_compound4.minorversion > 0;
+}
+
+/**
+ * @brief Thread a request past the DRC
+ *
+ * Only allocates the result; nfs_dupreq_rele still frees it.
+ *
+ * @param[in] reqnfs  The NFS request data
+ * @param[in] req     The request
+ */
+static inline void nfs_dupreq_nocache(nfs_request_t *reqnfs,
+				      struct svc_req *req)
+{
+	req->rq_u1 = (void *)DUPREQ_NOCACHE;
+	reqnfs->res_nfs = req->rq_u2 = alloc_nfs_res();
+}
+
 void dupreq2_pkginit(void);
 void dupreq2_pkgshutdown(void);
 
@@ -145,5 +234,8 @@ dupreq_status_t nfs_dupreq_start(nfs_request_t *,
 dupreq_status_t nfs_dupreq_finish(struct svc_req *, nfs_res_t *);
 dupreq_status_t nfs_dupreq_delete(struct svc_req *);
 void nfs_dupreq_rele(struct svc_req *, const nfs_function_desc_t *);
+void nfs_dupreq_stats(struct drc_stats *);
+uint32_t nfs_dupreq_trim_idle(drc_t *drc, time_t idle);
+size_t nfs_dupreq_drc_mem(drc_t *drc, uint32_t *entries);
 
 #endif /* NFS_DUPREQ_H */
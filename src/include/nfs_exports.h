@@ -121,6 +121,10 @@ typedef struct exportlist_client_entry__ {
 						 specified */
 #define EXPORT_OPTION_PREFWRITE_SET 0x00000080 /* Set if PrefWrite was
 						  specified */
+#define EXPORT_OPTION_LATENCY_HIST 0x00000100 /* Keep latency histograms
+						 of every op */
+#define EXPORT_OPTION_IMMUTABLE 0x00000200 /* Nothing on the export
+					      ever changes */
 
 /* Constants for export permissions masks */
 #define EXPORT_OPTION_ROOT 0	/*< Allow root access as root uid */
@@ -216,10 +220,40 @@ typedef struct exportlist_client_entry__ {
 						    altgrp in AUTH_SYS creds */
 #define EXPORT_OPTION_NO_READDIR_PLUS 0x80000000 /*< Disallow readdir plus */
 
+/** Exports a connection keeps its access decision for */
+#define EXPORT_PERMS_CACHE_SIZE 4
+
+/**
+ * @brief Access decisions of a client connection
+ *
+ * export_check_access() keeps what it resolved for an export here,
+ * until the export configuration changes or the decision expires.
+ * The export the connection last used is kept too, with a reference,
+ * until it uses another or the export is removed.
+ */
+struct export_perms_cache {
+	pthread_mutex_t mtx;
+	uint32_t next;		/*< Entry to replace */
+	struct gsh_export *export;
+	struct export_perms_entry {
+		uint32_t gen;	/*< export_perms_gen then, 0 if unused */
+		uint16_t export_id;
+		time_t expire;
+		struct export_perms perms;
+	} entries[EXPORT_PERMS_CACHE_SIZE];
+};
+
 /* Export list related functions */
 uid_t get_anonymous_uid(void);
 gid_t get_anonymous_gid(void);
 void export_check_access(void);
+struct export_perms_cache *export_perms_cache_alloc(void);
+void export_perms_cache_free(struct export_perms_cache *cache);
+struct gsh_export *export_perms_cache_export(struct export_perms_cache *cache,
+					     uint16_t export_id);
+void export_perms_cache_drop(struct export_perms_cache *cache,
+			     struct gsh_export *export);
+void export_perms_changed(void);
 
 bool export_check_security(struct svc_req *req);
 
@@ -228,6 +262,7 @@ int init_export_root(struct gsh_export *exp);
 fsal_status_t nfs_export_get_root_entry(struct gsh_export *exp,
 					struct fsal_obj_handle **obj);
 void unexport(struct gsh_export *exp);
+void unexport_async(struct gsh_export *exp);
 /* XXX */
 /*void kill_export_root_entry(cache_entry_t *entry);*/
 /*void kill_export_junction_entry(cache_entry_t *entry);*/
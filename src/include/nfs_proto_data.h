@@ -100,9 +100,23 @@ typedef union nfs_arg__ {
 	ext_setquota_args arg_ext_rquota_setactivequota;
 } nfs_arg_t;
 
+/**
+ * @brief An NFSv4.1 reply kept in XDR form by a slot for replay
+ */
+struct nfs41_cached_reply {
+	char *buf;		/*< Encoded COMPOUND4res, NULL if none */
+	u_int len;		/*< Length of buf */
+	nfsstat4 status;	/*< Status of the cached COMPOUND */
+};
+
 struct COMPOUND4res_extended {
 	COMPOUND4res res_compound4;
-	bool res_cached;
+	/* On a slot replay, a copy of the cached reply that is sent
+	 * in place of res_compound4.  A streamed reply is sent from
+	 * here too, followed by the results res_streamed onwards of
+	 * resarray. */
+	struct nfs41_cached_reply res_replay;
+	uint32_t res_streamed;	/*< Results of resarray in res_replay */
 };
 
 typedef union nfs_res__ {
@@ -283,6 +297,25 @@ typedef struct nfs_client_cred__ {
  * of a V4 compound request.
  */
 
+/** Most operations of a COMPOUND that may wait on I/O at once */
+#define NFS4_ASYNC_OPS_MAX 16
+
+struct compound_data;
+
+/**
+ * @brief An operation of a COMPOUND waiting on asynchronous I/O
+ */
+struct nfs4_async_op {
+	int (*resume)(struct nfs_argop4 *, struct compound_data *,
+		      struct nfs_resop4 *);	/*< Called to finish it */
+	void *op_data;		/*< Private data of the operation */
+	struct gsh_export *export;	/*< Export it was issued in,
+					    referenced */
+	uint32_t pos;		/*< Position within the COMPOUND */
+	nfs_opnum4 opcode;	/*< Opcode of the operation */
+	nsecs_elapsed_t start_time;	/*< Start time of the operation */
+};
+
 /**
  * @brief Compound data
  *
@@ -311,9 +344,9 @@ typedef struct compound_data {
 	nfs_client_cred_t credential;	/*< Raw RPC credentials */
 	nfs_client_id_t *preserved_clientid;	/*< clientid that has lease
 						   reserved, if any */
-	struct COMPOUND4res_extended *cached_res;	/*< NFv41: pointer to
-							   cached RPC result in
-							   a session's slot */
+	struct nfs41_cached_reply *cached_res;	/*< NFv41: pointer to
+						   cached RPC reply in
+						   a session's slot */
 	bool use_drc;		/*< Set to true if session DRC is to be used */
 	uint32_t oppos;		/*< Position of the operation within the
 				    request processed  */
@@ -323,6 +356,31 @@ typedef struct compound_data {
 				   (if applicable) */
 	slotid4 slot;		/*< Slot ID of the current compound
 				   (if applicable) */
+	struct nfs_argop4 *argarray;	/*< Operations of the compound */
+	uint32_t argarray_len;	/*< Number of operations */
+	nfs_res_t *res;		/*< Result of the compound */
+	nfs_opnum4 opcode;	/*< Opcode of the operation in progress */
+	nsecs_elapsed_t op_start_time;	/*< Start time of the operation
+					    in progress */
+	int (*op_resume)(struct nfs_argop4 *, struct compound_data *,
+			 struct nfs_resop4 *);	/*< Set by an operation
+						    waiting on asynchronous
+						    I/O, called to finish
+						    it */
+	void *op_data;		/*< Private data of a suspended operation */
+	struct nfs4_async_op async_ops[NFS4_ASYNC_OPS_MAX];
+				/*< Operations waiting on I/O, in order */
+	uint32_t async_count;	/*< Number of async_ops in use */
+	uint32_t async_io;	/*< I/O in flight, plus one while the
+				    COMPOUND is still issuing operations */
+	int async_status;	/*< Status to complete the COMPOUND with
+				    once async_ops are finished */
+	XDR reply_xdrs;		/*< Stream the results are encoded into */
+	char *reply_buf;	/*< Its buffer, NULL if not streaming */
+	u_int reply_size;	/*< Size of reply_buf */
+	uint32_t streamed;	/*< Results encoded and released */
+	bool stream_stop;	/*< A result did not fit, the rest are sent
+				    from resarray */
 } compound_data_t;
 
 typedef int (*nfs4_op_function_t) (struct nfs_argop4 *, compound_data_t *,
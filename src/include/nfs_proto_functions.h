@@ -338,6 +338,29 @@ int nfs4_op_io_advise(struct nfs_argop4 *, compound_data_t *,
 
 void nfs4_op_io_advise_Free(nfs_resop4 *resp);
 
+int nfs4_op_copy(struct nfs_argop4 *, compound_data_t *,
+		 struct nfs_resop4 *);
+
+void nfs4_op_copy_Free(nfs_resop4 *resp);
+
+int nfs4_op_clone(struct nfs_argop4 *, compound_data_t *,
+		  struct nfs_resop4 *);
+
+void nfs4_op_clone_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_status(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_status_Free(nfs_resop4 *resp);
+
+int nfs4_op_offload_cancel(struct nfs_argop4 *, compound_data_t *,
+			   struct nfs_resop4 *);
+
+void nfs4_op_offload_cancel_Free(nfs_resop4 *resp);
+
+int nfs4_copy_pkginit(void);
+int nfs4_copy_pkgshutdown(void);
+
 int nfs4_op_layouterror(struct nfs_argop4 *, compound_data_t *,
 		      struct nfs_resop4 *);
 
@@ -375,6 +398,9 @@ void nfs4_op_removexattr_Free(nfs_resop4 *resp);
 
 #define NFS_REQ_OK   0
 #define NFS_REQ_DROP 1
+#define NFS_REQ_ASYNC_WAIT 2	/*< Suspended on asynchronous I/O, see
+				 *  nfs_rpc_async_complete()
+				 */
 
 /* Free functions */
 void mnt1_Mnt_Free(nfs_res_t *);
@@ -430,8 +456,11 @@ void nfs3_read_free(nfs_res_t *);
 
 void nfs4_Compound_FreeOne(nfs_resop4 *);
 void nfs4_Compound_Free(nfs_res_t *);
+bool xdr_COMPOUND4res_extended(XDR *, struct COMPOUND4res_extended *);
 void nfs4_Compound_CopyResOne(nfs_resop4 *, nfs_resop4 *);
 void nfs4_Compound_CopyRes(nfs_res_t *, nfs_res_t *);
+void nfs4_op_async_start(compound_data_t *, nfs4_op_function_t, void *);
+void nfs4_op_async_done(compound_data_t *);
 
 void nfs4_op_access_Free(nfs_resop4 *);
 void nfs4_op_close_Free(nfs_resop4 *);
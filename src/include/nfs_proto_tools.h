@@ -43,6 +43,7 @@
 #include "nfs_file_handle.h"
 #include "sal_data.h"
 #include "fsal.h"
+#include "gsh_arena.h"
 
 /* Hard and soft limit for nfsv4 quotas */
 #define NFS_V4_MAX_QUOTA_SOFT 4294967296LL	/*  4 GB */
@@ -122,6 +123,29 @@ static inline int check_for_wrongsec_ok_attr(struct bitmap4 *attr_request)
 	return true;
 }
 
+#define WORD0_FATTR4_IMMUTABLE ((1 << FATTR4_TYPE) | (1 << FATTR4_FSID) | \
+				(1 << FATTR4_RDATTR_ERROR) | \
+				(1 << FATTR4_FILEHANDLE) | \
+				(1 << FATTR4_FILEID))
+
+/* Only attributes an object never changes: type, fileid, ... */
+static inline int check_for_immutable_attr(struct bitmap4 *attr_request)
+{
+	if (attr_request->bitmap4_len < 1)
+		return true;
+	if ((attr_request->map[0] & ~WORD0_FATTR4_IMMUTABLE) != 0)
+		return false;
+	if (attr_request->bitmap4_len < 2)
+		return true;
+	if ((attr_request->map[1] & ~WORD1_FATTR4_MOUNTED_ON_FILEID) != 0)
+		return false;
+	if (attr_request->bitmap4_len < 3)
+		return true;
+	if (attr_request->map[2] != 0)
+		return false;
+	return true;
+}
+
 static inline int check_for_rdattr_error(struct bitmap4 *attr_request)
 {
 	if (attr_request->bitmap4_len < 1)
@@ -263,6 +287,9 @@ typedef enum {
 
 nfsstat4 nfs4_utf8string2dynamic(const utf8string *input, utf8_scantype_t scan,
 				 char **obj_name);
+nfsstat4 nfs4_utf8string2arena(struct gsh_arena *arena,
+			       const utf8string *input, utf8_scantype_t scan,
+			       char **obj_name);
 
 int bitmap4_to_attrmask_t(bitmap4 *bitmap4, attrmask_t *mask);
 
@@ -289,15 +316,47 @@ bool nfs3_Sattr_To_FSALattr(struct attrlist *, sattr3 *);
 
 int nfs4_Fattr_To_FSAL_attr(struct attrlist *, fattr4 *, compound_data_t *);
 
+int nfs4_Fattr_To_FSAL_attr_fh(struct attrlist *, fattr4 *, nfs_fh4 *);
+
 int nfs4_Fattr_To_fsinfo(fsal_dynamicfsinfo_t *, fattr4 *);
 
 int nfs4_Fattr_Fill_Error(fattr4 *, nfsstat4);
 
 int nfs4_FSALattr_To_Fattr(struct xdr_attrs_args *, struct bitmap4 *,
 			   fattr4 *);
+int nfs4_FSALattr_To_Fattr_buf(struct xdr_attrs_args *, struct bitmap4 *,
+			       fattr4 *, char *);
 
 void nfs4_bitmap4_Remove_Unsupported(struct bitmap4 *);
 
+/**
+ * @brief Directory entries encoded as READDIR finds them
+ *
+ * The entries go in XDR form straight into one buffer the size of the
+ * client's limit, which the reply then sends as they are: no list of
+ * entries is built, and the room left is known exactly.
+ */
+struct nfs_dirent_stream {
+	XDR xdrs;
+	char *buf;
+	u_int mark;		/*< End of the last whole entry */
+	u_int count;		/*< Whole entries */
+};
+
+/** XDR size of a READDIR3resok or READDIRPLUS3resok without entries:
+    the directory's post_op_attr, the verifier, the list end and eof */
+#define NFS3_READDIR_RESOK_SIZE (BYTES_PER_XDR_UNIT + 84 + \
+				 NFS3_COOKIEVERFSIZE + 2 * BYTES_PER_XDR_UNIT)
+/** Same for READDIR4resok */
+#define NFS4_READDIR_RESOK_SIZE (NFS4_VERIFIER_SIZE + 2 * BYTES_PER_XDR_UNIT)
+
+void nfs_dirent_stream_init(struct nfs_dirent_stream *ds, u_int room);
+bool nfs_dirent_stream_start(struct nfs_dirent_stream *ds);
+void nfs_dirent_stream_end(struct nfs_dirent_stream *ds, bool whole);
+void nfs_dirent_stream_take(struct nfs_dirent_stream *ds, char **encoded,
+			    u_int *encoded_len);
+void nfs_dirent_stream_release(struct nfs_dirent_stream *ds);
+
 enum nfs4_minor_vers {
 	NFS4_MINOR_VERS_0,
 	NFS4_MINOR_VERS_1,
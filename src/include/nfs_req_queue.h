@@ -36,7 +36,10 @@
 #define NFS_REQ_QUEUE_H
 
 #include "gsh_list.h"
+#include "gsh_intrinsic.h"
+#include "abstract_atomic.h"
 #include "wait_queue.h"
+#include "fridgethr.h"
 
 struct req_q {
 	pthread_spinlock_t sp;
@@ -46,15 +49,37 @@ struct req_q {
 	uint32_t waiters;
 };
 
-struct req_q_pair {
-	const char *s;
+/**
+ * @brief Bounded lock-free multi-producer/multi-consumer ring
+ *
+ * Each slot carries a sequence number telling producers and consumers
+ * whose turn it is, so a push or pop costs one compare-and-swap on
+ * head or tail and never blocks.  The slot count must be a power of
+ * two.
+ */
+
+struct req_q_slot {
+	uint64_t seq;
+	void *ptr;
+};
+
+struct req_q_ring {
+	struct req_q_slot *slot;
+	uint64_t mask;
 	GSH_CACHE_PAD(0);
-	struct req_q producer;	/* from decoder */
+	uint64_t head;		/* next slot to fill */
 	GSH_CACHE_PAD(1);
-	struct req_q consumer;	/* to executor */
+	uint64_t tail;		/* next slot to drain */
 	GSH_CACHE_PAD(2);
 };
 
+struct req_q_pair {
+	const char *s;
+	struct req_q_ring ring;	/* decoder to executor, lock-free */
+	struct req_q overflow;	/* spill when the ring is full */
+	GSH_CACHE_PAD(0);
+};
+
 #define REQ_Q_MOUNT 0
 #define REQ_Q_CALL 1
 #define REQ_Q_LOW_LATENCY 2	/*< GETATTR, RENEW, etc */
@@ -67,21 +92,60 @@ struct req_q_set {
 	struct req_q_pair qset[N_REQ_QUEUES];
 };
 
+/**
+ * @brief Run queue of one affinity domain
+ *
+ * Workers pinned to the domain wait on its wait_list; requests decoded
+ * on its CPUs are queued here first.
+ */
+
+struct req_runq {
+	struct req_q_set nfs_request_q;
+	pthread_spinlock_t sp;
+	struct glist_head wait_list;
+	uint32_t waiters;
+	GSH_CACHE_PAD(0);
+};
+
+/** Buckets of the time-in-queue histogram, by powers of two of us */
+#define REQ_Q_WAIT_BUCKETS 24
+
+/**
+ * @brief Traffic of one request class, over all the run queues
+ *
+ * Bucket 0 of wait_hist counts requests dequeued within 1us, bucket i
+ * those that waited from 2^(i-1) to 2^i us, the last one all longer.
+ */
+
+struct req_q_stats {
+	uint64_t enqueued;
+	uint64_t dequeued;
+	uint64_t wait;		/* ns, summed */
+	uint64_t wait_max;	/* ns */
+	uint64_t wait_hist[REQ_Q_WAIT_BUCKETS];
+	GSH_CACHE_PAD(0);
+};
+
 struct nfs_req_st {
 	struct {
 		uint32_t ctr;
-		struct req_q_set nfs_request_q;
+		fridgethr_affinity_t affinity;
+		uint32_t n_runq;	/* one per affinity domain */
+		struct req_runq *runq;
 		uint64_t size;
-		pthread_spinlock_t sp;
-		struct glist_head wait_list;
-		uint32_t waiters;
 	} reqs;
 	GSH_CACHE_PAD(1);
+	struct req_q_stats stats[N_REQ_QUEUES];
+	struct {
+		uint32_t active;	/* executing a request now */
+		uint64_t busy;		/* ns spent executing, summed */
+		uint64_t idle;		/* ns spent waiting for work */
+	} workers;
+	GSH_CACHE_PAD(2);
 	struct {
 		pthread_mutex_t mtx;
 		struct glist_head q;
 		uint32_t stalled;
-		bool active;
 	} stallq;
 };
 
@@ -97,6 +161,101 @@ static inline void nfs_rpc_q_init(struct req_q *q)
 	q->waiters = 0;
 }
 
+static inline void req_q_ring_init(struct req_q_ring *r,
+				   struct req_q_slot *slot,
+				   uint32_t nslots)
+{
+	uint32_t ix;
+
+	for (ix = 0; ix < nslots; ++ix) {
+		slot[ix].seq = ix;
+		slot[ix].ptr = NULL;
+	}
+	r->slot = slot;
+	r->mask = nslots - 1;
+	r->head = 0;
+	r->tail = 0;
+}
+
+/**
+ * @brief Append to a ring
+ *
+ * @param[in] r   The ring
+ * @param[in] ptr Entry to append
+ *
+ * @return false if the ring is full.
+ */
+
+static inline bool req_q_ring_push(struct req_q_ring *r, void *ptr)
+{
+	struct req_q_slot *slot;
+	uint64_t pos = atomic_fetch_uint64_t(&r->head);
+	int64_t diff;
+
+	for (;;) {
+		slot = &r->slot[pos & r->mask];
+		diff = (int64_t) (atomic_fetch_uint64_t(&slot->seq) - pos);
+		if (diff == 0) {
+			if (atomic_cmpxchg_uint64_t(&r->head, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			/* the consumer has not drained this lap yet */
+			return false;
+		}
+		pos = atomic_fetch_uint64_t(&r->head);
+	}
+
+	slot->ptr = ptr;
+	atomic_store_uint64_t(&slot->seq, pos + 1);
+	return true;
+}
+
+/**
+ * @brief Remove the oldest entry of a ring
+ *
+ * @param[in] r The ring
+ *
+ * @return The entry, or NULL if the ring is empty.
+ */
+
+static inline void *req_q_ring_pop(struct req_q_ring *r)
+{
+	struct req_q_slot *slot;
+	uint64_t pos = atomic_fetch_uint64_t(&r->tail);
+	int64_t diff;
+	void *ptr;
+
+	for (;;) {
+		slot = &r->slot[pos & r->mask];
+		diff = (int64_t) (atomic_fetch_uint64_t(&slot->seq) -
+				  (pos + 1));
+		if (diff == 0) {
+			if (atomic_cmpxchg_uint64_t(&r->tail, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			/* the producer has not filled this slot yet */
+			return NULL;
+		}
+		pos = atomic_fetch_uint64_t(&r->tail);
+	}
+
+	ptr = slot->ptr;
+	atomic_store_uint64_t(&slot->seq, pos + r->mask + 1);
+	return ptr;
+}
+
+/**
+ * @brief Approximate number of entries in a ring
+ */
+
+static inline uint32_t req_q_ring_size(struct req_q_ring *r)
+{
+	uint64_t tail = atomic_fetch_uint64_t(&r->tail);
+	uint64_t head = atomic_fetch_uint64_t(&r->head);
+
+	return (head > tail) ? (uint32_t) (head - tail) : 0;
+}
+
 static inline uint32_t nfs_rpc_q_next_slot(void)
 {
 	uint32_t ix = atomic_inc_uint32_t(&nfs_req_st.reqs.ctr);
@@ -109,17 +268,23 @@ static inline uint32_t nfs_rpc_q_next_slot(void)
 static inline void nfs_rpc_queue_awaken(void *arg)
 {
 	struct nfs_req_st *st = arg;
+	struct req_runq *runq;
 	struct glist_head *g = NULL;
 	struct glist_head *n = NULL;
+	uint32_t ix;
 
-	pthread_spin_lock(&st->reqs.sp);
-	glist_for_each_safe(g, n, &st->reqs.wait_list) {
-		wait_q_entry_t *wqe = glist_entry(g, wait_q_entry_t, waitq);
+	for (ix = 0; ix < st->reqs.n_runq; ++ix) {
+		runq = &st->reqs.runq[ix];
+		pthread_spin_lock(&runq->sp);
+		glist_for_each_safe(g, n, &runq->wait_list) {
+			wait_q_entry_t *wqe =
+				glist_entry(g, wait_q_entry_t, waitq);
 
-		pthread_cond_signal(&wqe->lwe.cv);
-		pthread_cond_signal(&wqe->rwe.cv);
+			pthread_cond_signal(&wqe->lwe.cv);
+			pthread_cond_signal(&wqe->rwe.cv);
+		}
+		pthread_spin_unlock(&runq->sp);
 	}
-	pthread_spin_unlock(&st->reqs.sp);
 }
 
 #endif				/* NFS_REQ_QUEUE_H */
@@ -148,14 +148,20 @@ int32_t nfs_rpc_submit_call(rpc_call_t *call, void *completion_arg,
 /* Dispatch method to process a (queued) call */
 int32_t nfs_rpc_dispatch_call(rpc_call_t *call, uint32_t flags);
 
-int nfs_rpc_v41_single(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
-		       struct state_refer *refer,
-		       int32_t (*completion)(rpc_call_t *, rpc_call_hook,
-					     void *arg, uint32_t flags),
-		       void *completion_arg,
-		       void (*free_op)(nfs_cb_argop4 *op));
-void nfs41_complete_single(rpc_call_t *call, rpc_call_hook hook, void *arg,
-			   uint32_t flags);
+/**
+ * @brief Completion of an operation queued with nfs_rpc_cb_queue
+ *
+ * @param[in] op     The operation, as queued
+ * @param[in] status Result of the operation
+ * @param[in] hook   RPC_CALL_COMPLETE if the client answered
+ * @param[in] arg    Argument given to nfs_rpc_cb_queue
+ */
+typedef void (*nfs_cb_op_done)(nfs_cb_argop4 *op, nfsstat4 status,
+			       rpc_call_hook hook, void *arg);
+
+int nfs_rpc_cb_queue(nfs_client_id_t *clientid, nfs_cb_argop4 *op,
+		     struct state_refer *refer, nfs_cb_op_done done,
+		     void *arg);
 enum clnt_stat nfs_test_cb_chan(nfs_client_id_t *);
 
 #endif /* !NFS_RPC_CALLBACK_H */
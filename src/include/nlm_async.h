@@ -28,9 +28,6 @@
 
 #include "sal_data.h"
 
-extern pthread_mutex_t nlm_async_resp_mutex;
-extern pthread_cond_t nlm_async_resp_cond;
-
 int nlm_async_callback_init(void);
 
 int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
@@ -39,11 +36,7 @@ int nlm_send_async_res_nlm4(state_nlm_client_t *host, state_async_func_t func,
 int nlm_send_async_res_nlm4test(state_nlm_client_t *host,
 				state_async_func_t func, nfs_res_t *pres);
 
-/* Client routine  to send the asynchrnous response, key is used to wait for
- * a response
- */
-int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg, void *key);
-
-void nlm_signal_async_resp(void *key);
+/* Client routine to send the asynchronous response */
+int nlm_send_async(int proc, state_nlm_client_t *host, void *inarg);
 
 #endif				/* NLM_ASYNC_H */
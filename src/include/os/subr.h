@@ -54,5 +54,20 @@ bool to_vfs_dirent(char *buf, int bpos, struct vfs_dirent *vd, off_t base);
 uid_t setuser(uid_t uid);
 gid_t setgroup(gid_t gid);
 int set_threadgroups(size_t size, const gid_t *list);
+ssize_t vfs_copy_range(int src_fd, off_t *src_off, int dst_fd,
+		       off_t *dst_off, size_t len);
+int vfs_clone_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+		    uint64_t len);
+int vfs_alloc_range(int fd, off_t off, off_t len, bool punch);
+
+/** What the kernel knows of a connected socket */
+struct sock_stats {
+	uint64_t bytes_in;	/*< Received, 0 if unknown */
+	uint64_t bytes_out;	/*< Sent and acknowledged, 0 if unknown */
+	uint32_t recv_q;	/*< Bytes received not yet read */
+	uint32_t send_q;	/*< Bytes written not yet acknowledged */
+};
+
+int sock_stats(int fd, struct sock_stats *st);
 
 #endif/* SUBR_OS_H */
@@ -225,6 +225,64 @@ nfsstat4 FSAL_encode_file_layout(XDR *xdrs,
 nfsstat4 FSAL_encode_v4_multipath(XDR *xdrs, const uint32_t num_hosts,
 				  const fsal_multipath_member_t *hosts);
 
+/**
+ * A data server of a flexfiles mirror.  The handle is the FSAL's DS
+ * handle for a Ganesha DS (ganesha_ds set, with its ds_id), and the
+ * handle of the file on the server itself otherwise.
+ */
+
+struct fsal_ff_data_server {
+	struct pnfs_deviceid deviceid;	/*< Device of the server */
+	uint32_t efficiency;		/*< Preference, higher is better */
+	struct gsh_buffdesc fh;		/*< Handle of the file */
+	bool ganesha_ds;		/*< Wrap fh as a Ganesha DS handle */
+	uint16_t ds_id;			/*< Server ID, for ganesha_ds */
+	uint32_t uid;			/*< Credentials on the server */
+	uint32_t gid;
+};
+
+/** A copy of the file, striped over its servers */
+
+struct fsal_ff_mirror {
+	uint32_t num_servers;
+	const struct fsal_ff_data_server *servers;
+};
+
+nfsstat4 FSAL_encode_flex_file_layout(XDR *xdrs, length4 stripe_unit,
+				      const uint32_t num_mirrors,
+				      const struct fsal_ff_mirror *mirrors);
+
+nfsstat4 FSAL_encode_flex_file_device(XDR *xdrs, const uint32_t num_hosts,
+				      const fsal_multipath_member_t *hosts,
+				      const uint32_t num_versions,
+				      const ff_device_versions4 *versions);
+
+#define PNFS_FF_DS_STATS_MAX 256
+#define PNFS_FF_NETID_LEN 8
+#define PNFS_FF_ADDR_LEN 64
+
+/** I/O to a flexfiles data server, as reported in LAYOUTSTATS */
+
+struct pnfs_ff_ds_stats {
+	char netid[PNFS_FF_NETID_LEN];	/*< r_netid of the server */
+	char addr[PNFS_FF_ADDR_LEN];	/*< r_addr of the server */
+	uint64_t reports;		/*< LAYOUTSTATS received */
+	uint64_t read_ops;
+	uint64_t read_bytes;
+	uint64_t write_ops;
+	uint64_t write_bytes;
+	uint64_t read_timed;		/*< READs in read_ns */
+	uint64_t read_ns;		/*< Sum of their latencies */
+	uint64_t read_max_ns;
+	uint64_t write_timed;		/*< WRITEs in write_ns */
+	uint64_t write_ns;
+	uint64_t write_max_ns;
+};
+
+nfsstat4 pnfs_ff_layoutstats(const LAYOUTSTATS4args *args);
+uint32_t pnfs_ff_ds_stats(struct pnfs_ff_ds_stats *stats, uint32_t max,
+			  uint64_t *dropped);
+
 nfsstat4 posix2nfs4_error(int posix_errorcode);
 
 /*
@@ -243,6 +301,9 @@ static inline void pnfs_ds_get_ref(struct fsal_pnfs_ds *pds)
 }
 
 void pnfs_ds_put(struct fsal_pnfs_ds *pds);
+nfsstat4 pnfs_ds_handle(struct fsal_pnfs_ds *pds,
+			const struct gsh_buffdesc *desc, int flags,
+			struct fsal_ds_handle **handle);
 void pnfs_ds_remove(uint16_t id_servers, bool final);
 
 int ReadDataServers(config_file_t in_config,
@@ -49,6 +49,7 @@
 #include "hashtable.h"
 #include "fsal_pnfs.h"
 #include "config_parsing.h"
+#include "delayed_exec.h"
 
 #ifdef _USE_9P
 /* define u32 and related types independent of SAL and 9P */
@@ -116,12 +117,13 @@ extern pool_t *nfs41_session_pool;
 extern hash_table_t *ht_session_id;
 
 /**
- * @brief Number of forechannel slots in a session
+ * @brief Most backchannel slots we'll use, even if the client offers
+ *        more
  *
- * This is also the maximum number of backchannel slots we'll use,
- * even if the client offers more.
+ * The forechannel slot table is sized at CREATE_SESSION, up to
+ * Max_Session_Slots.
  */
-#define NFS41_NB_SLOTS 3
+#define NFS41_MAX_CB_SLOTS 16
 
 /**
  * @brief Members in the slot table
@@ -130,9 +132,9 @@ extern hash_table_t *ht_session_id;
 typedef struct nfs41_session_slot__ {
 	sequenceid4 sequence;	/*< Sequence number of this operation */
 	pthread_mutex_t lock;	/*< Lock on the slot */
-	struct COMPOUND4res_extended cached_result;	/*< NFv41: pointer to
-							   cached RPC result in
-							   a session's slot */
+	struct nfs41_cached_reply cached_result;	/*< NFv41: cached
+							   RPC reply of
+							   this slot */
 	unsigned int cache_used;	/*< If we cached the result */
 } nfs41_session_slot_t;
 
@@ -170,10 +172,12 @@ struct nfs41_session {
 	SVCXPRT *xprt;		/*< Referenced pointer to transport */
 
 	channel_attrs4 fore_channel_attrs;	/*< Fore-channel attributes */
-	nfs41_session_slot_t slots[NFS41_NB_SLOTS];	/*< Slot table */
+	nfs41_session_slot_t **slots;	/*< Slot table, ca_maxrequests
+					   entries, each allocated on its
+					   first use */
 
 	channel_attrs4 back_channel_attrs;	/*< Back-channel attributes */
-	nfs41_cb_session_slot_t cb_slots[NFS41_NB_SLOTS];	/*< Callback
+	nfs41_cb_session_slot_t cb_slots[NFS41_MAX_CB_SLOTS];	/*< Callback
 								   Slot table */
 	uint32_t cb_program;	/*< Callback program ID */
 	struct rpc_call_channel cb_chan;	/*< Back channel */
@@ -215,13 +219,12 @@ typedef struct rdel_fh {
  */
 typedef struct clid_entry {
 	struct glist_head cl_list;	/*< Link in the list */
+	struct glist_head cl_hash;	/*< Link in the clid_hash bucket */
 	struct glist_head cl_rfh_list;
+	bool cl_reclaim_complete;	/*< Client done reclaiming or dead */
 	char cl_name[PATH_MAX];	/*< Client name */
 } clid_entry_t;
 
-extern char v4_old_dir[PATH_MAX];
-extern char v4_recov_dir[PATH_MAX];
-
 /******************************************************************************
  *
  * NFSv4 State data
@@ -328,6 +331,9 @@ struct state_layout {
 	uint32_t granting;	/*< Number of LAYOUTGETs in progress */
 	bool state_return_on_close;	/*< Whether this layout should be
 					   returned on last close. */
+	uint64_t sequential_end;	/*< End of the last LAYOUTGET grant,
+					   a LAYOUTGET from there is
+					   sequential */
 };
 
 /**
@@ -500,6 +506,7 @@ struct state_nlm_client_t {
 						     made */
 	int32_t slc_nlm_caller_name_len;	/*< Length of client name */
 	char *slc_nlm_caller_name;	/*< Client name */
+	pthread_mutex_t slc_mutex;	/*< Protects the callback client */
 	CLIENT *slc_callback_clnt;	/*< Callback for blocking locks */
 	AUTH *slc_callback_auth;	/*< Authentication for callback */
 };
@@ -689,6 +696,14 @@ struct nfs_client_id_t {
 						       indication */
 			/** All sessions */
 			struct glist_head cb_session_list;
+			/** Callback operations waiting to be sent */
+			struct glist_head cb_queue;
+			/** Protects cb_queue, cb_inflight and cb_flushing */
+			pthread_mutex_t cb_queue_mutex;
+			/** Operations sent and not yet answered */
+			uint32_t cb_inflight;
+			/** Whether a flush of cb_queue is scheduled */
+			bool cb_flushing;
 		} v41;		/*< v4.1 callback information */
 	} cid_cb;		/*< Version specific callback information */
 	time_t first_path_down_resp_time;  /* Time when the server first sent
@@ -701,13 +716,19 @@ struct nfs_client_id_t {
 	state_owner_t cid_owner;	/*< Owner for per-client state */
 	int32_t cid_refcount;	/*< Reference count for lifecycle */
 	int cid_lease_reservations;	/*< Counted lease reservations, to spare
-					   this clientid from the reaper */
+					   this clientid from expiry */
+	struct delayed_timer cid_lease_timer;	/*< Expires the lease, holds
+						   a reference while armed */
 	uint32_t cid_minorversion;
 	uint32_t cid_stateid_counter;
 
 	uint32_t curr_deleg_grants; /* current num of delegations owned by
 				       this client */
 	uint32_t num_revokes;       /* Num revokes for the client */
+	uint32_t num_failed_recalls; /* Recalls failed since the last one
+					that succeeded */
+	time_t deleg_backoff;       /* No delegations under the aggressive
+				       policy before this time */
 	struct gsh_client *gsh_client; /* for client specific statistics. */
 };
 
@@ -730,6 +751,8 @@ struct nfs_client_record_t {
 						   one. */
 	uint32_t cr_server_addr; /*< Server IP address the client connected to
 				  */
+	int32_t cr_expiring;	/*< Clientids of this owner whose state is
+				    still being released */
 	uint32_t cr_pnfs_flags;  /*< pNFS flags.  RFC 5661 allows us
 				     to treat identical co_owners with
 				     different pNFS flags as
@@ -782,8 +805,6 @@ typedef struct state_nlm_block_data_t {
 						   FH buffer */
 } state_nlm_block_data_t;
 
-extern struct glist_head state_blocked_locks;
-
 /**
  * @brief Grant types
  */
@@ -806,6 +827,23 @@ typedef enum state_block_type_t {
 	STATE_BLOCK_POLL,
 } state_block_type_t;
 
+/**
+ * @brief Interval tree linkage of a lock entry
+ *
+ * The locks on a file are kept in an AVL tree ordered by lock start,
+ * each node also caching the largest last byte in its subtree, so the
+ * locks overlapping a range can be found without walking the whole
+ * lock list.
+ */
+struct state_lock_index {
+	state_lock_entry_t *sli_left;	/*< Locks starting before this one */
+	state_lock_entry_t *sli_right;	/*< Locks starting after this one */
+	uint64_t sli_end;	/*< Last byte of this lock */
+	uint64_t sli_max_end;	/*< Largest last byte in this subtree */
+	int32_t sli_height;	/*< Height of this subtree */
+	bool sli_indexed;	/*< Entry is in the tree */
+};
+
 /**
  * @brief Blocking lock data
  */
@@ -841,6 +879,8 @@ struct state_lock_entry_t {
 	int32_t sle_ref_count;	/*< Reference count */
 	fsal_lock_param_t sle_lock;	/*< Lock description */
 	pthread_mutex_t sle_mutex;	/*< Mutex to protect the structure */
+	struct state_lock_index sle_idx;	/*< Link in the file lock index */
+	uint64_t sle_seq;	/*< Order of insertion in the lock list */
 };
 
 /**
@@ -877,6 +917,9 @@ struct file_deleg_stats {
 	uint32_t fds_num_opens;         /* total num of opens so far. */
 	time_t fds_first_open;          /* time that we started recording
 					   num_opens */
+	uint32_t fds_write_opens;       /* opens asking for write access */
+	clientid4 fds_writer;           /* client of the write opens */
+	bool fds_multi_writer;          /* write opens from several clients */
 };
 
 /**
@@ -893,6 +936,15 @@ struct state_file {
 	struct glist_head layoutrecall_list;
 	/** Pointers for lock list. Protected by state_lock */
 	struct glist_head lock_list;
+	/** Interval tree over lock_list. Protected by state_lock */
+	state_lock_entry_t *lock_index;
+	/** Insertion counter for lock_list. Protected by state_lock */
+	uint64_t lock_seq;
+	/** Export of the locks in lock_list. Protected by state_lock */
+	struct gsh_export *lock_export;
+	/** Locks in lock_list came through several exports.
+	 *  Protected by state_lock */
+	bool lock_exports_mixed;
 	/** Pointers for NLM share list. Protected by state_lock */
 	struct glist_head nlm_share_list;
 	/** Share reservation state for this file. Protected by state_lock */
@@ -944,6 +996,9 @@ typedef struct state_layout_segment {
 	state_t *sls_state;	/*< Associated layout state */
 	struct pnfs_segment sls_segment;	/*< Segment descriptor */
 	void *sls_fsal_data;	/*< FSAL data */
+	void *sls_body;		/*< Copy of the encoded loc_body, to grant
+				   it again without the FSAL */
+	uint32_t sls_body_len;	/*< Its length */
 } state_layout_segment_t;
 
 /**
@@ -1031,7 +1086,6 @@ typedef void (state_async_func_t) (state_async_queue_t *arg);
  */
 typedef struct state_nlm_async_data_t {
 	state_nlm_client_t *nlm_async_host;	/*< The client */
-	void *nlm_async_key;	/*< Identifying key */
 	union {
 		nfs_res_t nlm_async_res;	/*< Asynchronous response */
 		nlm4_testargs nlm_async_grant;	/*< Arguments for grant */
@@ -47,6 +47,31 @@
  */
 #define PRIME_STATE 17
 
+/**
+ * @brief Divisions in the client id and client record tables.
+ *
+ * Every client reconnecting after a restart or failover goes through
+ * these tables at once, so they are split finer than the state tables.
+ */
+#define PRIME_CLIENT_ID 127
+
+/**
+ * @brief Cache slots per division of the client id tables.
+ */
+#define CLIENT_ID_CACHE_SIZE 2048
+
+/**
+ * @brief Divisions in the NFSv4 and NLM owner tables.
+ *
+ * An owner is looked up by every OPEN, CLOSE and LOCK.
+ */
+#define PRIME_OWNER 127
+
+/**
+ * @brief Freed owners kept per CPU for reuse.
+ */
+#define STATE_OWNER_POOL_CPU_MAX 128
+
 /*****************************************************************************
  *
  * Misc functions
@@ -282,6 +307,7 @@ clientid_status_t nfs_client_id_confirm(nfs_client_id_t *clientid,
 bool clientid_has_state(nfs_client_id_t *clientid);
 
 bool nfs_client_id_expire(nfs_client_id_t *clientid, bool make_stale);
+bool nfs_client_id_expire_async(nfs_client_id_t *clientid, bool make_stale);
 
 #define DISPLAY_CLIENTID_SIZE 36
 int display_clientid(struct display_buffer *dspbuf, clientid4 clientid);
@@ -311,6 +337,8 @@ void free_client_id(nfs_client_id_t *clientid);
 void
 nfs41_foreach_client_callback(bool(*cb) (nfs_client_id_t *cl, void *state),
 			      void *state);
+void nfs41_foreach_client(void (*cb)(nfs_client_id_t *cl, void *state),
+			  void *state);
 
 bool client_id_has_state(nfs_client_id_t *clientid);
 
@@ -353,6 +381,8 @@ int display_session(struct display_buffer *dspbuf, nfs41_session_t *session);
 
 int32_t inc_session_ref(nfs41_session_t *session);
 int32_t dec_session_ref(nfs41_session_t *session);
+nfs41_session_slot_t *nfs41_session_slot(nfs41_session_t *session,
+					 slotid4 slotid);
 
 int display_session_id_key(struct gsh_buffdesc *buff, char *str);
 int display_session_id_val(struct gsh_buffdesc *buff, char *str);
@@ -476,6 +506,8 @@ uint64_t state_id_rbt_hash_func(hash_parameter_t *hparam,
 int reserve_lease(nfs_client_id_t *clientid);
 void update_lease(nfs_client_id_t *clientid);
 bool valid_lease(nfs_client_id_t *clientid);
+void arm_lease_timer(nfs_client_id_t *clientid, unsigned int seconds);
+void lease_expired(void *arg);
 
 /******************************************************************************
  *
@@ -883,6 +915,10 @@ void init_new_deleg_state(union state_data *deleg_state,
 void deleg_heuristics_recall(struct fsal_obj_handle *obj,
 			     state_owner_t *owner,
 			     struct state_t *deleg);
+void deleg_heuristics_open(struct state_hdl *ostate, nfs_client_id_t *client,
+			   uint32_t share_access);
+void deleg_heuristics_recall_failed(nfs_client_id_t *client);
+void deleg_heuristics_recall_ok(nfs_client_id_t *client);
 void get_deleg_perm(nfsace4 *permissions, open_delegation_type4 type);
 void update_delegation_stats(struct state_hdl *ostate,
 			     state_owner_t *owner,
@@ -899,13 +935,19 @@ bool state_deleg_conflict(struct fsal_obj_handle *obj, bool write);
  ******************************************************************************/
 
 state_status_t state_add_segment(state_t *state, struct pnfs_segment *segment,
-				 void *fsal_data, bool return_on_close);
+				 void *fsal_data, bool return_on_close,
+				 const struct gsh_buffdesc *body);
 
 state_status_t state_delete_segment(state_layout_segment_t *segment);
 state_status_t state_lookup_layout_state(struct fsal_obj_handle *obj,
 					 state_owner_t *owner,
 					 layouttype4 type, state_t **state);
 void revoke_owner_layouts(state_owner_t *client_owner);
+nfsstat4 return_owner_layouts(state_owner_t *client_owner, layouttype4 type,
+			      const fsal_fsid_t *fsid,
+			      struct pnfs_segment spec,
+			      layoutreturn_type4 return_type,
+			      enum fsal_layoutreturn_circumstance circumstance);
 
 
 /******************************************************************************
@@ -1015,18 +1057,47 @@ void blocked_lock_polling(struct fridgethr_context *ctx);
  ******************************************************************************/
 
 void nfs4_start_grace(nfs_grace_start_t *gsp);
+void nfs4_start_export_grace(struct gsh_export *export, bool whole_fs,
+			     nfs_grace_start_t *gsp);
 int nfs_in_grace(void);
+bool nfs_export_in_grace(struct gsh_export *export);
 void nfs4_create_clid_name(nfs_client_record_t *, nfs_client_id_t *,
 			   struct svc_req *);
 void nfs4_add_clid(nfs_client_id_t *);
-void nfs4_rm_clid(const char *, char *, int);
+void nfs4_rm_clid(nfs_client_id_t *);
 void nfs4_chk_clid(nfs_client_id_t *);
+void nfs4_reclaim_complete(nfs_client_id_t *);
 void nfs4_load_recov_clids(nfs_grace_start_t *gsp);
-void nfs4_clean_old_recov_dir(char *);
-void nfs4_create_recov_dir(void);
+void nfs4_recovery_handoff(char **names, uint32_t count);
+char **nfs4_recovery_live_clids(uint32_t *count);
+void nfs4_end_grace(void);
+void nfs4_recovery_init(void);
 void nfs4_record_revoke(nfs_client_id_t *, nfs_fh4 *);
 bool nfs4_check_deleg_reclaim(nfs_client_id_t *, nfs_fh4 *);
 
+/**
+ * @brief Stable storage of the clients allowed to reclaim
+ *
+ * recovery_read_clids is called with grace_mutex held and fills the
+ * reclaim list with nfs4_add_clid_entry and nfs4_add_rfh_entry.  With
+ * a NULL grace start it loads this node's own records, the others are
+ * for the failover events.
+ */
+struct nfs4_recovery_backend {
+	void (*recovery_init)(void);
+	void (*recovery_read_clids)(nfs_grace_start_t *gsp);
+	void (*add_clid)(nfs_client_id_t *);
+	void (*rm_clid)(nfs_client_id_t *);
+	void (*add_revoke_fh)(nfs_client_id_t *, const char *);
+	void (*end_grace)(void);
+};
+
+extern const struct nfs4_recovery_backend fs_backend;
+extern const struct nfs4_recovery_backend log_backend;
+
+clid_entry_t *nfs4_add_clid_entry(char *);
+rdel_fh_t *nfs4_add_rfh_entry(clid_entry_t *, char *);
+
 
 #endif				/* SAL_FUNCTIONS_H */
 
@@ -41,17 +41,89 @@
 
 #include <sys/types.h>
 
+struct fsal_obj_handle;
+struct gsh_export;
+
+/* Sub-FSAL calls a stacked FSAL_NULL with Op_Stats times */
+enum fsal_stat_op {
+	FSAL_STAT_LOOKUP,
+	FSAL_STAT_READDIR,
+	FSAL_STAT_CREATE,
+	FSAL_STAT_MKDIR,
+	FSAL_STAT_MKNODE,
+	FSAL_STAT_SYMLINK,
+	FSAL_STAT_READLINK,
+	FSAL_STAT_LINK,
+	FSAL_STAT_RENAME,
+	FSAL_STAT_GETATTRS,
+	FSAL_STAT_GETATTRS_BULK,
+	FSAL_STAT_SETATTRS,
+	FSAL_STAT_SETATTR2,
+	FSAL_STAT_UNLINK,
+	FSAL_STAT_HANDLE_DIGEST,
+	FSAL_STAT_HANDLE_TO_KEY,
+	FSAL_STAT_RELEASE,
+	FSAL_STAT_OPEN,
+	FSAL_STAT_STATUS,
+	FSAL_STAT_READ,
+	FSAL_STAT_WRITE,
+	FSAL_STAT_COMMIT,
+	FSAL_STAT_LOCK_OP,
+	FSAL_STAT_CLOSE,
+	FSAL_STAT_OPEN2,
+	FSAL_STAT_CHECK_VERIFIER,
+	FSAL_STAT_STATUS2,
+	FSAL_STAT_REOPEN2,
+	FSAL_STAT_READ2,
+	FSAL_STAT_WRITE2,
+	FSAL_STAT_SEEK2,
+	FSAL_STAT_IO_ADVISE2,
+	FSAL_STAT_COMMIT2,
+	FSAL_STAT_LOCK_OP2,
+	FSAL_STAT_CLOSE2,
+	FSAL_STAT_READ2_ASYNC,
+	FSAL_STAT_WRITE2_ASYNC,
+	FSAL_STAT_COMMIT2_ASYNC,
+	FSAL_STAT_READV2,
+	FSAL_STAT_WRITEV2,
+	FSAL_STAT_COPY2,
+	FSAL_STAT_CLONE2,
+	FSAL_STAT_LIST_EXT_ATTRS,
+	FSAL_STAT_GETEXTATTR_ID_BY_NAME,
+	FSAL_STAT_GETEXTATTR_VALUE_BY_ID,
+	FSAL_STAT_GETEXTATTR_VALUE_BY_NAME,
+	FSAL_STAT_SETEXTATTR_VALUE,
+	FSAL_STAT_SETEXTATTR_VALUE_BY_ID,
+	FSAL_STAT_REMOVE_EXTATTR_BY_ID,
+	FSAL_STAT_REMOVE_EXTATTR_BY_NAME,
+	FSAL_STAT_CREATE_HANDLE,
+	FSAL_STAT_OPS
+};
+
+extern const char * const fsal_stat_op_name[FSAL_STAT_OPS];
+
 void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup);
+bool server_stats_latency_sample(void);
+void server_stats_latency_done(request_data_t *reqdata,
+			       struct timespec *executed);
 
 #ifdef _USE_9P
-void server_stats_9p_done(u8 msgtype, struct _9p_request_data *req9p);
+void server_stats_9p_done(u8 msgtype, struct _9p_request_data *req9p,
+			  struct timespec *start);
 #endif
 
-void server_stats_io_done(size_t requested,
+void server_stats_io_done(struct fsal_obj_handle *obj, size_t requested,
 			  size_t transferred, bool success, bool is_write);
+void server_stats_topn_init(void);
+void server_stats_read_plus_done(uint64_t data, uint64_t holes,
+				 uint64_t zeroes);
 void server_stats_compound_done(int num_ops, int status);
 void server_stats_nfsv4_op_done(int proto_op,
 				nsecs_elapsed_t start_time, int status);
+nsecs_elapsed_t server_stats_fsal_op_start(struct gsh_export *export,
+					   enum fsal_stat_op op);
+void server_stats_fsal_op_done(struct gsh_export *export,
+			       enum fsal_stat_op op, nsecs_elapsed_t start_time);
 void server_stats_transport_done(struct gsh_client *client,
 				uint64_t rx_bytes, uint64_t rx_pkt,
 				uint64_t rx_err, uint64_t tx_bytes,
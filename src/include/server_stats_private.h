@@ -58,6 +58,9 @@ struct rquota_stats;
 struct nfsv40_stats;
 struct nfsv41_stats;
 struct nfsv42_stats;
+struct latency_stats;
+struct op_hists;
+struct fsal_op_stats;
 struct deleg_stats;
 struct _9p_stats;
 
@@ -71,6 +74,9 @@ struct gsh_stats {
 	struct nfsv41_stats *nfsv42;
 	struct deleg_stats *deleg;
 	struct _9p_stats *_9p;
+	struct latency_stats *latency;
+	struct op_hists *op_hists;
+	struct fsal_op_stats *fsal_ops;
 };
 
 /**
@@ -235,6 +241,221 @@ struct export_stats {
 	.direction = "out"  \
 }
 
+#define IO_BUFPOOL_REPLY_ARRAY_TYPE "(ttttttt)"
+#define IO_BUFPOOL_REPLY			\
+{						\
+	.name = "io_bufpool",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		IO_BUFPOOL_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+#define POOL_STATS_REPLY_ARRAY_TYPE "(stttttttt)"
+#define POOL_STATS_REPLY			\
+{						\
+	.name = "pools",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		POOL_STATS_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+#define HASHTABLES_REPLY_ARRAY_TYPE "(stttttt)"
+#define HASHTABLES_REPLY			\
+{						\
+	.name = "hashtables",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		HASHTABLES_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+#define CACHE_LANES_REPLY_ARRAY_TYPE "(tttttt)"
+#define CACHE_LANES_REPLY			\
+{						\
+	.name = "lanes",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		CACHE_LANES_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+#define CACHE_HOT_REPLY_ARRAY_TYPE "(qstttttt)"
+#define CACHE_HOT_REPLY				\
+{						\
+	.name = "objects",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		CACHE_HOT_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+#define DRC_STATS_REPLY				\
+{						\
+	.name = "drc",				\
+	.type = "(tttttt)",			\
+	.direction = "out"			\
+}
+
+#define FF_DS_REPLY_ARRAY_TYPE "(ssttttttttttt)"
+#define FF_DS_REPLY				\
+{						\
+	.name = "dropped",			\
+	.type = "t",				\
+	.direction = "out"			\
+},						\
+{						\
+	.name = "servers",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		FF_DS_REPLY_ARRAY_TYPE,		\
+	.direction = "out"			\
+}
+
+#define LAYOUTRECALL_REPLY			\
+{						\
+	.name = "layoutrecall",			\
+	.type = "(ttttttttt)",			\
+	.direction = "out"			\
+}
+
+#define GROUP_CACHE_REPLY			\
+{						\
+	.name = "group_cache",			\
+	.type = "(ttttt)",			\
+	.direction = "out"			\
+}
+
+#define LOCK_PROFILE_REPLY			\
+{						\
+	.name = "locks",			\
+	.type = "a(ssutttttt)",			\
+	.direction = "out"			\
+}
+
+#define MEM_STATS_REPLY				\
+{						\
+	.name = "subsystems",			\
+	.type = "a(sttttt)",			\
+	.direction = "out"			\
+}
+
+#define CPU_PROFILE_REPLY			\
+{						\
+	.name = "samples",			\
+	.type = "t",				\
+	.direction = "out"			\
+},						\
+{						\
+	.name = "dropped",			\
+	.type = "t",				\
+	.direction = "out"			\
+},						\
+{						\
+	.name = "stacks",			\
+	.type = "a(st)",			\
+	.direction = "out"			\
+},						\
+{						\
+	.name = "allocs",			\
+	.type = "a(stt)",			\
+	.direction = "out"			\
+}
+
+#define XPRTS_REPLY_ARRAY_TYPE "(suttubutttuutut)"
+#define XPRTS_REPLY				\
+{						\
+	.name = "connections",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		XPRTS_REPLY_ARRAY_TYPE,		\
+	.direction = "out"			\
+}
+
+#define WORKER_QUEUES_REPLY_ARRAY_TYPE "(stttttat)"
+#define WORKER_STATS_REPLY			\
+{						\
+	.name = "workers",			\
+	.type = "(uutt)",			\
+	.direction = "out"			\
+},						\
+{						\
+	.name = "queues",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		WORKER_QUEUES_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+},						\
+{						\
+	.name = "fridges",			\
+	.type = "a(suuutttt)",			\
+	.direction = "out"			\
+}
+
+#define TOPN_LIST_REPLY(_name)			\
+{						\
+	.name = _name,				\
+	.type = "a(stt)",			\
+	.direction = "out"			\
+}
+
+#define TOPN_REPLY				\
+{						\
+	.name = "window",			\
+	.type = "u",				\
+	.direction = "out"			\
+},						\
+TOPN_LIST_REPLY("clients_by_ops"),		\
+TOPN_LIST_REPLY("clients_by_bytes"),		\
+TOPN_LIST_REPLY("clients_by_latency"),	\
+TOPN_LIST_REPLY("files_by_ops"),		\
+TOPN_LIST_REPLY("files_by_bytes"),		\
+TOPN_LIST_REPLY("files_by_latency")
+
+#define READ_PLUS_STATS_REPLY			\
+{						\
+	.name = "read_plus",			\
+	.type = "(tttt)",			\
+	.direction = "out"			\
+}
+
+#define FD_CACHE_REPLY				\
+{						\
+	.name = "fds",				\
+	.type = "(tt)",				\
+	.direction = "out"			\
+}
+
+#define READ_AHEAD_REPLY			\
+{						\
+	.name = "read_ahead",			\
+	.type = "(tttt)",			\
+	.direction = "out"			\
+}
+
+/* name, count, p50, p90, p99, p99.9 and max in nsecs */
+#define LATENCY_REPLY_ARRAY_TYPE "(stttttt)"
+#define LATENCY_REPLY				\
+{						\
+	.name = "latency",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		LATENCY_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+/* op, in flight, count, p50, p90, p99, p99.9 and max in nsecs */
+#define FSAL_LATENCY_REPLY_ARRAY_TYPE "(sttttttt)"
+#define FSAL_LATENCY_REPLY			\
+{						\
+	.name = "fsal_latency",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		FSAL_LATENCY_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
+/* protocol, op, count, p50, p90, p99, p99.9 and max in nsecs */
+#define OP_LATENCY_REPLY_ARRAY_TYPE "(sstttttt)"
+#define OP_LATENCY_REPLY			\
+{						\
+	.name = "op_latency",			\
+	.type = DBUS_TYPE_ARRAY_AS_STRING	\
+		OP_LATENCY_REPLY_ARRAY_TYPE,	\
+	.direction = "out"			\
+}
+
 
 void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st);
 void server_dbus_v3_iostats(struct nfsv3_stats *v3p, DBusMessageIter *iter);
@@ -250,7 +471,31 @@ void server_dbus_total_ops(struct export_stats *export_st,
 			   DBusMessageIter *iter);
 void global_dbus_total_ops(DBusMessageIter *iter);
 void server_dbus_fast_ops(DBusMessageIter *iter);
+void server_dbus_io_bufpool(DBusMessageIter *iter);
+void server_dbus_pools(DBusMessageIter *iter);
+void server_dbus_hashtables(DBusMessageIter *iter);
+void server_dbus_read_plus(DBusMessageIter *iter);
+void server_dbus_layoutrecall(DBusMessageIter *iter);
+void server_dbus_ff_ds(DBusMessageIter *iter);
+void server_dbus_drc(DBusMessageIter *iter);
+void server_dbus_uid2grp(DBusMessageIter *iter);
+void server_dbus_topn(uint32_t count, DBusMessageIter *iter);
+void server_dbus_workers(DBusMessageIter *iter);
+void nfs_rpc_dbus_xprts(DBusMessageIter *iter);
+void server_dbus_fd_cache(struct gsh_export *export, DBusMessageIter *iter);
+void server_dbus_read_ahead(struct gsh_export *export, DBusMessageIter *iter);
+void server_dbus_latency(struct export_stats *export_st,
+			 DBusMessageIter *iter);
+void global_dbus_latency(DBusMessageIter *iter);
+void server_dbus_op_latency(struct gsh_stats *st, DBusMessageIter *iter);
+void global_dbus_op_latency(DBusMessageIter *iter);
+void server_stats_reset_op_latency(struct gsh_stats *st);
+void global_reset_op_latency(void);
+void server_dbus_fsal_latency(struct gsh_stats *st, DBusMessageIter *iter);
+void server_stats_reset_fsal_latency(struct gsh_stats *st);
 void mdcache_dbus_show(DBusMessageIter *iter);
+void mdcache_dbus_show_lanes(DBusMessageIter *iter);
+void mdcache_dbus_show_hot(uint32_t count, DBusMessageIter *iter);
 
 #ifdef _USE_9P
 void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter);
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file stats_shm.h
+ * @brief Publishing the counters in a shared memory segment
+ *
+ * See gsh_stats_shm.h for the layout.  The segment is built in a
+ * buffer by the publisher thread, then copied under the seqlock, so
+ * readers never wait on the walk of the exports and clients.
+ */
+
+#ifndef STATS_SHM_H
+#define STATS_SHM_H
+
+#include <stdbool.h>
+#include "gsh_stats_shm.h"
+
+struct stats_shm_ctx;
+
+/**
+ * @brief Adds the counters of a module to the segment being built
+ *
+ * Called from the publisher thread, with stats_shm_value() and
+ * stats_shm_hist().
+ */
+typedef void (*stats_shm_provider_t)(struct stats_shm_ctx *ctx);
+
+void stats_shm_add_provider(stats_shm_provider_t provider);
+void stats_shm_start(void);
+void stats_shm_shutdown(void);
+
+struct gsh_stats_shm_counters *stats_shm_global(struct stats_shm_ctx *ctx);
+struct gsh_stats_shm_export *stats_shm_export(struct stats_shm_ctx *ctx);
+struct gsh_stats_shm_client *stats_shm_client(struct stats_shm_ctx *ctx);
+void stats_shm_value(struct stats_shm_ctx *ctx, const char *module,
+		     const char *name, uint64_t value);
+struct gsh_stats_shm_hist *stats_shm_hist(struct stats_shm_ctx *ctx,
+					  const char *module,
+					  const char *name);
+
+/* Fills in the server's own counters, in server_stats.c */
+void server_stats_shm_fill(struct stats_shm_ctx *ctx);
+
+#endif /* STATS_SHM_H */
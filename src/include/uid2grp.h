@@ -57,22 +57,30 @@ typedef struct group_data {
 	time_t epoch;
 	int nbgroups;
 	unsigned int refcount;
+	uint32_t refreshing;	/*< A refresh is queued */
 	pthread_mutex_t lock;
 	gid_t *groups;
 } group_data_t;
 
-extern pthread_rwlock_t uid2grp_user_lock;
+/**
+ * @brief Counters of the group list cache
+ */
+struct uid2grp_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t waits;		/*< Misses that waited for another one */
+	uint64_t refreshes;	/*< Refreshes queued before expiry */
+	uint64_t failures;	/*< Users that could not be resolved */
+};
 
 void uid2grp_cache_init(void);
+void uid2grp_refresh_init(void);
 
 void uid2grp_add_user(struct group_data *);
 bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *, uid_t *,
 			     struct group_data **);
 bool uid2grp_lookup_by_uid(const uid_t, struct group_data **);
 
-void uid2grp_remove_by_uname(const struct gsh_buffdesc *);
-void uid2grp_remove_by_uid(const uid_t);
-
 void uid2grp_clear_cache(void);
 
 bool uid2grp(uid_t uid, struct group_data **);
@@ -80,6 +88,7 @@ bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata);
 void uid2grp_unref(struct group_data *gdata);
 void uid2grp_hold_group_data(struct group_data *);
 void uid2grp_release_group_data(struct group_data *);
+void uid2grp_stats(struct uid2grp_stats *);
 
 #endif				/* UID2GRP_H */
 /** @} */
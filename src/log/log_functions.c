@@ -42,6 +42,7 @@
 #include <libgen.h>
 #include <execinfo.h>
 #include <sys/resource.h>
+#include <sys/uio.h>
 
 #include "log.h"
 #include "gsh_list.h"
@@ -49,6 +50,7 @@
 #include "gsh_rpc.h"
 #include "common_utils.h"
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
@@ -95,6 +97,24 @@
 			assert(0);					\
 	} while (0)
 
+#ifdef PTHREAD_MUTEX_lock
+#undef PTHREAD_MUTEX_lock
+#endif
+#define PTHREAD_MUTEX_lock(_mtx)					\
+	do {								\
+		if (pthread_mutex_lock(_mtx) != 0)			\
+			assert(0);					\
+	} while (0)
+
+#ifdef PTHREAD_MUTEX_unlock
+#undef PTHREAD_MUTEX_unlock
+#endif
+#define PTHREAD_MUTEX_unlock(_mtx)					\
+	do {								\
+		if (pthread_mutex_unlock(_mtx) != 0)			\
+			assert(0);					\
+	} while (0)
+
 pthread_rwlock_t log_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 
 /* Variables to control log fields */
@@ -202,6 +222,74 @@ struct log_facility {
 	void *lf_private;	/*< Private info for facility          */
 };
 
+/**
+ * @brief Private info of a FILE facility
+ *
+ * The file is kept open between messages.  fd is only closed with
+ * log_rwlock held for write and log_ring_mutex held, so writers
+ * holding either of them may use it.
+ */
+struct log_file {
+	char *path;		/*< Path of the log file */
+	int fd;			/*< Open fd of the file, -1 if not open */
+	pthread_mutex_t lock;	/*< Serializes opening fd */
+};
+
+/*
+ * Asynchronous file logging
+ *
+ * With Async_File_Logging, messages for FILE facilities are copied into
+ * a ring owned by the logging thread and written out in batches by the
+ * log flusher thread.  Each ring has a single producer (its thread) and
+ * a single consumer (the flusher) so neither side takes a lock.  A
+ * message that does not fit in its ring is dropped and counted.
+ */
+
+/** Size of the ring of each thread, a power of 2 */
+#define LOG_RING_SIZE (64 * 1024)
+
+/** How long the flusher sleeps between passes, in ms */
+#define LOG_FLUSH_INTERVAL 100
+
+/** Max iovecs written by the flusher at once */
+#define LOG_FLUSH_IOV 64
+
+#define LOG_REC_ALIGN 16
+
+/**
+ * @brief A message in a ring, followed by its text
+ *
+ * A record with no file pads the end of the ring when the next
+ * message does not fit there.
+ */
+struct log_rec {
+	struct log_file *file;	/*< File to write to, NULL for padding */
+	uint32_t len;		/*< Length of the text */
+} __attribute__ ((aligned(LOG_REC_ALIGN)));
+
+#define LOG_REC_SIZE(len) \
+	((sizeof(struct log_rec) + (len) + LOG_REC_ALIGN - 1) & \
+	 ~((uint64_t) LOG_REC_ALIGN - 1))
+
+struct log_ring {
+	struct glist_head rings;	/*< On log_rings */
+	uint64_t head;		/*< Bytes produced, written by the owner */
+	uint64_t tail;		/*< Bytes consumed, written by the flusher */
+	uint32_t dead;		/*< The owner has exited */
+	char buf[LOG_RING_SIZE] __attribute__ ((aligned(LOG_REC_ALIGN)));
+};
+
+static bool log_async;
+static bool log_flusher_running;
+static pthread_t log_flusher_thread;
+static uint64_t log_dropped;
+static struct glist_head log_rings = GLIST_HEAD_INIT(log_rings);
+static pthread_mutex_t log_ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_ring_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t log_ring_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_ring_key;
+static __thread struct log_ring *my_log_ring;
+
 /* Define the maximum length of a user time/date format. */
 #define MAX_TD_USER_LEN 64
 /* Define the maximum overall time/date format length, should have room
@@ -274,6 +362,360 @@ __thread char thread_name[16];
 __thread char log_buffer[LOG_BUFF_LEN + 1];
 __thread char *clientip = NULL;
 
+static struct log_file *new_log_file(const char *path)
+{
+	struct log_file *file = gsh_calloc(1, sizeof(*file));
+
+	file->path = gsh_strdup(path);
+	file->fd = -1;
+	pthread_mutex_init(&file->lock, NULL);
+
+	return file;
+}
+
+/**
+ * @brief Close a log file, it is opened again by the next write
+ *
+ * Must be called with log_rwlock held for write and log_ring_mutex held.
+ */
+static void close_log_file(struct log_file *file)
+{
+	if (file->fd >= 0) {
+		(void)close(file->fd);
+		file->fd = -1;
+	}
+}
+
+static void free_log_file(struct log_file *file)
+{
+	close_log_file(file);
+	pthread_mutex_destroy(&file->lock);
+	gsh_free(file->path);
+	gsh_free(file);
+}
+
+/**
+ * @brief Get the fd of a log file, opening it if needed
+ *
+ * @return The fd, or -1 with errno set.
+ */
+static int log_file_fd(struct log_file *file)
+{
+	int fd = atomic_fetch_int32_t(&file->fd);
+
+	if (fd >= 0)
+		return fd;
+
+	PTHREAD_MUTEX_lock(&file->lock);
+	fd = file->fd;
+	if (fd < 0) {
+		fd = open(file->path, O_WRONLY | O_APPEND | O_CREAT,
+			  log_mask);
+		if (fd >= 0)
+			atomic_store_int32_t(&file->fd, fd);
+	}
+	PTHREAD_MUTEX_unlock(&file->lock);
+
+	return fd;
+}
+
+/**
+ * @brief Write out a batch of messages for a log file
+ */
+static void log_file_writev(struct log_file *file, struct iovec *iov,
+			    int cnt)
+{
+	ssize_t rc;
+	int fd;
+
+	while (cnt > 0) {
+		fd = log_file_fd(file);
+		if (fd < 0)
+			goto error;
+
+		rc = writev(fd, iov, cnt);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			goto error;
+		}
+
+		/* Skip what went out, a short write resumes in an iovec */
+		while (cnt > 0 && (size_t) rc >= iov->iov_len) {
+			rc -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + rc;
+			iov->iov_len -= rc;
+		}
+	}
+	return;
+
+ error:
+	fprintf(stderr,
+		"Error: couldn't complete write to the log file %s status=%d (%s), %d messages lost\\n",
+		file->path, errno, strerror(errno), cnt);
+}
+
+static void log_ring_destroy(void *arg)
+{
+	struct log_ring *ring = arg;
+
+	/* The flusher frees it once drained */
+	atomic_store_uint32_t(&ring->dead, 1);
+}
+
+static void log_ring_key_init(void)
+{
+	(void)pthread_key_create(&log_ring_key, log_ring_destroy);
+}
+
+static struct log_ring *new_log_ring(void)
+{
+	struct log_ring *ring;
+
+	(void)pthread_once(&log_ring_once, log_ring_key_init);
+
+	ring = gsh_malloc(sizeof(*ring));
+	ring->head = 0;
+	ring->tail = 0;
+	ring->dead = 0;
+	(void)pthread_setspecific(log_ring_key, ring);
+
+	PTHREAD_MUTEX_lock(&log_ring_mutex);
+	glist_add_tail(&log_rings, &ring->rings);
+	PTHREAD_MUTEX_unlock(&log_ring_mutex);
+
+	my_log_ring = ring;
+
+	return ring;
+}
+
+/**
+ * @brief Queue a message in the ring of this thread
+ *
+ * @param[in] file  File to write it to
+ * @param[in] msg   Text of the message, with its newline
+ * @param[in] len   Length of the text
+ *
+ * @return false if the message is too long for a ring.
+ */
+static bool log_ring_put(struct log_file *file, const char *msg,
+			 uint32_t len)
+{
+	struct log_ring *ring = my_log_ring;
+	struct log_rec *rec;
+	uint64_t head, tail, pos, contig, need, total;
+
+	need = LOG_REC_SIZE(len);
+	if (need > LOG_RING_SIZE / 4)
+		return false;
+
+	if (ring == NULL)
+		ring = new_log_ring();
+
+	head = ring->head;
+	tail = atomic_fetch_uint64_t(&ring->tail);
+	pos = head & (LOG_RING_SIZE - 1);
+	contig = LOG_RING_SIZE - pos;
+	total = contig < need ? contig + need : need;
+
+	if (total > LOG_RING_SIZE - (head - tail)) {
+		(void)atomic_inc_uint64_t(&log_dropped);
+		pthread_cond_signal(&log_ring_cond);
+		return true;
+	}
+
+	if (contig < need) {
+		rec = (struct log_rec *)(ring->buf + pos);
+		rec->file = NULL;
+		rec->len = contig - sizeof(*rec);
+		pos = 0;
+	}
+
+	rec = (struct log_rec *)(ring->buf + pos);
+	rec->file = file;
+	rec->len = len;
+	memcpy(rec + 1, msg, len);
+
+	atomic_store_uint64_t(&ring->head, head + total);
+
+	if (head + total - tail > LOG_RING_SIZE / 2)
+		pthread_cond_signal(&log_ring_cond);
+
+	return true;
+}
+
+/**
+ * @brief Write out everything queued in the rings
+ *
+ * Must be called with log_ring_mutex held.
+ */
+static void drain_log_rings(void)
+{
+	struct glist_head *glist, *glistn;
+	struct log_ring *ring;
+	struct log_rec *rec;
+	struct log_file *file = NULL;
+	struct iovec iov[LOG_FLUSH_IOV];
+	uint64_t head, tail;
+	uint32_t dead;
+	int cnt = 0;
+
+	glist_for_each_safe(glist, glistn, &log_rings) {
+		ring = glist_entry(glist, struct log_ring, rings);
+		dead = atomic_fetch_uint32_t(&ring->dead);
+		head = atomic_fetch_uint64_t(&ring->head);
+		tail = ring->tail;
+
+		while (tail != head) {
+			rec = (struct log_rec *)
+				(ring->buf + (tail & (LOG_RING_SIZE - 1)));
+			tail += LOG_REC_SIZE(rec->len);
+			if (rec->file == NULL)
+				continue;
+			if (cnt > 0 &&
+			    (rec->file != file || cnt == LOG_FLUSH_IOV)) {
+				log_file_writev(file, iov, cnt);
+				cnt = 0;
+			}
+			file = rec->file;
+			iov[cnt].iov_base = rec + 1;
+			iov[cnt].iov_len = rec->len;
+			cnt++;
+		}
+
+		/* The records must be written before giving back the space */
+		if (cnt > 0) {
+			log_file_writev(file, iov, cnt);
+			cnt = 0;
+		}
+		atomic_store_uint64_t(&ring->tail, tail);
+
+		if (dead) {
+			glist_del(&ring->rings);
+			gsh_free(ring);
+		}
+	}
+}
+
+static void *log_flusher(void *arg)
+{
+	struct timespec ts;
+	uint64_t dropped, reported = atomic_fetch_uint64_t(&log_dropped);
+
+	SetNameFunction("log_flusher");
+
+	PTHREAD_MUTEX_lock(&log_ring_mutex);
+	while (log_flusher_running) {
+		drain_log_rings();
+
+		dropped = atomic_fetch_uint64_t(&log_dropped);
+		if (dropped != reported) {
+			PTHREAD_MUTEX_unlock(&log_ring_mutex);
+			LogWarn(COMPONENT_LOG,
+				"%" PRIu64
+				" log messages dropped, the log buffer of their thread was full",
+				dropped - reported);
+			reported = dropped;
+			PTHREAD_MUTEX_lock(&log_ring_mutex);
+		}
+
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += LOG_FLUSH_INTERVAL * 1000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		(void)pthread_cond_timedwait(&log_ring_cond, &log_ring_mutex,
+					     &ts);
+	}
+	drain_log_rings();
+	PTHREAD_MUTEX_unlock(&log_ring_mutex);
+
+	return NULL;
+}
+
+/**
+ * @brief Turn asynchronous file logging on or off
+ *
+ * Turning it off waits for the flusher to write out what is queued.
+ *
+ * @param[in] async  Whether FILE facilities are written asynchronously
+ */
+static void set_log_async(bool async)
+{
+	int rc;
+
+	if (async == log_async)
+		return;
+
+	if (async) {
+		log_flusher_running = true;
+		rc = pthread_create(&log_flusher_thread, NULL, log_flusher,
+				    NULL);
+		if (rc != 0) {
+			log_flusher_running = false;
+			LogCrit(COMPONENT_LOG,
+				"Could not start the log flusher thread (%s)",
+				strerror(rc));
+			return;
+		}
+	}
+
+	PTHREAD_RWLOCK_wrlock(&log_rwlock);
+	log_async = async;
+	PTHREAD_RWLOCK_unlock(&log_rwlock);
+
+	if (!async) {
+		PTHREAD_MUTEX_lock(&log_ring_mutex);
+		log_flusher_running = false;
+		pthread_cond_signal(&log_ring_cond);
+		PTHREAD_MUTEX_unlock(&log_ring_mutex);
+		(void)pthread_join(log_flusher_thread, NULL);
+	}
+}
+
+/**
+ * @brief Write out the messages queued for FILE facilities
+ */
+void flush_log_facilities(void)
+{
+	PTHREAD_MUTEX_lock(&log_ring_mutex);
+	drain_log_rings();
+	PTHREAD_MUTEX_unlock(&log_ring_mutex);
+}
+
+/**
+ * @brief Close the files of FILE facilities, they are opened again
+ *        by the next message
+ *
+ * Used on SIGHUP so that rotated logs are let go.
+ */
+void reopen_log_facilities(void)
+{
+	struct glist_head *glist;
+	struct log_facility *facility;
+
+	PTHREAD_RWLOCK_wrlock(&log_rwlock);
+	PTHREAD_MUTEX_lock(&log_ring_mutex);
+
+	/* What was queued goes to the old file */
+	drain_log_rings();
+
+	glist_for_each(glist, &facility_list) {
+		facility = glist_entry(glist, struct log_facility, lf_list);
+		if (facility->lf_func == log_to_file &&
+		    facility->lf_private != NULL)
+			close_log_file(facility->lf_private);
+	}
+
+	PTHREAD_MUTEX_unlock(&log_ring_mutex);
+	PTHREAD_RWLOCK_unlock(&log_rwlock);
+}
+
 /* threads keys */
 #define LogChanges(format, args...) \
 	do { \
@@ -308,6 +750,7 @@ void Cleanup(void)
 
 void Fatal(void)
 {
+	flush_log_facilities();
 	Cleanup();
 	exit(2);
 }
@@ -768,7 +1211,7 @@ int create_log_facility(const char *name, lf_function_t *log_func,
 	facility->lf_headers = header;
 
 	if (log_func == log_to_file && private != NULL)
-		facility->lf_private = gsh_strdup(private);
+		facility->lf_private = new_log_file(private);
 	else
 		facility->lf_private = private;
 
@@ -820,8 +1263,11 @@ void release_log_facility(const char *name)
 	glist_del(&facility->lf_list);
 	PTHREAD_RWLOCK_unlock(&log_rwlock);
 	if (facility->lf_func == log_to_file &&
-	    facility->lf_private != NULL)
-		gsh_free(facility->lf_private);
+	    facility->lf_private != NULL) {
+		/* No new message can reach it, write out the queued ones */
+		flush_log_facilities();
+		free_log_file(facility->lf_private);
+	}
 	gsh_free(facility->lf_name);
 	gsh_free(facility);
 }
@@ -1004,7 +1450,8 @@ int set_log_destination(const char *name, char *dest)
 		return -ENOENT;
 	}
 	if (facility->lf_func == log_to_file) {
-		char *logfile, *dir;
+		struct log_file *file = facility->lf_private;
+		char *dir;
 
 		dir = alloca(strlen(dest) + 1);
 		strcpy(dir, dest);
@@ -1017,9 +1464,16 @@ int set_log_destination(const char *name, char *dest)
 				dest, strerror(errno));
 			return -errno;
 		}
-		logfile = gsh_strdup(dest);
-		gsh_free(facility->lf_private);
-		facility->lf_private = logfile;
+		if (file == NULL) {
+			facility->lf_private = new_log_file(dest);
+		} else {
+			PTHREAD_MUTEX_lock(&log_ring_mutex);
+			drain_log_rings();
+			close_log_file(file);
+			gsh_free(file->path);
+			file->path = gsh_strdup(dest);
+			PTHREAD_MUTEX_unlock(&log_ring_mutex);
+		}
 	} else if (facility->lf_func == log_to_stream) {
 		FILE *out;
 
@@ -1199,7 +1653,7 @@ static int log_to_file(log_header_t headers, void *private,
 		       char *message)
 {
 	int fd, my_status, len, rc = 0;
-	char *path = private;
+	struct log_file *file = private;
 
 	len = display_buffer_len(buffer);
 
@@ -1207,26 +1661,25 @@ static int log_to_file(log_header_t headers, void *private,
 	buffer->b_start[len] = '\n';
 	buffer->b_start[len + 1] = '\0';
 
-	fd = open(path, O_WRONLY | O_APPEND | O_CREAT, log_mask);
+	if (log_async && log_ring_put(file, buffer->b_start, len + 1))
+		goto out;
+
+	fd = log_file_fd(file);
 
 	if (fd != -1) {
 		rc = write(fd, buffer->b_start, len + 1);
 
-		if (rc < (len + 1)) {
-			if (rc >= 0)
-				my_status = ENOSPC;
-			else
-				my_status = errno;
-
-			(void)close(fd);
-
-			goto error;
+		if (rc == (len + 1)) {
+			rc = 0;
+			goto out;
 		}
 
-		rc = close(fd);
+		if (rc >= 0)
+			my_status = ENOSPC;
+		else
+			my_status = errno;
 
-		if (rc == 0)
-			goto out;
+		goto error;
 	}
 
 	my_status = errno;
@@ -1235,7 +1688,7 @@ static int log_to_file(log_header_t headers, void *private,
 
 	fprintf(stderr,
 		"Error: couldn't complete write to the log file %s status=%d (%s) message was:\n%s",
-		path, my_status, strerror(my_status), buffer->b_start);
+		file->path, my_status, strerror(my_status), buffer->b_start);
 
  out:
 
@@ -1910,6 +2363,7 @@ struct facility_config {
 
 struct logger_config {
 	log_levels_t default_level;
+	bool async_file;
 	struct glist_head facility_list;
 	struct logfields *logfields;
 	log_levels_t *comp_log_level;
@@ -2507,6 +2961,7 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 		(void)facility_init(&logger->facility_list, conf);
 	}
 	if (errcnt == 0) {
+		set_log_async(logger->async_file);
 		if (logger->logfields != NULL) {
 			LogEvent(COMPONENT_CONFIG,
 				 "Changing definition of log fields");
@@ -2550,6 +3005,8 @@ static int log_conf_commit(void *node, void *link_mem, void *self_struct,
 static struct config_item logging_params[] = {
 	CONF_ITEM_TOKEN("Default_log_level", NB_LOG_LEVEL, log_levels,
 			 logger_config, default_level),
+	CONF_ITEM_BOOL("Async_File_Logging", false,
+		       logger_config, async_file),
 	CONF_ITEM_BLOCK("Facility", facility_params,
 			facility_init, facility_commit,
 			logger_config, facility_list),
@@ -30,10 +30,14 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <os/subr.h>
 #include <dirent.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/filio.h>
 #include <log.h>
 #include "syscalls.h"
 
@@ -151,3 +155,50 @@ int set_threadgroups(size_t size, const gid_t *list)
 {
 	return syscall(SYS_setgroups, size, list);
 }
+
+ssize_t vfs_copy_range(int src_fd, off_t *src_off, int dst_fd,
+		       off_t *dst_off, size_t len)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int vfs_clone_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+		    uint64_t len)
+{
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+int vfs_alloc_range(int fd, off_t off, off_t len, bool punch)
+{
+	int rc;
+
+	if (punch) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	rc = posix_fallocate(fd, off, len);
+	if (rc != 0) {
+		errno = rc;
+		return -1;
+	}
+
+	return 0;
+}
+
+int sock_stats(int fd, struct sock_stats *st)
+{
+	int val;
+
+	memset(st, 0, sizeof(*st));
+
+	if (ioctl(fd, FIONREAD, &val) != 0)
+		return -1;
+	st->recv_q = val;
+	if (ioctl(fd, FIONWRITE, &val) == 0)
+		st->send_q = val;
+
+	return 0;
+}
@@ -26,14 +26,32 @@
  *
  */
 
+#define _GNU_SOURCE
 #include "fsal.h"
 #include <stddef.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/fsuid.h>
 #include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <linux/tcp.h>
 #include "os/subr.h"
 
+#ifndef FICLONERANGE
+struct file_clone_range {
+	int64_t src_fd;
+	uint64_t src_offset;
+	uint64_t src_length;
+	uint64_t dest_offset;
+};
+
+#define FICLONERANGE _IOW(0x94, 13, struct file_clone_range)
+#endif
+
 /**
  * @brief Read system directory entries into the buffer
  *
@@ -53,7 +71,7 @@ int vfs_readents(int fd, char *buf, unsigned int bcount, off_t *basepp)
 }
 
 /**
- * @brief Mash a FreeBSD directory entry into the generic form
+ * @brief Mash a Linux directory entry into the generic form
  *
  * @param buf  [in] pointer into buffer read by vfs_readents
  * @param bpos [in] byte offset into buf to decode
@@ -66,12 +84,10 @@ int vfs_readents(int fd, char *buf, unsigned int bcount, off_t *basepp)
 bool to_vfs_dirent(char *buf, int bpos, struct vfs_dirent *vd, off_t base)
 {
 	struct dirent64 *dp = (struct dirent64 *)(buf + bpos);
-	char type;
 
 	vd->vd_ino = dp->d_ino;
 	vd->vd_reclen = dp->d_reclen;
-	type = buf[dp->d_reclen - 1];
-	vd->vd_type = type;
+	vd->vd_type = dp->d_type;
 	vd->vd_offset = dp->d_off;
 	vd->vd_name = dp->d_name;
 	return true;
@@ -130,3 +146,107 @@ int set_threadgroups(size_t size, const gid_t *list)
 {
 	return syscall(__NR_setgroups, size, list);
 }
+
+/**
+ * @brief Copy a range of one file to another in the kernel
+ *
+ * @param[in]     src_fd  File to copy from
+ * @param[in,out] src_off Offset in the source, advanced by the copy
+ * @param[in]     dst_fd  File to copy to
+ * @param[in,out] dst_off Offset in the destination, advanced by the copy
+ * @param[in]     len     Bytes to copy
+ *
+ * @return Bytes copied, 0 at the end of the source or -1 with errno set,
+ *         ENOSYS if the kernel can't copy.
+ */
+ssize_t vfs_copy_range(int src_fd, off_t *src_off, int dst_fd,
+		       off_t *dst_off, size_t len)
+{
+#ifdef __NR_copy_file_range
+	return syscall(__NR_copy_file_range, src_fd, src_off, dst_fd, dst_off,
+		       len, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Share a range of one file with another
+ *
+ * @param[in] src_fd  File to clone from
+ * @param[in] src_off Offset in the source
+ * @param[in] dst_fd  File to clone to
+ * @param[in] dst_off Offset in the destination
+ * @param[in] len     Bytes to clone, 0 for up to the end of the source
+ *
+ * @return 0 or -1 with errno set.
+ */
+int vfs_clone_range(int src_fd, off_t src_off, int dst_fd, off_t dst_off,
+		    uint64_t len)
+{
+	struct file_clone_range range = {
+		.src_fd = src_fd,
+		.src_offset = src_off,
+		.src_length = len,
+		.dest_offset = dst_off,
+	};
+
+	return ioctl(dst_fd, FICLONERANGE, &range);
+}
+
+/**
+ * @brief Reserve, or give back, the space of a range of a file
+ *
+ * Reserving may extend the file; punching a hole does not change its
+ * size, and the range reads back as zeroes.
+ *
+ * @param[in] fd     The file
+ * @param[in] off    Start of the range
+ * @param[in] len    Length of the range
+ * @param[in] punch  Punch a hole rather than reserve
+ *
+ * @return 0 or -1 with errno set.
+ */
+int vfs_alloc_range(int fd, off_t off, off_t len, bool punch)
+{
+	return fallocate(fd, punch ? FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE
+				   : 0,
+			 off, len);
+}
+
+/**
+ * @brief Byte counters and queue depths of a TCP socket
+ *
+ * The byte counters need Linux 4.1 or later, and are left 0 before.
+ *
+ * @param[in]  fd  The socket
+ * @param[out] st  What the kernel knows of it
+ *
+ * @return 0 or -1 with errno set.
+ */
+int sock_stats(int fd, struct sock_stats *st)
+{
+	struct tcp_info info;
+	socklen_t len = sizeof(info);
+	int val;
+
+	memset(st, 0, sizeof(*st));
+	memset(&info, 0, sizeof(info));
+
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+		return -1;
+
+	if (len >= offsetof(struct tcp_info, tcpi_bytes_received) +
+		   sizeof(info.tcpi_bytes_received)) {
+		st->bytes_in = info.tcpi_bytes_received;
+		st->bytes_out = info.tcpi_bytes_acked;
+	}
+
+	if (ioctl(fd, SIOCINQ, &val) == 0)
+		st->recv_q = val;
+	if (ioctl(fd, SIOCOUTQ, &val) == 0)
+		st->send_q = val;
+
+	return 0;
+}
@@ -0,0 +1,174 @@
+#!/usr/bin/python
+#
+# ganesha_critical_path.py - per-request critical paths from an LTTng trace
+#
+# Copyright (C) 2017 The nfs-ganesha contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Splits the latency of every request of a trace between:
+#
+#   queue   - from nfs_rpc:enqueue to nfs_rpc:dequeue, summed over the
+#             times the request was queued
+#   drc     - from nfs_rpc:start to nfs_rpc:dupreq_start
+#   fsal    - inside the FSAL below MDCACHE, fsal:subcall_start to
+#             fsal:subcall_end, outermost calls only
+#   ganesha - the rest of nfs_rpc:start to nfs_rpc:end
+#
+# and prints the slowest requests and the totals.  Blocked locks are
+# reported apart, from state:lock_blocked to state:lock_granted.
+#
+# Record the trace with at least:
+#
+#   lttng enable-event -u 'nfs_rpc:*,fsal:*,state:lock_*'
+#
+# Needs the babeltrace python bindings.
+#
+# Usage: ganesha_critical_path.py [--top N] trace_dir
+
+import sys
+from optparse import OptionParser
+
+import babeltrace
+
+
+class Request(object):
+    def __init__(self, req):
+        self.req = req
+        self.xid = None
+        self.queued = None
+        self.queue = 0
+        self.start = None
+        self.drc = 0
+        self.fsal = 0
+        self.fsal_calls = 0
+        self.total = 0
+        # (start, depth) of the FSAL call in progress
+        self.call_start = None
+        self.call_depth = 0
+
+    def ganesha(self):
+        return max(self.total - self.drc - self.fsal, 0)
+
+
+def us(ns):
+    return ns / 1000.0
+
+
+def main():
+    parser = OptionParser(usage="%prog [--top N] trace_dir")
+    parser.add_option("--top", type="int", default=20,
+                      help="number of slowest requests to show")
+    opts, args = parser.parse_args()
+    if len(args) != 1:
+        parser.error("an LTTng trace directory is needed")
+
+    col = babeltrace.TraceCollection()
+    if col.add_traces_recursive(args[0], "ctf") is None:
+        sys.exit("no trace found in %s" % args[0])
+
+    inflight = {}       # request address -> Request
+    by_ctx = {}         # op_ctx address -> Request
+    blocked = {}        # lock entry address -> time blocked
+    done = []
+    lock_waits = []
+
+    for event in col.events:
+        name = event.name
+        ts = event.timestamp
+
+        if name == "nfs_rpc:enqueue":
+            r = inflight.get(event["req"])
+            if r is None:
+                r = inflight[event["req"]] = Request(event["req"])
+            r.queued = ts
+        elif name == "nfs_rpc:dequeue":
+            r = inflight.get(event["req"])
+            if r is not None and r.queued is not None:
+                r.queue += ts - r.queued
+                r.queued = None
+        elif name == "nfs_rpc:start":
+            r = inflight.get(event["req"])
+            if r is None:
+                r = inflight[event["req"]] = Request(event["req"])
+            r.start = ts
+        elif name == "nfs_rpc:context":
+            r = inflight.get(event["req"])
+            if r is not None:
+                r.xid = event["xid"]
+                by_ctx[event["ctx"]] = r
+        elif name == "nfs_rpc:dupreq_start":
+            r = inflight.get(event["req"])
+            if r is not None and r.start is not None:
+                r.drc = ts - r.start
+        elif name == "fsal:subcall_start":
+            r = by_ctx.get(event["ctx"])
+            if r is not None:
+                if r.call_depth == 0:
+                    r.call_start = ts
+                r.call_depth += 1
+        elif name == "fsal:subcall_end":
+            r = by_ctx.get(event["ctx"])
+            if r is not None and r.call_depth > 0:
+                r.call_depth -= 1
+                if r.call_depth == 0:
+                    r.fsal += ts - r.call_start
+                    r.fsal_calls += 1
+        elif name == "nfs_rpc:end":
+            r = inflight.pop(event["req"], None)
+            if r is None or r.start is None:
+                continue
+            r.total = ts - r.start
+            for ctx in [c for c, v in by_ctx.items() if v is r]:
+                del by_ctx[ctx]
+            done.append(r)
+        elif name == "state:lock_blocked":
+            blocked[event["lock"]] = (ts, event["function"])
+        elif name == "state:lock_granted":
+            b = blocked.pop(event["lock"], None)
+            if b is not None:
+                lock_waits.append((ts - b[0], event["lock"], b[1]))
+
+    if not done:
+        sys.exit("no complete request in the trace")
+
+    print("%d requests, slowest %d (us):" % (len(done), opts.top))
+    print("%10s %10s %10s %10s %10s %10s %6s" % (
+        "xid", "total", "queue", "drc", "fsal", "ganesha", "calls"))
+    for r in sorted(done, key=lambda r: r.total + r.queue,
+                    reverse=True)[:opts.top]:
+        print("%10s %10.1f %10.1f %10.1f %10.1f %10.1f %6d" % (
+            r.xid, us(r.total + r.queue), us(r.queue), us(r.drc),
+            us(r.fsal), us(r.ganesha()), r.fsal_calls))
+
+    total = sum(r.total + r.queue for r in done) or 1
+    print("")
+    print("Share of all request time:")
+    for label, part in (("queue", sum(r.queue for r in done)),
+                        ("drc", sum(r.drc for r in done)),
+                        ("fsal", sum(r.fsal for r in done)),
+                        ("ganesha", sum(r.ganesha() for r in done))):
+        print("  %-8s %5.1f%%" % (label, 100.0 * part / total))
+
+    if lock_waits:
+        print("")
+        print("Blocked locks, longest first (us):")
+        for wait, lock, function in sorted(lock_waits,
+                                           reverse=True)[:opts.top]:
+            print("  %10.1f lock %#x blocked in %s" % (us(wait), lock,
+                                                       function))
+
+
+if __name__ == "__main__":
+    main()
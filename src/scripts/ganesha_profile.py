@@ -0,0 +1,122 @@
+#!/usr/bin/python
+#
+# ganesha_profile.py - fetch the CPU profile of ganesha by NFS operation
+#
+# Copyright (C) 2017 The nfs-ganesha contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# The server must be built with -DUSE_CPU_PROFILE=ON.
+#
+# Usage: ganesha_profile.py start [HZ [SAMPLES]]
+#        ganesha_profile.py stop
+#        ganesha_profile.py get [--by-export] [--by-client]
+#                               [--addr2line BINARY] [--allocs]
+#
+# get prints collapsed stacks, one "frame;frame;... count" per line,
+# rooted at the NFS operation, for flamegraph.pl:
+#
+#   ganesha_profile.py get > ops.folded
+#   flamegraph.pl ops.folded > ops.svg
+#
+# Frames of static functions come as object+0xaddress; with --addr2line
+# those of BINARY are named by addr2line.  --allocs prints the counts
+# of allocations by operation instead.
+
+import subprocess
+import sys
+from optparse import OptionParser
+
+import dbus
+
+SERVICE = "org.ganesha.nfsd"
+PATH = "/org/ganesha/nfsd/ExportMgr"
+IFACE = "org.ganesha.nfsd.exportstats"
+
+
+def method(name):
+    try:
+        obj = dbus.SystemBus().get_object(SERVICE, PATH)
+    except dbus.exceptions.DBusException:
+        sys.exit("Can't talk to ganesha on DBus, is it running?")
+    return obj.get_dbus_method(name, IFACE)
+
+
+def check(reply):
+    if not reply[0]:
+        sys.exit(reply[1])
+
+
+def symbolize(stacks, binary):
+    """Name the binary+0xaddress frames with addr2line"""
+    prefix = binary.rsplit("/", 1)[-1] + "+0x"
+    addrs = set()
+    for stack, _ in stacks:
+        for frame in stack.split(";"):
+            if frame.startswith(prefix):
+                addrs.add(frame[len(prefix) - 2:])
+    if not addrs:
+        return stacks
+    addrs = sorted(addrs)
+    out = subprocess.Popen(["addr2line", "-f", "-e", binary] + addrs,
+                           stdout=subprocess.PIPE).communicate()[0]
+    names = out.decode().splitlines()[::2]
+    table = dict((prefix[:-2] + a, n) for a, n in zip(addrs, names)
+                 if n != "??")
+    return [(";".join(table.get(f, f) for f in stack.split(";")), count)
+            for stack, count in stacks]
+
+
+def main():
+    parser = OptionParser(usage="%prog start [HZ [SAMPLES]] | stop | get")
+    parser.add_option("--by-export", action="store_true", default=False,
+                      help="put the export under the operation")
+    parser.add_option("--by-client", action="store_true", default=False,
+                      help="then the client")
+    parser.add_option("--addr2line", metavar="BINARY",
+                      help="name the frames of BINARY with addr2line")
+    parser.add_option("--allocs", action="store_true", default=False,
+                      help="print the allocations by operation")
+    opts, args = parser.parse_args()
+    if not args:
+        parser.error("start, stop or get?")
+
+    if args[0] == "start":
+        hz = int(args[1]) if len(args) > 1 else 99
+        samples = int(args[2]) if len(args) > 2 else 65536
+        check(method("StartCpuProfile")(dbus.UInt32(hz),
+                                        dbus.UInt32(samples)))
+    elif args[0] == "stop":
+        check(method("StopCpuProfile")())
+    elif args[0] == "get":
+        reply = method("GetCpuProfile")(dbus.Boolean(opts.by_export),
+                                        dbus.Boolean(opts.by_client))
+        check(reply)
+        taken, dropped, stacks, allocs = reply[3:7]
+        sys.stderr.write("%d samples, %d dropped\n" % (taken, dropped))
+        if opts.allocs:
+            for op, count, size in sorted(allocs, key=lambda a: -a[2]):
+                print("%-24s %12d allocs %14d bytes" % (op, count, size))
+            return
+        stacks = [(str(s), int(c)) for s, c in stacks]
+        if opts.addr2line:
+            stacks = symbolize(stacks, opts.addr2line)
+        for stack, count in stacks:
+            print("%s %d" % (stack, count))
+    else:
+        parser.error("unknown command %s" % args[0])
+
+
+if __name__ == "__main__":
+    main()
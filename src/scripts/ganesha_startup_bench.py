@@ -0,0 +1,235 @@
+#!/usr/bin/python
+#
+# ganesha_startup_bench.py - time the startup of ganesha as the
+# configuration and the recovery database grow
+#
+# Copyright (C) 2017 The nfs-ganesha contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Usage: ganesha_startup_bench.py [--exports N] [--clients M]
+#                                 [--netgroups G] [--runs K] ...
+#
+# Each run writes a configuration of N FSAL_MEM exports, fills the fs
+# recovery backend with M client records, starts ganesha.nfsd in the
+# foreground and sends NFS NULL calls until one is answered.  The
+# server is then left to end its grace period, and stopped.  None of
+# the clients reclaim, so with M > 0 grace runs to Grace_Period.  The
+# "Startup phase" lines of the log break the startup down; the time to
+# the first reply and out of grace are printed with them, as the
+# median over the runs.
+#
+# The recovery root is built into the server (NFS_V4_RECOV_ROOT), so
+# the client records go there: the script won't run over records it
+# did not write, and removes its own at the end.  With --netgroups,
+# the exports ask the clients to be in one of G netgroups, preloaded
+# with Netgroup_Preload_Interval; the netgroups are whatever NSS
+# knows them as, the script does not create them.
+
+import os
+import re
+import shutil
+import signal
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+from optparse import OptionParser
+
+PHASE = re.compile(r"Startup phase (.+) took (\d+) ms, "
+                   r"(\d+) ms since start")
+FIRST = re.compile(r"First request served (\d+) ms since start")
+GRACE = re.compile(r"(?:lifting GRACE|Now NOT IN GRACE).* "
+                   r"(\d+) ms since start")
+PREFIX = "ganesha-bench-"
+
+
+def write_config(path, opts):
+    conf = open(path, "w")
+    conf.write("NFS_CORE_PARAM {\n")
+    if opts.netgroups:
+        conf.write("\tNetgroup_Preload_Interval = 3600;\n")
+    conf.write("}\n")
+    conf.write("NFSV4 {\n\tGrace_Period = %d;\n"
+               "\tLease_Lifetime = %d;\n}\n"
+               % (opts.grace, min(opts.grace, 60)))
+    for i in range(1, opts.exports + 1):
+        conf.write("EXPORT {\n\tExport_ID = %d;\n"
+                   "\tPath = \"/mem%d\";\n\tPseudo = \"/mem%d\";\n"
+                   "\tAccess_Type = RW;\n\tSquash = No_Root_Squash;\n"
+                   "\tFSAL { Name = MEM; }\n" % (i, i, i))
+        if opts.netgroups:
+            conf.write("\tCLIENT {\n\t\tClients = @%s%d;\n"
+                       "\t\tAccess_Type = RW;\n\t}\n"
+                       % (opts.netgroup_prefix, i % opts.netgroups))
+        conf.write("}\n")
+    conf.close()
+
+
+def recov_dirs(root):
+    return [os.path.join(root, d) for d in ("v4recov", "v4old")]
+
+
+def clear_records(root, check):
+    """Remove the records of a previous run, refusing others"""
+    for d in recov_dirs(root):
+        if not os.path.isdir(d):
+            continue
+        for name in os.listdir(d):
+            if PREFIX not in name:
+                if check:
+                    sys.exit("%s holds records of real clients (%s), "
+                             "won't touch them" % (d, name))
+                continue
+            shutil.rmtree(os.path.join(d, name))
+
+
+def write_records(root, count):
+    """A directory per client, named as nfs4_create_clid_name does"""
+    d = recov_dirs(root)[0]
+    if not os.path.isdir(d):
+        os.makedirs(d, 0o755)
+    for i in range(count):
+        name = "%s%d" % (PREFIX, i)
+        addr = "10.%d.%d.%d" % ((i >> 16) & 255, (i >> 8) & 255, i & 255)
+        os.mkdir(os.path.join(d, "%s-(%d:%s)" % (addr, len(name), name)),
+                 0o700)
+
+
+def nfs_null(port, timeout):
+    """An NFSv3 NULL call over TCP, True once answered"""
+    call = struct.pack(">IIIIIIIIIII", 0x2b0b, 0, 2, 100003, 3, 0,
+                       0, 0, 0, 0, 0)
+    try:
+        sock = socket.create_connection(("127.0.0.1", port), timeout)
+        sock.settimeout(timeout)
+        sock.sendall(struct.pack(">I", 0x80000000 | len(call)) + call)
+        reply = sock.recv(28)
+        sock.close()
+    except (socket.error, socket.timeout):
+        return False
+    return len(reply) >= 12
+
+
+def run_once(opts, workdir):
+    log = os.path.join(workdir, "ganesha.log")
+    if os.path.exists(log):
+        os.unlink(log)
+    clear_records(opts.recov_root, False)
+    write_records(opts.recov_root, opts.clients)
+
+    start = time.time()
+    server = subprocess.Popen([opts.binary, "-F", "-L", log,
+                               "-f", os.path.join(workdir, "ganesha.conf"),
+                               "-p", os.path.join(workdir, "ganesha.pid")])
+    first = None
+    grace = None
+    deadline = start + opts.timeout
+    while time.time() < deadline and server.poll() is None:
+        if first is None and nfs_null(opts.port, 0.2):
+            first = (time.time() - start) * 1000
+        text = open(log).read() if os.path.exists(log) else ""
+        match = GRACE.search(text)
+        if first is not None and match:
+            grace = int(match.group(1))
+            break
+        time.sleep(0.05)
+
+    if server.poll() is None:
+        server.send_signal(signal.SIGTERM)
+        server.wait()
+    elif first is None:
+        sys.exit("ganesha.nfsd exited with %d, see %s"
+                 % (server.returncode, log))
+
+    text = open(log).read()
+    phases = [(m[0], int(m[1])) for m in PHASE.findall(text)]
+    served = FIRST.search(text)
+    return {"phases": phases,
+            "probe": first,
+            "served": int(served.group(1)) if served else None,
+            "grace": grace}
+
+
+def median(values):
+    values = sorted(v for v in values if v is not None)
+    if not values:
+        return None
+    return values[len(values) // 2]
+
+
+def show(label, value):
+    if value is None:
+        print("%-28s %10s" % (label, "-"))
+    else:
+        print("%-28s %10d ms" % (label, value))
+
+
+def main():
+    parser = OptionParser(usage="%prog [options]")
+    parser.add_option("--binary", default="ganesha.nfsd",
+                      help="server to start [%default]")
+    parser.add_option("--exports", type="int", default=1,
+                      help="FSAL_MEM exports [%default]")
+    parser.add_option("--clients", type="int", default=0,
+                      help="client records to recover [%default]")
+    parser.add_option("--netgroups", type="int", default=0,
+                      help="netgroups the exports check [%default]")
+    parser.add_option("--netgroup-prefix", default="bench",
+                      help="their names, PREFIXi [%default]")
+    parser.add_option("--grace", type="int", default=90,
+                      help="Grace_Period [%default]")
+    parser.add_option("--runs", type="int", default=5,
+                      help="starts to take the median over [%default]")
+    parser.add_option("--recov-root", default="/var/lib/nfs/ganesha",
+                      help="NFS_V4_RECOV_ROOT of the server [%default]")
+    parser.add_option("--port", type="int", default=2049,
+                      help="NFS port of the server [%default]")
+    parser.add_option("--timeout", type="int", default=300,
+                      help="seconds to wait for a run [%default]")
+    parser.add_option("--keep", action="store_true", default=False,
+                      help="keep the configuration and logs")
+    opts, args = parser.parse_args()
+    if args:
+        parser.error("no arguments expected")
+
+    clear_records(opts.recov_root, True)
+    workdir = tempfile.mkdtemp(prefix="ganesha_startup_bench.")
+    write_config(os.path.join(workdir, "ganesha.conf"), opts)
+
+    results = []
+    try:
+        for i in range(opts.runs):
+            results.append(run_once(opts, workdir))
+    finally:
+        clear_records(opts.recov_root, False)
+        if not opts.keep:
+            shutil.rmtree(workdir)
+
+    print("%d exports, %d clients, %d netgroups, %d runs"
+          % (opts.exports, opts.clients, opts.netgroups, opts.runs))
+    names = [name for name, _ in results[0]["phases"]]
+    for name in names:
+        show(name, median([dict(r["phases"]).get(name) for r in results]))
+    show("first reply (probe)", median([r["probe"] for r in results]))
+    show("first reply (server)", median([r["served"] for r in results]))
+    show("out of grace", median([r["grace"] for r in results]))
+    if opts.keep:
+        print("configuration and logs in %s" % workdir)
+
+
+if __name__ == "__main__":
+    main()
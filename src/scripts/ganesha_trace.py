@@ -0,0 +1,144 @@
+#!/usr/bin/python
+#
+# ganesha_trace.py - decode a dump of the ganesha trace rings
+#
+# Copyright (C) 2017 The nfs-ganesha contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Dumps are written by the trace_dump admin DBus method:
+#
+#   dbus-send --system --print-reply --dest=org.ganesha.nfsd \
+#       /org/ganesha/nfsd/admin org.ganesha.nfsd.admin.trace_dump \
+#       string:/tmp/trace
+#
+# or to Trace_Dump_Path.<pid> when the server crashes.  The layout is
+# described in src/support/gsh_trace.c.  The dump must be decoded on a
+# machine of the same byte order and word size as the server.
+#
+# Usage: ganesha_trace.py [--thread NAME] [--min-us N] dump
+#
+# Prints the events of all threads merged by time, oldest first.
+
+import struct
+import sys
+import time
+from optparse import OptionParser
+
+HDR = struct.Struct("=8sIIQQQII")
+RING = struct.Struct("=QII16s")
+REC = struct.Struct("=QQQII")
+SITE = struct.Struct("=QII")
+
+NFS4_OPS = {
+    3: "ACCESS", 4: "CLOSE", 5: "COMMIT", 6: "CREATE", 7: "DELEGPURGE",
+    8: "DELEGRETURN", 9: "GETATTR", 10: "GETFH", 11: "LINK", 12: "LOCK",
+    13: "LOCKT", 14: "LOCKU", 15: "LOOKUP", 16: "LOOKUPP", 17: "NVERIFY",
+    18: "OPEN", 19: "OPENATTR", 20: "OPEN_CONFIRM", 21: "OPEN_DOWNGRADE",
+    22: "PUTFH", 23: "PUTPUBFH", 24: "PUTROOTFH", 25: "READ",
+    26: "READDIR", 27: "READLINK", 28: "REMOVE", 29: "RENAME", 30: "RENEW",
+    31: "RESTOREFH", 32: "SAVEFH", 33: "SECINFO", 34: "SETATTR",
+    35: "SETCLIENTID", 36: "SETCLIENTID_CONFIRM", 37: "VERIFY",
+    38: "WRITE", 39: "RELEASE_LOCKOWNER", 40: "BACKCHANNEL_CTL",
+    41: "BIND_CONN_TO_SESSION", 42: "EXCHANGE_ID", 43: "CREATE_SESSION",
+    44: "DESTROY_SESSION", 45: "FREE_STATEID", 46: "GET_DIR_DELEGATION",
+    47: "GETDEVICEINFO", 48: "GETDEVICELIST", 49: "LAYOUTCOMMIT",
+    50: "LAYOUTGET", 51: "LAYOUTRETURN", 52: "SECINFO_NO_NAME",
+    53: "SEQUENCE", 54: "SET_SSV", 55: "TEST_STATEID", 56: "WANT_DELEGATION",
+    57: "DESTROY_CLIENTID", 58: "RECLAIM_COMPLETE", 59: "ALLOCATE",
+    60: "COPY", 61: "COPY_NOTIFY", 62: "DEALLOCATE", 63: "IO_ADVISE",
+    64: "LAYOUTERROR", 65: "LAYOUTSTATS", 66: "OFFLOAD_CANCEL",
+    67: "OFFLOAD_STATUS", 68: "READ_PLUS", 69: "SEEK",
+    70: "WRITE_SAME", 71: "CLONE",
+}
+
+PROGRAMS = {100003: "NFS", 100005: "MNT", 100021: "NLM", 100011: "RQUOTA"}
+
+
+def describe(event, arg, arg32):
+    if event == 1:
+        prog = arg >> 32
+        return "REQ_START xid=%d %s v%d proc=%d" % (
+            arg & 0xffffffff, PROGRAMS.get(prog, str(prog)),
+            arg32 >> 16, arg32 & 0xffff)
+    if event == 2:
+        return "REQ_DONE xid=%d %.1fus" % (arg32, arg / 1000.0)
+    if event == 3:
+        op = arg32 & 0xffff
+        return "NFS4_OP %s status=%d %.1fus" % (
+            NFS4_OPS.get(op, str(op)), arg32 >> 16, arg / 1000.0)
+    if event == 4:
+        return "FSAL_CALL line=%d %.1fus" % (arg32, arg / 1000.0)
+    if event == 5:
+        return "LOCK_WAIT line=%d %.1fus" % (arg32, arg / 1000.0)
+    if event == 6:
+        return "CACHE_MISS line=%d" % arg32
+    return "EVENT_%d arg=%d arg32=%d" % (event, arg, arg32)
+
+
+def timed(event):
+    return event in (2, 3, 4, 5)
+
+
+def read(f, st):
+    data = f.read(st.size)
+    if len(data) != st.size:
+        raise IOError("truncated dump")
+    return st.unpack(data)
+
+
+def main():
+    parser = OptionParser(usage="%prog [--thread NAME] [--min-us N] dump")
+    parser.add_option("--thread", help="only events of threads named NAME")
+    parser.add_option("--min-us", type="float", default=0,
+                      help="only timed events that took at least N us")
+    opts, args = parser.parse_args()
+    if len(args) != 1:
+        parser.error("a dump file is needed")
+
+    f = open(args[0], "rb")
+    magic, version, rec_size, ring_size, mono_ns, real_ns, nrings, _ = \
+        read(f, HDR)
+    if magic != b"GSHTRACE" or version != 1 or rec_size != REC.size:
+        sys.exit("%s is not a trace dump this script knows" % args[0])
+
+    events = []
+    for n in range(nrings):
+        count, tid, in_use, name = read(f, RING)
+        name = name.split(b"\0")[0].decode("ascii", "replace")
+        for i in range(min(count, ring_size)):
+            ts, site, arg, event, arg32 = read(f, REC)
+            events.append((ts, tid, name, site, event, arg, arg32))
+
+    sites = {}
+    (nsites,) = read(f, struct.Struct("=I"))
+    for n in range(nsites):
+        addr, length, _ = read(f, SITE)
+        sites[addr] = f.read(length).decode("ascii", "replace")
+
+    events.sort()
+    for ts, tid, name, site, event, arg, arg32 in events:
+        if opts.thread and name != opts.thread:
+            continue
+        if opts.min_us and (not timed(event) or arg < opts.min_us * 1000):
+            continue
+        wall = (real_ns - (mono_ns - ts)) / 1e9
+        print("%s.%06d %6d %-16s %-28s %s" % (
+            time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(wall)),
+            int(wall * 1e6) % 1000000, tid, name,
+            sites.get(site, hex(site)), describe(event, arg, arg32)))
+
+
+if __name__ == "__main__":
+    main()
@@ -225,6 +225,13 @@ class InodeStats():
         self.cache_conflict = stats[3][7]
         self.cache_add = stats[3][9]
         self.cache_mapping = stats[3][11]
+        self.mem_entries = stats[3][13]
+        self.mem_keys = stats[3][15]
+        self.mem_dirents = stats[3][17]
+        self.mem_acls = stats[3][19]
+        self.mem_budget = stats[3][21]
+        self.neg_hits = stats[3][23]
+        self.neg_added = stats[3][25]
     def __str__(self):
         if self.status != "OK":
             return "No NFS activity, GANESHA RESPONSE STATUS: " + self.status
@@ -234,7 +241,14 @@ class InodeStats():
                  "\nInode Cache Misses: " + str(self.cache_miss) +
                  "\nInode Cache Conflicts:: " + str(self.cache_conflict) +
                  "\nInode Cache Adds: " + str(self.cache_add) +
-                 "\nInode Cache Mapping: " + str(self.cache_mapping) )
+                 "\nInode Cache Mapping: " + str(self.cache_mapping) +
+                 "\nInode Cache Memory, entries: " + str(self.mem_entries) +
+                 "\nInode Cache Memory, handle keys: " + str(self.mem_keys) +
+                 "\nInode Cache Memory, dirents: " + str(self.mem_dirents) +
+                 "\nInode Cache Memory, ACLs: " + str(self.mem_acls) +
+                 "\nInode Cache Memory Budget: " + str(self.mem_budget) +
+                 "\nInode Cache Negative Hits: " + str(self.neg_hits) +
+                 "\nInode Cache Negative Adds: " + str(self.neg_added) )
 
 class FastStats():
     def __init__(self, stats):
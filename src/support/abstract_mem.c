@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file abstract_mem.c
+ * @brief List of the cached pools, their trimming, counters and arenas
+ *
+ * See abstract_mem.h.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "abstract_mem.h"
+#include "log.h"
+
+/** Size and alignment of an arena slab, that of a hugepage */
+#define POOL_SLAB_SIZE (2 * 1024 * 1024)
+
+/**
+ * @brief A hugepage of objects of one pool
+ *
+ * The slab starts with this header, so the slab of an object is found
+ * by rounding its address down.  Its lists and counters are only
+ * changed under the lock of its node.
+ */
+struct pool_slab {
+	struct glist_head list; /*< Entry in partial, full or empty */
+	struct pool_arena_node *node;
+	void *free; /*< Freed objects, chained through their first word */
+	char *next; /*< Objects never handed out start here */
+	uint32_t used;
+	bool huge; /*< On a reserved hugepage, not a transparent one */
+};
+
+/**
+ * @brief The slabs of an arena on one NUMA node
+ */
+struct pool_arena_node {
+	pthread_mutex_t lock;
+	struct glist_head partial; /*< Slabs with room and objects in use */
+	struct glist_head full;
+	struct glist_head empty; /*< Slabs with no object in use */
+	uint32_t nempty;
+	uint32_t idle; /*< Empty slabs through the whole last trim pass */
+	uint64_t slabs;
+	uint64_t huge_slabs;
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
+
+struct pool_arena {
+	size_t stride; /*< Object size rounded up, apart in the slab */
+	size_t first; /*< Offset of the first object */
+	uint32_t per_slab; /*< Objects a slab holds */
+	uint32_t nnodes;
+	struct pool_arena_node nodes[];
+};
+
+/** NUMA nodes of the system, from /sys */
+static uint32_t arena_nnodes;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static void pool_arena_trim(pool_t *pool);
+
+static pthread_mutex_t pools_mtx = PTHREAD_MUTEX_INITIALIZER;
+static GLIST_HEAD(pools);
+
+void pool_register(pool_t *pool)
+{
+	pthread_mutex_lock(&pools_mtx);
+	glist_add_tail(&pools, &pool->pools);
+	pthread_mutex_unlock(&pools_mtx);
+}
+
+void pool_unregister(pool_t *pool)
+{
+	pthread_mutex_lock(&pools_mtx);
+	glist_del(&pool->pools);
+	pthread_mutex_unlock(&pools_mtx);
+}
+
+/**
+ * @brief Give back the free objects a pool did not need lately
+ *
+ * On each CPU, as many objects as the list never went below since the
+ * last trim sat idle the whole time and are freed.
+ *
+ * @param[in] pool The pool
+ */
+void pool_trim(pool_t *pool)
+{
+	struct pool_cpu_cache *cc;
+	void *objects, *object;
+	uint32_t i, n;
+
+	for (i = 0; i < pool->ncpus; i++) {
+		cc = &pool->cpus[i];
+		objects = NULL;
+
+		pthread_mutex_lock(&cc->lock);
+		for (n = 0; n < cc->low && cc->head != NULL; n++) {
+			object = cc->head;
+			cc->head = *(void **) object;
+			*(void **) object = objects;
+			objects = object;
+		}
+		cc->count -= n;
+		cc->trimmed += n;
+		cc->low = cc->count;
+		pthread_mutex_unlock(&cc->lock);
+
+		while ((object = objects) != NULL) {
+			objects = *(void **) object;
+			pool_release(pool, object);
+		}
+	}
+
+	if (pool->arena != NULL)
+		pool_arena_trim(pool);
+}
+
+/**
+ * @brief Trim all the cached pools
+ *
+ * Called periodically, by the reaper.
+ */
+void pool_trim_all(void)
+{
+	struct glist_head *glist;
+
+	pthread_mutex_lock(&pools_mtx);
+	glist_for_each(glist, &pools)
+		pool_trim(glist_entry(glist, pool_t, pools));
+	pthread_mutex_unlock(&pools_mtx);
+}
+
+void pool_get_stats(pool_t *pool, struct pool_stats *stats)
+{
+	struct pool_cpu_cache *cc;
+	uint32_t i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i = 0; i < pool->ncpus; i++) {
+		cc = &pool->cpus[i];
+		pthread_mutex_lock(&cc->lock);
+		stats->allocs += cc->allocs;
+		stats->hits += cc->hits;
+		stats->frees += cc->frees;
+		stats->cached += cc->count;
+		stats->trimmed += cc->trimmed;
+		pthread_mutex_unlock(&cc->lock);
+	}
+
+	for (i = 0; pool->arena != NULL && i < pool->arena->nnodes; i++) {
+		struct pool_arena_node *an = &pool->arena->nodes[i];
+
+		pthread_mutex_lock(&an->lock);
+		stats->slabs += an->slabs;
+		stats->huge_slabs += an->huge_slabs;
+		pthread_mutex_unlock(&an->lock);
+	}
+}
+
+/**
+ * @brief Call @a cb on each cached pool
+ *
+ * The pools are not destroyed while @a cb runs.
+ */
+void pool_foreach(void (*cb)(pool_t *pool, void *arg), void *arg)
+{
+	struct glist_head *glist;
+
+	pthread_mutex_lock(&pools_mtx);
+	glist_for_each(glist, &pools)
+		cb(glist_entry(glist, pool_t, pools), arg);
+	pthread_mutex_unlock(&pools_mtx);
+}
+
+static void arena_count_nodes(void)
+{
+	DIR *dir = opendir("/sys/devices/system/node");
+	struct dirent *de;
+	unsigned int node;
+
+	arena_nnodes = 1;
+	if (dir == NULL)
+		return;
+
+	while ((de = readdir(dir)) != NULL) {
+		if (sscanf(de->d_name, "node%u", &node) == 1 &&
+		    node < 1024 && node >= arena_nnodes)
+			arena_nnodes = node + 1;
+	}
+	closedir(dir);
+}
+
+/**
+ * @brief Give a pool an arena of hugepage slabs
+ *
+ * Objects then come from 2MB slabs, kept apart for each NUMA node and
+ * handed out to the threads running on it, so the objects a thread
+ * allocates are on its node and a few hugepages cover many of them.  A
+ * slab is mapped on a reserved hugepage if there is one left, else on
+ * a transparent one.  The pages are placed on the node of the thread
+ * that first touches them, which is one allocating from the slab.
+ * Slabs left empty through a whole pass of pool_trim_all are unmapped.
+ *
+ * Must be called before any object is allocated from the pool.  Pools
+ * of objects too big for a slab stay on the heap.
+ *
+ * @param[in] pool The pool
+ */
+void pool_arena_init(pool_t *pool)
+{
+	struct pool_arena *arena;
+	size_t align, stride, first;
+	uint32_t i;
+
+	align = pool->object_size >= GSH_CACHE_LINE_SIZE ?
+		GSH_CACHE_LINE_SIZE : sizeof(void *);
+	stride = (pool->object_size + align - 1) & ~(align - 1);
+	first = (sizeof(struct pool_slab) + GSH_CACHE_LINE_SIZE - 1) &
+		~((size_t) GSH_CACHE_LINE_SIZE - 1);
+
+	if (pool->object_size < sizeof(void *) ||
+	    first + stride > POOL_SLAB_SIZE) {
+		LogWarn(COMPONENT_MEM_ALLOC,
+			"Objects of pool %s too big for an arena, left on the heap",
+			pool->name);
+		return;
+	}
+
+	pthread_once(&arena_once, arena_count_nodes);
+
+	arena = gsh_malloc_aligned(GSH_CACHE_LINE_SIZE,
+				   sizeof(*arena) +
+				   arena_nnodes * sizeof(arena->nodes[0]));
+	arena->stride = stride;
+	arena->first = first;
+	arena->per_slab = (POOL_SLAB_SIZE - first) / stride;
+	arena->nnodes = arena_nnodes;
+
+	for (i = 0; i < arena->nnodes; i++) {
+		struct pool_arena_node *an = &arena->nodes[i];
+
+		memset(an, 0, sizeof(*an));
+		pthread_mutex_init(&an->lock, NULL);
+		glist_init(&an->partial);
+		glist_init(&an->full);
+		glist_init(&an->empty);
+	}
+
+	pool->arena = arena;
+
+	LogInfo(COMPONENT_MEM_ALLOC,
+		"Pool %s in 2MB slabs of %"PRIu32" objects on %"PRIu32
+		" NUMA nodes",
+		pool->name, arena->per_slab, arena->nnodes);
+}
+
+/**
+ * @brief NUMA node of the calling thread, as an index into the arena
+ */
+static inline uint32_t arena_node(const struct pool_arena *arena)
+{
+#ifdef SYS_getcpu
+	unsigned int cpu, node;
+
+	if (arena->nnodes > 1 &&
+	    syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+		return node % arena->nnodes;
+#endif
+	return 0;
+}
+
+static void arena_unmap(struct pool_slab *slab)
+{
+	munmap(slab, POOL_SLAB_SIZE);
+}
+
+/**
+ * @brief Map a slab, on a reserved hugepage if possible
+ *
+ * Without one, twice the size is mapped to cut an aligned slab out of
+ * it, which is asked to be backed by a transparent hugepage.
+ */
+static struct pool_slab *arena_map(struct pool_arena *arena,
+				   struct pool_arena_node *an)
+{
+	struct pool_slab *slab = MAP_FAILED;
+	bool huge = true;
+	char *base;
+	size_t lead;
+
+#ifdef MAP_HUGETLB
+	slab = mmap(NULL, POOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+#ifdef MAP_HUGE_2MB
+		    | MAP_HUGE_2MB
+#endif
+		    , -1, 0);
+#endif
+	if (slab == MAP_FAILED) {
+		huge = false;
+		base = mmap(NULL, 2 * POOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base == MAP_FAILED) {
+			LogMallocFailure(__FILE__, __LINE__, __func__,
+					 "pool_arena_alloc");
+			abort();
+		}
+		lead = -(uintptr_t) base & (POOL_SLAB_SIZE - 1);
+		if (lead != 0)
+			munmap(base, lead);
+		munmap(base + lead + POOL_SLAB_SIZE, POOL_SLAB_SIZE - lead);
+		slab = (struct pool_slab *) (base + lead);
+#ifdef MADV_HUGEPAGE
+		(void) madvise(slab, POOL_SLAB_SIZE, MADV_HUGEPAGE);
+#endif
+	}
+
+	slab->node = an;
+	slab->free = NULL;
+	slab->next = (char *) slab + arena->first;
+	slab->used = 0;
+	slab->huge = huge;
+
+	return slab;
+}
+
+/**
+ * @brief Allocate a zeroed object from the arena of a pool
+ *
+ * Objects come from the slabs of the node of the calling thread that
+ * are partly used, and from empty ones only when there are none, so
+ * that slabs seldom used may empty.
+ *
+ * @param[in] pool The pool
+ *
+ * @return The object.
+ */
+void *pool_arena_alloc(pool_t *pool)
+{
+	struct pool_arena *arena = pool->arena;
+	struct pool_arena_node *an = &arena->nodes[arena_node(arena)];
+	struct pool_slab *slab;
+	void *object;
+
+	pthread_mutex_lock(&an->lock);
+	slab = glist_first_entry(&an->partial, struct pool_slab, list);
+
+	if (slab == NULL) {
+		slab = glist_first_entry(&an->empty, struct pool_slab, list);
+		if (slab != NULL) {
+			glist_del(&slab->list);
+			glist_add(&an->partial, &slab->list);
+			an->nempty--;
+			if (an->idle > an->nempty)
+				an->idle = an->nempty;
+		}
+	}
+
+	if (slab == NULL) {
+		/* Map outside the lock, it faults in 2MB */
+		pthread_mutex_unlock(&an->lock);
+		slab = arena_map(arena, an);
+		pthread_mutex_lock(&an->lock);
+		glist_add(&an->partial, &slab->list);
+		an->slabs++;
+		if (slab->huge)
+			an->huge_slabs++;
+	}
+
+	object = slab->free;
+	if (object != NULL) {
+		slab->free = *(void **) object;
+	} else {
+		object = slab->next;
+		slab->next += arena->stride;
+	}
+
+	if (++slab->used == arena->per_slab) {
+		glist_del(&slab->list);
+		glist_add(&an->full, &slab->list);
+	}
+	pthread_mutex_unlock(&an->lock);
+
+	memset(object, 0, pool->object_size);
+
+	return object;
+}
+
+/**
+ * @brief Give an object back to its slab
+ *
+ * The object goes back to the node it was allocated on, whichever
+ * thread frees it.
+ *
+ * @param[in] pool   The pool
+ * @param[in] object The object
+ */
+void pool_arena_free(pool_t *pool, void *object)
+{
+	struct pool_slab *slab = (struct pool_slab *)
+		((uintptr_t) object & ~((uintptr_t) POOL_SLAB_SIZE - 1));
+	struct pool_arena_node *an = slab->node;
+
+	pthread_mutex_lock(&an->lock);
+	*(void **) object = slab->free;
+	slab->free = object;
+	slab->used--;
+
+	if (slab->used == 0) {
+		glist_del(&slab->list);
+		glist_add(&an->empty, &slab->list);
+		an->nempty++;
+	} else if (slab->used == pool->arena->per_slab - 1) {
+		/* Nearly full, so first to hand out from */
+		glist_del(&slab->list);
+		glist_add(&an->partial, &slab->list);
+	}
+	pthread_mutex_unlock(&an->lock);
+}
+
+/**
+ * @brief Unmap the slabs that stayed empty since the last trim
+ *
+ * Slabs are taken from the head of the empty list, so those at its
+ * tail are the idle ones.
+ *
+ * @param[in] pool The pool
+ */
+static void pool_arena_trim(pool_t *pool)
+{
+	struct pool_arena *arena = pool->arena;
+	struct glist_head gone, *glist, *glistn;
+	struct pool_slab *slab;
+	uint32_t i, n;
+
+	for (i = 0; i < arena->nnodes; i++) {
+		struct pool_arena_node *an = &arena->nodes[i];
+
+		glist_init(&gone);
+
+		pthread_mutex_lock(&an->lock);
+		for (n = 0; n < an->idle; n++) {
+			slab = glist_entry(an->empty.prev, struct pool_slab,
+					   list);
+			glist_del(&slab->list);
+			glist_add(&gone, &slab->list);
+			an->slabs--;
+			if (slab->huge)
+				an->huge_slabs--;
+		}
+		an->nempty -= n;
+		an->idle = an->nempty;
+		pthread_mutex_unlock(&an->lock);
+
+		glist_for_each_safe(glist, glistn, &gone)
+			arena_unmap(glist_entry(glist, struct pool_slab, list));
+	}
+}
+
+/**
+ * @brief Unmap all the slabs of a pool, whose objects are all freed
+ *
+ * @param[in] pool The pool
+ */
+void pool_arena_destroy(pool_t *pool)
+{
+	struct pool_arena *arena = pool->arena;
+	struct glist_head *lists[3], *glist, *glistn;
+	uint32_t i, j;
+
+	for (i = 0; i < arena->nnodes; i++) {
+		struct pool_arena_node *an = &arena->nodes[i];
+
+		lists[0] = &an->partial;
+		lists[1] = &an->full;
+		lists[2] = &an->empty;
+		for (j = 0; j < 3; j++)
+			glist_for_each_safe(glist, glistn, lists[j])
+				arena_unmap(glist_entry(glist,
+							struct pool_slab,
+							list));
+		pthread_mutex_destroy(&an->lock);
+	}
+
+	gsh_free(arena);
+	pool->arena = NULL;
+}
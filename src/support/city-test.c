@@ -26,8 +26,10 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "city.h"
+#include "gsh_hash.h"
 #ifdef __SSE4_2__
 #include "citycrc.h"
 #endif
@@ -4398,6 +4400,133 @@ void Test(const uint64 *expected, int offset, int len)
 #endif
 }
 
+#if defined(__x86_64__)
+/* Bitwise CRC32C, what _mm_crc32_u64 computes */
+static uint64 crc32c_u64(uint64 crc, uint64 w)
+{
+	int i;
+
+	crc = (uint32) crc;
+	for (i = 0; i < 64; i++, w >>= 1)
+		crc = ((crc ^ w) & 1) ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+	return crc;
+}
+
+static uint64 Load64(const unsigned char *p)
+{
+	uint64 w = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		w |= (uint64) p[i] << (8 * i);
+	return w;
+}
+
+static uint64 Load32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint64) p[3] << 24;
+}
+
+/* gsh_hash64_crc32c() without the instruction, byte by byte */
+static uint64 RefHashCrc(const char *buf, size_t len, uint64 seed)
+{
+	const uint64 k1 = 0x9e3779b97f4a7c15ULL, k2 = 0xff51afd7ed558ccdULL;
+	const unsigned char *p = (const unsigned char *)buf;
+	uint64 h1 = (uint32) seed, h2 = seed >> 32, h3 = h1 ^ k1;
+	uint64 w0 = 0, w1 = 0, w2 = 0;
+	size_t n = len;
+
+	for (; n > 24; p += 24, n -= 24) {
+		h1 = crc32c_u64(h1, Load64(p));
+		h2 = crc32c_u64(h2, Load64(p + 8));
+		h3 = crc32c_u64(h3, Load64(p + 16));
+	}
+	if (n > 16) {
+		w0 = Load64(p);
+		w1 = Load64(p + 8);
+		w2 = Load64(p + n - 8);
+	} else if (n > 8) {
+		w0 = Load64(p);
+		w1 = Load64(p + n - 8);
+	} else if (len >= 8) {
+		w0 = Load64(p + n - 8);
+	} else if (n >= 4) {
+		w0 = Load32(p) | Load32(p + n - 4) << 32;
+	} else if (n > 0) {
+		w0 = p[0] | p[n / 2] << 8 | p[n - 1] << 16;
+	}
+	h1 = crc32c_u64(h1, w0);
+	h2 = crc32c_u64(h2, w1);
+	h3 = crc32c_u64(h3, w2);
+
+	w0 = ((h1 << 32 | h2) ^ len) * k2 + h3 * k1;
+	return w0 ^ w0 >> 32;
+}
+#endif
+
+/* Spread of 1M 32 byte handle-like keys, differing in a counter, over
+ * 127 buckets.  The chi-square should be about 126, give or take 16.
+ */
+double Chi2(uint64 (*hash)(const void *, size_t, uint64))
+{
+	static int bucket[127];
+	char key[32];
+	double expect = (1 << 20) / 127.0, chi2 = 0;
+	uint32 i;
+
+	memset(bucket, 0, sizeof(bucket));
+	memcpy(key, data, sizeof(key));
+	for (i = 0; i < 1 << 20; i++) {
+		memcpy(key + 8, &i, sizeof(i));
+		bucket[hash(key, sizeof(key), 557) % 127]++;
+	}
+	for (i = 0; i < 127; i++)
+		chi2 += (bucket[i] - expect) * (bucket[i] - expect) / expect;
+	return chi2;
+}
+
+double NsPerHash(uint64 (*hash)(const void *, size_t, uint64), int len)
+{
+	struct timespec t0, t1;
+	uint64 sum = 0;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < 1 << 22; i++)
+		sum += hash(data + (i & 4095), len, sum);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	data[0] ^= sum & 1;	/* keep the loop */
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + t1.tv_nsec - t0.tv_nsec)
+		/ (1 << 22);
+}
+
+void TestGshHash(void)
+{
+	static const int lens[] = { 8, 16, 28, 40, 64, 128 };
+	double chi2;
+	int i;
+
+#if defined(__x86_64__)
+	if (!strcmp(gsh_hash_impl(), "crc32c"))
+		for (i = 0; i < 300; i++)
+			Check(RefHashCrc(data + i * i, i, kSeed1),
+			      gsh_hash64(data + i * i, i, kSeed1));
+#endif
+
+	chi2 = Chi2(gsh_hash64_func);
+	printf("gsh_hash64 (%s): chi2 %.1f, city: chi2 %.1f\n",
+	       gsh_hash_impl(), chi2, Chi2(gsh_hash64_city));
+	if (chi2 > 2 * 127) {
+		fprintf(stderr, "ERROR: gsh_hash64 chi2 %.1f", chi2);
+		++errors;
+	}
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+		printf("%4d bytes: gsh_hash64 %.2f ns, city %.2f ns\n", lens[i],
+		       NsPerHash(gsh_hash64_func, lens[i]),
+		       NsPerHash(gsh_hash64_city, lens[i]));
+}
+
 int main(int argc, char **argv)
 {
 	setup(); int i;
@@ -4406,5 +4535,7 @@ int main(int argc, char **argv)
 
 	Test(testdata[i], 0, kDataSize);
 
+	TestGshHash();
+
 	return errors > 0;
 }
@@ -55,6 +55,7 @@
 #include "nfs_core.h"
 #include "log.h"
 #include "avltree.h"
+#include "city.h"
 #include "gsh_types.h"
 #ifdef USE_DBUS
 #include "gsh_dbus.h"
@@ -67,32 +68,77 @@
 #include "server_stats.h"
 #include "sal_functions.h"
 
-/* Clients are stored in an AVL tree
+/* Clients are stored in AVL trees, partitioned by a hash of their
+ * address so that lookups from many clients don't all serialize on
+ * one lock.  Each partition fronts its tree with a direct mapped
+ * cache, indexed by the same hash.
  */
 
+#define CLIENT_BY_IP_PARTITIONS 61
+#define CLIENT_BY_IP_CACHE_SZ 1021
+
 struct client_by_ip {
-	struct avltree t;
 	pthread_rwlock_t lock;
-	struct avltree_node **cache;
-	uint32_t cache_sz;
+	struct avltree t;
+	struct avltree_node *cache[CLIENT_BY_IP_CACHE_SZ];
 };
 
-static struct client_by_ip client_by_ip;
+static struct client_by_ip *client_by_ip;
 
 /**
- * @brief Compute cache slot for an entry
+ * @brief Find the partition and cache slot of an address
  *
- * This function computes a hash slot, taking an address modulo the
- * number of cache slotes (which should be prime).
+ * Set up the key of a lookup for the address and hash all of it, so
+ * that IPv6 clients sharing a prefix don't share a slot.
  *
- * @param wt [in] The table
- * @param ptr [in] Entry address
+ * @param[in]  client_ipaddr The sockaddr of the client
+ * @param[out] v             Key for the tree
+ * @param[out] slot          Cache slot in the partition
  *
- * @return The computed offset.
+ * @return The partition.
  */
-static inline uint32_t eip_cache_offsetof(struct client_by_ip *eid, uint32_t k)
+
+static struct client_by_ip *client_partition(sockaddr_t *client_ipaddr,
+					     struct gsh_client *v,
+					     void ***slot)
 {
-	return k % eid->cache_sz;
+	struct client_by_ip *part;
+	uint64_t hk;
+
+	switch (client_ipaddr->ss_family) {
+	case AF_INET:
+		v->addr.addr =
+		    (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
+		    sin_addr;
+		v->addr.len = 4;
+		break;
+	case AF_INET6:
+		v->addr.addr =
+		    (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
+		    sin6_addr;
+		v->addr.len = 16;
+		break;
+#ifdef RPC_VSOCK
+	case AF_VSOCK:
+	{
+		struct sockaddr_vm *svm; /* XXX checkpatch bs */
+
+		svm = (struct sockaddr_vm *)client_ipaddr;
+		v->addr.addr = (uint8_t *)&(svm->svm_cid);
+		v->addr.len = sizeof(svm->svm_cid);
+	}
+	break;
+#endif /* VSOCK */
+	default:
+		assert(0);
+	}
+
+	hk = CityHash64((char *)v->addr.addr, v->addr.len);
+	part = &client_by_ip[hk % CLIENT_BY_IP_PARTITIONS];
+	*slot = (void **)
+	    &part->cache[(hk / CLIENT_BY_IP_PARTITIONS) %
+			 CLIENT_BY_IP_CACHE_SZ];
+	return part;
 }
 
 /**
@@ -135,61 +181,24 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 	struct gsh_client *cl;
 	struct server_stats *server_st;
 	struct gsh_client v;
+	struct client_by_ip *part;
 	char hoststr[SOCK_NAME_MAX];
-	uint8_t *addr = NULL;
-	uint32_t ipaddr;
-	int addr_len = 0;
 	void **cache_slot;
 
-	switch (client_ipaddr->ss_family) {
-	case AF_INET:
-		addr =
-		    (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
-		    sin_addr;
-		addr_len = 4;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
-		       sin_addr, sizeof(ipaddr));
-		break;
-	case AF_INET6:
-		addr =
-		    (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
-		    sin6_addr;
-		addr_len = 16;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
-		       sin6_addr, sizeof(ipaddr));
-		break;
-#ifdef RPC_VSOCK
-	case AF_VSOCK:
-	{
-		struct sockaddr_vm *svm; /* XXX checkpatch bs */
+	part = client_partition(client_ipaddr, &v, &cache_slot);
 
-		svm = (struct sockaddr_vm *)client_ipaddr;
-		addr = (uint8_t *)&(svm->svm_cid);
-		addr_len = sizeof(svm->svm_cid);
-		ipaddr = svm->svm_cid;
-	}
-	break;
-#endif /* VSOCK */
-	default:
-		assert(0);
-	}
-	v.addr.addr = addr;
-	v.addr.len = addr_len;
-
-	PTHREAD_RWLOCK_rdlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_rdlock(&part->lock);
 
 	/* check cache */
-	cache_slot = (void **)
-	    &(client_by_ip.cache[eip_cache_offsetof(&client_by_ip, ipaddr)]);
 	node = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
 	if (node) {
 		if (client_ip_cmpf(&v.node_k, node) == 0) {
 			/* got it in 1 */
 			LogDebug(COMPONENT_HASHTABLE_CACHE,
-				 "client_mgr cache hit slot %d",
-				 eip_cache_offsetof(&client_by_ip, ipaddr));
+				 "client_mgr cache hit partition %d slot %d",
+				 (int)(part - client_by_ip),
+				 (int)((struct avltree_node **)cache_slot -
+				       part->cache));
 			cl = avltree_container_of(node, struct gsh_client,
 						  node_k);
 			goto out;
@@ -197,30 +206,31 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 	}
 
 	/* fall back to AVL */
-	node = avltree_lookup(&v.node_k, &client_by_ip.t);
+	node = avltree_lookup(&v.node_k, &part->t);
 	if (node) {
 		cl = avltree_container_of(node, struct gsh_client, node_k);
 		/* update cache */
 		atomic_store_voidptr(cache_slot, node);
 		goto out;
 	} else if (lookup_only) {
-		PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+		PTHREAD_RWLOCK_unlock(&part->lock);
 		return NULL;
 	}
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_unlock(&part->lock);
 
-	server_st = gsh_calloc(1, (sizeof(struct server_stats) + addr_len));
+	server_st = gsh_calloc(1, (sizeof(struct server_stats) +
+				   v.addr.len));
 
 	cl = &server_st->client;
-	memcpy(cl->addrbuf, addr, addr_len);
+	memcpy(cl->addrbuf, v.addr.addr, v.addr.len);
 	cl->addr.addr = cl->addrbuf;
-	cl->addr.len = addr_len;
+	cl->addr.len = v.addr.len;
 	cl->refcnt = 0;		/* we will hold a ref starting out... */
 	sprint_sockip(client_ipaddr, hoststr, SOCK_NAME_MAX);
 	cl->hostaddr_str = gsh_strdup(hoststr);
 
-	PTHREAD_RWLOCK_wrlock(&client_by_ip.lock);
-	node = avltree_insert(&cl->node_k, &client_by_ip.t);
+	PTHREAD_RWLOCK_wrlock(&part->lock);
+	node = avltree_insert(&cl->node_k, &part->t);
 	if (node) {
 		gsh_free(cl->hostaddr_str);
 		gsh_free(server_st);	/* somebody beat us to it */
@@ -231,7 +241,7 @@ struct gsh_client *get_gsh_client(sockaddr_t *client_ipaddr, bool lookup_only)
 
  out:
 	inc_gsh_client_refcount(cl);
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_unlock(&part->lock);
 	return cl;
 }
 
@@ -266,69 +276,29 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 	struct gsh_client *cl = NULL;
 	struct server_stats *server_st;
 	struct gsh_client v;
-	uint8_t *addr = NULL;
-	uint32_t ipaddr;
-	int addr_len = 0;
+	struct client_by_ip *part;
 	int removed = 0;
 	void **cache_slot;
 
-	switch (client_ipaddr->ss_family) {
-	case AF_INET:
-		addr =
-		    (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
-		    sin_addr;
-		addr_len = 4;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in *)client_ipaddr)->
-		       sin_addr, sizeof(ipaddr));
-		break;
-	case AF_INET6:
-		addr =
-		    (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
-		    sin6_addr;
-		addr_len = 16;
-		memcpy(&ipaddr,
-		       (uint8_t *) &((struct sockaddr_in6 *)client_ipaddr)->
-		       sin6_addr, sizeof(ipaddr));
-		break;
-#ifdef RPC_VSOCK
-	case AF_VSOCK:
-	{
-		struct sockaddr_vm *svm; /* XXX checkpatch horror */
-
-		svm = (struct sockaddr_vm *)client_ipaddr;
-		addr = (uint8_t *)&(svm->svm_cid);
-		addr_len = sizeof(svm->svm_cid);
-		ipaddr = svm->svm_cid;
-	}
-	break;
-#endif /* VSOCK */
-	default:
-		assert(0);
-	}
-	v.addr.addr = addr;
-	v.addr.len = addr_len;
+	part = client_partition(client_ipaddr, &v, &cache_slot);
 
-	PTHREAD_RWLOCK_wrlock(&client_by_ip.lock);
-	node = avltree_lookup(&v.node_k, &client_by_ip.t);
+	PTHREAD_RWLOCK_wrlock(&part->lock);
+	node = avltree_lookup(&v.node_k, &part->t);
 	if (node) {
 		cl = avltree_container_of(node, struct gsh_client, node_k);
 		if (atomic_fetch_int64_t(&cl->refcnt) > 0) {
 			removed = EBUSY;
 			goto out;
 		}
-		cache_slot = (void **)
-		    &(client_by_ip.
-		      cache[eip_cache_offsetof(&client_by_ip, ipaddr)]);
 		cnode = (struct avltree_node *)atomic_fetch_voidptr(cache_slot);
 		if (node == cnode)
 			atomic_store_voidptr(cache_slot, NULL);
-		avltree_remove(node, &client_by_ip.t);
+		avltree_remove(node, &part->t);
 	} else {
 		removed = ENOENT;
 	}
  out:
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+	PTHREAD_RWLOCK_unlock(&part->lock);
 	if (removed == 0) {
 		server_st = container_of(cl, struct server_stats, client);
 		server_stats_free(&server_st->st);
@@ -340,7 +310,11 @@ int remove_gsh_client(sockaddr_t *client_ipaddr)
 }
 
 /**
- * @ Walk the tree and do the callback on each node
+ * @ Walk the trees and do the callback on each node
+ *
+ * The clients of a partition are taken, with a reference, under its
+ * lock, and the callbacks run once it is released, so that a slow
+ * DBus reply doesn't hold up the lookups of requests.
  *
  * @param cb    [IN] Callback function
  * @param state [IN] param block to pass
@@ -350,19 +324,42 @@ int foreach_gsh_client(bool(*cb) (struct gsh_client *cl, void *state),
 		       void *state)
 {
 	struct avltree_node *client_node;
-	struct gsh_client *cl;
+	struct gsh_client **clients = NULL;
+	struct client_by_ip *part;
+	size_t count, size = 0, j;
+	bool more = true;
 	int cnt = 0;
-
-	PTHREAD_RWLOCK_rdlock(&client_by_ip.lock);
-	for (client_node = avltree_first(&client_by_ip.t); client_node != NULL;
-	     client_node = avltree_next(client_node)) {
-		cl = avltree_container_of(client_node, struct gsh_client,
-					  node_k);
-		if (!cb(cl, state))
-			break;
-		cnt++;
+	int i;
+
+	for (i = 0; i < CLIENT_BY_IP_PARTITIONS && more; i++) {
+		part = &client_by_ip[i];
+		count = 0;
+		PTHREAD_RWLOCK_rdlock(&part->lock);
+		for (client_node = avltree_first(&part->t);
+		     client_node != NULL;
+		     client_node = avltree_next(client_node)) {
+			if (count == size) {
+				size = size ? size * 2 : 64;
+				clients = gsh_realloc(clients,
+						      size * sizeof(*clients));
+			}
+			clients[count] = avltree_container_of(
+				client_node, struct gsh_client, node_k);
+			inc_gsh_client_refcount(clients[count]);
+			count++;
+		}
+		PTHREAD_RWLOCK_unlock(&part->lock);
+
+		for (j = 0; j < count; j++) {
+			if (more && cb(clients[j], state))
+				cnt++;
+			else
+				more = false;
+			put_gsh_client(clients[j]);
+		}
 	}
-	PTHREAD_RWLOCK_unlock(&client_by_ip.lock);
+
+	gsh_free(clients);
 	return cnt;
 }
 
@@ -976,6 +973,85 @@ static struct gsh_dbus_method cltmgr_show_9p_op_stats = {
 #endif
 
 
+/**
+ * DBUS method to report the op latency histograms of a client
+ *
+ */
+
+static bool get_op_latency(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = NULL;
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+		if (errormsg == NULL)
+			errormsg = "Client IP address not found";
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		server_st = container_of(client, struct server_stats, client);
+		server_dbus_op_latency(&server_st->st, &iter);
+		put_gsh_client(client);
+	}
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_show_op_latency = {
+	.name = "GetOpLatency",
+	.method = get_op_latency,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 OP_LATENCY_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to zero the op latency histograms of a client
+ *
+ */
+
+static bool reset_op_latency(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	struct gsh_client *client = NULL;
+	struct server_stats *server_st = NULL;
+	bool success = true;
+	char *errormsg = NULL;
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	client = lookup_client(args, &errormsg);
+	if (client == NULL) {
+		success = false;
+		if (errormsg == NULL)
+			errormsg = "Client IP address not found";
+	} else {
+		server_st = container_of(client, struct server_stats, client);
+		server_stats_reset_op_latency(&server_st->st);
+		put_gsh_client(client);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static struct gsh_dbus_method cltmgr_reset_op_latency = {
+	.name = "ResetOpLatency",
+	.method = reset_op_latency,
+	.args = {IPADDR_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_v3_io,
 	&cltmgr_show_v40_io,
@@ -987,6 +1063,8 @@ static struct gsh_dbus_method *cltmgr_stats_methods[] = {
 	&cltmgr_show_9p_trans,
 	&cltmgr_show_9p_op_stats,
 #endif
+	&cltmgr_show_op_latency,
+	&cltmgr_reset_op_latency,
 	NULL
 };
 
@@ -1020,6 +1098,7 @@ void dbus_client_init(void)
 void client_pkginit(void)
 {
 	pthread_rwlockattr_t rwlock_attr;
+	int i;
 
 	pthread_rwlockattr_init(&rwlock_attr);
 #ifdef GLIBC
@@ -1027,11 +1106,12 @@ void client_pkginit(void)
 		&rwlock_attr,
 		PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 #endif
-	PTHREAD_RWLOCK_init(&client_by_ip.lock, &rwlock_attr);
-	avltree_init(&client_by_ip.t, client_ip_cmpf, 0);
-	client_by_ip.cache_sz = 32767;
-	client_by_ip.cache =
-	    gsh_calloc(client_by_ip.cache_sz, sizeof(struct avltree_node *));
+	client_by_ip = gsh_calloc(CLIENT_BY_IP_PARTITIONS,
+				  sizeof(struct client_by_ip));
+	for (i = 0; i < CLIENT_BY_IP_PARTITIONS; i++) {
+		PTHREAD_RWLOCK_init(&client_by_ip[i].lock, &rwlock_attr);
+		avltree_init(&client_by_ip[i].t, client_ip_cmpf, 0);
+	}
 }
 
 /** @} */
@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file cpu_profile.c
+ * @brief SIGPROF stack sampler and allocation counters by operation
+ *
+ * See cpu_profile.h.  ITIMER_PROF sends SIGPROF to the thread that
+ * used up the interval of CPU.  The handler takes the next slot of a
+ * sample buffer, with no lock and no allocation, and fills it with the
+ * stack from backtrace() and the tag of the thread.  Once the buffer
+ * is full, samples are only counted as dropped.  Symbols are looked up
+ * when the profile is reported; static functions, which dladdr() does
+ * not know, are reported as object+0xaddress for addr2line.
+ *
+ * A sample buffer is freed at the second StartCpuProfile after it was
+ * replaced, a handler cannot still be filling it by then.
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <execinfo.h>
+#include <sys/time.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "cpu_profile.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Frames kept per sample */
+#define CPU_PROFILE_DEPTH 48
+/** The handler and the signal trampoline */
+#define CPU_PROFILE_SKIP 2
+#define CPU_PROFILE_CLIENT 48
+/** Slots of the allocation counters, a power of 2 */
+#define CPU_PROFILE_OPS 512
+#define CPU_PROFILE_LINE 8192
+
+extern __thread char thread_name[16];
+extern __thread char *clientip;
+
+__thread struct cpu_profile_tag cpu_profile_tag = {
+	.export_id = -1,
+};
+
+struct cpu_sample {
+	uint32_t ready;
+	uint16_t depth;
+	int32_t export_id;
+	const char *op;
+	char thread[16];
+	char client[CPU_PROFILE_CLIENT];
+	/* The interrupted pc, then return addresses less one, so each
+	 * falls within its call.
+	 */
+	void *pc[CPU_PROFILE_DEPTH];
+};
+
+struct cpu_profile_buf {
+	uint32_t size;
+	uint32_t next;
+	uint64_t dropped;
+	struct cpu_sample samples[];
+};
+
+/** Allocations of an operation, key is its name or 1 for none */
+struct cpu_profile_op {
+	uint64_t key;
+	uint64_t allocs;
+	uint64_t bytes;
+};
+
+static struct cpu_profile_op cpu_profile_ops[CPU_PROFILE_OPS];
+/* Not the PTHREAD_MUTEX_ macros, the lock profile may be built too */
+static pthread_mutex_t cpu_profile_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct cpu_profile_buf *cpu_profile_buf;
+static struct cpu_profile_buf *cpu_profile_retired;
+static bool cpu_profile_handler_set;
+
+/**
+ * @brief Add the allocations of the thread to its operation
+ */
+void cpu_profile_account(void)
+{
+	uint64_t key = cpu_profile_tag.op != NULL
+			? (uintptr_t) cpu_profile_tag.op : 1;
+	uint32_t i, h = (key >> 4 ^ key >> 12) & (CPU_PROFILE_OPS - 1);
+	struct cpu_profile_op *slot;
+	uint64_t k;
+
+	for (i = 0; i < CPU_PROFILE_OPS; i++) {
+		slot = &cpu_profile_ops[(h + i) & (CPU_PROFILE_OPS - 1)];
+		k = atomic_fetch_uint64_t(&slot->key);
+		if (k == 0 && atomic_cmpxchg_uint64_t(&slot->key, 0, key))
+			k = key;
+		else if (k == 0)
+			k = atomic_fetch_uint64_t(&slot->key);
+		if (k != key)
+			continue;
+
+		(void)atomic_add_uint64_t(&slot->allocs,
+					  cpu_profile_tag.allocs);
+		(void)atomic_add_uint64_t(&slot->bytes,
+					  cpu_profile_tag.alloc_bytes);
+		break;
+	}
+
+	cpu_profile_tag.allocs = 0;
+	cpu_profile_tag.alloc_bytes = 0;
+}
+
+static void cpu_profile_sigprof(int signo)
+{
+	struct cpu_profile_buf *buf;
+	struct cpu_sample *s;
+	void *pc[CPU_PROFILE_DEPTH + CPU_PROFILE_SKIP];
+	int saved_errno = errno;
+	int depth, i;
+	const char *client;
+
+	buf = atomic_fetch_voidptr((void **)&cpu_profile_buf);
+	if (buf == NULL)
+		goto out;
+
+	if (atomic_fetch_uint32_t(&buf->next) >= buf->size) {
+		(void)atomic_inc_uint64_t(&buf->dropped);
+		goto out;
+	}
+
+	i = atomic_postinc_uint32_t(&buf->next);
+	if (i >= buf->size) {
+		(void)atomic_inc_uint64_t(&buf->dropped);
+		goto out;
+	}
+
+	s = &buf->samples[i];
+	depth = backtrace(pc, CPU_PROFILE_DEPTH + CPU_PROFILE_SKIP) -
+		CPU_PROFILE_SKIP;
+	for (i = 0; i < depth; i++)
+		s->pc[i] = (char *)pc[i + CPU_PROFILE_SKIP] - (i != 0);
+	s->depth = depth > 0 ? depth : 0;
+	s->op = cpu_profile_tag.op;
+	s->export_id = cpu_profile_tag.export_id;
+	memcpy(s->thread, thread_name, sizeof(s->thread));
+	s->thread[sizeof(s->thread) - 1] = '\0';
+
+	client = clientip;
+	for (i = 0; client != NULL && client[i] != '\0' &&
+		    i < CPU_PROFILE_CLIENT - 1; i++)
+		s->client[i] = client[i];
+	s->client[i] = '\0';
+
+	atomic_store_uint32_t(&s->ready, 1);
+
+ out:
+	errno = saved_errno;
+}
+
+static void cpu_profile_timer(uint32_t hz)
+{
+	struct itimerval it;
+
+	memset(&it, 0, sizeof(it));
+	if (hz != 0) {
+		it.it_interval.tv_usec = 1000000 / hz;
+		it.it_value = it.it_interval;
+	}
+
+	(void)setitimer(ITIMER_PROF, &it, NULL);
+}
+
+/**
+ * @brief Start sampling, dropping the previous samples
+ *
+ * The allocation counters are zeroed too.
+ *
+ * @param[in] hz       Samples per second of CPU, 1 to 1000
+ * @param[in] samples  Room for that many samples
+ *
+ * @return 0 or an errno.
+ */
+int cpu_profile_start(uint32_t hz, uint32_t samples)
+{
+	struct cpu_profile_buf *buf;
+	struct sigaction act;
+	void *warm[1];
+	int i;
+
+	if (hz == 0 || hz > 1000 || samples == 0 || samples > 1 << 18)
+		return EINVAL;
+
+	buf = gsh_calloc(1, sizeof(*buf) + samples * sizeof(buf->samples[0]));
+	buf->size = samples;
+
+	/* The first backtrace() loads the unwinder, not in the handler */
+	(void)backtrace(warm, 1);
+
+	pthread_mutex_lock(&cpu_profile_mtx);
+
+	cpu_profile_timer(0);
+
+	if (!cpu_profile_handler_set) {
+		memset(&act, 0, sizeof(act));
+		act.sa_handler = cpu_profile_sigprof;
+		act.sa_flags = SA_RESTART;
+		sigemptyset(&act.sa_mask);
+		if (sigaction(SIGPROF, &act, NULL) != 0) {
+			i = errno;
+			pthread_mutex_unlock(&cpu_profile_mtx);
+			gsh_free(buf);
+			return i;
+		}
+		cpu_profile_handler_set = true;
+	}
+
+	gsh_free(cpu_profile_retired);
+	cpu_profile_retired = cpu_profile_buf;
+	atomic_store_voidptr((void **)&cpu_profile_buf, buf);
+
+	for (i = 0; i < CPU_PROFILE_OPS; i++) {
+		atomic_store_uint64_t(&cpu_profile_ops[i].allocs, 0);
+		atomic_store_uint64_t(&cpu_profile_ops[i].bytes, 0);
+	}
+
+	cpu_profile_timer(hz);
+
+	pthread_mutex_unlock(&cpu_profile_mtx);
+
+	LogEvent(COMPONENT_DBUS,
+		 "CPU profile started, %" PRIu32 " Hz, room for %" PRIu32
+		 " samples", hz, samples);
+
+	return 0;
+}
+
+/**
+ * @brief Stop sampling, the samples stay for GetCpuProfile
+ */
+void cpu_profile_stop(void)
+{
+	pthread_mutex_lock(&cpu_profile_mtx);
+	cpu_profile_timer(0);
+	pthread_mutex_unlock(&cpu_profile_mtx);
+}
+
+#ifdef USE_DBUS
+static int cpu_profile_pc_cmp(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t) *(void * const *)a;
+	uintptr_t y = (uintptr_t) *(void * const *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int cpu_profile_str_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * @brief Name a frame
+ *
+ * @return A new string, the symbol or object+0xaddress.
+ */
+static char *cpu_profile_symbol(void *pc)
+{
+	struct link_map *map = NULL;
+	const char *obj;
+	char name[256];
+	Dl_info info;
+
+	if (dladdr1(pc, &info, (void **)&map, RTLD_DL_LINKMAP) == 0) {
+		(void)snprintf(name, sizeof(name), "0x%" PRIxPTR,
+			       (uintptr_t) pc);
+		return gsh_strdup(name);
+	}
+
+	if (info.dli_sname != NULL)
+		return gsh_strdup(info.dli_sname);
+
+	obj = info.dli_fname != NULL ? strrchr(info.dli_fname, '/') : NULL;
+	obj = obj != NULL ? obj + 1 : info.dli_fname;
+	if (obj == NULL || *obj == '\0')
+		obj = program_invocation_short_name;
+
+	/* The address in the object file, as addr2line wants it */
+	(void)snprintf(name, sizeof(name), "%s+0x%" PRIxPTR, obj,
+		       (uintptr_t) pc - (map != NULL ? map->l_addr : 0));
+	return gsh_strdup(name);
+}
+
+static size_t cpu_profile_put(char *line, size_t len, const char *frame)
+{
+	size_t n = strlen(frame);
+
+	if (len + n + 2 > CPU_PROFILE_LINE)
+		return len;
+
+	if (len != 0)
+		line[len++] = ';';
+	memcpy(line + len, frame, n + 1);
+	return len + n;
+}
+
+/**
+ * @brief Collapsed stack of a sample
+ *
+ * The operation, or the thread name less its number, then the export
+ * and client if asked, then the frames from the outermost one.
+ */
+static char *cpu_profile_collapse(struct cpu_sample *s, void **pcs,
+				  char **names, size_t npcs, char *line,
+				  bool by_export, bool by_client)
+{
+	char root[32];
+	size_t len = 0;
+	void **found;
+	int i;
+
+	if (s->op != NULL) {
+		len = cpu_profile_put(line, len, s->op);
+	} else {
+		i = strlen(s->thread);
+		while (i > 0 && (s->thread[i - 1] == '-' ||
+				 s->thread[i - 1] == '_' ||
+				 (s->thread[i - 1] >= '0' &&
+				  s->thread[i - 1] <= '9')))
+			i--;
+		(void)snprintf(root, sizeof(root), "[%.*s]", i, s->thread);
+		len = cpu_profile_put(line, len, root);
+	}
+
+	if (by_export) {
+		(void)snprintf(root, sizeof(root), "export_%" PRIi32,
+			       s->export_id);
+		len = cpu_profile_put(line, len, root);
+	}
+
+	if (by_client)
+		len = cpu_profile_put(line, len,
+				      s->client[0] != '\0'
+					? s->client : "no_client");
+
+	for (i = s->depth - 1; i >= 0; i--) {
+		found = bsearch(&s->pc[i], pcs, npcs, sizeof(*pcs),
+				cpu_profile_pc_cmp);
+		len = cpu_profile_put(line, len, names[found - pcs]);
+	}
+
+	return gsh_strdup(line);
+}
+
+static void cpu_profile_dbus_stacks(DBusMessageIter *iter,
+				    struct cpu_profile_buf *buf,
+				    bool by_export, bool by_client)
+{
+	uint32_t n = 0, nready = 0, nlines, i, j;
+	size_t npcs = 0;
+	DBusMessageIter array_iter, struct_iter;
+	char **names, **lines, *line;
+	struct cpu_sample **ready;
+	void **pcs;
+	uint64_t count;
+
+	if (buf != NULL)
+		n = MIN(atomic_fetch_uint32_t(&buf->next), buf->size);
+
+	/* The samples complete by now, and each of their pcs to look up
+	 * once.
+	 */
+	ready = gsh_malloc((n + 1) * sizeof(*ready));
+	pcs = gsh_malloc(((size_t) n * CPU_PROFILE_DEPTH + 1) * sizeof(*pcs));
+	for (i = 0; i < n; i++) {
+		if (!atomic_fetch_uint32_t(&buf->samples[i].ready))
+			continue;
+		ready[nready++] = &buf->samples[i];
+		for (j = 0; j < buf->samples[i].depth; j++)
+			pcs[npcs++] = buf->samples[i].pc[j];
+	}
+	qsort(pcs, npcs, sizeof(*pcs), cpu_profile_pc_cmp);
+	for (i = 0, j = 0; i < npcs; i++)
+		if (j == 0 || pcs[i] != pcs[j - 1])
+			pcs[j++] = pcs[i];
+	npcs = j;
+	names = gsh_calloc(npcs + 1, sizeof(*names));
+	for (i = 0; i < npcs; i++)
+		names[i] = cpu_profile_symbol(pcs[i]);
+
+	line = gsh_malloc(CPU_PROFILE_LINE);
+	lines = gsh_malloc((nready + 1) * sizeof(*lines));
+	for (nlines = 0; nlines < nready; nlines++)
+		lines[nlines] = cpu_profile_collapse(ready[nlines], pcs, names,
+						     npcs, line, by_export,
+						     by_client);
+	qsort(lines, nlines, sizeof(*lines), cpu_profile_str_cmp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(st)",
+					 &array_iter);
+	for (i = 0; i < nlines; i = j) {
+		for (j = i + 1; j < nlines; j++)
+			if (strcmp(lines[i], lines[j]) != 0)
+				break;
+		count = j - i;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &lines[i]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &count);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	for (i = 0; i < nlines; i++)
+		gsh_free(lines[i]);
+	for (i = 0; i < npcs; i++)
+		gsh_free(names[i]);
+	gsh_free(lines);
+	gsh_free(line);
+	gsh_free(names);
+	gsh_free(pcs);
+	gsh_free(ready);
+}
+
+/**
+ * @brief Report the profile
+ *
+ * The samples taken and dropped, the collapsed stacks with their
+ * counts, then for each operation the allocations and bytes
+ * allocated.
+ *
+ * @param[in] iter       Reply
+ * @param[in] by_export  Put the export under the operation
+ * @param[in] by_client  Then the client
+ */
+void cpu_profile_dbus(DBusMessageIter *iter, bool by_export, bool by_client)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct cpu_profile_buf *buf;
+	struct timespec timestamp;
+	uint64_t taken = 0, dropped = 0, allocs, bytes, key;
+	const char *op;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	pthread_mutex_lock(&cpu_profile_mtx);
+
+	buf = cpu_profile_buf;
+	if (buf != NULL) {
+		taken = MIN(atomic_fetch_uint32_t(&buf->next), buf->size);
+		dropped = atomic_fetch_uint64_t(&buf->dropped);
+	}
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT64, &taken);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT64, &dropped);
+
+	cpu_profile_dbus_stacks(iter, buf, by_export, by_client);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(stt)",
+					 &array_iter);
+	for (i = 0; i < CPU_PROFILE_OPS; i++) {
+		key = atomic_fetch_uint64_t(&cpu_profile_ops[i].key);
+		allocs = atomic_fetch_uint64_t(&cpu_profile_ops[i].allocs);
+		bytes = atomic_fetch_uint64_t(&cpu_profile_ops[i].bytes);
+		if (key == 0 || allocs == 0)
+			continue;
+		op = key == 1 ? "no_op" : (const char *)(uintptr_t) key;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &op);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &allocs);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	pthread_mutex_unlock(&cpu_profile_mtx);
+}
+#endif
@@ -33,10 +33,20 @@
  * @file delayed_exec.c
  * @author Adam C. Emerson <aemerson@linuxbox.com>
  * @brief Implementation of the delayed execution system
+ *
+ * Each wheel has DELAYED_LEVELS levels of DELAYED_SLOTS slots.  A
+ * timer due within DELAYED_SLOTS ticks sits in the slot of its tick on
+ * level 0, one due later on the first level whose slots span its
+ * delay, and moves down a level each time the level below wraps around
+ * to its slot.  A bitmap of the slots in use per level finds the next
+ * thing to do without walking the slots.  Timers further out than
+ * the top level reaches are parked at its end and placed again.
  */
 
 #include "config.h"
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #ifdef LINUX
 #include <sys/signal.h>
 #elif FREEBSD
@@ -45,55 +55,33 @@
 #include "abstract_mem.h"
 #include "delayed_exec.h"
 #include "log.h"
-#include "avltree.h"
-#include "misc/queue.h"
 #include "gsh_intrinsic.h"
 #include "common_utils.h"
 
-/**
- * @brief A list of tasks
- */
-
-LIST_HEAD(delayed_tasklist, delayed_task);
-
-/**
- * @brief All tasks executing at a given time.
- */
-
-struct delayed_multi {
-	struct timespec realtime;	/*< A wallclock time at which to
-					   perform the given task. */
-	struct delayed_tasklist list;	/*< The linked list of tasks to
-					   perform. */
-	struct avltree_node node;	/*< Our node in the tree */
-};
-
-/**
- * @brief An individual delayed task
- */
-
-struct delayed_task {
-	/** Function for delayed task */
-	void (*func)(void *);
-	/** Argument for delayed task */
-	void *arg;
-	/** Link in the task list. */
-	LIST_ENTRY(delayed_task) link;
-};
-
-/**
- * @brief A list of threads
- */
-
-LIST_HEAD(delayed_threadlist, delayed_thread);
+#define DELAYED_SLOT_BITS 6
+#define DELAYED_SLOTS (1 << DELAYED_SLOT_BITS)
+#define DELAYED_SLOT_MASK (DELAYED_SLOTS - 1)
+#define DELAYED_LEVELS 4
+/** Ticks the top level reaches, about 4.9 hours */
+#define DELAYED_SPAN (UINT64_C(1) << (DELAYED_SLOT_BITS * DELAYED_LEVELS))
+#define DELAYED_MAX_WHEELS 64
 
 /**
- * @brief An individual executor thread
+ * @brief A timing wheel and its executor
  */
 
-struct delayed_thread {
-	pthread_t id;		/*< Thread id */
-	 LIST_ENTRY(delayed_thread) link;	/*< Link in the thread list. */
+struct delayed_wheel {
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;		/*< On CLOCK_MONOTONIC */
+	pthread_t id;
+	uint64_t tick;			/*< Next tick to run, the slots
+					    of the ticks before are run and
+					    those of this one moved down */
+	uint64_t sleep_until;		/*< Tick the executor waits for,
+					    0 while it runs */
+	uint64_t used[DELAYED_LEVELS];	/*< Slots that hold timers */
+	struct glist_head slot[DELAYED_LEVELS][DELAYED_SLOTS];
+	GSH_CACHE_PAD(0);
 };
 
 /**
@@ -101,14 +89,14 @@ struct delayed_thread {
  * Delayed execution state.
  */
 
-/** list of all threads */
-static struct delayed_threadlist thread_list;
-/** Mutex for delayed execution */
+static struct delayed_wheel *wheels;
+static uint32_t nwheels;
+/** Executor threads still running */
+static uint32_t nthreads;
+/** Mutex for nthreads */
 static pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-/** Condition variable for delayed execution */
+/** Condition variable for the last thread leaving */
 static pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
-/** The timer tree */
-static struct avltree tree;
 
 /**
  * @brief Posssible states for the delayed executor
@@ -121,87 +109,167 @@ enum delayed_state {
 /** State for the executor */
 static enum delayed_state delayed_state;
 
-enum delayed_employment {
-	delayed_employed,	/*< Work is available, do it. */
-	delayed_on_break,	/*< Work is available, but wait for it */
-	delayed_unemployed	/*< No work is available, wait indefinitely */
-};
-
 /** @} */
 
-static int comparator(const struct avltree_node *a,
-		      const struct avltree_node *b)
+static inline uint64_t delayed_clock(void)
 {
-	struct delayed_multi *p =
-	    avltree_container_of(a, struct delayed_multi, node);
-	struct delayed_multi *q =
-	    avltree_container_of(b, struct delayed_multi, node);
+	struct timespec ts;
 
-	return gsh_time_cmp(&p->realtime, &q->realtime);
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec_to_nsecs(&ts);
 }
 
 /**
- * @brief Get a task to perform
+ * @brief Link a timer in the slot for its expiry
  *
- * This function must be called with the mutex held.
- *
- * @param[out] when The time for which to wait, if there is one
- * @param[out] func The function to execute, if there is one
- * @param[out] arg  The argument to supply, if there is one
+ * Called with the wheel's mutex held.
+ */
+
+static void wheel_place(struct delayed_wheel *w, struct delayed_timer *t)
+{
+	uint64_t expires = t->expires;
+	uint64_t delta;
+	unsigned int level, slot;
+
+	if ((int64_t)(expires - w->tick) < 0)
+		expires = w->tick;
+	else if (expires - w->tick >= DELAYED_SPAN)
+		expires = w->tick + DELAYED_SPAN - 1;
+
+	delta = expires - w->tick;
+	for (level = 0; level < DELAYED_LEVELS - 1; level++)
+		if (delta < UINT64_C(1) << (DELAYED_SLOT_BITS * (level + 1)))
+			break;
+
+	slot = (expires >> (DELAYED_SLOT_BITS * level)) & DELAYED_SLOT_MASK;
+	glist_add_tail(&w->slot[level][slot], &t->link);
+	w->used[level] |= UINT64_C(1) << slot;
+	t->slot = level * DELAYED_SLOTS + slot;
+	t->wheel = w;
+}
+
+/**
+ * @brief Unlink a timer from its slot
  *
- * @retval delayed_employed if there is a task to perform now.  Its
- *         argument and function are stored in @c arg and @c func.
- * @retval delayed_on_break if there is work but it is not to be
- *         performed yet.  The time at which it is to be performed is
- *         set in *when.
- * @retval delayed_unemployed if there is no work at all.  The caller
- *         should wait indefinitely to be signalled.
+ * Called with the wheel's mutex held, t->wheel is left to the caller.
  */
 
-static enum delayed_employment delayed_get_work(struct timespec *when,
-						void (**func) (void *),
-						void **arg)
+static void wheel_unlink(struct delayed_wheel *w, struct delayed_timer *t)
 {
-	struct avltree_node *first = avltree_first(&tree);
-	struct delayed_multi *mul;
-	struct timespec current;
-	struct delayed_task *task;
+	unsigned int level = t->slot / DELAYED_SLOTS;
+	unsigned int slot = t->slot % DELAYED_SLOTS;
 
-	if (first == NULL)
-		return delayed_unemployed;
+	glist_del(&t->link);
+	if (glist_empty(&w->slot[level][slot]))
+		w->used[level] &= ~(UINT64_C(1) << slot);
+}
 
-	now(&current);
-	mul = avltree_container_of(first, struct delayed_multi, node);
+static void wheel_remove(struct delayed_wheel *w, struct delayed_timer *t)
+{
+	wheel_unlink(w, t);
+	atomic_store_voidptr((void **)&t->wheel, NULL);
+}
 
-	if (gsh_time_cmp(&mul->realtime, &current) > 0) {
-		*when = mul->realtime;
-		return delayed_on_break;
-	}
+/**
+ * @brief Rotate a bitmap of slots to start at a slot
+ */
+
+static inline uint64_t slots_from(uint64_t used, unsigned int slot)
+{
+	return slot ? used >> slot | used << (DELAYED_SLOTS - slot) : used;
+}
+
+/**
+ * @brief First tick from w->tick at which there is something to do
+ *
+ * Running a slot of level 0, or moving a slot of a higher level down.
+ *
+ * @return The tick, UINT64_MAX if the wheel is empty.
+ */
+
+static uint64_t wheel_next(struct delayed_wheel *w)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int level;
+
+	for (level = 0; level < DELAYED_LEVELS; level++) {
+		unsigned int shift = DELAYED_SLOT_BITS * level;
+		uint64_t base = w->tick >> shift;
+		unsigned int cur = base & DELAYED_SLOT_MASK;
+		uint64_t used = w->used[level], at;
+		unsigned int k;
+
+		if (used == 0)
+			continue;
+
+		/* Slots in the order the wheel reaches them */
+		if (level == 0) {
+			k = __builtin_ctzll(slots_from(used, cur));
+		} else {
+			/* This level's current slot was moved down on
+			   entering it, what is there now goes around */
+			cur = (cur + 1) & DELAYED_SLOT_MASK;
+			k = __builtin_ctzll(slots_from(used, cur)) + 1;
+		}
 
-	task = LIST_FIRST(&mul->list);
-	*func = task->func;
-	*arg = task->arg;
-	LIST_REMOVE(task, link);
-	gsh_free(task);
-	if (LIST_EMPTY(&mul->list)) {
-		avltree_remove(first, &tree);
-		gsh_free(mul);
+		at = level == 0 ? w->tick + k : (base + k) << shift;
+		if (at < next)
+			next = at;
 	}
 
-	return delayed_employed;
+	return next;
+}
+
+/**
+ * @brief Move the wheel to a tick, moving down the slots it enters
+ *
+ * Nothing may be waiting on the ticks skipped.
+ */
+
+static void wheel_advance(struct delayed_wheel *w, uint64_t tick)
+{
+	unsigned int level;
+
+	w->tick = tick;
+
+	for (level = 1; level < DELAYED_LEVELS; level++) {
+		unsigned int shift = DELAYED_SLOT_BITS * level;
+		unsigned int slot = (tick >> shift) & DELAYED_SLOT_MASK;
+		struct glist_head *head = &w->slot[level][slot];
+		struct glist_head moved;
+
+		if (tick & ((UINT64_C(1) << shift) - 1))
+			break;
+
+		if (glist_empty(head))
+			continue;
+
+		glist_init(&moved);
+		glist_splice_tail(&moved, head);
+		w->used[level] &= ~(UINT64_C(1) << slot);
+
+		while (!glist_empty(&moved)) {
+			struct delayed_timer *t =
+			    glist_first_entry(&moved, struct delayed_timer,
+					      link);
+
+			glist_del(&t->link);
+			wheel_place(w, t);
+		}
+	}
 }
 
 /**
  * @brief Thread function to execute delayed tasks
  *
- * @param[in] arg The thread entry (cast to void)
+ * @param[in] arg The wheel (cast to void)
  *
  * @return NULL, always and forever.
  */
 
 void *delayed_thread(void *arg)
 {
-	struct delayed_thread *thr = arg;
+	struct delayed_wheel *w = arg;
 	int old_type = 0;
 	int old_state = 0;
 	sigset_t old_sigmask;
@@ -218,34 +286,62 @@ void *delayed_thread(void *arg)
 
 	pthread_sigmask(SIG_SETMASK, NULL, &old_sigmask);
 
-	PTHREAD_MUTEX_lock(&mtx);
+	PTHREAD_MUTEX_lock(&w->mtx);
 	while (delayed_state == delayed_running) {
-		struct timespec then;
-		void (*func)(void *);
-		void *arg;
+		uint64_t cur = delayed_clock() >> DELAYED_TICK_SHIFT;
+		unsigned int slot = w->tick & DELAYED_SLOT_MASK;
+		struct delayed_timer *t;
+		uint64_t next;
+		bool autofree;
+
+		if (w->tick <= cur && !glist_empty(&w->slot[0][slot])) {
+			t = glist_first_entry(&w->slot[0][slot],
+					      struct delayed_timer, link);
+			if (t->expires > w->tick) {
+				/* Parked at the end of the top level */
+				wheel_unlink(w, t);
+				wheel_place(w, t);
+				continue;
+			}
+			wheel_remove(w, t);
+			autofree = t->autofree;
+			PTHREAD_MUTEX_unlock(&w->mtx);
+			/* The callback may free its timer */
+			t->func(t->arg);
+			if (autofree)
+				gsh_free(t);
+			PTHREAD_MUTEX_lock(&w->mtx);
+			continue;
+		}
 
-		switch (delayed_get_work(&then, &func, &arg)) {
-		case delayed_unemployed:
-			pthread_cond_wait(&cv, &mtx);
-			break;
+		next = wheel_next(w);
+		if (next <= cur) {
+			wheel_advance(w, next);
+			continue;
+		}
 
-		case delayed_on_break:
-			pthread_cond_timedwait(&cv, &mtx, &then);
-			break;
+		/* Nothing is due before next, so new timers can be placed
+		   from now on */
+		wheel_advance(w, cur);
 
-		case delayed_employed:
-			PTHREAD_MUTEX_unlock(&mtx);
-			func(arg);
-			PTHREAD_MUTEX_lock(&mtx);
-			break;
+		if (next == UINT64_MAX) {
+			w->sleep_until = UINT64_MAX;
+			pthread_cond_wait(&w->cv, &w->mtx);
+		} else {
+			struct timespec then;
+
+			nsecs_to_timespec(next << DELAYED_TICK_SHIFT, &then);
+			w->sleep_until = next;
+			pthread_cond_timedwait(&w->cv, &w->mtx, &then);
 		}
+		w->sleep_until = 0;
 	}
-	LIST_REMOVE(thr, link);
-	if (LIST_EMPTY(&thread_list))
-		pthread_cond_broadcast(&cv);
+	PTHREAD_MUTEX_unlock(&w->mtx);
 
+	PTHREAD_MUTEX_lock(&mtx);
+	if (--nthreads == 0)
+		pthread_cond_broadcast(&cv);
 	PTHREAD_MUTEX_unlock(&mtx);
-	gsh_free(thr);
 
 	return NULL;
 }
@@ -256,20 +352,17 @@ void *delayed_thread(void *arg)
 
 void delayed_start(void)
 {
-	/* Make this a parameter later */
-	const size_t threads_to_start = 1;
+	long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	uint64_t tick = delayed_clock() >> DELAYED_TICK_SHIFT;
 	/* Thread attributes */
 	pthread_attr_t attr;
-	/* Thread index */
-	int i;
-
-	LIST_INIT(&thread_list);
-	avltree_init(&tree, comparator, 0);
+	pthread_condattr_t cattr;
+	/* Wheel index */
+	int i, j, k;
 
-	if (threads_to_start == 0) {
-		LogFatal(COMPONENT_THREAD,
-			 "You can't execute tasks with zero threads.");
-	}
+	nwheels = ncpus < 1 ? 1 : ncpus > DELAYED_MAX_WHEELS
+				  ? DELAYED_MAX_WHEELS : ncpus;
+	wheels = gsh_calloc(nwheels, sizeof(struct delayed_wheel));
 
 	if (pthread_attr_init(&attr) != 0)
 		LogFatal(COMPONENT_THREAD, "can't init pthread's attributes");
@@ -277,56 +370,168 @@ void delayed_start(void)
 	if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) != 0)
 		LogFatal(COMPONENT_THREAD, "can't set pthread's join state");
 
+	if (pthread_condattr_init(&cattr) != 0 ||
+	    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC) != 0)
+		LogFatal(COMPONENT_THREAD, "can't set condition's clock");
+
 	PTHREAD_MUTEX_lock(&mtx);
 	delayed_state = delayed_running;
 
-	for (i = 0; i < threads_to_start; ++i) {
-		struct delayed_thread *thread =
-		    gsh_malloc(sizeof(struct delayed_thread));
+	for (i = 0; i < nwheels; ++i) {
+		struct delayed_wheel *w = &wheels[i];
 		int rc = 0;
 
-		rc = pthread_create(&thread->id, &attr, delayed_thread, thread);
+		PTHREAD_MUTEX_init(&w->mtx, NULL);
+		pthread_cond_init(&w->cv, &cattr);
+		w->tick = tick;
+		for (j = 0; j < DELAYED_LEVELS; j++)
+			for (k = 0; k < DELAYED_SLOTS; k++)
+				glist_init(&w->slot[j][k]);
+
+		rc = pthread_create(&w->id, &attr, delayed_thread, w);
 		if (rc != 0) {
 			LogFatal(COMPONENT_THREAD,
 				 "Unable to start delayed executor: %d", rc);
 		}
-		LIST_INSERT_HEAD(&thread_list, thread, link);
+		nthreads++;
 	}
 	PTHREAD_MUTEX_unlock(&mtx);
+
+	pthread_condattr_destroy(&cattr);
+	pthread_attr_destroy(&attr);
 }
 
 /**
  * @brief Shut down the delayed executor
+ *
+ * Timers still armed are not run.
  */
 
 void delayed_shutdown(void)
 {
 	int rc = -1;
 	struct timespec then;
+	int i;
 
 	now(&then);
 	then.tv_sec += 120;
 
 	PTHREAD_MUTEX_lock(&mtx);
 	delayed_state = delayed_stopping;
-	pthread_cond_broadcast(&cv);
-	while ((rc != ETIMEDOUT) && !LIST_EMPTY(&thread_list))
+	for (i = 0; i < nwheels; i++) {
+		PTHREAD_MUTEX_lock(&wheels[i].mtx);
+		pthread_cond_broadcast(&wheels[i].cv);
+		PTHREAD_MUTEX_unlock(&wheels[i].mtx);
+	}
+	while ((rc != ETIMEDOUT) && nthreads != 0)
 		rc = pthread_cond_timedwait(&cv, &mtx, &then);
 
-	if (!LIST_EMPTY(&thread_list)) {
-		struct delayed_thread *thr;
-
+	if (nthreads != 0) {
 		LogMajor(COMPONENT_THREAD,
 			 "Delayed executor threads not shutting down cleanly, taking harsher measures.");
-		while ((thr = LIST_FIRST(&thread_list)) != NULL) {
-			LIST_REMOVE(thr, link);
-			pthread_cancel(thr->id);
-			gsh_free(thr);
-		}
+		for (i = 0; i < nwheels; i++)
+			pthread_cancel(wheels[i].id);
 	}
 	PTHREAD_MUTEX_unlock(&mtx);
 }
 
+/**
+ * @brief Set up a timer
+ *
+ * @param[out] timer The timer
+ * @param[in]  func  The function to run
+ * @param[in]  arg   The argument to run it with
+ */
+
+void delayed_timer_init(struct delayed_timer *timer, void (*func)(void *),
+			void *arg)
+{
+	glist_init(&timer->link);
+	timer->func = func;
+	timer->arg = arg;
+	timer->expires = 0;
+	timer->wheel = NULL;
+	timer->slot = 0;
+	timer->autofree = false;
+}
+
+/**
+ * @brief Arm a timer, or move it if it is armed
+ *
+ * The timer goes to the wheel of the calling CPU.
+ *
+ * @param[in] timer The timer
+ * @param[in] delay The delay in nanoseconds
+ *
+ * @return Whether the timer was armed already.
+ */
+
+bool delayed_timer_arm(struct delayed_timer *timer, nsecs_elapsed_t delay)
+{
+	struct delayed_wheel *w = atomic_fetch_voidptr((void **)&timer->wheel);
+	struct delayed_wheel *local;
+	bool pending = false;
+	int cpu;
+
+	/* Rounded up, a timer never runs early */
+	timer->expires = (delayed_clock() + delay +
+			  (UINT64_C(1) << DELAYED_TICK_SHIFT) - 1)
+			 >> DELAYED_TICK_SHIFT;
+
+	cpu = sched_getcpu();
+	local = &wheels[cpu < 0 ? 0 : cpu % nwheels];
+
+	if (w != NULL && w != local) {
+		PTHREAD_MUTEX_lock(&w->mtx);
+		if (timer->wheel == w) {
+			wheel_remove(w, timer);
+			pending = true;
+		}
+		PTHREAD_MUTEX_unlock(&w->mtx);
+	}
+
+	PTHREAD_MUTEX_lock(&local->mtx);
+	if (w == local && timer->wheel == local) {
+		wheel_remove(local, timer);
+		pending = true;
+	}
+	wheel_place(local, timer);
+	if (timer->expires < local->sleep_until)
+		pthread_cond_signal(&local->cv);
+	PTHREAD_MUTEX_unlock(&local->mtx);
+
+	return pending;
+}
+
+/**
+ * @brief Disarm a timer
+ *
+ * A callback already started is not waited for.
+ *
+ * @param[in] timer The timer
+ *
+ * @return Whether the timer was armed, and so will not run.
+ */
+
+bool delayed_timer_cancel(struct delayed_timer *timer)
+{
+	struct delayed_wheel *w = atomic_fetch_voidptr((void **)&timer->wheel);
+	bool pending = false;
+
+	if (w == NULL)
+		return false;
+
+	PTHREAD_MUTEX_lock(&w->mtx);
+	/* Unless its executor took it meanwhile */
+	if (timer->wheel == w) {
+		wheel_remove(w, timer);
+		pending = true;
+	}
+	PTHREAD_MUTEX_unlock(&w->mtx);
+
+	return pending;
+}
+
 /**
  * @brief Submit a new task
  *
@@ -340,36 +545,11 @@ void delayed_shutdown(void)
 
 int delayed_submit(void (*func) (void *), void *arg, nsecs_elapsed_t delay)
 {
-	struct delayed_multi *mul = NULL;
-	struct delayed_task *task = NULL;
-	struct avltree_node *collision = NULL;
-	struct avltree_node *first = NULL;
+	struct delayed_timer *timer = gsh_malloc(sizeof(struct delayed_timer));
 
-	mul = gsh_malloc(sizeof(struct delayed_multi));
-	task = gsh_malloc(sizeof(struct delayed_task));
-
-	now(&mul->realtime);
-	timespec_add_nsecs(delay, &mul->realtime);
-
-	PTHREAD_MUTEX_lock(&mtx);
-	first = avltree_first(&tree);
-	collision = avltree_insert(&mul->node, &tree);
-	if (unlikely(collision)) {
-		gsh_free(mul);
-		/* There is already a node for this exact time in the
-		   tree.  Add our task to its list. */
-		mul =
-		    avltree_container_of(collision, struct delayed_multi, node);
-	} else {
-		LIST_INIT(&mul->list);
-	}
-	task->func = func;
-	task->arg = arg;
-	LIST_INSERT_HEAD(&mul->list, task, link);
-	if (!first || comparator(&mul->node, first) < 0)
-		pthread_cond_broadcast(&cv);
-
-	PTHREAD_MUTEX_unlock(&mtx);
+	delayed_timer_init(timer, func, arg);
+	timer->autofree = true;
+	(void)delayed_timer_arm(timer, delay);
 
 	return 0;
 }
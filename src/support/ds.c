@@ -32,6 +32,7 @@
 #include "nfs_core.h"
 #include "FSAL/fsal_commonlib.h"
 #include "pnfs_utils.h"
+#include "city.h"
 
 /**
  * @brief Servers are stored in an AVL tree with front-end cache.
@@ -199,6 +200,87 @@ struct fsal_pnfs_ds *pnfs_ds_get(uint16_t id_servers)
 	return pds;
 }
 
+/**
+ * @brief Get a DS handle for a wire handle, from the cache of the pDS
+ *
+ * A DS handle only carries what the FSAL decoded from the wire, so
+ * the one made for the previous PUTFH of the same file is good for
+ * this one.  Saves the allocation and decoding of make_ds_handle on
+ * every data server compound.
+ *
+ * @param pds    [IN] the server of the handle
+ * @param desc   [IN] opaque part of the wire handle
+ * @param flags  [IN] fhflags1 of the wire handle
+ * @param handle [OUT] referenced DS handle
+ *
+ * @return NFS4_OK or the status of make_ds_handle.
+ */
+
+nfsstat4 pnfs_ds_handle(struct fsal_pnfs_ds *pds,
+			const struct gsh_buffdesc *desc, int flags,
+			struct fsal_ds_handle **handle)
+{
+	uint32_t slot = CityHash64(desc->addr, desc->len)
+				& (PNFS_DS_HANDLE_CACHE - 1);
+	struct fsal_ds_handle *dsh;
+	struct fsal_ds_handle *old;
+	nfsstat4 status;
+
+	PTHREAD_RWLOCK_rdlock(&pds->lock);
+	dsh = pds->dsh_cache[slot];
+	if (dsh != NULL && dsh->key_flags == flags &&
+	    dsh->key_len == desc->len &&
+	    memcmp(dsh->key, desc->addr, desc->len) == 0) {
+		ds_handle_get_ref(dsh);
+		PTHREAD_RWLOCK_unlock(&pds->lock);
+		*handle = dsh;
+		return NFS4_OK;
+	}
+	PTHREAD_RWLOCK_unlock(&pds->lock);
+
+	status = pds->s_ops.make_ds_handle(pds, desc, handle, flags);
+	if (status != NFS4_OK || desc->len > sizeof(dsh->key))
+		return status;
+
+	dsh = *handle;
+	dsh->key_flags = flags;
+	dsh->key_len = desc->len;
+	memcpy(dsh->key, desc->addr, desc->len);
+
+	PTHREAD_RWLOCK_wrlock(&pds->lock);
+	old = pds->dsh_cache[slot];
+	ds_handle_get_ref(dsh);
+	pds->dsh_cache[slot] = dsh;
+	PTHREAD_RWLOCK_unlock(&pds->lock);
+
+	/* may release it, which takes the lock */
+	if (old != NULL)
+		ds_handle_put(old);
+
+	return NFS4_OK;
+}
+
+/**
+ * @brief Drop the references of the DS handle cache
+ *
+ * @param pds [IN] the server
+ */
+
+static void pnfs_ds_flush_handles(struct fsal_pnfs_ds *pds)
+{
+	struct fsal_ds_handle *cache[PNFS_DS_HANDLE_CACHE];
+	int i;
+
+	PTHREAD_RWLOCK_wrlock(&pds->lock);
+	memcpy(cache, pds->dsh_cache, sizeof(cache));
+	memset(pds->dsh_cache, 0, sizeof(pds->dsh_cache));
+	PTHREAD_RWLOCK_unlock(&pds->lock);
+
+	for (i = 0; i < PNFS_DS_HANDLE_CACHE; i++)
+		if (cache[i] != NULL)
+			ds_handle_put(cache[i]);
+}
+
 /**
  * @brief Release the fsal_pnfs_ds struct
  *
@@ -215,6 +297,7 @@ void pnfs_ds_put(struct fsal_pnfs_ds *pds)
 	}
 
 	/* free resources */
+	pnfs_ds_flush_handles(pds);
 	fsal_pnfs_ds_fini(pds);
 	gsh_free(pds);
 }
@@ -23,7 +23,10 @@
 
 #include "config.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
 #include <pthread.h>
 #include <sys/stat.h>
 #include <time.h>
@@ -33,6 +36,14 @@
 
 #include "common_utils.h"
 #include "log.h"
+#include "abstract_atomic.h"
+#include "gsh_list.h"
+#include "export_mgr.h"
+#include "server_stats.h"
+#include "err_inject.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
 
 int worker_delay_time = 0;
 int next_worker_delay_time = 0;
@@ -103,3 +114,542 @@ int init_error_injector(void)
 	return 0;
 }
 #endif
+
+/* Fault rules
+ *
+ * Each rule picks sub-FSAL calls by export, op and object path, and
+ * makes them wait for one of max_in_flight slots, sleep for a delay
+ * drawn from a distribution, and fail with an error at some rate.
+ * The first rule matching a call applies to it.
+ */
+
+enum fault_latency {
+	FAULT_LATENCY_NONE,
+	FAULT_LATENCY_FIXED,	/* latency_us */
+	FAULT_LATENCY_UNIFORM,	/* latency_us to latency_max_us */
+	FAULT_LATENCY_EXP,	/* mean latency_us, at most latency_max_us */
+};
+
+static const char * const fault_latency_name[] = {
+	[FAULT_LATENCY_NONE] = "none",
+	[FAULT_LATENCY_FIXED] = "fixed",
+	[FAULT_LATENCY_UNIFORM] = "uniform",
+	[FAULT_LATENCY_EXP] = "exp",
+};
+
+static const struct {
+	const char *name;
+	fsal_errors_t error;
+} fault_errors[] = {
+	{ "none", ERR_FSAL_NO_ERROR },
+	{ "IO", ERR_FSAL_IO },
+	{ "DELAY", ERR_FSAL_DELAY },
+	{ "NOSPC", ERR_FSAL_NOSPC },
+	{ "DQUOT", ERR_FSAL_DQUOT },
+	{ "STALE", ERR_FSAL_STALE },
+	{ "ACCESS", ERR_FSAL_ACCESS },
+	{ "PERM", ERR_FSAL_PERM },
+	{ "NOENT", ERR_FSAL_NOENT },
+	{ "ROFS", ERR_FSAL_ROFS },
+	{ "LOCKED", ERR_FSAL_LOCKED },
+	{ "SERVERFAULT", ERR_FSAL_SERVERFAULT },
+};
+
+struct fault_rule {
+	struct glist_head list;
+	uint32_t id;
+	int32_t export_id;	/*< -1 for every export */
+	int op;			/*< FSAL_STAT_OPS for every op */
+	char *pattern;		/*< fnmatch on the path, NULL for any */
+	fsal_errors_t error;
+	double error_pct;
+	enum fault_latency latency;
+	uint32_t latency_us;
+	uint32_t latency_max_us;
+	uint32_t max_in_flight;	/*< 0 for no limit */
+	uint32_t in_flight;	/*< Under mutex */
+	int32_t refcount;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint64_t calls;
+	uint64_t failed;
+	uint64_t waited;
+};
+
+static struct glist_head fault_rules = GLIST_HEAD_INIT(fault_rules);
+static pthread_rwlock_t fault_lock = PTHREAD_RWLOCK_INITIALIZER;
+static int32_t fault_rule_count;
+static uint32_t fault_next_id = 1;
+static __thread unsigned int fault_seed;
+
+static void fault_rule_put(struct fault_rule *rule)
+{
+	if (atomic_dec_int32_t(&rule->refcount) != 0)
+		return;
+
+	PTHREAD_MUTEX_destroy(&rule->mutex);
+	PTHREAD_COND_destroy(&rule->cond);
+	gsh_free(rule->pattern);
+	gsh_free(rule);
+}
+
+/* Uniform in [0, 1) */
+static double fault_random(void)
+{
+	if (fault_seed == 0)
+		fault_seed = (unsigned int)pthread_self() ^ time(NULL);
+
+	return rand_r(&fault_seed) / (RAND_MAX + 1.0);
+}
+
+/* -ln(u) of u uniform in (0, 1], log2 taken linear between powers of
+ * two, which is plenty for delays.
+ */
+static double fault_exp_sample(void)
+{
+	uint32_t r = (uint32_t)(fault_random() * 4294967295.0) + 1;
+	int msb = 31 - __builtin_clz(r);
+	double log2r = msb + ((double)r / (1U << msb) - 1.0);
+
+	return (32.0 - log2r) * 0.6931471805599453;
+}
+
+static void fault_delay(struct fault_rule *rule)
+{
+	struct timespec delay;
+	double usec;
+
+	switch (rule->latency) {
+	case FAULT_LATENCY_FIXED:
+		usec = rule->latency_us;
+		break;
+	case FAULT_LATENCY_UNIFORM:
+		usec = rule->latency_us + fault_random() *
+		       (rule->latency_max_us - rule->latency_us);
+		break;
+	case FAULT_LATENCY_EXP:
+		usec = rule->latency_us * fault_exp_sample();
+		if (usec > rule->latency_max_us)
+			usec = rule->latency_max_us;
+		break;
+	default:
+		return;
+	}
+
+	delay.tv_sec = (time_t)(usec / 1000000);
+	delay.tv_nsec = (long)(usec - delay.tv_sec * 1000000.0) * 1000;
+	while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+		;
+}
+
+static bool fault_rule_matches(struct fault_rule *rule,
+			       struct gsh_export *export, int op,
+			       const char *path)
+{
+	if (rule->export_id >= 0 &&
+	    (export == NULL || export->export_id != rule->export_id))
+		return false;
+
+	if (rule->op != FSAL_STAT_OPS && rule->op != op)
+		return false;
+
+	if (rule->pattern != NULL &&
+	    (path == NULL || fnmatch(rule->pattern, path, 0) != 0))
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Apply the fault rules to a sub-FSAL call about to be made
+ *
+ * Waits for a slot of the rule matching the call, if it has a
+ * max_in_flight, then sleeps for its latency, and fails the call at
+ * its error rate.
+ *
+ * @param[in]  export   Export of the call, may be NULL
+ * @param[in]  op       The call, an enum fsal_stat_op
+ * @param[in]  path     Path of the object, NULL if not known
+ * @param[in]  may_fail Whether the call can return an error
+ * @param[out] rule     Rule to pass to fault_inject_done
+ *
+ * @return The error to fail the call with, fault_inject_done was then
+ *         done, or ERR_FSAL_NO_ERROR to make the call.
+ */
+fsal_errors_t fault_inject_start(struct gsh_export *export, int op,
+				 const char *path, bool may_fail,
+				 struct fault_rule **rule)
+{
+	struct fault_rule *found = NULL;
+	struct glist_head *glist;
+	fsal_errors_t error;
+
+	*rule = NULL;
+
+	if (atomic_fetch_int32_t(&fault_rule_count) == 0)
+		return ERR_FSAL_NO_ERROR;
+
+	PTHREAD_RWLOCK_rdlock(&fault_lock);
+	glist_for_each(glist, &fault_rules) {
+		struct fault_rule *r =
+			glist_entry(glist, struct fault_rule, list);
+
+		if (fault_rule_matches(r, export, op, path)) {
+			(void)atomic_inc_int32_t(&r->refcount);
+			found = r;
+			break;
+		}
+	}
+	PTHREAD_RWLOCK_unlock(&fault_lock);
+
+	if (found == NULL)
+		return ERR_FSAL_NO_ERROR;
+
+	(void)atomic_inc_uint64_t(&found->calls);
+
+	if (found->max_in_flight != 0) {
+		PTHREAD_MUTEX_lock(&found->mutex);
+		if (found->in_flight >= found->max_in_flight) {
+			(void)atomic_inc_uint64_t(&found->waited);
+			while (found->in_flight >= found->max_in_flight)
+				pthread_cond_wait(&found->cond, &found->mutex);
+		}
+		found->in_flight++;
+		PTHREAD_MUTEX_unlock(&found->mutex);
+	}
+
+	fault_delay(found);
+
+	error = found->error;
+	if (may_fail && error != ERR_FSAL_NO_ERROR &&
+	    fault_random() * 100.0 < found->error_pct) {
+		(void)atomic_inc_uint64_t(&found->failed);
+		fault_inject_done(found);
+		return error;
+	}
+
+	*rule = found;
+	return ERR_FSAL_NO_ERROR;
+}
+
+/**
+ * @brief Release the slot fault_inject_start took for a call
+ *
+ * @param[in] rule What fault_inject_start gave back, may be NULL
+ */
+void fault_inject_done(struct fault_rule *rule)
+{
+	if (rule == NULL)
+		return;
+
+	if (rule->max_in_flight != 0) {
+		PTHREAD_MUTEX_lock(&rule->mutex);
+		rule->in_flight--;
+		pthread_cond_signal(&rule->cond);
+		PTHREAD_MUTEX_unlock(&rule->mutex);
+	}
+
+	fault_rule_put(rule);
+}
+
+#ifdef USE_DBUS
+
+static bool fault_arg(DBusMessageIter *args, bool first, int type,
+		      void *value, const char *what, DBusError *error)
+{
+	if (args == NULL || (!first && !dbus_message_iter_next(args)) ||
+	    dbus_message_iter_get_arg_type(args) != type) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+			       "%s is missing or not a (%c)", what, type);
+		return false;
+	}
+	dbus_message_iter_get_basic(args, value);
+	return true;
+}
+
+/**
+ * DBUS method to add a fault rule
+ *
+ * Takes the export id (-1 for all), the op ("*" for all), a path
+ * pattern ("" for any), an error name and rate in percent, a latency
+ * distribution with its two bounds in usecs and the number of calls
+ * let in flight at once (0 for no limit).  Returns the rule's id.
+ */
+
+static bool fault_add_rule(DBusMessageIter *args, DBusMessage *reply,
+			   DBusError *error)
+{
+	struct fault_rule *rule;
+	DBusMessageIter iter;
+	char *op, *pattern, *err, *latency;
+	int32_t export_id;
+	double error_pct;
+	uint32_t latency_us, latency_max_us, max_in_flight, id;
+	int i, nerr = sizeof(fault_errors) / sizeof(fault_errors[0]);
+
+	if (!fault_arg(args, true, DBUS_TYPE_INT32, &export_id,
+		       "export id", error) ||
+	    !fault_arg(args, false, DBUS_TYPE_STRING, &op, "op", error) ||
+	    !fault_arg(args, false, DBUS_TYPE_STRING, &pattern, "pattern",
+		       error) ||
+	    !fault_arg(args, false, DBUS_TYPE_STRING, &err, "error", error) ||
+	    !fault_arg(args, false, DBUS_TYPE_DOUBLE, &error_pct,
+		       "error rate", error) ||
+	    !fault_arg(args, false, DBUS_TYPE_STRING, &latency, "latency",
+		       error) ||
+	    !fault_arg(args, false, DBUS_TYPE_UINT32, &latency_us,
+		       "latency usecs", error) ||
+	    !fault_arg(args, false, DBUS_TYPE_UINT32, &latency_max_us,
+		       "latency max usecs", error) ||
+	    !fault_arg(args, false, DBUS_TYPE_UINT32, &max_in_flight,
+		       "max in flight", error))
+		return false;
+
+	rule = gsh_calloc(1, sizeof(*rule));
+	rule->export_id = export_id < 0 ? -1 : export_id;
+	rule->error_pct = error_pct;
+	rule->latency_us = latency_us;
+	rule->latency_max_us = latency_max_us;
+	rule->max_in_flight = max_in_flight;
+	rule->refcount = 1;
+
+	if (strcmp(op, "*") == 0) {
+		rule->op = FSAL_STAT_OPS;
+	} else {
+		for (rule->op = 0; rule->op < FSAL_STAT_OPS; rule->op++)
+			if (strcmp(op, fsal_stat_op_name[rule->op]) == 0)
+				break;
+		if (rule->op == FSAL_STAT_OPS)
+			goto invalid;
+	}
+
+	for (i = 0; i < nerr; i++)
+		if (strcasecmp(err, fault_errors[i].name) == 0)
+			break;
+	if (i == nerr)
+		goto invalid;
+	rule->error = fault_errors[i].error;
+
+	for (i = 0; i <= FAULT_LATENCY_EXP; i++)
+		if (strcasecmp(latency, fault_latency_name[i]) == 0)
+			break;
+	if (i > FAULT_LATENCY_EXP)
+		goto invalid;
+	rule->latency = i;
+
+	if (error_pct < 0 || error_pct > 100 ||
+	    (rule->latency == FAULT_LATENCY_UNIFORM &&
+	     latency_max_us < latency_us))
+		goto invalid;
+
+	if (rule->latency_max_us == 0)
+		rule->latency_max_us = UINT32_MAX;
+
+	if (pattern[0] != '\0')
+		rule->pattern = gsh_strdup(pattern);
+
+	PTHREAD_MUTEX_init(&rule->mutex, NULL);
+	PTHREAD_COND_init(&rule->cond, NULL);
+
+	PTHREAD_RWLOCK_wrlock(&fault_lock);
+	id = rule->id = fault_next_id++;
+	glist_add_tail(&fault_rules, &rule->list);
+	(void)atomic_inc_int32_t(&fault_rule_count);
+	PTHREAD_RWLOCK_unlock(&fault_lock);
+
+	LogEvent(COMPONENT_FSAL,
+		 "Fault rule %"PRIu32" added: export %"PRIi32" op %s path %s error %s %.2f%% latency %s %"PRIu32"-%"PRIu32" us in flight %"PRIu32,
+		 id, rule->export_id, op, pattern, err, error_pct, latency,
+		 latency_us, latency_max_us, max_in_flight);
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, true, "OK");
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_UINT32, &id);
+	return true;
+
+ invalid:
+	gsh_free(rule);
+	dbus_set_error(error, DBUS_ERROR_INVALID_ARGS,
+		       "Invalid op, error, latency or range");
+	return false;
+}
+
+/**
+ * DBUS method to remove a fault rule by id, or all of them with 0
+ *
+ * Calls already past the rule finish as they were going to.
+ */
+
+static bool fault_remove_rule(DBusMessageIter *args, DBusMessage *reply,
+			      DBusError *error)
+{
+	struct glist_head *glist, *glistn;
+	struct glist_head removed;
+	DBusMessageIter iter;
+	uint32_t id;
+	bool found = false;
+
+	if (!fault_arg(args, true, DBUS_TYPE_UINT32, &id, "rule id", error))
+		return false;
+
+	glist_init(&removed);
+
+	PTHREAD_RWLOCK_wrlock(&fault_lock);
+	glist_for_each_safe(glist, glistn, &fault_rules) {
+		struct fault_rule *rule =
+			glist_entry(glist, struct fault_rule, list);
+
+		if (id != 0 && rule->id != id)
+			continue;
+
+		glist_del(&rule->list);
+		glist_add_tail(&removed, &rule->list);
+		(void)atomic_dec_int32_t(&fault_rule_count);
+		found = true;
+	}
+	PTHREAD_RWLOCK_unlock(&fault_lock);
+
+	glist_for_each_safe(glist, glistn, &removed) {
+		struct fault_rule *rule =
+			glist_entry(glist, struct fault_rule, list);
+
+		glist_del(&rule->list);
+		fault_rule_put(rule);
+	}
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, found || id == 0,
+			  found || id == 0 ? "OK" : "No such rule");
+	return true;
+}
+
+/**
+ * DBUS method to list the fault rules with their counters
+ */
+
+static bool fault_list_rules(DBusMessageIter *args, DBusMessage *reply,
+			     DBusError *error)
+{
+	DBusMessageIter iter, array_iter, struct_iter;
+	struct glist_head *glist;
+	const char *str;
+	uint64_t value;
+	int i, nerr = sizeof(fault_errors) / sizeof(fault_errors[0]);
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, true, "OK");
+
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					 "(uisssdsuuuttt)", &array_iter);
+
+	PTHREAD_RWLOCK_rdlock(&fault_lock);
+	glist_for_each(glist, &fault_rules) {
+		struct fault_rule *rule =
+			glist_entry(glist, struct fault_rule, list);
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rule->id);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_INT32,
+					       &rule->export_id);
+		str = rule->op == FSAL_STAT_OPS ? "*"
+						: fsal_stat_op_name[rule->op];
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		str = rule->pattern != NULL ? rule->pattern : "";
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		for (i = 0; i < nerr - 1; i++)
+			if (fault_errors[i].error == rule->error)
+				break;
+		str = fault_errors[i].name;
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_DOUBLE,
+					       &rule->error_pct);
+		str = fault_latency_name[rule->latency];
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &str);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rule->latency_us);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rule->latency_max_us);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &rule->max_in_flight);
+		value = atomic_fetch_uint64_t(&rule->calls);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &value);
+		value = atomic_fetch_uint64_t(&rule->failed);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &value);
+		value = atomic_fetch_uint64_t(&rule->waited);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &value);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	PTHREAD_RWLOCK_unlock(&fault_lock);
+
+	dbus_message_iter_close_container(&iter, &array_iter);
+	return true;
+}
+
+static struct gsh_dbus_method fault_add = {
+	.name = "AddRule",
+	.method = fault_add_rule,
+	.args = {{.name = "export_id", .type = "i", .direction = "in"},
+		 {.name = "op", .type = "s", .direction = "in"},
+		 {.name = "pattern", .type = "s", .direction = "in"},
+		 {.name = "error", .type = "s", .direction = "in"},
+		 {.name = "error_pct", .type = "d", .direction = "in"},
+		 {.name = "latency", .type = "s", .direction = "in"},
+		 {.name = "latency_us", .type = "u", .direction = "in"},
+		 {.name = "latency_max_us", .type = "u", .direction = "in"},
+		 {.name = "max_in_flight", .type = "u", .direction = "in"},
+		 STATUS_REPLY,
+		 {.name = "id", .type = "u", .direction = "out"},
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method fault_remove = {
+	.name = "RemoveRule",
+	.method = fault_remove_rule,
+	.args = {{.name = "id", .type = "u", .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method fault_list = {
+	.name = "ListRules",
+	.method = fault_list_rules,
+	.args = {STATUS_REPLY,
+		 {.name = "rules", .type = "a(uisssdsuuuttt)",
+		  .direction = "out"},
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method *fault_methods[] = {
+	&fault_add,
+	&fault_remove,
+	&fault_list,
+	NULL
+};
+
+static struct gsh_dbus_interface fault_table = {
+	.name = "org.ganesha.nfsd.faults",
+	.props = NULL,
+	.methods = fault_methods,
+	.signals = NULL
+};
+
+static struct gsh_dbus_interface *fault_interfaces[] = {
+	&fault_table,
+	NULL
+};
+
+void dbus_fault_init(void)
+{
+	gsh_dbus_register_path("FaultInject", fault_interfaces);
+}
+
+#endif				/* USE_DBUS */
@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file export_index.c
+ * @brief Compiled client list of an export
+ *
+ * See export_index.h.  Entries are known by their position in the
+ * client list, the first match is the one with the lowest position.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "abstract_mem.h"
+#include "common_utils.h"
+#include "city.h"
+#include "export_index.h"
+
+/** No entry */
+#define EXPORT_INDEX_NONE UINT32_MAX
+
+/** Client addresses whose decision is cached (per export) */
+#define EXPORT_CACHE_SLOTS 1024
+#define EXPORT_CACHE_STRIPES 16
+
+/** Seconds a decision that took a netgroup or host name check is kept */
+#define EXPORT_CACHE_NAME_TTL 60
+
+/** A prefix of the client networks */
+struct trie_node {
+	struct trie_node *child[2];
+	uint32_t first;		/*< First network of exactly this prefix */
+};
+
+struct host4_slot {
+	uint32_t pos;
+	in_addr_t addr;
+};
+
+struct host6_slot {
+	uint32_t pos;
+	struct in6_addr addr;
+};
+
+struct cache_slot {
+	sa_family_t family;	/*< AF_UNSPEC if free */
+	uint32_t pos;		/*< The decision */
+	time_t expire;		/*< 0 for never */
+	uint8_t addr[16];
+};
+
+struct export_client_index {
+	exportlist_client_entry_t **entries;	/*< In client list order */
+	uint32_t *slow;		/*< Entries tried one by one, in order */
+	uint32_t nslow;
+	struct host4_slot *hosts4;
+	uint32_t hosts4_mask;
+	struct host6_slot *hosts6;
+	uint32_t hosts6_mask;
+	struct trie_node *trie;
+	pthread_mutex_t cache_mtx[EXPORT_CACHE_STRIPES];
+	struct cache_slot cache[EXPORT_CACHE_SLOTS];
+};
+
+static inline uint32_t hash4(in_addr_t addr)
+{
+	return addr * 0x9E3779B1U;
+}
+
+static inline uint32_t hash6(const struct in6_addr *addr)
+{
+	return CityHash64((char *)addr->s6_addr, sizeof(addr->s6_addr));
+}
+
+/**
+ * @brief Size of a host hash with room for count entries
+ */
+static uint32_t host_slots(uint32_t count)
+{
+	uint32_t slots = 16;
+
+	while (slots < 2 * count)
+		slots <<= 1;
+
+	return slots;
+}
+
+/**
+ * @brief Length of the prefix of a netmask, -1 if it has holes
+ */
+static int prefix_len(uint32_t netmask)
+{
+	uint32_t host = ~netmask;
+
+	if ((host & (host + 1)) != 0)
+		return -1;
+
+	return 32 - __builtin_popcount(host);
+}
+
+static void trie_insert(struct trie_node *node, uint32_t netaddr, int len,
+			uint32_t pos)
+{
+	int bit;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		bit = (netaddr >> (31 - i)) & 1;
+		if (node->child[bit] == NULL) {
+			node->child[bit] = gsh_calloc(1, sizeof(*node));
+			node->child[bit]->first = EXPORT_INDEX_NONE;
+		}
+		node = node->child[bit];
+	}
+
+	if (pos < node->first)
+		node->first = pos;
+}
+
+static void trie_free(struct trie_node *node)
+{
+	if (node == NULL)
+		return;
+
+	trie_free(node->child[0]);
+	trie_free(node->child[1]);
+	gsh_free(node);
+}
+
+static void host4_insert(struct export_client_index *index, in_addr_t addr,
+			 uint32_t pos)
+{
+	uint32_t i = hash4(addr) & index->hosts4_mask;
+
+	while (index->hosts4[i].pos != EXPORT_INDEX_NONE) {
+		if (index->hosts4[i].addr == addr)
+			return;	/* An earlier entry has it */
+		i = (i + 1) & index->hosts4_mask;
+	}
+
+	index->hosts4[i].pos = pos;
+	index->hosts4[i].addr = addr;
+}
+
+static void host6_insert(struct export_client_index *index,
+			 const struct in6_addr *addr, uint32_t pos)
+{
+	uint32_t i = hash6(addr) & index->hosts6_mask;
+
+	while (index->hosts6[i].pos != EXPORT_INDEX_NONE) {
+		if (memcmp(&index->hosts6[i].addr, addr, sizeof(*addr)) == 0)
+			return;
+		i = (i + 1) & index->hosts6_mask;
+	}
+
+	index->hosts6[i].pos = pos;
+	index->hosts6[i].addr = *addr;
+}
+
+/**
+ * @brief Compile a client list
+ *
+ * @param[in] clients The client list, which must outlive the index
+ *
+ * @return The index.
+ */
+struct export_client_index *export_index_build(struct glist_head *clients)
+{
+	struct export_client_index *index;
+	exportlist_client_entry_t *client;
+	struct glist_head *glist;
+	uint32_t count = 0, nhosts4 = 0, nhosts6 = 0, pos, i;
+	int len;
+
+	glist_for_each(glist, clients) {
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+		if (client->type == HOSTIF_CLIENT)
+			nhosts4++;
+		else if (client->type == HOSTIF_CLIENT_V6)
+			nhosts6++;
+		count++;
+	}
+
+	index = gsh_calloc(1, sizeof(*index));
+	index->entries = gsh_calloc(count + 1, sizeof(*index->entries));
+	index->slow = gsh_calloc(count + 1, sizeof(*index->slow));
+
+	index->hosts4_mask = host_slots(nhosts4) - 1;
+	index->hosts4 = gsh_malloc((index->hosts4_mask + 1) *
+				   sizeof(*index->hosts4));
+	for (i = 0; i <= index->hosts4_mask; i++)
+		index->hosts4[i].pos = EXPORT_INDEX_NONE;
+
+	index->hosts6_mask = host_slots(nhosts6) - 1;
+	index->hosts6 = gsh_malloc((index->hosts6_mask + 1) *
+				   sizeof(*index->hosts6));
+	for (i = 0; i <= index->hosts6_mask; i++)
+		index->hosts6[i].pos = EXPORT_INDEX_NONE;
+
+	index->trie = gsh_calloc(1, sizeof(*index->trie));
+	index->trie->first = EXPORT_INDEX_NONE;
+
+	for (i = 0; i < EXPORT_CACHE_STRIPES; i++)
+		PTHREAD_MUTEX_init(&index->cache_mtx[i], NULL);
+
+	pos = 0;
+	glist_for_each(glist, clients) {
+		client = glist_entry(glist, exportlist_client_entry_t,
+				     cle_list);
+		index->entries[pos] = client;
+
+		switch (client->type) {
+		case HOSTIF_CLIENT:
+			host4_insert(index, client->client.hostif.clientaddr,
+				     pos);
+			break;
+
+		case HOSTIF_CLIENT_V6:
+			host6_insert(index, &client->client.hostif.clientaddr6,
+				     pos);
+			break;
+
+		case NETWORK_CLIENT:
+			len = prefix_len(client->client.network.netmask);
+			if ((client->client.network.netaddr &
+			     ~client->client.network.netmask) != 0)
+				break;	/* Never matches */
+			if (len >= 0)
+				trie_insert(index->trie,
+					    client->client.network.netaddr,
+					    len, pos);
+			else
+				index->slow[index->nslow++] = pos;
+			break;
+
+		case NETGROUP_CLIENT:
+		case WILDCARDHOST_CLIENT:
+		case MATCH_ANY_CLIENT:
+			index->slow[index->nslow++] = pos;
+			break;
+
+		default:
+			/* Never matches */
+			break;
+		}
+		pos++;
+	}
+
+	return index;
+}
+
+void export_index_free(struct export_client_index *index)
+{
+	int i;
+
+	if (index == NULL)
+		return;
+
+	for (i = 0; i < EXPORT_CACHE_STRIPES; i++)
+		PTHREAD_MUTEX_destroy(&index->cache_mtx[i]);
+
+	trie_free(index->trie);
+	gsh_free(index->hosts6);
+	gsh_free(index->hosts4);
+	gsh_free(index->slow);
+	gsh_free(index->entries);
+	gsh_free(index);
+}
+
+/**
+ * @brief Whether an entry tried one by one matches
+ *
+ * @param[out] named Set if a netgroup or host name was checked
+ */
+static bool slow_match(exportlist_client_entry_t *client,
+		       sockaddr_t *hostaddr, export_name_match_t name_match,
+		       bool *named)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *)hostaddr;
+
+	if (client->type == MATCH_ANY_CLIENT)
+		return true;
+
+	/* Only the entries above are for IPv6 clients */
+	if (hostaddr->ss_family != AF_INET)
+		return false;
+
+	switch (client->type) {
+	case NETWORK_CLIENT:
+		return (client->client.network.netmask &
+			ntohl(sin->sin_addr.s_addr)) ==
+		       client->client.network.netaddr;
+
+	case NETGROUP_CLIENT:
+	case WILDCARDHOST_CLIENT:
+		*named = true;
+		return name_match(client, hostaddr);
+
+	default:
+		return false;
+	}
+}
+
+/**
+ * @brief The first entry matching a client, uncached
+ */
+static uint32_t index_lookup(struct export_client_index *index,
+			     sockaddr_t *hostaddr,
+			     export_name_match_t name_match, bool *named)
+{
+	uint32_t best = EXPORT_INDEX_NONE;
+	struct trie_node *node;
+	uint32_t addr, i;
+	int bit;
+
+	if (hostaddr->ss_family == AF_INET) {
+		in_addr_t a = ((struct sockaddr_in *)hostaddr)->sin_addr.s_addr;
+
+		for (i = hash4(a) & index->hosts4_mask;
+		     index->hosts4[i].pos != EXPORT_INDEX_NONE;
+		     i = (i + 1) & index->hosts4_mask) {
+			if (index->hosts4[i].addr == a) {
+				best = index->hosts4[i].pos;
+				break;
+			}
+		}
+
+		addr = ntohl(a);
+		node = index->trie;
+		for (bit = 31; node != NULL; bit--) {
+			if (node->first < best)
+				best = node->first;
+			if (bit < 0)
+				break;
+			node = node->child[(addr >> bit) & 1];
+		}
+	} else if (hostaddr->ss_family == AF_INET6) {
+		struct in6_addr *a =
+			&((struct sockaddr_in6 *)hostaddr)->sin6_addr;
+
+		for (i = hash6(a) & index->hosts6_mask;
+		     index->hosts6[i].pos != EXPORT_INDEX_NONE;
+		     i = (i + 1) & index->hosts6_mask) {
+			if (memcmp(&index->hosts6[i].addr, a,
+				   sizeof(*a)) == 0) {
+				best = index->hosts6[i].pos;
+				break;
+			}
+		}
+	}
+
+	/* Entries ahead of the address match can still come first */
+	for (i = 0; i < index->nslow && index->slow[i] < best; i++) {
+		if (slow_match(index->entries[index->slow[i]], hostaddr,
+			       name_match, named))
+			return index->slow[i];
+	}
+
+	return best;
+}
+
+/**
+ * @brief Find the first entry of the client list matching a client
+ *
+ * Called with the export lock held, for read at least.
+ *
+ * @param[in] index      The export's index
+ * @param[in] hostaddr   The client, IPv4 mapped addresses converted
+ * @param[in] name_match Check of netgroup and wildcard entries
+ *
+ * @return The entry, NULL if none matches.
+ */
+exportlist_client_entry_t *export_index_match(
+					struct export_client_index *index,
+					sockaddr_t *hostaddr,
+					export_name_match_t name_match)
+{
+	uint8_t key[16] = {0};
+	struct cache_slot *slot;
+	pthread_mutex_t *mtx;
+	bool named = false;
+	uint32_t h, pos;
+	time_t now = 0;
+
+	if (hostaddr->ss_family == AF_INET) {
+		memcpy(key, &((struct sockaddr_in *)hostaddr)->sin_addr, 4);
+		h = hash4(((struct sockaddr_in *)hostaddr)->sin_addr.s_addr);
+	} else if (hostaddr->ss_family == AF_INET6) {
+		memcpy(key, &((struct sockaddr_in6 *)hostaddr)->sin6_addr,
+		       16);
+		h = hash6(&((struct sockaddr_in6 *)hostaddr)->sin6_addr);
+	} else {
+		pos = index_lookup(index, hostaddr, name_match, &named);
+		goto out;
+	}
+
+	slot = &index->cache[h % EXPORT_CACHE_SLOTS];
+	mtx = &index->cache_mtx[h % EXPORT_CACHE_STRIPES];
+
+	PTHREAD_MUTEX_lock(mtx);
+	if (slot->family == hostaddr->ss_family &&
+	    memcmp(slot->addr, key, sizeof(key)) == 0) {
+		if (slot->expire != 0)
+			now = time(NULL);
+		if (slot->expire == 0 || now < slot->expire) {
+			pos = slot->pos;
+			PTHREAD_MUTEX_unlock(mtx);
+			goto out;
+		}
+	}
+	PTHREAD_MUTEX_unlock(mtx);
+
+	pos = index_lookup(index, hostaddr, name_match, &named);
+
+	PTHREAD_MUTEX_lock(mtx);
+	slot->family = hostaddr->ss_family;
+	memcpy(slot->addr, key, sizeof(key));
+	slot->pos = pos;
+	slot->expire = named ? time(NULL) + EXPORT_CACHE_NAME_TTL : 0;
+	PTHREAD_MUTEX_unlock(mtx);
+
+out:
+	return pos == EXPORT_INDEX_NONE ? NULL : index->entries[pos];
+}
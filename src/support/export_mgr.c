@@ -85,6 +85,31 @@ static struct export_by_id export_by_id;
   */
 static struct glist_head exportlist;
 
+/**
+ * @brief A component of the export paths
+ *
+ * Paths and pseudo paths are kept in tries of their components, so
+ * the longest export prefix of a path is found in one walk down the
+ * path.  The exports of a node are in exportlist order.  Protected by
+ * export_by_id.lock.
+ */
+struct export_path_node {
+	struct avltree_node node_k;	/*< In the children of parent */
+	struct avltree children;
+	struct export_path_node *parent;
+	struct glist_head exports;
+	const char *name;
+	size_t len;
+};
+
+enum export_path_trie {
+	EXPORT_PATH,
+	EXPORT_PSEUDO,
+};
+
+/* Roots of the tries, for absolute and relative paths */
+static struct export_path_node export_path_roots[2][2];
+
 /** List of exports to be mounted in PseudoFS,
   * protected by export_by_id.lock
   */
@@ -181,12 +206,174 @@ void export_revert(struct gsh_export *export)
 		atomic_store_voidptr(cache_slot, NULL);
 	avltree_remove(&export->node_k, &export_by_id.t);
 	glist_del(&export->exp_list);
+	export_path_remove(export);
 	glist_del(&export->exp_work);
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 	put_gsh_export(export); /* Release sentinel ref */
 }
 
+static int export_path_cmpf(const struct avltree_node *lhs,
+			    const struct avltree_node *rhs)
+{
+	struct export_path_node *lk, *rk;
+	int rc;
+
+	lk = avltree_container_of(lhs, struct export_path_node, node_k);
+	rk = avltree_container_of(rhs, struct export_path_node, node_k);
+
+	rc = memcmp(lk->name, rk->name, MIN(lk->len, rk->len));
+	if (rc != 0)
+		return rc;
+	return lk->len < rk->len ? -1 : lk->len > rk->len;
+}
+
+/* Next component of a path, skipping slashes, false at the end */
+static bool export_path_next(const char **path, const char **name,
+			     size_t *len)
+{
+	const char *p = *path;
+
+	while (*p == '/')
+		p++;
+	if (*p == '\0')
+		return false;
+
+	*name = p;
+	while (*p != '/' && *p != '\0')
+		p++;
+	*len = p - *name;
+	*path = p;
+	return true;
+}
+
+static struct export_path_node *export_path_root(enum export_path_trie trie,
+						 const char *path)
+{
+	return &export_path_roots[trie][path[0] == '/' || path[0] == '\0'];
+}
+
+static struct gsh_export *export_path_first(enum export_path_trie trie,
+					    struct export_path_node *node)
+{
+	if (trie == EXPORT_PSEUDO)
+		return glist_first_entry(&node->exports, struct gsh_export,
+					 pseudo_list);
+	return glist_first_entry(&node->exports, struct gsh_export,
+				 path_list);
+}
+
+/* Add an export to a trie, export_by_id.lock is held for write */
+static struct export_path_node *export_path_add(enum export_path_trie trie,
+						const char *path,
+						struct glist_head *link)
+{
+	struct export_path_node *node = export_path_root(trie, path);
+	struct export_path_node *child, v;
+	struct avltree_node *found;
+	const char *name;
+	size_t len;
+
+	while (export_path_next(&path, &name, &len)) {
+		v.name = name;
+		v.len = len;
+		found = avltree_lookup(&v.node_k, &node->children);
+		if (found != NULL) {
+			node = avltree_container_of(found,
+						    struct export_path_node,
+						    node_k);
+			continue;
+		}
+
+		child = gsh_calloc(1, sizeof(*child) + len);
+		memcpy(child + 1, name, len);
+		child->name = (const char *)(child + 1);
+		child->len = len;
+		child->parent = node;
+		avltree_init(&child->children, export_path_cmpf, 0);
+		glist_init(&child->exports);
+		avltree_insert(&child->node_k, &node->children);
+		node = child;
+	}
+
+	glist_add_tail(&node->exports, link);
+	return node;
+}
+
+/* Remove an export from a trie, export_by_id.lock is held for write */
+static void export_path_del(struct export_path_node *node,
+			    struct glist_head *link)
+{
+	struct export_path_node *parent;
+
+	glist_del(link);
+
+	while (node->parent != NULL && glist_empty(&node->exports) &&
+	       avltree_first(&node->children) == NULL) {
+		parent = node->parent;
+		avltree_remove(&node->node_k, &parent->children);
+		gsh_free(node);
+		node = parent;
+	}
+}
+
+/**
+ * @brief Find the export of the longest prefix of a path
+ *
+ * A trailing '/' in path is ignored, and so are repeated ones.
+ * export_by_id.lock is held.
+ */
+static struct gsh_export *export_path_lookup(enum export_path_trie trie,
+					     const char *path,
+					     bool exact_match)
+{
+	struct export_path_node *node = export_path_root(trie, path);
+	struct export_path_node v;
+	struct avltree_node *found;
+	struct gsh_export *ret_exp = export_path_first(trie, node);
+	const char *name;
+	size_t len;
+
+	while (export_path_next(&path, &name, &len)) {
+		v.name = name;
+		v.len = len;
+		found = avltree_lookup(&v.node_k, &node->children);
+		if (found == NULL)
+			return exact_match ? NULL : ret_exp;
+
+		node = avltree_container_of(found, struct export_path_node,
+					    node_k);
+		if (!glist_empty(&node->exports))
+			ret_exp = export_path_first(trie, node);
+		else if (exact_match)
+			ret_exp = NULL;
+	}
+
+	return ret_exp;
+}
+
+static void export_path_insert(struct gsh_export *export)
+{
+	export->path_node = export_path_add(EXPORT_PATH, export->fullpath,
+					    &export->path_list);
+	if (export->pseudopath != NULL)
+		export->pseudo_node = export_path_add(EXPORT_PSEUDO,
+						      export->pseudopath,
+						      &export->pseudo_list);
+}
+
+static void export_path_remove(struct gsh_export *export)
+{
+	if (export->path_node == NULL)
+		return;
+
+	export_path_del(export->path_node, &export->path_list);
+	if (export->pseudo_node != NULL)
+		export_path_del(export->pseudo_node, &export->pseudo_list);
+	export->path_node = NULL;
+	export->pseudo_node = NULL;
+}
+
 /**
  * @brief Export id comparator for AVL tree walk
  *
@@ -248,6 +435,9 @@ void free_export(struct gsh_export *export)
 
 	assert(export->refcnt == 0);
 
+	if (export->ref_slots != NULL)
+		gsh_free(export->ref_slots);
+
 	/* free resources */
 	free_export_resources(export);
 	export_st = container_of(export, struct export_stats, export);
@@ -272,6 +462,7 @@ void free_export(struct gsh_export *export)
 bool insert_gsh_export(struct gsh_export *export)
 {
 	struct avltree_node *node;
+	struct export_ref_slot *slots;
 	void **cache_slot = (void **)
 	    &(export_by_id.cache[eid_cache_offsetof(export->export_id)]);
 
@@ -289,12 +480,63 @@ bool insert_gsh_export(struct gsh_export *export)
 	/* update cache */
 	atomic_store_voidptr(cache_slot, &export->node_k);
 	glist_add_tail(&exportlist, &export->exp_list);
+	export_path_insert(export);
 	get_gsh_export_ref(export);		/* == 2 */
 
+	/* count the references to come per thread */
+	slots = gsh_malloc_aligned(sizeof(struct export_ref_slot),
+				   EXPORT_REF_SLOTS * sizeof(*slots));
+	memset(slots, 0, EXPORT_REF_SLOTS * sizeof(*slots));
+	atomic_store_voidptr((void **)&export->ref_slots, slots);
+
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 	return true;
 }
 
+__thread uint32_t export_ref_thread;
+static uint32_t export_ref_threads;
+
+/**
+ * @brief Give the thread its slot of the export references
+ */
+void export_ref_thread_init(void)
+{
+	export_ref_thread =
+		atomic_inc_uint32_t(&export_ref_threads) % EXPORT_REF_SLOTS + 1;
+}
+
+/**
+ * @brief Move the references of an export back to refcnt
+ *
+ * Once the export leaves the export manager, so that the last
+ * put_gsh_export sees the count drop to zero.  Each slot is sealed and
+ * read in one atomic add, a thread finding its slot sealed counts in
+ * refcnt.  Those threads may release references not folded yet, so
+ * refcnt is biased meanwhile.
+ */
+static void export_ref_seal(struct gsh_export *export)
+{
+	struct export_ref_slot *slots = export->ref_slots;
+	int64_t refs;
+	int i;
+
+	if (slots == NULL)
+		return;
+
+	(void) atomic_add_int64_t(&export->refcnt, EXPORT_REF_SEALED);
+
+	for (i = 0; i < EXPORT_REF_SLOTS; i++) {
+		refs = atomic_add_int64_t(&slots[i].refs, EXPORT_REF_SEALED) -
+		       EXPORT_REF_SEALED;
+		(void) atomic_add_int64_t(&export->refcnt, refs);
+	}
+
+	refs = atomic_sub_int64_t(&export->refcnt, EXPORT_REF_SEALED);
+
+	/* the caller still holds the sentinel reference */
+	assert(refs > 0);
+}
+
 /**
  * @brief Lookup the export manager struct for this export id
  *
@@ -350,9 +592,9 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list, assumes being called with
- * export manager lock held (such as from within foreach_gsh_export.
+ * Gets an export entry from its path using a longest prefix match in
+ * the path trie, assumes being called with export manager lock held
+ * (such as from within foreach_gsh_export.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -364,59 +606,9 @@ struct gsh_export *get_gsh_export(uint16_t export_id)
 struct gsh_export *get_gsh_export_by_path_locked(char *path,
 						 bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
-
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		len_export = strlen(export->fullpath);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in fullpath just after the end of path is not '/'
-		 * it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
+	struct gsh_export *ret_exp;
 
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->fullpath, path, len_export) == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	ret_exp = export_path_lookup(EXPORT_PATH, path, exact_match);
 
 	if (ret_exp != NULL)
 		get_gsh_export_ref(ret_exp);
@@ -427,8 +619,8 @@ struct gsh_export *get_gsh_export_by_path_locked(char *path,
 /**
  * @brief Lookup the export manager struct by export path
  *
- * Gets an export entry from its path using a substring match and
- * linear search of the export list.
+ * Gets an export entry from its path using a longest prefix match in
+ * the path trie.
  * If path has a trailing '/', ignore it.
  *
  * @param path        [IN] the path for the entry to be found.
@@ -466,69 +658,9 @@ struct gsh_export *get_gsh_export_by_path(char *path, bool exact_match)
 struct gsh_export *get_gsh_export_by_pseudo_locked(char *path,
 						   bool exact_match)
 {
-	struct gsh_export *export;
-	struct glist_head *glist;
-	int len_path = strlen(path);
-	int len_export;
-	struct gsh_export *ret_exp = NULL;
-	int len_ret = 0;
-
-	/* Ignore trailing slash in path */
-	if (len_path > 1 && path[len_path - 1] == '/')
-		len_path--;
-
-	glist_for_each(glist, &exportlist) {
-		export = glist_entry(glist, struct gsh_export, exp_list);
-
-		if (export->pseudopath == NULL)
-			continue;
-
-		len_export = strlen(export->pseudopath);
-
-		LogFullDebug(COMPONENT_EXPORT,
-			     "Comparing %s %d to %s %d",
-			     path, len_path,
-			     export->pseudopath, len_export);
-
-		if (len_path == 0 && len_export == 1) {
-			/* Special case for Pseudo root match */
-			ret_exp = export;
-			len_ret = len_export;
-			break;
-		}
-
-		/* A path shorter than the full path cannot match.
-		 * Also skip if this export has a shorter path than
-		 * the previous match.
-		 */
-		if (len_path < len_export ||
-		    len_export < len_ret)
-			continue;
-
-		/* If partial match is not allowed, lengths must be the same */
-		if (exact_match && len_path != len_export)
-			continue;
-
-		/* if the char in pseudopath just after the end of path is not
-		 * '/' it is a name token longer, i.e. /mnt/foo != /mnt/foob/
-		 */
-		if (len_export > 1 &&
-		    path[len_export] != '/' &&
-		    path[len_export] != '\0')
-			continue;
+	struct gsh_export *ret_exp;
 
-		/* we agree on size, now compare the leading substring
-		 */
-		if (strncmp(export->pseudopath, path, len_export)
-		    == 0) {
-			ret_exp = export;
-			len_ret = len_export;
-
-			/* If we have found an exact match, exit loop. */
-			if (len_export == len_path)
-				break;
-		}
-	}
+	ret_exp = export_path_lookup(EXPORT_PSEUDO, path, exact_match);
 
 	if (ret_exp != NULL)
 		get_gsh_export_ref(ret_exp);
@@ -620,7 +752,12 @@ bool mount_gsh_export(struct gsh_export *exp)
 
 void put_gsh_export(struct gsh_export *export)
 {
-	int64_t refcount = atomic_dec_int64_t(&export->refcnt);
+	int64_t refcount;
+
+	if (export_ref_slot_add(export, -1))
+		return;
+
+	refcount = atomic_dec_int64_t(&export->refcnt);
 
 	if (refcount != 0) {
 		assert(refcount > 0);
@@ -663,15 +800,22 @@ void remove_gsh_export(uint16_t export_id)
 
 		/* Remove the export from the export list */
 		glist_del(&export->exp_list);
+		export_path_remove(export);
 
 		/* No new references will be granted. Idempotent. */
 		export->export_status = EXPORT_STALE;
+		export_perms_changed();
 	}
 
 	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
 
 	/* removal has a once-only semantic */
 	if (export != NULL) {
+		export_ref_seal(export);
+
+		/* let the connections go of it */
+		nfs_rpc_drop_export(export);
+
 		if (export->has_pnfs_ds) {
 			/* once-only, so no need for lock here */
 			export->has_pnfs_ds = false;
@@ -711,6 +855,50 @@ bool foreach_gsh_export(bool(*cb) (struct gsh_export *exp, void *state),
 	return rc;
 }
 
+/**
+ * @brief Do the callback on each export, the export manager unlocked
+ *
+ * The exports are taken, with a reference, under the lock, which is
+ * released before the callbacks run.  For the DBus readers, so that
+ * a slow reply doesn't hold up lookups and the admin methods.
+ *
+ * @param cb    [IN] Callback function
+ * @param state [IN] param block to pass
+ */
+
+bool foreach_gsh_export_snapshot(bool(*cb) (struct gsh_export *exp,
+					     void *state),
+				 void *state)
+{
+	struct glist_head *glist;
+	struct gsh_export **exports = NULL;
+	size_t count = 0, size = 0, i;
+	bool rc = true;
+
+	PTHREAD_RWLOCK_rdlock(&export_by_id.lock);
+	glist_for_each(glist, &exportlist) {
+		if (count == size) {
+			size = size ? size * 2 : 64;
+			exports = gsh_realloc(exports,
+					      size * sizeof(*exports));
+		}
+		exports[count] = glist_entry(glist, struct gsh_export,
+					     exp_list);
+		get_gsh_export_ref(exports[count]);
+		count++;
+	}
+	PTHREAD_RWLOCK_unlock(&export_by_id.lock);
+
+	for (i = 0; i < count; i++) {
+		if (rc)
+			rc = cb(exports[i], state);
+		put_gsh_export(exports[i]);
+	}
+
+	gsh_free(exports);
+	return rc;
+}
+
 bool remove_one_export(struct gsh_export *export, void *state)
 {
 	export_add_to_unexport_work_locked(export);
@@ -726,6 +914,9 @@ void remove_all_exports(void)
 	struct gsh_export *export;
 	struct root_op_context root_op_context;
 
+	/* Let the exports removed earlier go first */
+	unexport_async_shutdown();
+
 	/* Initialize req_ctx */
 	init_root_op_context(&root_op_context, NULL, NULL,
 				NFS_V4, 0, NFS_REQUEST);
@@ -1089,8 +1280,9 @@ static bool gsh_export_removeexport(DBusMessageIter *args,
 				       "Cannot remove export with id 0");
 			goto out;
 		}
-		unexport(export);
-		LogInfo(COMPONENT_EXPORT, "Removed export with id %d",
+		unexport_async(export);
+		LogInfo(COMPONENT_EXPORT,
+			"Removed export with id %d, releasing its state and cache in the background",
 			export->export_id);
 
 		put_gsh_export(export);
@@ -1229,7 +1421,7 @@ static bool gsh_export_showexports(DBusMessageIter *args,
 					 "(qsbbbbbbbb(tt))",
 					 &iter_state.export_iter);
 
-	(void)foreach_gsh_export(export_to_dbus, (void *)&iter_state);
+	(void)foreach_gsh_export_snapshot(export_to_dbus, (void *)&iter_state);
 
 	dbus_message_iter_close_container(&iter, &iter_state.export_iter);
 	return true;
@@ -1430,12 +1622,80 @@ static struct gsh_dbus_method export_update_export = {
 		 END_ARG_LIST}
 };
 
+static const char *const unexport_phase_names[] = {
+	[UNEXPORT_NONE] = "none",
+	[UNEXPORT_QUEUED] = "queued",
+	[UNEXPORT_STATE] = "state",
+	[UNEXPORT_CACHE] = "cache",
+};
+
+static void unexport_to_dbus(struct gsh_export *export, void *state)
+{
+	DBusMessageIter *array_iter = state;
+	DBusMessageIter struct_iter;
+	const char *path = export->fullpath;
+	const char *phase =
+	    unexport_phase_names[atomic_fetch_uint32_t(&export->unexport_phase)];
+	uint64_t released;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT16,
+				       &export->export_id);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &path);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &phase);
+	released = atomic_fetch_uint64_t(&export->unexport_state);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &released);
+	released = atomic_fetch_uint64_t(&export->unexport_entries);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &released);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/**
+ * @brief List the exports removed but still being released
+ *
+ * For each: id, path, phase (queued, state or cache), the locks,
+ * states and shares released, then the cache entries.
+ */
+
+static bool gsh_export_getunexports(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	DBusMessageIter iter, array_iter;
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_append_timestamp(&iter, &timestamp);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(qsstt)",
+					 &array_iter);
+	foreach_unexport_pending(unexport_to_dbus, &array_iter);
+	dbus_message_iter_close_container(&iter, &array_iter);
+
+	return true;
+}
+
+static struct gsh_dbus_method export_get_unexports = {
+	.name = "GetUnexports",
+	.method = gsh_export_getunexports,
+	.args = {TIMESTAMP_REPLY,
+		 {
+		  .name = "unexports",
+		  .type = "a(qsstt)",
+		  .direction = "out"},
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method *export_mgr_methods[] = {
 	&export_add_export,
 	&export_remove_export,
 	&export_display_export,
 	&export_show_exports,
 	&export_update_export,
+	&export_get_unexports,
 	NULL
 };
 
@@ -1683,9 +1943,9 @@ static bool get_nfsv_global_fast_ops(DBusMessageIter *args,
 	return true;
 }
 
-static bool show_cache_inode_stats(DBusMessageIter *args,
-				   DBusMessage *reply,
-				   DBusError *error)
+static bool get_io_bufpool_stats(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
 {
 	bool success = true;
 	char *errormsg = "OK";
@@ -1694,89 +1954,707 @@ static bool show_cache_inode_stats(DBusMessageIter *args,
 	dbus_message_iter_init_append(reply, &iter);
 	dbus_status_reply(&iter, success, errormsg);
 
-	mdcache_dbus_show(&iter);
+	server_dbus_io_bufpool(&iter);
 
 	return true;
 }
 
-static struct gsh_dbus_method export_show_v41_layouts = {
-	.name = "GetNFSv41Layouts",
-	.method = get_nfsv41_export_layouts,
-	.args = {EXPORT_ID_ARG,
-		 STATUS_REPLY,
-		 TIMESTAMP_REPLY,
-		 LAYOUTS_REPLY,
-		 END_ARG_LIST}
-};
-
-#ifdef _USE_9P
-/**
- * DBUS method to report 9p I/O statistics
- *
- */
-static bool get_9p_export_io(DBusMessageIter *args,
-			     DBusMessage *reply,
-			     DBusError *error)
+static bool get_pool_stats(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
 {
-	struct gsh_export *export = NULL;
-	struct export_stats *export_st = NULL;
 	bool success = true;
 	char *errormsg = "OK";
 	DBusMessageIter iter;
 
 	dbus_message_iter_init_append(reply, &iter);
-	export = lookup_export(args, &errormsg);
-	if (export == NULL) {
-		success = false;
-	} else {
-		export_st = container_of(export, struct export_stats, export);
-		if (export_st->st._9p == NULL) {
-			success = false;
-			errormsg = "Export does not have any 9p activity";
-		}
-	}
 	dbus_status_reply(&iter, success, errormsg);
-	if (success)
-		server_dbus_9p_iostats(export_st->st._9p, &iter);
 
-	if (export != NULL)
-		put_gsh_export(export);
+	server_dbus_pools(&iter);
+
 	return true;
 }
 
-static struct gsh_dbus_method export_show_9p_io = {
-	.name = "Get9pIO",
-	.method = get_9p_export_io,
-	.args = {EXPORT_ID_ARG,
-		 STATUS_REPLY,
-		 TIMESTAMP_REPLY,
-		 IOSTATS_REPLY,
-		 END_ARG_LIST}
-};
-
-/**
- * DBUS method to report 9p protocol operation statistics
- *
- */
-static bool get_9p_export_op_stats(DBusMessageIter *args,
-				   DBusMessage *reply,
-				   DBusError *error)
+#ifdef USE_MEM_ACCOUNTING
+static bool get_memory_stats(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
 {
-	struct gsh_export *export = NULL;
-	struct export_stats *export_st = NULL;
-	u8 opcode;
 	bool success = true;
 	char *errormsg = "OK";
 	DBusMessageIter iter;
 
 	dbus_message_iter_init_append(reply, &iter);
-	export = lookup_export(args, &errormsg);
-	if (export == NULL) {
-		success = false;
-	} else {
-		export_st = container_of(export, struct export_stats, export);
-		if (export_st->st._9p == NULL) {
-			success = false;
+	dbus_status_reply(&iter, success, errormsg);
+
+	mem_account_dbus(&iter);
+
+	return true;
+}
+#endif
+
+static bool get_hashtable_stats(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	server_dbus_hashtables(&iter);
+
+	return true;
+}
+
+static bool get_read_plus_stats(DBusMessageIter *args,
+				DBusMessage *reply,
+				DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	server_dbus_read_plus(&iter);
+
+	return true;
+}
+
+static bool get_layoutrecall_stats(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	server_dbus_layoutrecall(&iter);
+
+	return true;
+}
+
+static bool get_ff_ds_stats(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	server_dbus_ff_ds(&iter);
+
+	return true;
+}
+
+/**
+ * DBUS method to report the busiest clients and files
+ */
+static bool get_top_n(DBusMessageIter *args,
+		      DBusMessage *reply,
+		      DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	uint32_t count = 10;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		if (dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+			success = false;
+			errormsg = "count is not a uint32";
+		} else {
+			dbus_message_iter_get_basic(args, &count);
+		}
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_topn(count, &iter);
+
+	return true;
+}
+
+static bool get_worker_stats(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	server_dbus_workers(&iter);
+
+	return true;
+}
+
+static bool get_xprt_stats(DBusMessageIter *args,
+			   DBusMessage *reply,
+			   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	nfs_rpc_dbus_xprts(&iter);
+
+	return true;
+}
+
+static bool get_drc_stats(DBusMessageIter *args,
+			  DBusMessage *reply,
+			  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	server_dbus_drc(&iter);
+
+	return true;
+}
+
+static bool get_group_cache_stats(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	server_dbus_uid2grp(&iter);
+
+	return true;
+}
+
+/**
+ * DBUS method to report global fd hits and misses of an export
+ *
+ */
+
+static bool get_fd_cache_stats(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		server_dbus_fd_cache(export, &iter);
+		put_gsh_export(export);
+	}
+	return true;
+}
+
+/**
+ * DBUS method to report read-ahead of an export
+ *
+ */
+
+static bool get_read_ahead_stats(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		server_dbus_read_ahead(export, &iter);
+		put_gsh_export(export);
+	}
+	return true;
+}
+
+/**
+ * DBUS method to report the latency histograms of an export
+ *
+ */
+
+static bool get_export_latency(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		server_dbus_latency(container_of(export, struct export_stats,
+						 export),
+				    &iter);
+		put_gsh_export(export);
+	}
+	return true;
+}
+
+/**
+ * DBUS method to report the latency histograms of the server
+ *
+ */
+
+static bool get_global_latency(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	global_dbus_latency(&iter);
+
+	return true;
+}
+
+/**
+ * DBUS method to report the op latency histograms of an export
+ *
+ */
+
+static bool get_export_op_latency(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		export_st = container_of(export, struct export_stats, export);
+		server_dbus_op_latency(&export_st->st, &iter);
+		put_gsh_export(export);
+	}
+	return true;
+}
+
+/**
+ * DBUS method to zero the op latency histograms of an export
+ *
+ */
+
+static bool reset_export_op_latency(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else {
+		export_st = container_of(export, struct export_stats, export);
+		server_stats_reset_op_latency(&export_st->st);
+		put_gsh_export(export);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+/**
+ * DBUS method to report the sub-FSAL call latencies of an export
+ *
+ */
+
+static bool get_export_fsal_latency(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL)
+		success = false;
+	dbus_status_reply(&iter, success, errormsg);
+	if (success) {
+		export_st = container_of(export, struct export_stats, export);
+		server_dbus_fsal_latency(&export_st->st, &iter);
+		put_gsh_export(export);
+	}
+	return true;
+}
+
+/**
+ * DBUS method to zero the sub-FSAL call latencies of an export
+ *
+ */
+
+static bool reset_export_fsal_latency(DBusMessageIter *args,
+				      DBusMessage *reply,
+				      DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else {
+		export_st = container_of(export, struct export_stats, export);
+		server_stats_reset_fsal_latency(&export_st->st);
+		put_gsh_export(export);
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static bool get_global_op_latency(DBusMessageIter *args,
+				  DBusMessage *reply,
+				  DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	global_dbus_op_latency(&iter);
+
+	return true;
+}
+
+static bool reset_global_op_latency(DBusMessageIter *args,
+				    DBusMessage *reply,
+				    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	global_reset_op_latency();
+
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static bool show_cache_inode_stats(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	mdcache_dbus_show(&iter);
+
+	return true;
+}
+
+static bool show_cache_inode_lanes(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	mdcache_dbus_show_lanes(&iter);
+
+	return true;
+}
+
+static bool show_cache_inode_hot(DBusMessageIter *args,
+				 DBusMessage *reply,
+				 DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	uint32_t count = 10;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		if (dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+			success = false;
+			errormsg = "count is not a uint32";
+		} else {
+			dbus_message_iter_get_basic(args, &count);
+		}
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		mdcache_dbus_show_hot(count, &iter);
+
+	return true;
+}
+
+#ifdef USE_LOCK_PROFILE
+static bool get_lock_profile(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_status_reply(&iter, success, errormsg);
+
+	lock_profile_dbus(&iter);
+
+	return true;
+}
+
+static bool reset_lock_profile(DBusMessageIter *args,
+			       DBusMessage *reply,
+			       DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	lock_profile_reset();
+
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+#endif
+
+#ifdef USE_CPU_PROFILE
+static bool start_cpu_profile(DBusMessageIter *args,
+			      DBusMessage *reply,
+			      DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	uint32_t hz = 99, samples = 65536;
+	int rc;
+
+	dbus_message_iter_init_append(reply, &iter);
+	if (args != NULL) {
+		if (dbus_message_iter_get_arg_type(args) != DBUS_TYPE_UINT32) {
+			success = false;
+			errormsg = "hz is not a uint32";
+			goto out;
+		}
+		dbus_message_iter_get_basic(args, &hz);
+		if (dbus_message_iter_next(args)) {
+			if (dbus_message_iter_get_arg_type(args) !=
+			    DBUS_TYPE_UINT32) {
+				success = false;
+				errormsg = "samples is not a uint32";
+				goto out;
+			}
+			dbus_message_iter_get_basic(args, &samples);
+		}
+	}
+
+	rc = cpu_profile_start(hz, samples);
+	if (rc != 0) {
+		success = false;
+		errormsg = rc == EINVAL
+			? "hz is 1 to 1000, samples 1 to 262144"
+			: strerror(rc);
+	}
+
+ out:
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static bool stop_cpu_profile(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+
+	cpu_profile_stop();
+
+	dbus_status_reply(&iter, success, errormsg);
+	return true;
+}
+
+static bool get_cpu_profile(DBusMessageIter *args,
+			    DBusMessage *reply,
+			    DBusError *error)
+{
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+	dbus_bool_t by[2] = {false, false};
+	int i;
+
+	dbus_message_iter_init_append(reply, &iter);
+	for (i = 0; args != NULL && i < 2; i++) {
+		if (dbus_message_iter_get_arg_type(args) !=
+		    DBUS_TYPE_BOOLEAN) {
+			success = false;
+			errormsg = "by_export and by_client are booleans";
+			break;
+		}
+		dbus_message_iter_get_basic(args, &by[i]);
+		if (!dbus_message_iter_next(args))
+			break;
+	}
+
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		cpu_profile_dbus(&iter, by[0], by[1]);
+
+	return true;
+}
+#endif
+
+static struct gsh_dbus_method export_show_v41_layouts = {
+	.name = "GetNFSv41Layouts",
+	.method = get_nfsv41_export_layouts,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAYOUTS_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef _USE_9P
+/**
+ * DBUS method to report 9p I/O statistics
+ *
+ */
+static bool get_9p_export_io(DBusMessageIter *args,
+			     DBusMessage *reply,
+			     DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else {
+		export_st = container_of(export, struct export_stats, export);
+		if (export_st->st._9p == NULL) {
+			success = false;
+			errormsg = "Export does not have any 9p activity";
+		}
+	}
+	dbus_status_reply(&iter, success, errormsg);
+	if (success)
+		server_dbus_9p_iostats(export_st->st._9p, &iter);
+
+	if (export != NULL)
+		put_gsh_export(export);
+	return true;
+}
+
+static struct gsh_dbus_method export_show_9p_io = {
+	.name = "Get9pIO",
+	.method = get_9p_export_io,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IOSTATS_REPLY,
+		 END_ARG_LIST}
+};
+
+/**
+ * DBUS method to report 9p protocol operation statistics
+ *
+ */
+static bool get_9p_export_op_stats(DBusMessageIter *args,
+				   DBusMessage *reply,
+				   DBusError *error)
+{
+	struct gsh_export *export = NULL;
+	struct export_stats *export_st = NULL;
+	u8 opcode;
+	bool success = true;
+	char *errormsg = "OK";
+	DBusMessageIter iter;
+
+	dbus_message_iter_init_append(reply, &iter);
+	export = lookup_export(args, &errormsg);
+	if (export == NULL) {
+		success = false;
+	} else {
+		export_st = container_of(export, struct export_stats, export);
+		if (export_st->st._9p == NULL) {
+			success = false;
 			errormsg = "Export does not have any 9p activity";
 		}
 	}
@@ -1832,6 +2710,210 @@ static struct gsh_dbus_method global_show_fast_ops = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method global_show_drc = {
+	.name = "GetDRCStats",
+	.method = get_drc_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 DRC_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_group_cache = {
+	.name = "GetGroupCacheStats",
+	.method = get_group_cache_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 GROUP_CACHE_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_top_n = {
+	.name = "GetTopN",
+	.method = get_top_n,
+	.args = {{.name = "count",
+		  .type = "u",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 TOPN_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_workers = {
+	.name = "GetWorkerStats",
+	.method = get_worker_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 WORKER_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_xprts = {
+	.name = "GetConnections",
+	.method = get_xprt_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 XPRTS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_io_bufpool = {
+	.name = "GetIOBufPool",
+	.method = get_io_bufpool_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 IO_BUFPOOL_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_pools = {
+	.name = "GetPoolStats",
+	.method = get_pool_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 POOL_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef USE_MEM_ACCOUNTING
+static struct gsh_dbus_method global_show_memory = {
+	.name = "GetMemoryStats",
+	.method = get_memory_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 MEM_STATS_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
+static struct gsh_dbus_method global_show_hashtables = {
+	.name = "GetHashTables",
+	.method = get_hashtable_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 HASHTABLES_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_read_plus = {
+	.name = "GetReadPlusStats",
+	.method = get_read_plus_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 READ_PLUS_STATS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_layoutrecall = {
+	.name = "GetLayoutRecallStats",
+	.method = get_layoutrecall_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LAYOUTRECALL_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_ff_ds = {
+	.name = "GetFlexFilesDSStats",
+	.method = get_ff_ds_stats,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 FF_DS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_fd_cache = {
+	.name = "GetFDCache",
+	.method = get_fd_cache_stats,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 FD_CACHE_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_read_ahead = {
+	.name = "GetReadAhead",
+	.method = get_read_ahead_stats,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 READ_AHEAD_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_latency = {
+	.name = "GetLatency",
+	.method = get_export_latency,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LATENCY_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_latency = {
+	.name = "GetGlobalLatency",
+	.method = get_global_latency,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LATENCY_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_op_latency = {
+	.name = "GetOpLatency",
+	.method = get_export_op_latency,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 OP_LATENCY_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_reset_op_latency = {
+	.name = "ResetOpLatency",
+	.method = reset_export_op_latency,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_show_fsal_latency = {
+	.name = "GetFsalLatency",
+	.method = get_export_fsal_latency,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 FSAL_LATENCY_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method export_reset_fsal_latency = {
+	.name = "ResetFsalLatency",
+	.method = reset_export_fsal_latency,
+	.args = {EXPORT_ID_ARG,
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_show_op_latency = {
+	.name = "GetGlobalOpLatency",
+	.method = get_global_op_latency,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 OP_LATENCY_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method global_reset_op_latency_method = {
+	.name = "ResetGlobalOpLatency",
+	.method = reset_global_op_latency,
+	.args = {STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
 static struct gsh_dbus_method cache_inode_show = {
 	.name = "ShowCacheInode",
 	.method = show_cache_inode_stats,
@@ -1841,6 +2923,82 @@ static struct gsh_dbus_method cache_inode_show = {
 		 END_ARG_LIST}
 };
 
+static struct gsh_dbus_method cache_inode_show_lanes = {
+	.name = "ShowCacheInodeLanes",
+	.method = show_cache_inode_lanes,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CACHE_LANES_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method cache_inode_show_hot = {
+	.name = "ShowCacheInodeHot",
+	.method = show_cache_inode_hot,
+	.args = {{.name = "count",
+		  .type = "u",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CACHE_HOT_REPLY,
+		 END_ARG_LIST}
+};
+
+#ifdef USE_LOCK_PROFILE
+static struct gsh_dbus_method lock_profile_show = {
+	.name = "GetLockProfile",
+	.method = get_lock_profile,
+	.args = {STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 LOCK_PROFILE_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method lock_profile_reset_method = {
+	.name = "ResetLockProfile",
+	.method = reset_lock_profile,
+	.args = {STATUS_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
+#ifdef USE_CPU_PROFILE
+static struct gsh_dbus_method cpu_profile_start_method = {
+	.name = "StartCpuProfile",
+	.method = start_cpu_profile,
+	.args = {{.name = "hz",
+		  .type = "u",
+		  .direction = "in"},
+		 {.name = "samples",
+		  .type = "u",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method cpu_profile_stop_method = {
+	.name = "StopCpuProfile",
+	.method = stop_cpu_profile,
+	.args = {STATUS_REPLY,
+		 END_ARG_LIST}
+};
+
+static struct gsh_dbus_method cpu_profile_show = {
+	.name = "GetCpuProfile",
+	.method = get_cpu_profile,
+	.args = {{.name = "by_export",
+		  .type = "b",
+		  .direction = "in"},
+		 {.name = "by_client",
+		  .type = "b",
+		  .direction = "in"},
+		 STATUS_REPLY,
+		 TIMESTAMP_REPLY,
+		 CPU_PROFILE_REPLY,
+		 END_ARG_LIST}
+};
+#endif
+
 /**
  * @brief Report all IO stats of all exports in one call
  *
@@ -1880,7 +3038,8 @@ static bool get_nfs_io(DBusMessageIter *args,
 	dbus_message_iter_open_container(&reply_iter, DBUS_TYPE_ARRAY,
 					 NFS_ALL_IO_REPLY_ARRAY_TYPE,
 					 &array_iter);
-	(void) foreach_gsh_export(&get_all_export_io, (void *) &array_iter);
+	(void) foreach_gsh_export_snapshot(&get_all_export_io,
+					   (void *) &array_iter);
 	dbus_message_iter_close_container(&reply_iter, &array_iter);
 
 	return true;
@@ -1907,7 +3066,42 @@ static struct gsh_dbus_method *export_stats_methods[] = {
 #endif
 	&global_show_total_ops,
 	&global_show_fast_ops,
+	&global_show_io_bufpool,
+	&global_show_pools,
+#ifdef USE_MEM_ACCOUNTING
+	&global_show_memory,
+#endif
+	&global_show_hashtables,
+	&global_show_read_plus,
+	&global_show_layoutrecall,
+	&global_show_ff_ds,
+	&global_show_drc,
+	&global_show_group_cache,
+	&global_show_top_n,
+	&global_show_workers,
+	&global_show_xprts,
 	&cache_inode_show,
+	&cache_inode_show_lanes,
+	&cache_inode_show_hot,
+	&export_show_fd_cache,
+	&export_show_read_ahead,
+	&export_show_latency,
+	&global_show_latency,
+	&export_show_op_latency,
+	&export_reset_op_latency,
+	&global_show_op_latency,
+	&global_reset_op_latency_method,
+	&export_show_fsal_latency,
+	&export_reset_fsal_latency,
+#ifdef USE_LOCK_PROFILE
+	&lock_profile_show,
+	&lock_profile_reset_method,
+#endif
+#ifdef USE_CPU_PROFILE
+	&cpu_profile_start_method,
+	&cpu_profile_stop_method,
+	&cpu_profile_show,
+#endif
 	&export_show_all_io,
 	NULL
 };
@@ -1939,6 +3133,7 @@ void dbus_export_init(void)
 void export_pkginit(void)
 {
 	pthread_rwlockattr_t rwlock_attr;
+	int i, j;
 
 	pthread_rwlockattr_init(&rwlock_attr);
 #ifdef GLIBC
@@ -1951,6 +3146,13 @@ void export_pkginit(void)
 	memset(&export_by_id.cache, 0, sizeof(export_by_id.cache));
 
 	glist_init(&exportlist);
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < 2; j++) {
+			avltree_init(&export_path_roots[i][j].children,
+				     export_path_cmpf, 0);
+			glist_init(&export_path_roots[i][j].exports);
+		}
+	}
 	glist_init(&mount_work);
 	glist_init(&unexport_work);
 }
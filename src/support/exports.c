@@ -52,6 +52,8 @@
 #include "pnfs_utils.h"
 #include "netgroup_cache.h"
 #include "mdcache.h"
+#include "export_index.h"
+#include "fridgethr.h"
 
 /**
  * @brief Protect EXPORT_DEFAULTS structure for dynamic update.
@@ -984,6 +986,14 @@ static inline void update_atomic_fields(struct gsh_export *export,
 	atomic_store_uint32_t(&export->options, src->options);
 	atomic_store_uint32_t(&export->options_set, src->options_set);
 	atomic_store_int32_t(&export->expire_time_attr, src->expire_time_attr);
+	atomic_store_int32_t(&export->expire_time_attr_min,
+			     src->expire_time_attr_min);
+	atomic_store_int32_t(&export->expire_time_attr_max,
+			     src->expire_time_attr_max);
+	atomic_store_uint32_t(&export->fq_weight, src->fq_weight);
+	atomic_store_uint64_t(&export->fq_max_ops, src->fq_max_ops);
+	atomic_store_uint64_t(&export->fq_max_bytes, src->fq_max_bytes);
+	atomic_store_uint32_t(&export->deleg_policy, src->deleg_policy);
 }
 
 /**
@@ -999,6 +1009,9 @@ enum export_commit_type {
 	update_export,
 };
 
+/* Fingerprint of the EXPORT_DEFAULTS block in force, 0 if none */
+static uint64_t export_defaults_hash;
+
 static int export_commit_common(void *node, void *link_mem, void *self_struct,
 				struct config_error_type *err_type,
 				enum export_commit_type commit_type)
@@ -1159,6 +1172,15 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 
 		glist_swap_lists(&probe_exp->clients, &export->clients);
 
+		/* The old index points into the old list */
+		export_index_free(probe_exp->client_index);
+		probe_exp->client_index =
+			export_index_build(&probe_exp->clients);
+		export_perms_changed();
+
+		probe_exp->config_hash =
+			config_block_hash(node, export_defaults_hash);
+
 		PTHREAD_RWLOCK_unlock(&probe_exp->lock);
 
 		/* We will need to dispose of the config export since we
@@ -1184,6 +1206,12 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		put_gsh_export(probe_exp);
 		err_type->exists = true;
 		errcnt++;
+	} else if (unexport_pending(export->export_id)) {
+		LogCrit(COMPONENT_CONFIG,
+			"Export %d is still being unexported",
+			export->export_id);
+		err_type->invalid = true;
+		errcnt++;
 	}
 
 	/* export->fsal_export is valid iff fsal_cfg_commit succeeds.
@@ -1251,6 +1279,10 @@ static int export_commit_common(void *node, void *link_mem, void *self_struct,
 		return errcnt;  /* have errors. don't init or load a fsal */
 	}
 
+	/* Not yet visible, no lock needed */
+	export->client_index = export_index_build(&export->clients);
+	export->config_hash = config_block_hash(node, export_defaults_hash);
+
 	if (!insert_gsh_export(export)) {
 		LogCrit(COMPONENT_CONFIG,
 			"Export id %d already in use.",
@@ -1424,6 +1456,7 @@ static int export_defaults_commit(void *node, void *link_mem,
 	/* Update under lock. */
 	PTHREAD_RWLOCK_wrlock(&export_opt_lock);
 	export_opt = export_opt_cfg;
+	export_perms_changed();
 	PTHREAD_RWLOCK_unlock(&export_opt_lock);
 
 	return 0;
@@ -1546,6 +1579,16 @@ static struct config_item_list delegations[] = {
 	CONFIG_LIST_EOL
 };
 
+/**
+ * @brief Policies for the Delegation_Policy parameter
+ */
+
+static struct config_item_list deleg_policies[] = {
+	CONFIG_LIST_TOK("Conservative", DELEG_POLICY_CONSERVATIVE),
+	CONFIG_LIST_TOK("Aggressive", DELEG_POLICY_AGGRESSIVE),
+	CONFIG_LIST_EOL
+};
+
 struct config_item_list deleg_types[] =  {
 	CONFIG_LIST_TOK("NONE", FSAL_OPTION_NO_DELEGATIONS),
 	CONFIG_LIST_TOK("Read", FSAL_OPTION_FILE_READ_DELEG),
@@ -1718,9 +1761,27 @@ static struct config_item fsal_params[] = {
 	CONF_ITEM_BOOLBIT_SET("Disable_ACL",				\
 		false, EXPORT_OPTION_DISABLE_ACL,			\
 		_struct_, options, options_set),			\
+	CONF_ITEM_BOOLBIT_SET("Latency_Histograms",			\
+		false, EXPORT_OPTION_LATENCY_HIST,			\
+		_struct_, options, options_set),			\
+	CONF_ITEM_BOOLBIT_SET("Immutable",				\
+		false, EXPORT_OPTION_IMMUTABLE,				\
+		_struct_, options, options_set),			\
 	CONF_ITEM_I32_SET("Attr_Expiration_Time", -1, INT32_MAX, 60,	\
 		       _struct_, expire_time_attr,			\
-		       EXPORT_OPTION_EXPIRE_SET, options_set)
+		       EXPORT_OPTION_EXPIRE_SET, options_set),		\
+	CONF_ITEM_I32("Attr_Expiration_Min", 0, INT32_MAX, 1,		\
+		       _struct_, expire_time_attr_min),			\
+	CONF_ITEM_I32("Attr_Expiration_Max", 0, INT32_MAX, 0,		\
+		       _struct_, expire_time_attr_max),			\
+	CONF_ITEM_UI32("FairShare_Weight", 1, 10000,			\
+		       FAIRSHARE_WEIGHT_DEFAULT, _struct_, fq_weight),	\
+	CONF_ITEM_UI64("Max_Ops_Per_Sec", 0, UINT32_MAX, 0,		\
+		       _struct_, fq_max_ops),				\
+	CONF_ITEM_UI64("Max_Bytes_Per_Sec", 0, 1024ULL*1024*1024*1024,	\
+		       0, _struct_, fq_max_bytes),			\
+	CONF_ITEM_TOKEN("Delegation_Policy", DELEG_POLICY_CONSERVATIVE,	\
+			deleg_policies, _struct_, deleg_policy)
 
 /**
  * @brief Table of EXPORT block parameters
@@ -1975,11 +2036,39 @@ err_out:
  *         the number of export entries else.
  */
 
+/**
+ * @brief Fingerprint of the EXPORT_DEFAULTS block of a parse tree
+ *
+ * @return The fingerprint, 0 if there is no such block.
+ */
+
+static uint64_t export_defaults_fingerprint(config_file_t in_config,
+					    struct config_error_type *err_type)
+{
+	struct config_node_list *config_list, *lp, *lp_next;
+	uint64_t hash;
+
+	if (find_config_nodes(in_config, "EXPORT_DEFAULTS", &config_list,
+			      err_type) != 0)
+		return 0;
+
+	hash = config_block_hash(config_list->tree_node, 0);
+
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		gsh_free(lp);
+	}
+
+	return hash;
+}
+
 int ReadExports(config_file_t in_config,
 		struct config_error_type *err_type)
 {
 	int rc, num_exp;
 
+	export_defaults_hash = export_defaults_fingerprint(in_config, err_type);
+
 	rc = load_config_from_parse(in_config,
 				    &export_defaults_param,
 				    NULL,
@@ -2009,9 +2098,43 @@ int ReadExports(config_file_t in_config,
 	return num_exp;
 }
 
+/* Fingerprints of the config of the exports, sorted */
+struct export_hashes {
+	uint64_t *hash;
+	size_t count;
+	size_t size;
+};
+
+static bool collect_export_hash(struct gsh_export *export, void *state)
+{
+	struct export_hashes *hashes = state;
+
+	if (export->config_hash == 0)
+		return true;
+
+	if (hashes->count == hashes->size) {
+		hashes->size = hashes->size ? hashes->size * 2 : 64;
+		hashes->hash = gsh_realloc(hashes->hash,
+					   hashes->size * sizeof(uint64_t));
+	}
+	hashes->hash[hashes->count++] = export->config_hash;
+	return true;
+}
+
+static int hash_cmp(const void *a, const void *b)
+{
+	uint64_t ha = *(const uint64_t *)a, hb = *(const uint64_t *)b;
+
+	return ha < hb ? -1 : ha > hb;
+}
+
 /**
  * @brief Reread the export entries from the parsed configuration file.
  *
+ * Only the EXPORT blocks that changed since their export was last
+ * committed go through the update, the others are left alone.  All
+ * of them do when EXPORT_DEFAULTS changed.
+ *
  * @param[in]  in_config    The file that contains the export list
  *
  * @return A negative value on error,
@@ -2021,10 +2144,15 @@ int ReadExports(config_file_t in_config,
 int reread_exports(config_file_t in_config,
 		   struct config_error_type *err_type)
 {
-	int rc, num_exp;
+	struct config_node_list *config_list, *lp, *lp_next;
+	struct export_hashes hashes = {NULL, 0, 0};
+	uint64_t defaults_hash, hash;
+	int rc, num_exp = 0, unchanged = 0;
 
 	LogInfo(COMPONENT_CONFIG, "Reread exports");
 
+	defaults_hash = export_defaults_fingerprint(in_config, err_type);
+
 	rc = load_config_from_parse(in_config,
 				    &export_defaults_param,
 				    NULL,
@@ -2036,17 +2164,47 @@ int reread_exports(config_file_t in_config,
 		return -1;
 	}
 
-	num_exp = load_config_from_parse(in_config,
-					 &update_export_param,
-					 NULL,
-					 false,
-					 err_type);
+	if (defaults_hash == export_defaults_hash) {
+		(void)foreach_gsh_export(collect_export_hash, &hashes);
+		if (hashes.count > 1)
+			qsort(hashes.hash, hashes.count, sizeof(uint64_t),
+			      hash_cmp);
+	}
+	export_defaults_hash = defaults_hash;
 
-	if (num_exp < 0) {
+	rc = find_config_nodes(in_config, "EXPORT", &config_list, err_type);
+	if (rc == ENOENT) {
+		gsh_free(hashes.hash);
+		return 0;
+	}
+	if (rc != 0) {
 		LogCrit(COMPONENT_CONFIG, "Export block error");
+		gsh_free(hashes.hash);
 		return -1;
 	}
 
+	for (lp = config_list; lp != NULL; lp = lp_next) {
+		lp_next = lp->next;
+		hash = config_block_hash(lp->tree_node, defaults_hash);
+
+		if (hashes.count != 0 &&
+		    bsearch(&hash, hashes.hash, hashes.count,
+			    sizeof(uint64_t), hash_cmp) != NULL) {
+			unchanged++;
+			num_exp++;
+		} else if (load_config_from_node(lp->tree_node,
+						 &update_export_param,
+						 NULL,
+						 false,
+						 err_type) == 0) {
+			num_exp++;
+		}
+		gsh_free(lp);
+	}
+
+	LogInfo(COMPONENT_CONFIG, "%d exports unchanged", unchanged);
+
+	gsh_free(hashes.hash);
 	return num_exp;
 }
 
@@ -2084,6 +2242,8 @@ static void FreeClientList(struct glist_head *clients)
 
 void free_export_resources(struct gsh_export *export)
 {
+	export_index_free(export->client_index);
+	export->client_index = NULL;
 	FreeClientList(&export->clients);
 	if (export->fsal_export != NULL) {
 		struct fsal_module *fsal = export->fsal_export->fsal;
@@ -2113,13 +2273,116 @@ static bool init_export_cb(struct gsh_export *exp, void *state)
 	return !(init_export_root(exp));
 }
 
+/* Exports whose roots are being looked up in parallel */
+struct export_init_work {
+	pthread_mutex_t mtx;
+	pthread_cond_t cond;
+	struct gsh_export **exports;
+	size_t count;
+	size_t size;
+	size_t pending;
+};
+
+static bool collect_export_cb(struct gsh_export *exp, void *state)
+{
+	struct export_init_work *work = state;
+
+	if (work->count == work->size) {
+		work->size = work->size ? work->size * 2 : 64;
+		work->exports = gsh_realloc(work->exports, work->size *
+					    sizeof(struct gsh_export *));
+	}
+	get_gsh_export_ref(exp);
+	work->exports[work->count++] = exp;
+	return true;
+}
+
+static struct export_init_work *export_init_work;
+
+static void init_export_run(struct fridgethr_context *ctx)
+{
+	struct gsh_export *export = ctx->arg;
+	struct export_init_work *work = export_init_work;
+
+	(void)init_export_root(export);
+	put_gsh_export(export);
+
+	PTHREAD_MUTEX_lock(&work->mtx);
+	if (--work->pending == 0)
+		pthread_cond_signal(&work->cond);
+	PTHREAD_MUTEX_unlock(&work->mtx);
+}
+
 /**
  * @brief Initialize exports over a live cache inode and fsal layer
+ *
+ * The roots are looked up by Export_Init_Threads threads, each
+ * lookup_path is independent of the others.  The exports are
+ * collected first: the lookups must not run under export_by_id.lock.
  */
 
 void exports_pkginit(void)
 {
-	foreach_gsh_export(init_export_cb, NULL);
+	struct export_init_work work;
+	struct fridgethr_params frp;
+	struct fridgethr *fr = NULL;
+	size_t i;
+
+	if (nfs_param.core_param.export_init_threads <= 1) {
+		foreach_gsh_export(init_export_cb, NULL);
+		return;
+	}
+
+	memset(&work, 0, sizeof(work));
+	PTHREAD_MUTEX_init(&work.mtx, NULL);
+	PTHREAD_COND_init(&work.cond, NULL);
+	(void)foreach_gsh_export(collect_export_cb, &work);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = MIN(nfs_param.core_param.export_init_threads,
+			  work.count);
+	frp.deferment = fridgethr_defer_queue;
+
+	if (work.count > 1 &&
+	    fridgethr_init(&fr, "export_init", &frp) != 0) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Unable to start the export init threads, looking up the export roots one after the other");
+		fr = NULL;
+	}
+
+	export_init_work = &work;
+	work.pending = work.count;
+
+	for (i = 0; i < work.count; i++) {
+		if (fr != NULL &&
+		    fridgethr_submit(fr, init_export_run,
+				     work.exports[i]) == 0)
+			continue;
+
+		/* No thread for this one, do it here */
+		(void)init_export_root(work.exports[i]);
+		put_gsh_export(work.exports[i]);
+		PTHREAD_MUTEX_lock(&work.mtx);
+		work.pending--;
+		PTHREAD_MUTEX_unlock(&work.mtx);
+	}
+
+	PTHREAD_MUTEX_lock(&work.mtx);
+	while (work.pending != 0)
+		pthread_cond_wait(&work.cond, &work.mtx);
+	PTHREAD_MUTEX_unlock(&work.mtx);
+
+	if (fr != NULL) {
+		if (fridgethr_sync_command(fr, fridgethr_comm_stop, 120) == 0)
+			fridgethr_destroy(fr);
+		else
+			fridgethr_cancel(fr);
+	}
+
+	export_init_work = NULL;
+	gsh_free(work.exports);
+	PTHREAD_COND_destroy(&work.cond);
+	PTHREAD_MUTEX_destroy(&work.mtx);
 }
 
 /**
@@ -2310,12 +2573,16 @@ static inline void clean_up_export(struct gsh_export *export,
 }
 
 /**
- * @brief Release all the export state, including the root object
+ * @brief Get the root object of an export off it
  *
- * @param exp [IN] the export
+ * @param[in]  export The export
+ * @param[out] objp   Its root object, with a reference
+ *
+ * @return false if the export has no root object left.
  */
 
-static void release_export(struct gsh_export *export)
+static bool detach_export_root(struct gsh_export *export,
+			       struct fsal_obj_handle **objp)
 {
 	struct fsal_obj_handle *obj = NULL;
 	fsal_status_t fsal_status;
@@ -2330,7 +2597,7 @@ static void release_export(struct gsh_export *export)
 		LogInfo(COMPONENT_CACHE_INODE,
 			"Export root for export id %d status %s",
 			export->export_id, msg_fsal_err(fsal_status.major));
-		return;
+		return false;
 	}
 
 	/* Make the export unreachable as a root object */
@@ -2350,6 +2617,23 @@ static void release_export(struct gsh_export *export)
 		 "Released root obj %p for path %s on export_id=%d",
 		 obj, export->fullpath, export->export_id);
 
+	*objp = obj;
+	return true;
+}
+
+/**
+ * @brief Release all the export state, including the root object
+ *
+ * @param exp [IN] the export
+ */
+
+static void release_export(struct gsh_export *export)
+{
+	struct fsal_obj_handle *obj;
+
+	if (!detach_export_root(export, &obj))
+		return;
+
 	clean_up_export(export, obj);
 
 	/* Release ref taken above */
@@ -2379,6 +2663,232 @@ void unexport(struct gsh_export *export)
 		release_root_op_context();
 }
 
+/** Background unexports, protected by unexport_mtx */
+static GLIST_HEAD(unexport_list);
+static pthread_mutex_t unexport_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct fridgethr *unexport_fridge;
+
+struct unexport_job {
+	struct gsh_export *export;	/*< With a reference */
+	struct fsal_obj_handle *root_obj;	/*< Likewise */
+};
+
+static void unexport_finish(struct unexport_job *job)
+{
+	struct gsh_export *export = job->export;
+	struct root_op_context root_op_context;
+
+	init_root_op_context(&root_op_context, export, export->fsal_export,
+			     0, 0, UNKNOWN_REQUEST);
+
+	atomic_store_uint32_t(&export->unexport_phase, UNEXPORT_STATE);
+	state_release_export(export);
+
+	atomic_store_uint32_t(&export->unexport_phase, UNEXPORT_CACHE);
+	export->fsal_export->exp_ops.unexport(export->fsal_export,
+					      job->root_obj);
+	job->root_obj->obj_ops.put_ref(job->root_obj);
+
+	release_root_op_context();
+
+	LogInfo(COMPONENT_EXPORT,
+		"Unexported export_id=%d, released %" PRIu64
+		" locks, states and shares and %" PRIu64 " cache entries",
+		export->export_id,
+		atomic_fetch_uint64_t(&export->unexport_state),
+		atomic_fetch_uint64_t(&export->unexport_entries));
+
+	PTHREAD_MUTEX_lock(&unexport_mtx);
+	glist_del(&export->exp_unexport);
+	PTHREAD_MUTEX_unlock(&unexport_mtx);
+
+	put_gsh_export(export);
+	gsh_free(job);
+}
+
+static void unexport_run(struct fridgethr_context *ctx)
+{
+	unexport_finish(ctx->arg);
+}
+
+/**
+ * @brief Unexport, releasing the state and cache of the export later
+ *
+ * The export is made unreachable before returning.  Its state and
+ * cache entries are then released one at a time by a thread of their
+ * own, pausing after each UNEXPORT_CHUNK, so other exports and the
+ * shared objects get their locks in between.  The progress is shown
+ * by GetUnexports of the exportmgr DBus interface.
+ *
+ * @param[in] export The export, the caller keeps its reference
+ */
+void unexport_async(struct gsh_export *export)
+{
+	struct unexport_job *job;
+	struct fsal_obj_handle *obj;
+	struct fridgethr_params frp;
+	bool op_ctx_set = false;
+	struct root_op_context ctx;
+	int rc = -1;
+
+	LogDebug(COMPONENT_EXPORT,
+		 "Unexport %s, Pseduo %s in the background",
+		 export->fullpath, export->pseudopath);
+
+	if (!op_ctx) {
+		init_root_op_context(&ctx, export, export->fsal_export, 0, 0,
+				UNKNOWN_REQUEST);
+		op_ctx_set = true;
+	}
+
+	if (!detach_export_root(export, &obj))
+		goto out;
+
+	job = gsh_malloc(sizeof(*job));
+	get_gsh_export_ref(export);
+	job->export = export;
+	job->root_obj = obj;
+
+	/* Make export unreachable */
+	pseudo_unmount_export(export);
+	remove_gsh_export(export->export_id);
+
+	atomic_store_uint32_t(&export->unexport_phase, UNEXPORT_QUEUED);
+
+	PTHREAD_MUTEX_lock(&unexport_mtx);
+
+	glist_add_tail(&unexport_list, &export->exp_unexport);
+
+	if (unexport_fridge == NULL) {
+		memset(&frp, 0, sizeof(struct fridgethr_params));
+		frp.thr_max = 1;
+		frp.deferment = fridgethr_defer_queue;
+
+		if (fridgethr_init(&unexport_fridge, "unexport", &frp) != 0)
+			unexport_fridge = NULL;
+	}
+
+	if (unexport_fridge != NULL)
+		rc = fridgethr_submit(unexport_fridge, unexport_run, job);
+
+	PTHREAD_MUTEX_unlock(&unexport_mtx);
+
+	if (rc != 0) {
+		LogMajor(COMPONENT_EXPORT,
+			 "Unable to queue the unexport of export_id=%d, unexporting now",
+			 export->export_id);
+		unexport_finish(job);
+	}
+
+out:
+	if (op_ctx_set)
+		release_root_op_context();
+}
+
+/**
+ * @brief Whether an export id is still being unexported
+ */
+bool unexport_pending(uint16_t export_id)
+{
+	struct glist_head *glist;
+	struct gsh_export *export;
+	bool found = false;
+
+	PTHREAD_MUTEX_lock(&unexport_mtx);
+	glist_for_each(glist, &unexport_list) {
+		export = glist_entry(glist, struct gsh_export, exp_unexport);
+		if (export->export_id == export_id) {
+			found = true;
+			break;
+		}
+	}
+	PTHREAD_MUTEX_unlock(&unexport_mtx);
+
+	return found;
+}
+
+/**
+ * @brief Call a function on each export being unexported
+ *
+ * @note The function runs under unexport_mtx.
+ */
+void foreach_unexport_pending(void (*cb)(struct gsh_export *exp,
+					 void *state),
+			      void *state)
+{
+	struct glist_head *glist;
+
+	PTHREAD_MUTEX_lock(&unexport_mtx);
+	glist_for_each(glist, &unexport_list)
+		cb(glist_entry(glist, struct gsh_export, exp_unexport), state);
+	PTHREAD_MUTEX_unlock(&unexport_mtx);
+}
+
+/**
+ * @brief Wait for the background unexports, and stop their thread
+ */
+void unexport_async_shutdown(void)
+{
+	struct fridgethr *fr;
+
+	PTHREAD_MUTEX_lock(&unexport_mtx);
+	fr = unexport_fridge;
+	unexport_fridge = NULL;
+	PTHREAD_MUTEX_unlock(&unexport_mtx);
+
+	if (fr == NULL)
+		return;
+
+	/* Stopping runs what is queued first */
+	if (fridgethr_sync_command(fr, fridgethr_comm_stop, 0) == 0)
+		fridgethr_destroy(fr);
+	else
+		LogMajor(COMPONENT_EXPORT,
+			 "Failed to stop the unexport thread");
+}
+
+/**
+ * @brief Match a netgroup or wildcard client entry
+ *
+ * @param[in] client   Entry to check
+ * @param[in] hostaddr IPv4 host
+ *
+ * @return true if the host is in the netgroup or matches the wildcard.
+ */
+static bool client_match_name(exportlist_client_entry_t *client,
+			      sockaddr_t *hostaddr)
+{
+	int rc;
+	char hostname[MAXHOSTNAMELEN + 1];
+	char ipstring[SOCK_NAME_MAX + 1];
+
+	/* Now checking for IP wildcards */
+	if (client->type == WILDCARDHOST_CLIENT &&
+	    sprint_sockip(hostaddr, ipstring, sizeof(ipstring)) &&
+	    fnmatch(client->client.wildcard.wildcard, ipstring,
+		    FNM_PATHNAME) == 0)
+		return true;
+
+	/* Get the name from the IP/name cache, without waiting on DNS
+	 * for long.  A decision made while the name is still resolved
+	 * is forgotten once it is.
+	 */
+	rc = nfs_ip_name_get(hostaddr, hostname, sizeof(hostname));
+
+	if (rc != IP_NAME_SUCCESS)
+		return false;
+
+	/* At this point 'hostname' should contain the
+	 * name that was found
+	 */
+	if (client->type == NETGROUP_CLIENT)
+		return ng_innetgr(client->client.netgroup.netgroupname,
+				  hostname);
+
+	return fnmatch(client->client.wildcard.wildcard, hostname,
+		       FNM_PATHNAME) == 0;
+}
+
 /**
  * @brief Match a specific option in the client export list
  *
@@ -2394,10 +2904,6 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 {
 	struct glist_head *glist;
 	in_addr_t addr = get_in_addr(hostaddr);
-	int rc;
-	int ipvalid = -1;	/* -1 need to print, 0 - invalid, 1 - ok */
-	char hostname[MAXHOSTNAMELEN + 1];
-	char ipstring[SOCK_NAME_MAX + 1];
 
 	glist_for_each(glist, &export->clients) {
 		exportlist_client_entry_t *client;
@@ -2424,70 +2930,9 @@ static exportlist_client_entry_t *client_match(sockaddr_t *hostaddr,
 			break;
 
 		case NETGROUP_CLIENT:
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
-
-			if (rc != IP_NAME_SUCCESS)
-				break; /* Fatal failure */
-
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (ng_innetgr(client->client.netgroup.netgroupname,
-				    hostname)) {
-				return client;
-			}
-			break;
-
 		case WILDCARDHOST_CLIENT:
-			/* Now checking for IP wildcards */
-			if (ipvalid < 0)
-				ipvalid = sprint_sockip(hostaddr,
-							ipstring,
-							sizeof(ipstring));
-
-			if (ipvalid &&
-			    (fnmatch(client->client.wildcard.wildcard,
-				     ipstring,
-				     FNM_PATHNAME) == 0)) {
-				return client;
-			}
-
-			/* Try to get the entry from th IP/name cache */
-			rc = nfs_ip_name_get(hostaddr, hostname,
-					     sizeof(hostname));
-
-			if (rc == IP_NAME_NOT_FOUND) {
-				/* IPaddr was not cached, add it to the cache */
-
-				/** @todo this change from 1.5 is not IPv6
-				 * useful.  come back to this and use the
-				 * string from client mgr inside req_ctx...
-				 */
-				rc = nfs_ip_name_add(hostaddr,
-						     hostname,
-						     sizeof(hostname));
-			}
-
-			if (rc != IP_NAME_SUCCESS)
-					break;
-
-			/* At this point 'hostname' should contain the
-			 * name that was found
-			 */
-			if (fnmatch
-			    (client->client.wildcard.wildcard, hostname,
-			     FNM_PATHNAME) == 0) {
+			if (client_match_name(client, hostaddr))
 				return client;
-			}
 			break;
 
 		case GSSPRINCIPAL_CLIENT:
@@ -2574,6 +3019,10 @@ static exportlist_client_entry_t *client_matchv6(struct in6_addr *paddrv6,
 static exportlist_client_entry_t *client_match_any(sockaddr_t *hostaddr,
 						   struct gsh_export *export)
 {
+	if (export->client_index != NULL)
+		return export_index_match(export->client_index, hostaddr,
+					  client_match_name);
+
 	if (hostaddr->ss_family == AF_INET6) {
 		struct sockaddr_in6 *psockaddr_in6 =
 		    (struct sockaddr_in6 *)hostaddr;
@@ -2795,13 +3244,171 @@ gid_t get_anonymous_gid(void)
 	return anon_gid;
 }
 
+/** Seconds a connection keeps a decision, for netgroups and DNS */
+#define EXPORT_PERMS_CACHE_TTL 60
+
+/**
+ * @brief Bumped when the configuration of any export changes
+ *
+ * Never 0, that marks an unused entry.
+ */
+static uint32_t export_perms_gen = 1;
+
+void export_perms_changed(void)
+{
+	if (atomic_inc_uint32_t(&export_perms_gen) == 0)
+		(void) atomic_inc_uint32_t(&export_perms_gen);
+}
+
+struct export_perms_cache *export_perms_cache_alloc(void)
+{
+	struct export_perms_cache *cache = gsh_calloc(1, sizeof(*cache));
+
+	PTHREAD_MUTEX_init(&cache->mtx, NULL);
+	return cache;
+}
+
+void export_perms_cache_free(struct export_perms_cache *cache)
+{
+	if (cache->export != NULL)
+		put_gsh_export(cache->export);
+	PTHREAD_MUTEX_destroy(&cache->mtx);
+	gsh_free(cache);
+}
+
+/**
+ * @brief Get an export for a request of a connection
+ *
+ * A connection mostly works in one export, the one it used last is
+ * taken without going through the export manager.
+ *
+ * @param[in] cache     Cache of the connection, NULL for none
+ * @param[in] export_id The export
+ *
+ * @return The export, with a reference, or NULL.
+ */
+struct gsh_export *export_perms_cache_export(struct export_perms_cache *cache,
+					     uint16_t export_id)
+{
+	struct gsh_export *export;
+	struct gsh_export *old;
+
+	if (cache == NULL)
+		return get_gsh_export(export_id);
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	export = cache->export;
+	if (export != NULL && export->export_id == export_id &&
+	    export_ready(export)) {
+		get_gsh_export_ref(export);
+		PTHREAD_MUTEX_unlock(&cache->mtx);
+		return export;
+	}
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	export = get_gsh_export(export_id);
+	if (export == NULL)
+		return NULL;
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	/* not if removed, its removal may have swept the connections */
+	if (export_ready(export)) {
+		get_gsh_export_ref(export);
+		old = cache->export;
+		cache->export = export;
+	} else {
+		old = NULL;
+	}
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	if (old != NULL)
+		put_gsh_export(old);
+	return export;
+}
+
+/**
+ * @brief Let go of an export being removed
+ */
+void export_perms_cache_drop(struct export_perms_cache *cache,
+			     struct gsh_export *export)
+{
+	bool drop;
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+	drop = cache->export == export;
+	if (drop)
+		cache->export = NULL;
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+
+	if (drop)
+		put_gsh_export(export);
+}
+
+/**
+ * @brief Take the decision of the connection for the export, if current
+ */
+static bool export_perms_cache_get(struct export_perms_cache *cache,
+				   uint16_t export_id, uint32_t gen,
+				   struct export_perms *perms)
+{
+	struct export_perms_entry *entry;
+	bool found = false;
+	int i;
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+
+	for (i = 0; i < EXPORT_PERMS_CACHE_SIZE; i++) {
+		entry = &cache->entries[i];
+		if (entry->gen == gen && entry->export_id == export_id &&
+		    entry->expire > time(NULL)) {
+			*perms = entry->perms;
+			found = true;
+			break;
+		}
+	}
+
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+	return found;
+}
+
+static void export_perms_cache_put(struct export_perms_cache *cache,
+				   uint16_t export_id, uint32_t gen,
+				   const struct export_perms *perms)
+{
+	struct export_perms_entry *entry = NULL;
+	int i;
+
+	PTHREAD_MUTEX_lock(&cache->mtx);
+
+	for (i = 0; i < EXPORT_PERMS_CACHE_SIZE; i++) {
+		if (cache->entries[i].export_id == export_id) {
+			entry = &cache->entries[i];
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		entry = &cache->entries[cache->next];
+		cache->next = (cache->next + 1) % EXPORT_PERMS_CACHE_SIZE;
+	}
+
+	entry->gen = gen;
+	entry->export_id = export_id;
+	entry->expire = time(NULL) + EXPORT_PERMS_CACHE_TTL;
+	entry->perms = *perms;
+
+	PTHREAD_MUTEX_unlock(&cache->mtx);
+}
+
 /**
  * @brief Checks if a machine is authorized to access an export entry
  *
  * Permissions in the op context get updated based on export and client.
  *
  * Takes the export->lock in read mode to protect the client list and
- * export permissions while performing this work.
+ * export permissions while performing this work.  On a connection the
+ * result is kept per export, so the next check of the same export
+ * does none of it.
  */
 
 void export_check_access(void)
@@ -2809,10 +3416,17 @@ void export_check_access(void)
 	exportlist_client_entry_t *client = NULL;
 	sockaddr_t alt_hostaddr;
 	sockaddr_t *hostaddr = NULL;
+	uint32_t gen = atomic_fetch_uint32_t(&export_perms_gen);
 
 	assert(op_ctx != NULL);
 	assert(op_ctx->export_perms != NULL);
 
+	if (op_ctx->ctx_export != NULL && op_ctx->perms_cache != NULL &&
+	    export_perms_cache_get(op_ctx->perms_cache,
+				   op_ctx->ctx_export->export_id, gen,
+				   op_ctx->export_perms))
+		return;
+
 	/* Initialize permissions to allow nothing, anonymous_uid and
 	 * anonymous_gid will get set farther down.
 	 */
@@ -2915,6 +3529,11 @@ void export_check_access(void)
 
 	op_ctx->export_perms->set |= export_opt.def.set;
 
+	/* No client may change an immutable export */
+	if (op_ctx->ctx_export != NULL &&
+	    op_ctx_export_has_option(EXPORT_OPTION_IMMUTABLE))
+		op_ctx->export_perms->options &= ~EXPORT_OPTION_MODIFY_ACCESS;
+
 	if (isMidDebug(COMPONENT_EXPORT)) {
 		char perms[1024];
 		struct display_buffer dspbuf = {sizeof(perms), perms, perms};
@@ -2959,5 +3578,10 @@ void export_check_access(void)
 	if (op_ctx->ctx_export != NULL) {
 		/* Release lock */
 		PTHREAD_RWLOCK_unlock(&op_ctx->ctx_export->lock);
+
+		if (op_ctx->perms_cache != NULL)
+			export_perms_cache_put(op_ctx->perms_cache,
+					       op_ctx->ctx_export->export_id,
+					       gen, op_ctx->export_perms);
 	}
 }
@@ -35,20 +35,272 @@
  *
  */
 
+#define _GNU_SOURCE
 #include "config.h"
 
 #include "log.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <pthread.h>
 #ifdef LINUX
+#include <sched.h>
 #include <sys/signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #elif FREEBSD
 #include <signal.h>
 #endif
 #include "abstract_mem.h"
+#include "abstract_atomic.h"
 #include "fridgethr.h"
 #include "nfs_core.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+#ifdef USE_LTTNG
+#include "gsh_lttng/fridgethr.h"
+#endif
+
+/* All the fridges, for their statistics */
+static pthread_mutex_t fridges_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct glist_head fridges = GLIST_HEAD_INIT(fridges);
+
+#ifdef LINUX
+/** Most NUMA nodes threads are spread across */
+#define FRIDGETHR_MAX_NODES 64
+
+/**
+ * @brief CPUs and NUMA nodes available to the process
+ *
+ * Captured once, from the affinity mask the process started with,
+ * before any fridge thread pins itself.
+ */
+
+static struct {
+	pthread_once_t once;
+	unsigned int ncpus;	/*< CPUs we may run on */
+	unsigned int nnodes;	/*< Nodes holding at least one of them */
+	int cpu_domain[CPU_SETSIZE];	/*< CPU to CPU domain, or -1 */
+	int node_domain[CPU_SETSIZE];	/*< CPU to node domain, or -1 */
+} fridgethr_topo = {
+	.once = PTHREAD_ONCE_INIT
+};
+
+/**
+ * @brief Assign the CPUs listed in a sysfs cpulist to a node domain
+ *
+ * @param[in] list   String such as "0-7,16-23"
+ * @param[in] domain Node domain to assign
+ *
+ * @return true if any CPU we may run on was in the list.
+ */
+
+static bool fridgethr_topo_node(const char *list, int domain)
+{
+	const char *p = list;
+	bool used = false;
+	char *end;
+	long lo, hi, cpu;
+
+	while (*p != '\0' && *p != '\n') {
+		lo = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		hi = lo;
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+			if (end == p)
+				break;
+		}
+		for (cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+			if (cpu < 0 || fridgethr_topo.cpu_domain[cpu] < 0)
+				continue;
+			fridgethr_topo.node_domain[cpu] = domain;
+			used = true;
+		}
+		p = (*end == ',') ? end + 1 : end;
+	}
+
+	return used;
+}
+
+static void fridgethr_topo_init(void)
+{
+	cpu_set_t allowed;
+	char path[64];
+	char list[1024];
+	unsigned int node;
+	bool unplaced = false;
+	FILE *f;
+	int cpu;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		fridgethr_topo.cpu_domain[cpu] = -1;
+		fridgethr_topo.node_domain[cpu] = -1;
+	}
+
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Unable to get CPU affinity, threads will not be pinned: %d",
+			 errno);
+		return;
+	}
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed))
+			fridgethr_topo.cpu_domain[cpu] =
+				fridgethr_topo.ncpus++;
+	}
+
+	for (node = 0; node < FRIDGETHR_MAX_NODES; node++) {
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%u/cpulist", node);
+		f = fopen(path, "r");
+		if (f == NULL)
+			continue;
+		if (fgets(list, sizeof(list), f) != NULL &&
+		    fridgethr_topo_node(list, fridgethr_topo.nnodes))
+			fridgethr_topo.nnodes++;
+		fclose(f);
+	}
+
+	/* CPUs sysfs does not place, e.g. on kernels without NUMA,
+	 * share one more node. */
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (fridgethr_topo.cpu_domain[cpu] >= 0 &&
+		    fridgethr_topo.node_domain[cpu] < 0) {
+			fridgethr_topo.node_domain[cpu] =
+				fridgethr_topo.nnodes;
+			unplaced = true;
+		}
+	}
+	if (unplaced)
+		fridgethr_topo.nnodes++;
+
+	LogInfo(COMPONENT_THREAD,
+		"Thread affinity: %u CPUs on %u NUMA nodes",
+		fridgethr_topo.ncpus, fridgethr_topo.nnodes);
+}
+#endif
+
+/**
+ * @brief Number of affinity domains
+ *
+ * @param[in] affinity Placement policy
+ *
+ * @return The number of CPUs or nodes threads may be pinned to, 1 if
+ *         threads are not pinned.
+ */
+
+unsigned int fridgethr_affinity_domains(fridgethr_affinity_t affinity)
+{
+#ifdef LINUX
+	pthread_once(&fridgethr_topo.once, fridgethr_topo_init);
+
+	switch (affinity) {
+	case fridgethr_affinity_cpu:
+		if (fridgethr_topo.ncpus > 0)
+			return fridgethr_topo.ncpus;
+		break;
+	case fridgethr_affinity_node:
+		if (fridgethr_topo.nnodes > 0)
+			return fridgethr_topo.nnodes;
+		break;
+	case fridgethr_affinity_none:
+		break;
+	}
+#endif
+	return 1;
+}
+
+/**
+ * @brief Affinity domain of a CPU
+ *
+ * @param[in] affinity Placement policy
+ * @param[in] cpu      CPU number, as from sched_getcpu()
+ *
+ * @return The domain, or -1 if the CPU is not one we may run on or
+ *         threads are not pinned.
+ */
+
+int fridgethr_affinity_domain(fridgethr_affinity_t affinity, int cpu)
+{
+#ifdef LINUX
+	pthread_once(&fridgethr_topo.once, fridgethr_topo_init);
+
+	if (cpu < 0 || cpu >= CPU_SETSIZE)
+		return -1;
+
+	switch (affinity) {
+	case fridgethr_affinity_cpu:
+		return fridgethr_topo.cpu_domain[cpu];
+	case fridgethr_affinity_node:
+		return fridgethr_topo.node_domain[cpu];
+	case fridgethr_affinity_none:
+		break;
+	}
+#endif
+	return -1;
+}
+
+/**
+ * @brief Pin a new thread to the fridge's next affinity domain
+ *
+ * @param[in] fr  The fridge
+ * @param[in] ctx Context of the calling thread
+ */
+
+static void fridgethr_pin(struct fridgethr *fr,
+			  struct fridgethr_context *ctx)
+{
+#ifdef LINUX
+	unsigned int ndomains;
+	cpu_set_t set;
+	int domain;
+	int cpu;
+	int rc;
+#endif
+
+	ctx->domain = -1;
+
+#ifdef LINUX
+	if (fr->p.affinity == fridgethr_affinity_none)
+		return;
+
+	ndomains = fridgethr_affinity_domains(fr->p.affinity);
+	if (fr->p.one_domain)
+		domain = fr->p.domain % ndomains;
+	else
+		domain = atomic_postinc_uint32_t(&fr->next_domain) % ndomains;
+
+	CPU_ZERO(&set);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (fridgethr_affinity_domain(fr->p.affinity, cpu) == domain)
+			CPU_SET(cpu, &set);
+	}
+	if (CPU_COUNT(&set) == 0)
+		return;
+
+	rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (rc != 0) {
+		LogMajor(COMPONENT_THREAD,
+			 "Unable to pin thread in fridge %s to domain %d: %d",
+			 fr->s, domain, rc);
+		return;
+	}
+
+	ctx->domain = domain;
+	LogFullDebug(COMPONENT_THREAD,
+		     "Pinned thread in fridge %s to domain %d of %u",
+		     fr->s, domain, ndomains);
+#endif
+}
 
 /**
  * @brief Initialize a thread fridge
@@ -100,6 +352,12 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 	frobj->nthreads = 0;
 	frobj->nidle = 0;
 	frobj->flags = fridgethr_flag_none;
+	frobj->next_domain = 0;
+	frobj->submitted = 0;
+	frobj->deferred = 0;
+	frobj->wait = 0;
+	frobj->wait_max = 0;
+	memset(&frobj->fast, 0, sizeof(frobj->fast));
 
 	/* This always succeeds on Linux, but it might fail on other
 	   systems or future versions of Linux. */
@@ -186,6 +444,30 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 		goto out;
 	}
 
+#ifdef LINUX
+	if (frobj->p.fast_slots != 0
+	    && frobj->p.flavor == fridgethr_flavor_worker) {
+		uint32_t ix;
+
+		if (frobj->p.fast_slots & (frobj->p.fast_slots - 1)) {
+			LogMajor(COMPONENT_THREAD,
+				 "Fast slots of %u is not a power of two in fridge %s",
+				 frobj->p.fast_slots, s);
+			rc = EINVAL;
+			goto out;
+		}
+		frobj->fast.slot = gsh_calloc(frobj->p.fast_slots,
+					      sizeof(struct fridgethr_slot));
+		for (ix = 0; ix < frobj->p.fast_slots; ++ix)
+			frobj->fast.slot[ix].seq = ix;
+		frobj->fast.mask = frobj->p.fast_slots - 1;
+	}
+#endif
+
+	PTHREAD_MUTEX_lock(&fridges_mtx);
+	glist_add_tail(&fridges, &frobj->fridges);
+	PTHREAD_MUTEX_unlock(&fridges_mtx);
+
 	*frout = frobj;
 	rc = 0;
 
@@ -221,8 +503,13 @@ int fridgethr_init(struct fridgethr **frout, const char *s,
 
 void fridgethr_destroy(struct fridgethr *fr)
 {
+	PTHREAD_MUTEX_lock(&fridges_mtx);
+	glist_del(&fr->fridges);
+	PTHREAD_MUTEX_unlock(&fridges_mtx);
+
 	PTHREAD_MUTEX_destroy(&fr->mtx);
 	pthread_attr_destroy(&fr->attr);
+	gsh_free(fr->fast.slot);
 	gsh_free(fr->s);
 	gsh_free(fr);
 }
@@ -265,6 +552,258 @@ static void fridgethr_finish_transition(struct fridgethr *fr, bool locked)
 	fr->transitioning = false;
 }
 
+#ifdef LINUX
+/**
+ * @brief Lock-free submission
+ *
+ * A job goes on the ring only while some thread is spinning or parked
+ * on it.  Submitters push and then check waiting, waiters drop out of
+ * waiting and then check the ring, so one of them sees the job: if no
+ * thread was left, the submitter takes a job back and submits it the
+ * old way.  Parked threads sleep on wakeseq; a submitter bumps it and
+ * wakes one, or all of them when the fridge changes command.  Jobs
+ * deferred the old way are counted in deferred, the same way, so that
+ * waiting threads leave to pick them up.
+ */
+
+static inline void fridgethr_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__asm__ __volatile__("pause" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+static inline uint64_t fridgethr_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static bool fridgethr_fast_push(struct fridgethr *fr,
+				void (*func)(struct fridgethr_context *),
+				void *arg)
+{
+	struct fridgethr_slot *slot;
+	uint64_t pos = atomic_fetch_uint64_t(&fr->fast.head);
+	int64_t diff;
+
+	for (;;) {
+		slot = &fr->fast.slot[pos & fr->fast.mask];
+		diff = (int64_t) (atomic_fetch_uint64_t(&slot->seq) - pos);
+		if (diff == 0) {
+			if (atomic_cmpxchg_uint64_t(&fr->fast.head, pos,
+						    pos + 1))
+				break;
+		} else if (diff < 0) {
+			return false;
+		}
+		pos = atomic_fetch_uint64_t(&fr->fast.head);
+	}
+
+	slot->func = func;
+	slot->arg = arg;
+	atomic_store_uint64_t(&slot->seq, pos + 1);
+	return true;
+}
+
+static bool fridgethr_fast_pop(struct fridgethr *fr,
+			       void (**func)(struct fridgethr_context *),
+			       void **arg)
+{
+	struct fridgethr_slot *slot;
+	uint64_t pos = atomic_fetch_uint64_t(&fr->fast.tail);
+	int64_t diff;
+
+	for (;;) {
+		slot = &fr->fast.slot[pos & fr->fast.mask];
+		diff = (int64_t) (atomic_fetch_uint64_t(&slot->seq) -
+				  (pos + 1));
+		if (diff == 0) {
+			if (atomic_cmpxchg_uint64_t(&fr->fast.tail, pos,
+						    pos + 1))
+				break;
+		} else if (diff < 0) {
+			return false;
+		}
+		pos = atomic_fetch_uint64_t(&fr->fast.tail);
+	}
+
+	*func = slot->func;
+	*arg = slot->arg;
+	atomic_store_uint64_t(&slot->seq, pos + fr->fast.mask + 1);
+	return true;
+}
+
+static void fridgethr_fast_wake(struct fridgethr *fr, int nr)
+{
+	(void) atomic_inc_uint32_t(&fr->fast.wakeseq);
+	(void) syscall(SYS_futex, &fr->fast.wakeseq, FUTEX_WAKE_PRIVATE, nr,
+		       NULL, NULL, 0);
+}
+
+static bool fridgethr_fast_leave(struct fridgethr *fr)
+{
+	return fr->command != fridgethr_comm_run
+	       || atomic_fetch_uint32_t(&fr->fast.deferred) > 0;
+}
+#endif
+
+/**
+ * @brief Count a job deferred the old way
+ *
+ * @note The fridge lock must be held when calling this function.
+ *
+ * @param[in,out] fr The fridge
+ * @param[in]     in Whether the job is being deferred or picked up
+ */
+
+static void fridgethr_fast_defer(struct fridgethr *fr, bool in)
+{
+#ifdef LINUX
+	if (fr->fast.slot == NULL)
+		return;
+
+	if (!in) {
+		(void) atomic_dec_uint32_t(&fr->fast.deferred);
+		return;
+	}
+
+	(void) atomic_inc_uint32_t(&fr->fast.deferred);
+	if (atomic_fetch_uint32_t(&fr->fast.parked) > 0)
+		fridgethr_fast_wake(fr, 1);
+#endif
+}
+
+#ifdef LINUX
+
+/**
+ * @brief Wake all the threads waiting on the ring
+ *
+ * So they notice a new command.
+ */
+
+static void fridgethr_fast_wake_all(struct fridgethr *fr)
+{
+	if (fr->fast.slot != NULL)
+		fridgethr_fast_wake(fr, INT_MAX);
+}
+
+/**
+ * @brief Try to hand a job over the ring
+ *
+ * @param[in]     fr   The fridge
+ * @param[in,out] func The thing to do; on failure, the job to submit
+ *                     the old way, maybe another one
+ * @param[in,out] arg  The thing to do it to
+ *
+ * @return true if the job went to a thread.
+ */
+
+static bool fridgethr_fast_submit(struct fridgethr *fr,
+				  void (**func)(struct fridgethr_context *),
+				  void **arg)
+{
+	if (atomic_fetch_uint32_t(&fr->fast.waiting) == 0
+	    || !fridgethr_fast_push(fr, *func, *arg))
+		return false;
+
+	if (atomic_fetch_uint32_t(&fr->fast.waiting) == 0) {
+		/* Everyone left meanwhile, take a job back unless one
+		   of them took it */
+		return !fridgethr_fast_pop(fr, func, arg);
+	}
+
+	if (atomic_fetch_uint32_t(&fr->fast.parked) > 0)
+		fridgethr_fast_wake(fr, 1);
+
+	return true;
+}
+
+/**
+ * @brief Wait for a job on the ring
+ *
+ * Spin for spin_us, then sleep for thread_delay.
+ *
+ * @param[in]  fr       The fridge
+ * @param[in]  fe       This thread
+ * @param[out] timedout Slept thread_delay without work
+ *
+ * @return true with the job in the context of fe, false if the thread
+ *         should go the old way: to the idle queue or away.
+ */
+
+static bool fridgethr_fast_wait(struct fridgethr *fr,
+				struct fridgethr_entry *fe, bool *timedout)
+{
+	struct timespec left;
+	uint64_t start = fridgethr_clock(), until, now_ns;
+	uint32_t seq;
+	bool got = false;
+	long rc;
+
+	*timedout = false;
+	(void) atomic_inc_uint32_t(&fr->fast.waiting);
+
+	until = start + (uint64_t) fr->p.spin_us * 1000;
+	while (!fridgethr_fast_leave(fr)) {
+		if (fridgethr_fast_pop(fr, &fe->ctx.func, &fe->ctx.arg)) {
+			got = true;
+			goto out;
+		}
+		if (fridgethr_clock() >= until)
+			break;
+		fridgethr_relax();
+	}
+
+	until = start + (uint64_t) fr->p.thread_delay * 1000000000;
+	while (!fridgethr_fast_leave(fr)) {
+		seq = atomic_fetch_uint32_t(&fr->fast.wakeseq);
+		(void) atomic_inc_uint32_t(&fr->fast.parked);
+		if (fridgethr_fast_pop(fr, &fe->ctx.func, &fe->ctx.arg)) {
+			(void) atomic_dec_uint32_t(&fr->fast.parked);
+			got = true;
+			break;
+		}
+		if (fridgethr_fast_leave(fr)) {
+			(void) atomic_dec_uint32_t(&fr->fast.parked);
+			break;
+		}
+		if (fr->p.thread_delay > 0) {
+			now_ns = fridgethr_clock();
+			if (now_ns >= until) {
+				(void) atomic_dec_uint32_t(&fr->fast.parked);
+				*timedout = true;
+				break;
+			}
+			left.tv_sec = (until - now_ns) / 1000000000;
+			left.tv_nsec = (until - now_ns) % 1000000000;
+		}
+		rc = syscall(SYS_futex, &fr->fast.wakeseq, FUTEX_WAIT_PRIVATE,
+			     seq, fr->p.thread_delay > 0 ? &left : NULL,
+			     NULL, 0);
+		(void) atomic_dec_uint32_t(&fr->fast.parked);
+		if (rc != 0 && errno == ETIMEDOUT) {
+			*timedout = true;
+			break;
+		}
+	}
+
+ out:
+	(void) atomic_dec_uint32_t(&fr->fast.waiting);
+	if (!got)
+		got = fridgethr_fast_pop(fr, &fe->ctx.func, &fe->ctx.arg);
+	if (got) {
+		*timedout = false;
+		fe->ctx.woke = true;
+	}
+	return got;
+}
+#endif
+
 /**
  * @brief Test whether the fridge has deferred work waiting
  *
@@ -310,6 +849,28 @@ static bool fridgethr_deferredwork(struct fridgethr *fr)
  * @return true if deferred work has been dequeued.
  */
 
+/**
+ * @brief Account the time a deferred job waited for a thread
+ *
+ * @note The fridge lock must be held when calling this function.
+ *
+ * @param[in,out] fr     The fridge
+ * @param[in]     queued When the job was deferred
+ */
+
+static void fridgethr_waited(struct fridgethr *fr,
+			     const struct timespec *queued)
+{
+	struct timespec ts;
+	nsecs_elapsed_t wait;
+
+	now(&ts);
+	wait = timespec_diff(queued, &ts);
+	fr->wait += wait;
+	if (wait > fr->wait_max)
+		fr->wait_max = wait;
+}
+
 static bool fridgethr_getwork(struct fridgethr *fr, struct fridgethr_entry *fe)
 {
 	if ((fr->p.deferment == fridgethr_defer_block)
@@ -322,13 +883,16 @@ static bool fridgethr_getwork(struct fridgethr *fr, struct fridgethr_entry *fe)
 				      struct fridgethr_work,
 				      link);
 		glist_del(&q->link);
+		fridgethr_fast_defer(fr, false);
 		fe->ctx.func = q->func;
 		fe->ctx.arg = q->arg;
+		fridgethr_waited(fr, &q->queued);
 		gsh_free(q);
 		return true;
 	}
 }
 
+
 /**
  * @brief Wait for more work
  *
@@ -355,6 +919,17 @@ static bool fridgethr_freeze(struct fridgethr *fr,
 	/* Return code from system calls */
 	int rc = 0;
 
+#ifdef LINUX
+	if (fr->fast.slot != NULL) {
+		bool timedout;
+
+		if (fridgethr_fast_wait(fr, fe, &timedout))
+			return true;
+		if (timedout)
+			rc = ETIMEDOUT;
+	}
+#endif
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
  restart:
 	/* If we are not paused and there is work left to do in the
@@ -543,11 +1118,21 @@ static void *fridgethr_start_routine(void *arg)
 	   which would indicate bugs in the code. */
 	assert(rc == 0);
 
+	fridgethr_pin(fr, &fe->ctx);
+
 	if (fr->p.thread_initialize)
 		fr->p.thread_initialize(&fe->ctx);
 
 	do {
+#ifdef USE_LTTNG
+		tracepoint(fridgethr, run_start, fr->s,
+			   (void *)fe->ctx.func, fe->ctx.arg);
+#endif
 		fe->ctx.func(&fe->ctx);
+#ifdef USE_LTTNG
+		tracepoint(fridgethr, run_end, fr->s,
+			   (void *)fe->ctx.func, fe->ctx.arg);
+#endif
 		if (fr->p.task_cleanup)
 			fr->p.task_cleanup(&fe->ctx);
 
@@ -682,7 +1267,9 @@ static int fridgethr_queue(struct fridgethr *fr,
 	glist_init(&q->link);
 	q->func = func;
 	q->arg = arg;
+	now(&q->queued);
 	glist_add_tail(&fr->deferment.work_q, &q->link);
+	fridgethr_fast_defer(fr, true);
 
 	return 0;
 }
@@ -759,8 +1346,12 @@ static int fridgethr_block(struct fridgethr *fr,
 	bool dispatched = true;
 	/* Return code */
 	int rc = 0;
+	/* When we started waiting */
+	struct timespec blocked;
 
+	now(&blocked);
 	++(fr->deferment.block.waiters);
+	fridgethr_fast_defer(fr, true);
 	do {
 		if (fr->p.block_delay > 0) {
 			struct timespec t;
@@ -791,6 +1382,9 @@ static int fridgethr_block(struct fridgethr *fr,
 		}
 	} while (!dispatched && (rc == 0));
 	--(fr->deferment.block.waiters);
+	fridgethr_fast_defer(fr, false);
+	if (rc == 0)
+		fridgethr_waited(fr, &blocked);
 	/* We check here, too, in case we get around to falling out
 	   after the last thread exited. */
 	if ((fr->nthreads == 0) && (fr->command == fridgethr_comm_stop)
@@ -833,6 +1427,18 @@ int fridgethr_submit(struct fridgethr *fr,
 		return EPIPE;
 	}
 
+#ifdef USE_LTTNG
+	tracepoint(fridgethr, submit, fr->s, (void *)func, arg);
+#endif
+
+#ifdef LINUX
+	if (fr->fast.slot != NULL && fr->command == fridgethr_comm_run
+	    && fridgethr_fast_submit(fr, &func, &arg)) {
+		(void) atomic_inc_uint64_t(&fr->submitted);
+		return 0;
+	}
+#endif
+
 	PTHREAD_MUTEX_lock(&fr->mtx);
 	if (fr->command == fridgethr_comm_stop) {
 		LogMajor(COMPONENT_THREAD,
@@ -842,6 +1448,8 @@ int fridgethr_submit(struct fridgethr *fr,
 		return EPIPE;
 	}
 
+	(void) atomic_inc_uint64_t(&fr->submitted);
+
 	if (fr->command == fridgethr_comm_pause) {
 		LogFullDebug(COMPONENT_THREAD,
 			     "Attempt to schedule job in paused fridge %s, pausing.",
@@ -862,6 +1470,7 @@ int fridgethr_submit(struct fridgethr *fr,
  defer:
 		switch (fr->p.deferment) {
 		case fridgethr_defer_queue:
+			++(fr->deferred);
 			rc = fridgethr_queue(fr, func, arg);
 			break;
 
@@ -870,6 +1479,7 @@ int fridgethr_submit(struct fridgethr *fr,
 			break;
 
 		case fridgethr_defer_block:
+			++(fr->deferred);
 			rc = fridgethr_block(fr, func, arg);
 		};
 		PTHREAD_MUTEX_unlock(&fr->mtx);
@@ -984,6 +1594,9 @@ int fridgethr_pause(struct fridgethr *fr, pthread_mutex_t *mtx,
 	fr->cb_cv = cv;
 	fr->cb_func = cb;
 	fr->cb_arg = arg;
+#ifdef LINUX
+	fridgethr_fast_wake_all(fr);
+#endif
 
 	if (fr->nthreads == fr->nidle)
 		fridgethr_finish_transition(fr, true);
@@ -1062,6 +1675,9 @@ int fridgethr_stop(struct fridgethr *fr, pthread_mutex_t *mtx,
 	fr->cb_cv = cv;
 	fr->cb_func = cb;
 	fr->cb_arg = arg;
+#ifdef LINUX
+	fridgethr_fast_wake_all(fr);
+#endif
 	if ((fr->nthreads == 0) && !fridgethr_deferredwork(fr)) {
 		fridgethr_finish_transition(fr, true);
 		PTHREAD_MUTEX_unlock(&fr->mtx);
@@ -1109,6 +1725,7 @@ int fridgethr_stop(struct fridgethr *fr, pthread_mutex_t *mtx,
 					      struct fridgethr_work,
 					      link);
 			glist_del(&q->link);
+			fridgethr_fast_defer(fr, false);
 			rc = fridgethr_spawn(fr, q->func, q->arg);
 			gsh_free(q);
 		} else {
@@ -1217,6 +1834,7 @@ int fridgethr_start(struct fridgethr *fr, pthread_mutex_t *mtx,
 					      struct fridgethr_work,
 					      link);
 			glist_del(&q->link);
+			fridgethr_fast_defer(fr, false);
 			rc = fridgethr_spawn(fr, q->func, q->arg);
 			gsh_free(q);
 			PTHREAD_MUTEX_lock(&fr->mtx);
@@ -1467,6 +2085,23 @@ time_t fridgethr_getwait(struct fridgethr_context *ctx)
 	return thread_delay;
 }
 
+/**
+ * @brief Get the spin time of a fridge
+ *
+ * For loopers that wait for work on their own, to poll for it this
+ * many microseconds before they sleep.
+ *
+ * @param[in] ctx Thread context
+ */
+
+uint32_t fridgethr_getspin(struct fridgethr_context *ctx)
+{
+	struct fridgethr_entry *fe = container_of(ctx, struct fridgethr_entry,
+						  ctx);
+
+	return fe->fr->p.spin_us;
+}
+
 /**
  * @brief Cancel all of the threads in the fridge
  *
@@ -1503,6 +2138,65 @@ void fridgethr_cancel(struct fridgethr *fr)
 	LogEvent(COMPONENT_THREAD, "All threads in %s cancelled.", fr->s);
 }
 
+#ifdef USE_DBUS
+/**
+ * @brief Report the size and queueing of every fridge
+ *
+ * For each fridge: its name, threads, idle threads (frozen or waiting
+ * on the submission ring) and thread limit,
+ * the jobs submitted, those that found no thread free, and the total
+ * and longest time these waited for one in ns.
+ *
+ * @param[out] iter Reply
+ */
+
+void fridgethr_dbus_stats(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct glist_head *g;
+	struct fridgethr *fr;
+	uint32_t val32[3];
+	uint64_t val64[4];
+	int i;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(suuutttt)", &array_iter);
+
+	PTHREAD_MUTEX_lock(&fridges_mtx);
+	glist_for_each(g, &fridges) {
+		fr = glist_entry(g, struct fridgethr, fridges);
+
+		PTHREAD_MUTEX_lock(&fr->mtx);
+		val32[0] = fr->nthreads;
+		val32[1] = fr->nidle +
+			   atomic_fetch_uint32_t(&fr->fast.waiting);
+		val32[2] = fr->p.thr_max;
+		val64[0] = fr->submitted;
+		val64[1] = fr->deferred;
+		val64[2] = fr->wait;
+		val64[3] = fr->wait_max;
+		PTHREAD_MUTEX_unlock(&fr->mtx);
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &fr->s);
+		for (i = 0; i < 3; i++)
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT32,
+						       &val32[i]);
+		for (i = 0; i < 4; i++)
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       &val64[i]);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	PTHREAD_MUTEX_unlock(&fridges_mtx);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif /* USE_DBUS */
+
 struct fridgethr *general_fridge;
 
 int general_fridge_init(void)
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_hash.c
+ * @brief Implementations of gsh_hash64 and their selection
+ *
+ * The CRC32C hash takes the key 24 bytes at a time, one 8 byte word
+ * to each of three CRC lanes so that the latency of the instruction is
+ * hidden.  A tail shorter than 24 bytes is read with overlapping
+ * loads, the length tells them apart.  Two multiplies mix the lanes
+ * and the length at the end.
+ *
+ * CRC is linear: two keys that differ by a multiple of the polynomial
+ * in a single word always collide.  That is one in 2^32 random keys,
+ * but anyone who knows it can forge colliding keys, so the hash is
+ * meant for keys the server makes (handles, pointers), not for ones a
+ * client picks.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include "gsh_hash.h"
+#include "city.h"
+
+static uint64_t gsh_hash64_select(const void *buf, size_t len, uint64_t seed);
+
+gsh_hash64_func_t gsh_hash64_func = gsh_hash64_select;
+
+static const char *gsh_hash_name = "city";
+
+uint64_t gsh_hash64_city(const void *buf, size_t len, uint64_t seed)
+{
+	return CityHash64WithSeed(buf, len, seed);
+}
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+
+#define CRC_K1 0x9e3779b97f4a7c15ULL
+#define CRC_K2 0xff51afd7ed558ccdULL
+
+static inline uint64_t load64(const unsigned char *p)
+{
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+	return w;
+}
+
+static inline uint64_t load32(const unsigned char *p)
+{
+	uint32_t w;
+
+	memcpy(&w, p, sizeof(w));
+	return w;
+}
+
+__attribute__ ((target("sse4.2")))
+uint64_t gsh_hash64_crc32c(const void *buf, size_t len, uint64_t seed)
+{
+	const unsigned char *p = buf;
+	uint64_t h1 = (uint32_t) seed, h2 = seed >> 32, h3 = h1 ^ CRC_K1;
+	uint64_t w0, w1 = 0, w2 = 0;
+	size_t n = len;
+
+	for (; n > 24; p += 24, n -= 24) {
+		h1 = _mm_crc32_u64(h1, load64(p));
+		h2 = _mm_crc32_u64(h2, load64(p + 8));
+		h3 = _mm_crc32_u64(h3, load64(p + 16));
+	}
+
+	/* The last 1 to 24 bytes, overlapping what came before */
+	if (n > 16) {
+		w0 = load64(p);
+		w1 = load64(p + 8);
+		w2 = load64(p + n - 8);
+	} else if (n > 8) {
+		w0 = load64(p);
+		w1 = load64(p + n - 8);
+	} else if (len >= 8) {
+		w0 = load64(p + n - 8);
+	} else if (n >= 4) {
+		w0 = load32(p) | load32(p + n - 4) << 32;
+	} else if (n > 0) {
+		w0 = p[0] | p[n / 2] << 8 | p[n - 1] << 16;
+	} else {
+		w0 = 0;
+	}
+
+	h1 = _mm_crc32_u64(h1, w0);
+	h2 = _mm_crc32_u64(h2, w1);
+	h3 = _mm_crc32_u64(h3, w2);
+
+	w0 = ((h1 << 32 | h2) ^ len) * CRC_K2 + h3 * CRC_K1;
+	return w0 ^ w0 >> 32;
+}
+#endif
+
+/**
+ * @brief Pick the implementation, then hash
+ *
+ * Runs once per thread at most until the pointer is replaced; every
+ * thread picks the same one.
+ */
+static uint64_t gsh_hash64_select(const void *buf, size_t len, uint64_t seed)
+{
+	gsh_hash64_func_t func = gsh_hash64_city;
+
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) {
+		func = gsh_hash64_crc32c;
+		gsh_hash_name = "crc32c";
+	}
+#endif
+
+	__atomic_store_n(&gsh_hash64_func, func, __ATOMIC_RELEASE);
+
+	return func(buf, len, seed);
+}
+
+/**
+ * @brief Name of the implementation in use
+ */
+const char *gsh_hash_impl(void)
+{
+	(void) gsh_hash64(NULL, 0, 0);
+	return gsh_hash_name;
+}
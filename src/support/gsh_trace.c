@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file gsh_trace.c
+ * @brief Trace rings and their dump
+ *
+ * See gsh_trace.h.  The rings live until the server exits, a thread
+ * that exits leaves its ring to the next thread created.  Dumps read
+ * the rings while their threads keep recording, so the last records
+ * of a ring may be torn.
+ *
+ * A dump is, in host byte order:
+ *
+ *	struct trace_file_hdr
+ *	for each ring:
+ *		struct trace_file_ring
+ *		min(count, ring_size) struct gsh_trace_rec, oldest first
+ *	uint32_t number of sites
+ *	for each site:
+ *		struct trace_file_site
+ *		len bytes of the name
+ *
+ * The site of a record is the address of its function name, resolved
+ * through the site table.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/param.h>
+#include <sys/syscall.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "log.h"
+#include "gsh_trace.h"
+
+#define TRACE_MAGIC "GSHTRACE"
+#define TRACE_VERSION 1
+
+/** Size of the site table of a dump, a power of 2 */
+#define TRACE_MAX_SITES 1024
+
+struct trace_ring {
+	struct gsh_trace_ring ring;	/*< Must be first */
+	struct trace_ring *next;	/*< All the rings */
+	uint32_t tid;		/*< Thread owning it */
+	uint32_t in_use;	/*< Whether the thread still runs */
+	const char *thread_name;	/*< Name of the running thread */
+	char name[16];		/*< Name of the thread, once exited */
+};
+
+struct trace_file_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;	/*< sizeof(struct gsh_trace_rec) */
+	uint64_t ring_size;	/*< Records per ring */
+	uint64_t mono_ns;	/*< CLOCK_MONOTONIC at dump */
+	uint64_t real_ns;	/*< CLOCK_REALTIME at dump */
+	uint32_t nrings;
+	uint32_t pad;
+};
+
+struct trace_file_ring {
+	uint64_t count;		/*< Events recorded in the ring */
+	uint32_t tid;
+	uint32_t in_use;
+	char name[16];
+};
+
+struct trace_file_site {
+	uint64_t site;
+	uint32_t len;
+	uint32_t pad;
+};
+
+extern __thread char thread_name[16];
+
+uint32_t gsh_trace_mask;
+__thread struct gsh_trace_ring *gsh_trace_ring;
+
+/* Not the PTHREAD_MUTEX_ macros, they trace lock waits themselves */
+static pthread_mutex_t trace_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_ring *trace_rings;
+static pthread_key_t trace_key;
+static char trace_crash_path[MAXPATHLEN];
+static const char *trace_sites[TRACE_MAX_SITES];
+static uint32_t trace_nsites;
+
+static void trace_thread_exit(void *arg)
+{
+	struct trace_ring *ring = arg;
+
+	strncpy(ring->name, ring->thread_name, sizeof(ring->name) - 1);
+	atomic_store_uint32_t(&ring->in_use, 0);
+}
+
+/**
+ * @brief Give the calling thread a ring
+ *
+ * Called from gsh_trace() the first time the thread records.
+ */
+struct gsh_trace_ring *gsh_trace_new_ring(void)
+{
+	struct trace_ring *ring;
+	size_t size = (size_t) (gsh_trace_mask + 1) *
+		sizeof(struct gsh_trace_rec);
+
+	pthread_mutex_lock(&trace_mtx);
+
+	for (ring = trace_rings; ring != NULL; ring = ring->next)
+		if (!ring->in_use)
+			break;
+
+	if (ring == NULL) {
+		ring = gsh_calloc(1, sizeof(*ring) + size);
+		ring->ring.recs = (struct gsh_trace_rec *)(ring + 1);
+		ring->next = trace_rings;
+		atomic_store_voidptr((void **)&trace_rings, ring);
+	}
+
+	ring->tid = (uint32_t) syscall(SYS_gettid);
+	ring->thread_name = thread_name;
+	ring->in_use = 1;
+
+	pthread_mutex_unlock(&trace_mtx);
+
+	(void)pthread_setspecific(trace_key, ring);
+	gsh_trace_ring = &ring->ring;
+
+	return &ring->ring;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t rc;
+
+	while (len > 0) {
+		rc = write(fd, p, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += rc;
+		len -= rc;
+	}
+
+	return true;
+}
+
+static void trace_add_site(const char *site)
+{
+	uint32_t i = ((uintptr_t) site >> 3) & (TRACE_MAX_SITES - 1);
+	uint32_t n;
+
+	if (site == NULL)
+		return;
+
+	for (n = 0; n < TRACE_MAX_SITES; n++) {
+		if (trace_sites[i] == site)
+			return;
+		if (trace_sites[i] == NULL) {
+			trace_sites[i] = site;
+			trace_nsites++;
+			return;
+		}
+		i = (i + 1) & (TRACE_MAX_SITES - 1);
+	}
+}
+
+/**
+ * @brief Write out all the rings
+ *
+ * Only makes async-signal-safe calls and allocates nothing, so it can
+ * run from the crash handler.  Dumps are serialized by the caller.
+ */
+static bool trace_dump_fd(int fd)
+{
+	struct trace_file_hdr hdr;
+	struct trace_file_ring fring;
+	struct trace_file_site fsite;
+	struct trace_ring *rings, *ring;
+	struct timespec ts;
+	uint64_t size = (uint64_t) gsh_trace_mask + 1;
+	uint64_t count, first, n;
+	uint32_t i;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.version = TRACE_VERSION;
+	hdr.rec_size = sizeof(struct gsh_trace_rec);
+	hdr.ring_size = size;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	hdr.mono_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	hdr.real_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	/* New rings go in front, this is the list we write */
+	rings = atomic_fetch_voidptr((void **)&trace_rings);
+	for (ring = rings; ring != NULL; ring = ring->next)
+		hdr.nrings++;
+
+	if (!write_all(fd, &hdr, sizeof(hdr)))
+		return false;
+
+	memset(trace_sites, 0, sizeof(trace_sites));
+	trace_nsites = 0;
+
+	for (ring = rings; ring != NULL; ring = ring->next) {
+		memset(&fring, 0, sizeof(fring));
+		count = ring->ring.count;
+		fring.count = count;
+		fring.tid = ring->tid;
+		fring.in_use = atomic_fetch_uint32_t(&ring->in_use);
+		strncpy(fring.name,
+			fring.in_use ? ring->thread_name : ring->name,
+			sizeof(fring.name) - 1);
+
+		if (!write_all(fd, &fring, sizeof(fring)))
+			return false;
+
+		/* Oldest first, in at most two pieces */
+		first = count > size ? count - size : 0;
+		while (first < count) {
+			i = first & gsh_trace_mask;
+			n = MIN(count - first, size - i);
+			if (!write_all(fd, &ring->ring.recs[i],
+				       n * sizeof(struct gsh_trace_rec)))
+				return false;
+			first += n;
+		}
+
+		for (n = 0; n < MIN(count, size); n++)
+			trace_add_site(ring->ring.recs[n].site);
+	}
+
+	if (!write_all(fd, &trace_nsites, sizeof(trace_nsites)))
+		return false;
+
+	for (i = 0; i < TRACE_MAX_SITES; i++) {
+		if (trace_sites[i] == NULL)
+			continue;
+		memset(&fsite, 0, sizeof(fsite));
+		fsite.site = (uintptr_t) trace_sites[i];
+		fsite.len = strlen(trace_sites[i]);
+		if (!write_all(fd, &fsite, sizeof(fsite)) ||
+		    !write_all(fd, trace_sites[i], fsite.len))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Dump the trace rings to a file
+ *
+ * @param[in] path  File to write, replaced if it exists
+ *
+ * @return 0 or an errno.
+ */
+int gsh_trace_dump(const char *path)
+{
+	int fd, rc = 0;
+
+	if (gsh_trace_mask == 0)
+		return ENOTSUP;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return errno;
+
+	pthread_mutex_lock(&trace_mtx);
+	if (!trace_dump_fd(fd))
+		rc = errno;
+	pthread_mutex_unlock(&trace_mtx);
+
+	if (close(fd) != 0 && rc == 0)
+		rc = errno;
+
+	return rc;
+}
+
+static void trace_crash_dump(void)
+{
+	int fd;
+
+	fd = open(trace_crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return;
+
+	/* Whoever holds the lock is not going to release it */
+	(void)trace_dump_fd(fd);
+	(void)close(fd);
+}
+
+static void trace_crash_handler(int sig)
+{
+	trace_crash_dump();
+
+	/* SA_RESETHAND put back the default action */
+	raise(sig);
+}
+
+static cleanup_list_element trace_cleanup = {
+	.clean = trace_crash_dump,
+};
+
+/**
+ * @brief Turn on tracing
+ *
+ * Called at startup once the config is read.
+ *
+ * @param[in] records     Records per ring, 0 to leave tracing off
+ * @param[in] crash_path  Where to dump the rings on a crash, the pid
+ *                        is appended
+ */
+void gsh_trace_pkginit(uint32_t records, const char *crash_path)
+{
+	static const int crash_signals[] = {
+		SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT
+	};
+	struct sigaction act;
+	uint32_t size = 64;
+	int i;
+
+	if (records == 0)
+		return;
+
+	while (size < records)
+		size <<= 1;
+
+	if (pthread_key_create(&trace_key, trace_thread_exit) != 0) {
+		LogCrit(COMPONENT_INIT, "Could not create the trace key");
+		return;
+	}
+
+	(void)snprintf(trace_crash_path, sizeof(trace_crash_path), "%s.%d",
+		       crash_path, (int) getpid());
+
+	memset(&act, 0, sizeof(act));
+	act.sa_handler = trace_crash_handler;
+	act.sa_flags = SA_RESETHAND;
+	sigemptyset(&act.sa_mask);
+	for (i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]);
+	     i++)
+		(void)sigaction(crash_signals[i], &act, NULL);
+
+	RegisterCleanup(&trace_cleanup);
+
+	gsh_trace_mask = size - 1;
+
+	LogInfo(COMPONENT_INIT,
+		"Tracing %" PRIu32 " events per thread, crash dump to %s",
+		size, trace_crash_path);
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file io_bufpool.c
+ * @brief Size-class pool of page-aligned READ/WRITE data buffers
+ *
+ * See io_bufpool.h for the overall design.  Each size class owns an
+ * equal slice of one MAP_NORESERVE reservation; buffers are carved out
+ * of the slice on demand, so memory is only committed for buffers that
+ * have actually been used, and free buffers are kept on a per-node LIFO
+ * list threaded through the buffers themselves.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "log.h"
+#include "nfs_core.h"
+#include "io_bufpool.h"
+
+/** Most NUMA nodes we keep separate free lists for */
+#define IO_BUF_MAX_NODES 64
+
+struct io_buf_freeent {
+	struct io_buf_freeent *next;
+};
+
+struct io_buf_node {
+	pthread_mutex_t mtx;
+	struct io_buf_freeent *head;
+};
+
+struct io_buf_class {
+	char *base;		/*< Start of this class' slice */
+	size_t size;		/*< Buffer size */
+	uint64_t capacity;	/*< Buffers the slice can hold */
+	uint64_t created;	/*< Buffers carved out so far */
+	uint8_t *home;		/*< First-touch node of each buffer */
+	pthread_mutex_t mtx;	/*< Protects created */
+	struct io_buf_node *nodes;
+	uint64_t in_use;
+	uint64_t hiwat;
+	uint64_t allocs;
+	uint64_t misses;
+};
+
+struct io_buf_tcache {
+	unsigned int count[IO_BUF_MAX_CLASSES];
+	void *bufs[IO_BUF_MAX_CLASSES][IO_BUF_TCACHE_MAX];
+	bool registered;
+};
+
+static struct {
+	char *base;
+	size_t slice;
+	unsigned int nclasses;
+	unsigned int nnodes;
+	unsigned int tcache;
+	struct io_buf_class classes[IO_BUF_MAX_CLASSES];
+} io_bufpool;
+
+static __thread struct io_buf_tcache io_buf_tcache;
+static pthread_key_t io_buf_tcache_key;
+
+/**
+ * @brief Count the NUMA nodes the kernel knows about
+ */
+static unsigned int io_buf_count_nodes(void)
+{
+	char path[64];
+	unsigned int n;
+
+	for (n = 0; n < IO_BUF_MAX_NODES; n++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%u",
+			 n);
+		if (access(path, F_OK) != 0)
+			break;
+	}
+
+	return n == 0 ? 1 : n;
+}
+
+/**
+ * @brief Node of the CPU the calling thread runs on
+ */
+static inline unsigned int io_buf_cur_node(void)
+{
+	unsigned int cpu, node;
+
+	if (io_bufpool.nnodes == 1 ||
+	    syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+		return 0;
+
+	return node % io_bufpool.nnodes;
+}
+
+static inline unsigned int io_buf_class_of(size_t size)
+{
+	unsigned int shift = IO_BUF_MIN_SHIFT;
+
+	while (((size_t) 1 << shift) < size)
+		shift++;
+
+	return shift - IO_BUF_MIN_SHIFT;
+}
+
+static inline void io_buf_note_alloc(struct io_buf_class *cls)
+{
+	uint64_t in_use, hiwat;
+
+	(void) atomic_inc_uint64_t(&cls->allocs);
+	in_use = atomic_inc_uint64_t(&cls->in_use);
+
+	do {
+		hiwat = atomic_fetch_uint64_t(&cls->hiwat);
+		if (in_use <= hiwat)
+			break;
+	} while (!__sync_bool_compare_and_swap(&cls->hiwat, hiwat, in_use));
+}
+
+static void *io_buf_pop(struct io_buf_node *node)
+{
+	struct io_buf_freeent *ent;
+
+	PTHREAD_MUTEX_lock(&node->mtx);
+	ent = node->head;
+	if (ent != NULL)
+		node->head = ent->next;
+	PTHREAD_MUTEX_unlock(&node->mtx);
+
+	return ent;
+}
+
+/**
+ * @brief Put a pool buffer back on its home node's free list
+ */
+static void io_buf_push(void *buf)
+{
+	struct io_buf_freeent *ent = buf;
+	size_t off = (char *) buf - io_bufpool.base;
+	struct io_buf_class *cls = &io_bufpool.classes[off / io_bufpool.slice];
+	struct io_buf_node *node =
+		&cls->nodes[cls->home[(off % io_bufpool.slice) / cls->size]];
+
+	PTHREAD_MUTEX_lock(&node->mtx);
+	ent->next = node->head;
+	node->head = ent;
+	PTHREAD_MUTEX_unlock(&node->mtx);
+}
+
+/**
+ * @brief Return a thread's cached buffers when it exits
+ */
+static void io_buf_tcache_flush(void *arg)
+{
+	struct io_buf_tcache *tc = arg;
+	unsigned int idx;
+
+	for (idx = 0; idx < io_bufpool.nclasses; idx++) {
+		while (tc->count[idx] > 0)
+			io_buf_push(tc->bufs[idx][--tc->count[idx]]);
+	}
+}
+
+/**
+ * @brief Set up the pool
+ *
+ * The largest class is the smallest power of two covering @a max_io,
+ * normally the largest MaxRead/MaxWrite of any export.  Each class gets
+ * IO_Buffer_Pool_Size bytes of address space; 0 disables the pool.
+ *
+ * @param[in] max_io  Largest I/O size to serve from the pool
+ */
+void io_bufpool_init(uint64_t max_io)
+{
+	uint64_t pool_size = nfs_param.core_param.io_buffer_pool_size;
+	struct io_buf_class *cls;
+	unsigned int idx, n;
+	size_t top;
+
+	if (pool_size == 0 || io_bufpool.base != NULL)
+		return;
+
+	io_bufpool.nclasses = io_buf_class_of(max_io) + 1;
+	if (io_bufpool.nclasses > IO_BUF_MAX_CLASSES)
+		io_bufpool.nclasses = IO_BUF_MAX_CLASSES;
+
+	top = (size_t) 1 << (IO_BUF_MIN_SHIFT + io_bufpool.nclasses - 1);
+
+	/* Every slice holds at least one buffer of the largest class */
+	io_bufpool.slice = (pool_size + top - 1) & ~(top - 1);
+	io_bufpool.nnodes = io_buf_count_nodes();
+	io_bufpool.tcache = nfs_param.core_param.io_buffer_thread_cache;
+
+	io_bufpool.base = mmap(NULL, io_bufpool.slice * io_bufpool.nclasses,
+			       PROT_READ | PROT_WRITE,
+			       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+			       -1, 0);
+
+	if (io_bufpool.base == MAP_FAILED) {
+		LogWarn(COMPONENT_INIT,
+			"Could not reserve I/O buffer pool: %s",
+			strerror(errno));
+		io_bufpool.base = NULL;
+		return;
+	}
+
+	(void) pthread_key_create(&io_buf_tcache_key, io_buf_tcache_flush);
+
+	for (idx = 0; idx < io_bufpool.nclasses; idx++) {
+		cls = &io_bufpool.classes[idx];
+		cls->base = io_bufpool.base + idx * io_bufpool.slice;
+		cls->size = (size_t) 1 << (IO_BUF_MIN_SHIFT + idx);
+		cls->capacity = io_bufpool.slice / cls->size;
+		cls->home = gsh_calloc(cls->capacity, sizeof(*cls->home));
+		cls->nodes = gsh_calloc(io_bufpool.nnodes,
+					sizeof(*cls->nodes));
+		PTHREAD_MUTEX_init(&cls->mtx, NULL);
+		for (n = 0; n < io_bufpool.nnodes; n++)
+			PTHREAD_MUTEX_init(&cls->nodes[n].mtx, NULL);
+	}
+
+	LogInfo(COMPONENT_INIT,
+		"I/O buffer pool: %u size classes from %u to %zu bytes, %zu bytes each, %u NUMA nodes",
+		io_bufpool.nclasses, 1 << IO_BUF_MIN_SHIFT, top,
+		io_bufpool.slice, io_bufpool.nnodes);
+}
+
+/**
+ * @brief Get a page-aligned buffer of at least @a size bytes
+ *
+ * @param[in] size  Size wanted
+ *
+ * @return The buffer, release with io_buf_free().
+ */
+void *io_buf_alloc(size_t size)
+{
+	struct io_buf_tcache *tc = &io_buf_tcache;
+	struct io_buf_class *cls;
+	unsigned int idx, node, n;
+	uint64_t i = 0;
+	void *buf;
+
+	if (io_bufpool.base == NULL ||
+	    size > io_bufpool.classes[io_bufpool.nclasses - 1].size)
+		return gsh_malloc_aligned(4096, size);
+
+	idx = io_buf_class_of(size);
+	cls = &io_bufpool.classes[idx];
+
+	if (tc->count[idx] > 0) {
+		buf = tc->bufs[idx][--tc->count[idx]];
+		goto out;
+	}
+
+	node = io_buf_cur_node();
+	buf = io_buf_pop(&cls->nodes[node]);
+	if (buf != NULL)
+		goto out;
+
+	/* Carve out a fresh buffer; whoever touches it first places its
+	 * pages, so it belongs to this node from now on.
+	 */
+	PTHREAD_MUTEX_lock(&cls->mtx);
+	if (cls->created < cls->capacity)
+		i = cls->created++;
+	else
+		i = cls->capacity;
+	PTHREAD_MUTEX_unlock(&cls->mtx);
+
+	if (i < cls->capacity) {
+		cls->home[i] = node;
+		buf = cls->base + i * cls->size;
+		goto out;
+	}
+
+	/* Slice exhausted, take a remote buffer before giving up */
+	for (n = 1; n < io_bufpool.nnodes; n++) {
+		buf = io_buf_pop(&cls->nodes[(node + n) % io_bufpool.nnodes]);
+		if (buf != NULL)
+			goto out;
+	}
+
+	(void) atomic_inc_uint64_t(&cls->misses);
+	return gsh_malloc_aligned(4096, size);
+
+ out:
+	io_buf_note_alloc(cls);
+	return buf;
+}
+
+/**
+ * @brief Release a buffer from io_buf_alloc()
+ *
+ * @param[in] buf  Buffer to release, may be NULL
+ */
+void io_buf_free(void *buf)
+{
+	struct io_buf_tcache *tc = &io_buf_tcache;
+	struct io_buf_class *cls;
+	unsigned int idx;
+
+	if (io_bufpool.base == NULL || (char *) buf < io_bufpool.base ||
+	    (char *) buf >= io_bufpool.base +
+			    io_bufpool.slice * io_bufpool.nclasses) {
+		gsh_free(buf);
+		return;
+	}
+
+	idx = ((char *) buf - io_bufpool.base) / io_bufpool.slice;
+	cls = &io_bufpool.classes[idx];
+
+	(void) atomic_dec_uint64_t(&cls->in_use);
+
+	if (tc->count[idx] < io_bufpool.tcache) {
+		if (!tc->registered) {
+			(void) pthread_setspecific(io_buf_tcache_key, tc);
+			tc->registered = true;
+		}
+		tc->bufs[idx][tc->count[idx]++] = buf;
+		return;
+	}
+
+	io_buf_push(buf);
+}
+
+/**
+ * @brief Snapshot the per-class counters
+ *
+ * @param[out] stats  Array to fill
+ * @param[in]  max    Size of @a stats
+ *
+ * @return Number of classes filled in.
+ */
+unsigned int io_bufpool_stats(struct io_bufpool_class_stats *stats,
+			      unsigned int max)
+{
+	unsigned int idx;
+
+	if (io_bufpool.base == NULL)
+		return 0;
+
+	for (idx = 0; idx < io_bufpool.nclasses && idx < max; idx++) {
+		struct io_buf_class *cls = &io_bufpool.classes[idx];
+
+		stats[idx].size = cls->size;
+		stats[idx].capacity = cls->capacity;
+		stats[idx].created = atomic_fetch_uint64_t(&cls->created);
+		stats[idx].in_use = atomic_fetch_uint64_t(&cls->in_use);
+		stats[idx].hiwat = atomic_fetch_uint64_t(&cls->hiwat);
+		stats[idx].allocs = atomic_fetch_uint64_t(&cls->allocs);
+		stats[idx].misses = atomic_fetch_uint64_t(&cls->misses);
+	}
+
+	return idx;
+}
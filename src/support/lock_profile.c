@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file lock_profile.c
+ * @brief Registry and report of the lock call sites
+ *
+ * See lock_profile.h.  A site joins the registry the first time it
+ * takes its lock and stays there, sites are static.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <time.h>
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "lock_profile.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+__thread struct lock_held lock_held[LOCK_PROFILE_HELD];
+__thread uint32_t lock_nheld;
+
+/* Not the PTHREAD_MUTEX_ macros, they would profile this one too */
+static pthread_mutex_t lock_sites_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct lock_site *lock_sites;
+
+void lock_profile_register(struct lock_site *site)
+{
+	pthread_mutex_lock(&lock_sites_mtx);
+
+	if (!site->registered) {
+		site->next = lock_sites;
+		lock_sites = site;
+		atomic_store_uint32_t(&site->registered, 1);
+	}
+
+	pthread_mutex_unlock(&lock_sites_mtx);
+}
+
+/**
+ * @brief Zero the counters of all the sites
+ *
+ * Locks held across the reset still add their hold time.
+ */
+void lock_profile_reset(void)
+{
+	struct lock_site *site;
+
+	pthread_mutex_lock(&lock_sites_mtx);
+
+	for (site = lock_sites; site != NULL; site = site->next) {
+		atomic_store_uint64_t(&site->acquired, 0);
+		atomic_store_uint64_t(&site->contended, 0);
+		atomic_store_uint64_t(&site->wait, 0);
+		atomic_store_uint64_t(&site->wait_max, 0);
+		atomic_store_uint64_t(&site->hold, 0);
+		atomic_store_uint64_t(&site->hold_max, 0);
+	}
+
+	pthread_mutex_unlock(&lock_sites_mtx);
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Ticks of lock_profile_clock() per nanosecond
+ *
+ * Measured once, against CLOCK_MONOTONIC.
+ */
+static double lock_ticks_per_ns(void)
+{
+	static double ratio;
+	struct timespec delay = {0, 10000000};
+	uint64_t ns, ticks;
+
+	if (ratio != 0)
+		return ratio;
+
+	ns = gsh_trace_clock();
+	ticks = lock_profile_clock();
+	(void)nanosleep(&delay, NULL);
+	ticks = lock_profile_clock() - ticks;
+	ns = gsh_trace_clock() - ns;
+
+	ratio = ns != 0 && ticks != 0 ? (double)ticks / ns : 1;
+	return ratio;
+}
+
+/**
+ * @brief Report the counters of all the sites
+ *
+ * For each site that took a lock: the lock expression, file and line,
+ * the acquisitions, those that waited, the total and longest wait in
+ * ns, and the total and longest hold in ns.
+ */
+void lock_profile_dbus(DBusMessageIter *iter)
+{
+	struct lock_site *site;
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	double ratio = lock_ticks_per_ns();
+	uint64_t val[6];
+	uint32_t line;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 "(ssutttttt)", &array_iter);
+
+	pthread_mutex_lock(&lock_sites_mtx);
+
+	for (site = lock_sites; site != NULL; site = site->next) {
+		val[0] = atomic_fetch_uint64_t(&site->acquired);
+		val[1] = atomic_fetch_uint64_t(&site->contended);
+		val[2] = atomic_fetch_uint64_t(&site->wait) / ratio;
+		val[3] = atomic_fetch_uint64_t(&site->wait_max) / ratio;
+		val[4] = atomic_fetch_uint64_t(&site->hold) / ratio;
+		val[5] = atomic_fetch_uint64_t(&site->hold_max) / ratio;
+		line = site->line;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &site->name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &site->file);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &line);
+		for (i = 0; i < 6; i++)
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       &val[i]);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+
+	pthread_mutex_unlock(&lock_sites_mtx);
+
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file mem_account.c
+ * @brief Counters of the memory held by each subsystem
+ *
+ * See mem_account.h.  The subsystem of a source file is found from its
+ * path once, then kept in a table keyed by the address of the file
+ * name, which is the same for all the calls from a file.  Each thread
+ * counts in one of a few stripes, so threads allocating at once mostly
+ * touch different cache lines; the stripes are summed when reported.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "abstract_mem.h"
+#include "abstract_atomic.h"
+#include "common_utils.h"
+#include "mem_account.h"
+#include "stats_shm.h"
+#ifdef USE_DBUS
+#include "gsh_dbus.h"
+#endif
+
+/** Slots of the file table, a power of 2 */
+#define MEM_ACCOUNT_FILES 2048
+#define MEM_ACCOUNT_STRIPES 32
+
+struct mem_account_counters {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t bytes;		/*< Allocated in all */
+	uint64_t freed;		/*< Bytes */
+};
+
+struct mem_account_stripe {
+	struct mem_account_counters tag[MEM_TAG_COUNT];
+} __attribute__ ((__aligned__(GSH_CACHE_LINE_SIZE)));
+
+static const char *const mem_tag_names[MEM_TAG_COUNT] = {
+	[MEM_TAG_OTHER] = "other",
+	[MEM_TAG_MDCACHE] = "mdcache",
+	[MEM_TAG_SAL] = "sal",
+	[MEM_TAG_DRC] = "drc",
+	[MEM_TAG_XDR] = "xdr",
+	[MEM_TAG_RPC] = "rpc",
+	[MEM_TAG_FSAL] = "fsal",
+	[MEM_TAG_PROTOCOLS] = "protocols",
+};
+
+/* File name address shifted by 8, or'ed with the tag, 0 if free.
+ * User space addresses fit in 56 bits.
+ */
+static uint64_t mem_account_files[MEM_ACCOUNT_FILES];
+static struct mem_account_stripe mem_account_stripes[MEM_ACCOUNT_STRIPES];
+static uint32_t mem_account_next_stripe;
+static __thread uint32_t mem_account_stripe; /*< Plus one, 0 if unset */
+
+/* A directory, or the start of a file name, within the path */
+static bool mem_path_has(const char *file, const char *dir)
+{
+	const char *s = file;
+
+	while ((s = strstr(s, dir)) != NULL) {
+		if (s == file || s[-1] == '/')
+			return true;
+		s++;
+	}
+
+	return false;
+}
+
+static enum mem_tag mem_classify(const char *file)
+{
+	if (mem_path_has(file, "FSAL_MDCACHE/"))
+		return MEM_TAG_MDCACHE;
+	if (mem_path_has(file, "nfs_dupreq"))
+		return MEM_TAG_DRC;
+	if (mem_path_has(file, "XDR/") || mem_path_has(file, "xdr"))
+		return MEM_TAG_XDR;
+	if (mem_path_has(file, "RPCAL/") || mem_path_has(file, "nfs_rpc_") ||
+	    strstr(file, "ntirpc") != NULL)
+		return MEM_TAG_RPC;
+	if (mem_path_has(file, "SAL/"))
+		return MEM_TAG_SAL;
+	if (mem_path_has(file, "FSAL/"))
+		return MEM_TAG_FSAL;
+	if (mem_path_has(file, "Protocols/"))
+		return MEM_TAG_PROTOCOLS;
+
+	return MEM_TAG_OTHER;
+}
+
+/**
+ * @brief Subsystem of a source file
+ *
+ * @param[in] file __FILE__ of the caller
+ */
+enum mem_tag mem_account_tag(const char *file)
+{
+	uint64_t key = (uint64_t) (uintptr_t) file << 8;
+	uint64_t h = key * 0x9E3779B97F4A7C15ULL, slot;
+	uint32_t i, idx;
+	enum mem_tag tag;
+
+	for (i = 0; i < MEM_ACCOUNT_FILES; i++) {
+		idx = ((h >> 40) + i) & (MEM_ACCOUNT_FILES - 1);
+		slot = atomic_fetch_uint64_t(&mem_account_files[idx]);
+		if (slot == 0)
+			break;
+		if ((slot & ~0xffULL) == key)
+			return slot & 0xff;
+	}
+
+	tag = mem_classify(file);
+
+	/* Lost races only leave a file in two slots */
+	if (i < MEM_ACCOUNT_FILES)
+		(void) atomic_cmpxchg_uint64_t(&mem_account_files[idx], 0,
+					       key | tag);
+
+	return tag;
+}
+
+static struct mem_account_counters *mem_account_counters(enum mem_tag tag)
+{
+	uint32_t s = mem_account_stripe;
+
+	if (s == 0) {
+		s = atomic_inc_uint32_t(&mem_account_next_stripe) %
+		    MEM_ACCOUNT_STRIPES + 1;
+		mem_account_stripe = s;
+	}
+
+	return &mem_account_stripes[s - 1].tag[tag];
+}
+
+void mem_account_add(enum mem_tag tag, size_t n)
+{
+	struct mem_account_counters *c = mem_account_counters(tag);
+
+	(void) atomic_inc_uint64_t(&c->allocs);
+	(void) atomic_add_uint64_t(&c->bytes, n);
+}
+
+void mem_account_sub(enum mem_tag tag, size_t n)
+{
+	struct mem_account_counters *c = mem_account_counters(tag);
+
+	(void) atomic_inc_uint64_t(&c->frees);
+	(void) atomic_add_uint64_t(&c->freed, n);
+}
+
+static void mem_account_sum(enum mem_tag tag,
+			    struct mem_account_counters *sum)
+{
+	struct mem_account_counters *c;
+	uint32_t i;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < MEM_ACCOUNT_STRIPES; i++) {
+		c = &mem_account_stripes[i].tag[tag];
+		sum->allocs += atomic_fetch_uint64_t(&c->allocs);
+		sum->frees += atomic_fetch_uint64_t(&c->frees);
+		sum->bytes += atomic_fetch_uint64_t(&c->bytes);
+		sum->freed += atomic_fetch_uint64_t(&c->freed);
+	}
+
+	/* Stripes read while others counted */
+	if (sum->frees > sum->allocs)
+		sum->frees = sum->allocs;
+	if (sum->freed > sum->bytes)
+		sum->freed = sum->bytes;
+}
+
+/**
+ * @brief Add the counters to the shared memory segment
+ *
+ * As mem.<subsystem>.blocks, .bytes and .allocs.
+ */
+void mem_account_shm_fill(struct stats_shm_ctx *ctx)
+{
+	struct mem_account_counters sum;
+	char name[GSH_STATS_SHM_NAME_LEN];
+	int tag;
+
+	for (tag = 0; tag < MEM_TAG_COUNT; tag++) {
+		mem_account_sum(tag, &sum);
+		snprintf(name, sizeof(name), "%s.blocks", mem_tag_names[tag]);
+		stats_shm_value(ctx, "mem", name, sum.allocs - sum.frees);
+		snprintf(name, sizeof(name), "%s.bytes", mem_tag_names[tag]);
+		stats_shm_value(ctx, "mem", name, sum.bytes - sum.freed);
+		snprintf(name, sizeof(name), "%s.allocs", mem_tag_names[tag]);
+		stats_shm_value(ctx, "mem", name, sum.allocs);
+	}
+}
+
+#ifdef USE_DBUS
+/**
+ * @brief Report the memory held by each subsystem
+ *
+ * For each: its name, the blocks and bytes live, then the blocks
+ * allocated and freed and the bytes allocated since the start.
+ */
+void mem_account_dbus(DBusMessageIter *iter)
+{
+	DBusMessageIter array_iter, struct_iter;
+	struct mem_account_counters sum;
+	struct timespec timestamp;
+	uint64_t blocks, bytes;
+	const char *name;
+	int tag;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "(sttttt)",
+					 &array_iter);
+	for (tag = 0; tag < MEM_TAG_COUNT; tag++) {
+		mem_account_sum(tag, &sum);
+		name = mem_tag_names[tag];
+		blocks = sum.allocs - sum.frees;
+		bytes = sum.bytes - sum.freed;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &blocks);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &bytes);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum.allocs);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum.frees);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &sum.bytes);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+#endif
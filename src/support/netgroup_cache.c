@@ -21,14 +21,19 @@
 #include "log.h"
 #include "config_parsing.h"
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <unistd.h>
 #include "gsh_intrinsic.h"
 #include "gsh_types.h"
+#include "gsh_list.h"
 #include "common_utils.h"
 #include "avltree.h"
 #include "abstract_atomic.h"
 #include "netdb.h"
 #include "abstract_mem.h"
+#include "fridgethr.h"
+#include "nfs_core.h"
 #include "netgroup_cache.h"
 
 /* Netgroup cache information */
@@ -41,6 +46,9 @@ struct ng_cache_info {
 
 #define NG_CACHE_SIZE 1009
 
+/* Shards of the cache, slot i of ng_cache belongs to shard i % NG_SHARDS */
+#define NG_SHARDS 16
+
 /* Uses FNV hash */
 #define FNV_PRIME32 16777619
 #define FNV_OFFSET32 2166136261U
@@ -66,11 +74,65 @@ static int ng_hash_key(struct ng_cache_info *info)
 
 static struct avltree_node *ng_cache[NG_CACHE_SIZE];
 
-pthread_rwlock_t ng_lock = PTHREAD_RWLOCK_INITIALIZER;
+/* Positive and negative cache trees of a shard */
+struct ng_shard {
+	pthread_rwlock_t lock;
+	struct avltree pos_ng_tree;
+	struct avltree neg_ng_tree;
+};
+
+static struct ng_shard ng_shards[NG_SHARDS];
+
+/**
+ * @brief A netgroup the exports use
+ *
+ * Netgroups join the list the first time a client is checked against
+ * them and are never removed.  With Netgroup_Preload_Interval, the
+ * preload thread enumerates them into the member table; once a group
+ * is loaded its checks are answered from the table alone.
+ */
+struct ng_group {
+	struct glist_head list;
+	uint32_t loaded;	/*< The members in the table are complete */
+	uint32_t any_host;	/*< A triple of the group has no host */
+	char name[];
+};
+
+static pthread_rwlock_t ng_groups_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct glist_head ng_groups = { &ng_groups, &ng_groups };
+
+/* A host of a loaded group */
+struct ng_member {
+	struct ng_member *next;
+	struct ng_group *group;
+	uint32_t hash;
+	char host[];
+};
+
+/* Buckets of the member table, bucket i is locked by shard i % NG_SHARDS */
+#define NG_MEMBER_BUCKETS 4096
 
-/* Positive and negative cache trees */
-static struct avltree pos_ng_tree;
-static struct avltree neg_ng_tree;
+static struct ng_member *ng_members[NG_MEMBER_BUCKETS];
+static pthread_rwlock_t ng_member_locks[NG_SHARDS];
+
+static struct fridgethr *ng_fridge;
+
+/* Host names compare without case, as innetgr() does */
+static uint32_t ng_host_hash(const char *host)
+{
+	uint32_t hash = FNV_OFFSET32;
+
+	while (*host) {
+		hash ^= tolower((unsigned char)*host++);
+		hash *= FNV_PRIME32;
+	}
+	return hash;
+}
+
+static inline struct ng_shard *ng_shard(int slot)
+{
+	return &ng_shards[slot % NG_SHARDS];
+}
 
 static inline int buffdesc_comparator(const struct gsh_buffdesc *buff1,
 				      const struct gsh_buffdesc *buff2)
@@ -113,16 +175,61 @@ static bool ng_expired(struct avltree_node *node)
 	return false;
 }
 
-
+static void ng_preload_run(struct fridgethr_context *ctx);
 
 /**
  * @brief Initialize the netgroups cache
  */
 void ng_cache_init(void)
 {
-	avltree_init(&pos_ng_tree, ng_comparator, 0);
-	avltree_init(&neg_ng_tree, ng_comparator, 0);
+	struct fridgethr_params frp;
+	int i;
+
+	for (i = 0; i < NG_SHARDS; i++) {
+		PTHREAD_RWLOCK_init(&ng_shards[i].lock, NULL);
+		avltree_init(&ng_shards[i].pos_ng_tree, ng_comparator, 0);
+		avltree_init(&ng_shards[i].neg_ng_tree, ng_comparator, 0);
+		PTHREAD_RWLOCK_init(&ng_member_locks[i], NULL);
+	}
 	memset(ng_cache, 0, NG_CACHE_SIZE * sizeof(struct avltree_node *));
+
+	if (nfs_param.core_param.netgroup_preload_interval == 0)
+		return;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = nfs_param.core_param.netgroup_preload_interval;
+	frp.flavor = fridgethr_flavor_looper;
+
+	if (fridgethr_init(&ng_fridge, "netgroup", &frp) != 0 ||
+	    fridgethr_submit(ng_fridge, ng_preload_run, NULL) != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to start the netgroup preload thread, netgroups will be looked up one client at a time");
+		ng_fridge = NULL;
+	}
+}
+
+/**
+ * @brief Stop the netgroup preload thread
+ */
+void ng_cache_shutdown(void)
+{
+	int rc;
+
+	if (ng_fridge == NULL)
+		return;
+
+	rc = fridgethr_sync_command(ng_fridge, fridgethr_comm_stop, 120);
+	if (rc == ETIMEDOUT) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Shutdown timed out, cancelling threads.");
+		fridgethr_cancel(ng_fridge);
+	} else if (rc != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Failed shutting down netgroup preload thread: %d",
+			 rc);
+	}
 }
 
 static void ng_free(struct ng_cache_info *info)
@@ -132,19 +239,21 @@ static void ng_free(struct ng_cache_info *info)
 	gsh_free(info);
 }
 
-/* The caller must hold ng_lock for write */
-static void ng_remove(struct ng_cache_info *info, bool negative)
+/* The caller must hold the lock of the shard for write */
+static void ng_remove(struct ng_shard *shard, struct ng_cache_info *info,
+		      bool negative)
 {
 	if (negative) {
-		avltree_remove(&info->ng_node, &neg_ng_tree);
+		avltree_remove(&info->ng_node, &shard->neg_ng_tree);
 	} else {
 		ng_cache[ng_hash_key(info)] = NULL;
-		avltree_remove(&info->ng_node, &pos_ng_tree);
+		avltree_remove(&info->ng_node, &shard->pos_ng_tree);
 	}
 }
 
- /* The caller must hold ng_lock for write */
-static void ng_add(const char *group, const char *host, bool negative)
+ /* The caller must hold the lock of the shard for write */
+static void ng_add(struct ng_shard *shard, const char *group,
+		   const char *host, bool negative)
 {
 	struct ng_cache_info *info;
 	struct avltree_node *found_node;
@@ -162,7 +271,8 @@ static void ng_add(const char *group, const char *host, bool negative)
 
 	if (negative) {
 		/* @todo check positive cache first? */
-		found_node = avltree_insert(&info->ng_node, &neg_ng_tree);
+		found_node = avltree_insert(&info->ng_node,
+					    &shard->neg_ng_tree);
 
 		/* If an already existing entry is found, keep the old
 		 * entry, and free the current entry
@@ -175,7 +285,8 @@ static void ng_add(const char *group, const char *host, bool negative)
 		}
 	} else {
 		/* @todo delete from negative cache if there? */
-		found_node = avltree_insert(&info->ng_node, &pos_ng_tree);
+		found_node = avltree_insert(&info->ng_node,
+					    &shard->pos_ng_tree);
 
 		/* If an already existing entry is found, keep the old
 		 * entry, and free the current entry
@@ -192,21 +303,17 @@ static void ng_add(const char *group, const char *host, bool negative)
 	}
 }
 
-/* The caller must hold ng_lock for read */
-static bool ng_lookup(const char *group, const char *host, bool negative)
+/* The caller must hold the lock of the shard for read */
+static bool ng_lookup(struct ng_shard *shard, struct ng_cache_info *prototype,
+		      int slot, bool negative)
 {
-	struct ng_cache_info prototype = {
-		.ng_group.addr = (char *)group,
-		.ng_group.len = strlen(group)+1,
-		.ng_host.addr = (char *)host,
-		.ng_host.len = strlen(host)+1
-	};
 	struct avltree_node *node;
 	struct ng_cache_info *info;
 	void **cache_slot;
 
 	if (negative) {
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
+		node = avltree_lookup(&prototype->ng_node,
+				      &shard->neg_ng_tree);
 		if (!node)
 			return false;
 
@@ -217,16 +324,16 @@ static bool ng_lookup(const char *group, const char *host, bool negative)
 	}
 
 	/* Positive lookups are stored in the cache */
-	cache_slot = (void **)&ng_cache[ng_hash_key(&prototype)];
+	cache_slot = (void **)&ng_cache[slot];
 	node = atomic_fetch_voidptr(cache_slot);
-	if (node && ng_comparator(node, &prototype.ng_node) == 0) {
+	if (node && ng_comparator(node, &prototype->ng_node) == 0) {
 		if (!ng_expired(node))
 			return true;
 		goto expired;
 	}
 
 	/* cache miss, search AVL tree */
-	node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
+	node = avltree_lookup(&prototype->ng_node, &shard->pos_ng_tree);
 	if (!node)
 		return false;
 
@@ -239,87 +346,302 @@ static bool ng_lookup(const char *group, const char *host, bool negative)
 
 expired:
 	/* entry expired, acquire write mode lock for removal */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
 
 	/* Since we dropped the read mode lock and acquired write mode
 	 * lock, make sure that the entry is still in the tree.
 	 */
 	if (negative)
-		node = avltree_lookup(&prototype.ng_node, &neg_ng_tree);
+		node = avltree_lookup(&prototype->ng_node,
+				      &shard->neg_ng_tree);
 	else
-		node = avltree_lookup(&prototype.ng_node, &pos_ng_tree);
+		node = avltree_lookup(&prototype->ng_node,
+				      &shard->pos_ng_tree);
 
 	if (node) {
 		info = avltree_container_of(node, struct ng_cache_info,
 					    ng_node);
-		ng_remove(info, negative);
+		ng_remove(shard, info, negative);
 		ng_free(info);
 	}
-	PTHREAD_RWLOCK_unlock(&ng_lock);
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
 	return false;
 }
 
+/**
+ * @brief Find a netgroup, adding it for the preload thread if new
+ */
+static struct ng_group *ng_group_get(const char *group)
+{
+	struct glist_head *glist;
+	struct ng_group *ng = NULL;
+
+	PTHREAD_RWLOCK_rdlock(&ng_groups_lock);
+	glist_for_each(glist, &ng_groups) {
+		ng = glist_entry(glist, struct ng_group, list);
+		if (strcmp(ng->name, group) == 0)
+			break;
+		ng = NULL;
+	}
+	PTHREAD_RWLOCK_unlock(&ng_groups_lock);
+
+	if (ng != NULL)
+		return ng;
+
+	PTHREAD_RWLOCK_wrlock(&ng_groups_lock);
+	glist_for_each(glist, &ng_groups) {
+		ng = glist_entry(glist, struct ng_group, list);
+		if (strcmp(ng->name, group) == 0)
+			break;
+		ng = NULL;
+	}
+	if (ng == NULL) {
+		ng = gsh_calloc(1, sizeof(*ng) + strlen(group) + 1);
+		strcpy(ng->name, group);
+		glist_add_tail(&ng_groups, &ng->list);
+	}
+	PTHREAD_RWLOCK_unlock(&ng_groups_lock);
+
+	/* Have it loaded now rather than at the next interval */
+	(void)fridgethr_wake(ng_fridge);
+
+	return ng;
+}
+
+/* Whether a host is in a loaded group */
+static bool ng_member_lookup(struct ng_group *ng, const char *host)
+{
+	uint32_t hash = ng_host_hash(host);
+	uint32_t bucket = hash % NG_MEMBER_BUCKETS;
+	struct ng_member *member;
+	bool found = false;
+
+	PTHREAD_RWLOCK_rdlock(&ng_member_locks[bucket % NG_SHARDS]);
+	for (member = ng_members[bucket]; member; member = member->next) {
+		if (member->group == ng && member->hash == hash &&
+		    strcasecmp(member->host, host) == 0) {
+			found = true;
+			break;
+		}
+	}
+	PTHREAD_RWLOCK_unlock(&ng_member_locks[bucket % NG_SHARDS]);
+
+	return found;
+}
+
+/**
+ * @brief Enumerate a netgroup into a new member table
+ *
+ * @return false if the netgroup could not be enumerated.
+ */
+static bool ng_preload_group(struct ng_group *ng, struct ng_member **table)
+{
+	char buf[4096];
+	char *host, *user, *domain;
+	struct ng_member *member;
+	uint32_t any_host = 0;
+	size_t len;
+
+	if (setnetgrent(ng->name) == 0) {
+		LogEvent(COMPONENT_IDMAPPER,
+			 "Could not enumerate netgroup %s", ng->name);
+		endnetgrent();
+		return false;
+	}
+
+	while (getnetgrent_r(&host, &user, &domain, buf, sizeof(buf)) == 1) {
+		if (host == NULL) {
+			any_host = 1;
+			continue;
+		}
+		if (*host == '\0' || strcmp(host, "-") == 0)
+			continue;
+
+		len = strlen(host) + 1;
+		member = gsh_malloc(sizeof(*member) + len);
+		memcpy(member->host, host, len);
+		member->group = ng;
+		member->hash = ng_host_hash(host);
+		member->next = table[member->hash % NG_MEMBER_BUCKETS];
+		table[member->hash % NG_MEMBER_BUCKETS] = member;
+	}
+	endnetgrent();
+
+	atomic_store_uint32_t(&ng->any_host, any_host);
+	return true;
+}
+
+static void ng_free_members(struct ng_member *member)
+{
+	struct ng_member *next;
+
+	for (; member; member = next) {
+		next = member->next;
+		gsh_free(member);
+	}
+}
+
+/**
+ * @brief Enumerate all the netgroups and swap the member table
+ *
+ * A group that can't be enumerated goes back to innetgr() until the
+ * next pass.
+ */
+static void ng_preload_run(struct fridgethr_context *ctx)
+{
+	struct ng_member **table;
+	struct ng_group **groups;
+	struct glist_head *glist;
+	bool *loaded;
+	size_t count = 0, i;
+	uint32_t bucket;
+
+	SetNameFunction("netgroup");
+
+	PTHREAD_RWLOCK_rdlock(&ng_groups_lock);
+	glist_for_each(glist, &ng_groups)
+		count++;
+	groups = gsh_calloc(count + 1, sizeof(*groups));
+	i = 0;
+	glist_for_each(glist, &ng_groups)
+		groups[i++] = glist_entry(glist, struct ng_group, list);
+	PTHREAD_RWLOCK_unlock(&ng_groups_lock);
+
+	if (count == 0) {
+		gsh_free(groups);
+		return;
+	}
+
+	table = gsh_calloc(NG_MEMBER_BUCKETS, sizeof(*table));
+	loaded = gsh_calloc(count, sizeof(*loaded));
+
+	for (i = 0; i < count; i++) {
+		loaded[i] = ng_preload_group(groups[i], table);
+		if (!loaded[i])
+			atomic_store_uint32_t(&groups[i]->loaded, 0);
+	}
+
+	/* Swap the new members in, freeing the old ones out of the locks */
+	for (i = 0; i < NG_SHARDS; i++) {
+		PTHREAD_RWLOCK_wrlock(&ng_member_locks[i]);
+		for (bucket = i; bucket < NG_MEMBER_BUCKETS;
+		     bucket += NG_SHARDS) {
+			struct ng_member *old = ng_members[bucket];
+
+			ng_members[bucket] = table[bucket];
+			table[bucket] = old;
+		}
+		PTHREAD_RWLOCK_unlock(&ng_member_locks[i]);
+	}
+
+	for (i = 0; i < count; i++)
+		if (loaded[i])
+			atomic_store_uint32_t(&groups[i]->loaded, 1);
+
+	for (bucket = 0; bucket < NG_MEMBER_BUCKETS; bucket++)
+		ng_free_members(table[bucket]);
+
+	LogDebug(COMPONENT_IDMAPPER, "Preloaded %zu netgroups", count);
+
+	gsh_free(table);
+	gsh_free(loaded);
+	gsh_free(groups);
+}
+
 /**
  * @brief Verify if the given host is in the given netgroup or not
  */
 bool ng_innetgr(const char *group, const char *host)
 {
+	struct ng_cache_info prototype = {
+		.ng_group.addr = (char *)group,
+		.ng_group.len = strlen(group)+1,
+		.ng_host.addr = (char *)host,
+		.ng_host.len = strlen(host)+1
+	};
+	struct ng_shard *shard;
+	struct ng_group *ng;
+	int slot;
 	int rc;
 
+	/* A preloaded group never goes to the name service */
+	if (ng_fridge != NULL) {
+		ng = ng_group_get(group);
+		if (atomic_fetch_uint32_t(&ng->loaded))
+			return atomic_fetch_uint32_t(&ng->any_host) ||
+			       ng_member_lookup(ng, host);
+	}
+
+	slot = ng_hash_key(&prototype);
+	shard = ng_shard(slot);
+
 	/* Check positive lookup and then negative lookup.  If absent in
 	 * both, then do a real innetgr call and cache the results.
 	 */
-	PTHREAD_RWLOCK_rdlock(&ng_lock);
-	if (ng_lookup(group, host, false)) { /* positive lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+	if (ng_lookup(shard, &prototype, slot, false)) { /* positive lookup */
+		PTHREAD_RWLOCK_unlock(&shard->lock);
 		return true;
 	}
-	if (ng_lookup(group, host, true)) { /* negative lookup */
-		PTHREAD_RWLOCK_unlock(&ng_lock);
+	if (ng_lookup(shard, &prototype, slot, true)) { /* negative lookup */
+		PTHREAD_RWLOCK_unlock(&shard->lock);
 		return false;
 	}
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
 	rc = innetgr(group, host, NULL, NULL);
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
 	if (rc)
-		ng_add(group, host, false);	/* positive lookup */
+		ng_add(shard, group, host, false);	/* positive lookup */
 	else
-		ng_add(group, host, true);	/* negative lookup */
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+		ng_add(shard, group, host, true);	/* negative lookup */
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 
 	return rc;
 }
 
 /**
  * @brief Wipe out the netgroup cache
+ *
+ * Preloaded groups are enumerated again right away.
  */
 void ng_clear_cache(void)
 {
 	struct avltree_node *node;
 	struct ng_cache_info *info;
+	struct ng_shard *shard;
+	int i;
 
-	PTHREAD_RWLOCK_wrlock(&ng_lock);
+	for (i = 0; i < NG_SHARDS; i++) {
+		shard = &ng_shards[i];
 
-	while ((node = avltree_first(&pos_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, false);
-		ng_free(info);
-	}
+		PTHREAD_RWLOCK_wrlock(&shard->lock);
 
-	while ((node = avltree_first(&neg_ng_tree))) {
-		info = avltree_container_of(node, struct ng_cache_info,
-					    ng_node);
-		ng_remove(info, true);
-		ng_free(info);
-	}
+		while ((node = avltree_first(&shard->pos_ng_tree))) {
+			info = avltree_container_of(node,
+						    struct ng_cache_info,
+						    ng_node);
+			ng_remove(shard, info, false);
+			ng_free(info);
+		}
 
-	assert(avltree_first(&pos_ng_tree) == NULL);
-	assert(avltree_first(&neg_ng_tree) == NULL);
+		while ((node = avltree_first(&shard->neg_ng_tree))) {
+			info = avltree_container_of(node,
+						    struct ng_cache_info,
+						    ng_node);
+			ng_remove(shard, info, true);
+			ng_free(info);
+		}
+
+		assert(avltree_first(&shard->pos_ng_tree) == NULL);
+		assert(avltree_first(&shard->neg_ng_tree) == NULL);
+
+		PTHREAD_RWLOCK_unlock(&shard->lock);
+	}
 
-	PTHREAD_RWLOCK_unlock(&ng_lock);
+	if (ng_fridge != NULL)
+		(void)fridgethr_wake(ng_fridge);
 }
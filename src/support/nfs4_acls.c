@@ -72,6 +72,184 @@ void nfs4_ace_free(fsal_ace_t *ace)
 	gsh_free(ace);
 }
 
+/* The whos an ACE may name, in the order they are sorted by */
+enum acl_who_class {
+	ACL_WHO_OWNER,
+	ACL_WHO_GROUP,
+	ACL_WHO_EVERYONE,
+	ACL_WHO_USER,
+	ACL_WHO_NAMED_GROUP,
+	ACL_WHO_NONE		/*< An unknown special who, matching no one */
+};
+
+struct acl_sort_ace {
+	uint32_t class;
+	uint32_t id;
+	uint32_t pos;
+};
+
+static int acl_sort_cmp(const void *a, const void *b)
+{
+	const struct acl_sort_ace *l = a, *r = b;
+
+	if (l->class != r->class)
+		return l->class < r->class ? -1 : 1;
+	if (l->id != r->id)
+		return l->id < r->id ? -1 : 1;
+	return l->pos < r->pos ? -1 : l->pos > r->pos;
+}
+
+static uint32_t acl_who_class(const fsal_ace_t *pace)
+{
+	if (IS_FSAL_ACE_SPECIAL_ID(*pace))
+		switch (pace->who.uid) {
+		case FSAL_ACE_SPECIAL_OWNER:
+			return ACL_WHO_OWNER;
+		case FSAL_ACE_SPECIAL_GROUP:
+			return ACL_WHO_GROUP;
+		case FSAL_ACE_SPECIAL_EVERYONE:
+			return ACL_WHO_EVERYONE;
+		default:
+			return ACL_WHO_NONE;
+		}
+
+	return IS_FSAL_ACE_GROUP_ID(*pace) ? ACL_WHO_NAMED_GROUP
+					   : ACL_WHO_USER;
+}
+
+/* Append the n ACEs in sorted to the order array, skipping those whose
+ * permissions were all seen before: once an ACE has allowed or denied a
+ * bit, it is no longer missing and a later ACE can't change its fate.
+ * Root ignores DENY ACEs, so they don't count for it. */
+static void acl_add_span(fsal_acl_t *acl, struct fsal_acl_kind *kind,
+			 const struct acl_sort_ace *sorted, uint32_t n,
+			 bool root, struct fsal_acl_span *span, uint32_t *used)
+{
+	fsal_aceperm_t seen = 0, perm;
+	uint32_t i;
+
+	span->off = *used;
+	for (i = 0; i < n; i++) {
+		if (root && IS_FSAL_ACE_DENY(acl->aces[sorted[i].pos]))
+			continue;
+		perm = acl->aces[sorted[i].pos].perm;
+		if ((perm & ~seen) == 0)
+			continue;
+		seen |= perm;
+		kind->order[(*used)++] = sorted[i].pos;
+	}
+	span->len = *used - span->off;
+}
+
+static void nfs4_acl_compile_kind(fsal_acl_t *acl, bool is_dir,
+				  struct fsal_acl_kind *kind,
+				  struct acl_sort_ace *sorted)
+{
+	fsal_ace_t *pace;
+	struct fsal_acl_span *span;
+	struct fsal_acl_named *named;
+	uint32_t i, j, n = 0, used = 0, nusers = 0, ngroups = 0;
+
+	for (i = 0; i < acl->naces; i++) {
+		pace = &acl->aces[i];
+		if (!IS_FSAL_ACE_PERM(*pace) || IS_FSAL_ACE_INHERIT_ONLY(*pace))
+			continue;
+		if (is_dir ? !IS_FSAL_DIR_APPLICABLE(*pace)
+			   : !IS_FSAL_FILE_APPLICABLE(*pace))
+			continue;
+		sorted[n].class = acl_who_class(pace);
+		sorted[n].id = GET_FSAL_ACE_WHO(*pace);
+		sorted[n].pos = i;
+		n++;
+	}
+
+	/* Each ACE at most once for root and once for its who */
+	kind->order = gsh_malloc(2 * n * sizeof(*kind->order));
+
+	/* Root is subject to every ACE, in ACL order */
+	acl_add_span(acl, kind, sorted, n, true, &kind->all, &used);
+
+	qsort(sorted, n, sizeof(*sorted), acl_sort_cmp);
+
+	for (i = 0; i < n; i++)
+		if (i == 0 || sorted[i].class != sorted[i - 1].class ||
+		    sorted[i].id != sorted[i - 1].id) {
+			if (sorted[i].class == ACL_WHO_USER)
+				nusers++;
+			else if (sorted[i].class == ACL_WHO_NAMED_GROUP)
+				ngroups++;
+		}
+	kind->users = gsh_calloc(nusers, sizeof(*kind->users));
+	kind->groups = gsh_calloc(ngroups, sizeof(*kind->groups));
+
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && sorted[j].class == sorted[i].class &&
+		     sorted[j].id == sorted[i].id; j++)
+			;
+
+		switch (sorted[i].class) {
+		case ACL_WHO_OWNER:
+			span = &kind->owner;
+			break;
+		case ACL_WHO_GROUP:
+			span = &kind->group;
+			break;
+		case ACL_WHO_EVERYONE:
+			span = &kind->everyone;
+			break;
+		case ACL_WHO_USER:
+			named = &kind->users[kind->nusers++];
+			named->id = sorted[i].id;
+			span = &named->span;
+			break;
+		case ACL_WHO_NAMED_GROUP:
+			named = &kind->groups[kind->ngroups++];
+			named->id = sorted[i].id;
+			span = &named->span;
+			break;
+		default:
+			continue;
+		}
+
+		acl_add_span(acl, kind, sorted + i, j - i, false, span, &used);
+	}
+}
+
+/**
+ * @brief Compile an ACL for fsal_check_access_acl()
+ *
+ * @param[in] acl The ACL, complete and about to be shared
+ *
+ * @return The index, to be freed with the ACL.
+ */
+static struct fsal_acl_index *nfs4_acl_compile(fsal_acl_t *acl)
+{
+	struct fsal_acl_index *index = gsh_calloc(1, sizeof(*index));
+	struct acl_sort_ace *sorted;
+
+	sorted = gsh_malloc(acl->naces * sizeof(*sorted));
+	nfs4_acl_compile_kind(acl, false, &index->kind[0], sorted);
+	nfs4_acl_compile_kind(acl, true, &index->kind[1], sorted);
+	gsh_free(sorted);
+
+	return index;
+}
+
+static void nfs4_acl_index_free(struct fsal_acl_index *index)
+{
+	int i;
+
+	if (index == NULL)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		gsh_free(index->kind[i].order);
+		gsh_free(index->kind[i].users);
+		gsh_free(index->kind[i].groups);
+	}
+	gsh_free(index);
+}
+
 void nfs4_acl_free(fsal_acl_t *acl)
 {
 	if (!acl)
@@ -80,6 +258,9 @@ void nfs4_acl_free(fsal_acl_t *acl)
 	if (acl->aces)
 		nfs4_ace_free(acl->aces);
 
+	nfs4_acl_index_free(acl->index);
+	acl->index = NULL;
+
 	pool_free(fsal_acl_pool, acl);
 }
 
@@ -154,6 +335,7 @@ fsal_acl_t *nfs4_acl_new_entry(fsal_acl_data_t *acldata,
 	acl->naces = acldata->naces;
 	acl->aces = acldata->aces;
 	acl->ref = 1;		/* We give out one reference */
+	acl->index = nfs4_acl_compile(acl);
 
 	/* Build the value */
 	value.addr = acl;
@@ -30,152 +30,272 @@
  */
 
 #include "config.h"
-#include "hashtable.h"
 #include "log.h"
 #include "nfs_core.h"
 #include "nfs_exports.h"
 #include "nfs_ip_stats.h"
 #include "config_parsing.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-/* Hashtable used to cache the hostname, accessed by their IP addess */
-hash_table_t *ht_ip_name;
-unsigned int expiration_time;
+/* Addresses are resolved by a pool of threads, a request needing the
+ * name of a client never calls getnameinfo itself.  A name is kept
+ * for Expiration_Time and still used after it, while it is resolved
+ * again in the background.  A request may only wait, up to
+ * Resolve_Wait, for an address seen for the first time.
+ */
+
+/** Buckets of the cache, a power of 2 */
+#define IP_NAME_BUCKETS 4096
+
+enum ip_name_state {
+	IPN_MISS,		/*< Not in the cache */
+	IPN_PENDING,		/*< Seen, not resolved yet */
+	IPN_NAME,		/*< Resolved */
+	IPN_NONAME,		/*< Could not be, named by its address */
+};
+
+struct ip_name_entry {
+	struct ip_name_entry *next;
+	sockaddr_t addr;
+	uint64_t hash;
+	time_t refresh;		/*< Resolved again after this */
+	time_t used;		/*< Last looked up, for eviction */
+	uint32_t refreshing;	/*< A resolution is queued */
+	uint32_t abandoned;	/*< A request gave up waiting for it */
+	enum ip_name_state state;
+	char hostname[MAXHOSTNAMELEN + 1];
+};
+
+struct ip_name_job {
+	sockaddr_t addr;
+	uint64_t hash;
+};
 
 /**
- * @name Compute the hash value for the entry in IP/name cache
- *
- * @param[in] hparam    Hash table parameter.
- * @param[in] buffcleff The hash key buffer
- *
- * @return the computed hash value.
- *
- * @see hashtable_init
+ * @defgroup config_ipnamemap Structure and defaults for NFS_IP_Name
  *
+ * @{
  */
-uint32_t ip_name_value_hash_func(hash_parameter_t *hparam,
-				 struct gsh_buffdesc *buffclef)
-{
-	return hash_sockaddr(buffclef->addr, true) % hparam->index_size;
-}
 
 /**
- * @brief Compute the rbt value for the entry in IP/name cache
- *
- * @param[in] hparam   Hash table parameter
- * @param[in] buffclef Hash key buffer
- *
- * @return the computed rbt value.
- *
- * @see hashtable_init
- *
+ * @brief Default number of locks of the IP-Name cache
+ */
+#define PRIME_IP_NAME 17
+
+/**
+ * @brief Default value for ip_name_param.expiration-time
+ */
+#define IP_NAME_EXPIRATION 3600
+
+/** @} */
+
+/**
+ * @brief NFS_IP_Name configuration stanza
  */
-uint64_t ip_name_rbt_hash_func(hash_parameter_t *hparam,
-			       struct gsh_buffdesc *buffclef)
+
+struct ip_name_cache {
+	/** Locks of the cache, spread over its buckets.  Default
+	    PRIME_IP_NAME, settable with Index_Size. */
+	uint32_t index_size;
+	/** Expiration time for ip-name mappings.  Defautls to
+	    IP_NAME_Expiration, and settable with Expiration_Time. */
+	uint32_t expiration_time;
+	/** The same for addresses that could not be resolved, settable
+	    with Negative_Expiration_Time. */
+	uint32_t negative_expiration;
+	/** Entries kept, the least recently used of a bucket go first.
+	    Settable with Max_Entries. */
+	uint32_t max_entries;
+	/** Threads resolving, settable with Resolvers. */
+	uint32_t resolvers;
+	/** Milliseconds a request waits for a new address to be resolved,
+	    settable with Resolve_Wait. */
+	uint32_t resolve_wait;
+};
+
+static struct ip_name_cache ip_name_cache;
+
+static struct ip_name_entry *ip_name_buckets[IP_NAME_BUCKETS];
+static pthread_rwlock_t *ip_name_locks;
+static uint32_t ip_name_bucket_max;
+static struct fridgethr *ip_name_fridge;
+
+/* Signalled when an address is resolved, for the waiting requests */
+static pthread_mutex_t ip_name_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ip_name_cond = PTHREAD_COND_INITIALIZER;
+
+static inline uint32_t ip_name_bucket(uint64_t hash)
+{
+	return (hash >> 32) & (IP_NAME_BUCKETS - 1);
+}
+
+static inline pthread_rwlock_t *ip_name_lock(uint32_t bucket)
+{
+	return &ip_name_locks[bucket % ip_name_cache.index_size];
+}
+
+/* The bucket of the entry is locked */
+static struct ip_name_entry *ip_name_find(sockaddr_t *ipaddr, uint64_t hash)
 {
-	return hash_sockaddr(buffclef->addr, true);
+	struct ip_name_entry *entry;
+
+	for (entry = ip_name_buckets[ip_name_bucket(hash)]; entry != NULL;
+	     entry = entry->next)
+		if (entry->hash == hash && cmp_sockaddr(&entry->addr, ipaddr,
+							true))
+			return entry;
+
+	return NULL;
 }
 
+static void ip_name_resolve_run(struct fridgethr_context *ctx);
+
 /**
+ * @brief Queue the resolution of an entry, once
  *
- * compare_ip_name: compares the ip address stored in the key buffers.
- *
- * compare the ip address stored in the key buffers. This function is to be used
- * as 'compare_key' field in the hashtable storing the nfs duplicated requests.
- *
- * @param buff1 [IN] first key
- * @param buff2 [IN] second key
- *
- * @return 0 if keys are identifical, 1 if they are different.
- *
+ * @note The bucket of the entry is locked.
  */
-int compare_ip_name(struct gsh_buffdesc *buff1, struct gsh_buffdesc *buff2)
+static void ip_name_queue(struct ip_name_entry *entry)
 {
-	return (cmp_sockaddr(buff1->addr, buff2->addr, true) !=
-		0) ? 0 : 1;
+	struct ip_name_job *job;
+
+	if (atomic_postset_uint32_t_bits(&entry->refreshing, 1) != 0)
+		return;
+
+	job = gsh_malloc(sizeof(*job));
+	job->addr = entry->addr;
+	job->hash = entry->hash;
+
+	if (fridgethr_submit(ip_name_fridge, ip_name_resolve_run, job) != 0) {
+		LogDebug(COMPONENT_DISPATCH, "Could not queue a resolution");
+		gsh_free(job);
+		atomic_clear_uint32_t_bits(&entry->refreshing, 1);
+	}
 }
 
 /**
- * @brief Display the ip_name stored in the buffer
+ * @brief Look an address up, copying its name
  *
- * @param[in]  pbuff Buffer to display
- * @param[out] str   Output string
+ * An entry due for refresh is queued for it, its name still given.
  *
- * @return number of character written.
+ * @return The state of the entry.
  */
-int display_ip_name_key(struct gsh_buffdesc *pbuff, char *str)
+static enum ip_name_state ip_name_lookup(sockaddr_t *ipaddr, uint64_t hash,
+					 char *hostname, size_t size)
 {
-	sockaddr_t *addr = (sockaddr_t *) (pbuff->addr);
+	uint32_t bucket = ip_name_bucket(hash);
+	pthread_rwlock_t *lock = ip_name_lock(bucket);
+	struct ip_name_entry *entry;
+	enum ip_name_state state = IPN_MISS;
+	time_t now = time(NULL);
+
+	PTHREAD_RWLOCK_rdlock(lock);
+
+	entry = ip_name_find(ipaddr, hash);
+	if (entry != NULL) {
+		state = entry->state;
+		atomic_store_time_t(&entry->used, now);
+		if (state != IPN_PENDING)
+			strmaxcpy(hostname, entry->hostname, size);
+		/* a pending entry is queued again if that failed */
+		if (entry->refresh <= now)
+			ip_name_queue(entry);
+	}
+
+	PTHREAD_RWLOCK_unlock(lock);
 
-	sprint_sockip(addr, str, HASHTABLE_DISPLAY_STRLEN);
-	return strlen(str);
+	return state;
 }
 
 /**
- * @brief Display the ip_name stored in the buffer
+ * @brief Add an entry for a new address and queue its resolution
  *
- * @param[in]  pbuff Buffer to display
- * @param[out] str   Output string
+ * The least recently used entry of a full bucket is dropped.
  *
- * @return number of character written
+ * @return The state of the entry, already there if another request
+ *         raced us.
  */
-int display_ip_name_val(struct gsh_buffdesc *pbuff, char *str)
+static enum ip_name_state ip_name_insert(sockaddr_t *ipaddr, uint64_t hash,
+					 char *hostname, size_t size)
 {
-	nfs_ip_name_t *nfs_ip_name = (pbuff->addr);
+	uint32_t bucket = ip_name_bucket(hash);
+	pthread_rwlock_t *lock = ip_name_lock(bucket);
+	struct ip_name_entry **prev, **lru = NULL, *entry;
+	enum ip_name_state state = IPN_PENDING;
+	uint32_t count = 0;
+
+	PTHREAD_RWLOCK_wrlock(lock);
+
+	entry = ip_name_find(ipaddr, hash);
+	if (entry != NULL) {
+		state = entry->state;
+		if (state != IPN_PENDING)
+			strmaxcpy(hostname, entry->hostname, size);
+		goto out;
+	}
+
+	for (prev = &ip_name_buckets[bucket]; *prev != NULL;
+	     prev = &(*prev)->next) {
+		count++;
+		if (!(*prev)->refreshing &&
+		    (lru == NULL || (*prev)->used < (*lru)->used))
+			lru = prev;
+	}
+
+	if (count >= ip_name_bucket_max && lru != NULL) {
+		entry = *lru;
+		*lru = entry->next;
+		gsh_free(entry);
+	}
 
-	return snprintf(str, HASHTABLE_DISPLAY_STRLEN, "%s",
-			nfs_ip_name->hostname);
+	entry = gsh_calloc(1, sizeof(*entry));
+	entry->addr = *ipaddr;
+	entry->hash = hash;
+	entry->used = time(NULL);
+	entry->state = IPN_PENDING;
+	entry->next = ip_name_buckets[bucket];
+	ip_name_buckets[bucket] = entry;
+
+	ip_name_queue(entry);
+
+ out:
+	PTHREAD_RWLOCK_unlock(lock);
+
+	return state;
 }
 
 /**
+ * @brief Resolve an address and update its entry
  *
- * nfs_ip_name_add: adds an entry into IP/name cache.
- *
- * Adds an entry in the duplicate requests cache.
- *
- * @param ipaddr           [IN]    the ipaddr to be used as key
- * @param hostname         [OUT]    the hostname added (found by using getnameinfo)
- *
- * @return IP_NAME_SUCCESS if successfull\n.
- * @return IP_NAME_INSERT_MALLOC_ERROR if an error occured during the insertion process \n
- * @return IP_NAME_NETDB_ERROR if an error occured during the netdb query (via gethostbyaddr).
- *
+ * A name that fails to resolve again is kept, and tried again after
+ * Negative_Expiration_Time.  So is an address that never resolved,
+ * named by its address meanwhile.
  */
-
-int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
+static void ip_name_resolve(sockaddr_t *ipaddr, uint64_t hash)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffdata;
-	nfs_ip_name_t *nfs_ip_name = NULL;
-	sockaddr_t *pipaddr = NULL;
+	uint32_t bucket = ip_name_bucket(hash);
+	pthread_rwlock_t *lock = ip_name_lock(bucket);
+	struct ip_name_entry *entry;
+	char hostname[MAXHOSTNAMELEN + 1];
+	char ipstring[SOCK_NAME_MAX + 1];
 	struct timeval tv0, tv1, dur;
+	bool changed = false;
 	int rc;
-	char ipstring[SOCK_NAME_MAX + 1];
-
-	nfs_ip_name = gsh_malloc(sizeof(nfs_ip_name_t));
-
-	pipaddr = gsh_malloc(sizeof(sockaddr_t));
-
-	/* I have to keep an integer as key, I wil use the pointer buffkey->addr
-	 * for this, this also means that buffkey->len will be 0
-	 */
-	memcpy(pipaddr, ipaddr, sizeof(sockaddr_t));
-
-	buffkey.addr = (caddr_t) pipaddr;
-	buffkey.len = sizeof(sockaddr_t);
 
 	gettimeofday(&tv0, NULL);
-	rc = getnameinfo((struct sockaddr *)pipaddr, sizeof(sockaddr_t),
-			 nfs_ip_name->hostname, sizeof(nfs_ip_name->hostname),
-			 NULL, 0, 0);
+	rc = getnameinfo((struct sockaddr *)ipaddr, sizeof(sockaddr_t),
+			 hostname, sizeof(hostname), NULL, 0, 0);
 	gettimeofday(&tv1, NULL);
 	timersub(&tv1, &tv0, &dur);
 
-	sprint_sockip(pipaddr, ipstring, sizeof(ipstring));
+	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
 
 	/* display warning if DNS resolution took more that 1.0s */
 	if (dur.tv_sec >= 1) {
@@ -185,155 +305,133 @@ int nfs_ip_name_add(sockaddr_t *ipaddr, char *hostname, size_t size)
 			 (unsigned int)dur.tv_usec);
 	}
 
-	/* Ask for the name to be cached */
-	if (rc != 0) {
-		strmaxcpy(nfs_ip_name->hostname, ipstring,
-			sizeof(nfs_ip_name->hostname));
+	if (rc != 0)
 		LogEvent(COMPONENT_DISPATCH,
-			 "Cannot resolve address %s, error %s, using %s as hostname",
-			 ipstring, gai_strerror(rc), nfs_ip_name->hostname);
-	}
+			 "Cannot resolve address %s, error %s",
+			 ipstring, gai_strerror(rc));
 
-	LogDebug(COMPONENT_DISPATCH, "Inserting %s->%s to addr cache", ipstring,
-		 nfs_ip_name->hostname);
+	PTHREAD_RWLOCK_wrlock(lock);
+
+	entry = ip_name_find(ipaddr, hash);
+	if (entry == NULL) {
+		/* evicted meanwhile */
+		PTHREAD_RWLOCK_unlock(lock);
+		return;
+	}
 
-	/* I build the data with the request pointer
-	 * that should be in state 'IN USE'
+	/* Access decisions made without the name, or with another one,
+	 * must go.
 	 */
-	nfs_ip_name->timestamp = time(NULL);
+	if (entry->state == IPN_PENDING)
+		changed = entry->abandoned != 0;
+	else if (rc == 0)
+		changed = strcmp(entry->hostname, hostname) != 0;
+
+	if (rc == 0) {
+		strmaxcpy(entry->hostname, hostname, sizeof(entry->hostname));
+		entry->state = IPN_NAME;
+		entry->refresh = time(NULL) + ip_name_cache.expiration_time;
+	} else {
+		if (entry->state == IPN_PENDING) {
+			strmaxcpy(entry->hostname, ipstring,
+				  sizeof(entry->hostname));
+			entry->state = IPN_NONAME;
+		}
+		entry->refresh = time(NULL) + ip_name_cache.negative_expiration;
+	}
 
-	buffdata.addr = (caddr_t) nfs_ip_name;
-	buffdata.len = sizeof(nfs_ip_name_t);
+	LogDebug(COMPONENT_DISPATCH, "Caching %s->%s", ipstring,
+		 entry->hostname);
 
-	if (HashTable_Set(ht_ip_name, &buffkey, &buffdata) != HASHTABLE_SUCCESS)
-		return IP_NAME_INSERT_MALLOC_ERROR;
+	entry->abandoned = 0;
+	atomic_clear_uint32_t_bits(&entry->refreshing, 1);
 
-	/* Copy the value for the caller */
-	strmaxcpy(hostname, nfs_ip_name->hostname, size);
+	PTHREAD_RWLOCK_unlock(lock);
 
-	return IP_NAME_SUCCESS;
-}				/* nfs_ip_name_add */
+	if (changed)
+		export_perms_changed();
+
+	PTHREAD_MUTEX_lock(&ip_name_mtx);
+	pthread_cond_broadcast(&ip_name_cond);
+	PTHREAD_MUTEX_unlock(&ip_name_mtx);
+}
+
+static void ip_name_resolve_run(struct fridgethr_context *ctx)
+{
+	struct ip_name_job *job = ctx->arg;
+
+	ip_name_resolve(&job->addr, job->hash);
+	gsh_free(job);
+}
+
+static void ip_name_abandon(sockaddr_t *ipaddr, uint64_t hash)
+{
+	pthread_rwlock_t *lock = ip_name_lock(ip_name_bucket(hash));
+	struct ip_name_entry *entry;
+
+	PTHREAD_RWLOCK_rdlock(lock);
+	entry = ip_name_find(ipaddr, hash);
+	if (entry != NULL)
+		atomic_store_uint32_t(&entry->abandoned, 1);
+	PTHREAD_RWLOCK_unlock(lock);
+}
 
 /**
  *
  * nfs_ip_name_get: Tries to get an entry for ip_name cache.
  *
- * Tries to get an entry for ip_name cache.
+ * Gets the name of an address from the cache.  A new address is
+ * queued for resolution, and waited for up to Resolve_Wait.  An
+ * address that could not be resolved is named by its address.
  *
  * @param ipaddr   [IN]  the ip address requested
  * @param hostname [OUT] the hostname
+ * @param size     [IN]  size of hostname
  *
- * @return the result previously set if *pstatus == IP_NAME_SUCCESS
+ * @return IP_NAME_SUCCESS, or IP_NAME_NOT_FOUND if it is being resolved.
  *
  */
 int nfs_ip_name_get(sockaddr_t *ipaddr, char *hostname, size_t size)
 {
-	struct gsh_buffdesc buffkey;
-	struct gsh_buffdesc buffval;
-	nfs_ip_name_t *nfs_ip_name;
-	char ipstring[SOCK_NAME_MAX + 1];
-
-	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
-
-	buffkey.addr = (caddr_t) ipaddr;
-	buffkey.len = sizeof(sockaddr_t);
-
-	if (HashTable_Get(ht_ip_name,
-			  &buffkey,
-			  &buffval) == HASHTABLE_SUCCESS) {
-		nfs_ip_name = buffval.addr;
-		strmaxcpy(hostname, nfs_ip_name->hostname, size);
-
-		LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s->%s",
-			     ipstring, nfs_ip_name->hostname);
-
-		return IP_NAME_SUCCESS;
+	uint64_t hash = hash_sockaddr(ipaddr, true) * 0x9e3779b97f4a7c15ULL;
+	enum ip_name_state state;
+	struct timespec deadline;
+
+	state = ip_name_lookup(ipaddr, hash, hostname, size);
+	if (state == IPN_MISS)
+		state = ip_name_insert(ipaddr, hash, hostname, size);
+
+	if (state == IPN_PENDING && ip_name_cache.resolve_wait != 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		timespec_add_nsecs(ip_name_cache.resolve_wait * NS_PER_MSEC,
+				   &deadline);
+
+		PTHREAD_MUTEX_lock(&ip_name_mtx);
+		while ((state = ip_name_lookup(ipaddr, hash, hostname, size))
+		       == IPN_PENDING &&
+		       pthread_cond_timedwait(&ip_name_cond, &ip_name_mtx,
+					      &deadline) != ETIMEDOUT)
+			;
+		PTHREAD_MUTEX_unlock(&ip_name_mtx);
 	}
 
-	LogFullDebug(COMPONENT_DISPATCH, "Cache get miss for %s", ipstring);
-
-	return IP_NAME_NOT_FOUND;
-}				/* nfs_ip_name_get */
-
-/**
- *
- * nfs_ip_name_remove: Tries to remove an entry for ip_name cache
- *
- * Tries to remove an entry for ip_name cache.
- *
- * @param ipaddr           [IN]    the ip address to be uncached.
- *
- * @return the result previously set if *pstatus == IP_NAME_SUCCESS
- *
- */
-int nfs_ip_name_remove(sockaddr_t *ipaddr)
-{
-	struct gsh_buffdesc buffkey, old_value;
-	nfs_ip_name_t *nfs_ip_name = NULL;
-	char ipstring[SOCK_NAME_MAX + 1];
-
-	sprint_sockip(ipaddr, ipstring, sizeof(ipstring));
-
-	buffkey.addr = (caddr_t) ipaddr;
-	buffkey.len = sizeof(sockaddr_t);
-
-	if (HashTable_Del(ht_ip_name, &buffkey, NULL, &old_value) ==
-	    HASHTABLE_SUCCESS) {
-		nfs_ip_name = (nfs_ip_name_t *) old_value.addr;
-
-		LogFullDebug(COMPONENT_DISPATCH, "Cache remove hit for %s->%s",
-			     ipstring, nfs_ip_name->hostname);
-
-		gsh_free(nfs_ip_name);
+	switch (state) {
+	case IPN_NAME:
+	case IPN_NONAME:
+		LogFullDebug(COMPONENT_DISPATCH, "Cache get hit for %s",
+			     hostname);
 		return IP_NAME_SUCCESS;
+	case IPN_PENDING:
+		ip_name_abandon(ipaddr, hash);
+		/* fall through */
+	case IPN_MISS:
+		break;
 	}
 
-	LogFullDebug(COMPONENT_DISPATCH, "Cache remove miss for %s", ipstring);
+	LogFullDebug(COMPONENT_DISPATCH, "Cache get miss");
 
 	return IP_NAME_NOT_FOUND;
-}				/* nfs_ip_name_remove */
-
-/**
- * @defgroup config_ipnamemap Structure and defaults for NFS_IP_Name
- *
- * @{
- */
-
-/**
- * @brief Default index size for IP-Name hash
- */
-#define PRIME_IP_NAME 17
-
-/**
- * @brief Default value for ip_name_param.expiration-time
- */
-#define IP_NAME_EXPIRATION 3600
-
-
-/** @} */
-
-/**
- * @brief NFS_IP_Name configuration stanza
- */
-
-struct ip_name_cache {
-	/** Configuration for hash table for NFS Name/IP map.
-	    Defautl index size is PRIME_IP_NAME, settable with
-	    Index_Size. */
-	hash_parameter_t hash_param;
-	/** Expiration time for ip-name mappings.  Defautls to
-	    IP_NAME_Expiration, and settable with Expiration_Time. */
-	uint32_t expiration_time;
-};
-
-static struct ip_name_cache ip_name_cache = {
-	.hash_param.hash_func_key = ip_name_value_hash_func,
-	.hash_param.hash_func_rbt = ip_name_rbt_hash_func,
-	.hash_param.compare_key = compare_ip_name,
-	.hash_param.key_to_str = display_ip_name_key,
-	.hash_param.val_to_str = display_ip_name_val,
-	.hash_param.flags = HT_FLAG_NONE,
-};
+}				/* nfs_ip_name_get */
 
 /**
  * @brief IP name cache parameters
@@ -341,9 +439,17 @@ static struct ip_name_cache ip_name_cache = {
 
 static struct config_item ip_name_params[] = {
 	CONF_ITEM_UI32("Index_Size", 1, 51, PRIME_IP_NAME,
-		       ip_name_cache, hash_param.index_size),
+		       ip_name_cache, index_size),
 	CONF_ITEM_UI32("Expiration_Time", 1, 60*60*24, IP_NAME_EXPIRATION,
 		       ip_name_cache, expiration_time),
+	CONF_ITEM_UI32("Negative_Expiration_Time", 1, 60*60*24, 60,
+		       ip_name_cache, negative_expiration),
+	CONF_ITEM_UI32("Max_Entries", 1024, 1024*1024, 65536,
+		       ip_name_cache, max_entries),
+	CONF_ITEM_UI32("Resolvers", 1, 64, 4,
+		       ip_name_cache, resolvers),
+	CONF_ITEM_UI32("Resolve_Wait", 0, 10000, 500,
+		       ip_name_cache, resolve_wait),
 	CONFIG_EOL
 };
 
@@ -360,7 +466,7 @@ static int ip_name_commit(void *node, void *link_mem, void *self_struct,
 {
 	struct ip_name_cache *params = self_struct;
 
-	if (!is_prime(params->hash_param.index_size)) {
+	if (!is_prime(params->index_size)) {
 		LogCrit(COMPONENT_CONFIG,
 			"IP name cache index size must be a prime.");
 		return 1;
@@ -379,25 +485,36 @@ struct config_block nfs_ip_name = {
 
 /**
  *
- * nfs_Init_ip_name: Init the hashtable for IP/name cache.
+ * nfs_Init_ip_name: Init the IP/name cache.
  *
- * Perform all the required initialization for hashtable IP/name cache
+ * Perform all the required initialization for the IP/name cache and
+ * start its resolvers.
  *
  * @return 0 if successful, -1 otherwise
  *
  */
 int nfs_Init_ip_name(void)
 {
-	ht_ip_name = hashtable_init(&ip_name_cache.hash_param);
+	struct fridgethr_params frp;
+	uint32_t i;
 
-	if (ht_ip_name == NULL) {
+	ip_name_locks = gsh_calloc(ip_name_cache.index_size,
+				   sizeof(*ip_name_locks));
+	for (i = 0; i < ip_name_cache.index_size; i++)
+		PTHREAD_RWLOCK_init(&ip_name_locks[i], NULL);
+
+	ip_name_bucket_max = MAX(1, ip_name_cache.max_entries /
+				    IP_NAME_BUCKETS);
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = ip_name_cache.resolvers;
+	frp.deferment = fridgethr_defer_queue;
+
+	if (fridgethr_init(&ip_name_fridge, "ip_name", &frp) != 0) {
 		LogCrit(COMPONENT_INIT,
-			"NFS IP_NAME: Cannot init IP/name cache");
+			"NFS IP_NAME: Cannot start the resolvers");
 		return -1;
 	}
 
-	/* Set the expiration time */
-	expiration_time = ip_name_cache.expiration_time;
-
 	return IP_NAME_SUCCESS;
 }				/* nfs_Init_ip_name */
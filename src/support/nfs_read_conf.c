@@ -52,6 +52,8 @@
 #include "nfs_proto_functions.h"
 #include "nfs_dupreq.h"
 #include "config_parsing.h"
+#include "io_bufpool.h"
+#include "fridgethr.h"
 
 /**
  * @brief Core configuration parameters
@@ -71,6 +73,19 @@ static struct config_item_list protocols[] = {
 	CONFIG_LIST_EOL
 };
 
+static struct config_item_list worker_affinities[] = {
+	CONFIG_LIST_TOK("none", fridgethr_affinity_none),
+	CONFIG_LIST_TOK("cpu", fridgethr_affinity_cpu),
+	CONFIG_LIST_TOK("numa", fridgethr_affinity_node),
+	CONFIG_LIST_EOL
+};
+
+static struct config_item_list recovery_backends[] = {
+	CONFIG_LIST_TOK("fs", RECOVERY_BACKEND_FS),
+	CONFIG_LIST_TOK("log", RECOVERY_BACKEND_LOG),
+	CONFIG_LIST_EOL
+};
+
 static struct config_item core_params[] = {
 	CONF_ITEM_UI16("NFS_Port", 0, UINT16_MAX, NFS_PORT,
 		       nfs_core_param, port[P_NFS]),
@@ -102,6 +117,13 @@ static struct config_item core_params[] = {
 		       nfs_core_param, dispatch_max_reqs),
 	CONF_ITEM_UI32("Dispatch_Max_Reqs_Xprt", 1, 2048, 512,
 		       nfs_core_param, dispatch_max_reqs_xprt),
+	CONF_ITEM_TOKEN("Worker_Affinity", fridgethr_affinity_none,
+			worker_affinities,
+			nfs_core_param, worker_affinity),
+	CONF_ITEM_BOOL("Decoder_Affinity", false,
+		       nfs_core_param, decoder_affinity),
+	CONF_ITEM_BOOL("Fair_Queue", false,
+		       nfs_core_param, fair_queue),
 	CONF_ITEM_BOOL("DRC_Disabled", false,
 		       nfs_core_param, drc.disabled),
 	CONF_ITEM_UI32("DRC_TCP_Npart", 1, 20, DRC_TCP_NPART,
@@ -118,6 +140,10 @@ static struct config_item core_params[] = {
 		       nfs_core_param, drc.tcp.recycle_expire_s),
 	CONF_ITEM_BOOL("DRC_TCP_Checksum", DRC_TCP_CHECKSUM,
 		       nfs_core_param, drc.tcp.checksum),
+	CONF_ITEM_BOOL("DRC_TCP_Per_Client", false,
+		       nfs_core_param, drc.tcp.per_client),
+	CONF_ITEM_UI32("DRC_TCP_Idle_Trim", 0, 24*60*60, DRC_TCP_IDLE_TRIM,
+		       nfs_core_param, drc.tcp.idle_trim),
 	CONF_ITEM_UI32("DRC_UDP_Npart", 1, 100, DRC_UDP_NPART,
 		       nfs_core_param, drc.udp.npart),
 	CONF_ITEM_UI32("DRC_UDP_Size", 512, 32768, DRC_UDP_SIZE,
@@ -152,6 +178,10 @@ static struct config_item core_params[] = {
 		      nfs_core_param, decoder_fridge_expiration_delay),
 	CONF_ITEM_I64("Decoder_Fridge_Block_Timeout", 0, 7200, 600,
 		      nfs_core_param, decoder_fridge_block_timeout),
+	CONF_ITEM_UI32("Decoder_Spin_Time", 0, 100000, 0,
+		       nfs_core_param, decoder_spin),
+	CONF_ITEM_UI32("Worker_Spin_Time", 0, 100000, 0,
+		       nfs_core_param, worker_spin),
 	CONF_ITEM_I64("Blocked_Lock_Poller_Interval", 0, 180, 10,
 		      nfs_core_param, blocked_lock_poller_interval),
 	CONF_ITEM_LIST("NFS_Protocols", CORE_OPTION_ALL_VERS, protocols,
@@ -174,18 +204,56 @@ static struct config_item core_params[] = {
 		       nfs_core_param, tcp_keepidle),
 	CONF_ITEM_UI32("TCP_KEEPINTVL", 0, 65535, 0,
 		       nfs_core_param, tcp_keepintvl),
+	CONF_ITEM_UI32("TCP_Listeners", 1, 64, 1,
+		       nfs_core_param, tcp_listeners),
+	CONF_ITEM_UI32("UDP_Listeners", 1, 64, 1,
+		       nfs_core_param, udp_listeners),
+	CONF_ITEM_UI32("UDP_Batch", 1, 1024, 1,
+		       nfs_core_param, udp_batch),
 	CONF_ITEM_BOOL("Enable_Fast_Stats", false,
 		       nfs_core_param, enable_FASTSTATS),
+	CONF_ITEM_UI32("Latency_Sample_Rate", 0, 1000000, 0,
+		       nfs_core_param, latency_sample_rate),
+	CONF_ITEM_UI32("Trace_Records", 0, 1048576, 1024,
+		       nfs_core_param, trace_records),
+	CONF_ITEM_PATH("Trace_Dump_Path", 1, MAXPATHLEN,
+		       "/var/log/ganesha-trace",
+		       nfs_core_param, trace_dump_path),
+	CONF_ITEM_UI32("Top_N_Window", 0, 3600, 60,
+		       nfs_core_param, top_n_window),
 	CONF_ITEM_BOOL("Short_File_Handle", false,
 		       nfs_core_param, short_file_handle),
 	CONF_ITEM_I64("Manage_Gids_Expiration", 0, 7*24*60*60, 30*60,
 			nfs_core_param, manage_gids_expiration),
+	CONF_ITEM_UI32("Netgroup_Preload_Interval", 0, 24*60*60, 0,
+		       nfs_core_param, netgroup_preload_interval),
+	CONF_ITEM_UI32("Export_Init_Threads", 1, 256, 16,
+		       nfs_core_param, export_init_threads),
+	CONF_ITEM_BOOL("State_Hugepage_Arenas", false,
+		       nfs_core_param, state_hugepage_arenas),
+	CONF_ITEM_STR("Stats_Shm_Name", 2, 255, NULL,
+		      nfs_core_param, stats_shm_name),
+	CONF_ITEM_UI32("Stats_Shm_Interval", 1, 3600, 1,
+		       nfs_core_param, stats_shm_interval),
+	CONF_ITEM_UI32("Stats_Shm_Exports", 1, 65536, 1024,
+		       nfs_core_param, stats_shm_exports),
+	CONF_ITEM_UI32("Stats_Shm_Clients", 1, 1048576, 4096,
+		       nfs_core_param, stats_shm_clients),
+	CONF_ITEM_PATH("Handoff_Socket", 1, 107, NULL,
+		       nfs_core_param, handoff_socket),
 	CONF_ITEM_PATH("Plugins_Dir", 1, MAXPATHLEN, FSAL_MODULE_LOC,
 		       nfs_core_param, ganesha_modules_loc),
 	CONF_ITEM_UI32("heartbeat_freq", 0, 5000, 1000,
 		       nfs_core_param, heartbeat_freq),
+	CONF_ITEM_UI32("DBus_Workers", 1, 64, 4,
+		       nfs_core_param, dbus_workers),
 	CONF_ITEM_BOOL("fsid_device", false,
 		       nfs_core_param, fsid_device),
+	CONF_ITEM_UI64("IO_Buffer_Pool_Size", 0, 64ULL*1024*1024*1024,
+		       256*1024*1024,
+		       nfs_core_param, io_buffer_pool_size),
+	CONF_ITEM_UI32("IO_Buffer_Thread_Cache", 0, IO_BUF_TCACHE_MAX, 4,
+		       nfs_core_param, io_buffer_thread_cache),
 	CONFIG_EOL
 };
 
@@ -254,6 +322,12 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, allow_numeric_owners),
 	CONF_ITEM_BOOL("Only_Numeric_Owners", false,
 		       nfs_version4_parameter, only_numeric_owners),
+	CONF_ITEM_UI32("Idmap_Cache_Expiration", 0, 7 * 24 * 3600,
+		       IDMAP_CACHE_EXPIRATION_DEFAULT,
+		       nfs_version4_parameter, idmap_cache_expiration),
+	CONF_ITEM_UI32("Idmap_Negative_Expiration", 0, 24 * 3600,
+		       IDMAP_NEGATIVE_EXPIRATION_DEFAULT,
+		       nfs_version4_parameter, idmap_negative_expiration),
 	CONF_ITEM_BOOL("Delegations", false,
 		       nfs_version4_parameter, allow_delegations),
 	CONF_ITEM_UI32("Deleg_Recall_Retry_Delay", 0, 10,
@@ -263,9 +337,102 @@ static struct config_item version4_params[] = {
 		       nfs_version4_parameter, pnfs_mds),
 	CONF_ITEM_BOOL("PNFS_DS", true,
 		       nfs_version4_parameter, pnfs_ds),
+	CONF_ITEM_UI32("Stateid_Cache_Size", 0, 1024*1024,
+		       STATEID_CACHE_SIZE_DEFAULT,
+		       nfs_version4_parameter, stateid_cache_size),
+	CONF_ITEM_TOKEN("RecoveryBackend", RECOVERY_BACKEND_FS,
+			recovery_backends,
+			nfs_version4_parameter, recovery_backend),
+	CONF_ITEM_UI32("Callback_Max_In_Flight", 1, 4096,
+		       CB_MAX_INFLIGHT_DEFAULT,
+		       nfs_version4_parameter, cb_max_inflight),
+	CONF_ITEM_UI32("Compound_Pipeline_Depth", 1, NFS4_ASYNC_OPS_MAX, 1,
+		       nfs_version4_parameter, compound_pipeline_depth),
+	CONF_ITEM_UI64("Copy_Sync_Max", 0, UINT64_MAX, COPY_SYNC_MAX_DEFAULT,
+		       nfs_version4_parameter, copy_sync_max),
+	CONF_ITEM_BOOL("Read_Plus_Zero_Detect", false,
+		       nfs_version4_parameter, read_plus_zero_detect),
+	CONF_ITEM_BOOL("Layout_Sequential_Whole_File", false,
+		       nfs_version4_parameter, layout_sequential_whole_file),
+	CONF_ITEM_UI32("Max_Session_Slots", 1, 1024,
+		       MAX_SESSION_SLOTS_DEFAULT,
+		       nfs_version4_parameter, max_session_slots),
+	CONF_ITEM_BOOL("Stream_Compound_Reply", false,
+		       nfs_version4_parameter, stream_compound_reply),
+	CONFIG_EOL
+};
+
+#ifdef _USE_NFS_RDMA
+/**
+ * @brief NFS/RDMA transport parameters
+ */
+static struct config_item rdma_params[] = {
+	CONF_ITEM_UI16("Port", 1, UINT16_MAX, NFS_RDMA_PORT,
+		       nfs_rdma_parameter, port),
+	CONF_ITEM_UI32("Sq_Depth", 2, 16384, NFS_RDMA_DEPTH_DEFAULT,
+		       nfs_rdma_parameter, sq_depth),
+	CONF_ITEM_UI32("Rq_Depth", 2, 65536, NFS_RDMA_DEPTH_DEFAULT,
+		       nfs_rdma_parameter, rq_depth),
+	CONF_ITEM_UI32("Max_Send_Sge", 2, 256, 32,
+		       nfs_rdma_parameter, max_send_sge),
+	CONF_ITEM_UI32("Max_Recv_Sge", 1, 256, 31,
+		       nfs_rdma_parameter, max_recv_sge),
+	CONF_ITEM_UI32("Backlog", 2, 4096, 10,
+		       nfs_rdma_parameter, backlog),
+	CONF_ITEM_UI32("Credits", 1, 1024, NFS_RDMA_CREDITS_DEFAULT,
+		       nfs_rdma_parameter, credits),
+	CONF_ITEM_BOOL("Use_SRQ", false,
+		       nfs_rdma_parameter, use_srq),
+	CONF_ITEM_UI32("Inline_Recv_Size", 1024, 1024 * 1024,
+		       NFS_RDMA_INLINE_DEFAULT,
+		       nfs_rdma_parameter, inline_recv),
+	CONF_ITEM_UI32("Inline_Send_Size", 1024, 1024 * 1024,
+		       NFS_RDMA_INLINE_DEFAULT,
+		       nfs_rdma_parameter, inline_send),
+	CONFIG_EOL
+};
+
+struct config_block rdma_param = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.rdma",
+	.blk_desc.name = "NFS_RDMA",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = rdma_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+#endif
+
+#ifdef USE_RPC_TLS
+/**
+ * @brief RPC-over-TLS parameters
+ */
+static struct config_item tls_params[] = {
+	CONF_ITEM_BOOL("Enable", false,
+		       nfs_tls_parameter, enable),
+	CONF_ITEM_BOOL("Required", false,
+		       nfs_tls_parameter, required),
+	CONF_ITEM_PATH("Certificate_File", 1, MAXPATHLEN, NULL,
+		       nfs_tls_parameter, cert_file),
+	CONF_ITEM_PATH("Private_Key_File", 1, MAXPATHLEN, NULL,
+		       nfs_tls_parameter, key_file),
+	CONF_ITEM_PATH("CA_File", 1, MAXPATHLEN, NULL,
+		       nfs_tls_parameter, ca_file),
+	CONF_ITEM_UI32("Handshake_Timeout", 1, 300,
+		       RPC_TLS_HANDSHAKE_TIMEOUT,
+		       nfs_tls_parameter, handshake_timeout),
 	CONFIG_EOL
 };
 
+struct config_block tls_param = {
+	.dbus_interface_name = "org.ganesha.nfsd.config.tls",
+	.blk_desc.name = "RPC_TLS",
+	.blk_desc.type = CONFIG_BLOCK,
+	.blk_desc.u.blk.init = noop_conf_init,
+	.blk_desc.u.blk.params = tls_params,
+	.blk_desc.u.blk.commit = noop_conf_commit
+};
+#endif
+
 struct config_block version4_param = {
 	.dbus_interface_name = "org.ganesha.nfsd.config.nfsv4",
 	.blk_desc.name = "NFSv4",
@@ -47,6 +47,7 @@
 #include <pthread.h>
 #include <assert.h>
 #include <arpa/inet.h>
+#include <sched.h>
 #include "fsal.h"
 #include "nfs_core.h"
 #include "log.h"
@@ -58,8 +59,20 @@
 #include "client_mgr.h"
 #include "export_mgr.h"
 #include "server_stats.h"
+#include "stats_shm.h"
 #include <abstract_atomic.h>
 #include "nfs_proto_functions.h"
+#include "io_bufpool.h"
+#include "nfs_dupreq.h"
+#include "pnfs_utils.h"
+#include "uid2grp.h"
+#include "nfs_req_queue.h"
+#include "fridgethr.h"
+#include "city.h"
+#include "hashtable.h"
+#ifdef USE_LTTNG
+#include "gsh_lttng/nfs_rpc.h"
+#endif
 
 #define NFS_V3_NB_COMMAND (NFSPROC3_COMMIT + 1)
 #define NFS_V4_NB_COMMAND 2
@@ -75,8 +88,6 @@
 #define NFS_pcp nfs_param.core_param
 #define NFS_program NFS_pcp.program
 
-#ifdef USE_DBUS
-
 struct op_name {
 	char *name;
 };
@@ -109,7 +120,7 @@ static const struct op_name optnlm[] = {
 	[NLMPROC4_CANCEL_MSG] = {.name = "CANCEL_MSG", },
 	[NLMPROC4_UNLOCK_MSG] = {.name = "UNLOCK_MSG", },
 	[NLMPROC4_GRANTED_MSG] = {.name = "GRANTED_MSG", },
-	[NLMPROC4_TEST_RES] = {.name = "TEST_RES ", },
+	[NLMPROC4_TEST_RES] = {.name = "TEST_RES", },
 	[NLMPROC4_LOCK_RES] = {.name = "LOCK_RES", },
 	[NLMPROC4_CANCEL_RES] = {.name = "CANCEL_RES", },
 	[NLMPROC4_UNLOCK_RES] = {.name = "UNLOCK_RES", },
@@ -141,7 +152,7 @@ static const struct op_name optabv3[] = {
 	[NFSPROC3_READDIR] = {.name = "READDIR", },
 	[NFSPROC3_READDIRPLUS] = {.name = "READDIRPLUS", },
 	[NFSPROC3_FSSTAT] = {.name = "FSSTAT", },
-	[NFSPROC3_FSINFO] = {.name = "FSINFO	", },
+	[NFSPROC3_FSINFO] = {.name = "FSINFO", },
 	[NFSPROC3_PATHCONF] = {.name = "PATHCONF", },
 	[NFSPROC3_COMMIT] = {.name = "COMMIT", },
 };
@@ -226,8 +237,6 @@ static const struct op_name optabv4[] = {
 	[NFS4_OP_REMOVEXATTR] = {.name = "OP_REMOVEXATTR",},
 };
 
-#endif
-
 /* Classify protocol ops for stats purposes
  */
 
@@ -309,23 +318,36 @@ struct nfsv4_ops {
 };
 
 /* basic op counter
+ *
+ * The counters are split in shards, picked by the CPU the thread runs
+ * on, so busy counters don't bounce between CPUs.  Readers add the
+ * shards up.
  */
 
-struct proto_op {
+#define STATS_SHARDS 8
+
+struct op_counters {
 	uint64_t total;		/* total of any kind */
 	uint64_t errors;	/* ! NFS_OK */
 	uint64_t dups;		/* detected dup requests */
 	struct op_latency latency;	/* either executed ops latency */
 	struct op_latency dup_latency;	/* or latency (runtime) to replay */
 	struct op_latency queue_latency;	/* queue wait time */
+	uint64_t requested;	/* bytes requested, for transfers */
+	uint64_t transferred;	/* bytes transferred, for transfers */
+};
+
+struct proto_op {
+	struct {
+		struct op_counters c;
+		GSH_CACHE_PAD(0);
+	} shard[STATS_SHARDS];
 };
 
 /* basic I/O transfer counter
  */
 struct xfer_op {
-	struct proto_op cmd;
-	uint64_t requested;
-	uint64_t transferred;
+	struct proto_op cmd;	/* bytes are counted in its shards */
 };
 
 /* pNFS Layout counters
@@ -435,6 +457,126 @@ struct deleg_stats {
 
 static struct global_stats global_st;
 
+/* Sampled request timelines
+ *
+ * Latencies go into log-linear histograms, a bucket for each eighth
+ * of each power of two nsecs, so any value is within 12.5% of the
+ * value reported for its bucket.
+ */
+
+#define LAT_SUB_BITS 3
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_MAX_MSB 40		/* about 18 minutes, longer is clamped */
+#define LAT_HIST_BUCKETS ((LAT_MAX_MSB - LAT_SUB_BITS + 2) * LAT_SUB)
+
+enum latency_phase {
+	LAT_DECODE,		/* read, decoded and queued */
+	LAT_QUEUE,		/* queued to picked up by a worker */
+	LAT_EXECUTE,		/* service function, backend included */
+	LAT_REPLY,		/* reply encoded and sent */
+	LAT_TOTAL,		/* read to reply sent */
+	LAT_PHASES
+};
+
+struct latency_hist {
+	uint64_t count;
+	uint64_t max;
+	uint64_t bucket[LAT_HIST_BUCKETS];
+};
+
+struct latency_stats {
+	struct latency_hist phase[LAT_PHASES];
+	struct latency_hist *v4op[NFS4_OP_LAST_ONE];
+};
+
+/* Latencies of every op on the exports with Latency_Histograms, not
+ * sampled.
+ */
+
+enum op_hist_proto {
+	OP_HIST_NFSV3,
+	OP_HIST_NFSV4,
+	OP_HIST_NLM,
+	OP_HIST_9P
+};
+
+struct op_hists {
+	struct latency_hist *v3[NFS_V3_NB_COMMAND];
+	struct latency_hist *v4[NFS4_OP_LAST_ONE];
+	struct latency_hist *nlm[NLM_V4_NB_OPERATION];
+#ifdef _USE_9P
+	struct latency_hist *_9p[_9P_RWSTAT + 1];
+#endif
+};
+
+/* Sub-FSAL calls timed by FSAL_NULL for an export */
+
+struct fsal_op_stats {
+	int64_t in_flight[FSAL_STAT_OPS];
+	struct latency_hist *hist[FSAL_STAT_OPS];
+};
+
+const char * const fsal_stat_op_name[FSAL_STAT_OPS] = {
+	[FSAL_STAT_LOOKUP] = "lookup",
+	[FSAL_STAT_READDIR] = "readdir",
+	[FSAL_STAT_CREATE] = "create",
+	[FSAL_STAT_MKDIR] = "mkdir",
+	[FSAL_STAT_MKNODE] = "mknode",
+	[FSAL_STAT_SYMLINK] = "symlink",
+	[FSAL_STAT_READLINK] = "readlink",
+	[FSAL_STAT_LINK] = "link",
+	[FSAL_STAT_RENAME] = "rename",
+	[FSAL_STAT_GETATTRS] = "getattrs",
+	[FSAL_STAT_GETATTRS_BULK] = "getattrs_bulk",
+	[FSAL_STAT_SETATTRS] = "setattrs",
+	[FSAL_STAT_SETATTR2] = "setattr2",
+	[FSAL_STAT_UNLINK] = "unlink",
+	[FSAL_STAT_HANDLE_DIGEST] = "handle_digest",
+	[FSAL_STAT_HANDLE_TO_KEY] = "handle_to_key",
+	[FSAL_STAT_RELEASE] = "release",
+	[FSAL_STAT_OPEN] = "open",
+	[FSAL_STAT_STATUS] = "status",
+	[FSAL_STAT_READ] = "read",
+	[FSAL_STAT_WRITE] = "write",
+	[FSAL_STAT_COMMIT] = "commit",
+	[FSAL_STAT_LOCK_OP] = "lock_op",
+	[FSAL_STAT_CLOSE] = "close",
+	[FSAL_STAT_OPEN2] = "open2",
+	[FSAL_STAT_CHECK_VERIFIER] = "check_verifier",
+	[FSAL_STAT_STATUS2] = "status2",
+	[FSAL_STAT_REOPEN2] = "reopen2",
+	[FSAL_STAT_READ2] = "read2",
+	[FSAL_STAT_WRITE2] = "write2",
+	[FSAL_STAT_SEEK2] = "seek2",
+	[FSAL_STAT_IO_ADVISE2] = "io_advise2",
+	[FSAL_STAT_COMMIT2] = "commit2",
+	[FSAL_STAT_LOCK_OP2] = "lock_op2",
+	[FSAL_STAT_CLOSE2] = "close2",
+	[FSAL_STAT_READ2_ASYNC] = "read2_async",
+	[FSAL_STAT_WRITE2_ASYNC] = "write2_async",
+	[FSAL_STAT_COMMIT2_ASYNC] = "commit2_async",
+	[FSAL_STAT_READV2] = "readv2",
+	[FSAL_STAT_WRITEV2] = "writev2",
+	[FSAL_STAT_COPY2] = "copy2",
+	[FSAL_STAT_CLONE2] = "clone2",
+	[FSAL_STAT_LIST_EXT_ATTRS] = "list_ext_attrs",
+	[FSAL_STAT_GETEXTATTR_ID_BY_NAME] = "getextattr_id_by_name",
+	[FSAL_STAT_GETEXTATTR_VALUE_BY_ID] = "getextattr_value_by_id",
+	[FSAL_STAT_GETEXTATTR_VALUE_BY_NAME] = "getextattr_value_by_name",
+	[FSAL_STAT_SETEXTATTR_VALUE] = "setextattr_value",
+	[FSAL_STAT_SETEXTATTR_VALUE_BY_ID] = "setextattr_value_by_id",
+	[FSAL_STAT_REMOVE_EXTATTR_BY_ID] = "remove_extattr_by_id",
+	[FSAL_STAT_REMOVE_EXTATTR_BY_NAME] = "remove_extattr_by_name",
+	[FSAL_STAT_CREATE_HANDLE] = "create_handle",
+};
+
+/* Only allocates, FSAL calls may be made under the export lock */
+static pthread_mutex_t fsal_ops_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct latency_stats *global_latency;
+static struct op_hists *global_op_hists;
+static pthread_rwlock_t global_latency_lock = PTHREAD_RWLOCK_INITIALIZER;
+
 /* include the top level server_stats struct definition
  */
 #include "server_stats_private.h"
@@ -558,6 +700,267 @@ static struct _9p_stats *get_9p(struct gsh_stats *stats, pthread_rwlock_t *lock)
 /* Functions for recording statistics
  */
 
+static unsigned int latency_bucket(nsecs_elapsed_t ns)
+{
+	int msb;
+
+	if (ns < LAT_SUB)
+		return ns;
+
+	if (ns >= (1ULL << (LAT_MAX_MSB + 1)))
+		ns = (1ULL << (LAT_MAX_MSB + 1)) - 1;
+
+	msb = 63 - __builtin_clzll(ns);
+
+	return (msb - LAT_SUB_BITS + 1) * LAT_SUB
+		+ ((ns >> (msb - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+static void record_latency_hist(struct latency_hist *hist,
+				nsecs_elapsed_t ns)
+{
+	(void)atomic_inc_uint64_t(&hist->count);
+	(void)atomic_inc_uint64_t(&hist->bucket[latency_bucket(ns)]);
+	if (hist->max < ns)
+		(void)atomic_store_uint64_t(&hist->max, ns);
+}
+
+static struct latency_stats *get_latency(struct latency_stats **latp,
+					 pthread_rwlock_t *lock)
+{
+	if (unlikely(*latp == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (*latp == NULL)
+			*latp = gsh_calloc(1, sizeof(struct latency_stats));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	return *latp;
+}
+
+static void record_latency_phases(struct latency_stats **latp,
+				  pthread_rwlock_t *lock,
+				  nsecs_elapsed_t *ns)
+{
+	struct latency_stats *lat = get_latency(latp, lock);
+	int i;
+
+	for (i = 0; i < LAT_PHASES; i++)
+		record_latency_hist(&lat->phase[i], ns[i]);
+}
+
+static void record_latency_v4op(struct latency_stats **latp,
+				pthread_rwlock_t *lock, int proto_op,
+				nsecs_elapsed_t ns)
+{
+	struct latency_stats *lat = get_latency(latp, lock);
+
+	if (unlikely(lat->v4op[proto_op] == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (lat->v4op[proto_op] == NULL)
+			lat->v4op[proto_op] =
+			    gsh_calloc(1, sizeof(struct latency_hist));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	record_latency_hist(lat->v4op[proto_op], ns);
+}
+
+static struct latency_hist **op_hist_slot(struct op_hists *hists,
+					  enum op_hist_proto proto,
+					  unsigned int op)
+{
+	switch (proto) {
+	case OP_HIST_NFSV3:
+		return op < NFS_V3_NB_COMMAND ? &hists->v3[op] : NULL;
+	case OP_HIST_NFSV4:
+		return op < NFS4_OP_LAST_ONE ? &hists->v4[op] : NULL;
+	case OP_HIST_NLM:
+		return op < NLM_V4_NB_OPERATION ? &hists->nlm[op] : NULL;
+#ifdef _USE_9P
+	case OP_HIST_9P:
+		return op <= _9P_RWSTAT ? &hists->_9p[op] : NULL;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static void record_op_hist(struct op_hists **hp, pthread_rwlock_t *lock,
+			   enum op_hist_proto proto, unsigned int op,
+			   nsecs_elapsed_t ns)
+{
+	struct latency_hist **slot;
+
+	if (unlikely(*hp == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (*hp == NULL)
+			*hp = gsh_calloc(1, sizeof(struct op_hists));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+
+	slot = op_hist_slot(*hp, proto, op);
+	if (slot == NULL)
+		return;
+
+	if (unlikely(*slot == NULL)) {
+		PTHREAD_RWLOCK_wrlock(lock);
+		if (*slot == NULL)
+			*slot = gsh_calloc(1, sizeof(struct latency_hist));
+		PTHREAD_RWLOCK_unlock(lock);
+	}
+	record_latency_hist(*slot, ns);
+}
+
+/**
+ * @brief Record the latency of an op in the op histograms
+ *
+ * Only done on exports with Latency_Histograms, for the server, the
+ * export and the client.
+ *
+ * @param proto   [IN] protocol of the op
+ * @param op      [IN] procedure or op number
+ * @param ns      [IN] latency of the op
+ * @param client  [IN] client the op came from, may be NULL
+ */
+
+static void record_op_hists(enum op_hist_proto proto, unsigned int op,
+			    nsecs_elapsed_t ns, struct gsh_client *client)
+{
+	struct gsh_export *export = op_ctx->ctx_export;
+	struct export_stats *exp_st;
+
+	if (export == NULL ||
+	    !op_ctx_export_has_option(EXPORT_OPTION_LATENCY_HIST))
+		return;
+
+	record_op_hist(&global_op_hists, &global_latency_lock, proto, op, ns);
+
+	exp_st = container_of(export, struct export_stats, export);
+	record_op_hist(&exp_st->st.op_hists, &export->lock, proto, op, ns);
+
+	if (client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(client, struct server_stats, client);
+		record_op_hist(&server_st->st.op_hists, &client->lock, proto,
+			       op, ns);
+	}
+}
+
+static struct fsal_op_stats *get_fsal_ops(struct gsh_export *export)
+{
+	struct export_stats *exp_st;
+
+	exp_st = container_of(export, struct export_stats, export);
+
+	if (unlikely(exp_st->st.fsal_ops == NULL)) {
+		PTHREAD_MUTEX_lock(&fsal_ops_lock);
+		if (exp_st->st.fsal_ops == NULL)
+			exp_st->st.fsal_ops =
+			    gsh_calloc(1, sizeof(struct fsal_op_stats));
+		PTHREAD_MUTEX_unlock(&fsal_ops_lock);
+	}
+	return exp_st->st.fsal_ops;
+}
+
+/**
+ * @brief Count a sub-FSAL call in flight on an export
+ *
+ * @param export [IN] export the call is made for, may be NULL
+ * @param op     [IN] the call
+ *
+ * @return the start time to pass to server_stats_fsal_op_done.
+ */
+
+nsecs_elapsed_t server_stats_fsal_op_start(struct gsh_export *export,
+					   enum fsal_stat_op op)
+{
+	struct timespec start_time;
+
+	if (export != NULL)
+		(void)atomic_inc_int64_t(&get_fsal_ops(export)->in_flight[op]);
+
+	now(&start_time);
+	return timespec_diff(&ServerBootTime, &start_time);
+}
+
+/**
+ * @brief Record the latency of a sub-FSAL call of an export
+ *
+ * @param export     [IN] export given to server_stats_fsal_op_start
+ * @param op         [IN] the call
+ * @param start_time [IN] what server_stats_fsal_op_start returned
+ */
+
+void server_stats_fsal_op_done(struct gsh_export *export,
+			       enum fsal_stat_op op, nsecs_elapsed_t start_time)
+{
+	struct fsal_op_stats *ops;
+	struct timespec stop_time;
+
+	if (export == NULL)
+		return;
+
+	now(&stop_time);
+	ops = get_fsal_ops(export);
+	(void)atomic_dec_int64_t(&ops->in_flight[op]);
+
+	if (unlikely(ops->hist[op] == NULL)) {
+		PTHREAD_MUTEX_lock(&fsal_ops_lock);
+		if (ops->hist[op] == NULL)
+			ops->hist[op] =
+			    gsh_calloc(1, sizeof(struct latency_hist));
+		PTHREAD_MUTEX_unlock(&fsal_ops_lock);
+	}
+	record_latency_hist(ops->hist[op],
+			    timespec_diff(&ServerBootTime, &stop_time) -
+			    start_time);
+}
+
+/**
+ * @brief Get the shard of a counter for the current CPU
+ */
+static inline struct op_counters *op_shard(struct proto_op *op)
+{
+	int cpu = sched_getcpu();
+
+	return &op->shard[cpu < 0 ? 0 : cpu % STATS_SHARDS].c;
+}
+
+/**
+ * @brief Record one latency sample
+ *
+ * min and max are swapped in, threads of CPUs sharing a shard can't
+ * lose each other's update.
+ */
+static void record_op_latency(struct op_latency *lat, nsecs_elapsed_t ns)
+{
+	uint64_t cur;
+
+	(void)atomic_add_uint64_t(&lat->latency, ns);
+
+	do {
+		cur = atomic_fetch_uint64_t(&lat->min);
+	} while ((cur == 0L || cur > ns) &&
+		 !atomic_cmpxchg_uint64_t(&lat->min, cur, ns));
+
+	do {
+		cur = atomic_fetch_uint64_t(&lat->max);
+	} while (cur < ns && !atomic_cmpxchg_uint64_t(&lat->max, cur, ns));
+}
+
+static void record_shard_latency(struct op_counters *c,
+				 nsecs_elapsed_t request_time,
+				 nsecs_elapsed_t qwait_time, bool dup)
+{
+	/* dup latency is counted separately */
+	if (likely(!dup))
+		record_op_latency(&c->latency, request_time);
+	else
+		record_op_latency(&c->dup_latency, request_time);
+	/* record how long it was laying around waiting ... */
+	record_op_latency(&c->queue_latency, qwait_time);
+}
+
 /**
  * @brief Record latency stats
  *
@@ -569,34 +972,7 @@ static struct _9p_stats *get_9p(struct gsh_stats *stats, pthread_rwlock_t *lock)
 void record_latency(struct proto_op *op, nsecs_elapsed_t request_time,
 		    nsecs_elapsed_t qwait_time, bool dup)
 {
-
-	/* dup latency is counted separately */
-	if (likely(!dup)) {
-		(void)atomic_add_uint64_t(&op->latency.latency, request_time);
-		if (op->latency.min == 0L || op->latency.min > request_time)
-			(void)atomic_store_uint64_t(&op->latency.min,
-						    request_time);
-		if (op->latency.max == 0L || op->latency.max < request_time)
-			(void)atomic_store_uint64_t(&op->latency.max,
-						    request_time);
-	} else {
-		(void)atomic_add_uint64_t(&op->dup_latency.latency,
-					  request_time);
-		if (op->dup_latency.min == 0L
-		    || op->dup_latency.min > request_time)
-			(void)atomic_store_uint64_t(&op->dup_latency.min,
-						    request_time);
-		if (op->dup_latency.max == 0L
-		    || op->dup_latency.max < request_time)
-			(void)atomic_store_uint64_t(&op->dup_latency.max,
-						    request_time);
-	}
-	/* record how long it was laying around waiting ... */
-	(void)atomic_add_uint64_t(&op->queue_latency.latency, qwait_time);
-	if (op->queue_latency.min == 0L || op->queue_latency.min > qwait_time)
-		(void)atomic_store_uint64_t(&op->queue_latency.min, qwait_time);
-	if (op->queue_latency.max == 0L || op->queue_latency.max < qwait_time)
-		(void)atomic_store_uint64_t(&op->queue_latency.max, qwait_time);
+	record_shard_latency(op_shard(op), request_time, qwait_time, dup);
 }
 
 /**
@@ -614,12 +990,14 @@ void record_latency(struct proto_op *op, nsecs_elapsed_t request_time,
 static void record_io(struct xfer_op *iop, size_t requested, size_t transferred,
 		      bool success)
 {
-	(void)atomic_inc_uint64_t(&iop->cmd.total);
+	struct op_counters *c = op_shard(&iop->cmd);
+
+	(void)atomic_inc_uint64_t(&c->total);
 	if (success) {
-		(void)atomic_add_uint64_t(&iop->requested, requested);
-		(void)atomic_add_uint64_t(&iop->transferred, transferred);
+		(void)atomic_add_uint64_t(&c->requested, requested);
+		(void)atomic_add_uint64_t(&c->transferred, transferred);
 	} else {
-		(void)atomic_inc_uint64_t(&iop->cmd.errors);
+		(void)atomic_inc_uint64_t(&c->errors);
 	}
 	/* somehow we must record latency */
 }
@@ -672,9 +1050,7 @@ static void record_io_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 /**
  * @brief count the protocol operation
  *
- * Use atomic ops to avoid locks. We don't lock for the max
- * and min because if there is a collision, over the long haul,
- * the error is near zero...
+ * Use atomic ops on the shard of the current CPU to avoid locks.
  *
  * @param op           [IN] pointer to specific protocol struct
  * @param request_time [IN] wallclock time (nsecs) for this op
@@ -686,14 +1062,16 @@ static void record_io_stats(struct gsh_stats *gsh_st, pthread_rwlock_t *lock,
 static void record_op(struct proto_op *op, nsecs_elapsed_t request_time,
 		      nsecs_elapsed_t qwait_time, bool success, bool dup)
 {
+	struct op_counters *c = op_shard(op);
+
 	/* count the op */
-	(void)atomic_inc_uint64_t(&op->total);
+	(void)atomic_inc_uint64_t(&c->total);
 	/* also count it as an error if protocol not happy */
 	if (!success)
-		(void)atomic_inc_uint64_t(&op->errors);
+		(void)atomic_inc_uint64_t(&c->errors);
 	if (unlikely(dup))
-		(void)atomic_inc_uint64_t(&op->dups);
-	record_latency(op, request_time, qwait_time, dup);
+		(void)atomic_inc_uint64_t(&c->dups);
+	record_shard_latency(c, request_time, qwait_time, dup);
 }
 
 /**
@@ -973,11 +1351,17 @@ void server_stats_transport_done(struct gsh_client *client,
  *
  * Called from 9P interpreter at operation completion
  */
-void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
+void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p,
+			  struct timespec *start)
 {
 	struct gsh_client *client;
 	struct gsh_export *export;
 	struct _9p_stats *sp;
+	struct timespec current_time;
+	nsecs_elapsed_t request_time;
+
+	now(&current_time);
+	request_time = timespec_diff(start, &current_time);
 
 	client = req9p->pconn->client;
 	if (client) {
@@ -988,7 +1372,7 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 		if (sp->opcodes[opc] == NULL)
 			sp->opcodes[opc] =
 				gsh_calloc(1, sizeof(struct proto_op));
-		record_op(sp->opcodes[opc], 0, 0, true, false);
+		record_op(sp->opcodes[opc], request_time, 0, true, false);
 	}
 
 	if (op_ctx->ctx_export) {
@@ -1000,11 +1384,166 @@ void server_stats_9p_done(u8 opc, struct _9p_request_data *req9p)
 		if (sp->opcodes[opc] == NULL)
 			sp->opcodes[opc] =
 				gsh_calloc(1, sizeof(struct proto_op));
-		record_op(sp->opcodes[opc], 0, 0, true, false);
+		record_op(sp->opcodes[opc], request_time, 0, true, false);
 	}
+
+	record_op_hists(OP_HIST_9P, opc, request_time, client);
 }
 #endif
 
+/* Top talkers
+ *
+ * Space-saving summaries of the clients and the files doing the most
+ * ops, moving the most bytes and taking the most time, over windows
+ * of Top_N_Window seconds.  Keys are spread over shards by hash, each
+ * shard keeps the current and the previous window.  The count of a
+ * key is overestimated by at most its error.
+ */
+
+#define TOPN_SHARDS 16
+#define TOPN_SLOTS 32
+#define TOPN_KEY_SIZE 48
+
+enum topn_kind {
+	TOPN_CLIENTS,
+	TOPN_FILES,
+	TOPN_KINDS
+};
+
+enum topn_metric {
+	TOPN_OPS,
+	TOPN_BYTES,
+	TOPN_LATENCY,
+	TOPN_METRICS
+};
+
+struct topn_slot {
+	uint64_t hash;
+	uint64_t count;
+	uint64_t error;
+	char key[TOPN_KEY_SIZE];
+};
+
+struct topn_shard {
+	pthread_mutex_t mtx;
+	uint64_t window;	/* window of slots[window & 1] */
+	struct topn_slot slots[2][TOPN_METRICS][TOPN_SLOTS];
+};
+
+struct topn_file_key {
+	uint64_t fsid_major;
+	uint64_t fsid_minor;
+	uint64_t fileid;
+	uint16_t export_id;
+};
+
+static struct topn_shard topn[TOPN_KINDS][TOPN_SHARDS];
+static nsecs_elapsed_t topn_window;	/* 0 when not tracking */
+
+/**
+ * @brief Start tracking top talkers, if configured
+ */
+
+void server_stats_topn_init(void)
+{
+	int kind, i;
+
+	for (kind = 0; kind < TOPN_KINDS; kind++)
+		for (i = 0; i < TOPN_SHARDS; i++)
+			PTHREAD_MUTEX_init(&topn[kind][i].mtx, NULL);
+
+	topn_window = (nsecs_elapsed_t) nfs_param.core_param.top_n_window *
+		NS_PER_SEC;
+}
+
+static void topn_add(struct topn_slot *slots, uint64_t hash, const char *key,
+		     uint64_t weight)
+{
+	struct topn_slot *slot, *min = slots;
+
+	for (slot = slots; slot < slots + TOPN_SLOTS; slot++) {
+		if (slot->hash == hash && slot->count != 0 &&
+		    memcmp(slot->key, key, TOPN_KEY_SIZE) == 0) {
+			slot->count += weight;
+			return;
+		}
+		if (slot->count < min->count)
+			min = slot;
+	}
+
+	/* Take over the smallest, inheriting its count as error */
+	min->error = min->count;
+	min->count += weight;
+	min->hash = hash;
+	memcpy(min->key, key, TOPN_KEY_SIZE);
+}
+
+static void topn_record(enum topn_kind kind, const char *key, uint64_t ops,
+			uint64_t bytes, nsecs_elapsed_t latency,
+			nsecs_elapsed_t now_ns)
+{
+	uint64_t hash = CityHash64(key, TOPN_KEY_SIZE);
+	struct topn_shard *shard = &topn[kind][hash % TOPN_SHARDS];
+	uint64_t window = now_ns / topn_window;
+	struct topn_slot (*cur)[TOPN_SLOTS];
+
+	PTHREAD_MUTEX_lock(&shard->mtx);
+
+	if (window != shard->window) {
+		if (window != shard->window + 1)
+			memset(shard->slots[(window + 1) & 1], 0,
+			       sizeof(shard->slots[0]));
+		memset(shard->slots[window & 1], 0, sizeof(shard->slots[0]));
+		shard->window = window;
+	}
+
+	cur = shard->slots[window & 1];
+	if (ops != 0)
+		topn_add(cur[TOPN_OPS], hash, key, ops);
+	if (bytes != 0)
+		topn_add(cur[TOPN_BYTES], hash, key, bytes);
+	if (latency != 0)
+		topn_add(cur[TOPN_LATENCY], hash, key, latency);
+
+	PTHREAD_MUTEX_unlock(&shard->mtx);
+}
+
+static void topn_client(struct gsh_client *client, uint64_t ops,
+			uint64_t bytes, nsecs_elapsed_t latency,
+			nsecs_elapsed_t now_ns)
+{
+	char key[TOPN_KEY_SIZE];
+
+	if (topn_window == 0 || client == NULL)
+		return;
+
+	memset(key, 0, sizeof(key));
+	strncpy(key, client->hostaddr_str, sizeof(key) - 1);
+	topn_record(TOPN_CLIENTS, key, ops, bytes, latency, now_ns);
+}
+
+static void topn_file(struct fsal_obj_handle *obj, uint64_t bytes,
+		      nsecs_elapsed_t now_ns)
+{
+	union {
+		struct topn_file_key file;
+		char key[TOPN_KEY_SIZE];
+	} k;
+
+	if (topn_window == 0 || obj == NULL)
+		return;
+
+	memset(&k, 0, sizeof(k));
+	k.file.fsid_major = obj->fsid.major;
+	k.file.fsid_minor = obj->fsid.minor;
+	k.file.fileid = obj->fileid;
+	if (op_ctx->ctx_export != NULL)
+		k.file.export_id = op_ctx->ctx_export->export_id;
+
+	topn_record(TOPN_FILES, k.key, 1, bytes, now_ns - op_ctx->start_time,
+		    now_ns);
+}
+
 /**
  * @brief record NFS op finished
  *
@@ -1034,6 +1573,18 @@ void server_stats_nfs_done(request_data_t *reqdata, int rc, bool dup)
 
 	now(&current_time);
 	stop_time = timespec_diff(&ServerBootTime, &current_time);
+
+	if (!dup)
+		topn_client(client, 1, 0, stop_time - op_ctx->start_time,
+			    stop_time);
+
+	if (!dup && program_op == NFS_PROGRAM && op_ctx->nfs_vers == NFS_V3)
+		record_op_hists(OP_HIST_NFSV3, proto_op,
+				stop_time - op_ctx->start_time, client);
+	else if (!dup && program_op == NFS_program[P_NLM])
+		record_op_hists(OP_HIST_NLM, proto_op,
+				stop_time - op_ctx->start_time, client);
+
 	if (client != NULL) {
 		struct server_stats *server_st;
 
@@ -1113,6 +1664,26 @@ void server_stats_nfsv4_op_done(int proto_op,
 		(void)atomic_store_uint64_t(&op_ctx->ctx_export->last_update,
 					    stop_time);
 	}
+
+	record_op_hists(OP_HIST_NFSV4, proto_op, stop_time - start_time,
+			client);
+
+	if (!op_ctx->latency_sample)
+		return;
+
+	record_latency_v4op(&global_latency, &global_latency_lock, proto_op,
+			    stop_time - start_time);
+
+	if (op_ctx->ctx_export != NULL) {
+		struct export_stats *exp_st;
+
+		exp_st =
+		    container_of(op_ctx->ctx_export, struct export_stats,
+			    export);
+		record_latency_v4op(&exp_st->st.latency,
+				    &op_ctx->ctx_export->lock, proto_op,
+				    stop_time - start_time);
+	}
 }
 
 /**
@@ -1155,34 +1726,150 @@ void server_stats_compound_done(int num_ops, int status)
 }
 
 /**
- * @brief Record I/O stats for protocol read/write
+ * @brief Whether to sample the timeline of the request being received
  *
- * Called from protocol operation/command handlers to record
- * transfers
+ * Called from the decoder, one request in Latency_Sample_Rate is
+ * sampled.
  */
 
-void server_stats_io_done(size_t requested,
-			  size_t transferred, bool success, bool is_write)
+bool server_stats_latency_sample(void)
 {
-	if (op_ctx->client != NULL) {
-		struct server_stats *server_st;
+	static __thread uint32_t received;
+	uint32_t rate = nfs_param.core_param.latency_sample_rate;
+
+	if (rate == 0 || nfs_param.core_param.enable_FASTSTATS)
+		return false;
+
+	if (++received < rate)
+		return false;
+
+	received = 0;
+	return true;
+}
+
+/**
+ * @brief Record the timeline of a sampled request
+ *
+ * Called once the reply is sent.  A compound is accounted to the
+ * export it ended on.
+ *
+ * @param[in] reqdata   The request
+ * @param[in] executed  When the service function was done
+ */
+
+void server_stats_latency_done(request_data_t *reqdata,
+			       struct timespec *executed)
+{
+	struct timespec sent;
+	nsecs_elapsed_t ns[LAT_PHASES];
+	nsecs_elapsed_t received, queued;
+
+	now(&sent);
+
+	received = timespec_diff(&ServerBootTime, &reqdata->time_received);
+	queued = op_ctx->start_time - op_ctx->queue_wait;
+
+	ns[LAT_DECODE] = queued - received;
+	ns[LAT_QUEUE] = op_ctx->queue_wait;
+	ns[LAT_EXECUTE] = timespec_diff(&ServerBootTime, executed)
+		- op_ctx->start_time;
+	ns[LAT_REPLY] = timespec_diff(executed, &sent);
+	ns[LAT_TOTAL] = timespec_diff(&reqdata->time_received, &sent);
+
+	record_latency_phases(&global_latency, &global_latency_lock, ns);
 
-		server_st = container_of(op_ctx->client, struct server_stats,
-					 client);
-		record_io_stats(&server_st->st, &op_ctx->client->lock,
-				requested, transferred, success,
-				is_write);
-	}
 	if (op_ctx->ctx_export != NULL) {
 		struct export_stats *exp_st;
 
 		exp_st =
 		    container_of(op_ctx->ctx_export, struct export_stats,
 			    export);
-		record_io_stats(&exp_st->st, &op_ctx->ctx_export->lock,
-				requested, transferred, success, is_write);
+		record_latency_phases(&exp_st->st.latency,
+				      &op_ctx->ctx_export->lock, ns);
 	}
-}
+
+#ifdef USE_LTTNG
+	tracepoint(nfs_rpc, timeline, reqdata,
+		   (op_ctx->ctx_export != NULL
+		    ? op_ctx->ctx_export->export_id : -1),
+		   ns[LAT_DECODE], ns[LAT_QUEUE], ns[LAT_EXECUTE],
+		   ns[LAT_REPLY]);
+#endif
+}
+
+/**
+ * @brief Record I/O stats for protocol read/write
+ *
+ * Called from protocol operation/command handlers to record
+ * transfers
+ *
+ * @param[in] obj  File read or written, NULL if not known
+ */
+
+void server_stats_io_done(struct fsal_obj_handle *obj, size_t requested,
+			  size_t transferred, bool success, bool is_write)
+{
+	if (topn_window != 0) {
+		struct timespec current_time;
+		nsecs_elapsed_t now_ns;
+
+		now(&current_time);
+		now_ns = timespec_diff(&ServerBootTime, &current_time);
+		topn_file(obj, transferred, now_ns);
+		if (transferred != 0)
+			topn_client(op_ctx->client, 0, transferred, 0, now_ns);
+	}
+
+	if (op_ctx->client != NULL) {
+		struct server_stats *server_st;
+
+		server_st = container_of(op_ctx->client, struct server_stats,
+					 client);
+		record_io_stats(&server_st->st, &op_ctx->client->lock,
+				requested, transferred, success,
+				is_write);
+	}
+	if (op_ctx->ctx_export != NULL) {
+		struct export_stats *exp_st;
+
+		exp_st =
+		    container_of(op_ctx->ctx_export, struct export_stats,
+			    export);
+		record_io_stats(&exp_st->st, &op_ctx->ctx_export->lock,
+				requested, transferred, success, is_write);
+	}
+}
+
+/**
+ * @brief Bytes of the READ_PLUS replies, server wide
+ */
+static struct {
+	uint64_t replies;	/*< READ_PLUS replies sent */
+	uint64_t data;		/*< bytes sent as data */
+	uint64_t holes;		/*< bytes of holes found with seek2 */
+	uint64_t zeroes;	/*< bytes of zero blocks found in the data */
+} read_plus_stats;
+
+/**
+ * @brief Record what a READ_PLUS reply carried
+ *
+ * Holes and zero blocks are the bytes the reply saved.
+ *
+ * @param[in] data   Bytes sent as data
+ * @param[in] holes  Bytes reported as holes found by the FSAL
+ * @param[in] zeroes Bytes reported as holes found scanning the data
+ */
+
+void server_stats_read_plus_done(uint64_t data, uint64_t holes,
+				 uint64_t zeroes)
+{
+	(void) atomic_inc_uint64_t(&read_plus_stats.replies);
+	(void) atomic_add_uint64_t(&read_plus_stats.data, data);
+	if (holes != 0)
+		(void) atomic_add_uint64_t(&read_plus_stats.holes, holes);
+	if (zeroes != 0)
+		(void) atomic_add_uint64_t(&read_plus_stats.zeroes, zeroes);
+}
 
 /**
  * @brief record Delegation stats
@@ -1250,6 +1937,297 @@ void inc_failed_recalls(struct gsh_client *client)
 	}
 }
 
+static void sum_op_latency(struct op_latency *sum, struct op_latency *lat)
+{
+	uint64_t min = atomic_fetch_uint64_t(&lat->min);
+	uint64_t max = atomic_fetch_uint64_t(&lat->max);
+
+	sum->latency += atomic_fetch_uint64_t(&lat->latency);
+	if (min != 0 && (sum->min == 0 || sum->min > min))
+		sum->min = min;
+	if (sum->max < max)
+		sum->max = max;
+}
+
+/**
+ * @brief Add up the shards of a counter
+ *
+ * @param op   [IN] the counter
+ * @param sum  [OUT] its totals
+ */
+static void sum_op(struct proto_op *op, struct op_counters *sum)
+{
+	int i;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for (i = 0; i < STATS_SHARDS; i++) {
+		struct op_counters *c = &op->shard[i].c;
+
+		sum->total += atomic_fetch_uint64_t(&c->total);
+		sum->errors += atomic_fetch_uint64_t(&c->errors);
+		sum->dups += atomic_fetch_uint64_t(&c->dups);
+		sum_op_latency(&sum->latency, &c->latency);
+		sum_op_latency(&sum->dup_latency, &c->dup_latency);
+		sum_op_latency(&sum->queue_latency, &c->queue_latency);
+		sum->requested += atomic_fetch_uint64_t(&c->requested);
+		sum->transferred += atomic_fetch_uint64_t(&c->transferred);
+	}
+}
+
+/* Counters published in the shared memory segment, see stats_shm.h
+ */
+
+static void shm_op(struct gsh_stats_shm_op *dst, struct proto_op *op,
+		   struct op_counters *sum)
+{
+	sum_op(op, sum);
+	dst->total += sum->total;
+	dst->errors += sum->errors;
+	dst->dups += sum->dups;
+	dst->latency_ns += sum->latency.latency;
+	if (dst->max_ns < sum->latency.max)
+		dst->max_ns = sum->latency.max;
+	dst->queue_ns += sum->queue_latency.latency;
+}
+
+static void shm_io(struct gsh_stats_shm_io *dst, struct xfer_op *iop)
+{
+	struct op_counters sum;
+
+	shm_op(&dst->op, &iop->cmd, &sum);
+	dst->requested += sum.requested;
+	dst->transferred += sum.transferred;
+}
+
+static void shm_proto(struct gsh_stats_shm_counters *dst,
+		      enum gsh_stats_shm_proto proto, struct proto_op *op,
+		      struct xfer_op *read, struct xfer_op *write)
+{
+	struct op_counters sum;
+
+	shm_op(&dst->proto[proto], op, &sum);
+	if (read != NULL)
+		shm_io(&dst->read[proto], read);
+	if (write != NULL)
+		shm_io(&dst->write[proto], write);
+}
+
+static void shm_v4(struct gsh_stats_shm_counters *dst,
+		   enum gsh_stats_shm_proto proto, struct nfsv41_stats *sp)
+{
+	if (sp != NULL)
+		shm_proto(dst, proto, &sp->compounds, &sp->read, &sp->write);
+}
+
+static void shm_counters(struct gsh_stats_shm_counters *dst,
+			 struct gsh_stats *st)
+{
+	struct nfsv3_stats *v3 = atomic_fetch_voidptr(&st->nfsv3);
+	struct nfsv40_stats *v40 = atomic_fetch_voidptr(&st->nfsv40);
+	struct mnt_stats *mnt = atomic_fetch_voidptr(&st->mnt);
+	struct nlmv4_stats *nlm = atomic_fetch_voidptr(&st->nlm4);
+	struct rquota_stats *qta = atomic_fetch_voidptr(&st->rquota);
+#ifdef _USE_9P
+	struct _9p_stats *_9p = atomic_fetch_voidptr(&st->_9p);
+#endif
+
+	if (v3 != NULL)
+		shm_proto(dst, GSH_STATS_SHM_NFSV3, &v3->cmds, &v3->read,
+			  &v3->write);
+	if (v40 != NULL)
+		shm_proto(dst, GSH_STATS_SHM_NFSV40, &v40->compounds,
+			  &v40->read, &v40->write);
+	shm_v4(dst, GSH_STATS_SHM_NFSV41,
+	       atomic_fetch_voidptr(&st->nfsv41));
+	shm_v4(dst, GSH_STATS_SHM_NFSV42,
+	       atomic_fetch_voidptr(&st->nfsv42));
+	if (nlm != NULL)
+		shm_proto(dst, GSH_STATS_SHM_NLM4, &nlm->ops, NULL, NULL);
+	if (mnt != NULL) {
+		shm_proto(dst, GSH_STATS_SHM_MNT, &mnt->v1_ops, NULL, NULL);
+		shm_proto(dst, GSH_STATS_SHM_MNT, &mnt->v3_ops, NULL, NULL);
+	}
+	if (qta != NULL) {
+		shm_proto(dst, GSH_STATS_SHM_RQUOTA, &qta->ops, NULL, NULL);
+		shm_proto(dst, GSH_STATS_SHM_RQUOTA, &qta->ext_ops, NULL,
+			  NULL);
+	}
+#ifdef _USE_9P
+	if (_9p != NULL)
+		shm_proto(dst, GSH_STATS_SHM_9P, &_9p->cmds, &_9p->read,
+			  &_9p->write);
+#endif
+}
+
+static bool shm_export(struct gsh_export *export, void *arg)
+{
+	struct export_stats *export_st;
+	struct gsh_stats_shm_export *rec = stats_shm_export(arg);
+
+	if (rec == NULL)
+		return true;
+
+	export_st = container_of(export, struct export_stats, export);
+	rec->export_id = export->export_id;
+	if (export->fullpath != NULL)
+		strlcpy(rec->path, export->fullpath, sizeof(rec->path));
+	shm_counters(&rec->c, &export_st->st);
+
+	return true;
+}
+
+static bool shm_client(struct gsh_client *client, void *arg)
+{
+	struct server_stats *server_st;
+	struct gsh_stats_shm_client *rec = stats_shm_client(arg);
+
+	if (rec == NULL)
+		return true;
+
+	server_st = container_of(client, struct server_stats, client);
+	if (client->hostaddr_str != NULL)
+		strlcpy(rec->addr, client->hostaddr_str, sizeof(rec->addr));
+	shm_counters(&rec->c, &server_st->st);
+
+	return true;
+}
+
+static void shm_op_table(struct stats_shm_ctx *ctx, const char *module,
+			 const struct op_name *names, uint64_t *ops, int nops)
+{
+	int i;
+
+	for (i = 0; i < nops; i++) {
+		if (names[i].name != NULL)
+			stats_shm_value(ctx, module, names[i].name,
+					atomic_fetch_uint64_t(&ops[i]));
+	}
+}
+
+static void shm_hist(struct stats_shm_ctx *ctx, const char *module,
+		     const char *name, struct latency_hist *hist)
+{
+	struct gsh_stats_shm_hist *rec;
+	int i;
+
+	if (hist == NULL)
+		return;
+
+	rec = stats_shm_hist(ctx, module, name);
+	if (rec == NULL)
+		return;
+
+	rec->count = atomic_fetch_uint64_t(&hist->count);
+	rec->max_ns = atomic_fetch_uint64_t(&hist->max);
+	for (i = 0; i < LAT_HIST_BUCKETS; i++)
+		rec->bucket[i] = atomic_fetch_uint64_t(&hist->bucket[i]);
+}
+
+static void shm_hist_table(struct stats_shm_ctx *ctx, const char *module,
+			   const struct op_name *names,
+			   struct latency_hist **hists, int nops)
+{
+	int i;
+
+	for (i = 0; i < nops; i++) {
+		if (names[i].name != NULL)
+			shm_hist(ctx, module, names[i].name,
+				 atomic_fetch_voidptr(&hists[i]));
+	}
+}
+
+/**
+ * @brief Fill in the server's counters in the stats segment
+ *
+ * The totals of the server, each export and each client; the op
+ * counts of the server and the DRC counters as values; the sampled
+ * latency histograms of the server and those of its ops kept with
+ * Latency_Histograms.
+ */
+void server_stats_shm_fill(struct stats_shm_ctx *ctx)
+{
+	static const char * const phase_name[LAT_PHASES] = {
+		[LAT_DECODE] = "decode",
+		[LAT_QUEUE] = "queue",
+		[LAT_EXECUTE] = "execute",
+		[LAT_REPLY] = "reply",
+		[LAT_TOTAL] = "total",
+	};
+	struct gsh_stats_shm_counters *global = stats_shm_global(ctx);
+	struct latency_stats *lat;
+	struct op_hists *hists;
+	struct drc_stats drc;
+	int i;
+
+	BUILD_BUG_ON(LAT_HIST_BUCKETS != GSH_STATS_SHM_HIST_BUCKETS);
+	BUILD_BUG_ON(LAT_SUB_BITS != GSH_STATS_SHM_HIST_SUB_BITS);
+
+	if (global != NULL) {
+		shm_proto(global, GSH_STATS_SHM_NFSV3, &global_st.nfsv3.cmds,
+			  &global_st.nfsv3.read, &global_st.nfsv3.write);
+		shm_proto(global, GSH_STATS_SHM_NFSV40,
+			  &global_st.nfsv40.compounds,
+			  &global_st.nfsv40.read, &global_st.nfsv40.write);
+		shm_v4(global, GSH_STATS_SHM_NFSV41, &global_st.nfsv41);
+		shm_v4(global, GSH_STATS_SHM_NFSV42, &global_st.nfsv42);
+		shm_proto(global, GSH_STATS_SHM_NLM4, &global_st.nlm4.ops,
+			  NULL, NULL);
+		shm_proto(global, GSH_STATS_SHM_MNT, &global_st.mnt.v1_ops,
+			  NULL, NULL);
+		shm_proto(global, GSH_STATS_SHM_MNT, &global_st.mnt.v3_ops,
+			  NULL, NULL);
+		shm_proto(global, GSH_STATS_SHM_RQUOTA,
+			  &global_st.rquota.ops, NULL, NULL);
+		shm_proto(global, GSH_STATS_SHM_RQUOTA,
+			  &global_st.rquota.ext_ops, NULL, NULL);
+	}
+
+	(void) foreach_gsh_export_snapshot(shm_export, ctx);
+	(void) foreach_gsh_client(shm_client, ctx);
+
+	shm_op_table(ctx, "nfsv3", optabv3, global_st.v3.op,
+		     NFS_V3_NB_COMMAND);
+	shm_op_table(ctx, "nfsv4", optabv4, global_st.v4.op,
+		     NFS4_OP_LAST_ONE);
+	shm_op_table(ctx, "nlm4", optnlm, global_st.lm.op,
+		     NLM_V4_NB_OPERATION);
+	shm_op_table(ctx, "mnt", optmnt, global_st.mn.op,
+		     MNT_V3_NB_COMMAND);
+	shm_op_table(ctx, "rquota", optqta, global_st.qt.op,
+		     RQUOTA_NB_COMMAND);
+
+	nfs_dupreq_stats(&drc);
+	stats_shm_value(ctx, "drc", "hits", drc.hits);
+	stats_shm_value(ctx, "drc", "lockfree_hits", drc.lockfree_hits);
+	stats_shm_value(ctx, "drc", "in_progress", drc.in_progress);
+	stats_shm_value(ctx, "drc", "misses", drc.misses);
+	stats_shm_value(ctx, "drc", "retired", drc.retired);
+	stats_shm_value(ctx, "drc", "retire_ns", drc.retire_ns);
+
+#ifdef USE_MEM_ACCOUNTING
+	mem_account_shm_fill(ctx);
+#endif
+
+	lat = atomic_fetch_voidptr(&global_latency);
+	if (lat != NULL) {
+		for (i = 0; i < LAT_PHASES; i++)
+			shm_hist(ctx, "phase", phase_name[i], &lat->phase[i]);
+		shm_hist_table(ctx, "sampled.nfsv4", optabv4, lat->v4op,
+			       NFS4_OP_LAST_ONE);
+	}
+
+	hists = atomic_fetch_voidptr(&global_op_hists);
+	if (hists != NULL) {
+		shm_hist_table(ctx, "nfsv3", optabv3, hists->v3,
+			       NFS_V3_NB_COMMAND);
+		shm_hist_table(ctx, "nfsv4", optabv4, hists->v4,
+			       NFS4_OP_LAST_ONE);
+		shm_hist_table(ctx, "nlm4", optnlm, hists->nlm,
+			       NLM_V4_NB_OPERATION);
+	}
+}
+
 #ifdef USE_DBUS
 
 /* Functions for marshalling statistics to DBUS
@@ -1307,6 +2285,17 @@ void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st)
 				       &stats_available);
 }
 
+static uint64_t sum_op_total(struct proto_op *op)
+{
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < STATS_SHARDS; i++)
+		total += atomic_fetch_uint64_t(&op->shard[i].c.total);
+
+	return total;
+}
+
 #ifdef _USE_9P
 /** @brief Report protocol operation statistics
  *
@@ -1322,14 +2311,19 @@ void server_stats_summary(DBusMessageIter *iter, struct gsh_stats *st)
 static void server_dbus_op_stats(struct proto_op *op, DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
-	uint64_t zero = 0;
+	struct op_counters sum;
+
+	if (op != NULL)
+		sum_op(op, &sum);
+	else
+		memset(&sum, 0, sizeof(sum));
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       op == NULL ? &zero : &op->total);
+				       &sum.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       op == NULL ? &zero : &op->errors);
+				       &sum.errors);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 #endif
@@ -1353,21 +2347,24 @@ static void server_dbus_op_stats(struct proto_op *op, DBusMessageIter *iter)
 static void server_dbus_iostats(struct xfer_op *iop, DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
+	struct op_counters sum;
+
+	sum_op(&iop->cmd, &sum);
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &iop->requested);
+				       &sum.requested);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &iop->transferred);
+				       &sum.transferred);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &iop->cmd.total);
+				       &sum.total);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &iop->cmd.errors);
+				       &sum.errors);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &iop->cmd.latency.latency);
+				       &sum.latency.latency);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &iop->cmd.queue_latency.latency);
+				       &sum.queue_latency.latency);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
@@ -1398,7 +2395,7 @@ static void server_dbus_transportstats(struct transport_stats *tstats,
 void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
-	uint64_t total = 0;
+	uint64_t total;
 	char *version;
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
@@ -1407,45 +2404,38 @@ void server_dbus_total(struct export_stats *export_st, DBusMessageIter *iter)
 	version = "NFSv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv3 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv3->cmds.total);
+	total = export_st->st.nfsv3 == NULL
+		? 0 : sum_op_total(&export_st->st.nfsv3->cmds);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv40 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv40->compounds.total);
+	total = export_st->st.nfsv40 == NULL
+		? 0 : sum_op_total(&export_st->st.nfsv40->compounds);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv41 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv41->compounds.total);
+	total = export_st->st.nfsv41 == NULL
+		? 0 : sum_op_total(&export_st->st.nfsv41->compounds);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
-	if (export_st->st.nfsv42 == NULL)
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&total);
-	else
-		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				&export_st->st.nfsv42->compounds.total);
+	total = export_st->st.nfsv42 == NULL
+		? 0 : sum_op_total(&export_st->st.nfsv42->compounds);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &total);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
 void global_dbus_total(DBusMessageIter *iter)
 {
 	DBusMessageIter struct_iter;
+	uint64_t total;
 	char *version;
 
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
@@ -1454,43 +2444,51 @@ void global_dbus_total(DBusMessageIter *iter)
 	version = "NFSv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.nfsv3.cmds);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv3.cmds.total);
+				       &total);
 	version = "NFSv40";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.nfsv40.compounds);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv40.compounds.total);
+				       &total);
 	version = "NFSv41";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.nfsv41.compounds);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv41.compounds.total);
+				       &total);
 	version = "NFSv42";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.nfsv42.compounds);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nfsv42.compounds.total);
+				       &total);
 	version = "NLM4";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.nlm4.ops);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.nlm4.ops.total);
+				       &total);
 	version = "MNTv1";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.mnt.v1_ops);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v1_ops.total);
+				       &total);
 	version = "MNTv3";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.mnt.v3_ops);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.mnt.v3_ops.total);
+				       &total);
 	version = "RQUOTA";
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
 				       &version);
+	total = sum_op_total(&global_st.rquota.ops);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-					&global_st.rquota.ops.total);
+				       &total);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
@@ -1709,87 +2707,992 @@ void global_dbus_total_ops(DBusMessageIter *iter)
 	global_dbus_total(iter);
 }
 
-
-#ifdef _USE_9P
-void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter)
+/**
+ * @brief Report the I/O buffer pool size classes
+ *
+ * For each class: buffer size, capacity, buffers created, buffers in
+ * use, high-water mark of buffers in use, allocations and misses.
+ */
+void server_dbus_io_bufpool(DBusMessageIter *iter)
 {
+	struct io_bufpool_class_stats stats[IO_BUF_MAX_CLASSES];
 	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	unsigned int n, i;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_iostats(&_9pp->read, iter);
-	server_dbus_iostats(&_9pp->write, iter);
+
+	n = io_bufpool_stats(stats, IO_BUF_MAX_CLASSES);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 IO_BUFPOOL_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (i = 0; i < n; i++) {
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].size);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].capacity);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].created);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].in_use);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].hiwat);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].allocs);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &stats[i].misses);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
 }
 
-void server_dbus_9p_transstats(struct _9p_stats *_9pp, DBusMessageIter *iter)
+static void server_dbus_pool(pool_t *pool, void *arg)
+{
+	DBusMessageIter *array_iter = arg;
+	DBusMessageIter struct_iter;
+	struct pool_stats stats;
+	const char *name = pool->name != NULL ? pool->name : "";
+	uint64_t size = pool->object_size;
+
+	pool_get_stats(pool, &stats);
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT,
+					 NULL, &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &size);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.allocs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.frees);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.cached);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.trimmed);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.slabs);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &stats.huge_slabs);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/**
+ * @brief Report the object pools
+ *
+ * For each cached pool: name, object size, allocations, those served
+ * from the free lists, frees, free objects kept, objects trimmed, and
+ * the hugepage slabs of its arena with those on reserved hugepages.
+ */
+void server_dbus_pools(DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	DBusMessageIter array_iter;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_transportstats(&_9pp->trans, iter);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 POOL_STATS_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	pool_foreach(server_dbus_pool, &array_iter);
+	dbus_message_iter_close_container(iter, &array_iter);
 }
 
-void server_dbus_9p_opstats(struct _9p_stats *_9pp, u8 opcode,
-			    DBusMessageIter *iter)
+static void server_dbus_hashtable(struct hash_table *ht, void *arg)
+{
+	DBusMessageIter *array_iter = arg;
+	DBusMessageIter struct_iter;
+	hash_stat_t st;
+	const char *name = ht->parameter.ht_name ? ht->parameter.ht_name : "";
+	uint64_t val[6];
+	int i;
+
+	hashtable_get_stats(ht, &st);
+	val[0] = st.partitions;
+	val[1] = st.entries;
+	val[2] = st.min_rbt_num_node;
+	val[3] = st.max_rbt_num_node;
+	val[4] = st.average_rbt_num_node;
+	val[5] = st.cache_slots;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT,
+					 NULL, &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &name);
+	for (i = 0; i < 6; i++)
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val[i]);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/**
+ * @brief Report the occupancy of the hash tables
+ *
+ * For each table: name, partitions, entries, fewest, most and average
+ * entries in a partition tree, and cache slots.  Entries over cache
+ * slots is the load factor of the caches, the most entries in a
+ * partition bounds the depth of the tree walks on a cache miss.
+ */
+void server_dbus_hashtables(DBusMessageIter *iter)
 {
 	struct timespec timestamp;
+	DBusMessageIter array_iter;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_op_stats(_9pp->opcodes[opcode], iter);
-}
-#endif
 
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 HASHTABLES_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	hashtable_foreach(server_dbus_hashtable, &array_iter);
+	dbus_message_iter_close_container(iter, &array_iter);
+}
 
 /**
- * @brief Report layout statistics as a struct
- *
- * struct layout {
- *       uint64_t total_layouts;
- *       uint64_t errors;
- *       uint64_t delays;
- * }
+ * @brief Report the duplicate request cache counters
  *
- * @param iop   [IN] pointer to xfer op sub-structure of interest
- * @param iter  [IN] interator in reply stream to fill
+ * Retransmits answered from the cache, those of them found without a
+ * lock, retransmits of requests still running, new requests cached,
+ * entries retired and nanoseconds spent retiring them.
  */
-
-static void server_dbus_layouts(struct layout_op *lop, DBusMessageIter *iter)
+void server_dbus_drc(DBusMessageIter *iter)
 {
+	struct drc_stats st;
+	struct timespec timestamp;
 	DBusMessageIter struct_iter;
 
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	nfs_dupreq_stats(&st);
+
 	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
 					 &struct_iter);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &lop->total);
+				       &st.hits);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &lop->errors);
+				       &st.lockfree_hits);
 	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
-				       &lop->delays);
+				       &st.in_progress);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.retired);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.retire_ns);
 	dbus_message_iter_close_container(iter, &struct_iter);
 }
 
-void server_dbus_v41_layouts(struct nfsv41_stats *v41p, DBusMessageIter *iter)
+/**
+ * @brief Report the group list cache counters
+ *
+ * Hits, misses, misses that waited for the same user to be resolved,
+ * refreshes queued before expiry and users that could not be resolved.
+ */
+void server_dbus_uid2grp(DBusMessageIter *iter)
 {
+	struct uid2grp_stats st;
 	struct timespec timestamp;
+	DBusMessageIter struct_iter;
 
 	now(&timestamp);
 	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v41p->getdevinfo, iter);
-	server_dbus_layouts(&v41p->layout_get, iter);
-	server_dbus_layouts(&v41p->layout_commit, iter);
-	server_dbus_layouts(&v41p->layout_return, iter);
-	server_dbus_layouts(&v41p->recall, iter);
-}
 
-void server_dbus_v42_layouts(struct nfsv41_stats *v42p, DBusMessageIter *iter)
-{
-	struct timespec timestamp;
+	uid2grp_stats(&st);
 
-	now(&timestamp);
-	dbus_append_timestamp(iter, &timestamp);
-	server_dbus_layouts(&v42p->getdevinfo, iter);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.misses);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.waits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.refreshes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &st.failures);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the READ_PLUS counters
+ *
+ * Replies, bytes sent as data, bytes of holes found by the FSALs and
+ * bytes of zero blocks found in the data.
+ */
+void server_dbus_read_plus(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	uint64_t replies, data, holes, zeroes;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	replies = atomic_fetch_uint64_t(&read_plus_stats.replies);
+	data = atomic_fetch_uint64_t(&read_plus_stats.data);
+	holes = atomic_fetch_uint64_t(&read_plus_stats.holes);
+	zeroes = atomic_fetch_uint64_t(&read_plus_stats.zeroes);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &replies);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &data);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &holes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &zeroes);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the CB_LAYOUTRECALL counters
+ *
+ * File and bulk recalls sent, those pending, resends, then how they
+ * ended: acknowledged, found nothing, revoked.  Last the total and the
+ * largest time from the first send to the end, in nanoseconds.
+ */
+void server_dbus_layoutrecall(DBusMessageIter *iter)
+{
+	struct layoutrecall_stats st;
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	uint64_t *val[] = {&st.file, &st.bulk, &st.pending, &st.retries,
+			   &st.acked, &st.nomatch, &st.revoked,
+			   &st.latency_ns, &st.latency_max_ns};
+	size_t i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	layoutrecall_stats(&st);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < sizeof(val) / sizeof(val[0]); i++)
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       val[i]);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report the flexfiles data servers, from LAYOUTSTATS
+ *
+ * The reports dropped past PNFS_FF_DS_STATS_MAX servers, then for each
+ * server its netid and address, the reports, READs and bytes, WRITEs
+ * and bytes, and for each of READ and WRITE, the calls timed, the sum
+ * of their latencies and the largest, in nanoseconds.
+ */
+void server_dbus_ff_ds(DBusMessageIter *iter)
+{
+	struct pnfs_ff_ds_stats *st;
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	uint64_t dropped;
+	uint32_t count, i;
+
+	st = gsh_malloc(PNFS_FF_DS_STATS_MAX * sizeof(*st));
+	count = pnfs_ff_ds_stats(st, PNFS_FF_DS_STATS_MAX, &dropped);
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT64, &dropped);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 FF_DS_REPLY_ARRAY_TYPE, &array_iter);
+	for (i = 0; i < count; i++) {
+		char *netid = st[i].netid, *addr = st[i].addr;
+		uint64_t *val[] = {&st[i].reports, &st[i].read_ops,
+				   &st[i].read_bytes, &st[i].write_ops,
+				   &st[i].write_bytes, &st[i].read_timed,
+				   &st[i].read_ns, &st[i].read_max_ns,
+				   &st[i].write_timed, &st[i].write_ns,
+				   &st[i].write_max_ns};
+		size_t j;
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &netid);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &addr);
+		for (j = 0; j < sizeof(val) / sizeof(val[0]); j++)
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       val[j]);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	gsh_free(st);
+}
+
+struct topn_entry {
+	uint64_t count;
+	uint64_t error;
+	char key[TOPN_KEY_SIZE];
+};
+
+static int topn_entry_cmp(const void *a, const void *b)
+{
+	const struct topn_entry *ea = a, *eb = b;
+
+	if (ea->count != eb->count)
+		return ea->count < eb->count ? 1 : -1;
+	return 0;
+}
+
+static size_t topn_gather(enum topn_kind kind, enum topn_metric metric,
+			  uint64_t window, struct topn_entry *entries)
+{
+	size_t n = 0, first, i;
+	struct topn_shard *shard;
+	struct topn_slot *slots, *slot;
+	uint64_t target;
+	int s, w;
+
+	for (s = 0; s < TOPN_SHARDS; s++) {
+		shard = &topn[kind][s];
+		first = n;
+
+		PTHREAD_MUTEX_lock(&shard->mtx);
+
+		/* The current window, then the one before */
+		for (w = 0; w < 2 && w <= window; w++) {
+			target = window - w;
+			if (shard->window != target &&
+			    shard->window != target + 1)
+				continue;
+			slots = shard->slots[target & 1][metric];
+			for (slot = slots; slot < slots + TOPN_SLOTS; slot++) {
+				if (slot->count == 0)
+					continue;
+				/* Keys of a shard stay in it */
+				for (i = first; i < n; i++)
+					if (memcmp(entries[i].key, slot->key,
+						   TOPN_KEY_SIZE) == 0)
+						break;
+				if (i == n) {
+					memset(&entries[n], 0,
+					       sizeof(entries[n]));
+					memcpy(entries[n].key, slot->key,
+					       TOPN_KEY_SIZE);
+					n++;
+				}
+				entries[i].count += slot->count;
+				entries[i].error += slot->error;
+			}
+		}
+
+		PTHREAD_MUTEX_unlock(&shard->mtx);
+	}
+
+	return n;
+}
+
+static void topn_dbus_entry(DBusMessageIter *array_iter, char *label,
+			    struct topn_entry *entry)
+{
+	DBusMessageIter struct_iter;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &label);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entry->count);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &entry->error);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+/**
+ * @brief Report the top talkers
+ *
+ * The window length in seconds, then for the clients and then for the
+ * files, the top @c count by ops, by bytes and by nsecs, over the
+ * current and the previous window.  Each entry is the client address,
+ * or export id:fsid major.minor:fileid, its count and the error of
+ * the count.
+ *
+ * @param[in]  count  Entries of each list
+ * @param[out] iter   Reply iterator
+ */
+void server_dbus_topn(uint32_t count, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter;
+	struct topn_entry *entries;
+	struct topn_file_key file;
+	uint32_t window_secs = topn_window / NS_PER_SEC;
+	uint64_t window = 0;
+	char label[TOPN_KEY_SIZE + 32];
+	size_t n, i;
+	int kind, metric;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	dbus_message_iter_append_basic(iter, DBUS_TYPE_UINT32, &window_secs);
+
+	if (topn_window != 0)
+		window = timespec_diff(&ServerBootTime, &timestamp) /
+			topn_window;
+
+	entries = gsh_malloc(2 * TOPN_SHARDS * TOPN_SLOTS * sizeof(*entries));
+
+	for (kind = 0; kind < TOPN_KINDS; kind++) {
+		for (metric = 0; metric < TOPN_METRICS; metric++) {
+			n = topn_window == 0 ? 0 :
+				topn_gather(kind, metric, window, entries);
+			qsort(entries, n, sizeof(*entries), topn_entry_cmp);
+
+			dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+							 "(stt)", &array_iter);
+			for (i = 0; i < n && i < count; i++) {
+				if (kind == TOPN_CLIENTS) {
+					memcpy(label, entries[i].key,
+					       TOPN_KEY_SIZE);
+				} else {
+					memcpy(&file, entries[i].key,
+					       sizeof(file));
+					(void)snprintf(label, sizeof(label),
+						       "%" PRIu16 ":%" PRIu64
+						       ".%" PRIu64 ":%" PRIu64,
+						       file.export_id,
+						       file.fsid_major,
+						       file.fsid_minor,
+						       file.fileid);
+				}
+				topn_dbus_entry(&array_iter, label,
+						&entries[i]);
+			}
+			dbus_message_iter_close_container(iter, &array_iter);
+		}
+	}
+
+	gsh_free(entries);
+}
+
+/**
+ * @brief Report the utilization of the workers and request queues
+ *
+ * The workers configured, executing a request now, and the ns they
+ * spent executing and waiting for work; for each request class its
+ * depth, the requests enqueued and dequeued, the total and longest time
+ * in queue in ns and its histogram (see struct req_q_stats); then the
+ * size and queueing of every thread fridge.
+ *
+ * @param[out] iter  Reply iterator
+ */
+void server_dbus_workers(DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter, hist_iter;
+	struct req_q_stats *st;
+	uint32_t val32[2];
+	uint64_t val64[5];
+	uint64_t hist[REQ_Q_WAIT_BUCKETS];
+	const uint64_t *histp = hist;
+	int ix, i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	val32[0] = nfs_param.core_param.nb_worker;
+	val32[1] = atomic_fetch_uint32_t(&nfs_req_st.workers.active);
+	val64[0] = atomic_fetch_uint64_t(&nfs_req_st.workers.busy);
+	val64[1] = atomic_fetch_uint64_t(&nfs_req_st.workers.idle);
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	for (i = 0; i < 2; i++)
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT32,
+					       &val32[i]);
+	for (i = 0; i < 2; i++)
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &val64[i]);
+	dbus_message_iter_close_container(iter, &struct_iter);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 WORKER_QUEUES_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (ix = 0; ix < N_REQ_QUEUES; ix++) {
+		st = &nfs_req_st.stats[ix];
+		val64[1] = atomic_fetch_uint64_t(&st->enqueued);
+		val64[2] = atomic_fetch_uint64_t(&st->dequeued);
+		val64[0] = val64[1] > val64[2] ? val64[1] - val64[2] : 0;
+		val64[3] = atomic_fetch_uint64_t(&st->wait);
+		val64[4] = atomic_fetch_uint64_t(&st->wait_max);
+		for (i = 0; i < REQ_Q_WAIT_BUCKETS; i++)
+			hist[i] = atomic_fetch_uint64_t(&st->wait_hist[i]);
+
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &req_q_s[ix]);
+		for (i = 0; i < 5; i++)
+			dbus_message_iter_append_basic(&struct_iter,
+						       DBUS_TYPE_UINT64,
+						       &val64[i]);
+		dbus_message_iter_open_container(&struct_iter, DBUS_TYPE_ARRAY,
+						 DBUS_TYPE_UINT64_AS_STRING,
+						 &hist_iter);
+		dbus_message_iter_append_fixed_array(&hist_iter,
+						     DBUS_TYPE_UINT64, &histp,
+						     REQ_Q_WAIT_BUCKETS);
+		dbus_message_iter_close_container(&struct_iter, &hist_iter);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+
+	fridgethr_dbus_stats(iter);
+}
+
+/**
+ * @brief Report global fd hits and misses of an export
+ *
+ * @param[in]  export  The export
+ * @param[out] iter    Reply iterator
+ */
+void server_dbus_fd_cache(struct gsh_export *export, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	uint64_t hits, misses;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	hits = atomic_fetch_uint64_t(&export->fd_hits);
+	misses = atomic_fetch_uint64_t(&export->fd_misses);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &misses);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/**
+ * @brief Report read-ahead of an export
+ *
+ * Reads ahead done and bytes they read, then READs answered from them
+ * and bytes they returned.
+ *
+ * @param[in]  export  The export
+ * @param[out] iter    Reply iterator
+ */
+void server_dbus_read_ahead(struct gsh_export *export, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+	DBusMessageIter struct_iter;
+	uint64_t reads, bytes, hits, hit_bytes;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	reads = atomic_fetch_uint64_t(&export->ra_reads);
+	bytes = atomic_fetch_uint64_t(&export->ra_bytes);
+	hits = atomic_fetch_uint64_t(&export->ra_hits);
+	hit_bytes = atomic_fetch_uint64_t(&export->ra_hit_bytes);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &reads);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &bytes);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64, &hits);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &hit_bytes);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+/* Percentiles reported for a latency histogram */
+#define LAT_PCTS 4
+
+/* Highest value counted in a latency bucket */
+static uint64_t latency_bucket_value(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < LAT_SUB)
+		return idx;
+
+	shift = idx / LAT_SUB - 1;
+
+	return ((uint64_t) (LAT_SUB + idx % LAT_SUB) << shift)
+		+ (1ULL << shift) - 1;
+}
+
+/* Append count, percentiles and max of a histogram to a struct */
+static void dbus_latency_values(DBusMessageIter *struct_iter,
+				struct latency_hist *hist)
+{
+	/* in thousandths */
+	static const uint64_t pct[LAT_PCTS] = { 500, 900, 990, 999 };
+	uint64_t counts[LAT_HIST_BUCKETS];
+	uint64_t value[LAT_PCTS] = { 0 };
+	uint64_t total = 0, seen = 0, count, max;
+	unsigned int i, j = 0;
+
+	count = atomic_fetch_uint64_t(&hist->count);
+	max = atomic_fetch_uint64_t(&hist->max);
+
+	for (i = 0; i < LAT_HIST_BUCKETS; i++) {
+		counts[i] = atomic_fetch_uint64_t(&hist->bucket[i]);
+		total += counts[i];
+	}
+
+	for (i = 0; i < LAT_HIST_BUCKETS && total != 0; i++) {
+		seen += counts[i];
+		while (j < LAT_PCTS &&
+		       seen * 1000 >= total * pct[j])
+			value[j++] = latency_bucket_value(i);
+	}
+
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64, &count);
+	for (j = 0; j < LAT_PCTS; j++)
+		dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64,
+					       &value[j]);
+	dbus_message_iter_append_basic(struct_iter, DBUS_TYPE_UINT64, &max);
+}
+
+static void dbus_latency_hist(DBusMessageIter *array_iter, const char *name,
+			      struct latency_hist *hist)
+{
+	DBusMessageIter struct_iter;
+
+	dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING, &name);
+	dbus_latency_values(&struct_iter, hist);
+	dbus_message_iter_close_container(array_iter, &struct_iter);
+}
+
+static void dbus_latency(DBusMessageIter *iter, struct latency_stats *lat)
+{
+	static const char * const phase_name[LAT_PHASES] = {
+		[LAT_DECODE] = "decode",
+		[LAT_QUEUE] = "queue",
+		[LAT_EXECUTE] = "execute",
+		[LAT_REPLY] = "reply",
+		[LAT_TOTAL] = "total",
+	};
+	struct timespec timestamp;
+	DBusMessageIter array_iter;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 LATENCY_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	if (lat != NULL) {
+		for (i = 0; i < LAT_PHASES; i++)
+			dbus_latency_hist(&array_iter, phase_name[i],
+					  &lat->phase[i]);
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++) {
+			struct latency_hist *hist =
+				atomic_fetch_voidptr(&lat->v4op[i]);
+
+			if (hist != NULL)
+				dbus_latency_hist(&array_iter,
+						  optabv4[i].name, hist);
+		}
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the latency histograms of an export
+ *
+ * The request phases come first, then the NFSv4 operations.
+ */
+void server_dbus_latency(struct export_stats *export_st,
+			 DBusMessageIter *iter)
+{
+	dbus_latency(iter, atomic_fetch_voidptr(&export_st->st.latency));
+}
+
+void global_dbus_latency(DBusMessageIter *iter)
+{
+	dbus_latency(iter, atomic_fetch_voidptr(&global_latency));
+}
+
+static void dbus_op_hist_table(DBusMessageIter *array_iter,
+			       const char *proto,
+			       struct latency_hist **hists, int nops,
+			       const char *(*opname)(int op))
+{
+	DBusMessageIter struct_iter;
+	const char *name;
+	int i;
+
+	for (i = 0; i < nops; i++) {
+		struct latency_hist *hist = atomic_fetch_voidptr(&hists[i]);
+
+		if (hist == NULL)
+			continue;
+
+		name = opname(i);
+		if (name == NULL)
+			name = "UNKNOWN";
+		dbus_message_iter_open_container(array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &proto);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &name);
+		dbus_latency_values(&struct_iter, hist);
+		dbus_message_iter_close_container(array_iter, &struct_iter);
+	}
+}
+
+static const char *v3_opname(int op)
+{
+	return optabv3[op].name;
+}
+
+static const char *v4_opname(int op)
+{
+	return optabv4[op].name;
+}
+
+static const char *nlm_opname(int op)
+{
+	return optnlm[op].name;
+}
+
+#ifdef _USE_9P
+static const char *_9p_opname(int op)
+{
+	return _9pfuncdesc[op].funcname;
+}
+#endif
+
+static void dbus_op_hists(DBusMessageIter *iter, struct op_hists *hists)
+{
+	struct timespec timestamp;
+	DBusMessageIter array_iter;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 OP_LATENCY_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	if (hists != NULL) {
+		dbus_op_hist_table(&array_iter, "NFSv3", hists->v3,
+				   NFS_V3_NB_COMMAND, v3_opname);
+		dbus_op_hist_table(&array_iter, "NFSv4", hists->v4,
+				   NFS4_OP_LAST_ONE, v4_opname);
+		dbus_op_hist_table(&array_iter, "NLM", hists->nlm,
+				   NLM_V4_NB_OPERATION, nlm_opname);
+#ifdef _USE_9P
+		dbus_op_hist_table(&array_iter, "9P", hists->_9p,
+				   _9P_RWSTAT + 1, _9p_opname);
+#endif
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Report the op latency histograms of an export or a client
+ */
+void server_dbus_op_latency(struct gsh_stats *st, DBusMessageIter *iter)
+{
+	dbus_op_hists(iter, atomic_fetch_voidptr(&st->op_hists));
+}
+
+void global_dbus_op_latency(DBusMessageIter *iter)
+{
+	dbus_op_hists(iter, atomic_fetch_voidptr(&global_op_hists));
+}
+
+/**
+ * @brief Report the sub-FSAL call latencies of an export
+ *
+ * Calls never made are left out, calls in flight are counted.
+ */
+void server_dbus_fsal_latency(struct gsh_stats *st, DBusMessageIter *iter)
+{
+	struct fsal_op_stats *ops = atomic_fetch_voidptr(&st->fsal_ops);
+	struct timespec timestamp;
+	DBusMessageIter array_iter, struct_iter;
+	struct latency_hist empty;
+	uint64_t in_flight;
+	int i;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+
+	memset(&empty, 0, sizeof(empty));
+	dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY,
+					 FSAL_LATENCY_REPLY_ARRAY_TYPE,
+					 &array_iter);
+	for (i = 0; ops != NULL && i < FSAL_STAT_OPS; i++) {
+		struct latency_hist *hist = atomic_fetch_voidptr(&ops->hist[i]);
+		int64_t flight = atomic_fetch_int64_t(&ops->in_flight[i]);
+
+		if (hist == NULL && flight == 0)
+			continue;
+
+		in_flight = flight > 0 ? flight : 0;
+		dbus_message_iter_open_container(&array_iter, DBUS_TYPE_STRUCT,
+						 NULL, &struct_iter);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_STRING,
+					       &fsal_stat_op_name[i]);
+		dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+					       &in_flight);
+		dbus_latency_values(&struct_iter, hist ? hist : &empty);
+		dbus_message_iter_close_container(&array_iter, &struct_iter);
+	}
+	dbus_message_iter_close_container(iter, &array_iter);
+}
+
+/**
+ * @brief Zero the sub-FSAL call latencies of an export
+ *
+ * The calls in flight are still counted.
+ */
+void server_stats_reset_fsal_latency(struct gsh_stats *st)
+{
+	struct fsal_op_stats *ops = atomic_fetch_voidptr(&st->fsal_ops);
+	int i;
+
+	if (ops == NULL)
+		return;
+
+	for (i = 0; i < FSAL_STAT_OPS; i++) {
+		struct latency_hist *hist = atomic_fetch_voidptr(&ops->hist[i]);
+
+		if (hist != NULL)
+			memset(hist, 0, sizeof(*hist));
+	}
+}
+
+static void reset_op_hist_table(struct latency_hist **hists, int nops)
+{
+	int i;
+
+	for (i = 0; i < nops; i++) {
+		struct latency_hist *hist = atomic_fetch_voidptr(&hists[i]);
+
+		/* Racing updates may survive, that's fine for a reset */
+		if (hist != NULL)
+			memset(hist, 0, sizeof(*hist));
+	}
+}
+
+static void reset_op_hists(struct op_hists *hists)
+{
+	if (hists == NULL)
+		return;
+
+	reset_op_hist_table(hists->v3, NFS_V3_NB_COMMAND);
+	reset_op_hist_table(hists->v4, NFS4_OP_LAST_ONE);
+	reset_op_hist_table(hists->nlm, NLM_V4_NB_OPERATION);
+#ifdef _USE_9P
+	reset_op_hist_table(hists->_9p, _9P_RWSTAT + 1);
+#endif
+}
+
+/**
+ * @brief Zero the op latency histograms of an export or a client
+ */
+void server_stats_reset_op_latency(struct gsh_stats *st)
+{
+	reset_op_hists(atomic_fetch_voidptr(&st->op_hists));
+}
+
+void global_reset_op_latency(void)
+{
+	reset_op_hists(atomic_fetch_voidptr(&global_op_hists));
+}
+
+#ifdef _USE_9P
+void server_dbus_9p_iostats(struct _9p_stats *_9pp, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	server_dbus_iostats(&_9pp->read, iter);
+	server_dbus_iostats(&_9pp->write, iter);
+}
+
+void server_dbus_9p_transstats(struct _9p_stats *_9pp, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	server_dbus_transportstats(&_9pp->trans, iter);
+}
+
+void server_dbus_9p_opstats(struct _9p_stats *_9pp, u8 opcode,
+			    DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	server_dbus_op_stats(_9pp->opcodes[opcode], iter);
+}
+#endif
+
+
+/**
+ * @brief Report layout statistics as a struct
+ *
+ * struct layout {
+ *       uint64_t total_layouts;
+ *       uint64_t errors;
+ *       uint64_t delays;
+ * }
+ *
+ * @param iop   [IN] pointer to xfer op sub-structure of interest
+ * @param iter  [IN] interator in reply stream to fill
+ */
+
+static void server_dbus_layouts(struct layout_op *lop, DBusMessageIter *iter)
+{
+	DBusMessageIter struct_iter;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_STRUCT, NULL,
+					 &struct_iter);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &lop->total);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &lop->errors);
+	dbus_message_iter_append_basic(&struct_iter, DBUS_TYPE_UINT64,
+				       &lop->delays);
+	dbus_message_iter_close_container(iter, &struct_iter);
+}
+
+void server_dbus_v41_layouts(struct nfsv41_stats *v41p, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	server_dbus_layouts(&v41p->getdevinfo, iter);
+	server_dbus_layouts(&v41p->layout_get, iter);
+	server_dbus_layouts(&v41p->layout_commit, iter);
+	server_dbus_layouts(&v41p->layout_return, iter);
+	server_dbus_layouts(&v41p->recall, iter);
+}
+
+void server_dbus_v42_layouts(struct nfsv41_stats *v42p, DBusMessageIter *iter)
+{
+	struct timespec timestamp;
+
+	now(&timestamp);
+	dbus_append_timestamp(iter, &timestamp);
+	server_dbus_layouts(&v42p->getdevinfo, iter);
 	server_dbus_layouts(&v42p->layout_get, iter);
 	server_dbus_layouts(&v42p->layout_commit, iter);
 	server_dbus_layouts(&v42p->layout_return, iter);
@@ -1863,6 +3766,39 @@ void server_stats_free(struct gsh_stats *statsp)
 		gsh_free(statsp->nfsv42);
 		statsp->nfsv42 = NULL;
 	}
+	if (statsp->latency != NULL) {
+		int i;
+
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+			gsh_free(statsp->latency->v4op[i]);
+		gsh_free(statsp->latency);
+		statsp->latency = NULL;
+	}
+	if (statsp->op_hists != NULL) {
+		struct op_hists *hists = statsp->op_hists;
+		int i;
+
+		for (i = 0; i < NFS_V3_NB_COMMAND; i++)
+			gsh_free(hists->v3[i]);
+		for (i = 0; i < NFS4_OP_LAST_ONE; i++)
+			gsh_free(hists->v4[i]);
+		for (i = 0; i < NLM_V4_NB_OPERATION; i++)
+			gsh_free(hists->nlm[i]);
+#ifdef _USE_9P
+		for (i = 0; i <= _9P_RWSTAT; i++)
+			gsh_free(hists->_9p[i]);
+#endif
+		gsh_free(hists);
+		statsp->op_hists = NULL;
+	}
+	if (statsp->fsal_ops != NULL) {
+		int i;
+
+		for (i = 0; i < FSAL_STAT_OPS; i++)
+			gsh_free(statsp->fsal_ops->hist[i]);
+		gsh_free(statsp->fsal_ops);
+		statsp->fsal_ops = NULL;
+	}
 #ifdef _USE_9P
 	if (statsp->_9p != NULL) {
 		u8 opc;
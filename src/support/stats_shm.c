@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file stats_shm.c
+ * @brief The shared memory stats segment and its publisher thread
+ *
+ * See stats_shm.h.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "log.h"
+#include "nfs_core.h"
+#include "fridgethr.h"
+#include "abstract_atomic.h"
+#include "stats_shm.h"
+
+/** Most modules adding counters */
+#define STATS_SHM_PROVIDERS 16
+/** Room for the named counters and the histograms */
+#define STATS_SHM_VALUES 2048
+#define STATS_SHM_HISTS 512
+
+#define NFS_pcp nfs_param.core_param
+
+struct stats_shm_ctx {
+	struct gsh_stats_shm_header *hdr;
+};
+
+static stats_shm_provider_t shm_providers[STATS_SHM_PROVIDERS];
+static uint32_t shm_nproviders;
+static pthread_mutex_t shm_providers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct gsh_stats_shm_header *shm_seg;	/*< The mapped segment */
+static struct gsh_stats_shm_header *shm_buf;	/*< Where it is built */
+static size_t shm_size;
+static struct fridgethr *shm_fridge;
+
+/**
+ * @brief Register a module's counters with the segment
+ *
+ * May be called before the segment is set up, or without one.
+ *
+ * @param[in] provider Function adding them
+ */
+void stats_shm_add_provider(stats_shm_provider_t provider)
+{
+	PTHREAD_MUTEX_lock(&shm_providers_lock);
+	if (shm_nproviders < STATS_SHM_PROVIDERS)
+		shm_providers[shm_nproviders++] = provider;
+	else
+		LogCrit(COMPONENT_INIT,
+			"Too many modules in the stats segment");
+	PTHREAD_MUTEX_unlock(&shm_providers_lock);
+}
+
+/* The next free record of a section, zeroed, or NULL if full */
+static void *shm_record(struct stats_shm_ctx *ctx,
+			enum gsh_stats_shm_section_id id)
+{
+	struct gsh_stats_shm_section *sect = &ctx->hdr->section[id];
+
+	if (sect->count == sect->max) {
+		sect->dropped++;
+		return NULL;
+	}
+
+	return (char *) ctx->hdr + sect->offset +
+	       (size_t) sect->count++ * sect->size;
+}
+
+struct gsh_stats_shm_counters *stats_shm_global(struct stats_shm_ctx *ctx)
+{
+	return shm_record(ctx, GSH_STATS_SHM_GLOBAL);
+}
+
+struct gsh_stats_shm_export *stats_shm_export(struct stats_shm_ctx *ctx)
+{
+	return shm_record(ctx, GSH_STATS_SHM_EXPORTS);
+}
+
+struct gsh_stats_shm_client *stats_shm_client(struct stats_shm_ctx *ctx)
+{
+	return shm_record(ctx, GSH_STATS_SHM_CLIENTS);
+}
+
+/**
+ * @brief Add a named counter, called module.name in the segment
+ */
+void stats_shm_value(struct stats_shm_ctx *ctx, const char *module,
+		     const char *name, uint64_t value)
+{
+	struct gsh_stats_shm_value *rec;
+
+	rec = shm_record(ctx, GSH_STATS_SHM_VALUES);
+	if (rec == NULL)
+		return;
+
+	snprintf(rec->name, sizeof(rec->name), "%s.%s", module, name);
+	rec->value = value;
+}
+
+/**
+ * @brief Add a histogram, called module.name, for the caller to fill
+ *
+ * @return The histogram, or NULL if there is no room.
+ */
+struct gsh_stats_shm_hist *stats_shm_hist(struct stats_shm_ctx *ctx,
+					  const char *module,
+					  const char *name)
+{
+	struct gsh_stats_shm_hist *rec;
+
+	rec = shm_record(ctx, GSH_STATS_SHM_HISTS);
+	if (rec != NULL)
+		snprintf(rec->name, sizeof(rec->name), "%s.%s", module,
+			 name);
+
+	return rec;
+}
+
+static uint64_t shm_realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * @brief Rebuild the segment and publish it
+ *
+ * Only the filled part of each section is copied, under the seqlock.
+ */
+static void shm_publish(struct fridgethr_context *unused)
+{
+	struct stats_shm_ctx ctx = { .hdr = shm_buf };
+	struct gsh_stats_shm_section *sect;
+	size_t first = shm_buf->section[0].offset;
+	uint32_t i;
+
+	for (i = 0; i < GSH_STATS_SHM_SECTIONS; i++) {
+		shm_buf->section[i].count = 0;
+		shm_buf->section[i].dropped = 0;
+	}
+	memset((char *) shm_buf + first, 0, shm_size - first);
+
+	server_stats_shm_fill(&ctx);
+
+	PTHREAD_MUTEX_lock(&shm_providers_lock);
+	for (i = 0; i < shm_nproviders; i++)
+		shm_providers[i](&ctx);
+	PTHREAD_MUTEX_unlock(&shm_providers_lock);
+
+	shm_buf->updated_ns = shm_realtime_ns();
+
+	/* Odd while copying; the increments are full barriers */
+	shm_buf->seq = atomic_inc_uint64_t(&shm_seg->seq);
+	memcpy(shm_seg, shm_buf, sizeof(*shm_buf));
+	for (i = 0; i < GSH_STATS_SHM_SECTIONS; i++) {
+		sect = &shm_buf->section[i];
+		memcpy((char *) shm_seg + sect->offset,
+		       (char *) shm_buf + sect->offset,
+		       (size_t) sect->count * sect->size);
+	}
+	(void) atomic_inc_uint64_t(&shm_seg->seq);
+}
+
+/* Lay the sections out, each on a cache line */
+static size_t shm_layout(struct gsh_stats_shm_header *hdr)
+{
+	static const uint32_t size[GSH_STATS_SHM_SECTIONS] = {
+		[GSH_STATS_SHM_GLOBAL] = sizeof(struct gsh_stats_shm_counters),
+		[GSH_STATS_SHM_EXPORTS] = sizeof(struct gsh_stats_shm_export),
+		[GSH_STATS_SHM_CLIENTS] = sizeof(struct gsh_stats_shm_client),
+		[GSH_STATS_SHM_VALUES] = sizeof(struct gsh_stats_shm_value),
+		[GSH_STATS_SHM_HISTS] = sizeof(struct gsh_stats_shm_hist),
+	};
+	uint32_t max[GSH_STATS_SHM_SECTIONS] = {
+		[GSH_STATS_SHM_GLOBAL] = 1,
+		[GSH_STATS_SHM_EXPORTS] = NFS_pcp.stats_shm_exports,
+		[GSH_STATS_SHM_CLIENTS] = NFS_pcp.stats_shm_clients,
+		[GSH_STATS_SHM_VALUES] = STATS_SHM_VALUES,
+		[GSH_STATS_SHM_HISTS] = STATS_SHM_HISTS,
+	};
+	size_t offset = sizeof(*hdr);
+	uint32_t i;
+
+	for (i = 0; i < GSH_STATS_SHM_SECTIONS; i++) {
+		offset = (offset + GSH_CACHE_LINE_SIZE - 1) &
+			 ~((size_t) GSH_CACHE_LINE_SIZE - 1);
+		hdr->section[i].offset = offset;
+		hdr->section[i].max = max[i];
+		hdr->section[i].size = size[i];
+		offset += (size_t) max[i] * size[i];
+	}
+
+	return offset;
+}
+
+/**
+ * @brief Create the segment and start publishing
+ *
+ * Does nothing without Stats_Shm_Name.  A segment of that name left
+ * by an earlier server is reused.
+ */
+void stats_shm_start(void)
+{
+	const char *name = NFS_pcp.stats_shm_name;
+	struct gsh_stats_shm_header hdr;
+	struct fridgethr_params frp;
+	void *seg;
+	int fd;
+
+	if (name == NULL)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	shm_size = shm_layout(&hdr);
+
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		LogCrit(COMPONENT_INIT,
+			"Could not open stats segment %s: %s",
+			name, strerror(errno));
+		return;
+	}
+
+	if (ftruncate(fd, shm_size) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Could not size stats segment %s: %s",
+			name, strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return;
+	}
+
+	seg = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED) {
+		LogCrit(COMPONENT_INIT,
+			"Could not map stats segment %s: %s",
+			name, strerror(errno));
+		shm_unlink(name);
+		return;
+	}
+
+	hdr.magic = GSH_STATS_SHM_MAGIC;
+	hdr.version = GSH_STATS_SHM_VERSION;
+	hdr.size = shm_size;
+	hdr.started_ns = shm_realtime_ns();
+	hdr.pid = getpid();
+	hdr.interval = NFS_pcp.stats_shm_interval;
+	hdr.hist_sub_bits = GSH_STATS_SHM_HIST_SUB_BITS;
+	hdr.hist_buckets = GSH_STATS_SHM_HIST_BUCKETS;
+
+	shm_seg = seg;
+
+	/* Even, and new to the readers of a reused segment */
+	hdr.seq = (atomic_fetch_uint64_t(&shm_seg->seq) + 2) & ~1ULL;
+	memcpy(shm_seg, &hdr, sizeof(hdr));
+
+	shm_buf = gsh_calloc(1, shm_size);
+	memcpy(shm_buf, &hdr, sizeof(hdr));
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 1;
+	frp.thr_min = 1;
+	frp.thread_delay = hdr.interval;
+	frp.flavor = fridgethr_flavor_looper;
+
+	if (fridgethr_init(&shm_fridge, "stats_shm", &frp) != 0 ||
+	    fridgethr_submit(shm_fridge, shm_publish, NULL) != 0) {
+		LogCrit(COMPONENT_INIT,
+			"Unable to start the stats segment thread");
+		stats_shm_shutdown();
+		return;
+	}
+
+	LogInfo(COMPONENT_INIT, "Publishing stats in %s, %zu bytes",
+		name, shm_size);
+}
+
+/**
+ * @brief Stop publishing and remove the segment
+ */
+void stats_shm_shutdown(void)
+{
+	int rc;
+
+	if (shm_fridge != NULL) {
+		rc = fridgethr_sync_command(shm_fridge, fridgethr_comm_stop,
+					    120);
+		if (rc == ETIMEDOUT) {
+			LogMajor(COMPONENT_INIT,
+				 "Shutdown timed out, cancelling threads.");
+			fridgethr_cancel(shm_fridge);
+		} else if (rc != 0) {
+			LogMajor(COMPONENT_INIT,
+				 "Failed shutting down stats segment thread: %d",
+				 rc);
+		}
+		fridgethr_destroy(shm_fridge);
+		shm_fridge = NULL;
+	}
+
+	if (shm_seg == NULL)
+		return;
+
+	/* Tell readers still mapping it */
+	atomic_store_uint32_t(&shm_seg->magic, 0);
+	munmap(shm_seg, shm_size);
+	shm_unlink(NFS_pcp.stats_shm_name);
+	shm_seg = NULL;
+	gsh_free(shm_buf);
+	shm_buf = NULL;
+}
@@ -45,6 +45,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "common_utils.h"
+#include "abstract_atomic.h"
+#include "fridgethr.h"
+#include "gsh_list.h"
 #include "uid2grp.h"
 
 /* group_data has a reference counter. If it goes to zero, it implies
@@ -199,6 +202,7 @@ static struct group_data *uid2grp_allocate_by_name(
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
@@ -246,9 +250,198 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
 	PTHREAD_MUTEX_init(&gdata->lock, NULL);
 	gdata->epoch = time(NULL);
 	gdata->refcount = 0;
+	gdata->refreshing = 0;
 	return gdata;
 }
 
+/**
+ * @brief A resolution in progress
+ *
+ * Concurrent misses on the same user wait for the first one instead
+ * of all asking the name service.  The flight holds a reference on
+ * the result until the last waiter took its own.
+ */
+struct uid2grp_flight {
+	struct glist_head list;
+	uid_t uid;
+	struct gsh_buffdesc name;	/*< Empty when resolving by UID */
+	struct group_data *gdata;
+	unsigned int refs;
+	bool done;
+};
+
+static pthread_mutex_t uid2grp_flight_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uid2grp_flight_cond = PTHREAD_COND_INITIALIZER;
+static struct glist_head uid2grp_flights = {
+	&uid2grp_flights, &uid2grp_flights
+};
+
+static struct fridgethr *uid2grp_fridge;
+static struct uid2grp_stats uid2grp_counters;
+
+/**
+ * @brief Start the threads refreshing group lists before they expire
+ */
+void uid2grp_refresh_init(void)
+{
+	struct fridgethr_params frp;
+
+	memset(&frp, 0, sizeof(struct fridgethr_params));
+	frp.thr_max = 4;
+	frp.deferment = fridgethr_defer_queue;
+
+	if (fridgethr_init(&uid2grp_fridge, "uid2grp", &frp) != 0) {
+		LogMajor(COMPONENT_IDMAPPER,
+			 "Unable to start the refresh threads, group lists will only expire");
+		uid2grp_fridge = NULL;
+	}
+}
+
+static struct uid2grp_flight *uid2grp_flight_find(uid_t uid,
+					const struct gsh_buffdesc *name)
+{
+	struct glist_head *glist;
+	struct uid2grp_flight *flight;
+
+	glist_for_each(glist, &uid2grp_flights) {
+		flight = glist_entry(glist, struct uid2grp_flight, list);
+		if (name == NULL) {
+			if (flight->name.len == 0 && flight->uid == uid)
+				return flight;
+		} else if (flight->name.len == name->len &&
+			   memcmp(flight->name.addr, name->addr,
+				  name->len) == 0) {
+			return flight;
+		}
+	}
+
+	return NULL;
+}
+
+/* Drop a reference on a flight, uid2grp_flight_mtx is held */
+static void uid2grp_flight_put(struct uid2grp_flight *flight)
+{
+	if (--flight->refs != 0)
+		return;
+
+	if (flight->gdata)
+		uid2grp_release_group_data(flight->gdata);
+	gsh_free(flight);
+}
+
+/**
+ * @brief Resolve a user missing from the cache and cache it
+ *
+ * @param[in] uid  The uid, when name is NULL
+ * @param[in] name The name of the user, or NULL
+ *
+ * @return The group data with a reference for the caller, or NULL.
+ */
+static struct group_data *uid2grp_resolve(uid_t uid,
+					  const struct gsh_buffdesc *name)
+{
+	struct uid2grp_flight *flight;
+	struct group_data *gdata;
+	size_t len = name ? name->len : 0;
+
+	(void)atomic_inc_uint64_t(&uid2grp_counters.misses);
+
+	PTHREAD_MUTEX_lock(&uid2grp_flight_mtx);
+
+	flight = uid2grp_flight_find(uid, name);
+	if (flight != NULL) {
+		(void)atomic_inc_uint64_t(&uid2grp_counters.waits);
+		flight->refs++;
+		while (!flight->done)
+			pthread_cond_wait(&uid2grp_flight_cond,
+					  &uid2grp_flight_mtx);
+		gdata = flight->gdata;
+		if (gdata)
+			uid2grp_hold_group_data(gdata);
+		uid2grp_flight_put(flight);
+		PTHREAD_MUTEX_unlock(&uid2grp_flight_mtx);
+		return gdata;
+	}
+
+	flight = gsh_calloc(1, sizeof(*flight) + len);
+	flight->uid = uid;
+	flight->name.addr = (char *)flight + sizeof(*flight);
+	flight->name.len = len;
+	if (len)
+		memcpy(flight->name.addr, name->addr, len);
+	flight->refs = 1;
+	glist_add_tail(&uid2grp_flights, &flight->list);
+
+	PTHREAD_MUTEX_unlock(&uid2grp_flight_mtx);
+
+	gdata = name ? uid2grp_allocate_by_name(name)
+		     : uid2grp_allocate_by_uid(uid);
+	if (gdata) {
+		uid2grp_add_user(gdata);
+		/* One for the caller, one for the flight */
+		uid2grp_hold_group_data(gdata);
+		uid2grp_hold_group_data(gdata);
+	} else {
+		(void)atomic_inc_uint64_t(&uid2grp_counters.failures);
+	}
+
+	PTHREAD_MUTEX_lock(&uid2grp_flight_mtx);
+	flight->gdata = gdata;
+	flight->done = true;
+	glist_del(&flight->list);
+	pthread_cond_broadcast(&uid2grp_flight_cond);
+	uid2grp_flight_put(flight);
+	PTHREAD_MUTEX_unlock(&uid2grp_flight_mtx);
+
+	return gdata;
+}
+
+static void uid2grp_refresh_run(struct fridgethr_context *ctx)
+{
+	struct group_data *old = ctx->arg;
+	struct group_data *gdata = uid2grp_allocate_by_uid(old->uid);
+
+	if (gdata)
+		uid2grp_add_user(gdata);
+	else
+		atomic_clear_uint32_t_bits(&old->refreshing, 1);
+
+	uid2grp_release_group_data(old);
+}
+
+/**
+ * @brief Check a cached group list, queue its refresh once it is old
+ *
+ * The refresh starts in the last quarter of Manage_Gids_Expiration so
+ * that users in use are replaced before they expire.
+ *
+ * @return true if the entry is still valid.
+ */
+static bool uid2grp_check(struct group_data *gdata)
+{
+	time_t expiration = nfs_param.core_param.manage_gids_expiration;
+	time_t age = time(NULL) - gdata->epoch;
+
+	if (age > expiration)
+		return false;
+
+	if (uid2grp_fridge == NULL || age <= expiration - expiration / 4 ||
+	    atomic_postset_uint32_t_bits(&gdata->refreshing, 1) != 0)
+		return true;
+
+	uid2grp_hold_group_data(gdata);
+	if (fridgethr_submit(uid2grp_fridge, uid2grp_refresh_run,
+			     gdata) != 0) {
+		LogDebug(COMPONENT_IDMAPPER, "Could not queue a refresh");
+		atomic_clear_uint32_t_bits(&gdata->refreshing, 1);
+		uid2grp_release_group_data(gdata);
+	} else {
+		(void)atomic_inc_uint64_t(&uid2grp_counters.refreshes);
+	}
+
+	return true;
+}
+
 /**
  * @brief Get supplementary groups given uname
  *
@@ -257,41 +450,23 @@ static struct group_data *uid2grp_allocate_by_uid(uid_t uid)
  *
  * @return true if successful, false otherwise
  */
-#define uid2grp_expired(gdata) (time(NULL) - (gdata)->epoch > \
-		nfs_param.core_param.manage_gids_expiration)
 bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
 {
-	bool success = false;
 	uid_t uid = -1;
 
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
-
 	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
-	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-
-	if (success) {
-		/* Cache entry is expired */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uname(name);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	if (uid2grp_lookup_by_uname(name, &uid, gdata)) {
+		if (uid2grp_check(*gdata)) {
+			(void)atomic_inc_uint64_t(&uid2grp_counters.hits);
+			return true;
+		}
+		/* Cache entry is expired, the new one replaces it */
+		uid2grp_release_group_data(*gdata);
 	}
 
-	*gdata = uid2grp_allocate_by_name(name);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uname(name, &uid, gdata);
-	if (success)
-		uid2grp_hold_group_data(*gdata);
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	*gdata = uid2grp_resolve(-1, name);
 
-	return success;
+	return *gdata != NULL;
 }
 
 /**
@@ -304,36 +479,31 @@ bool name2grp(const struct gsh_buffdesc *name, struct group_data **gdata)
  */
 bool uid2grp(uid_t uid, struct group_data **gdata)
 {
-	bool success = false;
-
-	PTHREAD_RWLOCK_rdlock(&uid2grp_user_lock);
-	success = uid2grp_lookup_by_uid(uid, gdata);
-
 	/* Handle common case first */
-	if (success && !uid2grp_expired(*gdata)) {
-		uid2grp_hold_group_data(*gdata);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-		return success;
+	if (uid2grp_lookup_by_uid(uid, gdata)) {
+		if (uid2grp_check(*gdata)) {
+			(void)atomic_inc_uint64_t(&uid2grp_counters.hits);
+			return true;
+		}
+		/* Cache entry is expired, the new one replaces it */
+		uid2grp_release_group_data(*gdata);
 	}
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 
-	if (success) {
-		/* Cache entry is expired */
-		PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-		uid2grp_remove_by_uid(uid);
-		PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
-	}
+	*gdata = uid2grp_resolve(uid, NULL);
 
-	*gdata = uid2grp_allocate_by_uid(uid);
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-	if (*gdata)
-		uid2grp_add_user(*gdata);
-	success = uid2grp_lookup_by_uid(uid, gdata);
-	if (success)
-		uid2grp_hold_group_data(*gdata);
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
+	return *gdata != NULL;
+}
 
-	return success;
+/**
+ * @brief Copy the counters of the group list cache
+ */
+void uid2grp_stats(struct uid2grp_stats *st)
+{
+	st->hits = atomic_fetch_uint64_t(&uid2grp_counters.hits);
+	st->misses = atomic_fetch_uint64_t(&uid2grp_counters.misses);
+	st->waits = atomic_fetch_uint64_t(&uid2grp_counters.waits);
+	st->refreshes = atomic_fetch_uint64_t(&uid2grp_counters.refreshes);
+	st->failures = atomic_fetch_uint64_t(&uid2grp_counters.failures);
 }
 
 /*
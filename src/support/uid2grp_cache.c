@@ -30,6 +30,10 @@
 /**
  * @file    uid_grplist_cache.c
  * @brief   Uid->Group List mapping cache functions
+ *
+ * Users are kept in two indexes, by UID and by name, each split in
+ * shards with a lock and an AVL tree of their own.  Each index holds a
+ * reference on the group_data of its entries.
  */
 #include "config.h"
 #include "log.h"
@@ -42,53 +46,38 @@
 #include "gsh_types.h"
 #include "common_utils.h"
 #include "avltree.h"
+#include "city.h"
 #include "uid2grp.h"
 #include "abstract_atomic.h"
 
+/** Shards of each index, a power of 2 */
+#define UID2GRP_SHARDS 16
+
 /**
- * @brief User entry in the IDMapper cache
+ * @brief User entry in one index of the cache
  */
 
 struct cache_info {
 	uid_t uid;		/*< Corresponding UID */
 	struct gsh_buffdesc uname;
 	struct group_data *gdata;
-	struct avltree_node uname_node;	/*< Node in the name tree */
-	struct avltree_node uid_node;	/*< Node in the UID tree */
+	union {
+		struct avltree_node node;	/*< In the uname index */
+		struct btree_node bnode;	/*< In the uid index, by uid */
+	};
 };
 
-/**
- * @brief Number of entires in the UID cache, should be prime.
- */
-
-#define id_cache_size 1009
-
-/**
- * @brief UID cache, may only be accessed with uid2grp_user_lock
- * held.  If uid2grp_user_lock is held for read, it must be accessed
- * atomically.  (For a write, normal fetch/store is sufficient since
- * others are kept out.)
- */
-
-static struct avltree_node *uid_grplist_cache[id_cache_size];
-
-/**
- * @brief Lock that protects the idmapper user cache
- */
-
-pthread_rwlock_t uid2grp_user_lock = PTHREAD_RWLOCK_INITIALIZER;
-
-/**
- * @brief Tree of users, by name
- */
-
-static struct avltree uname_tree;
-
-/**
- * @brief Tree of users, by ID
- */
+struct uid2grp_shard {
+	pthread_rwlock_t lock;
+	bool by_uid;
+	union {
+		struct avltree tree;	/*< Of the uname index */
+		struct btree btree;	/*< Of the uid index */
+	};
+};
 
-static struct avltree uid_tree;
+static struct uid2grp_shard uid_shards[UID2GRP_SHARDS];
+static struct uid2grp_shard uname_shards[UID2GRP_SHARDS];
 
 /**
  * @brief Compare two buffers
@@ -136,42 +125,23 @@ static int uname_comparator(const struct avltree_node *node1,
 			    const struct avltree_node *nodea)
 {
 	struct cache_info *user1 =
-	    avltree_container_of(node1, struct cache_info,
-				 uname_node);
+	    avltree_container_of(node1, struct cache_info, node);
 	struct cache_info *usera =
-	    avltree_container_of(nodea, struct cache_info,
-				 uname_node);
+	    avltree_container_of(nodea, struct cache_info, node);
 
 	return buffdesc_comparator(&user1->uname, &usera->uname);
 }
 
-/**
- * @brief Comparison for UIDs
- *
- * @param[in] node1 A node
- * @param[in] nodea Another node
- *
- * @retval -1 if node1 is less than nodea
- * @retval 0 if node1 and nodea are equal
- * @retval 1 if node1 is greater than nodea
- */
-
-static int uid_comparator(const struct avltree_node *node1,
-			  const struct avltree_node *nodea)
+static inline struct uid2grp_shard *uid_shard(uid_t uid)
 {
-	struct cache_info *user1 =
-	    avltree_container_of(node1, struct cache_info,
-				 uid_node);
-	struct cache_info *usera =
-	    avltree_container_of(nodea, struct cache_info,
-				 uid_node);
+	return &uid_shards[uid & (UID2GRP_SHARDS - 1)];
+}
 
-	if (user1->uid < usera->uid)
-		return -1;
-	else if (user1->uid > usera->uid)
-		return 1;
-	else
-		return 0;
+static inline struct uid2grp_shard *uname_shard(
+					const struct gsh_buffdesc *name)
+{
+	return &uname_shards[CityHash64(name->addr, name->len) &
+			     (UID2GRP_SHARDS - 1)];
 }
 
 /**
@@ -180,21 +150,30 @@ static int uid_comparator(const struct avltree_node *node1,
 
 void uid2grp_cache_init(void)
 {
-	avltree_init(&uname_tree, uname_comparator, 0);
-	avltree_init(&uid_tree, uid_comparator, 0);
-	memset(uid_grplist_cache, 0,
-	       id_cache_size * sizeof(struct avltree_node *));
+	int i;
+
+	for (i = 0; i < UID2GRP_SHARDS; i++) {
+		PTHREAD_RWLOCK_init(&uid_shards[i].lock, NULL);
+		uid_shards[i].by_uid = true;
+		btree_init(&uid_shards[i].btree);
+		PTHREAD_RWLOCK_init(&uname_shards[i].lock, NULL);
+		avltree_init(&uname_shards[i].tree, uname_comparator, 0);
+	}
+
+	uid2grp_refresh_init();
 }
 
-/* Remove given user/cache_info from the AVL trees
+/* Remove given user/cache_info from the tree of its shard
  *
- * @note The caller must hold uid2grp_user_lock for write.
+ * @note The caller must hold the lock of the shard for write.
  */
-static void uid2grp_remove_user(struct cache_info *info)
+static void uid2grp_remove_user(struct uid2grp_shard *shard,
+				struct cache_info *info)
 {
-	uid_grplist_cache[info->uid % id_cache_size] = NULL;
-	avltree_remove(&info->uid_node, &uid_tree);
-	avltree_remove(&info->uname_node, &uname_tree);
+	if (shard->by_uid)
+		btree_remove(&info->bnode, &shard->btree);
+	else
+		avltree_remove(&info->node, &shard->tree);
 	/* We decrement hold on group data when it is
 	 * removed from cache trees.
 	 */
@@ -203,23 +182,37 @@ static void uid2grp_remove_user(struct cache_info *info)
 }
 
 /**
- * @brief Add a user entry to the cache
- *
- * @note The caller must hold uid2grp_user_lock for write.
- *
- * @param[in] group_data that has supplementary groups allocated
+ * @brief Insert in the tree of a shard
  *
- * @retval true on success.
- * @retval false if our reach exceeds our grasp.
+ * @return The entry of the same key already there, if any.
  */
-void uid2grp_add_user(struct group_data *gdata)
+static struct cache_info *shard_insert(struct uid2grp_shard *shard,
+				       struct cache_info *info)
+{
+	struct avltree_node *found;
+	struct btree_node *bfound;
+
+	if (shard->by_uid) {
+		info->bnode.key = info->uid;
+		bfound = btree_insert(&info->bnode, &shard->btree);
+		return bfound ? btree_container_of(bfound, struct cache_info,
+						   bnode)
+			      : NULL;
+	}
+
+	found = avltree_insert(&info->node, &shard->tree);
+	return found ? avltree_container_of(found, struct cache_info, node)
+		     : NULL;
+}
+
+/**
+ * @brief Insert in one index, replacing the entry of the same key
+ */
+static void uid2grp_insert(struct uid2grp_shard *shard,
+			   struct group_data *gdata)
 {
-	struct avltree_node *name_node;
-	struct avltree_node *id_node;
-	struct avltree_node *name_node2 = NULL;
-	struct avltree_node *id_node2 = NULL;
 	struct cache_info *info;
-	struct cache_info *tmp;
+	struct cache_info *found;
 
 	info = gsh_malloc(sizeof(struct cache_info));
 
@@ -228,123 +221,45 @@ void uid2grp_add_user(struct group_data *gdata)
 	info->uname.len = gdata->uname.len;
 	info->gdata = gdata;
 
-	/* The refcount on group_data should be 1 when we put it in
-	 * AVL trees.
-	 */
+	/* Each index holds a reference */
 	uid2grp_hold_group_data(gdata);
 
-	/* We may have lost the race to insert. We remove existing
-	 * entry and insert this new entry if so!
-	 */
-	name_node = avltree_insert(&info->uname_node, &uname_tree);
-	if (unlikely(name_node)) {
-		tmp = avltree_container_of(name_node,
-					   struct cache_info,
-					   uname_node);
-		uid2grp_remove_user(tmp);
-		name_node2 = avltree_insert(&info->uname_node, &uname_tree);
-	}
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
 
-	id_node = avltree_insert(&info->uid_node, &uid_tree);
-	if (unlikely(id_node)) {
-		/* We should not come here unless someone changed uid of
-		 * a user. Remove old entry and re-insert the new
-		 * entry.
-		 */
-		tmp = avltree_container_of(id_node,
-					   struct cache_info,
-					   uid_node);
-		uid2grp_remove_user(tmp);
-		id_node2 = avltree_insert(&info->uid_node, &uid_tree);
+	/* We may have lost the race to insert, or the group list is
+	 * being refreshed.  We remove existing entry and insert this
+	 * new entry if so!
+	 */
+	found = shard_insert(shard, info);
+	if (unlikely(found)) {
+		uid2grp_remove_user(shard, found);
+		found = shard_insert(shard, info);
+		if (found)
+			LogWarn(COMPONENT_IDMAPPER,
+				"shouldn't happen, internal error");
 	}
-	uid_grplist_cache[info->uid % id_cache_size] = &info->uid_node;
 
-	if (name_node && id_node)
-		LogWarn(COMPONENT_IDMAPPER, "shouldn't happen, internal error");
-	if ((name_node && name_node2) || (id_node && id_node2))
-		LogWarn(COMPONENT_IDMAPPER, "shouldn't happen, internal error");
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 }
 
-
-static bool lookup_by_uname(const struct gsh_buffdesc *name,
-			    struct cache_info **info)
-{
-	struct cache_info prototype = {
-		.uname = *name
-	};
-	struct avltree_node *found_node = avltree_lookup(&prototype.uname_node,
-							 &uname_tree);
-	struct cache_info *found_info;
-	void **cache_slot;
-
-	if (unlikely(!found_node))
-		return false;
-
-	found_info = avltree_container_of(found_node,
-					  struct cache_info,
-					  uname_node);
-
-	/* I assume that if someone likes this user enough to look it
-	   up by name, they'll like it enough to look it up by ID
-	   later. */
-
-	cache_slot = (void **)
-		&uid_grplist_cache[found_info->uid % id_cache_size];
-	atomic_store_voidptr(cache_slot, &found_info->uid_node);
-
-	*info = found_info;
-
-	return true;
-}
-
-static bool lookup_by_uid(const uid_t uid, struct cache_info **info)
+/**
+ * @brief Add a user entry to the cache
+ *
+ * @param[in] group_data that has supplementary groups allocated
+ */
+void uid2grp_add_user(struct group_data *gdata)
 {
-	struct cache_info prototype = {
-		.uid = uid
-	};
-	void **cache_slot = (void **)
-	    &uid_grplist_cache[prototype.uid % id_cache_size];
-	struct avltree_node *found_node = atomic_fetch_voidptr(cache_slot);
-	struct cache_info *found_info;
-	bool found = false;
-
-	/* Verify that the node found in the cache array is in fact what we
-	 * want.
-	 */
-	if (likely(found_node)) {
-		found_info =
-		    avltree_container_of(found_node, struct cache_info,
-					 uid_node);
-		if (found_info->uid == uid)
-			found = true;
-	}
-
-	if (unlikely(!found)) {
-		found_node = avltree_lookup(&prototype.uid_node, &uid_tree);
-		if (unlikely(!found_node))
-			return false;
-
-		atomic_store_voidptr(cache_slot, found_node);
-		found_info =
-		    avltree_container_of(found_node, struct cache_info,
-					 uid_node);
-	}
-
-	*info = found_info;
-
-	return true;
+	uid2grp_insert(uid_shard(gdata->uid), gdata);
+	uid2grp_insert(uname_shard(&gdata->uname), gdata);
 }
 
 /**
  * @brief Look up a user by name
  *
- * @note The caller must hold uid2grp_user_lock for read.
- *
  * @param[in]  name The user name to look up.
- * @param[out] uid  The user ID found.  May be NULL if the caller
- *                  isn't interested in the UID.  (This seems
- *                  unlikely.)
- * @gdata[out] group_data containing supplementary groups.
+ * @param[out] uid  The user ID found.
+ * @gdata[out] group_data containing supplementary groups, with a
+ *             reference the caller must release.
  *
  * @retval true on success.
  * @retval false if we need to try, try again.
@@ -353,26 +268,35 @@ static bool lookup_by_uid(const uid_t uid, struct cache_info **info)
 bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 			     struct group_data **gdata)
 {
+	struct uid2grp_shard *shard = uname_shard(name);
+	struct cache_info prototype = {
+		.uname = *name
+	};
+	struct avltree_node *found_node;
 	struct cache_info *info;
-	bool success;
 
-	success = lookup_by_uname(name, &info);
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
 
-	if (success) {
+	found_node = avltree_lookup(&prototype.node, &shard->tree);
+	if (likely(found_node)) {
+		info = avltree_container_of(found_node, struct cache_info,
+					    node);
 		*gdata = info->gdata;
 		*uid = info->gdata->uid;
+		uid2grp_hold_group_data(*gdata);
 	}
 
-	return success;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
+
+	return found_node != NULL;
 }
 
 /**
  * @brief Look up a user by ID
  *
- * @note The caller must hold uid2grp_user_lock for read.
- *
  * @param[in]  uid  The user ID to look up.
- * @gdata[out] group_data containing supplementary groups.
+ * @gdata[out] group_data containing supplementary groups, with a
+ *             reference the caller must release.
  *
  * @retval true on success.
  * @retval false if we weren't so successful.
@@ -380,34 +304,48 @@ bool uid2grp_lookup_by_uname(const struct gsh_buffdesc *name, uid_t *uid,
 
 bool uid2grp_lookup_by_uid(const uid_t uid, struct group_data **gdata)
 {
+	struct uid2grp_shard *shard = uid_shard(uid);
+	struct btree_node *found_node;
 	struct cache_info *info;
-	bool success;
 
-	success = lookup_by_uid(uid, &info);
-	if (success)
+	PTHREAD_RWLOCK_rdlock(&shard->lock);
+
+	found_node = btree_lookup(uid, &shard->btree);
+	if (likely(found_node)) {
+		info = btree_container_of(found_node, struct cache_info,
+					  bnode);
 		*gdata = info->gdata;
+		uid2grp_hold_group_data(*gdata);
+	}
 
-	return success;
+	PTHREAD_RWLOCK_unlock(&shard->lock);
+
+	return found_node != NULL;
 }
 
-void uid2grp_remove_by_uid(const uid_t uid)
+static void uid2grp_clear_shard(struct uid2grp_shard *shard)
 {
+	struct avltree_node *node;
+	struct btree_node *bnode;
 	struct cache_info *info;
-	bool success;
 
-	success = lookup_by_uid(uid, &info);
-	if (success)
-		uid2grp_remove_user(info);
-}
+	PTHREAD_RWLOCK_wrlock(&shard->lock);
 
-void uid2grp_remove_by_uname(const struct gsh_buffdesc *name)
-{
-	struct cache_info *info;
-	bool success;
+	if (shard->by_uid) {
+		while ((bnode = btree_first(&shard->btree))) {
+			info = btree_container_of(bnode, struct cache_info,
+						  bnode);
+			uid2grp_remove_user(shard, info);
+		}
+	} else {
+		while ((node = avltree_first(&shard->tree))) {
+			info = avltree_container_of(node, struct cache_info,
+						    node);
+			uid2grp_remove_user(shard, info);
+		}
+	}
 
-	success = lookup_by_uname(name, &info);
-	if (success)
-		uid2grp_remove_user(info);
+	PTHREAD_RWLOCK_unlock(&shard->lock);
 }
 
 /**
@@ -416,21 +354,12 @@ void uid2grp_remove_by_uname(const struct gsh_buffdesc *name)
 
 void uid2grp_clear_cache(void)
 {
-	struct avltree_node *node;
+	int i;
 
-	PTHREAD_RWLOCK_wrlock(&uid2grp_user_lock);
-
-	while ((node = avltree_first(&uname_tree))) {
-		struct cache_info *info = avltree_container_of(node,
-							       struct
-							       cache_info,
-							       uname_node);
-		uid2grp_remove_user(info);
+	for (i = 0; i < UID2GRP_SHARDS; i++) {
+		uid2grp_clear_shard(&uid_shards[i]);
+		uid2grp_clear_shard(&uname_shards[i]);
 	}
-
-	assert(avltree_first(&uid_tree) == NULL);
-
-	PTHREAD_RWLOCK_unlock(&uid2grp_user_lock);
 }
 
 /** @} */
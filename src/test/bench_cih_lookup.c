@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ * Microbenchmark of handle lookups in the MDCACHE handle table: the
+ * rwlocked, AVL-backed partitions cih_fhcache used to be built from
+ * against the lockless hash chains and reader sequences that replaced
+ * them.  Each lookup takes and drops a reference, as PUTFH does.  One
+ * writer thread keeps unhashing and rehashing entries meanwhile.
+ *
+ * usage: bench_cih_lookup [readers [entries [lookups per reader]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "avltree.h"
+
+#define NPART 7
+#define CACHE_SZ 32633
+
+struct entry {
+	struct avltree_node node_k;
+	struct entry *next;
+	uint64_t hk;
+	int32_t refcnt;
+	bool hashed;
+};
+
+/* the old partition: AVL tree plus a direct-mapped front cache, readers
+ * take the rwlock shared */
+struct avl_part {
+	pthread_rwlock_t lock;
+	struct avltree t;
+	struct avltree_node **cache;
+	GSH_CACHE_PAD(0);
+};
+
+/* the new partition: chains changed under the lock, read without it */
+struct chain_part {
+	pthread_mutex_t lock;
+	struct entry **buckets;
+	GSH_CACHE_PAD(0);
+};
+
+struct reader {
+	uint64_t seq;
+	GSH_CACHE_PAD(0);
+};
+
+struct bench {
+	bool chain;
+	struct avl_part avl[NPART];
+	struct chain_part ch[NPART];
+	struct reader *readers;
+	int nreaders;
+	struct entry *entries;
+	uint64_t nentries;
+	uint64_t lookups;	/* per reader */
+	uint32_t done;		/* readers have finished */
+	uint64_t hits;
+	uint64_t churn;		/* writer remove/insert cycles */
+	int32_t next_reader;
+};
+
+static int avl_cmpf(const struct avltree_node *lhs,
+		    const struct avltree_node *rhs)
+{
+	const struct entry *l = avltree_container_of(lhs, struct entry, node_k);
+	const struct entry *r = avltree_container_of(rhs, struct entry, node_k);
+
+	return l->hk < r->hk ? -1 : l->hk > r->hk ? 1 : 0;
+}
+
+static inline uint64_t mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static struct entry **bucket_of(struct chain_part *cp, uint64_t hk)
+{
+	return &cp->buckets[(hk / NPART) % CACHE_SZ];
+}
+
+static bool avl_lookup(struct bench *b, uint64_t hk)
+{
+	struct avl_part *cp = &b->avl[hk % NPART];
+	struct avltree_node **slot = &cp->cache[hk % CACHE_SZ];
+	struct avltree_node *node;
+	struct entry key, *e = NULL;
+
+	key.hk = hk;
+	pthread_rwlock_rdlock(&cp->lock);
+	node = atomic_fetch_voidptr((void **)slot);
+	if (node == NULL || avl_cmpf(node, &key.node_k) != 0) {
+		node = avltree_lookup(&key.node_k, &cp->t);
+		if (node)
+			atomic_store_voidptr((void **)slot, node);
+	}
+	if (node) {
+		e = avltree_container_of(node, struct entry, node_k);
+		(void) atomic_inc_int32_t(&e->refcnt);
+	}
+	pthread_rwlock_unlock(&cp->lock);
+
+	if (e)
+		(void) atomic_dec_int32_t(&e->refcnt);
+	return e != NULL;
+}
+
+static bool chain_lookup(struct bench *b, struct reader *r, uint64_t hk)
+{
+	struct chain_part *cp = &b->ch[hk % NPART];
+	struct entry *e;
+	int32_t refcnt;
+
+	(void) atomic_inc_uint64_t(&r->seq);
+	for (e = atomic_fetch_voidptr((void **)bucket_of(cp, hk)); e != NULL;
+	     e = atomic_fetch_voidptr((void **)&e->next))
+		if (e->hk == hk)
+			break;
+	if (e) {
+		refcnt = atomic_fetch_int32_t(&e->refcnt);
+		while (refcnt > 0 &&
+		       !atomic_cmpxchg_int32_t(&e->refcnt, refcnt, refcnt + 1))
+			refcnt = atomic_fetch_int32_t(&e->refcnt);
+		if (refcnt <= 0)
+			e = NULL;
+	}
+	(void) atomic_inc_uint64_t(&r->seq);
+
+	if (e)
+		(void) atomic_dec_int32_t(&e->refcnt);
+	return e != NULL;
+}
+
+static void synchronize(struct bench *b)
+{
+	uint64_t seq;
+	int i;
+
+	for (i = 0; i < b->nreaders; ++i) {
+		seq = atomic_fetch_uint64_t(&b->readers[i].seq);
+		if ((seq & 1) == 0)
+			continue;
+		while (atomic_fetch_uint64_t(&b->readers[i].seq) == seq)
+			sched_yield();
+	}
+}
+
+static void insert(struct bench *b, struct entry *e)
+{
+	if (!b->chain) {
+		struct avl_part *cp = &b->avl[e->hk % NPART];
+
+		pthread_rwlock_wrlock(&cp->lock);
+		avltree_insert(&e->node_k, &cp->t);
+		pthread_rwlock_unlock(&cp->lock);
+	} else {
+		struct chain_part *cp = &b->ch[e->hk % NPART];
+		struct entry **bucket = bucket_of(cp, e->hk);
+
+		pthread_mutex_lock(&cp->lock);
+		e->next = *bucket;
+		atomic_store_voidptr((void **)bucket, e);
+		pthread_mutex_unlock(&cp->lock);
+	}
+	e->hashed = true;
+}
+
+static void remove_entry(struct bench *b, struct entry *e)
+{
+	if (!b->chain) {
+		struct avl_part *cp = &b->avl[e->hk % NPART];
+
+		pthread_rwlock_wrlock(&cp->lock);
+		avltree_remove(&e->node_k, &cp->t);
+		cp->cache[e->hk % CACHE_SZ] = NULL;
+		pthread_rwlock_unlock(&cp->lock);
+	} else {
+		struct chain_part *cp = &b->ch[e->hk % NPART];
+		struct entry **link = bucket_of(cp, e->hk);
+
+		pthread_mutex_lock(&cp->lock);
+		while (*link != e)
+			link = &(*link)->next;
+		atomic_store_voidptr((void **)link, e->next);
+		pthread_mutex_unlock(&cp->lock);
+		/* as the LRU reaper does before recycling */
+		synchronize(b);
+	}
+	e->hashed = false;
+}
+
+static void *reader(void *arg)
+{
+	struct bench *b = arg;
+	int32_t me = atomic_postinc_int32_t(&b->next_reader);
+	struct reader *r = &b->readers[me];
+	uint64_t x = mix(me + 1);
+	uint64_t hits = 0, ix;
+
+	for (ix = 0; ix < b->lookups; ++ix) {
+		uint64_t hk = b->entries[(x = mix(x)) % b->nentries].hk;
+
+		if (b->chain ? chain_lookup(b, r, hk) : avl_lookup(b, hk))
+			++hits;
+	}
+	(void) atomic_add_uint64_t(&b->hits, hits);
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	struct bench *b = arg;
+	uint64_t x = mix(0), churn = 0;
+
+	while (!atomic_fetch_uint32_t(&b->done)) {
+		struct entry *e = &b->entries[(x = mix(x)) % b->nentries];
+
+		remove_entry(b, e);
+		insert(b, e);
+		++churn;
+	}
+	b->churn = churn;
+	return NULL;
+}
+
+static double run(bool chain, int nreaders, uint64_t nentries,
+		  uint64_t lookups)
+{
+	struct bench *b = calloc(1, sizeof(*b));
+	pthread_t *thr = calloc(nreaders + 1, sizeof(pthread_t));
+	struct timespec t0, t1;
+	uint64_t ix;
+	int i;
+
+	if (!b || !thr) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	b->chain = chain;
+	b->nreaders = nreaders;
+	b->nentries = nentries;
+	b->lookups = lookups;
+	b->readers = calloc(nreaders, sizeof(struct reader));
+	b->entries = calloc(nentries, sizeof(struct entry));
+	if (!b->readers || !b->entries) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < NPART; ++i) {
+		pthread_rwlock_init(&b->avl[i].lock, NULL);
+		avltree_init(&b->avl[i].t, avl_cmpf, 0);
+		b->avl[i].cache = calloc(CACHE_SZ, sizeof(void *));
+		pthread_mutex_init(&b->ch[i].lock, NULL);
+		b->ch[i].buckets = calloc(CACHE_SZ, sizeof(void *));
+		if (!b->avl[i].cache || !b->ch[i].buckets) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	for (ix = 0; ix < nentries; ++ix) {
+		b->entries[ix].hk = mix(ix + 1);
+		b->entries[ix].refcnt = 1;	/* the sentinel */
+		insert(b, &b->entries[ix]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nreaders; ++i)
+		pthread_create(&thr[i], NULL, reader, b);
+	pthread_create(&thr[nreaders], NULL, writer, b);
+	for (i = 0; i < nreaders; ++i)
+		pthread_join(thr[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	atomic_store_uint32_t(&b->done, 1);
+	pthread_join(thr[nreaders], NULL);
+
+	printf("%s: %" PRIu64 " of %" PRIu64 " lookups hit, %" PRIu64
+	       " writer cycles\n", chain ? "lockless" : "avl",
+	       b->hits, lookups * nreaders, b->churn);
+
+	for (i = 0; i < NPART; ++i) {
+		pthread_rwlock_destroy(&b->avl[i].lock);
+		free(b->avl[i].cache);
+		pthread_mutex_destroy(&b->ch[i].lock);
+		free(b->ch[i].buckets);
+	}
+	free(b->entries);
+	free(b->readers);
+	free(thr);
+	free(b);
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int nreaders = argc > 1 ? atoi(argv[1]) : 16;
+	uint64_t nentries = argc > 2 ? strtoull(argv[2], NULL, 10) : 100000;
+	uint64_t lookups = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000;
+	double avl, chain;
+
+	if (nreaders < 1 || nentries < 1 || lookups < 1) {
+		fprintf(stderr,
+			"usage: %s [readers [entries [lookups per reader]]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	avl = run(false, nreaders, nentries, lookups);
+	chain = run(true, nreaders, nentries, lookups);
+
+	printf("%d readers, %" PRIu64 " entries, %" PRIu64 " lookups\n",
+	       nreaders, nentries, lookups * nreaders);
+	printf("rwlocked AVL:   %8.3f s %12.0f lookups/s\n", avl,
+	       lookups * nreaders / avl);
+	printf("lockless chain: %8.3f s %12.0f lookups/s\n", chain,
+	       lookups * nreaders / chain);
+
+	return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ * Microbenchmark of a reconnect storm after a failover: every client
+ * known to the recovery directory comes back at once, is looked up in
+ * the reclaim list under the grace mutex, then has its client id
+ * inserted unconfirmed, confirmed and renewed a few times.
+ *
+ * The old layout walks the whole reclaim list for each lookup and keeps
+ * client ids in 17 rwlocked partitions; the new one hashes the reclaim
+ * list and uses 127 partitions.
+ *
+ * usage: bench_clid_reclaim [threads [clients [renewals]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include "gsh_intrinsic.h"
+#include "city.h"
+
+#define CLID_HASH_SIZE 4093
+#define NAME_LEN 64
+
+struct clid {
+	struct clid *next;	/* reclaim list */
+	struct clid *hnext;	/* reclaim hash chain */
+	struct clid *pnext;	/* client id partition chain */
+	uint64_t clientid;
+	bool confirmed;
+	bool reclaim;
+	char name[NAME_LEN];
+};
+
+struct part {
+	pthread_rwlock_t lock;
+	struct clid *unconfirmed;
+	struct clid *confirmed;
+	GSH_CACHE_PAD(0);
+};
+
+struct bench {
+	bool hashed;
+	int nparts;
+	int threads;
+	uint64_t clients;
+	int renewals;
+	pthread_mutex_t grace_mutex;
+	struct clid *clids;
+	struct clid *list;
+	struct clid *hash[CLID_HASH_SIZE];
+	struct part *parts;
+};
+
+struct worker {
+	struct bench *b;
+	uint64_t first, last;
+	uint64_t found;
+};
+
+static struct clid *reclaim_find(struct bench *b, const char *name)
+{
+	struct clid *c;
+
+	if (b->hashed) {
+		c = b->hash[CityHash64(name, strlen(name)) % CLID_HASH_SIZE];
+		for (; c != NULL; c = c->hnext)
+			if (!strcmp(c->name, name))
+				return c;
+		return NULL;
+	}
+
+	for (c = b->list; c != NULL; c = c->next)
+		if (!strcmp(c->name, name))
+			return c;
+
+	return NULL;
+}
+
+static struct clid **chain_find(struct clid **head, uint64_t clientid)
+{
+	for (; *head != NULL; head = &(*head)->pnext)
+		if ((*head)->clientid == clientid)
+			return head;
+
+	return NULL;
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	struct bench *b = w->b;
+	struct clid *c, *found, **pp;
+	struct part *p;
+	uint64_t i;
+	int r;
+
+	for (i = w->first; i < w->last; i++) {
+		c = &b->clids[i];
+		p = &b->parts[c->clientid % b->nparts];
+
+		/* EXCHANGE_ID: new unconfirmed client id */
+		pthread_rwlock_wrlock(&p->lock);
+		c->pnext = p->unconfirmed;
+		p->unconfirmed = c;
+		pthread_rwlock_unlock(&p->lock);
+
+		/* CREATE_SESSION: confirm, then check for reclaim */
+		pthread_rwlock_wrlock(&p->lock);
+		pp = chain_find(&p->unconfirmed, c->clientid);
+		if (pp != NULL) {
+			*pp = c->pnext;
+			c->pnext = p->confirmed;
+			p->confirmed = c;
+			c->confirmed = true;
+		}
+		pthread_rwlock_unlock(&p->lock);
+
+		pthread_mutex_lock(&b->grace_mutex);
+		found = reclaim_find(b, c->name);
+		if (found != NULL) {
+			found->reclaim = true;
+			w->found++;
+		}
+		pthread_mutex_unlock(&b->grace_mutex);
+
+		/* RENEW / SEQUENCE */
+		for (r = 0; r < b->renewals; r++) {
+			pthread_rwlock_rdlock(&p->lock);
+			(void) chain_find(&p->confirmed, c->clientid);
+			pthread_rwlock_unlock(&p->lock);
+		}
+	}
+
+	return NULL;
+}
+
+static double run(struct bench *b, bool hashed, int nparts)
+{
+	struct timespec t0, t1;
+	pthread_t *tids;
+	struct worker *ws;
+	uint64_t i, found = 0, share;
+	struct clid *c;
+	size_t h;
+	int t;
+
+	b->hashed = hashed;
+	b->nparts = nparts;
+	b->list = NULL;
+	memset(b->hash, 0, sizeof(b->hash));
+
+	b->parts = calloc(nparts, sizeof(*b->parts));
+	tids = calloc(b->threads, sizeof(*tids));
+	ws = calloc(b->threads, sizeof(*ws));
+	if (b->parts == NULL || tids == NULL || ws == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (t = 0; t < nparts; t++)
+		pthread_rwlock_init(&b->parts[t].lock, NULL);
+
+	/* The recovery directory, as loaded at grace start */
+	for (i = 0; i < b->clients; i++) {
+		c = &b->clids[i];
+		c->confirmed = false;
+		c->reclaim = false;
+		c->next = b->list;
+		b->list = c;
+		h = CityHash64(c->name, strlen(c->name)) % CLID_HASH_SIZE;
+		c->hnext = b->hash[h];
+		b->hash[h] = c;
+	}
+
+	share = b->clients / b->threads;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (t = 0; t < b->threads; t++) {
+		ws[t].b = b;
+		ws[t].first = t * share;
+		ws[t].last = t == b->threads - 1 ? b->clients : (t + 1) * share;
+		pthread_create(&tids[t], NULL, worker, &ws[t]);
+	}
+
+	for (t = 0; t < b->threads; t++) {
+		pthread_join(tids[t], NULL);
+		found += ws[t].found;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (found != b->clients)
+		fprintf(stderr, "only %" PRIu64 " of %" PRIu64 " reclaimed\n",
+			found, b->clients);
+
+	for (t = 0; t < nparts; t++)
+		pthread_rwlock_destroy(&b->parts[t].lock);
+
+	free(b->parts);
+	free(tids);
+	free(ws);
+
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench b;
+	double old, new;
+	uint64_t i;
+
+	memset(&b, 0, sizeof(b));
+	b.threads = argc > 1 ? atoi(argv[1]) : 16;
+	b.clients = argc > 2 ? strtoull(argv[2], NULL, 0) : 20000;
+	b.renewals = argc > 3 ? atoi(argv[3]) : 8;
+
+	if (b.threads < 1 || b.clients < (uint64_t) b.threads ||
+	    b.renewals < 0) {
+		fprintf(stderr,
+			"usage: bench_clid_reclaim [threads [clients [renewals]]]\n");
+		return 1;
+	}
+
+	b.clids = calloc(b.clients, sizeof(*b.clids));
+	if (b.clids == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	for (i = 0; i < b.clients; i++) {
+		b.clids[i].clientid = (0x5a000000ULL << 32) + i + 1;
+		snprintf(b.clids[i].name, NAME_LEN,
+			 "::ffff:10.%d.%d.%d-(21:Linux NFSv4.1 c%" PRIu64 ")",
+			 (int) (i >> 16) & 0xff, (int) (i >> 8) & 0xff,
+			 (int) i & 0xff, i);
+	}
+
+	pthread_mutex_init(&b.grace_mutex, NULL);
+
+	printf("%d threads, %" PRIu64 " clients, %d renewals each\n",
+	       b.threads, b.clients, b.renewals);
+
+	old = run(&b, false, 17);
+	printf("list, 17 partitions:  %8.3f s %10.0f clients/s\n", old,
+	       b.clients / old);
+
+	new = run(&b, true, 127);
+	printf("hash, 127 partitions: %8.3f s %10.0f clients/s\n", new,
+	       b.clients / new);
+
+	pthread_mutex_destroy(&b.grace_mutex);
+	free(b.clids);
+
+	return 0;
+}
@@ -0,0 +1,632 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ * Microbenchmark of fattr4 encoding for the bitmaps Linux clients send
+ * with GETATTR and READDIR.
+ *
+ * The generic loop walks the requested bitmap, calls one encoder per
+ * attribute through a table and sets each encoded attribute in the
+ * reply bitmap.  The plan path looks the bitmap up in a small cache of
+ * encode plans, copies the reply bitmap from it and writes runs of fixed
+ * size attributes straight into the buffer after one bounds check.
+ *
+ * Encoders are calls through an operations vector, as with the XDR
+ * memory stream, and both paths are checked to produce the same bytes.
+ *
+ * usage: bench_fattr4_plan [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define MAPLEN 3
+#define MAX_ATTRS (MAPLEN * 32)
+#define PLAN_CACHE_SIZE 8
+
+/* Attribute numbers from RFC 7530 */
+#define A_TYPE 1
+#define A_CHANGE 3
+#define A_SIZE 4
+#define A_FSID 8
+#define A_RDATTR_ERROR 11
+#define A_FILEHANDLE 19
+#define A_FILEID 20
+#define A_MODE 33
+#define A_NUMLINKS 35
+#define A_OWNER 36
+#define A_OWNER_GROUP 37
+#define A_RAWDEV 41
+#define A_SPACE_USED 45
+#define A_TIME_ACCESS 47
+#define A_TIME_METADATA 52
+#define A_TIME_MODIFY 53
+#define A_MOUNTED_ON_FILEID 55
+
+struct bitmap {
+	unsigned int len;
+	uint32_t map[MAPLEN];
+};
+
+struct attrs {
+	uint32_t type, mode, numlinks, rawdev_major, rawdev_minor;
+	uint64_t change, size, fsid_major, fsid_minor, fileid, spaceused;
+	uint64_t mounted_on_fileid;
+	struct timespec atime, ctime, mtime;
+	const char *owner, *group;
+	uint32_t fh_len;
+	char fh[64];
+};
+
+struct mxdr;
+
+struct mxdr_ops {
+	bool (*putlong)(struct mxdr *, const int32_t *);
+	bool (*putbytes)(struct mxdr *, const char *, unsigned int);
+	int32_t *(*inline_)(struct mxdr *, unsigned int);
+};
+
+struct mxdr {
+	const struct mxdr_ops *ops;
+	char *base, *pos, *end;
+};
+
+static bool mx_putlong(struct mxdr *x, const int32_t *lp)
+{
+	if (x->end - x->pos < 4)
+		return false;
+	*(int32_t *) x->pos = htonl(*lp);
+	x->pos += 4;
+	return true;
+}
+
+static bool mx_putbytes(struct mxdr *x, const char *p, unsigned int len)
+{
+	if ((unsigned int) (x->end - x->pos) < len)
+		return false;
+	memcpy(x->pos, p, len);
+	x->pos += len;
+	return true;
+}
+
+static int32_t *mx_inline(struct mxdr *x, unsigned int len)
+{
+	int32_t *p = (int32_t *) x->pos;
+
+	if ((unsigned int) (x->end - x->pos) < len)
+		return NULL;
+	x->pos += len;
+	return p;
+}
+
+static const struct mxdr_ops mx_ops = {mx_putlong, mx_putbytes, mx_inline};
+
+static bool x_u32(struct mxdr *x, uint32_t v)
+{
+	int32_t l = v;
+
+	return x->ops->putlong(x, &l);
+}
+
+static bool x_u64(struct mxdr *x, uint64_t v)
+{
+	return x_u32(x, v >> 32) && x_u32(x, (uint32_t) v);
+}
+
+static bool x_opaque(struct mxdr *x, const char *p, uint32_t len)
+{
+	static const char zero[4];
+	uint32_t pad = (4 - (len & 3)) & 3;
+
+	return x_u32(x, len) && x->ops->putbytes(x, p, len) &&
+	       (pad == 0 || x->ops->putbytes(x, zero, pad));
+}
+
+static bool x_time(struct mxdr *x, const struct timespec *ts)
+{
+	return x_u64(x, ts->tv_sec) && x_u32(x, ts->tv_nsec);
+}
+
+/* The generic encoders */
+
+typedef bool (*encode_t)(struct mxdr *, const struct attrs *);
+
+static bool e_type(struct mxdr *x, const struct attrs *a)
+{
+	return x_u32(x, a->type);
+}
+
+static bool e_change(struct mxdr *x, const struct attrs *a)
+{
+	return x_u64(x, a->change);
+}
+
+static bool e_size(struct mxdr *x, const struct attrs *a)
+{
+	return x_u64(x, a->size);
+}
+
+static bool e_fsid(struct mxdr *x, const struct attrs *a)
+{
+	return x_u64(x, a->fsid_major) && x_u64(x, a->fsid_minor);
+}
+
+static bool e_rdattr_error(struct mxdr *x, const struct attrs *a)
+{
+	return x_u32(x, 0);
+}
+
+static bool e_filehandle(struct mxdr *x, const struct attrs *a)
+{
+	return x_opaque(x, a->fh, a->fh_len);
+}
+
+static bool e_fileid(struct mxdr *x, const struct attrs *a)
+{
+	return x_u64(x, a->fileid);
+}
+
+static bool e_mode(struct mxdr *x, const struct attrs *a)
+{
+	return x_u32(x, a->mode);
+}
+
+static bool e_numlinks(struct mxdr *x, const struct attrs *a)
+{
+	return x_u32(x, a->numlinks);
+}
+
+static bool e_owner(struct mxdr *x, const struct attrs *a)
+{
+	return x_opaque(x, a->owner, strlen(a->owner));
+}
+
+static bool e_group(struct mxdr *x, const struct attrs *a)
+{
+	return x_opaque(x, a->group, strlen(a->group));
+}
+
+static bool e_rawdev(struct mxdr *x, const struct attrs *a)
+{
+	return x_u32(x, a->rawdev_major) && x_u32(x, a->rawdev_minor);
+}
+
+static bool e_spaceused(struct mxdr *x, const struct attrs *a)
+{
+	return x_u64(x, a->spaceused);
+}
+
+static bool e_atime(struct mxdr *x, const struct attrs *a)
+{
+	return x_time(x, &a->atime);
+}
+
+static bool e_ctime(struct mxdr *x, const struct attrs *a)
+{
+	return x_time(x, &a->ctime);
+}
+
+static bool e_mtime(struct mxdr *x, const struct attrs *a)
+{
+	return x_time(x, &a->mtime);
+}
+
+static bool e_mounted_on_fileid(struct mxdr *x, const struct attrs *a)
+{
+	return x_u64(x, a->mounted_on_fileid);
+}
+
+static const encode_t encoders[MAX_ATTRS] = {
+	[A_TYPE] = e_type,
+	[A_CHANGE] = e_change,
+	[A_SIZE] = e_size,
+	[A_FSID] = e_fsid,
+	[A_RDATTR_ERROR] = e_rdattr_error,
+	[A_FILEHANDLE] = e_filehandle,
+	[A_FILEID] = e_fileid,
+	[A_MODE] = e_mode,
+	[A_NUMLINKS] = e_numlinks,
+	[A_OWNER] = e_owner,
+	[A_OWNER_GROUP] = e_group,
+	[A_RAWDEV] = e_rawdev,
+	[A_SPACE_USED] = e_spaceused,
+	[A_TIME_ACCESS] = e_atime,
+	[A_TIME_METADATA] = e_ctime,
+	[A_TIME_MODIFY] = e_mtime,
+	[A_MOUNTED_ON_FILEID] = e_mounted_on_fileid,
+};
+
+/* The fixed size writers */
+
+typedef int32_t *(*put_t)(int32_t *, const struct attrs *);
+
+#define PUT32(p, v) (*(p)++ = htonl((uint32_t) (v)))
+
+static inline int32_t *p_u64(int32_t *p, uint64_t v)
+{
+	PUT32(p, v >> 32);
+	PUT32(p, v);
+	return p;
+}
+
+static inline int32_t *p_time(int32_t *p, const struct timespec *ts)
+{
+	p = p_u64(p, ts->tv_sec);
+	PUT32(p, ts->tv_nsec);
+	return p;
+}
+
+static int32_t *p_type(int32_t *p, const struct attrs *a)
+{
+	PUT32(p, a->type);
+	return p;
+}
+
+static int32_t *p_change(int32_t *p, const struct attrs *a)
+{
+	return p_u64(p, a->change);
+}
+
+static int32_t *p_size(int32_t *p, const struct attrs *a)
+{
+	return p_u64(p, a->size);
+}
+
+static int32_t *p_fsid(int32_t *p, const struct attrs *a)
+{
+	p = p_u64(p, a->fsid_major);
+	return p_u64(p, a->fsid_minor);
+}
+
+static int32_t *p_rdattr_error(int32_t *p, const struct attrs *a)
+{
+	PUT32(p, 0);
+	return p;
+}
+
+static int32_t *p_fileid(int32_t *p, const struct attrs *a)
+{
+	return p_u64(p, a->fileid);
+}
+
+static int32_t *p_mode(int32_t *p, const struct attrs *a)
+{
+	PUT32(p, a->mode);
+	return p;
+}
+
+static int32_t *p_numlinks(int32_t *p, const struct attrs *a)
+{
+	PUT32(p, a->numlinks);
+	return p;
+}
+
+static int32_t *p_rawdev(int32_t *p, const struct attrs *a)
+{
+	PUT32(p, a->rawdev_major);
+	PUT32(p, a->rawdev_minor);
+	return p;
+}
+
+static int32_t *p_spaceused(int32_t *p, const struct attrs *a)
+{
+	return p_u64(p, a->spaceused);
+}
+
+static int32_t *p_atime(int32_t *p, const struct attrs *a)
+{
+	return p_time(p, &a->atime);
+}
+
+static int32_t *p_ctime(int32_t *p, const struct attrs *a)
+{
+	return p_time(p, &a->ctime);
+}
+
+static int32_t *p_mtime(int32_t *p, const struct attrs *a)
+{
+	return p_time(p, &a->mtime);
+}
+
+static int32_t *p_mounted_on_fileid(int32_t *p, const struct attrs *a)
+{
+	return p_u64(p, a->mounted_on_fileid);
+}
+
+static const struct {
+	put_t put;
+	unsigned int bytes;
+} fixed[MAX_ATTRS] = {
+	[A_TYPE] = {p_type, 4},
+	[A_CHANGE] = {p_change, 8},
+	[A_SIZE] = {p_size, 8},
+	[A_FSID] = {p_fsid, 16},
+	[A_RDATTR_ERROR] = {p_rdattr_error, 4},
+	[A_FILEID] = {p_fileid, 8},
+	[A_MODE] = {p_mode, 4},
+	[A_NUMLINKS] = {p_numlinks, 4},
+	[A_RAWDEV] = {p_rawdev, 8},
+	[A_SPACE_USED] = {p_spaceused, 8},
+	[A_TIME_ACCESS] = {p_atime, 12},
+	[A_TIME_METADATA] = {p_ctime, 12},
+	[A_TIME_MODIFY] = {p_mtime, 12},
+	[A_MOUNTED_ON_FILEID] = {p_mounted_on_fileid, 8},
+};
+
+/* Bitmap helpers, as in nfs_proto_tools.h */
+
+static inline int next_attr(const struct bitmap *bits, int last_attr)
+{
+	int offset, bit;
+
+	for (offset = (last_attr + 1) / 32;
+	     offset >= 0 && offset < (int) bits->len; offset++) {
+		if ((bits->map[offset] & (-1 << ((last_attr + 1) % 32))) != 0) {
+			for (bit = (last_attr + 1) % 32; bit < 32; bit++) {
+				if (bits->map[offset] & (1 << bit))
+					return offset * 32 + bit;
+			}
+		}
+		last_attr = -1;
+	}
+	return -1;
+}
+
+static inline void set_attr(struct bitmap *bits, int attr)
+{
+	int offset = attr / 32;
+
+	if (offset >= (int) bits->len)
+		bits->len = offset + 1;
+	bits->map[offset] |= (1 << (attr % 32));
+}
+
+static size_t encode_generic(struct mxdr *x, const struct bitmap *req,
+			     const struct attrs *a, struct bitmap *res)
+{
+	int attr;
+
+	memset(res, 0, sizeof(*res));
+
+	for (attr = next_attr(req, -1); attr != -1; attr = next_attr(req, attr)) {
+		if (!encoders[attr](x, a))
+			return 0;
+		set_attr(res, attr);
+	}
+
+	return x->pos - x->base;
+}
+
+/* The plan path */
+
+struct step {
+	uint8_t first, count;
+	uint16_t bytes;
+};
+
+struct plan {
+	struct bitmap request, result;
+	uint8_t nattrs, nsteps;
+	uint8_t attrs[MAX_ATTRS];
+	struct step steps[MAX_ATTRS];
+};
+
+static struct plan plans[PLAN_CACHE_SIZE];
+
+static void plan_build(struct plan *plan, const struct bitmap *req)
+{
+	struct step *step = NULL;
+	unsigned int bytes;
+	int attr;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->request = *req;
+
+	for (attr = next_attr(req, -1); attr != -1; attr = next_attr(req, attr)) {
+		bytes = fixed[attr].bytes;
+		if (bytes != 0 && step != NULL && step->count != 0) {
+			step->count++;
+			step->bytes += bytes;
+		} else {
+			step = &plan->steps[plan->nsteps++];
+			step->first = plan->nattrs;
+			step->count = bytes != 0 ? 1 : 0;
+			step->bytes = bytes;
+		}
+		plan->attrs[plan->nattrs++] = attr;
+		set_attr(&plan->result, attr);
+	}
+}
+
+static const struct plan *plan_get(const struct bitmap *req)
+{
+	struct plan *plan;
+	uint32_t hash = 0;
+	unsigned int i;
+
+	for (i = 0; i < req->len; i++)
+		hash = hash * 0x9e3779b1 + req->map[i];
+
+	plan = &plans[(hash ^ (hash >> 16)) % PLAN_CACHE_SIZE];
+
+	if (plan->request.len != req->len ||
+	    memcmp(plan->request.map, req->map, req->len * sizeof(uint32_t)))
+		plan_build(plan, req);
+
+	return plan;
+}
+
+static size_t encode_plan(struct mxdr *x, const struct bitmap *req,
+			  const struct attrs *a, struct bitmap *res)
+{
+	const struct plan *plan = plan_get(req);
+	const struct step *step;
+	const uint8_t *attrs;
+	unsigned int n, s, count;
+	int32_t *p;
+
+	*res = plan->result;
+
+	for (s = 0; s < plan->nsteps; s++) {
+		step = &plan->steps[s];
+		attrs = &plan->attrs[step->first];
+		count = 1;
+		if (step->count != 0) {
+			p = x->ops->inline_(x, step->bytes);
+			if (p != NULL) {
+				for (n = 0; n < step->count; n++)
+					p = fixed[attrs[n]].put(p, a);
+				continue;
+			}
+			count = step->count;
+		}
+		for (n = 0; n < count; n++)
+			if (!encoders[attrs[n]](x, a))
+				return 0;
+	}
+
+	return x->pos - x->base;
+}
+
+static void bitmap_add(struct bitmap *bits, const int *attrs)
+{
+	memset(bits, 0, sizeof(*bits));
+	for (; *attrs != -1; attrs++)
+		set_attr(bits, *attrs);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef size_t (*encoder_t)(struct mxdr *, const struct bitmap *,
+			    const struct attrs *, struct bitmap *);
+
+static double run(encoder_t enc, const struct bitmap *req,
+		  struct attrs *a, long iterations)
+{
+	char buf[1024];
+	struct mxdr x = {&mx_ops, buf, buf, buf + sizeof(buf)};
+	struct bitmap res;
+	volatile size_t sink = 0;
+	double t0;
+	long i;
+
+	t0 = now();
+	for (i = 0; i < iterations; i++) {
+		a->fileid = i;
+		x.pos = buf;
+		sink += enc(&x, req, a, &res);
+	}
+	(void) sink;
+
+	return now() - t0;
+}
+
+static bool same_encoding(const struct bitmap *req, const struct attrs *a)
+{
+	char b1[1024], b2[1024];
+	struct mxdr x1 = {&mx_ops, b1, b1, b1 + sizeof(b1)};
+	struct mxdr x2 = {&mx_ops, b2, b2, b2 + sizeof(b2)};
+	struct bitmap r1, r2;
+	size_t l1, l2;
+
+	l1 = encode_generic(&x1, req, a, &r1);
+	l2 = encode_plan(&x2, req, a, &r2);
+
+	return l1 != 0 && l1 == l2 && memcmp(b1, b2, l1) == 0 &&
+	       r1.len == r2.len &&
+	       memcmp(r1.map, r2.map, r1.len * sizeof(uint32_t)) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int getattr[] = {
+		A_TYPE, A_CHANGE, A_SIZE, A_FSID, A_FILEID, A_MODE,
+		A_NUMLINKS, A_OWNER, A_OWNER_GROUP, A_RAWDEV, A_SPACE_USED,
+		A_TIME_ACCESS, A_TIME_METADATA, A_TIME_MODIFY,
+		A_MOUNTED_ON_FILEID, -1
+	};
+	static const int readdir[] = {
+		A_RDATTR_ERROR, A_FILEID, A_TYPE, A_CHANGE, A_SIZE, A_FSID,
+		A_FILEHANDLE, A_MODE, A_NUMLINKS, A_OWNER, A_OWNER_GROUP,
+		A_RAWDEV, A_SPACE_USED, A_TIME_ACCESS, A_TIME_METADATA,
+		A_TIME_MODIFY, A_MOUNTED_ON_FILEID, -1
+	};
+	static const struct {
+		const char *name;
+		const int *attrs;
+	} masks[] = {{"GETATTR", getattr}, {"READDIR", readdir}};
+	long iterations = argc > 1 ? atol(argv[1]) : 10000000;
+	struct attrs a;
+	struct bitmap req;
+	double generic, plan;
+	unsigned int m;
+
+	if (iterations < 1) {
+		fprintf(stderr, "usage: bench_fattr4_plan [iterations]\n");
+		return 1;
+	}
+
+	memset(&a, 0, sizeof(a));
+	a.type = 1;
+	a.mode = 0644;
+	a.numlinks = 1;
+	a.change = 0x123456789ULL;
+	a.size = 4096;
+	a.fsid_major = 0x42;
+	a.fsid_minor = 0x17;
+	a.spaceused = 8192;
+	a.mounted_on_fileid = 2;
+	a.atime.tv_sec = a.ctime.tv_sec = a.mtime.tv_sec = 1500000000;
+	a.owner = "1000";
+	a.group = "1000";
+	a.fh_len = 36;
+
+	printf("%ld iterations\n", iterations);
+
+	for (m = 0; m < sizeof(masks) / sizeof(masks[0]); m++) {
+		bitmap_add(&req, masks[m].attrs);
+
+		if (!same_encoding(&req, &a)) {
+			fprintf(stderr, "%s: encodings differ\n", masks[m].name);
+			return 1;
+		}
+
+		generic = run(encode_generic, &req, &a, iterations);
+		plan = run(encode_plan, &req, &a, iterations);
+
+		printf("%s generic: %8.3f s %6.1f ns/op\n", masks[m].name,
+		       generic, generic * 1e9 / iterations);
+		printf("%s plan:    %8.3f s %6.1f ns/op\n", masks[m].name,
+		       plan, plan * 1e9 / iterations);
+	}
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ * Microbenchmark of hashtable_getref on the partitions of hashtable.c:
+ * red-black trees behind a direct-mapped cache, with the partition
+ * rwlock taken shared for every lookup, against HT_FLAG_LOCKLESS
+ * lookups that read the cache inside a reader sequence and only fall
+ * back to the lock on a miss.  Each lookup takes and drops a
+ * reference, as the SAL lookups do.  One writer thread keeps deleting
+ * and reinserting entries meanwhile.
+ *
+ * usage: bench_ht_getref [readers [entries [lookups per reader]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "rbt_node.h"
+#include "rbt_tree.h"
+
+/* PRIME_STATE and the default cache_entry_count */
+#define NPART 17
+#define CACHE_SZ 32767
+
+struct entry {
+	struct rbt_node node;
+	uint64_t key;
+	int32_t refcnt;
+};
+
+struct part {
+	pthread_rwlock_t lock;
+	struct rbt_head rbt;
+	struct rbt_node **cache;
+	GSH_CACHE_PAD(0);
+};
+
+struct reader {
+	uint64_t seq;
+	GSH_CACHE_PAD(0);
+};
+
+struct bench {
+	bool lockless;
+	struct part part[NPART];
+	struct reader *readers;
+	int nreaders;
+	struct entry *entries;
+	uint64_t nentries;
+	uint64_t lookups;	/* per reader */
+	uint32_t done;		/* readers have finished */
+	uint64_t hits;
+	uint64_t churn;		/* writer delete/insert cycles */
+	int32_t next_reader;
+};
+
+static inline uint64_t mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static struct part *part_of(struct bench *b, uint64_t key)
+{
+	return &b->part[key % NPART];
+}
+
+static void **slot_of(struct part *p, uint64_t key)
+{
+	return (void **)&p->cache[key % CACHE_SZ];
+}
+
+/* key_locate() with the partition locked */
+static struct entry *locked_lookup(struct bench *b, uint64_t key)
+{
+	struct part *p = part_of(b, key);
+	struct rbt_node *cursor;
+	struct entry *e = NULL;
+
+	pthread_rwlock_rdlock(&p->lock);
+	cursor = atomic_fetch_voidptr(slot_of(p, key));
+	if (cursor != NULL && RBT_VALUE(cursor) == key) {
+		e = RBT_OPAQ(cursor);
+	} else {
+		RBT_FIND_LEFT(&p->rbt, cursor, key);
+		while (cursor != NULL && RBT_VALUE(cursor) == key) {
+			e = RBT_OPAQ(cursor);
+			if (e->key == key) {
+				atomic_store_voidptr(slot_of(p, key), cursor);
+				break;
+			}
+			e = NULL;
+			RBT_INCREMENT(cursor);
+		}
+	}
+	if (e)
+		(void) atomic_inc_int32_t(&e->refcnt);
+	pthread_rwlock_unlock(&p->lock);
+
+	return e;
+}
+
+static struct entry *lockless_lookup(struct bench *b, struct reader *r,
+				     uint64_t key)
+{
+	struct rbt_node *node;
+	struct entry *e = NULL;
+
+	(void) atomic_inc_uint64_t(&r->seq);
+	node = atomic_fetch_voidptr(slot_of(part_of(b, key), key));
+	if (node != NULL && RBT_VALUE(node) == key) {
+		e = RBT_OPAQ(node);
+		if (e->key == key)
+			(void) atomic_inc_int32_t(&e->refcnt);
+		else
+			e = NULL;
+	}
+	(void) atomic_inc_uint64_t(&r->seq);
+
+	return e != NULL ? e : locked_lookup(b, key);
+}
+
+static void synchronize(struct bench *b)
+{
+	uint64_t seq;
+	int i;
+
+	for (i = 0; i < b->nreaders; ++i) {
+		seq = atomic_fetch_uint64_t(&b->readers[i].seq);
+		if ((seq & 1) == 0)
+			continue;
+		while (atomic_fetch_uint64_t(&b->readers[i].seq) == seq)
+			sched_yield();
+	}
+}
+
+static void insert(struct bench *b, struct entry *e)
+{
+	struct part *p = part_of(b, e->key);
+	struct rbt_node *locator;
+
+	pthread_rwlock_wrlock(&p->lock);
+	RBT_FIND(&p->rbt, locator, e->key);
+	RBT_OPAQ(&e->node) = e;
+	RBT_VALUE(&e->node) = e->key;
+	RBT_INSERT(&p->rbt, &e->node, locator);
+	pthread_rwlock_unlock(&p->lock);
+}
+
+/* hashtable_deletelatched() */
+static void delete(struct bench *b, struct entry *e)
+{
+	struct part *p = part_of(b, e->key);
+	void **slot = slot_of(p, e->key);
+
+	pthread_rwlock_wrlock(&p->lock);
+	if (atomic_fetch_voidptr(slot) == &e->node)
+		atomic_store_voidptr(slot, NULL);
+	if (b->lockless)
+		synchronize(b);
+	RBT_UNLINK(&p->rbt, &e->node);
+	pthread_rwlock_unlock(&p->lock);
+}
+
+static void *reader(void *arg)
+{
+	struct bench *b = arg;
+	int32_t me = atomic_postinc_int32_t(&b->next_reader);
+	struct reader *r = &b->readers[me];
+	uint64_t x = mix(me + 1);
+	uint64_t hits = 0, ix;
+	struct entry *e;
+
+	for (ix = 0; ix < b->lookups; ++ix) {
+		uint64_t key = b->entries[(x = mix(x)) % b->nentries].key;
+
+		e = b->lockless ? lockless_lookup(b, r, key)
+				: locked_lookup(b, key);
+		if (e) {
+			(void) atomic_dec_int32_t(&e->refcnt);
+			++hits;
+		}
+	}
+	(void) atomic_add_uint64_t(&b->hits, hits);
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	struct bench *b = arg;
+	uint64_t x = mix(0), churn = 0;
+
+	while (!atomic_fetch_uint32_t(&b->done)) {
+		struct entry *e = &b->entries[(x = mix(x)) % b->nentries];
+
+		delete(b, e);
+		insert(b, e);
+		++churn;
+	}
+	b->churn = churn;
+	return NULL;
+}
+
+static double run(bool lockless, int nreaders, uint64_t nentries,
+		  uint64_t lookups)
+{
+	struct bench *b = calloc(1, sizeof(*b));
+	pthread_t *thr = calloc(nreaders + 1, sizeof(pthread_t));
+	struct timespec t0, t1;
+	uint64_t ix;
+	int i;
+
+	if (!b || !thr) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	b->lockless = lockless;
+	b->nreaders = nreaders;
+	b->nentries = nentries;
+	b->lookups = lookups;
+	b->readers = calloc(nreaders, sizeof(struct reader));
+	b->entries = calloc(nentries, sizeof(struct entry));
+	if (!b->readers || !b->entries) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < NPART; ++i) {
+		pthread_rwlock_init(&b->part[i].lock, NULL);
+		RBT_HEAD_INIT(&b->part[i].rbt);
+		b->part[i].cache = calloc(CACHE_SZ, sizeof(void *));
+		if (!b->part[i].cache) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	for (ix = 0; ix < nentries; ++ix) {
+		b->entries[ix].key = mix(ix + 1);
+		b->entries[ix].refcnt = 1;	/* the table's */
+		insert(b, &b->entries[ix]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nreaders; ++i)
+		pthread_create(&thr[i], NULL, reader, b);
+	pthread_create(&thr[nreaders], NULL, writer, b);
+	for (i = 0; i < nreaders; ++i)
+		pthread_join(thr[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	atomic_store_uint32_t(&b->done, 1);
+	pthread_join(thr[nreaders], NULL);
+
+	printf("%s: %" PRIu64 " of %" PRIu64 " lookups hit, %" PRIu64
+	       " writer cycles\n", lockless ? "lockless" : "rwlock",
+	       b->hits, lookups * nreaders, b->churn);
+
+	for (i = 0; i < NPART; ++i) {
+		pthread_rwlock_destroy(&b->part[i].lock);
+		free(b->part[i].cache);
+	}
+	free(b->entries);
+	free(b->readers);
+	free(thr);
+	free(b);
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int nreaders = argc > 1 ? atoi(argv[1]) : 16;
+	uint64_t nentries = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000;
+	uint64_t lookups = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000;
+	double locked, lockless;
+
+	if (nreaders < 1 || nentries < 1 || lookups < 1) {
+		fprintf(stderr,
+			"usage: %s [readers [entries [lookups per reader]]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	locked = run(false, nreaders, nentries, lookups);
+	lockless = run(true, nreaders, nentries, lookups);
+
+	printf("%d readers, %" PRIu64 " entries, %" PRIu64 " lookups\n",
+	       nreaders, nentries, lookups * nreaders);
+	printf("rwlocked:  %8.3f s %12.0f lookups/s\n", locked,
+	       lookups * nreaders / locked);
+	printf("lockless:  %8.3f s %12.0f lookups/s\n", lockless,
+	       lookups * nreaders / lockless);
+
+	return 0;
+}
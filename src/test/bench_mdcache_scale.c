@@ -0,0 +1,599 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ * Scaling of the MDCACHE paths every request goes through, at growing
+ * thread counts.  The entries, the cih_fhcache partitions with their
+ * lockless readers, the LRU lanes and the directory name trees are
+ * modelled after FSAL_MDCACHE, with the same locks taken in the same
+ * order:
+ *
+ * locate  mdcache_locate_keyed() hits: a lockless lookup taking a
+ *         reference, _mdcache_lru_ref() moving every third initial
+ *         ref to the MRU of its lane, _mdcache_lru_unref().
+ * insert  The cache holds half the keys, so half the lookups miss and
+ *         go through mdcache_new_entry(): the partition lock, the
+ *         recheck, the LRU insert, and a reclaim from the head of the
+ *         next lane as mdcache_lru_get() does once over its budget.
+ * dirent  mdcache_dirent_add() and mdcache_dirent_remove() on a few
+ *         shared directories, half of them on names looked up under
+ *         the content lock shared.
+ *
+ * Each workload runs for a while at every thread count; the operations
+ * per second and their ratio to one thread are printed, and written as
+ * CSV with -o for plotting the curves.  With -m, the bench fails if a
+ * run on no more threads than CPUs falls below that fraction of linear
+ * scaling, which is what a regression test of the cache would check.
+ *
+ * usage: bench_mdcache_scale [-t threads,...] [-n entries] [-s seconds]
+ *                            [-w workload] [-o csv] [-m efficiency]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "abstract_atomic.h"
+#include "gsh_intrinsic.h"
+#include "gsh_list.h"
+#include "avltree.h"
+#include "city.h"
+
+#define NPART 7
+#define CACHE_SZ 32633
+#define LANES 17
+#define MAX_THREADS 1024
+#define NDIRS 16
+
+struct entry {
+	struct entry *next;	/* hash chain */
+	struct glist_head q;	/* LRU lane L1 */
+	uint64_t hk;
+	int32_t refcnt;		/* 1 for the sentinel while hashed */
+	uint32_t cf;
+	uint32_t lane;
+	bool queued;
+};
+
+struct partition {
+	pthread_rwlock_t lock;
+	struct entry **buckets;
+	GSH_CACHE_PAD(0);
+};
+
+struct lane {
+	pthread_mutex_t mtx;
+	struct glist_head L1;
+	uint64_t size;
+	GSH_CACHE_PAD(0);
+};
+
+struct reader {
+	uint64_t seq;
+	GSH_CACHE_PAD(0);
+};
+
+struct dirent {
+	struct avltree_node node_hk;
+	uint64_t k;
+	char name[24];
+};
+
+struct dir {
+	pthread_rwlock_t content_lock;
+	struct avltree t;
+	GSH_CACHE_PAD(0);
+};
+
+enum workload { LOCATE, INSERT, DIRENT, NWORKLOADS };
+
+static const char *const workload_names[] = { "locate", "insert", "dirent" };
+
+struct bench {
+	enum workload w;
+	struct partition part[NPART];
+	struct lane lanes[LANES];
+	struct dir dirs[NDIRS];
+	struct reader readers[MAX_THREADS];
+	int nthreads;
+	uint64_t nkeys;		/* keys looked up */
+	uint64_t names;		/* names per directory */
+	int64_t entries;	/* hashed */
+	int64_t budget;		/* entries before reclaiming */
+	uint32_t reap_lane;
+	uint32_t stop;
+	int32_t next_thread;
+	uint64_t ops;
+	uint64_t misses;
+};
+
+static inline uint64_t mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+	void *p = calloc(n, size);
+
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+static inline struct partition *part_of(struct bench *b, uint64_t hk)
+{
+	return &b->part[hk % NPART];
+}
+
+static inline struct entry **bucket_of(struct bench *b, uint64_t hk)
+{
+	return &part_of(b, hk)->buckets[(hk / NPART) % CACHE_SZ];
+}
+
+static inline uint32_t lane_of(struct entry *e)
+{
+	return (uint32_t) ((((uintptr_t) e) / 2*sizeof(uintptr_t)) % LANES);
+}
+
+/* cih_synchronize() */
+static void synchronize(struct bench *b)
+{
+	uint64_t seq;
+	int i;
+
+	for (i = 0; i < b->nthreads; ++i) {
+		seq = atomic_fetch_uint64_t(&b->readers[i].seq);
+		if ((seq & 1) == 0)
+			continue;
+		while (atomic_fetch_uint64_t(&b->readers[i].seq) == seq)
+			sched_yield();
+	}
+}
+
+/* cih_get_by_key_ref(), inside a read section */
+static struct entry *get_ref(struct bench *b, struct reader *r, uint64_t hk)
+{
+	struct entry *e;
+	int32_t refcnt;
+
+	(void) atomic_inc_uint64_t(&r->seq);
+	for (e = atomic_fetch_voidptr((void **)bucket_of(b, hk)); e != NULL;
+	     e = atomic_fetch_voidptr((void **)&e->next))
+		if (e->hk == hk)
+			break;
+	if (e) {
+		refcnt = atomic_fetch_int32_t(&e->refcnt);
+		while (refcnt > 0 &&
+		       !atomic_cmpxchg_int32_t(&e->refcnt, refcnt, refcnt + 1))
+			refcnt = atomic_fetch_int32_t(&e->refcnt);
+		if (refcnt <= 0)
+			e = NULL;
+	}
+	(void) atomic_inc_uint64_t(&r->seq);
+	return e;
+}
+
+/* _mdcache_lru_ref() with LRU_REQ_INITIAL, the reference being taken */
+static void lru_ref_initial(struct bench *b, struct entry *e)
+{
+	struct lane *qlane = &b->lanes[e->lane];
+
+	if ((atomic_inc_uint32_t(&e->cf) % 3) != 0)
+		return;
+
+	pthread_mutex_lock(&qlane->mtx);
+	if (e->queued) {
+		glist_del(&e->q);
+		glist_add_tail(&qlane->L1, &e->q);
+	}
+	pthread_mutex_unlock(&qlane->mtx);
+}
+
+/* _mdcache_lru_unref() */
+static void lru_unref(struct bench *b, struct entry *e)
+{
+	struct lane *qlane = &b->lanes[e->lane];
+
+	/* the LRU_ENTRY_CLEANUP check */
+	pthread_mutex_lock(&qlane->mtx);
+	pthread_mutex_unlock(&qlane->mtx);
+
+	if (atomic_dec_int32_t(&e->refcnt) == 0) {
+		synchronize(b);
+		free(e);
+		(void) atomic_dec_int64_t(&b->entries);
+	}
+}
+
+/* lru_reap_lane() and cih_remove_latched(), dropping the sentinel */
+static void reclaim(struct bench *b)
+{
+	struct entry *e = NULL, **link;
+	struct partition *cp;
+	struct lane *qlane;
+	int i;
+
+	for (i = 0; i < LANES && e == NULL; ++i) {
+		qlane = &b->lanes[atomic_inc_uint32_t(&b->reap_lane) % LANES];
+		pthread_mutex_lock(&qlane->mtx);
+		e = glist_first_entry(&qlane->L1, struct entry, q);
+		if (e) {
+			glist_del(&e->q);
+			e->queued = false;
+			--qlane->size;
+		}
+		pthread_mutex_unlock(&qlane->mtx);
+	}
+	if (e == NULL)
+		return;
+
+	cp = part_of(b, e->hk);
+	pthread_rwlock_wrlock(&cp->lock);
+	for (link = bucket_of(b, e->hk); *link != e; link = &(*link)->next)
+		;
+	atomic_store_voidptr((void **)link, e->next);
+	pthread_rwlock_unlock(&cp->lock);
+
+	lru_unref(b, e);
+}
+
+/* mdcache_new_entry(): NULL if it raced and the caller should retry */
+static struct entry *new_entry(struct bench *b, uint64_t hk)
+{
+	struct partition *cp = part_of(b, hk);
+	struct entry **bucket = bucket_of(b, hk);
+	struct entry *e, *nentry = xcalloc(1, sizeof(*nentry));
+	struct lane *qlane;
+
+	if (atomic_inc_int64_t(&b->entries) > b->budget)
+		reclaim(b);
+
+	nentry->hk = hk;
+	nentry->refcnt = 2;	/* the sentinel and ours */
+	nentry->lane = lane_of(nentry);
+
+	pthread_rwlock_wrlock(&cp->lock);
+	for (e = *bucket; e != NULL; e = e->next)
+		if (e->hk == hk)
+			break;
+	if (e) {
+		/* someone else inserted it */
+		pthread_rwlock_unlock(&cp->lock);
+		free(nentry);
+		(void) atomic_dec_int64_t(&b->entries);
+		return NULL;
+	}
+	nentry->next = *bucket;
+	atomic_store_voidptr((void **)bucket, nentry);
+	pthread_rwlock_unlock(&cp->lock);
+
+	qlane = &b->lanes[nentry->lane];
+	pthread_mutex_lock(&qlane->mtx);
+	glist_add_tail(&qlane->L1, &nentry->q);
+	nentry->queued = true;
+	++qlane->size;
+	pthread_mutex_unlock(&qlane->mtx);
+
+	return nentry;
+}
+
+/* mdcache_locate_keyed() */
+static void locate(struct bench *b, struct reader *r, uint64_t hk,
+		   uint64_t *misses)
+{
+	struct entry *e;
+
+	for (;;) {
+		e = get_ref(b, r, hk);
+		if (e) {
+			lru_ref_initial(b, e);
+			break;
+		}
+		++*misses;
+		e = new_entry(b, hk);
+		if (e)
+			break;
+	}
+	lru_unref(b, e);
+}
+
+static struct dirent *dir_lookup(struct dir *d, uint64_t k)
+{
+	struct dirent key;
+	struct avltree_node *node;
+
+	key.k = k;
+	node = avltree_lookup(&key.node_hk, &d->t);
+	return node ? avltree_container_of(node, struct dirent, node_hk)
+		    : NULL;
+}
+
+/* mdcache_dirent_add() or mdcache_dirent_remove() of one name */
+static void dirent_op(struct bench *b, uint64_t x, bool lookup_first)
+{
+	struct dir *d = &b->dirs[x % NDIRS];
+	struct dirent *v;
+	char name[24];
+	uint64_t k;
+
+	snprintf(name, sizeof(name), "f%" PRIu64, (x / NDIRS) % b->names);
+	k = CityHash64WithSeed(name, strlen(name), 67);
+
+	if (lookup_first) {
+		pthread_rwlock_rdlock(&d->content_lock);
+		v = dir_lookup(d, k);
+		pthread_rwlock_unlock(&d->content_lock);
+		if (v)
+			return;
+	}
+
+	pthread_rwlock_wrlock(&d->content_lock);
+	v = dir_lookup(d, k);
+	if (v) {
+		avltree_remove(&v->node_hk, &d->t);
+		pthread_rwlock_unlock(&d->content_lock);
+		free(v);
+		return;
+	}
+	v = xcalloc(1, sizeof(*v));
+	v->k = k;
+	memcpy(v->name, name, sizeof(name));
+	(void) avltree_insert(&v->node_hk, &d->t);
+	pthread_rwlock_unlock(&d->content_lock);
+}
+
+static int dirent_cmpf(const struct avltree_node *lhs,
+		       const struct avltree_node *rhs)
+{
+	const struct dirent *l =
+		avltree_container_of(lhs, struct dirent, node_hk);
+	const struct dirent *r =
+		avltree_container_of(rhs, struct dirent, node_hk);
+
+	return l->k < r->k ? -1 : l->k > r->k ? 1 : 0;
+}
+
+static void *worker(void *arg)
+{
+	struct bench *b = arg;
+	int32_t me = atomic_postinc_int32_t(&b->next_thread);
+	struct reader *r = &b->readers[me];
+	uint64_t x = mix(me + 1), ops = 0, misses = 0;
+
+	while (!atomic_fetch_uint32_t(&b->stop)) {
+		int i;
+
+		/* check the clock less often than the cache */
+		for (i = 0; i < 64; ++i) {
+			x = mix(x);
+			if (b->w == DIRENT)
+				dirent_op(b, x, x & 1);
+			else
+				locate(b, r, mix(x % b->nkeys + 1), &misses);
+		}
+		ops += 64;
+	}
+	(void) atomic_add_uint64_t(&b->ops, ops);
+	(void) atomic_add_uint64_t(&b->misses, misses);
+	return NULL;
+}
+
+static void setup(struct bench *b, enum workload w, uint64_t nkeys)
+{
+	struct reader scratch = { 0 };
+	uint64_t ix, misses = 0;
+	int i;
+
+	b->w = w;
+	b->nkeys = nkeys;
+	b->names = nkeys / NDIRS;
+	b->budget = w == INSERT ? nkeys / 2 : nkeys;
+	b->nthreads = 0;
+	for (i = 0; i < NPART; ++i) {
+		pthread_rwlock_init(&b->part[i].lock, NULL);
+		b->part[i].buckets = xcalloc(CACHE_SZ, sizeof(void *));
+	}
+	for (i = 0; i < LANES; ++i) {
+		pthread_mutex_init(&b->lanes[i].mtx, NULL);
+		glist_init(&b->lanes[i].L1);
+	}
+	for (i = 0; i < NDIRS; ++i) {
+		pthread_rwlock_init(&b->dirs[i].content_lock, NULL);
+		avltree_init(&b->dirs[i].t, dirent_cmpf, 0);
+	}
+
+	if (w == DIRENT) {
+		for (ix = 0; ix < nkeys; ix += 2)
+			dirent_op(b, mix(ix + 1), false);
+		return;
+	}
+	for (ix = 0; ix < (uint64_t) b->budget; ++ix)
+		locate(b, &scratch, mix(ix + 1), &misses);
+}
+
+static void teardown(struct bench *b)
+{
+	struct avltree_node *node;
+	struct entry *e, *next;
+	int i;
+	uint32_t j;
+
+	for (i = 0; i < NPART; ++i) {
+		for (j = 0; j < CACHE_SZ; ++j)
+			for (e = b->part[i].buckets[j]; e != NULL; e = next) {
+				next = e->next;
+				free(e);
+			}
+		free(b->part[i].buckets);
+		pthread_rwlock_destroy(&b->part[i].lock);
+	}
+	for (i = 0; i < LANES; ++i)
+		pthread_mutex_destroy(&b->lanes[i].mtx);
+	for (i = 0; i < NDIRS; ++i) {
+		while ((node = avltree_first(&b->dirs[i].t)) != NULL) {
+			avltree_remove(node, &b->dirs[i].t);
+			free(avltree_container_of(node, struct dirent,
+						  node_hk));
+		}
+		pthread_rwlock_destroy(&b->dirs[i].content_lock);
+	}
+}
+
+static double run(enum workload w, int nthreads, uint64_t nkeys,
+		  double secs, uint64_t *misses)
+{
+	struct bench *b = xcalloc(1, sizeof(*b));
+	pthread_t *thr = xcalloc(nthreads, sizeof(pthread_t));
+	struct timespec t0, t1, nap;
+	double elapsed, rate;
+	int i;
+
+	setup(b, w, nkeys);
+	b->nthreads = nthreads;
+
+	nap.tv_sec = (time_t) secs;
+	nap.tv_nsec = (long) ((secs - nap.tv_sec) * 1e9);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nthreads; ++i)
+		pthread_create(&thr[i], NULL, worker, b);
+	nanosleep(&nap, NULL);
+	atomic_store_uint32_t(&b->stop, 1);
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(thr[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	rate = b->ops / elapsed;
+	*misses = b->misses;
+
+	teardown(b);
+	free(thr);
+	free(b);
+	return rate;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads,...] [-n entries] [-s seconds]\n"
+		"          [-w locate|insert|dirent] [-o csv] [-m efficiency]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int threads[64] = { 1, 8, 32, 64 };
+	int nthreads = 4, ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t nkeys = 100000, misses;
+	double secs = 2, efficiency = 0, rate, base;
+	const char *only = NULL;
+	FILE *csv = NULL;
+	bool failed = false;
+	char *tok, *save;
+	int opt, i, w;
+
+	while ((opt = getopt(argc, argv, "t:n:s:w:o:m:")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = 0;
+			for (tok = strtok_r(optarg, ",", &save);
+			     tok != NULL && nthreads < 64;
+			     tok = strtok_r(NULL, ",", &save))
+				threads[nthreads++] = atoi(tok);
+			break;
+		case 'n':
+			nkeys = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			secs = atof(optarg);
+			break;
+		case 'w':
+			only = optarg;
+			break;
+		case 'o':
+			csv = fopen(optarg, "w");
+			if (csv == NULL) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			efficiency = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nthreads == 0 || nkeys < 2 * NDIRS || secs <= 0)
+		usage(argv[0]);
+	for (i = 0; i < nthreads; ++i)
+		if (threads[i] < 1 || threads[i] > MAX_THREADS)
+			usage(argv[0]);
+
+	if (csv)
+		fprintf(csv, "workload,threads,ops_per_sec,speedup,misses\n");
+	printf("%" PRIu64 " entries, %.1f s per run, %d CPUs\n",
+	       nkeys, secs, ncpu);
+
+	for (w = 0; w < NWORKLOADS; ++w) {
+		if (only && strcmp(only, workload_names[w]) != 0)
+			continue;
+		printf("%-8s %8s %14s %8s\n", workload_names[w], "threads",
+		       "ops/s", "speedup");
+		base = 0;
+		for (i = 0; i < nthreads; ++i) {
+			rate = run(w, threads[i], nkeys, secs, &misses);
+			if (base == 0)
+				base = rate / threads[i];
+			printf("%-8s %8d %14.0f %8.2f\n", "", threads[i], rate,
+			       rate / base);
+			if (csv)
+				fprintf(csv, "%s,%d,%.0f,%.3f,%" PRIu64 "\n",
+					workload_names[w], threads[i], rate,
+					rate / base, misses);
+			if (efficiency > 0 && threads[i] <= ncpu &&
+			    rate < base * threads[i] * efficiency) {
+				printf("%s at %d threads below %.0f%% of linear\n",
+				       workload_names[w], threads[i],
+				       efficiency * 100);
+				failed = true;
+			}
+		}
+	}
+
+	if (csv)
+		fclose(csv);
+	return failed ? 2 : 0;
+}
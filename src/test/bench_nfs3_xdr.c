@@ -0,0 +1,612 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ * Microbenchmark of the NFSv3 XDR for GETATTR, LOOKUP, ACCESS, READ and
+ * WRITE: decoding the arguments and encoding the replies.
+ *
+ * The field path makes one call through the stream operations vector
+ * per XDR unit, as the rpcgen code does.  The inline path asks the
+ * stream for the whole fixed part of the object with one bounds check
+ * and moves it directly, as xdr_nfs23.c does when XDR_INLINE()
+ * succeeds.  Both paths are checked to decode and encode the same.
+ *
+ * The arguments are the bodies a Linux client sends, laid out as they
+ * come off the wire with 28 byte file handles.
+ *
+ * usage: bench_nfs3_xdr [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define FH_LEN 28
+#define FATTR3_UNITS 21
+
+struct mxdr;
+
+struct mxdr_ops {
+	bool (*getlong)(struct mxdr *, int32_t *);
+	bool (*putlong)(struct mxdr *, const int32_t *);
+	bool (*getbytes)(struct mxdr *, char *, unsigned int);
+	bool (*putbytes)(struct mxdr *, const char *, unsigned int);
+	int32_t *(*inline_)(struct mxdr *, unsigned int);
+};
+
+struct mxdr {
+	const struct mxdr_ops *ops;
+	char *base, *pos, *end;
+};
+
+static bool mx_getlong(struct mxdr *x, int32_t *lp)
+{
+	if (x->end - x->pos < 4)
+		return false;
+	*lp = ntohl(*(int32_t *) x->pos);
+	x->pos += 4;
+	return true;
+}
+
+static bool mx_putlong(struct mxdr *x, const int32_t *lp)
+{
+	if (x->end - x->pos < 4)
+		return false;
+	*(int32_t *) x->pos = htonl(*lp);
+	x->pos += 4;
+	return true;
+}
+
+static bool mx_getbytes(struct mxdr *x, char *p, unsigned int len)
+{
+	if ((unsigned int) (x->end - x->pos) < len)
+		return false;
+	memcpy(p, x->pos, len);
+	x->pos += len;
+	return true;
+}
+
+static bool mx_putbytes(struct mxdr *x, const char *p, unsigned int len)
+{
+	if ((unsigned int) (x->end - x->pos) < len)
+		return false;
+	memcpy(x->pos, p, len);
+	x->pos += len;
+	return true;
+}
+
+static int32_t *mx_inline(struct mxdr *x, unsigned int len)
+{
+	int32_t *p = (int32_t *) x->pos;
+
+	if ((unsigned int) (x->end - x->pos) < len)
+		return NULL;
+	x->pos += len;
+	return p;
+}
+
+static const struct mxdr_ops mx_ops = {
+	mx_getlong, mx_putlong, mx_getbytes, mx_putbytes, mx_inline
+};
+
+#define PUT32(buf, v) (*(buf)++ = htonl((uint32_t) (v)))
+#define GET32(buf) ((uint32_t) ntohl(*(buf)++))
+
+struct fattr3 {
+	uint32_t type, mode, nlink, uid, gid;
+	uint64_t size, used;
+	uint32_t rdev1, rdev2;
+	uint64_t fsid, fileid;
+	uint32_t atime_s, atime_ns, mtime_s, mtime_ns, ctime_s, ctime_ns;
+};
+
+struct fh3 {
+	uint32_t len;
+	char data[64];
+};
+
+/* The union of the arguments of the five operations */
+struct args {
+	struct fh3 fh;
+	char name[256];
+	uint32_t access, count, stable;
+	uint64_t offset;
+	uint32_t data_len;
+	const char *data;
+};
+
+/* The union of their replies */
+struct res {
+	uint32_t status;
+	bool obj_follows, dir_follows;
+	struct fh3 fh;
+	struct fattr3 obj, dir;
+	uint32_t access, count, eof, committed;
+	char verf[8];
+	uint32_t data_len;
+	const char *data;
+};
+
+/* Field at a time, the rpcgen way */
+
+static bool f_u32(struct mxdr *x, uint32_t *v)
+{
+	return x->ops->getlong(x, (int32_t *) v);
+}
+
+static bool f_u64(struct mxdr *x, uint64_t *v)
+{
+	uint32_t hi, lo;
+
+	if (!f_u32(x, &hi) || !f_u32(x, &lo))
+		return false;
+	*v = (uint64_t) hi << 32 | lo;
+	return true;
+}
+
+static bool f_put32(struct mxdr *x, uint32_t v)
+{
+	int32_t l = v;
+
+	return x->ops->putlong(x, &l);
+}
+
+static bool f_put64(struct mxdr *x, uint64_t v)
+{
+	return f_put32(x, v >> 32) && f_put32(x, (uint32_t) v);
+}
+
+static bool f_opaque(struct mxdr *x, char *p, uint32_t *len, uint32_t max)
+{
+	static char pad[4];
+
+	if (!f_u32(x, len) || *len > max)
+		return false;
+	return x->ops->getbytes(x, p, *len) &&
+	       x->ops->getbytes(x, pad, (4 - (*len & 3)) & 3);
+}
+
+static bool f_put_opaque(struct mxdr *x, const char *p, uint32_t len)
+{
+	static const char zero[4];
+
+	return f_put32(x, len) && x->ops->putbytes(x, p, len) &&
+	       x->ops->putbytes(x, zero, (4 - (len & 3)) & 3);
+}
+
+static bool f_fh(struct mxdr *x, struct fh3 *fh)
+{
+	return f_opaque(x, fh->data, &fh->len, 64);
+}
+
+static bool f_fattr3(struct mxdr *x, const struct fattr3 *a)
+{
+	return f_put32(x, a->type) && f_put32(x, a->mode) &&
+	       f_put32(x, a->nlink) && f_put32(x, a->uid) &&
+	       f_put32(x, a->gid) && f_put64(x, a->size) &&
+	       f_put64(x, a->used) && f_put32(x, a->rdev1) &&
+	       f_put32(x, a->rdev2) && f_put64(x, a->fsid) &&
+	       f_put64(x, a->fileid) && f_put32(x, a->atime_s) &&
+	       f_put32(x, a->atime_ns) && f_put32(x, a->mtime_s) &&
+	       f_put32(x, a->mtime_ns) && f_put32(x, a->ctime_s) &&
+	       f_put32(x, a->ctime_ns);
+}
+
+static bool f_post_op_attr(struct mxdr *x, bool follows,
+			   const struct fattr3 *a)
+{
+	if (!f_put32(x, follows))
+		return false;
+	return !follows || f_fattr3(x, a);
+}
+
+/* Inline, as xdr_nfs23.c does when the stream hands out the object */
+
+static int32_t *i_fattr3(int32_t *buf, const struct fattr3 *a)
+{
+	PUT32(buf, a->type);
+	PUT32(buf, a->mode);
+	PUT32(buf, a->nlink);
+	PUT32(buf, a->uid);
+	PUT32(buf, a->gid);
+	PUT32(buf, a->size >> 32);
+	PUT32(buf, a->size);
+	PUT32(buf, a->used >> 32);
+	PUT32(buf, a->used);
+	PUT32(buf, a->rdev1);
+	PUT32(buf, a->rdev2);
+	PUT32(buf, a->fsid >> 32);
+	PUT32(buf, a->fsid);
+	PUT32(buf, a->fileid >> 32);
+	PUT32(buf, a->fileid);
+	PUT32(buf, a->atime_s);
+	PUT32(buf, a->atime_ns);
+	PUT32(buf, a->mtime_s);
+	PUT32(buf, a->mtime_ns);
+	PUT32(buf, a->ctime_s);
+	PUT32(buf, a->ctime_ns);
+	return buf;
+}
+
+static bool i_post_op_attr(struct mxdr *x, bool follows,
+			   const struct fattr3 *a)
+{
+	int32_t *buf;
+
+	if (follows) {
+		buf = x->ops->inline_(x, (1 + FATTR3_UNITS) * 4);
+		if (buf != NULL) {
+			PUT32(buf, 1);
+			i_fattr3(buf, a);
+			return true;
+		}
+	}
+	return f_post_op_attr(x, follows, a);
+}
+
+/* The operations */
+
+struct op {
+	const char *name;
+	bool (*dec)(struct mxdr *, struct args *, bool);
+	bool (*enc)(struct mxdr *, const struct res *, bool);
+	char call[512];
+	size_t call_len;
+};
+
+static bool getattr_dec(struct mxdr *x, struct args *a, bool fast)
+{
+	return f_fh(x, &a->fh);
+}
+
+static bool getattr_enc(struct mxdr *x, const struct res *r, bool fast)
+{
+	int32_t *buf;
+
+	if (!f_put32(x, r->status))
+		return false;
+	if (fast) {
+		buf = x->ops->inline_(x, FATTR3_UNITS * 4);
+		if (buf != NULL) {
+			i_fattr3(buf, &r->obj);
+			return true;
+		}
+	}
+	return f_fattr3(x, &r->obj);
+}
+
+static bool lookup_dec(struct mxdr *x, struct args *a, bool fast)
+{
+	uint32_t len;
+
+	return f_fh(x, &a->fh) && f_opaque(x, a->name, &len, 255);
+}
+
+static bool lookup_enc(struct mxdr *x, const struct res *r, bool fast)
+{
+	bool (*poa)(struct mxdr *, bool, const struct fattr3 *) =
+		fast ? i_post_op_attr : f_post_op_attr;
+
+	return f_put32(x, r->status) &&
+	       f_put_opaque(x, r->fh.data, r->fh.len) &&
+	       poa(x, r->obj_follows, &r->obj) &&
+	       poa(x, r->dir_follows, &r->dir);
+}
+
+static bool access_dec(struct mxdr *x, struct args *a, bool fast)
+{
+	int32_t *buf;
+
+	if (!f_fh(x, &a->fh))
+		return false;
+	if (fast) {
+		buf = x->ops->inline_(x, 4);
+		if (buf != NULL) {
+			a->access = GET32(buf);
+			return true;
+		}
+	}
+	return f_u32(x, &a->access);
+}
+
+static bool access_enc(struct mxdr *x, const struct res *r, bool fast)
+{
+	int32_t *buf;
+
+	if (!f_put32(x, r->status))
+		return false;
+	if (fast && r->obj_follows) {
+		buf = x->ops->inline_(x, (2 + FATTR3_UNITS) * 4);
+		if (buf != NULL) {
+			PUT32(buf, 1);
+			buf = i_fattr3(buf, &r->obj);
+			PUT32(buf, r->access);
+			return true;
+		}
+	}
+	return f_post_op_attr(x, r->obj_follows, &r->obj) &&
+	       f_put32(x, r->access);
+}
+
+static bool read_dec(struct mxdr *x, struct args *a, bool fast)
+{
+	int32_t *buf = NULL;
+
+	if (!f_fh(x, &a->fh))
+		return false;
+	if (fast)
+		buf = x->ops->inline_(x, 3 * 4);
+	if (buf != NULL) {
+		a->offset = (uint64_t) GET32(buf) << 32;
+		a->offset |= GET32(buf);
+		a->count = GET32(buf);
+		return true;
+	}
+	return f_u64(x, &a->offset) && f_u32(x, &a->count);
+}
+
+static bool read_enc(struct mxdr *x, const struct res *r, bool fast)
+{
+	int32_t *buf = NULL;
+
+	if (!f_put32(x, r->status))
+		return false;
+	if (fast && r->obj_follows)
+		buf = x->ops->inline_(x, (3 + FATTR3_UNITS) * 4);
+	if (buf != NULL) {
+		PUT32(buf, 1);
+		buf = i_fattr3(buf, &r->obj);
+		PUT32(buf, r->count);
+		PUT32(buf, r->eof);
+	} else if (!f_post_op_attr(x, r->obj_follows, &r->obj) ||
+		   !f_put32(x, r->count) || !f_put32(x, r->eof)) {
+		return false;
+	}
+	/* The data goes out by reference, only its length is encoded */
+	return f_put32(x, r->data_len);
+}
+
+static bool write_dec(struct mxdr *x, struct args *a, bool fast)
+{
+	int32_t *buf = NULL;
+
+	if (!f_fh(x, &a->fh))
+		return false;
+	if (fast)
+		buf = x->ops->inline_(x, 4 * 4);
+	if (buf != NULL) {
+		a->offset = (uint64_t) GET32(buf) << 32;
+		a->offset |= GET32(buf);
+		a->count = GET32(buf);
+		a->stable = GET32(buf);
+	} else if (!f_u64(x, &a->offset) || !f_u32(x, &a->count) ||
+		   !f_u32(x, &a->stable)) {
+		return false;
+	}
+	/* The data stays in the receive buffer */
+	if (!f_u32(x, &a->data_len) || a->data_len > x->end - x->pos)
+		return false;
+	a->data = x->pos;
+	x->pos += (a->data_len + 3) & ~3;
+	return true;
+}
+
+static bool write_enc(struct mxdr *x, const struct res *r, bool fast)
+{
+	bool (*poa)(struct mxdr *, bool, const struct fattr3 *) =
+		fast ? i_post_op_attr : f_post_op_attr;
+	int32_t *buf;
+
+	/* wcc_data with no pre op attributes */
+	if (!f_put32(x, r->status) || !f_put32(x, 0) ||
+	    !poa(x, r->obj_follows, &r->obj))
+		return false;
+	if (fast) {
+		buf = x->ops->inline_(x, 2 * 4 + 8);
+		if (buf != NULL) {
+			PUT32(buf, r->count);
+			PUT32(buf, r->committed);
+			memcpy(buf, r->verf, 8);
+			return true;
+		}
+	}
+	return f_put32(x, r->count) && f_put32(x, r->committed) &&
+	       x->ops->putbytes(x, r->verf, 8);
+}
+
+/* Lay out the call bodies */
+
+static char *put32(char *p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, 4);
+	return p + 4;
+}
+
+static char *put_opaque(char *p, const char *data, uint32_t len)
+{
+	p = put32(p, len);
+	memcpy(p, data, len);
+	memset(p + len, 0, (4 - (len & 3)) & 3);
+	return p + ((len + 3) & ~3);
+}
+
+static void record_calls(struct op *ops)
+{
+	char fh[FH_LEN];
+	char *p;
+	int i;
+
+	for (i = 0; i < FH_LEN; i++)
+		fh[i] = i * 7;
+
+	p = put_opaque(ops[0].call, fh, FH_LEN);
+	ops[0].call_len = p - ops[0].call;
+
+	p = put_opaque(ops[1].call, fh, FH_LEN);
+	p = put_opaque(p, "Makefile.am", 11);
+	ops[1].call_len = p - ops[1].call;
+
+	p = put_opaque(ops[2].call, fh, FH_LEN);
+	p = put32(p, 0x1f);
+	ops[2].call_len = p - ops[2].call;
+
+	p = put_opaque(ops[3].call, fh, FH_LEN);
+	p = put32(p, 0);
+	p = put32(p, 1 << 20);
+	p = put32(p, 1 << 16);
+	ops[3].call_len = p - ops[3].call;
+
+	p = put_opaque(ops[4].call, fh, FH_LEN);
+	p = put32(p, 0);
+	p = put32(p, 1 << 20);
+	p = put32(p, 64);
+	p = put32(p, 0);
+	p = put32(p, 64);
+	memset(p, 'x', 64);
+	p += 64;
+	ops[4].call_len = p - ops[4].call;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run(const struct op *op, struct res *r, bool fast,
+		  long iterations)
+{
+	char call[512], reply[512];
+	struct mxdr in = {&mx_ops, call, call, call + op->call_len};
+	struct mxdr out = {&mx_ops, reply, reply, reply + sizeof(reply)};
+	struct args a;
+	volatile size_t sink = 0;
+	double t0;
+	long i;
+
+	memcpy(call, op->call, op->call_len);
+
+	t0 = now();
+	for (i = 0; i < iterations; i++) {
+		in.pos = call;
+		out.pos = reply;
+		r->obj.fileid = i;
+		if (!op->dec(&in, &a, fast) || !op->enc(&out, r, fast))
+			return -1;
+		sink += out.pos - reply + a.fh.len;
+	}
+	(void) sink;
+
+	return now() - t0;
+}
+
+static bool same_coding(const struct op *op, const struct res *r)
+{
+	char c1[512], c2[512], b1[512], b2[512];
+	struct mxdr i1 = {&mx_ops, c1, c1, c1 + op->call_len};
+	struct mxdr i2 = {&mx_ops, c2, c2, c2 + op->call_len};
+	struct mxdr o1 = {&mx_ops, b1, b1, b1 + sizeof(b1)};
+	struct mxdr o2 = {&mx_ops, b2, b2, b2 + sizeof(b2)};
+	struct args a1, a2;
+
+	memcpy(c1, op->call, op->call_len);
+	memcpy(c2, op->call, op->call_len);
+	memset(&a1, 0, sizeof(a1));
+	memset(&a2, 0, sizeof(a2));
+
+	if (!op->dec(&i1, &a1, false) || !op->dec(&i2, &a2, true) ||
+	    !op->enc(&o1, r, false) || !op->enc(&o2, r, true))
+		return false;
+
+	return i1.pos - c1 == i2.pos - c2 && a1.fh.len == a2.fh.len &&
+	       memcmp(a1.fh.data, a2.fh.data, a1.fh.len) == 0 &&
+	       a1.access == a2.access && a1.offset == a2.offset &&
+	       a1.count == a2.count && a1.stable == a2.stable &&
+	       a1.data_len == a2.data_len &&
+	       o1.pos - b1 == o2.pos - b2 &&
+	       memcmp(b1, b2, o1.pos - b1) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct op ops[] = {
+		{"GETATTR", getattr_dec, getattr_enc},
+		{"LOOKUP", lookup_dec, lookup_enc},
+		{"ACCESS", access_dec, access_enc},
+		{"READ", read_dec, read_enc},
+		{"WRITE", write_dec, write_enc},
+	};
+	long iterations = argc > 1 ? atol(argv[1]) : 10000000;
+	struct res r;
+	double field, inl;
+	unsigned int i;
+
+	if (iterations < 1) {
+		fprintf(stderr, "usage: bench_nfs3_xdr [iterations]\n");
+		return 1;
+	}
+
+	record_calls(ops);
+
+	memset(&r, 0, sizeof(r));
+	r.obj_follows = r.dir_follows = true;
+	r.fh.len = FH_LEN;
+	r.obj.type = r.dir.type = 1;
+	r.obj.mode = 0644;
+	r.dir.mode = 0755;
+	r.obj.nlink = 1;
+	r.dir.nlink = 2;
+	r.obj.size = 1 << 20;
+	r.obj.used = 1 << 20;
+	r.obj.fsid = r.dir.fsid = 0x42;
+	r.dir.fileid = 2;
+	r.obj.mtime_s = r.obj.ctime_s = r.obj.atime_s = 1500000000;
+	r.access = 0x1f;
+	r.count = 64;
+	r.committed = 2;
+	r.data_len = 1 << 16;
+	memcpy(r.verf, "ganesha!", 8);
+
+	printf("%ld iterations\n", iterations);
+
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+		if (!same_coding(&ops[i], &r)) {
+			fprintf(stderr, "%s: codings differ\n", ops[i].name);
+			return 1;
+		}
+
+		field = run(&ops[i], &r, false, iterations);
+		inl = run(&ops[i], &r, true, iterations);
+
+		printf("%-7s field:  %8.3f s %6.1f ns/op\n", ops[i].name,
+		       field, field * 1e9 / iterations);
+		printf("%-7s inline: %8.3f s %6.1f ns/op\n", ops[i].name,
+		       inl, inl * 1e9 / iterations);
+	}
+
+	return 0;
+}
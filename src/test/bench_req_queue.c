@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/*
+ * Microbenchmark of the request queue: the lock-free ring behind each
+ * REQ_Q_* class against the spinlocked producer/consumer list pair it
+ * replaced.
+ *
+ * usage: bench_req_queue [producers [consumers [ops per producer]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "nfs_req_queue.h"
+
+#define RING_SLOTS 8192
+
+struct item {
+	struct glist_head q;
+	uint64_t v;
+};
+
+/* the pre-ring queue: decoders append to producer under its lock, and
+ * an empty consumer list steals the whole producer list at once */
+struct spin_pair {
+	GSH_CACHE_PAD(0);
+	struct req_q producer;
+	GSH_CACHE_PAD(1);
+	struct req_q consumer;
+	GSH_CACHE_PAD(2);
+};
+
+static void spin_push(struct spin_pair *p, struct item *it)
+{
+	pthread_spin_lock(&p->producer.sp);
+	glist_add_tail(&p->producer.q, &it->q);
+	++(p->producer.size);
+	pthread_spin_unlock(&p->producer.sp);
+}
+
+static struct item *spin_pop(struct spin_pair *p)
+{
+	struct item *it = NULL;
+
+	pthread_spin_lock(&p->consumer.sp);
+	if (p->consumer.size == 0) {
+		pthread_spin_lock(&p->producer.sp);
+		if (p->producer.size > 0) {
+			glist_splice_tail(&p->consumer.q, &p->producer.q);
+			p->consumer.size = p->producer.size;
+			p->producer.size = 0;
+		}
+		pthread_spin_unlock(&p->producer.sp);
+	}
+	if (p->consumer.size > 0) {
+		it = glist_first_entry(&p->consumer.q, struct item, q);
+		glist_del(&it->q);
+		--(p->consumer.size);
+	}
+	pthread_spin_unlock(&p->consumer.sp);
+	return it;
+}
+
+struct bench {
+	bool ring;
+	struct spin_pair spin;
+	struct req_q_ring r;
+	struct item *items;
+	uint64_t ops;		/* per producer */
+	uint64_t total;		/* ops * producers */
+	uint32_t done;		/* all producers have finished */
+	uint64_t sum;
+	uint64_t full;		/* ring pushes that found it full */
+	int32_t next_producer;
+};
+
+static void *producer(void *arg)
+{
+	struct bench *b = arg;
+	uint64_t base = atomic_postinc_int32_t(&b->next_producer) * b->ops;
+	uint64_t ix;
+
+	for (ix = 0; ix < b->ops; ++ix) {
+		struct item *it = &b->items[base + ix];
+
+		if (!b->ring) {
+			spin_push(&b->spin, it);
+			continue;
+		}
+		while (!req_q_ring_push(&b->r, it)) {
+			(void) atomic_inc_uint64_t(&b->full);
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct bench *b = arg;
+	uint64_t sum = 0;
+	struct item *it;
+	uint32_t done;
+
+	for (;;) {
+		done = atomic_fetch_uint32_t(&b->done);
+		if (b->ring)
+			it = req_q_ring_pop(&b->r);
+		else
+			it = spin_pop(&b->spin);
+		if (it) {
+			sum += it->v;
+			continue;
+		}
+		if (done)
+			break;
+		/* an idle worker would sleep on the wait list here */
+		sched_yield();
+	}
+	(void) atomic_add_uint64_t(&b->sum, sum);
+	return NULL;
+}
+
+static double run(bool ring, int nprod, int ncons, uint64_t ops,
+		  struct req_q_slot *slots)
+{
+	struct bench b;
+	pthread_t *thr;
+	struct timespec t0, t1;
+	uint64_t ix, expect;
+	int i;
+
+	memset(&b, 0, sizeof(b));
+	b.ring = ring;
+	b.ops = ops;
+	b.total = ops * nprod;
+	b.items = calloc(b.total, sizeof(struct item));
+	thr = calloc(nprod + ncons, sizeof(pthread_t));
+	if (!b.items || !thr) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (ix = 0; ix < b.total; ++ix)
+		b.items[ix].v = ix;
+	expect = b.total * (b.total - 1) / 2;
+
+	nfs_rpc_q_init(&b.spin.producer);
+	nfs_rpc_q_init(&b.spin.consumer);
+	req_q_ring_init(&b.r, slots, RING_SLOTS);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < ncons; ++i)
+		pthread_create(&thr[i], NULL, consumer, &b);
+	for (i = 0; i < nprod; ++i)
+		pthread_create(&thr[ncons + i], NULL, producer, &b);
+	for (i = 0; i < nprod; ++i)
+		pthread_join(thr[ncons + i], NULL);
+	atomic_store_uint32_t(&b.done, 1);
+	for (i = 0; i < ncons; ++i)
+		pthread_join(thr[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (b.sum != expect) {
+		fprintf(stderr, "%s: checksum mismatch %" PRIu64
+			" != %" PRIu64 "\n",
+			ring ? "ring" : "spin", b.sum, expect);
+		exit(1);
+	}
+	if (ring && b.full)
+		printf("ring: %" PRIu64 " pushes found the ring full\n",
+		       b.full);
+
+	free(thr);
+	free(b.items);
+	return (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	int nprod = argc > 1 ? atoi(argv[1]) : 4;
+	int ncons = argc > 2 ? atoi(argv[2]) : 16;
+	uint64_t ops = argc > 3 ? strtoull(argv[3], NULL, 10) : 1000000;
+	struct req_q_slot *slots = calloc(RING_SLOTS, sizeof(*slots));
+	double spin, ring;
+
+	if (nprod < 1 || ncons < 1 || ops < 1 || !slots) {
+		fprintf(stderr,
+			"usage: %s [producers [consumers [ops per producer]]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	spin = run(false, nprod, ncons, ops, slots);
+	ring = run(true, nprod, ncons, ops, slots);
+
+	printf("%d producers, %d consumers, %" PRIu64 " requests\n",
+	       nprod, ncons, ops * nprod);
+	printf("spinlocked pair: %8.3f s %12.0f req/s\n", spin,
+	       ops * nprod / spin);
+	printf("lock-free ring:  %8.3f s %12.0f req/s\n", ring,
+	       ops * nprod / ring);
+
+	free(slots);
+	return 0;
+}
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
+#include <time.h>
 
 #include "CUnit/Basic.h"
 
@@ -15,10 +16,18 @@ struct avltree avl_tree_1;
 struct avltree avl_tree_2;
 struct avltree avl_tree_100;
 struct avltree avl_tree_10000;
+struct avltree avl_tree_1m;
+struct btree btree_1m;
+
+/* Nodes of the 1M trees, and their keys in insertion order */
+#define BTREE_BENCH_NODES (1024 * 1024)
+#define BTREE_BENCH_LOOKUPS (4 * BTREE_BENCH_NODES)
+struct avl_unit_val *bench_vals;
 
 typedef struct avl_unit_val {
 	int refs;
 	struct avltree_node node_k;
+	struct btree_node node_b;
 	unsigned long key;
 	unsigned long val;
 } avl_unit_val_t;
@@ -221,6 +230,24 @@ int clean_supremum(void)
 	return 0;
 }
 
+int init_suite1m(void)
+{
+	avltree_init(&avl_tree_1m, avl_unit_cmpf, 0 /* flags */);
+	btree_init(&btree_1m);
+	bench_vals = calloc(BTREE_BENCH_NODES, sizeof(avl_unit_val_t));
+
+	return bench_vals == NULL;
+}
+
+int clean_suite1m(void)
+{
+	avltree_destroy(&avl_tree_1m);
+	btree_destroy(&btree_1m);
+	free(bench_vals);
+
+	return 0;
+}
+
 /*
  *  END SUITE INITIALIZATION and CLEANUP FUNCTIONS
  */
@@ -826,6 +853,133 @@ void check_min_2(void)
 	CU_ASSERT(v->val == (mval + 1));
 }
 
+/*
+ * B+tree against AVL, over 1M nodes inserted in random order.  The
+ * keys are a permutation of 0..2^20 - 1 scaled by 3, so that key + 1
+ * is never in the trees.
+ */
+
+static inline unsigned long bench_key(unsigned long ix)
+{
+	/* An odd multiplier permutes the low 20 bits */
+	return ((ix * 2654435761UL) & (BTREE_BENCH_NODES - 1)) * 3;
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void inserts_tree_1m(void)
+{
+	avl_unit_val_t *v;
+	unsigned long ix;
+
+	for (ix = 0; ix < BTREE_BENCH_NODES; ++ix) {
+		v = &bench_vals[ix];
+		v->key = bench_key(ix);
+		v->val = v->key + 1;
+		v->node_b.key = v->key;
+		CU_ASSERT(avltree_insert(&v->node_k, &avl_tree_1m) == NULL);
+		CU_ASSERT(btree_insert(&v->node_b, &btree_1m) == NULL);
+	}
+
+	/* Same key again */
+	v = avl_unit_new_val(0);
+	v->node_b.key = bench_key(7);
+	CU_ASSERT(btree_insert(&v->node_b, &btree_1m) ==
+		  &bench_vals[7].node_b);
+	avl_unit_free_val(v);
+
+	CU_ASSERT_EQUAL(avltree_size(&avl_tree_1m), BTREE_BENCH_NODES);
+	CU_ASSERT_EQUAL(btree_size(&btree_1m), BTREE_BENCH_NODES);
+}
+
+void lookups_tree_1m(void)
+{
+	struct avltree_node *node;
+	struct btree_node *bnode;
+	avl_unit_val_t *v2, *v = avl_unit_new_val(0);
+	unsigned long ix, key, avl_hits = 0, btree_hits = 0;
+	double start, avl_ns, btree_ns;
+
+	start = bench_now();
+	for (ix = 0; ix < BTREE_BENCH_LOOKUPS; ++ix) {
+		v->key = bench_key(ix * 40503UL);
+		node = avltree_lookup(&v->node_k, &avl_tree_1m);
+		if (node) {
+			v2 = avltree_container_of(node, avl_unit_val_t,
+						  node_k);
+			avl_hits += v2->val == v->key + 1;
+		}
+	}
+	avl_ns = (bench_now() - start) / BTREE_BENCH_LOOKUPS;
+
+	start = bench_now();
+	for (ix = 0; ix < BTREE_BENCH_LOOKUPS; ++ix) {
+		key = bench_key(ix * 40503UL);
+		bnode = btree_lookup(key, &btree_1m);
+		if (bnode) {
+			v2 = btree_container_of(bnode, avl_unit_val_t,
+						node_b);
+			btree_hits += v2->val == key + 1;
+		}
+	}
+	btree_ns = (bench_now() - start) / BTREE_BENCH_LOOKUPS;
+
+	CU_ASSERT_EQUAL(avl_hits, BTREE_BENCH_LOOKUPS);
+	CU_ASSERT_EQUAL(btree_hits, BTREE_BENCH_LOOKUPS);
+
+	/* Misses */
+	for (ix = 0; ix < BTREE_BENCH_NODES; ix += 1000)
+		CU_ASSERT(btree_lookup(bench_key(ix) + 1, &btree_1m) == NULL);
+
+	printf("\n%d lookups in %d nodes: avl %.1f ns, btree %.1f ns\n",
+	       BTREE_BENCH_LOOKUPS, BTREE_BENCH_NODES, avl_ns, btree_ns);
+
+	avl_unit_free_val(v);
+}
+
+void trav_tree_1m(void)
+{
+	struct btree_node *bnode;
+	unsigned long ntrav = 0;
+
+	for (bnode = btree_first(&btree_1m); bnode;
+	     bnode = btree_next(bnode, &btree_1m)) {
+		CU_ASSERT_EQUAL(bnode->key, ntrav * 3);
+		ntrav++;
+	}
+	CU_ASSERT_EQUAL(ntrav, BTREE_BENCH_NODES);
+}
+
+void deletes_tree_1m(void)
+{
+	unsigned long ix;
+
+	/* Every other one, then check, then the rest */
+	for (ix = 0; ix < BTREE_BENCH_NODES; ix += 2) {
+		avltree_remove(&bench_vals[ix].node_k, &avl_tree_1m);
+		btree_remove(&bench_vals[ix].node_b, &btree_1m);
+	}
+
+	for (ix = 0; ix < BTREE_BENCH_NODES; ++ix)
+		CU_ASSERT((btree_lookup(bench_vals[ix].key, &btree_1m) ==
+			   NULL) == !(ix & 1));
+
+	for (ix = 1; ix < BTREE_BENCH_NODES; ix += 2) {
+		avltree_remove(&bench_vals[ix].node_k, &avl_tree_1m);
+		btree_remove(&bench_vals[ix].node_b, &btree_1m);
+	}
+
+	CU_ASSERT_EQUAL(avltree_size(&avl_tree_1m), 0);
+	CU_ASSERT_EQUAL(btree_size(&btree_1m), 0);
+	CU_ASSERT(btree_first(&btree_1m) == NULL);
+}
+
 /* The main() function for setting up and running the tests.
  * Returns a CUE_SUCCESS on successful running, another
  * CUnit error code on failure.
@@ -923,6 +1077,18 @@ int main(int argc, char *argv[])
 		CU_TEST_INFO_NULL,
 	};
 
+	CU_TestInfo btree_unit_1m_arr[] = {
+		{"Tree insertions 1M.", inserts_tree_1m}
+		,
+		{"Tree lookups 1M, against AVL.", lookups_tree_1m}
+		,
+		{"Tree traverse 1M.", trav_tree_1m}
+		,
+		{"Tree deletes 1M.", deletes_tree_1m}
+		,
+		CU_TEST_INFO_NULL,
+	};
+
 	CU_SuiteInfo suites[] = {
 		{"Avl operations 1", init_suite1, clean_suite1,
 		 avl_tree_unit_1_arr}
@@ -945,6 +1111,9 @@ int main(int argc, char *argv[])
 		{"Check supremum", init_supremum, clean_supremum,
 		 avl_tree_unit_supremum}
 		,
+		{"B+tree operations 1M", init_suite1m, clean_suite1m,
+		 btree_unit_1m_arr}
+		,
 		CU_SUITE_INFO_NULL,
 	};
 
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "CUnit/Basic.h"
 
@@ -14,11 +15,15 @@
 
 /* STATICS  we use across multiple tests */
 struct avltree avl_tree_1;
+struct btree btree_1;
+
+#define BTREE_BENCH_NAMES (1024 * 1024)
 
 /* dirent-like structure */
 typedef struct avl_unit_val {
 	struct avltree_node node_n;
 	struct avltree_node node_hk;
+	struct btree_node node_b;	/* keyed by hk.k too */
 	struct {
 		uint64_t k;
 		uint32_t p;	/* nprobes , eff. metric */
@@ -260,6 +265,21 @@ int clean_suite1(void)
 	return 0;
 }
 
+int init_suite3(void)
+{
+	avltree_init(&avl_tree_1, avl_unit_hk_cmpf, 0 /* flags */);
+	btree_init(&btree_1);
+
+	return 0;
+}
+
+int clean_suite3(void)
+{
+	btree_destroy(&btree_1);
+
+	return clean_suite1();
+}
+
 /*
  *  END SUITE INITIALIZATION and CLEANUP FUNCTIONS
  */
@@ -379,6 +399,100 @@ void deletes_tree_2(void)
 	avl_unit_clear_tree(&avl_tree_1);
 }
 
+/*
+ * The hash keys of 1M dirent names, in a B+tree and an AVL tree.
+ * Only the tree lookups are timed, the names are hashed beforehand.
+ */
+
+void inserts_tree_3(void)
+{
+	avl_unit_val_t *v;
+	char s[256];
+	int ix;
+
+	for (ix = 0; ix < BTREE_BENCH_NAMES; ++ix) {
+		sprintf(s, "file%d", ix);
+		v = avl_unit_new_val(gsh_strdup(s));
+		if (qp_avl_insert(&avl_tree_1, v) == -1)
+			abort();
+		/* probed to a key unique in the AVL tree, so in this one */
+		v->node_b.key = v->hk.k;
+		CU_ASSERT(btree_insert(&v->node_b, &btree_1) == NULL);
+	}
+
+	CU_ASSERT_EQUAL(btree_size(&btree_1), avltree_size(&avl_tree_1));
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void lookups_tree_3(void)
+{
+	uint64_t *keys = malloc(BTREE_BENCH_NAMES * sizeof(uint64_t));
+	avl_unit_val_t *v, *v2;
+	struct avltree_node *node;
+	struct btree_node *bnode;
+	double start, avl_ns, btree_ns;
+	unsigned long avl_hits = 0, btree_hits = 0;
+	char s[256];
+	int ix;
+
+	/* The keys the names were stored under, in another order */
+	v = avl_unit_new_val(s);
+	for (ix = 0; ix < BTREE_BENCH_NAMES; ++ix) {
+		sprintf(s, "file%d", (int)((ix * 40503UL) %
+					   BTREE_BENCH_NAMES));
+		v2 = qp_avl_lookup_s(&avl_tree_1, v, 1);
+		if (!v2)
+			abort();
+		keys[ix] = v2->hk.k;
+	}
+
+	start = bench_now();
+	for (ix = 0; ix < BTREE_BENCH_NAMES; ++ix) {
+		v->hk.k = keys[ix];
+		node = avltree_inline_lookup(&v->node_hk, &avl_tree_1);
+		avl_hits += node != NULL;
+	}
+	avl_ns = (bench_now() - start) / BTREE_BENCH_NAMES;
+
+	start = bench_now();
+	for (ix = 0; ix < BTREE_BENCH_NAMES; ++ix) {
+		bnode = btree_lookup(keys[ix], &btree_1);
+		if (bnode) {
+			v2 = btree_container_of(bnode, avl_unit_val_t,
+						node_b);
+			btree_hits += v2->hk.k == keys[ix];
+		}
+	}
+	btree_ns = (bench_now() - start) / BTREE_BENCH_NAMES;
+
+	CU_ASSERT_EQUAL(avl_hits, BTREE_BENCH_NAMES);
+	CU_ASSERT_EQUAL(btree_hits, BTREE_BENCH_NAMES);
+
+	printf("\n%d hash key lookups: avl %.1f ns, btree %.1f ns\n",
+	       BTREE_BENCH_NAMES, avl_ns, btree_ns);
+
+	avl_unit_free_val(v);
+	free(keys);
+}
+
+void deletes_tree_3(void)
+{
+	struct btree_node *bnode;
+
+	/* The AVL tree is cleared with the suite */
+	while ((bnode = btree_first(&btree_1)) != NULL)
+		btree_remove(bnode, &btree_1);
+
+	CU_ASSERT_EQUAL(btree_size(&btree_1), 0);
+}
+
 /* The main() function for setting up and running the tests.
  * Returns a CUE_SUCCESS on successful running, another
  * CUnit error code on failure.
@@ -410,10 +524,23 @@ int main(int argc, char *argv[])
 		CU_TEST_INFO_NULL,
 	};
 
+	CU_TestInfo btree_unit_3_arr[] = {
+		{"Tree insertions 1M.", inserts_tree_3}
+		,
+		{"Tree lookups 1M, against AVL.", lookups_tree_3}
+		,
+		{"Tree deletes 1M.", deletes_tree_3}
+		,
+		CU_TEST_INFO_NULL,
+	};
+
 	CU_SuiteInfo suites[] = {
 		{"Rb tree operations 1", init_suite1, clean_suite1,
 		 avl_tree_unit_1_arr}
 		,
+		{"B+tree on hash keys 1M", init_suite3, clean_suite3,
+		 btree_unit_3_arr}
+		,
 		CU_SUITE_INFO_NULL,
 	};
 
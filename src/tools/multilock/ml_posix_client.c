@@ -25,16 +25,21 @@
 
 #include <pthread.h>
 #include <assert.h>
+#include <stdint.h>
+#include <sys/wait.h>
 #include "multilock.h"
 #include "../../include/gsh_list.h"
 
 /* command line syntax */
 
-char options[] = "c:qdx:s:n:p:h?";
+char options[] = "c:qdx:s:n:p:b:l:B:N:t:r:T:h?";
 char usage[] =
 	"Usage: ml_posix_client -s server -p port -n name [-q] [-d] [-c path]\n"
 	"       ml_posix_client -x script [-q] [-d] [-c path]\n"
-	"       ml_posix_client [-q] [-d] [-c path]\n" "\n"
+	"       ml_posix_client [-q] [-d] [-c path]\n"
+	"       ml_posix_client -b file [-l locks] [-c path]\n"
+	"       ml_posix_client -B file [-N clients] [-t threads] [-r percent]\n"
+	"                       [-T seconds] [-c path]\n" "\n"
 	"  ml_posix_client may be run in three modes\n"
 	"  - In the first mode, the client will be driven by a master.\n"
 	"  - In the second mode, the client is driven by a script.\n"
@@ -45,7 +50,14 @@ char usage[] =
 	"  -x script - specify the name of a script to execute\n"
 	"  -q        - specify quiet mode\n"
 	"  -d        - specify dup errors mode (errors are sent to stdout and stderr)\n"
-	"  -c path   - chdir\n";
+	"  -c path   - chdir\n"
+	"  -b file   - benchmark byte range locks on file and exit\n"
+	"  -l locks  - number of locks held by the benchmark (default 10000)\n"
+	"  -B file   - benchmark lock contention on file and exit\n"
+	"  -N clients - client processes of the contention benchmark (default 1)\n"
+	"  -t threads - threads per client (default 4)\n"
+	"  -r percent - share of locks in the range all threads lock (default 10)\n"
+	"  -T seconds - length of the contention benchmark (default 10)\n";
 
 #define NUM_WORKER 4
 #define POLL_DELAY 10
@@ -1102,6 +1114,385 @@ void *worker(void *t_type)
 	}
 }
 
+static double bench_elapsed(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void bench_report(const char *phase, long int ops, double secs)
+{
+	fprintf(output, "%-8s %10ld ops %10.3f s %12.0f ops/s\n",
+		phase, ops, secs, secs > 0 ? ops / secs : 0.0);
+}
+
+/**
+ * @brief Time byte range lock operations on a file holding many locks
+ *
+ * Takes count disjoint write locks, tests a range between each pair,
+ * then releases them in reverse order, reporting the rate of each
+ * phase.  With a server that walks the whole lock list of a file for
+ * each request, each phase slows down as the number of locks grows.
+ *
+ * @param[in] path  File to lock
+ * @param[in] count Number of locks to hold
+ */
+void do_bench(const char *path, long int count)
+{
+	struct timespec start;
+	struct flock lock;
+	long int i;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT, 0666);
+
+	if (fd == -1)
+		fatal("Could not open %s errno = %d \"%s\"\n",
+		      path, errno, strerror(errno));
+
+	/* Every other byte, so the server can not merge the locks */
+	lock.l_whence = SEEK_SET;
+	lock.l_len = 1;
+	lock.l_pid = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < count; i++) {
+		lock.l_type = F_WRLCK;
+		lock.l_start = i * 2;
+
+		if (fcntl(fd, F_SETLK, &lock) == -1)
+			fatal("Lock %ld failed errno = %d \"%s\"\n",
+			      i, errno, strerror(errno));
+	}
+
+	bench_report("LOCK", count, bench_elapsed(&start));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < count; i++) {
+		lock.l_type = F_WRLCK;
+		lock.l_start = i * 2 + 1;
+
+		if (fcntl(fd, F_GETLK, &lock) == -1)
+			fatal("Test %ld failed errno = %d \"%s\"\n",
+			      i, errno, strerror(errno));
+	}
+
+	bench_report("TEST", count, bench_elapsed(&start));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = count - 1; i >= 0; i--) {
+		lock.l_type = F_UNLCK;
+		lock.l_start = i * 2;
+		lock.l_len = 1;
+
+		if (fcntl(fd, F_SETLK, &lock) == -1)
+			fatal("Unlock %ld failed errno = %d \"%s\"\n",
+			      i, errno, strerror(errno));
+	}
+
+	bench_report("UNLOCK", count, bench_elapsed(&start));
+
+	close(fd);
+}
+
+/* Contention benchmark: every thread locks and unlocks random ranges,
+ * mostly in a slice of the file of its own, sometimes in a small range
+ * every thread locks.
+ */
+#define CONTEND_MAXLEN 64
+#define CONTEND_SHARED (CONTEND_MAXLEN * 4)
+#define CONTEND_SLICE (1024 * 1024)
+
+struct contend_thread {
+	pthread_t thread;
+	const char *path;
+	long int id;
+	int shared_pct;
+	struct timespec start;
+	struct timespec stop;
+	uint64_t *lat;		/* Grant latency in ns << 1 | shared */
+	size_t count;
+	size_t size;
+};
+
+static bool ts_before(struct timespec *a, struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec ||
+	       (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static uint64_t ts_diff_ns(struct timespec *a, struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1000000000ULL +
+	       b->tv_nsec - a->tv_nsec;
+}
+
+static void *contend_worker(void *arg)
+{
+	struct contend_thread *ct = arg;
+	unsigned int seed = (getpid() << 16) ^ ct->id;
+	struct timespec before, after;
+	struct flock lock;
+	bool shared;
+	int fd;
+
+	/* An open file description of its own makes it its own lock owner */
+	fd = open(ct->path, O_RDWR | O_CREAT, 0666);
+
+	if (fd == -1)
+		fatal("Could not open %s errno = %d \"%s\"\n",
+		      ct->path, errno, strerror(errno));
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ct->start, NULL);
+
+	while (true) {
+		clock_gettime(CLOCK_MONOTONIC, &before);
+
+		if (!ts_before(&before, &ct->stop))
+			break;
+
+		shared = rand_r(&seed) % 100 < ct->shared_pct;
+		lock.l_whence = SEEK_SET;
+		lock.l_len = 1 + rand_r(&seed) % CONTEND_MAXLEN;
+		lock.l_pid = 0;
+
+		if (shared) {
+			lock.l_type = F_WRLCK;
+			lock.l_start = rand_r(&seed) %
+				       (CONTEND_SHARED - lock.l_len + 1);
+		} else {
+			lock.l_type = rand_r(&seed) % 2 ? F_WRLCK : F_RDLCK;
+			lock.l_start = CONTEND_SHARED +
+				       ct->id * CONTEND_SLICE +
+				       rand_r(&seed) %
+				       (CONTEND_SLICE - lock.l_len + 1);
+		}
+
+		if (fcntl(fd, F_OFD_SETLKW, &lock) == -1)
+			fatal("Lock failed errno = %d \"%s\"\n",
+			      errno, strerror(errno));
+
+		clock_gettime(CLOCK_MONOTONIC, &after);
+
+		if (ct->count == ct->size) {
+			ct->size = ct->size ? ct->size * 2 : 4096;
+			ct->lat = realloc(ct->lat, ct->size * sizeof(*ct->lat));
+			if (ct->lat == NULL)
+				fatal("Out of memory\n");
+		}
+
+		ct->lat[ct->count++] = ts_diff_ns(&before, &after) << 1 | shared;
+
+		lock.l_type = F_UNLCK;
+
+		if (fcntl(fd, F_OFD_SETLK, &lock) == -1)
+			fatal("Unlock failed errno = %d \"%s\"\n",
+			      errno, strerror(errno));
+	}
+
+	close(fd);
+	return NULL;
+}
+
+/* Run the threads of one client and send the parent their samples */
+static void contend_client(struct contend_thread *ct, long int threads,
+			   int pipefd)
+{
+	ssize_t len;
+	size_t done;
+	long int i;
+	int rc;
+
+	for (i = 0; i < threads; i++) {
+		rc = pthread_create(&ct[i].thread, NULL, contend_worker, &ct[i]);
+		if (rc != 0)
+			fatal("pthread_create failed %s\n", strerror(rc));
+	}
+
+	for (i = 0; i < threads; i++) {
+		pthread_join(ct[i].thread, NULL);
+
+		for (done = 0; done < sizeof(ct[i].count); done += len) {
+			len = write(pipefd, (char *)&ct[i].count + done,
+				    sizeof(ct[i].count) - done);
+			if (len <= 0)
+				fatal("Write to parent failed\n");
+		}
+
+		for (done = 0; done < ct[i].count * sizeof(*ct[i].lat);
+		     done += len) {
+			len = write(pipefd, (char *)ct[i].lat + done,
+				    ct[i].count * sizeof(*ct[i].lat) - done);
+			if (len <= 0)
+				fatal("Write to parent failed\n");
+		}
+	}
+
+	close(pipefd);
+	_exit(0);
+}
+
+static void read_all(int fd, void *buf, size_t size)
+{
+	ssize_t len;
+	size_t done;
+
+	for (done = 0; done < size; done += len) {
+		len = read(fd, (char *)buf + done, size - done);
+		if (len <= 0)
+			fatal("A client failed\n");
+	}
+}
+
+static int cmp_lat(const void *a, const void *b)
+{
+	uint64_t la = *(const uint64_t *)a >> 1;
+	uint64_t lb = *(const uint64_t *)b >> 1;
+
+	return la < lb ? -1 : la > lb;
+}
+
+static void contend_report(const char *which, uint64_t *lat, size_t count,
+			   double secs)
+{
+	if (count == 0) {
+		fprintf(output, "%-8s %10d\n", which, 0);
+		return;
+	}
+
+	/* In us, from the sorted ns << 1 */
+#define PCT(p) ((lat[(size_t)((count - 1) * (p))] >> 1) / 1000.0)
+	fprintf(output,
+		"%-8s %10zu %10.0f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		which, count, count / secs, PCT(0.5), PCT(0.9), PCT(0.99),
+		PCT(0.999), PCT(1.0));
+#undef PCT
+}
+
+/**
+ * @brief Measure byte range lock grants with many lock owners contending
+ *
+ * Forks clients processes of threads threads each.  Each thread, with
+ * an open file description of its own, takes and releases blocking
+ * locks of random ranges for secs seconds: shared_pct percent of them
+ * write locks within a range every thread locks, the others read or
+ * write locks in a slice of the file of its own.  Reports the lock
+ * rate and the percentiles of the time to grant, overall and for each
+ * kind of lock.
+ *
+ * @param[in] path       File to lock
+ * @param[in] clients    Client processes
+ * @param[in] threads    Threads per client
+ * @param[in] shared_pct Share of locks taken in the shared range
+ * @param[in] secs       Length of the run
+ */
+void do_contend(const char *path, long int clients, long int threads,
+		int shared_pct, long int secs)
+{
+	struct contend_thread *ct;
+	struct timespec start, stop;
+	uint64_t *lat = NULL, *split;
+	size_t count = 0, n, nshared, s, i;
+	int (*pipes)[2];
+	long int c, t;
+	pid_t pid;
+
+	ct = calloc(threads, sizeof(*ct));
+	pipes = calloc(clients, sizeof(*pipes));
+	if (ct == NULL || pipes == NULL)
+		fatal("Out of memory\n");
+
+	/* Give every client time to start */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	start.tv_sec += 1;
+	stop = start;
+	stop.tv_sec += secs;
+
+	for (c = 0; c < clients; c++) {
+		if (pipe(pipes[c]) == -1)
+			fatal("pipe failed errno = %d \"%s\"\n",
+			      errno, strerror(errno));
+
+		for (t = 0; t < threads; t++) {
+			ct[t].path = path;
+			ct[t].id = c * threads + t;
+			ct[t].shared_pct = shared_pct;
+			ct[t].start = start;
+			ct[t].stop = stop;
+		}
+
+		pid = fork();
+		if (pid == -1)
+			fatal("fork failed errno = %d \"%s\"\n",
+			      errno, strerror(errno));
+
+		if (pid == 0) {
+			close(pipes[c][0]);
+			contend_client(ct, threads, pipes[c][1]);
+		}
+
+		close(pipes[c][1]);
+	}
+
+	for (c = 0; c < clients; c++) {
+		for (t = 0; t < threads; t++) {
+			read_all(pipes[c][0], &n, sizeof(n));
+			lat = realloc(lat, (count + n) * sizeof(*lat));
+			if (lat == NULL && count + n != 0)
+				fatal("Out of memory\n");
+			read_all(pipes[c][0], lat + count, n * sizeof(*lat));
+			count += n;
+		}
+
+		close(pipes[c][0]);
+	}
+
+	while (wait(NULL) > 0)
+		;
+
+	qsort(lat, count, sizeof(*lat), cmp_lat);
+
+	fprintf(output,
+		"%ld clients x %ld threads, %d%% shared, %ld s\n"
+		"%-8s %10s %10s %10s %10s %10s %10s %10s\n",
+		clients, threads, shared_pct, secs,
+		"locks", "count", "locks/s", "p50 us", "p90 us", "p99 us",
+		"p99.9 us", "max us");
+
+	contend_report("ALL", lat, count, secs);
+
+	/* Split in place, keeping each side sorted */
+	for (i = 0, nshared = 0; i < count; i++)
+		if (lat[i] & 1)
+			nshared++;
+
+	split = malloc((count + 1) * sizeof(*split));
+	if (split == NULL)
+		fatal("Out of memory\n");
+
+	for (i = 0, s = 0, n = nshared; i < count; i++) {
+		if (lat[i] & 1)
+			split[s++] = lat[i];
+		else
+			split[n++] = lat[i];
+	}
+
+	contend_report("SHARED", split, nshared, secs);
+	contend_report("PRIVATE", split + nshared, count - nshared, secs);
+
+	free(split);
+	free(lat);
+	free(pipes);
+	free(ct);
+}
+
 int main(int argc, char **argv)
 {
 	int opt;
@@ -1110,6 +1501,13 @@ int main(int argc, char **argv)
 	char *rest;
 	int oflags = 0;
 	int no_tag;
+	char *bench = NULL;
+	long int bench_locks = 10000;
+	char *contend = NULL;
+	long int contend_clients = 1;
+	long int contend_threads = 4;
+	long int contend_pct = 10;
+	long int contend_secs = 10;
 
 	/* Init the lists of work for each fno */
 	for (i = 0; i <= MAXFPOS; i++)
@@ -1205,6 +1603,52 @@ int main(int argc, char **argv)
 			port = atoi(optarg);
 			break;
 
+		case 'b':
+			if (oflags != 0)
+				show_usage(1,
+					   "Can not combine -b and -s/-p/-n/-x\n");
+
+			bench = optarg;
+			break;
+
+		case 'l':
+			bench_locks = atol(optarg);
+			if (bench_locks <= 0)
+				show_usage(1, "Invalid number of locks\n");
+			break;
+
+		case 'B':
+			if (oflags != 0)
+				show_usage(1,
+					   "Can not combine -B and -s/-p/-n/-x\n");
+
+			contend = optarg;
+			break;
+
+		case 'N':
+			contend_clients = atol(optarg);
+			if (contend_clients <= 0)
+				show_usage(1, "Invalid number of clients\n");
+			break;
+
+		case 't':
+			contend_threads = atol(optarg);
+			if (contend_threads <= 0)
+				show_usage(1, "Invalid number of threads\n");
+			break;
+
+		case 'r':
+			contend_pct = atol(optarg);
+			if (contend_pct < 0 || contend_pct > 100)
+				show_usage(1, "Invalid percentage\n");
+			break;
+
+		case 'T':
+			contend_secs = atol(optarg);
+			if (contend_secs <= 0)
+				show_usage(1, "Invalid number of seconds\n");
+			break;
+
 		case '?':
 		case 'h':
 		default:
@@ -1213,6 +1657,23 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (bench != NULL) {
+		if (oflags != 0)
+			show_usage(1, "Can not combine -b and -s/-p/-n/-x\n");
+
+		do_bench(bench, bench_locks);
+		exit(0);
+	}
+
+	if (contend != NULL) {
+		if (oflags != 0)
+			show_usage(1, "Can not combine -B and -s/-p/-n/-x\n");
+
+		do_contend(contend, contend_clients, contend_threads,
+			   contend_pct, contend_secs);
+		exit(0);
+	}
+
 	if (oflags > 0 && oflags < 7)
 		show_usage(1, "Must specify -s, -p, and -n together\n");
 
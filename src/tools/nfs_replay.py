@@ -0,0 +1,500 @@
+#!/usr/bin/python
+#
+# nfs_replay.py - replay the RPC calls of a packet capture against a server
+#
+# Copyright (C) 2017 The nfs-ganesha contributors
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Reads the RPC calls sent over TCP to the given ports from a pcap file,
+# for instance one taken on a production server with
+#
+#   tcpdump -s 0 -w trace.pcap port 2049
+#
+# and sends them again to a server, each client connection of the trace
+# on a connection of its own, at the pace they were captured at divided
+# by --speed (0 sends as fast as --window allows).  --clients replays
+# every connection of the trace that many times at once.  Prints then
+# the count, errors and latency distribution of every operation, NFSv4
+# COMPOUNDs by their first operation after SEQUENCE and PUTFH.
+#
+# The calls go as they were captured, credentials and file handles
+# included, only the XIDs change.  So the target must have the same
+# exports with the same handles as the traced server (a restored
+# snapshot, or the server itself), it must trust the traced client
+# addresses' AUTH_SYS credentials, and RPCSEC_GSS calls are not worth
+# replaying.  NFSv4.1 traces only replay well when they include the
+# EXCHANGE_ID and CREATE_SESSION of their clients, which then get
+# NFS4ERR_CLID_INUSE or a new session the later calls don't use: expect
+# errors, they are counted apart.
+#
+# Usage: nfs_replay.py [options] trace.pcap [server]
+#
+# Without a server, only lists the calls found in the trace.
+
+import json
+import socket
+import struct
+import sys
+import threading
+import time
+from optparse import OptionParser
+
+NFS_PROGRAM = 100003
+MOUNT_PROGRAM = 100005
+
+NFS3_PROCS = [
+    "NULL", "GETATTR", "SETATTR", "LOOKUP", "ACCESS", "READLINK", "READ",
+    "WRITE", "CREATE", "MKDIR", "SYMLINK", "MKNOD", "REMOVE", "RMDIR",
+    "RENAME", "LINK", "READDIR", "READDIRPLUS", "FSSTAT", "FSINFO",
+    "PATHCONF", "COMMIT"]
+
+MOUNT3_PROCS = ["NULL", "MNT", "DUMP", "UMNT", "UMNTALL", "EXPORT"]
+
+NFS4_OPS = {
+    3: "ACCESS", 4: "CLOSE", 5: "COMMIT", 6: "CREATE", 7: "DELEGPURGE",
+    8: "DELEGRETURN", 9: "GETATTR", 10: "GETFH", 11: "LINK", 12: "LOCK",
+    13: "LOCKT", 14: "LOCKU", 15: "LOOKUP", 16: "LOOKUPP", 17: "NVERIFY",
+    18: "OPEN", 19: "OPENATTR", 20: "OPEN_CONFIRM", 21: "OPEN_DOWNGRADE",
+    22: "PUTFH", 23: "PUTPUBFH", 24: "PUTROOTFH", 25: "READ",
+    26: "READDIR", 27: "READLINK", 28: "REMOVE", 29: "RENAME", 30: "RENEW",
+    31: "RESTOREFH", 32: "SAVEFH", 33: "SECINFO", 34: "SETATTR",
+    35: "SETCLIENTID", 36: "SETCLIENTID_CONFIRM", 37: "VERIFY",
+    38: "WRITE", 39: "RELEASE_LOCKOWNER", 40: "BACKCHANNEL_CTL",
+    41: "BIND_CONN_TO_SESSION", 42: "EXCHANGE_ID", 43: "CREATE_SESSION",
+    44: "DESTROY_SESSION", 45: "FREE_STATEID", 46: "GET_DIR_DELEGATION",
+    47: "GETDEVICEINFO", 48: "GETDEVICELIST", 49: "LAYOUTCOMMIT",
+    50: "LAYOUTGET", 51: "LAYOUTRETURN", 52: "SECINFO_NO_NAME",
+    53: "SEQUENCE", 54: "SET_SSV", 55: "TEST_STATEID", 56: "WANT_DELEGATION",
+    57: "DESTROY_CLIENTID", 58: "RECLAIM_COMPLETE"}
+
+OP_SEQUENCE = 53
+OP_PUTFH = 22
+SEQUENCE_ARGS = 32      # sessionid, sequenceid, slotid, highest slotid, cache
+
+
+def pad4(n):
+    return (n + 3) & ~3
+
+
+def u32(buf, off):
+    return struct.unpack_from(">I", buf, off)[0]
+
+
+class Call(object):
+    __slots__ = ("ts", "record", "label")
+
+    def __init__(self, ts, record, label):
+        self.ts = ts
+        self.record = record
+        self.label = label
+
+
+def compound_label(buf, off):
+    """First operation of a COMPOUND that is neither SEQUENCE nor a PUTFH"""
+    off += 4 + pad4(u32(buf, off))          # tag
+    off += 4                                # minorversion
+    numops = u32(buf, off)
+    off += 4
+    op = None
+    for _ in range(numops):
+        op = u32(buf, off)
+        off += 4
+        if op == OP_SEQUENCE:
+            off += SEQUENCE_ARGS
+        elif op == OP_PUTFH:
+            off += 4 + pad4(u32(buf, off))
+        elif op not in (23, 24):
+            break
+    return "COMPOUND" if op is None else NFS4_OPS.get(op, "OP%d" % op)
+
+
+def call_label(buf):
+    """Name of the procedure of an RPC call, None if it is not a call"""
+    if len(buf) < 40 or u32(buf, 4) != 0:
+        return None
+    prog, vers, proc = struct.unpack_from(">III", buf, 12)
+    off = 24
+    off += 8 + pad4(u32(buf, off + 4))      # credential
+    off += 8 + pad4(u32(buf, off + 4))      # verifier
+    try:
+        if prog == NFS_PROGRAM and vers == 3 and proc < len(NFS3_PROCS):
+            return NFS3_PROCS[proc]
+        if prog == NFS_PROGRAM and vers == 4:
+            return "NULL" if proc == 0 else compound_label(buf, off)
+        if prog == MOUNT_PROGRAM and proc < len(MOUNT3_PROCS):
+            return "MOUNT_" + MOUNT3_PROCS[proc]
+    except struct.error:
+        pass
+    return "%d.%d.%d" % (prog, vers, proc)
+
+
+class Stream(object):
+    """One direction of a TCP connection, to the server"""
+
+    def __init__(self, dport):
+        self.dport = dport
+        self.next_seq = None
+        self.pending = {}       # out of order segments by sequence number
+        self.data = bytearray()
+        self.record = bytearray()
+        self.calls = []
+
+    def segment(self, ts, seq, payload):
+        if self.next_seq is None:
+            self.next_seq = seq
+        if seq != self.next_seq:
+            if ((seq - self.next_seq) & 0xffffffff) < 0x80000000:
+                self.pending[seq] = payload
+                return
+            # retransmission, keep what is past what we have
+            skip = (self.next_seq - seq) & 0xffffffff
+            if skip >= len(payload):
+                return
+            payload = payload[skip:]
+        self.append(ts, payload)
+        while self.next_seq in self.pending:
+            self.append(ts, self.pending.pop(self.next_seq))
+
+    def append(self, ts, payload):
+        self.next_seq = (self.next_seq + len(payload)) & 0xffffffff
+        self.data += payload
+        while len(self.data) >= 4:
+            mark = u32(self.data, 0)
+            size = mark & 0x7fffffff
+            if len(self.data) < 4 + size:
+                break
+            self.record += self.data[4:4 + size]
+            del self.data[:4 + size]
+            if mark & 0x80000000:
+                record = bytes(self.record)
+                self.record = bytearray()
+                label = call_label(record)
+                if label is not None:
+                    self.calls.append(Call(ts, record, label))
+
+
+def read_pcap(path, ports):
+    """Streams to the ports found in a pcap file, in the order they start"""
+    f = open(path, "rb")
+    header = f.read(24)
+    if len(header) < 24:
+        sys.exit("%s: not a pcap file" % path)
+    magic = struct.unpack("<I", header[:4])[0]
+    if magic in (0xa1b2c3d4, 0xa1b23c4d):
+        endian = "<"
+    elif magic in (0xd4c3b2a1, 0x4d3cb2a1):
+        endian = ">"
+    else:
+        sys.exit("%s: not a pcap file (pcapng is not read, convert it "
+                 "with editcap -F pcap)" % path)
+    nano = magic in (0xa1b23c4d, 0x4d3cb2a1)
+    linktype = struct.unpack(endian + "I", header[20:24])[0]
+
+    streams = {}
+    order = []
+    while True:
+        rec = f.read(16)
+        if len(rec) < 16:
+            break
+        sec, frac, incl, _ = struct.unpack(endian + "IIII", rec)
+        pkt = f.read(incl)
+        ts = sec + frac / (1e9 if nano else 1e6)
+
+        ip = link_payload(linktype, pkt)
+        if ip is None:
+            continue
+        seg = tcp_segment(ip)
+        if seg is None:
+            continue
+        src, dst, sport, dport, seq, payload = seg
+        if dport not in ports or not payload:
+            continue
+        key = (src, sport, dst, dport)
+        stream = streams.get(key)
+        if stream is None:
+            stream = streams[key] = Stream(dport)
+            order.append(stream)
+        stream.segment(ts, seq, payload)
+
+    f.close()
+    return [s for s in order if s.calls]
+
+
+def link_payload(linktype, pkt):
+    """The IP packet of a frame"""
+    if linktype == 1:                       # Ethernet
+        off = 12
+        ethertype = struct.unpack_from(">H", pkt, off)[0]
+        while ethertype in (0x8100, 0x88a8):
+            off += 4
+            ethertype = struct.unpack_from(">H", pkt, off)[0]
+        off += 2
+    elif linktype == 113:                   # Linux cooked
+        ethertype = struct.unpack_from(">H", pkt, 14)[0]
+        off = 16
+    elif linktype == 276:                   # Linux cooked v2
+        ethertype = struct.unpack_from(">H", pkt, 0)[0]
+        off = 20
+    elif linktype in (12, 101):             # raw IP
+        return pkt
+    elif linktype == 0:                     # BSD loopback
+        return pkt[4:]
+    else:
+        return None
+    if ethertype not in (0x0800, 0x86dd):
+        return None
+    return pkt[off:]
+
+
+def tcp_segment(ip):
+    if len(ip) < 20:
+        return None
+    version = ord(ip[0:1]) >> 4
+    if version == 4:
+        ihl = (ord(ip[0:1]) & 0xf) * 4
+        total = struct.unpack_from(">H", ip, 2)[0]
+        if ord(ip[9:10]) != 6:
+            return None
+        src, dst = ip[12:16], ip[16:20]
+        tcp = ip[ihl:total]
+    elif version == 6:
+        if len(ip) < 40 or ord(ip[6:7]) != 6:
+            return None
+        total = 40 + struct.unpack_from(">H", ip, 4)[0]
+        src, dst = ip[8:24], ip[24:40]
+        tcp = ip[40:total]
+    else:
+        return None
+    if len(tcp) < 20:
+        return None
+    sport, dport, seq = struct.unpack_from(">HHI", tcp, 0)
+    doff = (ord(tcp[12:13]) >> 4) * 4
+    return src, dst, sport, dport, seq, tcp[doff:]
+
+
+class Stats(object):
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.lat = {}           # label -> latencies in us
+        self.errors = {}        # label -> calls not answered NFS_OK
+        self.lost = 0
+
+    def add(self, label, us, ok):
+        with self.lock:
+            self.lat.setdefault(label, []).append(us)
+            if not ok:
+                self.errors[label] = self.errors.get(label, 0) + 1
+
+
+def reply_ok(buf):
+    """Accepted, successful and, but for NULL, a zero status"""
+    if len(buf) < 24 or u32(buf, 4) != 1 or u32(buf, 8) != 0:
+        return False
+    off = 12 + 8 + pad4(u32(buf, 16))       # verifier
+    if len(buf) < off + 4 or u32(buf, off) != 0:
+        return False
+    off += 4
+    return len(buf) == off or u32(buf, off) == 0
+
+
+class Replayer(object):
+    """Replays one stream over a connection of its own"""
+
+    def __init__(self, stream, server, opts, stats, t0, start, xid_base):
+        self.stream = stream
+        self.opts = opts
+        self.stats = stats
+        self.t0 = t0
+        self.start = start
+        self.xid = xid_base
+        self.inflight = {}      # xid -> (label, send time)
+        self.lock = threading.Lock()
+        self.window = threading.Semaphore(opts.window)
+        self.done = threading.Event()
+        self.sock = socket.create_connection((server, stream.dport))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    def send(self):
+        for call in self.stream.calls:
+            if self.opts.speed > 0:
+                due = self.start + (call.ts - self.t0) / self.opts.speed
+                delay = due - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+            self.window.acquire()
+            self.xid = (self.xid + 1) & 0xffffffff
+            record = struct.pack(">I", self.xid) + call.record[4:]
+            with self.lock:
+                self.inflight[self.xid] = (call.label, time.time())
+            self.sock.sendall(struct.pack(">I", 0x80000000 | len(record)) +
+                              record)
+
+    def receive(self):
+        data = bytearray()
+        record = bytearray()
+        while True:
+            try:
+                chunk = self.sock.recv(65536)
+            except socket.error:
+                break
+            if not chunk:
+                break
+            data += chunk
+            while len(data) >= 4:
+                mark = u32(data, 0)
+                size = mark & 0x7fffffff
+                if len(data) < 4 + size:
+                    break
+                record += data[4:4 + size]
+                del data[:4 + size]
+                if mark & 0x80000000:
+                    self.reply(bytes(record))
+                    record = bytearray()
+        self.done.set()
+
+    def reply(self, buf):
+        now = time.time()
+        with self.lock:
+            sent = self.inflight.pop(u32(buf, 0), None)
+        if sent is None:
+            return
+        self.stats.add(sent[0], (now - sent[1]) * 1e6, reply_ok(buf))
+        self.window.release()
+
+    def finish(self, timeout):
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            with self.lock:
+                if not self.inflight:
+                    break
+            if self.done.wait(0.05):
+                break
+        with self.lock:
+            self.stats.lost += len(self.inflight)
+        try:
+            self.sock.shutdown(socket.SHUT_RDWR)
+        except socket.error:
+            pass
+        self.sock.close()
+
+
+def percentile(values, p):
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def report(stats, elapsed, as_json):
+    rows = []
+    for label in sorted(stats.lat, key=lambda l: -len(stats.lat[l])):
+        lat = sorted(stats.lat[label])
+        rows.append({"op": label, "count": len(lat),
+                     "errors": stats.errors.get(label, 0),
+                     "mean": sum(lat) / len(lat),
+                     "p50": percentile(lat, 50), "p90": percentile(lat, 90),
+                     "p99": percentile(lat, 99), "max": lat[-1]})
+    total = sum(r["count"] for r in rows)
+
+    if as_json:
+        print(json.dumps({"elapsed": elapsed, "calls": total,
+                          "lost": stats.lost, "ops": rows}))
+        return
+
+    print("%d calls in %.1f s, %.0f/s, %d unanswered" % (
+        total, elapsed, total / elapsed if elapsed else 0, stats.lost))
+    print("%-20s %8s %7s %10s %10s %10s %10s %10s" % (
+        "op", "count", "errors", "mean us", "p50", "p90", "p99", "max"))
+    for r in rows:
+        print("%-20s %8d %7d %10.1f %10.1f %10.1f %10.1f %10.1f" % (
+            r["op"], r["count"], r["errors"], r["mean"], r["p50"], r["p90"],
+            r["p99"], r["max"]))
+
+
+def list_calls(streams):
+    counts = {}
+    for s in streams:
+        for c in s.calls:
+            counts[c.label] = counts.get(c.label, 0) + 1
+    first = min(s.calls[0].ts for s in streams)
+    last = max(s.calls[-1].ts for s in streams)
+    print("%d connections, %d calls over %.1f s" % (
+        len(streams), sum(counts.values()), last - first))
+    for label in sorted(counts, key=lambda l: -counts[l]):
+        print("  %-20s %8d" % (label, counts[label]))
+
+
+def main():
+    parser = OptionParser(usage="%prog [options] trace.pcap [server]")
+    parser.add_option("--ports", default="2049",
+                      help="comma separated server ports of the calls to "
+                      "replay, 2049 by default; a mountd port adds the "
+                      "MOUNT calls")
+    parser.add_option("--speed", type="float", default=1.0,
+                      help="replay that many times faster than captured, "
+                      "0 for as fast as possible")
+    parser.add_option("--clients", type="int", default=1,
+                      help="connections replaying every traced connection")
+    parser.add_option("--window", type="int", default=64,
+                      help="calls in flight per connection at most")
+    parser.add_option("--timeout", type="float", default=30.0,
+                      help="seconds to wait for the last replies")
+    parser.add_option("--json", action="store_true", default=False,
+                      help="report as one JSON object")
+    opts, args = parser.parse_args()
+    if len(args) not in (1, 2):
+        parser.error("a pcap file is needed")
+    if opts.clients < 1 or opts.window < 1 or opts.speed < 0:
+        parser.error("--clients and --window must be positive, --speed "
+                     "not negative")
+
+    ports = set(int(p) for p in opts.ports.split(","))
+    streams = read_pcap(args[0], ports)
+    if not streams:
+        sys.exit("no RPC call to ports %s in %s" % (opts.ports, args[0]))
+
+    if len(args) == 1:
+        list_calls(streams)
+        return
+
+    stats = Stats()
+    t0 = min(s.calls[0].ts for s in streams)
+    start = time.time() + (0.1 if opts.speed > 0 else 0)
+    replayers = []
+    for copy in range(opts.clients):
+        for i, s in enumerate(streams):
+            xid_base = ((copy * len(streams) + i) * 0x10000) & 0xffffffff
+            replayers.append(Replayer(s, args[1], opts, stats, t0, start,
+                                      xid_base))
+
+    threads = []
+    for r in replayers:
+        for target in (r.receive, r.send):
+            t = threading.Thread(target=target)
+            t.daemon = True
+            t.start()
+            threads.append((r, t, target == r.send))
+
+    for r, t, sender in threads:
+        if sender:
+            t.join()
+    for r in replayers:
+        r.finish(opts.timeout)
+    for r, t, sender in threads:
+        if not sender:
+            t.join()
+
+    report(stats, time.time() - start, opts.json)
+
+
+if __name__ == "__main__":
+    main()
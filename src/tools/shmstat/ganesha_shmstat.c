@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2017 The nfs-ganesha contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ---------------------------------------
+ */
+
+/**
+ * @file ganesha_shmstat.c
+ * @brief Print the counters ganesha publishes in shared memory
+ *
+ * Usage: ganesha_shmstat [-n NAME] [-e] [-c] [-v] [-H] [-i SECS]
+ *
+ * Maps the segment named by Stats_Shm_Name read-only and prints the
+ * totals of the server by protocol; -e and -c add those of each
+ * export and client, -v the named counters and -H the percentiles of
+ * the histograms.  With -i, prints the requests per second of each
+ * protocol every SECS seconds instead.  The server is never asked for
+ * anything, see include/gsh_stats_shm.h.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "gsh_stats_shm.h"
+
+static const char * const proto_name[GSH_STATS_SHM_PROTOS] = {
+	[GSH_STATS_SHM_NFSV3] = "NFSv3",
+	[GSH_STATS_SHM_NFSV40] = "NFSv4.0",
+	[GSH_STATS_SHM_NFSV41] = "NFSv4.1",
+	[GSH_STATS_SHM_NFSV42] = "NFSv4.2",
+	[GSH_STATS_SHM_NLM4] = "NLMv4",
+	[GSH_STATS_SHM_MNT] = "MNT",
+	[GSH_STATS_SHM_RQUOTA] = "RQUOTA",
+	[GSH_STATS_SHM_9P] = "9P",
+};
+
+struct segment {
+	const char *name;
+	void *map;
+	size_t mapped;
+	char *copy;	/*< Consistent copy of the segment */
+	size_t size;
+};
+
+static const struct gsh_stats_shm_header *header(struct segment *seg)
+{
+	return (const struct gsh_stats_shm_header *) seg->copy;
+}
+
+static int seg_map(struct segment *seg)
+{
+	struct stat st;
+	int fd;
+
+	fd = shm_open(seg->name, O_RDONLY, 0);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", seg->name, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &st) != 0 ||
+	    st.st_size < (off_t) sizeof(struct gsh_stats_shm_header)) {
+		fprintf(stderr, "%s: not a stats segment\n", seg->name);
+		close(fd);
+		return -1;
+	}
+
+	if (seg->map != NULL)
+		munmap(seg->map, seg->mapped);
+	seg->mapped = st.st_size;
+	seg->map = mmap(NULL, seg->mapped, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg->map == MAP_FAILED) {
+		seg->map = NULL;
+		fprintf(stderr, "%s: %s\n", seg->name, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Copy the segment as the server last published it
+ *
+ * @return 0, or -1 if it is not or no longer a segment of a server.
+ */
+static int seg_read(struct segment *seg)
+{
+	const struct gsh_stats_shm_header *hdr;
+	uint64_t seq, size;
+	unsigned int tries;
+
+	if (seg->map == NULL && seg_map(seg) != 0)
+		return -1;
+
+	for (tries = 0; ; tries++) {
+		hdr = seg->map;
+		seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			usleep(tries < 100 ? 100 : 10000);
+			continue;
+		}
+
+		if (hdr->magic != GSH_STATS_SHM_MAGIC) {
+			fprintf(stderr, "%s: no server is publishing in it\n",
+				seg->name);
+			return -1;
+		}
+		if (hdr->version != GSH_STATS_SHM_VERSION) {
+			fprintf(stderr, "%s: version %u, this reader knows %u\n",
+				seg->name, hdr->version,
+				GSH_STATS_SHM_VERSION);
+			return -1;
+		}
+
+		size = hdr->size;
+		if (size > seg->mapped) {
+			/* A server restarted with more room */
+			if (seg_map(seg) != 0)
+				return -1;
+			continue;
+		}
+
+		if (size > seg->size) {
+			free(seg->copy);
+			seg->copy = malloc(size);
+			if (seg->copy == NULL) {
+				fprintf(stderr, "out of memory\n");
+				return -1;
+			}
+			seg->size = size;
+		}
+
+		memcpy(seg->copy, seg->map, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == seq)
+			return 0;
+	}
+}
+
+static const void *section(struct segment *seg,
+			   enum gsh_stats_shm_section_id id,
+			   uint32_t *count, uint32_t *size)
+{
+	const struct gsh_stats_shm_section *sect =
+		&header(seg)->section[id];
+
+	*count = sect->count;
+	*size = sect->size;
+	return seg->copy + sect->offset;
+}
+
+static void print_op(const char *label, const struct gsh_stats_shm_op *op)
+{
+	printf("  %-8s %12" PRIu64 " req %10" PRIu64 " err %8" PRIu64
+	       " dup %10.3f ms avg %10.3f ms max\n",
+	       label, op->total, op->errors, op->dups,
+	       op->total ? op->latency_ns / 1e6 / op->total : 0.0,
+	       op->max_ns / 1e6);
+}
+
+static void print_io(const char *label, const char *dir,
+		     const struct gsh_stats_shm_io *io)
+{
+	if (io->op.total == 0)
+		return;
+
+	printf("  %-8s %12" PRIu64 " %-5s %14" PRIu64 " bytes %10.3f ms avg\n",
+	       label, io->op.total, dir, io->transferred,
+	       io->op.latency_ns / 1e6 / io->op.total);
+}
+
+static void print_counters(const struct gsh_stats_shm_counters *c)
+{
+	int i;
+
+	for (i = 0; i < GSH_STATS_SHM_PROTOS; i++) {
+		if (c->proto[i].total == 0)
+			continue;
+		print_op(proto_name[i], &c->proto[i]);
+		print_io(proto_name[i], "reads", &c->read[i]);
+		print_io(proto_name[i], "writes", &c->write[i]);
+	}
+}
+
+static void print_hist(const struct gsh_stats_shm_hist *hist,
+		       uint32_t buckets)
+{
+	/* in thousandths */
+	static const uint64_t pct[] = { 500, 900, 990, 999 };
+	uint64_t value[4] = { 0 };
+	uint64_t total = 0, seen = 0;
+	unsigned int i, j = 0;
+
+	for (i = 0; i < buckets; i++)
+		total += hist->bucket[i];
+	if (total == 0)
+		return;
+
+	for (i = 0; i < buckets && j < 4; i++) {
+		seen += hist->bucket[i];
+		while (j < 4 && seen * 1000 >= total * pct[j])
+			value[j++] = gsh_stats_shm_bucket_value(i);
+	}
+
+	printf("  %-36s %10" PRIu64 " p50 %9.3f p90 %9.3f p99 %9.3f"
+	       " p99.9 %9.3f max %9.3f ms\n",
+	       hist->name, hist->count, value[0] / 1e6, value[1] / 1e6,
+	       value[2] / 1e6, value[3] / 1e6, hist->max_ns / 1e6);
+}
+
+static void print_dropped(struct segment *seg,
+			  enum gsh_stats_shm_section_id id, const char *what)
+{
+	uint32_t dropped = header(seg)->section[id].dropped;
+
+	if (dropped != 0)
+		printf("  (%u %s left out, no room in the segment)\n",
+		       dropped, what);
+}
+
+static void print_all(struct segment *seg, int exports, int clients,
+		      int values, int hists)
+{
+	const struct gsh_stats_shm_header *hdr = header(seg);
+	const char *rec;
+	uint32_t count, size, i;
+	time_t updated = hdr->updated_ns / 1000000000;
+
+	printf("ganesha pid %u, updated %s", hdr->pid, ctime(&updated));
+
+	rec = section(seg, GSH_STATS_SHM_GLOBAL, &count, &size);
+	printf("Server:\n");
+	if (count != 0)
+		print_counters((const struct gsh_stats_shm_counters *) rec);
+
+	if (exports) {
+		rec = section(seg, GSH_STATS_SHM_EXPORTS, &count, &size);
+		for (i = 0; i < count; i++, rec += size) {
+			const struct gsh_stats_shm_export *e =
+				(const struct gsh_stats_shm_export *) rec;
+
+			printf("Export %u %s:\n", e->export_id, e->path);
+			print_counters(&e->c);
+		}
+		print_dropped(seg, GSH_STATS_SHM_EXPORTS, "exports");
+	}
+
+	if (clients) {
+		rec = section(seg, GSH_STATS_SHM_CLIENTS, &count, &size);
+		for (i = 0; i < count; i++, rec += size) {
+			const struct gsh_stats_shm_client *c =
+				(const struct gsh_stats_shm_client *) rec;
+
+			printf("Client %s:\n", c->addr);
+			print_counters(&c->c);
+		}
+		print_dropped(seg, GSH_STATS_SHM_CLIENTS, "clients");
+	}
+
+	if (values) {
+		printf("Counters:\n");
+		rec = section(seg, GSH_STATS_SHM_VALUES, &count, &size);
+		for (i = 0; i < count; i++, rec += size) {
+			const struct gsh_stats_shm_value *v =
+				(const struct gsh_stats_shm_value *) rec;
+
+			printf("  %-40s %20" PRIu64 "\n", v->name, v->value);
+		}
+		print_dropped(seg, GSH_STATS_SHM_VALUES, "counters");
+	}
+
+	if (hists) {
+		printf("Latencies:\n");
+		rec = section(seg, GSH_STATS_SHM_HISTS, &count, &size);
+		for (i = 0; i < count; i++, rec += size)
+			print_hist((const struct gsh_stats_shm_hist *) rec,
+				   hdr->hist_buckets);
+		print_dropped(seg, GSH_STATS_SHM_HISTS, "histograms");
+	}
+}
+
+/* Requests per second of each protocol, every interval seconds */
+static int print_rates(struct segment *seg, unsigned int interval)
+{
+	uint64_t prev[GSH_STATS_SHM_PROTOS], prev_ns = 0, seq = 0;
+	const struct gsh_stats_shm_counters *c;
+	uint32_t count, size;
+	double secs;
+	int i;
+
+	memset(prev, 0, sizeof(prev));
+
+	printf("%10s", "time");
+	for (i = 0; i < GSH_STATS_SHM_PROTOS; i++)
+		printf(" %10s", proto_name[i]);
+	printf("\n");
+
+	for (;;) {
+		if (seg_read(seg) != 0)
+			return 1;
+
+		c = section(seg, GSH_STATS_SHM_GLOBAL, &count, &size);
+		if (count != 0 && header(seg)->seq != seq) {
+			secs = (header(seg)->updated_ns - prev_ns) / 1e9;
+			if (prev_ns != 0 && secs > 0) {
+				time_t now = header(seg)->updated_ns /
+					     1000000000;
+				char stamp[16];
+
+				strftime(stamp, sizeof(stamp), "%H:%M:%S",
+					 localtime(&now));
+				printf("%10s", stamp);
+				for (i = 0; i < GSH_STATS_SHM_PROTOS; i++)
+					printf(" %10.0f",
+					       (c->proto[i].total - prev[i]) /
+					       secs);
+				printf("\n");
+				fflush(stdout);
+			}
+			for (i = 0; i < GSH_STATS_SHM_PROTOS; i++)
+				prev[i] = c->proto[i].total;
+			prev_ns = header(seg)->updated_ns;
+			seq = header(seg)->seq;
+		}
+
+		sleep(interval);
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-n NAME] [-e] [-c] [-v] [-H] [-i SECS]\n"
+		"  -n NAME  segment, Stats_Shm_Name [/ganesha-stats]\n"
+		"  -e       each export\n"
+		"  -c       each client\n"
+		"  -v       named counters (cache, DRC, ops)\n"
+		"  -H       latency percentiles\n"
+		"  -i SECS  requests per second, every SECS seconds\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct segment seg = { .name = "/ganesha-stats" };
+	int exports = 0, clients = 0, values = 0, hists = 0;
+	unsigned int interval = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:ecvHi:")) != -1) {
+		switch (opt) {
+		case 'n':
+			seg.name = optarg;
+			break;
+		case 'e':
+			exports = 1;
+			break;
+		case 'c':
+			clients = 1;
+			break;
+		case 'v':
+			values = 1;
+			break;
+		case 'H':
+			hists = 1;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			if (interval == 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	if (interval != 0)
+		return print_rates(&seg, interval);
+
+	if (seg_read(&seg) != 0)
+		return 1;
+
+	print_all(&seg, exports, clients, values, hists);
+
+	return 0;
+}